@@ -66,6 +66,8 @@ extern __thread char	*record;	/* points to $0 */
 extern __thread int	lineno;		/* line number in awk program */
 extern __thread int	errorflag;	/* 1 if error has occurred */
 extern __thread int	donefld;	/* 1 if record broken into fields */
+extern __thread int	fldlimit;	/* highest $n in the program, ALLFLDS if $expr or NF */
+#define	ALLFLDS	INT_MAX
 extern __thread int	donerec;	/* 1 if record is valid (no fld has changed */
 extern __thread char	inputFS[];	/* FS at time of input, for field splitting */
 
@@ -83,13 +85,19 @@ typedef struct Cell {
 	char	*sval;		/* string value */
 	Awkfloat fval;		/* value as number */
 	int	 tval;		/* type info: STR|NUM|ARR|FCN|FLD|CON|DONTFREE */
+	unsigned int chash;	/* hash of nval, in symbol tables */
+	unsigned int cfmt;	/* the format of a CONV sval, 0 if integral */
 	struct Cell *cnext;	/* ptr to next if chained */
 } Cell;
 
 typedef struct Array {		/* symbol table array */
 	int	nelem;		/* elements in table right now */
-	int	size;		/* size of tab */
-	Cell	**tab;		/* hash table pointers */
+	int	size;		/* size of tab, a power of 2 */
+	int	nused;		/* slots of tab ever filled since it was made */
+	Cell	**tab;		/* open addressing: NULL is a free slot */
+	Cell	**otab;		/* the previous tab, while rehash() empties it */
+	int	osize;
+	int	omoved;		/* otab[0..omoved-1] are in tab now */
 } Array;
 
 #define	NSYMTAB	50	/* initial size of a symbol table */
@@ -110,6 +118,7 @@ extern __thread Cell	*rlengthloc;	/* RLENGTH */
 #define	FCN	040	/* this is a function name */
 #define FLD	0100	/* this is a field $1, $2, ... */
 #define	REC	0200	/* this is $0 */
+#define	CONV	0400	/* sval is fval converted, see get_str_val */
 
 
 /* function types */
@@ -136,6 +145,7 @@ typedef struct Node {
 	int	lineno;
 	int	nobj;
 	int nnarg; 
+	Cell	*(*nproc)(struct Node **, int);	/* proctab entry for nobj */
 	struct	Node *narg[1];	/* variable: actual size set by calling malloc */
 } Node;
 
@@ -199,7 +209,7 @@ extern	__thread int	pairstack[], paircnt;
 #define istemp(n)	((n)->csub == CTEMP)
 #define	isargument(n)	((n)->nobj == ARG)
 /* #define freeable(p)	(!((p)->tval & DONTFREE)) */
-#define freeable(p)	( ((p)->tval & (STR|DONTFREE)) == STR )
+#define freeable(p)	( ((p)->tval & (STR|CONV)) != 0 && ((p)->tval & DONTFREE) == 0 )
 
 /* structures used by regular expression matching machinery, mostly b.c: */
 
@@ -218,12 +228,19 @@ typedef struct rrow {
 } rrow;
 
 typedef struct fa {
-	uschar	gototab[NSTATES][NCHARS];
+	Node	nonode;		/* all 0: freeTree() meets fa's in the program tree */
+	uschar	*gototab;	/* [NSTATES][nclass]: next state, 0 if not known yet */
+	int	nclass;		/* chars that no leaf tells apart share a class */
+	unsigned short	cclass[NCHARS+3];	/* class of each char, and of HAT */
+	int	firstc;		/* every match starts with this char, or 0 */
 	uschar	out[NSTATES];
 	uschar	*restr;
 	int	*posns[NSTATES];
 	int	anchor;
-	int	use;
+	unsigned int hash;	/* of restr and anchor, for makedfa() */
+	struct	fa *hnext;	/* next in the same hash chain */
+	struct	fa *newer;	/* makedfa()'s LRU list */
+	struct	fa *older;
 	int	initstat;
 	int	curstat;
 	int	accept;
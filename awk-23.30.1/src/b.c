@@ -81,15 +81,73 @@ static	__thread int poscnt;
 __thread char	*patbeg;
 __thread int	patlen;
 
-#define	NFA	20	/* cache this many dynamic fa's */
-static __thread fa	*fatab[NFA];
-static __thread int	nfatab	= 0;	/* entries in fatab */
+/*
+ * Dynamic regular expressions ($0 ~ pat[i]) are compiled once and kept
+ * in a hash table, NFA of them or $AWK_REGEX_CACHE, evicting the least
+ * recently used.  Never fewer than NFAMIN: sub() and gsub() keep their
+ * fa while they evaluate the replacement, which may compile others.
+ */
+#define	NFA	64
+#define	NFAMIN	20
+static __thread fa	**fahash;	/* chains of fa with the same hash */
+static __thread unsigned int	nfahash;	/* size of fahash, a power of 2 */
+static __thread fa	*fanewest;	/* LRU list, most recently used first */
+static __thread fa	*faoldest;
+static __thread int	nfatab	= 0;	/* entries in fahash */
+static __thread int	nfamax;
+static __thread unsigned long	fahits, famisses, facompiles;
+
+static unsigned int fahashof(const char *s, int anchor)
+{
+	unsigned int h = 2166136261U ^ anchor;	/* FNV-1a */
+
+	for (; *s; s++)
+		h = (h ^ (uschar) *s) * 16777619U;
+	return h;
+}
+
+static void faunlink(fa *f)	/* take f off the LRU list */
+{
+	if (f->newer)
+		f->newer->older = f->older;
+	else
+		fanewest = f->older;
+	if (f->older)
+		f->older->newer = f->newer;
+	else
+		faoldest = f->newer;
+}
+
+static void fafront(fa *f)	/* make f the most recently used */
+{
+	f->newer = NULL;
+	f->older = fanewest;
+	if (fanewest)
+		fanewest->newer = f;
+	else
+		faoldest = f;
+	fanewest = f;
+}
+
+static void fainit(void)
+{
+	char *p;
+
+	nfamax = NFA;
+	if ((p = getenv("AWK_REGEX_CACHE")) != NULL && *p != '\0')
+		nfamax = atoi(p);
+	if (nfamax < NFAMIN)
+		nfamax = NFAMIN;
+	for (nfahash = 16; nfahash < (unsigned int) nfamax && nfahash < 1U << 20; nfahash <<= 1)
+		;
+	if ((fahash = (fa **) calloc(nfahash, sizeof(fa *))) == NULL)
+		overflo("out of space initializing makedfa");
+}
 
 fa *makedfa(const char *s, int anchor)	/* returns dfa for reg expr s */
 {
-	int i, use, nuse;
-	fa *pfa;
-	static __thread int now = 1;
+	unsigned int h;
+	fa *pfa, **pp;
 
 	if (setvec == 0) {	/* first time through any RE */
 		maxsetvec = MAXLIN;
@@ -101,30 +159,139 @@ fa *makedfa(const char *s, int anchor)	/* returns dfa for reg expr s */
 
 	if (compile_time)	/* a constant for sure */
 		return mkdfa(s, anchor);
-	for (i = 0; i < nfatab; i++)	/* is it there already? */
-		if (fatab[i]->anchor == anchor
-		  && strcmp((const char *) fatab[i]->restr, s) == 0) {
-			fatab[i]->use = now++;
-			return fatab[i];
+	if (fahash == NULL)
+		fainit();
+	h = fahashof(s, anchor);
+	for (pfa = fahash[h & (nfahash-1)]; pfa != NULL; pfa = pfa->hnext)
+		if (pfa->hash == h && pfa->anchor == anchor
+		  && strcmp((const char *) pfa->restr, s) == 0) {	/* it's there already */
+			fahits++;
+			if (pfa != fanewest) {
+				faunlink(pfa);
+				fafront(pfa);
+			}
+			return pfa;
 		}
+	famisses++;
+	if (nfatab >= nfamax) {	/* replace least-recently used */
+		pfa = faoldest;
+		faunlink(pfa);
+		for (pp = &fahash[pfa->hash & (nfahash-1)]; *pp != pfa; pp = &(*pp)->hnext)
+			;
+		*pp = pfa->hnext;
+		freefa(pfa);
+		nfatab--;
+	}
 	pfa = mkdfa(s, anchor);
-	if (nfatab < NFA) {	/* room for another */
-		fatab[nfatab] = pfa;
-		fatab[nfatab]->use = now++;
-		nfatab++;
-		return pfa;
+	pfa->hash = h;
+	pfa->hnext = fahash[h & (nfahash-1)];
+	fahash[h & (nfahash-1)] = pfa;
+	fafront(pfa);
+	nfatab++;
+	return pfa;
+}
+
+void freefatab(void)	/* at the end of the program */
+{
+	fa *f, *older;
+
+	if (dbg)
+		fprintf(thread_stderr, "regex cache: %lu hits, %lu misses, "
+		    "%lu compiles, %d of %d kept\n",
+		    fahits, famisses, facompiles, nfatab, nfamax);
+	for (f = fanewest; f != NULL; f = older) {
+		older = f->older;
+		freefa(f);
+	}
+	xfree(fahash);
+	fanewest = faoldest = NULL;
+	nfatab = nfahash = 0;
+	fahits = famisses = facompiles = 0;
+}
+
+#define	GOTO(f, s, c)	(f)->gototab[(s) * (f)->nclass + (f)->cclass[c]]
+#define	NEAGER	64	/* fill in the whole table for up to this many leaves */
+
+static int leafmatch(rrow *r, int c)	/* does leaf r let c through? */
+{
+	switch (r->ltype) {
+	case CHAR:	return c == ptoi(r->lval.np);
+	case DOT:	return c != 0 && c != HAT;
+	case ALL:	return c != 0;
+	case EMPTYRE:	return c != 0;
+	case CCL:	return member(c, (char *) r->lval.up);
+	case NCCL:	return !member(c, (char *) r->lval.up) && c != 0 && c != HAT;
 	}
-	use = fatab[0]->use;	/* replace least-recently used */
-	nuse = 0;
-	for (i = 1; i < nfatab; i++)
-		if (fatab[i]->use < use) {
-			use = fatab[i]->use;
-			nuse = i;
+	return 0;	/* FINAL */
+}
+
+/*
+ * Sort the chars (and HAT) into classes that every leaf treats alike,
+ * refining them one leaf at a time, so that gototab has a column per
+ * class rather than per char.
+ */
+static void mkclasses(fa *f)
+{
+	int c, i, k, n, split[2 * (NCHARS+1)];
+
+	/*
+	 * HAT starts in a class of its own: the leading ALL leaf lets it
+	 * through like any char, but makeinit() keeps the state reached on
+	 * HAT without position 0, and real chars must not share its cell.
+	 */
+	for (c = 0; c <= HAT; c++)
+		f->cclass[c] = 0;
+	f->cclass[HAT] = 1;
+	f->nclass = 2;
+	for (i = 0; i <= f->accept; i++) {
+		for (c = 0; c < 2 * f->nclass; c++)
+			split[c] = -1;
+		n = 0;
+		for (c = 0; c <= HAT; c++) {
+			if (c >= NCHARS && c != HAT)
+				continue;
+			k = 2 * f->cclass[c] + leafmatch(&f->re[i], c);
+			if (split[k] < 0)
+				split[k] = n++;
+			f->cclass[c] = split[k];
 		}
-	freefa(fatab[nuse]);
-	fatab[nuse] = pfa;
-	pfa->use = now++;
-	return pfa;
+		f->nclass = n;
+	}
+	if ((f->gototab = (uschar *) calloc(NSTATES, f->nclass)) == NULL)
+		overflo("out of space for fa");
+}
+
+/*
+ * The whole table for a small dfa, so that matching never stops in
+ * cgoto(), as long as its states fit.  HAT only follows the start.
+ */
+static void mkgotos(fa *f)
+{
+	int s, c, k, done[NCHARS+1];
+
+	for (k = 0; k < f->nclass; k++)
+		done[k] = 0;
+	for (s = 1; s <= f->curstat; s++) {
+		for (c = 0; c < 256; c++) {
+			if (done[k = f->cclass[c]] == s)
+				continue;	/* this class is filled in */
+			done[k] = s;
+			if (GOTO(f, s, c) != 0)
+				continue;
+			if (f->curstat >= NSTATES-2)
+				return;	/* would start replacing states */
+			cgoto(f, s, c);
+		}
+	}
+}
+
+static int firstchar(Node *p)	/* the char every match of p starts with */
+{
+	while (type(p) == CAT || type(p) == PLUS)
+		p = left(p);
+	if (type(p) == CHAR && ptoi(right(p)) != HAT)
+		return ptoi(right(p));	/* 0 for $ */
+	return 0;
 }
 
 fa *mkdfa(const char *s, int anchor)	/* does the real work of making a dfa */
@@ -132,7 +299,9 @@ fa *mkdfa(const char *s, int anchor)	/* does the real work of making a dfa */
 {
 	Node *p, *p1;
 	fa *f;
+	int c;
 
+	facompiles++;
 	firstbasestr = (char *)s;
 	basestr = firstbasestr;
 	if (replogfile==0) {
@@ -141,6 +310,7 @@ fa *mkdfa(const char *s, int anchor)	/* does the real work of making a dfa */
 		*/
 	}
 	p = reparse(s);
+	c = firstchar(p);
 	p1 = op2(CAT, op2(STAR, op2(ALL, NIL, NIL), NIL), p);
 		/* put ALL STAR in front of reg.  exp. */
 	p1 = op2(CAT, p1, op2(FINAL, NIL, NIL));
@@ -153,6 +323,8 @@ fa *mkdfa(const char *s, int anchor)	/* does the real work of making a dfa */
 	f->accept = poscnt-1;	/* penter has computed number of positions in re */
 	cfoll(f, p1);	/* set up follow sets */
 	freetr(p1);
+	mkclasses(f);
+	f->firstc = c;
 	if ((f->posns[0] = (int *) calloc(1, *(f->re[0].lfollow)*sizeof(int))) == NULL)
 			overflo("out of space in makedfa");
 	if ((f->posns[1] = (int *) calloc(1, sizeof(int))) == NULL)
@@ -160,6 +332,8 @@ fa *mkdfa(const char *s, int anchor)	/* does the real work of making a dfa */
 	*f->posns[1] = 0;
 	f->initstat = makeinit(f, anchor);
 	f->anchor = anchor;
+	if (f->accept <= NEAGER)
+		mkgotos(f);
 	f->restr = (uschar *) tostring(s);
 	if (replogfile) {
 		fflush(replogfile);
@@ -188,8 +362,7 @@ int makeinit(fa *f, int anchor)
 	}
 	if ((f->posns[2])[1] == f->accept)
 		f->out[2] = 1;
-	for (i=0; i < NCHARS; i++)
-		f->gototab[2][i] = 0;
+	memset(&f->gototab[2 * f->nclass], 0, f->nclass);
 	f->curstat = cgoto(f, 2, HAT);
 	if (anchor) {
 		*f->posns[2] = k-1;	/* leave out position 0 */
@@ -501,8 +674,12 @@ int smatch(fa *f, const char *p0)    /* shortest match ? */
     if (f->out[s])
         return(1);
     do {
+        /* nothing happens in the start state until the first char of a match */
+        if (s == f->initstat && f->firstc != 0 && !f->anchor && !f->reset
+          && *p != f->firstc && (p = (uschar *) strchr((char *) p, f->firstc)) == NULL)
+            return(0);
         /* assert(*p < NCHARS); */
-        if ((ns = f->gototab[s][*p]) != 0)
+        if ((ns = GOTO(f, s, *p)) != 0)
             s = ns;
         else
             s = cgoto(f, s, *p);
@@ -528,12 +705,15 @@ int pmatch(fa *f, const char *p0)	/* longest match, for sub */
 	patbeg = (char *) p;
 	patlen = -1;
 	do {
+		if (f->firstc != 0 && !f->reset && *p != f->firstc
+		  && (p = (uschar *) strchr((char *) p, f->firstc)) == NULL)
+			return (0);	/* no match can start before it */
 		q = p;
 		do {
 			if (f->out[s])		/* final state */
 				patlen = q-p;
 			/* assert(*q < NCHARS); */
-			if ((ns = f->gototab[s][*q]) != 0)
+			if ((ns = GOTO(f, s, *q)) != 0)
 				s = ns;
 			else
 				s = cgoto(f, s, *q);
@@ -564,8 +744,7 @@ int pmatch(fa *f, const char *p0)	/* longest match, for sub */
 				(f->posns[2])[i] = (f->posns[0])[i];
 			f->initstat = f->curstat = 2;
 			f->out[2] = f->out[0];
-			for (i = 0; i < NCHARS; i++)
-				f->gototab[2][i] = 0;
+			memset(&f->gototab[2 * f->nclass], 0, f->nclass);
 		}
 	} while (*p++ != 0);
 	return (0);
@@ -586,12 +765,15 @@ int nematch(fa *f, const char *p0)	/* non-empty match, for sub */
 	}
 	patlen = -1;
 	while (*p) {
+		if (f->firstc != 0 && !f->reset && *p != f->firstc
+		  && (p = (uschar *) strchr((char *) p, f->firstc)) == NULL)
+			return (0);	/* no match can start before it */
 		q = p;
 		do {
 			if (f->out[s])		/* final state */
 				patlen = q-p;
 			/* assert(*q < NCHARS); */
-			if ((ns = f->gototab[s][*q]) != 0)
+			if ((ns = GOTO(f, s, *q)) != 0)
 				s = ns;
 			else
 				s = cgoto(f, s, *q);
@@ -621,8 +803,7 @@ int nematch(fa *f, const char *p0)	/* non-empty match, for sub */
 				(f->posns[2])[i] = (f->posns[0])[i];
 			f->initstat = f->curstat = 2;
 			f->out[2] = f->out[0];
-			for (i = 0; i < NCHARS; i++)
-				f->gototab[2][i] = 0;
+			memset(&f->gototab[2 * f->nclass], 0, f->nclass);
 		}
 		p++;
 	}
@@ -1182,13 +1363,8 @@ int cgoto(fa *f, int s, int c)
 	/* compute positions of gototab[s,c] into setvec */
 	p = f->posns[s];
 	for (i = 1; i <= *p; i++) {
-		if ((k = f->re[p[i]].ltype) != FINAL) {
-			if ((k == CHAR && c == ptoi(f->re[p[i]].lval.np))
-			 || (k == DOT && c != 0 && c != HAT)
-			 || (k == ALL && c != 0)
-			 || (k == EMPTYRE && c != 0)
-			 || (k == CCL && member(c, (char *) f->re[p[i]].lval.up))
-			 || (k == NCCL && !member(c, (char *) f->re[p[i]].lval.up) && c != 0 && c != HAT)) {
+		if (f->re[p[i]].ltype != FINAL) {
+			if (leafmatch(&f->re[p[i]], c)) {
 				q = f->re[p[i]].lfollow;
 				for (j = 1; j <= *q; j++) {
 					if (q[j] >= maxsetvec) {
@@ -1222,7 +1398,7 @@ int cgoto(fa *f, int s, int c)
 			if (tmpset[j] != p[j])
 				goto different;
 		/* setvec is state i */
-		f->gototab[s][c] = i;
+		GOTO(f, s, c) = i;
 		return i;
 	  different:;
 	}
@@ -1235,14 +1411,13 @@ int cgoto(fa *f, int s, int c)
 			xfree(f->posns[i]);
 	} else
 		++(f->curstat);
-	for (i = 0; i < NCHARS; i++)
-		f->gototab[f->curstat][i] = 0;
+	memset(&f->gototab[f->curstat * f->nclass], 0, f->nclass);
 	xfree(f->posns[f->curstat]);
 	if ((p = (int *) calloc(1, (setcnt+1)*sizeof(int))) == NULL)
 		overflo("out of space in cgoto");
 
 	f->posns[f->curstat] = p;
-	f->gototab[s][c] = f->curstat;
+	GOTO(f, s, c) = f->curstat;
 	for (i = 0; i <= setcnt; i++)
 		p[i] = tmpset[i];
 	if (setvec[f->accept])
@@ -1267,5 +1442,6 @@ void freefa(fa *f)	/* free a finite automaton */
 			xfree((f->re[i].lval.np));
 	}
 	xfree(f->restr);
+	xfree(f->gototab);
 	xfree(f);
 }
@@ -26,6 +26,7 @@ THIS SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include "awk.h"
 #include "ytab.h"
 #include "ios_error.h"
@@ -166,8 +167,8 @@ int gettok(char **pbuf, int *psz)	/* get next input token */
 int	word(char *);
 int	string(void);
 int	regexpr(void);
-int	sc	= 0;	/* 1 => return a } right now */
-int	reg	= 0;	/* 1 => return a REGEXPR now */
+__thread int	sc	= 0;	/* 1 => return a } right now */
+__thread int	reg	= 0;	/* 1 => return a REGEXPR now */
 
 int yylex(void)
 {
@@ -304,6 +305,13 @@ int yylex(void)
 		case '$':
 			/* BUG: awkward, if not wrong */
 			c = gettok(&buf, &bufsize);
+			/* $3: fldbld() need not split further; $i: it must */
+			if (c == '0' && strlen(buf) < 9 &&
+			    strspn(buf, "0123456789") == strlen(buf)) {
+				if (atoi(buf) > fldlimit)
+					fldlimit = atoi(buf);
+			} else
+				fldlimit = ALLFLDS;
 			if (isalpha(c)) {
 				if (strcmp(buf, "NF") == 0) {	/* very special */
 					unputstr("(NF)");
@@ -480,6 +488,7 @@ int word(char *w)
 				SYNTAX( "return not in function" );
 			RET(kp->type);
 		case VARNF:
+			fldlimit = ALLFLDS;
 			yylval.cp = setsymtab("NF", "", 0.0, NUM, symtab);
 			RET(VARNF);
 		default:
@@ -539,10 +548,10 @@ int regexpr(void)
 
 /* low-level lexical stuff, sort of inherited from lex */
 
-char	ebuf[300];
-char	*ep = ebuf;
-static char	yysbuf[100];	/* pushback buffer */
-static char	*yysptr = yysbuf;
+__thread char	ebuf[300];
+__thread char	*ep;		/* in ebuf, once input() has started */
+static __thread char	yysbuf[100];	/* pushback buffer */
+static __thread char	*yysptr;
 __thread FILE	*yyin = 0;
 
 int input(void)	/* get next lexical input character */
@@ -550,6 +559,8 @@ int input(void)	/* get next lexical input character */
 	int c;
 	extern __thread char *lexprog;
 
+	if (yysptr == NULL)
+		yysptr = yysbuf;
 	if (yysptr > yysbuf)
 		c = (uschar)*--yysptr;
 	else if (lexprog != NULL) {	/* awk '...' */
@@ -561,7 +572,7 @@ int input(void)	/* get next lexical input character */
 		lineno++;
 	else if (c == EOF)
 		c = 0;
-	if (ep >= ebuf + sizeof ebuf)
+	if (ep == NULL || ep >= ebuf + sizeof ebuf)
 		ep = ebuf;
 	return *ep++ = c;
 }
@@ -570,10 +581,12 @@ void unput(int c)	/* put lexical character back on input */
 {
 	if (c == '\n')
 		lineno--;
+	if (yysptr == NULL)
+		yysptr = yysbuf;
 	if (yysptr >= yysbuf + sizeof(yysbuf))
 		FATAL("pushed back too much: %.20s...", yysbuf);
 	*yysptr++ = c;
-	if (--ep < ebuf)
+	if (ep == NULL || --ep < ebuf)
 		ep = ebuf + sizeof(ebuf) - 1;
 }
 
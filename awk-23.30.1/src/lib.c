@@ -29,6 +29,7 @@ THIS SOFTWARE.
 #include <errno.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
 #include "awk.h"
 #include "ytab.h"
 #include "ios_error.h"
@@ -47,10 +48,15 @@ __thread char	inputFS[100] = " ";
 __thread int	nfields	= MAXFLD;	/* last allocated slot for $i */
 
 __thread int	donefld;	/* 1 = implies rec broken into fields */
+__thread int	fldlimit;	/* split no further than $fldlimit */
+static __thread int	fldpartial;	/* 1 = fields past $fldlimit not split yet */
+static __thread char	fldFS[100];	/* inputFS when they were not */
 __thread int	donerec;	/* 1 = record is valid (no flds have changed) */
 
 __thread int	lastfld	= 0;	/* last used field */
 __thread int	argno	= 1;	/* current input argument number */
+__thread off_t	rangestart = 0;	/* awk -P: read only the records that start */
+__thread off_t	rangeend = -1;	/*   in [rangestart, rangeend) of the file */
 extern	__thread Awkfloat *ARGC;
 
 static __thread Cell dollar0 = { OCELL, CFLD, NULL, "", 0.0, REC|STR|DONTFREE };
@@ -89,6 +95,16 @@ void makefields(int n1, int n2)		/* create $n1..$n2 inclusive */
 	}
 }
 
+static void rangeseek(FILE *inf)	/* to the first record at or after rangestart */
+{
+	int c, sep = **RS;
+
+	if (fseeko(inf, rangestart - 1, SEEK_SET) == -1)
+		FATAL("can't seek in %s", file);
+	while ((c = getc(inf)) != EOF && c != sep)
+		;
+}
+
 void initgetrec(void)
 {
 	int i;
@@ -145,19 +161,22 @@ int getrec(char **pbuf, int *pbufsize, int isrecord)	/* get next input record */
 				infile = thread_stdin;
 			else if ((infile = fopen(file, "r")) == NULL)
 				FATAL("can't open file %s", file);
+			else if (rangestart > 0)
+				rangeseek(infile);
 			setfval(fnrloc, 0.0);
 		}
-		c = readrec(&buf, &bufsize, infile);
+		if (rangeend >= 0 && ftello(infile) >= rangeend)
+			c = buf[0] = '\0';	/* the rest is another thread's */
+		else
+			c = readrec(&buf, &bufsize, infile);
 		if (c != 0 || buf[0] != '\0') {	/* normal record */
 			if (isrecord) {
 				if (freeable(fldtab[0]))
 					xfree(fldtab[0]->sval);
 				fldtab[0]->sval = buf;	/* buf == record */
 				fldtab[0]->tval = REC | STR | DONTFREE;
-				if (is_number(fldtab[0]->sval)) {
-					fldtab[0]->fval = atof(fldtab[0]->sval);
+				if (is_numval(fldtab[0]->sval, &fldtab[0]->fval))
 					fldtab[0]->tval |= NUM;
-				}
 			}
 			setfval(nrloc, nrloc->fval+1);
 			setfval(fnrloc, fnrloc->fval+1);
@@ -197,13 +216,35 @@ int readrec(char **pbuf, int *pbufsize, FILE *inf)	/* read one record into buf *
 	if (strlen(*FS) >= sizeof(inputFS))
 		FATAL("field separator %.10s... is too long", *FS);
 	strcpy(inputFS, *FS);	/* for subsequent field splitting */
-	if ((sep = **RS) == 0) {
-		sep = '\n';
-		while ((c=getc(inf)) == '\n' && c != EOF)	/* skip leading \n's */
-			;
-		if (c != EOF)
-			ungetc(c, inf);
+	if ((sep = **RS) != 0) {
+		/*
+		 * One-character RS: getdelim() looks for the separator with
+		 * memchr() in the stream's own buffer and copies the record
+		 * in one go, instead of a getc() per character.  The buffer
+		 * stays stdio's, so getline <file on the same stream and the
+		 * getc() in getrec() still see the bytes that follow.
+		 */
+		size_t size = bufsize;
+		ssize_t n = getdelim(&buf, &size, sep, inf);
+
+		if (n < 0 && ferror(inf) && errno == ENOMEM)
+			FATAL("out of space for input record");
+		if (size > INT_MAX)
+			FATAL("input record `%.30s...' too long", buf);
+		if (n < 0)
+			buf[n = 0] = 0;
+		else if (buf[n-1] == sep)
+			buf[n-1] = 0;
+		   dprintf( (thread_stdout, "readrec saw <%s>, returns %d\n", buf, n > 0) );
+		*pbuf = buf;
+		*pbufsize = size;
+		return n > 0;
 	}
+	sep = '\n';	/* RS == "": paragraph mode */
+	while ((c=getc(inf)) == '\n' && c != EOF)	/* skip leading \n's */
+		;
+	if (c != EOF)
+		ungetc(c, inf);
 	for (rr = buf; ; ) {
 		for (; (c=getc(inf)) != sep && c != EOF; ) {
 			if (rr-buf+1 > bufsize)
@@ -253,24 +294,43 @@ void setclvar(char *s)	/* set var=value from s */
 	p = qstring(p, '\0');
 	q = setsymtab(s, p, 0.0, STR, symtab);
 	setsval(q, p);
-	if (is_number(q->sval)) {
-		q->fval = atof(q->sval);
+	if (is_numval(q->sval, &q->fval))
 		q->tval |= NUM;
-	}
 	   dprintf( (thread_stdout, "command line set %s to |%s|\n", s, p) );
 }
 
 
+static void fldsplit(const char *, int);
+
 void fldbld(void)	/* create fields from current record */
+{
+	if (donefld)
+		return;
+	fldsplit(inputFS, fldlimit);
+}
+
+void fldall(void)	/* all the fields, for NF or to assign one */
+{
+	if (!donefld)
+		fldsplit(inputFS, ALLFLDS);
+	else if (fldpartial)
+		fldsplit(fldFS, ALLFLDS);
+}
+
+/*
+ * Split $0 into at most limit fields (but for FS="" or a regular
+ * expression, which always split it all).  Splitting again, to go
+ * further, writes the same first fields at the same place in fields[].
+ */
+static void fldsplit(const char *fs, int limit)
 {
 	/* this relies on having fields[] the same length as $0 */
 	/* the fields are all stored in this one array with \0's */
-	char *r, *fr, sep;
+	char *r, *fr, *e, sep;
 	Cell *p;
 	int i, j, n;
 
-	if (donefld)
-		return;
+	fldpartial = 0;
 	if (!isstr(fldtab[0]))
 		getsval(fldtab[0]);
 	r = fldtab[0]->sval;
@@ -283,14 +343,18 @@ void fldbld(void)	/* create fields from current record */
 	}
 	fr = fields;
 	i = 0;	/* number of fields accumulated here */
-	if (strlen(inputFS) > 1) {	/* it's a regular expression */
-		i = refldbld(r, inputFS);
-	} else if ((sep = *inputFS) == ' ') {	/* default whitespace */
+	if (strlen(fs) > 1) {	/* it's a regular expression */
+		i = refldbld(r, fs);
+	} else if ((sep = *fs) == ' ') {	/* default whitespace */
 		for (i = 0; ; ) {
 			while (*r == ' ' || *r == '\t' || *r == '\n')
 				r++;
 			if (*r == 0)
 				break;
+			if (i == limit) {
+				fldpartial = 1;
+				break;
+			}
 			i++;
 			if (i > nfields)
 				growfldtab(i);
@@ -298,13 +362,15 @@ void fldbld(void)	/* create fields from current record */
 				xfree(fldtab[i]->sval);
 			fldtab[i]->sval = fr;
 			fldtab[i]->tval = FLD | STR | DONTFREE;
-			do
-				*fr++ = *r++;
-			while (*r != ' ' && *r != '\t' && *r != '\n' && *r != '\0');
+			for (e = r + 1; *e != ' ' && *e != '\t' && *e != '\n' && *e != '\0'; e++)
+				;
+			memcpy(fr, r, e - r);
+			fr += e - r;
+			r = e;
 			*fr++ = 0;
 		}
 		*fr = 0;
-	} else if ((sep = *inputFS) == 0) {		/* new: FS="" => 1 char/field */
+	} else if ((sep = *fs) == 0) {		/* new: FS="" => 1 char/field */
 		for (i = 0; *r != 0; r++) {
 			char buf[2];
 			i++;
@@ -327,6 +393,10 @@ void fldbld(void)	/* create fields from current record */
 		if (strlen(*RS) > 0)
 			rtest = '\0';
 		for (;;) {
+			if (i == limit) {
+				fldpartial = 1;
+				break;
+			}
 			i++;
 			if (i > nfields)
 				growfldtab(i);
@@ -347,12 +417,12 @@ void fldbld(void)	/* create fields from current record */
 	cleanfld(i+1, lastfld);	/* clean out junk from previous record */
 	lastfld = i;
 	donefld = 1;
+	if (fldpartial)
+		strcpy(fldFS, fs);
 	for (j = 1; j <= lastfld; j++) {
 		p = fldtab[j];
-		if(is_number(p->sval)) {
-			p->fval = atof(p->sval);
+		if (is_numval(p->sval, &p->fval))
 			p->tval |= NUM;
-		}
 	}
 	setfval(nfloc, (Awkfloat) lastfld);
 	if (dbg) {
@@ -613,9 +683,9 @@ void eprint(void)	/* try to print context around error */
 	char *p, *q;
 	int c;
 	static __thread int been_here = 0;
-	extern char ebuf[], *ep;
+	extern __thread char ebuf[], *ep;
 
-	if (compile_time == 2 || compile_time == 0 || been_here++ > 0)
+	if (compile_time == 2 || compile_time == 0 || been_here++ > 0 || ep == NULL)
 		return;
 	p = ep - 1;
 	if (p > ebuf && *p == '\n')
@@ -690,16 +760,54 @@ int isclvar(const char *s)	/* is s of form var=something ? */
 #include <math.h>
 int is_number(const char *s)
 {
+	Awkfloat f;
+
+	return is_numval(s, &f);
+}
+
+/*
+ * is_number(s), also leaving in *fp what atof(s) would give.  Plain
+ * decimals of up to 15 digits, which is what most fields are, are done
+ * here: their digits and the power of 10 are exact doubles, so one
+ * division rounds the way strtod does.  Anything else goes to strtod.
+ */
+static const double pow10tab[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+	1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+int is_numval(const char *s, Awkfloat *fp)
+{
+	const char *p;
+	unsigned long long m;
+	int nd, nf, neg;
 	double r;
 	char *ep;
-	errno = 0;
-	r = strtod(s, &ep);
-	if (ep == s || r == HUGE_VAL || errno == ERANGE)
-		return 0;
+
+	for (p = s; isspace((uschar) *p); p++)
+		;
+	neg = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+	m = 0;
+	for (nd = 0; isdigit((uschar) *p) && nd < 15; p++, nd++)
+		m = m * 10 + (*p - '0');
+	nf = 0;
+	if (*p == '.')
+		for (p++; isdigit((uschar) *p) && nd < 15; p++, nd++, nf++)
+			m = m * 10 + (*p - '0');
+	if (nd == 0 || isdigit((uschar) *p) || *p == 'e' || *p == 'E'
+	    || *p == 'x' || *p == 'X') {	/* not plain, or too long */
+		errno = 0;
+		*fp = r = strtod(s, &ep);
+		if (ep == s || r == HUGE_VAL || errno == ERANGE)
+			return 0;
+	} else {
+		r = (double) m / pow10tab[nf];
+		*fp = neg ? -r : r;
+		ep = (char *) p;
+	}
 	while (*ep == ' ' || *ep == '\t' || *ep == '\n')
 		ep++;
-	if (*ep == '\0')
-		return 1;
-	else
-		return 0;
+	return *ep == '\0';
 }
@@ -25,12 +25,18 @@ THIS SOFTWARE.
 const char	*version = "version 20070501";
 
 #define DEBUG
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <locale.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <pthread.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
 #include "awk.h"
 #include "ytab.h"
 
@@ -44,6 +50,8 @@ const char	*version = "version 20070501";
 
 extern	char	**environ;
 extern	__thread int	nfields;
+extern	__thread Cell	**fldtab;
+extern	__thread Awkfloat *ARGC;
 
 __thread int	dbg	= 0;    // Set to 1 for serious debugging
 __thread char	*cmdname;	/* gets argv[0] for error messages */
@@ -62,6 +70,38 @@ static __thread int	curpfile = 0;	/* current filename */
 __thread int	safe	= 0;	/* 1 => "safe" mode */
 __thread int	Unix2003_compat;
 
+/*
+ * awk -P n: if the program allows it (see parallelok()) and reads one
+ * big enough file, n threads each read a piece of the file, starting
+ * and stopping on record boundaries.  Each runs BEGIN and then the
+ * rules over its piece, into memory; if they all get to the end, their
+ * output is copied out in order, the accumulators are added up, NR,
+ * FNR, FILENAME and $0 are set as if the file had been read here, and
+ * END is run.  If one of them fails, the file is read again here.
+ */
+#define	PMAX	64		/* threads, at most */
+#define	PMIN	(64*1024)	/* bytes of input for each, at least */
+
+struct pchunk {
+	char	**argv;		/* its own copy, for awk_main() */
+	int	argc;
+	off_t	start, end;	/* it reads the records that start in here */
+	FILE	*in;
+	FILE	*out, *err;	/* memory streams, into: */
+	char	*obuf, *ebuf;
+	size_t	olen, elen;
+	locale_t loc;		/* LC_NUMERIC "C", for parsing */
+	int	status;		/* 0 once it has got to the end */
+	Array	*symtab;	/* where its accumulators are, then */
+	Awkfloat nr;
+	char	*lastrec;
+};
+
+static __thread struct pchunk *pchunk;	/* in one of -P's threads */
+static __thread int	nparallel;	/* -P n */
+static __thread char	**pargv;	/* the arguments as they came, for them */
+static __thread int	pargc;
+
 static void initializeVariables() {
     // initialize all flags:
     cmdname = NULL;
@@ -88,10 +128,12 @@ static void initializeVariables() {
     
     extern __thread int lastfld;
     lastfld    = 0;    /* last used field */
+    fldlimit   = 0;    /* raised by the $n in the program */
     extern __thread int argno;
     argno    = 1;    /* current input argument number */
     if (symtab != NULL) {
         free(symtab->tab);
+        free(symtab->otab);
         free(symtab);
         symtab = NULL;
     }
@@ -104,20 +146,210 @@ static void initializeVariables() {
     fieldssize = RECSIZE;
     extern __thread Cell    **fldtab;    /* pointers to Cells */
     if (fldtab) { free(fldtab); fldtab = NULL; }
+    nparallel = 0;
+}
+
+/*
+ * A copy of argv for awk_main(), which writes on the strings (setclvar())
+ * and on the array; the strings are kept a second time after the array's
+ * end for freeargs().
+ */
+static char **copyargs(int argc, char *argv[])
+{
+	char **v;
+	int i;
+
+	if ((v = (char **) calloc(2 * (argc + 1), sizeof(char *))) == NULL)
+		FATAL("out of space copying arguments");
+	for (i = 0; i < argc; i++)
+		v[i] = v[argc + 1 + i] = tostring(argv[i]);
+	return v;
+}
+
+static void freeargs(char **v, int argc)
+{
+	int i;
+
+	for (i = 0; i < argc; i++)
+		free(v[argc + 1 + i]);
+	free(v);
+}
+
+int awk_main(int, char *[]);
+
+static void *pworker(void *arg)	/* one piece of the input, for -P */
+{
+	extern __thread off_t rangestart, rangeend;
+	extern __thread int donerec;
+	struct pchunk *c = (struct pchunk *) arg;
+
+	thread_stdin = c->in;
+	thread_stdout = c->out;
+	thread_stderr = c->err;
+	pchunk = c;
+	rangestart = c->start;
+	rangeend = c->end;
+	if (awk_main(c->argc, c->argv) == 0) {
+		if (donerec == 0)
+			recbld();
+		c->symtab = symtab;
+		c->nr = getfval(nrloc);
+		c->lastrec = tostring(getsval(fldtab[0]));
+		c->status = 0;
+		symtab = NULL;	/* parallel() frees it */
+	}
+	initializeVariables();
+	return NULL;
+}
+
+static void pmerge(Cell *a, Cell *w)	/* add accumulator w of a thread into a */
+{
+	Array *tp;
+	char **keys;
+	Cell *p;
+	int i;
+
+	if (isarr(a)) {
+		if (!isarr(w))
+			return;
+		tp = (Array *) w->sval;
+		keys = symkeys(tp);
+		for (i = 0; keys[i] != NULL; i++) {
+			p = setsymtab(keys[i], "", 0.0, STR|NUM, (Array *) a->sval);
+			setfval(p, getfval(p) + getfval(lookup(keys[i], tp)));
+		}
+		free(keys);
+		freesymtab(w);
+	} else if ((w->tval & (NUM|STR|ARR)) == NUM)	/* it was added to */
+		setfval(a, isstr(a) ? w->fval : getfval(a) + w->fval);
+}
+
+static void parallel(void)	/* -P: read the input on nparallel threads, if we can */
+{
+	extern __thread int awk_firsttime, argno;
+	struct pchunk *c;
+	pthread_t *tid;
+	struct stat sb;
+	locale_t loc;
+	Cell **acc, *w;
+	Awkfloat nr;
+	char *file;
+	int i, j, n, nacc, started, fail;
+
+	if (pargv == NULL || *ARGC != 2 || strlen(*RS) != 1)
+		return;
+	for (i = 0; i < npfile; i++)
+		if (strcmp(pfile[i], "-") == 0)	/* they would read it too */
+			return;
+	file = getargv(1);
+	if (strcmp(file, "-") == 0 || isclvar(file) || stat(file, &sb) == -1
+	    || !S_ISREG(sb.st_mode))
+		return;
+#ifdef __APPLE__
+	/* the output is kept in memory until the end: as big as the input, maybe */
+	if (sb.st_size > ios_memoryBudget())
+		return;
+#endif
+	n = nparallel < PMAX ? nparallel : PMAX;
+	if (n > sb.st_size / PMIN)
+		n = sb.st_size / PMIN;
+	if (n < 2 || (nacc = parallelok(winner, &acc)) < 0)
+		return;
+	for (i = 0; i < nacc; i++)	/* -v can have set them */
+		if (isarr(acc[i]) ? ((Array *) acc[i]->sval)->nelem != 0
+		    : !isstr(acc[i]) || *acc[i]->sval != '\0') {
+			free(acc);
+			return;
+		}
+	c = (struct pchunk *) calloc(n, sizeof(struct pchunk));
+	tid = (pthread_t *) calloc(n, sizeof(pthread_t));
+	loc = newlocale(LC_NUMERIC_MASK, "C", duplocale(LC_GLOBAL_LOCALE));
+	if (c == NULL || tid == NULL || loc == (locale_t) 0)
+		FATAL("out of space for -P");
+	fail = 0;
+	for (started = 0; started < n; started++) {
+		c[started].argv = copyargs(pargc, pargv);
+		c[started].argc = pargc;
+		c[started].start = sb.st_size * started / n;
+		c[started].end = started == n-1 ? -1 : sb.st_size * (started+1) / n;
+		c[started].in = thread_stdin;
+		c[started].out = open_memstream(&c[started].obuf, &c[started].olen);
+		c[started].err = open_memstream(&c[started].ebuf, &c[started].elen);
+		c[started].loc = loc;
+		c[started].status = 2;
+		if (c[started].out == NULL || c[started].err == NULL
+		    || pthread_create(&tid[started], NULL, pworker, &c[started]) != 0) {
+			fail = 1;
+			break;
+		}
+	}
+	for (i = 0; i < started; i++) {
+		pthread_join(tid[i], NULL);
+		if (c[i].status != 0)
+			fail = 1;
+	}
+	nr = 0;
+	for (i = 0; i < n && i <= started; i++) {
+		if (c[i].out != NULL)
+			fclose(c[i].out);
+		if (c[i].err != NULL)
+			fclose(c[i].err);
+		if (!fail) {
+			fwrite(c[i].ebuf, 1, c[i].elen, thread_stderr);
+			fwrite(c[i].obuf, 1, c[i].olen, thread_stdout);
+			for (j = 0; j < nacc; j++)
+				if ((w = lookup(acc[j]->nval, c[i].symtab)) != NULL)
+					pmerge(acc[j], w);
+			nr += c[i].nr;
+			if (c[i].nr > 0)
+				setsval(fldtab[0], c[i].lastrec);
+		} else if (c[i].symtab != NULL)
+			for (j = 0; j < nacc; j++)
+				if ((w = lookup(acc[j]->nval, c[i].symtab)) != NULL)
+					freesymtab(w);
+		if (c[i].symtab != NULL) {
+			free(c[i].symtab->tab);
+			free(c[i].symtab->otab);
+			free(c[i].symtab);
+		}
+		free(c[i].obuf);
+		free(c[i].ebuf);
+		free(c[i].lastrec);
+		freeargs(c[i].argv, c[i].argc);
+	}
+	if (!fail) {	/* as if the file had been read, for END */
+		if (is_numval(fldtab[0]->sval, &fldtab[0]->fval))
+			fldtab[0]->tval |= NUM;
+		fldbld();
+		setfval(nrloc, nr);
+		setfval(fnrloc, nr);
+		setsval(lookup("FILENAME", symtab), file);
+		awk_firsttime = 0;
+		argno = (int) *ARGC;
+	}
+	freelocale(loc);
+	free(tid);
+	free(c);
+	free(acc);
 }
 
 
 int awk_main(int argc, char *argv[])
 {
 	const char *fs = NULL;
+	Node *end = NULL;
+	int i;
     initializeVariables();
 
-	setlocale(LC_CTYPE, "");
-	setlocale(LC_NUMERIC, "C"); /* for parsing cmdline & prog */
+	if (pchunk == NULL) {
+		setlocale(LC_CTYPE, "");
+		setlocale(LC_NUMERIC, "C"); /* for parsing cmdline & prog */
+	} else
+		uselocale(pchunk->loc);	/* setlocale() is for the whole process */
 	cmdname = argv[0];
 	if (argc == 1) {
 		fprintf(thread_stderr, 
-		  "usage: %s [-F fs] [-v var=value] [-f progfile | 'prog'] [file ...]\n", 
+		  "usage: %s [-F fs] [-v var=value] [-P n] [-f progfile | 'prog'] [file ...]\n", 
 		  cmdname);
         exit(1);
 	}
@@ -125,6 +357,12 @@ int awk_main(int argc, char *argv[])
 	signal(SIGFPE, fpecatch);
 	yyin = NULL;
 	symtab = makesymtab(NSYMTAB/NSYMTAB);
+	pargv = NULL;
+	for (i = 1; i < argc && pchunk == NULL; i++)
+		if (strncmp(argv[i], "-P", 2) == 0) {
+			pargv = copyargs(pargc = argc, argv);
+			break;
+		}
 	while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
 		if (strcmp(argv[1],"-version") == 0 || strcmp(argv[1],"--version") == 0) {
 			fprintf(thread_stdout, "awk %s\n", version);
@@ -166,6 +404,14 @@ int awk_main(int argc, char *argv[])
 			if (fs == NULL || *fs == '\0')
 				WARNING("field separator FS is empty");
 			break;
+		case 'P':	/* -P n: read the input on n threads, if the program allows */
+			if (argv[1][2] != 0)
+				nparallel = atoi(&argv[1][2]);
+			else if (argc > 2) {
+				argc--; argv++;
+				nparallel = atoi(argv[1]);
+			}
+			break;
 		case 'v':	/* -v a=1 to be done NOW.  one -v for each */
 			if (argv[1][2] == '\0' && --argc > 1 && isclvar((++argv)[1]))
 				setclvar(argv[1]);
@@ -210,16 +456,29 @@ int awk_main(int argc, char *argv[])
         envinit(environmentVariables(ios_currentPid()));
 #endif
 	yyparse();
-	setlocale(LC_NUMERIC, ""); /* back to whatever it is locally */
+	if (pchunk == NULL)
+		setlocale(LC_NUMERIC, ""); /* back to whatever it is locally */
+	else
+		uselocale(LC_GLOBAL_LOCALE);
 	if (fs)
 		*FS = qstring(fs, '\0');
 	   dprintf( (thread_stdout, "errorflag=%d\n", errorflag) );
 	if (errorflag == 0) {
 		compile_time = 0;
+		if (pchunk != NULL) {
+			end = winner->narg[2];	/* END is run once, after all of them */
+			winner->narg[2] = NULL;
+		} else if (nparallel > 1)
+			parallel();
 		run(winner);
         winner = NULL;
+		freeTree(end, 1);
 	} else
 		bracecheck();
+	if (pargv != NULL) {
+		freeargs(pargv, pargc);
+		pargv = NULL;
+	}
 	return(errorflag);
 }
 
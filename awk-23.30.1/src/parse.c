@@ -44,6 +44,14 @@ Node *nodealloc(int n)
 	return(x);
 }
 
+static void setproc(Node *x)	/* look up x's proctab entry once, for execute() */
+{
+	if (x->nobj <= FIRSTTOKEN || x->nobj >= LASTTOKEN)
+		x->nproc = nullproc;
+	else
+		x->nproc = proctab[x->nobj-FIRSTTOKEN];
+}
+
 Node *exptostat(Node *a)
 {
 	a->ntype = NSTAT;
@@ -56,6 +64,7 @@ Node *node1(int a, Node *b)
 
 	x = nodealloc(1);
 	x->nobj = a;
+	setproc(x);
 	x->narg[0]=b;
 	return(x);
 }
@@ -66,6 +75,7 @@ Node *node2(int a, Node *b, Node *c)
 
 	x = nodealloc(2);
 	x->nobj = a;
+	setproc(x);
 	x->narg[0] = b;
 	x->narg[1] = c;
 	return(x);
@@ -77,6 +87,7 @@ Node *node3(int a, Node *b, Node *c, Node *d)
 
 	x = nodealloc(3);
 	x->nobj = a;
+	setproc(x);
 	x->narg[0] = b;
 	x->narg[1] = c;
 	x->narg[2] = d;
@@ -89,6 +100,7 @@ Node *node4(int a, Node *b, Node *c, Node *d, Node *e)
 
 	x = nodealloc(4);
 	x->nobj = a;
+	setproc(x);
 	x->narg[0] = b;
 	x->narg[1] = c;
 	x->narg[2] = d;
@@ -277,3 +289,355 @@ Node *itonp(int i)	/* and vice versa */
 {
 	return (Node *) (long) i;
 }
+
+/*
+ * awk -P: can the input be cut into pieces, each read on its own
+ * thread, and the pieces' results put together for END?  Only if
+ * what a record does is print to the standard output, and add to
+ * accumulators: scalars and arrays that the rules change only with
+ * += -= ++ and -- statements, and never read.  Any other variable
+ * the rules set must be set in a record before it is read, and may
+ * not be looked at by END.  BEGIN, which every thread runs, may only
+ * set variables, and END is run once, after the pieces.
+ * This errs on the side of saying no.
+ */
+
+#define	PBEGIN	0
+#define	PRULES	1
+#define	PEND	2
+
+struct cellset {
+	Cell	**c;
+	int	n;
+	int	size;
+};
+
+struct pcheck {
+	int	where;		/* PBEGIN, PRULES or PEND */
+	int	pass;		/* rules: 1 finds what they set, 2 checks */
+	struct cellset acc;	/* set by += -= ++ -- statements */
+	struct cellset rec;	/* set by the rules in some other way */
+	struct cellset def;	/* set so far in this record */
+	struct cellset fcns;	/* functions looked at for END */
+	Cell	*nr, *fnr, *filename, *rs, *argv, *argc, *symtab;
+	Cell	*fixed[14];	/* that the rules may not set */
+};
+
+static int inset(struct cellset *s, Cell *c)
+{
+	int i;
+
+	for (i = 0; i < s->n; i++)
+		if (s->c[i] == c)
+			return 1;
+	return 0;
+}
+
+static void addset(struct cellset *s, Cell *c)
+{
+	if (inset(s, c))
+		return;
+	if (s->n >= s->size) {
+		s->size = s->size ? 2 * s->size : 16;
+		s->c = (Cell **) realloc(s->c, s->size * sizeof(Cell *));
+		if (s->c == NULL)
+			FATAL("out of space in addset");
+	}
+	s->c[s->n++] = c;
+}
+
+static int isacc(struct pcheck *pc, Cell *c)
+{
+	return inset(&pc->acc, c) && !inset(&pc->rec, c);
+}
+
+static int pstmts(struct pcheck *, Node *);
+static int pexpr(struct pcheck *, Node *);
+
+static int isfield(Node *n)
+{
+	if (isvalue(n))
+		return (((Cell *) n->narg[0])->tval & FLD) != 0;
+	return n->nobj == INDIRECT || n->nobj == VARNF;
+}
+
+static int plist(struct pcheck *pc, Node *n)	/* n and what follows it */
+{
+	for ( ; n != NULL; n = n->nnext)
+		if (!pexpr(pc, n))
+			return 0;
+	return 1;
+}
+
+static int pvar(struct pcheck *pc, Cell *c)	/* c is looked at */
+{
+	if (c->tval & CON)
+		return 1;
+	if (c == pc->symtab)
+		return pc->where == PEND;
+	switch (pc->where) {
+	case PBEGIN:
+		return !(c->tval & FLD) && c != nfloc && !isacc(pc, c)
+		    && c != pc->nr && c != pc->fnr && c != pc->filename
+		    && c != pc->argv && c != pc->argc;
+	case PRULES:
+		if (pc->pass == 1)
+			return 1;
+		if (isacc(pc, c) || c == pc->nr || c == pc->fnr || c == pc->filename)
+			return 0;
+		return !inset(&pc->rec, c) || inset(&pc->def, c);
+	default:
+		return !inset(&pc->rec, c);
+	}
+}
+
+static int pset(struct pcheck *pc, Node *n, int stmt)	/* n assigns, increments or decrements */
+{
+	Node *lhs = n->narg[0];
+	Cell *c;
+	int acc, i;
+
+	acc = n->nobj == ADDEQ || n->nobj == SUBEQ || n->nobj == PREINCR
+	    || n->nobj == POSTINCR || n->nobj == PREDECR || n->nobj == POSTDECR;
+	if (n->nnarg > 1 && !pexpr(pc, n->narg[1]))
+		return 0;
+	if (isfield(lhs))
+		return pc->where != PBEGIN && pexpr(pc, lhs);
+	if (pc->where == PBEGIN && isvalue(lhs) && (Cell *) lhs->narg[0] == pc->rs)
+		return 0;
+	if (pc->where != PRULES)
+		return pexpr(pc, lhs);
+	if (lhs->nobj == ARRAY) {
+		if (!stmt || !acc || !plist(pc, lhs->narg[1]))
+			return 0;
+		c = (Cell *) lhs->narg[0]->narg[0];
+		if (pc->pass == 1)
+			addset(&pc->acc, c);
+		return pc->pass == 1 || isacc(pc, c);
+	}
+	c = (Cell *) lhs->narg[0];
+	if (c == nfloc)
+		return 1;
+	for (i = 0; i < sizeof(pc->fixed)/sizeof(pc->fixed[0]); i++)
+		if (c == pc->fixed[i])
+			return 0;
+	if (!stmt)
+		return 0;
+	if (pc->pass == 1) {
+		addset(acc ? &pc->acc : &pc->rec, c);
+		return 1;
+	}
+	if (n->nobj == ASSIGN) {
+		addset(&pc->def, c);
+		return 1;
+	}
+	return isacc(pc, c) || inset(&pc->def, c);
+}
+
+static int pdest(struct pcheck *pc, Node *lhs)	/* lhs is set by sub, gsub or getline */
+{
+	if (isfield(lhs))
+		return pc->where != PBEGIN && pexpr(pc, lhs);
+	return pc->where != PRULES && pexpr(pc, lhs);
+}
+
+static int pexpr(struct pcheck *pc, Node *n)
+{
+	Cell *f;
+	int i;
+
+	if (n == NULL)
+		return 1;
+	if (isvalue(n))
+		return pvar(pc, (Cell *) n->narg[0]);
+	switch (n->nobj) {
+	case ASSIGN: case ADDEQ: case SUBEQ: case MULTEQ: case DIVEQ:
+	case MODEQ: case POWEQ:
+	case PREINCR: case POSTINCR: case PREDECR: case POSTDECR:
+		return pset(pc, n, 0);
+	case INDIRECT:
+		return pc->where != PBEGIN && pexpr(pc, n->narg[0]);
+	case VARNF:
+		return pc->where != PBEGIN;
+	case MATCHFCN:
+		if (pc->where == PRULES) {
+			addset(pc->pass == 1 ? &pc->rec : &pc->def, rstartloc);
+			addset(pc->pass == 1 ? &pc->rec : &pc->def, rlengthloc);
+		}
+		/* fall through */
+	case MATCH: case NOTMATCH:
+		return pexpr(pc, n->narg[1]) && (n->narg[0] == NIL || pexpr(pc, n->narg[2]));
+	case SUB: case GSUB:
+		return (n->narg[0] == NIL || pexpr(pc, n->narg[1]))
+		    && pexpr(pc, n->narg[2]) && pdest(pc, n->narg[3]);
+	case SPLIT:
+		return pc->where != PRULES && pexpr(pc, n->narg[0])
+		    && pexpr(pc, n->narg[1])
+		    && (ptoi(n->narg[3]) == REGEXPR || pexpr(pc, n->narg[2]));
+	case GETLINE:
+		return pc->where == PEND && (n->narg[0] == NIL || pdest(pc, n->narg[0]))
+		    && pexpr(pc, n->narg[2]);
+	case CLOSE:
+		return pc->where == PEND && pexpr(pc, n->narg[0]);
+	case BLTIN:
+		i = ptoi(n->narg[0]);
+		if (pc->where != PEND && (i == FSYSTEM || i == FFLUSH || i == FRAND || i == FSRAND))
+			return 0;
+		return plist(pc, n->narg[1]);
+	case CALL:
+		if (pc->where != PEND)
+			return 0;
+		f = (Cell *) n->narg[0]->narg[0];
+		if (!inset(&pc->fcns, f)) {
+			addset(&pc->fcns, f);
+			if (!isfcn(f) || !pstmts(pc, (Node *) f->sval))
+				return 0;
+		}
+		return plist(pc, n->narg[1]);
+	case ARG:
+		return 1;
+	case ARRAY:
+		return pexpr(pc, n->narg[0]) && plist(pc, n->narg[1]);
+	case INTEST:
+		return plist(pc, n->narg[0]) && pexpr(pc, n->narg[1]);
+	case ADD: case MINUS: case MULT: case DIVIDE: case MOD: case POWER:
+	case UMINUS: case UPLUS: case NOT: case AND: case BOR:
+	case EQ: case NE: case LT: case LE: case GT: case GE:
+	case CAT: case CONDEXPR: case INDEX: case SUBSTR: case SPRINTF:
+		for (i = 0; i < n->nnarg; i++)
+			if (!plist(pc, n->narg[i]))
+				return 0;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int pstmts(struct pcheck *pc, Node *n)
+{
+	int ndef;
+
+	for ( ; n != NULL; n = n->nnext) {
+		ndef = pc->def.n;	/* what is set in a branch stays there */
+		switch (n->nobj) {
+		case PRINT: case PRINTF:	/* a bare pattern's has two arguments */
+			if (n->nnarg < 3)
+				break;
+			if (pc->where == PBEGIN || (pc->where == PRULES && n->narg[1] != NIL))
+				return 0;
+			if (!plist(pc, n->narg[0]) || !pexpr(pc, n->narg[2]))
+				return 0;
+			break;
+		case IF:
+			if (!pexpr(pc, n->narg[0]) || !pstmts(pc, n->narg[1]))
+				return 0;
+			pc->def.n = ndef;
+			if (!pstmts(pc, n->narg[2]))
+				return 0;
+			break;
+		case WHILE:
+			if (!pexpr(pc, n->narg[0]) || !pstmts(pc, n->narg[1]))
+				return 0;
+			break;
+		case DO:
+			if (!pstmts(pc, n->narg[0]))
+				return 0;
+			pc->def.n = ndef;
+			if (!pexpr(pc, n->narg[1]))
+				return 0;
+			break;
+		case FOR:
+			if (!pstmts(pc, n->narg[0]))
+				return 0;
+			ndef = pc->def.n;
+			if (!pexpr(pc, n->narg[1]) || !pstmts(pc, n->narg[3]))
+				return 0;
+			pc->def.n = ndef;
+			if (!pstmts(pc, n->narg[2]))
+				return 0;
+			break;
+		case IN:
+			if (!isvalue(n->narg[0]) && pc->where == PRULES)
+				return 0;
+			if (!pexpr(pc, n->narg[1]))
+				return 0;
+			if (pc->where == PRULES) {
+				addset(pc->pass == 1 ? &pc->rec : &pc->def, (Cell *) n->narg[0]->narg[0]);
+			} else if (!pexpr(pc, n->narg[0]))
+				return 0;
+			if (!pstmts(pc, n->narg[2]))
+				return 0;
+			break;
+		case NEXT: case BREAK: case CONTINUE:
+			break;
+		case EXIT: case RETURN: case NEXTFILE:
+			if (pc->where != PEND || !pexpr(pc, n->narg[0]))
+				return 0;
+			break;
+		case DELETE:
+			if (pc->where == PRULES || !pexpr(pc, n->narg[0]) || !plist(pc, n->narg[1]))
+				return 0;
+			break;
+		case ASSIGN: case ADDEQ: case SUBEQ: case MULTEQ: case DIVEQ:
+		case MODEQ: case POWEQ:
+		case PREINCR: case POSTINCR: case PREDECR: case POSTDECR:
+			if (!pset(pc, n, 1))
+				return 0;
+			continue;	/* what it sets stays set */
+		default:
+			if (!pexpr(pc, n))
+				return 0;
+			continue;
+		}
+		pc->def.n = ndef;
+	}
+	return 1;
+}
+
+int parallelok(Node *prog, Cell ***accp)	/* see above; -1, or how many accumulators */
+{
+	static const char *fixed[] = { "FS", "RS", "OFS", "ORS", "OFMT", "CONVFMT",
+	    "SUBSEP", "NR", "FNR", "FILENAME", "ARGC", "ARGV", "ENVIRON", "SYMTAB" };
+	struct pcheck pc;
+	Node *r;
+	Cell *c;
+	int i, n = -1;
+
+	memset(&pc, 0, sizeof(pc));
+	pc.nr = nrloc;
+	pc.fnr = fnrloc;
+	pc.filename = lookup("FILENAME", symtab);
+	pc.rs = lookup("RS", symtab);
+	pc.argv = lookup("ARGV", symtab);
+	pc.argc = lookup("ARGC", symtab);
+	pc.symtab = lookup("SYMTAB", symtab);
+	for (i = 0; i < sizeof(fixed)/sizeof(fixed[0]); i++)
+		pc.fixed[i] = lookup(fixed[i], symtab);
+	if (prog == NULL || prog->narg[1] == NULL)
+		goto out;
+	pc.where = PRULES;
+	for (pc.pass = 1; pc.pass <= 2; pc.pass++)
+		for (r = prog->narg[1]; r != NULL; r = r->nnext) {
+			pc.def.n = 0;
+			if (r->nobj != PASTAT || !pexpr(&pc, r->narg[0])
+			    || !pstmts(&pc, r->narg[1]))
+				goto out;
+		}
+	pc.where = PBEGIN;
+	if (!pstmts(&pc, prog->narg[0]))
+		goto out;
+	pc.where = PEND;
+	if (!pstmts(&pc, prog->narg[2]))
+		goto out;
+	for (i = n = 0; i < pc.acc.n; i++)
+		if (isacc(&pc, c = pc.acc.c[i]))
+			pc.acc.c[n++] = c;
+	*accp = pc.acc.c;
+	pc.acc.c = NULL;
+  out:
+	free(pc.acc.c);
+	free(pc.rec.c);
+	free(pc.def.c);
+	free(pc.fcns.c);
+	return n;
+}
@@ -39,6 +39,7 @@ extern	int	yyback(int *, int);
 extern	int	yyinput(void);
 
 extern	fa	*makedfa(const char *, int);
+extern	void	freefatab(void);
 extern	fa	*mkdfa(const char *, int);
 extern	int	makeinit(fa *, int);
 extern	void	penter(Node *);
@@ -92,6 +93,7 @@ extern	char	*tokname(int);
 extern	Cell	*(*proctab[])(Node **, int);
 extern	int	ptoi(void *);
 extern	Node	*itonp(int);
+extern	int	parallelok(Node *, Cell ***);
 
 extern	void	syminit(void);
 extern	void	arginit(int, char **);
@@ -100,9 +102,10 @@ extern	Array	*makesymtab(int);
 extern	void	freesymtab(Cell *);
 extern	void	freeelem(Cell *, const char *);
 extern	Cell	*setsymtab(const char *, const char *, double, unsigned int, Array *);
-extern	int	hash(const char *, int);
+extern	unsigned int	hash(const char *);
 extern	void	rehash(Array *);
 extern	Cell	*lookup(const char *, Array *);
+extern	char	**symkeys(Array *);
 extern	double	setfval(Cell *, double);
 extern	void	funnyvar(Cell *, const char *);
 extern	char	*setsval(Cell *, const char *);
@@ -122,6 +125,7 @@ extern	int	readrec(char **buf, int *bufsize, FILE *inf);
 extern	char	*getargv(int);
 extern	void	setclvar(char *);
 extern	void	fldbld(void);
+extern	void	fldall(void);
 extern	void	cleanfld(int, int);
 extern	void	newfld(int);
 extern	int	refldbld(const char *, const char *);
@@ -140,6 +144,7 @@ extern	void	bclass(int);
 extern	double	errcheck(double, const char *);
 extern	int	isclvar(const char *);
 extern	int	is_number(const char *);
+extern	int	is_numval(const char *, Awkfloat *);
 
 extern	int	adjbuf(char **pb, int *sz, int min, int q, char **pbp, const char *what);
 extern	void	run(Node *);
@@ -70,7 +70,7 @@ static __thread jmp_buf env;
 extern	__thread int	pairstack[];
 
 __thread Node	*winner = NULL;	/* root of parse tree */
-Cell	*tmps;		/* free temporary cells for execution */
+__thread Cell	*tmps;		/* free temporary cells for execution */
 
 static Cell	truecell	={ OBOOL, BTRUE, 0, 0, 1.0, NUM };
 Cell	*True	= &truecell;
@@ -136,6 +136,7 @@ void run(Node *a)	/* execution of parse tree starts here */
 	stdinit();
 	execute(a);
 	closeall();
+	freefatab();
     freeTree(a, 1);
     // Reset main variables at exit:
     curnode = NULL;
@@ -147,27 +148,52 @@ void run(Node *a)	/* execution of parse tree starts here */
     endloc = 0;
 }
 
+#define	ANODE	1	/* a Node */
+#define	AFA	2	/* a regular expression compiled with the program */
+
+static int argkind(Node *a, int i)	/* what a->narg[i] is, for freeTree() */
+{
+	switch (a->nobj) {
+	case VARNF: case ARG: case BLTIN:	/* a Cell or a number */
+		return i == 0 ? 0 : ANODE;
+	case MATCH: case NOTMATCH: case MATCHFCN:
+		if (i == 2)
+			return a->narg[0] == NIL ? AFA : ANODE;
+		return i == 1 ? ANODE : 0;
+	case SUB: case GSUB:
+		if (i == 1)
+			return a->narg[0] == NIL ? AFA : ANODE;
+		return i == 0 ? 0 : ANODE;
+	case SPLIT:
+		if (i == 2)
+			return ptoi(a->narg[3]) == REGEXPR ? AFA : ANODE;
+		return i == 3 ? 0 : ANODE;
+	case GETLINE: case PRINT: case PRINTF:
+		return i == 1 ? 0 : ANODE;
+	case PASTAT2:
+		return i == 3 ? 0 : ANODE;
+	default:
+		return ANODE;
+	}
+}
+
 void freeTree(Node *u, int eraseSelf)    /* scan the entire tree, and frees the allocated memory */
 {
     Node *a;
     Node *anext;
     
     if (u == NULL) return;
-    if ((int)u == 0x1) return; // safeguard
-    
-    // If it's a tree, freetr will do the job:
-    if ((u->nobj == CCL) || (u->nobj == NCCL) || (u->nobj == CHAR) || (u->nobj == DOT) || (u->nobj == FINAL)
-        || (u->nobj == ALL) || (u->nobj == EMPTYRE) || (u->nobj == STAR) || (u->nobj == PLUS) || (u->nobj == QUEST)
-        || (u->nobj == CAT) || (u->nobj == OR)) {
-        freetr(u);
-        return;
-    }
     for (a = u; a; a = anext) {
         if ((a->ntype == NSTAT) || (a->ntype == NEXPR)) {
             for (int i = 0; i < a->nnarg; i++) {
-                freeTree(a->narg[i], 0); // never free narg, it was allocated as part of the node
-                a->narg[i] = NULL;
+                if (argkind(a, i) == ANODE)
+                    freeTree(a->narg[i], 0); // never free narg, it was allocated as part of the node
+                else if (argkind(a, i) == AFA && a->narg[i] != NULL)
+                    freefa((fa *) a->narg[i]);
             }
+            // argkind() looks at the other args: clear them once they are all freed
+            for (int i = 0; i < a->nnarg; i++)
+                a->narg[i] = NULL;
         }
         // Erase all values, all pointers.
         anext = a->nnext;
@@ -205,9 +231,8 @@ Cell *execute(Node *u)	/* execute a node of the parse tree */
 				recbld();
 			return(x);
 		}
-		if (notlegal(a->nobj))	/* probably a Cell* but too risky to print */
+		if ((proc = a->nproc) == nullproc)	/* probably a Cell* but too risky to print */
 			FATAL("illegal statement");
-		proc = proctab[a->nobj-FIRSTTOKEN];
 		x = (*proc)(a->narg, a->nobj);
 		if (isfld(x) && !donefld)
 			fldbld();
@@ -223,6 +248,24 @@ Cell *execute(Node *u)	/* execute a node of the parse tree */
 	}
 }
 
+/*
+ * execute(u), less the call for a variable or constant: most operands
+ * are one, and every operator fetches its operands through here.
+ */
+static inline Cell *operand(Node *u)
+{
+	Cell *x;
+
+	if (u != NULL && isvalue(u)) {
+		x = (Cell *) (u->narg[0]);
+		if ((x->tval & (FLD|REC)) == 0) {
+			curnode = u;
+			return(x);
+		}
+	}
+	return(execute(u));
+}
+
 
 Cell *program(Node **a, int n)	/* execute an awk program */
 {				/* a[0] = BEGIN, a[1] = body, a[2] = END */
@@ -268,9 +311,9 @@ struct Frame {	/* stack frame for awk function calls */
 
 #define	NARGS	50	/* max args in a call */
 
-struct Frame *frame = NULL;	/* base of stack frames; dynamically allocated */
-int	nframe = 0;		/* number of frames allocated */
-struct Frame *fp = NULL;	/* frame pointer. bottom level unused */
+__thread struct Frame *frame = NULL;	/* base of stack frames; dynamically allocated */
+__thread int	nframe = 0;		/* number of frames allocated */
+__thread struct Frame *fp = NULL;	/* frame pointer. bottom level unused */
 
 Cell *call(Node **a, int n)	/* function call.  very kludgy and fragile */
 {
@@ -382,7 +425,7 @@ Cell *copycell(Cell *x)	/* make a copy of a cell in a temp */
 	if (isstr(x))
 		y->sval = tostring(x->sval);
 	y->fval = x->fval;
-	y->tval = x->tval & ~(CON|FLD|REC|DONTFREE);	/* copy is not constant or field */
+	y->tval = x->tval & ~(CON|FLD|REC|DONTFREE|CONV);	/* copy is not constant or field */
 							/* is DONTFREE right? */
 	return y;
 }
@@ -475,10 +518,8 @@ Cell *awk_getline(Node **a, int n)	/* get next line from specific input */
 			tempfree(x);
 		} else {			/* getline <file */
 			setsval(fldtab[0], buf);
-			if (is_number(fldtab[0]->sval)) {
-				fldtab[0]->fval = atof(fldtab[0]->sval);
+			if (is_numval(fldtab[0]->sval, &fldtab[0]->fval))
 				fldtab[0]->tval |= NUM;
-			}
 		}
 	} else {			/* bare getline; use current input */
 		if (a[0] == NULL)	/* getline */
@@ -497,8 +538,7 @@ Cell *awk_getline(Node **a, int n)	/* get next line from specific input */
 
 Cell *getnf(Node **a, int n)	/* get NF */
 {
-	if (donefld == 0)
-		fldbld();
+	fldall();
 	return (Cell *) a[0];
 }
 
@@ -514,10 +554,10 @@ Cell *array(Node **a, int n)	/* a[0] is symtab, a[1] is list of subscripts */
 	if ((buf = (char *) malloc(bufsz)) == NULL)
 		FATAL("out of memory in array");
 
-	x = execute(a[0]);	/* Cell* for symbol table */
+	x = operand(a[0]);	/* Cell* for symbol table */
 	buf[0] = 0;
 	for (np = a[1]; np; np = np->nnext) {
-		y = execute(np);	/* subscript */
+		y = operand(np);	/* subscript */
 		s = getsval(y);
 		if (!adjbuf(&buf, &bufsz, strlen(buf)+strlen(s)+nsub+1, recsize, 0, "array"))
 			FATAL("out of memory for %s[%s...]", x->nval, buf);
@@ -530,7 +570,7 @@ Cell *array(Node **a, int n)	/* a[0] is symtab, a[1] is list of subscripts */
 		   dprintf( (thread_stdout, "making %s into an array\n", NN(x->nval)) );
 		if (freeable(x))
 			xfree(x->sval);
-		x->tval &= ~(STR|NUM|DONTFREE);
+		x->tval &= ~(STR|NUM|DONTFREE|CONV);
 		x->tval |= ARR;
 		x->sval = (char *) makesymtab(NSYMTAB);
 	}
@@ -549,7 +589,7 @@ Cell *awkdelete(Node **a, int n)	/* a[0] is symtab, a[1] is list of subscripts *
 	char *s;
 	int nsub = strlen(*SUBSEP);
 
-	x = execute(a[0]);	/* Cell* for symbol table */
+	x = operand(a[0]);	/* Cell* for symbol table */
 	if (!isarr(x))
 		return True;
 	if (a[1] == 0) {	/* delete the elements, not the table */
@@ -564,7 +604,7 @@ Cell *awkdelete(Node **a, int n)	/* a[0] is symtab, a[1] is list of subscripts *
 			FATAL("out of memory in adelete");
 		buf[0] = 0;
 		for (np = a[1]; np; np = np->nnext) {
-			y = execute(np);	/* subscript */
+			y = operand(np);	/* subscript */
 			s = getsval(y);
 			if (!adjbuf(&buf, &bufsz, strlen(buf)+strlen(s)+nsub+1, recsize, 0, "awkdelete"))
 				FATAL("out of memory deleting %s[%s...]", x->nval, buf);
@@ -589,12 +629,12 @@ Cell *intest(Node **a, int n)	/* a[0] is index (list), a[1] is symtab */
 	int bufsz = recsize;
 	int nsub = strlen(*SUBSEP);
 
-	ap = execute(a[1]);	/* array name */
+	ap = operand(a[1]);	/* array name */
 	if (!isarr(ap)) {
 		   dprintf( (thread_stdout, "making %s into an array\n", ap->nval) );
 		if (freeable(ap))
 			xfree(ap->sval);
-		ap->tval &= ~(STR|NUM|DONTFREE);
+		ap->tval &= ~(STR|NUM|DONTFREE|CONV);
 		ap->tval |= ARR;
 		ap->sval = (char *) makesymtab(NSYMTAB);
 	}
@@ -668,20 +708,20 @@ Cell *boolop(Node **a, int n)	/* a[0] || a[1], a[0] && a[1], !a[0] */
 	Cell *x, *y;
 	int i;
 
-	x = execute(a[0]);
+	x = operand(a[0]);
 	i = istrue(x);
 	tempfree(x);
 	switch (n) {
 	case BOR:
 		if (i) return(True);
-		y = execute(a[1]);
+		y = operand(a[1]);
 		i = istrue(y);
 		tempfree(y);
 		if (i) return(True);
 		else return(False);
 	case AND:
 		if ( !i ) return(False);
-		y = execute(a[1]);
+		y = operand(a[1]);
 		i = istrue(y);
 		tempfree(y);
 		if (i) return(True);
@@ -701,8 +741,8 @@ Cell *relop(Node **a, int n)	/* a[0 < a[1], etc. */
 	Cell *x, *y;
 	Awkfloat j;
 
-	x = execute(a[0]);
-	y = execute(a[1]);
+	x = operand(a[0]);
+	y = operand(a[1]);
 	if (x->tval&NUM && y->tval&NUM) {
 		j = x->fval - y->fval;
 		i = j<0? -1: (j>0? 1: 0);
@@ -767,7 +807,7 @@ Cell *indirect(Node **a, int n)	/* $( a[0] ) */
 	int m;
 	char *s;
 
-	x = execute(a[0]);
+	x = operand(a[0]);
 	val = getfval(x);	/* freebsd: defend against super large field numbers */
 	if ((Awkfloat)INT_MAX < val)
 		FATAL("trying to access out of range field %s", x->nval);
@@ -994,7 +1034,7 @@ int format(char **pbuf, int *pbufsize, const char *s, Node *a)	/* printf-like co
 }
 
 // Moved function so it is static:
-struct files {
+__thread struct files {
     FILE    *fp;
     const char    *fname;
     int    mode;    /* '|', 'a', 'w' => LE/LT, GT */
@@ -1081,15 +1121,19 @@ Cell *arith(Node **a, int n)	/* a[0] + a[1], etc.  also -a[0] */
 	double v;
 	Cell *x, *y, *z;
 
-	x = execute(a[0]);
+	x = operand(a[0]);
 	i = getfval(x);
-	tempfree(x);
+	z = istemp(x) ? x : NULL;	/* the result can go in an operand's temp */
 	if (n != UMINUS && n != UPLUS) {
-		y = execute(a[1]);
+		y = operand(a[1]);
 		j = getfval(y);
-		tempfree(y);
+		if (z == NULL && istemp(y))
+			z = y;
+		else
+			tempfree(y);
 	}
-	z = gettemp();
+	if (z == NULL)
+		z = gettemp();
 	switch (n) {
 	case ADD:
 		i += j;
@@ -1149,7 +1193,7 @@ Cell *incrdecr(Node **a, int n)		/* a[0]++, etc. */
 	int k;
 	Awkfloat xf;
 
-	x = execute(a[0]);
+	x = operand(a[0]);
 	xf = getfval(x);
 	k = (n == PREINCR || n == POSTINCR) ? 1 : -1;
 	if (n == PREINCR || n == PREDECR) {
@@ -1169,8 +1213,8 @@ Cell *assign(Node **a, int n)	/* a[0] = a[1], a[0] += a[1], etc. */
 	Awkfloat xf, yf;
 	double v;
 
-	y = execute(a[1]);
-	x = execute(a[0]);
+	y = operand(a[1]);
+	x = operand(a[0]);
 	if (n == ASSIGN) {	/* ordinary assignment */
 		if (x == y && !(x->tval & (FLD|REC)))	/* self-assignment: */
 			;		/* leave alone unless it's a field */
@@ -1232,8 +1276,8 @@ Cell *cat(Node **a, int q)	/* a[0] cat a[1] */
 	int n1, n2;
 	char *s;
 
-	x = execute(a[0]);
-	y = execute(a[1]);
+	x = operand(a[0]);
+	y = operand(a[1]);
 	getsval(x);
 	getsval(y);
 	n1 = strlen(x->sval);
@@ -1315,7 +1359,7 @@ Cell *split(Node **a, int nnn)	/* split(a[0], a[1], a[2]); a[3] is type */
 	ap = execute(a[1]);	/* array name */
 	freesymtab(ap);
 	   dprintf( (thread_stdout, "split: s=|%s|, a=%s, sep=|%s|\n", s, NN(ap->nval), fs) );
-	ap->tval &= ~STR;
+	ap->tval &= ~(STR|CONV);
 	ap->tval |= ARR;
 	ap->sval = (char *) makesymtab(NSYMTAB);
 
@@ -1427,13 +1471,13 @@ Cell *condexpr(Node **a, int n)	/* a[0] ? a[1] : a[2] */
 {
 	Cell *x;
 
-	x = execute(a[0]);
+	x = operand(a[0]);
 	if (istrue(x)) {
 		tempfree(x);
-		x = execute(a[1]);
+		x = operand(a[1]);
 	} else {
 		tempfree(x);
-		x = execute(a[2]);
+		x = operand(a[2]);
 	}
 	return(x);
 }
@@ -1516,8 +1560,8 @@ Cell *forstat(Node **a, int n)	/* for (a[0]; a[1]; a[2]) a[3] */
 
 Cell *instat(Node **a, int n)	/* for (a[0] in a[1]) a[2] */
 {
-	Cell *x, *vp, *arrayp, *cp, *ncp;
-	Array *tp;
+	Cell *x, *vp, *arrayp;
+	char **keys;
 	int i;
 
 	vp = execute(a[0]);
@@ -1525,24 +1569,24 @@ Cell *instat(Node **a, int n)	/* for (a[0] in a[1]) a[2] */
 	if (!isarr(arrayp)) {
 		return True;
 	}
-	tp = (Array *) arrayp->sval;
+	keys = symkeys((Array *) arrayp->sval);
 	tempfree(arrayp);
-	for (i = 0; i < tp->size; i++) {	/* this routine knows too much */
-		for (cp = tp->tab[i]; cp != NULL; cp = ncp) {
-			setsval(vp, cp->nval);
-			ncp = cp->cnext;
-			x = execute(a[2]);
-			if (isbreak(x)) {
-				tempfree(vp);
-				return True;
-			}
-			if (isnext(x) || isexit(x) || isret(x)) {
-				tempfree(vp);
-				return(x);
-			}
-			tempfree(x);
+	for (i = 0; keys[i] != NULL; i++) {
+		setsval(vp, keys[i]);
+		x = execute(a[2]);
+		if (isbreak(x)) {
+			tempfree(vp);
+			free(keys);
+			return True;
 		}
+		if (isnext(x) || isexit(x) || isret(x)) {
+			tempfree(vp);
+			free(keys);
+			return(x);
+		}
+		tempfree(x);
 	}
+	free(keys);
 	return True;
 }
 
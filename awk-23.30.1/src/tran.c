@@ -32,8 +32,8 @@ THIS SOFTWARE.
 #include "ytab.h"
 #include "ios_error.h"
 
-#define	FULLTAB	2	/* rehash when table gets this x full */
-#define	GROWTAB 4	/* grow table by this factor */
+#define	FULLTAB	2	/* rehash when table gets 1/this full */
+#define	GROWTAB 2	/* and leave it 1/(this x FULLTAB) full */
 
 __thread Array	*symtab;	/* main symbol table */
 
@@ -62,6 +62,14 @@ __thread Cell	*rstartloc;	/* RSTART */
 __thread Cell	*rlengthloc;	/* RLENGTH */
 static __thread Cell	*symtabloc;	/* SYMTAB */
 
+/*
+ * Which value of CONVFMT and of OFMT a CONV string was made with;
+ * assigning to either gives it a new number.
+ */
+static __thread unsigned int	convfmtid;
+static __thread unsigned int	ofmtid;
+static __thread unsigned int	lastfmtid;
+
 static __thread Cell	*nullloc;	/* a guaranteed empty cell */
 __thread Node	*nullnode;	/* zero&null, converted into a node for comparisons */
 __thread Cell	*literal0;
@@ -70,6 +78,8 @@ extern __thread Cell **fldtab;
 
 void syminit(void)	/* initialize symbol table with builtin vars */
 {
+	convfmtid = 1;
+	ofmtid = lastfmtid = 2;
 	literal0 = setsymtab("0", "0", 0.0, NUM|STR|CON|DONTFREE, symtab);
 	/* this is used for if(x)... tests: */
 	nullloc = setsymtab("$zero&null", "", 0.0, NUM|STR|CON|DONTFREE, symtab);
@@ -140,146 +150,256 @@ void envinit(char **envp)	/* set up ENVIRON variable */
 	}
 }
 
+/*
+ * Symbol tables use open addressing, with linear probing over a power
+ * of 2 slots, and the hash of each name kept in its cell.  A cell and
+ * its name are one allocation.  A deleted element leaves DELETED in
+ * its slot, so that the search for the names after it goes on.  When
+ * the table is 1/FULLTAB full, rehash() makes a bigger one and setsymtab()
+ * moves the cells over, a few slots at a time, so that no insertion
+ * has to move them all; until then lookup() looks in both.
+ */
+#define	DELETED	((Cell *) &deletedcell)
+#define	NMOVE	8	/* slots of otab moved to tab per insertion */
+
+static const Cell	deletedcell;
+
 Array *makesymtab(int n)	/* make a new symbol table */
 {
 	Array *ap;
 	Cell **tp;
+	int size;
 
+	for (size = 16; size < n * FULLTAB; size *= 2)
+		;
 	ap = (Array *) calloc(1, sizeof(Array));
-	tp = (Cell **) calloc(n, sizeof(Cell *));
+	tp = (Cell **) calloc(size, sizeof(Cell *));
 	if (ap == NULL || tp == NULL)
 		FATAL("out of space in makesymtab");
 
 	ap->nelem = 0;
-	ap->size = n;
+	ap->size = size;
 	ap->tab = tp;
 	return(ap);
 }
 
+static void freecells(Cell **tab, int size, Array *tp)
+{
+	Cell *cp;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		if ((cp = tab[i]) == NULL || cp == DELETED)
+			continue;
+		if (freeable(cp))
+			xfree(cp->sval);
+		free(cp);	/* and its nval */
+		tp->nelem--;
+	}
+	free(tab);
+}
+
 void freesymtab(Cell *ap)	/* free a symbol table */
 {
-	Cell *cp, *temp;
 	Array *tp;
-	int i;
 
 	if (!isarr(ap))
 		return;
 	tp = (Array *) ap->sval;
 	if (tp == NULL)
 		return;
-	for (i = 0; i < tp->size; i++) {
-		for (cp = tp->tab[i]; cp != NULL; cp = temp) {
-			xfree(cp->nval);
-			if (freeable(cp))
-				xfree(cp->sval);
-			temp = cp->cnext;	/* avoids freeing then using */
-			free(cp); 
-			tp->nelem--;
-		}
-		tp->tab[i] = 0;
-	}
+	freecells(tp->tab, tp->size, tp);
+	if (tp->otab)
+		freecells(tp->otab, tp->osize, tp);
 	if (tp->nelem != 0)
 		WARNING("can't happen: inconsistent element count freeing %s", ap->nval);
-	free(tp->tab);
 	free(tp);
 }
 
+static Cell **findslot(Cell **tab, int size, const char *s, unsigned int h)
+{
+	unsigned int i;
+	Cell *p;
+
+	for (i = h & (size-1); (p = tab[i]) != NULL; i = (i+1) & (size-1))
+		if (p != DELETED && p->chash == h && strcmp(s, p->nval) == 0)
+			return(&tab[i]);
+	return(NULL);
+}
+
+static Cell **findcell(Array *tp, const char *s, unsigned int h)
+{
+	Cell **cpp;
+
+	if ((cpp = findslot(tp->tab, tp->size, s, h)) == NULL && tp->otab != NULL)
+		cpp = findslot(tp->otab, tp->osize, s, h);
+	return(cpp);
+}
+
+static void putcell(Array *tp, Cell *p)	/* into tab; p is not in it */
+{
+	unsigned int i;
+
+	for (i = p->chash & (tp->size-1); tp->tab[i] != NULL && tp->tab[i] != DELETED;
+	    i = (i+1) & (tp->size-1))
+		;
+	if (tp->tab[i] == NULL)
+		tp->nused++;
+	tp->tab[i] = p;
+}
+
+static void movecells(Array *tp, int n)	/* move n slots of otab over to tab */
+{
+	Cell *p;
+
+	for (; n > 0 && tp->omoved < tp->osize; n--, tp->omoved++) {
+		p = tp->otab[tp->omoved];
+		if (p != NULL && p != DELETED) {
+			putcell(tp, p);
+			tp->otab[tp->omoved] = DELETED;	/* still on others' way */
+		}
+	}
+	if (tp->omoved == tp->osize) {
+		xfree(tp->otab);
+		tp->osize = tp->omoved = 0;
+	}
+}
+
 void freeelem(Cell *ap, const char *s)	/* free elem s from ap (i.e., ap["s"] */
 {
 	Array *tp;
-	Cell *p, *prev = NULL;
-	int h;
-	
+	Cell *p, **cpp;
+
 	tp = (Array *) ap->sval;
-	h = hash(s, tp->size);
-	for (p = tp->tab[h]; p != NULL; prev = p, p = p->cnext)
-		if (strcmp(s, p->nval) == 0) {
-			if (prev == NULL)	/* 1st one */
-				tp->tab[h] = p->cnext;
-			else			/* middle somewhere */
-				prev->cnext = p->cnext;
-			if (freeable(p))
-				xfree(p->sval);
-			free(p->nval);
-			free(p);
-			tp->nelem--;
-			return;
-		}
+	if ((cpp = findcell(tp, s, hash(s))) == NULL)
+		return;
+	p = *cpp;
+	*cpp = DELETED;
+	if (freeable(p))
+		xfree(p->sval);
+	free(p);
+	tp->nelem--;
 }
 
 Cell *setsymtab(const char *n, const char *s, Awkfloat f, unsigned t, Array *tp)
 {
-	int h;
-	Cell *p;
+	unsigned int h;
+	size_t len;
+	Cell *p, **cpp;
 
-	if (n != NULL && (p = lookup(n, tp)) != NULL) {
+	h = hash(n);
+	if ((cpp = findcell(tp, n, h)) != NULL) {
+		p = *cpp;
 		   dprintf( (thread_stdout, "setsymtab found %p: n=%s s=\"%s\" f=%g t=%o\n",
 			p, NN(p->nval), NN(p->sval), p->fval, p->tval) );
 		return(p);
 	}
-	p = (Cell *) malloc(sizeof(Cell));
+	len = strlen(n) + 1;
+	p = (Cell *) malloc(sizeof(Cell) + len);
 	if (p == NULL)
 		FATAL("out of space for symbol table at %s", n);
-	p->nval = tostring(n);
+	p->nval = memcpy(p + 1, n, len);
+	p->chash = h;
+	p->cfmt = 0;
 	p->sval = s ? tostring(s) : tostring("");
 	p->fval = f;
 	p->tval = t;
 	p->csub = CUNK;
 	p->ctype = OCELL;
-	tp->nelem++;
-	if (tp->nelem > FULLTAB * tp->size)
+	p->cnext = NULL;
+	if (tp->otab != NULL)
+		movecells(tp, NMOVE);
+	if ((tp->nused + 1) * FULLTAB > tp->size)
 		rehash(tp);
-	h = hash(n, tp->size);
-	p->cnext = tp->tab[h];
-	tp->tab[h] = p;
+	putcell(tp, p);
+	tp->nelem++;
 	   dprintf( (thread_stdout, "setsymtab set %p: n=%s s=\"%s\" f=%g t=%o\n",
 		p, p->nval, p->sval, p->fval, p->tval) );
 	return(p);
 }
 
-int hash(const char *s, int n)	/* form hash value for string s */
+unsigned int hash(const char *s)	/* form hash value for string s */
 {
-	unsigned hashval;
+	unsigned int hashval;
 
 	for (hashval = 0; *s != '\0'; s++)
 		hashval = (*s + 31 * hashval);
-	return hashval % n;
+	return hashval;	/* taken mod the size where it is used */
 }
 
-void rehash(Array *tp)	/* rehash items in small table into big one */
+void rehash(Array *tp)	/* start moving the cells to a new table */
 {
-	int i, nh, nsz;
-	Cell *cp, *op, **np;
-
-	nsz = GROWTAB * tp->size;
+	int nsz;
+	Cell **np;
+
+	if (tp->otab != NULL)	/* not done with the last one */
+		movecells(tp, tp->osize);
+	nsz = tp->size;
+	while (nsz < GROWTAB * FULLTAB * (tp->nelem + 1))
+		nsz *= 2;	/* else: as many slots, without the deleted */
 	np = (Cell **) calloc(nsz, sizeof(Cell *));
-	if (np == NULL)		/* can't do it, but can keep running. */
-		return;		/* someone else will run out later. */
-	for (i = 0; i < tp->size; i++) {
-		for (cp = tp->tab[i]; cp; cp = op) {
-			op = cp->cnext;
-			nh = hash(cp->nval, nsz);
-			cp->cnext = np[nh];
-			np[nh] = cp;
-		}
-	}
-	free(tp->tab);
+	if (np == NULL)
+		FATAL("out of space growing a symbol table to %d", nsz);
+	tp->otab = tp->tab;
+	tp->osize = tp->size;
+	tp->omoved = 0;
 	tp->tab = np;
 	tp->size = nsz;
+	tp->nused = 0;
 }
 
 Cell *lookup(const char *s, Array *tp)	/* look for s in tp */
 {
-	Cell *p;
-	int h;
+	Cell **cpp;
 
-	h = hash(s, tp->size);
-	for (p = tp->tab[h]; p != NULL; p = p->cnext)
-		if (strcmp(s, p->nval) == 0)
-			return(p);	/* found it */
+	if ((cpp = findcell(tp, s, hash(s))) != NULL)
+		return(*cpp);	/* found it */
 	return(NULL);			/* not found */
 }
 
+/*
+ * The names in tp, NULL-terminated, in one allocation for free():
+ * for (k in a) goes through these, whatever its body adds or deletes.
+ */
+char **symkeys(Array *tp)
+{
+	Cell **tabs[2], *cp;
+	char **keys, *s;
+	size_t len;
+	int sizes[2], i, j, n;
+
+	tabs[0] = tp->tab;
+	sizes[0] = tp->size;
+	tabs[1] = tp->otab;
+	sizes[1] = tp->otab ? tp->osize : 0;
+	len = 0;
+	for (j = 0; j < 2; j++)
+		for (i = 0; i < sizes[j]; i++)
+			if ((cp = tabs[j][i]) != NULL && cp != DELETED)
+				len += strlen(cp->nval) + 1;
+	keys = (char **) malloc((tp->nelem + 1) * sizeof(char *) + len);
+	if (keys == NULL)
+		FATAL("out of space for the %d elements of an array", tp->nelem);
+	s = (char *) (keys + tp->nelem + 1);
+	n = 0;
+	for (j = 0; j < 2; j++)
+		for (i = 0; i < sizes[j]; i++)
+			if ((cp = tabs[j][i]) != NULL && cp != DELETED) {
+				keys[n++] = s;
+				s = stpcpy(s, cp->nval) + 1;
+			}
+	keys[n] = NULL;
+	return(keys);
+}
+
+static void newfmt(Cell *vp)	/* if vp is CONVFMT or OFMT, number its new value */
+{
+	if (&vp->sval == CONVFMT)
+		convfmtid = ++lastfmtid;
+	else if (&vp->sval == OFMT)
+		ofmtid = ++lastfmtid;
+}
+
 Awkfloat setfval(Cell *vp, Awkfloat f)	/* set float val of a Cell */
 {
 	int fldno;
@@ -287,6 +407,7 @@ Awkfloat setfval(Cell *vp, Awkfloat f)	/* set float val of a Cell */
 	if ((vp->tval & (NUM | STR)) == 0) 
 		funnyvar(vp, "assign to");
 	if (isfld(vp)) {
+		fldall();	/* NF must be right, and stay so */
 		donerec = 0;	/* mark $0 invalid */
 		fldno = atoi(vp->nval);
 		if (fldno > *NF)
@@ -298,10 +419,11 @@ Awkfloat setfval(Cell *vp, Awkfloat f)	/* set float val of a Cell */
 	}
 	if (freeable(vp))
 		xfree(vp->sval); /* free any previous string */
-	vp->tval &= ~STR;	/* mark string invalid */
+	vp->tval &= ~(STR|CONV);	/* mark string invalid */
 	vp->tval |= NUM;	/* mark number ok */
 	if (f == -0)  /* who would have thought this possible? */
 		f = 0;
+	newfmt(vp);
 	   dprintf( (thread_stdout, "setfval %p: %s = %g, t=%o\n", vp, NN(vp->nval), f, vp->tval) );
 	return vp->fval = f;
 }
@@ -326,6 +448,7 @@ char *setsval(Cell *vp, const char *s)	/* set string val of a Cell */
 	if ((vp->tval & (NUM | STR)) == 0)
 		funnyvar(vp, "assign to");
 	if (isfld(vp)) {
+		fldall();	/* NF must be right, and stay so */
 		donerec = 0;	/* mark $0 invalid */
 		fldno = atoi(vp->nval);
 		if (fldno > *NF)
@@ -338,9 +461,10 @@ char *setsval(Cell *vp, const char *s)	/* set string val of a Cell */
 	t = tostring(s);	/* in case it's self-assign */
 	if (freeable(vp))
 		xfree(vp->sval);
-	vp->tval &= ~NUM;
+	vp->tval &= ~(NUM|CONV);
 	vp->tval |= STR;
 	vp->tval &= ~DONTFREE;
+	newfmt(vp);
 	   dprintf( (thread_stdout, "setsval %p: %s = \"%s (%p) \", t=%o r,f=%d,%d\n",
 		vp, NN(vp->nval), t,t, vp->tval, donerec, donefld) );
 	return(vp->sval = t);
@@ -355,18 +479,34 @@ Awkfloat getfval(Cell *vp)	/* get float val of a Cell */
 	else if (isrec(vp) && donerec == 0)
 		recbld();
 	if (!isnum(vp)) {	/* not a number */
-		vp->fval = atof(vp->sval);	/* best guess */
-		if (is_number(vp->sval) && !(vp->tval&CON))
+		if (is_numval(vp->sval, &vp->fval) && !(vp->tval&CON))	/* else a best guess */
 			vp->tval |= NUM;	/* make NUM only sparingly */
 	}
 	   dprintf( (thread_stdout, "getfval %p: %s = %g, t=%o\n", vp, NN(vp->nval), vp->fval, vp->tval) );
 	return(vp->fval);
 }
 
+static void intstr(char *s, long long n)	/* sprintf(s, "%lld", n) */
+{
+	char buf[24], *p;
+	unsigned long long u;
+
+	p = buf + sizeof(buf);
+	*--p = '\0';
+	u = n < 0 ? -(unsigned long long) n : n;
+	do
+		*--p = '0' + u % 10;
+	while ((u /= 10) != 0);
+	if (n < 0)
+		*--p = '-';
+	strcpy(s, p);
+}
+
 static char *get_str_val(Cell *vp, char **fmt)        /* get string val of a Cell */
 {
 	char s[100];	/* BUG: unchecked */
 	double dtemp;
+	unsigned int fmtid;
 
 	if ((vp->tval & (NUM | STR)) == 0)
 		funnyvar(vp, "read value of");
@@ -374,24 +514,29 @@ static char *get_str_val(Cell *vp, char **fmt)        /* get string val of a Cel
 		fldbld();
 	else if (isrec(vp) && donerec == 0)
 		recbld();
-	if (isstr(vp) == 0) {
+	/*
+	 * A number's string is kept, marked CONV rather than STR: it
+	 * is only right for the format it was made with (conformance
+	 * test awk.ex 233), which cfmt records; an integer's is right
+	 * for any format.  Anything that changes fval drops it.
+	 */
+	fmtid = fmt == OFMT ? ofmtid : convfmtid;
+	if (isstr(vp) == 0 &&
+	    ((vp->tval & CONV) == 0 || (vp->cfmt != 0 && vp->cfmt != fmtid))) {
 		if (freeable(vp))
 			xfree(vp->sval);
-		if (modf(vp->fval, &dtemp) == 0)	/* it's integral */
-			sprintf(s, "%.30g", vp->fval);
-		else
+		vp->cfmt = 0;
+		if (modf(vp->fval, &dtemp) != 0) {
 			sprintf(s, *fmt, vp->fval);
+			vp->cfmt = fmtid;
+		} else if (vp->fval > -1e18 && vp->fval < 1e18 &&
+		    (vp->fval != 0 || !signbit(vp->fval)))
+			intstr(s, (long long) vp->fval);
+		else	/* it's integral, but big, infinite or -0 */
+			sprintf(s, "%.30g", vp->fval);
 		vp->sval = tostring(s);
-#if 0
-		/*
-		  Cannot reuse the converted form unless you confirm
-		  that the current value of CONVFMT is the same as that
-		  which was used to convert the previous string. See
-		  conformance test awk.ex 233
-		*/
 		vp->tval &= ~DONTFREE;
-		vp->tval |= STR;
-#endif
+		vp->tval |= CONV;
 	}
 	   dprintf( (thread_stdout, "getsval %p: %s = \"%s (%p)\", t=%o\n", vp, NN(vp->nval), vp->sval, vp->sval, vp->tval) );
 	return(vp->sval);
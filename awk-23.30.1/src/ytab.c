@@ -2471,13 +2471,13 @@ int yyparse ();
 
 
 /* The look-ahead symbol.  */
-static int yychar;
+static __thread int yychar;
 
 /* The semantic value of the look-ahead symbol.  */
 __thread YYSTYPE yylval;
 
 /* Number of syntax errors so far.  */
-static int yynerrs;
+static __thread int yynerrs;
 
 
 
@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Character classes of the DFA: a leftmost match must not start at the
+# first char of the input when that char only shares a class with the
+# ones of the regular expression.
+#
+
+AWK=${AWK:-awk}
+STATUS=0
+
+check() {
+	r=`echo 'a12bb' | $AWK "$1" 2>&1`
+	s=$?
+	if [ "$r" != "$2" -o $s -ne 0 ] ; then
+		echo "ERROR awk '$1': got '$r' (status $s), expected '$2'" 1>&2
+		STATUS=1
+	fi
+}
+
+check '{ print match($0, /[12]/), RSTART, RLENGTH }'	'2 2 1'
+check '{ print match($0, /[0-9]+/), RSTART, RLENGTH }'	'2 2 2'
+check '{ sub(/[0-9]+/, "X"); print }'			'aXbb'
+check '{ gsub(/[0-9]/, "X"); print }'			'aXXbb'
+check '{ gsub(/(1|2)+/, "<&>"); print }'		'a<12>bb'
+check '{ print ($0 ~ /x|1/), ($0 ~ /^1/), ($0 ~ /^a1/) }'	'1 0 1'
+check '{ n = split($0, a, /[0-9]/); print n, a[1], a[2], a[3] }'	'3 a  bb'
+
+# The same with dynamic regular expressions, whose Nodes are freed with the program
+check '{ r = "[12]"; print match($0, r), RSTART, RLENGTH }'	'2 2 1'
+check '{ r = "[0-9]+"; sub(r, "X"); print }'		'aXbb'
+check '{ r = "[0-9]"; gsub(r, "X"); print }'		'aXXbb'
+check '{ r = "x|1"; print ($0 ~ r), ($0 !~ r) }'	'1 0'
+check '{ r = "[0-9]"; n = split($0, a, r); print n, a[1], a[3] }'	'3 a bb'
+
+exit $STATUS
@@ -40,15 +40,17 @@ __FBSDID("$FreeBSD$");
 
 int	 Nflag, Pflag, diff_rflag, Tflag, diff_cflag;
 static int     sflag;
-int	 diff_format, diff_context, status, ignore_file_case;
+int	 diff_format, diff_context, ignore_file_case;
+__thread int	 status;	/* per thread, for the -j workers */
 int	 tabsize = 8;
+unsigned int	 diff_jobs;	/* -j x: compare x files at once with -r */
 char	*start, *ifdefname, *diffargs, *diff_label[2], *ignore_pats;
 char	*group_format = NULL;
-struct stat stb1, stb2;
+__thread struct stat stb1, stb2;
 struct excludes *excludes_list;
 regex_t	 ignore_re;
 
-#define	OPTIONS	"0123456789aBbC:cdD:efHhI:iL:lnNPpqrS:sTtU:uwX:x:"
+#define	OPTIONS	"0123456789aBbC:cdD:efHhI:ij:L:lnNPpqrS:sTtU:uwX:x:"
 enum {
 	OPT_TSIZE = CHAR_MAX + 1,
 	OPT_STRIPCR,
@@ -57,6 +59,7 @@ enum {
 	OPT_NORMAL,
 	OPT_HORIZON_LINES,
 	OPT_CHANGED_GROUP_FORMAT,
+	OPT_DIFF_ALGORITHM,
 };
 
 static struct option longopts[] = {
@@ -70,6 +73,7 @@ static struct option longopts[] = {
 	{ "speed-large-files",		no_argument,		NULL,	'H' },
 	{ "ignore-matching-lines",	required_argument,	0,	'I' },
 	{ "ignore-case",		no_argument,		0,	'i' },
+	{ "jobs",			required_argument,	0,	'j' },
 	{ "paginate",			no_argument,		NULL,	'l' },
 	{ "label",			required_argument,	0,	'L' },
 	{ "new-file",			no_argument,		0,	'N' },
@@ -93,6 +97,7 @@ static struct option longopts[] = {
 	{ "strip-trailing-cr",		no_argument,		NULL,	OPT_STRIPCR },
 	{ "tabsize",			optional_argument,	NULL,	OPT_TSIZE },
 	{ "changed-group-format",	required_argument,	NULL,	OPT_CHANGED_GROUP_FORMAT},
+	{ "diff-algorithm",		required_argument,	NULL,	OPT_DIFF_ALGORITHM },
 	{ NULL,				0,			0,	'\0'}
 };
 
@@ -128,6 +133,7 @@ diff_main(int argc, char **argv)
     status = 0;
     ignore_file_case = 0;
     tabsize = 8;
+    diff_jobs = 1;
     start = NULL;
     ifdefname = NULL;
     diffargs = NULL;
@@ -190,7 +196,8 @@ diff_main(int argc, char **argv)
 			diff_format = D_REVERSE;
 			break;
 		case 'H':
-			/* ignore but needed for compatibility with GNU diff */
+			dflags &= ~D_ALG_STONE;
+			dflags |= D_ALG_MYERS;
 			break;
 		case 'h':
 			/* silently ignore for backwards compatibility */
@@ -201,6 +208,14 @@ diff_main(int argc, char **argv)
 		case 'i':
 			dflags |= D_IGNORECASE;
 			break;
+		case 'j':
+			l = strtol(optarg, &ep, 10);
+			if (*ep != '\0' || l < 1 || l > 256) {
+				warnx("Invalid argument for jobs");
+				usage();
+			}
+			diff_jobs = (unsigned int)l;
+			break;
 		case 'L':
 			if (diff_label[0] == NULL)
 				diff_label[0] = optarg;
@@ -268,6 +283,17 @@ diff_main(int argc, char **argv)
 			diff_format = D_GFORMAT;
 			group_format = optarg;
 			break;
+		case OPT_DIFF_ALGORITHM:
+			dflags &= ~(D_ALG_MYERS|D_ALG_STONE);
+			if (strcmp(optarg, "myers") == 0)
+				dflags |= D_ALG_MYERS;
+			else if (strcmp(optarg, "stone") == 0)
+				dflags |= D_ALG_STONE;
+			else if (strcmp(optarg, "auto") != 0) {
+				warnx("Invalid argument for diff-algorithm");
+				usage();
+			}
+			break;
 		case OPT_HORIZON_LINES:
 			break; /* XXX TODO for compatibility with GNU diff3 */
 		case OPT_IGN_FN_CASE:
@@ -482,8 +508,9 @@ void
 usage(void)
 {
 	(void)fprintf(thread_stderr,
-	    "usage: diff [-abdilpTtw] [-c | -e | -f | -n | -q | -u] [--ignore-case]\n"
+	    "usage: diff [-abdHilpTtw] [-c | -e | -f | -n | -q | -u] [--ignore-case]\n"
 	    "            [--no-ignore-case] [--normal] [--strip-trailing-cr] [--tabsize]\n"
+	    "            [--diff-algorithm=auto|myers|stone]\n"
 	    "            [-I pattern] [-L label] file1 file2\n"
 	    "       diff [-abdilpTtw] [-I pattern] [-L label] [--ignore-case]\n"
 	    "            [--no-ignore-case] [--normal] [--strip-trailing-cr] [--tabsize]\n"
@@ -495,7 +522,7 @@ usage(void)
 	    "            -U number file1 file2\n"
 	    "       diff [-abdilNPprsTtw] [-c | -e | -f | -n | -q | -u] [--ignore-case]\n"
 	    "            [--no-ignore-case] [--normal] [--tabsize] [-I pattern] [-L label]\n"
-	    "            [-S name] [-X file] [-x pattern] dir1 dir2\n");
+	    "            [-j jobs] [-S name] [-X file] [-x pattern] dir1 dir2\n");
 
 	exit(2);
 }
@@ -67,6 +67,8 @@
 #define D_EXPANDTABS		0x100	/* Expand tabs to spaces */
 #define D_IGNOREBLANKS		0x200	/* Ignore white space changes */
 #define D_STRIPCR		0x400	/* Strip trailing cr */
+#define D_ALG_MYERS		0x800	/* Always use the Myers engine */
+#define D_ALG_STONE		0x1000	/* Never use the Myers engine */
 
 /*
  * Status values for print_status() and diffreg() return values
@@ -85,11 +87,13 @@ struct excludes {
 };
 
 extern int	Nflag, Pflag, diff_rflag, Tflag, diff_cflag;
-extern int	diff_format, diff_context, status, ignore_file_case;
+extern int	diff_format, diff_context, ignore_file_case;
+extern __thread int	status;
 extern int	tabsize;
+extern unsigned int	diff_jobs;
 extern char	*start, *ifdefname, *diffargs, *diff_label[2], *ignore_pats;
 extern char	*group_format;
-extern struct	stat stb1, stb2;
+extern __thread struct	stat stb1, stb2;
 extern struct	excludes *excludes_list;
 extern regex_t	ignore_re;
 
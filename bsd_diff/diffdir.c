@@ -25,22 +25,271 @@ __FBSDID("$FreeBSD$");
 
 #include <sys/stat.h>
 
-#include <dirent.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <limits.h>
 
 #include "diff.h"
+#include "dirwalk.h"
+#include "xmalloc.h"
 #include "ios_error.h"
 
-static int selectfile(const struct dirent *);
-static void diffit(struct dirent *, char *, size_t, char *, size_t, int);
+static int selectfile(const char *);
+static int readentries(char *, struct dw_list *, char ***, int);
+static void diffit(const char *, char *, size_t, char *, size_t, int);
 
-#define d_status	d_type		/* we need to store status for -l */
+/*
+ * Parallel directory diff (-j): the tree is walked on the calling
+ * thread, and each pair of files to compare becomes a job for the
+ * worker threads, which run diffreg() with their output going to
+ * memory buffers.  Whatever the calling thread prints itself ("Only
+ * in", "Common subdirectories", warnings) is collected the same way
+ * between two jobs.  The buffers are written out in traversal order,
+ * so the output does not depend on scheduling.
+ */
+#define	DIFF_WINDOW	8	/* files in flight per worker */
+
+struct diff_job {
+	char		*path1, *path2;
+	struct stat	 sb1, sb2;
+	int		 flags;
+	char		*out, *errs;	/* buffered stdout and stderr */
+	size_t		 outlen, errlen;
+	int		 status;
+	int		 done;
+};
+
+struct diff_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* job queued, or end of traversal */
+	pthread_cond_t	 done;		/* job completed */
+	struct diff_job	*jobs;
+	size_t		 size;
+	size_t		 head;		/* next job to print */
+	size_t		 next;		/* next job to start */
+	size_t		 tail;		/* next free slot */
+	int		 finished;
+	unsigned int	 nthreads;
+	pthread_t	*threads;
+	FILE		*out, *errs;	/* the caller's thread_stdout/stderr */
+	FILE		*hold, *holderrs; /* the calling thread's own output */
+};
+
+static __thread struct diff_pool *pool;
+
+static void *
+diff_worker(void *arg)
+{
+	struct diff_pool *p = arg;
+	struct diff_job *job;
+	FILE *out, *errs;
+
+	for (;;) {
+		pthread_mutex_lock(&p->mtx);
+		while (p->next == p->tail && !p->finished)
+			pthread_cond_wait(&p->work, &p->mtx);
+		if (p->next == p->tail) {
+			pthread_mutex_unlock(&p->mtx);
+			break;
+		}
+		job = &p->jobs[p->next++ % p->size];
+		if (job->done) {
+			/* output of the calling thread, nothing to run */
+			pthread_mutex_unlock(&p->mtx);
+			continue;
+		}
+		pthread_mutex_unlock(&p->mtx);
+
+		if ((out = open_memstream(&job->out, &job->outlen)) == NULL ||
+		    (errs = open_memstream(&job->errs, &job->errlen)) == NULL)
+			err(2, "open_memstream");
+		thread_stdout = out;
+		thread_stderr = errs;
+		status = 0;
+		stb1 = job->sb1;
+		stb2 = job->sb2;
+
+		print_status(diffreg(job->path1, job->path2, job->flags, 0),
+		    job->path1, job->path2, "");
+		job->status = status;
+		fclose(out);
+		fclose(errs);
+
+		pthread_mutex_lock(&p->mtx);
+		job->done = 1;
+		pthread_cond_signal(&p->done);
+		pthread_mutex_unlock(&p->mtx);
+	}
+	return (NULL);
+}
+
+/*
+ * Writes out the completed jobs at the head of the window, waiting
+ * until no more than "keep" jobs are left in flight.
+ */
+static void
+diff_pool_print(struct diff_pool *p, size_t keep)
+{
+	struct diff_job *job;
+
+	pthread_mutex_lock(&p->mtx);
+	while (p->head != p->tail) {
+		job = &p->jobs[p->head % p->size];
+		if (!job->done) {
+			if (p->tail - p->head <= keep)
+				break;
+			pthread_cond_wait(&p->done, &p->mtx);
+			continue;
+		}
+		p->head++;
+		pthread_mutex_unlock(&p->mtx);
+
+		fwrite(job->errs, 1, job->errlen, p->errs);
+		fwrite(job->out, 1, job->outlen, p->out);
+		status |= job->status;
+		free(job->path1);
+		free(job->path2);
+		free(job->out);
+		free(job->errs);
+
+		pthread_mutex_lock(&p->mtx);
+	}
+	pthread_mutex_unlock(&p->mtx);
+}
+
+/*
+ * Start collecting what the calling thread prints into the free slot
+ * at the tail of the window.
+ */
+static void
+diff_pool_hold(struct diff_pool *p)
+{
+	struct diff_job *job;
+
+	/* Keep one slot free; the workers never touch it */
+	diff_pool_print(p, p->size - 1);
+	job = &p->jobs[p->tail % p->size];
+	memset(job, 0, sizeof(*job));
+	if ((p->hold = open_memstream(&job->out, &job->outlen)) == NULL ||
+	    (p->holderrs = open_memstream(&job->errs, &job->errlen)) == NULL)
+		err(2, "open_memstream");
+	thread_stdout = p->hold;
+	thread_stderr = p->holderrs;
+}
+
+/*
+ * Queue what the calling thread printed since diff_pool_hold(), if
+ * anything, as an already completed job.
+ */
+static void
+diff_pool_release(struct diff_pool *p)
+{
+	struct diff_job *job;
+
+	job = &p->jobs[p->tail % p->size];
+	fclose(p->hold);
+	fclose(p->holderrs);
+	thread_stdout = p->out;
+	thread_stderr = p->errs;
+	if (job->outlen == 0 && job->errlen == 0) {
+		free(job->out);
+		free(job->errs);
+		return;
+	}
+	pthread_mutex_lock(&p->mtx);
+	job->done = 1;
+	p->tail++;
+	pthread_mutex_unlock(&p->mtx);
+}
+
+static void
+diff_pool_add(struct diff_pool *p, const char *path1, const char *path2,
+    int flags)
+{
+	struct diff_job *job;
+
+	diff_pool_release(p);
+	diff_pool_print(p, p->size - 1);
+
+	job = &p->jobs[p->tail % p->size];
+	memset(job, 0, sizeof(*job));
+	job->path1 = xstrdup(path1);
+	job->path2 = xstrdup(path2);
+	job->sb1 = stb1;
+	job->sb2 = stb2;
+	job->flags = flags;
+
+	pthread_mutex_lock(&p->mtx);
+	p->tail++;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+
+	diff_pool_hold(p);
+}
+
+static struct diff_pool *
+diff_pool_create(void)
+{
+	struct diff_pool *p;
+	unsigned int i;
+
+	p = xcalloc(1, sizeof(*p));
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	p->size = (size_t)diff_jobs * DIFF_WINDOW;
+	p->jobs = xcalloc(p->size, sizeof(struct diff_job));
+	p->threads = xcalloc(diff_jobs, sizeof(pthread_t));
+	p->out = thread_stdout;
+	p->errs = thread_stderr;
+
+	for (i = 0; i < diff_jobs; i++) {
+		if (pthread_create(&p->threads[i], NULL, diff_worker, p) != 0)
+			break;
+		p->nthreads++;
+	}
+	if (p->nthreads == 0) {
+		pthread_cond_destroy(&p->done);
+		pthread_cond_destroy(&p->work);
+		pthread_mutex_destroy(&p->mtx);
+		free(p->threads);
+		free(p->jobs);
+		free(p);
+		return (NULL);
+	}
+	diff_pool_hold(p);
+	return (p);
+}
+
+static void
+diff_pool_finish(struct diff_pool *p)
+{
+	unsigned int i;
+
+	diff_pool_release(p);
+	pthread_mutex_lock(&p->mtx);
+	p->finished = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+
+	diff_pool_print(p, 0);
+	for (i = 0; i < p->nthreads; i++)
+		pthread_join(p->threads[i], NULL);
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->mtx);
+	free(p->threads);
+	free(p->jobs);
+	free(p);
+}
 
 /*
  * Diff directory traversal. Will be called recursively if -r was specified.
@@ -48,19 +297,28 @@ static void diffit(struct dirent *, char *, size_t, char *, size_t, int);
 void
 diffdir(char *p1, char *p2, int flags)
 {
-	struct dirent *dent1, **dp1, **edp1, **dirp1 = NULL;
-	struct dirent *dent2, **dp2, **edp2, **dirp2 = NULL;
+	struct dw_list dl1, dl2;
+	char **dirp1 = NULL, **dirp2 = NULL;
+	char **dp1, **edp1, **dp2, **edp2;
+	const char *dent1, *dent2;
 	size_t dirlen1, dirlen2;
 	char path1[PATH_MAX], path2[PATH_MAX];
-	int pos;
+	int pos, toplevel;
+
+	toplevel = 0;
+	if (pool == NULL && diff_rflag && diff_jobs > 1 &&
+	    (pool = diff_pool_create()) != NULL)
+		toplevel = 1;
 
+	memset(&dl1, 0, sizeof(dl1));
+	memset(&dl2, 0, sizeof(dl2));
 	edp1 = edp2 = NULL;
 
 	dirlen1 = strlcpy(path1, *p1 ? p1 : ".", sizeof(path1));
 	if (dirlen1 >= sizeof(path1) - 1) {
 		warnc(ENAMETOOLONG, "%s", p1);
 		status = 2;
-		return;
+		goto closem;
 	}
 	if (path1[dirlen1 - 1] != '/') {
 		path1[dirlen1++] = '/';
@@ -70,7 +328,7 @@ diffdir(char *p1, char *p2, int flags)
 	if (dirlen2 >= sizeof(path2) - 1) {
 		warnc(ENAMETOOLONG, "%s", p2);
 		status = 2;
-		return;
+		goto closem;
 	}
 	if (path2[dirlen2 - 1] != '/') {
 		path2[dirlen2++] = '/';
@@ -81,26 +339,18 @@ diffdir(char *p1, char *p2, int flags)
 	 * Get a list of entries in each directory, skipping "excluded" files
 	 * and sorting alphabetically.
 	 */
-	pos = scandir(path1, &dirp1, selectfile, alphasort);
+	pos = readentries(path1, &dl1, &dirp1, Nflag || Pflag);
 	if (pos == -1) {
-		if (errno == ENOENT && (Nflag || Pflag)) {
-			pos = 0;
-		} else {
-			warn("%s", path1);
-			goto closem;
-		}
+		warn("%s", path1);
+		goto closem;
 	}
 	dp1 = dirp1;
 	edp1 = dirp1 + pos;
 
-	pos = scandir(path2, &dirp2, selectfile, alphasort);
+	pos = readentries(path2, &dl2, &dirp2, Nflag);
 	if (pos == -1) {
-		if (errno == ENOENT && Nflag) {
-			pos = 0;
-		} else {
-			warn("%s", path2);
-			goto closem;
-		}
+		warn("%s", path2);
+		goto closem;
 	}
 	dp2 = dirp2;
 	edp2 = dirp2 + pos;
@@ -109,9 +359,9 @@ diffdir(char *p1, char *p2, int flags)
 	 * If we were given a starting point, find it.
 	 */
 	if (start != NULL) {
-		while (dp1 != edp1 && strcmp((*dp1)->d_name, start) < 0)
+		while (dp1 != edp1 && strcmp(*dp1, start) < 0)
 			dp1++;
-		while (dp2 != edp2 && strcmp((*dp2)->d_name, start) < 0)
+		while (dp2 != edp2 && strcmp(*dp2, start) < 0)
 			dp2++;
 	}
 
@@ -123,8 +373,8 @@ diffdir(char *p1, char *p2, int flags)
 		dent2 = dp2 != edp2 ? *dp2 : NULL;
 
 		pos = dent1 == NULL ? 1 : dent2 == NULL ? -1 :
-		    ignore_file_case ? strcasecmp(dent1->d_name, dent2->d_name) :
-		    strcmp(dent1->d_name, dent2->d_name) ;
+		    ignore_file_case ? strcasecmp(dent1, dent2) :
+		    strcmp(dent1, dent2) ;
 		if (pos == 0) {
 			/* file exists in both dirs, diff it */
 			diffit(dent1, path1, dirlen1, path2, dirlen2, flags);
@@ -136,8 +386,8 @@ diffdir(char *p1, char *p2, int flags)
 				diffit(dent1, path1, dirlen1, path2, dirlen2,
 				    flags);
 			else {
-				print_only(path1, dirlen1, dent1->d_name);
-				status = 1;
+				print_only(path1, dirlen1, dent1);
+				status |= 1;
 			}
 			dp1++;
 		} else {
@@ -146,35 +396,63 @@ diffdir(char *p1, char *p2, int flags)
 				diffit(dent2, path1, dirlen1, path2, dirlen2,
 				    flags);
 			else {
-				print_only(path2, dirlen2, dent2->d_name);
-				status = 1;
+				print_only(path2, dirlen2, dent2);
+				status |= 1;
 			}
 			dp2++;
 		}
 	}
 
 closem:
-	if (dirp1 != NULL) {
-		for (dp1 = dirp1; dp1 < edp1; dp1++)
-			free(*dp1);
-		free(dirp1);
+	free(dirp1);
+	free(dirp2);
+	dirwalk_free(&dl1);
+	dirwalk_free(&dl2);
+	if (toplevel) {
+		diff_pool_finish(pool);
+		pool = NULL;
 	}
-	if (dirp2 != NULL) {
-		for (dp2 = dirp2; dp2 < edp2; dp2++)
-			free(*dp2);
-		free(dirp2);
+}
+
+/*
+ * Read the names in directory path that pass selectfile() into *namesp,
+ * in strcmp() order, with dirwalk_read().  A missing directory reads as
+ * empty if missingok.  Returns the number of names, or -1.
+ */
+static int
+readentries(char *path, struct dw_list *dl, char ***namesp, int missingok)
+{
+	char **names;
+	size_t i;
+	int dfd, n, serrno;
+
+	*namesp = NULL;
+	if ((dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		return (errno == ENOENT && missingok ? 0 : -1);
+	if (dirwalk_read(dfd, DW_TYPE | DW_SORT, dl) == -1) {
+		serrno = errno;
+		(void)close(dfd);
+		errno = serrno;
+		return (-1);
 	}
+	(void)close(dfd);
+	names = xcalloc(dl->dl_count + 1, sizeof(*names));
+	for (i = 0, n = 0; i < dl->dl_count; i++)
+		if (selectfile(dl->dl_ents[i].de_name))
+			names[n++] = dl->dl_ents[i].de_name;
+	*namesp = names;
+	return (n);
 }
 
 /*
  * Do the actual diff by calling either diffreg() or diffdir().
  */
 static void
-diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
+diffit(const char *name, char *path1, size_t plen1, char *path2, size_t plen2,
     int flags)
 {
 	flags |= D_HEADER;
-	strlcpy(path1 + plen1, dp->d_name, PATH_MAX - plen1);
+	strlcpy(path1 + plen1, name, PATH_MAX - plen1);
 	if (stat(path1, &stb1) != 0) {
 		if (!(Nflag || Pflag) || errno != ENOENT) {
 			warn("%s", path1);
@@ -184,7 +462,7 @@ diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
 		memset(&stb1, 0, sizeof(stb1));
 	}
 
-	strlcpy(path2 + plen2, dp->d_name, PATH_MAX - plen2);
+	strlcpy(path2 + plen2, name, PATH_MAX - plen2);
 	if (stat(path2, &stb2) != 0) {
 		if (!Nflag || errno != ENOENT) {
 			warn("%s", path2);
@@ -206,12 +484,14 @@ diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
 		return;
 	}
 	if (!S_ISREG(stb1.st_mode) && !S_ISDIR(stb1.st_mode))
-		dp->d_status = D_SKIPPED1;
+		print_status(D_SKIPPED1, path1, path2, "");
 	else if (!S_ISREG(stb2.st_mode) && !S_ISDIR(stb2.st_mode))
-		dp->d_status = D_SKIPPED2;
+		print_status(D_SKIPPED2, path1, path2, "");
+	else if (pool != NULL)
+		diff_pool_add(pool, path1, path2, flags);
 	else
-		dp->d_status = diffreg(path1, path2, flags, 0);
-	print_status(dp->d_status, path1, path2, "");
+		print_status(diffreg(path1, path2, flags, 0), path1, path2,
+		    "");
 }
 
 /*
@@ -219,21 +499,18 @@ diffit(struct dirent *dp, char *path1, size_t plen1, char *path2, size_t plen2,
  * diff, else 0.  Checks the excludes list.
  */
 static int
-selectfile(const struct dirent *dp)
+selectfile(const char *name)
 {
 	struct excludes *excl;
 
-	if (dp->d_fileno == 0)
-		return (0);
-
 	/* always skip "." and ".." */
-	if (dp->d_name[0] == '.' && (dp->d_name[1] == '\0' ||
-	    (dp->d_name[1] == '.' && dp->d_name[2] == '\0')))
+	if (name[0] == '.' && (name[1] == '\0' ||
+	    (name[1] == '.' && name[2] == '\0')))
 		return (0);
 
 	/* check excludes list */
 	for (excl = excludes_list; excl != NULL; excl = excl->next)
-		if (fnmatch(excl->pattern, dp->d_name, FNM_PATHNAME) == 0)
+		if (fnmatch(excl->pattern, name, FNM_PATHNAME) == 0)
 			return (0);
 
 	return (1);
@@ -71,6 +71,7 @@ __FBSDID("$FreeBSD$");
 
 // #include <sys/capsicum.h>
 // #include <sys/procdesc.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/event.h>
@@ -94,6 +95,7 @@ __FBSDID("$FreeBSD$");
 #include <time.h>
 
 #include "diff.h"
+#include "filecmp.h"
 #include "xmalloc.h"
 #include "ios_error.h"
 
@@ -167,15 +169,32 @@ __FBSDID("$FreeBSD$");
  *	are (in words) 2*length(file0) + length(file1) +
  *	3*(number of k-candidates installed),  typically about
  *	6n words for files of length n.
+ *
+ *	stone() degrades badly when the files are large and share
+ *	many equal lines (blank lines, braces, generated text): the
+ *	number of k-candidates explodes.  For those inputs, or when
+ *	asked to with -H / --diff-algorithm=myers, the match vector
+ *	is instead computed by myers(), a linear-space O((N+M)D)
+ *	divide-and-conquer search for the middle snake (E. Myers,
+ *	"An O(ND) Difference Algorithm and Its Variations", 1986).
+ *	Lines that occur in only one of the files can never match
+ *	and are discarded before the search, so two large, mostly
+ *	unrelated files cost little more than reading them.
  */
 
+/*
+ * Above this many lines left after pruning the common prefix and
+ * suffix, myers() is used unless --diff-algorithm=stone was given.
+ */
+#define	MYERS_AUTO_LINES	32768
+
 struct cand {
 	int	x;
 	int	y;
 	int	pred;
 };
 
-static struct line {
+static __thread struct line {
 	int	serial;
 	int	value;
 } *file[2];
@@ -217,35 +236,37 @@ static int	 search(int *, int, int);
 static int	 skipline(FILE *);
 static int	 isqrt(int);
 static int	 stone(int *, int, int *, int *, int);
+static void	 myers(int);
 static int	 readhash(FILE *, int);
+static int	 readhash_mem(const char **, const char *, int);
 static int	 files_differ(FILE *, FILE *, int);
 static char	*match_function(const long *, int, FILE *);
 static char	*preadline(int, size_t, off_t);
 
-static int  *J;			/* will be overlaid on class */
-static int  *class;		/* will be overlaid on file[0] */
-static int  *klist;		/* will be overlaid on file[0] after class */
-static int  *member;		/* will be overlaid on file[1] */
-static int   clen;
-static int   inifdef;		/* whether or not we are in a #ifdef block */
-static int   len[2];
-static int   pref, suff;	/* length of prefix and suffix */
-static int   slen[2];
-static int   anychange;
-static long *ixnew;		/* will be overlaid on file[1] */
-static long *ixold;		/* will be overlaid on klist */
-static struct cand *clist;	/* merely a free storage pot for candidates */
-static int   clistlen;		/* the length of clist */
-static struct line *sfile[2];	/* shortened by pruning common prefix/suffix */
-static int (*chrtran)(int);	/* translation table for case-folding */
-static struct context_vec *context_vec_start;
-static struct context_vec *context_vec_end;
-static struct context_vec *context_vec_ptr;
+static __thread int  *J;			/* will be overlaid on class */
+static __thread int  *class;		/* will be overlaid on file[0] */
+static __thread int  *klist;		/* will be overlaid on file[0] after class */
+static __thread int  *member;		/* will be overlaid on file[1] */
+static __thread int   clen;
+static __thread int   inifdef;		/* whether or not we are in a #ifdef block */
+static __thread int   len[2];
+static __thread int   pref, suff;	/* length of prefix and suffix */
+static __thread int   slen[2];
+static __thread int   anychange;
+static __thread long *ixnew;		/* will be overlaid on file[1] */
+static __thread long *ixold;		/* will be overlaid on klist */
+static __thread struct cand *clist;	/* merely a free storage pot for candidates */
+static __thread int   clistlen;		/* the length of clist */
+static __thread struct line *sfile[2];	/* shortened by pruning common prefix/suffix */
+static __thread int (*chrtran)(int);	/* translation table for case-folding */
+static __thread struct context_vec *context_vec_start;
+static __thread struct context_vec *context_vec_end;
+static __thread struct context_vec *context_vec_ptr;
 
 #define FUNCTION_CONTEXT_SIZE	55
-static char lastbuf[FUNCTION_CONTEXT_SIZE];
-static int lastline;
-static int lastmatchline;
+static __thread char lastbuf[FUNCTION_CONTEXT_SIZE];
+static __thread int lastline;
+static __thread int lastmatchline;
 
 static int
 clow2low(int c)
@@ -449,29 +470,36 @@ diffreg(char *file1, char *file2, int flags, int capsicum)
 	prepare(1, f2, stb2.st_size, flags);
 
 	prune();
-	sort(sfile[0], slen[0]);
-	sort(sfile[1], slen[1]);
-
-	member = (int *)file[1];
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	member = xreallocarray(member, slen[1] + 2, sizeof(*member));
-
-	class = (int *)file[0];
-	unsort(sfile[0], slen[0], class);
-	class = xreallocarray(class, slen[0] + 2, sizeof(*class));
-
-	klist = xcalloc(slen[0] + 2, sizeof(*klist));
-	clen = 0;
-	clistlen = 100;
-	clist = xcalloc(clistlen, sizeof(*clist));
-	i = stone(class, slen[0], member, klist, flags);
-	free(member);
-	free(class);
-
-	J = xreallocarray(J, len[0] + 2, sizeof(*J));
-	unravel(klist[i]);
-	free(clist);
-	free(klist);
+	if ((flags & D_ALG_MYERS) || ((flags & D_ALG_STONE) == 0 &&
+	    slen[0] + slen[1] > MYERS_AUTO_LINES)) {
+		myers(flags);
+		free(file[0]);
+		free(file[1]);
+	} else {
+		sort(sfile[0], slen[0]);
+		sort(sfile[1], slen[1]);
+
+		member = (int *)file[1];
+		equiv(sfile[0], slen[0], sfile[1], slen[1], member);
+		member = xreallocarray(member, slen[1] + 2, sizeof(*member));
+
+		class = (int *)file[0];
+		unsort(sfile[0], slen[0], class);
+		class = xreallocarray(class, slen[0] + 2, sizeof(*class));
+
+		klist = xcalloc(slen[0] + 2, sizeof(*klist));
+		clen = 0;
+		clistlen = 100;
+		clist = xcalloc(clistlen, sizeof(*clist));
+		i = stone(class, slen[0], member, klist, flags);
+		free(member);
+		free(class);
+
+		J = xreallocarray(J, len[0] + 2, sizeof(*J));
+		unravel(klist[i]);
+		free(clist);
+		free(klist);
+	}
 
 	ixold = xreallocarray(ixold, len[0] + 2, sizeof(*ixold));
 	ixnew = xreallocarray(ixnew, len[1] + 2, sizeof(*ixnew));
@@ -499,6 +527,14 @@ diffreg(char *file1, char *file2, int flags, int capsicum)
 	}
 
 closem:
+	/* diffreg() runs once per file under -r: don't carry these over */
+	free(context_vec_start);
+	context_vec_start = context_vec_end = NULL;
+	free(J);
+	free(ixold);
+	free(ixnew);
+	J = NULL;
+	ixold = ixnew = NULL;
 	if (anychange) {
 		status |= 1;
 		if (rval == D_SAME)
@@ -515,28 +551,21 @@ closem:
 /*
  * Check to see if the given files differ.
  * Returns 0 if they are the same, 1 if different, and -1 on error.
- * XXX - could use code from cmp(1) [faster]
  */
 static int
 files_differ(FILE *f1, FILE *f2, int flags)
 {
-	char buf1[BUFSIZ], buf2[BUFSIZ];
-	size_t i, j;
 
 	if ((flags & (D_EMPTY1|D_EMPTY2)) || stb1.st_size != stb2.st_size ||
 	    (stb1.st_mode & S_IFMT) != (stb2.st_mode & S_IFMT))
 		return (1);
-	for (;;) {
-		i = fread(buf1, 1, sizeof(buf1), f1);
-		j = fread(buf2, 1, sizeof(buf2), f2);
-		if ((!i && ferror(f1)) || (!j && ferror(f2)))
-			return (-1);
-		if (i != j)
-			return (1);
-		if (i == 0)
-			return (0);
-		if (memcmp(buf1, buf2, i) != 0)
-			return (1);
+	switch (filecmp_fd(fileno(f1), fileno(f2), FC_QUICK, NULL)) {
+	case FC_SAME:
+		return (0);
+	case FC_DIFFER:
+		return (1);
+	default:
+		return (-1);
 	}
 }
 
@@ -592,11 +621,36 @@ static void
 prepare(int i, FILE *fd, size_t filesize, int flags)
 {
 	struct line *p;
+	struct stat st;
+	const char *base, *cp, *ep;
 	int h;
 	size_t sz, j;
 
 	rewind(fd);
 
+	/*
+	 * Regular files are hashed straight from an mmap()ed image
+	 * rather than a getc() at a time, and the newline count sizes
+	 * file[i] exactly.
+	 */
+	if (fstat(fileno(fd), &st) == 0 && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && (uintmax_t)st.st_size <= SIZE_MAX &&
+	    (base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+	    fileno(fd), 0)) != MAP_FAILED) {
+		ep = base + st.st_size;
+		for (sz = 1, cp = base;
+		    (cp = memchr(cp, '\n', ep - cp)) != NULL; cp++)
+			sz++;
+		p = xcalloc(sz + 3, sizeof(*p));
+		cp = base;
+		for (j = 0; j < sz && (h = readhash_mem(&cp, ep, flags));)
+			p[++j].value = h;
+		munmap((void *)base, (size_t)st.st_size);
+		len[i] = j;
+		file[i] = p;
+		return;
+	}
+
 	sz = MIN(filesize, SIZE_MAX) / 25;
 	if (sz < 100)
 		sz = 100;
@@ -782,6 +836,239 @@ unravel(int p)
 		J[q->x + pref] = q->y + pref;
 }
 
+/*
+ * Linear-space Myers engine.  The two pruned files are reduced to
+ * the lines that have an equal in the other file (ma[], mb[] hold
+ * their hashes, xa[], yb[] their serials in sfile[]); matched pairs
+ * found by myers_compare() are written straight into J.
+ */
+struct myers_ctx {
+	int	*ma, *mb;	/* hashes of the lines that may match */
+	int	*xa, *yb;	/* their serials in sfile[0], sfile[1] */
+	int	*fd, *bd;	/* furthest reaching x, by diagonal */
+	int	 limit;		/* edit cost before giving up on optimality */
+};
+
+struct myers_part {
+	int	xmid, ymid;
+};
+
+/*
+ * Find the midpoint of the shortest edit script for
+ * ma[xoff, xlim) and mb[yoff, ylim).  Unless -d was given, a search
+ * that runs past ctx->limit edits settles for the diagonal that got
+ * furthest, which keeps pathological inputs close to linear.
+ */
+static void
+myers_split(struct myers_ctx *ctx, int xoff, int xlim, int yoff, int ylim,
+    int minimal, struct myers_part *part)
+{
+	int *const fd = ctx->fd, *const bd = ctx->bd;
+	const int *a = ctx->ma, *b = ctx->mb;
+	const int dmin = xoff - ylim, dmax = xlim - yoff;
+	const int fmid = xoff - yoff, bmid = xlim - ylim;
+	int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+	int odd = (fmid - bmid) & 1;
+	int c, d, x, y, tlo, thi;
+	int fxybest, fxbest, bxybest, bxbest;
+
+	fd[fmid] = xoff;
+	bd[bmid] = xlim;
+	for (c = 1;; c++) {
+		if (fmin > dmin)
+			fd[--fmin - 1] = -1;
+		else
+			++fmin;
+		if (fmax < dmax)
+			fd[++fmax + 1] = -1;
+		else
+			--fmax;
+		for (d = fmax; d >= fmin; d -= 2) {
+			tlo = fd[d - 1];
+			thi = fd[d + 1];
+			x = tlo >= thi ? tlo + 1 : thi;
+			y = x - d;
+			while (x < xlim && y < ylim && a[x] == b[y]) {
+				x++;
+				y++;
+			}
+			fd[d] = x;
+			if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+				part->xmid = x;
+				part->ymid = y;
+				return;
+			}
+		}
+
+		if (bmin > dmin)
+			bd[--bmin - 1] = INT_MAX;
+		else
+			++bmin;
+		if (bmax < dmax)
+			bd[++bmax + 1] = INT_MAX;
+		else
+			--bmax;
+		for (d = bmax; d >= bmin; d -= 2) {
+			tlo = bd[d - 1];
+			thi = bd[d + 1];
+			x = tlo < thi ? tlo : thi - 1;
+			y = x - d;
+			while (x > xoff && y > yoff && a[x - 1] == b[y - 1]) {
+				x--;
+				y--;
+			}
+			bd[d] = x;
+			if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+				part->xmid = x;
+				part->ymid = y;
+				return;
+			}
+		}
+
+		if (minimal || c < ctx->limit)
+			continue;
+
+		fxybest = -1;
+		fxbest = xoff;
+		for (d = fmax; d >= fmin; d -= 2) {
+			x = MIN(fd[d], xlim);
+			y = x - d;
+			if (ylim < y) {
+				x = ylim + d;
+				y = ylim;
+			}
+			if (fxybest < x + y) {
+				fxybest = x + y;
+				fxbest = x;
+			}
+		}
+		bxybest = INT_MAX;
+		bxbest = xlim;
+		for (d = bmax; d >= bmin; d -= 2) {
+			x = MAX(xoff, bd[d]);
+			y = x - d;
+			if (y < yoff) {
+				x = yoff + d;
+				y = yoff;
+			}
+			if (x + y < bxybest) {
+				bxybest = x + y;
+				bxbest = x;
+			}
+		}
+		if ((xlim + ylim) - bxybest < fxybest - (xoff + yoff)) {
+			part->xmid = fxbest;
+			part->ymid = fxybest - fxbest;
+		} else {
+			part->xmid = bxbest;
+			part->ymid = bxybest - bxbest;
+		}
+		return;
+	}
+}
+
+static void
+myers_compare(struct myers_ctx *ctx, int xoff, int xlim, int yoff, int ylim,
+    int minimal)
+{
+	struct myers_part part;
+
+	/* the second half is handled by looping, the first by recursion */
+	for (;;) {
+		while (xoff < xlim && yoff < ylim &&
+		    ctx->ma[xoff] == ctx->mb[yoff]) {
+			J[ctx->xa[xoff] + pref] = ctx->yb[yoff] + pref;
+			xoff++;
+			yoff++;
+		}
+		while (xlim > xoff && ylim > yoff &&
+		    ctx->ma[xlim - 1] == ctx->mb[ylim - 1]) {
+			xlim--;
+			ylim--;
+			J[ctx->xa[xlim] + pref] = ctx->yb[ylim] + pref;
+		}
+		if (xoff == xlim || yoff == ylim)
+			return;
+		myers_split(ctx, xoff, xlim, yoff, ylim, minimal, &part);
+		myers_compare(ctx, xoff, part.xmid, yoff, part.ymid, minimal);
+		xoff = part.xmid;
+		yoff = part.ymid;
+	}
+}
+
+static void
+myers(int flags)
+{
+	struct myers_ctx ctx;
+	struct line *p;
+	int *seen, *v;
+	u_int mask, h;
+	int i, j, n, m, size;
+
+	J = xreallocarray(J, len[0] + 2, sizeof(*J));
+	for (i = 0; i <= len[0]; i++)
+		J[i] = i <= pref ? i :
+		    i > len[0] - suff ? i + len[1] - len[0] : 0;
+
+	/*
+	 * Open-addressed set of hash values: bit 0 of seen[] marks a
+	 * value present in file0, bit 1 one present in file1.  Hash 0
+	 * never comes out of readhash(), so it marks an empty slot.
+	 */
+	for (size = 64; size < 2 * (slen[0] + slen[1]); size *= 2)
+		;
+	mask = size - 1;
+	v = xcalloc(size, sizeof(*v));
+	seen = xcalloc(size, sizeof(*seen));
+	for (i = 0; i < 2; i++) {
+		p = sfile[i];
+		for (j = 1; j <= slen[i]; j++) {
+			for (h = (u_int)p[j].value * 2654435761U & mask;
+			    v[h] != 0 && v[h] != p[j].value; h = (h + 1) & mask)
+				;
+			v[h] = p[j].value;
+			seen[h] |= 1 << i;
+		}
+	}
+
+	ctx.ma = xcalloc(slen[0] + 1, sizeof(int));
+	ctx.xa = xcalloc(slen[0] + 1, sizeof(int));
+	ctx.mb = xcalloc(slen[1] + 1, sizeof(int));
+	ctx.yb = xcalloc(slen[1] + 1, sizeof(int));
+	m = 0;
+	for (i = 0; i < 2; i++) {
+		p = sfile[i];
+		for (n = 0, j = 1; j <= slen[i]; j++) {
+			for (h = (u_int)p[j].value * 2654435761U & mask;
+			    v[h] != p[j].value; h = (h + 1) & mask)
+				;
+			if (seen[h] != 3)
+				continue;
+			(i == 0 ? ctx.ma : ctx.mb)[n] = p[j].value;
+			(i == 0 ? ctx.xa : ctx.yb)[n] = j;
+			n++;
+		}
+		if (i == 0)
+			m = n;
+	}
+	free(seen);
+	free(v);
+
+	/* m lines of file0 and n lines of file1 are left to align */
+	ctx.fd = xcalloc(2 * ((size_t)m + n + 3), sizeof(int));
+	ctx.bd = ctx.fd + m + n + 3;
+	ctx.fd += n + 1;
+	ctx.bd += n + 1;
+	ctx.limit = MAX(256, isqrt(m + n) * 4);
+	myers_compare(&ctx, 0, m, 0, n, (flags & D_MINIMAL) != 0);
+
+	free(ctx.fd - (n + 1));
+	free(ctx.ma);
+	free(ctx.xa);
+	free(ctx.mb);
+	free(ctx.yb);
+}
+
 /*
  * Check does double duty:
  *  1.	ferret out any fortuitous correspondences due
@@ -1071,7 +1358,7 @@ static void
 change(char *file1, FILE *f1, char *file2, FILE *f2, int a, int b, int c, int d,
     int *pflags)
 {
-	static size_t max_context = 64;
+	static __thread size_t max_context = 64;
 	long curpos;
 	int i, nc, f;
 	const char *walk;
@@ -1116,7 +1403,9 @@ proceed:
 		 */
 		if (context_vec_ptr == context_vec_end - 1) {
 			ptrdiff_t offset = context_vec_ptr - context_vec_start;
-			max_context <<= 1;
+			/* diffreg() starts every file with no vector */
+			max_context = context_vec_start == NULL ? 64 :
+			    max_context << 1;
 			context_vec_start = xreallocarray(context_vec_start,
 			    max_context, sizeof(*context_vec_start));
 			context_vec_end = context_vec_start + max_context;
@@ -1388,6 +1677,75 @@ readhash(FILE *f, int flags)
 	return (sum == 0 ? 1 : sum);
 }
 
+/*
+ * readhash() over an in-memory image: hashes the line at *pp, advances
+ * *pp past it and returns 0 once ep is reached.  Must hash exactly as
+ * readhash() does, since the other file may have gone through stdio.
+ */
+static int
+readhash_mem(const char **pp, const char *ep, int flags)
+{
+	const char *cp;
+	int i, t, space;
+	int sum;
+
+#define	MGETC()	(cp < ep ? (unsigned char)*cp++ : EOF)
+	cp = *pp;
+	sum = 1;
+	space = 0;
+	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) == 0) {
+		for (i = 0; (t = MGETC()) != '\n'; i++) {
+			if (flags & D_STRIPCR && t == '\r') {
+				t = MGETC();
+				if (t == '\n')
+					break;
+				if (t != EOF)
+					cp--;
+			}
+			if (t == EOF) {
+				if (i == 0) {
+					*pp = cp;
+					return (0);
+				}
+				break;
+			}
+			sum = sum * 127 + chrtran(t);
+		}
+	} else {
+		for (i = 0;;) {
+			switch (t = MGETC()) {
+			case '\r':
+			case '\t':
+			case '\v':
+			case '\f':
+			case ' ':
+				space++;
+				continue;
+			default:
+				if (space && (flags & D_IGNOREBLANKS) == 0) {
+					i++;
+					space = 0;
+				}
+				sum = sum * 127 + chrtran(t);
+				i++;
+				continue;
+			case EOF:
+				if (i == 0) {
+					*pp = cp;
+					return (0);
+				}
+				/* FALLTHROUGH */
+			case '\n':
+				break;
+			}
+			break;
+		}
+	}
+#undef MGETC
+	*pp = cp;
+	return (sum == 0 ? 1 : sum);
+}
+
 static int
 asciifile(FILE *f)
 {
@@ -115,9 +115,13 @@ exec_f	f_size;
 exec_f	f_sparse;
 exec_f	f_type;
 exec_f	f_user;
+#ifdef __APPLE__
+exec_f	f_xattr;
+exec_f	f_xattrname;
+#endif
 
 extern int ftsoptions, ignore_readdir_race, isdepth, isoutput;
-extern int issort, isxargs;
+extern int issort, isxargs, isunordered, numjobs;
 extern int mindepth, maxdepth;
 extern int regexp_flags;
 extern int exitstatus;
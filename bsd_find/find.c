@@ -42,22 +42,41 @@ static char sccsid[] = "@(#)find.c	8.5 (Berkeley) 8/5/94";
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD$");
 
+#include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "find.h"
+#include "dirwalk.h"
 #include "ios_error.h"
 
 
 static int find_compare(const FTSENT * const *s1, const FTSENT * const *s2);
+static int plan_stat(PLAN *, int);
+static int entry_stat(FTSENT *, struct stat *);
+static int plan_mt(PLAN *);
+static int find_execute_mt(PLAN *, char **);
+
+/*
+ * For a walk that leaves the stat'ing to the primaries; where fts can,
+ * it still tells the file type in fts_statp.
+ */
+#ifdef FTS_NOSTAT_TYPE
+#define	FTS_LAZYSTAT	(FTS_NOSTAT | FTS_NOSTAT_TYPE)
+#else
+#define	FTS_LAZYSTAT	FTS_NOSTAT
+#endif
 
 /*
  * find_compare --
@@ -169,6 +188,50 @@ find_formplan(char *argv[])
 
 FTS *tree;			/* pointer to top of FTS hierarchy */
 
+/*
+ * Flag the operators with an operand that looks at fts_statp F_NEEDSTAT
+ * too, since they are evaluated below the loops that check the flag, and
+ * clear it for -type when the type is known without a stat.  Returns
+ * whether any node of plan needs one.
+ */
+static int
+plan_stat(PLAN *plan, int typeknown)
+{
+	PLAN *p;
+	int i, need;
+
+	need = 0;
+	for (p = plan; p != NULL; p = p->next) {
+		if (p->execute == f_type &&
+		    (typeknown || p->m_data == S_IFDIR))
+			p->flags &= ~F_NEEDSTAT;
+		else if (p->execute == f_expr || p->execute == f_not ||
+		    p->execute == f_or) {
+			for (i = 0; i < (p->execute == f_or ? 2 : 1); i++)
+				if (plan_stat(p->p_data[i], typeknown))
+					p->flags |= F_NEEDSTAT;
+		}
+		if (p->flags & F_NEEDSTAT)
+			need = 1;
+	}
+	return (need);
+}
+
+/* Stat entry as fts would have, for a node flagged F_NEEDSTAT. */
+static int
+entry_stat(FTSENT *entry, struct stat *sb)
+{
+
+	if (ftsoptions & FTS_LOGICAL ||
+	    (entry->fts_level == 0 && ftsoptions & FTS_COMFOLLOW)) {
+		if (stat(entry->fts_accpath, sb) == 0)
+			return (0);
+		if (errno != ENOENT)
+			return (-1);
+	}
+	return (lstat(entry->fts_accpath, sb));
+}
+
 /*
  * find_execute --
  *	take a search plan and an array of search paths and executes the plan
@@ -179,7 +242,28 @@ find_execute(PLAN *plan, char *paths[])
 {
 	FTSENT *entry;
 	PLAN *p;
-	int e;
+	struct stat sb, *statp;
+	int e, lazystat;
+
+	if (numjobs > 1 && !isdepth && !issort &&
+	    !(ftsoptions & (FTS_LOGICAL | FTS_XDEV)) && plan_mt(plan))
+		return (find_execute_mt(plan, paths));
+
+	/*
+	 * Unless the first node of a physical walk needs it anyway, have
+	 * fts stat only the directories, and an entry stat'ed once its
+	 * evaluation reaches a node that looks at fts_statp: for
+	 * "-name '*.c' -size +1", only the C files are, and for "-type d"
+	 * none.
+	 */
+	lazystat = 0;
+	if (!(ftsoptions & FTS_LOGICAL)) {
+		lazystat = plan_stat(plan, FTS_LAZYSTAT != FTS_NOSTAT);
+		if (plan->flags & F_NEEDSTAT)
+			lazystat = 0;
+		else
+			ftsoptions |= FTS_LAZYSTAT;
+	}
 
 	tree = fts_open(paths, ftsoptions, (issort ? find_compare : NULL));
 	if (tree == NULL)
@@ -234,7 +318,28 @@ find_execute(PLAN *plan, char *paths[])
 		 * false or all have been executed.  This is where we do all
 		 * the work specified by the user on the command line.
 		 */
-		for (p = plan; p && (p->execute)(p, entry); p = p->next);
+		if (!lazystat) {
+			for (p = plan; p && (p->execute)(p, entry); p = p->next);
+			continue;
+		}
+		statp = entry->fts_statp;
+		for (p = plan; p != NULL; p = p->next) {
+			if (p->flags & F_NEEDSTAT && entry->fts_statp != &sb) {
+				if (entry_stat(entry, &sb) == -1) {
+					if (ignore_readdir_race && errno == ENOENT &&
+					    entry->fts_level > 0)
+						break;
+					(void)fflush(stdout);
+					warn("%s", entry->fts_path);
+					exitstatus = 1;
+					break;
+				}
+				entry->fts_statp = &sb;
+			}
+			if (!(p->execute)(p, entry))
+				break;
+		}
+		entry->fts_statp = statp;
 	}
 	e = errno;
 	finish_execplus();
@@ -242,3 +347,411 @@ find_execute(PLAN *plan, char *paths[])
 		errc(1, e, "fts_read");
 	return (exitstatus);
 }
+
+/*
+ * The -j walk.  Directories are read with dirwalk_read() and handed out
+ * to numjobs threads, each of which evaluates the plan on the entries of
+ * its directory.  It is only taken for a physical, pre-order, unsorted
+ * walk that stays away from -exec, -ls, -delete and the other primaries
+ * that are not in mt_safe[]; find_execute() uses fts otherwise.
+ *
+ * As in the fts walk, an entry is stat'ed only once the evaluation
+ * reaches a primary that looks at fts_statp; -type is answered from the
+ * directory alone here.  Each directory's output is kept in memory: unless -U,
+ * it is then written out in the order fts would have used, by a thread
+ * that follows the tree as its directories are completed.
+ */
+static exec_f *const mt_safe[] = {
+	f_Xmin, f_Xtime, f_always_true, f_depth, f_empty, f_expr, f_false,
+#if HAVE_STRUCT_STAT_ST_FLAGS
+	f_flags,
+#endif
+	f_group, f_inum, f_links, f_name, f_newer, f_not, f_or, f_path,
+	f_perm, f_print, f_print0, f_prune, f_regex, f_size, f_sparse,
+	f_type, f_user,
+#ifdef __APPLE__
+	f_xattr, f_xattrname,
+#endif
+};
+
+#define	WALK_CHUNK	65536	/* -U output is written out in chunks of */
+
+struct wseg {			/* output, followed by the subtree of child */
+	char *buf;
+	size_t len;
+	struct wdir *child;
+};
+
+struct wdir {
+	char *path;
+	size_t pathlen;
+	int level;
+	int done;		/* segs are complete */
+	struct wseg *segs;
+	size_t nsegs;
+	size_t nalloc;
+};
+
+struct wbuf {			/* the output of a thread, as it comes */
+	FILE *fp;
+	char *buf;
+	size_t len;
+};
+
+struct find_walk {
+	struct dw_pool pool;
+	PLAN *plan;
+	int want;		/* For dirwalk_read() */
+	pthread_mutex_t mtx;	/* out, exitstatus, wdir.done */
+	pthread_cond_t done;
+	FILE *out;
+	struct wdir *top;	/* The paths given */
+};
+
+/* Can several threads evaluate plan at once? */
+static int
+plan_mt(PLAN *plan)
+{
+	PLAN *p;
+	size_t i;
+
+	for (p = plan; p != NULL; p = p->next) {
+		for (i = 0; i < sizeof(mt_safe) / sizeof(mt_safe[0]); i++)
+			if (p->execute == mt_safe[i])
+				break;
+		if (i == sizeof(mt_safe) / sizeof(mt_safe[0]))
+			return (0);
+		if (p->execute != f_expr && p->execute != f_not &&
+		    p->execute != f_or)
+			continue;
+		for (i = 0; i < (p->execute == f_or ? 2 : 1); i++)
+			if (!plan_mt(p->p_data[i]))
+				return (0);
+	}
+	return (1);
+}
+
+static void
+walk_warn(struct find_walk *fw, int level, const char *path, int error)
+{
+
+	if (ignore_readdir_race && error == ENOENT && level > 0)
+		return;
+	pthread_mutex_lock(&fw->mtx);
+	warnx("%s: %s", path, strerror(error));
+	exitstatus = 1;
+	pthread_mutex_unlock(&fw->mtx);
+}
+
+static void
+wbuf_open(struct wbuf *wb)
+{
+
+	if ((wb->fp = open_memstream(&wb->buf, &wb->len)) == NULL)
+		err(1, "open_memstream");
+	thread_stdout = wb->fp;
+}
+
+/*
+ * Done with wb: keep its output in d, ahead of the subtree of child,
+ * or write it out right away with -U.
+ */
+static void
+wbuf_close(struct find_walk *fw, struct wbuf *wb, struct wdir *d,
+    struct wdir *child)
+{
+	struct wseg *seg;
+
+	thread_stdout = fw->out;
+	if (fclose(wb->fp) != 0)
+		err(1, NULL);
+	if (isunordered) {
+		if (wb->len > 0) {
+			pthread_mutex_lock(&fw->mtx);
+			(void)fwrite(wb->buf, 1, wb->len, fw->out);
+			pthread_mutex_unlock(&fw->mtx);
+		}
+		free(wb->buf);
+		return;
+	}
+	if (d->nsegs == d->nalloc) {
+		d->nalloc = d->nalloc ? d->nalloc * 2 : 8;
+		if ((d->segs = reallocf(d->segs,
+		    d->nalloc * sizeof(*d->segs))) == NULL)
+			err(1, NULL);
+	}
+	seg = &d->segs[d->nsegs++];
+	seg->buf = wb->buf;
+	seg->len = wb->len;
+	seg->child = child;
+}
+
+static FTSENT *
+walk_alloc(void)
+{
+	FTSENT *ent;
+
+	/* fts_name is an array at the end of FTSENT, but on FreeBSD */
+	if ((ent = calloc(1, sizeof(*ent) + MAXPATHLEN)) == NULL)
+		err(1, NULL);
+	return (ent);
+}
+
+/* What fts would have set fts_info to, with FTS_NOSTAT if !statted. */
+static int
+walk_info(mode_t mode, int statted)
+{
+
+	if (S_ISDIR(mode))
+		return (FTS_D);
+	if (!statted)
+		return (FTS_NSOK);
+	if (S_ISLNK(mode))
+		return (FTS_SL);
+	return (S_ISREG(mode) ? FTS_F : FTS_DEFAULT);
+}
+
+static void
+walk_set(FTSENT *ent, char *path, size_t pathlen, const char *name,
+    size_t namelen, int level, struct stat *sb, int statted)
+{
+
+	ent->fts_path = ent->fts_accpath = path;
+	ent->fts_pathlen = pathlen;
+#ifdef __FreeBSD__
+	ent->fts_name = (char *)name;
+#else
+	memcpy(ent->fts_name, name, namelen + 1);
+#endif
+	ent->fts_namelen = namelen;
+	ent->fts_level = level;
+	ent->fts_errno = 0;
+	ent->fts_instr = FTS_NOINSTR;
+	ent->fts_statp = sb;
+	ent->fts_number = statted;
+	ent->fts_info = walk_info(sb->st_mode, statted);
+}
+
+/*
+ * As in find_execute(), with the entry stat'ed on the way to the first
+ * primary that needs it.  fts_number tells whether it was.
+ */
+static void
+walk_eval(struct find_walk *fw, FTSENT *ent)
+{
+	PLAN *p;
+
+	for (p = fw->plan; p != NULL; p = p->next) {
+		if ((p->flags & F_NEEDSTAT) && !ent->fts_number) {
+			if (entry_stat(ent, ent->fts_statp) == -1) {
+				walk_warn(fw, ent->fts_level, ent->fts_path,
+				    errno);
+				return;
+			}
+			ent->fts_number = 1;
+			ent->fts_info = walk_info(ent->fts_statp->st_mode, 1);
+		}
+		if (!(p->execute)(p, ent))
+			break;
+	}
+}
+
+/* Evaluate ent, an entry of d, and queue it if it is to be descended. */
+static void
+walk_visit(struct find_walk *fw, struct wdir *d, struct wbuf *wb,
+    FTSENT *ent)
+{
+	struct wdir *child;
+
+	if (isxargs && strpbrk(ent->fts_path, BADCH)) {
+		pthread_mutex_lock(&fw->mtx);
+		warnx("%s: illegal path", ent->fts_path);
+		exitstatus = 1;
+		pthread_mutex_unlock(&fw->mtx);
+	} else if (mindepth == -1 || ent->fts_level >= mindepth)
+		walk_eval(fw, ent);
+
+	/* -prune: fts_set() only records the instruction in ent */
+	if (ent->fts_info != FTS_D || ent->fts_instr == FTS_SKIP ||
+	    (maxdepth != -1 && ent->fts_level >= maxdepth))
+		return;
+	if ((child = calloc(1, sizeof(*child))) == NULL ||
+	    (child->path = strdup(ent->fts_path)) == NULL)
+		err(1, NULL);
+	child->pathlen = ent->fts_pathlen;
+	child->level = ent->fts_level;
+	if (!isunordered) {
+		wbuf_close(fw, wb, d, child);
+		wbuf_open(wb);
+	}
+	dw_pool_push(&fw->pool, child);
+}
+
+static void
+walk_dir(struct dw_pool *pool, void *item)
+{
+	struct find_walk *fw = pool->dp_arg;
+	struct wdir *d = item;
+	struct dw_entry *e;
+	struct dw_list dl;
+	struct wbuf wb;
+	struct stat sb;
+	FTSENT *ent;
+	char path[MAXPATHLEN];
+	size_t i, len, plen;
+	int error, fd;
+
+	wbuf_open(&wb);
+	fd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+	    (d->level > 0 ? O_NOFOLLOW : 0));
+	if (fd == -1 || dirwalk_read(fd, fw->want, &dl) == -1) {
+		error = errno;
+		if (fd != -1)
+			(void)close(fd);
+		walk_warn(fw, d->level, d->path, error);
+		goto done;
+	}
+	(void)close(fd);
+
+	ent = walk_alloc();
+	plen = d->pathlen;
+	if (plen > 0 && d->path[plen - 1] == '/')
+		plen--;
+	memcpy(path, d->path, plen);
+	path[plen] = '/';
+	for (i = 0; i < dl.dl_count; i++) {
+		e = &dl.dl_ents[i];
+		len = plen + 1 + e->de_namelen;
+		if (len >= sizeof(path)) {
+			walk_warn(fw, d->level + 1, e->de_name, ENAMETOOLONG);
+			continue;
+		}
+		memcpy(path + plen + 1, e->de_name, e->de_namelen + 1);
+		if (e->de_sb != NULL)
+			walk_set(ent, path, len, e->de_name, e->de_namelen,
+			    d->level + 1, e->de_sb, 1);
+		else {
+			memset(&sb, 0, sizeof(sb));
+			sb.st_mode = e->de_type;
+			walk_set(ent, path, len, e->de_name, e->de_namelen,
+			    d->level + 1, &sb, 0);
+		}
+		walk_visit(fw, d, &wb, ent);
+		if (isunordered && ftello(wb.fp) >= WALK_CHUNK) {
+			wbuf_close(fw, &wb, d, NULL);
+			wbuf_open(&wb);
+		}
+	}
+	free(ent);
+	dirwalk_free(&dl);
+
+done:	wbuf_close(fw, &wb, d, NULL);
+	if (isunordered) {
+		free(d->path);
+		free(d);
+		return;
+	}
+	pthread_mutex_lock(&fw->mtx);
+	d->done = 1;
+	pthread_cond_broadcast(&fw->done);
+	pthread_mutex_unlock(&fw->mtx);
+}
+
+/* Write out d and its subtree, as their directories are completed. */
+static void
+walk_flush(struct find_walk *fw, struct wdir *d)
+{
+	size_t i;
+
+	pthread_mutex_lock(&fw->mtx);
+	while (!d->done)
+		pthread_cond_wait(&fw->done, &fw->mtx);
+	pthread_mutex_unlock(&fw->mtx);
+	for (i = 0; i < d->nsegs; i++) {
+		if (d->segs[i].len > 0)
+			(void)fwrite(d->segs[i].buf, 1, d->segs[i].len,
+			    fw->out);
+		free(d->segs[i].buf);
+		if (d->segs[i].child != NULL)
+			walk_flush(fw, d->segs[i].child);
+	}
+	free(d->segs);
+	free(d->path);
+	free(d);
+}
+
+static void *
+walk_emit(void *arg)
+{
+	struct find_walk *fw = arg;
+
+	thread_stdout = fw->out;
+	thread_stderr = fw->pool.dp_err;
+	walk_flush(fw, fw->top);
+	return (NULL);
+}
+
+static int
+find_execute_mt(PLAN *plan, char *paths[])
+{
+	struct find_walk fw;
+	struct wbuf wb;
+	struct stat sb;
+	pthread_t emitter;
+	FTSENT *ent;
+	char **pp;
+	size_t len;
+	int emitting;
+
+	memset(&fw, 0, sizeof(fw));
+	fw.plan = plan;
+	(void)plan_stat(plan, 1);
+	/* A plan that stats everything might as well get it with the names */
+	fw.want = (plan->flags & F_NEEDSTAT) ? DW_STAT : DW_TYPE;
+	fw.out = thread_stdout;
+	pthread_mutex_init(&fw.mtx, NULL);
+	pthread_cond_init(&fw.done, NULL);
+	dw_pool_init(&fw.pool, walk_dir, &fw);
+	if ((fw.top = calloc(1, sizeof(*fw.top))) == NULL)
+		err(1, NULL);
+	fw.top->level = -1;
+	tree = NULL;
+	exitstatus = 0;
+
+	/* The paths themselves, as fts_open() would: always stat'ed */
+	ent = walk_alloc();
+	wbuf_open(&wb);
+	for (pp = paths; *pp != NULL; pp++) {
+		len = strlen(*pp);
+		if (len >= MAXPATHLEN) {
+			walk_warn(&fw, 0, *pp, ENAMETOOLONG);
+			continue;
+		}
+		if ((!(ftsoptions & FTS_COMFOLLOW) || stat(*pp, &sb) == -1) &&
+		    lstat(*pp, &sb) == -1) {
+			walk_warn(&fw, 0, *pp, errno);
+			continue;
+		}
+		walk_set(ent, *pp, len, *pp, len, 0, &sb, 1);
+		walk_visit(&fw, fw.top, &wb, ent);
+	}
+	wbuf_close(&fw, &wb, fw.top, NULL);
+	free(ent);
+
+	emitting = 0;
+	if (isunordered)
+		free(fw.top);
+	else {
+		fw.top->done = 1;
+		emitting = pthread_create(&emitter, NULL, walk_emit, &fw) == 0;
+	}
+	dw_pool_run(&fw.pool, numjobs);
+	if (emitting)
+		pthread_join(emitter, NULL);
+	else if (!isunordered)
+		walk_flush(&fw, fw.top);
+	dw_pool_destroy(&fw.pool);
+	pthread_cond_destroy(&fw.done);
+	pthread_mutex_destroy(&fw.mtx);
+	return (exitstatus);
+}
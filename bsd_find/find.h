@@ -100,6 +100,7 @@ typedef	struct _plandata *creat_f(struct _option *, char ***);
 #define	F_TIME2_B	0x00080000	/* one of -newer?B */
 #endif
 #define F_LINK		0x00100000	/* lname or ilname */
+#define	F_NEEDSTAT	0x00200000	/* looks at fts_statp */
 
 /* node definition */
 typedef struct _plandata {
@@ -132,6 +133,7 @@ typedef struct _plandata {
 			int _e_pbsize;		/* base num. of bytes of args */
 			int _e_psizemax;	/* max num. of bytes of args */
 			struct _plandata *_e_next;/* next F_EXECPLUS in tree */
+			struct execjobs *_e_jobs;/* -exec -P N, or NULL */
 		} ex;
 		char *_a_data[2];		/* array of char pointers */
 		char *_c_data;			/* char pointer */
@@ -163,6 +165,7 @@ typedef struct _plandata {
 #define e_pbsize p_un.ex._e_pbsize
 #define e_psizemax p_un.ex._e_psizemax
 #define e_next p_un.ex._e_next
+#define e_jobs p_un.ex._e_jobs
 
 typedef struct _option {
 	const char *name;		/* option name */
@@ -48,6 +48,9 @@ __FBSDID("$FreeBSD$");
 #include <sys/acl.h>
 #include <sys/wait.h>
 #include <sys/mount.h>
+#ifdef __APPLE__
+#include <sys/xattr.h>
+#endif
 
 #include <dirent.h>
 #include <err.h>
@@ -63,6 +66,7 @@ __FBSDID("$FreeBSD$");
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "find.h"
 #include <TargetConditionals.h>
@@ -78,6 +82,24 @@ extern char **environ;
 
 static PLAN *lastexecplus = NULL;
 
+#if TARGET_OS_IPHONE
+/*
+ * -exec -P N: up to max utilities run at once, each on its own thread.
+ * The primary is then always true; a utility that fails makes find
+ * exit with 1, as with -exec ... {} +.
+ */
+struct execjobs {
+	pthread_mutex_t mtx;
+	pthread_cond_t done;
+	int max;
+	int running;
+	int failed;
+	struct execjobs *next;
+};
+
+static struct execjobs *lastexecjobs = NULL;
+#endif
+
 #define	COMPARE(a, b) do {						\
 	switch (plan->flags & F_ELG_MASK) {				\
 	case F_EQUAL:							\
@@ -429,6 +451,33 @@ c_acl(OPTION *option, char ***argvp __unused)
 	return (palloc(option));
 }
 
+#ifdef __APPLE__
+/*
+ * -xattr functions --
+ *
+ *	True if the file has extended attributes.
+ */
+int
+f_xattr(PLAN *plan __unused, FTSENT *entry)
+{
+
+	return (listxattr(entry->fts_accpath, NULL, 0, XATTR_NOFOLLOW) > 0);
+}
+
+/*
+ * -xattrname name functions --
+ *
+ *	True if the file has an extended attribute called name.
+ */
+int
+f_xattrname(PLAN *plan, FTSENT *entry)
+{
+
+	return (getxattr(entry->fts_accpath, plan->c_data, NULL, 0, 0,
+	    XATTR_NOFOLLOW) > 0);
+}
+#endif /* __APPLE__ */
+
 /*
  * -delete functions --
  *
@@ -619,6 +668,38 @@ c_empty(OPTION *option, char ***argvp __unused)
 // Not sure this is necessary anymore.
 extern int ios_fchdir_nolock(const int fd);
 
+#if TARGET_OS_IPHONE
+static void
+exec_done(void *arg, pid_t pid __unused, int status)
+{
+	struct execjobs *j = arg;
+
+	pthread_mutex_lock(&j->mtx);
+	if (status != 0)
+		j->failed = 1;
+	j->running--;
+	pthread_cond_signal(&j->done);
+	pthread_mutex_unlock(&j->mtx);
+}
+
+/* Start the utility once one of the -P slots is free. */
+static void
+exec_async(PLAN *plan)
+{
+	struct execjobs *j = plan->e_jobs;
+
+	pthread_mutex_lock(&j->mtx);
+	while (j->running >= j->max)
+		pthread_cond_wait(&j->done, &j->mtx);
+	j->running++;
+	pthread_mutex_unlock(&j->mtx);
+	/* ios_spawnv_async() copies the arguments, and calls exec_done() even if it fails */
+	if (ios_spawnv_async(plan->e_argv[0], plan->e_argv, NULL,
+	    NULL, NULL, NULL, j, exec_done) == -1)
+		err(1, "fork");
+}
+#endif
+
 int
 f_exec(PLAN *plan, FTSENT *entry)
 {
@@ -645,7 +726,7 @@ f_exec(PLAN *plan, FTSENT *entry)
 		if ((plan->e_argv[plan->e_ppos] = strdup(file)) == NULL)
 			err(1, NULL);
 		plan->e_len[plan->e_ppos] = strlen(file);
-		plan->e_psize += plan->e_len[plan->e_ppos];
+		plan->e_psize += plan->e_len[plan->e_ppos] + 1;
 		if (++plan->e_ppos < plan->e_pnummax &&
 		    plan->e_psize < plan->e_psizemax)
 			return (1);
@@ -665,6 +746,15 @@ doexec:	if ((plan->flags & F_NEEDOK) && !queryuser(plan->e_argv))
 	fflush(stdout);
 	fflush(stderr);
 
+#if TARGET_OS_IPHONE
+	if (plan->e_jobs != NULL) {
+		exec_async(plan);
+		pid = 0;
+		status = 0;
+		goto reap;
+	}
+#endif
+
 	switch (pid = fork()) {
 	case -1:
 		err(1, "fork");
@@ -677,12 +767,19 @@ doexec:	if ((plan->flags & F_NEEDOK) && !queryuser(plan->e_argv))
 			warn("chdir");
 			_exit(1);
 		}
+#if TARGET_OS_IPHONE
+		// The arguments are split already: execvp() would join them
+		// and have ios_system() parse the command line again.
+		ios_spawnv(plan->e_argv[0], plan->e_argv, NULL, NULL, NULL, NULL);
+#else
 		execvp(plan->e_argv[0], plan->e_argv);
+#endif
 		/* warn("%s", plan->e_argv[0]);
 		_exit(1); */
 			}
 	}
     pid = waitpid(pid, &status, 0);
+reap:
 	if (plan->flags & F_EXECPLUS) {
 		while (--plan->e_ppos >= plan->e_pbnum)
 			free(plan->e_argv[plan->e_ppos]);
@@ -725,6 +822,42 @@ c_exec(OPTION *option, char ***argvp)
 
 	/* XXX - this is a change from the previous coding */
 	new = palloc(option);
+	new->e_jobs = NULL;
+
+#if TARGET_OS_IPHONE
+	/* -exec -P N utility ...: run up to N of them at a time */
+	if (**argvp != NULL && strcmp(**argvp, "-P") == 0) {
+		long jobs;
+
+		if (option->flags & (F_EXECDIR | F_NEEDOK))
+			errx(1, "%s: -P is only supported by -exec",
+			    option->name);
+		if ((*argvp)[1] == NULL)
+			errx(1, "%s: -P requires a number", option->name);
+		jobs = strtol((*argvp)[1], &p, 10);
+		if (*p != '\0' || jobs <= 0 || jobs > INT_MAX)
+			errx(1, "%s: -P %s: invalid number of jobs",
+			    option->name, (*argvp)[1]);
+		*argvp += 2;
+		if (jobs > 1) {
+			struct execjobs *j;
+
+			if ((j = calloc(1, sizeof(*j))) == NULL)
+				err(1, NULL);
+			pthread_mutex_init(&j->mtx, NULL);
+			pthread_cond_init(&j->done, NULL);
+			j->max = jobs;
+			j->next = lastexecjobs;
+			lastexecjobs = j;
+			new->e_jobs = j;
+			/*
+			 * The utilities outlive the visit of their directory:
+			 * give them paths from where find started instead.
+			 */
+			ftsoptions |= FTS_NOCHDIR;
+		}
+	}
+#endif
 
 	for (ap = argv = *argvp;; ++ap) {
 		if (!*ap)
@@ -820,12 +953,28 @@ void
 finish_execplus(void)
 {
 	PLAN *p;
+#if TARGET_OS_IPHONE
+	struct execjobs *j;
+#endif
 
 	p = lastexecplus;
 	while (p != NULL) {
 		(p->execute)(p, NULL);
 		p = p->e_next;
 	}
+	lastexecplus = NULL;
+#if TARGET_OS_IPHONE
+	/* and wait for the -exec -P ones still running */
+	for (j = lastexecjobs; j != NULL; j = j->next) {
+		pthread_mutex_lock(&j->mtx);
+		while (j->running > 0)
+			pthread_cond_wait(&j->done, &j->mtx);
+		if (j->failed)
+			exitstatus = 1;
+		pthread_mutex_unlock(&j->mtx);
+	}
+	lastexecjobs = NULL;
+#endif
 }
 
 #if HAVE_STRUCT_STAT_ST_FLAGS
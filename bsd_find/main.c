@@ -72,6 +72,8 @@ int isdepth;			/* do directories on post-order visit */
 int isoutput;			/* user specified output operator */
 int issort;         		/* do hierarchies in lexicographical order */
 int isxargs;			/* don't permit xargs delimiting chars */
+int isunordered;		/* -j output as it comes */
+int numjobs;			/* threads for the -j walk, 0 for fts */
 int mindepth = -1, maxdepth = -1; /* minimum and maximum depth */
 int regexp_flags = REG_BASIC;	/* use the "basic" regexp by default*/
 int exitstatus;
@@ -81,7 +83,7 @@ static void usage(void);
 int
 find_main(int argc, char *argv[])
 {
-	char **p, **start;
+	char **p, **start, *end;
 	int Hflag, Lflag, ch;
 
 	(void)setlocale(LC_ALL, "");
@@ -97,12 +99,14 @@ find_main(int argc, char *argv[])
     isoutput = 0;            /* user specified output operator */
     issort = 0;                 /* do hierarchies in lexicographical order */
     isxargs = 0;            /* don't permit xargs delimiting chars */
+    isunordered = 0;
+    numjobs = 0;
     mindepth = -1;
     maxdepth = -1; /* minimum and maximum depth */
     regexp_flags = REG_BASIC;    /* use the "basic" regexp by default*/
     exitstatus = 0;
     
-	while ((ch = getopt(argc, argv, "EHLPXdf:sx")) != -1)
+	while ((ch = getopt(argc, argv, "EHLPUXdf:j:sx")) != -1)
 		switch (ch) {
 		case 'E':
 			regexp_flags |= REG_EXTENDED;
@@ -118,6 +122,9 @@ find_main(int argc, char *argv[])
 		case 'P':
 			Hflag = Lflag = 0;
 			break;
+		case 'U':
+			isunordered = 1;
+			break;
 		case 'X':
 			isxargs = 1;
 			break;
@@ -127,6 +134,11 @@ find_main(int argc, char *argv[])
 		case 'f':
 			*p++ = optarg;
 			break;
+		case 'j':
+			numjobs = strtol(optarg, &end, 10);
+			if (*end != '\0' || numjobs <= 0)
+				errx(1, "%s: invalid number of jobs", optarg);
+			break;
 		case 's':
 			issort = 1;
 			break;
@@ -177,7 +189,7 @@ static void
 usage(void)
 {
 	(void)fprintf(thread_stderr, "%s\n%s\n",
-"usage: find [-H | -L | -P] [-EXdsx] [-f path] path ... [expression]",
-"       find [-H | -L | -P] [-EXdsx] -f path [path ...] [expression]");
+"usage: find [-H | -L | -P] [-EUXdsx] [-f path] [-j jobs] path ... [expression]",
+"       find [-H | -L | -P] [-EUXdsx] [-j jobs] -f path [path ...] [expression]");
 	exit(1);
 }
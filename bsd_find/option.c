@@ -211,6 +211,10 @@ static OPTION const options[] = {
 	{ "-uid",	c_user,		f_user,		0 },
 	{ "-user",	c_user,		f_user,		0 },
 	{ "-wholename",	c_name,		f_path,		0 },
+#ifdef __APPLE__
+	{ "-xattr",	c_simple,	f_xattr,	0 },
+	{ "-xattrname",	c_name,		f_xattrname,	0 },
+#endif
 	{ "-xdev",	c_xdev,		f_always_true,	0 },
 // -xtype
 };
@@ -229,6 +233,7 @@ find_create(char ***argvp)
 	OPTION *p;
 	PLAN *new;
 	char **argv;
+	int nostat;
 
 	argv = *argvp;
 
@@ -236,7 +241,14 @@ find_create(char ***argvp)
 		errx(1, "%s: unknown primary or operator", *argv);
 	++argv;
 
+	/* Tell which primaries look at fts_statp, for the -j walk */
+	nostat = ftsoptions & FTS_NOSTAT;
+	ftsoptions |= FTS_NOSTAT;
 	new = (p->create)(p, &argv);
+	if (new != NULL && !(ftsoptions & FTS_NOSTAT))
+		new->flags |= F_NEEDSTAT;
+	if (!nostat)
+		ftsoptions &= ~FTS_NOSTAT;
 	*argvp = argv;
 	return (new);
 }
@@ -418,6 +418,14 @@
 /* if zlib is available */
 #define HAVE_LIBZ 1
 
+/* if brotli is available: when the brotli decoder built for Apple platforms
+   is in the header search path, see README.APPLE */
+#if defined(__has_include)
+#if __has_include(<brotli/decode.h>)
+#define HAVE_BROTLI 1
+#endif
+#endif
+
 /* Define to 1 if you have the <limits.h> header file. */
 #define HAVE_LIMITS_H 1
 
@@ -940,6 +948,10 @@
 /* to enable Apple OS native SSL/TLS support */
 #define USE_DARWINSSL 1
 
+/* to resolve names with mDNSResponder (dns_sd.h) from the multi loop,
+   rather than with a thread per lookup */
+#define USE_DNSSD 1
+
 /* if GnuTLS is enabled */
 /* #undef USE_GNUTLS */
 
@@ -965,8 +977,14 @@
 /* Define to enable metalink support */
 /* #undef USE_METALINK */
 
-/* if nghttp2 is in use */
-// #define USE_NGHTTP2 1
+/* if nghttp2 is in use: when the nghttp2 built for iOS is in the header
+   search path, see README.APPLE */
+#if defined(__has_include)
+#if __has_include(<nghttp2/nghttp2.h>)
+#define USE_NGHTTP2 1
+#define HAVE_NGHTTP2_NGHTTP2_H 1
+#endif
+#endif
 
 /* if NSS is enabled */
 /* #undef USE_NSS */
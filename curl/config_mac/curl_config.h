@@ -417,6 +417,14 @@
 /* if zlib is available */
 #define HAVE_LIBZ 1
 
+/* if brotli is available: when the brotli decoder built for Apple platforms
+   is in the header search path, see README.APPLE */
+#if defined(__has_include)
+#if __has_include(<brotli/decode.h>)
+#define HAVE_BROTLI 1
+#endif
+#endif
+
 /* Define to 1 if you have the <limits.h> header file. */
 #define HAVE_LIMITS_H 1
 
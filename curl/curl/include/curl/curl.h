@@ -1782,6 +1782,9 @@ typedef enum {
   /* Suppress proxy CONNECT response headers from user callbacks */
   CINIT(SUPPRESS_CONNECT_HEADERS, LONG, 265),
 
+  /* Set the size of the upload buffer (number of the upstream option) */
+  CINIT(UPLOAD_BUFFERSIZE, LONG, 280),
+
   CURLOPT_LASTENTRY /* the last unused */
 } CURLoption;
 
@@ -0,0 +1,630 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+/***********************************************************************
+ * Only for DNS Service Discovery (dns_sd) name resolves builds
+ **********************************************************************/
+#ifdef CURLRES_DNSSD
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#include <dns_sd.h>
+
+#include "urldata.h"
+#include "sendf.h"
+#include "hostip.h"
+#include "hash.h"
+#include "share.h"
+#include "strerror.h"
+#include "url.h"
+#include "multiif.h"
+#include "inet_pton.h"
+#include "connect.h"
+#include "select.h"
+#include "progress.h"
+/* The last 3 #include files should be in this order */
+#include "curl_printf.h"
+#include "curl_memory.h"
+#include "memdebug.h"
+
+/*
+ * The lookups are handed to mDNSResponder with DNSServiceGetAddrInfo(). The
+ * replies come back on a single socket per lookup, which is returned by
+ * Curl_resolver_getsock() so that the multi interface waits on it along
+ * with the transfer sockets: no thread is started and nothing is polled.
+ */
+
+#define DNSSD_IPV4 (1<<0)
+#define DNSSD_IPV6 (1<<1)
+
+struct dnssd_data {
+  DNSServiceRef ref;      /* the on-going DNSServiceGetAddrInfo() */
+  Curl_addrinfo *res;     /* addresses received so far */
+  Curl_addrinfo *tail;    /* last one, to keep them in reply order */
+  int port;
+  int pending;            /* DNSSD_IPV* families not answered yet */
+  int status;             /* CURL_ASYNC_SUCCESS or a DNSServiceErrorType */
+  bool done;
+};
+
+/*
+ * Curl_resolver_global_init()
+ * Called from curl_global_init() to initialize global resolver environment.
+ * Does nothing here.
+ */
+int Curl_resolver_global_init(void)
+{
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_global_cleanup()
+ * Called from curl_global_cleanup() to destroy global resolver environment.
+ * Does nothing here.
+ */
+void Curl_resolver_global_cleanup(void)
+{
+}
+
+/*
+ * Curl_resolver_init()
+ * Called from curl_easy_init() -> Curl_open() to initialize resolver
+ * URL-state specific environment ('resolver' member of the UrlState
+ * structure).  Does nothing here.
+ */
+CURLcode Curl_resolver_init(void **resolver)
+{
+  (void)resolver;
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_cleanup()
+ * Called from curl_easy_cleanup() -> Curl_close() to cleanup resolver
+ * URL-state specific environment ('resolver' member of the UrlState
+ * structure).  Does nothing here.
+ */
+void Curl_resolver_cleanup(void *resolver)
+{
+  (void)resolver;
+}
+
+/*
+ * Curl_resolver_duphandle()
+ * Called from curl_easy_duphandle() to duplicate resolver URL state-specific
+ * environment ('resolver' member of the UrlState structure).  Does nothing
+ * here.
+ */
+int Curl_resolver_duphandle(void **to, void *from)
+{
+  (void)to;
+  (void)from;
+  return CURLE_OK;
+}
+
+static void destroy_async_data(struct Curl_async *async)
+{
+  struct dnssd_data *dd = (struct dnssd_data *)async->os_specific;
+
+  if(dd) {
+    /* closes the socket, no more replies get delivered after this */
+    if(dd->ref)
+      DNSServiceRefDeallocate(dd->ref);
+    if(dd->res)
+      Curl_freeaddrinfo(dd->res);
+    free(dd);
+  }
+  async->os_specific = NULL;
+
+  free(async->hostname);
+  async->hostname = NULL;
+}
+
+/*
+ * Cancel all possibly still on-going resolves for this connection.
+ */
+void Curl_resolver_cancel(struct connectdata *conn)
+{
+  destroy_async_data(&conn->async);
+}
+
+/*
+ * append_address() adds a copy of one address from a reply to the list of
+ * results, with the port number filled in.
+ */
+static bool append_address(struct dnssd_data *dd,
+                           const struct sockaddr *addr)
+{
+  Curl_addrinfo *ai;
+  size_t len;
+
+  switch(addr->sa_family) {
+  case AF_INET:
+    len = sizeof(struct sockaddr_in);
+    break;
+#ifdef ENABLE_IPV6
+  case AF_INET6:
+    len = sizeof(struct sockaddr_in6);
+    break;
+#endif
+  default:
+    return TRUE; /* not for us, ignore */
+  }
+
+  ai = calloc(1, sizeof(Curl_addrinfo));
+  if(!ai)
+    return FALSE;
+  ai->ai_addr = malloc(len);
+  if(!ai->ai_addr) {
+    free(ai);
+    return FALSE;
+  }
+  memcpy(ai->ai_addr, addr, len);
+
+  ai->ai_family = addr->sa_family;
+  ai->ai_socktype = SOCK_STREAM;
+  ai->ai_protocol = IPPROTO_TCP;
+  ai->ai_addrlen = (curl_socklen_t)len;
+
+  if(ai->ai_family == AF_INET)
+    ((struct sockaddr_in *)ai->ai_addr)->sin_port = htons((unsigned short)
+                                                          dd->port);
+#ifdef ENABLE_IPV6
+  else
+    ((struct sockaddr_in6 *)ai->ai_addr)->sin6_port = htons((unsigned short)
+                                                            dd->port);
+#endif
+
+  if(dd->tail)
+    dd->tail->ai_next = ai;
+  else
+    dd->res = ai;
+  dd->tail = ai;
+
+  return TRUE;
+}
+
+/*
+ * addrinfo_reply() is called from DNSServiceProcessResult() once for each
+ * address in a reply, and once with kDNSServiceErr_NoSuchRecord for a family
+ * the name has no address in. The lookup is done when every family asked for
+ * got its answer and no more of the reply is queued.
+ */
+static void DNSSD_API addrinfo_reply(DNSServiceRef ref,
+                                     DNSServiceFlags flags,
+                                     uint32_t interface_index,
+                                     DNSServiceErrorType error,
+                                     const char *hostname,
+                                     const struct sockaddr *addr,
+                                     uint32_t ttl,
+                                     void *context)
+{
+  struct dnssd_data *dd = (struct dnssd_data *)context;
+
+  (void)ref;
+  (void)interface_index;
+  (void)hostname;
+  (void)ttl;
+
+  if(dd->done)
+    return;
+
+  if((error == kDNSServiceErr_NoError) ||
+     (error == kDNSServiceErr_NoSuchRecord)) {
+    if(addr) {
+      if(addr->sa_family == AF_INET)
+        dd->pending &= ~DNSSD_IPV4;
+#ifdef ENABLE_IPV6
+      else if(addr->sa_family == AF_INET6)
+        dd->pending &= ~DNSSD_IPV6;
+#endif
+      if((error == kDNSServiceErr_NoError) &&
+         (flags & kDNSServiceFlagsAdd) &&
+         !append_address(dd, addr)) {
+        dd->status = kDNSServiceErr_NoMemory;
+        dd->pending = 0;
+      }
+    }
+  }
+  else {
+    dd->status = error;
+    dd->pending = 0;
+  }
+
+  if(!dd->pending && !(flags & kDNSServiceFlagsMoreComing))
+    dd->done = TRUE;
+}
+
+/*
+ * process_replies() reads whatever mDNSResponder has sent, waiting for at
+ * most 'timeout_ms' milliseconds for something to arrive.
+ */
+static void process_replies(struct dnssd_data *dd, time_t timeout_ms)
+{
+  curl_socket_t sock = DNSServiceRefSockFD(dd->ref);
+
+  while(!dd->done && (SOCKET_READABLE(sock, timeout_ms) > 0)) {
+    DNSServiceErrorType error = DNSServiceProcessResult(dd->ref);
+    if(error != kDNSServiceErr_NoError) {
+      dd->status = error;
+      dd->done = TRUE;
+    }
+    timeout_ms = 0; /* only drain what is already there */
+  }
+}
+
+/*
+ * dnssd_complete() hands the result over to the DNS cache. The addresses are
+ * only passed on for a successful lookup that found any.
+ */
+static void dnssd_complete(struct connectdata *conn)
+{
+  struct dnssd_data *dd = (struct dnssd_data *)conn->async.os_specific;
+
+  if((dd->status == CURL_ASYNC_SUCCESS) && dd->res) {
+    Curl_addrinfo_callback(conn, CURL_ASYNC_SUCCESS, dd->res);
+    /* the list is owned by the DNS cache now */
+    dd->res = NULL;
+    dd->tail = NULL;
+  }
+  else
+    Curl_addrinfo_callback(conn, dd->status ? dd->status :
+                           kDNSServiceErr_NoSuchRecord, NULL);
+}
+
+/*
+ * resolver_error() calls failf() with the appropriate message after a resolve
+ * error
+ */
+
+static CURLcode resolver_error(struct connectdata *conn)
+{
+  const char *host_or_proxy;
+  CURLcode result;
+
+  if(conn->bits.httpproxy) {
+    host_or_proxy = "proxy";
+    result = CURLE_COULDNT_RESOLVE_PROXY;
+  }
+  else {
+    host_or_proxy = "host";
+    result = CURLE_COULDNT_RESOLVE_HOST;
+  }
+
+  failf(conn->data, "Could not resolve %s: %s", host_or_proxy,
+        conn->async.hostname);
+
+  return result;
+}
+
+/*
+ * Curl_resolver_wait_resolv()
+ *
+ * waits for a resolve to finish. This function should be avoided since using
+ * this risk getting the multi interface to "hang".
+ *
+ * If 'entry' is non-NULL, make it point to the resolved dns entry
+ *
+ * Returns CURLE_COULDNT_RESOLVE_HOST if the host was not resolved, and
+ * CURLE_OPERATION_TIMEDOUT if a time-out occurred.
+ */
+CURLcode Curl_resolver_wait_resolv(struct connectdata *conn,
+                                   struct Curl_dns_entry **entry)
+{
+  struct Curl_easy *data = conn->data;
+  struct dnssd_data *dd = (struct dnssd_data *)conn->async.os_specific;
+  CURLcode result = CURLE_OK;
+  struct timeval now = Curl_tvnow();
+  time_t timeout;
+
+  DEBUGASSERT(dd);
+
+  if(entry)
+    *entry = NULL; /* clear on entry */
+
+  timeout = Curl_timeleft(data, &now, TRUE);
+  if(timeout < 0) {
+    /* already expired! */
+    connclose(conn, "Timed out before name resolve started");
+    return CURLE_OPERATION_TIMEDOUT;
+  }
+  if(!timeout)
+    timeout = CURL_TIMEOUT_RESOLVE * 1000; /* default name resolve timeout */
+
+  /* Wait for the name resolve query to complete, but wake up every second
+     to make sure the progress callback gets called frequent enough */
+  while(!dd->done) {
+    struct timeval now2;
+    time_t timediff;
+
+    process_replies(dd, timeout > 1000 ? 1000 : timeout);
+    if(dd->done)
+      break;
+
+    if(Curl_pgrsUpdate(conn)) {
+      result = CURLE_ABORTED_BY_CALLBACK;
+      break;
+    }
+    now2 = Curl_tvnow();
+    timediff = Curl_tvdiff(now2, now); /* spent time */
+    timeout -= timediff ? timediff : 1; /* always deduct at least 1 */
+    now = now2; /* for next loop */
+    if(timeout <= 0) {
+      result = CURLE_OPERATION_TIMEDOUT;
+      break;
+    }
+  }
+
+  if(!result) {
+    dnssd_complete(conn);
+
+    if(entry)
+      *entry = conn->async.dns;
+
+    if(!conn->async.dns)
+      /* a name was not resolved, report error */
+      result = resolver_error(conn);
+  }
+
+  destroy_async_data(&conn->async);
+
+  if(result)
+    /* close the connection, since we can't return failure here without
+       cleaning up this connection properly. */
+    connclose(conn, "dns_sd resolve failed");
+
+  return result;
+}
+
+/*
+ * Curl_resolver_is_resolved() is called repeatedly to check if a previous
+ * name resolve request has completed. It should also make sure to time-out if
+ * the operation seems to take too long.
+ */
+CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
+                                   struct Curl_dns_entry **entry)
+{
+  struct dnssd_data *dd = (struct dnssd_data *)conn->async.os_specific;
+
+  *entry = NULL;
+
+  if(!dd) {
+    DEBUGASSERT(dd);
+    return CURLE_COULDNT_RESOLVE_HOST;
+  }
+
+  process_replies(dd, 0);
+
+  if(dd->done) {
+    dnssd_complete(conn);
+
+    if(!conn->async.dns) {
+      CURLcode result = resolver_error(conn);
+      destroy_async_data(&conn->async);
+      return result;
+    }
+    destroy_async_data(&conn->async);
+    *entry = conn->async.dns;
+  }
+
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_getsock() returns the socket mDNSResponder replies on, so
+ * that the multi interface wakes up as soon as the answer is there. A one
+ * second timer makes sure time-outs and the progress meter still get
+ * checked while nothing comes back.
+ */
+int Curl_resolver_getsock(struct connectdata *conn,
+                          curl_socket_t *socks,
+                          int numsocks)
+{
+  struct dnssd_data *dd = (struct dnssd_data *)conn->async.os_specific;
+
+  if(!dd || !dd->ref || !numsocks)
+    return GETSOCK_BLANK;
+
+  socks[0] = DNSServiceRefSockFD(dd->ref);
+  Curl_expire_latest(conn->data, 1000);
+
+  return GETSOCK_READSOCK(0);
+}
+
+/*
+ * init_resolve_dnssd() starts the lookup with mDNSResponder. This function
+ * returns before the resolve is done.
+ *
+ * Returns FALSE in case of failure, otherwise TRUE.
+ */
+static bool init_resolve_dnssd(struct connectdata *conn,
+                               const char *hostname, int port,
+                               int families)
+{
+  struct dnssd_data *dd = calloc(1, sizeof(struct dnssd_data));
+  DNSServiceProtocol protocol = 0;
+  DNSServiceErrorType error;
+
+  conn->async.os_specific = (void *)dd;
+  if(!dd)
+    goto err_exit;
+
+  conn->async.port = port;
+  conn->async.done = FALSE;
+  conn->async.status = 0;
+  conn->async.dns = NULL;
+  dd->port = port;
+  dd->pending = families;
+
+  free(conn->async.hostname);
+  conn->async.hostname = strdup(hostname);
+  if(!conn->async.hostname)
+    goto err_exit;
+
+  if(families & DNSSD_IPV4)
+    protocol |= kDNSServiceProtocol_IPv4;
+  if(families & DNSSD_IPV6)
+    protocol |= kDNSServiceProtocol_IPv6;
+
+  error = DNSServiceGetAddrInfo(&dd->ref, kDNSServiceFlagsTimeout, 0,
+                                protocol, hostname, addrinfo_reply, dd);
+  if(error != kDNSServiceErr_NoError) {
+    infof(conn->data, "DNSServiceGetAddrInfo() failed for %s; %d\n",
+          hostname, (int)error);
+    dd->ref = NULL;
+    goto err_exit;
+  }
+
+  return TRUE;
+
+ err_exit:
+  destroy_async_data(&conn->async);
+
+  return FALSE;
+}
+
+/*
+ * Curl_resolver_getaddrinfo() - for dns_sd
+ */
+Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
+                                         const char *hostname,
+                                         int port,
+                                         int *waitp)
+{
+  struct addrinfo hints;
+  struct in_addr in;
+  Curl_addrinfo *res;
+  int error;
+  char sbuf[12];
+  int pf = PF_INET;
+  int families = DNSSD_IPV4;
+#ifdef CURLRES_IPV6
+  struct in6_addr in6;
+#endif /* CURLRES_IPV6 */
+
+  *waitp = 0; /* default to synchronous response */
+
+  /* First check if this is an IPv4 address string */
+  if(Curl_inet_pton(AF_INET, hostname, &in) > 0)
+    /* This is a dotted IP address 123.123.123.123-style */
+    return Curl_ip2addr(AF_INET, &in, hostname, port);
+
+#ifdef CURLRES_IPV6
+  /* check if this is an IPv6 address string */
+  if(Curl_inet_pton(AF_INET6, hostname, &in6) > 0)
+    /* This is an IPv6 address literal */
+    return Curl_ip2addr(AF_INET6, &in6, hostname, port);
+
+  /*
+   * Check if a limited name resolve has been requested.
+   */
+  switch(conn->ip_version) {
+  case CURL_IPRESOLVE_V4:
+    pf = PF_INET;
+    families = DNSSD_IPV4;
+    break;
+  case CURL_IPRESOLVE_V6:
+    pf = PF_INET6;
+    families = DNSSD_IPV6;
+    break;
+  default:
+    pf = PF_UNSPEC;
+    families = DNSSD_IPV4 | DNSSD_IPV6;
+    break;
+  }
+
+  if((pf != PF_INET) && !Curl_ipv6works()) {
+    /* The stack seems to be a non-IPv6 one */
+    pf = PF_INET;
+    families = DNSSD_IPV4;
+  }
+#endif /* CURLRES_IPV6 */
+
+  /* start the lookup, the reply is read from the multi loop */
+  if(init_resolve_dnssd(conn, hostname, port, families)) {
+    *waitp = 1; /* expect asynchronous response */
+    return NULL;
+  }
+
+  /* fall-back to blocking version */
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = pf;
+  hints.ai_socktype = conn->socktype;
+
+  snprintf(sbuf, sizeof(sbuf), "%d", port);
+
+  error = Curl_getaddrinfo_ex(hostname, sbuf, &hints, &res);
+  if(error) {
+    infof(conn->data, "getaddrinfo() failed for %s:%d; %s\n",
+          hostname, port, Curl_strerror(conn, SOCKERRNO));
+    return NULL;
+  }
+  else {
+    Curl_addrinfo_set_port(res, port);
+  }
+
+  return res;
+}
+
+CURLcode Curl_set_dns_servers(struct Curl_easy *data,
+                              char *servers)
+{
+  (void)data;
+  (void)servers;
+  return CURLE_NOT_BUILT_IN;
+}
+
+CURLcode Curl_set_dns_interface(struct Curl_easy *data,
+                                const char *interf)
+{
+  (void)data;
+  (void)interf;
+  return CURLE_NOT_BUILT_IN;
+}
+
+CURLcode Curl_set_dns_local_ip4(struct Curl_easy *data,
+                                const char *local_ip4)
+{
+  (void)data;
+  (void)local_ip4;
+  return CURLE_NOT_BUILT_IN;
+}
+
+CURLcode Curl_set_dns_local_ip6(struct Curl_easy *data,
+                                const char *local_ip6)
+{
+  (void)data;
+  (void)local_ip6;
+  return CURLE_NOT_BUILT_IN;
+}
+
+#endif /* CURLRES_DNSSD */
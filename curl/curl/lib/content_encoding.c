@@ -36,7 +36,7 @@
    (doing so will reduce code size slightly). */
 #define OLD_ZLIB_SUPPORT 1
 
-#define DSIZ CURL_MAX_WRITE_SIZE /* buffer size for decompressed data */
+#define DSIZ CURL_MAX_WRITE_SIZE /* smallest buffer for decompressed data */
 
 #define GZIP_MAGIC_0 0x1f
 #define GZIP_MAGIC_1 0x8b
@@ -78,6 +78,24 @@ process_zlib_error(struct connectdata *conn, z_stream *z)
   return CURLE_BAD_CONTENT_ENCODING;
 }
 
+/*
+ * The buffer the decoders uncompress into, kept for the whole response and
+ * as large as the receive buffer the application asked for: a read from the
+ * network is then decoded in one or a few passes rather than 16 KB at a time.
+ */
+static char *decode_buffer(struct connectdata *conn, struct SingleRequest *k)
+{
+  if(!k->decomp) {
+    size_t size = (size_t)conn->data->set.buffer_size;
+    if(size < DSIZ)
+      size = DSIZ;
+    k->decomp = malloc(size);
+    if(k->decomp)
+      k->decomp_size = size;
+  }
+  return k->decomp;
+}
+
 static CURLcode
 exit_zlib(z_stream *z, zlibInitState *zlib_init, CURLcode result)
 {
@@ -97,37 +115,35 @@ inflate_stream(struct connectdata *conn,
   int status;                   /* zlib status */
   CURLcode result = CURLE_OK;   /* Curl_client_write status */
   char *decomp;                 /* Put the decompressed data here. */
+  uInt dsize;
 
-  /* Dynamically allocate a buffer for decompression because it's uncommonly
-     large to hold on the stack */
-  decomp = malloc(DSIZ);
+  decomp = decode_buffer(conn, k);
   if(decomp == NULL) {
     return exit_zlib(z, &k->zlib_init, CURLE_OUT_OF_MEMORY);
   }
+  dsize = (uInt)k->decomp_size;
 
   /* because the buffer size is fixed, iteratively decompress and transfer to
      the client via client_write. */
   for(;;) {
     /* (re)set buffer for decompressed output for every iteration */
     z->next_out = (Bytef *)decomp;
-    z->avail_out = DSIZ;
+    z->avail_out = dsize;
 
     status = inflate(z, Z_SYNC_FLUSH);
     if(status == Z_OK || status == Z_STREAM_END) {
       allow_restart = 0;
-      if((DSIZ - z->avail_out) && (!k->ignorebody)) {
+      if((dsize - z->avail_out) && (!k->ignorebody)) {
         result = Curl_client_write(conn, CLIENTWRITE_BODY, decomp,
-                                   DSIZ - z->avail_out);
+                                   dsize - z->avail_out);
         /* if !CURLE_OK, clean up, return */
         if(result) {
-          free(decomp);
           return exit_zlib(z, &k->zlib_init, result);
         }
       }
 
       /* Done? clean up, return */
       if(status == Z_STREAM_END) {
-        free(decomp);
         if(inflateEnd(z) == Z_OK)
           return exit_zlib(z, &k->zlib_init, result);
         return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
@@ -137,7 +153,6 @@ inflate_stream(struct connectdata *conn,
 
       /* status is always Z_OK at this point! */
       if(z->avail_in == 0) {
-        free(decomp);
         return result;
       }
     }
@@ -147,7 +162,6 @@ inflate_stream(struct connectdata *conn,
 
       (void) inflateEnd(z);     /* don't care about the return code */
       if(inflateInit2(z, -MAX_WBITS) != Z_OK) {
-        free(decomp);
         return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
       }
       z->next_in = orig_in;
@@ -156,7 +170,6 @@ inflate_stream(struct connectdata *conn,
       continue;
     }
     else {                      /* Error; exit loop, handle below */
-      free(decomp);
       return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
     }
   }
@@ -419,6 +432,66 @@ Curl_unencode_gzip_write(struct connectdata *conn,
 #endif
 }
 
+#ifdef HAVE_BROTLI
+static void *brotli_alloc_cb(void *opaque, size_t size)
+{
+  (void) opaque;
+  return malloc(size);
+}
+
+static void brotli_free_cb(void *opaque, void *ptr)
+{
+  (void) opaque;
+  free(ptr);
+}
+
+CURLcode
+Curl_unencode_brotli_write(struct connectdata *conn,
+                           struct SingleRequest *k,
+                           ssize_t nread)
+{
+  const uint8_t *next_in = (const uint8_t *)k->str;
+  size_t avail_in = (size_t)nread;
+  CURLcode result = CURLE_OK;
+  char *decomp;
+
+  /* Initialize the decoder? */
+  if(!k->brotli) {
+    k->brotli = BrotliDecoderCreateInstance(brotli_alloc_cb, brotli_free_cb,
+                                            NULL);
+    if(!k->brotli)
+      return CURLE_OUT_OF_MEMORY;
+  }
+  decomp = decode_buffer(conn, k);
+  if(!decomp)
+    return CURLE_OUT_OF_MEMORY;
+
+  /* decode until the decoder wants more input, or the stream ends */
+  for(;;) {
+    uint8_t *next_out = (uint8_t *)decomp;
+    size_t avail_out = k->decomp_size;
+    BrotliDecoderResult status =
+      BrotliDecoderDecompressStream(k->brotli, &avail_in, &next_in,
+                                    &avail_out, &next_out, NULL);
+
+    if(status == BROTLI_DECODER_RESULT_ERROR) {
+      failf(conn->data, "Error while processing content unencoding: %s",
+            BrotliDecoderErrorString(BrotliDecoderGetErrorCode(k->brotli)));
+      return CURLE_BAD_CONTENT_ENCODING;
+    }
+    if((k->decomp_size - avail_out) && !k->ignorebody) {
+      result = Curl_client_write(conn, CLIENTWRITE_BODY, decomp,
+                                 k->decomp_size - avail_out);
+      if(result)
+        return result;
+    }
+    if(status != BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT)
+      /* anything after the end of the stream is ignored */
+      return result;
+  }
+}
+#endif /* HAVE_BROTLI */
+
 void Curl_unencode_cleanup(struct connectdata *conn)
 {
   struct Curl_easy *data = conn->data;
@@ -426,6 +499,14 @@ void Curl_unencode_cleanup(struct connectdata *conn)
   z_stream *z = &k->z;
   if(k->zlib_init != ZLIB_UNINIT)
     (void) exit_zlib(z, &k->zlib_init, CURLE_OK);
+#ifdef HAVE_BROTLI
+  if(k->brotli) {
+    BrotliDecoderDestroyInstance(k->brotli);
+    k->brotli = NULL;
+  }
+#endif
+  Curl_safefree(k->decomp);
+  k->decomp_size = 0;
 }
 
 #endif /* HAVE_LIBZ */
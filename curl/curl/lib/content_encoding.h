@@ -26,8 +26,12 @@
 /*
  * Comma-separated list all supported Content-Encodings ('identity' is implied)
  */
-#ifdef HAVE_LIBZ
+#if defined(HAVE_LIBZ) && defined(HAVE_BROTLI)
+#define ALL_CONTENT_ENCODINGS "deflate, gzip, br"
+#elif defined(HAVE_LIBZ)
 #define ALL_CONTENT_ENCODINGS "deflate, gzip"
+#endif
+#ifdef HAVE_LIBZ
 /* force a cleanup */
 void Curl_unencode_cleanup(struct connectdata *conn);
 #else
@@ -44,5 +48,12 @@ Curl_unencode_gzip_write(struct connectdata *conn,
                          struct SingleRequest *k,
                          ssize_t nread);
 
+#ifdef HAVE_BROTLI
+CURLcode
+Curl_unencode_brotli_write(struct connectdata *conn,
+                           struct SingleRequest *k,
+                           ssize_t nread);
+#endif
+
 
 #endif /* HEADER_CURL_CONTENT_ENCODING_H */
@@ -528,6 +528,9 @@
 #  undef HAVE_GETADDRINFO
 #  undef HAVE_FREEADDRINFO
 #  undef HAVE_GETHOSTBYNAME
+#elif defined(USE_DNSSD)
+#  define CURLRES_ASYNCH
+#  define CURLRES_DNSSD
 #elif defined(USE_THREADS_POSIX) || defined(USE_THREADS_WIN32)
 #  define CURLRES_ASYNCH
 #  define CURLRES_THREADED
@@ -874,6 +874,12 @@ struct Curl_easy *curl_easy_duphandle(struct Curl_easy *data)
   if(!outcurl->state.buffer)
     goto fail;
 
+  outcurl->set.upload_buffer_size = data->set.upload_buffer_size;
+  outcurl->state.uploadbuffer =
+    malloc(CURL_BUFSIZE(outcurl->set.upload_buffer_size) + 1);
+  if(!outcurl->state.uploadbuffer)
+    goto fail;
+
   outcurl->state.headerbuff = malloc(HEADERSIZE);
   if(!outcurl->state.headerbuff)
     goto fail;
@@ -945,6 +951,7 @@ struct Curl_easy *curl_easy_duphandle(struct Curl_easy *data)
     curl_slist_free_all(outcurl->change.cookielist);
     outcurl->change.cookielist = NULL;
     Curl_safefree(outcurl->state.buffer);
+    Curl_safefree(outcurl->state.uploadbuffer);
     Curl_safefree(outcurl->state.headerbuff);
     Curl_safefree(outcurl->change.url);
     Curl_safefree(outcurl->change.referer);
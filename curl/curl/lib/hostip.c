@@ -86,7 +86,11 @@
  * Windows, and then the name resolve will be done in a new thread, and the
  * supported API will be the same as for ares-builds.
  *
- * If any of the two previous are defined, CURLRES_ASYNCH is defined too. If
+ * CURLRES_DNSSD - is defined if libcurl is built to hand the name resolves
+ * to mDNSResponder with DNSServiceGetAddrInfo() (Apple platforms), and then
+ * the answer is read from a socket the multi interface waits on.
+ *
+ * If any of the three previous are defined, CURLRES_ASYNCH is defined too. If
  * libcurl is not built to use an asynchronous resolver, CURLRES_SYNCH is
  * defined.
  *
@@ -3639,6 +3639,10 @@ CURLcode Curl_http_readwrite_headers(struct Curl_easy *data,
       else if(checkprefix("gzip", start)
               || checkprefix("x-gzip", start))
         k->auto_decoding = GZIP;
+#ifdef HAVE_BROTLI
+      else if(checkprefix("br", start))
+        k->auto_decoding = BROTLI;
+#endif
     }
     else if(checkprefix("Content-Range:", k->p)) {
       /* Content-Range: bytes [num]-
@@ -218,6 +218,15 @@ CHUNKcode Curl_httpchunk_read(struct connectdata *conn,
                                           (ssize_t)piece);
         break;
 
+#ifdef HAVE_BROTLI
+      case BROTLI:
+        /* update data->req.keep.str to point to the chunk data. */
+        data->req.str = datap;
+        result = Curl_unencode_brotli_write(conn, &data->req,
+                                            (ssize_t)piece);
+        break;
+#endif
+
       default:
         failf(conn->data,
               "Unrecognized content encoding type. "
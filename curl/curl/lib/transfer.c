@@ -774,6 +774,14 @@ static CURLcode readwrite_data(struct Curl_easy *data,
               result = Curl_unencode_gzip_write(conn, k, nread);
             break;
 
+#ifdef HAVE_BROTLI
+          case BROTLI:
+            /* Assume CLIENTWRITE_BODY; headers are not encoded. */
+            if(!k->ignorebody)
+              result = Curl_unencode_brotli_write(conn, k, nread);
+            break;
+#endif
+
           default:
             failf(data, "Unrecognized content encoding type. "
                   "libcurl understands `identity', `deflate' and `gzip' "
@@ -905,7 +913,9 @@ static CURLcode readwrite_upload(struct Curl_easy *data,
             sending_http_headers = FALSE;
         }
 
-        result = Curl_fillreadbuffer(conn, BUFSIZE, &fillcount);
+        result = Curl_fillreadbuffer(conn,
+                               (int)CURL_BUFSIZE(data->set.upload_buffer_size),
+                               &fillcount);
         if(result)
           return result;
 
@@ -937,7 +947,8 @@ static CURLcode readwrite_upload(struct Curl_easy *data,
          (data->set.crlf))) {
         /* Do we need to allocate a scratch buffer? */
         if(!data->state.scratch) {
-          data->state.scratch = malloc(2 * BUFSIZE);
+          data->state.scratch =
+            malloc(2 * CURL_BUFSIZE(data->set.upload_buffer_size));
           if(!data->state.scratch) {
             failf(data, "Failed to alloc scratch buffer!");
 
@@ -462,6 +462,7 @@ CURLcode Curl_close(struct Curl_easy *data)
   data->change.url = NULL;
 
   Curl_safefree(data->state.buffer);
+  Curl_safefree(data->state.uploadbuffer);
   Curl_safefree(data->state.headerbuff);
 
   Curl_flush_cookies(data, 1);
@@ -662,6 +663,12 @@ CURLcode Curl_open(struct Curl_easy **curl)
     result = CURLE_OUT_OF_MEMORY;
   }
 
+  data->state.uploadbuffer = malloc(BUFSIZE + 1);
+  if(!data->state.uploadbuffer) {
+    DEBUGF(fprintf(thread_stderr, "Error: malloc of uploadbuffer failed\n"));
+    result = CURLE_OUT_OF_MEMORY;
+  }
+
   data->state.headerbuff = malloc(HEADERSIZE);
   if(!data->state.headerbuff) {
     DEBUGF(fprintf(thread_stderr, "Error: malloc of headerbuff failed\n"));
@@ -690,6 +697,7 @@ CURLcode Curl_open(struct Curl_easy **curl)
   if(result) {
     Curl_resolver_cleanup(data->state.resolver);
     free(data->state.buffer);
+    free(data->state.uploadbuffer);
     free(data->state.headerbuff);
     Curl_freeset(data);
     free(data);
@@ -2315,6 +2323,36 @@ CURLcode Curl_setopt(struct Curl_easy *data, CURLoption option,
 
     break;
 
+  case CURLOPT_UPLOAD_BUFFERSIZE:
+    /*
+     * The application asks for a larger upload buffer: fewer read callbacks
+     * and fewer, larger sends, which matters for SFTP and TLS uploads.
+     * Never smaller than BUFSIZE, as the protocols assume that much.
+     */
+    data->set.upload_buffer_size = va_arg(param, long);
+
+    if(data->set.upload_buffer_size > MAX_BUFSIZE)
+      data->set.upload_buffer_size = MAX_BUFSIZE;
+    else if(data->set.upload_buffer_size < BUFSIZE)
+      data->set.upload_buffer_size = BUFSIZE;
+
+    if(data->set.upload_buffer_size > BUFSIZE) {
+      char *newbuff = realloc(data->state.uploadbuffer,
+                              data->set.upload_buffer_size + 1);
+      if(!newbuff) {
+        DEBUGF(fprintf(thread_stderr,
+                       "Error: realloc of uploadbuffer failed\n"));
+        data->set.upload_buffer_size = BUFSIZE;
+        result = CURLE_OUT_OF_MEMORY;
+      }
+      else
+        data->state.uploadbuffer = newbuff;
+    }
+    /* the CRLF conversion buffer is twice the upload size */
+    Curl_safefree(data->state.scratch);
+
+    break;
+
   case CURLOPT_NOSIGNAL:
     /*
      * The application asks not to set any signal() or alarm() handlers,
@@ -165,6 +165,10 @@
 #endif
 #endif
 
+#ifdef HAVE_BROTLI
+#include <brotli/decode.h>      /* for content-encoding: br */
+#endif
+
 #include <curl/curl.h>
 
 #include "http_chunks.h" /* for the structs and enum stuff */
@@ -705,11 +709,17 @@ struct SingleRequest {
 #define IDENTITY 0              /* No encoding */
 #define DEFLATE 1               /* zlib deflate [RFC 1950 & 1951] */
 #define GZIP 2                  /* gzip algorithm [RFC 1952] */
+#define BROTLI 3                /* brotli [RFC 7932] */
 
 #ifdef HAVE_LIBZ
   zlibInitState zlib_init;      /* possible zlib init state;
                                    undefined if Content-Encoding header. */
   z_stream z;                   /* State structure for zlib. */
+#ifdef HAVE_BROTLI
+  BrotliDecoderState *brotli;   /* brotli decoder, once one is needed */
+#endif
+  char *decomp;                 /* decoded data, see content_encoding.c */
+  size_t decomp_size;
 #endif
 
   time_t timeofdoc;
@@ -1326,7 +1336,7 @@ struct UrlState {
   size_t headersize;   /* size of the allocation */
 
   char *buffer; /* download buffer */
-  char uploadbuffer[BUFSIZE+1]; /* upload buffer */
+  char *uploadbuffer; /* upload buffer, set.upload_buffer_size+1 bytes */
   curl_off_t current_speed;  /* the ProgressShow() function sets this,
                                 bytes / second */
   bool this_is_a_follow; /* this is a followed Location: request */
@@ -1659,6 +1669,7 @@ struct UserDefined {
   curl_proxytype proxytype; /* what kind of proxy that is in use */
   long dns_cache_timeout; /* DNS cache timeout */
   long buffer_size;      /* size of receive buffer to use */
+  long upload_buffer_size; /* size of upload buffer to use, 0: BUFSIZE */
   void *private_data; /* application-private data */
 
   struct curl_slist *http200aliases; /* linked list of aliases for http200 */
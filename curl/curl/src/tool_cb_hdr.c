@@ -81,6 +81,16 @@ size_t tool_header_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
     (void)fflush(heads->stream);
   }
 
+  /*
+   * Remember the size of the body to come, so that tool_write_cb() can
+   * reserve the space for it in the output file.
+   */
+
+  if(checkprefix("HTTP/", str))
+    outs->prealloc = 0;
+  else if((cb > 15) && checkprefix("Content-Length:", str))
+    outs->prealloc = curlx_strtoofft(str + 15, NULL, 10);
+
   /*
    * This callback sets the filename where output shall be written when
    * curl options --remote-name (-O) and --remote-header-name (-J) have
@@ -90,7 +100,7 @@ size_t tool_header_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
 
   if(hdrcbdata->honor_cd_filename &&
      (cb > 20) && checkprefix("Content-disposition:", str) &&
-     !curl_easy_getinfo(outs->config->easy, CURLINFO_EFFECTIVE_URL, &url) &&
+     !curl_easy_getinfo(hdrcbdata->curl, CURLINFO_EFFECTIVE_URL, &url) &&
      url && (checkprefix("http://", url) || checkprefix("https://", url))) {
     const char *p = str + 20;
 
@@ -27,6 +27,9 @@
  * curl operates using a single HdrCbData struct variable, a
  * pointer to this is passed as userdata pointer to tool_header_cb.
  *
+ * 'curl' member is the easy handle of the transfer, which is not the
+ * operation's one for the transfers done with --parallel.
+ *
  * 'outs' member is a pointer to the OutStruct variable used to keep
  * track of information relative to curl's output writing.
  *
@@ -39,6 +42,7 @@
  */
 
 struct HdrCbData {
+  CURL *curl;
   struct OutStruct *outs;
   struct OutStruct *heads;
   bool honor_cd_filename;
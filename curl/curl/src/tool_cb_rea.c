@@ -27,6 +27,7 @@
 
 #include "tool_cfgable.h"
 #include "tool_cb_rea.h"
+#include "ios_error.h"
 
 #include "memdebug.h" /* keep this as LAST include */
 
@@ -39,6 +40,10 @@ size_t tool_read_cb(void *buffer, size_t sz, size_t nmemb, void *userdata)
   ssize_t rc;
   struct InStruct *in = userdata;
 
+  if(in->fd == -1)
+    /* stdin is an in-process pipe of ios_system, with no descriptor */
+    return fread(buffer, 1, sz*nmemb, thread_stdin);
+
   rc = read(in->fd, buffer, sz*nmemb);
   if(rc < 0) {
     if(errno == EAGAIN) {
@@ -21,6 +21,11 @@
  ***************************************************************************/
 #include "tool_setup.h"
 
+#ifdef HAVE_FCNTL_H
+/* for F_PREALLOCATE */
+#  include <fcntl.h>
+#endif
+
 #define ENABLE_CURLX_PRINTF
 /* use our own printf() functions */
 #include "curlx.h"
@@ -68,6 +73,57 @@ bool tool_create_output_file(struct OutStruct *outs)
   return TRUE;
 }
 
+/* write all of 'len' bytes to 'fd', return TRUE on success */
+static bool write_all(int fd, const char *ptr, size_t len)
+{
+  while(len) {
+    ssize_t n = write(fd, ptr, len);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      return FALSE;
+    }
+    ptr += n;
+    len -= (size_t)n;
+  }
+  return TRUE;
+}
+
+bool tool_flush_output(struct OutStruct *outs)
+{
+  size_t len = outs->wlen;
+
+  outs->wlen = 0;
+  return !len || write_all(fileno(outs->stream), outs->wbuf, len);
+}
+
+/*
+ * Reserve 'size' more bytes past the end of the file in one go, rather than
+ * as the file grows, for the file systems that can.
+ */
+void tool_preallocate(int fd, curl_off_t size)
+{
+#ifdef F_PREALLOCATE
+  if(size > TOOL_BUFFERSIZE) {
+    fstore_t fst;
+
+    fst.fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL;
+    fst.fst_posmode = F_PEOFPOSMODE;
+    fst.fst_offset = 0;
+    fst.fst_length = (off_t)size;
+    fst.fst_bytesalloc = 0;
+    if(fcntl(fd, F_PREALLOCATE, &fst) == -1) {
+      /* not in one piece then */
+      fst.fst_flags = F_ALLOCATEALL;
+      (void)fcntl(fd, F_PREALLOCATE, &fst);
+    }
+  }
+#else
+  (void)fd;
+  (void)size;
+#endif
+}
+
 /*
 ** callback for CURLOPT_WRITEFUNCTION
 */
@@ -98,7 +154,7 @@ size_t tool_write_cb(char *buffer, size_t sz, size_t nmemb, void *userdata)
     }
   }
   else {
-    if(sz * nmemb > (size_t)CURL_MAX_WRITE_SIZE) {
+    if(sz * nmemb > (size_t)CURL_MAX_READ_SIZE) {
       warnf(config->global, "Data size exceeds single call write limit!\n");
       return failure;
     }
@@ -137,9 +193,39 @@ size_t tool_write_cb(char *buffer, size_t sz, size_t nmemb, void *userdata)
   if(!outs->stream && !tool_create_output_file(outs))
     return failure;
 
-  rc = fwrite(buffer, sz, nmemb, outs->stream);
+  if(outs->fopened && outs->s_isreg) {
+    /* A file of ours: gathered into large writes to its descriptor, and
+       large chunks written from libcurl's buffer as they are */
+    size_t len = sz * nmemb;
+
+    if(!outs->direct) {
+      if(fflush(outs->stream))
+        return failure;
+      outs->direct = TRUE;
+      /* the space for the Content-Length still to come */
+      tool_preallocate(fileno(outs->stream), outs->prealloc);
+    }
+    if((outs->wlen + len > TOOL_BUFFERSIZE) && !tool_flush_output(outs))
+      return failure;
+    if((len >= TOOL_BUFFERSIZE) || config->nobuffer) {
+      if(!write_all(fileno(outs->stream), buffer, len))
+        return failure;
+    }
+    else {
+      if(!outs->wbuf) {
+        outs->wbuf = malloc(TOOL_BUFFERSIZE);
+        if(!outs->wbuf)
+          return failure;
+      }
+      memcpy(outs->wbuf + outs->wlen, buffer, len);
+      outs->wlen += len;
+    }
+    rc = nmemb;
+  }
+  else
+    rc = fwrite(buffer, sz, nmemb, outs->stream);
 
-  if((sz * nmemb) == rc)
+  if(nmemb == rc)
     /* we added this amount of data to the output */
     outs->bytes += (sz * nmemb);
 
@@ -23,6 +23,13 @@
  ***************************************************************************/
 #include "tool_setup.h"
 
+/*
+ * Receive buffer asked of libcurl, unless --limit-rate wants a smaller one,
+ * and what tool_write_cb() gathers before writing it to a file. Chunks that
+ * large go to the file straight from libcurl's buffer.
+ */
+#define TOOL_BUFFERSIZE (256 * 1024)
+
 /*
 ** callback for CURLOPT_WRITEFUNCTION
 */
@@ -32,5 +39,11 @@ size_t tool_write_cb(char *buffer, size_t sz, size_t nmemb, void *userdata);
 /* create a local file for writing, return TRUE on success */
 bool tool_create_output_file(struct OutStruct *outs);
 
+/* write out what is gathered for the file, return TRUE on success */
+bool tool_flush_output(struct OutStruct *outs);
+
+/* reserve room for 'size' more bytes in the file, where that is possible */
+void tool_preallocate(int fd, curl_off_t size);
+
 #endif /* HEADER_CURL_TOOL_CB_WRT_H */
 
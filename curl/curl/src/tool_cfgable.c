@@ -131,6 +131,7 @@ static void free_config_fields(struct OperationConfig *config)
 
   Curl_safefree(config->unix_socket_path);
   Curl_safefree(config->writeout);
+  Curl_safefree(config->metrics);
   Curl_safefree(config->proto_default);
 
   curl_slist_free_all(config->quote);
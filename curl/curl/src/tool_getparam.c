@@ -34,6 +34,7 @@
 #include "tool_getparam.h"
 #include "tool_helpers.h"
 #include "tool_libinfo.h"
+#include "tool_main.h"
 #include "tool_metalink.h"
 #include "tool_msgs.h"
 #include "tool_paramhlp.h"
@@ -158,6 +159,7 @@ static const struct LongShort aliases[]= {
   {"$3", "keepalive-time",           TRUE},
   {"$4", "post302",                  FALSE},
   {"$5", "noproxy",                  TRUE},
+  {"$6", "metrics",                  TRUE},
   {"$7", "socks5-gssapi-nec",        FALSE},
   {"$8", "proxy1.0",                 TRUE},
   {"$9", "tftp-blksize",             TRUE},
@@ -187,6 +189,7 @@ static const struct LongShort aliases[]= {
   {"$W", "abstract-unix-socket",     TRUE},
   {"$X", "tls-max",                  TRUE},
   {"$Y", "suppress-connect-headers", FALSE},
+  {"$Z", "segments",                 TRUE},
   {"0",   "http1.0",                 FALSE},
   {"01",  "http1.1",                 FALSE},
   {"02",  "http2",                   FALSE},
@@ -299,6 +302,8 @@ static const struct LongShort aliases[]= {
   {"Y",  "speed-limit",              TRUE},
   {"y",  "speed-time",               TRUE},
   {"z",  "time-cond",                TRUE},
+  {"Z",  "parallel",                 FALSE},
+  {"Zb", "parallel-max",             TRUE},
   {"#",  "progress-bar",             FALSE},
   {":",  "next",                     FALSE},
 };
@@ -946,6 +951,9 @@ ParameterError getparameter(char *flag,    /* f or -long-flag */
         /* This specifies the noproxy list */
         GetStr(&config->noproxy, nextarg);
         break;
+      case '6': /* --metrics */
+        GetStr(&config->metrics, nextarg);
+        break;
        case '7': /* --socks5-gssapi-nec*/
         config->socks5_gssapi_nec = toggle;
         break;
@@ -1070,6 +1078,13 @@ ParameterError getparameter(char *flag,    /* f or -long-flag */
       case 'Y': /* --suppress-connect-headers */
         config->suppress_connect_headers = toggle;
         break;
+      case 'Z': /* --segments */
+        err = str2unum(&config->segments, nextarg);
+        if(err)
+          return err;
+        if(config->segments > MAX_SEGMENTS)
+          config->segments = MAX_SEGMENTS;
+        break;
       }
       break;
     case '#': /* --progress-bar */
@@ -2005,6 +2020,21 @@ ParameterError getparameter(char *flag,    /* f or -long-flag */
         }
       }
       break;
+    case 'Z':
+      switch(subletter) {
+      case '\0':  /* --parallel */
+        global->parallel = toggle;
+        break;
+      case 'b':   /* --parallel-max */
+        err = str2unum(&global->parallel_max, nextarg);
+        if(err)
+          return err;
+        if((global->parallel_max > MAX_PARALLEL) ||
+           (global->parallel_max < 1))
+          global->parallel_max = PARALLEL_DEFAULT;
+        break;
+      }
+      break;
     default: /* unknown flag */
       return PARAM_OPTION_UNKNOWN;
     }
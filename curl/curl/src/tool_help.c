@@ -144,6 +144,7 @@ static const char *const helptext[] = {
   "     --max-redirs NUM  Maximum number of redirects allowed (H)",
   " -m, --max-time SECONDS  Maximum time allowed for the transfer",
   "     --metalink      Process given URLs as metalink XML file",
+  "     --metrics FILE  Append the timings of each transfer to FILE, as JSON",
   "     --negotiate     Use HTTP Negotiate (SPNEGO) authentication (H)",
   " -n, --netrc         Must read .netrc for user name and password",
   "     --netrc-optional  Use either .netrc or URL; overrides -n",
@@ -160,6 +161,8 @@ static const char *const helptext[] = {
   "     --ntlm-wb       Use HTTP NTLM authentication with winbind (H)",
   "     --oauth2-bearer TOKEN  OAuth 2 Bearer Token (IMAP, POP3, SMTP)",
   " -o, --output FILE   Write to FILE instead of stdout",
+  " -Z, --parallel      Perform the transfers in parallel",
+  "     --parallel-max NUM  Maximum number of transfers at once",
   "     --pass PASS     Pass phrase for the private key (SSL/SSH)",
   "     --path-as-is    Do not squash .. sequences in URL path",
   "     --pinnedpubkey FILE/HASHES Public key to verify peer against (SSL)",
@@ -229,6 +232,7 @@ static const char *const helptext[] = {
   "     --retry-delay SECONDS  Wait SECONDS between retries",
   "     --retry-max-time SECONDS  Retry only within this period",
   "     --sasl-ir       Enable initial response in SASL authentication",
+  "     --segments NUM  Download one file with NUM range requests at once",
   " -S, --show-error    "
   "Show error. With -s, make curl show errors when they occur",
   " -s, --silent        Silent mode (don't output anything)",
@@ -44,6 +44,7 @@
 #include "tool_vms.h"
 #include "tool_main.h"
 #include "tool_libinfo.h"
+#include "tool_share.h"
 #include "ios_error.h"
 
 /*
@@ -139,6 +140,7 @@ static CURLcode main_init(struct GlobalConfig *config)
   /* Initialise the global config */
   config->showerror = -1;             /* Will show errors */
   config->errors = thread_stderr;            /* Default errors to stderr */
+  config->parallel_max = PARALLEL_DEFAULT;
 
   /* Allocate the initial operate config */
   config->first = config->last = malloc(sizeof(struct OperationConfig));
@@ -150,8 +152,9 @@ static CURLcode main_init(struct GlobalConfig *config)
       result = get_libcurl_info();
 
       if(!result) {
-        /* Get a curl handle to use for all forthcoming curl transfers */
-        config->easy = curl_easy_init();
+        /* Get a curl handle to use for all forthcoming curl transfers,
+           perhaps one an earlier command left with its connections */
+        config->easy = tool_share_easy();
         if(config->easy) {
           /* Initialise the config */
           config_init(config->first);
@@ -203,8 +206,17 @@ static void free_config_fields(struct GlobalConfig *config)
  */
 static void main_free(struct GlobalConfig *config)
 {
-  /* Cleanup the easy handle */
-  curl_easy_cleanup(config->easy);
+  struct OperationConfig *operation;
+  bool keep = TRUE;
+
+  /* A handle with the cookie engine on, or names given with --resolve in
+     its DNS cache, is no good to the next command */
+  for(operation = config->first; operation; operation = operation->next)
+    if(operation->cookiefile || operation->cookiejar || operation->resolve)
+      keep = FALSE;
+
+  /* Give back the easy handle */
+  tool_share_release(config->easy, keep);
   config->easy = NULL;
 
   /* Main cleanup */
@@ -28,6 +28,10 @@
 #define RETRY_SLEEP_DEFAULT 1000L   /* ms */
 #define RETRY_SLEEP_MAX     600000L /* ms == 10 minutes */
 
+#define PARALLEL_DEFAULT 50L  /* transfers at once with --parallel */
+#define MAX_PARALLEL     300L /* and at most, with --parallel-max */
+#define MAX_SEGMENTS     16L  /* range requests at once with --segments */
+
 #ifndef STDIN_FILENO
 #  define STDIN_FILENO  fileno(thread_stdin)
 #endif
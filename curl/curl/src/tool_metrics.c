@@ -0,0 +1,202 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "tool_setup.h"
+
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
+#define ENABLE_CURLX_PRINTF
+/* use our own printf() functions */
+#include "curlx.h"
+
+#include "tool_cfgable.h"
+#include "tool_metrics.h"
+#include "tool_msgs.h"
+
+#include "memdebug.h" /* keep this as LAST include */
+
+static struct curl_tool_metrics totals;
+
+#ifdef HAVE_PTHREAD_H
+/* The counters and the writes to the files of --metrics */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+#define METRICS_LOCK() pthread_mutex_lock(&metrics_lock)
+#define METRICS_UNLOCK() pthread_mutex_unlock(&metrics_lock)
+#else
+#define METRICS_LOCK()
+#define METRICS_UNLOCK()
+#endif
+
+/* 'str' as a JSON string, quotes included, into a new allocation */
+static char *json_string(const char *str)
+{
+  size_t len = 2;
+  const char *p;
+  char *out;
+  char *o;
+
+  if(!str)
+    return strdup("null");
+  for(p = str; *p; p++)
+    len += ((unsigned char)*p < 0x20 || *p == '"' || *p == '\\') ? 6 : 1;
+  out = malloc(len + 1);
+  if(!out)
+    return NULL;
+  o = out;
+  *o++ = '"';
+  for(p = str; *p; p++) {
+    unsigned char c = (unsigned char)*p;
+    if(c == '"' || c == '\\') {
+      *o++ = '\\';
+      *o++ = (char)c;
+    }
+    else if(c < 0x20) {
+      snprintf(o, 7, "\\u%04x", c);
+      o += 6;
+    }
+    else
+      *o++ = (char)c;
+  }
+  *o++ = '"';
+  *o = '\0';
+  return out;
+}
+
+static double info_time(CURL *curl, CURLINFO info)
+{
+  double value = 0;
+  curl_easy_getinfo(curl, info, &value);
+  return value;
+}
+
+static long info_long(CURL *curl, CURLINFO info)
+{
+  long value = 0;
+  curl_easy_getinfo(curl, info, &value);
+  return value;
+}
+
+void tool_metrics_transfer(struct OperationConfig *config, CURL *curl,
+                           CURLcode result)
+{
+  double namelookup = info_time(curl, CURLINFO_NAMELOOKUP_TIME);
+  double connect = info_time(curl, CURLINFO_CONNECT_TIME);
+  double appconnect = info_time(curl, CURLINFO_APPCONNECT_TIME);
+  double pretransfer = info_time(curl, CURLINFO_PRETRANSFER_TIME);
+  double starttransfer = info_time(curl, CURLINFO_STARTTRANSFER_TIME);
+  double redirect = info_time(curl, CURLINFO_REDIRECT_TIME);
+  double total = info_time(curl, CURLINFO_TOTAL_TIME);
+  double down = info_time(curl, CURLINFO_SIZE_DOWNLOAD);
+  double up = info_time(curl, CURLINFO_SIZE_UPLOAD);
+  long connects = info_long(curl, CURLINFO_NUM_CONNECTS);
+  long response = info_long(curl, CURLINFO_RESPONSE_CODE);
+  long httpversion = info_long(curl, CURLINFO_HTTP_VERSION);
+  long redirects = info_long(curl, CURLINFO_REDIRECT_COUNT);
+  long port = info_long(curl, CURLINFO_PRIMARY_PORT);
+  char *url = NULL;
+  char *ip = NULL;
+  char *jurl;
+  char *jip;
+  char *line;
+  struct curl_tool_metrics now;
+  /* a transfer that got somewhere without a connection of its own */
+  bool reused = !connects && (pretransfer > 0);
+  FILE *file;
+  bool written = FALSE;
+
+  METRICS_LOCK();
+  totals.transfers++;
+  totals.connections_new += connects;
+  if(reused)
+    totals.connections_reused++;
+  totals.time_namelookup += namelookup;
+  totals.time_connect += connect;
+  totals.time_appconnect += appconnect;
+  totals.time_starttransfer += starttransfer;
+  totals.time_total += total;
+  totals.bytes_down += (curl_off_t)down;
+  totals.bytes_up += (curl_off_t)up;
+  now = totals;
+  METRICS_UNLOCK();
+
+  if(!config->metrics)
+    return;
+
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip);
+  jurl = json_string(url);
+  jip = json_string((ip && *ip) ? ip : NULL);
+  line = (jurl && jip) ? aprintf(
+    "{\"url\":%s,\"result\":%d,\"response_code\":%ld,"
+    "\"http_version\":%ld,\"remote_ip\":%s,\"remote_port\":%ld,"
+    "\"time_namelookup\":%.6f,\"time_connect\":%.6f,"
+    "\"time_appconnect\":%.6f,\"time_pretransfer\":%.6f,"
+    "\"time_starttransfer\":%.6f,\"time_redirect\":%.6f,"
+    "\"time_total\":%.6f,\"size_download\":%.0f,\"size_upload\":%.0f,"
+    "\"num_connects\":%ld,\"num_redirects\":%ld,\"connection_reused\":%s,"
+    "\"process\":{\"transfers\":%ld,\"connections_new\":%ld,"
+    "\"connections_reused\":%ld,\"handles_new\":%ld,"
+    "\"handles_reused\":%ld}}\n",
+    jurl, (int)result, response, httpversion, jip, port,
+    namelookup, connect, appconnect, pretransfer, starttransfer, redirect,
+    total, down, up, connects, redirects, reused ? "true" : "false",
+    now.transfers, now.connections_new, now.connections_reused,
+    now.handles_new, now.handles_reused) : NULL;
+  free(jurl);
+  free(jip);
+  if(!line) {
+    warnf(config->global, "out of memory for --metrics\n");
+    return;
+  }
+
+  /* whole lines, one command at a time, for the concurrent ones */
+  METRICS_LOCK();
+  file = fopen(config->metrics, "a");
+  if(file) {
+    written = (fputs(line, file) != EOF);
+    if(fclose(file))
+      written = FALSE;
+  }
+  METRICS_UNLOCK();
+  if(!written)
+    warnf(config->global, "Failed writing metrics to '%s'\n",
+          config->metrics);
+  free(line);
+}
+
+void tool_metrics_handle(bool reused)
+{
+  METRICS_LOCK();
+  if(reused)
+    totals.handles_reused++;
+  else
+    totals.handles_new++;
+  METRICS_UNLOCK();
+}
+
+void curl_tool_metrics(struct curl_tool_metrics *metrics)
+{
+  METRICS_LOCK();
+  *metrics = totals;
+  METRICS_UNLOCK();
+}
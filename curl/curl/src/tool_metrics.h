@@ -0,0 +1,63 @@
+#ifndef HEADER_CURL_TOOL_METRICS_H
+#define HEADER_CURL_TOOL_METRICS_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "tool_setup.h"
+#include "tool_cfgable.h"
+
+/*
+ * --metrics FILE appends one line of JSON to FILE for each transfer: the
+ * times of its phases, its sizes, and whether it reused a connection.
+ * Each line also carries the counters of the process, kept whether
+ * --metrics is used or not: the transfers, the connections opened and
+ * reused, and the easy handles taken new or from the pool of tool_share.c.
+ */
+
+struct curl_tool_metrics {
+  long transfers;               /* done, passed or failed */
+  long connections_new;         /* opened */
+  long connections_reused;      /* transfers that opened none */
+  long handles_new;             /* created by tool_share_easy() */
+  long handles_reused;          /* taken from the pool */
+  double time_namelookup;       /* seconds, summed over the transfers */
+  double time_connect;
+  double time_appconnect;
+  double time_starttransfer;
+  double time_total;
+  curl_off_t bytes_down;
+  curl_off_t bytes_up;
+};
+
+/* Counts the result of a transfer, and writes it to --metrics if set */
+void tool_metrics_transfer(struct OperationConfig *config, CURL *curl,
+                           CURLcode result);
+
+/* Counts a handle taken by tool_share_easy() */
+void tool_metrics_handle(bool reused);
+
+/* Copies the counters of the process, for the app to call */
+#ifdef __GNUC__
+__attribute__ ((visibility("default")))
+#endif
+void curl_tool_metrics(struct curl_tool_metrics *metrics);
+
+#endif /* HEADER_CURL_TOOL_METRICS_H */
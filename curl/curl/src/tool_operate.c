@@ -66,12 +66,15 @@
 #include "tool_libinfo.h"
 #include "tool_main.h"
 #include "tool_metalink.h"
+#include "tool_metrics.h"
 #include "tool_msgs.h"
 #include "tool_operate.h"
 #include "tool_operhlp.h"
 #include "tool_paramhlp.h"
 #include "tool_parsecfg.h"
 #include "tool_setopt.h"
+#include "tool_segments.h"
+#include "tool_share.h"
 #include "tool_sleep.h"
 #include "tool_urlglob.h"
 #include "tool_util.h"
@@ -250,15 +253,581 @@ static void setfiletime(long filetime, const char *filename,
 #endif /* defined(HAVE_UTIME) || \
           (defined(WIN32) && (CURL_SIZEOF_CURL_OFF_T >= 8)) */
 
+/*
+ * Everything a single transfer keeps from its setup until it is done. With
+ * --parallel, a number of them are on a multi handle at once and each one
+ * has an easy handle of its own.
+ */
+struct per_transfer {
+  struct per_transfer *next;
+  CURL *curl;
+  struct OperationConfig *config;
+  char errorbuffer[CURL_ERROR_SIZE];
+  struct ProgressData progressbar;
+  struct HdrCbData hdrcbdata;
+  struct OutStruct outs;
+  struct OutStruct heads;       /* headers to stdout, when spooled */
+  struct InStruct input;
+  int infd;
+  bool infdopen;
+  char *outfile;
+  char *this_url;
+  struct timeval retrystart;
+  long retry_numretries;
+  long retry_sleep_default;
+  long retry_sleep;
+  int metalink;                 /* nonzero for metalink download */
+  metalinkfile *mlfile;
+  int metalink_next_res;
+  bool parallel;                /* done on the multi handle */
+  FILE *spool;                  /* what goes to stdout, until its turn */
+  char *spoolbuf;
+  size_t spoollen;
+  bool retrying;                /* waiting to be added again */
+  struct timeval retryat;
+  long delay;                   /* ms after retryat */
+  bool done;
+};
+
+/* The transfers of one operation that run at once, with --parallel */
+struct parallel {
+  CURLM *multi;
+  struct per_transfer *first;   /* in the order the URLs were given */
+  struct per_transfer *last;
+  int running;
+  int waiting;                  /* for a retry */
+  unsigned long done;
+  curl_off_t received;          /* by the transfers done */
+  bool meter;                   /* show the combined progress line */
+  bool meter_shown;
+  struct timeval shown;
+  CURLcode result;              /* of the last transfer that failed */
+};
+
+/*
+ * A transfer has returned with 'result'. Returns what it ends with, or sets
+ * '*delay' to the number of milliseconds to wait before trying it again.
+ */
+static CURLcode post_transfer(struct GlobalConfig *global,
+                              struct per_transfer *per, CURLcode result,
+                              long *delay)
+{
+  struct OperationConfig *config = per->config;
+  CURL *curl = per->curl;
+
+  *delay = 0;
+
+  tool_metrics_transfer(config, curl, result);
+
+  if(!result && !per->outs.stream && !per->outs.bytes) {
+    /* we have received no data despite the transfer was successful
+       ==> force cration of an empty output file (if an output file
+       was specified) */
+    long cond_unmet = 0L;
+    /* do not create (or even overwrite) the file in case we get no
+       data because of unmet condition */
+    curl_easy_getinfo(curl, CURLINFO_CONDITION_UNMET, &cond_unmet);
+    if(!cond_unmet && !tool_create_output_file(&per->outs))
+      result = CURLE_WRITE_ERROR;
+  }
+
+  if(per->outs.is_cd_filename && per->outs.stream && !global->mute &&
+     per->outs.filename)
+    fprintf(thread_stdout, "curl: Saved to filename '%s'\n",
+            per->outs.filename);
+
+  /* if retry-max-time is non-zero, make sure we haven't exceeded the
+     time */
+  if(per->retry_numretries &&
+     (!config->retry_maxtime ||
+      (tvdiff(tvnow(), per->retrystart) <
+       config->retry_maxtime*1000L)) ) {
+    enum {
+      RETRY_NO,
+      RETRY_TIMEOUT,
+      RETRY_CONNREFUSED,
+      RETRY_HTTP,
+      RETRY_FTP,
+      RETRY_LAST /* not used */
+    } retry = RETRY_NO;
+    long response;
+    if((CURLE_OPERATION_TIMEDOUT == result) ||
+       (CURLE_COULDNT_RESOLVE_HOST == result) ||
+       (CURLE_COULDNT_RESOLVE_PROXY == result) ||
+       (CURLE_FTP_ACCEPT_TIMEOUT == result))
+      /* retry timeout always */
+      retry = RETRY_TIMEOUT;
+    else if(config->retry_connrefused &&
+            (CURLE_COULDNT_CONNECT == result)) {
+      long oserrno;
+      curl_easy_getinfo(curl, CURLINFO_OS_ERRNO, &oserrno);
+      if(ECONNREFUSED == oserrno)
+        retry = RETRY_CONNREFUSED;
+    }
+    else if((CURLE_OK == result) ||
+            (config->failonerror &&
+             (CURLE_HTTP_RETURNED_ERROR == result))) {
+      /* If it returned OK. _or_ failonerror was enabled and it
+         returned due to such an error, check for HTTP transient
+         errors to retry on. */
+      char *effective_url = NULL;
+      curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective_url);
+      if(effective_url &&
+         checkprefix("http", effective_url)) {
+        /* This was HTTP(S) */
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
+
+        switch(response) {
+        case 500: /* Internal Server Error */
+        case 502: /* Bad Gateway */
+        case 503: /* Service Unavailable */
+        case 504: /* Gateway Timeout */
+          retry = RETRY_HTTP;
+          /*
+           * At this point, we have already written data to the output
+           * file (or terminal). If we write to a file, we must rewind
+           * or close/re-open the file so that the next attempt starts
+           * over from the beginning.
+           *
+           * TODO: similar action for the upload case. We might need
+           * to start over reading from a previous point if we have
+           * uploaded something when this was returned.
+           */
+          break;
+        }
+      }
+    } /* if CURLE_OK */
+    else if(result) {
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
+
+      if(response/100 == 4)
+        /*
+         * This is typically when the FTP server only allows a certain
+         * amount of users and we are not one of them.  All 4xx codes
+         * are transient.
+         */
+        retry = RETRY_FTP;
+    }
+
+    if(retry) {
+      static const char * const m[]={
+        NULL,
+        "timeout",
+        "connection refused",
+        "HTTP error",
+        "FTP error"
+      };
+
+      warnf(config->global, "Transient problem: %s "
+            "Will retry in %ld seconds. "
+            "%ld retries left.\n",
+            m[retry], per->retry_sleep/1000L, per->retry_numretries);
+
+      *delay = per->retry_sleep;
+      per->retry_numretries--;
+      if(!config->retry_delay) {
+        per->retry_sleep *= 2;
+        if(per->retry_sleep > RETRY_SLEEP_MAX)
+          per->retry_sleep = RETRY_SLEEP_MAX;
+      }
+      if(per->outs.bytes && per->outs.filename && per->outs.stream) {
+        /* We have written data to a output file, we truncate file
+         */
+        if(!global->mute)
+          fprintf(global->errors, "Throwing away %"
+                  CURL_FORMAT_CURL_OFF_T " bytes\n",
+                  per->outs.bytes);
+        per->outs.wlen = 0; /* what is still gathered goes too */
+        fflush(per->outs.stream);
+        /* truncate file at the position where we started appending */
+#ifdef HAVE_FTRUNCATE
+        if(ftruncate(fileno(per->outs.stream), per->outs.init)) {
+          /* when truncate fails, we can't just append as then we'll
+             create something strange, bail out */
+          if(!global->mute)
+            fprintf(global->errors,
+                    "failed to truncate, exiting\n");
+          *delay = 0;
+          return CURLE_WRITE_ERROR;
+        }
+        /* now seek to the end of the file, the position where we
+           just truncated the file in a large file-safe way */
+        fseek(per->outs.stream, 0, SEEK_END);
+#else
+        /* ftruncate is not available, so just reposition the file
+           to the location we would have truncated it. This won't
+           work properly with large files on 32-bit systems, but
+           most of those will have ftruncate. */
+        fseek(per->outs.stream, (long)per->outs.init, SEEK_SET);
+#endif
+        per->outs.bytes = 0; /* clear for next round */
+      }
+      return result;
+    }
+  } /* if retry_numretries */
+  else if(per->metalink) {
+    /* Metalink: Decide to try the next resource or
+       not. Basically, we want to try the next resource if
+       download was not successful. */
+    long response;
+    if(CURLE_OK == result) {
+      /* TODO We want to try next resource when download was
+         not successful. How to know that? */
+      char *effective_url = NULL;
+      curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective_url);
+      if(effective_url &&
+         curl_strnequal(effective_url, "http", 4)) {
+        /* This was HTTP(S) */
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
+        if(response != 200 && response != 206) {
+          per->metalink_next_res = 1;
+          fprintf(global->errors,
+                  "Metalink: fetching (%s) from (%s) FAILED "
+                  "(HTTP status code %ld)\n",
+                  per->mlfile->filename, per->this_url, response);
+        }
+      }
+    }
+    else {
+      per->metalink_next_res = 1;
+      fprintf(global->errors,
+              "Metalink: fetching (%s) from (%s) FAILED (%s)\n",
+              per->mlfile->filename, per->this_url,
+              (per->errorbuffer[0]) ?
+              per->errorbuffer : curl_easy_strerror(result));
+    }
+  }
+  if(per->metalink && !per->metalink_next_res)
+    fprintf(global->errors, "Metalink: fetching (%s) from (%s) OK\n",
+            per->mlfile->filename, per->this_url);
+
+  return result;
+}
+
+/* The newline after the progress bar, --write-out and --writeenv */
+static void transfer_output(struct per_transfer *per)
+{
+  struct OperationConfig *config = per->config;
+
+  if((config->global->progressmode == CURL_PROGRESS_BAR) &&
+     per->progressbar.calls)
+    /* if the custom progress bar has been displayed, we output a
+       newline here */
+    fputs("\n", per->progressbar.out);
+
+  if(config->writeout)
+    ourWriteOut(per->curl, &per->outs, config->writeout);
+
+  if(config->writeenv)
+    ourWriteEnv(per->curl);
+}
+
+/* Displays the error message for a transfer that failed with 'result' */
+static void transfer_error(struct GlobalConfig *global,
+                           struct per_transfer *per, CURLcode result)
+{
+#ifdef __VMS
+  if(is_vms_shell()) {
+    /* VMS DCL shell behavior */
+    if(!global->showerror)
+      vms_show = VMSSTS_HIDE;
+  }
+  else
+#endif
+  if(result && global->showerror) {
+    fprintf(global->errors, "curl: (%d) %s\n", result,
+            (per->errorbuffer[0]) ?
+            per->errorbuffer : curl_easy_strerror(result));
+    if(result == CURLE_SSL_CACERT)
+      fprintf(global->errors, "%s%s%s",
+              CURL_CA_CERT_ERRORMSG1, CURL_CA_CERT_ERRORMSG2,
+              ((curlinfo->features & CURL_VERSION_HTTPS_PROXY) ?
+               "HTTPS-proxy has similar options --proxy-cacert "
+               "and --proxy-insecure.\n" :
+               ""));
+  }
+}
+
+/*
+ * Closes the files of a transfer and frees what it allocated, except for
+ * the spooled output and the struct itself. Returns 'result', or the error
+ * that closing the output file gave.
+ */
+static CURLcode end_transfer(struct GlobalConfig *global,
+                             struct per_transfer *per, CURLcode result)
+{
+  struct OperationConfig *config = per->config;
+  CURL *curl = per->curl;
+
+  /* Set file extended attributes */
+  if(!result && config->xattr && per->outs.fopened && per->outs.stream) {
+    int rc = fwrite_xattr(curl, fileno(per->outs.stream));
+    if(rc)
+      warnf(config->global, "Error setting extended attributes: %s\n",
+            strerror(errno));
+  }
+
+  /* Close the file */
+  if(per->outs.fopened && per->outs.stream) {
+    bool flushed = tool_flush_output(&per->outs);
+    int rc = fclose(per->outs.stream);
+    if(!result && (rc || !flushed)) {
+      /* something went wrong in the writing process */
+      result = CURLE_WRITE_ERROR;
+      fprintf(global->errors, "(%d) Failed writing body\n", result);
+    }
+  }
+  else if(!per->outs.s_isreg && per->outs.stream) {
+    /* Dump standard stream buffered data */
+    int rc = fflush(per->outs.stream);
+    if(!result && rc) {
+      /* something went wrong in the writing process */
+      result = CURLE_WRITE_ERROR;
+      fprintf(global->errors, "(%d) Failed writing body\n", result);
+    }
+  }
+
+#ifdef __AMIGA__
+  if(!result && per->outs.s_isreg && per->outs.filename) {
+    /* Set the url (up to 80 chars) as comment for the file */
+    if(strlen(url) > 78)
+      url[79] = '\0';
+    SetComment(per->outs.filename, url);
+  }
+#endif
+
+#if defined(HAVE_UTIME) || \
+    (defined(WIN32) && (CURL_SIZEOF_CURL_OFF_T >= 8))
+  /* File time can only be set _after_ the file has been closed */
+  if(!result && config->remote_time && per->outs.s_isreg &&
+     per->outs.filename) {
+    /* Ask libcurl if we got a remote file time */
+    long filetime = -1;
+    curl_easy_getinfo(curl, CURLINFO_FILETIME, &filetime);
+    if(filetime >= 0)
+      setfiletime(filetime, per->outs.filename, config->global->errors);
+  }
+#endif /* defined(HAVE_UTIME) || \
+          (defined(WIN32) && (CURL_SIZEOF_CURL_OFF_T >= 8)) */
+
+#ifdef USE_METALINK
+  if(!per->metalink && config->use_metalink && result == CURLE_OK) {
+    int rv = parse_metalink(config, &per->outs, per->this_url);
+    if(rv == 0)
+      fprintf(config->global->errors, "Metalink: parsing (%s) OK\n",
+              per->this_url);
+    else if(rv == -1)
+      fprintf(config->global->errors, "Metalink: parsing (%s) FAILED\n",
+              per->this_url);
+  }
+  else if(per->metalink && result == CURLE_OK && !per->metalink_next_res) {
+    int rv = metalink_check_hash(global, per->mlfile, per->outs.filename);
+    if(rv == 0) {
+      per->metalink_next_res = 1;
+    }
+  }
+#endif /* USE_METALINK */
+
+  /* No more business with this output struct */
+  if(per->outs.alloc_filename)
+    Curl_safefree(per->outs.filename);
+  Curl_safefree(per->outs.wbuf);
+#ifdef USE_METALINK
+  if(per->outs.metalink_parser)
+    metalink_parser_context_delete(per->outs.metalink_parser);
+#endif /* USE_METALINK */
+  memset(&per->outs, 0, sizeof(struct OutStruct));
+  per->hdrcbdata.outs = NULL;
+
+  /* Free loop-local allocated memory and close loop-local opened fd */
+
+  Curl_safefree(per->outfile);
+  Curl_safefree(per->this_url);
+
+  if(per->infdopen)
+    close(per->infd);
+  per->infdopen = FALSE;
+
+  return result;
+}
+
+/*
+ * Writes out what the transfers at the head of the list spooled for stdout,
+ * as soon as they are done, so that it comes out in the order of the URLs.
+ */
+static void parallel_flush(struct parallel *par)
+{
+  struct per_transfer *per;
+
+  while((per = par->first) && per->done) {
+    if(per->spool) {
+      fclose(per->spool);
+      if(per->spoollen)
+        fwrite(per->spoolbuf, 1, per->spoollen, thread_stdout);
+      fflush(thread_stdout);
+      free(per->spoolbuf);
+    }
+    par->first = per->next;
+    if(!par->first)
+      par->last = NULL;
+    free(per);
+  }
+}
+
+/* The one progress line for all the transfers, at most once a second */
+static void parallel_meter(struct GlobalConfig *global,
+                           struct parallel *par, bool final)
+{
+  struct per_transfer *per;
+  curl_off_t received = par->received;
+  struct timeval now = tvnow();
+
+  if(!par->meter || (final && !par->meter_shown) ||
+     (!final && tvdiff(now, par->shown) < 1000))
+    return;
+  par->shown = now;
+  par->meter_shown = TRUE;
+
+  for(per = par->first; per; per = per->next)
+    received += per->outs.bytes;
+  fprintf(global->errors, "\r%lu done, %d running, %d to retry, %"
+          CURL_FORMAT_CURL_OFF_T " bytes received   %s", par->done,
+          par->running, par->waiting, received, final ? "\n" : "");
+}
+
+/* A transfer on the multi handle has returned with 'result' */
+static void parallel_done(struct GlobalConfig *global, struct parallel *par,
+                          struct per_transfer *per, CURLcode result)
+{
+  struct OperationConfig *config = per->config;
+  long delay;
+
+  curl_multi_remove_handle(par->multi, per->curl);
+  par->running--;
+
+  result = post_transfer(global, per, result, &delay);
+  if(delay) {
+    per->retrying = TRUE;
+    per->retryat = tvnow();
+    per->delay = delay;
+    par->waiting++;
+    return;
+  }
+
+  par->received += per->outs.bytes;
+  transfer_output(per);
+  if(result && par->meter_shown)
+    fputs("\n", global->errors);
+  transfer_error(global, per, result);
+  result = end_transfer(global, per, result);
+
+  tool_share_release(per->curl, !config->cookiefile && !config->resolve);
+  per->curl = NULL;
+  per->done = TRUE;
+  par->done++;
+  if(result)
+    par->result = result;
+}
+
+/* Lets the transfers on the multi handle run for a while */
+static void parallel_perform(struct GlobalConfig *global,
+                             struct parallel *par)
+{
+  struct per_transfer *per;
+  CURLMsg *msg;
+  int still;
+  int queued;
+
+  if(par->waiting) {
+    /* those to retry go back on the multi handle once their time is up */
+    struct timeval now = tvnow();
+    for(per = par->first; per; per = per->next) {
+      if(per->retrying && (tvdiff(now, per->retryat) >= per->delay)) {
+        per->retrying = FALSE;
+        par->waiting--;
+        curl_multi_add_handle(par->multi, per->curl);
+        par->running++;
+      }
+    }
+  }
+
+  if(par->running)
+    curl_multi_wait(par->multi, NULL, 0, par->waiting ? 100 : 1000, NULL);
+  else
+    tool_go_sleep(100);
+  curl_multi_perform(par->multi, &still);
+
+  while((msg = curl_multi_info_read(par->multi, &queued))) {
+    if(msg->msg == CURLMSG_DONE) {
+      CURLcode result = msg->data.result;
+      char *ptr = NULL;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &ptr);
+      parallel_done(global, par, (struct per_transfer *)ptr, result);
+    }
+  }
+
+  parallel_meter(global, par, FALSE);
+  parallel_flush(par);
+}
+
+/*
+ * Puts the transfer on the multi handle, once there is room for it. Returns
+ * an error, and keeps nothing of the transfer, if it could not be added.
+ */
+static CURLcode parallel_add(struct GlobalConfig *global,
+                             struct parallel *par, struct per_transfer *per)
+{
+  if(!par->multi) {
+    par->multi = curl_multi_init();
+    if(!par->multi)
+      return CURLE_OUT_OF_MEMORY;
+    if(curlinfo->features & CURL_VERSION_HTTP2)
+      /* the HTTP/2 transfers to one host all go over one connection */
+      curl_multi_setopt(par->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  }
+
+  while(par->running + par->waiting >= global->parallel_max)
+    parallel_perform(global, par);
+
+  curl_easy_setopt(per->curl, CURLOPT_PRIVATE, (char *)per);
+  per->retrystart = tvnow();
+  if(curl_multi_add_handle(par->multi, per->curl))
+    return CURLE_OUT_OF_MEMORY;
+  par->running++;
+
+  per->next = NULL;
+  if(par->last)
+    par->last->next = per;
+  else
+    par->first = per;
+  par->last = per;
+
+  return CURLE_OK;
+}
+
+/* Waits for all the transfers to be done, returns the last error */
+static CURLcode parallel_finish(struct GlobalConfig *global,
+                                struct parallel *par)
+{
+  while(par->running || par->waiting)
+    parallel_perform(global, par);
+  parallel_meter(global, par, TRUE);
+  parallel_flush(par);
+
+  if(par->multi)
+    curl_multi_cleanup(par->multi);
+  par->multi = NULL;
+
+  return par->result;
+}
+
 static CURLcode operate_do(struct GlobalConfig *global,
                            struct OperationConfig *config)
 {
-  char errorbuffer[CURL_ERROR_SIZE];
-  struct ProgressData progressbar;
   struct getout *urlnode;
 
-  struct HdrCbData hdrcbdata;
   struct OutStruct heads;
+  struct parallel par;
 
   metalinkfile *mlfile_last = NULL;
 
@@ -273,10 +842,10 @@ static CURLcode operate_do(struct GlobalConfig *global,
   bool orig_noprogress = global->noprogress;
   bool orig_isatty = global->isatty;
 
-  errorbuffer[0] = '\0';
+  memset(&par, 0, sizeof(struct parallel));
+  par.meter = !orig_noprogress && !global->mute;
 
   /* default headers output stream is stdout */
-  memset(&hdrcbdata, 0, sizeof(struct HdrCbData));
   memset(&heads, 0, sizeof(struct OutStruct));
   heads.stream = thread_stdout;
   heads.config = config;
@@ -531,64 +1100,85 @@ static CURLcode operate_do(struct GlobalConfig *global,
       /* Here's looping around each globbed URL */
       for(li = 0 ; li < urlnum; li++) {
 
-        int infd;
-        bool infdopen;
-        char *outfile;
-        struct OutStruct outs;
-        struct InStruct input;
-        struct timeval retrystart;
+        struct per_transfer *per;
         curl_off_t uploadfilesize;
-        long retry_numretries;
-        long retry_sleep_default;
-        long retry_sleep;
-        char *this_url = NULL;
-        int metalink_next_res = 0;
-
-        outfile = NULL;
-        infdopen = FALSE;
-        infd = fileno(thread_stdin);
+        int metalink_next_res;
+        bool segmented;
+
+        per = calloc(1, sizeof(struct per_transfer));
+        if(!per) {
+          helpf(global->errors, "out of memory\n");
+          result = CURLE_OUT_OF_MEMORY;
+          break;
+        }
+        per->config = config;
+        per->metalink = metalink;
+        per->mlfile = mlfile;
+        per->infd = fileno(thread_stdin);
         uploadfilesize = -1; /* -1 means unknown */
 
+        /* transfers that read stdin, keep state in the handle between
+           the URLs or write the --libcurl source stay one at a time */
+        per->parallel = global->parallel && !metalink &&
+          !config->use_metalink && !config->cookiejar && !global->libcurl &&
+          (config->segments < 2) && !(uploadfile && stdin_upload(uploadfile));
+        if(per->parallel) {
+          per->curl = tool_share_easy();
+          if(!per->curl) {
+            free(per);
+            helpf(global->errors, "out of memory\n");
+            result = CURLE_OUT_OF_MEMORY;
+            break;
+          }
+        }
+        else
+          per->curl = config->easy;
+        curl = per->curl;
+
         /* default output stream is stdout */
-        memset(&outs, 0, sizeof(struct OutStruct));
-        outs.stream = thread_stdout;
-        outs.config = config;
+        memset(&per->outs, 0, sizeof(struct OutStruct));
+        per->outs.stream = thread_stdout;
+        per->outs.config = config;
 
         if(metalink) {
           /* For Metalink download, use name in Metalink file as
              filename. */
-          outfile = strdup(mlfile->filename);
-          if(!outfile) {
+          per->outfile = strdup(mlfile->filename);
+          if(!per->outfile) {
             result = CURLE_OUT_OF_MEMORY;
             goto show_error;
           }
-          this_url = strdup(mlres->url);
-          if(!this_url) {
+          per->this_url = strdup(mlres->url);
+          if(!per->this_url) {
             result = CURLE_OUT_OF_MEMORY;
             goto show_error;
           }
         }
         else {
           if(urls) {
-            result = glob_next_url(&this_url, urls);
+            result = glob_next_url(&per->this_url, urls);
             if(result)
               goto show_error;
           }
           else if(!li) {
-            this_url = strdup(urlnode->url);
-            if(!this_url) {
+            per->this_url = strdup(urlnode->url);
+            if(!per->this_url) {
               result = CURLE_OUT_OF_MEMORY;
               goto show_error;
             }
           }
           else
-            this_url = NULL;
-          if(!this_url)
+            per->this_url = NULL;
+          if(!per->this_url) {
+            if(per->parallel)
+              tool_share_release(per->curl, TRUE);
+            free(per);
             break;
+          }
 
           if(outfiles) {
-            outfile = strdup(outfiles);
-            if(!outfile) {
+            per->outfile = strdup(outfiles);
+            if(!per->outfile) {
               result = CURLE_OUT_OF_MEMORY;
               goto show_error;
             }
@@ -596,7 +1186,7 @@ static CURLcode operate_do(struct GlobalConfig *global,
         }
 
         if(((urlnode->flags&GETOUT_USEREMOTE) ||
-            (outfile && strcmp("-", outfile))) &&
+            (per->outfile && strcmp("-", per->outfile))) &&
            (metalink || !config->use_metalink)) {
 
           /*
@@ -604,12 +1194,12 @@ static CURLcode operate_do(struct GlobalConfig *global,
            * decided we want to use the remote file name.
            */
 
-          if(!outfile) {
+          if(!per->outfile) {
             /* extract the file name from the URL */
-            result = get_url_file_name(&outfile, this_url);
+            result = get_url_file_name(&per->outfile, per->this_url);
             if(result)
               goto show_error;
-            if(!*outfile && !config->content_disposition) {
+            if(!*per->outfile && !config->content_disposition) {
               helpf(global->errors, "Remote file name has no length!\n");
               result = CURLE_WRITE_ERROR;
               goto quit_urls;
@@ -617,8 +1207,8 @@ static CURLcode operate_do(struct GlobalConfig *global,
           }
           else if(urls) {
             /* fill '#1' ... '#9' terms from URL pattern */
-            char *storefile = outfile;
-            result = glob_match_url(&outfile, storefile, urls);
+            char *storefile = per->outfile;
+            result = glob_match_url(&per->outfile, storefile, urls);
             Curl_safefree(storefile);
             if(result) {
               /* bad globbing */
@@ -631,7 +1221,7 @@ static CURLcode operate_do(struct GlobalConfig *global,
              file output call */
 
           if(config->create_dirs || metalink) {
-            result = create_dir_hierarchy(outfile, global->errors);
+            result = create_dir_hierarchy(per->outfile, global->errors);
             /* create_dir_hierarchy shows error upon CURLE_WRITE_ERROR */
             if(result == CURLE_WRITE_ERROR)
               goto quit_urls;
@@ -643,7 +1233,7 @@ static CURLcode operate_do(struct GlobalConfig *global,
           if((urlnode->flags & GETOUT_USEREMOTE)
              && config->content_disposition) {
             /* Our header callback MIGHT set the filename */
-            DEBUGASSERT(!outs.filename);
+            DEBUGASSERT(!per->outs.filename);
           }
 
           if(config->resume_from_current) {
@@ -651,7 +1241,7 @@ static CURLcode operate_do(struct GlobalConfig *global,
                of the file as it is now and open it for append instead */
             struct_stat fileinfo;
             /* VMS -- Danger, the filesize is only valid for stream files */
-            if(0 == stat(outfile, &fileinfo))
+            if(0 == stat(per->outfile, &fileinfo))
               /* set offset to current file size: */
               config->resume_from = fileinfo.st_size;
             else
@@ -663,26 +1253,26 @@ static CURLcode operate_do(struct GlobalConfig *global,
 #ifdef __VMS
             /* open file for output, forcing VMS output format into stream
                mode which is needed for stat() call above to always work. */
-            FILE *file = fopen(outfile, config->resume_from?"ab":"wb",
+            FILE *file = fopen(per->outfile, config->resume_from?"ab":"wb",
                                "ctx=stm", "rfm=stmlf", "rat=cr", "mrs=0");
 #else
             /* open file for output: */
-            FILE *file = fopen(outfile, config->resume_from?"ab":"wb");
+            FILE *file = fopen(per->outfile, config->resume_from?"ab":"wb");
 #endif
             if(!file) {
-              helpf(global->errors, "Can't open '%s'!\n", outfile);
+              helpf(global->errors, "Can't open '%s'!\n", per->outfile);
               result = CURLE_WRITE_ERROR;
               goto quit_urls;
             }
-            outs.fopened = TRUE;
-            outs.stream = file;
-            outs.init = config->resume_from;
+            per->outs.fopened = TRUE;
+            per->outs.stream = file;
+            per->outs.init = config->resume_from;
           }
           else {
-            outs.stream = NULL; /* open when needed */
+            per->outs.stream = NULL; /* open when needed */
           }
-          outs.filename = outfile;
-          outs.s_isreg = TRUE;
+          per->outs.filename = per->outfile;
+          per->outs.s_isreg = TRUE;
         }
 
         if(uploadfile && !stdin_upload(uploadfile)) {
@@ -691,8 +1281,9 @@ static CURLcode operate_do(struct GlobalConfig *global,
            */
           struct_stat fileinfo;
 
-          this_url = add_file_name_to_url(curl, this_url, uploadfile);
-          if(!this_url) {
+          per->this_url = add_file_name_to_url(curl, per->this_url,
+                                               uploadfile);
+          if(!per->this_url) {
             result = CURLE_OUT_OF_MEMORY;
             goto show_error;
           }
@@ -712,35 +1303,35 @@ static CURLcode operate_do(struct GlobalConfig *global,
            */
 #ifdef __VMS
           /* Calculate the real upload site for VMS */
-          infd = -1;
+          per->infd = -1;
           if(stat(uploadfile, &fileinfo) == 0) {
             fileinfo.st_size = VmsSpecialSize(uploadfile, &fileinfo);
             switch(fileinfo.st_fab_rfm) {
             case FAB$C_VAR:
             case FAB$C_VFC:
             case FAB$C_STMCR:
-              infd = open(uploadfile, O_RDONLY | O_BINARY);
+              per->infd = open(uploadfile, O_RDONLY | O_BINARY);
               break;
             default:
-              infd = open(uploadfile, O_RDONLY | O_BINARY,
+              per->infd = open(uploadfile, O_RDONLY | O_BINARY,
                           "rfm=stmlf", "ctx=stm");
             }
           }
-          if(infd == -1)
+          if(per->infd == -1)
 #else
-          infd = open(uploadfile, O_RDONLY | O_BINARY);
-          if((infd == -1) || fstat(infd, &fileinfo))
+          per->infd = open(uploadfile, O_RDONLY | O_BINARY);
+          if((per->infd == -1) || fstat(per->infd, &fileinfo))
 #endif
           {
             helpf(global->errors, "Can't open '%s'!\n", uploadfile);
-            if(infd != -1) {
-              close(infd);
-              infd = fileno(thread_stdin);
+            if(per->infd != -1) {
+              close(per->infd);
+              per->infd = fileno(thread_stdin);
             }
             result = CURLE_READ_ERROR;
             goto quit_urls;
           }
-          infdopen = TRUE;
+          per->infdopen = TRUE;
 
           /* we ignore file size for char/block devices, sockets, etc. */
           if(S_ISREG(fileinfo.st_mode))
@@ -773,22 +1364,22 @@ static CURLcode operate_do(struct GlobalConfig *global,
                   " file or a fixed auth type instead!\n");
           }
 
-          DEBUGASSERT(infdopen == FALSE);
-          DEBUGASSERT(infd == fileno(thread_stdin));
+          DEBUGASSERT(per->infdopen == FALSE);
+          DEBUGASSERT(per->infd == fileno(thread_stdin));
 
           set_binmode(thread_stdin);
           if(!strcmp(uploadfile, ".")) {
-            if(curlx_nonblock((curl_socket_t)infd, TRUE) < 0)
+            if(curlx_nonblock((curl_socket_t)per->infd, TRUE) < 0)
               warnf(config->global,
-                    "fcntl failed on fd=%d: %s\n", infd, strerror(errno));
+                    "fcntl failed on fd=%d: %s\n", per->infd, strerror(errno));
           }
         }
 
         if(uploadfile && config->resume_from_current)
           config->resume_from = -1; /* -1 will then force get-it-yourself */
 
-        if(output_expected(this_url, uploadfile) && outs.stream &&
-           ios_isatty(fileno(outs.stream)))
+        if(output_expected(per->this_url, uploadfile) && per->outs.stream &&
+           ios_isatty(fileno(per->outs.stream)))
           /* we send the output to a tty, therefore we switch off the progress
              meter */
           global->noprogress = global->isatty = TRUE;
@@ -799,21 +1390,45 @@ static CURLcode operate_do(struct GlobalConfig *global,
           global->isatty = orig_isatty;
         }
 
+        if(per->parallel) {
+          /* one combined progress line rather than a meter each */
+          global->noprogress = TRUE;
+          if(per->outs.stream == thread_stdout) {
+            /* what goes to stdout is held back until the transfers of the
+               URLs before this one have been written out */
+            per->spool = open_memstream(&per->spoolbuf, &per->spoollen);
+            if(!per->spool) {
+              helpf(global->errors, "out of memory\n");
+              result = CURLE_OUT_OF_MEMORY;
+              goto quit_urls;
+            }
+            per->outs.stream = per->outs.spool = per->spool;
+            if(ios_isatty(fileno(thread_stdout)))
+              par.meter = FALSE;
+            if(!heads.fopened && heads.stream == thread_stdout) {
+              per->heads = heads;
+              per->heads.stream = per->spool;
+            }
+          }
+        }
+
         if(urlnum > 1 && !global->mute) {
           fprintf(global->errors, "\n[%lu/%lu]: %s --> %s\n",
-                  li+1, urlnum, this_url, outfile ? outfile : "<stdout>");
+                  li+1, urlnum, per->this_url,
+                  per->outfile ? per->outfile : "<stdout>");
           if(separator)
-            printf("%s%s\n", CURLseparator, this_url);
+            fprintf(per->spool ? per->spool : thread_stdout, "%s%s\n",
+                    CURLseparator, per->this_url);
         }
         if(httpgetfields) {
           char *urlbuffer;
           /* Find out whether the url contains a file name */
-          const char *pc = strstr(this_url, "://");
+          const char *pc = strstr(per->this_url, "://");
           char sep = '?';
           if(pc)
             pc += 3;
           else
-            pc = this_url;
+            pc = per->this_url;
 
           pc = strrchr(pc, '/'); /* check for a slash */
 
@@ -829,26 +1444,27 @@ static CURLcode operate_do(struct GlobalConfig *global,
            * Then append ? followed by the get fields to the url.
            */
           if(pc)
-            urlbuffer = aprintf("%s%c%s", this_url, sep, httpgetfields);
+            urlbuffer = aprintf("%s%c%s", per->this_url, sep, httpgetfields);
           else
             /* Append  / before the ? to create a well-formed url
                if the url contains a hostname only
             */
-            urlbuffer = aprintf("%s/?%s", this_url, httpgetfields);
+            urlbuffer = aprintf("%s/?%s", per->this_url, httpgetfields);
 
           if(!urlbuffer) {
             result = CURLE_OUT_OF_MEMORY;
             goto show_error;
           }
 
-          Curl_safefree(this_url); /* free previous URL */
-          this_url = urlbuffer; /* use our new URL instead! */
+          Curl_safefree(per->this_url); /* free previous URL */
+          per->this_url = urlbuffer; /* use our new URL instead! */
         }
 
         if(!global->errors)
           global->errors = thread_stderr;
 
-        if((!outfile || !strcmp(outfile, "-")) && !config->use_ascii) {
+        if((!per->outfile || !strcmp(per->outfile, "-")) &&
+           !config->use_ascii) {
           /* We get the output to stdout and we have not got the ASCII/text
              flag, then set stdout to be binary */
           set_binmode(thread_stdout);
@@ -861,8 +1477,8 @@ static CURLcode operate_do(struct GlobalConfig *global,
           my_setopt(curl, CURLOPT_TCP_FASTOPEN, 1L);
 
         /* where to store */
-        my_setopt(curl, CURLOPT_WRITEDATA, &outs);
-        my_setopt(curl, CURLOPT_INTERLEAVEDATA, &outs);
+        my_setopt(curl, CURLOPT_WRITEDATA, &per->outs);
+        my_setopt(curl, CURLOPT_INTERLEAVEDATA, &per->outs);
         if(metalink || !config->use_metalink)
           /* what call to write */
           my_setopt(curl, CURLOPT_WRITEFUNCTION, tool_write_cb);
@@ -874,8 +1490,8 @@ static CURLcode operate_do(struct GlobalConfig *global,
 #endif /* USE_METALINK */
 
         /* for uploads */
-        input.fd = infd;
-        input.config = config;
+        per->input.fd = per->infd;
+        per->input.config = config;
         /* Note that if CURLOPT_READFUNCTION is fread (the default), then
          * lib/telnet.c will Curl_poll() on the input file descriptor
          * rather then calling the READFUNCTION at regular intervals.
@@ -883,24 +1499,34 @@ static CURLcode operate_do(struct GlobalConfig *global,
          * behaviour, by omitting to set the READFUNCTION & READDATA options,
          * have not been determined.
          */
-        my_setopt(curl, CURLOPT_READDATA, &input);
+        my_setopt(curl, CURLOPT_READDATA, &per->input);
         /* what call to read */
         my_setopt(curl, CURLOPT_READFUNCTION, tool_read_cb);
 
         /* in 7.18.0, the CURLOPT_SEEKFUNCTION/DATA pair is taking over what
            CURLOPT_IOCTLFUNCTION/DATA pair previously provided for seeking */
-        my_setopt(curl, CURLOPT_SEEKDATA, &input);
+        my_setopt(curl, CURLOPT_SEEKDATA, &per->input);
         my_setopt(curl, CURLOPT_SEEKFUNCTION, tool_seek_cb);
 
-        if(config->recvpersecond)
+        if(config->recvpersecond &&
+           (config->recvpersecond < TOOL_BUFFERSIZE))
           /* tell libcurl to use a smaller sized buffer as it allows us to
              make better sleeps! 7.9.9 stuff! */
           my_setopt(curl, CURLOPT_BUFFERSIZE, (long)config->recvpersecond);
+        else
+          /* fewer, larger writes to the output file; new in 7.53.0 */
+          my_setopt(curl, CURLOPT_BUFFERSIZE, (long)TOOL_BUFFERSIZE);
 
         /* size of uploaded file: */
         if(uploadfilesize != -1)
           my_setopt(curl, CURLOPT_INFILESIZE_LARGE, uploadfilesize);
-        my_setopt_str(curl, CURLOPT_URL, this_url);     /* what to fetch */
+        /* uploading a file: read it in larger chunks, for fewer read
+           callbacks and larger sends (TLS, SFTP). Not with --limit-rate,
+           which works better with small writes. */
+        if(per->infdopen && (uploadfilesize > TOOL_BUFFERSIZE / 4) &&
+           !config->sendpersecond)
+          my_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, (long)TOOL_BUFFERSIZE);
+        my_setopt_str(curl, CURLOPT_URL, per->this_url); /* what to fetch */
         my_setopt(curl, CURLOPT_NOPROGRESS, global->noprogress?1L:0L);
         if(config->no_body) {
           my_setopt(curl, CURLOPT_NOBODY, 1L);
@@ -978,7 +1604,7 @@ static CURLcode operate_do(struct GlobalConfig *global,
           my_setopt_str(curl, CURLOPT_LOGIN_OPTIONS, config->login_options);
         my_setopt_str(curl, CURLOPT_USERPWD, config->userpwd);
         my_setopt_str(curl, CURLOPT_RANGE, config->range);
-        my_setopt(curl, CURLOPT_ERRORBUFFER, errorbuffer);
+        my_setopt(curl, CURLOPT_ERRORBUFFER, per->errorbuffer);
         my_setopt(curl, CURLOPT_TIMEOUT_MS, (long)(config->timeout * 1000));
 
         if(built_in_protos & CURLPROTO_HTTP) {
@@ -1024,6 +1650,11 @@ static CURLcode operate_do(struct GlobalConfig *global,
             my_setopt_enum(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
           }
 
+          if(per->parallel && (curlinfo->features & CURL_VERSION_HTTP2))
+            /* rather wait for a connection to the same host to multiplex
+               on than open one more; new in libcurl 7.43.0 */
+            my_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
           /* new in libcurl 7.10.6 (default is Basic) */
           if(config->authtype)
             my_setopt_bitmask(curl, CURLOPT_HTTPAUTH, (long)config->authtype);
@@ -1236,13 +1867,13 @@ static CURLcode operate_do(struct GlobalConfig *global,
         my_setopt_str(curl, CURLOPT_INTERFACE, config->iface);
         my_setopt_str(curl, CURLOPT_KRBLEVEL, config->krblevel);
 
-        progressbarinit(&progressbar, config);
+        progressbarinit(&per->progressbar, config);
         if((global->progressmode == CURL_PROGRESS_BAR) &&
            !global->noprogress && !global->mute) {
           /* we want the alternative style, then we have to implement it
              ourselves! */
           my_setopt(curl, CURLOPT_XFERINFOFUNCTION, tool_progress_cb);
-          my_setopt(curl, CURLOPT_XFERINFODATA, &progressbar);
+          my_setopt(curl, CURLOPT_XFERINFODATA, &per->progressbar);
         }
 
         /* new in libcurl 7.24.0: */
@@ -1412,19 +2043,24 @@ static CURLcode operate_do(struct GlobalConfig *global,
 
         if(config->content_disposition
            && (urlnode->flags & GETOUT_USEREMOTE))
-          hdrcbdata.honor_cd_filename = TRUE;
+          per->hdrcbdata.honor_cd_filename = TRUE;
         else
-          hdrcbdata.honor_cd_filename = FALSE;
+          per->hdrcbdata.honor_cd_filename = FALSE;
 
-        hdrcbdata.outs = &outs;
-        hdrcbdata.heads = &heads;
+        per->hdrcbdata.curl = curl;
+        per->hdrcbdata.outs = &per->outs;
+        per->hdrcbdata.heads = per->heads.stream ? &per->heads : &heads;
 
         my_setopt(curl, CURLOPT_HEADERFUNCTION, tool_header_cb);
-        my_setopt(curl, CURLOPT_HEADERDATA, &hdrcbdata);
+        my_setopt(curl, CURLOPT_HEADERDATA, &per->hdrcbdata);
 
-        if(config->resolve)
+        if(config->resolve) {
+          /* iOS: keep these names out of the DNS cache all the curl
+             commands share */
+          curl_easy_setopt(curl, CURLOPT_SHARE, NULL);
           /* new in 7.21.3 */
           my_setopt_slist(curl, CURLOPT_RESOLVE, config->resolve);
+        }
 
         if(config->connect_to)
           /* new in 7.49.0 */
@@ -1509,12 +2145,12 @@ static CURLcode operate_do(struct GlobalConfig *global,
           my_setopt(curl, CURLOPT_TFTP_NO_OPTIONS, 1L);
 
         /* initialize retry vars for loop below */
-        retry_sleep_default = (config->retry_delay) ?
+        per->retry_sleep_default = (config->retry_delay) ?
           config->retry_delay*1000L : RETRY_SLEEP_DEFAULT; /* ms */
 
-        retry_numretries = config->req_retry;
-        retry_sleep = retry_sleep_default; /* ms */
-        retrystart = tvnow();
+        per->retry_numretries = config->req_retry;
+        per->retry_sleep = per->retry_sleep_default; /* ms */
+        per->retrystart = tvnow();
 
 #ifndef CURL_DISABLE_LIBCURL_OPTION
         if(global->libcurl) {
@@ -1524,24 +2160,43 @@ static CURLcode operate_do(struct GlobalConfig *global,
         }
 #endif
 
+        if(per->parallel) {
+          /* the multi handle has it from here */
+          result = parallel_add(global, &par, per);
+          if(result)
+            goto show_error;
+          if(is_fatal_error(par.result) ||
+             (par.result && global->fail_early)) {
+            result = par.result;
+            break;
+          }
+          continue;
+        }
+
+        /* --segments takes a plain download into a file of its own */
+        segmented = (config->segments > 1) && per->outs.filename &&
+          !per->outs.stream && !uploadfile && !metalink &&
+          !config->use_metalink && !config->content_disposition;
+
         for(;;) {
+          long delay;
 #ifdef USE_METALINK
           if(!metalink && config->use_metalink) {
             /* If outs.metalink_parser is non-NULL, delete it first. */
-            if(outs.metalink_parser)
-              metalink_parser_context_delete(outs.metalink_parser);
-            outs.metalink_parser = metalink_parser_context_new();
-            if(outs.metalink_parser == NULL) {
+            if(per->outs.metalink_parser)
+              metalink_parser_context_delete(per->outs.metalink_parser);
+            per->outs.metalink_parser = metalink_parser_context_new();
+            if(per->outs.metalink_parser == NULL) {
               result = CURLE_OUT_OF_MEMORY;
               goto show_error;
             }
             fprintf(config->global->errors,
-                    "Metalink: parsing (%s) metalink/XML...\n", this_url);
+                    "Metalink: parsing (%s) metalink/XML...\n", per->this_url);
           }
           else if(metalink)
             fprintf(config->global->errors,
                     "Metalink: fetching (%s) from (%s)...\n",
-                    mlfile->filename, this_url);
+                    mlfile->filename, per->this_url);
 #endif /* USE_METALINK */
 
 #ifdef CURLDEBUG
@@ -1549,204 +2204,22 @@ static CURLcode operate_do(struct GlobalConfig *global,
             result = curl_easy_perform_ev(curl);
           else
 #endif
+          if(segmented)
+            result = segments_perform(config, curl, &per->outs);
+          else
           result = curl_easy_perform(curl);
 
-          if(!result && !outs.stream && !outs.bytes) {
-            /* we have received no data despite the transfer was successful
-               ==> force cration of an empty output file (if an output file
-               was specified) */
-            long cond_unmet = 0L;
-            /* do not create (or even overwrite) the file in case we get no
-               data because of unmet condition */
-            curl_easy_getinfo(curl, CURLINFO_CONDITION_UNMET, &cond_unmet);
-            if(!cond_unmet && !tool_create_output_file(&outs))
-              result = CURLE_WRITE_ERROR;
-          }
-
-          if(outs.is_cd_filename && outs.stream && !global->mute &&
-             outs.filename)
-            fprintf(thread_stdout, "curl: Saved to filename '%s'\n", outs.filename);
-
-          /* if retry-max-time is non-zero, make sure we haven't exceeded the
-             time */
-          if(retry_numretries &&
-             (!config->retry_maxtime ||
-              (tvdiff(tvnow(), retrystart) <
-               config->retry_maxtime*1000L)) ) {
-            enum {
-              RETRY_NO,
-              RETRY_TIMEOUT,
-              RETRY_CONNREFUSED,
-              RETRY_HTTP,
-              RETRY_FTP,
-              RETRY_LAST /* not used */
-            } retry = RETRY_NO;
-            long response;
-            if((CURLE_OPERATION_TIMEDOUT == result) ||
-               (CURLE_COULDNT_RESOLVE_HOST == result) ||
-               (CURLE_COULDNT_RESOLVE_PROXY == result) ||
-               (CURLE_FTP_ACCEPT_TIMEOUT == result))
-              /* retry timeout always */
-              retry = RETRY_TIMEOUT;
-            else if(config->retry_connrefused &&
-                    (CURLE_COULDNT_CONNECT == result)) {
-              long oserrno;
-              curl_easy_getinfo(curl, CURLINFO_OS_ERRNO, &oserrno);
-              if(ECONNREFUSED == oserrno)
-                retry = RETRY_CONNREFUSED;
-            }
-            else if((CURLE_OK == result) ||
-                    (config->failonerror &&
-                     (CURLE_HTTP_RETURNED_ERROR == result))) {
-              /* If it returned OK. _or_ failonerror was enabled and it
-                 returned due to such an error, check for HTTP transient
-                 errors to retry on. */
-              char *effective_url = NULL;
-              curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective_url);
-              if(effective_url &&
-                 checkprefix("http", effective_url)) {
-                /* This was HTTP(S) */
-                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
-
-                switch(response) {
-                case 500: /* Internal Server Error */
-                case 502: /* Bad Gateway */
-                case 503: /* Service Unavailable */
-                case 504: /* Gateway Timeout */
-                  retry = RETRY_HTTP;
-                  /*
-                   * At this point, we have already written data to the output
-                   * file (or terminal). If we write to a file, we must rewind
-                   * or close/re-open the file so that the next attempt starts
-                   * over from the beginning.
-                   *
-                   * TODO: similar action for the upload case. We might need
-                   * to start over reading from a previous point if we have
-                   * uploaded something when this was returned.
-                   */
-                  break;
-                }
-              }
-            } /* if CURLE_OK */
-            else if(result) {
-              curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
-
-              if(response/100 == 4)
-                /*
-                 * This is typically when the FTP server only allows a certain
-                 * amount of users and we are not one of them.  All 4xx codes
-                 * are transient.
-                 */
-                retry = RETRY_FTP;
-            }
-
-            if(retry) {
-              static const char * const m[]={
-                NULL,
-                "timeout",
-                "connection refused",
-                "HTTP error",
-                "FTP error"
-              };
-
-              warnf(config->global, "Transient problem: %s "
-                    "Will retry in %ld seconds. "
-                    "%ld retries left.\n",
-                    m[retry], retry_sleep/1000L, retry_numretries);
-
-              tool_go_sleep(retry_sleep);
-              retry_numretries--;
-              if(!config->retry_delay) {
-                retry_sleep *= 2;
-                if(retry_sleep > RETRY_SLEEP_MAX)
-                  retry_sleep = RETRY_SLEEP_MAX;
-              }
-              if(outs.bytes && outs.filename && outs.stream) {
-                /* We have written data to a output file, we truncate file
-                 */
-                if(!global->mute)
-                  fprintf(global->errors, "Throwing away %"
-                          CURL_FORMAT_CURL_OFF_T " bytes\n",
-                          outs.bytes);
-                fflush(outs.stream);
-                /* truncate file at the position where we started appending */
-#ifdef HAVE_FTRUNCATE
-                if(ftruncate(fileno(outs.stream), outs.init)) {
-                  /* when truncate fails, we can't just append as then we'll
-                     create something strange, bail out */
-                  if(!global->mute)
-                    fprintf(global->errors,
-                            "failed to truncate, exiting\n");
-                  result = CURLE_WRITE_ERROR;
-                  goto quit_urls;
-                }
-                /* now seek to the end of the file, the position where we
-                   just truncated the file in a large file-safe way */
-                fseek(outs.stream, 0, SEEK_END);
-#else
-                /* ftruncate is not available, so just reposition the file
-                   to the location we would have truncated it. This won't
-                   work properly with large files on 32-bit systems, but
-                   most of those will have ftruncate. */
-                fseek(outs.stream, (long)outs.init, SEEK_SET);
-#endif
-                outs.bytes = 0; /* clear for next round */
-              }
-              continue; /* curl_easy_perform loop */
-            }
-          } /* if retry_numretries */
-          else if(metalink) {
-            /* Metalink: Decide to try the next resource or
-               not. Basically, we want to try the next resource if
-               download was not successful. */
-            long response;
-            if(CURLE_OK == result) {
-              /* TODO We want to try next resource when download was
-                 not successful. How to know that? */
-              char *effective_url = NULL;
-              curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective_url);
-              if(effective_url &&
-                 curl_strnequal(effective_url, "http", 4)) {
-                /* This was HTTP(S) */
-                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
-                if(response != 200 && response != 206) {
-                  metalink_next_res = 1;
-                  fprintf(global->errors,
-                          "Metalink: fetching (%s) from (%s) FAILED "
-                          "(HTTP status code %ld)\n",
-                          mlfile->filename, this_url, response);
-                }
-              }
-            }
-            else {
-              metalink_next_res = 1;
-              fprintf(global->errors,
-                      "Metalink: fetching (%s) from (%s) FAILED (%s)\n",
-                      mlfile->filename, this_url,
-                      (errorbuffer[0]) ?
-                      errorbuffer : curl_easy_strerror(result));
-            }
+          result = post_transfer(global, per, result, &delay);
+          if(delay) {
+            tool_go_sleep(delay);
+            continue; /* curl_easy_perform loop */
           }
-          if(metalink && !metalink_next_res)
-            fprintf(global->errors, "Metalink: fetching (%s) from (%s) OK\n",
-                    mlfile->filename, this_url);
 
           /* In all ordinary cases, just break out of loop here */
           break; /* curl_easy_perform loop */
-
         }
 
-        if((global->progressmode == CURL_PROGRESS_BAR) &&
-           progressbar.calls)
-          /* if the custom progress bar has been displayed, we output a
-             newline here */
-          fputs("\n", progressbar.out);
-
-        if(config->writeout)
-          ourWriteOut(curl, &outs, config->writeout);
-
-        if(config->writeenv)
-          ourWriteEnv(curl);
+        transfer_output(per);
 
         /*
         ** Code within this loop may jump directly here to label 'show_error'
@@ -1757,25 +2230,7 @@ static CURLcode operate_do(struct GlobalConfig *global,
 
         show_error:
 
-#ifdef __VMS
-        if(is_vms_shell()) {
-          /* VMS DCL shell behavior */
-          if(!global->showerror)
-            vms_show = VMSSTS_HIDE;
-        }
-        else
-#endif
-        if(result && global->showerror) {
-          fprintf(global->errors, "curl: (%d) %s\n", result, (errorbuffer[0]) ?
-                  errorbuffer : curl_easy_strerror(result));
-          if(result == CURLE_SSL_CACERT)
-            fprintf(global->errors, "%s%s%s",
-                    CURL_CA_CERT_ERRORMSG1, CURL_CA_CERT_ERRORMSG2,
-                    ((curlinfo->features & CURL_VERSION_HTTPS_PROXY) ?
-                     "HTTPS-proxy has similar options --proxy-cacert "
-                     "and --proxy-insecure.\n" :
-                     ""));
-        }
+        transfer_error(global, per, result);
 
         /* Fall through comment to 'quit_urls' label */
 
@@ -1792,90 +2247,17 @@ static CURLcode operate_do(struct GlobalConfig *global,
 
         quit_urls:
 
-        /* Set file extended attributes */
-        if(!result && config->xattr && outs.fopened && outs.stream) {
-          int rc = fwrite_xattr(curl, fileno(outs.stream));
-          if(rc)
-            warnf(config->global, "Error setting extended attributes: %s\n",
-                  strerror(errno));
-        }
+        result = end_transfer(global, per, result);
 
-        /* Close the file */
-        if(outs.fopened && outs.stream) {
-          int rc = fclose(outs.stream);
-          if(!result && rc) {
-            /* something went wrong in the writing process */
-            result = CURLE_WRITE_ERROR;
-            fprintf(global->errors, "(%d) Failed writing body\n", result);
-          }
+        if(per->spool) {
+          /* nothing of a transfer that never started is written out */
+          fclose(per->spool);
+          free(per->spoolbuf);
         }
-        else if(!outs.s_isreg && outs.stream) {
-          /* Dump standard stream buffered data */
-          int rc = fflush(outs.stream);
-          if(!result && rc) {
-            /* something went wrong in the writing process */
-            result = CURLE_WRITE_ERROR;
-            fprintf(global->errors, "(%d) Failed writing body\n", result);
-          }
-        }
-
-#ifdef __AMIGA__
-        if(!result && outs.s_isreg && outs.filename) {
-          /* Set the url (up to 80 chars) as comment for the file */
-          if(strlen(url) > 78)
-            url[79] = '\0';
-          SetComment(outs.filename, url);
-        }
-#endif
-
-#if defined(HAVE_UTIME) || \
-    (defined(WIN32) && (CURL_SIZEOF_CURL_OFF_T >= 8))
-        /* File time can only be set _after_ the file has been closed */
-        if(!result && config->remote_time && outs.s_isreg && outs.filename) {
-          /* Ask libcurl if we got a remote file time */
-          long filetime = -1;
-          curl_easy_getinfo(curl, CURLINFO_FILETIME, &filetime);
-          if(filetime >= 0)
-            setfiletime(filetime, outs.filename, config->global->errors);
-        }
-#endif /* defined(HAVE_UTIME) || \
-          (defined(WIN32) && (CURL_SIZEOF_CURL_OFF_T >= 8)) */
-
-#ifdef USE_METALINK
-        if(!metalink && config->use_metalink && result == CURLE_OK) {
-          int rv = parse_metalink(config, &outs, this_url);
-          if(rv == 0)
-            fprintf(config->global->errors, "Metalink: parsing (%s) OK\n",
-                    this_url);
-          else if(rv == -1)
-            fprintf(config->global->errors, "Metalink: parsing (%s) FAILED\n",
-                    this_url);
-        }
-        else if(metalink && result == CURLE_OK && !metalink_next_res) {
-          int rv = metalink_check_hash(global, mlfile, outs.filename);
-          if(rv == 0) {
-            metalink_next_res = 1;
-          }
-        }
-#endif /* USE_METALINK */
-
-        /* No more business with this output struct */
-        if(outs.alloc_filename)
-          Curl_safefree(outs.filename);
-#ifdef USE_METALINK
-        if(outs.metalink_parser)
-          metalink_parser_context_delete(outs.metalink_parser);
-#endif /* USE_METALINK */
-        memset(&outs, 0, sizeof(struct OutStruct));
-        hdrcbdata.outs = NULL;
-
-        /* Free loop-local allocated memory and close loop-local opened fd */
-
-        Curl_safefree(outfile);
-        Curl_safefree(this_url);
-
-        if(infdopen)
-          close(infd);
+        if(per->parallel)
+          tool_share_release(per->curl, FALSE);
+        metalink_next_res = per->metalink_next_res;
+        free(per);
 
         if(metalink) {
           /* Should exit if error is fatal. */
@@ -1955,6 +2337,13 @@ static CURLcode operate_do(struct GlobalConfig *global,
 
   quit_curl:
 
+  if(par.multi) {
+    /* the transfers still on the multi handle finish first */
+    CURLcode presult = parallel_finish(global, &par);
+    if(!result)
+      result = presult;
+  }
+
   /* Reset the global config variables */
   global->noprogress = orig_noprogress;
   global->isatty = orig_isatty;
@@ -1965,8 +2354,6 @@ static CURLcode operate_do(struct GlobalConfig *global,
   /* Free list of given URLs */
   clean_getout(config);
 
-  hdrcbdata.heads = NULL;
-
   /* Close function-local opened file descriptors */
   if(heads.fopened && heads.stream)
     fclose(heads.stream);
@@ -72,6 +72,11 @@ struct OutStruct {
   struct OperationConfig *config;
   curl_off_t bytes;
   curl_off_t init;
+  FILE *spool;      /* stdout of a --parallel transfer, until its turn */
+  bool direct;      /* file written with write(), past stdio */
+  char *wbuf;       /* what is gathered for it */
+  size_t wlen;
+  curl_off_t prealloc; /* Content-Length, to reserve the space */
 #ifdef USE_METALINK
   metalink_parser_context_t *metalink_parser;
 #endif /* USE_METALINK */
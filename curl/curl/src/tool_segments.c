@@ -0,0 +1,602 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "tool_setup.h"
+
+#ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+
+#include "strcase.h"
+
+#define ENABLE_CURLX_PRINTF
+/* use our own printf() functions */
+#include "curlx.h"
+
+#include "tool_cfgable.h"
+#include "tool_cb_wrt.h"
+#include "tool_main.h"
+#include "tool_msgs.h"
+#include "tool_util.h"
+#include "tool_segments.h"
+
+#include "memdebug.h" /* keep this as LAST include */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ * The state file has a line with the number of segments and the size of
+ * the file, a line with the ETag or Last-Modified it was downloaded with,
+ * then one record per segment: its first byte, its last byte and the next
+ * byte to write.  The records all have the same length, so that one write
+ * at a known offset updates a segment.
+ */
+#define SEGMENT_RECORD "%20" CURL_FORMAT_CURL_OFF_T " %20" \
+  CURL_FORMAT_CURL_OFF_T " %20" CURL_FORMAT_CURL_OFF_T "\n"
+#define SEGMENT_RECLEN 63
+
+struct segments;
+
+struct segment {
+  struct segments *all;
+  CURL *curl;
+  curl_off_t start;             /* first byte */
+  curl_off_t end;               /* last byte */
+  curl_off_t pos;               /* next byte to write */
+  curl_off_t saved;             /* 'pos' as the state file has it */
+  long index;
+  bool checked;                 /* the response was seen to be a range */
+};
+
+struct segments {
+  struct OperationConfig *config;
+  char *statename;
+  int fd;                       /* the output file */
+  int statefd;
+  long header;                  /* where the records start in the state */
+  curl_off_t size;
+  curl_off_t received;          /* by this run */
+  long num;
+  struct segment seg[MAX_SEGMENTS];
+  struct timeval shown;         /* the meter, last time */
+  bool meter_shown;
+};
+
+/* What the first request learnt of the file */
+struct probe {
+  curl_off_t size;              /* Content-Length, -1 when not told */
+  bool ranges;                  /* "Accept-Ranges: bytes" */
+  bool etag;
+  char validator[256];          /* the ETag, or else the Last-Modified */
+};
+
+/*
+ * If the header line 'ptr' is the header 'name', copies its value, without
+ * the white space around it, into 'value'.
+ */
+static bool header_value(const char *name, const char *ptr, size_t len,
+                         char *value, size_t size)
+{
+  size_t namelen = strlen(name);
+  size_t vlen;
+
+  if((len <= namelen) || !curl_strnequal(name, ptr, namelen))
+    return FALSE;
+  ptr += namelen;
+  len -= namelen;
+  while(len && ISSPACE(*ptr)) {
+    ptr++;
+    len--;
+  }
+  while(len && ISSPACE(ptr[len - 1]))
+    len--;
+  vlen = (len < size) ? len : size - 1;
+  memcpy(value, ptr, vlen);
+  value[vlen] = '\0';
+  return TRUE;
+}
+
+static size_t probe_header(char *ptr, size_t size, size_t nmemb,
+                           void *userdata)
+{
+  struct probe *probe = userdata;
+  size_t len = size * nmemb;
+  char value[256];
+
+  if((len > 5) && checkprefix("HTTP/", ptr)) {
+    /* a response of its own, after a redirect */
+    probe->size = -1;
+    probe->ranges = FALSE;
+    probe->etag = FALSE;
+    probe->validator[0] = '\0';
+  }
+  else if(header_value("Content-Length:", ptr, len, value, sizeof(value)))
+    probe->size = curlx_strtoofft(value, NULL, 10);
+  else if(header_value("Accept-Ranges:", ptr, len, value, sizeof(value)))
+    probe->ranges = curl_strequal(value, "bytes") ? TRUE : FALSE;
+  else if(header_value("ETag:", ptr, len, value, sizeof(value))) {
+    strcpy(probe->validator, value);
+    probe->etag = TRUE;
+  }
+  else if(!probe->etag &&
+          header_value("Last-Modified:", ptr, len, value, sizeof(value)))
+    strcpy(probe->validator, value);
+
+  return len;
+}
+
+/*
+ * Runs the one transfer 'curl' on the multi handle, so that the connection
+ * stays there for the segments.
+ */
+static CURLcode multi_one(CURLM *multi, CURL *curl)
+{
+  CURLcode result = CURLE_OUT_OF_MEMORY;
+  CURLMsg *msg;
+  int still = 1;
+  int queued;
+
+  if(curl_multi_add_handle(multi, curl))
+    return result;
+  while(still) {
+    if(curl_multi_perform(multi, &still))
+      break;
+    if(still)
+      curl_multi_wait(multi, NULL, 0, 1000, NULL);
+  }
+  while((msg = curl_multi_info_read(multi, &queued)))
+    if(msg->msg == CURLMSG_DONE)
+      result = msg->data.result;
+  curl_multi_remove_handle(multi, curl);
+
+  return result;
+}
+
+/*
+ * Asks with a HEAD request whether the file is large enough, and whether
+ * the server takes ranges for it.  Returns the URL it moved to, or NULL
+ * when it is to be downloaded in one go.
+ */
+static char *probe_url(CURLM *multi, CURL *curl, struct probe *probe)
+{
+  CURL *head = curl_easy_duphandle(curl);
+  char *url = NULL;
+
+  if(!head)
+    return NULL;
+  memset(probe, 0, sizeof(struct probe));
+  probe->size = -1;
+
+  curl_easy_setopt(head, CURLOPT_NOBODY, 1L);
+  curl_easy_setopt(head, CURLOPT_HEADER, 0L);
+  curl_easy_setopt(head, CURLOPT_NOPROGRESS, 1L);
+  curl_easy_setopt(head, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(head, CURLOPT_HEADERFUNCTION, probe_header);
+  curl_easy_setopt(head, CURLOPT_HEADERDATA, probe);
+
+  if(!multi_one(multi, head)) {
+    long response = 0;
+    char *effective = NULL;
+    curl_easy_getinfo(head, CURLINFO_RESPONSE_CODE, &response);
+    curl_easy_getinfo(head, CURLINFO_EFFECTIVE_URL, &effective);
+    if((response == 200) && probe->ranges &&
+       (probe->size >= 2 * SEGMENT_MIN_SIZE) && effective &&
+       checkprefix("http", effective))
+      url = strdup(effective);
+  }
+  curl_easy_cleanup(head);
+
+  return url;
+}
+
+/* Writes all of 'len' bytes at 'offset' */
+static bool pwrite_all(int fd, const char *buf, size_t len, curl_off_t offset)
+{
+  while(len) {
+    ssize_t rc = pwrite(fd, buf, len, (off_t)offset);
+    if(rc < 0) {
+      if(errno == EINTR)
+        continue;
+      return FALSE;
+    }
+    buf += rc;
+    len -= (size_t)rc;
+    offset += rc;
+  }
+  return TRUE;
+}
+
+/* Updates the record of 'seg' in the state file */
+static bool save_segment(struct segment *seg)
+{
+  struct segments *all = seg->all;
+  char rec[SEGMENT_RECLEN + 1];
+
+  if(seg->saved == seg->pos)
+    return TRUE;
+  snprintf(rec, sizeof(rec), SEGMENT_RECORD, seg->start, seg->end, seg->pos);
+  if(!pwrite_all(all->statefd, rec, SEGMENT_RECLEN,
+                 all->header + seg->index * SEGMENT_RECLEN))
+    return FALSE;
+  seg->saved = seg->pos;
+  return TRUE;
+}
+
+/*
+ * Takes on the segments of an earlier run from the state file, if it was
+ * for this file as the server has it now and the output file is still
+ * there.  Returns TRUE when it did.
+ */
+static bool load_state(struct segments *all, const struct probe *probe,
+                       const char *filename)
+{
+  FILE *file;
+  char line[300];
+  char *nl;
+  long num = 0;
+  long i;
+  curl_off_t size = -1;
+  curl_off_t next = 0;
+  struct_stat fileinfo;
+
+  if(stat(filename, &fileinfo) || (fileinfo.st_size != probe->size))
+    return FALSE;
+  file = fopen(all->statename, "rb");
+  if(!file)
+    return FALSE;
+
+  if(!fgets(line, sizeof(line), file) ||
+     (sscanf(line, "curl segments %ld %" CURL_FORMAT_CURL_OFF_T,
+             &num, &size) != 2) ||
+     (num < 2) || (num > MAX_SEGMENTS) || (size != probe->size) ||
+     !fgets(line, sizeof(line), file))
+    goto fail;
+  nl = strchr(line, '\n');
+  if(nl)
+    *nl = '\0';
+  if(strcmp(line, probe->validator))
+    /* the file changed on the server */
+    goto fail;
+  all->header = ftell(file);
+
+  for(i = 0; i < num; i++) {
+    struct segment *seg = &all->seg[i];
+    if(!fgets(line, sizeof(line), file) ||
+       (strlen(line) != SEGMENT_RECLEN) ||
+       (sscanf(line, "%" CURL_FORMAT_CURL_OFF_T " %" CURL_FORMAT_CURL_OFF_T
+               " %" CURL_FORMAT_CURL_OFF_T, &seg->start, &seg->end,
+               &seg->pos) != 3) ||
+       (seg->start != next) || (seg->end < seg->start) ||
+       (seg->pos < seg->start) || (seg->pos > seg->end + 1))
+      goto fail;
+    next = seg->end + 1;
+  }
+  if(next != size)
+    goto fail;
+  fclose(file);
+
+  all->num = num;
+  all->size = size;
+  return TRUE;
+
+  fail:
+  fclose(file);
+  return FALSE;
+}
+
+/*
+ * Opens the output file and the state file, taking on the state of an
+ * earlier run or else splitting the file in new segments.
+ */
+static CURLcode open_files(struct segments *all, const struct probe *probe,
+                           const char *filename)
+{
+  struct OperationConfig *config = all->config;
+  long i;
+
+  if(load_state(all, probe, filename)) {
+    all->fd = open(filename, O_WRONLY | O_BINARY);
+    all->statefd = open(all->statename, O_RDWR | O_BINARY);
+  }
+  else {
+    curl_off_t part;
+    char *header;
+    size_t len;
+
+    all->size = probe->size;
+    all->num = config->segments;
+    if(all->size / all->num < SEGMENT_MIN_SIZE)
+      all->num = (long)(all->size / SEGMENT_MIN_SIZE);
+    part = all->size / all->num;
+    for(i = 0; i < all->num; i++) {
+      all->seg[i].start = all->seg[i].pos = i * part;
+      all->seg[i].end = (i == all->num - 1) ? all->size - 1 :
+        (i + 1) * part - 1;
+    }
+
+    all->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if(all->fd != -1) {
+      /* all of it in one piece, written in place from there */
+      tool_preallocate(all->fd, all->size);
+#ifdef HAVE_FTRUNCATE
+      if(ftruncate(all->fd, all->size)) {
+        helpf(config->global->errors, "Can't size '%s'!\n", filename);
+        return CURLE_WRITE_ERROR;
+      }
+#endif
+    }
+
+    header = aprintf("curl segments %ld %" CURL_FORMAT_CURL_OFF_T "\n%s\n",
+                     all->num, all->size, probe->validator);
+    if(!header)
+      return CURLE_OUT_OF_MEMORY;
+    len = strlen(header);
+    all->header = (long)len;
+    all->statefd = open(all->statename,
+                        O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if((all->statefd != -1) &&
+       !pwrite_all(all->statefd, header, len, 0)) {
+      close(all->statefd);
+      all->statefd = -1;
+    }
+    free(header);
+  }
+
+  if(all->fd == -1) {
+    helpf(config->global->errors, "Can't open '%s'!\n", filename);
+    return CURLE_WRITE_ERROR;
+  }
+  if(all->statefd == -1) {
+    helpf(config->global->errors, "Can't open '%s'!\n", all->statename);
+    return CURLE_WRITE_ERROR;
+  }
+
+  for(i = 0; i < all->num; i++) {
+    struct segment *seg = &all->seg[i];
+    seg->all = all;
+    seg->index = i;
+    seg->saved = -1; /* written below */
+    if(!save_segment(seg)) {
+      helpf(config->global->errors, "Failed writing '%s'\n",
+            all->statename);
+      return CURLE_WRITE_ERROR;
+    }
+  }
+
+  return CURLE_OK;
+}
+
+/*
+ * callback for CURLOPT_WRITEFUNCTION of a segment: writes the data in
+ * place and moves the segment on.
+ */
+static size_t segment_write(char *buffer, size_t sz, size_t nmemb,
+                            void *userdata)
+{
+  struct segment *seg = userdata;
+  struct segments *all = seg->all;
+  size_t len = sz * nmemb;
+  const size_t failure = len ? 0 : 1;
+
+  if(!seg->checked) {
+    long response = 0;
+    curl_easy_getinfo(seg->curl, CURLINFO_RESPONSE_CODE, &response);
+    if(response != 206) {
+      warnf(all->config->global, "Segment %ld: the server sent the whole "
+            "file rather than the range asked for\n", seg->index + 1);
+      return failure;
+    }
+    seg->checked = TRUE;
+  }
+
+  if(((curl_off_t)len > seg->end + 1 - seg->pos) ||
+     !pwrite_all(all->fd, buffer, len, seg->pos))
+    return failure;
+  seg->pos += len;
+  all->received += len;
+
+  if(((seg->pos - seg->saved >= SEGMENT_SAVE_EVERY) ||
+      (seg->pos > seg->end)) && !save_segment(seg))
+    return failure;
+
+  return len;
+}
+
+/* The one progress line for the segments, at most once a second */
+static void segments_meter(struct segments *all, long running, bool final)
+{
+  struct GlobalConfig *global = all->config->global;
+  curl_off_t have = 0;
+  struct timeval now = tvnow();
+  long i;
+
+  if(global->noprogress || (final && !all->meter_shown) ||
+     (!final && all->meter_shown && (tvdiff(now, all->shown) < 1000)))
+    return;
+  all->shown = now;
+  all->meter_shown = TRUE;
+
+  for(i = 0; i < all->num; i++)
+    have += all->seg[i].pos - all->seg[i].start;
+  fprintf(global->errors, "\r%ld segments, %ld running, %"
+          CURL_FORMAT_CURL_OFF_T " of %" CURL_FORMAT_CURL_OFF_T
+          " bytes (%d%%)   %s", all->num, running, have, all->size,
+          (int)(have * 100 / all->size), final ? "\n" : "");
+}
+
+/* Sets up the easy handle of a segment, 'curl' itself for the first one */
+static CURLcode segment_easy(struct segment *seg, CURL *curl,
+                             const char *url)
+{
+  char range[50];
+
+  if(!seg->curl) {
+    seg->curl = curl_easy_duphandle(curl);
+    if(!seg->curl)
+      return CURLE_OUT_OF_MEMORY;
+    /* headers only go to --dump-header for the first one */
+    curl_easy_setopt(seg->curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(seg->curl, CURLOPT_HEADERDATA, NULL);
+  }
+  snprintf(range, sizeof(range), "%" CURL_FORMAT_CURL_OFF_T "-%"
+           CURL_FORMAT_CURL_OFF_T, seg->pos, seg->end);
+
+  curl_easy_setopt(seg->curl, CURLOPT_URL, url);
+  curl_easy_setopt(seg->curl, CURLOPT_RANGE, range);
+  curl_easy_setopt(seg->curl, CURLOPT_RESUME_FROM_LARGE, CURL_OFF_T_C(0));
+  curl_easy_setopt(seg->curl, CURLOPT_HEADER, 0L);
+  curl_easy_setopt(seg->curl, CURLOPT_NOPROGRESS, 1L);
+  curl_easy_setopt(seg->curl, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(seg->curl, CURLOPT_WRITEFUNCTION, segment_write);
+  curl_easy_setopt(seg->curl, CURLOPT_WRITEDATA, seg);
+  curl_easy_setopt(seg->curl, CURLOPT_PRIVATE, (char *)seg);
+
+  return CURLE_OK;
+}
+
+/*
+ * Runs the segments not done yet all at once. Returns the first error one
+ * of them ended with, the others are let finish.
+ */
+static CURLcode run_segments(struct segments *all, CURLM *multi, CURL *curl,
+                             const char *url)
+{
+  CURLcode result = CURLE_OK;
+  long running = 0;
+  long i;
+
+  for(i = 0; i < all->num; i++) {
+    struct segment *seg = &all->seg[i];
+    if(seg->pos > seg->end)
+      continue;
+    if(!running)
+      seg->curl = curl;
+    result = segment_easy(seg, curl, url);
+    if(!result && curl_multi_add_handle(multi, seg->curl))
+      result = CURLE_OUT_OF_MEMORY;
+    if(result)
+      break;
+    running++;
+  }
+
+  while(running) {
+    CURLMsg *msg;
+    int still;
+    int queued;
+
+    if(curl_multi_perform(multi, &still))
+      break;
+    while((msg = curl_multi_info_read(multi, &queued))) {
+      if(msg->msg == CURLMSG_DONE) {
+        CURLcode done = msg->data.result;
+        char *ptr = NULL;
+        struct segment *seg;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &ptr);
+        seg = (struct segment *)ptr;
+        curl_multi_remove_handle(multi, seg->curl);
+        running--;
+        if(!done && (seg->pos <= seg->end))
+          done = CURLE_PARTIAL_FILE;
+        if(!save_segment(seg) && !done)
+          done = CURLE_WRITE_ERROR;
+        if(done && !result)
+          result = done;
+      }
+    }
+    segments_meter(all, running, FALSE);
+    if(running)
+      curl_multi_wait(multi, NULL, 0, 1000, NULL);
+  }
+  segments_meter(all, running, TRUE);
+
+  for(i = 0; i < all->num; i++) {
+    struct segment *seg = &all->seg[i];
+    if(seg->curl) {
+      curl_multi_remove_handle(multi, seg->curl);
+      if(seg->curl != curl)
+        curl_easy_cleanup(seg->curl);
+      seg->curl = NULL;
+    }
+  }
+
+  return result;
+}
+
+CURLcode segments_perform(struct OperationConfig *config, CURL *curl,
+                          struct OutStruct *outs)
+{
+  struct segments all;
+  struct probe probe;
+  CURLM *multi;
+  char *url = NULL;
+  CURLcode result;
+
+  memset(&all, 0, sizeof(struct segments));
+  all.config = config;
+  all.fd = -1;
+  all.statefd = -1;
+  all.statename = aprintf("%s%s", outs->filename, SEGMENT_STATE_SUFFIX);
+  if(!all.statename)
+    return CURLE_OUT_OF_MEMORY;
+
+  multi = curl_multi_init();
+  if(multi)
+    url = probe_url(multi, curl, &probe);
+  if(!url) {
+    /* one ordinary transfer then, and the state of an earlier run no
+       longer tells the truth */
+    if(multi)
+      curl_multi_cleanup(multi);
+    unlink(all.statename);
+    free(all.statename);
+    return curl_easy_perform(curl);
+  }
+
+  result = open_files(&all, &probe, outs->filename);
+  if(!result)
+    result = run_segments(&all, multi, curl, url);
+  curl_multi_cleanup(multi);
+
+  if((all.fd != -1) && close(all.fd) && !result) {
+    result = CURLE_WRITE_ERROR;
+    fprintf(config->global->errors, "(%d) Failed writing body\n", result);
+  }
+  if(all.statefd != -1)
+    close(all.statefd);
+
+  if(!result) {
+    /* complete, the file is all there is to keep */
+    unlink(all.statename);
+    outs->bytes = all.size;
+  }
+  else {
+    outs->bytes = all.received;
+    if(all.statefd != -1)
+      notef(config->global, "%s keeps how far the segments got, the same "
+            "command goes on from there\n", all.statename);
+  }
+
+  free(url);
+  free(all.statename);
+  return result;
+}
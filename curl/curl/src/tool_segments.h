@@ -0,0 +1,52 @@
+#ifndef HEADER_CURL_TOOL_SEGMENTS_H
+#define HEADER_CURL_TOOL_SEGMENTS_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "tool_setup.h"
+
+/*
+ * --segments: a large HTTP download from a server that takes byte ranges
+ * is split into one range request per segment, all run at once on a multi
+ * handle and written in place into the output file.  How far each segment
+ * got is kept in a state file next to it, so that a download that was cut
+ * short goes on where each of its segments stopped.
+ */
+
+/* Smallest segment worth a request of its own */
+#define SEGMENT_MIN_SIZE (1024 * 1024)
+
+/* Bytes a segment gets between two updates of the state file */
+#define SEGMENT_SAVE_EVERY (1024 * 1024)
+
+/* Appended to the output file name for the state file */
+#define SEGMENT_STATE_SUFFIX ".segments"
+
+/*
+ * Performs the transfer set up on 'curl' into outs->filename: in segments,
+ * when the server allows, or else as one ordinary transfer.  'curl' itself
+ * runs the first segment, so what libcurl tells of it afterwards is about
+ * that one.
+ */
+CURLcode segments_perform(struct OperationConfig *config, CURL *curl,
+                          struct OutStruct *outs);
+
+#endif /* HEADER_CURL_TOOL_SEGMENTS_H */
@@ -0,0 +1,291 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "tool_setup.h"
+
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
+#include "tool_share.h"
+#include "tool_metrics.h"
+
+#include "memdebug.h" /* keep this as LAST include */
+
+#ifdef HAVE_PTHREAD_H
+
+/*
+ * libcurl 7.54 cannot share its connection cache (CURL_LOCK_DATA_CONNECT
+ * is not supported yet), but an easy handle keeps its own connections
+ * across curl_easy_reset(), so it is the handles that are kept.  Cookies
+ * are not shared: a shared cookie store turns the cookie engine on in
+ * every handle, which a curl command without -b or -c must not have.
+ */
+
+struct idle_handle {
+  CURL *curl;
+  time_t since;                 /* When it was given back */
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+static bool share_locks_ready = FALSE;
+static CURLSH *share = NULL;    /* Created for the first command */
+static struct idle_handle idle[TOOL_SHARE_MAX]; /* Oldest first */
+static int nidle = 0;
+static int inuse = 0;           /* Handles handed out */
+static bool reaping = FALSE;    /* The reaper thread is running */
+
+static void share_lock(CURL *curl, curl_lock_data data,
+                       curl_lock_access access, void *userptr)
+{
+  (void)curl;
+  (void)access;
+  (void)userptr;
+  pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *curl, curl_lock_data data, void *userptr)
+{
+  (void)curl;
+  (void)userptr;
+  pthread_mutex_unlock(&share_locks[data]);
+}
+
+/*
+ * Create the share, holding a reference to the library of its own so that
+ * the curl_global_cleanup() at the end of each command does not pull it
+ * from under the handles kept.  Called with pool_lock held.
+ */
+static void share_init(void)
+{
+  int i;
+
+  if(!share_locks_ready) {
+    for(i = 0; i < CURL_LOCK_DATA_LAST; i++)
+      pthread_mutex_init(&share_locks[i], NULL);
+    share_locks_ready = TRUE;
+  }
+  if(curl_global_init(CURL_GLOBAL_DEFAULT))
+    return;
+  share = curl_share_init();
+  if(!share) {
+    curl_global_cleanup();
+    return;
+  }
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+/*
+ * Drop the share once no handle uses it.  Called with pool_lock held.
+ */
+static void share_drop(void)
+{
+  if(share && !nidle && !inuse) {
+    curl_share_cleanup(share);
+    share = NULL;
+    curl_global_cleanup();
+  }
+}
+
+/*
+ * Take the handles unused since before 'until' (all of them with 0) out of
+ * the pool, into 'gone'.  Called with pool_lock held.
+ */
+static int take_idle(time_t until, CURL **gone)
+{
+  int n = 0;
+  int i;
+
+  while(n < nidle && (!until || idle[n].since <= until)) {
+    gone[n] = idle[n].curl;
+    n++;
+  }
+  for(i = n; i < nidle; i++)
+    idle[i - n] = idle[i];
+  nidle -= n;
+  return n;
+}
+
+static void cleanup_all(CURL **gone, int n)
+{
+  while(n > 0)
+    curl_easy_cleanup(gone[--n]);
+}
+
+/*
+ * The reaper: closes handles, and so their connections, once they have not
+ * been used for TOOL_SHARE_IDLE seconds.
+ */
+static void *reaper(void *arg)
+{
+  CURL *gone[TOOL_SHARE_MAX];
+  struct timespec deadline;
+  time_t now;
+  int n;
+
+  (void)arg;
+  pthread_mutex_lock(&pool_lock);
+  while(nidle > 0) {
+    now = time(NULL);
+    n = take_idle(now - TOOL_SHARE_IDLE, gone);
+    if(n) {
+      /* inuse keeps the share alive meanwhile */
+      inuse++;
+      pthread_mutex_unlock(&pool_lock);
+      cleanup_all(gone, n);
+      pthread_mutex_lock(&pool_lock);
+      inuse--;
+      continue;
+    }
+    deadline.tv_sec = idle[0].since + TOOL_SHARE_IDLE + 1;
+    deadline.tv_nsec = 0;
+    pthread_cond_timedwait(&pool_wake, &pool_lock, &deadline);
+  }
+  reaping = FALSE;
+  share_drop();
+  pthread_mutex_unlock(&pool_lock);
+  return NULL;
+}
+
+/*
+ * Get a handle for a curl command: the one most recently given back if
+ * there is one, reset, or else a new one.
+ */
+CURL *tool_share_easy(void)
+{
+  CURL *curl = NULL;
+  CURLSH *sh;
+
+  pthread_mutex_lock(&pool_lock);
+  if(!share)
+    share_init();
+  sh = share;
+  if(nidle > 0)
+    curl = idle[--nidle].curl;
+  inuse++;
+  pthread_mutex_unlock(&pool_lock);
+
+  if(curl) {
+    curl_easy_reset(curl);
+    tool_metrics_handle(TRUE);
+  }
+  else {
+    curl = curl_easy_init();
+    if(curl)
+      tool_metrics_handle(FALSE);
+  }
+  if(curl && sh)
+    /* again after a reset, which forgets the share's session cache size */
+    curl_easy_setopt(curl, CURLOPT_SHARE, sh);
+  if(!curl) {
+    pthread_mutex_lock(&pool_lock);
+    inuse--;
+    share_drop();
+    pthread_mutex_unlock(&pool_lock);
+  }
+  return curl;
+}
+
+/*
+ * Give back a handle from tool_share_easy().  With 'keep' it goes into the
+ * pool with its connections, unless the pool is full.
+ */
+void tool_share_release(CURL *curl, bool keep)
+{
+  pthread_t thread;
+  pthread_attr_t attr;
+
+  if(!curl)
+    return;
+  pthread_mutex_lock(&pool_lock);
+  if(keep && share && nidle < TOOL_SHARE_MAX) {
+    idle[nidle].curl = curl;
+    idle[nidle].since = time(NULL);
+    nidle++;
+    curl = NULL;
+    if(!reaping) {
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+      if(!pthread_create(&thread, &attr, reaper, NULL))
+        reaping = TRUE;
+      pthread_attr_destroy(&attr);
+    }
+  }
+  pthread_mutex_unlock(&pool_lock);
+
+  if(curl)
+    curl_easy_cleanup(curl);
+
+  pthread_mutex_lock(&pool_lock);
+  inuse--;
+  share_drop();
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * Close every unused handle with its connections now, and drop the DNS and
+ * TLS session caches if no curl command is running.
+ */
+void curl_tool_flush(void)
+{
+  CURL *gone[TOOL_SHARE_MAX];
+  int n;
+
+  pthread_mutex_lock(&pool_lock);
+  n = take_idle(0, gone);
+  inuse++;
+  pthread_mutex_unlock(&pool_lock);
+
+  cleanup_all(gone, n);
+
+  pthread_mutex_lock(&pool_lock);
+  inuse--;
+  share_drop();
+  pthread_cond_broadcast(&pool_wake);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+#else /* HAVE_PTHREAD_H */
+
+CURL *tool_share_easy(void)
+{
+  CURL *curl = curl_easy_init();
+  if(curl)
+    tool_metrics_handle(FALSE);
+  return curl;
+}
+
+void tool_share_release(CURL *curl, bool keep)
+{
+  (void)keep;
+  curl_easy_cleanup(curl);
+}
+
+void curl_tool_flush(void)
+{
+}
+
+#endif /* HAVE_PTHREAD_H */
@@ -0,0 +1,48 @@
+#ifndef HEADER_CURL_TOOL_SHARE_H
+#define HEADER_CURL_TOOL_SHARE_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2017, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "tool_setup.h"
+
+/*
+ * All the curl commands run in one process, so the handles they use are
+ * kept between them: a handle given back is reset and handed to the next
+ * command, with the connections it still has open, and all of them share
+ * one DNS cache and one TLS session cache.
+ */
+
+/* Seconds an unused handle is kept, with its connections */
+#define TOOL_SHARE_IDLE 60
+
+/* Most unused handles kept */
+#define TOOL_SHARE_MAX  4
+
+CURL *tool_share_easy(void);
+void tool_share_release(CURL *curl, bool keep);
+
+/* Drop every unused handle and the shared caches, for the app to call */
+#ifdef __GNUC__
+__attribute__ ((visibility("default")))
+#endif
+void curl_tool_flush(void);
+
+#endif /* HEADER_CURL_TOOL_SHARE_H */
@@ -107,7 +107,8 @@ static const struct variable replacements[]={
 
 void ourWriteOut(CURL *curl, struct OutStruct *outs, const char *writeinfo)
 {
-  FILE *stream = thread_stdout;
+  /* a --parallel transfer writes where the rest of its stdout goes */
+  FILE *stream = outs->spool ? outs->spool : thread_stdout;
   const char *ptr = writeinfo;
   char *stringp = NULL;
   long longinfo;
@@ -51,8 +51,10 @@ __RCSID("$FreeBSD: src/bin/chmod/chmod.c,v 1.27 2002/08/04 05:29:13 obrien Exp $
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -66,8 +68,46 @@ __RCSID("$FreeBSD: src/bin/chmod/chmod.c,v 1.27 2002/08/04 05:29:13 obrien Exp $
 
 __thread int chmod_fflag = 0;
 
+/*
+ * With -j, the traversal stays on the calling thread, which also changes
+ * the directories, since fts reads each one right after.  The modes of
+ * the other entries are changed by the pool threads, through a window of
+ * CHMOD_WINDOW entries per thread.
+ */
+#define	CHMOD_WINDOW	64
+
+struct chmod_job {
+	char	*path;
+	mode_t	 omode;
+	mode_t	 nmode;
+};
+
+struct chmod_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* job queued, or end of traversal */
+	pthread_cond_t	 room;		/* job taken */
+	struct chmod_job *jobs;
+	size_t		 size;
+	size_t		 head;		/* next job to take */
+	size_t		 tail;		/* next free slot */
+	int		 finished;
+	int		 rval;
+	unsigned int	 nthreads;
+	pthread_t	*threads;
+	int		 atflag;
+	int		 vflag;
+	/* The calling thread's thread-local state, for the workers */
+	FILE		*out, *errs;
+	int		 fflag;
+};
+
 int chmod_main(int, char *[]);
 void chmod_usage(void);
+static int	chmod_one(const char *, const char *, mode_t, mode_t, int, int);
+static struct chmod_pool *chmod_pool_create(unsigned int, int, int);
+static void	chmod_pool_add(struct chmod_pool *, const char *, mode_t,
+		    mode_t);
+static int	chmod_pool_finish(struct chmod_pool *);
 
 int
 chmod_main(int argc, char *argv[])
@@ -78,8 +118,11 @@ chmod_main(int argc, char *argv[])
 	mode_t *set = NULL;
 	long val = 0;
 	int oct = 0;
-	int Hflag, Lflag, Pflag, Rflag, ch, fts_options, hflag, rval;
+	int Hflag, Lflag, Pflag, Rflag, atflag, ch, fts_options, hflag, rval;
 	int vflag;
+	unsigned int njobs;
+	unsigned long l;
+	struct chmod_pool *pool;
 	char *ep, *mode;
 	mode_t newmode, omode;
 #ifdef __APPLE__
@@ -92,15 +135,16 @@ chmod_main(int argc, char *argv[])
 	acl_t acl_input = NULL;
     optind = 1; opterr = 1; optreset = 1;
 #endif /* __APPLE__*/
-	int (*change_mode)(const char *, mode_t);
 
 	set = NULL;
 	omode = 0;
 	Hflag = Lflag = Pflag = Rflag = chmod_fflag = hflag = vflag = 0;
+	njobs = 1;
+	pool = NULL;
 #ifndef __APPLE__
-	while ((ch = getopt(argc, argv, "HLPRXfghorstuvwx")) != -1)
+	while ((ch = getopt(argc, argv, "HLPRXfghj:orstuvwx")) != -1)
 #else
-	while ((ch = getopt(argc, argv, "ACEHILNPRVXafghinorstuvwx")) != -1)
+	while ((ch = getopt(argc, argv, "ACEHILNPRVXafghij:norstuvwx")) != -1)
 #endif
 		switch (ch) {
 		case 'H':
@@ -134,6 +178,13 @@ chmod_main(int argc, char *argv[])
 			 */
 			hflag = 1;
 			break;
+		case 'j':
+			errno = 0;
+			l = strtoul(optarg, &ep, 10);
+			if (errno != 0 || *ep != '\0' || l == 0 || l > UINT_MAX)
+				errx(1, "%s: invalid number of jobs", optarg);
+			njobs = (unsigned int)l;
+			break;
 #ifdef __APPLE__
 		case 'a':
 			if (argv[optind - 1][0] == '-' &&
@@ -290,10 +341,10 @@ apnoacl:
 	} else
 		fts_options = hflag ? FTS_PHYSICAL : FTS_LOGICAL;
 
-	if (hflag)
-		change_mode = lchmod;
-	else
-		change_mode = chmod;
+	atflag = hflag ? AT_SYMLINK_NOFOLLOW : 0;
+	/* The pool threads take paths, so they must not be relative */
+	if (Rflag && njobs > 1)
+		fts_options |= FTS_NOCHDIR;
 #ifdef __APPLE__
 	if (acloptflags & ACL_FROM_STDIN) {
 		ssize_t readval = 0;
@@ -368,6 +419,12 @@ apnoacl:
     if ((ftsp = fts_open(++argv, fts_options, 0)) == NULL) {
 		err(1, "fts_open");
     }
+#ifdef __APPLE__
+	if (Rflag && njobs > 1 && !(acloptflags & ACL_FLAG))
+#else
+	if (Rflag && njobs > 1)
+#endif /* __APPLE__ */
+		pool = chmod_pool_create(njobs, atflag, vflag);
 	for (rval = 0; (p = fts_read(ftsp)) != NULL;) {
 		switch (p->fts_info) {
 		case FTS_D:
@@ -412,33 +469,23 @@ apnoacl:
 			newmode = oct ? omode : getmode(set, p->fts_statp->st_mode);
 			if ((newmode & ALLPERMS) == (p->fts_statp->st_mode & ALLPERMS))
 				continue;
-			if ((*change_mode)(p->fts_accpath, newmode) && !chmod_fflag) {
-                warn("Unable to change file mode on %s", p->fts_path);
+			if (pool != NULL && p->fts_info != FTS_D)
+				chmod_pool_add(pool, p->fts_accpath,
+				    p->fts_statp->st_mode, newmode);
+			else if (chmod_one(p->fts_accpath, p->fts_path,
+			    p->fts_statp->st_mode, newmode, atflag, vflag))
 				rval = 1;
-			} else {
-				if (vflag) {
-					(void)fprintf(thread_stdout, "%s", p->fts_accpath);
-
-					if (vflag > 1) {
-						char m1[12], m2[12];
-						
-						strmode(p->fts_statp->st_mode, m1);
-						strmode((p->fts_statp->st_mode &
-							 S_IFMT) | newmode, m2);
-						
-						(void)fprintf(thread_stdout, ": 0%o [%s] -> 0%o [%s]",
-							     p->fts_statp->st_mode, m1,
-					    (p->fts_statp->st_mode & S_IFMT) |
-							     newmode, m2);
-					}
-					(void)fprintf(thread_stdout, "\n");
-				}
-				
-			}
 #ifdef __APPLE__
 		}
 #endif /* __APPLE__*/
 	}
+	if (pool != NULL) {
+		/* Keep the errno of fts_read() for the check below */
+		ch = errno;
+		if (chmod_pool_finish(pool))
+			rval = 1;
+		errno = ch;
+	}
     if (errno) {
 		err(1, "fts_read");
     }
@@ -454,16 +501,162 @@ apnoacl:
 	exit(rval);
 }
 
+/*
+ * Change the mode of path, known to the user as name, from omode to
+ * nmode, and report it.
+ */
+static int
+chmod_one(const char *path, const char *name, mode_t omode, mode_t nmode,
+    int atflag, int vflag)
+{
+
+	if (fchmodat(AT_FDCWD, path, nmode, atflag) && !chmod_fflag) {
+		warn("Unable to change file mode on %s", name);
+		return (1);
+	}
+	if (vflag) {
+		(void)fprintf(thread_stdout, "%s", path);
+
+		if (vflag > 1) {
+			char m1[12], m2[12];
+
+			strmode(omode, m1);
+			strmode((omode & S_IFMT) | nmode, m2);
+
+			(void)fprintf(thread_stdout, ": 0%o [%s] -> 0%o [%s]",
+			    omode, m1, (omode & S_IFMT) | nmode, m2);
+		}
+		(void)fprintf(thread_stdout, "\n");
+	}
+	return (0);
+}
+
+static void *
+chmod_worker(void *arg)
+{
+	struct chmod_pool *pool = arg;
+	struct chmod_job job;
+	int rval;
+
+	thread_stdout = pool->out;
+	thread_stderr = pool->errs;
+	chmod_fflag = pool->fflag;
+
+	pthread_mutex_lock(&pool->mtx);
+	for (;;) {
+		while (pool->head == pool->tail && !pool->finished)
+			pthread_cond_wait(&pool->work, &pool->mtx);
+		if (pool->head == pool->tail)
+			break;
+		job = pool->jobs[pool->head++ % pool->size];
+		pthread_cond_signal(&pool->room);
+		pthread_mutex_unlock(&pool->mtx);
+
+		rval = chmod_one(job.path, job.path, job.omode, job.nmode,
+		    pool->atflag, pool->vflag);
+		free(job.path);
+
+		pthread_mutex_lock(&pool->mtx);
+		if (rval)
+			pool->rval = 1;
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (NULL);
+}
+
+/*
+ * Returns NULL if the modes should be changed on this thread.
+ */
+static struct chmod_pool *
+chmod_pool_create(unsigned int njobs, int atflag, int vflag)
+{
+	struct chmod_pool *pool;
+	unsigned int n;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL ||
+	    (pool->threads = calloc(njobs, sizeof(pthread_t))) == NULL ||
+	    (pool->jobs = calloc((size_t)njobs * CHMOD_WINDOW,
+	    sizeof(struct chmod_job))) == NULL)
+		err(1, "calloc");
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->room, NULL);
+	pool->size = (size_t)njobs * CHMOD_WINDOW;
+	pool->atflag = atflag;
+	pool->vflag = vflag;
+	pool->out = thread_stdout;
+	pool->errs = thread_stderr;
+	pool->fflag = chmod_fflag;
+	for (n = 0; n < njobs; n++)
+		if (pthread_create(&pool->threads[n], NULL, chmod_worker,
+		    pool) != 0)
+			break;
+	if (n == 0) {
+		pthread_cond_destroy(&pool->room);
+		pthread_cond_destroy(&pool->work);
+		pthread_mutex_destroy(&pool->mtx);
+		free(pool->threads);
+		free(pool->jobs);
+		free(pool);
+		return (NULL);
+	}
+	pool->nthreads = n;
+	return (pool);
+}
+
+static void
+chmod_pool_add(struct chmod_pool *pool, const char *path, mode_t omode,
+    mode_t nmode)
+{
+	struct chmod_job *job;
+	char *p;
+
+	if ((p = strdup(path)) == NULL)
+		err(1, "strdup");
+	pthread_mutex_lock(&pool->mtx);
+	while (pool->tail - pool->head == pool->size)
+		pthread_cond_wait(&pool->room, &pool->mtx);
+	job = &pool->jobs[pool->tail++ % pool->size];
+	job->path = p;
+	job->omode = omode;
+	job->nmode = nmode;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+static int
+chmod_pool_finish(struct chmod_pool *pool)
+{
+	unsigned int i;
+	int rval;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->finished = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	rval = pool->rval;
+	pthread_cond_destroy(&pool->room);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->mtx);
+	free(pool->threads);
+	free(pool->jobs);
+	free(pool);
+	return (rval);
+}
+
 void
 chmod_usage(void)
 {
 #ifdef __APPLE__
 	(void)fprintf(thread_stderr,
-		      "usage:\tchmod [-fhv] [-R [-H | -L | -P]] [-a | +a | =a  [i][# [ n]]] mode|entry file ...\n"
+		      "usage:\tchmod [-fhv] [-R [-H | -L | -P] [-j jobs]] [-a | +a | =a  [i][# [ n]]] mode|entry file ...\n"
 		      "\tchmod [-fhv] [-R [-H | -L | -P]] [-E | -C | -N | -i | -I] file ...\n"); /* add -A and -V when implemented */
 #else
 	(void)fprintf(thread_stderr,
-	    "usage: chmod [-fhv] [-R [-H | -L | -P]] mode file ...\n");
+	    "usage: chmod [-fhv] [-R [-H | -L | -P] [-j jobs]] mode file ...\n");
 #endif /* __APPLE__ */
 	exit(1);
 }
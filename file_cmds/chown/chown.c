@@ -52,8 +52,11 @@ __RCSID("$FreeBSD: src/usr.sbin/chown/chown.c,v 1.24 2002/07/17 16:22:24 dwmalon
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
 #include <grp.h>
+#include <limits.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -68,9 +71,42 @@ __RCSID("$FreeBSD: src/usr.sbin/chown/chown.c,v 1.24 2002/07/17 16:22:24 dwmalon
 #define COMPAT_MODE(a,b) (1)
 #endif /* __APPLE__ */
 
+/*
+ * With -j, fts runs on the calling thread and the pool threads change the
+ * owners, through a window of CHOWN_WINDOW entries per thread.
+ */
+#define	CHOWN_WINDOW	64
+
+struct chown_job {
+	char	*path;
+	int	 atflag;
+};
+
+struct chown_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* job queued, or end of traversal */
+	pthread_cond_t	 room;		/* job taken */
+	struct chown_job *jobs;
+	size_t		 size;
+	size_t		 head;		/* next job to take */
+	size_t		 tail;		/* next free slot */
+	int		 finished;
+	int		 rval;
+	int		 fflag;
+	int		 vflag;
+	unsigned int	 nthreads;
+	pthread_t	*threads;
+	/* The calling thread's thread-local state, for the workers */
+	FILE		*out, *errs;
+};
+
 static void	a_gid(const char *);
 static void	a_uid(const char *);
 static void	chownerr(const char *);
+static int	chown_one(const char *, const char *, int, int, int);
+static struct chown_pool *chown_pool_create(unsigned int, int, int);
+static void	chown_pool_add(struct chown_pool *, const char *, int);
+static int	chown_pool_finish(struct chown_pool *);
 static uid_t	id(const char *, const char *);
 static void	usage(void);
 
@@ -78,6 +114,7 @@ static uid_t uid;
 static gid_t gid;
 static int ischown;
 static const char *gname;
+static pthread_mutex_t chownerr_mtx = PTHREAD_MUTEX_INITIALIZER;
 
 int
 chown_main(int argc, char **argv)
@@ -85,8 +122,11 @@ chown_main(int argc, char **argv)
 	FTS *ftsp;
 	FTSENT *p;
 	int Hflag, Lflag, Pflag, Rflag, fflag, hflag, vflag;
-	int ch, fts_options, rval;
-	char *cp;
+	int atflag, ch, fts_options, rval;
+	unsigned int njobs;
+	unsigned long l;
+	struct chown_pool *pool;
+	char *cp, *ep;
 	int unix2003_compat = 0;
 	int symlink_found = 0;
 
@@ -97,8 +137,10 @@ chown_main(int argc, char **argv)
 	ischown = (strcmp(cp, "chown") == 0);
 
 	Hflag = Lflag = Pflag = Rflag = fflag = hflag = vflag = 0;
+	njobs = 1;
+	pool = NULL;
     optind = 1; opterr = 1; optreset = 1;
-	while ((ch = getopt(argc, argv, "HLPRfhv")) != -1)
+	while ((ch = getopt(argc, argv, "HLPRfhj:v")) != -1)
 		switch (ch) {
 		case 'H':
 			Hflag = 1;
@@ -121,6 +163,13 @@ chown_main(int argc, char **argv)
 		case 'h':
 			hflag = 1;
 	 		break;
+		case 'j':
+			errno = 0;
+			l = strtoul(optarg, &ep, 10);
+			if (errno != 0 || *ep != '\0' || l == 0 || l > UINT_MAX)
+				errx(1, "%s: invalid number of jobs", optarg);
+			njobs = (unsigned int)l;
+			break;
 		case 'v':
 			vflag = 1;
 			break;
@@ -148,6 +197,9 @@ chown_main(int argc, char **argv)
 			fts_options &= ~FTS_PHYSICAL;
 			fts_options |= FTS_LOGICAL;
 		}
+		/* The pool threads take paths, so they must not be relative */
+		if (njobs > 1)
+			fts_options |= FTS_NOCHDIR;
 	} else
 		fts_options = hflag ? FTS_PHYSICAL : FTS_LOGICAL;
 
@@ -175,6 +227,8 @@ chown_main(int argc, char **argv)
     if ((ftsp = fts_open(++argv, fts_options, 0)) == NULL) {
         err(1, NULL);
     }
+	if (Rflag && njobs > 1)
+		pool = chown_pool_create(njobs, fflag, vflag);
 
 	for (rval = 0; (p = fts_read(ftsp)) != NULL;) {
 		symlink_found = 0;
@@ -227,15 +281,19 @@ chown_main(int argc, char **argv)
 			    (gid == (gid_t)-1 || gid == p->fts_statp->st_gid))
 				continue;
 		}
-		if (((hflag || symlink_found) ? lchown : chown)(p->fts_accpath, uid, gid) == -1) {
-			if (!fflag) {
-				chownerr(p->fts_path);
-				rval = 1;
-			}
-		} else {
-			if (vflag)
-				fprintf(thread_stdout, "%s\n", p->fts_path);
-		}
+		atflag = (hflag || symlink_found) ? AT_SYMLINK_NOFOLLOW : 0;
+		if (pool != NULL)
+			chown_pool_add(pool, p->fts_accpath, atflag);
+		else if (chown_one(p->fts_accpath, p->fts_path, atflag, fflag,
+		    vflag))
+			rval = 1;
+	}
+	if (pool != NULL) {
+		/* Keep the errno of fts_read() for the check below */
+		ch = errno;
+		if (chown_pool_finish(pool))
+			rval = 1;
+		errno = ch;
 	}
     if (errno) {
 		err(1, "fts_read");
@@ -243,6 +301,141 @@ chown_main(int argc, char **argv)
 	exit(rval);
 }
 
+/*
+ * Change the owner of path, known to the user as name, and report it.
+ */
+static int
+chown_one(const char *path, const char *name, int atflag, int fflag,
+    int vflag)
+{
+
+	if (fchownat(AT_FDCWD, path, uid, gid, atflag) == -1) {
+		if (!fflag) {
+			/* chownerr() keeps its findings in statics */
+			pthread_mutex_lock(&chownerr_mtx);
+			chownerr(name);
+			pthread_mutex_unlock(&chownerr_mtx);
+			return (1);
+		}
+	} else {
+		if (vflag)
+			fprintf(thread_stdout, "%s\n", name);
+	}
+	return (0);
+}
+
+static void *
+chown_worker(void *arg)
+{
+	struct chown_pool *pool = arg;
+	struct chown_job job;
+	int rval;
+
+	thread_stdout = pool->out;
+	thread_stderr = pool->errs;
+
+	pthread_mutex_lock(&pool->mtx);
+	for (;;) {
+		while (pool->head == pool->tail && !pool->finished)
+			pthread_cond_wait(&pool->work, &pool->mtx);
+		if (pool->head == pool->tail)
+			break;
+		job = pool->jobs[pool->head++ % pool->size];
+		pthread_cond_signal(&pool->room);
+		pthread_mutex_unlock(&pool->mtx);
+
+		rval = chown_one(job.path, job.path, job.atflag, pool->fflag,
+		    pool->vflag);
+		free(job.path);
+
+		pthread_mutex_lock(&pool->mtx);
+		if (rval)
+			pool->rval = 1;
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (NULL);
+}
+
+/*
+ * Returns NULL if the owners should be changed on this thread.
+ */
+static struct chown_pool *
+chown_pool_create(unsigned int njobs, int fflag, int vflag)
+{
+	struct chown_pool *pool;
+	unsigned int n;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL ||
+	    (pool->threads = calloc(njobs, sizeof(pthread_t))) == NULL ||
+	    (pool->jobs = calloc((size_t)njobs * CHOWN_WINDOW,
+	    sizeof(struct chown_job))) == NULL)
+		err(1, "calloc");
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->room, NULL);
+	pool->size = (size_t)njobs * CHOWN_WINDOW;
+	pool->fflag = fflag;
+	pool->vflag = vflag;
+	pool->out = thread_stdout;
+	pool->errs = thread_stderr;
+	for (n = 0; n < njobs; n++)
+		if (pthread_create(&pool->threads[n], NULL, chown_worker,
+		    pool) != 0)
+			break;
+	if (n == 0) {
+		pthread_cond_destroy(&pool->room);
+		pthread_cond_destroy(&pool->work);
+		pthread_mutex_destroy(&pool->mtx);
+		free(pool->threads);
+		free(pool->jobs);
+		free(pool);
+		return (NULL);
+	}
+	pool->nthreads = n;
+	return (pool);
+}
+
+static void
+chown_pool_add(struct chown_pool *pool, const char *path, int atflag)
+{
+	struct chown_job *job;
+	char *p;
+
+	if ((p = strdup(path)) == NULL)
+		err(1, "strdup");
+	pthread_mutex_lock(&pool->mtx);
+	while (pool->tail - pool->head == pool->size)
+		pthread_cond_wait(&pool->room, &pool->mtx);
+	job = &pool->jobs[pool->tail++ % pool->size];
+	job->path = p;
+	job->atflag = atflag;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+static int
+chown_pool_finish(struct chown_pool *pool)
+{
+	unsigned int i;
+	int rval;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->finished = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	rval = pool->rval;
+	pthread_cond_destroy(&pool->room);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->mtx);
+	free(pool->threads);
+	free(pool->jobs);
+	free(pool);
+	return (rval);
+}
+
 void
 a_gid(const char *s)
 {
@@ -311,11 +504,13 @@ usage(void)
 
 	if (ischown)
 		(void)fprintf(thread_stderr, "%s\n%s\n",
-		    "usage: chown [-fhv] [-R [-H | -L | -P]] owner[:group]"
-		    " file ...",
-		    "       chown [-fhv] [-R [-H | -L | -P]] :group file ...");
+		    "usage: chown [-fhv] [-R [-H | -L | -P] [-j jobs]]"
+		    " owner[:group] file ...",
+		    "       chown [-fhv] [-R [-H | -L | -P] [-j jobs]]"
+		    " :group file ...");
 	else
 		(void)fprintf(thread_stderr, "%s\n",
-		    "usage: chgrp [-fhv] [-R [-H | -L | -P]] group file ...");
+		    "usage: chgrp [-fhv] [-R [-H | -L | -P] [-j jobs]] group"
+		    " file ...");
 	exit(1);
 }
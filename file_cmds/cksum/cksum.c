@@ -51,9 +51,13 @@ static char sccsid[] = "@(#)cksum.c	8.2 (Berkeley) 4/28/95";
 __FBSDID("$FreeBSD: src/usr.bin/cksum/cksum.c,v 1.17 2003/03/13 23:32:28 robert Exp $");
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <err.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -64,6 +68,34 @@ __FBSDID("$FreeBSD: src/usr.bin/cksum/cksum.c,v 1.17 2003/03/13 23:32:28 robert
 #include <errno.h>
 #include "ios_error.h" // remap exit to pthread_exit
 
+/*
+ * With -j, files are handed out to the workers in argument order, and each
+ * result is printed once all the files before it have been printed.
+ */
+struct ck_job {
+	char		*fn;
+	uint32_t	 val;
+	off_t		 len;
+	int		 error;		/* errno, or 0 */
+	int		 done;
+};
+
+struct ck_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 done;		/* a job completed */
+	struct ck_job	*jobs;
+	size_t		 njobs;
+	size_t		 next;		/* next job to hand out */
+	int		(*cfncn)(int, uint32_t *, off_t *);
+	const char	*cname;
+};
+
+static int ck_sum(int (*)(int, uint32_t *, off_t *), const char *, int,
+    uint32_t *, off_t *);
+static void *ck_worker(void *);
+static int ck_files(char **, unsigned int,
+    int (*)(int, uint32_t *, off_t *), const char *,
+    void (*)(char *, u_int32_t, off_t));
 static void usage(void);
 
 int
@@ -75,8 +107,15 @@ chksum_main(int argc, char **argv)
 	char *fn, *p;
 	int (*cfncn)(int, uint32_t *, off_t *);
 	void (*pfncn)(char *, u_int32_t, off_t);
+	const char *cname;		/* for the digest cache, NULL with -N */
+	unsigned int njobs;
+	u_long l;
+	int nocache;
 	
 	cfncn=NULL;
+	nocache = 0;
+	cname = NULL;
+	njobs = 1;
     optind = 1; opterr = 1; optreset = 1;
 
 	if(*argv) {
@@ -87,26 +126,42 @@ chksum_main(int argc, char **argv)
 	  if (!strcmp(p, "sum")) {
 	    cfncn = csum1;
 	    pfncn = psum1;
+	    cname = "sum1";
 	    ++argv;
 	  }
 	} 
 	
 	if(!cfncn) {
-		cfncn = crc;
+		cfncn = posix_crc;
 		pfncn = pcrc;
+		cname = "cksum";
 
-		while ((ch = getopt(argc, argv, "o:")) != -1)
+		while ((ch = getopt(argc, argv, "j:No:")) != -1)
 			switch (ch) {
+			case 'j':
+				errno = 0;
+				l = strtoul(optarg, &p, 10);
+				if (errno != 0 || *p != '\0' || l == 0 ||
+				    l > UINT_MAX)
+					errx(1, "%s: invalid number of jobs", optarg);
+				njobs = (unsigned int)l;
+				break;
+			case 'N':
+				nocache = 1;
+				break;
 			case 'o':
 				if (!strcmp(optarg, "1")) {
 					cfncn = csum1;
 					pfncn = psum1;
+					cname = "sum1";
 				} else if (!strcmp(optarg, "2")) {
 					cfncn = csum2;
 					pfncn = psum2;
+					cname = "sum2";
 				} else if (!strcmp(optarg, "3")) {
 					cfncn = chksum_crc32;
 					pfncn = pcrc;
+					cname = "crc32";
 				} else {
                     warnx("illegal argument to -o option");
 					usage();
@@ -119,6 +174,11 @@ chksum_main(int argc, char **argv)
 //		argc -= optind;
 		argv += optind;
 	}
+	if (nocache)
+		cname = NULL;
+
+	if (njobs > 1 && *argv != NULL && argv[1] != NULL)
+		exit(ck_files(argv, njobs, cfncn, cname, pfncn));
 
 	fd = fileno(thread_stdin);
 	fn = NULL;
@@ -132,7 +192,8 @@ chksum_main(int argc, char **argv)
 				continue;
 			}
 		}
-		if (cfncn(fd, &val, &len)) {
+		/* the standard input may not be at the start of the file */
+		if (ck_sum(cfncn, fn ? cname : NULL, fd, &val, &len)) {
             warn("%s", fn ? fn : "stdin");
 			rval = 1;
 		} else
@@ -142,10 +203,131 @@ chksum_main(int argc, char **argv)
 	exit(rval);
 }
 
+/*
+ * Checksums fd with cfncn, or takes the result from the digest cache of
+ * ios_system, under the name cname, when the file hasn't changed since
+ * it was stored.  Returns 0, or 1 with errno set, like cfncn.
+ */
+static int
+ck_sum(int (*cfncn)(int, uint32_t *, off_t *), const char *cname, int fd,
+    uint32_t *val, off_t *len)
+{
+	struct stat sb;
+	char buf[64];
+	long long clen;
+
+	if (cname == NULL)
+		return (cfncn(fd, val, len));
+	if (ios_getCachedDigest(fd, cname, buf, sizeof(buf), &sb) != NULL &&
+	    sscanf(buf, "%" SCNu32 " %lld", val, &clen) == 2) {
+		*len = (off_t)clen;
+		return (0);
+	}
+	if (cfncn(fd, val, len))
+		return (1);
+	(void)snprintf(buf, sizeof(buf), "%" PRIu32 " %lld", *val,
+	    (long long)*len);
+	ios_setCachedDigest(fd, cname, buf, &sb);
+	return (0);
+}
+
+static void *
+ck_worker(void *arg)
+{
+	struct ck_pool *pool = arg;
+	struct ck_job *job;
+	int fd;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->mtx);
+		if (pool->next == pool->njobs) {
+			pthread_mutex_unlock(&pool->mtx);
+			return (NULL);
+		}
+		job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->mtx);
+
+		if ((fd = open(job->fn, O_RDONLY, 0)) < 0)
+			job->error = errno;
+		else {
+			if (ck_sum(pool->cfncn, pool->cname, fd, &job->val,
+			    &job->len))
+				job->error = errno;
+			(void)close(fd);
+		}
+
+		pthread_mutex_lock(&pool->mtx);
+		job->done = 1;
+		pthread_cond_broadcast(&pool->done);
+		pthread_mutex_unlock(&pool->mtx);
+	}
+}
+
+/*
+ * Checksums the files with up to njobs worker threads.  Returns the exit
+ * status.
+ */
+static int
+ck_files(char **argv, unsigned int njobs,
+    int (*cfncn)(int, uint32_t *, off_t *), const char *cname,
+    void (*pfncn)(char *, u_int32_t, off_t))
+{
+	struct ck_pool pool;
+	struct ck_job *job;
+	pthread_t *threads;
+	size_t head, n, nthreads;
+	int rval;
+
+	for (n = 0; argv[n] != NULL; n++)
+		;
+	nthreads = njobs < n ? njobs : n;
+	if ((pool.jobs = calloc(n, sizeof(*pool.jobs))) == NULL ||
+	    (threads = calloc(nthreads, sizeof(*threads))) == NULL)
+		err(1, NULL);
+	for (head = 0; head < n; head++)
+		pool.jobs[head].fn = argv[head];
+	pool.njobs = n;
+	pool.next = 0;
+	pool.cfncn = cfncn;
+	pool.cname = cname;
+	pthread_mutex_init(&pool.mtx, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	for (n = 0; n < nthreads; n++)
+		if ((errno = pthread_create(&threads[n], NULL, ck_worker,
+		    &pool)) != 0)
+			break;
+	if (n == 0)
+		err(1, "pthread_create");
+	nthreads = n;
+
+	rval = 0;
+	for (head = 0; head < pool.njobs; head++) {
+		job = &pool.jobs[head];
+		pthread_mutex_lock(&pool.mtx);
+		while (!job->done)
+			pthread_cond_wait(&pool.done, &pool.mtx);
+		pthread_mutex_unlock(&pool.mtx);
+		if (job->error != 0) {
+			errno = job->error;
+			warn("%s", job->fn);
+			rval = 1;
+		} else
+			pfncn(job->fn, job->val, job->len);
+	}
+
+	for (n = 0; n < nthreads; n++)
+		pthread_join(threads[n], NULL);
+	pthread_cond_destroy(&pool.done);
+	pthread_mutex_destroy(&pool.mtx);
+	free(threads);
+	free(pool.jobs);
+	return (rval);
+}
+
 static void
 usage(void)
 {
-	(void)fprintf(thread_stderr, "usage: cksum [-o 1 | 2 | 3] [file ...]\n");
+	(void)fprintf(thread_stderr, "usage: cksum [-N] [-j jobs] [-o 1 | 2 | 3] [file ...]\n");
 	(void)fprintf(thread_stderr, "       sum [file ...]\n");
 	exit(1);
 }
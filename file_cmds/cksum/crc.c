@@ -44,7 +44,9 @@ __FBSDID("$FreeBSD: src/usr.bin/cksum/crc.c,v 1.8 2003/03/13 23:32:28 robert Exp
 
 #include <sys/types.h>
 
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "extern.h"
@@ -105,32 +107,73 @@ static const uint32_t crctab[] = {
 };
 
 /*
- * Compute a POSIX 1003.2 checksum.  This routine has been broken out so that
- * other programs can use it.  It takes a file descriptor to read from and
- * locations to store the crc and the number of bytes read.  It returns 0 on
- * success and 1 on failure.  Errno is set on failure.
+ * crcslice[k][i] is the crc of byte i followed by k zero bytes, so that
+ * eight bytes can be folded in with eight independent table lookups
+ * (slicing-by-8).  crcslice[0] is crctab.
  */
-uint32_t crc_total = ~0;		/* The crc over a number of files. */
+static uint32_t crcslice[8][256];
+static pthread_once_t crcslice_once = PTHREAD_ONCE_INIT;
 
-int
-crc(int fd, uint32_t *cval, off_t *clen)
+#define	COMPUTE(var, ch)	(var) = (var) << 8 ^ crctab[(var) >> 24 ^ (ch)]
+
+static void
+crcslice_init(void)
+{
+	uint32_t v;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		v = crctab[i];
+		crcslice[0][i] = v;
+		for (k = 1; k < 8; k++) {
+			v = v << 8 ^ crctab[v >> 24];
+			crcslice[k][i] = v;
+		}
+	}
+}
+
+static uint32_t
+crc_update(uint32_t lcrc, const u_char *p, size_t len)
+{
+	uint32_t hi, lo;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		hi = lcrc ^ ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		    (uint32_t)p[2] << 8 | p[3]);
+		lo = (uint32_t)p[4] << 24 | (uint32_t)p[5] << 16 |
+		    (uint32_t)p[6] << 8 | p[7];
+		lcrc = crcslice[7][hi >> 24] ^ crcslice[6][hi >> 16 & 0xff] ^
+		    crcslice[5][hi >> 8 & 0xff] ^ crcslice[4][hi & 0xff] ^
+		    crcslice[3][lo >> 24] ^ crcslice[2][lo >> 16 & 0xff] ^
+		    crcslice[1][lo >> 8 & 0xff] ^ crcslice[0][lo & 0xff];
+	}
+	for (; len != 0; p++, len--)
+		COMPUTE(lcrc, *p);
+	return (lcrc);
+}
+
+static int
+crc_fd(int fd, uint32_t *cval, off_t *clen, uint32_t *total)
 {
 	uint32_t lcrc;
 	ssize_t nr;
 	off_t len;
-	u_char *p;
-	u_char buf[16 * 1024];
-
-#define	COMPUTE(var, ch)	(var) = (var) << 8 ^ crctab[(var) >> 24 ^ (ch)]
+	u_char *buf;
 
+	(void)pthread_once(&crcslice_once, crcslice_init);
+	if ((buf = malloc(CKSUM_BUFSIZ)) == NULL)
+		return (1);
 	lcrc = 0;
 	len = 0;
-	crc_total = ~crc_total;
-	while ((nr = read(fd, buf, sizeof(buf))) > 0)
-		for (len += nr, p = buf; nr--; ++p) {
-			COMPUTE(lcrc, *p);
-			COMPUTE(crc_total, *p);
-		}
+	if (total != NULL)
+		*total = ~*total;
+	while ((nr = read(fd, buf, CKSUM_BUFSIZ)) > 0) {
+		len += nr;
+		lcrc = crc_update(lcrc, buf, nr);
+		if (total != NULL)
+			*total = crc_update(*total, buf, nr);
+	}
+	free(buf);
 	if (nr < 0)
 		return (1);
 
@@ -139,10 +182,38 @@ crc(int fd, uint32_t *cval, off_t *clen)
 	/* Include the length of the file. */
 	for (; len != 0; len >>= 8) {
 		COMPUTE(lcrc, len & 0xff);
-		COMPUTE(crc_total, len & 0xff);
+		if (total != NULL)
+			COMPUTE(*total, len & 0xff);
 	}
 
 	*cval = ~lcrc;
-	crc_total = ~crc_total;
+	if (total != NULL)
+		*total = ~*total;
 	return (0);
 }
+
+/*
+ * Compute a POSIX 1003.2 checksum.  This routine has been broken out so that
+ * other programs can use it.  It takes a file descriptor to read from and
+ * locations to store the crc and the number of bytes read.  It returns 0 on
+ * success and 1 on failure.  Errno is set on failure.
+ */
+uint32_t crc_total = ~0;		/* The crc over a number of files. */
+
+int
+crc(int fd, uint32_t *cval, off_t *clen)
+{
+
+	return (crc_fd(fd, cval, clen, &crc_total));
+}
+
+/*
+ * The same checksum without the running crc_total, so that cksum -j can
+ * checksum several files at once.
+ */
+int
+posix_crc(int fd, uint32_t *cval, off_t *clen)
+{
+
+	return (crc_fd(fd, cval, clen, NULL));
+}
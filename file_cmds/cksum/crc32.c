@@ -15,10 +15,19 @@
 __FBSDID("$FreeBSD: src/usr.bin/cksum/crc32.c,v 1.9 2003/03/13 23:32:28 robert Exp $");
 
 #include <sys/types.h>
+#if defined(__aarch64__) && defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#ifdef __aarch64__
+#include <arm_acle.h>
+#endif
 
 #include "extern.h"
 
@@ -95,28 +104,118 @@ static const uint32_t crctab[256] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
-uint32_t crc32_total = 0;
+/*
+ * Slicing-by-8 tables: crc32slice[k][i] is the crc of byte i followed by
+ * k zero bytes.  crc32slice[0] is crctab.
+ */
+static uint32_t crc32slice[8][256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+static uint32_t (*crc32_update)(uint32_t, const u_char *, size_t);
+
+static uint32_t
+crc32_slice8(uint32_t lcrc, const u_char *p, size_t len)
+{
+	uint32_t hi, lo;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = lcrc ^ (p[0] | (uint32_t)p[1] << 8 |
+		    (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+		hi = p[4] | (uint32_t)p[5] << 8 |
+		    (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+		lcrc = crc32slice[7][lo & 0xff] ^ crc32slice[6][lo >> 8 & 0xff] ^
+		    crc32slice[5][lo >> 16 & 0xff] ^ crc32slice[4][lo >> 24] ^
+		    crc32slice[3][hi & 0xff] ^ crc32slice[2][hi >> 8 & 0xff] ^
+		    crc32slice[1][hi >> 16 & 0xff] ^ crc32slice[0][hi >> 24];
+	}
+	for (; len != 0; p++, len--)
+		CRC(lcrc, *p);
+	return (lcrc);
+}
+
+#ifdef __aarch64__
+/*
+ * The ARMv8 CRC32 instructions use the same reflected polynomial, and
+ * take eight bytes per instruction.
+ */
+__attribute__((target("crc")))
+static uint32_t
+crc32_armv8(uint32_t lcrc, const u_char *p, size_t len)
+{
+	uint64_t v;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&v, p, sizeof(v));
+		lcrc = __crc32d(lcrc, v);
+	}
+	for (; len != 0; p++, len--)
+		lcrc = __crc32b(lcrc, *p);
+	return (lcrc);
+}
+
+static int
+crc32_armv8_present(void)
+{
+#ifdef __ARM_FEATURE_CRC32
+	return (1);
+#elif defined(__APPLE__)
+	int present;
+	size_t size;
+
+	size = sizeof(present);
+	if (sysctlbyname("hw.optional.armv8_crc32", &present, &size,
+	    NULL, 0) != 0)
+		return (0);
+	return (present);
+#else
+	return (0);
+#endif
+}
+#endif /* __aarch64__ */
+
+static void
+crc32_init(void)
+{
+	uint32_t v;
+	int i, k;
+
+#ifdef __aarch64__
+	if (crc32_armv8_present()) {
+		crc32_update = crc32_armv8;
+		return;
+	}
+#endif
+	for (i = 0; i < 256; i++) {
+		v = crctab[i];
+		crc32slice[0][i] = v;
+		for (k = 1; k < 8; k++) {
+			v = v >> 8 ^ crctab[v & 0xff];
+			crc32slice[k][i] = v;
+		}
+	}
+	crc32_update = crc32_slice8;
+}
 
 int
 chksum_crc32(int fd, uint32_t *cval, off_t *clen)
 {
-    uint32_t lcrc = ~0;
-    ssize_t nr;
-    off_t len ;
-    char buf[BUFSIZ], *p ;
-	
-    len = 0 ;
-    crc32_total = ~crc32_total ;
-    while ((nr = read(fd, buf, sizeof(buf))) > 0)
-        for (len += nr, p = buf; nr--; ++p) {
-	    CRC(lcrc, *p) ;
-	    CRC(crc32_total, *p) ;
+	uint32_t lcrc = ~0;
+	ssize_t nr;
+	off_t len;
+	u_char *buf;
+
+	(void)pthread_once(&crc32_once, crc32_init);
+	if ((buf = malloc(CKSUM_BUFSIZ)) == NULL)
+		return (1);
+	len = 0;
+	while ((nr = read(fd, buf, CKSUM_BUFSIZ)) > 0) {
+		len += nr;
+		lcrc = crc32_update(lcrc, buf, nr);
 	}
-    if (nr < 0)
-        return 1 ;
+	free(buf);
+	if (nr < 0)
+		return (1);
 
-    *clen = len ;
-    *cval = ~lcrc ;
-    crc32_total = ~crc32_total ;
-    return 0 ;
+	*clen = len;
+	*cval = ~lcrc;
+	return (0);
 }
@@ -36,8 +36,12 @@
 
 #include <sys/cdefs.h>
 
+/* Read size of the crc routines */
+#define	CKSUM_BUFSIZ	(256 * 1024)
+
 __BEGIN_DECLS
 int	crc(int, uint32_t *, off_t *);
+int	posix_crc(int, uint32_t *, off_t *);
 void	pcrc(char *, uint32_t, off_t);
 void	psum1(char *, uint32_t, off_t);
 void	psum2(char *, uint32_t, off_t);
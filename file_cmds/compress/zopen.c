@@ -65,7 +65,9 @@ __FBSDID("$FreeBSD: src/usr.bin/compress/zopen.c,v 1.17 2011/09/28 08:47:17 bz E
 
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -73,7 +75,9 @@ __FBSDID("$FreeBSD: src/usr.bin/compress/zopen.c,v 1.17 2011/09/28 08:47:17 bz E
 #include "zopen.h"
 
 #define	BITS		16		/* Default bits. */
-#define	HSIZE		69001		/* 95% occupancy */
+#define	HBITS		17
+#define	HSIZE		(1 << HBITS)	/* At most 50% occupancy */
+#define	HEMPTY		0xffffffffU	/* Key of an empty slot */
 
 /* A code_int must be able to hold 2**BITS values of type int, and also -1. */
 typedef long code_int;
@@ -104,9 +108,6 @@ struct s_zstate {
 	u_int zs_maxbits;		/* User settable max # bits/code. */
 	code_int zs_maxcode;		/* Maximum code, given n_bits. */
 	code_int zs_maxmaxcode;		/* Should NEVER generate this code. */
-	count_int zs_htab [HSIZE];
-	u_short zs_codetab [HSIZE];
-	code_int zs_hsize;		/* For dynamic table sizing. */
 	code_int zs_free_ent;		/* First unused entry. */
 	/*
 	 * Block compression parameters -- after all codes are used up,
@@ -125,8 +126,6 @@ struct s_zstate {
 		struct {
 			long zs_fcode;
 			code_int zs_ent;
-			code_int zs_hsize_reg;
-			int zs_hshift;
 		} w;			/* Write parameters */
 		struct {
 			char_type *zs_stackp;
@@ -136,6 +135,22 @@ struct s_zstate {
 			char_type zs_gbuf[BITS];
 		} r;			/* Read parameters */
 	} u;
+	/*
+	 * The tables come last: zopen() clears only what is above them.  The
+	 * hash keys are probed on every input byte, so they are kept apart
+	 * from the codes, which are only read on a hit.
+	 */
+	union {
+		struct {
+			u_int32_t zs_htab[HSIZE];	/* Prefix code and char */
+			u_short zs_codetab[HSIZE];	/* Their code */
+		} w;
+		struct {
+			u_short zs_prefix[1 << BITS];
+			char_type zs_suffix[1 << BITS];
+			char_type zs_stack[1 << BITS];
+		} r;
+	} t;
 };
 
 /* Definitions to retain old variable names */
@@ -146,9 +161,8 @@ struct s_zstate {
 #define	maxbits		zs->zs_maxbits
 #define	maxcode		zs->zs_maxcode
 #define	maxmaxcode	zs->zs_maxmaxcode
-#define	htab		zs->zs_htab
-#define	codetab		zs->zs_codetab
-#define	hsize		zs->zs_hsize
+#define	htab		zs->t.w.zs_htab
+#define	codetab		zs->t.w.zs_codetab
 #define	free_ent	zs->zs_free_ent
 #define	block_compress	zs->zs_block_compress
 #define	clear_flg	zs->zs_clear_flg
@@ -160,9 +174,7 @@ struct s_zstate {
 #define	out_count	zs->zs_out_count
 #define	buf		zs->zs_buf
 #define	fcode		zs->u.w.zs_fcode
-#define	hsize_reg	zs->u.w.zs_hsize_reg
 #define	ent		zs->u.w.zs_ent
-#define	hshift		zs->u.w.zs_hshift
 #define	stackp		zs->u.r.zs_stackp
 #define	finchar		zs->u.r.zs_finchar
 #define	code		zs->u.r.zs_code
@@ -173,20 +185,19 @@ struct s_zstate {
 #define	gbuf		zs->u.r.zs_gbuf
 
 /*
- * To save much memory, we overlay the table used by compress() with those
- * used by decompress().  The tab_prefix table is the same size and type as
- * the codetab.  The tab_suffix table needs 2**BITS characters.  We get this
- * from the beginning of htab.  The output stack uses the rest of htab, and
- * contains characters.  There is plenty of room for any possible stack
- * (stack used to be 8000 characters).
+ * The tables used by compress() and decompress() overlay each other.  The
+ * hash table is a power of two in size, so that a multiplicative hash
+ * and linear probing can replace the modulo and secondary probe.  No more
+ * than 2**BITS codes are ever entered, so at least half of it is free.
  */
 
 #define	htabof(i)	htab[i]
 #define	codetabof(i)	codetab[i]
+#define	HASH(fc)	((u_int32_t)(fc) * 0x9e3779b1U >> (32 - HBITS))
 
-#define	tab_prefixof(i)	codetabof(i)
-#define	tab_suffixof(i)	((char_type *)(htab))[i]
-#define	de_stack	((char_type *)&tab_suffixof(1 << BITS))
+#define	tab_prefixof(i)	zs->t.r.zs_prefix[i]
+#define	tab_suffixof(i)	zs->t.r.zs_suffix[i]
+#define	de_stack	zs->t.r.zs_stack
 
 #define	CHECK_GAP 10000		/* Ratio check interval. */
 
@@ -198,7 +209,8 @@ struct s_zstate {
 #define	CLEAR	256		/* Table clear output code. */
 
 static int	cl_block(struct s_zstate *);
-static void	cl_hash(struct s_zstate *, count_int);
+static void	cl_hash(struct s_zstate *);
+static void	zs_free(struct s_zstate *);
 static code_int	getcode(struct s_zstate *);
 static int	output(struct s_zstate *, code_int);
 static int	zclose(void *);
@@ -235,7 +247,7 @@ static int
 zwrite(void *cookie, const char *wbp, int num)
 {
 	code_int i;
-	int c, disp;
+	int c;
 	struct s_zstate *zs;
 	const u_char *bp;
 	u_char tmp;
@@ -272,37 +284,19 @@ zwrite(void *cookie, const char *wbp, int num)
 	ent = *bp++;
 	--count;
 
-	hshift = 0;
-	for (fcode = (long)hsize; fcode < 65536L; fcode *= 2L)
-		hshift++;
-	hshift = 8 - hshift;	/* Set hash code range bound. */
-
-	hsize_reg = hsize;
-	cl_hash(zs, (count_int)hsize_reg);	/* Clear hash table. */
+	cl_hash(zs);		/* Clear hash table. */
 
 middle:	for (; count--;) {
 		c = *bp++;
 		in_count++;
 		fcode = (long)(((long)c << maxbits) + ent);
-		i = ((c << hshift) ^ ent);	/* Xor hashing. */
 
-		if (htabof(i) == fcode) {
-			ent = codetabof(i);
-			continue;
-		} else if ((long)htabof(i) < 0)	/* Empty slot. */
-			goto nomatch;
-		disp = hsize_reg - i;	/* Secondary hash (after G. Knott). */
-		if (i == 0)
-			disp = 1;
-probe:		if ((i -= disp) < 0)
-			i += hsize_reg;
-
-		if (htabof(i) == fcode) {
-			ent = codetabof(i);
-			continue;
-		}
-		if ((long)htabof(i) >= 0)
-			goto probe;
+		for (i = HASH(fcode); htabof(i) != fcode;
+		    i = (i + 1) & (HSIZE - 1))
+			if (htabof(i) == HEMPTY)
+				goto nomatch;
+		ent = codetabof(i);
+		continue;
 nomatch:	if (output(zs, (code_int) ent) == -1)
 			return (-1);
 		out_count++;
@@ -329,18 +323,18 @@ zclose(void *cookie)
 	if (zmode == 'w') {		/* Put out the final code. */
 		if (output(zs, (code_int) ent) == -1) {
 			(void)fclose(fp);
-			free(zs);
+			zs_free(zs);
 			return (-1);
 		}
 		out_count++;
 		if (output(zs, (code_int) - 1) == -1) {
 			(void)fclose(fp);
-			free(zs);
+			zs_free(zs);
 			return (-1);
 		}
 	}
 	rval = fclose(fp) == EOF ? -1 : 0;
-	free(zs);
+	zs_free(zs);
 	return (rval);
 }
 
@@ -648,7 +642,7 @@ cl_block(struct s_zstate *zs)		/* Table clear for block compress. */
 		ratio = rat;
 	else {
 		ratio = 0;
-		cl_hash(zs, (count_int) hsize);
+		cl_hash(zs);
 		free_ent = FIRST;
 		clear_flg = 1;
 		if (output(zs, (code_int) CLEAR) == -1)
@@ -658,35 +652,47 @@ cl_block(struct s_zstate *zs)		/* Table clear for block compress. */
 }
 
 static void
-cl_hash(struct s_zstate *zs, count_int cl_hsize)	/* Reset code table. */
+cl_hash(struct s_zstate *zs)		/* Reset code table. */
 {
-	count_int *htab_p;
-	long i, m1;
-
-	m1 = -1;
-	htab_p = htab + cl_hsize;
-	i = cl_hsize - 16;
-	do {			/* Might use Sys V memset(3) here. */
-		*(htab_p - 16) = m1;
-		*(htab_p - 15) = m1;
-		*(htab_p - 14) = m1;
-		*(htab_p - 13) = m1;
-		*(htab_p - 12) = m1;
-		*(htab_p - 11) = m1;
-		*(htab_p - 10) = m1;
-		*(htab_p - 9) = m1;
-		*(htab_p - 8) = m1;
-		*(htab_p - 7) = m1;
-		*(htab_p - 6) = m1;
-		*(htab_p - 5) = m1;
-		*(htab_p - 4) = m1;
-		*(htab_p - 3) = m1;
-		*(htab_p - 2) = m1;
-		*(htab_p - 1) = m1;
-		htab_p -= 16;
-	} while ((i -= 16) >= 0);
-	for (i += 16; i > 0; i--)
-		*--htab_p = m1;
+
+	memset(htab, 0xff, sizeof(htab));	/* HEMPTY */
+}
+
+/*
+ * The tables take up most of a state, which is kept for the next zopen()
+ * when the stream is closed.  Commands run as threads of one process, so
+ * a script running zcat on many small files allocates it only once.
+ */
+static pthread_mutex_t zs_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct s_zstate *zs_cache;
+
+static struct s_zstate *
+zs_alloc(void)
+{
+	struct s_zstate *zs;
+
+	pthread_mutex_lock(&zs_cache_lock);
+	zs = zs_cache;
+	zs_cache = NULL;
+	pthread_mutex_unlock(&zs_cache_lock);
+	if (zs == NULL && (zs = malloc(sizeof(struct s_zstate))) == NULL)
+		return (NULL);
+	/* The tables are set up before they are read. */
+	memset(zs, 0, offsetof(struct s_zstate, t));
+	return (zs);
+}
+
+static void
+zs_free(struct s_zstate *zs)
+{
+
+	pthread_mutex_lock(&zs_cache_lock);
+	if (zs_cache == NULL) {
+		zs_cache = zs;
+		zs = NULL;
+	}
+	pthread_mutex_unlock(&zs_cache_lock);
+	free(zs);
 }
 
 FILE *
@@ -700,12 +706,11 @@ zopen(const char *fname, const char *mode, int bits)
 		return (NULL);
 	}
 
-	if ((zs = calloc(1, sizeof(struct s_zstate))) == NULL)
+	if ((zs = zs_alloc()) == NULL)
 		return (NULL);
 
 	maxbits = bits ? bits : BITS;	/* User settable max # bits/code. */
 	maxmaxcode = 1L << maxbits;	/* Should NEVER generate this code. */
-	hsize = HSIZE;			/* For dynamic table sizing. */
 	free_ent = 0;			/* First unused entry. */
 	block_compress = BLOCK_MASK;
 	clear_flg = 0;
@@ -722,7 +727,7 @@ zopen(const char *fname, const char *mode, int bits)
 	 * and ensure that reads and write work with the data specified.
 	 */
 	if ((fp = fopen(fname, mode)) == NULL) {
-		free(zs);
+		zs_free(zs);
 		return (NULL);
 	}
 	switch (*mode) {
@@ -59,13 +59,14 @@ __FBSDID("$FreeBSD: src/bin/cp/cp.c,v 1.52 2005/09/05 04:36:08 csjp Exp $");
  * in "to") to form the final target path.
  */
 
-#include <sys/types.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 
 #include <err.h>
 #include <errno.h>
 #include <fts.h>
 #include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -74,6 +75,7 @@ __FBSDID("$FreeBSD: src/bin/cp/cp.c,v 1.52 2005/09/05 04:36:08 csjp Exp $");
 
 #ifdef __APPLE__
 #include <copyfile.h>
+#include <sys/clonefile.h>
 // #include <get_compat.h>
 // #else /* !__APPLE__ */
 #define COMPAT_MODE(a,b) (1)
@@ -96,12 +98,57 @@ __thread int cp_fflag, cp_iflag, cp_nflag, cp_pflag, cp_vflag;
 __thread int Xflag;
 #endif /* __APPLE__ */
 static int Rflag, rflag;
+static unsigned int njobs;
 __thread int cp_cflag = 0;
 volatile __thread sig_atomic_t info;
 
 enum op { FILE_TO_FILE, FILE_TO_DIR, DIR_TO_DNE };
 
+/*
+ * With -j, the traversal stays on the calling thread, and regular files
+ * are handed to the copier threads through a window of CP_WINDOW files
+ * per thread.  The attributes of a directory are set when the window
+ * reaches its post-order entry, once everything in it has been copied.
+ */
+#define	CP_WINDOW	8
+
+struct cp_job {
+	char		*from;
+	char		*to;
+	struct stat	 sb;
+	int		 dne;
+	int		 dir;		/* set the attributes of directory "to" */
+	int		 rval;
+	int		 done;
+};
+
+struct cp_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* job queued, or end of traversal */
+	pthread_cond_t	 done;		/* job completed */
+	struct cp_job	*jobs;
+	size_t		 size;
+	size_t		 head;		/* next job to retire */
+	size_t		 next;		/* next job to start */
+	size_t		 tail;		/* next free slot */
+	int		 finished;
+	int		 rval;
+	mode_t		 mask;
+	unsigned int	 nthreads;
+	unsigned int	 nstarted;	/* workers that took their buffer */
+	pthread_t	*threads;
+	char		**bufs;		/* copy buffer of each worker */
+	/* The calling thread's thread-local state, for the workers */
+	FILE		*out, *errs;
+	int		 fflag, nflag, pflag, vflag, Xflag, cflag;
+};
+
 static int copy(char *[], enum op, int);
+static int setdir(const char *, const char *, struct stat *, mode_t);
+static struct cp_pool *cp_pool_create(mode_t);
+static void cp_pool_add(struct cp_pool *, const char *, struct stat *,
+    const char *, int, int);
+static int cp_pool_finish(struct cp_pool *);
 static void siginfo(int __unused);
 
 int
@@ -110,7 +157,8 @@ cp_main(int argc, char *argv[])
 	struct stat to_stat, tmp_stat;
 	enum op type;
 	int Hflag, Lflag, Pflag, ch, fts_options, r, have_trailing_slash;
-	char *target;
+	unsigned long l;
+	char *ep, *target;
 
     Hflag = Lflag = Pflag = 0;
     cp_fflag = cp_iflag = cp_nflag = cp_pflag = cp_vflag = 0;
@@ -118,9 +166,10 @@ cp_main(int argc, char *argv[])
     Xflag = 0;
 #endif /* __APPLE__ */
     Rflag = rflag = cp_cflag = 0;
+    njobs = 1;
     optind = 1; opterr = 1; optreset = 1;
     
-	while ((ch = getopt(argc, argv, "cHLPRXafinprv")) != -1)
+	while ((ch = getopt(argc, argv, "cHLPRXafij:nprv")) != -1)
 		switch (ch) {
 		case 'c':
 			cp_cflag = 1;
@@ -158,6 +207,13 @@ cp_main(int argc, char *argv[])
 			else
 				cp_fflag = cp_nflag = 0;
 			break;
+		case 'j':
+			errno = 0;
+			l = strtoul(optarg, &ep, 10);
+			if (errno != 0 || *ep != '\0' || l == 0 || l > UINT_MAX)
+				errx(1, "%s: invalid number of jobs", optarg);
+			njobs = (unsigned int)l;
+			break;
 		case 'n':
 			cp_nflag = 1;
 			cp_fflag = cp_iflag = 0;
@@ -298,16 +354,56 @@ cp_main(int argc, char *argv[])
 	return (copy(argv, type, fts_options));
 }
 
+/*
+ * Copy "from" to "target", which must not exist, as "cp -PRp" would:
+ * the copy half of a move across file systems for mv(1).  Regular files
+ * are copied with "jobs" threads, as with -j.
+ */
+int
+cp_move_copy(char *from, char *target, unsigned int jobs)
+{
+	struct stat sb;
+	char *argv[2];
+
+	cp_fflag = cp_iflag = cp_nflag = cp_vflag = cp_cflag = 0;
+#ifdef __APPLE__
+	Xflag = 0;
+#endif /* __APPLE__ */
+	cp_pflag = 1;
+	Rflag = 1;
+	rflag = 0;
+	njobs = jobs;
+
+	if (lstat(from, &sb)) {
+		warn("%s", from);
+		return (1);
+	}
+	if (strlcpy(to.p_path, target, sizeof(to.p_path)) >=
+	    sizeof(to.p_path)) {
+		warnx("%s: name too long", target);
+		return (1);
+	}
+	to.p_end = to.p_path + strlen(to.p_path);
+	STRIP_TRAILING_SLASH(to);
+	to.target_end = to.p_end;
+
+	argv[0] = from;
+	argv[1] = NULL;
+	return (copy(argv, S_ISDIR(sb.st_mode) ? DIR_TO_DNE : FILE_TO_FILE,
+	    FTS_NOCHDIR | FTS_PHYSICAL));
+}
+
 static int
 copy(char *argv[], enum op type, int fts_options)
 {
 	struct stat to_stat;
+	struct cp_pool *pool;
 	FTS *ftsp;
 	FTSENT *curr;
-	int base = 0, dne, badcp, rval;
+	int base = 0, clonetree, dne, badcp, queued, rval, serrno;
 	size_t nlen;
 	char *p, *target_mid;
-	mode_t mask, mode;
+	mode_t mask;
 
 	/*
 	 * Keep an inverted copy of the umask, for use in correcting
@@ -316,10 +412,26 @@ copy(char *argv[], enum op type, int fts_options)
 	mask = ~umask(0777);
 	umask(~mask);
 
+	/*
+	 * With -p, a new tree can be cloned with one clonefile() of its
+	 * root when -c or -j asks for speed: the clone shares the data and
+	 * keeps the modes, times, extended attributes and ACLs.  Symbolic
+	 * links are cloned as links, so not with -L.
+	 */
+	clonetree = 0;
+#ifdef __APPLE__
+	clonetree = cp_pflag && !Xflag && (cp_cflag || njobs > 1) &&
+	    !(fts_options & FTS_LOGICAL);
+#endif /* __APPLE__ */
+	pool = NULL;
+	if (njobs > 1 && !cp_iflag && type != FILE_TO_FILE)
+		pool = cp_pool_create(mask);
+
     if ((ftsp = fts_open(argv, fts_options, NULL)) == NULL) {
 		err(1, "fts_open");
     }
-	for (badcp = rval = 0; (curr = fts_read(ftsp)) != NULL; badcp = 0) {
+	for (badcp = queued = rval = 0; (curr = fts_read(ftsp)) != NULL;
+	    badcp = queued = 0) {
 		switch (curr->fts_info) {
 		case FTS_NS:
 		case FTS_DNR:
@@ -428,36 +540,12 @@ copy(char *argv[], enum op type, int fts_options)
 			 */
 			if (!curr->fts_number)
 				continue;
-			/*
-			 * If -p is in effect, set all the attributes.
-			 * Otherwise, set the correct permissions, limited
-			 * by the umask.  Optimise by avoiding a chmod()
-			 * if possible (which is usually the case if we
-			 * made the directory).  Note that mkdir() does not
-			 * honour setuid, setgid and sticky bits, but we
-			 * normally want to preserve them on directories.
-			 */
-			if (cp_pflag) {
-				if (setfile(curr->fts_statp, -1))
-					rval = 1;
-#ifdef __APPLE__
-				/* setfile will fail if writeattr is denied */
-				if (copyfile(curr->fts_path, to.p_path, NULL, COPYFILE_ACL)<0)
-					warn("%s: unable to copy ACL to %s", curr->fts_path, to.p_path);
-#else  /* !__APPLE__ */
-				if (preserve_dir_acls(curr->fts_statp,
-				    curr->fts_accpath, to.p_path) != 0)
-					rval = 1;
-#endif /* __APPLE__ */
-			} else {
-				mode = curr->fts_statp->st_mode;
-				if ((mode & (S_ISUID | S_ISGID | S_ISTXT)) ||
-				    ((mode | S_IRWXU) & mask) != (mode & mask))
-					if (chmod(to.p_path, mode & mask) != 0){
-						warn("chmod: %s", to.p_path);
-						rval = 1;
-					}
-			}
+			if (pool != NULL)
+				cp_pool_add(pool, curr->fts_path, curr->fts_statp,
+				    to.p_path, 0, 1);
+			else if (setdir(curr->fts_path, to.p_path,
+			    curr->fts_statp, mask))
+				rval = 1;
 			continue;
 		}
 
@@ -491,7 +579,8 @@ copy(char *argv[], enum op type, int fts_options)
 			if ((fts_options & FTS_LOGICAL) ||
 			    ((fts_options & FTS_COMFOLLOW) &&
 			    curr->fts_level == 0)) {
-				if (copy_file(curr, dne))
+				if (copy_file(curr->fts_path, curr->fts_statp,
+				    to.p_path, dne))
 					badcp = rval = 1;
 			} else {	
 				if (copy_link(curr, !dne))
@@ -514,6 +603,14 @@ copy(char *argv[], enum op type, int fts_options)
 			 * 555) and not causing a permissions race.  If the
 			 * umask blocks owner writes, we fail..
 			 */
+#ifdef __APPLE__
+			if (dne && clonetree &&
+			    curr->fts_level == FTS_ROOTLEVEL &&
+			    clonefile(curr->fts_path, to.p_path, 0) == 0) {
+				(void)fts_set(ftsp, curr, FTS_SKIP);
+				break;
+			}
+#endif /* __APPLE__ */
 			if (dne) {
 				if (mkdir(to.p_path,
 					  curr->fts_statp->st_mode | S_IRWXU) < 0) {
@@ -551,7 +648,8 @@ copy(char *argv[], enum op type, int fts_options)
 				if (copy_special(curr->fts_statp, !dne))
 					badcp = rval = 1;
 			} else {
-				if (copy_file(curr, dne))
+				if (copy_file(curr->fts_path, curr->fts_statp,
+				    to.p_path, dne))
 					badcp = rval = 1;
 			}
 			break;
@@ -560,18 +658,31 @@ copy(char *argv[], enum op type, int fts_options)
 				if (copy_fifo(curr->fts_statp, !dne))
 					badcp = rval = 1;
 			} else {
-				if (copy_file(curr, dne))
+				if (copy_file(curr->fts_path, curr->fts_statp,
+				    to.p_path, dne))
 					badcp = rval = 1;
 			}
 			break;
 		default:
-			if (copy_file(curr, dne))
+			if (pool != NULL && S_ISREG(curr->fts_statp->st_mode)) {
+				cp_pool_add(pool, curr->fts_path, curr->fts_statp,
+				    to.p_path, dne, 0);
+				queued = 1;
+			} else if (copy_file(curr->fts_path, curr->fts_statp,
+			    to.p_path, dne))
 				badcp = rval = 1;
 			break;
 		}
-		if (cp_vflag && !badcp)
+		if (cp_vflag && !badcp && !queued)
 			(void)fprintf(thread_stdout, "%s -> %s\n", curr->fts_path, to.p_path);
 	}
+	if (pool != NULL) {
+		/* Keep the errno of fts_read() for the check below */
+		serrno = errno;
+		if (cp_pool_finish(pool))
+			rval = 1;
+		errno = serrno;
+	}
     fts_close(ftsp);
     if (errno) {
         err(1, "fts_read");
@@ -579,6 +690,228 @@ copy(char *argv[], enum op type, int fts_options)
 	return (rval);
 }
 
+/*
+ * Set the attributes of a directory once its contents have been copied.
+ * If -p is in effect, set all the attributes.  Otherwise, set the
+ * correct permissions, limited by the umask.  Optimise by avoiding a
+ * chmod() if possible (which is usually the case if we made the
+ * directory).  Note that mkdir() does not honour setuid, setgid and
+ * sticky bits, but we normally want to preserve them on directories.
+ */
+static int
+setdir(const char *from, const char *topath, struct stat *fs, mode_t mask)
+{
+	mode_t mode;
+	int rval;
+
+	rval = 0;
+	if (cp_pflag) {
+		if (setfile(topath, fs, -1))
+			rval = 1;
+#ifdef __APPLE__
+		/* setfile will fail if writeattr is denied */
+		if (copyfile(from, topath, NULL, COPYFILE_ACL)<0)
+			warn("%s: unable to copy ACL to %s", from, topath);
+#else  /* !__APPLE__ */
+		if (preserve_dir_acls(fs, (char *)from, (char *)topath) != 0)
+			rval = 1;
+#endif /* __APPLE__ */
+	} else {
+		mode = fs->st_mode;
+		if ((mode & (S_ISUID | S_ISGID | S_ISTXT)) ||
+		    ((mode | S_IRWXU) & mask) != (mode & mask))
+			if (chmod(topath, mode & mask) != 0){
+				warn("chmod: %s", topath);
+				rval = 1;
+			}
+	}
+	return (rval);
+}
+
+static void *
+cp_worker(void *arg)
+{
+	struct cp_pool *pool = arg;
+	struct cp_job *job;
+
+	thread_stdout = pool->out;
+	thread_stderr = pool->errs;
+	cp_fflag = pool->fflag;
+	cp_nflag = pool->nflag;
+	cp_pflag = pool->pflag;
+	cp_vflag = pool->vflag;
+#ifdef __APPLE__
+	Xflag = pool->Xflag;
+#endif /* __APPLE__ */
+	cp_cflag = pool->cflag;
+
+	pthread_mutex_lock(&pool->mtx);
+	copy_buf = pool->bufs[pool->nstarted++];
+	for (;;) {
+		while (pool->next == pool->tail && !pool->finished)
+			pthread_cond_wait(&pool->work, &pool->mtx);
+		if (pool->next == pool->tail)
+			break;
+		job = &pool->jobs[pool->next++ % pool->size];
+		pthread_mutex_unlock(&pool->mtx);
+
+		/* Directories are left to cp_pool_retire() */
+		if (!job->dir) {
+			job->rval = copy_file(job->from, &job->sb, job->to,
+			    job->dne);
+			if (cp_vflag && !job->rval)
+				(void)fprintf(thread_stdout, "%s -> %s\n",
+				    job->from, job->to);
+		}
+
+		pthread_mutex_lock(&pool->mtx);
+		job->done = 1;
+		pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (NULL);
+}
+
+/*
+ * Returns NULL if the copy should stay on this thread.
+ */
+static struct cp_pool *
+cp_pool_create(mode_t mask)
+{
+	struct cp_pool *pool;
+	unsigned int n;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL ||
+	    (pool->threads = calloc(njobs, sizeof(pthread_t))) == NULL ||
+	    (pool->bufs = calloc(njobs, sizeof(char *))) == NULL ||
+	    (pool->jobs = calloc((size_t)njobs * CP_WINDOW,
+	    sizeof(struct cp_job))) == NULL)
+		err(1, "calloc");
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->size = (size_t)njobs * CP_WINDOW;
+	pool->mask = mask;
+	pool->out = thread_stdout;
+	pool->errs = thread_stderr;
+	pool->fflag = cp_fflag;
+	pool->nflag = cp_nflag;
+	pool->pflag = cp_pflag;
+	pool->vflag = cp_vflag;
+#ifdef __APPLE__
+	pool->Xflag = Xflag;
+#endif /* __APPLE__ */
+	pool->cflag = cp_cflag;
+
+	/* Each worker takes the next buffer when it starts */
+	for (n = 0; n < njobs; n++) {
+		if ((pool->bufs[n] = malloc(MAXBSIZE)) == NULL ||
+		    pthread_create(&pool->threads[n], NULL, cp_worker,
+		    pool) != 0) {
+			free(pool->bufs[n]);
+			break;
+		}
+	}
+	if (n == 0) {
+		pthread_cond_destroy(&pool->done);
+		pthread_cond_destroy(&pool->work);
+		pthread_mutex_destroy(&pool->mtx);
+		free(pool->bufs);
+		free(pool->threads);
+		free(pool->jobs);
+		free(pool);
+		return (NULL);
+	}
+	pool->nthreads = n;
+	return (pool);
+}
+
+/*
+ * Retires the completed jobs at the head of the window, waiting until
+ * no more than "keep" jobs are left in flight.
+ */
+static void
+cp_pool_retire(struct cp_pool *pool, size_t keep)
+{
+	struct cp_job *job;
+
+	pthread_mutex_lock(&pool->mtx);
+	while (pool->head != pool->tail) {
+		job = &pool->jobs[pool->head % pool->size];
+		if (!job->done) {
+			if (pool->tail - pool->head <= keep)
+				break;
+			pthread_cond_wait(&pool->done, &pool->mtx);
+			continue;
+		}
+		pool->head++;
+		pthread_mutex_unlock(&pool->mtx);
+
+		if (job->dir)
+			job->rval = setdir(job->from, job->to, &job->sb,
+			    pool->mask);
+		if (job->rval)
+			pool->rval = 1;
+		free(job->from);
+		free(job->to);
+
+		pthread_mutex_lock(&pool->mtx);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+static void
+cp_pool_add(struct cp_pool *pool, const char *from, struct stat *sb,
+    const char *to, int dne, int dir)
+{
+	struct cp_job *job;
+
+	/* Keep one slot free; the workers never touch it */
+	cp_pool_retire(pool, pool->size - 1);
+
+	job = &pool->jobs[pool->tail % pool->size];
+	memset(job, 0, sizeof(*job));
+	if ((job->from = strdup(from)) == NULL ||
+	    (job->to = strdup(to)) == NULL)
+		err(1, "strdup");
+	job->sb = *sb;
+	job->dne = dne;
+	job->dir = dir;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->tail++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+static int
+cp_pool_finish(struct cp_pool *pool)
+{
+	unsigned int i;
+	int rval;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->finished = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+
+	cp_pool_retire(pool, 0);
+	for (i = 0; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+		free(pool->bufs[i]);
+	}
+
+	rval = pool->rval;
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->mtx);
+	free(pool->bufs);
+	free(pool->threads);
+	free(pool->jobs);
+	free(pool);
+	return (rval);
+}
+
 static void
 siginfo(int sig __unused)
 {
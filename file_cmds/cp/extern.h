@@ -43,13 +43,15 @@ extern __thread int Xflag;
 #endif /* __APPLE__ */
 extern __thread int cp_cflag;
 extern volatile __thread sig_atomic_t info;
+extern __thread char *copy_buf;
 
 __BEGIN_DECLS
 int	copy_fifo(struct stat *, int);
-int	copy_file(const FTSENT *, int);
+int	copy_file(const char *, struct stat *, const char *, int);
 int	copy_link(const FTSENT *, int);
 int	copy_special(struct stat *, int);
-int	setfile(struct stat *, int);
+int	cp_move_copy(char *, char *, unsigned int);
+int	setfile(const char *, struct stat *, int);
 int	preserve_dir_acls(struct stat *, char *, char *);
 int	preserve_fd_acls(int, int);
 void	cp_usage(void);
@@ -48,6 +48,7 @@ __FBSDID("$FreeBSD: src/bin/cp/utils.c,v 1.46 2005/09/05 04:36:08 csjp Exp $");
 #include <fcntl.h>
 #include <fts.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sysexits.h>
@@ -69,12 +70,40 @@ __FBSDID("$FreeBSD: src/bin/cp/utils.c,v 1.46 2005/09/05 04:36:08 csjp Exp $");
 #include "ios_error.h"
 #define	cp_pct(x,y)	(int)(100.0 * (double)(x) / (double)(y))
 
+/*
+ * Regular files of at least CP_STREAM_MIN bytes are copied by
+ * copy_stream(): a reader thread fills one buffer while the calling
+ * thread writes the other.  Chunks are CP_STREAM_CHUNK bytes, twice
+ * that for files of CP_STREAM_BIG bytes or more.
+ */
+#define	CP_STREAM_MIN	(8 * 1024 * 1024)
+#define	CP_STREAM_CHUNK	(4 * 1024 * 1024)
+#define	CP_STREAM_BIG	(128 * 1024 * 1024)
+
+struct stream {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	int		 fd;
+	char		*buf[2];
+	size_t		 size;		/* of each buffer */
+	ssize_t		 len[2];	/* bytes read into buf, -1 if empty */
+	int		 error;		/* errno of the reader */
+	int		 stop;		/* the writer is done */
+};
+
+static int copy_stream(int, int, const char *, const char *, struct stat *);
+
+/*
+ * Copier threads of cp -j set this to a buffer of their own.
+ */
+__thread char *copy_buf;
+
 int
-copy_file(const FTSENT *entp, int dne)
+copy_file(const char *from, struct stat *fs, const char *topath, int dne)
 {
-	static char buf[MAXBSIZE];
-	struct stat *fs;
-	int ch, checkch, from_fd, rval, to_fd;
+	static char sbuf[MAXBSIZE];
+	char *buf;
+	int ch, checkch, copied, xcopied, from_fd, r, rval, to_fd;
 	ssize_t rcount;
 	ssize_t wcount;
 	size_t wresid;
@@ -86,12 +115,11 @@ copy_file(const FTSENT *entp, int dne)
 	mode_t mode = 0;
 	struct stat to_stat;
 
-	if ((from_fd = open(entp->fts_path, O_RDONLY, 0)) == -1) {
-        warn("%s", entp->fts_path);
+	if ((from_fd = open(from, O_RDONLY, 0)) == -1) {
+        warn("%s", from);
 		return (1);
 	}
-
-	fs = entp->fts_statp;
+	buf = copy_buf != NULL ? copy_buf : sbuf;
 
 	/*
 	 * If the file exists and we're interactive, verify with the user.
@@ -105,12 +133,12 @@ copy_file(const FTSENT *entp, int dne)
 #define YESNO "(y/n [n]) "
 		if (cp_nflag) {
 			if (cp_vflag)
-				fprintf(thread_stdout, "%s not overwritten\n", to.p_path);
+				fprintf(thread_stdout, "%s not overwritten\n", topath);
 			(void)close(from_fd);
 			return (1);
 		} else if (cp_iflag) {
 			(void)fprintf(thread_stderr, "overwrite %s? %s", 
-					to.p_path, YESNO);
+					topath, YESNO);
             fflush(thread_stderr);
 			checkch = ch = getchar();
 			while (ch != '\n' && ch != EOF)
@@ -124,22 +152,22 @@ copy_file(const FTSENT *entp, int dne)
 		}
 		
 		if (cp_cflag) {
-			(void)unlink(to.p_path);
-			int error = clonefile(entp->fts_path, to.p_path, 0);
+			(void)unlink(topath);
+			int error = clonefile(from, topath, 0);
 			if (error)
-                warn("%s: clonefile failed", to.p_path);
+                warn("%s: clonefile failed", topath);
 			(void)close(from_fd);
 			return error == 0 ? 0 : 1;
 		}
 
 		if (COMPAT_MODE("bin/cp", "unix2003")) {
 		    /* first try to overwrite existing destination file name */
-		    to_fd = open(to.p_path, O_WRONLY | O_TRUNC, 0);
+		    to_fd = open(topath, O_WRONLY | O_TRUNC, 0);
 		    if (to_fd == -1) {
 			if (cp_fflag) {
 			    /* Only if it fails remove file and create a new one */
-			    (void)unlink(to.p_path);
-			    to_fd = open(to.p_path, O_WRONLY | O_TRUNC | O_CREAT,
+			    (void)unlink(topath);
+			    to_fd = open(topath, O_WRONLY | O_TRUNC | O_CREAT,
 					 fs->st_mode & ~(S_ISUID | S_ISGID));
 			}
 		    }
@@ -147,29 +175,29 @@ copy_file(const FTSENT *entp, int dne)
 			if (cp_fflag) {
 			    /* remove existing destination file name, 
 			     * create a new file  */
-			    (void)unlink(to.p_path);
-			    to_fd = open(to.p_path, O_WRONLY | O_TRUNC | O_CREAT,
+			    (void)unlink(topath);
+			    to_fd = open(topath, O_WRONLY | O_TRUNC | O_CREAT,
 					 fs->st_mode & ~(S_ISUID | S_ISGID));
 			} else 
 			    /* overwrite existing destination file name */
-			    to_fd = open(to.p_path, O_WRONLY | O_TRUNC, 0);
+			    to_fd = open(topath, O_WRONLY | O_TRUNC, 0);
 		}
 	} else {
 
 		if (cp_cflag) {
-			int error = clonefile(entp->fts_path, to.p_path, 0);
+			int error = clonefile(from, topath, 0);
 			if (error)
-                warn("%s: clonefile failed", to.p_path);
+                warn("%s: clonefile failed", topath);
 			(void)close(from_fd);
 			return error == 0 ? 0 : 1;
 		}
 
-		to_fd = open(to.p_path, O_WRONLY | O_TRUNC | O_CREAT,
+		to_fd = open(topath, O_WRONLY | O_TRUNC | O_CREAT,
 		    fs->st_mode & ~(S_ISUID | S_ISGID));
 	}
 
 	if (to_fd == -1) {
-        warn("%s", to.p_path);
+        warn("%s", topath);
 		(void)close(from_fd);
 		return (1);
 	}
@@ -177,7 +205,7 @@ copy_file(const FTSENT *entp, int dne)
 	rval = 0;
 
 #ifdef __APPLE__
-       if (S_ISREG(fs->st_mode)) {
+       if (S_ISREG(fs->st_mode) && fs->st_size < CP_STREAM_MIN) {
                struct statfs sfs;
 
                /*
@@ -203,23 +231,49 @@ copy_file(const FTSENT *entp, int dne)
 	       if ((mode & (S_IRWXG|S_IRWXO))
 		   && fchmod(to_fd, mode & ~(S_IRWXG|S_IRWXO))) {
 		       if (errno != EPERM) /* we have write access but do not own the file */
-                   warn("%s: fchmod failed", to.p_path);
+                   warn("%s: fchmod failed", topath);
 		       mode = 0;
 	       }
        } else {
-           warn("%s", to.p_path);
+           warn("%s", topath);
        }
+	copied = xcopied = 0;
+	if (S_ISREG(fs->st_mode) && fs->st_size >= CP_STREAM_MIN &&
+	    (r = copy_stream(from_fd, to_fd, from, topath, fs)) != -1) {
+		if (r)
+			rval = 1;
+		copied = 1;
+	}
+#ifdef __APPLE__
+	/*
+	 * Copy the data and the extended attributes with a single
+	 * fcopyfile().  If that fails, start over with read and write, so
+	 * that an attribute that cannot be copied is a warning only.
+	 */
+	if (!copied && S_ISREG(fs->st_mode)) {
+		if (fcopyfile(from_fd, to_fd, NULL,
+		    COPYFILE_DATA | (Xflag ? 0 : COPYFILE_XATTR)) == 0)
+			copied = xcopied = 1;
+		else if (lseek(from_fd, 0, SEEK_SET) == -1 ||
+		    lseek(to_fd, 0, SEEK_SET) == -1 || ftruncate(to_fd, 0)) {
+			warn("%s", topath);
+			copied = rval = 1;
+		}
+	}
+#endif /* __APPLE__ */
 	/*
 	 * Mmap and write if less than 8M (the limit is so we don't totally
 	 * trash memory on big files.  This is really a minor hack, but it
 	 * wins some CPU back.
 	 */
+	if (copied)
+		;
 #ifdef VM_AND_BUFFER_CACHE_SYNCHRONIZED
-	if (S_ISREG(fs->st_mode) && fs->st_size > 0 &&
+	else if (S_ISREG(fs->st_mode) && fs->st_size > 0 &&
 	    fs->st_size <= 8 * 1048576) {
 		if ((p = mmap(NULL, (size_t)fs->st_size, PROT_READ,
 		    MAP_SHARED, from_fd, (off_t)0)) == MAP_FAILED) {
-            warn("%s", entp->fts_path);
+            warn("%s", from);
 			rval = 1;
 		} else {
 			wtotal = 0;
@@ -231,7 +285,7 @@ copy_file(const FTSENT *entp, int dne)
 					info = 0;
 					(void)fprintf(thread_stderr,
 						"%s -> %s %3d%%\n",
-						entp->fts_path, to.p_path,
+						from, topath,
 						cp_pct(wtotal, fs->st_size));
 						
 				}
@@ -239,18 +293,18 @@ copy_file(const FTSENT *entp, int dne)
 					break;
 			}
 			if (wcount != (ssize_t)wresid) {
-                warn("%s", to.p_path);
+                warn("%s", topath);
 				rval = 1;
 			}
 			/* Some systems don't unmap on close(2). */
 			if (munmap(p, fs->st_size) < 0) {
-                warn("%s", entp->fts_path);
+                warn("%s", from);
 				rval = 1;
 			}
 		}
-	} else
+	}
 #endif
-	{
+	else {
 		wtotal = 0;
 		while ((rcount = read(from_fd, buf, MAXBSIZE)) > 0) {
 			for (bufp = buf, wresid = rcount; ;
@@ -261,7 +315,7 @@ copy_file(const FTSENT *entp, int dne)
 					info = 0;
 					(void)fprintf(thread_stderr,
 						"%s -> %s %3d%%\n",
-						entp->fts_path, to.p_path,
+						from, topath,
 						cp_pct(wtotal, fs->st_size));
 						
 				}
@@ -269,13 +323,13 @@ copy_file(const FTSENT *entp, int dne)
 					break;
 			}
 			if (wcount != (ssize_t)wresid) {
-                warn("%s", to.p_path);
+                warn("%s", topath);
 				rval = 1;
 				break;
 			}
 		}
 		if (rcount < 0) {
-            warn("%s", entp->fts_path);
+            warn("%s", from);
 			rval = 1;
 		}
 	}
@@ -288,34 +342,181 @@ copy_file(const FTSENT *entp, int dne)
 	 */
 	if (mode != 0)
 		if (fchmod(to_fd, mode))
-            warn("%s: fchmod failed", to.p_path);
+            warn("%s: fchmod failed", topath);
 #ifdef __APPLE__
 	/* do these before setfile in case copyfile changes mtime */
-	if (!Xflag && S_ISREG(fs->st_mode)) { /* skip devices, etc */
+	if (!Xflag && !xcopied && S_ISREG(fs->st_mode)) { /* skip devices, etc */
 		if (fcopyfile(from_fd, to_fd, NULL, COPYFILE_XATTR) < 0)
-            warn("%s: could not copy extended attributes to %s", entp->fts_path, to.p_path);
+            warn("%s: could not copy extended attributes to %s", from, topath);
 	}
-	if (cp_pflag && setfile(fs, to_fd))
+	if (cp_pflag && setfile(topath, fs, to_fd))
 		rval = 1;
 	if (cp_pflag) {
 		/* If this ACL denies writeattr then setfile will fail... */
 		if (fcopyfile(from_fd, to_fd, NULL, COPYFILE_ACL) < 0)
-            warn("%s: could not copy ACL to %s", entp->fts_path, to.p_path);
+            warn("%s: could not copy ACL to %s", from, topath);
 	}
 #else  /* !__APPLE__ */
-	if (cp_pflag && setfile(fs, to_fd))
+	if (cp_pflag && setfile(topath, fs, to_fd))
 		rval = 1;
 	if (cp_pflag && preserve_fd_acls(from_fd, to_fd) != 0)
 		rval = 1;
 #endif /* __APPLE__ */
 	(void)close(from_fd);
 	if (close(to_fd)) {
-        warn("%s", to.p_path);
+        warn("%s", topath);
 		rval = 1;
 	}
 	return (rval);
 }
 
+static void *
+stream_reader(void *arg)
+{
+	struct stream *st = arg;
+	ssize_t n;
+	size_t off;
+	int i;
+
+	for (i = 0; ; i ^= 1) {
+		pthread_mutex_lock(&st->mtx);
+		while (st->len[i] != -1 && !st->stop)
+			pthread_cond_wait(&st->cv, &st->mtx);
+		if (st->stop) {
+			pthread_mutex_unlock(&st->mtx);
+			break;
+		}
+		pthread_mutex_unlock(&st->mtx);
+
+		/* A short buffer marks the end of the file, or an error */
+		for (off = 0, n = 0; off < st->size; off += n)
+			if ((n = read(st->fd, st->buf[i] + off,
+			    st->size - off)) <= 0)
+				break;
+
+		pthread_mutex_lock(&st->mtx);
+		if (n < 0)
+			st->error = errno;
+		st->len[i] = off;
+		pthread_cond_signal(&st->cv);
+		pthread_mutex_unlock(&st->mtx);
+		if (n <= 0)
+			break;
+	}
+	return (NULL);
+}
+
+/*
+ * Copy a large regular file through two buffers, with the reading done
+ * on a thread of its own.  The data bypasses the buffer cache, which
+ * would otherwise fill up with pages of a file that is read once.
+ * Progress is reported on SIGINFO and to the host's ios_copyProgress.
+ * Returns -1, before anything is copied, if the buffers or the thread
+ * cannot be had.
+ */
+static int
+copy_stream(int from_fd, int to_fd, const char *from, const char *topath,
+    struct stat *fs)
+{
+	struct stream st;
+	pthread_t reader;
+	ssize_t len, wcount;
+	off_t wtotal;
+	char *bufp;
+	int error, i, rval;
+#ifdef __APPLE__
+	fstore_t fst;
+#endif
+
+	memset(&st, 0, sizeof(st));
+	st.fd = from_fd;
+	st.size = fs->st_size >= CP_STREAM_BIG ?
+	    2 * CP_STREAM_CHUNK : CP_STREAM_CHUNK;
+	st.len[0] = st.len[1] = -1;
+	if ((st.buf[0] = malloc(st.size)) == NULL ||
+	    (st.buf[1] = malloc(st.size)) == NULL) {
+		free(st.buf[0]);
+		return (-1);
+	}
+	pthread_mutex_init(&st.mtx, NULL);
+	pthread_cond_init(&st.cv, NULL);
+
+#ifdef __APPLE__
+	(void)fcntl(from_fd, F_RDAHEAD, 1);
+	(void)fcntl(from_fd, F_NOCACHE, 1);
+	(void)fcntl(to_fd, F_NOCACHE, 1);
+	/* Contiguous if possible; this is only a hint. */
+	fst.fst_flags = F_ALLOCATECONTIG;
+	fst.fst_posmode = F_PEOFPOSMODE;
+	fst.fst_offset = 0;
+	fst.fst_length = fs->st_size;
+	if (fcntl(to_fd, F_PREALLOCATE, &fst) == -1) {
+		fst.fst_flags = F_ALLOCATEALL;
+		(void)fcntl(to_fd, F_PREALLOCATE, &fst);
+	}
+#endif /* __APPLE__ */
+
+	if (pthread_create(&reader, NULL, stream_reader, &st) != 0) {
+		rval = -1;
+		goto out;
+	}
+	rval = 0;
+	for (i = 0, wtotal = 0; ; i ^= 1) {
+		pthread_mutex_lock(&st.mtx);
+		while (st.len[i] == -1)
+			pthread_cond_wait(&st.cv, &st.mtx);
+		len = st.len[i];
+		error = st.error;
+		pthread_mutex_unlock(&st.mtx);
+
+		for (bufp = st.buf[i]; bufp < st.buf[i] + len; bufp += wcount)
+			if ((wcount = write(to_fd, bufp,
+			    st.buf[i] + len - bufp)) <= 0)
+				break;
+		if (bufp < st.buf[i] + len) {
+			warn("%s", topath);
+			rval = 1;
+			break;
+		}
+		wtotal += len;
+		if (info) {
+			info = 0;
+			(void)fprintf(thread_stderr, "%s -> %s %3d%%\n",
+			    from, topath, cp_pct(wtotal, fs->st_size));
+		}
+		if (ios_copyProgress != NULL && len > 0)
+			ios_copyProgress(from, topath, wtotal, fs->st_size);
+		if ((size_t)len < st.size) {
+			if (error) {
+				errno = error;
+				warn("%s", from);
+				rval = 1;
+			}
+			break;
+		}
+		if (ios_isInterrupted()) {
+			rval = 1;
+			break;
+		}
+
+		pthread_mutex_lock(&st.mtx);
+		st.len[i] = -1;
+		pthread_cond_signal(&st.cv);
+		pthread_mutex_unlock(&st.mtx);
+	}
+	pthread_mutex_lock(&st.mtx);
+	st.stop = 1;
+	pthread_cond_signal(&st.cv);
+	pthread_mutex_unlock(&st.mtx);
+	pthread_join(reader, NULL);
+out:
+	pthread_cond_destroy(&st.cv);
+	pthread_mutex_destroy(&st.mtx);
+	free(st.buf[0]);
+	free(st.buf[1]);
+	return (rval);
+}
+
 int
 copy_link(const FTSENT *p, int exists)
 {
@@ -341,7 +542,7 @@ copy_link(const FTSENT *p, int exists)
             warn("%s: could not copy extended attributes to %s",
                  p->fts_path, to.p_path, strerror(errno));
 #endif
-	return (cp_pflag ? setfile(p->fts_statp, -1) : 0);
+	return (cp_pflag ? setfile(to.p_path, p->fts_statp, -1) : 0);
 }
 
 int
@@ -355,7 +556,7 @@ copy_fifo(struct stat *from_stat, int exists)
         warn("mkfifo: %s", to.p_path);
 		return (1);
 	}
-	return (cp_pflag ? setfile(from_stat, -1) : 0);
+	return (cp_pflag ? setfile(to.p_path, from_stat, -1) : 0);
 }
 
 int
@@ -369,13 +570,13 @@ copy_special(struct stat *from_stat, int exists)
         warn("mknod: %s", to.p_path);
 		return (1);
 	}
-	return (cp_pflag ? setfile(from_stat, -1) : 0);
+	return (cp_pflag ? setfile(to.p_path, from_stat, -1) : 0);
 }
 
 int
-setfile(struct stat *fs, int fd)
+setfile(const char *topath, struct stat *fs, int fd)
 {
-	static struct timeval tv[2];
+	struct timeval tv[2];
 	struct stat ts;
 	int rval, gotstat, islink, fdval;
 
@@ -386,12 +587,12 @@ setfile(struct stat *fs, int fd)
 
 	TIMESPEC_TO_TIMEVAL(&tv[0], &fs->st_atimespec);
 	TIMESPEC_TO_TIMEVAL(&tv[1], &fs->st_mtimespec);
-	if (fdval ? futimes(fd, tv) : (islink ? lutimes(to.p_path, tv) : utimes(to.p_path, tv))) {
-        warn("%sutimes: %s", fdval ? "f" : (islink ? "l" : ""), to.p_path);
+	if (fdval ? futimes(fd, tv) : (islink ? lutimes(topath, tv) : utimes(topath, tv))) {
+        warn("%sutimes: %s", fdval ? "f" : (islink ? "l" : ""), topath);
 		rval = 1;
 	}
-	if (fdval ? fstat(fd, &ts) : (islink ? lstat(to.p_path, &ts) :
-				      stat(to.p_path, &ts))) {
+	if (fdval ? fstat(fd, &ts) : (islink ? lstat(topath, &ts) :
+				      stat(topath, &ts))) {
 		gotstat = 0;
 	} else {
 		gotstat = 1;
@@ -405,10 +606,10 @@ setfile(struct stat *fs, int fd)
 	 */
 	if (!gotstat || fs->st_uid != ts.st_uid || fs->st_gid != ts.st_gid) {
 		if (fdval ? fchown(fd, fs->st_uid, fs->st_gid) : (islink ?
-								  lchown(to.p_path, fs->st_uid, fs->st_gid) :
-								  chown(to.p_path, fs->st_uid, fs->st_gid))) {
+								  lchown(topath, fs->st_uid, fs->st_gid) :
+								  chown(topath, fs->st_uid, fs->st_gid))) {
 			    if (errno != EPERM) {
-                    warn("%schown: %s", fdval ? "f" : (islink ? "l" : ""), to.p_path);
+                    warn("%schown: %s", fdval ? "f" : (islink ? "l" : ""), topath);
 				    rval = 1;
 			    }
 			    fs->st_mode &= ~(S_ISUID | S_ISGID);
@@ -417,19 +618,19 @@ setfile(struct stat *fs, int fd)
 
 	if (!gotstat || fs->st_mode != ts.st_mode) {
 		if (fdval ? fchmod(fd, fs->st_mode) : (islink ?
-						       lchmod(to.p_path, fs->st_mode) :
-						       chmod(to.p_path, fs->st_mode))) {
-            warn("%schmod: %s", fdval ? "f" : (islink ? "l" : ""), to.p_path);
+						       lchmod(topath, fs->st_mode) :
+						       chmod(topath, fs->st_mode))) {
+            warn("%schmod: %s", fdval ? "f" : (islink ? "l" : ""), topath);
 			rval = 1;
 		}
 	}
 
 	if (!gotstat || fs->st_flags != ts.st_flags) {
 		if (fdval ? fchflags(fd, fs->st_flags) : (islink ?
-							  lchflags(to.p_path, fs->st_flags) :
-							  chflags(to.p_path, fs->st_flags))) {
+							  lchflags(topath, fs->st_flags) :
+							  chflags(topath, fs->st_flags))) {
 			if (errno != EPERM) {
-                warn("%schflags: %s", fdval ? "f" : (islink ? "l" : ""), to.p_path);
+                warn("%schflags: %s", fdval ? "f" : (islink ? "l" : ""), topath);
 				rval = 1;
 			}
 		}
@@ -521,13 +722,13 @@ cp_usage(void)
 
 	if (COMPAT_MODE("bin/cp", "unix2003")) {
 	(void)fprintf(thread_stderr, "%s\n%s\n",
-"usage: cp [-R [-H | -L | -P]] [-fi | -n] [-apvXc] source_file target_file",
-"       cp [-R [-H | -L | -P]] [-fi | -n] [-apvXc] source_file ... "
+"usage: cp [-R [-H | -L | -P]] [-fi | -n] [-apvXc] [-j jobs] source_file target_file",
+"       cp [-R [-H | -L | -P]] [-fi | -n] [-apvXc] [-j jobs] source_file ... "
 "target_directory");
 	} else {
 	(void)fprintf(thread_stderr, "%s\n%s\n",
-"usage: cp [-R [-H | -L | -P]] [-f | -i | -n] [-apvXc] source_file target_file",
-"       cp [-R [-H | -L | -P]] [-f | -i | -n] [-apvXc] source_file ... "
+"usage: cp [-R [-H | -L | -P]] [-f | -i | -n] [-apvXc] [-j jobs] source_file target_file",
+"       cp [-R [-H | -L | -P]] [-f | -i | -n] [-apvXc] [-j jobs] source_file ... "
 "target_directory");
 	}
 	exit(EX_USAGE);
@@ -64,8 +64,10 @@ static void	f_count(char *);
 static void	f_files(char *);
 static void	f_ibs(char *);
 static void	f_if(char *);
+static void	f_iflag(char *);
 static void	f_obs(char *);
 static void	f_of(char *);
+static void	f_oflag(char *);
 static void	f_seek(char *);
 static void	f_skip(char *);
 static quad_t	get_num(char *);
@@ -83,9 +85,11 @@ static const struct arg {
 	{ "files",	f_files,	C_FILES, C_FILES },
 	{ "ibs",	f_ibs,		C_IBS,	 C_IBS },
 	{ "if",		f_if,		C_IF,	 C_IF },
+	{ "iflag",	f_iflag,	0,	 0 },
 	{ "iseek",	f_skip,		C_SKIP,	 C_SKIP },
 	{ "obs",	f_obs,		C_OBS,	 C_OBS },
 	{ "of",		f_of,		C_OF,	 C_OF },
+	{ "oflag",	f_oflag,	0,	 0 },
 	{ "oseek",	f_seek,		C_SEEK,	 C_SEEK },
 	{ "seek",	f_seek,		C_SEEK,	 C_SEEK },
 	{ "skip",	f_skip,		C_SKIP,	 C_SKIP },
@@ -328,6 +332,43 @@ c_conv(const void *a, const void *b)
 	    ((const struct conv *)b)->name));
 }
 
+static const struct conv ilist[] = {
+	{ "async",	C_IASYNC,	0,		NULL },
+	{ "direct",	C_IDIRECT,	0,		NULL },
+};
+
+static const struct conv olist[] = {
+	{ "direct",	C_ODIRECT,	0,		NULL },
+};
+
+static void
+f_flags(char *arg, const struct conv *list, size_t n, const char *what)
+{
+	struct conv *cp, tmp;
+
+	while (arg != NULL) {
+		tmp.name = strsep(&arg, ",");
+		cp = bsearch(&tmp, list, n, sizeof(struct conv), c_conv);
+		if (cp == NULL)
+			errx(1, "unknown %s flag %s", what, tmp.name);
+		ddflags |= cp->set;
+	}
+}
+
+static void
+f_iflag(char *arg)
+{
+
+	f_flags(arg, ilist, sizeof(ilist) / sizeof(struct conv), "input");
+}
+
+static void
+f_oflag(char *arg)
+{
+
+	f_flags(arg, olist, sizeof(olist) / sizeof(struct conv), "output");
+}
+
 /*
  * Convert an expression of the following forms to a quad_t.
  * 	1) A positive decimal number.
@@ -67,6 +67,8 @@ __used static const char rcsid[] =
 #include <errno.h>
 #include <fcntl.h>
 #include <locale.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -78,6 +80,9 @@ __used static const char rcsid[] =
 static void dd_close(void);
 static void dd_in(void);
 static void getfdtype(IO *);
+static ssize_t ring_read(u_char *, int *);
+static void ring_start(void);
+static void ring_stop(void);
 static void setup(void);
 
 IO	in, out;		/* input/output state */
@@ -90,6 +95,28 @@ size_t	cbsz;			/* conversion block size */
 quad_t	files_cnt = 1;		/* # of files to copy */
 const	u_char *ctab;		/* conversion table */
 
+/*
+ * With iflag=async, a reader thread fills a ring of input blocks while
+ * the main thread converts and writes the ones before them.
+ */
+#define	RING_SIZE	8
+
+static struct {
+	pthread_mutex_t	mtx;
+	pthread_cond_t	cv;
+	pthread_t	thread;
+	struct {
+		u_char	*buf;
+		ssize_t	n;		/* read(2) result */
+		int	error;		/* its errno */
+		int	serror;		/* errno of the seek past an error */
+	} slot[RING_SIZE];
+	u_quad_t	head;		/* next block to convert */
+	u_quad_t	tail;		/* next block to read */
+	quad_t		left;		/* blocks left to read, -1 if no limit */
+	int		done;		/* reader has stopped */
+} ring;
+
 int
 main(int argc, char *argv[])
 {
@@ -152,6 +179,14 @@ setup(void)
 
 	getfdtype(&out);
 
+#ifdef F_NOCACHE
+	/* Keep the data out of the buffer cache. */
+	if (ddflags & C_IDIRECT && fcntl(in.fd, F_NOCACHE, 1) == -1)
+		warn("%s", in.name);
+	if (ddflags & C_ODIRECT && fcntl(out.fd, F_NOCACHE, 1) == -1)
+		warn("%s", out.name);
+#endif
+
 	/*
 	 * Allocate space for the input and output buffers.  If not doing
 	 * record oriented I/O, only need a single buffer.
@@ -165,6 +200,13 @@ setup(void)
 		err(1, "output buffer");
 	in.dbp = in.db;
 	out.dbp = out.db;
+	if (ddflags & C_IASYNC) {
+		for (cnt = 0; cnt < RING_SIZE; cnt++)
+			if ((ring.slot[cnt].buf = malloc(in.dbsz)) == NULL)
+				err(1, "input buffer");
+		pthread_mutex_init(&ring.mtx, NULL);
+		pthread_cond_init(&ring.cv, NULL);
+	}
 
 	/* Position the input/output streams. */
 	if (in.offset)
@@ -261,7 +303,10 @@ static void
 dd_in(void)
 {
 	ssize_t n;
+	int serror;
 
+	if (ddflags & C_IASYNC && cpy_cnt != -1)
+		ring_start();
 	for (;;) {
 		switch (cpy_cnt) {
 		case -1:			/* count=0 was specified */
@@ -270,7 +315,7 @@ dd_in(void)
 			break;
 		default:
 			if (st.in_full + st.in_part >= (u_quad_t)cpy_cnt)
-				return;
+				goto done;
 			break;
 		}
 
@@ -285,10 +330,13 @@ dd_in(void)
 				memset(in.dbp, 0, in.dbsz);
 		}
 
-		n = read(in.fd, in.dbp, in.dbsz);
+		if (ddflags & C_IASYNC)
+			n = ring_read(in.dbp, &serror);
+		else
+			n = read(in.fd, in.dbp, in.dbsz);
 		if (n == 0) {
 			in.dbrcnt = 0;
-			return;
+			goto done;
 		}
 
 		/* Read error. */
@@ -306,9 +354,15 @@ dd_in(void)
 			 * If it's a seekable file descriptor, seek past the
 			 * error.  If your OS doesn't do the right thing for
 			 * raw disks this section should be modified to re-read
-			 * in sector size chunks.
+			 * in sector size chunks.  The reader thread has
+			 * already done so.
 			 */
-			if (in.flags & ISSEEK &&
+			if (ddflags & C_IASYNC) {
+				if (serror != 0) {
+					errno = serror;
+					warn("%s", in.name);
+				}
+			} else if (in.flags & ISSEEK &&
 			    lseek(in.fd, (off_t)in.dbsz, SEEK_CUR))
 				warn("%s", in.name);
 
@@ -358,6 +412,108 @@ dd_in(void)
 		in.dbp += in.dbrcnt;
 		(*cfunc)();
 	}
+done:
+	if (ddflags & C_IASYNC)
+		ring_stop();
+}
+
+/*
+ * The reader thread reads the blocks dd_in() would, and no more: it stops
+ * at end of file, at a read error without noerror, or after count blocks.
+ */
+static void *
+ring_reader(void *arg __unused)
+{
+	sigset_t set;
+	ssize_t n;
+	int i;
+
+	/* Leave SIGINFO and SIGINT to the main thread. */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&ring.mtx);
+	while (ring.left != 0) {
+		while (ring.tail - ring.head == RING_SIZE)
+			pthread_cond_wait(&ring.cv, &ring.mtx);
+		i = ring.tail % RING_SIZE;
+		pthread_mutex_unlock(&ring.mtx);
+
+		n = read(in.fd, ring.slot[i].buf, in.dbsz);
+		ring.slot[i].n = n;
+		ring.slot[i].error = n == -1 ? errno : 0;
+		ring.slot[i].serror = 0;
+		if (n == -1 && ddflags & C_NOERROR && in.flags & ISSEEK &&
+		    lseek(in.fd, (off_t)in.dbsz, SEEK_CUR) == -1)
+			ring.slot[i].serror = errno;
+
+		pthread_mutex_lock(&ring.mtx);
+		ring.tail++;
+		pthread_cond_signal(&ring.cv);
+		if (n == 0 || (n == -1 && !(ddflags & C_NOERROR)))
+			break;
+		/* Only blocks that dd_in() counts */
+		if (ring.left > 0 && (n > 0 || ddflags & C_SYNC))
+			ring.left--;
+	}
+	ring.done = 1;
+	pthread_cond_signal(&ring.cv);
+	pthread_mutex_unlock(&ring.mtx);
+	return (NULL);
+}
+
+static void
+ring_start(void)
+{
+
+	ring.head = ring.tail = 0;
+	ring.done = 0;
+	ring.left = cpy_cnt == 0 ? -1 :
+	    cpy_cnt - (quad_t)(st.in_full + st.in_part);
+	if ((errno = pthread_create(&ring.thread, NULL, ring_reader,
+	    NULL)) != 0)
+		err(1, "reader thread");
+}
+
+static void
+ring_stop(void)
+{
+
+	pthread_join(ring.thread, NULL);
+}
+
+/*
+ * Copy the next block read into buf, like read(2) would.  *serrorp is
+ * set to the errno of a failed seek past a read error, or 0.
+ */
+static ssize_t
+ring_read(u_char *buf, int *serrorp)
+{
+	ssize_t n;
+	int i, error;
+
+	pthread_mutex_lock(&ring.mtx);
+	while (ring.head == ring.tail && !ring.done)
+		pthread_cond_wait(&ring.cv, &ring.mtx);
+	if (ring.head == ring.tail) {
+		pthread_mutex_unlock(&ring.mtx);
+		*serrorp = 0;
+		return (0);
+	}
+	i = ring.head % RING_SIZE;
+	pthread_mutex_unlock(&ring.mtx);
+
+	if ((n = ring.slot[i].n) > 0)
+		memcpy(buf, ring.slot[i].buf, n);
+	error = ring.slot[i].error;
+	*serrorp = ring.slot[i].serror;
+
+	pthread_mutex_lock(&ring.mtx);
+	ring.head++;
+	pthread_cond_signal(&ring.cv);
+	pthread_mutex_unlock(&ring.mtx);
+	errno = error;
+	return (n);
 }
 
 /*
@@ -95,3 +95,6 @@ typedef struct {
 #define	C_UNBLOCK	0x80000
 #define	C_OSYNC		0x100000
 #define	C_SPARSE	0x200000
+#define	C_IASYNC	0x400000
+#define	C_IDIRECT	0x800000
+#define	C_ODIRECT	0x1000000
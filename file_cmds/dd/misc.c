@@ -88,13 +88,34 @@ summary(void)
 	(void)write(STDERR_FILENO, buf, strlen(buf));
 }
 
+/*
+ * SIGINFO: the summary, and the rate since the previous report, which
+ * shows a transfer slowing down long before the average does.
+ */
 /* ARGSUSED */
 void
 summaryx(int notused)
 {
+	static double last;
+	static u_quad_t lastbytes;
+	struct timeval tv;
+	double now, secs;
+	char buf[100];
 	int save_errno = errno;
 
 	summary();
+	(void)gettimeofday(&tv, (struct timezone *)NULL);
+	now = tv.tv_sec + tv.tv_usec * 1e-6;
+	if (last == 0)
+		last = st.start;
+	if ((secs = now - last) < 1e-6)
+		secs = 1e-6;
+	(void)snprintf(buf, sizeof(buf),
+	    "%qu bytes in the last %.6f secs (%.0f bytes/sec)\n",
+	    st.bytes - lastbytes, secs, (st.bytes - lastbytes) / secs);
+	(void)write(STDERR_FILENO, buf, strlen(buf));
+	last = now;
+	lastbytes = st.bytes;
 	errno = save_errno;
 }
 
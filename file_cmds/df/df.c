@@ -61,11 +61,13 @@ __used static const char rcsid[] =
 #include <sys/stat.h>
 #include <sys/mount.h>
 #include <sys/sysctl.h>
+#include <sys/time.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <fstab.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -101,6 +103,24 @@ __used static const char rcsid[] =
 #define TERA_SI_SZ (TERA_SZ(1000ULL))
 #define PETA_SI_SZ (PETA_SZ(1000ULL))
 
+/*
+ * Each file system is asked for new statistics on a thread of its own, so
+ * that one that does not answer, like a network or File Provider mount,
+ * delays the others by STATFS_TIMEOUT seconds at most.
+ */
+#define	STATFS_TIMEOUT	3
+
+struct fsquery {
+	struct statfs	sfs;
+	char		path[MAXPATHLEN];
+	int		rc;
+	int		done;		/* statfs() has returned */
+	int		abandoned;	/* the caller gave up, free when done */
+};
+
+static pthread_mutex_t fsquery_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fsquery_cv = PTHREAD_COND_INITIALIZER;
+
 /* Maximum widths of various fields. */
 struct maxwidths {
 	int mntfrom;
@@ -128,6 +148,7 @@ char	**makevfslist(const char *);
 static void	  prthuman(struct statfs *, uint64_t);
 static void	  prthumanval(int64_t);
 static void	  prtstat(struct statfs *, struct maxwidths *);
+static void	  refreshmntinfo(struct statfs *, long);
 static long	  regetmntinfo(struct statfs **, long, char **);
 static unit_t	  unit_adjust(double *);
 static void	  update_maxwidths(struct maxwidths *, struct statfs *);
@@ -343,22 +364,101 @@ regetmntinfo(struct statfs **mntbufp, long mntsize, char **vfslist)
 	int i, j;
 	struct statfs *mntbuf;
 
-	if (vfslist == NULL)
-		return (nflag ? mntsize : getmntinfo(mntbufp, MNT_WAIT));
-
 	mntbuf = *mntbufp;
 	for (j = 0, i = 0; i < mntsize; i++) {
-		if (checkvfsname(mntbuf[i].f_fstypename, vfslist))
+		if (vfslist != NULL &&
+		    checkvfsname(mntbuf[i].f_fstypename, vfslist))
 			continue;
-		if (!nflag)
-			(void)statfs(mntbuf[i].f_mntonname,&mntbuf[j]);
-		else if (i != j)
+		if (i != j)
 			mntbuf[j] = mntbuf[i];
 		j++;
 	}
+	if (!nflag)
+		refreshmntinfo(mntbuf, j);
 	return (j);
 }
 
+static void *
+fsquery_run(void *arg)
+{
+	struct fsquery *q = arg;
+	struct statfs sfs;
+	int rc;
+
+	rc = statfs(q->path, &sfs);
+	pthread_mutex_lock(&fsquery_mtx);
+	if (q->abandoned) {
+		pthread_mutex_unlock(&fsquery_mtx);
+		free(q);
+		return (NULL);
+	}
+	q->sfs = sfs;
+	q->rc = rc;
+	q->done = 1;
+	pthread_cond_broadcast(&fsquery_cv);
+	pthread_mutex_unlock(&fsquery_mtx);
+	return (NULL);
+}
+
+/*
+ * Ask every file system in mntbuf for new statistics at once.  Those
+ * that have not answered within STATFS_TIMEOUT seconds keep the ones
+ * getmntinfo(MNT_NOWAIT) had, as with -n.
+ */
+void
+refreshmntinfo(struct statfs *mntbuf, long mntsize)
+{
+	struct fsquery **qs;
+	struct timespec deadline;
+	struct timeval now;
+	pthread_attr_t attr;
+	pthread_t thread;
+	long i;
+	int late;
+
+	if (mntsize == 0)
+		return;
+	if ((qs = calloc(mntsize, sizeof(*qs))) == NULL)
+		err(1, "calloc");
+	(void)pthread_attr_init(&attr);
+	(void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < mntsize; i++) {
+		if ((qs[i] = calloc(1, sizeof(**qs))) == NULL)
+			err(1, "calloc");
+		(void)strlcpy(qs[i]->path, mntbuf[i].f_mntonname,
+		    sizeof(qs[i]->path));
+		if (pthread_create(&thread, &attr, fsquery_run, qs[i]) != 0) {
+			/* Ask it from here, then. */
+			qs[i]->rc = statfs(qs[i]->path, &qs[i]->sfs);
+			qs[i]->done = 1;
+		}
+	}
+	(void)pthread_attr_destroy(&attr);
+
+	(void)gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec + STATFS_TIMEOUT;
+	deadline.tv_nsec = now.tv_usec * 1000;
+	late = 0;
+	pthread_mutex_lock(&fsquery_mtx);
+	for (i = 0; i < mntsize; i++) {
+		while (!qs[i]->done && !late)
+			if (pthread_cond_timedwait(&fsquery_cv, &fsquery_mtx,
+			    &deadline) == ETIMEDOUT)
+				late = 1;
+		if (!qs[i]->done) {
+			qs[i]->abandoned = 1;
+			warnx("%s: not responding, statistics may be stale",
+			    mntbuf[i].f_mntonname);
+			continue;
+		}
+		if (qs[i]->rc == 0)
+			mntbuf[i] = qs[i]->sfs;
+		free(qs[i]);
+	}
+	pthread_mutex_unlock(&fsquery_mtx);
+	free(qs);
+}
+
 /*
  * Output in "human-readable" format.  Uses 3 digits max and puts
  * unit suffixes at the end.  Makes output compact and easy to read,
@@ -57,10 +57,12 @@ __FBSDID("$FreeBSD: src/usr.bin/du/du.c,v 1.38 2005/04/09 14:31:40 stefanf Exp $
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <fts.h>
 #include <locale.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -68,6 +70,7 @@ __FBSDID("$FreeBSD: src/usr.bin/du/du.c,v 1.38 2005/04/09 14:31:40 stefanf Exp $
 #include <sysexits.h>
 #include <unistd.h>
 #include "ios_error.h"
+#include "dirwalk.h"
 
 #ifdef __APPLE__
 // #include <get_compat.h>
@@ -109,14 +112,90 @@ struct ignentry {
 	SLIST_ENTRY(ignentry)	next;
 };
 
+/*
+ * Inodes with more than one link, so that each is only counted once.
+ */
+struct links_entry {
+	struct links_entry *next;
+	struct links_entry *previous;
+	int	 links;
+	dev_t	 dev;
+	ino_t	 ino;
+};
+
+struct linktab {
+	struct links_entry **buckets;
+	struct links_entry *free_list;
+	size_t number_buckets;
+	unsigned long number_entries;
+	char stop_allocating;
+	const char *what;		/* For the messages */
+};
+
+static __thread struct linktab filelinks = { .what = "" };
+static __thread struct linktab dirlinks = { .what = "directory " };
+
+/*
+ * With -j, the hierarchies are read by several threads, which take the
+ * directories off a shared stack.  Only directories are kept.  Each one
+ * holds the blocks of the files in it, and the entries that have to be
+ * looked at in the order fts_read() would have returned them: files with
+ * more than one link, and files that could not be stat'ed.  The totals
+ * are added up and printed on the calling thread once all the threads
+ * are done, so the output is the same as without -j.
+ */
+struct du_ent {
+	char		*name;		/* If it could not be stat'ed */
+	int		 error;
+	dev_t		 dev;
+	ino_t		 ino;
+	nlink_t		 nlink;
+	off_t		 blocks;
+	size_t		 nsub;		/* Subdirectories read before it */
+};
+
+struct du_dir {
+	struct du_dir	*child;		/* Subdirectories, in directory order */
+	struct du_dir	*lastchild;
+	struct du_dir	*next;
+	char		*path;
+	int		 level;
+	int		 error;		/* Could not be read */
+	int		 skip;		/* Counted, but not read */
+	dev_t		 rootdev;	/* For -x */
+	off_t		 blocks;	/* Its own and its files' */
+	struct du_ent	*ents;
+	size_t		 nents;
+	size_t		 entsize;
+	size_t		 nsub;
+};
+
+struct du_pool {
+	struct dw_pool	 dw;
+	struct linktab	*dirlinks;	/* Shared, under dw.dp_mtx */
+	int		 xflag;
+};
+
+struct du_opts {
+	int		 depth;
+	int		 hflag;
+	long		 blocksize;
+	int		 rval;
+};
+
+static int	links_seen(struct linktab *, dev_t, ino_t, nlink_t);
+static void	links_free(struct linktab *);
 static int	linkchk(FTSENT *);
+static int	dirlinkcount(const char *);
 static int	dirlinkchk(FTSENT *);
+static off_t	du_jobs(char **, int, int, unsigned int, struct du_opts *);
 static void	usage(void);
 static void		prthumanval(double);
 static unit_t		unit_adjust(double *);
 static void		ignoreadd(const char *);
 static void		ignoreclean(void);
 static int		ignorep(FTSENT *);
+static int		ignorename(const char *, const char *, int);
 
 int
 du_main(int argc, char *argv[])
@@ -132,6 +211,10 @@ du_main(int argc, char *argv[])
 	char 		**save;
 	static char	dot[] = ".";
 	off_t           *ftsnum, *ftsparnum;
+	struct du_opts	opts;
+	unsigned int	njobs;
+	u_long		l;
+	char		*ep;
 
 	setlocale(LC_ALL, "");
 
@@ -141,9 +224,10 @@ du_main(int argc, char *argv[])
 	save = argv;
 	ftsoptions = FTS_NOCHDIR;
 	depth = INT_MAX;
+	njobs = 1;
 	SLIST_INIT(&ignores);
 
-	while ((ch = getopt(argc, argv, "HI:LPasd:cghkmrx")) != -1)
+	while ((ch = getopt(argc, argv, "HI:LPasd:cghj:kmrx")) != -1)
 		switch (ch) {
 			case 'H':
 				Lflag = Pflag = 0;
@@ -183,6 +267,13 @@ du_main(int argc, char *argv[])
 				hflag = 1;
 				valp = vals_base2;
 				break;
+			case 'j':
+				errno = 0;
+				l = strtoul(optarg, &ep, 10);
+				if (errno != 0 || *ep != '\0' || l == 0 || l > UINT_MAX)
+					errx(1, "%s: invalid number of jobs", optarg);
+				njobs = (unsigned int)l;
+				break;
 			case 'k':
 				hflag = 0;
 				putenv("BLOCKSIZE=1024");
@@ -259,11 +350,21 @@ du_main(int argc, char *argv[])
 
 	rval = 0;
 
-    if ((fts = fts_open(argv, ftsoptions, NULL)) == NULL) {
+	/* -j reads the directories in parallel; -a and -L stay with fts */
+	if (njobs > 1 && !listall && !Lflag) {
+		opts.depth = depth;
+		opts.hflag = hflag;
+		opts.blocksize = blocksize;
+		opts.rval = 0;
+		savednumber = du_jobs(argv, Hflag, ftsoptions & FTS_XDEV,
+		    njobs, &opts);
+		rval = opts.rval;
+		fts = NULL;
+	} else if ((fts = fts_open(argv, ftsoptions, NULL)) == NULL) {
 		err(1, "fts_open");
-    }
+	}
 
-	while ((p = fts_read(fts)) != NULL) {
+	while (fts != NULL && (p = fts_read(fts)) != NULL) {
 		switch (p->fts_info) {
 			case FTS_D:
 				if (ignorep(p) || dirlinkchk(p))
@@ -351,7 +452,7 @@ du_main(int argc, char *argv[])
 		savednumber = ((off_t *)&p->fts_parent->fts_number)[0];
 	}
 
-    if (errno) {
+    if (fts != NULL && errno) {
 		err(1, "fts_read");
     }
 
@@ -365,69 +466,63 @@ du_main(int argc, char *argv[])
 	}
 
 	ignoreclean();
+	links_free(&filelinks);
+	links_free(&dirlinks);
 	exit(rval);
 }
 
+/*
+ * Look up the inode dev/ino, with nlink links, in tab.  Returns 1 if it
+ * has been seen before.  An inode is forgotten once all its links have
+ * been seen.
+ */
 static int
-linkchk(FTSENT *p)
+links_seen(struct linktab *tab, dev_t dev, ino_t ino, nlink_t nlink)
 {
-	struct links_entry {
-		struct links_entry *next;
-		struct links_entry *previous;
-		int	 links;
-		dev_t	 dev;
-		ino_t	 ino;
-	};
 	static const size_t links_hash_initial_size = 8192;
-	static struct links_entry **buckets;
-	static struct links_entry *free_list;
-	static size_t number_buckets;
-	static unsigned long number_entries;
-	static char stop_allocating;
 	struct links_entry *le, **new_buckets;
-	struct stat *st;
 	size_t i, new_size;
 	int hash;
 
-	st = p->fts_statp;
-
 	/* If necessary, initialize the hash table. */
-	if (buckets == NULL) {
-		number_buckets = links_hash_initial_size;
-		buckets = malloc(number_buckets * sizeof(buckets[0]));
-        if (buckets == NULL) {
-			errx(1, "No memory for hardlink detection");
+	if (tab->buckets == NULL) {
+		tab->number_buckets = links_hash_initial_size;
+		tab->buckets = malloc(tab->number_buckets *
+		    sizeof(tab->buckets[0]));
+        if (tab->buckets == NULL) {
+			errx(1, "No memory for %shardlink detection", tab->what);
         }
-		for (i = 0; i < number_buckets; i++)
-			buckets[i] = NULL;
+		for (i = 0; i < tab->number_buckets; i++)
+			tab->buckets[i] = NULL;
 	}
 
 	/* If the hash table is getting too full, enlarge it. */
-	if (number_entries > number_buckets * 10 && !stop_allocating) {
-		new_size = number_buckets * 2;
+	if (tab->number_entries > tab->number_buckets * 10 &&
+	    !tab->stop_allocating) {
+		new_size = tab->number_buckets * 2;
 		new_buckets = malloc(new_size * sizeof(struct links_entry *));
 
 		/* Try releasing the free list to see if that helps. */
-		if (new_buckets == NULL && free_list != NULL) {
-			while (free_list != NULL) {
-				le = free_list;
-				free_list = le->next;
+		if (new_buckets == NULL && tab->free_list != NULL) {
+			while (tab->free_list != NULL) {
+				le = tab->free_list;
+				tab->free_list = le->next;
 				free(le);
 			}
 			new_buckets = malloc(new_size * sizeof(new_buckets[0]));
 		}
 
 		if (new_buckets == NULL) {
-			stop_allocating = 1;
-            warnx("No more memory for tracking hard links");
+			tab->stop_allocating = 1;
+            warnx("No more memory for tracking %shard links", tab->what);
 		} else {
 			memset(new_buckets, 0,
 			    new_size * sizeof(struct links_entry *));
-			for (i = 0; i < number_buckets; i++) {
-				while (buckets[i] != NULL) {
+			for (i = 0; i < tab->number_buckets; i++) {
+				while (tab->buckets[i] != NULL) {
 					/* Remove entry from old bucket. */
-					le = buckets[i];
-					buckets[i] = le->next;
+					le = tab->buckets[i];
+					tab->buckets[i] = le->next;
 
 					/* Add entry to new bucket. */
 					hash = (le->dev ^ le->ino) % new_size;
@@ -440,16 +535,16 @@ linkchk(FTSENT *p)
 					new_buckets[hash] = le;
 				}
 			}
-			free(buckets);
-			buckets = new_buckets;
-			number_buckets = new_size;
+			free(tab->buckets);
+			tab->buckets = new_buckets;
+			tab->number_buckets = new_size;
 		}
 	}
 
 	/* Try to locate this entry in the hash table. */
-	hash = ( st->st_dev ^ st->st_ino ) % number_buckets;
-	for (le = buckets[hash]; le != NULL; le = le->next) {
-		if (le->dev == st->st_dev && le->ino == st->st_ino) {
+	hash = ( dev ^ ino ) % tab->number_buckets;
+	for (le = tab->buckets[hash]; le != NULL; le = le->next) {
+		if (le->dev == dev && le->ino == ino) {
 			/*
 			 * Save memory by releasing an entry when we've seen
 			 * all of it's links.
@@ -459,69 +554,88 @@ linkchk(FTSENT *p)
 					le->previous->next = le->next;
 				if (le->next != NULL)
 					le->next->previous = le->previous;
-				if (buckets[hash] == le)
-					buckets[hash] = le->next;
-				number_entries--;
+				if (tab->buckets[hash] == le)
+					tab->buckets[hash] = le->next;
+				tab->number_entries--;
 				/* Recycle this node through the free list */
-				if (stop_allocating) {
+				if (tab->stop_allocating) {
 					free(le);
 				} else {
-					le->next = free_list;
-					free_list = le;
+					le->next = tab->free_list;
+					tab->free_list = le;
 				}
 			}
 			return (1);
 		}
 	}
 
-	if (stop_allocating)
+	if (tab->stop_allocating)
 		return (0);
 
 	/* Add this entry to the links cache. */
-	if (free_list != NULL) {
+	if (tab->free_list != NULL) {
 		/* Pull a node from the free list if we can. */
-		le = free_list;
-		free_list = le->next;
+		le = tab->free_list;
+		tab->free_list = le->next;
 	} else
 		/* Malloc one if we have to. */
 		le = malloc(sizeof(struct links_entry));
 	if (le == NULL) {
-		stop_allocating = 1;
+		tab->stop_allocating = 1;
         warnx("No more memory for tracking hard links");
 		return (0);
 	}
-	le->dev = st->st_dev;
-	le->ino = st->st_ino;
-	le->links = st->st_nlink - 1;
-	number_entries++;
-	le->next = buckets[hash];
+	le->dev = dev;
+	le->ino = ino;
+	le->links = nlink - 1;
+	tab->number_entries++;
+	le->next = tab->buckets[hash];
 	le->previous = NULL;
-	if (buckets[hash] != NULL)
-		buckets[hash]->previous = le;
-	buckets[hash] = le;
+	if (tab->buckets[hash] != NULL)
+		tab->buckets[hash]->previous = le;
+	tab->buckets[hash] = le;
 	return (0);
 }
 
+static void
+links_free(struct linktab *tab)
+{
+	struct links_entry *le;
+	size_t i;
+
+	for (i = 0; i < tab->number_buckets; i++) {
+		while ((le = tab->buckets[i]) != NULL) {
+			tab->buckets[i] = le->next;
+			free(le);
+		}
+	}
+	while ((le = tab->free_list) != NULL) {
+		tab->free_list = le->next;
+		free(le);
+	}
+	free(tab->buckets);
+	tab->buckets = NULL;
+	tab->number_buckets = 0;
+	tab->number_entries = 0;
+	tab->stop_allocating = 0;
+}
+
 static int
-dirlinkchk(FTSENT *p)
+linkchk(FTSENT *p)
 {
-	struct links_entry {
-		struct links_entry *next;
-		struct links_entry *previous;
-		int	 links;
-		dev_t	 dev;
-		ino_t	 ino;
-	};
-	static const size_t links_hash_initial_size = 8192;
-	static struct links_entry **buckets;
-	static struct links_entry *free_list;
-	static size_t number_buckets;
-	static unsigned long number_entries;
-	static char stop_allocating;
-	struct links_entry *le, **new_buckets;
 	struct stat *st;
-	size_t i, new_size;
-	int hash;
+
+	st = p->fts_statp;
+	return (links_seen(&filelinks, st->st_dev, st->st_ino, st->st_nlink));
+}
+
+/*
+ * Returns the number of hard links to the directory at path, or 1 if it
+ * cannot be told.  Unlike st_nlink, this does not count subdirectories.
+ */
+static int
+dirlinkcount(const char *path)
+{
 	struct attrbuf {
 		int size;
 		int linkcount;
@@ -531,120 +645,309 @@ dirlinkchk(FTSENT *p)
 	memset(&attrList, 0, sizeof(attrList));
 	attrList.bitmapcount = ATTR_BIT_MAP_COUNT;
 	attrList.dirattr = ATTR_DIR_LINKCOUNT;
-	if (-1 == getattrlist(p->fts_path, &attrList, &buf, sizeof(buf), 0))
-		return 0;
-	if (buf.linkcount == 1)
+	if (-1 == getattrlist(path, &attrList, &buf, sizeof(buf), 0))
+		return 1;
+	return buf.linkcount;
+}
+
+static int
+dirlinkchk(FTSENT *p)
+{
+	struct stat *st;
+	int linkcount;
+
+	if ((linkcount = dirlinkcount(p->fts_path)) == 1)
 		return 0;
 	st = p->fts_statp;
+	return (links_seen(&dirlinks, st->st_dev, st->st_ino, linkcount));
+}
 
-	/* If necessary, initialize the hash table. */
-	if (buckets == NULL) {
-		number_buckets = links_hash_initial_size;
-		buckets = malloc(number_buckets * sizeof(buckets[0]));
-        if (buckets == NULL) {
-			errx(1, "No memory for directory hardlink detection");
-        }
-		for (i = 0; i < number_buckets; i++)
-			buckets[i] = NULL;
+/*
+ * Returns the path of the entry name of directory dir, as fts(3) would.
+ */
+static char *
+du_path(const char *dir, const char *name)
+{
+	char *path;
+	size_t len;
+
+	len = strlen(dir);
+	if (len > 0 && dir[len - 1] == '/')
+		len--;
+	if (asprintf(&path, "%.*s/%s", (int)len, dir, name) == -1)
+		err(1, "asprintf");
+	return (path);
+}
+
+static struct du_dir *
+du_newdir(char *path, int level, struct stat *sb, dev_t rootdev)
+{
+	struct du_dir *d;
+
+	if ((d = calloc(1, sizeof(*d))) == NULL)
+		err(1, "calloc");
+	d->path = path;
+	d->level = level;
+	d->rootdev = rootdev;
+	if (sb->st_size < TWO_TB)
+		d->blocks = sb->st_blocks;
+	else
+		d->blocks = howmany(sb->st_size, 512LL);
+	return (d);
+}
+
+static struct du_ent *
+du_newent(struct du_dir *d)
+{
+	struct du_ent *e;
+
+	if (d->nents == d->entsize) {
+		d->entsize = d->entsize ? d->entsize * 2 : 16;
+		d->ents = reallocf(d->ents, d->entsize * sizeof(*d->ents));
+		if (d->ents == NULL)
+			err(1, "realloc");
 	}
+	e = &d->ents[d->nents++];
+	memset(e, 0, sizeof(*e));
+	e->nsub = d->nsub;
+	return (e);
+}
 
-	/* If the hash table is getting too full, enlarge it. */
-	if (number_entries > number_buckets * 10 && !stop_allocating) {
-		new_size = number_buckets * 2;
-		new_buckets = malloc(new_size * sizeof(struct links_entry *));
+/*
+ * Account for entry e of directory d.
+ */
+static void
+du_dirent(struct du_pool *pool, struct du_dir *d, struct dw_entry *e)
+{
+	struct stat *sb;
+	struct du_dir *c;
+	struct du_ent *ent;
+	char *path;
+	int linkcount;
+
+	if ((sb = e->de_sb) == NULL) {
+		ent = du_newent(d);
+		ent->error = e->de_errno;
+		if ((ent->name = strdup(e->de_name)) == NULL)
+			err(1, "strdup");
+		return;
+	}
+	if (!S_ISDIR(sb->st_mode)) {
+		if (ignorename(e->de_name, NULL, 0))
+			return;
+		if (sb->st_nlink > 1) {
+			ent = du_newent(d);
+			ent->dev = sb->st_dev;
+			ent->ino = sb->st_ino;
+			ent->nlink = sb->st_nlink;
+			ent->blocks = sb->st_size < TWO_TB ? sb->st_blocks :
+			    sb->st_size / 512LL;
+		} else if (sb->st_size < TWO_TB)
+			d->blocks += sb->st_blocks;
+		else
+			d->blocks += sb->st_size / 512LL;
+		return;
+	}
 
-		/* Try releasing the free list to see if that helps. */
-		if (new_buckets == NULL && free_list != NULL) {
-			while (free_list != NULL) {
-				le = free_list;
-				free_list = le->next;
-				free(le);
-			}
-			new_buckets = malloc(new_size * sizeof(new_buckets[0]));
+	path = du_path(d->path, e->de_name);
+	if (ignorename(e->de_name, path, 1)) {
+		free(path);
+		return;
+	}
+	c = du_newdir(path, d->level + 1, sb, d->rootdev);
+	if (pool->xflag && sb->st_dev != d->rootdev)
+		c->skip = 1;
+	else {
+		if ((linkcount = e->de_dirlinks) == 0)
+			linkcount = dirlinkcount(path);
+		if (linkcount > 1) {
+			pthread_mutex_lock(&pool->dw.dp_mtx);
+			c->skip = links_seen(pool->dirlinks, sb->st_dev,
+			    sb->st_ino, linkcount);
+			pthread_mutex_unlock(&pool->dw.dp_mtx);
 		}
+	}
+	if (d->lastchild == NULL)
+		d->child = c;
+	else
+		d->lastchild->next = c;
+	d->lastchild = c;
+	d->nsub++;
+}
 
-		if (new_buckets == NULL) {
-			stop_allocating = 1;
-            warnx("No more memory for tracking directory hard links");
-		} else {
-			memset(new_buckets, 0,
-			    new_size * sizeof(struct links_entry *));
-			for (i = 0; i < number_buckets; i++) {
-				while (buckets[i] != NULL) {
-					/* Remove entry from old bucket. */
-					le = buckets[i];
-					buckets[i] = le->next;
+/*
+ * Read directory d, with the sizes of its entries and the link counts
+ * of its subdirectories, and queue the subdirectories.
+ */
+static void
+du_work(struct dw_pool *dw, void *arg)
+{
+	struct du_pool *pool = dw->dp_arg;
+	struct du_dir *c, *d = arg;
+	struct dw_list dl;
+	size_t i;
+	int dfd;
+
+	if ((dfd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		d->error = errno;
+		return;
+	}
+	if (dirwalk_read(dfd, DW_INODE | DW_NLINK | DW_SIZE | DW_DIRLINKS,
+	    &dl) == -1) {
+		d->error = errno;
+		(void)close(dfd);
+		return;
+	}
+	(void)close(dfd);
+	for (i = 0; i < dl.dl_count; i++)
+		du_dirent(pool, d, &dl.dl_ents[i]);
+	dirwalk_free(&dl);
+
+	for (c = d->child; c != NULL; c = c->next)
+		if (!c->skip)
+			dw_pool_push(dw, c);
+}
 
-					/* Add entry to new bucket. */
-					hash = (le->dev ^ le->ino) % new_size;
+static void
+du_print(struct du_opts *o, off_t blocks, const char *path)
+{
 
-					if (new_buckets[hash] != NULL)
-						new_buckets[hash]->previous =
-						    le;
-					le->next = new_buckets[hash];
-					le->previous = NULL;
-					new_buckets[hash] = le;
-				}
+	if (o->hflag) {
+		(void) prthumanval(howmany(blocks, o->blocksize));
+		(void) fprintf(thread_stdout, "\t%s\n", path);
+	} else {
+		(void) fprintf(thread_stdout, "%jd\t%s\n",
+		    (intmax_t)howmany(blocks, o->blocksize), path);
+	}
+}
+
+/*
+ * Add up the hierarchy under d, printing its directories as fts_read()
+ * would have returned them in post-order, and free it.
+ */
+static off_t
+du_total(struct du_opts *o, struct du_dir *d)
+{
+	struct du_dir *c, *next;
+	struct du_ent *e;
+	off_t blocks;
+	size_t i, n;
+	char *path;
+
+	blocks = 0;
+	if (d->error != 0) {
+		warnx("%s: %s", d->path, strerror(d->error));
+		o->rval = 1;
+	} else {
+		blocks = d->blocks;
+		for (c = d->child, i = n = 0;; c = next, n++) {
+			/* The entries read before the n-th subdirectory */
+			for (; i < d->nents && d->ents[i].nsub <= n; i++) {
+				e = &d->ents[i];
+				if (e->name != NULL) {
+					path = du_path(d->path, e->name);
+					warnx("%s: %s", path, strerror(e->error));
+					free(path);
+					free(e->name);
+					o->rval = 1;
+				} else if (!links_seen(&filelinks, e->dev, e->ino,
+				    e->nlink))
+					blocks += e->blocks;
 			}
-			free(buckets);
-			buckets = new_buckets;
-			number_buckets = new_size;
+			if (c == NULL)
+				break;
+			next = c->next;
+			blocks += du_total(o, c);
 		}
+		if (d->level <= o->depth)
+			du_print(o, blocks, d->path);
 	}
+	free(d->ents);
+	free(d->path);
+	free(d);
+	return (blocks);
+}
 
-	/* Try to locate this entry in the hash table. */
-	hash = ( st->st_dev ^ st->st_ino ) % number_buckets;
-	for (le = buckets[hash]; le != NULL; le = le->next) {
-		if (le->dev == st->st_dev && le->ino == st->st_ino) {
-			/*
-			 * Save memory by releasing an entry when we've seen
-			 * all of it's links.
-			 */
-			if (--le->links <= 0) {
-				if (le->previous != NULL)
-					le->previous->next = le->next;
-				if (le->next != NULL)
-					le->next->previous = le->previous;
-				if (buckets[hash] == le)
-					buckets[hash] = le->next;
-				number_entries--;
-				/* Recycle this node through the free list */
-				if (stop_allocating) {
-					free(le);
-				} else {
-					le->next = free_list;
-					free_list = le;
-				}
+/*
+ * du -j: read the hierarchies named by argv with njobs threads, then
+ * print them.  Returns the grand total.
+ */
+static off_t
+du_jobs(char **argv, int Hflag, int xflag, unsigned int njobs,
+    struct du_opts *o)
+{
+	struct du_root {
+		char		*path;
+		struct stat	 sb;
+		int		 error;
+		int		 ignored;
+		struct du_dir	*dir;
+	} *roots, *r;
+	struct du_pool pool;
+	char *path;
+	off_t total;
+	int argc, i, linkcount;
+
+	for (argc = 0; argv[argc] != NULL; argc++)
+		;
+	if ((roots = calloc(argc, sizeof(*roots))) == NULL)
+		err(1, "calloc");
+	dw_pool_init(&pool.dw, du_work, &pool);
+	pool.dirlinks = &dirlinks;
+	pool.xflag = xflag;
+
+	for (i = 0; i < argc; i++) {
+		r = &roots[i];
+		r->path = argv[i];
+		if (Hflag ? stat(r->path, &r->sb) : lstat(r->path, &r->sb)) {
+			/* -H counts a dangling link itself, as fts(3) does */
+			if (!Hflag || errno != ENOENT ||
+			    lstat(r->path, &r->sb) == -1) {
+				r->error = errno;
+				continue;
 			}
-			return (1);
 		}
+		if (ignorename(r->path, r->path, S_ISDIR(r->sb.st_mode))) {
+			r->ignored = 1;
+			continue;
+		}
+		if (!S_ISDIR(r->sb.st_mode))
+			continue;
+		if ((path = strdup(r->path)) == NULL)
+			err(1, "strdup");
+		r->dir = du_newdir(path, 0, &r->sb, r->sb.st_dev);
+		if ((linkcount = dirlinkcount(r->path)) > 1 &&
+		    links_seen(&dirlinks, r->sb.st_dev, r->sb.st_ino, linkcount))
+			r->dir->skip = 1;
+		else
+			dw_pool_push(&pool.dw, r->dir);
 	}
-
-	if (stop_allocating)
-		return (0);
-	/* Add this entry to the links cache. */
-	if (free_list != NULL) {
-		/* Pull a node from the free list if we can. */
-		le = free_list;
-		free_list = le->next;
-	} else
-		/* Malloc one if we have to. */
-		le = malloc(sizeof(struct links_entry));
-	if (le == NULL) {
-		stop_allocating = 1;
-        warnx("No more memory for tracking hard links");
-		return (0);
+	dw_pool_run(&pool.dw, njobs);
+	dw_pool_destroy(&pool.dw);
+
+	total = 0;
+	for (i = 0; i < argc; i++) {
+		r = &roots[i];
+		if (r->error != 0) {
+			warnx("%s: %s", r->path, strerror(r->error));
+			o->rval = 1;
+		} else if (r->ignored)
+			continue;
+		else if (r->dir != NULL)
+			total += du_total(o, r->dir);
+		else if (r->sb.st_nlink > 1 && links_seen(&filelinks,
+		    r->sb.st_dev, r->sb.st_ino, r->sb.st_nlink))
+			continue;
+		else if (r->sb.st_size < TWO_TB) {
+			du_print(o, r->sb.st_blocks, r->path);
+			total += r->sb.st_blocks;
+		} else {
+			du_print(o, howmany(r->sb.st_size, 512LL), r->path);
+			total += r->sb.st_size / 512LL;
+		}
 	}
-	le->dev = st->st_dev;
-	le->ino = st->st_ino;
-	le->links = buf.linkcount - 1;
-	number_entries++;
-	le->next = buckets[hash];
-	le->previous = NULL;
-	if (buckets[hash] != NULL)
-		buckets[hash]->previous = le;
-	buckets[hash] = le;
-	return (0);
+	free(roots);
+	return (total);
 }
 
 /*
@@ -694,7 +997,7 @@ static void
 usage(void)
 {
 	(void)fprintf(thread_stderr,
-		"usage: du [-H | -L | -P] [-a | -s | -d depth] [-c] [-h | -k | -m | -g] [-x] [-I mask] [file ...]\n");
+		"usage: du [-H | -L | -P] [-a | -s | -d depth] [-c] [-h | -k | -m | -g] [-x] [-j jobs] [-I mask] [file ...]\n");
 	exit(EX_USAGE);
 }
 
@@ -729,13 +1032,24 @@ ignoreclean(void)
 
 int
 ignorep(FTSENT *ent)
+{
+
+	return (ignorename(ent->fts_name, ent->fts_accpath,
+	    S_ISDIR(ent->fts_statp->st_mode)));
+}
+
+/*
+ * Whether the file or directory called name, at path, is left out.
+ */
+static int
+ignorename(const char *name, const char *path, int isdir)
 {
 	struct ignentry *ign;
 
 #ifdef __APPLE__
-	if (S_ISDIR(ent->fts_statp->st_mode) && !strcmp("fd", ent->fts_name)) {
+	if (isdir && !strcmp("fd", name)) {
 		struct statfs sfsb;
-		int rc = statfs(ent->fts_accpath, &sfsb);
+		int rc = statfs(path, &sfsb);
 		if (rc >= 0 && !strcmp("devfs", sfsb.f_fstypename)) {
 			/* Don't cd into /dev/fd/N since one of those is likely to be
 			  the cwd as of the start of du which causes all manner of
@@ -745,7 +1059,7 @@ ignorep(FTSENT *ent)
 	}
 #endif /* __APPLE__ */
 	SLIST_FOREACH(ign, &ignores, next)
-		if (fnmatch(ign->mask, ent->fts_name, 0) != FNM_NOMATCH)
+		if (fnmatch(ign->mask, name, 0) != FNM_NOMATCH)
 			return 1;
 	return 0;
 }
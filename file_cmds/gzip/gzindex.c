@@ -0,0 +1,465 @@
+/*
+ * Random access into gzip files.
+ *
+ * gzip --index writes a sidecar file, <file>.gzx, listing access points
+ * in the deflate stream about every span bytes of output, the way zlib's
+ * examples/zran.c does.  An access point is a deflate block boundary: the
+ * offsets of the block in the compressed and uncompressed data, the bit
+ * position of the block within its first byte, and the 32 KiB of output
+ * before it, which later blocks may refer back to.  gzip --range starts
+ * inflating from the last access point before the range instead of from
+ * the beginning of the file.
+ *
+ * The sidecar stores the size and modification time of the gzip file,
+ * and is ignored if they do not match.  All numbers are little endian:
+ *
+ *	header	"GZX" 1, access points (4), gzip size (8), gzip mtime (8),
+ *		offset of the table (8)
+ *	windows	the windows of the access points, one after another
+ *	table	per access point: uncompressed offset (8), compressed
+ *		offset (8), offset of its window (8), window length (4),
+ *		bit position (4)
+ */
+
+#define	GZX_SUFFIX	".gzx"
+#define	GZX_MAGIC	"GZX\1"
+#define	GZX_HEADER	32
+#define	GZX_ENTRY	32
+#define	GZX_WINDOW	32768
+
+struct gzx_point {
+	off_t		 out;		/* uncompressed offset */
+	off_t		 in;		/* first full byte of the block */
+	off_t		 winoff;	/* window in the sidecar */
+	unsigned int	 winlen;
+	int		 bits;		/* bits of the block in byte in - 1 */
+};
+
+static void
+gzx_put(unsigned char *p, uint64_t v, int n)
+{
+
+	while (n-- > 0) {
+		*p++ = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static uint64_t
+gzx_get(const unsigned char *p, int n)
+{
+	uint64_t v = 0;
+
+	while (n-- > 0)
+		v = v << 8 | p[n];
+	return (v);
+}
+
+static char *
+gzx_name(const char *file)
+{
+	char *name;
+
+	if (asprintf(&name, "%s%s", file, GZX_SUFFIX) == -1)
+		maybe_err("malloc");
+	return (name);
+}
+
+/*
+ * Inflate all of fd, which is at the start of a gzip file, and write the
+ * access points to xfd.  Returns the number of access points, -1 on error.
+ */
+static long
+gz_index_build(int fd, int xfd, const char *file, const struct stat *sbp,
+    off_t span)
+{
+	z_stream z;
+	unsigned char *inbuf, *outbuf, *window, *table, *e;
+	unsigned char header[GZX_HEADER];
+	off_t in_tot, out_tot, last, winoff;
+	long npoints, tsize;
+	ssize_t n;
+	uInt winlen;
+	int error, member;
+
+	inbuf = malloc(BUFLEN);
+	outbuf = malloc(BUFLEN);
+	window = malloc(GZX_WINDOW);
+	table = NULL;
+	if (inbuf == NULL || outbuf == NULL || window == NULL) {
+		maybe_warn("malloc");
+		npoints = -1;
+		goto out;
+	}
+	memset(&z, 0, sizeof z);
+	if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+		maybe_warnx("failed to inflateInit");
+		npoints = -1;
+		goto out;
+	}
+
+	/* The header is written last, on success */
+	memset(header, 0, sizeof header);
+	if (write(xfd, header, sizeof header) != sizeof header)
+		goto werror;
+	winoff = GZX_HEADER;
+	in_tot = out_tot = last = 0;
+	npoints = tsize = 0;
+	member = 1;
+	for (;;) {
+		if (z.avail_in == 0) {
+			n = read(fd, inbuf, BUFLEN);
+			if (n == -1) {
+				maybe_warn("can't read %s", file);
+				goto fail;
+			}
+			if (n == 0) {
+				if (member)
+					break;
+				maybe_warnx("%s: unexpected end of file",
+				    file);
+				goto fail;
+			}
+			z.next_in = inbuf;
+			z.avail_in = n;
+		}
+		if (member && z.avail_in > 0 && *z.next_in != GZIP_MAGIC0) {
+			maybe_warnx("%s: trailing garbage ignored", file);
+			exit_value = 2;
+			break;
+		}
+		z.next_out = outbuf;
+		z.avail_out = BUFLEN;
+		n = z.avail_in;
+		error = inflate(&z, Z_BLOCK);
+		in_tot += n - z.avail_in;
+		out_tot += BUFLEN - z.avail_out;
+		if (error == Z_STREAM_END) {
+			/* Another member may follow */
+			inflateReset(&z);
+			member = 1;
+			continue;
+		}
+		if (error != Z_OK && error != Z_BUF_ERROR) {
+			maybe_warnx("%s: data stream error", file);
+			goto fail;
+		}
+		member = 0;
+
+		/* At a block boundary that is not the end of the member? */
+		if ((z.data_type & 128) == 0 || (z.data_type & 64) != 0 ||
+		    (npoints > 0 && out_tot - last < span))
+			continue;
+		winlen = GZX_WINDOW;
+		if (inflateGetDictionary(&z, window, &winlen) != Z_OK) {
+			maybe_warnx("%s: inflateGetDictionary failed", file);
+			goto fail;
+		}
+		if (write(xfd, window, winlen) != (ssize_t)winlen)
+			goto werror;
+		if (npoints == tsize) {
+			tsize = tsize ? tsize * 2 : 64;
+			if ((e = realloc(table, tsize * GZX_ENTRY)) == NULL) {
+				maybe_warn("malloc");
+				goto fail;
+			}
+			table = e;
+		}
+		e = table + npoints++ * GZX_ENTRY;
+		gzx_put(e, out_tot, 8);
+		gzx_put(e + 8, in_tot, 8);
+		gzx_put(e + 16, winoff, 8);
+		gzx_put(e + 24, winlen, 4);
+		gzx_put(e + 28, z.data_type & 7, 4);
+		winoff += winlen;
+		last = out_tot;
+	}
+
+	if (write(xfd, table, npoints * GZX_ENTRY) != npoints * GZX_ENTRY)
+		goto werror;
+	memcpy(header, GZX_MAGIC, 4);
+	gzx_put(header + 4, npoints, 4);
+	gzx_put(header + 8, sbp->st_size, 8);
+	gzx_put(header + 16, sbp->st_mtime, 8);
+	gzx_put(header + 24, winoff, 8);
+	if (pwrite(xfd, header, sizeof header, 0) != sizeof header)
+		goto werror;
+	goto end;
+
+werror:
+	maybe_warn("can't write index for %s", file);
+fail:
+	npoints = -1;
+end:
+	inflateEnd(&z);
+out:
+	free(table);
+	free(window);
+	free(outbuf);
+	free(inbuf);
+	return (npoints);
+}
+
+/* gzip --index: write the sidecar of file */
+static void
+gz_index_file(const char *file, const struct stat *sbp)
+{
+	char *xname;
+	long npoints;
+	int fd, xfd;
+
+	if ((fd = open(file, O_RDONLY)) == -1) {
+		maybe_warn("can't open %s", file);
+		return;
+	}
+	xname = gzx_name(file);
+	if ((xfd = open(xname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		maybe_warn("can't create %s", xname);
+		goto out;
+	}
+	npoints = gz_index_build(fd, xfd, file, sbp, index_span);
+	if (close(xfd) != 0 && npoints != -1) {
+		maybe_warn("can't write %s", xname);
+		npoints = -1;
+	}
+	if (npoints == -1)
+		unlink(xname);
+	else if (vflag)
+		fprintf(thread_stderr, "%s: %ld access points\n", xname,
+		    npoints);
+out:
+	free(xname);
+	close(fd);
+}
+
+/*
+ * Find the last access point at or before uncompressed offset start in
+ * the sidecar of file.  Returns 0 and fills in *pp and the window, or -1
+ * if there is no usable sidecar or no such access point.
+ */
+static int
+gz_index_find(const char *file, const struct stat *sbp, off_t start,
+    struct gzx_point *pp, unsigned char *window)
+{
+	unsigned char header[GZX_HEADER], *table, *e;
+	struct stat xsb;
+	char *xname;
+	off_t toff;
+	long npoints, lo, hi, mid;
+	int xfd, rv = -1;
+
+	xname = gzx_name(file);
+	xfd = open(xname, O_RDONLY);
+	free(xname);
+	if (xfd == -1)
+		return (-1);
+	table = NULL;
+	if (fstat(xfd, &xsb) != 0 ||
+	    pread(xfd, header, sizeof header, 0) != sizeof header ||
+	    memcmp(header, GZX_MAGIC, 4) != 0 ||
+	    (off_t)gzx_get(header + 8, 8) != sbp->st_size ||
+	    (time_t)gzx_get(header + 16, 8) != sbp->st_mtime)
+		goto out;
+	npoints = gzx_get(header + 4, 4);
+	toff = gzx_get(header + 24, 8);
+	if (npoints == 0 || toff + npoints * GZX_ENTRY != xsb.st_size ||
+	    (table = malloc(npoints * GZX_ENTRY)) == NULL ||
+	    pread(xfd, table, npoints * GZX_ENTRY, toff) !=
+	    npoints * GZX_ENTRY)
+		goto out;
+
+	/* The access points are in order; find the last one <= start */
+	lo = 0;
+	hi = npoints;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if ((off_t)gzx_get(table + mid * GZX_ENTRY, 8) <= start)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = table + lo * GZX_ENTRY;
+	pp->out = gzx_get(e, 8);
+	pp->in = gzx_get(e + 8, 8);
+	pp->winoff = gzx_get(e + 16, 8);
+	pp->winlen = gzx_get(e + 24, 4);
+	pp->bits = gzx_get(e + 28, 4);
+	if (pp->out > start || pp->winlen > GZX_WINDOW || pp->bits > 7 ||
+	    pp->in < (pp->bits ? 1 : 0) ||
+	    pread(xfd, window, pp->winlen, pp->winoff) != pp->winlen)
+		goto out;
+	rv = 0;
+out:
+	free(table);
+	close(xfd);
+	return (rv);
+}
+
+/*
+ * Write len bytes of the uncompressed data, from offset start on, to out;
+ * len -1 means up to the end.  If p is not NULL, in is positioned at the
+ * access point p, whose window is in window, otherwise at the start of a
+ * gzip file.  Returns the bytes written, -1 on error.
+ */
+static off_t
+gz_range(int in, int out, const char *file, const struct gzx_point *p,
+    const unsigned char *window, off_t start, off_t len)
+{
+	z_stream z;
+	unsigned char *inbuf, *outbuf, *op;
+	off_t pos, out_tot = -1;
+	ssize_t n;
+	size_t have;
+	int error, raw, member, trailer;
+
+	inbuf = malloc(BUFLEN);
+	outbuf = malloc(BUFLEN);
+	if (inbuf == NULL || outbuf == NULL) {
+		maybe_warn("malloc");
+		goto out;
+	}
+	memset(&z, 0, sizeof z);
+	/* From an access point, inflate raw deflate data up to the trailer */
+	raw = p != NULL;
+	if (inflateInit2(&z, raw ? -MAX_WBITS : 16 + MAX_WBITS) != Z_OK) {
+		maybe_warnx("failed to inflateInit");
+		goto out;
+	}
+	if (raw) {
+		if (p->bits != 0) {
+			if (read(in, inbuf, 1) != 1) {
+				maybe_warnx("%s: unexpected end of file", file);
+				goto end;
+			}
+			inflatePrime(&z, p->bits, inbuf[0] >> (8 - p->bits));
+		}
+		if (p->winlen > 0)
+			inflateSetDictionary(&z, window, p->winlen);
+	}
+
+	pos = raw ? p->out : 0;
+	out_tot = 0;
+	member = !raw;
+	trailer = 0;
+	while (len == -1 || out_tot < len) {
+		if (z.avail_in == 0) {
+			n = read(in, inbuf, BUFLEN);
+			if (n == -1) {
+				maybe_warn("can't read %s", file);
+				goto fail;
+			}
+			if (n == 0) {
+				if (member)
+					break;
+				maybe_warnx("%s: unexpected end of file", file);
+				goto fail;
+			}
+			z.next_in = inbuf;
+			z.avail_in = n;
+		}
+		if (trailer > 0) {
+			/* Skip the CRC and length after raw deflate data */
+			n = MIN((size_t)trailer, z.avail_in);
+			z.next_in += n;
+			z.avail_in -= n;
+			if ((trailer -= n) == 0) {
+				inflateReset2(&z, 16 + MAX_WBITS);
+				member = 1;
+			}
+			continue;
+		}
+		if (member && *z.next_in != GZIP_MAGIC0) {
+			maybe_warnx("%s: trailing garbage ignored", file);
+			exit_value = 2;
+			break;
+		}
+		z.next_out = outbuf;
+		z.avail_out = BUFLEN;
+		error = inflate(&z, Z_NO_FLUSH);
+		if (error != Z_OK && error != Z_STREAM_END &&
+		    error != Z_BUF_ERROR) {
+			maybe_warnx("%s: %s", file, error == Z_DATA_ERROR ?
+			    "data stream error" : "inflate error");
+			goto fail;
+		}
+		member = 0;
+
+		/* Drop what comes before start, stop at the end */
+		op = outbuf;
+		have = BUFLEN - z.avail_out;
+		if (pos < start) {
+			n = MIN((off_t)have, start - pos);
+			pos += n;
+			op += n;
+			have -= n;
+		}
+		if (len != -1 && (off_t)have > len - out_tot)
+			have = len - out_tot;
+		if (have > 0) {
+			if (write(out, op, have) != (ssize_t)have) {
+				maybe_warn("error writing to output");
+				goto fail;
+			}
+			pos += have;
+			out_tot += have;
+		}
+
+		if (error == Z_STREAM_END) {
+			if (raw) {
+				raw = 0;
+				trailer = 8;
+			} else {
+				inflateReset(&z);
+				member = 1;
+			}
+		}
+	}
+	goto end;
+
+fail:
+	out_tot = -1;
+end:
+	inflateEnd(&z);
+out:
+	free(outbuf);
+	free(inbuf);
+	return (out_tot);
+}
+
+/*
+ * gzip --range: write the range of the uncompressed data of file to the
+ * standard output, or of the standard input if file is NULL.
+ */
+static void
+gz_range_file(const char *file, const struct stat *sbp)
+{
+	struct gzx_point point, *p = NULL;
+	unsigned char *window;
+	int fd;
+
+	if (file == NULL) {
+		fd = fileno(thread_stdin);
+		file = "(stdin)";
+	} else if ((fd = open(file, O_RDONLY)) == -1) {
+		maybe_warn("can't open %s", file);
+		return;
+	}
+	if ((window = malloc(GZX_WINDOW)) == NULL) {
+		maybe_warn("malloc");
+		goto out;
+	}
+	if (sbp != NULL &&
+	    gz_index_find(file, sbp, range_start, &point, window) == 0 &&
+	    lseek(fd, point.in - (point.bits ? 1 : 0), SEEK_SET) != -1)
+		p = &point;
+	if (p == NULL && sbp != NULL && lseek(fd, 0, SEEK_SET) == -1) {
+		maybe_warn("can't seek %s", file);
+		goto out;
+	}
+	(void)gz_range(fd, fileno(thread_stdout), file, p, window,
+	    range_start, range_len);
+out:
+	free(window);
+	if (fd != fileno(thread_stdin))
+		close(fd);
+}
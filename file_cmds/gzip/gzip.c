@@ -50,7 +50,9 @@ __FBSDID("$FreeBSD: head/usr.bin/gzip/gzip.c 290073 2015-10-27 21:26:05Z delphij
 #include <sys/stat.h>
 #include <sys/time.h>
 
+#include <ctype.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
@@ -64,6 +66,8 @@ __FBSDID("$FreeBSD: head/usr.bin/gzip/gzip.c 290073 2015-10-27 21:26:05Z delphij
 #include <stdarg.h>
 #include <getopt.h>
 #include <time.h>
+#include <pthread.h>
+#include <stddef.h>
 
 #ifdef __APPLE__
 #include <sys/attr.h>
@@ -217,6 +221,10 @@ static	int	qflag;			/* quiet mode */
 static	int	rflag;			/* recursive mode */
 static	int	tflag;			/* test */
 static	int	vflag;			/* verbose mode */
+static	int	pflag = 1;		/* compression threads */
+static	off_t	index_span;		/* --index spacing, or 0 */
+static	off_t	range_start = -1;	/* --range start, or -1 */
+static	off_t	range_len = -1;		/* --range length, or -1 */
 static	const char *remove_file = NULL;	/* file to be removed upon SIGINT */
 #else
 #define		qflag	0
@@ -243,7 +251,14 @@ static	enum filetype file_gettype(u_char *);
 #define gz_compress(if, of, sz, fn, tm) gz_compress(if, of, sz)
 #endif
 static	off_t	gz_compress(int, int, off_t *, const char *, uint32_t);
+#ifndef SMALL
+static	off_t	gz_compress_blocks(int, int, off_t *, uLong *);
+#endif
 static	off_t	gz_uncompress(int, int, char *, size_t, off_t *, const char *);
+#ifndef SMALL
+static	void	gz_index_file(const char *, const struct stat *);
+static	void	gz_range_file(const char *, const struct stat *);
+#endif
 static	off_t	file_compress(char *, char *, size_t);
 static	off_t	file_uncompress(char *, char *, size_t);
 static	void	handle_pathname(char *);
@@ -293,6 +308,11 @@ static	off_t	unxz(int, int, char *, size_t, off_t *);
 #ifdef SMALL
 #define getopt_long(a,b,c,d,e) getopt(a,b,c)
 #else
+enum {
+	OPT_INDEX = CHAR_MAX + 1,
+	OPT_RANGE,
+};
+
 static const struct option longopts[] = {
 	{ "stdout",		no_argument,		0,	'c' },
 	{ "to-stdout",		no_argument,		0,	'c' },
@@ -314,6 +334,9 @@ static const struct option longopts[] = {
 	{ "best",		no_argument,		0,	'9' },
 	{ "ascii",		no_argument,		0,	'a' },
 	{ "license",		no_argument,		0,	'L' },
+	{ "processes",		required_argument,	0,	'p' },
+	{ "index",		optional_argument,	0,	OPT_INDEX },
+	{ "range",		required_argument,	0,	OPT_RANGE },
 	{ NULL,			no_argument,		0,	0 },
 };
 #endif
@@ -323,7 +346,7 @@ gzip_main(int argc, char **argv)
 {
 	const char *progname = argv[0]; // getprogname(); // getprogname returns Host application
 #ifndef SMALL
-	char *gzip;
+	char *gzip, *end;
 	int len;
 #endif
 	int ch;
@@ -333,6 +356,9 @@ gzip_main(int argc, char **argv)
     numflag = 6;
 #ifndef SMALL
     fflag = kflag = nflag = Nflag = qflag = rflag = tflag = vflag = 0;
+    pflag = 1;
+    index_span = 0;
+    range_start = range_len = -1;
 #endif
     exit_value = 0;           /* exit value */
 #ifdef __APPLE__
@@ -364,7 +390,7 @@ gzip_main(int argc, char **argv)
 #ifdef SMALL
 #define OPT_LIST "123456789cdhlV"
 #else
-#define OPT_LIST "123456789acdfhklLNnqrS:tVv"
+#define OPT_LIST "123456789acdfhklLNnp:qrS:tVv"
 #endif
 
 	while ((ch = getopt_long(argc, argv, OPT_LIST, longopts, NULL)) != -1) {
@@ -408,6 +434,32 @@ gzip_main(int argc, char **argv)
 			nflag = 1;
 			Nflag = 0;
 			break;
+		case 'p':
+			pflag = (int)strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || pflag < 1 ||
+			    pflag > 256)
+				errx(1, "incorrect number of processes: '%s'",
+				    optarg);
+			break;
+		case OPT_INDEX:
+			index_span = 1;
+			if (optarg != NULL) {
+				index_span = strtoll(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' ||
+				    index_span < 1 || index_span > 1024 * 1024)
+					errx(1, "incorrect index spacing: '%s'",
+					    optarg);
+			}
+			index_span *= 1024 * 1024;
+			break;
+		case OPT_RANGE:
+			range_start = strtoll(optarg, &end, 10);
+			if (*end == ',' && isdigit((unsigned char)end[1]))
+				range_len = strtoll(end + 1, &end, 10);
+			if (!isdigit((unsigned char)*optarg) || *end != '\0')
+				errx(1, "incorrect range: '%s'", optarg);
+			dflag = cflag = 1;
+			break;
 		case 'q':
 			qflag = 1;
 			break;
@@ -444,6 +496,12 @@ gzip_main(int argc, char **argv)
 	argv += optind;
 	argc -= optind;
 
+#ifndef SMALL
+	if (index_span != 0 && argc == 0)
+		errx(1, "--index needs file operands");
+	if (index_span != 0 && range_start != -1)
+		errx(1, "--index and --range are mutually exclusive");
+#endif
 	if (argc == 0) {
 		if (dflag)	/* stdin mode */
 			handle_stdin();
@@ -589,6 +647,271 @@ copy_done:
 }
 #endif
 
+#ifndef SMALL
+/*
+ * gzip -p: the input is cut into blocks, which are deflated by separate
+ * threads.  Each block uses the 32 KiB of input before it as its
+ * dictionary and, but for the last one, ends with a sync flush, so that
+ * the pieces written one after the other make up a single deflate
+ * stream.  The CRCs of the blocks are put together with crc32_combine().
+ */
+#define	GZ_BLOCK	(128 * 1024)
+#define	GZ_DICT		(32 * 1024)
+#define	GZ_WINDOW	2		/* Blocks in flight per thread */
+
+struct gz_job {
+	unsigned char	*in;		/* Dictionary, then the block */
+	size_t		 dictlen;
+	size_t		 inlen;
+	unsigned char	*out;
+	size_t		 outsize;
+	size_t		 outlen;
+	uLong		 crc;
+	int		 last;
+	int		 error;
+	int		 done;
+};
+
+struct gz_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;
+	pthread_cond_t	 done;
+	struct gz_job	*jobs;
+	size_t		 size;
+	size_t		 head;		/* Next to be written out */
+	size_t		 next;		/* Next to be deflated */
+	size_t		 tail;		/* Next free slot */
+	int		 finished;
+	int		 failed;	/* Nothing more is written */
+	int		 level;
+	pthread_t	*threads;
+	unsigned int	 nthreads;
+};
+
+static int
+gz_deflate_block(struct gz_job *job, int level)
+{
+	z_stream z;
+	int error, flush;
+
+	memset(&z, 0, sizeof z);
+	if (deflateInit2(&z, level, Z_DEFLATED, (-MAX_WBITS), 8,
+	    Z_DEFAULT_STRATEGY) != Z_OK)
+		return (-1);
+	if (job->dictlen > 0 &&
+	    deflateSetDictionary(&z, job->in, job->dictlen) != Z_OK) {
+		(void)deflateEnd(&z);
+		return (-1);
+	}
+	z.next_in = job->in + job->dictlen;
+	z.avail_in = job->inlen;
+	flush = job->last ? Z_FINISH : Z_SYNC_FLUSH;
+	job->outlen = 0;
+	for (;;) {
+		if (job->outsize - job->outlen < 64) {
+			job->outsize = MAX(job->outsize * 2,
+			    deflateBound(&z, job->inlen) + 64);
+			job->out = realloc(job->out, job->outsize);
+			if (job->out == NULL) {
+				job->outsize = 0;
+				(void)deflateEnd(&z);
+				return (-1);
+			}
+		}
+		z.next_out = job->out + job->outlen;
+		z.avail_out = job->outsize - job->outlen;
+		error = deflate(&z, flush);
+		job->outlen = z.next_out - job->out;
+		if (error == Z_STREAM_END)
+			break;
+		if (error != Z_OK && error != Z_BUF_ERROR) {
+			(void)deflateEnd(&z);
+			return (-1);
+		}
+		/* The flush is complete once deflate() leaves room */
+		if (!job->last && z.avail_out != 0)
+			break;
+	}
+	job->crc = crc32(crc32(0L, Z_NULL, 0), job->in + job->dictlen,
+	    job->inlen);
+	/* Z_DATA_ERROR here only means the stream was left unfinished */
+	(void)deflateEnd(&z);
+	return (0);
+}
+
+static void *
+gz_worker(void *arg)
+{
+	struct gz_pool *pool = arg;
+	struct gz_job *job;
+
+	pthread_mutex_lock(&pool->mtx);
+	for (;;) {
+		while (pool->next == pool->tail && !pool->finished)
+			pthread_cond_wait(&pool->work, &pool->mtx);
+		if (pool->next == pool->tail)
+			break;
+		job = &pool->jobs[pool->next++ % pool->size];
+		pthread_mutex_unlock(&pool->mtx);
+
+		job->error = gz_deflate_block(job, pool->level);
+
+		pthread_mutex_lock(&pool->mtx);
+		job->done = 1;
+		pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (NULL);
+}
+
+/*
+ * Write out the jobs at the head of the window as they complete, until
+ * no more than "keep" are left in flight.  Returns -1 on error.
+ */
+static int
+gz_pool_retire(struct gz_pool *pool, size_t keep, int out, off_t *out_totp,
+    uLong *crcp)
+{
+	struct gz_job *job;
+	ssize_t w;
+
+	pthread_mutex_lock(&pool->mtx);
+	while (pool->head != pool->tail) {
+		job = &pool->jobs[pool->head % pool->size];
+		if (!job->done) {
+			if (pool->tail - pool->head <= keep)
+				break;
+			pthread_cond_wait(&pool->done, &pool->mtx);
+			continue;
+		}
+		pool->head++;
+		pthread_mutex_unlock(&pool->mtx);
+
+		if (!pool->failed && job->error != 0) {
+			maybe_warnx("deflate failed");
+			pool->failed = 1;
+		}
+		if (!pool->failed) {
+			w = write(out, job->out, job->outlen);
+			if (w == -1 || (size_t)w != job->outlen) {
+				maybe_warn("write");
+				pool->failed = 1;
+			} else {
+				*out_totp += job->outlen;
+				*crcp = crc32_combine(*crcp, job->crc,
+				    job->inlen);
+			}
+		}
+
+		pthread_mutex_lock(&pool->mtx);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (pool->failed ? -1 : 0);
+}
+
+/*
+ * Deflate in to out with pflag threads.  Returns the bytes read, -1 on
+ * error; the bytes written are added to *out_totp and *crcp is set to
+ * the CRC of the input.
+ */
+static off_t
+gz_compress_blocks(int in, int out, off_t *out_totp, uLong *crcp)
+{
+	struct gz_pool pool;
+	struct gz_job *job, *prev;
+	off_t in_tot;
+	ssize_t in_size;
+	size_t i;
+	unsigned int n;
+
+	memset(&pool, 0, sizeof pool);
+	pool.size = (size_t)pflag * GZ_WINDOW;
+	pool.level = numflag;
+	if ((pool.jobs = calloc(pool.size, sizeof(*pool.jobs))) == NULL ||
+	    (pool.threads = calloc(pflag, sizeof(pthread_t))) == NULL) {
+		free(pool.jobs);
+		maybe_warn("calloc");
+		return (-1);
+	}
+	for (i = 0; i < pool.size; i++) {
+		pool.jobs[i].in = malloc(GZ_DICT + GZ_BLOCK);
+		if (pool.jobs[i].in == NULL) {
+			maybe_warn("malloc");
+			in_tot = -1;
+			goto out;
+		}
+	}
+	pthread_mutex_init(&pool.mtx, NULL);
+	pthread_cond_init(&pool.work, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	for (n = 0; n < (unsigned int)pflag; n++)
+		if (pthread_create(&pool.threads[n], NULL, gz_worker,
+		    &pool) != 0)
+			break;
+	pool.nthreads = n;
+
+	*crcp = crc32(0L, Z_NULL, 0);
+	in_tot = 0;
+	prev = NULL;
+	for (;;) {
+		/* Keep one slot free; the workers never touch it */
+		if (gz_pool_retire(&pool, pool.size - 1, out, out_totp,
+		    crcp) != 0)
+			break;
+		job = &pool.jobs[pool.tail % pool.size];
+		job->dictlen = 0;
+		if (prev != NULL) {
+			job->dictlen = MIN(prev->dictlen + prev->inlen, GZ_DICT);
+			memcpy(job->in, prev->in + prev->dictlen + prev->inlen -
+			    job->dictlen, job->dictlen);
+		}
+		in_size = read_retry(in, job->in + job->dictlen, GZ_BLOCK);
+		if (in_size < 0) {
+			maybe_warn("read");
+			pool.failed = 1;
+			break;
+		}
+		in_tot += in_size;
+		job->inlen = in_size;
+		/* read_retry() only comes back short at the end */
+		job->last = in_size < GZ_BLOCK;
+		job->done = 0;
+
+		if (pool.nthreads == 0) {
+			job->error = gz_deflate_block(job, pool.level);
+			job->done = 1;
+		}
+		pthread_mutex_lock(&pool.mtx);
+		pool.tail++;
+		pthread_cond_signal(&pool.work);
+		pthread_mutex_unlock(&pool.mtx);
+		if (job->last)
+			break;
+		prev = job;
+	}
+
+	pthread_mutex_lock(&pool.mtx);
+	pool.finished = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.mtx);
+	if (gz_pool_retire(&pool, 0, out, out_totp, crcp) != 0)
+		in_tot = -1;
+	for (n = 0; n < pool.nthreads; n++)
+		pthread_join(pool.threads[n], NULL);
+	pthread_cond_destroy(&pool.done);
+	pthread_cond_destroy(&pool.work);
+	pthread_mutex_destroy(&pool.mtx);
+out:
+	for (i = 0; i < pool.size; i++) {
+		free(pool.jobs[i].in);
+		free(pool.jobs[i].out);
+	}
+	free(pool.jobs);
+	free(pool.threads);
+	return (in_tot);
+}
+#endif
+
 /* compress input to output. Return bytes read, -1 on error */
 static off_t
 gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime)
@@ -642,6 +965,21 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 		i++;
 #endif
 
+#ifndef SMALL
+	if (pflag > 1) {
+		if (write(out, outbufp, i) != i) {
+			maybe_warn("write");
+			out_tot = -1;
+			goto out;
+		}
+		out_tot = i;
+		in_tot = gz_compress_blocks(in, out, &out_tot, &crc);
+		if (in_tot == -1)
+			goto out;
+		goto trailer;
+	}
+#endif
+
 	z.next_out = (unsigned char *)outbufp + i;
 	z.avail_out = BUFLEN - i;
 
@@ -725,6 +1063,9 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 		goto out;
 	}
 
+#ifndef SMALL
+trailer:
+#endif
 	i = snprintf(outbufp, BUFLEN, "%c%c%c%c%c%c%c%c", 
 		 (int)crc & 0xff,
 		 (int)(crc >> 8) & 0xff,
@@ -752,6 +1093,119 @@ out:
 	return in_tot;
 }
 
+#ifndef SMALL
+/*
+ * gz_uncompress() hands each full output buffer to a second thread and
+ * goes on inflating into the other one, so that writing overlaps with
+ * inflating.
+ */
+struct gz_writer {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	pthread_t	 thread;
+	int		 fd;
+	char		*spare;		/* buffer free for the inflater */
+	char		*pending;	/* buffer being written, or NULL */
+	size_t		 len;
+	int		 error;		/* errno of a failed write */
+	int		 finished;
+};
+
+static void *
+gz_writer_thread(void *arg)
+{
+	struct gz_writer *w = arg;
+	ssize_t wr;
+
+	pthread_mutex_lock(&w->mtx);
+	for (;;) {
+		while (w->pending == NULL && !w->finished)
+			pthread_cond_wait(&w->cv, &w->mtx);
+		if (w->pending == NULL)
+			break;
+		pthread_mutex_unlock(&w->mtx);
+
+		if (w->error == 0) {
+			wr = write(w->fd, w->pending, w->len);
+			if (wr == -1 || (size_t)wr != w->len)
+				w->error = wr == -1 ? errno : EIO;
+		}
+
+		pthread_mutex_lock(&w->mtx);
+		w->pending = NULL;
+		pthread_cond_signal(&w->cv);
+	}
+	pthread_mutex_unlock(&w->mtx);
+	return (NULL);
+}
+
+static int
+gz_writer_start(struct gz_writer *w, int fd)
+{
+
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	if ((w->spare = malloc(BUFLEN)) == NULL)
+		return (-1);
+	pthread_mutex_init(&w->mtx, NULL);
+	pthread_cond_init(&w->cv, NULL);
+	if (pthread_create(&w->thread, NULL, gz_writer_thread, w) != 0) {
+		pthread_cond_destroy(&w->cv);
+		pthread_mutex_destroy(&w->mtx);
+		free(w->spare);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Queue the len bytes at *bufp for writing and replace *bufp with a free
+ * buffer.  Returns -1, with errno set, if an earlier write failed.
+ */
+static int
+gz_writer_put(struct gz_writer *w, char **bufp, size_t len)
+{
+	int error;
+
+	pthread_mutex_lock(&w->mtx);
+	while (w->pending != NULL)
+		pthread_cond_wait(&w->cv, &w->mtx);
+	if ((error = w->error) == 0) {
+		w->pending = *bufp;
+		w->len = len;
+		*bufp = w->spare;
+		w->spare = w->pending;
+		pthread_cond_signal(&w->cv);
+	}
+	pthread_mutex_unlock(&w->mtx);
+	if (error != 0) {
+		errno = error;
+		return (-1);
+	}
+	return (0);
+}
+
+/* Wait for the last write.  Returns -1, with errno set, if any failed. */
+static int
+gz_writer_finish(struct gz_writer *w)
+{
+
+	pthread_mutex_lock(&w->mtx);
+	w->finished = 1;
+	pthread_cond_signal(&w->cv);
+	pthread_mutex_unlock(&w->mtx);
+	pthread_join(w->thread, NULL);
+	pthread_cond_destroy(&w->cv);
+	pthread_mutex_destroy(&w->mtx);
+	free(w->spare);
+	if (w->error != 0) {
+		errno = w->error;
+		return (-1);
+	}
+	return (0);
+}
+#endif
+
 /*
  * uncompress input to output then close the input.  return the
  * uncompressed size written, and put the compressed sized read
@@ -788,6 +1242,9 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 	uLong crc = 0;
 	ssize_t wr;
 	int needmore = 0;
+#ifndef SMALL
+	struct gz_writer writer_s, *writer = NULL;
+#endif
 
 #define ADVANCE()       { z.next_in++; z.avail_in--; }
 
@@ -812,6 +1269,12 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 	in_tot = prelen;
 	out_tot = 0;
 
+#ifndef SMALL
+	/* Without the thread, the output is written inline */
+	if (tflag == 0 && gz_writer_start(&writer_s, out) == 0)
+		writer = &writer_s;
+#endif
+
 	for (;;) {
 		if ((z.avail_in == 0 || needmore) && done_reading == 0) {
 			ssize_t in_size;
@@ -996,6 +1459,15 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 
 			if (wr != 0) {
 				crc = crc32(crc, (const Bytef *)outbufp, (unsigned)wr);
+#ifndef SMALL
+				if (writer != NULL) {
+					if (gz_writer_put(writer, &outbufp,
+					    wr) != 0) {
+						maybe_warn("error writing to output");
+						goto stop_and_fail;
+					}
+				} else
+#endif
 				if (
 #ifndef SMALL
 				    /* don't write anything with -t */
@@ -1092,6 +1564,13 @@ stop:
 	}
 	if (state > GZSTATE_INIT)
 		inflateEnd(&z);
+#ifndef SMALL
+	if (writer != NULL && gz_writer_finish(writer) != 0 &&
+	    out_tot != -1) {
+		maybe_warn("error writing to output");
+		out_tot = -1;
+	}
+#endif
 
 	free(inbufp);
 out1:
@@ -1771,6 +2250,13 @@ handle_stdin(void)
 	}
 #endif
 
+#ifndef SMALL
+	if (range_start != -1) {
+		gz_range_file(NULL, NULL);
+		return;
+	}
+#endif
+
 	if (lflag) {
 		struct stat isb;
 
@@ -1978,6 +2464,16 @@ handle_file(char *file, struct stat *sbp)
 	char	outfile[PATH_MAX];
 
 	infile = file;
+#ifndef SMALL
+	if (index_span != 0) {
+		gz_index_file(file, sbp);
+		return;
+	}
+	if (range_start != -1) {
+		gz_range_file(file, sbp);
+		return;
+	}
+#endif
 	if (dflag) {
 		usize = file_uncompress(file, outfile, sizeof(outfile));
 #ifndef SMALL
@@ -2192,7 +2688,8 @@ usage(void)
 #ifdef SMALL
     "usage: %s [-" OPT_LIST "] [<file> [<file> ...]]\n",
 #else
-    "usage: %s [-123456789acdfhklLNnqrtVv] [-S .suffix] [<file> [<file> ...]]\n"
+    "usage: %s [-123456789acdfhklLNnqrtVv] [-p n] [-S .suffix]\n"
+    "       [--index[=MiB] | --range=start[,length]] [<file> [<file> ...]]\n"
     " -1 --fast            fastest (worst) compression\n"
     " -2 .. -8             set compression level\n"
     " -9 --best            best (slowest) compression\n"
@@ -2206,13 +2703,19 @@ usage(void)
     " -l --list            list compressed file contents\n"
     " -N --name            save or restore original file name and time stamp\n"
     " -n --no-name         don't save original file name or time stamp\n"
+    " -p --processes n     compress with n threads\n"
     " -q --quiet           output no warnings\n"
     " -r --recursive       recursively compress files in directories\n"
     " -S .suf              use suffix .suf instead of .gz\n"
     "    --suffix .suf\n"
     " -t --test            test compressed file\n"
     " -V --version         display program version\n"
-    " -v --verbose         print extra statistics\n",
+    " -v --verbose         print extra statistics\n"
+    "    --index[=MiB]     write a <file>.gzx access point index, one\n"
+    "                      access point per MiB of output (default 1)\n"
+    "    --range=start[,length]\n"
+    "                      write only the given range of the uncompressed\n"
+    "                      data to stdout, using <file>.gzx if present\n",
 #endif
 	    ios_progname());
 	exit(0);
@@ -2255,6 +2758,9 @@ display_version(void)
 #ifndef NO_XZ_SUPPORT
 #include "unxz.c"
 #endif
+#ifndef SMALL
+#include "gzindex.c"
+#endif
 
 static ssize_t
 read_retry(int fd, void *buf, size_t sz)
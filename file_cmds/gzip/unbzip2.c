@@ -33,6 +33,575 @@
 
 /* This file is #included by gzip.c */
 
+#ifndef SMALL
+/*
+ * bzip2 blocks are independent: each one starts with a 48-bit magic
+ * number, at any bit offset, and carries the CRC of its data.  With -p,
+ * the blocks are cut out of the input, each is wrapped into a stream of
+ * its own and they are decoded in parallel, then written out in order.
+ * The block magic can also turn up inside compressed data; a block cut
+ * short by such a false match fails to decode, and is joined to the
+ * next one and decoded again.
+ */
+#define	BZ_BLOCK_MAGIC	0x314159265359ULL
+#define	BZ_EOS_MAGIC	0x177245385090ULL
+#define	BZ_MAGIC_MASK	0xffffffffffffULL
+#define	BZ_MAXBLOCK	(2 * 1024 * 1024)	/* Well over a 900k block */
+#define	BZ_READ		(1024 * 1024)
+#define	BZ_WINDOW	2		/* Blocks in flight per thread */
+
+struct bz_job {
+	unsigned char	*bits;		/* The block, from its magic */
+	size_t		 nbits;
+	size_t		 bitsize;	/* Bytes allocated */
+	uint32_t	 crc;		/* Block CRC, or the stream's at eos */
+	int		 level;		/* Block size of the stream, 1-9 */
+	int		 eos;		/* Not a block: the end of a stream */
+	unsigned char	*in;		/* The block as a stream */
+	size_t		 insize;
+	unsigned char	*out;
+	size_t		 outsize;
+	size_t		 outlen;
+	int		 error;
+	int		 done;
+};
+
+struct bz_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;
+	pthread_cond_t	 done;
+	struct bz_job	*jobs;
+	size_t		 size;
+	size_t		 head;		/* Next to be written out */
+	size_t		 next;		/* Next to be decoded */
+	size_t		 tail;		/* Next free slot */
+	int		 finished;
+	int		 failed;	/* Nothing more is written */
+	uint32_t	 combined;	/* CRC of the stream so far */
+	pthread_t	*threads;
+	unsigned int	 nthreads;
+};
+
+/* Bits [bit, bit + n) of buf, most significant first, n <= 57 */
+static uint64_t
+bz_getbits(const unsigned char *buf, size_t bit, int n)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | buf[(bit >> 3) + i];
+	return ((v << (bit & 7)) >> (64 - n));
+}
+
+static void
+bz_putbits(unsigned char *buf, size_t bit, uint64_t v, int n)
+{
+	unsigned char mask;
+
+	while (n-- > 0) {
+		mask = 0x80 >> (bit & 7);
+		if ((v >> n) & 1)
+			buf[bit >> 3] |= mask;
+		else
+			buf[bit >> 3] &= ~mask;
+		bit++;
+	}
+}
+
+/*
+ * Append nbits of src, from bit srcbit, to job->bits.  src needs 8
+ * readable bytes past the last bit.
+ */
+static int
+bz_addbits(struct bz_job *job, const unsigned char *src, size_t srcbit,
+    size_t nbits)
+{
+	size_t need, i, q;
+	unsigned int r;
+
+	need = (job->nbits + nbits + 7) / 8 + 8;
+	if (need > job->bitsize) {
+		if ((job->bits = realloc(job->bits, need * 2)) == NULL) {
+			job->bitsize = 0;
+			return (-1);
+		}
+		job->bitsize = need * 2;
+	}
+	if ((job->nbits & 7) != 0) {
+		/* Only when joining blocks: no need to be quick */
+		for (i = 0; i < nbits; i++)
+			bz_putbits(job->bits, job->nbits + i,
+			    bz_getbits(src, srcbit + i, 1), 1);
+	} else {
+		q = srcbit >> 3;
+		r = srcbit & 7;
+		for (i = 0; i < (nbits + 7) / 8; i++, q++)
+			job->bits[job->nbits / 8 + i] = r == 0 ? src[q] :
+			    (unsigned char)((src[q] << r) | (src[q + 1] >> (8 - r)));
+	}
+	job->nbits += nbits;
+	return (0);
+}
+
+/*
+ * Decode the block of a job: a stream header, the block, and an end of
+ * stream whose CRC is that of the block.
+ */
+static int
+bz_decode_block(struct bz_job *job)
+{
+	bz_stream bzs;
+	size_t len;
+	int ret;
+
+	len = 4 + (job->nbits + 80 + 7) / 8;
+	if (len > job->insize) {
+		free(job->in);
+		if ((job->in = malloc(len)) == NULL) {
+			job->insize = 0;
+			return (-1);
+		}
+		job->insize = len;
+	}
+	job->in[0] = 'B';
+	job->in[1] = 'Z';
+	job->in[2] = 'h';
+	job->in[3] = '0' + job->level;
+	memcpy(job->in + 4, job->bits, (job->nbits + 7) / 8);
+	bz_putbits(job->in, 32 + job->nbits, BZ_EOS_MAGIC, 48);
+	bz_putbits(job->in, 80 + job->nbits, job->crc, 32);
+
+	memset(&bzs, 0, sizeof bzs);
+	if (BZ2_bzDecompressInit(&bzs, 0, 0) != BZ_OK)
+		return (-1);
+	bzs.next_in = (char *)job->in;
+	bzs.avail_in = len;
+	job->outlen = 0;
+	for (;;) {
+		if (job->outsize - job->outlen == 0) {
+			job->outsize = MAX(job->outsize * 2,
+			    (size_t)job->level * 100000 + BUFLEN);
+			if ((job->out = realloc(job->out,
+			    job->outsize)) == NULL) {
+				job->outsize = 0;
+				ret = -1;
+				break;
+			}
+		}
+		bzs.next_out = (char *)job->out + job->outlen;
+		bzs.avail_out = job->outsize - job->outlen;
+		ret = BZ2_bzDecompress(&bzs);
+		job->outlen = job->outsize - bzs.avail_out;
+		if (ret == BZ_STREAM_END) {
+			ret = 0;
+			break;
+		}
+		/* Out of input with room to spare: cut short */
+		if (ret != BZ_OK || (bzs.avail_in == 0 && bzs.avail_out != 0)) {
+			ret = -1;
+			break;
+		}
+	}
+	(void)BZ2_bzDecompressEnd(&bzs);
+	return (ret);
+}
+
+static void *
+bz_worker(void *arg)
+{
+	struct bz_pool *pool = arg;
+	struct bz_job *job;
+
+	pthread_mutex_lock(&pool->mtx);
+	for (;;) {
+		while (pool->next == pool->tail && !pool->finished)
+			pthread_cond_wait(&pool->work, &pool->mtx);
+		if (pool->next == pool->tail)
+			break;
+		job = &pool->jobs[pool->next++ % pool->size];
+		pthread_mutex_unlock(&pool->mtx);
+
+		job->error = job->eos ? 0 : bz_decode_block(job);
+
+		pthread_mutex_lock(&pool->mtx);
+		job->done = 1;
+		pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (NULL);
+}
+
+/*
+ * Write out the jobs at the head of the window as they complete, until
+ * no more than "keep" are left in flight.  A block that did not decode
+ * is joined to the one after it, which is then decoded again here.
+ * Returns -1 on error.
+ */
+static int
+bz_pool_retire(struct bz_pool *pool, size_t keep, int out, off_t *bytes_out)
+{
+	struct bz_job *job, *next;
+	unsigned char *bits;
+	size_t bitsize;
+	ssize_t w;
+
+	pthread_mutex_lock(&pool->mtx);
+	while (pool->head != pool->tail && !pool->failed) {
+		job = &pool->jobs[pool->head % pool->size];
+		next = &pool->jobs[(pool->head + 1) % pool->size];
+		if (!job->done || (job->error != 0 &&
+		    pool->head + 1 != pool->tail && !next->done)) {
+			if (pool->tail - pool->head <= keep)
+				break;
+			pthread_cond_wait(&pool->done, &pool->mtx);
+			continue;
+		}
+		if (job->error != 0 && pool->head + 1 == pool->tail) {
+			/* The next block is not in yet */
+			if (keep > 0)
+				break;
+			maybe_warnx("bzip2 data integrity error");
+			pool->failed = 1;
+			break;
+		}
+		pool->head++;
+		pthread_mutex_unlock(&pool->mtx);
+
+		if (job->eos) {
+			if (job->crc != pool->combined) {
+				maybe_warnx("bzip2 data integrity error");
+				pool->failed = 1;
+			}
+			pool->combined = 0;
+		} else if (job->error != 0) {
+			/*
+			 * Take the bits of the next block after these, and
+			 * this CRC: the block is whole again, or still not.
+			 */
+			if (next->eos || job->nbits + next->nbits >
+			    (size_t)BZ_MAXBLOCK * 8) {
+				maybe_warnx("bzip2 data integrity error");
+				pool->failed = 1;
+			} else if (bz_addbits(job, next->bits, 0,
+			    next->nbits) != 0) {
+				maybe_warn("malloc");
+				pool->failed = 1;
+			} else {
+				bits = next->bits;
+				bitsize = next->bitsize;
+				next->bits = job->bits;
+				next->bitsize = job->bitsize;
+				next->nbits = job->nbits;
+				job->bits = bits;
+				job->bitsize = bitsize;
+				next->crc = job->crc;
+				next->error = bz_decode_block(next);
+			}
+		} else {
+			if (!tflag) {
+				w = write(out, job->out, job->outlen);
+				if (w == -1 || (size_t)w != job->outlen) {
+					maybe_warn("write");
+					pool->failed = 1;
+				}
+			}
+			*bytes_out += job->outlen;
+			pool->combined = ((pool->combined << 1) |
+			    (pool->combined >> 31)) ^ job->crc;
+		}
+
+		pthread_mutex_lock(&pool->mtx);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return (pool->failed ? -1 : 0);
+}
+
+/*
+ * The bzip2 input, read as it is needed.  Bit offsets are from buf,
+ * which moves along as the blocks before it are handed out.
+ */
+struct bz_input {
+	int		 fd;
+	unsigned char	*buf;
+	size_t		 len;		/* Bytes in buf */
+	size_t		 size;		/* Bytes allocated, less 8 of slack */
+	int		 eof;
+	off_t		*bytes_in;
+};
+
+/* Have at least want bytes in buf, or all there is.  Returns -1 on error */
+static int
+bz_input_fill(struct bz_input *bi, size_t want)
+{
+	ssize_t n;
+
+	while (bi->len < want && !bi->eof) {
+		if (bi->size - bi->len < BZ_READ) {
+			bi->size = MAX(bi->size * 2, bi->len + BZ_READ);
+			if ((bi->buf = realloc(bi->buf, bi->size + 8)) == NULL) {
+				maybe_warn("malloc");
+				return (-1);
+			}
+		}
+		n = read_retry(bi->fd, bi->buf + bi->len, BZ_READ);
+		if (n < 0) {
+			maybe_warn("read");
+			return (-1);
+		}
+		if (bi->bytes_in)
+			*bi->bytes_in += n;
+		if (n < BZ_READ)
+			bi->eof = 1;
+		bi->len += n;
+	}
+	/* Slack for bz_getbits() and bz_addbits() */
+	memset(bi->buf + bi->len, 0, 8);
+	return (0);
+}
+
+/*
+ * Find the next block or end of stream magic at or after bit.  Returns
+ * its bit offset, -1 on error, or -2 if the input ends first.
+ */
+static ssize_t
+bz_input_scan(struct bz_input *bi, size_t bit)
+{
+	uint64_t acc, m;
+	size_t i, stop;
+	int k;
+
+	for (i = bit >> 3;; i++) {
+		if (i + 8 > bi->len) {
+			if (bz_input_fill(bi, i + 8 + BZ_READ) != 0)
+				return (-1);
+			if (i + 8 > bi->len)
+				break;
+		}
+		acc = 0;
+		for (k = 0; k < 8; k++)
+			acc = (acc << 8) | bi->buf[i + k];
+		for (k = 0; k < 8; k++) {
+			m = (acc >> (16 - k)) & BZ_MAGIC_MASK;
+			if ((m == BZ_BLOCK_MAGIC || m == BZ_EOS_MAGIC) &&
+			    i * 8 + k >= bit)
+				return ((ssize_t)(i * 8 + k));
+		}
+	}
+	/* The last 7 bytes */
+	stop = bi->len * 8;
+	for (i = MAX(bit, stop >= 56 ? stop - 56 : 0); i + 48 <= stop; i++) {
+		m = bz_getbits(bi->buf, i, 48);
+		if (m == BZ_BLOCK_MAGIC || m == BZ_EOS_MAGIC)
+			return ((ssize_t)i);
+	}
+	return (-2);
+}
+
+/*
+ * Whether the end of stream magic at bit is followed by the end of the
+ * input or by another stream.  Returns 1, 0, or -1 on error.
+ */
+static int
+bz_eos_follows(struct bz_input *bi, size_t bit)
+{
+	size_t p;
+	uint64_t m;
+
+	p = ((bit + 80 + 7) & ~(size_t)7) / 8;
+	if (bz_input_fill(bi, p + 10) != 0)
+		return (-1);
+	if (p == bi->len)
+		return (1);
+	if (p + 10 > bi->len || memcmp(bi->buf + p, BZIP2_MAGIC, 3) != 0 ||
+	    bi->buf[p + 3] < '1' || bi->buf[p + 3] > '9')
+		return (0);
+	m = bz_getbits(bi->buf, (p + 4) * 8, 48);
+	return (m == BZ_BLOCK_MAGIC || m == BZ_EOS_MAGIC);
+}
+
+/*
+ * Decompress the bzip2 streams of in to out with pflag threads.
+ */
+static off_t
+unbzip2_blocks(int in, int out, char *pre, size_t prelen, off_t *bytes_in)
+{
+	struct bz_input bi;
+	struct bz_pool pool;
+	struct bz_job *job;
+	off_t bytes_out = 0;
+	ssize_t nxt, fake;
+	size_t i, bit, drop, from;
+	int level = 0, error = 0, r;
+	unsigned int n;
+	uint64_t m;
+
+	memset(&bi, 0, sizeof bi);
+	bi.fd = in;
+	bi.bytes_in = bytes_in;
+	if (bytes_in)
+		*bytes_in = prelen;
+	bi.size = MAX(prelen, BZ_READ);
+	if ((bi.buf = malloc(bi.size + 8)) == NULL) {
+		maybe_warn("malloc");
+		return (-1);
+	}
+	memcpy(bi.buf, pre, prelen);
+	bi.len = prelen;
+
+	memset(&pool, 0, sizeof pool);
+	pool.size = (size_t)pflag * BZ_WINDOW;
+	if ((pool.jobs = calloc(pool.size, sizeof(*pool.jobs))) == NULL ||
+	    (pool.threads = calloc(pflag, sizeof(pthread_t))) == NULL) {
+		free(pool.jobs);
+		free(bi.buf);
+		maybe_warn("calloc");
+		return (-1);
+	}
+	pthread_mutex_init(&pool.mtx, NULL);
+	pthread_cond_init(&pool.work, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	for (n = 0; n < (unsigned int)pflag; n++)
+		if (pthread_create(&pool.threads[n], NULL, bz_worker,
+		    &pool) != 0)
+			break;
+	pool.nthreads = n;
+
+	/* bit is where the next stream, block or end of stream starts */
+	bit = 0;
+	for (;;) {
+		/* Keep one slot free; the workers never touch it */
+		if (bz_pool_retire(&pool, pool.size - 1, out,
+		    &bytes_out) != 0)
+			break;
+
+		/* Hand out the input before this point */
+		drop = bit >> 3;
+		if (drop > BZ_READ) {
+			memmove(bi.buf, bi.buf + drop, bi.len - drop);
+			bi.len -= drop;
+			bit -= drop * 8;
+		}
+
+		if (level == 0) {
+			/* A stream header, or the end of the input */
+			bit = (bit + 7) & ~(size_t)7;
+			if (bz_input_fill(&bi, bit / 8 + 4) != 0) {
+				error = 1;
+				break;
+			}
+			if (bit / 8 == bi.len && pool.tail > 0)
+				break;
+			if (bit / 8 + 4 > bi.len ||
+			    memcmp(bi.buf + bit / 8, BZIP2_MAGIC, 3) != 0 ||
+			    bi.buf[bit / 8 + 3] < '1' ||
+			    bi.buf[bit / 8 + 3] > '9') {
+				maybe_warnx("bzip2 magic number error");
+				error = 1;
+				break;
+			}
+			level = bi.buf[bit / 8 + 3] - '0';
+			bit += 32;
+		}
+
+		if (bz_input_fill(&bi, bit / 8 + 18) != 0) {
+			error = 1;
+			break;
+		}
+		if (bit + 80 > bi.len * 8) {
+			maybe_warnx("truncated file");
+			error = 1;
+			break;
+		}
+		m = bz_getbits(bi.buf, bit, 48);
+		if (m != BZ_BLOCK_MAGIC && m != BZ_EOS_MAGIC) {
+			maybe_warnx("bzip2 data integrity error");
+			error = 1;
+			break;
+		}
+
+		job = &pool.jobs[pool.tail % pool.size];
+		job->nbits = 0;
+		job->level = level;
+		job->crc = (uint32_t)bz_getbits(bi.buf, bit + 48, 32);
+		job->eos = m == BZ_EOS_MAGIC;
+		job->error = 0;
+		job->done = 0;
+		if (job->eos) {
+			bit += 80;
+			level = 0;
+		} else {
+			/*
+			 * The block runs up to the next magic.  An end of
+			 * stream must be followed by another stream or by
+			 * nothing; if none is, the first one found is taken,
+			 * and what follows it is reported.
+			 */
+			from = bit + 80;
+			fake = -1;
+			for (;;) {
+				nxt = bz_input_scan(&bi, from);
+				if (nxt == -2 && fake >= 0)
+					nxt = fake;
+				if (nxt < 0 || nxt == fake ||
+				    bz_getbits(bi.buf, nxt, 48) == BZ_BLOCK_MAGIC)
+					break;
+				if ((r = bz_eos_follows(&bi, nxt)) != 0) {
+					if (r == -1)
+						nxt = -1;
+					break;
+				}
+				if (fake < 0)
+					fake = nxt;
+				from = nxt + 1;
+			}
+			if (nxt == -2)
+				maybe_warnx("truncated file");
+			if (nxt < 0)
+				error = 1;
+			else if (bz_addbits(job, bi.buf + bit / 8,
+			    bit & 7, (size_t)nxt - bit) != 0) {
+				maybe_warn("malloc");
+				error = 1;
+			}
+			if (error)
+				break;
+			bit = (size_t)nxt;
+		}
+
+		if (pool.nthreads == 0) {
+			job->error = job->eos ? 0 : bz_decode_block(job);
+			job->done = 1;
+		}
+		pthread_mutex_lock(&pool.mtx);
+		pool.tail++;
+		pthread_cond_signal(&pool.work);
+		pthread_mutex_unlock(&pool.mtx);
+	}
+	pthread_mutex_lock(&pool.mtx);
+	pool.finished = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.mtx);
+	/* What was decoded before an error is still written out */
+	(void)bz_pool_retire(&pool, 0, out, &bytes_out);
+	for (n = 0; n < pool.nthreads; n++)
+		pthread_join(pool.threads[n], NULL);
+	pthread_cond_destroy(&pool.done);
+	pthread_cond_destroy(&pool.work);
+	pthread_mutex_destroy(&pool.mtx);
+
+	for (i = 0; i < pool.size; i++) {
+		free(pool.jobs[i].bits);
+		free(pool.jobs[i].in);
+		free(pool.jobs[i].out);
+	}
+	free(pool.jobs);
+	free(pool.threads);
+	free(bi.buf);
+	return (pool.failed || error ? -1 : bytes_out);
+}
+#endif
+
 static off_t
 unbzip2(int in, int out, char *pre, size_t prelen, off_t *bytes_in)
 {
@@ -41,6 +610,11 @@ unbzip2(int in, int out, char *pre, size_t prelen, off_t *bytes_in)
 	bz_stream	bzs;
 	static char	*inbuf, *outbuf;
 
+#ifndef SMALL
+	if (pflag > 1)
+		return (unbzip2_blocks(in, out, pre, prelen, bytes_in));
+#endif
+
 	if (inbuf == NULL)
 		inbuf = malloc(BUFLEN);
 	if (outbuf == NULL)
@@ -40,12 +40,11 @@
 
 static int	zread(void *, char *, int);
 
-#define	tab_prefixof(i)	(zs->zs_codetab[i])
-#define	tab_suffixof(i)	((char_type *)(zs->zs_htab))[i]
-#define	de_stack	((char_type *)&tab_suffixof(1 << BITS))
+#define	tab_prefixof(i)	(zs->zs_prefix[i])
+#define	tab_suffixof(i)	(zs->zs_suffix[i])
+#define	de_stack	(zs->zs_stack)
 
 #define BITS		16		/* Default bits. */
-#define HSIZE		69001		/* 95% occupancy */ /* XXX may not need HSIZE */
 #define BIT_MASK	0x1f		/* Defines for third byte of header. */
 #define BLOCK_MASK	0x80
 #define CHECK_GAP	10000		/* Ratio check interval. */
@@ -91,9 +90,6 @@ struct s_zstate {
 	int zs_maxbits;			/* User settable max # bits/code. */
 	code_int zs_maxcode;		/* Maximum code, given n_bits. */
 	code_int zs_maxmaxcode;		/* Should NEVER generate this code. */
-	count_int zs_htab [HSIZE];
-	u_short zs_codetab [HSIZE];
-	code_int zs_hsize;		/* For dynamic table sizing. */
 	code_int zs_free_ent;		/* First unused entry. */
 	/*
 	 * Block compression parameters -- after all codes are used up,
@@ -123,8 +119,19 @@ struct s_zstate {
 			char_type zs_gbuf[BITS];
 		} r;			/* Read parameters */
 	} u;
+	/* The tables come last: zdopen() clears only what is above them. */
+	u_short zs_prefix[1 << BITS];
+	char_type zs_suffix[1 << BITS];
+	char_type zs_stack[1 << BITS];
 };
 
+/*
+ * As in compress(1), the state of a closed stream is kept for the next
+ * zdopen(), so that zcat on many small files allocates it only once.
+ */
+static pthread_mutex_t zs_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct s_zstate *zs_cache;
+
 static code_int	getcode(struct s_zstate *zs);
 
 static off_t
@@ -163,6 +170,12 @@ zuncompress(FILE *in, FILE *out, char *pre, size_t prelen,
 static int
 zclose(void *zs)
 {
+	pthread_mutex_lock(&zs_cache_lock);
+	if (zs_cache == NULL) {
+		zs_cache = zs;
+		zs = NULL;
+	}
+	pthread_mutex_unlock(&zs_cache_lock);
 	free(zs);
 	/* We leave the caller to close the fd passed to zdopen() */
 	return 0;
@@ -173,13 +186,18 @@ zdopen(int fd)
 {
 	struct s_zstate *zs;
 
-	if ((zs = calloc(1, sizeof(struct s_zstate))) == NULL)
+	pthread_mutex_lock(&zs_cache_lock);
+	zs = zs_cache;
+	zs_cache = NULL;
+	pthread_mutex_unlock(&zs_cache_lock);
+	if (zs == NULL && (zs = malloc(sizeof(struct s_zstate))) == NULL)
 		return (NULL);
+	/* The tables are set up before they are read. */
+	memset(zs, 0, offsetof(struct s_zstate, zs_prefix));
 
 	zs->zs_state = S_START;
 
 	/* XXX we can get rid of some of these */
-	zs->zs_hsize = HSIZE;			/* For dynamic table sizing. */
 	zs->zs_free_ent = 0;			/* First unused entry. */
 	zs->zs_block_compress = BLOCK_MASK;
 	zs->zs_clear_flg = 0;			/* XXX we calloc()'d this structure why = 0? */
@@ -195,7 +213,7 @@ zdopen(int fd)
 	 * and ensure that reads and write work with the data specified.
 	 */
 	if ((zs->zs_fp = fdopen(fd, "r")) == NULL) {
-		free(zs);
+		zclose(zs);
 		return NULL;
 	}
 
@@ -50,6 +50,7 @@ __used static const char rcsid[] =
 #include <sys/wait.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/mount.h>
 
 #include <ctype.h>
@@ -70,6 +71,7 @@ __used static const char rcsid[] =
 #ifdef __APPLE__
 #include <TargetConditionals.h>
 #include <copyfile.h>
+#include <sys/clonefile.h>
 #endif	/* __APPLE__ */
 
 #include "pathnames.h"
@@ -92,10 +94,12 @@ int dobackup, docompare, dodir, dopreserve, dostrip, nommap, safecopy, verbose;
 mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
 char *suffix = BACKUP_SUFFIX;
 
+int	create_clone __P((int, char *));
 void	copy __P((int, char *, int, char *, off_t));
 int	compare __P((int, const char *, size_t, int, const char *, size_t));
-int	create_newfile __P((char *, int, struct stat *));
-int	create_tempfile __P((char *, char *, size_t));
+int	create_newfile __P((char *, int, struct stat *, int, int *));
+int	create_tempfile __P((char *, char *, size_t, int, int *));
+int	same_stat __P((struct stat *, struct stat *));
 void	install __P((char *, char *, u_long, u_int));
 void	install_dir __P((char *));
 u_long	numeric_id __P((char *, char *));
@@ -279,7 +283,8 @@ install(from_name, to_name, fset, flags)
 {
 	struct stat from_sb, temp_sb, to_sb;
 	struct utimbuf utb;
-	int devnull, files_match, from_fd=0, serrno, target;
+	struct timespec times[2];
+	int cloned, devnull, files_match, from_fd=0, serrno, target;
 	int tempcopy, temp_fd, to_fd=0;
 	char backup[MAXPATHLEN], *p, pathbuf[MAXPATHLEN], tempfile[MAXPATHLEN];
 
@@ -326,6 +331,8 @@ install(from_name, to_name, fset, flags)
 			err(EX_OSERR, "%s", to_name);
 		if (devnull)
 			files_match = to_sb.st_size == 0;
+		else if (same_stat(&from_sb, &to_sb))
+			files_match = 1;
 		else
 			files_match = !(compare(from_fd, from_name,
 			    (size_t)from_sb.st_size, to_fd,
@@ -337,20 +344,25 @@ install(from_name, to_name, fset, flags)
 	}
 
 	if (!files_match) {
+		cloned = 0;
 		if (tempcopy) {
 			to_fd = create_tempfile(to_name, tempfile,
-			    sizeof(tempfile));
+			    sizeof(tempfile), devnull ? -1 : from_fd, &cloned);
 			if (to_fd < 0)
 				err(EX_OSERR, "%s", tempfile);
 		} else {
 			if ((to_fd = create_newfile(to_name, target,
-			    &to_sb)) < 0)
+			    &to_sb, devnull ? -1 : from_fd, &cloned)) < 0)
 				err(EX_OSERR, "%s", to_name);
 			if (verbose)
 				(void)printf("install: %s -> %s\n",
 				    from_name, to_name);
 		}
-		if (!devnull)
+		if (cloned) {
+			/* A clone keeps the source's times. */
+			if (!dopreserve)
+				(void)futimes(to_fd, NULL);
+		} else if (!devnull)
 			copy(from_fd, from_name, to_fd,
 			     tempcopy ? tempfile : to_name, from_sb.st_size);
 	}
@@ -456,9 +468,10 @@ install(from_name, to_name, fset, flags)
 	 * Preserve the timestamp of the source file if necessary.
 	 */
 	if (dopreserve && !files_match && !devnull) {
-		utb.actime = from_sb.st_atime;
-		utb.modtime = from_sb.st_mtime;
-		(void)utime(to_name, &utb);
+		/* To the nanosecond, for same_stat() next time. */
+		times[0] = from_sb.st_atimespec;
+		times[1] = from_sb.st_mtimespec;
+		(void)futimens(to_fd, times);
 	}
 
 	if (fstat(to_fd, &to_sb) == -1) {
@@ -598,17 +611,63 @@ compare(int from_fd, const char *from_name, size_t from_len,
 	return rv;
 }
 
+/*
+ * same_stat --
+ *	true if the target has the source's size and modification time,
+ *	as left by an earlier install -p, so neither needs to be read
+ */
+int
+same_stat(from_sbp, to_sbp)
+	struct stat *from_sbp, *to_sbp;
+{
+
+	return (from_sbp->st_size == to_sbp->st_size &&
+	    from_sbp->st_mtimespec.tv_sec == to_sbp->st_mtimespec.tv_sec &&
+	    from_sbp->st_mtimespec.tv_nsec == to_sbp->st_mtimespec.tv_nsec);
+}
+
+/*
+ * create_clone --
+ *	create path as a clone of from_fd and open it; -1 if the file
+ *	system can't, and the data must be copied
+ */
+int
+create_clone(from_fd, path)
+	int from_fd;
+	char *path;
+{
+#ifdef __APPLE__
+	int fd;
+
+#ifdef CLONE_NOOWNERCOPY
+	if (fclonefileat(from_fd, AT_FDCWD, path, CLONE_NOOWNERCOPY) < 0)
+#else
+	if (fclonefileat(from_fd, AT_FDCWD, path, 0) < 0)
+#endif
+		return (-1);
+	if ((fd = open(path, O_RDWR, 0)) < 0)
+		(void)unlink(path);
+	return (fd);
+#else	/* !__APPLE__ */
+	return (-1);
+#endif	/* __APPLE__ */
+}
+
 /*
  * create_tempfile --
- *	create a temporary file based on path and open it
+ *	create a temporary file based on path and open it, as a clone of
+ *	from_fd if it is not -1 and that works
  */
 int
-create_tempfile(path, temp, tsize)
+create_tempfile(path, temp, tsize, from_fd, clonedp)
 	char *path;
 	char *temp;
 	size_t tsize;
+	int from_fd;
+	int *clonedp;
 {
 	char *p;
+	int fd;
 
 	(void)strncpy(temp, path, tsize);
 	temp[tsize - 1] = '\0';
@@ -618,20 +677,34 @@ create_tempfile(path, temp, tsize)
 		p = temp;
 	(void)strncpy(p, "INS@XXXX", &temp[tsize - 1] - p);
 	temp[tsize - 1] = '\0';
-	return (mkstemp(temp));
+	if ((fd = mkstemp(temp)) < 0 || from_fd < 0)
+		return (fd);
+
+	/* The name is ours now; put the clone in its place. */
+	(void)close(fd);
+	(void)unlink(temp);
+	if ((fd = create_clone(from_fd, temp)) >= 0) {
+		*clonedp = 1;
+		return (fd);
+	}
+	return (open(temp, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR));
 }
 
 /*
  * create_newfile --
- *	create a new file, overwriting an existing one if necessary
+ *	create a new file, overwriting an existing one if necessary, as a
+ *	clone of from_fd if it is not -1 and that works
  */
 int
-create_newfile(path, target, sbp)
+create_newfile(path, target, sbp, from_fd, clonedp)
 	char *path;
 	int target;
 	struct stat *sbp;
+	int from_fd;
+	int *clonedp;
 {
 	char backup[MAXPATHLEN];
+	int fd;
 
 	if (target) {
 		/*
@@ -658,6 +731,10 @@ create_newfile(path, target, sbp)
 			(void)unlink(path);
 	}
 
+	if (from_fd >= 0 && (fd = create_clone(from_fd, path)) >= 0) {
+		*clonedp = 1;
+		return (fd);
+	}
 	return (open(path, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR));
 }
 
@@ -52,6 +52,8 @@ void	 printlong(DISPLAY *);
 void	 printscol(DISPLAY *);
 void	 printstream(DISPLAY *);
 void	 ls_usage(void);
+const char *ls_user(uid_t);
+const char *ls_group(gid_t);
 int      prn_normal(const char *);
 size_t	 len_octal(const char *, int);
 int	 prn_octal(const char *);
@@ -74,6 +74,7 @@ __RCSID("$FreeBSD: src/bin/ls/ls.c,v 1.66 2002/09/21 01:28:36 wollman Exp $");
 #include <sys/acl.h>
 #include <sys/xattr.h>
 #include <sys/param.h>
+#include <fcntl.h>
 // #include <get_compat.h>
 // #else
 #define COMPAT_MODE(a,b) (1)
@@ -81,6 +82,7 @@ __RCSID("$FreeBSD: src/bin/ls/ls.c,v 1.66 2002/09/21 01:28:36 wollman Exp $");
 #include "ls.h"
 #include "extern.h"
 #include "ios_error.h"
+#include "dirwalk.h"
 
 /*
  * Upward approximation of the maximum number of characters needed to
@@ -89,6 +91,10 @@ __RCSID("$FreeBSD: src/bin/ls/ls.c,v 1.66 2002/09/21 01:28:36 wollman Exp $");
  */
 #define	STRBUF_SIZEOF(t)	(1 + CHAR_BIT * sizeof(t) / 3 + 1)
 
+#ifdef __APPLE__
+static int	 bulk_children(FTSENT *, FTSENT **);
+static void	 bulk_free(FTSENT *);
+#endif
 static void	 display(FTSENT *, FTSENT *);
 static u_quad_t	 makenines(u_quad_t);
 static int	 mastercmp(const FTSENT **, const FTSENT **);
@@ -571,7 +577,7 @@ traverse(int argc, char *argv[], int options)
 {
 	FTS *ftsp;
 	FTSENT *p, *chp;
-	int ch_options, error;
+	int bulk, ch_options, error;
 
 	if ((ftsp =
          fts_open(argv, options, f_nosort ? NULL : mastercmp)) == NULL) {
@@ -621,7 +627,19 @@ traverse(int argc, char *argv[], int options)
 				(void)fprintf(thread_stdout, "%s:\n", p->fts_path);
 				output = 1;
 			}
-			chp = fts_children(ftsp, ch_options);
+			/*
+			 * A directory that is listed but not descended into
+			 * can be read with its attributes in bulk.
+			 */
+			bulk = 0;
+#ifdef __APPLE__
+			if (!f_recursive && !f_whiteout &&
+			    !(options & (FTS_NOSTAT | FTS_LOGICAL | FTS_SEEDOT)) &&
+			    bulk_children(p, &chp) == 0)
+				bulk = 1;
+			else
+#endif
+				chp = fts_children(ftsp, ch_options);
 			if (COMPAT_MODE("bin/ls", "Unix2003") && ((options & FTS_LOGICAL)!=0)) {
 				FTSENT *curr;
 				for (curr = chp; curr; curr = curr->fts_link) {
@@ -631,6 +649,12 @@ traverse(int argc, char *argv[], int options)
 			}
 			display(p, chp);
 
+#ifdef __APPLE__
+			if (bulk) {
+				bulk_free(chp);
+				(void)fts_set(ftsp, p, FTS_SKIP);
+			} else
+#endif
 			if (!f_recursive && chp != NULL)
 				(void)fts_set(ftsp, p, FTS_SKIP);
 			break;
@@ -654,6 +678,95 @@ traverse(int argc, char *argv[], int options)
     }
 }
 
+#ifdef __APPLE__
+/*
+ * Read the entries of directory p, and their attributes, with
+ * dirwalk_read(), which gets them in bulk where it can, instead of a
+ * readdir() and an lstat() per entry, and return them as fts_children()
+ * would.  Returns -1, for the caller to use fts_children(), if the
+ * directory cannot be read that way.
+ */
+static int
+bulk_children(FTSENT *p, FTSENT **listp)
+{
+	struct dw_list dl;
+	struct dw_entry *de;
+	struct stat *sp;
+	FTSENT *e, *head, **tail, **v;
+	size_t i, n, off;
+	int dfd;
+
+	if ((dfd = open(p->fts_accpath, O_RDONLY | O_DIRECTORY)) == -1)
+		return (-1);
+	if (dirwalk_read(dfd, DW_STAT, &dl) == -1) {
+		(void)close(dfd);
+		return (-1);
+	}
+	(void)close(dfd);
+
+	head = NULL;
+	tail = &head;
+	n = 0;
+	for (i = 0; i < dl.dl_count; i++) {
+		de = &dl.dl_ents[i];
+		off = roundup(sizeof(FTSENT) + de->de_namelen, sizeof(long long));
+		if ((e = calloc(1, off + sizeof(struct stat))) == NULL)
+			err(1, "calloc");
+		memcpy(e->fts_name, de->de_name, de->de_namelen + 1);
+		e->fts_namelen = de->de_namelen;
+		e->fts_path = e->fts_accpath = e->fts_name;
+		e->fts_parent = p;
+		e->fts_level = p->fts_level + 1;
+		e->fts_statp = sp = (struct stat *)((char *)e + off);
+		*tail = e;
+		tail = &e->fts_link;
+		n++;
+
+		if (de->de_sb == NULL) {
+			e->fts_info = FTS_NS;
+			e->fts_errno = de->de_errno;
+			continue;
+		}
+		*sp = *de->de_sb;
+		switch (sp->st_mode & S_IFMT) {
+		case S_IFDIR:	e->fts_info = FTS_D; break;
+		case S_IFLNK:	e->fts_info = FTS_SL; break;
+		case S_IFREG:	e->fts_info = FTS_F; break;
+		default:	e->fts_info = FTS_DEFAULT; break;
+		}
+	}
+	dirwalk_free(&dl);
+
+	/* Sort the way fts_open() was asked to */
+	if (!f_nosort && n > 1) {
+		if ((v = malloc(n * sizeof(*v))) == NULL)
+			err(1, "malloc");
+		for (e = head, i = 0; e != NULL; e = e->fts_link)
+			v[i++] = e;
+		qsort(v, n, sizeof(*v),
+		    (int (*)(const void *, const void *))mastercmp);
+		for (i = 0; i < n - 1; i++)
+			v[i]->fts_link = v[i + 1];
+		v[n - 1]->fts_link = NULL;
+		head = v[0];
+		free(v);
+	}
+	*listp = head;
+	return (0);
+}
+
+static void
+bulk_free(FTSENT *list)
+{
+	FTSENT *e;
+
+	while ((e = list) != NULL) {
+		list = e->fts_link;
+		free(e);
+	}
+}
+#endif /* __APPLE__ */
+
 /*
  * Display() takes a linked list of FTSENT structures and passes the list
  * along with any other necessary information to the print function.  P
@@ -834,8 +947,8 @@ display(FTSENT *p, FTSENT *list)
 					user = nuser;
 					group = ngroup;
 				} else {
-					user = user_from_uid(sp->st_uid, 0);
-					group = group_from_gid(sp->st_gid, 0);
+					user = ls_user(sp->st_uid);
+					group = ls_group(sp->st_gid);
 				}
 				if ((ulen = strlen(user)) > maxuser)
 					maxuser = ulen;
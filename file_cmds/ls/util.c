@@ -44,7 +44,10 @@ __FBSDID("$FreeBSD: src/bin/ls/util.c,v 1.38 2005/06/03 11:05:58 dd Exp $");
 #include <ctype.h>
 #include <err.h>
 #include <fts.h>
+#include <grp.h>
 #include <limits.h>
+#include <pthread.h>
+#include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -231,6 +234,117 @@ prn_octal(const char *s)
 	return (len);
 }
 
+/*
+ * User and group names, cached for the life of the process: a long
+ * listing asks for the same few ids over and over, and so do the other
+ * ls commands running in the process.  Entries are never replaced, so
+ * a returned name stays valid; when the table is full, names are looked
+ * up each time.  The last id of each kind is also remembered by each
+ * thread, which saves taking the lock for most files.
+ */
+#define	IDCACHE_SIZE	256		/* power of two */
+#define	IDNAME_MAX	256
+
+struct idcache {
+	pthread_mutex_t	 mtx;
+	int		 n;
+	struct {
+		u_int	 id;
+		char	*name;		/* NULL if the slot is free */
+	} ent[IDCACHE_SIZE];
+};
+
+static struct idcache uidcache = { PTHREAD_MUTEX_INITIALIZER };
+static struct idcache gidcache = { PTHREAD_MUTEX_INITIALIZER };
+
+static const char *
+idname(struct idcache *c, u_int id, int group)
+{
+	static __thread char umiss[IDNAME_MAX], gmiss[IDNAME_MAX];
+	struct passwd pw, *pwp;
+	struct group gr, *grp;
+	char buf[4096], *name, *q;
+	const char *p;
+	u_int i;
+
+	pthread_mutex_lock(&c->mtx);
+	for (i = id & (IDCACHE_SIZE - 1); c->ent[i].name != NULL;
+	    i = (i + 1) & (IDCACHE_SIZE - 1))
+		if (c->ent[i].id == id) {
+			pthread_mutex_unlock(&c->mtx);
+			return (c->ent[i].name);
+		}
+	pthread_mutex_unlock(&c->mtx);
+
+	/* Same result as user_from_uid(id, 0) and group_from_gid(id, 0) */
+	p = NULL;
+	if (group) {
+		if (getgrgid_r(id, &gr, buf, sizeof(buf), &grp) == 0 &&
+		    grp != NULL)
+			p = grp->gr_name;
+	} else if (getpwuid_r(id, &pw, buf, sizeof(buf), &pwp) == 0 &&
+	    pwp != NULL)
+		p = pwp->pw_name;
+	if (p == NULL) {
+		(void)snprintf(buf, sizeof(buf), "%u", id);
+		p = buf;
+	}
+	if ((name = strdup(p)) == NULL)
+		err(1, "strdup");
+
+	pthread_mutex_lock(&c->mtx);
+	/* Keep a quarter of the slots free, so that probes stay short */
+	if (c->n < IDCACHE_SIZE * 3 / 4) {
+		for (i = id & (IDCACHE_SIZE - 1); c->ent[i].name != NULL;
+		    i = (i + 1) & (IDCACHE_SIZE - 1))
+			if (c->ent[i].id == id)
+				break;
+		if (c->ent[i].name == NULL) {
+			c->ent[i].id = id;
+			c->ent[i].name = name;
+			c->n++;
+			name = NULL;
+		}
+		p = c->ent[i].name;
+		pthread_mutex_unlock(&c->mtx);
+		free(name);
+		return (p);
+	}
+	pthread_mutex_unlock(&c->mtx);
+
+	/* The table is full: the name is good until the next miss */
+	q = group ? gmiss : umiss;
+	(void)strlcpy(q, name, IDNAME_MAX);
+	free(name);
+	return (q);
+}
+
+const char *
+ls_user(uid_t uid)
+{
+	static __thread const char *last;
+	static __thread uid_t lastuid;
+
+	if (last == NULL || uid != lastuid) {
+		last = idname(&uidcache, uid, 0);
+		lastuid = uid;
+	}
+	return (last);
+}
+
+const char *
+ls_group(gid_t gid)
+{
+	static __thread const char *last;
+	static __thread gid_t lastgid;
+
+	if (last == NULL || gid != lastgid) {
+		last = idname(&gidcache, gid, 1);
+		lastgid = gid;
+	}
+	return (last);
+}
+
 void
 ls_usage(void)
 {
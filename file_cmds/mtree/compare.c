@@ -81,8 +81,9 @@ int
 compare(char *name __unused, NODE *s, FTSENT *p)
 {
 	struct timeval tv[2];
+	struct dg_job *dg;
 	uint32_t val;
-	int fd, label;
+	int label;
 	off_t len;
 	char *cp;
 	const char *tab = "";
@@ -124,6 +125,7 @@ typeerr:		LABEL;
 		}
 		break;
 	}
+	dg = compare_digests(s, p) & dg_mask() ? dg_get(p->fts_path) : NULL;
 	/* Set the uid/gid first, then set the mode. */
 	if (s->flags & (F_UID | F_UNAME) && s->st_uid != p->fts_statp->st_uid) {
 		LABEL;
@@ -205,25 +207,16 @@ typeerr:		LABEL;
 		tab = "\t";
 	}
 	if (s->flags & F_CKSUM) {
-		if ((fd = open(p->fts_accpath, O_RDONLY, 0)) < 0) {
+		if (dg_crc(dg, p->fts_accpath, &val)) {
 			LABEL;
 			(void)printf("%scksum: %s: %s\n",
 			    tab, p->fts_accpath, strerror(errno));
 			tab = "\t";
-		} else if (crc(fd, &val, &len)) {
-			(void)close(fd);
+		} else if (s->cksum != val) {
 			LABEL;
-			(void)printf("%scksum: %s: %s\n",
-			    tab, p->fts_accpath, strerror(errno));
+			(void)printf("%scksum expected %lu found %lu\n",
+			    tab, s->cksum, (unsigned long)val);
 			tab = "\t";
-		} else {
-			(void)close(fd);
-			if (s->cksum != val) {
-				LABEL;
-				(void)printf("%scksum expected %lu found %lu\n",
-				    tab, s->cksum, (unsigned long)val);
-				tab = "\t";
-			}
 		}
 	}
 	if (s->flags & F_FLAGS) {
@@ -260,7 +253,7 @@ typeerr:		LABEL;
 	if (s->flags & F_MD5) {
 		char *new_digest, buf[33];
 
-		new_digest = MD5File(p->fts_accpath, buf);
+		new_digest = dg_digest(dg, F_MD5, p->fts_accpath, buf);
 		if (!new_digest) {
 			LABEL;
 			printf("%sMD5: %s: %s\n", tab, p->fts_accpath,
@@ -278,7 +271,7 @@ typeerr:		LABEL;
 	if (s->flags & F_SHA1) {
 		char *new_digest, buf[41];
 
-		new_digest = SHA1_File(p->fts_accpath, buf);
+		new_digest = dg_digest(dg, F_SHA1, p->fts_accpath, buf);
 		if (!new_digest) {
 			LABEL;
 			printf("%sSHA-1: %s: %s\n", tab, p->fts_accpath,
@@ -296,7 +289,7 @@ typeerr:		LABEL;
 	if (s->flags & F_RMD160) {
 		char *new_digest, buf[41];
 
-		new_digest = RIPEMD160_File(p->fts_accpath, buf);
+		new_digest = dg_digest(dg, F_RMD160, p->fts_accpath, buf);
 		if (!new_digest) {
 			LABEL;
 			printf("%sRIPEMD160: %s: %s\n", tab,
@@ -314,7 +307,7 @@ typeerr:		LABEL;
 	if (s->flags & F_SHA256) {
 		char *new_digest, buf[kSHA256NullTerminatedBuffLen];
 
-		new_digest = SHA256_File(p->fts_accpath, buf);
+		new_digest = dg_digest(dg, F_SHA256, p->fts_accpath, buf);
 		if (!new_digest) {
 			LABEL;
 			printf("%sSHA-256: %s: %s\n", tab, p->fts_accpath,
@@ -328,6 +321,7 @@ typeerr:		LABEL;
 		}
 	}
 #endif /* ENABLE_SHA256 */
+	dg_release(dg);
 
 	if (s->flags & F_SLINK &&
 	    strcmp(cp = rlink(p->fts_accpath), s->slink)) {
@@ -422,6 +416,21 @@ typeerr:		LABEL;
 	return (label);
 }
 
+/*
+ * The digests compare() will compute for p: those in the spec, for a
+ * regular file that passes the type check.  The -j walk queues exactly
+ * these.
+ */
+u_int
+compare_digests(NODE *s, FTSENT *p)
+{
+
+	if (!S_ISREG(p->fts_statp->st_mode) || (s->type != F_FILE &&
+	    s->type & (F_BLOCK | F_CHAR | F_DIR | F_FIFO | F_LINK | F_SOCK)))
+		return (0);
+	return (s->flags & F_DIGESTS);
+}
+
 const char *
 inotype(u_int type)
 {
@@ -80,6 +80,7 @@ static u_long flags = 0xffffffff;
 static char *xattrs = kNone;
 static char *acl = kNone;
 
+static void	cprefetch(void);
 static int	dsort(const FTSENT **, const FTSENT **);
 static void	output(int, int *, const char *, ...) __printflike(3, 4);
 static int	statd(FTS *, FTSENT *, uid_t *, gid_t *, mode_t *, u_long *, char **, char **);
@@ -107,6 +108,8 @@ cwalk(void)
 		    fullpath, ctime(&cl));
 	}
 
+	if (njobs > 1 && keys & F_DIGESTS && !dflag)
+		dg_start(njobs, cprefetch);
 	argv[0] = dot;
 	argv[1] = NULL;
 	if ((t = fts_open(argv, ftsoptions, dsort)) == NULL)
@@ -153,18 +156,58 @@ cwalk(void)
 		}
 	}
 	(void)fts_close(t);
+	dg_end();
 	if (sflag && keys & F_CKSUM)
 		warnx("%s checksum: %lu", fullpath, (unsigned long)crc_total);
 }
 
+/*
+ * The -j walk: the same traversal as cwalk(), queueing each file statf()
+ * will digest.
+ */
+static void
+cprefetch(void)
+{
+	FTS *t;
+	FTSENT *p;
+	char *argv[2];
+	char dot[] = ".";
+
+	argv[0] = dot;
+	argv[1] = NULL;
+	if ((t = fts_open(argv, ftsoptions, dsort)) == NULL)
+		return;
+	while ((p = fts_read(t))) {
+		if (check_excludes(p->fts_name, p->fts_path)) {
+			fts_set(t, p, FTS_SKIP);
+			continue;
+		}
+		switch(p->fts_info) {
+		case FTS_D:
+		case FTS_DP:
+		case FTS_DNR:
+		case FTS_ERR:
+		case FTS_NS:
+			break;
+		default:
+			if (S_ISREG(p->fts_statp->st_mode) &&
+			    dg_queue(p->fts_path, keys))
+				goto done;
+			break;
+		}
+	}
+done:
+	(void)fts_close(t);
+}
+
 static void
 statf(int indent, FTSENT *p)
 {
 	struct group *gr;
 	struct passwd *pw;
+	struct dg_job *dg;
 	uint32_t val;
-	off_t len;
-	int fd, offset;
+	int offset;
 	char *fflags;
 	char *escaped_name;
 
@@ -230,18 +273,18 @@ statf(int indent, FTSENT *p)
 		output(indent, &offset, "time=%ld.%09ld",
 		    (long)p->fts_statp->st_mtimespec.tv_sec,
 		    p->fts_statp->st_mtimespec.tv_nsec);
+	dg = keys & dg_mask() && S_ISREG(p->fts_statp->st_mode) ?
+	    dg_get(p->fts_path) : NULL;
 	if (keys & F_CKSUM && S_ISREG(p->fts_statp->st_mode)) {
-		if ((fd = open(p->fts_accpath, O_RDONLY, 0)) < 0 ||
-		    crc(fd, &val, &len))
+		if (dg_crc(dg, p->fts_accpath, &val))
 			err(1, "%s", p->fts_accpath);
-		(void)close(fd);
 		output(indent, &offset, "cksum=%lu", (unsigned long)val);
 	}
 #ifdef ENABLE_MD5
 	if (keys & F_MD5 && S_ISREG(p->fts_statp->st_mode)) {
 		char *digest, buf[33];
 
-		digest = MD5File(p->fts_accpath, buf);
+		digest = dg_digest(dg, F_MD5, p->fts_accpath, buf);
 		if (!digest)
 			err(1, "%s", p->fts_accpath);
 		output(indent, &offset, "md5digest=%s", digest);
@@ -251,7 +294,7 @@ statf(int indent, FTSENT *p)
 	if (keys & F_SHA1 && S_ISREG(p->fts_statp->st_mode)) {
 		char *digest, buf[41];
 
-		digest = SHA1_File(p->fts_accpath, buf);
+		digest = dg_digest(dg, F_SHA1, p->fts_accpath, buf);
 		if (!digest)
 			err(1, "%s", p->fts_accpath);
 		output(indent, &offset, "sha1digest=%s", digest);
@@ -261,7 +304,7 @@ statf(int indent, FTSENT *p)
 	if (keys & F_RMD160 && S_ISREG(p->fts_statp->st_mode)) {
 		char *digest, buf[41];
 
-		digest = RIPEMD160_File(p->fts_accpath, buf);
+		digest = dg_digest(dg, F_RMD160, p->fts_accpath, buf);
 		if (!digest)
 			err(1, "%s", p->fts_accpath);
 		output(indent, &offset, "ripemd160digest=%s", digest);
@@ -271,12 +314,13 @@ statf(int indent, FTSENT *p)
 	if (keys & F_SHA256 && S_ISREG(p->fts_statp->st_mode)) {
 		char *digest, buf[kSHA256NullTerminatedBuffLen];
 
-		digest = SHA256_File(p->fts_accpath, buf);
+		digest = dg_digest(dg, F_SHA256, p->fts_accpath, buf);
 		if (!digest)
 			err(1, "%s", p->fts_accpath);
 		output(indent, &offset, "sha256digest=%s", digest);
 	}
 #endif /* ENABLE_SHA256 */
+	dg_release(dg);
 	if (keys & F_SLINK &&
 	    (p->fts_info == FTS_SL || p->fts_info == FTS_SLNONE)) {
 		char visbuf[MAXPATHLEN * 4];
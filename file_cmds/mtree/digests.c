@@ -0,0 +1,357 @@
+/*
+ * digests -- compute file digests ahead of the walk for mtree -j.
+ *
+ * A second fts walk over the same tree, run on its own thread by the
+ * prefetch routine handed to dg_start(), queues the regular files the
+ * real walk is going to digest.  Worker threads digest them in any
+ * order; the real walk picks up each result with dg_get() as it reaches
+ * the file, so that the spec and the report come out exactly as before.
+ * If the two walks ever disagree the queue is abandoned and the real
+ * walk goes back to digesting files itself.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#ifndef __APPLE__
+#ifdef ENABLE_MD5
+#include <md5.h>
+#endif
+#ifdef ENABLE_RMD160
+#include <ripemd.h>
+#endif
+#ifdef ENABLE_SHA1
+#include <sha.h>
+#endif
+#ifdef ENABLE_SHA256
+#include <sha256.h>
+#endif
+#endif /* !__APPLE__ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "mtree.h"
+#include "extern.h"
+
+#ifdef __APPLE__
+#include "commoncrypto.h"
+#endif /* __APPLE__ */
+
+#define	DG_WINDOW	8		/* queued files per worker */
+#define	DG_NDIGEST	4
+
+static const u_int dg_key[DG_NDIGEST] = { F_MD5, F_SHA1, F_RMD160, F_SHA256 };
+
+struct dg_job {
+	char	*path;
+	u_int	 keys;			/* what the walk will ask for */
+	int	 done;
+	uint32_t cksum;
+	int	 cksum_errno;
+	char	 digest[DG_NDIGEST][DG_DIGESTLEN];
+	int	 digest_errno[DG_NDIGEST];
+};
+
+static struct {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	struct dg_job	*ring;
+	u_int		 keys;		/* digests worth queueing */
+	u_int		 size;
+	u_int		 head;		/* next job dg_get() hands out */
+	u_int		 next;		/* next job for a worker */
+	u_int		 tail;		/* next free slot */
+	int		 queued;	/* prefetch walk has finished */
+	int		 stop;		/* walks disagreed, or dg_end() */
+	int		 nthreads;
+	pthread_t	*threads;
+	void		(*walk)(void);
+} dg = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
+static u_int dgmask;			/* main thread only */
+
+static char	*dg_compute(u_int, const char *, char *);
+static void	 dg_run(struct dg_job *);
+static void	*dg_prefetch(void *);
+static void	*dg_worker(void *);
+
+/*
+ * Start the prefetch walk and njobs digest workers.  The file checksum
+ * is left to the walk under -s, since crc_total must see the files in
+ * order.
+ */
+void
+dg_start(int njobs, void (*walk)(void))
+{
+	sigset_t all, old;
+	int i;
+
+	dg.keys = sflag ? F_DIGESTS & ~F_CKSUM : F_DIGESTS;
+	dgmask = dg.keys;
+	dg.size = njobs * DG_WINDOW;
+	if ((dg.ring = calloc(dg.size, sizeof(*dg.ring))) == NULL ||
+	    (dg.threads = calloc(njobs + 1, sizeof(*dg.threads))) == NULL)
+		err(1, "calloc");
+	dg.walk = walk;
+
+	/* Signals are for the main thread. */
+	(void)sigfillset(&all);
+	(void)pthread_sigmask(SIG_SETMASK, &all, &old);
+	if ((errno = pthread_create(&dg.threads[0], NULL, dg_prefetch,
+	    NULL)) != 0)
+		err(1, "pthread_create");
+	for (i = 1; i <= njobs; i++)
+		if ((errno = pthread_create(&dg.threads[i], NULL, dg_worker,
+		    NULL)) != 0)
+			err(1, "pthread_create");
+	(void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+	dg.nthreads = njobs + 1;
+}
+
+/*
+ * Stop everything and wait for the threads.
+ */
+void
+dg_end(void)
+{
+	int i;
+
+	if (dg.threads == NULL)
+		return;
+	pthread_mutex_lock(&dg.mtx);
+	dg.stop = 1;
+	pthread_cond_broadcast(&dg.cv);
+	pthread_mutex_unlock(&dg.mtx);
+	for (i = 0; i < dg.nthreads; i++)
+		(void)pthread_join(dg.threads[i], NULL);
+	for (; dg.head != dg.tail; dg.head++)
+		free(dg.ring[dg.head % dg.size].path);
+	free(dg.ring);
+	free(dg.threads);
+	dg.ring = NULL;
+	dg.threads = NULL;
+	dgmask = 0;
+}
+
+/*
+ * The digest keys the walk should take from dg_get(), or 0 when there is
+ * nothing to take them from.
+ */
+u_int
+dg_mask(void)
+{
+
+	return (dgmask);
+}
+
+/*
+ * Called by the prefetch walk for each file the real walk will digest.
+ * Returns -1 when the walk should give up.
+ */
+int
+dg_queue(const char *path, u_int keys)
+{
+	struct dg_job *job;
+	char *p;
+
+	if ((keys &= dg.keys) == 0)
+		return (0);
+	if ((p = strdup(path)) == NULL)
+		return (-1);
+	pthread_mutex_lock(&dg.mtx);
+	while (!dg.stop && dg.tail - dg.head == dg.size)
+		pthread_cond_wait(&dg.cv, &dg.mtx);
+	if (dg.stop) {
+		pthread_mutex_unlock(&dg.mtx);
+		free(p);
+		return (-1);
+	}
+	job = &dg.ring[dg.tail % dg.size];
+	job->path = p;
+	job->keys = keys;
+	job->done = 0;
+	dg.tail++;
+	pthread_cond_broadcast(&dg.cv);
+	pthread_mutex_unlock(&dg.mtx);
+	return (0);
+}
+
+/*
+ * Wait for the digests of path.  Returns NULL, and turns the queue off
+ * for good, if the prefetch walk did not queue path next.
+ */
+struct dg_job *
+dg_get(const char *path)
+{
+	struct dg_job *job;
+
+	if (dgmask == 0)
+		return (NULL);
+	pthread_mutex_lock(&dg.mtx);
+	while (!dg.stop && !dg.queued && dg.head == dg.tail)
+		pthread_cond_wait(&dg.cv, &dg.mtx);
+	job = &dg.ring[dg.head % dg.size];
+	if (dg.stop || dg.head == dg.tail || strcmp(job->path, path) != 0) {
+		dg.stop = 1;
+		pthread_cond_broadcast(&dg.cv);
+		pthread_mutex_unlock(&dg.mtx);
+		dgmask = 0;
+		return (NULL);
+	}
+	while (!job->done)
+		pthread_cond_wait(&dg.cv, &dg.mtx);
+	pthread_mutex_unlock(&dg.mtx);
+	return (job);
+}
+
+void
+dg_release(struct dg_job *job)
+{
+
+	if (job == NULL)
+		return;
+	pthread_mutex_lock(&dg.mtx);
+	free(job->path);
+	job->path = NULL;
+	dg.head++;
+	pthread_cond_broadcast(&dg.cv);
+	pthread_mutex_unlock(&dg.mtx);
+}
+
+/*
+ * The checksum of accpath, from job if it has it.  Returns 0, or 1 with
+ * errno set, like crc().
+ */
+int
+dg_crc(struct dg_job *job, const char *accpath, uint32_t *val)
+{
+	off_t len;
+	int fd, rval;
+
+	if (job != NULL && job->keys & F_CKSUM) {
+		if (job->cksum_errno != 0) {
+			errno = job->cksum_errno;
+			return (1);
+		}
+		*val = job->cksum;
+		return (0);
+	}
+	if ((fd = open(accpath, O_RDONLY, 0)) < 0)
+		return (1);
+	rval = crc(fd, val, &len);
+	(void)close(fd);
+	return (rval);
+}
+
+/*
+ * The digest of accpath named by key, from job if it has it.  Returns
+ * buf, or NULL with errno set, like the *_File() functions.
+ */
+char *
+dg_digest(struct dg_job *job, u_int key, const char *accpath, char *buf)
+{
+	int i;
+
+	if (job == NULL || !(job->keys & key))
+		return (dg_compute(key, accpath, buf));
+	for (i = 0; dg_key[i] != key; i++)
+		;
+	if (job->digest_errno[i] != 0) {
+		errno = job->digest_errno[i];
+		return (NULL);
+	}
+	return (strcpy(buf, job->digest[i]));
+}
+
+static char *
+dg_compute(u_int key, const char *path, char *buf)
+{
+
+	switch (key) {
+#ifdef ENABLE_MD5
+	case F_MD5:
+		return (MD5File(path, buf));
+#endif
+#ifdef ENABLE_SHA1
+	case F_SHA1:
+		return (SHA1_File(path, buf));
+#endif
+#ifdef ENABLE_RMD160
+	case F_RMD160:
+		return (RIPEMD160_File(path, buf));
+#endif
+#ifdef ENABLE_SHA256
+	case F_SHA256:
+		return (SHA256_File(path, buf));
+#endif
+	}
+	errno = EINVAL;
+	return (NULL);
+}
+
+static void
+dg_run(struct dg_job *job)
+{
+	off_t len;
+	int fd, i;
+
+	if (job->keys & F_CKSUM) {
+		job->cksum_errno = 0;
+		if ((fd = open(job->path, O_RDONLY, 0)) < 0)
+			job->cksum_errno = errno;
+		else {
+			if (posix_crc(fd, &job->cksum, &len))
+				job->cksum_errno = errno;
+			(void)close(fd);
+		}
+	}
+	for (i = 0; i < DG_NDIGEST; i++) {
+		if (!(job->keys & dg_key[i]))
+			continue;
+		job->digest_errno[i] = 0;
+		if (dg_compute(dg_key[i], job->path, job->digest[i]) == NULL)
+			job->digest_errno[i] = errno;
+	}
+}
+
+static void *
+dg_prefetch(void *arg __unused)
+{
+
+	dg.walk();
+	pthread_mutex_lock(&dg.mtx);
+	dg.queued = 1;
+	pthread_cond_broadcast(&dg.cv);
+	pthread_mutex_unlock(&dg.mtx);
+	return (NULL);
+}
+
+static void *
+dg_worker(void *arg __unused)
+{
+	struct dg_job *job;
+
+	pthread_mutex_lock(&dg.mtx);
+	for (;;) {
+		while (!dg.stop && !dg.queued && dg.next == dg.tail)
+			pthread_cond_wait(&dg.cv, &dg.mtx);
+		if (dg.stop || dg.next == dg.tail)
+			break;
+		job = &dg.ring[dg.next++ % dg.size];
+		pthread_mutex_unlock(&dg.mtx);
+		dg_run(job);
+		pthread_mutex_lock(&dg.mtx);
+		job->done = 1;
+		pthread_cond_broadcast(&dg.cv);
+	}
+	pthread_mutex_unlock(&dg.mtx);
+	return (NULL);
+}
@@ -33,8 +33,10 @@ extern uint32_t crc_total;
 
 #ifdef _FTS_H_
 int	 compare(char *, NODE *, FTSENT *);
+u_int	 compare_digests(NODE *, FTSENT *);
 #endif
 int	 crc(int, uint32_t *, off_t *);
+int	 posix_crc(int, uint32_t *, off_t *);
 void	 cwalk(void);
 char	*flags_to_string(u_long);
 char	*escape_path(char *string);
@@ -52,7 +54,17 @@ void	 init_excludes(void);
 void	 read_excludes_file(const char *);
 const char * ftype(u_int type);
 
-extern int ftsoptions;
+struct dg_job;
+void	 dg_start(int, void (*)(void));
+void	 dg_end(void);
+u_int	 dg_mask(void);
+int	 dg_queue(const char *, u_int);
+struct dg_job *dg_get(const char *);
+void	 dg_release(struct dg_job *);
+int	 dg_crc(struct dg_job *, const char *, uint32_t *);
+char	*dg_digest(struct dg_job *, u_int, const char *, char *);
+
+extern int ftsoptions, njobs;
 extern u_int keys;
 extern int lineno;
 extern int dflag, eflag, iflag, nflag, qflag, rflag, sflag, uflag, wflag;
@@ -46,6 +46,7 @@ __FBSDID("$FreeBSD: src/usr.sbin/mtree/mtree.c,v 1.29 2004/06/04 19:29:28 ru Exp
 #include <err.h>
 #include <errno.h>
 #include <fts.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -53,6 +54,7 @@ __FBSDID("$FreeBSD: src/usr.sbin/mtree/mtree.c,v 1.29 2004/06/04 19:29:28 ru Exp
 #include "extern.h"
 
 int ftsoptions = FTS_PHYSICAL;
+int njobs = 1;
 int cflag, dflag, eflag, iflag, nflag, qflag, rflag, sflag, uflag, Uflag, wflag;
 u_int keys;
 char fullpath[MAXPATHLEN];
@@ -63,6 +65,7 @@ int
 main(int argc, char *argv[])
 {
 	int ch;
+	u_long l;
 	char *dir, *p;
 	int status;
 	FILE *spec1, *spec2;
@@ -73,7 +76,7 @@ main(int argc, char *argv[])
 	spec1 = stdin;
 	spec2 = NULL;
 
-	while ((ch = getopt(argc, argv, "cdef:iK:k:LnPp:qrs:UuwxX:")) != -1)
+	while ((ch = getopt(argc, argv, "cdef:ij:K:k:LnPp:qrs:UuwxX:")) != -1)
 		switch((char)ch) {
 		case 'c':
 			cflag = 1;
@@ -99,6 +102,13 @@ main(int argc, char *argv[])
 		case 'i':
 			iflag = 1;
 			break;
+		case 'j':
+			errno = 0;
+			l = strtoul(optarg, &p, 10);
+			if (errno != 0 || *p != '\0' || l == 0 || l > INT_MAX)
+				errx(1, "%s: invalid number of jobs", optarg);
+			njobs = (int)l;
+			break;
 		case 'K':
 			while ((p = strsep(&optarg, " \t,")) != NULL)
 				if (*p != '\0')
@@ -162,6 +172,10 @@ main(int argc, char *argv[])
 	if (argc)
 		usage();
 
+	/* The -j walk runs beside the real one; neither may chdir. */
+	if (njobs > 1)
+		ftsoptions |= FTS_NOCHDIR;
+
 	if (dir && chdir(dir))
 		err(1, "%s", dir);
 
@@ -185,7 +199,7 @@ static void
 usage(void)
 {
 	(void)fprintf(stderr,
-"usage: mtree [-LPUcdeinqruxw] [-f spec] [-f spec] [-K key] [-k key] [-p path] [-s seed]\n"
-"\t[-X excludes]\n");
+"usage: mtree [-LPUcdeinqruxw] [-f spec] [-f spec] [-j jobs] [-K key] [-k key]\n"
+"\t[-p path] [-s seed] [-X excludes]\n");
 	exit(1);
 }
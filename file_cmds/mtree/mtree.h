@@ -38,6 +38,11 @@
 
 #define	MISMATCHEXIT	2
 
+/* Keys that read the whole file, and can be computed ahead by -j. */
+#define	F_DIGESTS \
+	(F_CKSUM | F_MD5 | F_SHA1 | F_RMD160 | F_SHA256)
+#define	DG_DIGESTLEN	65		/* SHA-256 in hex and a NUL */
+
 typedef struct _node {
 	struct _node	*parent, *child;	/* up, down */
 	struct _node	*prev, *next;		/* left, right */
@@ -77,7 +82,6 @@ typedef struct _node {
 #define	F_TYPE		0x00000800		/* file type */
 #define	F_UID		0x00001000		/* uid */
 #define	F_UNAME		0x00002000		/* user name */
-#define	F_VISIT		0x00004000		/* file visited */
 #define F_MD5		0x00008000		/* MD5 digest */
 #define F_NOCHANGE	0x00010000		/* If owner/mode "wrong", do */
 						/* not change */
@@ -102,6 +106,8 @@ typedef struct _node {
 #define	F_LINK	0x020				/* symbolic link */
 #define	F_SOCK	0x040				/* socket */
 	u_char	type;				/* file type */
+	u_char	visit;				/* file visited; not in flags, */
+						/* which -j reads concurrently */
 
 	char	name[1];			/* file name (must be last) */
 } NODE;
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Check that -j produces the same specification and report as a serial run.
+#
+
+set -e
+
+TMP=/tmp/mtree.$$
+
+rm -rf ${TMP}
+mkdir -p ${TMP} ${TMP}/mr ${TMP}/mr/a ${TMP}/mr/b/c
+
+for d in a b b/c ; do
+	for f in 1 2 3 4 5 6 7 8 9 ; do
+		dd if=/dev/urandom of=${TMP}/mr/$d/f$f bs=1k count=$f 2>/dev/null
+	done
+done
+ln -s f1 ${TMP}/mr/a/link
+mkfifo ${TMP}/mr/b/fifo
+
+K=cksum,md5digest,sha1digest,sha256digest
+mtree -c -n -K $K -p ${TMP}/mr > ${TMP}/_1
+mtree -c -n -K $K -j 4 -p ${TMP}/mr > ${TMP}/_2
+if cmp -s ${TMP}/_1 ${TMP}/_2 ; then
+	true
+else
+	echo "ERROR Mtree -j created a different specification" 1>&2
+	rm -rf ${TMP}
+	exit 1
+fi
+
+echo changed >> ${TMP}/mr/a/f3
+rm ${TMP}/mr/b/c/f5
+mtree -p ${TMP}/mr < ${TMP}/_1 > ${TMP}/_3 || true
+mtree -j 4 -p ${TMP}/mr < ${TMP}/_1 > ${TMP}/_4 || true
+if cmp -s ${TMP}/_3 ${TMP}/_4 ; then
+	true
+else
+	echo "ERROR Mtree -j reported differently" 1>&2
+	rm -rf ${TMP}
+	exit 1
+fi
+
+rm -rf ${TMP}
+exit 0
@@ -52,6 +52,7 @@ static NODE *root;
 static char path[MAXPATHLEN];
 
 static int	miss(NODE *, char *);
+static void	vprefetch(void);
 static int	vwalk(void);
 
 int
@@ -60,7 +61,10 @@ mtree_verifyspec(FILE *fi)
 	int rval, mval;
 
 	root = mtree_readspec(fi);
+	if (njobs > 1 && !dflag)
+		dg_start(njobs, vprefetch);
 	rval = vwalk();
+	dg_end();
 	mval = miss(root, path);
 	
 	if (rval != 0)
@@ -120,7 +124,7 @@ vwalk(void)
 			if ((ep->flags & F_MAGIC &&
 			    !fnmatch(ep->name, p->fts_name, FNM_PATHNAME)) ||
 			    !strcmp(ep->name, p->fts_name)) {
-				ep->flags |= F_VISIT;
+				ep->visit = 1;
 				if ((ep->flags & F_NOCHANGE) == 0 &&
 				    compare(ep->name, ep, p))
 					rval = MISMATCHEXIT;
@@ -157,6 +161,79 @@ extra:
 	return (rval);
 }
 
+/*
+ * The -j walk: the same traversal and spec matching as vwalk(), queueing
+ * each file compare() will digest.  The spec is only read here; vwalk()
+ * marks visited nodes outside of their flags.
+ */
+static void
+vprefetch(void)
+{
+	FTS *t;
+	FTSENT *p;
+	NODE *ep, *level;
+	int specdepth;
+	u_int dkeys;
+	char *argv[2];
+	char dot[] = ".";
+
+	argv[0] = dot;
+	argv[1] = NULL;
+	if ((t = fts_open(argv, ftsoptions, NULL)) == NULL)
+		return;
+	level = root;
+	specdepth = 0;
+	while ((p = fts_read(t))) {
+		if (check_excludes(p->fts_name, p->fts_path)) {
+			fts_set(t, p, FTS_SKIP);
+			continue;
+		}
+		switch(p->fts_info) {
+		case FTS_D:
+		case FTS_SL:
+			break;
+		case FTS_DP:
+			if (level == NULL)
+				goto done;
+			if (specdepth > p->fts_level) {
+				for (level = level->parent; level->prev;
+				      level = level->prev);
+				--specdepth;
+			}
+			continue;
+		case FTS_DNR:
+		case FTS_ERR:
+		case FTS_NS:
+			continue;
+		}
+
+		ep = NULL;
+		if (specdepth == p->fts_level)
+			for (ep = level; ep; ep = ep->next)
+				if ((ep->flags & F_MAGIC &&
+				    !fnmatch(ep->name, p->fts_name, FNM_PATHNAME)) ||
+				    !strcmp(ep->name, p->fts_name))
+					break;
+		if (ep == NULL) {
+			(void)fts_set(t, p, FTS_SKIP);
+			continue;
+		}
+		if ((ep->flags & F_NOCHANGE) == 0 &&
+		    (dkeys = compare_digests(ep, p)) != 0 &&
+		    dg_queue(p->fts_path, dkeys))
+			break;
+		if (ep->flags & F_IGN)
+			(void)fts_set(t, p, FTS_SKIP);
+		else if (ep->child && ep->type == F_DIR &&
+		    p->fts_info == FTS_D) {
+			level = ep->child;
+			++specdepth;
+		}
+	}
+done:
+	(void)fts_close(t);
+}
+
 static int
 miss(NODE *p, char *tail)
 {
@@ -168,16 +245,16 @@ miss(NODE *p, char *tail)
 	int rrval = 0;
 
 	for (; p; p = p->next) {
-		if (p->type != F_DIR && (dflag || p->flags & F_VISIT))
+		if (p->type != F_DIR && (dflag || p->visit))
 			continue;
 		(void)strcpy(tail, p->name);
-		if (!(p->flags & F_VISIT)) {
+		if (!p->visit) {
 			/* Don't print missing message if file exists as a
 			   symbolic link and the -q flag is set. */
 			struct stat statbuf;
 
 			if (qflag && stat(path, &statbuf) == 0) {
-				p->flags |= F_VISIT;
+				p->visit = 1;
 			} else {
 				(void)printf("%s missing", path);
 				rval = MISMATCHEXIT;
@@ -193,7 +270,7 @@ miss(NODE *p, char *tail)
 			type = "symlink";
 		else
 			type = "directory";
-		if (!(p->flags & F_VISIT) && uflag) {
+		if (!p->visit && uflag) {
 			if (!(p->flags & (F_UID | F_UNAME)))
 				(void)printf(" (%s not created: user not specified)", type);
 			else if (!(p->flags & (F_GID | F_GNAME)))
@@ -229,7 +306,7 @@ miss(NODE *p, char *tail)
 				(void)printf(" (created)");
 			}
 		}
-		if (!(p->flags & F_VISIT))
+		if (!p->visit)
 			(void)putchar('\n');
 
 		for (tp = tail; *tp; ++tp);
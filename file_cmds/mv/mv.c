@@ -58,6 +58,7 @@ __RCSID("$FreeBSD: src/bin/mv/mv.c,v 1.39 2002/07/09 17:45:13 johan Exp $");
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fts.h>
 #include <grp.h>
 #include <limits.h>
 #include <paths.h>
@@ -69,7 +70,6 @@ __RCSID("$FreeBSD: src/bin/mv/mv.c,v 1.39 2002/07/09 17:45:13 johan Exp $");
 #include <unistd.h>
 
 #ifdef __APPLE__
-#include <copyfile.h>
 #include <sys/mount.h>
 #endif
 
@@ -83,11 +83,16 @@ __RCSID("$FreeBSD: src/bin/mv/mv.c,v 1.39 2002/07/09 17:45:13 johan Exp $");
 #include "ios_error.h"
 
 static int fflg, iflg, nflg, vflg;
+static unsigned int njobs;
 
+static int	copy(char *, char *);
 static int	do_move(char *, char *);
-static int	fastcopy(char *, char *, struct stat *);
+static int	rmtree(char *);
 static void	usage(void);
 
+/* cp/cp.c */
+int	cp_move_copy(char *, char *, unsigned int);
+
 int
 mv_main(int argc, char *argv[])
 {
@@ -99,13 +104,18 @@ mv_main(int argc, char *argv[])
 	struct stat fsb, tsb;
 #endif /* __APPLE__ */
 	int ch;
+	long ncpu;
+	unsigned long l;
 	char path[PATH_MAX];
     // initialize flags
     fflg = iflg = nflg = vflg = 0;
     optind = 1; opterr = 1; optreset = 1;
+	/* Moves across file systems copy with a thread per processor */
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	njobs = ncpu > 1 ? (unsigned int)ncpu : 1;
 
 
-	while ((ch = getopt(argc, argv, "finv")) != -1)
+	while ((ch = getopt(argc, argv, "fij:nv")) != -1)
 		switch (ch) {
 		case 'i':
 			iflg = 1;
@@ -115,6 +125,13 @@ mv_main(int argc, char *argv[])
 			fflg = 1;
 			iflg = nflg = 0;
 			break;
+		case 'j':
+			errno = 0;
+			l = strtoul(optarg, &endp, 10);
+			if (errno != 0 || *endp != '\0' || l == 0 || l > UINT_MAX)
+				errx(1, "%s: invalid number of jobs", optarg);
+			njobs = (unsigned int)l;
+			break;
 		case 'n':
 			nflg = 1;
 			fflg = iflg = 0;
@@ -312,136 +329,94 @@ do_move(char *from, char *to)
 	}
 
 	/*
-	 * If rename fails because we're trying to cross devices, and
-	 * it's a regular file, do the copy internally; otherwise, use
-	 * cp and rm.
+	 * If rename fails because we're trying to cross devices, copy
+	 * the file or the tree and remove the original.
 	 */
 	if (lstat(from, &sb)) {
         warn("%s", from);
 		return (1);
 	}
-	return (S_ISREG(sb.st_mode) ?
-            fastcopy(from, to, &sb): 0); //  : copy(from, to));
+	return (copy(from, to));
 }
 
-int
-fastcopy(char *from, char *to, struct stat *sbp)
+/*
+ * Move across file systems, as "rm -f to && cp -PRp from to &&
+ * rm -rf from" would: the copy is made with cp's copy engine, and the
+ * source is only removed once all of it has been copied.
+ */
+static int
+copy(char *from, char *to)
 {
-	struct timeval tval[2];
-	static u_int blen;
-	static char *bp;
-	mode_t oldmode;
-	ssize_t nread;
-	int from_fd, to_fd;
+	struct stat sb;
 
-	if ((from_fd = open(from, O_RDONLY, 0)) < 0) {
-        warn("%s", from);
-		return (1);
-	}
-	if (blen < sbp->st_blksize) {
-		if (bp != NULL)
-			free(bp);
-		if ((bp = malloc((size_t)sbp->st_blksize)) == NULL) {
-			blen = 0;
-            warnx("malloc failed");
+	if (lstat(to, &sb) == 0) {
+		/* Destination path exists. */
+		if (S_ISDIR(sb.st_mode) ? rmdir(to) : unlink(to)) {
+			warn("%s: remove", to);
 			return (1);
 		}
-		blen = sbp->st_blksize;
+	} else if (errno != ENOENT) {
+		warn("%s", to);
+		return (1);
 	}
-	while ((to_fd =
-	    open(to, O_CREAT | O_EXCL | O_TRUNC | O_WRONLY, 0)) < 0) {
-		if (errno == EEXIST && unlink(to) == 0)
-			continue;
-        warn("%s", to);
-		(void)close(from_fd);
+	if (cp_move_copy(from, to, njobs)) {
+		warnx("%s: not removed, the copy to %s is incomplete",
+		    from, to);
 		return (1);
 	}
-#ifdef __APPLE__
-       {
-               struct statfs sfs;
-
-               /*
-                * Pre-allocate blocks for the destination file if it
-                * resides on Xsan.
-                */
-               if (fstatfs(to_fd, &sfs) == 0 &&
-                   strcmp(sfs.f_fstypename, "acfs") == 0) {
-                       fstore_t fst;
+	if (rmtree(from))
+		return (1);
+	if (vflg)
+		fprintf(thread_stdout, "%s -> %s\n", from, to);
+	return (0);
+}
 
-                       fst.fst_flags = 0;
-                       fst.fst_posmode = F_PEOFPOSMODE;
-                       fst.fst_offset = 0;
-                       fst.fst_length = sbp->st_size;
+/*
+ * Remove the source of a move in one traversal, once it has been copied.
+ */
+static int
+rmtree(char *path)
+{
+	FTS *fts;
+	FTSENT *p;
+	char *argv[2];
+	int rval;
 
-                       (void) fcntl(to_fd, F_PREALLOCATE, &fst);
-               }
-       }
-#endif /* __APPLE__ */
-	while ((nread = read(from_fd, bp, (size_t)blen)) > 0)
-		if (write(to_fd, bp, (size_t)nread) != nread) {
-            warn("%s", to);
-			goto err;
-		}
-	if (nread < 0) {
-        warn("%s", from);
-err:		if (unlink(to))
-                warn("%s: remove", to);
-		(void)close(from_fd);
-		(void)close(to_fd);
+	argv[0] = path;
+	argv[1] = NULL;
+	if ((fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR, NULL)) == NULL) {
+		warn("%s: remove", path);
 		return (1);
 	}
-#ifdef __APPLE__
-	/* XATTR can fail if to_fd has mode 000 */
-	if (fcopyfile(from_fd, to_fd, NULL, COPYFILE_ACL | COPYFILE_XATTR) < 0) {
-        warn("%s: unable to move extended attributes and ACL from %s",
-                to, from);
-	}
-#endif
-	(void)close(from_fd);
-
-	oldmode = sbp->st_mode & ALLPERMS;
-	if (fchown(to_fd, sbp->st_uid, sbp->st_gid)) {
-        warn("%s: set owner/group (was: %lu/%lu)", to,
-            (u_long)sbp->st_uid, (u_long)sbp->st_gid);
-		if (oldmode & (S_ISUID | S_ISGID)) {
-            warnx(
-			        "mv: %s: owner/group changed; clearing suid/sgid (mode was 0%03o)\n",
-			    to, oldmode);
-			sbp->st_mode &= ~(S_ISUID | S_ISGID);
+	rval = 0;
+	while ((p = fts_read(fts)) != NULL) {
+		switch (p->fts_info) {
+		case FTS_D:
+			continue;
+		case FTS_DNR:
+		case FTS_ERR:
+		case FTS_NS:
+			warnx("%s: %s", p->fts_path, strerror(p->fts_errno));
+			rval = 1;
+			continue;
+		case FTS_DP:
+			if (rmdir(p->fts_accpath) == 0)
+				continue;
+			break;
+		default:
+			if (unlink(p->fts_accpath) == 0)
+				continue;
+			break;
 		}
+		warn("%s: remove", p->fts_path);
+		rval = 1;
 	}
-	if (fchmod(to_fd, sbp->st_mode))
-        warn("%s: set mode (was: 0%03o)", to, oldmode);
-	/*
-	 * XXX
-	 * NFS doesn't support chflags; ignore errors unless there's reason
-	 * to believe we're losing bits.  (Note, this still won't be right
-	 * if the server supports flags and we were trying to *remove* flags
-	 * on a file that we copied, i.e., that we didn't create.)
-	 */
-	errno = 0;
-	if (fchflags(to_fd, (u_int)sbp->st_flags))
-		if (errno != ENOTSUP || sbp->st_flags != 0)
-            warn("%s: set flags (was: 0%07o)", to, sbp->st_flags);
-
-	tval[0].tv_sec = sbp->st_atime;
-	tval[1].tv_sec = sbp->st_mtime;
-	tval[0].tv_usec = tval[1].tv_usec = 0;
-	if (utimes(to, tval))
-        warn("%s: set times", to);
-
-	if (close(to_fd)) {
-        warn("%s", to);
-		return (1);
+	if (errno != 0) {
+		warn("fts_read");
+		rval = 1;
 	}
-
-	if (unlink(from)) {
-        warn("%s: remove", from);
-		return (1);
-	}
-	if (vflg)
-		fprintf(thread_stdout, "%s -> %s\n", from, to);
-	return (0);
+	(void)fts_close(fts);
+	return (rval);
 }
 
 void
@@ -449,7 +424,7 @@ usage(void)
 {
 
 	(void)fprintf(thread_stderr, "%s\n%s\n",
-		      "usage: mv [-f | -i | -n] [-v] source target",
-		      "       mv [-f | -i | -n] [-v] source ... directory");
+		      "usage: mv [-f | -i | -n] [-v] [-j jobs] source target",
+		      "       mv [-f | -i | -n] [-v] [-j jobs] source ... directory");
 	exit(EX_USAGE);
 }
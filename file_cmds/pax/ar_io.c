@@ -52,6 +52,7 @@ __used static const char rcsid[] = "$OpenBSD: ar_io.c,v 1.38 2008/06/11 00:49:08
 #endif	/* !__APPLE__ */
 #include <sys/param.h>
 #include <sys/wait.h>
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
 #include <fcntl.h>
@@ -92,11 +93,30 @@ const char *gzip_program;		/* name of gzip program */
 static pid_t zpid = -1;			/* pid of child process */
 int force_one_volume;			/* 1 if we ignore volume changes */
 
+/*
+ * Pipelined archive writes: the writer thread writes one buffer out while
+ * buf_subs.c fills the other one with headers and file data.
+ */
+struct ar_wrq {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	pthread_t	 thread;
+	char		*spare;		/* buffer free for filling */
+	char		*pending;	/* buffer being written, or NULL */
+	int		 len;
+	int		 error;		/* errno of a failed write */
+	int		 discard;	/* reader of the pipe went away */
+	int		 finished;
+};
+static struct ar_wrq *wrq;		/* pipelined writes, if started */
+
 #ifndef __APPLE__
 static int get_phys(void);
 #endif	/* __APPLE__ */
 extern sigset_t s_mask;
 static void ar_start_gzip(int, const char *, int);
+static void *ar_wrq_thread(void *);
+static int ar_wrq_finish(void);
 
 /*
  * ar_open()
@@ -320,6 +340,10 @@ ar_close(void)
 		did_io = io_ok = flcnt = 0;
 		return;
 	}
+	if ((wrq != NULL) && (ar_wrq_finish() < 0)) {
+		syswarn(1, errno, "Failed write to archive volume: %d", arvol);
+		exit_val = 1;
+	}
 
 	/*
 	 * Close archive file. This may take a LONG while on tapes (we may be
@@ -726,6 +750,160 @@ ar_write(char *buf, int bsz)
 	return(res);
 }
 
+/*
+ * ar_wrq_thread()
+ *	writes out the buffers handed over by ar_wrq_put(). Signals are left
+ *	to the main thread.
+ */
+
+static void *
+ar_wrq_thread(void *arg)
+{
+	struct ar_wrq *w = arg;
+	sigset_t set;
+	ssize_t res;
+	char *pt;
+	int cnt;
+
+	(void)sigfillset(&set);
+	(void)pthread_sigmask(SIG_BLOCK, &set, NULL);
+	pthread_mutex_lock(&w->mtx);
+	for (;;) {
+		while ((w->pending == NULL) && !w->finished)
+			pthread_cond_wait(&w->cv, &w->mtx);
+		if (w->pending == NULL)
+			break;
+		pthread_mutex_unlock(&w->mtx);
+
+		pt = w->pending;
+		cnt = w->len;
+		while ((cnt > 0) && (w->error == 0) && !w->discard) {
+			if ((res = write(arfd, pt, cnt)) >= 0) {
+				pt += res;
+				cnt -= res;
+			} else if (errno == EPIPE && artyp == ISPIPE)
+				w->discard = 1;	/* same as ar_write() */
+			else if (errno != EINTR)
+				w->error = errno;
+		}
+
+		pthread_mutex_lock(&w->mtx);
+		w->pending = NULL;
+		pthread_cond_signal(&w->cv);
+	}
+	pthread_mutex_unlock(&w->mtx);
+	return(NULL);
+}
+
+/*
+ * ar_wrq_start()
+ *	start pipelined writes if the archive is a regular file or a pipe
+ *	being created. The record size only matters to tapes and other
+ *	devices, so buffers of any multiple of it can be written. bufsz is
+ *	the size of the buffers the caller fills.
+ * Return:
+ *	0 if started, -1 if the archive has to be written synchronously
+ */
+
+int
+ar_wrq_start(int bufsz)
+{
+	struct ar_wrq *w;
+
+	if ((act != ARCHIVE) || (arfd < 0) ||
+	    ((artyp != ISREG) && (artyp != ISPIPE)))
+		return(-1);
+	if ((w = calloc(1, sizeof(*w))) == NULL)
+		return(-1);
+	if ((w->spare = malloc(bufsz)) == NULL) {
+		free(w);
+		return(-1);
+	}
+	pthread_mutex_init(&w->mtx, NULL);
+	pthread_cond_init(&w->cv, NULL);
+	if (pthread_create(&w->thread, NULL, ar_wrq_thread, w) != 0) {
+		pthread_cond_destroy(&w->cv);
+		pthread_mutex_destroy(&w->mtx);
+		free(w->spare);
+		free(w);
+		return(-1);
+	}
+	wrq = w;
+	return(0);
+}
+
+/*
+ * ar_wrq_put()
+ *	queue the bsz bytes at *bufp for writing to the archive and replace
+ *	*bufp with a free buffer. There is no volume change in this mode, a
+ *	failed write ends the archive.
+ * Return:
+ *	bsz if queued, -1 if an earlier write failed
+ */
+
+int
+ar_wrq_put(char **bufp, int bsz)
+{
+	struct ar_wrq *w = wrq;
+	int error;
+
+	pthread_mutex_lock(&w->mtx);
+	while (w->pending != NULL)
+		pthread_cond_wait(&w->cv, &w->mtx);
+	if ((error = w->error) == 0) {
+		w->pending = *bufp;
+		w->len = bsz;
+		*bufp = w->spare;
+		w->spare = w->pending;
+		pthread_cond_signal(&w->cv);
+	}
+	pthread_mutex_unlock(&w->mtx);
+	if (error != 0) {
+		if (lstrval > 0)
+			syswarn(1, error, "Failed write to archive volume: %d",
+			    arvol);
+		lstrval = -1;
+		return(-1);
+	}
+	wr_trail = 1;
+	io_ok = 1;
+	return(bsz);
+}
+
+/*
+ * ar_wrq_finish()
+ *	wait for the last write and stop the writer thread
+ * Return:
+ *	0 if all the writes went out, -1 with errno set otherwise
+ */
+
+static int
+ar_wrq_finish(void)
+{
+	struct ar_wrq *w = wrq;
+	int error;
+
+	wrq = NULL;
+	pthread_mutex_lock(&w->mtx);
+	w->finished = 1;
+	pthread_cond_signal(&w->cv);
+	pthread_mutex_unlock(&w->mtx);
+	pthread_join(w->thread, NULL);
+	pthread_cond_destroy(&w->cv);
+	pthread_mutex_destroy(&w->mtx);
+	/*
+	 * a failure already reported by ar_wrq_put() is not reported again
+	 */
+	error = (lstrval < 0) ? 0 : w->error;
+	free(w->spare);
+	free(w);
+	if (error != 0) {
+		errno = error;
+		return(-1);
+	}
+	return(0);
+}
+
 /*
  * ar_rdsync()
  *	Try to move past a bad spot on a flawed archive as needed to continue
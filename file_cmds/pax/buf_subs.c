@@ -71,6 +71,8 @@ static char bufmem[MAXBLK+BLKMULT];	/* i/o buffer + pushback id space */
 static char *buf;			/* normal start of i/o buffer */
 static char *bufend;			/* end or last char in i/o buffer */
 static char *bufpt;			/* read/write point in i/o buffer */
+static char *bigbuf;			/* BIGBLK buffer for pipelined writes */
+static int wrrec;			/* record size if writes are pipelined */
 int blksz = MAXBLK;			/* block input/output size in bytes */
 int wrblksz;				/* user spec output size in bytes */
 int maxflt = MAXFLT;			/* MAX consecutive media errors */
@@ -121,8 +123,23 @@ wr_start(void)
 	blksz = rdblksz = wrblksz;
 	if ((ar_open(arcname) < 0) && (ar_next() < 0))
 		return(-1);
+
+	/*
+	 * archives in regular files and pipes are written BIGBLK at a time,
+	 * on a writer thread so that reading the files being archived and
+	 * writing the archive overlap. Only the last record is padded, so
+	 * the archive is the same as when written a record at a time. This
+	 * is not done with -B, as there is no volume change in this mode.
+	 */
+	if ((wrlimit == 0) &&
+	    ((bigbuf != NULL) || ((bigbuf = malloc(BIGBLK)) != NULL)) &&
+	    (ar_wrq_start(BIGBLK) == 0)) {
+		buf = bigbuf;
+		blksz = (BIGBLK / wrblksz) * wrblksz;
+		wrrec = wrblksz;
+	}
 	wrcnt = 0;
-	bufend = buf + wrblksz;
+	bufend = buf + blksz;
 	bufpt = buf;
 	return(0);
 }
@@ -467,9 +484,14 @@ void
 wr_fin(void)
 {
 	if (bufpt > buf) {
+		/*
+		 * pipelined writes only pad up to the end of the record
+		 */
+		if (wrrec > 0)
+			bufend = buf + roundup(bufpt - buf, wrrec);
 		memset(bufpt, 0, bufend - bufpt);
 		bufpt = bufend;
-		(void)buf_flush(blksz);
+		(void)buf_flush(bufend - buf);
 	}
 }
 
@@ -890,6 +912,21 @@ buf_flush(int bufcnt)
 	int push = 0;
 	int totcnt = 0;
 
+	/*
+	 * pipelined writes hand the buffer over to the writer thread and
+	 * carry on with a free one
+	 */
+	if (wrrec > 0) {
+		if (ar_wrq_put(&buf, bufcnt) < 0) {
+			exit_val = 1;
+			return(-1);
+		}
+		wrcnt += bufcnt;
+		bufend = buf + blksz;
+		bufpt = buf;
+		return(bufcnt);
+	}
+
 	/*
 	 * if we have reached the user specified byte count for each archive
 	 * volume, prompt for the next volume. (The non-standard -R flag).
@@ -55,6 +55,8 @@ int ar_set_wr(void);
 int ar_app_ok(void);
 int ar_read(char *, int);
 int ar_write(char *, int);
+int ar_wrq_start(int);
+int ar_wrq_put(char **, int);
 int ar_rdsync(void);
 int ar_fow(off_t, off_t *);
 int ar_rev(off_t );
@@ -48,6 +48,7 @@
 				/* Don't even think of changing this */
 #define DEVBLK		8192	/* default read blksize for devices */
 #define FILEBLK		10240	/* default read blksize for files */
+#define BIGBLK		(1024 * 1024)	/* write size for file/pipe archives */
 #define PAXPATHLEN	3072	/* maximum path length for pax. MUST be */
 				/* longer than the system MAXPATHLEN */
 
@@ -73,16 +73,30 @@ __used static const char rcsid[] = "$OpenBSD: tables.c,v 1.25 2007/09/02 15:19:0
  */
 
 static HRDLNK **ltab = NULL;	/* hard link table for detecting hard links */
-static FTM **ftab = NULL;	/* file time table for updating arch */
+static size_t ltabsize;		/* slots in ltab, a power of two */
+static size_t ltabcnt;		/* entries in ltab */
+static FTM *ftab = NULL;	/* file time table for updating arch */
+static size_t ftabsize;		/* slots in ftab, a power of two */
+static size_t ftabcnt;		/* entries in ftab */
 static NAMT **ntab = NULL;	/* interactive rename storage table */
 static DEVT **dtab = NULL;	/* device/inode mapping tables */
 static ATDIR **atab = NULL;	/* file tree directory time reset table */
 static DIRDATA *dirp = NULL;	/* storage for setting created dir time/mode */
 static size_t dirsize;		/* size of dirp table */
 static long dircnt = 0;		/* entries in dir time/mode storage */
+static char *farena = NULL;	/* current file time name arena chunk */
+static size_t farenaleft;	/* bytes left in farena */
+static size_t farenatot;	/* bytes of names kept in memory */
 static int ffd = -1;		/* tmp file for file time table name storage */
 
 static DEVT *chk_dev(dev_t, int);
+static u_int lnk_hash(dev_t, ino_t);
+static size_t lnk_slot(dev_t, ino_t);
+static void lnk_del(size_t);
+static int lnk_grow(void);
+static u_int ft_hash(char *, int);
+static int ft_grow(void);
+static int ft_store(FTM *, char *, int);
 
 /*
  * hard link table routines
@@ -98,6 +112,10 @@ static DEVT *chk_dev(dev_t, int);
  * used by the format read routine to detect hard links from stored dev and
  * inode numbers (like cpio). This will allow pax to create a link when one
  * can be detected by the archive format.
+ *
+ * The table is open addressed with linear probing, and doubles in size
+ * whenever it becomes half full. Entries are removed by shifting the rest of
+ * their probe run back, so no tombstones are left behind.
  */
 
 /*
@@ -112,10 +130,104 @@ lnk_start(void)
 {
 	if (ltab != NULL)
 		return(0);
- 	if ((ltab = (HRDLNK **)calloc(L_TAB_SZ, sizeof(HRDLNK *))) == NULL) {
+ 	if ((ltab = (HRDLNK **)calloc(L_TAB_INIT, sizeof(HRDLNK *))) == NULL) {
 		paxwarn(1, "Cannot allocate memory for hard link table");
 		return(-1);
 	}
+	ltabsize = L_TAB_INIT;
+	ltabcnt = 0;
+	return(0);
+}
+
+/*
+ * lnk_hash()
+ *	mixes the device and inode numbers, the high bits of the product are
+ *	the well mixed ones.
+ */
+
+static u_int
+lnk_hash(dev_t dev, ino_t ino)
+{
+	u_int64_t key;
+
+	key = ((u_int64_t)ino + (u_int64_t)dev * 0x9e3779b97f4a7c15ULL) *
+	    0xbf58476d1ce4e5b9ULL;
+	return((u_int)(key >> 32));
+}
+
+/*
+ * lnk_slot()
+ *	returns the slot holding the dev/ino pair, or the empty slot it
+ *	would be added at.
+ */
+
+static size_t
+lnk_slot(dev_t dev, ino_t ino)
+{
+	HRDLNK *pt;
+	size_t mask = ltabsize - 1;
+	size_t i;
+
+	for (i = lnk_hash(dev, ino) & mask; (pt = ltab[i]) != NULL;
+	    i = (i + 1) & mask) {
+		if ((pt->ino == ino) && (pt->dev == dev))
+			break;
+	}
+	return(i);
+}
+
+/*
+ * lnk_del()
+ *	empties a slot, moving back the entries after it in the same probe
+ *	run that would no longer be found. The entry itself is not freed.
+ */
+
+static void
+lnk_del(size_t i)
+{
+	size_t mask = ltabsize - 1;
+	size_t j, k;
+
+	ltab[i] = NULL;
+	--ltabcnt;
+	for (j = (i + 1) & mask; ltab[j] != NULL; j = (j + 1) & mask) {
+		/*
+		 * an entry whose home slot k lies cyclically in (i, j] can
+		 * stay where it is
+		 */
+		k = lnk_hash(ltab[j]->dev, ltab[j]->ino) & mask;
+		if ((i < j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		ltab[i] = ltab[j];
+		ltab[j] = NULL;
+		i = j;
+	}
+}
+
+/*
+ * lnk_grow()
+ *	doubles the hard link table
+ * Return:
+ *	0 if ok, -1 if out of memory (the table is left unchanged)
+ */
+
+static int
+lnk_grow(void)
+{
+	HRDLNK **otab = ltab;
+	size_t osize = ltabsize;
+	size_t i;
+
+	if ((ltab = (HRDLNK **)calloc(osize * 2, sizeof(HRDLNK *))) == NULL) {
+		ltab = otab;
+		return(-1);
+	}
+	ltabsize = osize * 2;
+	for (i = 0; i < osize; ++i) {
+		if (otab[i] != NULL)
+			ltab[lnk_slot(otab[i]->dev, otab[i]->ino)] = otab[i];
+	}
+	free(otab);
 	return(0);
 }
 
@@ -135,8 +247,7 @@ int
 chk_lnk(ARCHD *arcn)
 {
 	HRDLNK *pt;
-	HRDLNK **ppt;
-	u_int indx;
+	size_t indx;
 
 	if (ltab == NULL)
 		return(-1);
@@ -149,66 +260,58 @@ chk_lnk(ARCHD *arcn)
 	/*
 	 * hash inode number and look for this file
 	 */
-	indx = ((unsigned)arcn->sb.st_ino) % L_TAB_SZ;
+	indx = lnk_slot(arcn->sb.st_dev, arcn->sb.st_ino);
 	if ((pt = ltab[indx]) != NULL) {
 		/*
-		 * its hash chain in not empty, walk down looking for it
+		 * found a link. set the node type and copy in the
+		 * name of the file it is to link to. we need to
+		 * handle hardlinks to regular files differently than
+		 * other links.
 		 */
-		ppt = &(ltab[indx]);
-		while (pt != NULL) {
-			if ((pt->ino == arcn->sb.st_ino) &&
-			    (pt->dev == arcn->sb.st_dev))
-				break;
-			ppt = &(pt->fow);
-			pt = pt->fow;
-		}
+		arcn->ln_nlen = strlcpy(arcn->ln_name, pt->name,
+			sizeof(arcn->ln_name));
+		/* XXX truncate? */
+		if (arcn->nlen >= sizeof(arcn->name))
+			arcn->nlen = sizeof(arcn->name) - 1;
+		if (arcn->type == PAX_REG)
+			arcn->type = PAX_HRG;
+		else
+			arcn->type = PAX_HLK;
 
-		if (pt != NULL) {
-			/*
-			 * found a link. set the node type and copy in the
-			 * name of the file it is to link to. we need to
-			 * handle hardlinks to regular files differently than
-			 * other links.
-			 */
-			arcn->ln_nlen = strlcpy(arcn->ln_name, pt->name,
-				sizeof(arcn->ln_name));
-			/* XXX truncate? */
-			if (arcn->nlen >= sizeof(arcn->name))
-				arcn->nlen = sizeof(arcn->name) - 1;
-			if (arcn->type == PAX_REG)
-				arcn->type = PAX_HRG;
-			else
-				arcn->type = PAX_HLK;
-
-			/*
-			 * if we have found all the links to this file, remove
-			 * it from the database
-			 */
-			if (--pt->nlink <= 1) {
-				*ppt = pt->fow;
-				(void)free((char *)pt->name);
-				(void)free((char *)pt);
-			}
-			return(1);
+		/*
+		 * if we have found all the links to this file, remove
+		 * it from the database
+		 */
+		if (--pt->nlink <= 1) {
+			lnk_del(indx);
+			(void)free((char *)pt->name);
+			(void)free((char *)pt);
 		}
+		return(1);
 	}
 
 	/*
 	 * we never saw this file before. It has links so we add it to the
-	 * front of this hash chain
+	 * table, growing it first if it would become more than half full
 	 */
+	if ((ltabcnt + 1) * 2 > ltabsize) {
+		if (lnk_grow() < 0)
+			goto nomem;
+		indx = lnk_slot(arcn->sb.st_dev, arcn->sb.st_ino);
+	}
 	if ((pt = (HRDLNK *)malloc(sizeof(HRDLNK))) != NULL) {
 		if ((pt->name = strdup(arcn->name)) != NULL) {
 			pt->dev = arcn->sb.st_dev;
 			pt->ino = arcn->sb.st_ino;
 			pt->nlink = arcn->sb.st_nlink;
-			pt->fow = ltab[indx];
 			ltab[indx] = pt;
+			++ltabcnt;
 			return(0);
 		}
 		(void)free((char *)pt);
 	}
 
+nomem:
 	paxwarn(1, "Hard link table out of memory");
 	return(-1);
 }
@@ -224,8 +327,7 @@ void
 purg_lnk(ARCHD *arcn)
 {
 	HRDLNK *pt;
-	HRDLNK **ppt;
-	u_int indx;
+	size_t indx;
 
 	if (ltab == NULL)
 		return;
@@ -237,31 +339,16 @@ purg_lnk(ARCHD *arcn)
 		return;
 
 	/*
-	 * find the hash chain for this inode value, if empty return
+	 * look for the inode/dev pair, if not there return
 	 */
-	indx = ((unsigned)arcn->sb.st_ino) % L_TAB_SZ;
+	indx = lnk_slot(arcn->sb.st_dev, arcn->sb.st_ino);
 	if ((pt = ltab[indx]) == NULL)
 		return;
 
-	/*
-	 * walk down the list looking for the inode/dev pair, unlink and
-	 * free if found
-	 */
-	ppt = &(ltab[indx]);
-	while (pt != NULL) {
-		if ((pt->ino == arcn->sb.st_ino) &&
-		    (pt->dev == arcn->sb.st_dev))
-			break;
-		ppt = &(pt->fow);
-		pt = pt->fow;
-	}
-	if (pt == NULL)
-		return;
-
 	/*
 	 * remove and free it
 	 */
-	*ppt = pt->fow;
+	lnk_del(indx);
 	(void)free((char *)pt->name);
 	(void)free((char *)pt);
 }
@@ -277,29 +364,20 @@ purg_lnk(ARCHD *arcn)
 void
 lnk_end(void)
 {
-	int i;
+	size_t i;
 	HRDLNK *pt;
-	HRDLNK *ppt;
 
 	if (ltab == NULL)
 		return;
 
-	for (i = 0; i < L_TAB_SZ; ++i) {
-		if (ltab[i] == NULL)
+	for (i = 0; i < ltabsize; ++i) {
+		if ((pt = ltab[i]) == NULL)
 			continue;
-		pt = ltab[i];
 		ltab[i] = NULL;
-
-		/*
-		 * free up each entry on this chain
-		 */
-		while (pt != NULL) {
-			ppt = pt;
-			pt = ppt->fow;
-			(void)free((char *)ppt->name);
-			(void)free((char *)ppt);
-		}
+		(void)free((char *)pt->name);
+		(void)free((char *)pt);
 	}
+	ltabcnt = 0;
 	return;
 }
 
@@ -313,25 +391,22 @@ lnk_end(void)
  * name on the archive it is added). This applies to writes and appends.
  * An append with an -u must read the archive and store the modification time
  * for every file on that archive before starting the write phase. It is clear
- * that this is one HUGE database. To save memory space, the actual file names
- * are stored in a scratch file and indexed by an in-memory hash table. The
- * hash table is indexed by hashing the file path. The nodes in the table store
- * the length of the filename and the lseek offset within the scratch file
- * where the actual name is stored. Since there are never any deletions from
- * this table, fragmentation of the scratch file is never a issue. Lookups 
- * seem to not exhibit any locality at all (files in the database are rarely
- * looked up more than once...), so caching is just a waste of memory. The
- * only limitation is the amount of scratch file space available to store the
- * path names.
+ * that this is one HUGE database. The table is open addressed with linear
+ * probing on a hash of the full path, and doubles whenever it becomes half
+ * full. Each slot keeps the hash, so names are only compared when the hashes
+ * match. Since there are never any deletions from this table, file names are
+ * packed one after the other into large memory chunks. Once F_MEM_MAX bytes
+ * of names are in memory, further names are written to a scratch file
+ * instead, so the size of the archive we can handle is still only limited by
+ * the scratch file space available to store the path names.
  */
 
 /*
  * ftime_start()
- *	create the file time hash table and open for read/write the scratch
- *	file. (after created it is unlinked, so when we exit we leave
- *	no witnesses).
+ *	create the file time hash table. The scratch file is only created
+ *	once the names outgrow F_MEM_MAX.
  * Return:
- *	0 if the table and file was created ok, -1 otherwise
+ *	0 if the table was created ok, -1 otherwise
  */
 
 int
@@ -340,30 +415,126 @@ ftime_start(void)
 
 	if (ftab != NULL)
 		return(0);
- 	if ((ftab = (FTM **)calloc(F_TAB_SZ, sizeof(FTM *))) == NULL) {
+ 	if ((ftab = (FTM *)calloc(F_TAB_INIT, sizeof(FTM))) == NULL) {
 		paxwarn(1, "Cannot allocate memory for file time table");
 		return(-1);
 	}
+	ftabsize = F_TAB_INIT;
+	ftabcnt = 0;
+	return(0);
+}
 
-	/*
-	 * get random name and create temporary scratch file, unlink name
-	 * so it will get removed on exit
-	 */
-	memcpy(tempbase, _TFILE_BASE, sizeof(_TFILE_BASE));
-	if ((ffd = mkstemp(tempfile)) < 0) {
-		syswarn(1, errno, "Unable to create temporary file: %s",
-		    tempfile);
+/*
+ * ft_hash()
+ *	FNV-1a hash of a whole path name. Unlike st_hash() its low bits are
+ *	well spread, as needed for a power of two table.
+ */
+
+static u_int
+ft_hash(char *name, int len)
+{
+	u_char *pt = (u_char *)name;
+	u_char *end = pt + len;
+	u_int key = 2166136261U;
+
+	while (pt < end)
+		key = (key ^ *pt++) * 16777619U;
+	return(key);
+}
+
+/*
+ * ft_grow()
+ *	doubles the file time table
+ * Return:
+ *	0 if ok, -1 if out of memory (the table is left unchanged)
+ */
+
+static int
+ft_grow(void)
+{
+	FTM *otab = ftab;
+	size_t osize = ftabsize;
+	size_t mask = osize * 2 - 1;
+	size_t i, j;
+
+	if ((ftab = (FTM *)calloc(osize * 2, sizeof(FTM))) == NULL) {
+		ftab = otab;
 		return(-1);
 	}
-	(void)unlink(tempfile);
+	ftabsize = osize * 2;
+	for (i = 0; i < osize; ++i) {
+		if (otab[i].namelen == 0)
+			continue;
+		for (j = otab[i].hash & mask; ftab[j].namelen != 0;
+		    j = (j + 1) & mask)
+			;
+		ftab[j] = otab[i];
+	}
+	free(otab);
+	return(0);
+}
+
+/*
+ * ft_store()
+ *	saves a copy of the name for a file time table entry, in memory while
+ *	under F_MEM_MAX, at the end of the scratch file after that (after
+ *	created it is unlinked, so when we exit we leave no witnesses).
+ * Return:
+ *	0 if ok, -1 otherwise
+ */
 
+static int
+ft_store(FTM *pt, char *name, int namelen)
+{
+	if (farenatot + namelen <= F_MEM_MAX) {
+		if ((size_t)namelen > farenaleft) {
+			/*
+			 * the rest of the current chunk is given up, names
+			 * are never split between chunks
+			 */
+			if ((farena = malloc(F_ARENA_SZ)) == NULL) {
+				paxwarn(1, "File time table ran out of memory");
+				return(-1);
+			}
+			farenaleft = F_ARENA_SZ;
+		}
+		memcpy(farena, name, namelen);
+		pt->name = farena;
+		farena += namelen;
+		farenaleft -= namelen;
+		farenatot += namelen;
+		return(0);
+	}
+
+	if (ffd < 0) {
+		/*
+		 * get random name and create temporary scratch file, unlink
+		 * name so it will get removed on exit
+		 */
+		memcpy(tempbase, _TFILE_BASE, sizeof(_TFILE_BASE));
+		if ((ffd = mkstemp(tempfile)) < 0) {
+			syswarn(1, errno, "Unable to create temporary file: %s",
+			    tempfile);
+			return(-1);
+		}
+		(void)unlink(tempfile);
+	}
+	if ((pt->seek = lseek(ffd, (off_t)0, SEEK_END)) < 0) {
+		syswarn(1, errno, "Failed seek on file time table");
+		return(-1);
+	}
+	if (write(ffd, name, namelen) != namelen) {
+		syswarn(1, errno, "Failed write to file time table");
+		return(-1);
+	}
+	pt->name = NULL;
 	return(0);
 }
 
 /*
  * chk_ftime()
  *	looks up entry in file time hash table. If not found, the file is
- *	added to the hash table and the file named stored in the scratch file.
+ *	added to the hash table and the file named stored in the name arena.
  *	If a file with the same name is found, the file times are compared and
  *	the most recent file time is retained. If the new file was younger (or
  *	was not in the database) the new file is selected for storage.
@@ -377,7 +548,8 @@ chk_ftime(ARCHD *arcn)
 {
 	FTM *pt;
 	int namelen;
-	u_int indx;
+	u_int hash;
+	size_t indx, mask;
 	char ckname[PAXPATHLEN+1];
 
 	/*
@@ -387,89 +559,74 @@ chk_ftime(ARCHD *arcn)
 		return(0);
 
 	/*
-	 * hash the pathname and look up in table
+	 * hash the pathname and look up in table. An empty name never
+	 * makes it here, a namelen of 0 marks a free slot.
 	 */
 	namelen = arcn->nlen;
-	indx = st_hash(arcn->name, namelen, F_TAB_SZ);
-	if ((pt = ftab[indx]) != NULL) {
+	if (namelen <= 0)
+		return(0);
+	hash = ft_hash(arcn->name, namelen);
+	mask = ftabsize - 1;
+	for (indx = hash & mask; (pt = &ftab[indx])->namelen != 0;
+	    indx = (indx + 1) & mask) {
 		/*
-		 * the hash chain is not empty, walk down looking for match
-		 * only read up the path names if the lengths match, speeds
-		 * up the search a lot
+		 * only look at the path names if the hashes and lengths
+		 * match, speeds up the search a lot
 		 */
-		while (pt != NULL) {
-			if (pt->namelen == namelen) {
-				/*
-				 * potential match, have to read the name
-				 * from the scratch file.
-				 */
-				if (lseek(ffd,pt->seek,SEEK_SET) != pt->seek) {
-					syswarn(1, errno,
-					    "Failed ftime table seek");
-					return(-1);
-				}
-				if (read(ffd, ckname, namelen) != namelen) {
-					syswarn(1, errno,
-					    "Failed ftime table read");
-					return(-1);
-				}
-
-				/*
-				 * if the names match, we are done
-				 */
-				if (!strncmp(ckname, arcn->name, namelen))
-					break;
-			}
-
-			/*
-			 * try the next entry on the chain
-			 */
-			pt = pt->fow;
-		}
-
-		if (pt != NULL) {
+		if ((pt->hash != hash) || (pt->namelen != namelen))
+			continue;
+		if (pt->name == NULL) {
 			/*
-			 * found the file, compare the times, save the newer
+			 * potential match, have to read the name from the
+			 * scratch file.
 			 */
-			if (arcn->sb.st_mtime > pt->mtime) {
-				/*
-				 * file is newer
-				 */
-				pt->mtime = arcn->sb.st_mtime;
-				return(0);
+			if (pread(ffd, ckname, namelen, pt->seek) != namelen) {
+				syswarn(1, errno, "Failed ftime table read");
+				return(-1);
 			}
+			if (memcmp(ckname, arcn->name, namelen) != 0)
+				continue;
+		} else if (memcmp(pt->name, arcn->name, namelen) != 0)
+			continue;
+
+		/*
+		 * found the file, compare the times, save the newer
+		 */
+		if (arcn->sb.st_mtime > pt->mtime) {
 			/*
-			 * file is older
+			 * file is newer
 			 */
-			return(1);
+			pt->mtime = arcn->sb.st_mtime;
+			return(0);
 		}
+		/*
+		 * file is older
+		 */
+		return(1);
 	}
 
 	/*
-	 * not in table, add it
+	 * not in table, add it, growing the table first if it would become
+	 * more than half full
 	 */
-	if ((pt = (FTM *)malloc(sizeof(FTM))) != NULL) {
-		/*
-		 * add the name at the end of the scratch file, saving the
-		 * offset. add the file to the head of the hash chain
-		 */
-		if ((pt->seek = lseek(ffd, (off_t)0, SEEK_END)) >= 0) {
-			if (write(ffd, arcn->name, namelen) == namelen) {
-				pt->mtime = arcn->sb.st_mtime;
-				pt->namelen = namelen;
-				pt->fow = ftab[indx];
-				ftab[indx] = pt;
-				return(0);
-			}
-			syswarn(1, errno, "Failed write to file time table");
-		} else
-			syswarn(1, errno, "Failed seek on file time table");
-	} else
-		paxwarn(1, "File time table ran out of memory");
-
-	if (pt != NULL)
-		(void)free((char *)pt);
-	return(-1);
+	if ((ftabcnt + 1) * 2 > ftabsize) {
+		if (ft_grow() < 0) {
+			paxwarn(1, "File time table ran out of memory");
+			return(-1);
+		}
+		mask = ftabsize - 1;
+		for (indx = hash & mask; ftab[indx].namelen != 0;
+		    indx = (indx + 1) & mask)
+			;
+		pt = &ftab[indx];
+	}
+	if (ft_store(pt, arcn->name, namelen) < 0)
+		return(-1);
+	pt->hash = hash;
+	pt->mtime = arcn->sb.st_mtime;
+	pt->namelen = namelen;
+	++ftabcnt;
+	return(0);
 }
 
 /*
@@ -42,11 +42,13 @@
 
 /*
  * Hash Table Sizes MUST BE PRIME, if set too small performance suffers.
- * Probably safe to expect 500000 inodes per tape. Assuming good key
- * distribution (inodes) chains of under 50 long (worst case) is ok.
+ * The hard link and file time tables grow as needed, their initial sizes
+ * MUST BE A POWER OF TWO.
  */
-#define L_TAB_SZ	2503		/* hard link hash table size */
-#define F_TAB_SZ	50503		/* file time hash table size */
+#define L_TAB_INIT	1024		/* initial hard link hash table size */
+#define F_TAB_INIT	4096		/* initial file time hash table size */
+#define F_ARENA_SZ	(1024 * 1024)	/* file time name arena chunk size */
+#define F_MEM_MAX	(64 * 1024 * 1024)	/* file time names kept in memory */
 #define N_TAB_SZ	541		/* interactive rename hash table */
 #define D_TAB_SZ	317		/* unique device mapping table */
 #define A_TAB_SZ	317		/* ftree dir access time reset table */
@@ -54,33 +56,33 @@
 #define DIRP_SIZE	64		/* initial size of created dir table */
 
 /*
- * file hard link structure (hashed by dev/ino and chained) used to find the
- * hard links in a file system or with some archive formats (cpio)
+ * file hard link structure (hashed by dev/ino) used to find the hard links
+ * in a file system or with some archive formats (cpio)
  */
 typedef struct hrdlnk {
 	char		*name;	/* name of first file seen with this ino/dev */
 	dev_t		dev;	/* files device number */
 	ino_t		ino;	/* files inode number */
 	u_long		nlink;	/* expected link count */
-	struct hrdlnk	*fow;
 } HRDLNK;
 
 /*
  * Archive write update file time table (the -u, -C flag), hashed by filename.
- * Filenames are stored in a scratch file at seek offset into the file. The
- * file time (mod time) and the file name length (for a quick check) are
- * stored in a hash table node. We were forced to use a scratch file because
- * with -u, the mtime for every node in the archive must always be available
- * to compare against (and this data can get REALLY large with big archives).
- * By being careful to read only when we have a good chance of a match, the
- * performance loss is not measurable (and the size of the archive we can
- * handle is greatly increased).
+ * The table holds the nodes themselves. A node with a namelen of 0 is a free
+ * slot. Filenames are kept in memory chunks up to F_MEM_MAX bytes in all, and
+ * past that in a scratch file at seek offset into the file. The file time
+ * (mod time), the hash and the file name length (for a quick check) are
+ * stored in the node, so a name is only looked at when it is very likely to
+ * match. With -u, the mtime for every node in the archive must always be
+ * available to compare against (and this data can get REALLY large with big
+ * archives).
  */
 typedef struct ftm {
-	int		namelen;	/* file name length */
-	time_t		mtime;		/* files last modification time */
+	char		*name;		/* file name, NULL if in scratch file */
 	off_t		seek;		/* location in scratch file */
-	struct ftm	*fow;
+	time_t		mtime;		/* files last modification time */
+	u_int		hash;		/* ft_hash() of the file name */
+	int		namelen;	/* file name length */
 } FTM;
 
 /*
@@ -55,6 +55,8 @@ __used static const char rcsid[] =
 #include <errno.h>
 #include <fcntl.h>
 #include <fts.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -70,9 +72,23 @@ __used static const char rcsid[] =
 #define COMPAT_MODE(func, mode) 1
 #endif
 #include "ios_error.h"
+#include "dirwalk.h"
 
 static int dflag, eval, fflag, iflag, Pflag, vflag, Wflag, stdin_ok;
 static uid_t uid;
+static unsigned int njobs;
+
+/*
+ * A directory being emptied by rm_fast().  It is removed, and its
+ * descriptor closed, once pending drops to zero: one for the thread
+ * reading it, plus one for each subdirectory still there.
+ */
+struct rm_dir {
+	struct rm_dir	*parent;
+	int		 fd;
+	int		 pending;
+	char		 name[];
+};
 
 static int	check __P((char *, char *, struct stat *));
 static int checkdir __P((char *));
@@ -81,6 +97,10 @@ static void	checkdot __P((char **));
 static void	rm_file __P((char **));
 static void	rm_overwrite __P((char *, struct stat *));
 static void	rm_tree __P((char **));
+static void	rm_fast __P((char **));
+static void	rm_work __P((struct dw_pool *, void *));
+static void	rm_read __P((struct dw_pool *, struct rm_dir *));
+static void	rm_release __P((struct dw_pool *, struct rm_dir *));
 static void	usage __P((void));
 
 /*
@@ -96,13 +116,15 @@ rm_main(argc, argv)
 	char *argv[];
 {
 	int ch, rflag;
-	char *p;
+	char *p, *ep;
+	u_long l;
 
 	if (argc < 1)
 		usage();
 
     // init all flags, something quite important for rm
     dflag = eval = fflag = iflag = Pflag = vflag = Wflag = stdin_ok = 0;
+    njobs = 1;
         optind = 1; opterr = 1; optreset = 1;
 
 	/*
@@ -124,7 +146,7 @@ rm_main(argc, argv)
 	}
 
 	Pflag = rflag = 0;
-	while ((ch = getopt(argc, argv, "dfiPRrvW")) != -1)
+	while ((ch = getopt(argc, argv, "dfij:PRrvW")) != -1)
 		switch(ch) {
 		case 'd':
 			dflag = 1;
@@ -137,6 +159,13 @@ rm_main(argc, argv)
 			fflag = 0;
 			iflag = 1;
 			break;
+		case 'j':
+			errno = 0;
+			l = strtoul(optarg, &ep, 10);
+			if (errno != 0 || *ep != '\0' || l == 0 || l > UINT_MAX)
+				errx(1, "%s: invalid number of jobs", optarg);
+			njobs = (unsigned int)l;
+			break;
 		case 'P':
 			Pflag = 1;
 			break;
@@ -167,8 +196,12 @@ rm_main(argc, argv)
 	if (*argv) {
 		stdin_ok = ios_isatty(STDIN_FILENO);
 
-		if (rflag)
+		if (rflag) {
+			/* Nothing to ask or report: empty the trees first */
+			if (fflag && !Pflag && !vflag && !Wflag)
+				rm_fast(argv);
 			rm_tree(argv);
+		}
 		else
 			rm_file(argv);
 	}
@@ -334,6 +367,121 @@ err:
     }
 }
 
+/*
+ * The fast path of rm -rf.  The directories named by argv are emptied by
+ * njobs threads, which take directories off a shared stack and remove
+ * their entries with unlinkat() relative to the directory's descriptor,
+ * with no paths to build and nothing to stat.  A directory is removed by
+ * whichever thread removes its last subdirectory.  Nothing is reported
+ * here: whatever is left, the named directories themselves included, is
+ * then removed by rm_tree(), which prints the errors.
+ */
+void
+rm_fast(argv)
+	char **argv;
+{
+	struct dw_pool pool;
+	struct rm_dir *d;
+	struct stat sb;
+	int fd;
+
+	dw_pool_init(&pool, rm_work, NULL);
+	for (; *argv != NULL; argv++) {
+		if (lstat(*argv, &sb) != 0 || !S_ISDIR(sb.st_mode))
+			continue;
+		fd = open(*argv, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+		if ((d = calloc(1, sizeof(*d) + 1)) == NULL)
+			err(1, "calloc");
+		d->fd = fd;
+		d->pending = 1;
+		dw_pool_push(&pool, d);
+	}
+	if (pool.dp_depth > 0)
+		dw_pool_run(&pool, njobs);
+	dw_pool_destroy(&pool);
+}
+
+void
+rm_work(pool, arg)
+	struct dw_pool *pool;
+	void *arg;
+{
+
+	rm_read(pool, arg);
+	rm_release(pool, arg);
+}
+
+/*
+ * Remove the files in directory d and queue its subdirectories.  The
+ * names are all read before anything is removed, since some file systems
+ * skip entries when the directory changes under readdir().
+ */
+void
+rm_read(pool, d)
+	struct dw_pool *pool;
+	struct rm_dir *d;
+{
+	struct dw_list dl;
+	struct dw_entry *e;
+	struct rm_dir *c;
+	size_t i;
+	int fd;
+
+	if (dirwalk_read(d->fd, DW_TYPE, &dl) == -1)
+		return;
+	for (i = 0; i < dl.dl_count; i++) {
+		e = &dl.dl_ents[i];
+		if (e->de_type != S_IFDIR) {
+			(void)unlinkat(d->fd, e->de_name, 0);
+			continue;
+		}
+		fd = openat(d->fd, e->de_name,
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+		if ((c = malloc(sizeof(*c) + e->de_namelen + 1)) == NULL)
+			err(1, "malloc");
+		c->parent = d;
+		c->fd = fd;
+		c->pending = 1;
+		strcpy(c->name, e->de_name);
+
+		pthread_mutex_lock(&pool->dp_mtx);
+		d->pending++;
+		pthread_mutex_unlock(&pool->dp_mtx);
+		dw_pool_push(pool, c);
+	}
+	dirwalk_free(&dl);
+}
+
+/*
+ * Drop a reference to d, removing it and, in turn, the parents it was
+ * the last subdirectory of.  The named directories are left in place.
+ */
+void
+rm_release(pool, d)
+	struct dw_pool *pool;
+	struct rm_dir *d;
+{
+	struct rm_dir *parent;
+	int last;
+
+	for (; d != NULL; d = parent) {
+		pthread_mutex_lock(&pool->dp_mtx);
+		last = --d->pending == 0;
+		pthread_mutex_unlock(&pool->dp_mtx);
+		if (!last)
+			break;
+		parent = d->parent;
+		(void)close(d->fd);
+		if (parent != NULL)
+			(void)unlinkat(parent->fd, d->name, AT_REMOVEDIR);
+		free(d);
+	}
+}
+
 void
 rm_file(argv)
 	char **argv;
@@ -577,7 +725,7 @@ usage()
 {
 
 	(void)fprintf(thread_stderr, "%s\n%s\n",
-	    "usage: rm [-f | -i] [-dPRrvW] file ...",
+	    "usage: rm [-f | -i] [-dPRrvW] [-j jobs] file ...",
 	    "       unlink file");
 	exit(EX_USAGE);
 }
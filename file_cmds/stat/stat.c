@@ -59,6 +59,7 @@ __FBSDID("$FreeBSD: src/usr.bin/stat/stat.c,v 1.6 2003/10/06 01:55:17 dougb Exp
 
 #include <ctype.h>
 #include <err.h>
+#include <getopt.h>
 #include <grp.h>
 #include <limits.h>
 #include <pwd.h>
@@ -182,9 +183,28 @@ __FBSDID("$FreeBSD: src/usr.bin/stat/stat.c,v 1.6 2003/10/06 01:55:17 dougb Exp
 #define SHOW_filename	'N'
 #define SHOW_sizerdev	'Z'
 
+/*
+ * The format string is compiled once into a list of these.  Literal text
+ * points into the format string, or at one of the simple characters.
+ */
+#define	OP_END		0
+#define	OP_TEXT		1		/* str, len */
+#define	OP_NUMBER	2		/* the file's number, %@ */
+#define	OP_FIELD	3		/* the format substring str, len */
+
+struct fmtop {
+	int		 op;
+	const char	*str;
+	int		 len;
+	int		 flags, size, prec, ofmt, hilo, what;
+};
+
 static void	usage(const char *);
+static struct fmtop *compile(const char *);
+static int	statfile(const char *, const struct fmtop *, int, int, int,
+	    int);
 static void	output(const struct stat *, const char *,
-	    const char *, int, int, int);
+	    const struct fmtop *, int, int, int);
 static int	format1(const struct stat *,	/* stat info */
 	    const char *,		/* the file name */
 	    const char *, int,		/* the format string itself */
@@ -195,21 +215,27 @@ static int	format1(const struct stat *,	/* stat info */
 static char *timefmt;
 static int linkfail;
 
-#define addchar(s, c, nl) \
-	do { \
-		(void)fputc((c), (s)); \
-		(*nl) = ((c) == '\n'); \
-	} while (0/*CONSTCOND*/)
-
 static char* progname;
+static int batch;
+
+static const struct option long_opts[] = {
+	{"files-from",	required_argument,	NULL, 'T'},
+	{NULL,		no_argument,		NULL, 0}
+};
+static const struct option no_long_opts[] = {
+	{NULL,		no_argument,		NULL, 0}
+};
 
 int
 stat_main(int argc, char *argv[])
 {
-	struct stat st;
-	int ch, rc, errs, am_readlink;
+	struct fmtop *ops;
+	FILE *fp;
+	int ch, errs, am_readlink, zflag;
 	int lsF, fmtchar, usestat, fn, nonl, quiet;
-	char *statfmt, *options, *synopsis;
+	char *statfmt, *options, *synopsis, *filesfrom, *name;
+	size_t namesize;
+	ssize_t len;
 
 	am_readlink = 0;
 	lsF = 0;
@@ -218,8 +244,11 @@ stat_main(int argc, char *argv[])
 	nonl = 0;
 	quiet = 0;
 	linkfail = 0;
+	zflag = 0;
+	batch = 0;
 	statfmt = NULL;
 	timefmt = NULL;
+	filesfrom = NULL;
     optind = 1; opterr = 1; optreset = 1;
     progname = argv[0];
 
@@ -232,12 +261,18 @@ stat_main(int argc, char *argv[])
 		fmtchar = 'f';
 		quiet = 1;
 	} else {
-		options = "f:FlLnqrst:x";
-		synopsis = "[-FlLnqrsx] [-f format] [-t timefmt] [file ...]";
+		options = "0f:FlLnqrst:x";
+		synopsis = "[-FlLnqrsx] [-f format] [-t timefmt] [file ...]\n"
+		    "       stat [-0FlLnqrsx] [-f format] [-t timefmt]"
+		    " --files-from file";
 	}
 
-	while ((ch = getopt(argc, argv, options)) != -1)
+	while ((ch = getopt_long(argc, argv, options,
+	    am_readlink ? no_long_opts : long_opts, NULL)) != -1)
 		switch (ch) {
+		case '0':
+			zflag = 1;
+			break;
 		case 'F':
 			lsF = 1;
 			break;
@@ -266,13 +301,15 @@ stat_main(int argc, char *argv[])
 		case 't':
 			timefmt = optarg;
 			break;
+		case 'T':
+			filesfrom = optarg;
+			break;
 		default:
 			usage(synopsis);
 		}
 
 	argc -= optind;
 	argv += optind;
-	fn = 1;
 
 	if (fmtchar == '\0') {
 		if (lsF)
@@ -313,33 +350,82 @@ stat_main(int argc, char *argv[])
 	if (timefmt == NULL)
 		timefmt = TIME_FORMAT;
 
-	errs = 0;
-	do {
-		if (argc == 0)
-			rc = fstat(fileno(thread_stdin), &st);
-		else if (usestat)
-			rc = stat(argv[0], &st);
-		else
-			rc = lstat(argv[0], &st);
+	if (filesfrom != NULL ? argc != 0 : zflag)
+		usage(synopsis);
 
-		if (rc == -1) {
-			errs = 1;
-			linkfail = 1;
-			if (!quiet)
-				warn("%s: stat",
-                    argc == 0 ? "(stdin)" : argv[0]);
+	ops = compile(statfmt);
+	errs = 0;
+	if (filesfrom != NULL) {
+		/*
+		 * One name per line, or per NUL with -0.  The output is only
+		 * flushed at the end.
+		 */
+		if (strcmp(filesfrom, "-") == 0)
+			fp = thread_stdin;
+		else if ((fp = fopen(filesfrom, "r")) == NULL)
+			err(1, "%s", filesfrom);
+		batch = 1;
+		name = NULL;
+		namesize = 0;
+		for (fn = 1; (len = getdelim(&name, &namesize,
+		    zflag ? '\0' : '\n', fp)) != -1; fn++) {
+			if (len > 0 && name[len - 1] == (zflag ? '\0' : '\n'))
+				name[--len] = '\0';
+			if (len == 0) {
+				fn--;
+				continue;
+			}
+			errs |= statfile(name, ops, fn, usestat, nonl, quiet);
 		}
-		else
-			output(&st, argv[0], statfmt, fn, nonl, quiet);
-
-		argv++;
-		argc--;
-		fn++;
-	} while (argc > 0);
+		if (ferror(fp))
+			err(1, "%s", filesfrom);
+		free(name);
+		if (fp != thread_stdin)
+			(void)fclose(fp);
+		(void)fflush(thread_stdout);
+	} else {
+		fn = 1;
+		do {
+			errs |= statfile(argc == 0 ? NULL : argv[0], ops, fn,
+			    usestat, nonl, quiet);
+			argv++;
+			argc--;
+			fn++;
+		} while (argc > 0);
+	}
+	free(ops);
 
 	return (am_readlink ? linkfail : errs);
 }
 
+/*
+ * Stat file, or the standard input if it is NULL, and print it.  Returns
+ * 1 if it could not be stat'ed.
+ */
+static int
+statfile(const char *file, const struct fmtop *ops, int fn, int usestat,
+    int nonl, int quiet)
+{
+	struct stat st;
+	int rc;
+
+	if (file == NULL)
+		rc = fstat(fileno(thread_stdin), &st);
+	else if (usestat)
+		rc = stat(file, &st);
+	else
+		rc = lstat(file, &st);
+
+	if (rc == -1) {
+		linkfail = 1;
+		if (!quiet)
+			warn("%s: stat", file == NULL ? "(stdin)" : file);
+		return (1);
+	}
+	output(&st, file, ops, fn, nonl, quiet);
+	return (0);
+}
+
 void
 usage(const char *synopsis)
 {
@@ -349,26 +435,40 @@ usage(const char *synopsis)
 }
 
 /* 
- * Parses a format string.
+ * Parses a format string, once for all the files.
  */
-void
-output(const struct stat *st, const char *file,
-    const char *statfmt, int fn, int nonl, int quiet)
+static struct fmtop *
+compile(const char *statfmt)
 {
+	struct fmtop *ops, *op;
+	size_t nops, maxops;
 	int flags, size, prec, ofmt, hilo, what;
-	char buf[PATH_MAX];
 	const char *subfmt;
-	int nl, t, i;
 
-	nl = 1;
-	while (*statfmt != '\0') {
+	ops = NULL;
+	nops = maxops = 0;
+	for (;;) {
+		if (nops == maxops) {
+			maxops = maxops ? maxops * 2 : 32;
+			if ((ops = realloc(ops, maxops * sizeof(*ops))) == NULL)
+				err(1, "realloc");
+		}
+		op = &ops[nops++];
+		op->op = OP_TEXT;
+		op->str = statfmt;
+		op->len = 1;
+		if (*statfmt == '\0') {
+			op->op = OP_END;
+			break;
+		}
 
 		/*
 		 * Non-format characters go straight out.
 		 */
 		if (*statfmt != FMT_MAGIC) {
-			addchar(thread_stdout, *statfmt, &nl);
-			statfmt++;
+			for (statfmt++; *statfmt != '\0' &&
+			    *statfmt != FMT_MAGIC; statfmt++)
+				op->len++;
 			continue;
 		}
 
@@ -384,27 +484,22 @@ output(const struct stat *st, const char *file,
 		 */
 		switch (*statfmt) {
 		case SIMPLE_NEWLINE:
-			addchar(thread_stdout, '\n', &nl);
+			op->str = "\n";
 			statfmt++;
 			continue;
 		case SIMPLE_TAB:
-			addchar(thread_stdout, '\t', &nl);
+			op->str = "\t";
 			statfmt++;
 			continue;
 		case SIMPLE_PERCENT:
-			addchar(thread_stdout, '%', &nl);
+			op->str = "%";
 			statfmt++;
 			continue;
-		case SIMPLE_NUMBER: {
-			char num[12], *p;
-
-			snprintf(num, sizeof(num), "%d", fn);
-			for (p = &num[0]; *p; p++)
-				addchar(thread_stdout, *p, &nl);
+		case SIMPLE_NUMBER:
+			op->op = OP_NUMBER;
 			statfmt++;
 			continue;
 		}
-		}
 
 		/*
 		 * This must be an actual format string.  Format strings are
@@ -520,25 +615,68 @@ output(const struct stat *st, const char *file,
 #undef fmtcasef
 #undef fmtcase
 
-		t = format1(st,
-		     file,
-		     subfmt, statfmt - subfmt,
-		     buf, sizeof(buf),
-		     flags, size, prec, ofmt, hilo, what);
-
-		for (i = 0; i < t && i < sizeof(buf); i++)
-			addchar(thread_stdout, buf[i], &nl);
-
+		op->op = OP_FIELD;
+		op->str = subfmt;
+		op->len = statfmt - subfmt;
+		op->flags = flags;
+		op->size = size;
+		op->prec = prec;
+		op->ofmt = ofmt;
+		op->hilo = hilo;
+		op->what = what;
 		continue;
 
 	badfmt:
         errx(1, "%.*s: bad format",
 		    (int)(statfmt - subfmt + 1), subfmt);
 	}
+	return (ops);
+}
+
+/*
+ * Prints one file with a compiled format.
+ */
+static void
+output(const struct stat *st, const char *file,
+    const struct fmtop *op, int fn, int nonl, int quiet)
+{
+	char buf[PATH_MAX];
+	const char *out;
+	int nl, t;
+
+	nl = 1;
+	for (; op->op != OP_END; op++) {
+		switch (op->op) {
+		case OP_TEXT:
+			out = op->str;
+			t = op->len;
+			break;
+		case OP_NUMBER:
+			t = snprintf(buf, sizeof(buf), "%d", fn);
+			out = buf;
+			break;
+		default:
+			t = format1(st,
+			     file,
+			     op->str, op->len,
+			     buf, sizeof(buf),
+			     op->flags, op->size, op->prec, op->ofmt, op->hilo,
+			     op->what);
+			if (t > (int)sizeof(buf))
+				t = sizeof(buf);
+			out = buf;
+			break;
+		}
+		if (t <= 0)
+			continue;
+		(void)fwrite(out, 1, t, thread_stdout);
+		nl = (out[t - 1] == '\n');
+	}
 
 	if (!nl && !nonl)
 		(void)fputc('\n', thread_stdout);
-	(void)fflush(thread_stdout);
+	if (!batch)
+		(void)fflush(thread_stdout);
 }
 
 /*
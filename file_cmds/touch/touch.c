@@ -72,9 +72,11 @@ touch_main(int argc, char *argv[])
 {
 	struct stat sb;
 	struct timeval tv[2];
+	struct timespec ts[2];
 	int (*stat_f)(const char *, struct stat *);
 	int (*utimes_f)(const char *, const struct timeval *);
-	int Aflag, aflag, cflag, fflag, mflag, ch, fd, len, rval, timeset;
+	int Aflag, aflag, atflag, cflag, fflag, mflag, ch, fd, len, rval;
+	int timeset;
 	char *p;
 	char *myname;
 
@@ -83,6 +85,7 @@ touch_main(int argc, char *argv[])
     optind = 1; opterr = 1; optreset = 1;
 	stat_f = stat;
 	utimes_f = utimes;
+	atflag = 0;
     if (gettimeofday(&tv[0], NULL)) {
 		err(1, "gettimeofday");
     }
@@ -105,6 +108,7 @@ touch_main(int argc, char *argv[])
 			cflag = 1;
 			stat_f = lstat;
 			utimes_f = lutimes;
+			atflag = AT_SYMLINK_NOFOLLOW;
 			break;
 		case 'm':
 			mflag = 1;
@@ -164,7 +168,24 @@ touch_main(int argc, char *argv[])
 	if (Aflag)
 		cflag = 1;
 
+	/*
+	 * Unless the times depend on the file's own, the file is only
+	 * looked at if setting them straight away fails; the time not
+	 * being changed is left alone by utimensat(2).
+	 */
+	if (aflag) {
+		TIMEVAL_TO_TIMESPEC(&tv[0], &ts[0]);
+	} else
+		ts[0].tv_nsec = UTIME_OMIT;
+	if (mflag) {
+		TIMEVAL_TO_TIMESPEC(&tv[1], &ts[1]);
+	} else
+		ts[1].tv_nsec = UTIME_OMIT;
+
 	for (rval = 0; *argv; ++argv) {
+		if (!Aflag && utimensat(AT_FDCWD, *argv, ts, atflag) == 0)
+			continue;
+
 		/* See if the file exists. */
 		if (stat_f(*argv, &sb) != 0) {
 			if (errno != ENOENT) {
@@ -51,12 +51,33 @@
 
 __thread int    __db_getopt_reset;    /* global reset for VxWorks. */
 
-// Not __thread unless I rename them. 
-int    opterr = 1,        /* if error message should be printed */
-optind = 1,        /* index into parent argv vector */
-optopt,            /* character checked for validity */
-optreset;        /* reset getopt */
-char    *optarg;        /* argument associated with option */
+/*
+ * The getopt state is per thread, so that commands can parse their
+ * arguments at the same time. ios_error.h maps optind & co. to the
+ * accessors below; here we use the variables directly.
+ */
+__thread int    thread_opterr = 1,    /* if error message should be printed */
+thread_optind = 1,        /* index into parent argv vector */
+thread_optopt,            /* character checked for validity */
+thread_optreset;        /* reset getopt */
+__thread char    *thread_optarg;    /* argument associated with option */
+
+int *ios_opterr(void) { return &thread_opterr; }
+int *ios_optind(void) { return &thread_optind; }
+int *ios_optopt(void) { return &thread_optopt; }
+int *ios_optreset(void) { return &thread_optreset; }
+char **ios_optarg(void) { return &thread_optarg; }
+
+#undef    opterr
+#define    opterr    thread_opterr
+#undef    optind
+#define    optind    thread_optind
+#undef    optopt
+#define    optopt    thread_optopt
+#undef    optreset
+#define    optreset    thread_optreset
+#undef    optarg
+#define    optarg    thread_optarg
 
 #undef    BADCH
 #define    BADCH    (int)'?'
@@ -79,8 +100,8 @@ int nargc;
 char * const *nargv;
 const char *ostr;
 {
-    static char *progname;
-    static char *place = EMSG;        /* option letter processing */
+    static __thread char *progname;
+    static __thread char *place = EMSG;        /* option letter processing */
     char *oli;                /* option letter list index */
     
     /*
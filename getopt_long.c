@@ -69,6 +69,7 @@ __FBSDID("$FreeBSD: src/lib/libc/stdlib/getopt_long.c,v 1.15 2006/09/23 14:48:31
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include "ios_error.h"
 
 #define GNU_COMPATIBLE		/* Be more compatible, configure's use us! */
 
@@ -82,6 +83,18 @@ int	optind = 1;		/* index into parent argv vector */
 int	optopt = '?';		/* character checked for validity */
 int	optreset;		/* reset getopt */
 char    *optarg;		/* argument associated with option */
+#else
+/* The state lives in getopt.c, one copy per thread: */
+#undef	opterr
+#define	opterr		thread_opterr
+#undef	optind
+#define	optind		thread_optind
+#undef	optopt
+#define	optopt		thread_optopt
+#undef	optreset
+#define	optreset	thread_optreset
+#undef	optarg
+#define	optarg		thread_optarg
 #endif
 
 #define PRINT_ERROR	((opterr) && (*options != ':'))
@@ -111,17 +124,17 @@ static int parse_long_options(char * const *, const char *,
 static int gcd(int, int);
 static void permute_args(int, int, int, char * const *);
 
-static char *place = EMSG; /* option letter processing */
+static __thread char *place = EMSG; /* option letter processing */
 
 /* XXX: set optreset to 1 rather than these two */
-static int nonopt_start = -1; /* first non option argument (for permute) */
-static int nonopt_end = -1;   /* first option after non options (for permute) */
+static __thread int nonopt_start = -1; /* first non option argument (for permute) */
+static __thread int nonopt_end = -1;   /* first option after non options (for permute) */
 
 /* Error messages */
 static const char recargchar[] = "option requires an argument -- %c";
 static const char illoptchar[] = "illegal option -- %c"; /* From P1003.2 */
 #ifdef GNU_COMPATIBLE
-static int dash_prefix = NO_PREFIX;
+static __thread int dash_prefix = NO_PREFIX;
 static const char gnuoptchar[] = "invalid option -- %c";
 
 static const char recargstring[] = "option `%s%s' requires an argument";
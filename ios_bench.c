@@ -0,0 +1,2005 @@
+//
+//  ios_bench.c
+//  ios_system
+//
+//  Benchmarks of ios_system and its commands. They run as a command, "ios_bench", inside the host app, so
+//  that the numbers are those of the device (or the simulator) and of the frameworks the app ships:
+//  ios_bench launch    time to start a command (ios_system, ios_popen, ios_execv, aliases, wildcards),
+//                      median and 99th percentile, and commands per second, in 1 to N sessions at once.
+//  ios_bench text      grep, sort, uniq, wc, cut, tr, sed, awk, md5 and gzip over generated corpora (log lines,
+//                      UTF-8, CSV, long lines, short lines) of 1 MB to 1 GB, in MB/s.
+//  ios_bench tree      ls -lR, du, find, chmod -R, mtree, tar, cp -R, mv and rm -rf over synthesized trees (deep,
+//                      wide, small files, large files, hard links, extended attributes), in files/s and syscalls.
+//  ios_bench net       curl (HTTP and HTTPS, against servers of its own), scp and sftp (against an SSH server),
+//                      with an added round-trip time and bandwidth limit: handshakes, MB/s, CPU per MB.
+//  ios_bench clean     removes the scratch files, corpora and trees.
+//  Results can be saved (-r file) and compared with those of another build or device (-b file).
+//  Scratch files go to $TMPDIR/ios_bench.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <sys/xattr.h>
+#include <mach/mach.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <Security/Security.h>
+
+#include "ios_error.h"
+
+// From ios_system.h, which is Objective-C:
+extern void ios_switchSession(const void* sessionid);
+extern void ios_closeSession(const void* sessionid);
+extern void ios_setStreams(FILE* _stdin, FILE* _stdout, FILE* _stderr);
+
+#define BENCH_MAX_SESSIONS 64
+#define LAUNCH_WILDCARD_FILES 64
+#define NUM_ELEMENTS(array) (sizeof(array) / sizeof(array[0]))
+
+static double benchClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Nearest rank: the smallest value that fraction of the values are lower than or equal to. sorted has n > 0 values.
+static double percentile(const double* sorted, int n, double fraction) {
+    int rank = (int)ceil(fraction * n);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
+
+// $TMPDIR/ios_bench/name ($TMPDIR/ios_bench if name is NULL), created if needed.
+// malloc()ed, NULL if it can't be created.
+static char* benchDirectory(const char* name) {
+    const char* tmp = getenv("TMPDIR");
+    char* path = NULL;
+    if ((tmp == NULL) || (tmp[0] == 0)) tmp = "/tmp";
+    if (asprintf(&path, "%s/ios_bench", tmp) < 0) return NULL;
+    if ((mkdir(path, 0755) != 0) && (errno != EEXIST)) {
+        free(path);
+        return NULL;
+    }
+    if (name == NULL) return path;
+    char* directory = NULL;
+    int length = asprintf(&directory, "%s/%s", path, name);
+    free(path);
+    if (length < 0) return NULL;
+    if ((mkdir(directory, 0755) != 0) && (errno != EEXIST)) {
+        free(directory);
+        return NULL;
+    }
+    return directory;
+}
+
+// Runs a command line in the current session and waits for it, whatever joinMainThread is (as ios_system_batch).
+// Returns its exit status; *pid (if not NULL) is its pid, for ios_getProcessStats.
+static int benchRun(const char* command, pid_t* pid) {
+    pid_t commandPid = ios_fork();
+    if (pid != NULL) *pid = commandPid;
+    if (commandPid < 0) {
+        ios_storeThreadId(0); // releases pid_mtx
+        return EAGAIN;
+    }
+    ios_system(command);
+    ios_waitpid(commandPid);
+    return ios_getCommandStatus();
+}
+
+// Results, compared with those of an earlier run (-b file) and saved for a later one (-r file). The files have
+// one line per result: its name (suite, case and parameters, separated by tabs), a tab, and its value, where
+// higher is better (commands/s, MB/s, files/s).
+typedef struct _benchReport {
+    FILE* results;
+    int numBaselines;
+    char** names;
+    double* values;
+} benchReport;
+
+static void closeReport(benchReport* report) {
+    if (report->results != NULL) fclose(report->results);
+    for (int i = 0; i < report->numBaselines; i++) free(report->names[i]);
+    free(report->names);
+    free(report->values);
+    memset(report, 0, sizeof(*report));
+}
+
+// baselines, results: file names, or NULL. Returns false (with a message) if one of them can't be opened.
+static bool openReport(benchReport* report, const char* baselines, const char* results) {
+    memset(report, 0, sizeof(*report));
+    if (baselines != NULL) {
+        FILE* file = fopen(baselines, "r");
+        char* line = NULL;
+        size_t size = 0;
+        ssize_t length;
+        int capacity = 0;
+        if (file == NULL) {
+            fprintf(thread_stderr, "ios_bench: %s: %s\n", baselines, strerror(errno));
+            return false;
+        }
+        while ((length = getline(&line, &size, file)) > 0) {
+            if (line[length - 1] == '\n') line[length - 1] = 0;
+            char* tab = strrchr(line, '\t');
+            if (tab == NULL) continue;
+            *tab = 0;
+            if (report->numBaselines == capacity) {
+                capacity = (capacity == 0) ? 64 : 2 * capacity;
+                char** names = realloc(report->names, capacity * sizeof(char*));
+                if (names != NULL) report->names = names;
+                double* values = realloc(report->values, capacity * sizeof(double));
+                if (values != NULL) report->values = values;
+                if ((names == NULL) || (values == NULL)) break;
+            }
+            report->names[report->numBaselines] = strdup(line);
+            if (report->names[report->numBaselines] == NULL) break;
+            report->values[report->numBaselines++] = atof(tab + 1);
+        }
+        free(line);
+        fclose(file);
+    }
+    // opened after the baselines are read, so that both can be the same file:
+    if ((results != NULL) && ((report->results = fopen(results, "w")) == NULL)) {
+        fprintf(thread_stderr, "ios_bench: %s: %s\n", results, strerror(errno));
+        closeReport(report);
+        return false;
+    }
+    return true;
+}
+
+// Header of the last column of the tables, if there are baselines.
+static const char* baselineHeader(const benchReport* report) {
+    return (report->numBaselines > 0) ? "   baseline" : "";
+}
+
+// Ends a line of a table with the change from the baseline of the same name (if any) and saves the result.
+static void reportResult(benchReport* report, const char* name, double value) {
+    for (int i = 0; i < report->numBaselines; i++) {
+        if ((strcmp(report->names[i], name) == 0) && (report->values[i] > 0)) {
+            fprintf(thread_stdout, " %+9.1f%%", (value / report->values[i] - 1) * 100);
+            break;
+        }
+    }
+    fputc('\n', thread_stdout);
+    if (report->results != NULL) fprintf(report->results, "%s\t%.3f\n", name, value);
+}
+
+// ios_bench launch: the same command started again and again, in 1, 2, 4... sessions running at the same time.
+// Each session is a thread of its own, as a window of the app would be, with its output sent to /dev/null.
+typedef enum { LaunchSystem, LaunchPopen, LaunchExecv } launchKind;
+
+typedef struct _launchCase {
+    const char* name;
+    launchKind kind;
+    const char* command;    // ios_system, ios_popen: command line. ios_execv: the command, without arguments
+} launchCase;
+
+typedef struct _launchGate {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    int ready;              // sessions done with their warm-up
+    bool go;
+} launchGate;
+
+typedef struct _launchSession {
+    char name[32];          // its address is the sessionId
+    const launchCase* test;
+    int runs;
+    int warmup;
+    double* latencies;      // seconds, one per run
+    int failures;
+    double finished;        // benchClock() after the last run
+    launchGate* gate;
+    pthread_t thread;
+} launchSession;
+
+static int launchOnce(const launchCase* test) {
+    switch (test->kind) {
+        case LaunchSystem:
+            return benchRun(test->command, NULL);
+        case LaunchPopen: {
+            FILE* output = ios_popen(test->command, "r");
+            char buffer[256];
+            size_t length = 0;
+            size_t n;
+            if (output == NULL) return (errno != 0) ? errno : EIO;
+            while ((n = fread(buffer, 1, sizeof(buffer), output)) > 0) length += n;
+            pclose(output);
+            return (length > 0) ? 0 : EIO;
+        }
+        case LaunchExecv: {
+            char* argv[2] = { (char*)test->command, NULL };
+            pid_t pid = ios_fork();
+            if (pid < 0) {
+                ios_storeThreadId(0);
+                return EAGAIN;
+            }
+            ios_execv(test->command, argv);
+            ios_waitpid(pid);
+            return ios_getCommandStatus();
+        }
+    }
+    return EINVAL;
+}
+
+static void* runLaunchSession(void* arg) {
+    launchSession* session = (launchSession*) arg;
+    FILE* in = fopen("/dev/null", "r");
+    FILE* out = fopen("/dev/null", "w");
+    bool ready = (in != NULL) && (out != NULL);
+    if (ready) {
+        ios_switchSession(session->name);
+        ios_setStreams(in, out, out);
+        thread_stdin = in;
+        thread_stdout = out;
+        thread_stderr = out;
+        // the libraries are loaded and the caches filled before the clock starts:
+        for (int i = 0; i < session->warmup; i++) launchOnce(session->test);
+    }
+    pthread_mutex_lock(&session->gate->mutex);
+    session->gate->ready++;
+    pthread_cond_broadcast(&session->gate->changed);
+    while (!session->gate->go) pthread_cond_wait(&session->gate->changed, &session->gate->mutex);
+    pthread_mutex_unlock(&session->gate->mutex);
+    for (int i = 0; i < session->runs; i++) {
+        double start = benchClock();
+        if (!ready || (launchOnce(session->test) != 0)) session->failures++;
+        session->latencies[i] = benchClock() - start;
+    }
+    session->finished = benchClock();
+    if (ready) ios_closeSession(session->name);
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+    return NULL;
+}
+
+// Runs test in numSessions sessions at once and prints one line. Returns false if the threads couldn't start.
+static bool launchSessions(const launchCase* test, int numSessions, int runs, benchReport* report) {
+    launchSession sessions[BENCH_MAX_SESSIONS];
+    launchGate gate;
+    double* latencies = malloc(sizeof(double) * runs * numSessions);
+    int started = 0;
+    if (latencies == NULL) return false;
+    pthread_mutex_init(&gate.mutex, NULL);
+    pthread_cond_init(&gate.changed, NULL);
+    gate.ready = 0;
+    gate.go = false;
+    for (int i = 0; i < numSessions; i++) {
+        launchSession* session = &sessions[i];
+        snprintf(session->name, sizeof(session->name), "ios_bench %d", i);
+        session->test = test;
+        session->runs = runs;
+        session->warmup = (runs + 9) / 10;
+        session->latencies = latencies + i * runs;
+        session->failures = 0;
+        session->finished = 0;
+        session->gate = &gate;
+        if (pthread_create(&session->thread, NULL, runLaunchSession, session) != 0) break;
+        started++;
+    }
+    pthread_mutex_lock(&gate.mutex);
+    while (gate.ready < started) pthread_cond_wait(&gate.changed, &gate.mutex);
+    double start = benchClock();
+    gate.go = true;
+    pthread_cond_broadcast(&gate.changed);
+    pthread_mutex_unlock(&gate.mutex);
+    double finished = start;
+    int failures = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(sessions[i].thread, NULL);
+        if (sessions[i].finished > finished) finished = sessions[i].finished;
+        failures += sessions[i].failures;
+    }
+    if (started > 0) {
+        int n = started * runs;
+        double commandsPerSecond = (finished > start) ? n / (finished - start) : 0;
+        char name[128];
+        qsort(latencies, n, sizeof(double), compareDoubles);
+        fprintf(thread_stdout, "%-28s %8d %10.0f %10.0f %12.0f", test->name, started,
+                percentile(latencies, n, 0.50) * 1e6, percentile(latencies, n, 0.99) * 1e6, commandsPerSecond);
+        snprintf(name, sizeof(name), "launch\t%s\t%d", test->name, started);
+        reportResult(report, name, commandsPerSecond);
+        if (failures > 0) fprintf(thread_stderr, "ios_bench: %s: %d of %d commands failed\n", test->name, failures, n);
+    }
+    pthread_cond_destroy(&gate.changed);
+    pthread_mutex_destroy(&gate.mutex);
+    free(latencies);
+    return started == numSessions;
+}
+
+static const char* launchUsage = "usage: ios_bench launch [-n runs] [-s sessions] [-b baselines] [-r results]\n";
+
+static int benchLaunch(int argc, char** argv) {
+    int runs = 1000;
+    int maxSessions = 4;
+    const char* baselines = NULL;
+    const char* results = NULL;
+    benchReport report;
+    int ch;
+    optind = 1;
+    while ((ch = getopt(argc, argv, "b:n:r:s:")) != -1) {
+        switch (ch) {
+            case 'b':
+                baselines = optarg;
+                break;
+            case 'r':
+                results = optarg;
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 's':
+                maxSessions = atoi(optarg);
+                break;
+            default:
+                fputs(launchUsage, thread_stderr);
+                return 1;
+        }
+    }
+    if ((runs < 1) || (maxSessions < 1) || (maxSessions > BENCH_MAX_SESSIONS)) {
+        fprintf(thread_stderr, "ios_bench: runs must be positive, sessions between 1 and %d\n", BENCH_MAX_SESSIONS);
+        return 1;
+    }
+    if (!openReport(&report, baselines, results)) return 1;
+    // Wildcards are expanded against a directory of LAUNCH_WILDCARD_FILES files (not quoted: quoted
+    // arguments are not expanded, and $TMPDIR has no spaces):
+    char* directory = benchDirectory("launch");
+    char* wildcard = NULL;
+    if ((directory == NULL) || (asprintf(&wildcard, "echo %s/*.txt", directory) < 0)) {
+        fprintf(thread_stderr, "ios_bench: $TMPDIR/ios_bench: %s\n", strerror(errno));
+        free(directory);
+        closeReport(&report);
+        return 1;
+    }
+    for (int i = 0; i < LAUNCH_WILDCARD_FILES; i++) {
+        char path[MAXPATHLEN];
+        snprintf(path, sizeof(path), "%s/file%02d.txt", directory, i);
+        int fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd >= 0) close(fd);
+    }
+    benchRun("alias ios_bench_true true", NULL);
+    const launchCase cases[] = {
+        { "true", LaunchSystem, "true" },
+        { "echo x | cat | wc -l", LaunchSystem, "echo x | cat | wc -l" },
+        { "ios_popen(\"echo x\")", LaunchPopen, "echo x" },
+        { "ios_execv(\"true\")", LaunchExecv, "true" },
+        { "alias (ios_bench_true)", LaunchSystem, "ios_bench_true" },
+        { "echo *.txt (64 files)", LaunchSystem, wildcard },
+    };
+    fprintf(thread_stdout, "%-28s %8s %10s %10s %12s%s\n", "launch", "sessions", "p50 (us)", "p99 (us)", "commands/s",
+            baselineHeader(&report));
+    int status = 0;
+    for (size_t c = 0; (c < sizeof(cases) / sizeof(cases[0])) && (status == 0) && !ios_isInterrupted(); c++) {
+        for (int numSessions = 1; !ios_isInterrupted(); numSessions *= 2) {
+            if (numSessions > maxSessions) numSessions = maxSessions;
+            if (!launchSessions(&cases[c], numSessions, runs, &report)) {
+                fprintf(thread_stderr, "ios_bench: cannot start %d sessions\n", numSessions);
+                status = 1;
+                break;
+            }
+            if (numSessions == maxSessions) break;
+        }
+    }
+    benchRun("unalias ios_bench_true", NULL);
+    for (int i = 0; i < LAUNCH_WILDCARD_FILES; i++) {
+        char path[MAXPATHLEN];
+        snprintf(path, sizeof(path), "%s/file%02d.txt", directory, i);
+        unlink(path);
+    }
+    rmdir(directory);
+    free(wildcard);
+    free(directory);
+    closeReport(&report);
+    return status;
+}
+
+// ios_bench text: the text commands over generated corpora, in MB/s (the best of the runs). The corpora are
+// the same from one run to the next (a fixed seed for each size), and kept in $TMPDIR/ios_bench/text.
+#define TEXT_MAX_LINE 80000     // longest line of a corpus, with its '\n'
+#define TEXT_BLOCK (1 << 20)
+
+typedef struct _textCorpus {
+    const char* name;
+    // Writes one line, '\n' included, to buffer (TEXT_MAX_LINE bytes) and returns its length:
+    size_t (*line)(char* buffer, uint64_t* state);
+} textCorpus;
+
+typedef struct _textCommand {
+    const char* name;
+    const char* format;         // command line, %s is the corpus
+} textCommand;
+
+static const char* const asciiWords[] = {
+    "the", "request", "server", "client", "timeout", "retry", "cache", "session", "connection", "user",
+    "file", "error", "write", "read", "queue", "worker", "index", "update", "value", "status",
+};
+static const char* const utf8Words[] = {
+    "café", "naïve", "façade", "über", "straße", "smörgåsbord", "crème", "brûlée", "日本語", "東京",
+    "テキスト", "Ελληνικά", "λόγος", "русский", "текст", "中文", "文字", "한국어", "the", "text",
+};
+static const char* const cities[] = {
+    "Paris", "Grenoble", "Tokyo", "Lagos", "Lima", "Oslo", "Austin", "Pune", "Quito", "Perth",
+};
+
+// xorshift64*
+static uint64_t nextRandom(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Words separated by spaces, from length to about length + 20 bytes, and a '\n'.
+static size_t wordsLine(char* buffer, uint64_t* state, const char* const* words, size_t numWords, size_t length) {
+    size_t used = 0;
+    while (used < length) {
+        const char* word = words[nextRandom(state) % numWords];
+        size_t wordLength = strlen(word);
+        if (used > 0) buffer[used++] = ' ';
+        memcpy(buffer + used, word, wordLength);
+        used += wordLength;
+    }
+    buffer[used++] = '\n';
+    return used;
+}
+
+static size_t logLine(char* buffer, uint64_t* state) {
+    uint64_t r = nextRandom(state);
+    unsigned level = r % 100;
+    int length = snprintf(buffer, TEXT_MAX_LINE, "2026-10-%02u %02u:%02u:%02u.%03u host%02u worker[%u]: %s ",
+                          (unsigned)(r >> 8) % 28 + 1, (unsigned)(r >> 16) % 24, (unsigned)(r >> 24) % 60,
+                          (unsigned)(r >> 32) % 60, (unsigned)(r >> 40) % 1000, (unsigned)(r >> 50) % 16,
+                          (unsigned)(r >> 54) % 1000,
+                          (level < 2) ? "ERROR" : (level < 10) ? "WARN" : (level < 40) ? "DEBUG" : "INFO");
+    length += wordsLine(buffer + length, state, asciiWords, NUM_ELEMENTS(asciiWords), 20) - 1;
+    r = nextRandom(state);
+    length += snprintf(buffer + length, TEXT_MAX_LINE - length, " latency=%ums status=%u\n",
+                       (unsigned)(r % 2000), (level < 2) ? 500 : (level < 10) ? 404 : 200);
+    return length;
+}
+
+static size_t utf8Line(char* buffer, uint64_t* state) {
+    return wordsLine(buffer, state, utf8Words, NUM_ELEMENTS(utf8Words), 20 + nextRandom(state) % 100);
+}
+
+static size_t csvLine(char* buffer, uint64_t* state) {
+    uint64_t r = nextRandom(state);
+    return snprintf(buffer, TEXT_MAX_LINE, "%llu,%s%u,%s,%u.%02u,2026-%02u-%02u,%s\n",
+                    (unsigned long long)(r >> 40), asciiWords[r % NUM_ELEMENTS(asciiWords)], (unsigned)(r >> 8) % 100,
+                    cities[(r >> 16) % NUM_ELEMENTS(cities)], (unsigned)(r >> 20) % 10000, (unsigned)(r >> 34) % 100,
+                    (unsigned)(r >> 24) % 12 + 1, (unsigned)(r >> 28) % 28 + 1, ((r >> 33) & 1) ? "true" : "false");
+}
+
+static size_t longLine(char* buffer, uint64_t* state) {
+    return wordsLine(buffer, state, asciiWords, NUM_ELEMENTS(asciiWords), 32768 + nextRandom(state) % 32768);
+}
+
+// 1 to 4 characters: many lines, and many of them the same (for sort and uniq)
+static size_t shortLine(char* buffer, uint64_t* state) {
+    return snprintf(buffer, TEXT_MAX_LINE, "%u\n", (unsigned)(nextRandom(state) % 1000));
+}
+
+static const textCorpus textCorpora[] = {
+    { "log", logLine },         // ASCII log lines
+    { "utf8", utf8Line },       // UTF-8 text, several scripts
+    { "csv", csvLine },
+    { "long", longLine },       // 32 to 64 KB per line
+    { "short", shortLine },
+};
+
+static const textCommand textCommands[] = {
+    { "grep ERROR", "grep -c ERROR %s" },
+    { "grep -E 'ERR(OR)?|WARN'", "grep -c -E 'ERR(OR)?|WARN' %s" },
+    { "sort", "sort %s" },
+    { "uniq -c", "uniq -c %s" },
+    { "wc", "wc %s" },
+    { "wc -m", "wc -m %s" },
+    { "cut -d , -f 3", "cut -d , -f 3 %s" },
+    { "tr a-z A-Z", "tr a-z A-Z < %s" },
+    { "sed s/e/E/g", "sed s/e/E/g %s" },
+    { "awk '{ n += NF }'", "awk '{ n += NF } END { print n }' %s" },
+    { "md5", "md5 %s" },
+    { "gzip -c", "gzip -c %s" },
+};
+
+// Creates path with size bytes of corpus, unless it is there already. Returns false (with a message) on errors.
+static bool generateCorpus(const char* path, const textCorpus* corpus, off_t size) {
+    struct stat sb;
+    if ((stat(path, &sb) == 0) && (sb.st_size == size)) return true;
+    FILE* file = fopen(path, "w");
+    char* block = malloc(TEXT_BLOCK + TEXT_MAX_LINE);
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ (uint64_t)size;
+    off_t written = 0;
+    bool ok = (file != NULL) && (block != NULL);
+    while (ok && (written < size) && !ios_isInterrupted()) {
+        size_t used = 0;
+        while ((used < TEXT_BLOCK) && (written + (off_t)used < size)) used += corpus->line(block + used, &state);
+        if (written + (off_t)used > size) {
+            // the last line is cut to the size
+            used = size - written;
+            block[used - 1] = '\n';
+        }
+        ok = (fwrite(block, 1, used, file) == used);
+        written += used;
+    }
+    if ((file != NULL) && (fclose(file) != 0)) ok = false;
+    free(block);
+    if (!ok || (written < size)) {
+        fprintf(thread_stderr, "ios_bench: %s: %s\n", path, ok ? "interrupted" : strerror(errno));
+        unlink(path);
+        return false;
+    }
+    return true;
+}
+
+// "1M", "16M", "1G"... (K, M, G: powers of 1024). Returns 0 if it is not a size.
+static off_t parseSize(const char* string) {
+    char* end;
+    long long size = strtoll(string, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': size <<= 10; end++; break;
+        case 'm': case 'M': size <<= 20; end++; break;
+        case 'g': case 'G': size <<= 30; end++; break;
+    }
+    return ((*end == 0) && (size > 0)) ? size : 0;
+}
+
+// The other way round, for the names of the corpora and the tables.
+static void formatSize(char* buffer, size_t length, off_t size) {
+    const char* units = "GMK";
+    for (int shift = 30; shift > 0; shift -= 10, units++) {
+        if ((size >= ((off_t)1 << shift)) && (size % ((off_t)1 << shift) == 0)) {
+            snprintf(buffer, length, "%lld%c", (long long)(size >> shift), *units);
+            return;
+        }
+    }
+    snprintf(buffer, length, "%lld", (long long)size);
+}
+
+static const char* textUsage =
+    "usage: ios_bench text [-n runs] [-s size[,size...]] [-b baselines] [-r results] [corpus ...]\n";
+
+static int benchText(int argc, char** argv) {
+    int runs = 3;
+    const char* sizes = "1M,16M";
+    const char* baselines = NULL;
+    const char* results = NULL;
+    off_t sizeList[16];
+    int numSizes = 0;
+    bool selected[NUM_ELEMENTS(textCorpora)];
+    benchReport report;
+    int ch;
+    optind = 1;
+    while ((ch = getopt(argc, argv, "b:n:r:s:")) != -1) {
+        switch (ch) {
+            case 'b':
+                baselines = optarg;
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'r':
+                results = optarg;
+                break;
+            case 's':
+                sizes = optarg;
+                break;
+            default:
+                fputs(textUsage, thread_stderr);
+                return 1;
+        }
+    }
+    if (runs < 1) {
+        fputs("ios_bench: runs must be positive\n", thread_stderr);
+        return 1;
+    }
+    for (const char* size = sizes; (size != NULL) && (*size != 0); ) {
+        const char* comma = strchr(size, ',');
+        char string[32];
+        snprintf(string, sizeof(string), "%.*s", (int)((comma != NULL) ? comma - size : strlen(size)), size);
+        if ((numSizes == sizeof(sizeList) / sizeof(sizeList[0])) || ((sizeList[numSizes++] = parseSize(string)) == 0)) {
+            fprintf(thread_stderr, "ios_bench: %s: not a size, or too many sizes\n", string);
+            return 1;
+        }
+        size = (comma != NULL) ? comma + 1 : NULL;
+    }
+    for (size_t c = 0; c < NUM_ELEMENTS(textCorpora); c++) selected[c] = (optind == argc);
+    for (int i = optind; i < argc; i++) {
+        size_t c = 0;
+        while ((c < NUM_ELEMENTS(textCorpora)) && (strcmp(argv[i], textCorpora[c].name) != 0)) c++;
+        if (c == NUM_ELEMENTS(textCorpora)) {
+            fprintf(thread_stderr, "ios_bench: %s: no such corpus (log, utf8, csv, long, short)\n", argv[i]);
+            return 1;
+        }
+        selected[c] = true;
+    }
+    char* directory = benchDirectory("text");
+    FILE* devNull = fopen("/dev/null", "w");
+    if ((directory == NULL) || (devNull == NULL)) {
+        fprintf(thread_stderr, "ios_bench: $TMPDIR/ios_bench: %s\n", strerror(errno));
+        free(directory);
+        if (devNull != NULL) fclose(devNull);
+        return 1;
+    }
+    if (!openReport(&report, baselines, results)) {
+        free(directory);
+        fclose(devNull);
+        return 1;
+    }
+    // Commands this build doesn't have are left out, once:
+    bool available[NUM_ELEMENTS(textCommands)];
+    for (size_t t = 0; t < NUM_ELEMENTS(textCommands); t++) {
+        char command[32];
+        sscanf(textCommands[t].format, "%31s", command);
+        available[t] = ios_executable(command);
+        if (!available[t]) fprintf(thread_stderr, "ios_bench: %s: command not found, skipped\n", command);
+    }
+    FILE* out = thread_stdout;
+    int status = 0;
+    fprintf(thread_stdout, "%-28s %-6s %6s %10s%s\n", "text", "corpus", "size", "MB/s", baselineHeader(&report));
+    for (size_t c = 0; (c < NUM_ELEMENTS(textCorpora)) && (status == 0); c++) {
+        if (!selected[c]) continue;
+        for (int s = 0; (s < numSizes) && (status == 0); s++) {
+            char path[MAXPATHLEN];
+            char size[24];
+            formatSize(size, sizeof(size), sizeList[s]);
+            snprintf(path, sizeof(path), "%s/%s-%s.txt", directory, textCorpora[c].name, size);
+            if (!generateCorpus(path, &textCorpora[c], sizeList[s])) {
+                status = 1;
+                break;
+            }
+            for (size_t t = 0; (t < NUM_ELEMENTS(textCommands)) && !ios_isInterrupted(); t++) {
+                if (!available[t]) continue;
+                char command[MAXPATHLEN + 64];
+                double best = 0;
+                int failed = 0;
+                snprintf(command, sizeof(command), textCommands[t].format, path);
+                for (int r = 0; r < runs; r++) {
+                    thread_stdout = devNull;
+                    double start = benchClock();
+                    failed = benchRun(command, NULL);
+                    double elapsed = benchClock() - start;
+                    thread_stdout = out;
+                    // grep -c exits with 1 when it finds nothing
+                    if ((failed != 0) && !((failed == 1) && (strncmp(command, "grep", 4) == 0))) break;
+                    failed = 0;
+                    if ((elapsed > 0) && (sizeList[s] / elapsed > best)) best = sizeList[s] / elapsed;
+                }
+                if (failed != 0) {
+                    fprintf(thread_stderr, "ios_bench: %s: exit status %d\n", command, failed);
+                    continue;
+                }
+                char name[128];
+                fprintf(thread_stdout, "%-28s %-6s %6s %10.1f", textCommands[t].name, textCorpora[c].name, size,
+                        best / (1 << 20));
+                snprintf(name, sizeof(name), "text\t%s\t%s\t%s", textCommands[t].name, textCorpora[c].name, size);
+                reportResult(&report, name, best / (1 << 20));
+            }
+        }
+    }
+    if (ios_isInterrupted()) status = 1;
+    closeReport(&report);
+    fclose(devNull);
+    free(directory);
+    return status;
+}
+
+// ios_bench tree: the file commands over synthesized trees, in files/s (the best of the runs) and system calls
+// per file. The trees are kept in $TMPDIR/ios_bench/tree, with a .count file next to each one once it is complete.
+#define TREE_LARGE_FILES 4
+#define TREE_LARGE_SIZE (64 << 20)
+
+typedef struct _treeCount {
+    long entries;               // files, links and directories, the root included
+    long long bytes;            // of the files, counted once for hard links
+} treeCount;
+
+typedef struct _treeShape {
+    const char* name;
+    bool (*build)(const char* root, treeCount* count);
+} treeShape;
+
+enum { TreeLs, TreeDu, TreeFind, TreeChmod, TreeMtree, TreeTarCreate, TreeTarExtract, TreeCopy, TreeMove, TreeRemove,
+    NUM_TREE_OPERATIONS };
+static const char* const treeOperations[NUM_TREE_OPERATIONS] = {
+    "ls -lR", "du -s", "find -name '*.c'", "chmod -R u+w", "mtree -c", "tar cf", "tar xf", "cp -R", "mv", "rm -rf",
+};
+
+// System calls of the whole app so far (commands are threads of the app, they have no count of their own).
+// Differences are right even when the count wraps.
+static uint32_t benchSyscalls(void) {
+    task_events_info_data_t info;
+    mach_msg_type_number_t count = TASK_EVENTS_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_EVENTS_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return (uint32_t)info.syscalls_unix + (uint32_t)info.syscalls_mach;
+}
+
+static bool makeDirectory(const char* path, treeCount* count) {
+    if (mkdir(path, 0755) != 0) return false;
+    count->entries++;
+    return true;
+}
+
+// A file of size bytes, named f00000.c, f00001.txt... after number (half of them match find -name '*.c').
+static bool makeFile(const char* directory, int number, size_t size, treeCount* count) {
+    static char content[64 << 10];
+    char path[MAXPATHLEN];
+    bool ok = true;
+    if (content[0] == 0) {
+        for (size_t i = 0; i < sizeof(content); i++) content[i] = ((i % 64) == 63) ? '\n' : 'a' + (i % 26);
+    }
+    snprintf(path, sizeof(path), "%s/f%05d.%s", directory, number, (number % 2 == 0) ? "c" : "txt");
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    for (size_t written = 0; ok && (written < size); ) {
+        size_t length = MIN(size - written, sizeof(content));
+        ok = (write(fd, content, length) == (ssize_t)length);
+        written += length;
+    }
+    if (close(fd) != 0) ok = false;
+    count->entries++;
+    count->bytes += size;
+    return ok;
+}
+
+// 64 directories, one in the other, with 16 files in each
+static bool buildDeep(const char* root, treeCount* count) {
+    char path[MAXPATHLEN];
+    strlcpy(path, root, sizeof(path));
+    for (int level = 0; level < 64; level++) {
+        if (level > 0) {
+            snprintf(path + strlen(path), sizeof(path) - strlen(path), "/d%02d", level);
+            if (!makeDirectory(path, count)) return false;
+        }
+        for (int i = 0; i < 16; i++) {
+            if (!makeFile(path, i, 1024, count)) return false;
+        }
+    }
+    return true;
+}
+
+// 10,000 files in one directory
+static bool buildWide(const char* root, treeCount* count) {
+    for (int i = 0; i < 10000; i++) {
+        if (!makeFile(root, i, 256, count)) return false;
+    }
+    return true;
+}
+
+// 100 directories of 500 files, 1 to 4 KB
+static bool buildSmall(const char* root, treeCount* count) {
+    char path[MAXPATHLEN];
+    for (int d = 0; d < 100; d++) {
+        snprintf(path, sizeof(path), "%s/d%03d", root, d);
+        if (!makeDirectory(path, count)) return false;
+        for (int i = 0; i < 500; i++) {
+            if (!makeFile(path, i, 1024 * (1 + (d + i) % 4), count)) return false;
+        }
+    }
+    return true;
+}
+
+static bool buildLarge(const char* root, treeCount* count) {
+    for (int i = 0; i < TREE_LARGE_FILES; i++) {
+        if (!makeFile(root, i, TREE_LARGE_SIZE, count)) return false;
+    }
+    return true;
+}
+
+// 1,000 files in a, each with a hard link in b, c and d
+static bool buildLinks(const char* root, treeCount* count) {
+    char directory[MAXPATHLEN];
+    snprintf(directory, sizeof(directory), "%s/a", root);
+    if (!makeDirectory(directory, count)) return false;
+    for (int i = 0; i < 1000; i++) {
+        if (!makeFile(directory, i, 2048, count)) return false;
+    }
+    for (const char* name = "bcd"; *name != 0; name++) {
+        snprintf(directory, sizeof(directory), "%s/%c", root, *name);
+        if (!makeDirectory(directory, count)) return false;
+        for (int i = 0; i < 1000; i++) {
+            char source[MAXPATHLEN];
+            char destination[MAXPATHLEN];
+            const char* extension = (i % 2 == 0) ? "c" : "txt";
+            snprintf(source, sizeof(source), "%s/a/f%05d.%s", root, i, extension);
+            snprintf(destination, sizeof(destination), "%s/f%05d.%s", directory, i, extension);
+            if (link(source, destination) != 0) return false;
+            count->entries++;
+        }
+    }
+    return true;
+}
+
+// 2,000 files with two extended attributes each, of 64 bytes and 1 KB
+static bool buildXattrs(const char* root, treeCount* count) {
+    char value[1024];
+    memset(value, 'x', sizeof(value));
+    for (int i = 0; i < 2000; i++) {
+        char path[MAXPATHLEN];
+        if (!makeFile(root, i, 1024, count)) return false;
+        snprintf(path, sizeof(path), "%s/f%05d.%s", root, i, (i % 2 == 0) ? "c" : "txt");
+        if ((setxattr(path, "org.ios_system.bench.tag", value, 64, 0, XATTR_NOFOLLOW) != 0) ||
+            (setxattr(path, "org.ios_system.bench.data", value, sizeof(value), 0, XATTR_NOFOLLOW) != 0))
+            return false;
+    }
+    return true;
+}
+
+static const treeShape treeShapes[] = {
+    { "deep", buildDeep },
+    { "wide", buildWide },
+    { "small", buildSmall },
+    { "large", buildLarge },
+    { "links", buildLinks },
+    { "xattrs", buildXattrs },
+};
+
+// Creates the tree at root unless it is complete already. Returns false (with a message) on errors.
+static bool buildTree(const char* root, const treeShape* shape, treeCount* count) {
+    char countPath[MAXPATHLEN];
+    char command[MAXPATHLEN + 16];
+    snprintf(countPath, sizeof(countPath), "%s.count", root);
+    FILE* file = fopen(countPath, "r");
+    memset(count, 0, sizeof(*count));
+    if (file != NULL) {
+        int fields = fscanf(file, "%ld %lld", &count->entries, &count->bytes);
+        fclose(file);
+        if (fields == 2) return true;
+    }
+    // an interrupted build is started again:
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    benchRun(command, NULL);
+    memset(count, 0, sizeof(*count));
+    if (!makeDirectory(root, count) || !shape->build(root, count)) {
+        fprintf(thread_stderr, "ios_bench: %s: %s\n", root, strerror(errno));
+        return false;
+    }
+    if ((file = fopen(countPath, "w")) == NULL) return false;
+    fprintf(file, "%ld %lld\n", count->entries, count->bytes);
+    return fclose(file) == 0;
+}
+
+typedef struct _treeResult {
+    double best;                // seconds, of the fastest run
+    uint32_t syscalls;          // fewest system calls of a run
+    int status;                 // of the last run, if it failed
+} treeResult;
+
+static void treeStep(const char* command, FILE* devNull, treeResult* result) {
+    FILE* out = thread_stdout;
+    thread_stdout = devNull;
+    uint32_t syscalls = benchSyscalls();
+    double start = benchClock();
+    int status = benchRun(command, NULL);
+    double elapsed = benchClock() - start;
+    syscalls = benchSyscalls() - syscalls;
+    thread_stdout = out;
+    if (status != 0) {
+        result->status = status;
+        return;
+    }
+    if ((result->best == 0) || (elapsed < result->best)) result->best = elapsed;
+    if ((result->syscalls == 0) || (syscalls < result->syscalls)) result->syscalls = syscalls;
+}
+
+static const char* treeUsage =
+    "usage: ios_bench tree [-n runs] [-m directory] [-b baselines] [-r results] [tree ...]\n";
+
+static int benchTree(int argc, char** argv) {
+    int runs = 3;
+    const char* moveDirectory = NULL;
+    const char* baselines = NULL;
+    const char* results = NULL;
+    bool selected[NUM_ELEMENTS(treeShapes)];
+    benchReport report;
+    int ch;
+    optind = 1;
+    while ((ch = getopt(argc, argv, "b:m:n:r:")) != -1) {
+        switch (ch) {
+            case 'b':
+                baselines = optarg;
+                break;
+            case 'm':
+                moveDirectory = optarg;
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'r':
+                results = optarg;
+                break;
+            default:
+                fputs(treeUsage, thread_stderr);
+                return 1;
+        }
+    }
+    if (runs < 1) {
+        fputs("ios_bench: runs must be positive\n", thread_stderr);
+        return 1;
+    }
+    for (size_t t = 0; t < NUM_ELEMENTS(treeShapes); t++) selected[t] = (optind == argc);
+    for (int i = optind; i < argc; i++) {
+        size_t t = 0;
+        while ((t < NUM_ELEMENTS(treeShapes)) && (strcmp(argv[i], treeShapes[t].name) != 0)) t++;
+        if (t == NUM_ELEMENTS(treeShapes)) {
+            fprintf(thread_stderr, "ios_bench: %s: no such tree (deep, wide, small, large, links, xattrs)\n", argv[i]);
+            return 1;
+        }
+        selected[t] = true;
+    }
+    char* directory = benchDirectory("tree");
+    char* moved = (moveDirectory != NULL) ? strdup(moveDirectory) : benchDirectory("moved");
+    FILE* devNull = fopen("/dev/null", "w");
+    struct stat treeStat, movedStat;
+    if ((directory == NULL) || (moved == NULL) || (devNull == NULL) || (stat(directory, &treeStat) != 0) ||
+        (stat(moved, &movedStat) != 0)) {
+        fprintf(thread_stderr, "ios_bench: %s: %s\n", (moved == NULL) ? "$TMPDIR/ios_bench" : moved, strerror(errno));
+        free(directory);
+        free(moved);
+        if (devNull != NULL) fclose(devNull);
+        return 1;
+    }
+    if (!openReport(&report, baselines, results)) {
+        free(directory);
+        free(moved);
+        fclose(devNull);
+        return 1;
+    }
+    // mv is a rename() on the same volume, a copy and a removal across volumes:
+    bool otherVolume = (treeStat.st_dev != movedStat.st_dev);
+    const char* moveName = otherVolume ? "mv (other volume)" : "mv (same volume)";
+    bool available[NUM_TREE_OPERATIONS];
+    for (int o = 0; o < NUM_TREE_OPERATIONS; o++) {
+        char command[32];
+        sscanf(treeOperations[o], "%31s", command);
+        available[o] = ios_executable(command);
+        if (!available[o] && ((o == 0) || (strcmp(command, treeOperations[o - 1]) != 0)))
+            fprintf(thread_stderr, "ios_bench: %s: command not found, skipped\n", command);
+    }
+    int status = 0;
+    fprintf(thread_stdout, "%-20s %-6s %7s %10s %8s %10s%s\n", "tree", "tree", "files", "files/s", "MB/s", "syscalls/f",
+            baselineHeader(&report));
+    for (size_t t = 0; (t < NUM_ELEMENTS(treeShapes)) && (status == 0) && !ios_isInterrupted(); t++) {
+        if (!selected[t]) continue;
+        char root[MAXPATHLEN];
+        char archive[MAXPATHLEN];
+        char extracted[MAXPATHLEN];
+        char copy[MAXPATHLEN];
+        char destination[MAXPATHLEN];
+        char command[5 * MAXPATHLEN];
+        treeCount count;
+        treeResult results[NUM_TREE_OPERATIONS];
+        const char* name = treeShapes[t].name;
+        snprintf(root, sizeof(root), "%s/%s", directory, name);
+        snprintf(archive, sizeof(archive), "%s/%s.tar", directory, name);
+        snprintf(extracted, sizeof(extracted), "%s/%s.extracted", directory, name);
+        snprintf(copy, sizeof(copy), "%s/%s.copy", directory, name);
+        snprintf(destination, sizeof(destination), "%s/%s.copy", moved, name);
+        if (!buildTree(root, &treeShapes[t], &count)) {
+            status = 1;
+            break;
+        }
+        memset(results, 0, sizeof(results));
+        for (int r = 0; (r < runs) && !ios_isInterrupted(); r++) {
+            for (int o = 0; o < NUM_TREE_OPERATIONS; o++) {
+                if (!available[o]) continue;
+                switch (o) {
+                    case TreeLs: snprintf(command, sizeof(command), "ls -lR %s", root); break;
+                    case TreeDu: snprintf(command, sizeof(command), "du -s %s", root); break;
+                    case TreeFind: snprintf(command, sizeof(command), "find %s -name '*.c'", root); break;
+                    case TreeChmod: snprintf(command, sizeof(command), "chmod -R u+w %s", root); break;
+                    case TreeMtree: snprintf(command, sizeof(command), "mtree -c -p %s", root); break;
+                    case TreeTarCreate:
+                        snprintf(command, sizeof(command), "tar cf %s -C %s %s", archive, directory, name);
+                        break;
+                    case TreeTarExtract:
+                        mkdir(extracted, 0755);
+                        snprintf(command, sizeof(command), "tar xf %s -C %s", archive, extracted);
+                        break;
+                    case TreeCopy: snprintf(command, sizeof(command), "cp -R %s %s", root, copy); break;
+                    case TreeMove: snprintf(command, sizeof(command), "mv %s %s", copy, destination); break;
+                    case TreeRemove: snprintf(command, sizeof(command), "rm -rf %s", destination); break;
+                }
+                treeStep(command, devNull, &results[o]);
+                if (o == TreeTarExtract) {
+                    // not timed:
+                    snprintf(command, sizeof(command), "rm -rf %s %s", extracted, archive);
+                    benchRun(command, NULL);
+                }
+            }
+            // what is left if a step failed:
+            snprintf(command, sizeof(command), "rm -rf %s %s", copy, destination);
+            benchRun(command, NULL);
+        }
+        for (int o = 0; o < NUM_TREE_OPERATIONS; o++) {
+            const char* operation = (o == TreeMove) ? moveName : treeOperations[o];
+            char resultName[128];
+            if (!available[o]) continue;
+            if ((results[o].status != 0) || (results[o].best == 0)) {
+                fprintf(thread_stderr, "ios_bench: %s, %s tree: exit status %d\n", operation, name, results[o].status);
+                continue;
+            }
+            double filesPerSecond = count.entries / results[o].best;
+            fprintf(thread_stdout, "%-20s %-6s %7ld %10.0f", operation, name, count.entries, filesPerSecond);
+            // MB/s, for the commands that read and write the content of the files:
+            if ((o == TreeTarCreate) || (o == TreeTarExtract) || (o == TreeCopy) || ((o == TreeMove) && otherVolume))
+                fprintf(thread_stdout, " %8.1f", count.bytes / results[o].best / (1 << 20));
+            else
+                fprintf(thread_stdout, " %8s", "-");
+            fprintf(thread_stdout, " %10.1f", (double)results[o].syscalls / count.entries);
+            snprintf(resultName, sizeof(resultName), "tree\t%s\t%s", operation, name);
+            reportResult(&report, resultName, filesPerSecond);
+        }
+    }
+    if (ios_isInterrupted()) status = 1;
+    closeReport(&report);
+    fclose(devNull);
+    free(moved);
+    free(directory);
+    return status;
+}
+
+// ios_bench net: curl against HTTP and HTTPS servers of its own on the loopback, scp and sftp against an SSH
+// server (-H), with an added round-trip time (-d) and bandwidth limit (-l). The shaping is done by a relay,
+// also in the app, between the commands and the servers. The servers and the relay are threads of ios_bench.
+// The TCP handshake of a command is with the relay, on the loopback: the added round-trip time shows in the
+// TLS and SSH handshakes and the transfers, not in the time to connect.
+#define NET_SMALL_SIZE (16 << 10)
+#define NET_CHUNK (16 << 10)
+#define NET_MAX_CONNECTIONS 128
+#define NET_REMOTE "ios_bench_net"  // directory created (and removed) in the home directory of the SSH server
+
+typedef struct _netLink {
+    double delay;               // seconds, each way (half the round-trip time)
+    double rate;                // bytes/s, each way, shared by the connections. 0: no limit
+} netLink;
+
+typedef struct _netServer {
+    int listener;
+    int port;
+    void* (*serve)(void*);      // thread of a connection, with its netConnection
+    SecIdentityRef identity;    // HTTP server: NULL, or the identity of HTTPS
+    struct sockaddr_storage upstream;   // relay: where the connections go
+    socklen_t upstreamLength;
+    netLink link;
+    double linkFree[2];         // relay: when each way of the link is free again (rate limit)
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    bool stopping;
+    int numConnections;
+    int numSockets;
+    int sockets[2 * NET_MAX_CONNECTIONS];   // of the connections, shut down by stopServer
+} netServer;
+
+typedef struct _netConnection {
+    netServer* server;
+    int fd;
+} netConnection;
+
+static void sleepUntil(double when) {
+    for (double now = benchClock(); now < when; now = benchClock()) {
+        double wait = when - now;
+        struct timespec duration = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+        nanosleep(&duration, NULL);
+    }
+}
+
+// No SIGPIPE when the other end is gone (the app would be killed), no Nagle delay on small writes.
+static void setSocketOptions(int fd) {
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static bool writeAll(int fd, const char* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, buffer, length, 0);
+        if ((written < 0) && (errno == EINTR)) continue;
+        if (written <= 0) return false;
+        buffer += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Sockets of the connections are known to the server, so that stopServer can end them. false if it is stopping.
+static bool trackSocket(netServer* server, int fd) {
+    pthread_mutex_lock(&server->mutex);
+    bool tracked = !server->stopping && (server->numSockets < 2 * NET_MAX_CONNECTIONS);
+    if (tracked) server->sockets[server->numSockets++] = fd;
+    pthread_mutex_unlock(&server->mutex);
+    return tracked;
+}
+
+static void untrackSocket(netServer* server, int fd) {
+    pthread_mutex_lock(&server->mutex);
+    for (int i = 0; i < server->numSockets; i++) {
+        if (server->sockets[i] == fd) {
+            server->sockets[i] = server->sockets[--server->numSockets];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+static void endConnection(netConnection* connection) {
+    netServer* server = connection->server;
+    untrackSocket(server, connection->fd);
+    close(connection->fd);
+    free(connection);
+    pthread_mutex_lock(&server->mutex);
+    server->numConnections--;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+static void* acceptConnections(void* arg) {
+    netServer* server = (netServer*) arg;
+    for (;;) {
+        struct pollfd listener = { server->listener, POLLIN, 0 };
+        pthread_mutex_lock(&server->mutex);
+        bool stopping = server->stopping;
+        pthread_mutex_unlock(&server->mutex);
+        if (stopping) break;
+        // woken up every 100 ms to see if it is stopping:
+        if (poll(&listener, 1, 100) <= 0) continue;
+        int fd = accept(server->listener, NULL, NULL);
+        if (fd < 0) continue;
+        netConnection* connection = malloc(sizeof(netConnection));
+        bool accepted = (connection != NULL) && trackSocket(server, fd);
+        pthread_t thread;
+        setSocketOptions(fd);
+        if (accepted) {
+            connection->server = server;
+            connection->fd = fd;
+            pthread_mutex_lock(&server->mutex);
+            accepted = (server->numConnections < NET_MAX_CONNECTIONS);
+            if (accepted) server->numConnections++;
+            pthread_mutex_unlock(&server->mutex);
+            if (accepted && (pthread_create(&thread, NULL, server->serve, connection) == 0)) {
+                pthread_detach(thread);
+                continue;
+            }
+            if (accepted) {
+                pthread_mutex_lock(&server->mutex);
+                server->numConnections--;
+                pthread_mutex_unlock(&server->mutex);
+            }
+            untrackSocket(server, fd);
+        }
+        close(fd);
+        free(connection);
+    }
+    return NULL;
+}
+
+// Listens on 127.0.0.1, on a port of the system. Returns false if it can't.
+static bool startServer(netServer* server, void* (*serve)(void*)) {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    int one = 1;
+    server->serve = serve;
+    server->stopping = false;
+    server->numConnections = 0;
+    server->numSockets = 0;
+    server->linkFree[0] = server->linkFree[1] = 0;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    if ((server->listener = socket(AF_INET, SOCK_STREAM, 0)) < 0) return false;
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if ((bind(server->listener, (struct sockaddr*)&address, sizeof(address)) != 0) ||
+        (listen(server->listener, 64) != 0) ||
+        (getsockname(server->listener, (struct sockaddr*)&address, &length) != 0)) {
+        close(server->listener);
+        return false;
+    }
+    server->port = ntohs(address.sin_port);
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->changed, NULL);
+    if (pthread_create(&server->thread, NULL, acceptConnections, server) != 0) {
+        pthread_cond_destroy(&server->changed);
+        pthread_mutex_destroy(&server->mutex);
+        close(server->listener);
+        return false;
+    }
+    return true;
+}
+
+// Ends the connections still open, and waits for their threads.
+static void stopServer(netServer* server) {
+    pthread_mutex_lock(&server->mutex);
+    server->stopping = true;
+    for (int i = 0; i < server->numSockets; i++) shutdown(server->sockets[i], SHUT_RDWR);
+    while (server->numConnections > 0) pthread_cond_wait(&server->changed, &server->mutex);
+    pthread_mutex_unlock(&server->mutex);
+    pthread_join(server->thread, NULL);
+    close(server->listener);
+    pthread_cond_destroy(&server->changed);
+    pthread_mutex_destroy(&server->mutex);
+}
+
+// The relay: each way of a connection has a reader, which queues what it receives, and a writer, which sends it
+// on once the link would have carried it.
+typedef struct _netChunk {
+    struct _netChunk* next;
+    double arrival;             // benchClock() when it entered the link
+    size_t length;
+    char data[NET_CHUNK];
+} netChunk;
+
+typedef struct _netDirection {
+    int from;
+    int to;
+    netServer* relay;
+    int way;                    // index in relay->linkFree
+    size_t limit;               // bytes queued at most (the buffer of a router), past that the reader waits
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    netChunk* first;
+    netChunk* last;
+    size_t queued;
+    bool ended;                 // nothing more from "from"
+    bool failed;                // "to" doesn't take more
+} netDirection;
+
+static void* readDirection(void* arg) {
+    netDirection* direction = (netDirection*) arg;
+    for (;;) {
+        netChunk* chunk = malloc(sizeof(netChunk));
+        ssize_t length = -1;
+        if (chunk != NULL) {
+            do length = recv(direction->from, chunk->data, NET_CHUNK, 0); while ((length < 0) && (errno == EINTR));
+        }
+        pthread_mutex_lock(&direction->mutex);
+        while ((length > 0) && (direction->queued >= direction->limit) && !direction->failed)
+            pthread_cond_wait(&direction->changed, &direction->mutex);
+        if ((length <= 0) || direction->failed) {
+            direction->ended = true;
+            pthread_cond_broadcast(&direction->changed);
+            pthread_mutex_unlock(&direction->mutex);
+            free(chunk);
+            break;
+        }
+        chunk->next = NULL;
+        chunk->arrival = benchClock();
+        chunk->length = length;
+        if (direction->last != NULL) direction->last->next = chunk;
+        else direction->first = chunk;
+        direction->last = chunk;
+        direction->queued += length;
+        pthread_cond_broadcast(&direction->changed);
+        pthread_mutex_unlock(&direction->mutex);
+    }
+    return NULL;
+}
+
+static void* writeDirection(void* arg) {
+    netDirection* direction = (netDirection*) arg;
+    netServer* relay = direction->relay;
+    for (;;) {
+        pthread_mutex_lock(&direction->mutex);
+        while ((direction->first == NULL) && !direction->ended)
+            pthread_cond_wait(&direction->changed, &direction->mutex);
+        // the chunk stays in the queue (and counts in its size) until it is sent:
+        netChunk* chunk = direction->first;
+        pthread_mutex_unlock(&direction->mutex);
+        if (chunk == NULL) {
+            shutdown(direction->to, SHUT_WR);
+            break;
+        }
+        // sent once it has gone through the link (at rate), and then spent delay on the way:
+        double sent = chunk->arrival;
+        if (relay->link.rate > 0) {
+            pthread_mutex_lock(&relay->mutex);
+            double start = MAX(chunk->arrival, relay->linkFree[direction->way]);
+            relay->linkFree[direction->way] = start + chunk->length / relay->link.rate;
+            sent = relay->linkFree[direction->way];
+            pthread_mutex_unlock(&relay->mutex);
+        }
+        sleepUntil(sent + relay->link.delay);
+        bool written = writeAll(direction->to, chunk->data, chunk->length);
+        pthread_mutex_lock(&direction->mutex);
+        direction->first = chunk->next;
+        if (direction->first == NULL) direction->last = NULL;
+        direction->queued -= chunk->length;
+        if (!written) direction->failed = true;
+        pthread_cond_broadcast(&direction->changed);
+        pthread_mutex_unlock(&direction->mutex);
+        free(chunk);
+        if (!written) {
+            // the reader stops too:
+            shutdown(direction->from, SHUT_RD);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void initDirection(netDirection* direction, int from, int to, netServer* relay, int way) {
+    memset(direction, 0, sizeof(*direction));
+    direction->from = from;
+    direction->to = to;
+    direction->relay = relay;
+    direction->way = way;
+    // what the link holds in a round trip, and 256 KB more:
+    direction->limit = (256 << 10) + (size_t)(relay->link.rate * 2 * relay->link.delay);
+    pthread_mutex_init(&direction->mutex, NULL);
+    pthread_cond_init(&direction->changed, NULL);
+}
+
+static void destroyDirection(netDirection* direction) {
+    while (direction->first != NULL) {
+        netChunk* chunk = direction->first;
+        direction->first = chunk->next;
+        free(chunk);
+    }
+    pthread_cond_destroy(&direction->changed);
+    pthread_mutex_destroy(&direction->mutex);
+}
+
+static void* relayConnection(void* arg) {
+    netConnection* connection = (netConnection*) arg;
+    netServer* relay = connection->server;
+    int upstream = socket(relay->upstream.ss_family, SOCK_STREAM, 0);
+    bool tracked = (upstream >= 0) && trackSocket(relay, upstream);
+    if (tracked && (connect(upstream, (struct sockaddr*)&relay->upstream, relay->upstreamLength) == 0)) {
+        netDirection directions[2];
+        // the writer of directions[1] is this thread:
+        void* (*routines[3])(void*) = { readDirection, writeDirection, readDirection };
+        netDirection* arguments[3] = { &directions[0], &directions[0], &directions[1] };
+        pthread_t threads[3];
+        int started = 0;
+        setSocketOptions(upstream);
+        initDirection(&directions[0], connection->fd, upstream, relay, 0);
+        initDirection(&directions[1], upstream, connection->fd, relay, 1);
+        while ((started < 3) && (pthread_create(&threads[started], NULL, routines[started], arguments[started]) == 0))
+            started++;
+        if (started == 3) {
+            writeDirection(&directions[1]);
+        } else {
+            for (int d = 0; d < 2; d++) {
+                pthread_mutex_lock(&directions[d].mutex);
+                directions[d].failed = true;
+                pthread_cond_broadcast(&directions[d].changed);
+                pthread_mutex_unlock(&directions[d].mutex);
+            }
+            shutdown(connection->fd, SHUT_RDWR);
+            shutdown(upstream, SHUT_RDWR);
+        }
+        for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        destroyDirection(&directions[0]);
+        destroyDirection(&directions[1]);
+    }
+    if (tracked) untrackSocket(relay, upstream);
+    if (upstream >= 0) close(upstream);
+    endConnection(connection);
+    return NULL;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+// HTTPS: Secure Transport, as curl, with a self-signed identity made for ios_bench (curl is run with -k).
+// openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 36500 -subj /CN=ios_bench
+// openssl pkcs12 -export -passout pass:ios_bench -certpbe PBE-SHA1-3DES -keypbe PBE-SHA1-3DES -macalg sha1
+static const unsigned char netIdentity[] = {
+    0x30, 0x82, 0x03, 0xe9, 0x02, 0x01, 0x03, 0x30, 0x82, 0x03, 0xaf, 0x06, 0x09, 0x2a, 0x86, 0x48,
+    0x86, 0xf7, 0x0d, 0x01, 0x07, 0x01, 0xa0, 0x82, 0x03, 0xa0, 0x04, 0x82, 0x03, 0x9c, 0x30, 0x82,
+    0x03, 0x98, 0x30, 0x82, 0x02, 0x67, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x07,
+    0x06, 0xa0, 0x82, 0x02, 0x58, 0x30, 0x82, 0x02, 0x54, 0x02, 0x01, 0x00, 0x30, 0x82, 0x02, 0x4d,
+    0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x07, 0x01, 0x30, 0x1c, 0x06, 0x0a, 0x2a,
+    0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x0c, 0x01, 0x03, 0x30, 0x0e, 0x04, 0x08, 0xb9, 0x62, 0x37,
+    0x1f, 0xa8, 0x19, 0xa9, 0x71, 0x02, 0x02, 0x08, 0x00, 0x80, 0x82, 0x02, 0x20, 0xf5, 0xe4, 0x0e,
+    0x77, 0xea, 0x30, 0xa4, 0xac, 0x82, 0xc5, 0x2a, 0xa8, 0xef, 0x83, 0x67, 0xbe, 0xb0, 0x39, 0xa4,
+    0x14, 0x92, 0x3b, 0x84, 0xb0, 0x65, 0x4d, 0x2e, 0x04, 0x49, 0x51, 0x1f, 0x16, 0x39, 0xed, 0xa1,
+    0x05, 0x89, 0x6b, 0xa2, 0xe5, 0xed, 0xd2, 0xf8, 0x5f, 0x98, 0xd9, 0xd7, 0x44, 0x54, 0x65, 0x25,
+    0x7a, 0xb7, 0x50, 0xe9, 0x43, 0x1f, 0xa2, 0xc8, 0x36, 0xc1, 0xa0, 0x69, 0xc8, 0xf3, 0x3e, 0xfa,
+    0x4e, 0x9f, 0xe8, 0xa5, 0xed, 0x39, 0xb7, 0x39, 0x5f, 0x05, 0x9d, 0x02, 0x92, 0xbe, 0xaa, 0x42,
+    0xa6, 0x90, 0xc8, 0x13, 0x85, 0x0a, 0xa0, 0xfa, 0xb3, 0x87, 0xa4, 0x68, 0x23, 0x64, 0x22, 0x3e,
+    0x9a, 0xd8, 0xb7, 0xee, 0xed, 0x66, 0x42, 0xcc, 0x89, 0xa7, 0xe7, 0xb7, 0x9f, 0x6c, 0x67, 0xf8,
+    0x44, 0x56, 0x87, 0x7e, 0xce, 0x44, 0xaa, 0xa3, 0xa8, 0xcd, 0x9c, 0x23, 0xed, 0x16, 0x57, 0xff,
+    0x98, 0x1d, 0x25, 0x83, 0xbf, 0x80, 0x40, 0xc6, 0xef, 0xce, 0xcd, 0x79, 0x24, 0x5e, 0xa8, 0x5d,
+    0x1d, 0xc4, 0x77, 0x6e, 0xa5, 0xf5, 0xe7, 0x95, 0x0f, 0xad, 0xf8, 0xca, 0x66, 0xf9, 0x89, 0x8d,
+    0x4f, 0x39, 0x53, 0x3c, 0x49, 0x94, 0xae, 0x25, 0x38, 0x7c, 0x09, 0xfa, 0x31, 0x23, 0x72, 0x5c,
+    0x23, 0xb8, 0x03, 0xc6, 0x7b, 0x84, 0x00, 0xa9, 0x91, 0x47, 0xc2, 0x07, 0x3f, 0x50, 0x47, 0x08,
+    0x95, 0xec, 0x67, 0xea, 0x2f, 0x47, 0x76, 0xa3, 0x97, 0x81, 0xb4, 0x24, 0x90, 0x09, 0xbd, 0x21,
+    0xcb, 0x0e, 0x6c, 0xf9, 0x48, 0x26, 0xf1, 0x2a, 0xa1, 0x93, 0x4b, 0x8a, 0xd3, 0xa8, 0x22, 0x48,
+    0x05, 0xa3, 0x85, 0xa9, 0xc8, 0x51, 0xf1, 0xff, 0x49, 0xc5, 0x7d, 0x4a, 0x76, 0x68, 0x12, 0x12,
+    0x41, 0x71, 0x33, 0x0e, 0xcd, 0xa2, 0x64, 0xf1, 0xdc, 0xe7, 0xd7, 0x3f, 0x38, 0x9a, 0x7e, 0x93,
+    0xfe, 0x51, 0xd1, 0x0a, 0xc8, 0x4c, 0x15, 0xa2, 0x60, 0x2f, 0xfb, 0x72, 0x49, 0x8d, 0x0c, 0x18,
+    0x3c, 0x44, 0xa5, 0xc0, 0x92, 0x02, 0x79, 0xc2, 0xa6, 0x0f, 0xeb, 0x18, 0x13, 0x11, 0x8c, 0x71,
+    0xde, 0x0a, 0x50, 0xed, 0x4b, 0x46, 0xfa, 0x23, 0xbe, 0x00, 0x48, 0x24, 0xc0, 0xa1, 0xd0, 0xb9,
+    0x3d, 0xf4, 0x23, 0x52, 0xac, 0xbf, 0xf0, 0x1c, 0x16, 0xe1, 0xc1, 0xf3, 0x0e, 0xc7, 0x82, 0xbd,
+    0xd1, 0x73, 0x78, 0xf6, 0xe5, 0x62, 0xda, 0xf8, 0x13, 0xe9, 0x7f, 0xfa, 0x52, 0x0a, 0xed, 0xfe,
+    0x43, 0x82, 0x7b, 0xc7, 0x6e, 0xe9, 0xd5, 0x71, 0xef, 0x04, 0xb5, 0x29, 0x28, 0x02, 0x0c, 0x40,
+    0xaf, 0xdd, 0x96, 0x67, 0x6a, 0x5e, 0xa0, 0x35, 0xba, 0x59, 0x8c, 0x39, 0x71, 0x91, 0xb6, 0x8b,
+    0x44, 0x2c, 0xd0, 0x00, 0xde, 0x0e, 0xaf, 0xa9, 0xbb, 0x85, 0xec, 0x35, 0x6a, 0xc1, 0x42, 0x13,
+    0x6c, 0xdb, 0x9e, 0x60, 0x80, 0xf0, 0x98, 0xac, 0xd8, 0x28, 0x3e, 0x0a, 0xef, 0xba, 0xd2, 0xcb,
+    0xa1, 0xfd, 0x2c, 0xc9, 0x13, 0x6d, 0xb3, 0x01, 0x01, 0x9f, 0xf1, 0x74, 0x8d, 0x08, 0x5d, 0x6e,
+    0x91, 0xf3, 0x47, 0xec, 0x8f, 0x85, 0xa7, 0xab, 0xc2, 0xe4, 0x6e, 0x2a, 0xb7, 0xad, 0x05, 0x90,
+    0xd1, 0x70, 0x4f, 0x83, 0x69, 0xef, 0x9a, 0xf6, 0xed, 0x6d, 0xcb, 0xb1, 0x3e, 0xe5, 0xfc, 0xfd,
+    0x81, 0x35, 0x44, 0xde, 0xff, 0x00, 0xce, 0x4e, 0xa8, 0x99, 0x1f, 0x9c, 0xad, 0xa2, 0xd0, 0xae,
+    0x66, 0x39, 0xc0, 0x74, 0x0e, 0xce, 0xd4, 0xdf, 0x0b, 0x3c, 0xf4, 0x62, 0x43, 0x0a, 0xec, 0xa9,
+    0x13, 0x81, 0x1a, 0xbf, 0x1a, 0x8c, 0x5f, 0x05, 0xbb, 0xe2, 0x21, 0x5b, 0xb7, 0x3f, 0xb8, 0xbc,
+    0xe7, 0x31, 0x39, 0x27, 0x8f, 0xf0, 0x99, 0x86, 0xb6, 0xa2, 0x40, 0xfa, 0x25, 0x79, 0x10, 0x29,
+    0x0d, 0xe5, 0xc3, 0x0e, 0x6d, 0x8e, 0xbe, 0x05, 0xbe, 0x8a, 0x36, 0x7d, 0xbc, 0xa1, 0xf5, 0x48,
+    0xeb, 0x5a, 0x6e, 0xad, 0xe6, 0x40, 0x0c, 0x2c, 0xda, 0x82, 0xb2, 0x5b, 0x66, 0x30, 0x82, 0x01,
+    0x29, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x07, 0x01, 0xa0, 0x82, 0x01, 0x1a,
+    0x04, 0x82, 0x01, 0x16, 0x30, 0x82, 0x01, 0x12, 0x30, 0x82, 0x01, 0x0e, 0x06, 0x0b, 0x2a, 0x86,
+    0x48, 0x86, 0xf7, 0x0d, 0x01, 0x0c, 0x0a, 0x01, 0x02, 0xa0, 0x81, 0xb4, 0x30, 0x81, 0xb1, 0x30,
+    0x1c, 0x06, 0x0a, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x0c, 0x01, 0x03, 0x30, 0x0e, 0x04,
+    0x08, 0x46, 0xb5, 0x8e, 0x55, 0x5a, 0xaa, 0x51, 0x44, 0x02, 0x02, 0x08, 0x00, 0x04, 0x81, 0x90,
+    0x68, 0xe4, 0x22, 0x5a, 0xc0, 0xc9, 0x9b, 0xe7, 0x6f, 0x81, 0x48, 0x8b, 0xc3, 0xea, 0x0a, 0x21,
+    0x17, 0xe0, 0xa4, 0xa0, 0xf8, 0x52, 0x4e, 0x34, 0x2d, 0x40, 0x91, 0x3d, 0x54, 0xc9, 0xfd, 0x3b,
+    0x75, 0xcb, 0x45, 0xc7, 0x32, 0xef, 0xa6, 0x4a, 0xc8, 0x8b, 0xae, 0xea, 0xb9, 0x11, 0x51, 0x97,
+    0x47, 0x22, 0xbe, 0x8e, 0xbd, 0x77, 0xe4, 0x34, 0x02, 0xc0, 0x5a, 0x22, 0x83, 0xa7, 0x1d, 0x67,
+    0x24, 0xad, 0xbf, 0x9c, 0xdc, 0xee, 0x16, 0xdc, 0x6d, 0x02, 0x8d, 0x76, 0xa5, 0xc8, 0x8c, 0x1b,
+    0xa6, 0xf9, 0xe8, 0xfb, 0xfc, 0x7d, 0x6d, 0xf9, 0x6d, 0x3c, 0x6e, 0x22, 0xea, 0x3b, 0xee, 0x14,
+    0xfd, 0xb7, 0x61, 0x44, 0x63, 0x68, 0x09, 0xa6, 0x64, 0xaf, 0xd1, 0xa0, 0x3c, 0xd8, 0xf1, 0xa9,
+    0xe7, 0xdc, 0x18, 0x59, 0x1d, 0x20, 0xaf, 0x7c, 0x82, 0x2b, 0x5e, 0xc2, 0xaa, 0x21, 0x87, 0xc0,
+    0x64, 0xcd, 0xa6, 0x52, 0x41, 0xa3, 0x1e, 0x8e, 0x53, 0x98, 0xf3, 0x43, 0xe9, 0xb5, 0x76, 0x36,
+    0x31, 0x48, 0x30, 0x21, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x09, 0x14, 0x31,
+    0x14, 0x1e, 0x12, 0x00, 0x69, 0x00, 0x6f, 0x00, 0x73, 0x00, 0x5f, 0x00, 0x62, 0x00, 0x65, 0x00,
+    0x6e, 0x00, 0x63, 0x00, 0x68, 0x30, 0x23, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01,
+    0x09, 0x15, 0x31, 0x16, 0x04, 0x14, 0xf2, 0xad, 0x29, 0xd7, 0x80, 0xcd, 0x58, 0xf1, 0x6c, 0x03,
+    0xe2, 0x14, 0xab, 0x87, 0x1f, 0x19, 0x2e, 0xb3, 0x5c, 0xec, 0x30, 0x31, 0x30, 0x21, 0x30, 0x09,
+    0x06, 0x05, 0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00, 0x04, 0x14, 0xfe, 0x5c, 0x9f, 0x72, 0x54,
+    0x7c, 0x75, 0x76, 0x4c, 0x15, 0xba, 0x8a, 0x7c, 0x3b, 0x49, 0x5c, 0x4b, 0xd4, 0x80, 0x6e, 0x04,
+    0x08, 0xbf, 0xda, 0x99, 0xa7, 0x6e, 0x45, 0xee, 0x41, 0x02, 0x02, 0x08, 0x00,
+};
+
+static SecIdentityRef loadIdentity(void) {
+    CFDataRef data = CFDataCreate(NULL, netIdentity, sizeof(netIdentity));
+    const void* keys[] = { kSecImportExportPassphrase };
+    const void* values[] = { CFSTR("ios_bench") };
+    CFDictionaryRef options = CFDictionaryCreate(NULL, keys, values, 1, &kCFTypeDictionaryKeyCallBacks,
+                                                 &kCFTypeDictionaryValueCallBacks);
+    CFArrayRef items = NULL;
+    SecIdentityRef identity = NULL;
+    if ((data != NULL) && (options != NULL) && (SecPKCS12Import(data, options, &items) == errSecSuccess) &&
+        (CFArrayGetCount(items) > 0)) {
+        CFDictionaryRef item = (CFDictionaryRef)CFArrayGetValueAtIndex(items, 0);
+        identity = (SecIdentityRef)CFDictionaryGetValue(item, kSecImportItemIdentity);
+        if (identity != NULL) CFRetain(identity);
+    }
+    if (items != NULL) CFRelease(items);
+    if (options != NULL) CFRelease(options);
+    if (data != NULL) CFRelease(data);
+    return identity;
+}
+
+// Secure Transport wants all the bytes it asks for, or an error.
+static OSStatus tlsRead(SSLConnectionRef connection, void* data, size_t* length) {
+    int fd = (int)(intptr_t)connection;
+    size_t done = 0;
+    while (done < *length) {
+        ssize_t n = recv(fd, (char*)data + done, *length - done, 0);
+        if ((n < 0) && (errno == EINTR)) continue;
+        if (n <= 0) {
+            *length = done;
+            return (n == 0) ? errSSLClosedGraceful : errSSLClosedAbort;
+        }
+        done += n;
+    }
+    return noErr;
+}
+
+static OSStatus tlsWrite(SSLConnectionRef connection, const void* data, size_t* length) {
+    if (!writeAll((int)(intptr_t)connection, data, *length)) {
+        *length = 0;
+        return errSSLClosedAbort;
+    }
+    return noErr;
+}
+
+// The server side of a TLS connection, after the handshake. NULL if it failed.
+static SSLContextRef startTLS(int fd, SecIdentityRef identity) {
+    SSLContextRef context = SSLCreateContext(NULL, kSSLServerSide, kSSLStreamType);
+    CFArrayRef certificates = CFArrayCreate(NULL, (const void**)&identity, 1, &kCFTypeArrayCallBacks);
+    OSStatus status = ((context == NULL) || (certificates == NULL)) ? errSecAllocate : noErr;
+    if (status == noErr) status = SSLSetIOFuncs(context, tlsRead, tlsWrite);
+    if (status == noErr) status = SSLSetConnection(context, (SSLConnectionRef)(intptr_t)fd);
+    if (status == noErr) status = SSLSetCertificate(context, certificates);
+    if (status == noErr) {
+        do status = SSLHandshake(context); while (status == errSSLWouldBlock);
+    }
+    if (certificates != NULL) CFRelease(certificates);
+    if ((status != noErr) && (context != NULL)) {
+        CFRelease(context);
+        context = NULL;
+    }
+    return context;
+}
+
+static ssize_t httpRead(int fd, SSLContextRef tls, char* buffer, size_t length) {
+    if (tls == NULL) {
+        ssize_t n;
+        do n = recv(fd, buffer, length, 0); while ((n < 0) && (errno == EINTR));
+        return n;
+    }
+    size_t processed = 0;
+    OSStatus status = SSLRead(tls, buffer, length, &processed);
+    if (processed > 0) return processed;
+    return ((status == errSSLClosedGraceful) || (status == errSSLClosedNoNotify)) ? 0 : -1;
+}
+
+static bool httpWrite(int fd, SSLContextRef tls, const char* buffer, size_t length) {
+    if (tls == NULL) return writeAll(fd, buffer, length);
+    while (length > 0) {
+        size_t processed = 0;
+        if ((SSLWrite(tls, buffer, length, &processed) != noErr) && (processed == 0)) return false;
+        buffer += processed;
+        length -= processed;
+    }
+    return true;
+}
+
+static char netBody[NET_CHUNK];   // filled by benchNet before the servers start
+
+// GET /bytes/n: n bytes. HTTP/1.1, with persistent connections (as long as the client keeps them).
+static void* serveHTTP(void* arg) {
+    netConnection* connection = (netConnection*) arg;
+    SecIdentityRef identity = connection->server->identity;
+    SSLContextRef tls = (identity != NULL) ? startTLS(connection->fd, identity) : NULL;
+    char request[8192];
+    size_t used = 0;
+    while ((identity == NULL) || (tls != NULL)) {
+        char* end;
+        while ((end = memmem(request, used, "\r\n\r\n", 4)) == NULL) {
+            ssize_t n = -1;
+            if (used < sizeof(request) - 1)
+                n = httpRead(connection->fd, tls, request + used, sizeof(request) - 1 - used);
+            if (n <= 0) break;
+            used += n;
+        }
+        if (end == NULL) break;
+        end[2] = 0;
+        char method[8];
+        char path[1024];
+        long long size = -1;
+        if ((sscanf(request, "%7s %1023s", method, path) == 2) && (strcmp(method, "GET") == 0) &&
+            (strncmp(path, "/bytes/", 7) == 0))
+            size = strtoll(path + 7, NULL, 10);
+        bool keepAlive = (strcasestr(request, "\r\nConnection: close") == NULL);
+        char header[256];
+        int length = (size >= 0) ?
+            snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                     "Content-Length: %lld\r\n\r\n", size) :
+            snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        bool ok = httpWrite(connection->fd, tls, header, length);
+        for (long long sent = 0; ok && (sent < size); sent += sizeof(netBody))
+            ok = httpWrite(connection->fd, tls, netBody, (size_t)MIN(size - sent, (long long)sizeof(netBody)));
+        if (!ok || !keepAlive) break;
+        // the next request may be there already:
+        used -= (end + 4) - request;
+        memmove(request, end + 4, used);
+    }
+    if (tls != NULL) {
+        SSLClose(tls);
+        CFRelease(tls);
+    }
+    endConnection(connection);
+    return NULL;
+}
+#pragma clang diagnostic pop
+
+// From curl --metrics: one JSON line per transfer.
+typedef struct _curlMetrics {
+    int transfers;
+    int connections;            // new ones; the other transfers reused a connection
+    double connect;             // seconds, total of the TCP handshakes of the new connections
+    double handshake;           // seconds, total of their TLS handshakes
+    double bytes;
+} curlMetrics;
+
+static double metricsValue(const char* line, const char* key) {
+    const char* value = strstr(line, key);
+    return (value != NULL) ? atof(value + strlen(key)) : 0;
+}
+
+static void readMetrics(const char* path, curlMetrics* metrics) {
+    FILE* file = fopen(path, "r");
+    char* line = NULL;
+    size_t size = 0;
+    memset(metrics, 0, sizeof(*metrics));
+    if (file == NULL) return;
+    while (getline(&line, &size, file) > 0) {
+        int connections = (int)metricsValue(line, "\"num_connects\":");
+        double connect = metricsValue(line, "\"time_connect\":");
+        double appconnect = metricsValue(line, "\"time_appconnect\":");
+        metrics->transfers++;
+        metrics->bytes += metricsValue(line, "\"size_download\":") + metricsValue(line, "\"size_upload\":");
+        if (connections > 0) {
+            metrics->connections += connections;
+            metrics->connect += connect;
+            if (appconnect > connect) metrics->handshake += appconnect - connect;
+        }
+    }
+    free(line);
+    fclose(file);
+}
+
+typedef struct _netResult {
+    double wall;                // seconds, of the fastest run
+    double cpu;                 // seconds, of the main thread of the command in that run
+    curlMetrics metrics;        // of that run (curl)
+    int status;                 // of the last run, if it failed
+} netResult;
+
+// metrics: curl --metrics file, or NULL.
+static void netStep(const char* command, FILE* devNull, const char* metrics, netResult* result) {
+    FILE* out = thread_stdout;
+    pid_t pid;
+    if (metrics != NULL) unlink(metrics);
+    thread_stdout = devNull;
+    double start = benchClock();
+    int status = benchRun(command, &pid);
+    double elapsed = benchClock() - start;
+    thread_stdout = out;
+    if (status != 0) {
+        result->status = status;
+        return;
+    }
+    if ((result->wall == 0) || (elapsed < result->wall)) {
+        result->wall = elapsed;
+        result->cpu = (pid > 0) ? ios_getProcessStats(pid).cpuTime : 0;
+        if (metrics != NULL) readMetrics(metrics, &result->metrics);
+    }
+}
+
+// One line of the table. bytes is 0 for ssh true: the time of the session is its handshake, and the result is
+// sessions/s instead of MB/s.
+static void netLine(benchReport* report, const netLink* link, const char* test, const char* protocol, int files,
+                    double bytes, const netResult* result) {
+    const curlMetrics* metrics = &result->metrics;
+    char connections[16] = "-";
+    char connect[16] = "-";
+    char handshake[16] = "-";
+    char speed[16] = "-";
+    char cpu[16] = "-";
+    char name[160];
+    double value = 1 / result->wall;
+    if (metrics->connections > 0) {
+        snprintf(connections, sizeof(connections), "%d", metrics->connections);
+        snprintf(connect, sizeof(connect), "%.1f", metrics->connect * 1000 / metrics->connections);
+        if (metrics->handshake > 0)
+            snprintf(handshake, sizeof(handshake), "%.1f", metrics->handshake * 1000 / metrics->connections);
+    }
+    if (bytes > 0) {
+        value = bytes / result->wall / (1 << 20);
+        snprintf(speed, sizeof(speed), "%.2f", value);
+        if (result->cpu > 0) snprintf(cpu, sizeof(cpu), "%.1f", result->cpu * 1000 / (bytes / (1 << 20)));
+    } else {
+        snprintf(handshake, sizeof(handshake), "%.1f", result->wall * 1000);
+    }
+    fprintf(thread_stdout, "%-22s %-5s %5d %5s %8s %8s %8s %8.2f %9s", test, protocol, files, connections, connect,
+            handshake, speed, result->wall * 1000 / MAX(files, 1), cpu);
+    snprintf(name, sizeof(name), "net\t%s\t%s\t%.0f ms\t%.0f Mbit/s", test, protocol, link->delay * 2000,
+             link->rate * 8 / 1e6);
+    reportResult(report, name, value);
+}
+
+static void netFailed(const char* test, const char* protocol, int status) {
+    fprintf(thread_stderr, "ios_bench: %s (%s): exit status %d\n", test, protocol, status);
+}
+
+static const char* netUsage =
+    "usage: ios_bench net [-n runs] [-d rtt (ms)] [-l Mbit/s] [-s size] [-f files] [-H [user@]host[:port]]\n"
+    "                     [-b baselines] [-r results]\n";
+
+static int benchNet(int argc, char** argv) {
+    int runs = 3;
+    double rtt = 0;
+    double mbits = 0;
+    off_t size = 16 << 20;
+    int files = 100;
+    const char* sshServer = NULL;
+    const char* baselines = NULL;
+    const char* results = NULL;
+    benchReport report;
+    int ch;
+    optind = 1;
+    while ((ch = getopt(argc, argv, "b:d:f:H:l:n:r:s:")) != -1) {
+        switch (ch) {
+            case 'b':
+                baselines = optarg;
+                break;
+            case 'd':
+                rtt = atof(optarg);
+                break;
+            case 'f':
+                files = atoi(optarg);
+                break;
+            case 'H':
+                sshServer = optarg;
+                break;
+            case 'l':
+                mbits = atof(optarg);
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'r':
+                results = optarg;
+                break;
+            case 's':
+                size = parseSize(optarg);
+                break;
+            default:
+                fputs(netUsage, thread_stderr);
+                return 1;
+        }
+    }
+    if ((runs < 1) || (rtt < 0) || (mbits < 0) || (size == 0) || (files < 1)) {
+        fputs("ios_bench: runs, size and files must be positive, rtt and Mbit/s positive or 0\n", thread_stderr);
+        return 1;
+    }
+    // [user@]host[:port]
+    char user[256] = "";
+    char host[256];
+    char port[16] = "22";
+    if (sshServer != NULL) {
+        const char* at = strrchr(sshServer, '@');
+        if (at != NULL) snprintf(user, sizeof(user), "%.*s@", (int)(at - sshServer), sshServer);
+        snprintf(host, sizeof(host), "%s", (at != NULL) ? at + 1 : sshServer);
+        char* colon = strchr(host, ':');
+        if ((colon != NULL) && (strchr(colon + 1, ':') == NULL)) {
+            snprintf(port, sizeof(port), "%s", colon + 1);
+            *colon = 0;
+        }
+    }
+    netLink link = { rtt / 2000, mbits * 1e6 / 8 };
+    bool shaped = (link.delay > 0) || (link.rate > 0);
+    char* directory = benchDirectory("net");
+    FILE* devNull = fopen("/dev/null", "w");
+    if ((directory == NULL) || (devNull == NULL)) {
+        fprintf(thread_stderr, "ios_bench: $TMPDIR/ios_bench: %s\n", strerror(errno));
+        free(directory);
+        if (devNull != NULL) fclose(devNull);
+        return 1;
+    }
+    if (!openReport(&report, baselines, results)) {
+        free(directory);
+        fclose(devNull);
+        return 1;
+    }
+    // Servers: HTTP and HTTPS, and a relay in front of each of them (and of the SSH server) if the link is shaped.
+    enum { ServerHTTP, ServerHTTPS, NUM_SERVERS };
+    const char* protocols[NUM_SERVERS] = { "http", "https" };
+    netServer servers[NUM_SERVERS];
+    netServer relays[NUM_SERVERS + 1];  // the last one for SSH
+    bool started[NUM_SERVERS] = { false, false };
+    bool relayed[NUM_SERVERS + 1] = { false, false, false };
+    int ports[NUM_SERVERS + 1] = { 0, 0, atoi(port) };
+    memset(servers, 0, sizeof(servers));
+    memset(netBody, 'x', sizeof(netBody));
+    memset(relays, 0, sizeof(relays));
+    servers[ServerHTTPS].identity = loadIdentity();
+    if (servers[ServerHTTPS].identity == NULL) fputs("ios_bench: no TLS identity, https skipped\n", thread_stderr);
+    for (int s = 0; s < NUM_SERVERS; s++) {
+        if ((s == ServerHTTPS) && (servers[s].identity == NULL)) continue;
+        started[s] = startServer(&servers[s], serveHTTP);
+        if (!started[s]) fprintf(thread_stderr, "ios_bench: %s server: %s\n", protocols[s], strerror(errno));
+        ports[s] = servers[s].port;
+    }
+    for (int s = 0; shaped && (s <= NUM_SERVERS); s++) {
+        netServer* relay = &relays[s];
+        relay->link = link;
+        if (s < NUM_SERVERS) {
+            struct sockaddr_in* upstream = (struct sockaddr_in*)&relay->upstream;
+            if (!started[s]) continue;
+            upstream->sin_family = AF_INET;
+            upstream->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            upstream->sin_port = htons(servers[s].port);
+            relay->upstreamLength = sizeof(struct sockaddr_in);
+        } else {
+            struct addrinfo hints;
+            struct addrinfo* addresses = NULL;
+            if (sshServer == NULL) continue;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host, port, &hints, &addresses) != 0) {
+                fprintf(thread_stderr, "ios_bench: %s: unknown host\n", host);
+                continue;
+            }
+            memcpy(&relay->upstream, addresses->ai_addr, addresses->ai_addrlen);
+            relay->upstreamLength = addresses->ai_addrlen;
+            freeaddrinfo(addresses);
+        }
+        relayed[s] = startServer(relay, relayConnection);
+        if (relayed[s]) ports[s] = relay->port;
+        else fprintf(thread_stderr, "ios_bench: relay: %s\n", strerror(errno));
+    }
+    fprintf(thread_stdout, "%-22s %-5s %5s %5s %8s %8s %8s %8s %9s%s\n", "net", "", "files", "conns", "tcp ms",
+            "hs ms", "MB/s", "ms/file", "cpu ms/MB", baselineHeader(&report));
+    // curl: one file, many small files in one command, the same in parallel
+    char metrics[MAXPATHLEN];
+    char command[4 * MAXPATHLEN];
+    char test[64];
+    snprintf(metrics, sizeof(metrics), "%s/metrics.json", directory);
+    for (int s = 0; (s < NUM_SERVERS) && ios_executable("curl"); s++) {
+        if (!started[s] || (shaped && !relayed[s])) continue;
+        for (int c = 0; (c < 3) && !ios_isInterrupted(); c++) {
+            netResult result;
+            memset(&result, 0, sizeof(result));
+            for (int r = 0; r < runs; r++) {
+                if (c == 0) {
+                    snprintf(command, sizeof(command),
+                             "curl -s -k --metrics %s -o /dev/null %s://127.0.0.1:%d/bytes/%lld", metrics,
+                             protocols[s], ports[s], (long long)size);
+                } else {
+                    // quoted, so that ios_system leaves the [1-n] of curl alone:
+                    snprintf(command, sizeof(command), "curl -s -k %s--metrics %s '%s://127.0.0.1:%d/bytes/%d?[1-%d]'",
+                             (c == 2) ? "-Z --parallel-max 8 " : "", metrics, protocols[s], ports[s], NET_SMALL_SIZE,
+                             files);
+                }
+                netStep(command, devNull, metrics, &result);
+            }
+            if (c == 0) snprintf(test, sizeof(test), "curl (1 file)");
+            else snprintf(test, sizeof(test), "curl%s (%d files)", (c == 2) ? " -Z" : "", files);
+            if ((result.status != 0) || (result.wall == 0)) netFailed(test, protocols[s], result.status);
+            else netLine(&report, &link, test, protocols[s], (c == 0) ? 1 : files,
+                         (c == 0) ? (double)size : (double)files * NET_SMALL_SIZE, &result);
+        }
+    }
+    unlink(metrics);
+    // ssh, scp and sftp: one large file and a directory of small ones, up and down
+    enum { SshTrue, ScpPut, ScpGet, ScpPutDirectory, ScpGetDirectory, SftpPut, SftpGet, NUM_SSH_TESTS };
+    const char* sshTests[NUM_SSH_TESTS] = {
+        "ssh true", "scp put (1 file)", "scp get (1 file)", "scp -r put", "scp -r get", "sftp put -r", "sftp get -r",
+    };
+    if ((sshServer != NULL) && (!shaped || relayed[NUM_SERVERS])) {
+        char upload[MAXPATHLEN];
+        char small[MAXPATHLEN];
+        char download[MAXPATHLEN];
+        char batch[MAXPATHLEN];
+        char options[600];
+        char destination[300];
+        treeCount count;
+        netResult sshResults[NUM_SSH_TESTS];
+        bool available[NUM_SSH_TESTS];
+        bool ok;
+        snprintf(upload, sizeof(upload), "%s/upload", directory);
+        snprintf(small, sizeof(small), "%s/upload/small", directory);
+        snprintf(download, sizeof(download), "%s/download", directory);
+        snprintf(batch, sizeof(batch), "%s/batch", directory);
+        memset(&count, 0, sizeof(count));
+        snprintf(command, sizeof(command), "rm -rf %s", upload);
+        benchRun(command, NULL);
+        ok = makeDirectory(upload, &count) && makeFile(upload, 0, size, &count) && makeDirectory(small, &count);
+        for (int i = 0; ok && (i < files); i++) ok = makeFile(small, i, NET_SMALL_SIZE, &count);
+        if (!ok) fprintf(thread_stderr, "ios_bench: %s: %s\n", upload, strerror(errno));
+        // Through the relay, the host key is still the one of the server:
+        if (!shaped) snprintf(options, sizeof(options), "-o BatchMode=yes");
+        else if (strcmp(port, "22") == 0)
+            snprintf(options, sizeof(options), "-o BatchMode=yes -o HostKeyAlias=%s", host);
+        else snprintf(options, sizeof(options), "-o BatchMode=yes -o 'HostKeyAlias=[%s]:%s'", host, port);
+        snprintf(destination, sizeof(destination), "%s%s", user, shaped ? "127.0.0.1" : host);
+        for (int t = 0; t < NUM_SSH_TESTS; t++) {
+            char name[8];
+            sscanf(sshTests[t], "%7s", name);
+            available[t] = ios_executable(name);
+        }
+        memset(sshResults, 0, sizeof(sshResults));
+        for (int r = 0; ok && (r < runs) && !ios_isInterrupted(); r++) {
+            int p = ports[NUM_SERVERS];
+            mkdir(download, 0755);
+            if (available[SshTrue]) {
+                snprintf(command, sizeof(command), "ssh -p %d %s %s true", p, options, destination);
+                netStep(command, devNull, NULL, &sshResults[SshTrue]);
+                // not timed:
+                snprintf(command, sizeof(command), "ssh -p %d %s %s mkdir -p " NET_REMOTE, p, options, destination);
+                benchRun(command, NULL);
+            }
+            for (int t = ScpPut; t < NUM_SSH_TESTS; t++) {
+                FILE* file;
+                if (!available[t]) continue;
+                switch (t) {
+                    case ScpPut:
+                        snprintf(command, sizeof(command), "scp -q -P %d %s %s/f00000.c %s:" NET_REMOTE "/",
+                                 p, options, upload, destination);
+                        break;
+                    case ScpGet:
+                        snprintf(command, sizeof(command), "scp -q -P %d %s %s:" NET_REMOTE "/f00000.c %s/",
+                                 p, options, destination, download);
+                        break;
+                    case ScpPutDirectory:
+                        snprintf(command, sizeof(command), "scp -q -r -P %d %s %s %s:" NET_REMOTE "/",
+                                 p, options, small, destination);
+                        break;
+                    case ScpGetDirectory:
+                        snprintf(command, sizeof(command), "scp -q -r -P %d %s %s:" NET_REMOTE "/small %s/",
+                                 p, options, destination, download);
+                        break;
+                    case SftpPut:
+                    case SftpGet:
+                        if ((file = fopen(batch, "w")) == NULL) continue;
+                        if (t == SftpPut) fprintf(file, "put -r %s " NET_REMOTE "/sftp\n", small);
+                        else fprintf(file, "get -r " NET_REMOTE "/sftp %s/sftp\n", download);
+                        fclose(file);
+                        snprintf(command, sizeof(command), "sftp -q -P %d %s -b %s %s", p, options, batch, destination);
+                        break;
+                }
+                netStep(command, devNull, NULL, &sshResults[t]);
+            }
+            snprintf(command, sizeof(command), "rm -rf %s %s", download, batch);
+            benchRun(command, NULL);
+            if (available[SshTrue]) {
+                snprintf(command, sizeof(command), "ssh -p %d %s %s rm -rf " NET_REMOTE, p, options, destination);
+                benchRun(command, NULL);
+            }
+        }
+        for (int t = 0; ok && (t < NUM_SSH_TESTS); t++) {
+            bool single = (t == SshTrue) || (t == ScpPut) || (t == ScpGet);
+            if (!available[t]) continue;
+            if ((sshResults[t].status != 0) || (sshResults[t].wall == 0))
+                netFailed(sshTests[t], "ssh", sshResults[t].status);
+            else netLine(&report, &link, sshTests[t], "ssh", single ? 1 : files,
+                         (t == SshTrue) ? 0 : single ? (double)size : (double)files * NET_SMALL_SIZE, &sshResults[t]);
+        }
+        snprintf(command, sizeof(command), "rm -rf %s", upload);
+        benchRun(command, NULL);
+    }
+    for (int s = 0; s <= NUM_SERVERS; s++) {
+        if (relayed[s]) stopServer(&relays[s]);
+    }
+    for (int s = 0; s < NUM_SERVERS; s++) {
+        if (started[s]) stopServer(&servers[s]);
+    }
+    if (servers[ServerHTTPS].identity != NULL) CFRelease(servers[ServerHTTPS].identity);
+    int status = ios_isInterrupted() ? 1 : 0;
+    closeReport(&report);
+    fclose(devNull);
+    free(directory);
+    return status;
+}
+
+// ios_bench clean: removes $TMPDIR/ios_bench, corpora included.
+static int benchClean(void) {
+    char* directory = benchDirectory(NULL);
+    char* command = NULL;
+    if ((directory == NULL) || (asprintf(&command, "rm -rf %s", directory) < 0)) {
+        free(directory);
+        return 1;
+    }
+    int status = benchRun(command, NULL);
+    free(command);
+    free(directory);
+    return status;
+}
+
+int ios_bench_main(int argc, char** argv) {
+    if ((argc >= 2) && (strcmp(argv[1], "launch") == 0)) return benchLaunch(argc - 1, argv + 1);
+    if ((argc >= 2) && (strcmp(argv[1], "text") == 0)) return benchText(argc - 1, argv + 1);
+    if ((argc >= 2) && (strcmp(argv[1], "tree") == 0)) return benchTree(argc - 1, argv + 1);
+    if ((argc >= 2) && (strcmp(argv[1], "net") == 0)) return benchNet(argc - 1, argv + 1);
+    if ((argc == 2) && (strcmp(argv[1], "clean") == 0)) return benchClean();
+    fputs(launchUsage, thread_stderr);
+    fprintf(thread_stderr, "       %s", textUsage + strlen("usage: "));
+    fprintf(thread_stderr, "       %s", treeUsage + strlen("usage: "));
+    fprintf(thread_stderr, "       %s", netUsage + strlen("usage: "));
+    fputs("       ios_bench clean\n", thread_stderr);
+    return 1;
+}
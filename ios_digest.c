@@ -0,0 +1,65 @@
+//
+//  ios_digest.c
+//  ios_system
+//
+//  Digest cache for md5 and cksum: the digest of a file is kept in an extended attribute
+//  of the file, with the size, modification time and inode it was computed for. The next command
+//  that needs it reads it back instead of the whole file, as long as these haven't changed.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include "ios_error.h"
+
+// the host opts in; commands can still ignore the cache (-N)
+bool cacheFileDigests = false;
+
+#define DIGEST_XATTR_PREFIX "ios_system.digest."
+#define DIGEST_XATTR_MAX 256
+
+static bool sameFile(const struct stat* a, const struct stat* b) {
+    return (a->st_dev == b->st_dev) && (a->st_ino == b->st_ino) && (a->st_size == b->st_size)
+        && (a->st_mtimespec.tv_sec == b->st_mtimespec.tv_sec) && (a->st_mtimespec.tv_nsec == b->st_mtimespec.tv_nsec);
+}
+
+// The digest of the regular file open as fd, for this algorithm ("md5", "sha256", "cksum"...), if it
+// is cached and still valid. Returns digest, or NULL. The file is described in before, for ios_setCachedDigest.
+char* ios_getCachedDigest(int fd, const char* algorithm, char* digest, size_t size, struct stat* before) {
+    char name[64], value[DIGEST_XATTR_MAX];
+    long long fileSize, seconds;
+    long nanoseconds;
+    unsigned long long inode;
+    int used = 0;
+    memset(before, 0, sizeof(*before));
+    if (!cacheFileDigests || (fstat(fd, before) != 0) || !S_ISREG(before->st_mode)) return NULL;
+    snprintf(name, sizeof(name), DIGEST_XATTR_PREFIX "%s", algorithm);
+    ssize_t length = fgetxattr(fd, name, value, sizeof(value) - 1, 0, 0);
+    if (length <= 0) return NULL;
+    value[length] = 0;
+    // "size seconds.nanoseconds inode digest"
+    if ((sscanf(value, "%lld %lld.%ld %llu %n", &fileSize, &seconds, &nanoseconds, &inode, &used) != 4) || (used == 0))
+        return NULL;
+    if ((fileSize != before->st_size) || (seconds != before->st_mtimespec.tv_sec)
+        || (nanoseconds != before->st_mtimespec.tv_nsec) || (inode != before->st_ino))
+        return NULL;
+    if ((value[used] == 0) || (strlen(value + used) >= size)) return NULL;
+    return strcpy(digest, value + used);
+}
+
+// Store the digest just computed from fd, unless the file changed since ios_getCachedDigest described it.
+// Files that can't be written to, or file systems without extended attributes, keep no digest.
+void ios_setCachedDigest(int fd, const char* algorithm, const char* digest, const struct stat* before) {
+    char name[64], value[DIGEST_XATTR_MAX];
+    struct stat now;
+    if (!cacheFileDigests || !S_ISREG(before->st_mode) || (fstat(fd, &now) != 0) || !sameFile(before, &now)) return;
+    snprintf(name, sizeof(name), DIGEST_XATTR_PREFIX "%s", algorithm);
+    int length = snprintf(value, sizeof(value), "%lld %lld.%09ld %llu %s", (long long)now.st_size,
+                          (long long)now.st_mtimespec.tv_sec, (long)now.st_mtimespec.tv_nsec,
+                          (unsigned long long)now.st_ino, digest);
+    if ((length <= 0) || (length >= (int)sizeof(value))) return;
+    (void)fsetxattr(fd, name, value, length, 0, 0);
+}
@@ -17,6 +17,7 @@ extern "C" {
 #include <stdarg.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdbool.h>
 
 /* #define errx compileError
 #define err compileError
@@ -28,6 +29,9 @@ extern "C" {
 
 #define putchar(a) fputc(a, thread_stdout)
 #define getchar() fgetc(thread_stdin)
+// For loops that lock the stream themselves (flockfile), one character at a time:
+#define putchar_unlocked(a) putc_unlocked(a, thread_stdout)
+#define getchar_unlocked() getc_unlocked(thread_stdin)
 // these functions are defined differently in C++. The #define approach breaks things.
 #ifndef __cplusplus
   #define getwchar() fgetwc(thread_stdin)
@@ -48,6 +52,21 @@ extern __thread FILE* thread_stdin;
 extern __thread FILE* thread_stdout;
 extern __thread FILE* thread_stderr;
 
+// Thread-local getopt state, so commands can parse their arguments concurrently.
+// Accessors in the style of errno: "extern int optind;" in BSD sources still compiles.
+extern __thread int thread_opterr, thread_optind, thread_optopt, thread_optreset;
+extern __thread char* thread_optarg;
+extern int* ios_opterr(void);
+extern int* ios_optind(void);
+extern int* ios_optopt(void);
+extern int* ios_optreset(void);
+extern char** ios_optarg(void);
+#define opterr (*ios_opterr())
+#define optind (*ios_optind())
+#define optopt (*ios_optopt())
+#define optreset (*ios_optreset())
+#define optarg (*ios_optarg())
+
 #define exit ios_exit
 #define abort() ios_exit(1)
 #define _exit ios_exit
@@ -66,8 +85,29 @@ extern __thread FILE* thread_stderr;
 #define unsetenv ios_unsetenv
 #define putenv ios_putenv
 #define fchdir ios_fchdir
+#define tmpfile ios_tmpfile
+
+// Commands that rely on exit() to release their memory define IOS_COMMAND_MEMORY before including this
+// file: their allocations are counted (ios_getProcessStats) and, if the host sets reclaimCommandMemory,
+// made in a malloc zone of their own, released when the command ends. Nothing they allocate may be
+// used after that: static caches must be reset when the command starts. free() and realloc() of the
+// system work on these pointers too; only the counts are not updated.
+#ifdef IOS_COMMAND_MEMORY
+#define malloc(size) ios_malloc(size)
+#define calloc(count, size) ios_calloc(count, size)
+#define realloc(ptr, size) ios_realloc(ptr, size)
+#define free(ptr) ios_free(ptr)
+#define strdup(s) ios_strdup(s)
+#endif
+extern void* ios_malloc(size_t size);
+extern void* ios_calloc(size_t count, size_t size);
+extern void* ios_realloc(void* ptr, size_t size);
+extern void ios_free(void* ptr);
+extern char* ios_strdup(const char* s);
 
 extern int ios_executable(const char* cmd); // is this command part of the "shell" commands?
+extern char* ios_which(const char* cmd); // file in $PATH or command that ios_system would run, malloc()ed, NULL if none
+extern void ios_hashReset(void); // forget the locations of commands in $PATH, as "hash -r"
 extern int ios_system(const char* inputCmd); // execute this command (executable file or builtin command)
 extern FILE *ios_popen(const char *command, const char *type); // Execute this command and pipe the result
 extern int ios_kill(void); // kill the current running command
@@ -76,6 +116,8 @@ extern int ios_killpid(pid_t pid, int sig); // kill the current running command
 extern void ios_exit(int errorCode) __dead2; // set error code and exits from the thread.
 extern int ios_execv(const char *path, char* const argv[]);
 extern int ios_execve(const char *path, char* const argv[], char** envlist);
+extern int ios_spawnv(const char* path, char* const argv[], char* const envp[], FILE* in, FILE* out, FILE* err);
+extern pid_t ios_spawnv_async(const char* path, char* const argv[], char* const envp[], FILE* in, FILE* out, FILE* err, void* info, void (*completion)(void* info, pid_t pid, int status));
 extern int ios_dup2(int fd1, int fd2);
 extern char * ios_getenv(const char *name);
 extern int ios_setenv(const char* variableName, const char* value, int overwrite);
@@ -95,8 +137,57 @@ extern const char* ios_progname(void);
 extern pid_t ios_fork(void);
 extern void ios_waitpid(pid_t pid);
 extern void ios_signal(int signal);
+// Resources used by a process (ios_getProcessStats). Kept after it terminates, until the pid is reused.
+#ifndef IOS_DURATION_BUCKETS
+#define IOS_DURATION_BUCKETS 32 // ios_getDurationHistogram: bucket i counts commands that took 2^i to 2^(i+1) microseconds
+typedef struct _ios_processStats {
+    double wallTime;                // seconds, from ios_fork to the end of the command
+    double cpuTime;                 // seconds (user + system) of the main thread of the command
+    double userTime;                // the same, split between user
+    double systemTime;              // and system time
+    unsigned long long bytesOut;    // written to stdout
+    unsigned long long bytesErr;    // written to stderr
+    // memory allocated by the parts of the command compiled with IOS_COMMAND_MEMORY:
+    unsigned long long memoryInUse;     // bytes, now (or when it ended)
+    unsigned long long peakMemory;      // bytes, at most at the same time
+    unsigned long long reclaimedMemory; // bytes it had not released, freed when it ended (reclaimCommandMemory)
+    bool running;
+} ios_processStats;
+typedef struct _ios_pipelineStage {
+    char command[32];
+    unsigned long long bytesIn;     // read from the previous stage (in-process pipes only)
+    unsigned long long bytesOut;    // written to stdout
+    double blockedOnRead;           // seconds waiting for the previous stage (in-process pipes only)
+    double blockedOnWrite;          // seconds waiting for the next stage to read (in-process pipes only)
+    double wallTime;                // seconds
+    double userTime;                // CPU seconds of the stage's thread, once it has terminated
+    double systemTime;
+    bool running;
+} ios_pipelineStage;
+#endif
+extern ios_processStats ios_getProcessStats(pid_t pid);
+extern int ios_getDurationHistogram(unsigned long* buckets, int numBuckets);
+// stages of the last pipeline started by pid, first command first; returns the number of stages:
+extern int ios_pipelineReport(pid_t pid, ios_pipelineStage* stages, int maxStages);
+// sampling profiler (ios_profile.c), folded stacks for flamegraph.pl:
+extern int ios_profile(const pid_t* pids, int numPids, int frequency, double duration, FILE* output);
+extern void ios_interrupt(pid_t pid); // ask a command to stop (at its next output, or when it checks ios_isInterrupted)
+extern void ios_interruptThread(pthread_t thread);
+extern bool ios_isInterrupted(void); // for long loops in commands: has the current command been interrupted?
+extern void (*ios_copyProgress)(const char* source, const char* destination, off_t copied, off_t total); // set by the host app
 
 extern int ios_fchdir(const int fd);
+// Scratch files, in memory up to scratchMemoryBudget (ios_system.h), then on disk in $TMPDIR:
+extern FILE* ios_tmpfile(void);
+extern FILE* ios_scratch_fopen(const char* path, const char* mode); // kept under this name until ios_scratch_unlink
+extern int ios_scratch_unlink(const char* path); // removes it, from memory or from disk
+// Memory budget (ios_memory.c): bytes a command may use for its buffers, smaller when memory is short:
+extern size_t ios_memoryBudget(void);
+extern int ios_memoryPressure(void); // 0: normal, 1: warning, 2: critical. Cheap enough for every record.
+// Digest cache (ios_digest.c), in an extended attribute of the file, if the host sets cacheFileDigests:
+struct stat;
+extern char* ios_getCachedDigest(int fd, const char* algorithm, char* digest, size_t size, struct stat* before); // NULL if none valid
+extern void ios_setCachedDigest(int fd, const char* algorithm, const char* digest, const struct stat* before);
 extern ssize_t ios_write(int fildes, const void *buf, size_t nbyte);
 extern size_t ios_fwrite(const void *ptr, size_t size, size_t nitems, FILE *stream);
 extern int ios_puts(const char *s);
@@ -0,0 +1,814 @@
+//
+//  ios_fusion.c
+//  ios_system
+//
+//  Pipeline fusion: the usual chains of text commands ("grep x file | wc -l", "sort | uniq -c | sort -rn",
+//  "cat file | grep x") run as one command, ios_fuse, that splits its input in lines once and passes them
+//  from one stage to the next in memory, instead of a thread per command, each of them reading from a pipe
+//  and splitting the lines again. ios_system only hands it the pipelines where the output is the same as
+//  with the commands: the options below, regular files, the C locale. Everything else runs as usual.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <locale.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#if defined(__APPLE__)
+#include <xlocale.h>
+#endif
+
+#include "ios_error.h"
+
+// set to false to run every command of a pipeline in its own thread
+bool pipelineFusion = true;
+static unsigned long fusedPipelines = 0;     // run by ios_fuse
+static unsigned long unfusedPipelines = 0;   // of the same commands, with options or operands it doesn't handle
+static __thread bool fusionDisabled = false; // ios_fuse -c, running the pipeline as separate commands
+
+#define FUSION_MAX_STAGES 8
+#define FUSION_MAX_WORDS 64
+#define FUSION_BLOCK (1 << 20)             // bytes read at a time
+#define FUSION_OUTPUT (64 << 10)           // bytes written at a time
+#define FUSION_CHUNK (1 << 20)             // allocation for the lines kept in memory
+#define FUSION_GREP_PROBE (256 << 10)      // grep looks for NUL bytes in its first read (GREPBUFSIZ)
+#define FUSION_GREP_PROBE_MAX (4 << 20)    // GREPBUFMAX
+#define FUSION_MAX_NUM_SIZE 128            // digits sort -n reads in a number
+#define FUSION_STANDARD_INPUT "(standard input)"
+
+// Characters that need the shell (redirections, expansions, lists) outside of quotes:
+#define FUSION_SPECIAL "'\"\\$`<>&;()*?[]{}~#"
+
+typedef enum { fuseCat, fuseGrep, fuseSort, fuseUniq, fuseCount } fusionKind;
+
+typedef struct _fusionStage {
+    fusionKind kind;
+    const char* name;
+    // grep:
+    const char* pattern;
+    char syntax;            // 'G', 'E' or 'F'
+    bool ignoreCase;
+    bool invert;
+    bool compiled;
+    regex_t regex;
+    // sort:
+    bool reverse, numeric, unique;
+    // uniq -c, wc -l:
+    bool count;
+} fusionStage;
+
+typedef struct _fusionPipeline {
+    char* text;             // copy of the command line, the words point into it
+    char* words[FUSION_MAX_WORDS];
+    int numStages;
+    fusionStage stages[FUSION_MAX_STAGES];
+    char** files;           // operands of the first command, none: standard input
+    int numFiles;
+} fusionPipeline;
+
+// A line, without its newline. The lines point into the chunks of a fusionLines, or into the input. There is
+// always a NUL byte after them, as regexec() implementations that ignore REG_STARTEND expect.
+typedef struct _fusionLine {
+    const char* data;
+    size_t length;
+} fusionLine;
+
+typedef struct _fusionLines {
+    fusionLine* lines;
+    size_t count, capacity;
+    bool unterminated;      // the last line has no newline
+    char** chunks;
+    int numChunks, maxChunks;
+    char* room;             // free space at the end of the last chunk
+    size_t roomLength;
+} fusionLines;
+
+typedef enum { sinkPrint, sinkCount, sinkCollect } fusionSink;
+
+typedef struct _fusionRun {
+    fusionPipeline* p;
+    fusionStage* filter;    // grep applied to the lines as they are read, or NULL
+    int next;               // first stage applied to all the lines together
+    fusionSink sink;
+    // the input being read:
+    const char* name;       // for "Binary file %s matches" and "file:line"
+    bool prefix;            // grep with several files
+    bool binary;
+    bool matchedInput;
+    bool matched;           // by grep, in any input: its exit status
+    unsigned long long numLines;   // sinkCount
+    fusionLines lines;      // sinkCollect
+    char* buffer;
+    size_t bufferSize;
+    char* output;
+    size_t outputLength;
+    bool failed;
+} fusionRun;
+
+// Each category the commands use is C or POSIX, or a locale that setlocale() doesn't know and leaves in C.
+static bool byteCategory(const char* category) {
+    const char* value = getenv("LC_ALL");
+    if ((value == NULL) || (value[0] == 0)) value = getenv(category);
+    if ((value == NULL) || (value[0] == 0)) value = getenv("LANG");
+    if ((value == NULL) || (value[0] == 0) || (strcmp(value, "C") == 0) || (strcmp(value, "POSIX") == 0)) return true;
+    locale_t locale = newlocale(LC_ALL_MASK, value, NULL);
+    if (locale == NULL) return true;
+    freelocale(locale);
+    return false;
+}
+
+static bool byteLocale(void) {
+    return byteCategory("LC_COLLATE") && byteCategory("LC_CTYPE") && byteCategory("LC_NUMERIC");
+}
+
+// Splits the command line in words, in place, and the words in stages at each "|". Only plain words and
+// words entirely in quotes, which ios_system passes as they are. Returns false for anything else.
+static bool splitPipeline(fusionPipeline* p, int* start, int* length) {
+    char* s = p->text;
+    int numWords = 0;
+    p->numStages = 0;
+    start[0] = 0;
+    for (;;) {
+        while ((*s == ' ') || (*s == '\t')) s++;
+        if ((*s != '|') && (*s != 0)) {
+            if (numWords == FUSION_MAX_WORDS) return false;
+            if ((*s == '\'') || (*s == '"')) {
+                char quote = *s++;
+                char* end = strchr(s, quote);
+                if (end == NULL) return false;
+                // ios_system looks for escaped quotes in both, and expands variables in double quotes:
+                for (char* c = s; c < end; c++)
+                    if ((*c == '\\') || ((quote == '"') && ((*c == '$') || (*c == '`')))) return false;
+                p->words[numWords++] = s;
+                *end = 0;
+                s = end + 1;
+                if ((*s != ' ') && (*s != '\t') && (*s != '|') && (*s != 0)) return false;
+            } else {
+                p->words[numWords++] = s;
+                while ((*s != ' ') && (*s != '\t') && (*s != '|') && (*s != 0)) {
+                    if (strchr(FUSION_SPECIAL, *s) != NULL) return false;
+                    s++;
+                }
+            }
+            if ((*s == ' ') || (*s == '\t')) {
+                *s++ = 0;
+                continue;
+            }
+        }
+        // end of the words of this stage, at "|" or at the end of the line:
+        bool last = (*s == 0);
+        if (!last) *s++ = 0;
+        length[p->numStages] = numWords - start[p->numStages];
+        if (length[p->numStages] == 0) return false; // "a | | b", "| a", "a |"
+        p->numStages++;
+        if (last) return true;
+        if (p->numStages == FUSION_MAX_STAGES) return false;
+        start[p->numStages] = numWords;
+    }
+}
+
+static bool setOption(fusionStage* stage, char option) {
+    switch (stage->kind) {
+        case fuseGrep:
+            if (option == 'v') stage->invert = true;
+            else if (option == 'i') stage->ignoreCase = true;
+            else if ((option == 'G') || (option == 'E') || (option == 'F')) stage->syntax = option;
+            else return false;
+            return true;
+        case fuseSort:
+            if (option == 'r') stage->reverse = true;
+            else if (option == 'n') stage->numeric = true;
+            else if (option == 'u') stage->unique = true;
+            else return false;
+            return true;
+        case fuseUniq:
+        case fuseCount:
+            if (option != ((stage->kind == fuseUniq) ? 'c' : 'l')) return false;
+            stage->count = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The options of one command, as its getopt reads them. Returns the index of its first operand, -1 if
+// ios_fuse doesn't handle one of them. Operands that getopt_long would take as options are refused too.
+static int parseStage(fusionStage* stage, char** argv, int argc) {
+    int i;
+    bool endOfOptions = false;
+    stage->syntax = 'G';
+    for (i = 1; (i < argc) && (argv[i][0] == '-') && (argv[i][1] != 0); i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            endOfOptions = true;
+            i++;
+            break;
+        }
+        bool nextWord = false;
+        for (const char* c = argv[i] + 1; (*c != 0) && !nextWord; c++) {
+            if ((stage->kind == fuseGrep) && (*c == 'e')) {
+                if (stage->pattern != NULL) return -1; // several patterns
+                if (c[1] != 0) stage->pattern = c + 1;
+                else if (i + 1 < argc) stage->pattern = argv[++i];
+                else return -1;
+                nextWord = true;
+            } else if (!setOption(stage, *c)) return -1;
+        }
+    }
+    if ((stage->kind == fuseGrep) && (stage->pattern == NULL)) {
+        if (i == argc) return -1;
+        stage->pattern = argv[i++];
+    }
+    for (int j = i; j < argc; j++)
+        if ((argv[j][0] == '+') || (!endOfOptions && (argv[j][0] == '-'))) return -1;
+    return i;
+}
+
+static bool compileStage(fusionStage* stage) {
+    int cflags = REG_NOSUB;
+    if (stage->syntax == 'E') cflags |= REG_EXTENDED | REG_ENHANCED;
+    else if (stage->syntax == 'F') cflags |= REG_LITERAL;
+    else cflags |= REG_ENHANCED;
+    if (stage->ignoreCase) cflags |= REG_ICASE;
+    stage->compiled = (regcomp(&stage->regex, stage->pattern, cflags) == 0);
+    return stage->compiled;
+}
+
+static void releasePipeline(fusionPipeline* p) {
+    for (int i = 0; i < p->numStages; i++)
+        if (p->stages[i].compiled) regfree(&p->stages[i].regex);
+    free(p->text);
+    p->text = NULL;
+}
+
+// 1: ios_fuse runs this pipeline, 0: its commands are the ones ios_fuse knows, not their options or operands,
+// -1: other commands, or a line that needs the shell. fusibleCommand (NULL: all) tells if a name is the command
+// of this library, not an alias or a file in $PATH.
+static int parsePipeline(fusionPipeline* p, const char* command, bool (*fusibleCommand)(const char* name)) {
+    int start[FUSION_MAX_STAGES], length[FUSION_MAX_STAGES];
+    memset(p, 0, sizeof(fusionPipeline));
+    if (strpbrk(command, "\n\r\x1e") != NULL) return -1;
+    if ((p->text = strdup(command)) == NULL) return -1;
+    if (!splitPipeline(p, start, length) || (p->numStages < 2)) return -1;
+    for (int s = 0; s < p->numStages; s++) {
+        const char* name = p->words[start[s]];
+        fusionStage* stage = &p->stages[s];
+        stage->name = name;
+        if (strcmp(name, "cat") == 0) stage->kind = fuseCat;
+        else if (strcmp(name, "grep") == 0) stage->kind = fuseGrep;
+        else if (strcmp(name, "sort") == 0) stage->kind = fuseSort;
+        else if (strcmp(name, "uniq") == 0) stage->kind = fuseUniq;
+        else if (strcmp(name, "wc") == 0) stage->kind = fuseCount;
+        else return -1;
+        if ((fusibleCommand != NULL) && !fusibleCommand(name)) return -1;
+    }
+    bool waitsForInput = false; // the output comes once the input is read, whatever ios_fuse does
+    for (int s = 0; s < p->numStages; s++) {
+        fusionStage* stage = &p->stages[s];
+        char** argv = p->words + start[s];
+        int first = parseStage(stage, argv, length[s]);
+        if (first < 0) return 0;
+        int numOperands = length[s] - first;
+        if ((s > 0) && (numOperands > 0)) return 0;
+        if (s == 0) {
+            p->files = argv + first;
+            p->numFiles = numOperands;
+        }
+        switch (stage->kind) {
+            case fuseCat:
+                if (s > 0) return 0;
+                break;
+            case fuseGrep: {
+                const char* options = getenv("GREP_OPTIONS");
+                if ((stage->pattern[0] == 0) || ((options != NULL) && (options[0] != 0))) return 0;
+                if (!compileStage(stage)) return 0;
+                break;
+            }
+            case fuseSort:
+                if (stage->numeric && (stage->unique || (getenv("GNUSORT_NUMERIC_COMPATIBILITY") != NULL))) return 0;
+                waitsForInput = true;
+                break;
+            case fuseUniq:
+                if (numOperands > 1) return 0; // uniq input output
+                break;
+            case fuseCount:
+                if ((s == 0) || (s != p->numStages - 1) || !stage->count || (length[s] != 2)) return 0;
+                waitsForInput = true;
+                break;
+        }
+    }
+    if (!byteLocale()) return 0;
+    // Reading standard input until the end is only right when the commands would:
+    if ((p->numFiles == 0) && !waitsForInput) return 0;
+    for (int i = 0; i < p->numFiles; i++) {
+        struct stat st;
+        if ((stat(p->files[i], &st) != 0) || !S_ISREG(st.st_mode) || (access(p->files[i], R_OK) != 0)) return 0;
+    }
+    return 1;
+}
+
+// Called by ios_system for a command line with a "|": can ios_fuse run it?
+bool ios_canFusePipeline(const char* command, bool (*fusibleCommand)(const char* name)) {
+    if (!pipelineFusion || fusionDisabled || (command == NULL) || (strchr(command, '|') == NULL)) return false;
+    fusionPipeline p;
+    int result = parsePipeline(&p, command, fusibleCommand);
+    releasePipeline(&p);
+    if (result > 0) __sync_fetch_and_add(&fusedPipelines, 1);
+    else if (result == 0) __sync_fetch_and_add(&unfusedPipelines, 1);
+    return (result > 0);
+}
+
+void ios_pipelineFusionStats(unsigned long* fused, unsigned long* notFused) {
+    if (fused != NULL) *fused = __sync_fetch_and_add(&fusedPipelines, 0);
+    if (notFused != NULL) *notFused = __sync_fetch_and_add(&unfusedPipelines, 0);
+}
+
+static void releaseLines(fusionLines* l) {
+    for (int i = 0; i < l->numChunks; i++) free(l->chunks[i]);
+    free(l->chunks);
+    free(l->lines);
+    memset(l, 0, sizeof(fusionLines));
+}
+
+// Room for length bytes that stay in memory until the end of the command.
+static char* reserveText(fusionLines* l, size_t length) {
+    if (length > l->roomLength) {
+        if (l->numChunks == l->maxChunks) {
+            int maxChunks = (l->maxChunks > 0) ? 2 * l->maxChunks : 16;
+            char** chunks = realloc(l->chunks, maxChunks * sizeof(char*));
+            if (chunks == NULL) return NULL;
+            l->chunks = chunks;
+            l->maxChunks = maxChunks;
+        }
+        size_t size = MAX(length, FUSION_CHUNK);
+        if ((l->room = malloc(size)) == NULL) return NULL;
+        l->chunks[l->numChunks++] = l->room;
+        l->roomLength = size;
+    }
+    char* text = l->room;
+    l->room += length;
+    l->roomLength -= length;
+    return text;
+}
+
+static bool addLine(fusionLines* l, const char* data, size_t length) {
+    if (l->count == l->capacity) {
+        size_t capacity = (l->capacity > 0) ? 2 * l->capacity : 4096;
+        fusionLine* lines = realloc(l->lines, capacity * sizeof(fusionLine));
+        if (lines == NULL) return false;
+        l->lines = lines;
+        l->capacity = capacity;
+    }
+    l->lines[l->count].data = data;
+    l->lines[l->count].length = length;
+    l->count++;
+    return true;
+}
+
+// Adds the lines of text, which stays in memory.
+static bool splitText(fusionLines* l, const char* text, size_t length) {
+    const char* end = text + length;
+    const char* newline;
+    while ((newline = memchr(text, '\n', end - text)) != NULL) {
+        if (!addLine(l, text, newline - text)) return false;
+        text = newline + 1;
+    }
+    l->unterminated = (text < end);
+    return !l->unterminated || addLine(l, text, end - text);
+}
+
+static void emit(fusionRun* run, const char* data, size_t length) {
+    if (run->outputLength + length > FUSION_OUTPUT) {
+        if (run->outputLength > 0) fwrite(run->output, 1, run->outputLength, thread_stdout);
+        run->outputLength = 0;
+        if (length > FUSION_OUTPUT) {
+            fwrite(data, 1, length, thread_stdout);
+            return;
+        }
+    }
+    memcpy(run->output + run->outputLength, data, length);
+    run->outputLength += length;
+}
+
+static bool grepMatches(fusionStage* stage, const char* data, size_t length) {
+    regmatch_t match;
+    match.rm_so = 0;
+    match.rm_eo = length;
+    return (regexec(&stage->regex, data, 1, &match, REG_STARTEND) == 0) != stage->invert;
+}
+
+static int compareNumbers(const fusionLine* a, const fusionLine* b);
+
+// sort compares the lines with the flags of the stage being run:
+static __thread fusionStage* sortStage;
+
+// The bytes, then the length: sort in the C locale, and the last resort after the keys.
+static int compareBytes(const fusionLine* a, const fusionLine* b) {
+    int result = memcmp(a->data, b->data, MIN(a->length, b->length));
+    if (result != 0) return result;
+    return (a->length < b->length) ? -1 : (a->length > b->length);
+}
+
+static int compareLines(const void* x, const void* y) {
+    const fusionLine* a = x;
+    const fusionLine* b = y;
+    int result = sortStage->numeric ? compareNumbers(a, b) : 0;
+    if (result == 0) result = compareBytes(a, b);
+    return sortStage->reverse ? -result : result;
+}
+
+// As read_number in sort: blanks, "-", the digits without their leading zeros, the fraction without its trailing zeros.
+typedef struct _fusionNumber {
+    bool negative;
+    const char* integer;
+    size_t integerLength;
+    const char* fraction;
+    size_t fractionLength;
+} fusionNumber;
+
+static void readNumber(const fusionLine* line, fusionNumber* n) {
+    const char* s = line->data;
+    const char* end = s + line->length;
+    while ((s < end) && ((*s == ' ') || (*s == '\t'))) s++;
+    n->negative = (s < end) && (*s == '-');
+    if (n->negative) s++;
+    while ((s < end) && (*s == '0')) s++;
+    n->integer = s;
+    while ((s < end) && (*s >= '0') && (*s <= '9') && (s - n->integer < FUSION_MAX_NUM_SIZE)) s++;
+    n->integerLength = s - n->integer;
+    n->fraction = s;
+    n->fractionLength = 0;
+    if ((s < end) && (*s == '.')) {
+        n->fraction = ++s;
+        while ((s < end) && (*s >= '0') && (*s <= '9') && (s - n->fraction < FUSION_MAX_NUM_SIZE)) s++;
+        n->fractionLength = s - n->fraction;
+        while ((n->fractionLength > 0) && (n->fraction[n->fractionLength - 1] == '0')) n->fractionLength--;
+    }
+    if (n->integerLength + n->fractionLength == 0) n->negative = false;
+}
+
+static int compareNumbers(const fusionLine* a, const fusionLine* b) {
+    fusionNumber n1, n2;
+    readNumber(a, &n1);
+    readNumber(b, &n2);
+    bool empty1 = (n1.integerLength + n1.fractionLength == 0);
+    bool empty2 = (n2.integerLength + n2.fractionLength == 0);
+    if (empty1 && empty2) return 0;
+    if (n1.negative != n2.negative) return n1.negative ? -1 : 1;
+    if (empty1) return n2.negative ? 1 : -1;
+    if (empty2) return n1.negative ? -1 : 1;
+    int result;
+    if (n1.integerLength != n2.integerLength) result = (n1.integerLength < n2.integerLength) ? -1 : 1;
+    else result = memcmp(n1.integer, n2.integer, n1.integerLength);
+    if (result == 0) {
+        result = memcmp(n1.fraction, n2.fraction, MIN(n1.fractionLength, n2.fractionLength));
+        if (result == 0) result = (n1.fractionLength < n2.fractionLength) ? -1 : (n1.fractionLength > n2.fractionLength);
+    }
+    return n1.negative ? -result : result;
+}
+
+static void sortLines(fusionRun* run, fusionStage* stage) {
+    fusionLines* l = &run->lines;
+    sortStage = stage;
+    qsort(l->lines, l->count, sizeof(fusionLine), compareLines);
+    if (stage->unique && (l->count > 0)) {
+        size_t kept = 1;
+        for (size_t i = 1; i < l->count; i++)
+            if (compareLines(&l->lines[kept - 1], &l->lines[i]) != 0) l->lines[kept++] = l->lines[i];
+        l->count = kept;
+    }
+    l->unterminated = false;
+}
+
+// uniq compares the lines as strings: up to a NUL byte, if there is one.
+static size_t stringLength(const fusionLine* line) {
+    const char* nul = memchr(line->data, 0, line->length);
+    return (nul != NULL) ? (size_t)(nul - line->data) : line->length;
+}
+
+// uniq prints its lines with "%s" (and -c "%4d %s"): the output is made again as text, then split in lines.
+static void uniqLines(fusionRun* run, fusionStage* stage) {
+    fusionLines* l = &run->lines;
+    size_t size = 0;
+    for (size_t i = 0; i < l->count; i++) size += l->lines[i].length + 1 + (stage->count ? 16 : 0);
+    char* text = reserveText(l, size + 1);
+    if (text == NULL) {
+        run->failed = true;
+        return;
+    }
+    char* out = text;
+    for (size_t i = 0; i < l->count; ) {
+        fusionLine* line = &l->lines[i];
+        size_t length = stringLength(line);
+        size_t j = i + 1;
+        while ((j < l->count) && (((l->lines[j].length == line->length) && (memcmp(l->lines[j].data, line->data, line->length) == 0))
+                                  || ((stringLength(&l->lines[j]) == length) && (memcmp(l->lines[j].data, line->data, length) == 0))))
+            j++;
+        if (stage->count) out += sprintf(out, "%4d ", (int)(j - i));
+        memcpy(out, line->data, length);
+        out += length;
+        if ((length == line->length) && !((i == l->count - 1) && l->unterminated)) *out++ = '\n';
+        i = j;
+    }
+    *out = 0;
+    l->count = 0;
+    if (!splitText(l, text, out - text)) run->failed = true;
+}
+
+// grep reading from a pipe: binary if there is a NUL byte in the start of its input.
+static void grepLines(fusionRun* run, fusionStage* stage) {
+    fusionLines* l = &run->lines;
+    bool binary = false;
+    size_t probed = 0;
+    for (size_t i = 0; (i < l->count) && (probed < FUSION_GREP_PROBE) && !binary; i++) {
+        binary = (memchr(l->lines[i].data, 0, MIN(l->lines[i].length, FUSION_GREP_PROBE - probed)) != NULL);
+        probed += l->lines[i].length + 1;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < l->count; i++)
+        if (grepMatches(stage, l->lines[i].data, l->lines[i].length)) l->lines[kept++] = l->lines[i];
+    run->matched = (kept > 0);
+    l->count = kept;
+    l->unterminated = false;
+    if (binary && (kept > 0)) {
+        static const char message[] = "Binary file " FUSION_STANDARD_INPUT " matches";
+        l->count = 0;
+        addLine(l, message, sizeof(message) - 1);
+    }
+}
+
+// A line of the input, through the grep of the first stage if there is one, to the sink.
+static void feedLine(fusionRun* run, const char* data, size_t length, bool terminated) {
+    if (run->filter != NULL) {
+        if (!grepMatches(run->filter, data, length)) return;
+        run->matched = run->matchedInput = true;
+        if (run->binary) return; // "Binary file %s matches" once the input is read
+        terminated = true;
+    }
+    size_t nameLength = run->prefix ? strlen(run->name) + 1 : 0;
+    switch (run->sink) {
+        case sinkPrint:
+            if (nameLength > 0) {
+                emit(run, run->name, nameLength - 1);
+                emit(run, ":", 1);
+            }
+            emit(run, data, length);
+            if (terminated) emit(run, "\n", 1);
+            break;
+        case sinkCount:
+            if (terminated) run->numLines++;
+            break;
+        case sinkCollect: {
+            char* copy = reserveText(&run->lines, nameLength + length + 1);
+            if ((copy == NULL) || !addLine(&run->lines, copy, nameLength + length)) {
+                run->failed = true;
+                return;
+            }
+            if (nameLength > 0) {
+                memcpy(copy, run->name, nameLength - 1);
+                copy[nameLength - 1] = ':';
+            }
+            memcpy(copy + nameLength, data, length);
+            copy[nameLength + length] = 0;
+            run->lines.unterminated = !terminated;
+            break;
+        }
+    }
+}
+
+static void endOfInput(fusionRun* run) {
+    if ((run->filter == NULL) || !run->binary || !run->matchedInput) return;
+    char message[PATH_MAX + 32];
+    int length = snprintf(message, sizeof(message), "Binary file %s matches\n", run->name);
+    if ((length <= 0) || (length >= (int)sizeof(message))) return;
+    bool prefix = run->prefix;
+    fusionStage* filter = run->filter;
+    run->prefix = false;
+    run->filter = NULL;
+    feedLine(run, message, length - 1, true);
+    run->prefix = prefix;
+    run->filter = filter;
+}
+
+// Reads the files one after the other (a single file, or the files of cat), or standard input if numFiles is 0,
+// and feeds their lines. The grep of the first stage decides if they are binary on the first bytes it would read.
+static int readInput(fusionRun* run, char** files, int numFiles, const char* name) {
+    FILE* in = (numFiles == 0) ? thread_stdin : NULL;
+    int fd = -1, file = 0;
+    size_t probe = FUSION_GREP_PROBE;
+    size_t length = 0;
+    bool first = true, end = false;
+    run->name = name;
+    run->binary = run->matchedInput = false;
+    while (!end && !run->failed) {
+        // fill the buffer, so the lines are split a block at a time:
+        while ((length < run->bufferSize) && !end) {
+            ssize_t count;
+            if (in != NULL) {
+                count = fread(run->buffer + length, 1, run->bufferSize - length, in);
+                if ((count == 0) && ferror(in)) count = -1;
+            } else {
+                if (fd < 0) {
+                    if ((fd = open(files[file], O_RDONLY)) < 0) {
+                        fprintf(thread_stderr, "%s: %s: %s\n", run->p->stages[0].name, files[file], strerror(errno));
+                        return -1;
+                    }
+                    struct stat st;
+                    if (first && (fstat(fd, &st) == 0) && (st.st_blksize > FUSION_GREP_PROBE))
+                        probe = MIN((size_t)st.st_blksize, FUSION_GREP_PROBE_MAX);
+                }
+                count = read(fd, run->buffer + length, run->bufferSize - length);
+                if (count == 0) {
+                    close(fd);
+                    fd = -1;
+                    if (++file < numFiles) continue;
+                }
+            }
+            if (count < 0) {
+                fprintf(thread_stderr, "%s: %s: %s\n", run->p->stages[0].name, (in != NULL) ? "stdin" : files[file], strerror(errno));
+                if (fd >= 0) close(fd);
+                return -1;
+            }
+            if (count == 0) end = true;
+            length += count;
+        }
+        run->buffer[length] = 0;
+        if (first && (run->filter != NULL)) run->binary = (memchr(run->buffer, 0, MIN(length, probe)) != NULL);
+        first = false;
+        char* start = run->buffer;
+        char* last = run->buffer + length;
+        char* newline;
+        while (((newline = memchr(start, '\n', last - start)) != NULL) && !run->failed) {
+            feedLine(run, start, newline - start, true);
+            start = newline + 1;
+        }
+        if (end) {
+            if (start < last) feedLine(run, start, last - start, false);
+            break;
+        }
+        // keep the start of the next line, in a larger buffer if it fills this one:
+        length = last - start;
+        if (length == run->bufferSize) {
+            char* larger = realloc(run->buffer, 2 * run->bufferSize + 1);
+            if (larger == NULL) {
+                run->failed = true;
+                break;
+            }
+            run->buffer = larger;
+            run->bufferSize *= 2;
+        } else memmove(run->buffer, start, length);
+        if (ios_isInterrupted()) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    if (fd >= 0) close(fd);
+    endOfInput(run);
+    return 0;
+}
+
+static int runPipeline(fusionPipeline* p) {
+    fusionRun run;
+    memset(&run, 0, sizeof(run));
+    run.p = p;
+    fusionStage* source = &p->stages[0];
+    if (source->kind == fuseCat) {
+        run.next = 1;
+        if (p->stages[1].kind == fuseGrep) run.filter = &p->stages[run.next++];
+    } else if (source->kind == fuseGrep) {
+        run.filter = source;
+        run.next = 1;
+        run.prefix = (p->numFiles > 1);
+    }
+    if (run.next == p->numStages) run.sink = sinkPrint;
+    else if (p->stages[run.next].kind == fuseCount) run.sink = sinkCount;
+    else run.sink = sinkCollect;
+    run.bufferSize = FUSION_BLOCK;
+    run.buffer = malloc(run.bufferSize + 1);
+    run.output = malloc(FUSION_OUTPUT);
+    int status = 0;
+    if ((run.buffer == NULL) || (run.output == NULL)) {
+        run.failed = true;
+    } else if ((source->kind == fuseCat) || (p->numFiles == 0)) {
+        // cat: the files are one stream; a line can start in one file and end in the next.
+        if (readInput(&run, p->files, p->numFiles, FUSION_STANDARD_INPUT) < 0) status = 2;
+    } else {
+        for (int i = 0; (i < p->numFiles) && (status == 0) && !run.failed; i++)
+            if (readInput(&run, p->files + i, 1, p->files[i]) < 0) status = 2;
+    }
+    for (int s = run.next; (s < p->numStages) && (status == 0) && !run.failed && !ios_isInterrupted(); s++) {
+        fusionStage* stage = &p->stages[s];
+        switch (stage->kind) {
+            case fuseGrep:
+                grepLines(&run, stage);
+                break;
+            case fuseSort:
+                sortLines(&run, stage);
+                break;
+            case fuseUniq:
+                uniqLines(&run, stage);
+                break;
+            case fuseCount: {
+                char count[32];
+                if (run.sink == sinkCollect) run.numLines = run.lines.count - (run.lines.unterminated ? 1 : 0);
+                int length = snprintf(count, sizeof(count), " %7llu\n", run.numLines);
+                emit(&run, count, length);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (run.failed) {
+        fprintf(thread_stderr, "ios_fuse: %s\n", strerror(ENOMEM));
+        status = 2;
+    } else if ((status == 0) && (p->stages[p->numStages - 1].kind != fuseCount)) {
+        for (size_t i = 0; i < run.lines.count; i++) {
+            emit(&run, run.lines.lines[i].data, run.lines.lines[i].length);
+            if ((i < run.lines.count - 1) || !run.lines.unterminated) emit(&run, "\n", 1);
+        }
+    }
+    if ((status == 0) && (p->stages[p->numStages - 1].kind == fuseGrep) && !run.matched) status = 1;
+    if (run.outputLength > 0) fwrite(run.output, 1, run.outputLength, thread_stdout);
+    releaseLines(&run.lines);
+    free(run.buffer);
+    free(run.output);
+    return status;
+}
+
+// ios_fuse -c: the output of the fused pipeline, then of the same pipeline as separate commands, compared.
+static int checkPipeline(fusionPipeline* p, const char* command) {
+    if (p->numFiles == 0) {
+        fputs("ios_fuse: -c: the pipeline must read files, not standard input\n", thread_stderr);
+        return 2;
+    }
+    FILE* output = thread_stdout;
+    FILE* errors = thread_stderr;
+    FILE* fused = tmpfile();
+    if (fused == NULL) {
+        fprintf(thread_stderr, "ios_fuse: %s\n", strerror(errno));
+        return 2;
+    }
+    thread_stdout = fused;
+    int status = runPipeline(p);
+    thread_stdout = output;
+    fflush(fused);
+    rewind(fused);
+    // ios_system sets the streams of this thread for the pipes it opens:
+    fusionDisabled = true;
+    FILE* separate = popen(command, "r");
+    fusionDisabled = false;
+    thread_stdout = output;
+    thread_stderr = errors;
+    if (separate == NULL) {
+        fprintf(thread_stderr, "ios_fuse: %s: %s\n", command, strerror(errno));
+        fclose(fused);
+        return 2;
+    }
+    char a[4096], b[4096];
+    unsigned long long offset = 0;
+    bool same = true;
+    for (;;) {
+        size_t lengthA = fread(a, 1, sizeof(a), fused);
+        size_t lengthB = fread(b, 1, sizeof(b), separate);
+        size_t i = 0;
+        while ((i < MIN(lengthA, lengthB)) && (a[i] == b[i])) i++;
+        offset += i;
+        if ((i < lengthA) || (i < lengthB)) {
+            same = false;
+            break;
+        }
+        if (lengthA == 0) break;
+    }
+    // read the rest, so the commands can end:
+    while (fread(b, 1, sizeof(b), separate) > 0) ;
+    fclose(separate);
+    fclose(fused);
+    if (same) fprintf(thread_stdout, "ios_fuse: same output, %llu bytes (exit status %d)\n", offset, status);
+    else fprintf(thread_stdout, "ios_fuse: the outputs differ at byte %llu\n", offset);
+    return same ? 0 : 1;
+}
+
+// ios_fuse 'grep x file | wc -l': what ios_system starts for a pipeline that ios_canFusePipeline accepted.
+// ios_fuse -c 'grep x file | wc -l' checks that the fused pipeline writes the same as the commands.
+int ios_fuse_main(int argc, char** argv) {
+    bool check = (argc == 3) && (strcmp(argv[1], "-c") == 0);
+    if ((argc != 2) && !check) {
+        fputs("usage: ios_fuse [-c] 'command | command ...'\n", thread_stderr);
+        return 2;
+    }
+    const char* command = argv[argc - 1];
+    fusionPipeline p;
+    int status;
+    if (parsePipeline(&p, command, NULL) > 0) {
+        status = check ? checkPipeline(&p, command) : runPipeline(&p);
+    } else {
+        fprintf(thread_stderr, "ios_fuse: %s: cannot run this pipeline\n", command);
+        status = 2;
+    }
+    releasePipeline(&p);
+    return status;
+}
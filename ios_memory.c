@@ -0,0 +1,71 @@
+//
+//  ios_memory.c
+//  ios_system
+//
+//  Memory budget for the commands. On iOS, an app that goes over its memory limit is killed (jetsam),
+//  with all its sessions. Commands that can trade memory for disk or for speed (sort, less, awk, tar,
+//  the scratch files) ask ios_memoryBudget() how much they may use, instead of a fraction of the
+//  physical memory, and use less of it when the system says memory is getting short.
+//
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <dispatch/dispatch.h>
+#include <TargetConditionals.h>
+#if TARGET_OS_IPHONE
+#include <os/proc.h> // os_proc_available_memory()
+#endif
+
+#include "ios_error.h"
+
+// fraction of the memory still available to the app that a single command may use
+int memoryBudgetShare = 4;
+
+static _Atomic(int) memoryPressure = 0; // 0: normal, 1: warning, 2: critical
+static dispatch_source_t memoryPressureSource = NULL;
+
+static void memoryPressureChanged(void* unused) {
+    unsigned long status = dispatch_source_get_data(memoryPressureSource);
+    if (status & DISPATCH_MEMORYPRESSURE_CRITICAL) memoryPressure = 2;
+    else if (status & DISPATCH_MEMORYPRESSURE_WARN) memoryPressure = 1;
+    else memoryPressure = 0;
+}
+
+static void startMemoryPressureSource(void* unused) {
+    memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+        DISPATCH_MEMORYPRESSURE_NORMAL | DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+        dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+    if (memoryPressureSource == NULL) return;
+    dispatch_source_set_event_handler_f(memoryPressureSource, memoryPressureChanged);
+    dispatch_resume(memoryPressureSource);
+}
+
+// Memory pressure reported by the system: 0 normal, 1 warning, 2 critical. Only an atomic read,
+// commands can check it for every record.
+int ios_memoryPressure(void) {
+    static dispatch_once_t started;
+    dispatch_once_f(&started, NULL, startMemoryPressureSource);
+    return memoryPressure;
+}
+
+// Bytes a command may use for its buffers now: a share of the memory the app can still allocate before
+// it is killed, divided by 4 under warning and by 16 under critical memory pressure. At least 1 MB.
+size_t ios_memoryBudget(void) {
+    int pressure = ios_memoryPressure();
+    size_t available = 0;
+#if TARGET_OS_IPHONE
+    available = os_proc_available_memory();
+#endif
+    if (available == 0) {
+        // not running under a memory limit (simulator, Mac): half of the physical memory, as sort did
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        if ((pages > 0) && (pageSize > 0)) available = (size_t)pages * (size_t)pageSize / 2;
+    }
+    size_t budget = available / ((memoryBudgetShare > 0) ? memoryBudgetShare : 1);
+    if (pressure == 1) budget /= 4;
+    else if (pressure == 2) budget /= 16;
+    if (budget < (1 << 20)) budget = 1 << 20;
+    return budget;
+}
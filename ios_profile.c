@@ -0,0 +1,217 @@
+//
+//  ios_profile.c
+//  ios_system
+//
+//  Sampling profiler for the commands, when Instruments can't be attached: the thread of a command
+//  is suspended a few hundred times per second, its stack is walked through the frame pointers,
+//  and the stacks are written in the folded format of flamegraph.pl ("lib`a;lib`b;lib`c count").
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <mach/mach.h>
+#if __has_feature(ptrauth_calls)
+#include <ptrauth.h>
+#endif
+
+#include "ios_error.h"
+
+#define PROFILE_MAX_DEPTH 128
+#define PROFILE_MAX_SAMPLES 65536 // about 3 minutes at the default frequency
+
+typedef struct _profileSample {
+    int depth;
+    uintptr_t frames[PROFILE_MAX_DEPTH]; // innermost first
+} profileSample;
+
+static inline uintptr_t stripPointer(uintptr_t address) {
+#if __has_feature(ptrauth_calls)
+    return (uintptr_t)ptrauth_strip((void*)address, ptrauth_key_return_address);
+#else
+    return address;
+#endif
+}
+
+// The thread is suspended while its stack is read: no allocation, no lock (it may hold the malloc lock).
+// Frame pointers are only followed inside the stack of the thread, upwards.
+static int sampleThread(pthread_t thread, profileSample* sample) {
+    mach_port_t port = pthread_mach_thread_np(thread);
+    uintptr_t pc, lr = 0, fp;
+    uintptr_t stackHigh = (uintptr_t)pthread_get_stackaddr_np(thread);
+    uintptr_t stackLow = stackHigh - pthread_get_stacksize_np(thread);
+    if (thread_suspend(port) != KERN_SUCCESS) return -1;
+#if defined(__arm64__)
+    arm_thread_state64_t state;
+    mach_msg_type_number_t count = ARM_THREAD_STATE64_COUNT;
+    kern_return_t kr = thread_get_state(port, ARM_THREAD_STATE64, (thread_state_t)&state, &count);
+    pc = (uintptr_t)arm_thread_state64_get_pc(state);
+    lr = (uintptr_t)arm_thread_state64_get_lr(state);
+    fp = (uintptr_t)arm_thread_state64_get_fp(state);
+#elif defined(__x86_64__)
+    x86_thread_state64_t state;
+    mach_msg_type_number_t count = x86_THREAD_STATE64_COUNT;
+    kern_return_t kr = thread_get_state(port, x86_THREAD_STATE64, (thread_state_t)&state, &count);
+    pc = (uintptr_t)state.__rip;
+    fp = (uintptr_t)state.__rbp;
+#else
+    kern_return_t kr = KERN_FAILURE;
+#endif
+    if (kr != KERN_SUCCESS) {
+        thread_resume(port);
+        return -1;
+    }
+    int depth = 0;
+    sample->frames[depth++] = stripPointer(pc);
+    // in a leaf function, the caller is only in the link register:
+    if ((lr != 0) && ((fp < stackLow) || (fp >= stackHigh) || (stripPointer(((uintptr_t*)fp)[1]) != stripPointer(lr))))
+        sample->frames[depth++] = stripPointer(lr);
+    while ((depth < PROFILE_MAX_DEPTH) && (fp >= stackLow) && (fp + 2 * sizeof(uintptr_t) <= stackHigh) && ((fp & (sizeof(uintptr_t) - 1)) == 0)) {
+        uintptr_t* frame = (uintptr_t*)fp;
+        uintptr_t returnAddress = stripPointer(frame[1]);
+        if (returnAddress == 0) break;
+        sample->frames[depth++] = returnAddress;
+        if (frame[0] <= fp) break;
+        fp = frame[0];
+    }
+    thread_resume(port);
+    sample->depth = depth;
+    return depth;
+}
+
+// "framework`function": enough to tell regexec from fts_read or SecureTransport.
+static void appendSymbol(char* line, size_t size, uintptr_t address, int innermost) {
+    Dl_info info;
+    size_t used = strlen(line);
+    if (used > 0 && used < size - 1) line[used++] = ';';
+    // return addresses point after the call, which can be the start of the next function:
+    uintptr_t lookup = innermost ? address : address - 1;
+    if ((dladdr((void*)lookup, &info) != 0) && (info.dli_fname != NULL)) {
+        const char* library = strrchr(info.dli_fname, '/');
+        library = (library != NULL) ? library + 1 : info.dli_fname;
+        if (info.dli_sname != NULL)
+            snprintf(line + used, size - used, "%s`%s", library, info.dli_sname);
+        else
+            snprintf(line + used, size - used, "%s`0x%lx", library, (unsigned long)(lookup - (uintptr_t)info.dli_fbase));
+    } else {
+        snprintf(line + used, size - used, "0x%lx", (unsigned long)address);
+    }
+}
+
+static int compareLines(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Sample the commands running as pids, frequency times per second, for duration seconds (0: until they
+// have all terminated, or the caller is interrupted). Writes the folded stacks to output, one line per
+// distinct stack with its number of samples. Returns the number of samples, -1 if no pid could be sampled.
+int ios_profile(const pid_t* pids, int numPids, int frequency, double duration, FILE* output) {
+    if ((pids == NULL) || (numPids <= 0) || (output == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (frequency <= 0) frequency = 397; // not a divisor of the usual timer periods
+    int capacity = 256 + numPids;
+    profileSample* samples = malloc(sizeof(profileSample) * capacity);
+    int numSamples = 0;
+    if (samples == NULL) return -1;
+    struct timespec period = { 0, 1000000000L / frequency };
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool sampled = false;
+    while (!ios_isInterrupted() && (numSamples < PROFILE_MAX_SAMPLES)) {
+        if (numSamples + numPids > capacity) {
+            profileSample* larger = realloc(samples, sizeof(profileSample) * capacity * 2);
+            if (larger == NULL) break;
+            samples = larger;
+            capacity *= 2;
+        }
+        bool running = false;
+        for (int i = 0; i < numPids; i++) {
+            if (pids[i] == ios_currentPid()) continue;
+            pthread_t thread = ios_getThreadId(pids[i]);
+            if ((thread == 0) || (thread == pthread_self())) continue;
+            running = true;
+            if (sampleThread(thread, &samples[numSamples]) > 0) numSamples++;
+        }
+        if (!running) break;
+        sampled = true;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((duration > 0) && ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9 >= duration)) break;
+        nanosleep(&period, NULL);
+    }
+    if (!sampled) {
+        free(samples);
+        errno = ESRCH;
+        return -1;
+    }
+    // Symbolize after sampling, outermost frame first, then count identical stacks:
+    size_t lineSize = PROFILE_MAX_DEPTH * 64;
+    char** lines = malloc(sizeof(char*) * (numSamples + 1));
+    int numLines = 0;
+    for (int s = 0; (lines != NULL) && (s < numSamples); s++) {
+        char* line = malloc(lineSize);
+        if (line == NULL) break;
+        line[0] = 0;
+        for (int f = samples[s].depth - 1; f >= 0; f--)
+            appendSymbol(line, lineSize, samples[s].frames[f], f == 0);
+        lines[numLines++] = line;
+    }
+    free(samples);
+    if (lines == NULL) return -1;
+    qsort(lines, numLines, sizeof(char*), compareLines);
+    for (int i = 0; i < numLines; ) {
+        int j = i + 1;
+        while ((j < numLines) && (strcmp(lines[i], lines[j]) == 0)) j++;
+        fprintf(output, "%s %d\n", lines[i], j - i);
+        i = j;
+    }
+    for (int i = 0; i < numLines; i++) free(lines[i]);
+    free(lines);
+    return numSamples;
+}
+
+int ios_profile_main(int argc, char** argv) {
+    int frequency = 0;
+    double duration = 0;
+    FILE* output = thread_stdout;
+    const char* usage = "usage: ios_profile [-F frequency] [-d seconds] [-o file] pid ...\n";
+    int ch;
+    while ((ch = getopt(argc, argv, "F:d:o:")) != -1) {
+        switch (ch) {
+            case 'F':
+                frequency = atoi(optarg);
+                break;
+            case 'd':
+                duration = atof(optarg);
+                break;
+            case 'o':
+                if ((output != thread_stdout) && (output != NULL)) fclose(output);
+                if ((output = fopen(optarg, "w")) == NULL) {
+                    fprintf(thread_stderr, "ios_profile: %s: %s\n", optarg, strerror(errno));
+                    return 1;
+                }
+                break;
+            default:
+                fputs(usage, thread_stderr);
+                return 1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 1) {
+        fputs(usage, thread_stderr);
+        return 1;
+    }
+    pid_t* pids = malloc(sizeof(pid_t) * argc);
+    if (pids == NULL) return 1;
+    for (int i = 0; i < argc; i++) pids[i] = (pid_t)atoi(argv[i]);
+    int numSamples = ios_profile(pids, argc, frequency, duration, output);
+    if (numSamples < 0) fprintf(thread_stderr, "ios_profile: %s\n", strerror(errno));
+    free(pids);
+    if (output != thread_stdout) fclose(output);
+    return (numSamples < 0) ? 1 : 0;
+}
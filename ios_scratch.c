@@ -0,0 +1,278 @@
+//
+//  ios_scratch.c
+//  ios_system
+//
+//  Scratch files kept in memory: tmpfile() for the commands, the temporary runs of sort.
+//  All of them share scratchMemoryBudget bytes; a file that would go over it is moved
+//  to $TMPDIR, and continues there.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/param.h>
+
+#include "ios_error.h"
+#undef tmpfile
+#undef fwrite
+#undef fflush
+
+// bytes of memory for all scratch files together (0: scratch files are on disk, as usual)
+size_t scratchMemoryBudget = 32 << 20;
+
+#define SCRATCH_MIN_ALLOCATION (64 << 10)
+#define SCRATCH_STREAM_BUFFER (64 << 10)
+
+typedef struct _scratchFile {
+    char* path;             // NULL for tmpfile()
+    char* data;
+    size_t length;
+    size_t capacity;        // counted against the budget
+    int references;         // open streams
+    bool linked;            // can still be opened by name
+    struct _scratchFile* next;
+} scratchFile;
+
+typedef struct _scratchStream {
+    scratchFile* file;      // NULL once moved to disk
+    FILE* disk;
+    off_t position;
+    bool append;
+} scratchStream;
+
+// One lock for the list of named files, the budget and the contents: streams are buffered,
+// so it is taken once per SCRATCH_STREAM_BUFFER bytes.
+static pthread_mutex_t scratchLock = PTHREAD_MUTEX_INITIALIZER;
+static scratchFile* scratchFiles = NULL;
+static size_t scratchUsed = 0;
+
+size_t ios_scratchMemoryUsage(void) {
+    pthread_mutex_lock(&scratchLock);
+    size_t used = scratchUsed;
+    pthread_mutex_unlock(&scratchLock);
+    return used;
+}
+
+// scratchLock held for all the functions below, up to the stream callbacks.
+static scratchFile* findScratchFile(const char* path) {
+    for (scratchFile* f = scratchFiles; f != NULL; f = f->next)
+        if (strcmp(f->path, path) == 0) return f;
+    return NULL;
+}
+
+static void releaseScratchFile(scratchFile* f) {
+    if ((f->references > 0) || f->linked) return;
+    scratchUsed -= f->capacity;
+    free(f->data);
+    free(f->path);
+    free(f);
+}
+
+static void unlinkScratchFile(scratchFile* f) {
+    for (scratchFile** p = &scratchFiles; *p != NULL; p = &(*p)->next)
+        if (*p == f) {
+            *p = f->next;
+            break;
+        }
+    f->linked = false;
+    releaseScratchFile(f);
+}
+
+// Make room for needed bytes, within the budget. Returns -1 if they don't fit.
+// When memory gets short, the budget shrinks with ios_memoryBudget(), and files go to disk sooner.
+static int growScratchFile(scratchFile* f, size_t needed) {
+    if (needed <= f->capacity) return 0;
+    size_t budget = scratchMemoryBudget;
+    if (ios_memoryPressure() != 0) budget = MIN(budget, ios_memoryBudget());
+    size_t capacity = MAX(MAX(needed, 2 * f->capacity), SCRATCH_MIN_ALLOCATION);
+    if (scratchUsed - f->capacity + capacity > budget)
+        capacity = needed;
+    if (scratchUsed - f->capacity + capacity > budget) return -1;
+    char* data = realloc(f->data, capacity);
+    if (data == NULL) return -1;
+    scratchUsed += capacity - f->capacity;
+    f->data = data;
+    f->capacity = capacity;
+    return 0;
+}
+
+// Move the file of this stream to disk: to its own path, or to an unlinked file in $TMPDIR for tmpfile().
+// Not possible while the file is open by another stream.
+static int spillScratchStream(scratchStream* s) {
+    scratchFile* f = s->file;
+    FILE* disk = NULL;
+    if (f->references > 1) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (f->path != NULL) {
+        disk = fopen(f->path, "w+");
+    } else {
+        const char* dir = getenv("TMPDIR");
+        char template[PATH_MAX];
+        snprintf(template, sizeof(template), "%s/scratch.XXXXXX", (dir != NULL) ? dir : "/tmp");
+        int fd = mkstemp(template);
+        if (fd >= 0) {
+            unlink(template);
+            if ((disk = fdopen(fd, "w+")) == NULL) close(fd);
+        }
+    }
+    if (disk == NULL) return -1;
+    if (((f->length > 0) && (fwrite(f->data, 1, f->length, disk) != f->length)) || (fseeko(disk, s->position, SEEK_SET) != 0)) {
+        fclose(disk);
+        return -1;
+    }
+    s->disk = disk;
+    s->file = NULL;
+    f->references--;
+    if (f->linked) unlinkScratchFile(f);
+    else releaseScratchFile(f);
+    return 0;
+}
+
+static int scratchRead(void* cookie, char* buf, int n) {
+    scratchStream* s = cookie;
+    if (s->disk != NULL) return (int)fread(buf, 1, n, s->disk);
+    pthread_mutex_lock(&scratchLock);
+    scratchFile* f = s->file;
+    size_t count = 0;
+    if (s->position < (off_t)f->length) {
+        count = MIN((size_t)n, f->length - (size_t)s->position);
+        memcpy(buf, f->data + s->position, count);
+        s->position += count;
+    }
+    pthread_mutex_unlock(&scratchLock);
+    return (int)count;
+}
+
+static int scratchWrite(void* cookie, const char* buf, int n) {
+    scratchStream* s = cookie;
+    if (s->disk == NULL) {
+        pthread_mutex_lock(&scratchLock);
+        scratchFile* f = s->file;
+        if (s->append) s->position = f->length;
+        size_t end = (size_t)s->position + n;
+        if (growScratchFile(f, end) == 0) {
+            if ((size_t)s->position > f->length) memset(f->data + f->length, 0, s->position - f->length);
+            memcpy(f->data + s->position, buf, n);
+            f->length = MAX(f->length, end);
+            s->position = end;
+            pthread_mutex_unlock(&scratchLock);
+            return n;
+        }
+        int rc = spillScratchStream(s);
+        pthread_mutex_unlock(&scratchLock);
+        if (rc < 0) return -1;
+    }
+    if (s->append) fseeko(s->disk, 0, SEEK_END);
+    size_t count = fwrite(buf, 1, n, s->disk);
+    return (count > 0) ? (int)count : -1;
+}
+
+static fpos_t scratchSeek(void* cookie, fpos_t offset, int whence) {
+    scratchStream* s = cookie;
+    if (s->disk != NULL) {
+        if (fseeko(s->disk, offset, whence) != 0) return -1;
+        return ftello(s->disk);
+    }
+    pthread_mutex_lock(&scratchLock);
+    off_t base = (whence == SEEK_SET) ? 0 : (whence == SEEK_CUR) ? s->position : (off_t)s->file->length;
+    pthread_mutex_unlock(&scratchLock);
+    if ((whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END) || (base + offset < 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->position = base + offset;
+    return s->position;
+}
+
+static int scratchClose(void* cookie) {
+    scratchStream* s = cookie;
+    int rc = 0;
+    if (s->disk != NULL) {
+        rc = fclose(s->disk);
+    } else {
+        pthread_mutex_lock(&scratchLock);
+        s->file->references--;
+        releaseScratchFile(s->file);
+        pthread_mutex_unlock(&scratchLock);
+    }
+    free(s);
+    return rc;
+}
+
+static FILE* openScratchStream(scratchFile* f, const char* mode) {
+    scratchStream* s = calloc(1, sizeof(scratchStream));
+    if (s == NULL) return NULL;
+    bool readable = (mode[0] == 'r') || (strchr(mode, '+') != NULL);
+    bool writable = (mode[0] != 'r') || (strchr(mode, '+') != NULL);
+    s->file = f;
+    s->append = (mode[0] == 'a');
+    if (s->append) s->position = f->length;
+    FILE* stream = funopen(s, readable ? scratchRead : NULL, writable ? scratchWrite : NULL, scratchSeek, scratchClose);
+    if (stream == NULL) {
+        free(s);
+        return NULL;
+    }
+    f->references++;
+    setvbuf(stream, NULL, _IOFBF, SCRATCH_STREAM_BUFFER);
+    return stream;
+}
+
+FILE* ios_tmpfile(void) {
+    if (scratchMemoryBudget == 0) return tmpfile();
+    scratchFile* f = calloc(1, sizeof(scratchFile));
+    if (f == NULL) return tmpfile();
+    pthread_mutex_lock(&scratchLock);
+    FILE* stream = openScratchStream(f, "w+");
+    pthread_mutex_unlock(&scratchLock);
+    if (stream == NULL) {
+        free(f);
+        return tmpfile();
+    }
+    return stream;
+}
+
+// A named scratch file: kept in memory under that name until ios_scratch_unlink(), and written
+// to that path if it goes over the budget. "r" of a name that isn't in memory opens the path.
+FILE* ios_scratch_fopen(const char* path, const char* mode) {
+    if (scratchMemoryBudget == 0) return fopen(path, mode);
+    pthread_mutex_lock(&scratchLock);
+    scratchFile* f = findScratchFile(path);
+    bool created = false;
+    if (mode[0] == 'r') {
+        if (f == NULL) {
+            pthread_mutex_unlock(&scratchLock);
+            return fopen(path, mode);
+        }
+    } else if ((f == NULL) || (mode[0] == 'w')) {
+        // a stream still reading the previous contents keeps them
+        if (f != NULL) unlinkScratchFile(f);
+        if ((f = calloc(1, sizeof(scratchFile))) == NULL || (f->path = strdup(path)) == NULL) {
+            free(f);
+            pthread_mutex_unlock(&scratchLock);
+            return fopen(path, mode);
+        }
+        f->linked = true;
+        f->next = scratchFiles;
+        scratchFiles = f;
+        created = true;
+    }
+    FILE* stream = openScratchStream(f, mode);
+    if ((stream == NULL) && created) unlinkScratchFile(f);
+    pthread_mutex_unlock(&scratchLock);
+    return stream;
+}
+
+// Removes a named scratch file, from memory, or from disk if it isn't there.
+int ios_scratch_unlink(const char* path) {
+    pthread_mutex_lock(&scratchLock);
+    scratchFile* f = findScratchFile(path);
+    if (f != NULL) unlinkScratchFile(f);
+    pthread_mutex_unlock(&scratchLock);
+    return (f != NULL) ? 0 : unlink(path);
+}
@@ -27,6 +27,8 @@
 #include <libgen.h> // for basename()
 #include <dlfcn.h>  // for dlopen()/dlsym()/dlclose()
 #include <glob.h>   // for wildcard expansion
+#include <dirent.h> // for opendir()/readdir(), cached for wildcard expansion
+#include <fcntl.h>  // for open(), used to change directory
 // Sideloading: when you compile yourself, as opposed to uploading on the app store
 // If true, all commands are enabled + debug messages if dylib not found.
 // If false, you get a smaller set, but compliance with AppStore rules.
@@ -41,22 +43,111 @@ bool joinMainThread = true;
 static NSString* ios_bookmarkDictionaryName = @"bookmarkNames";
 // Include file for getrlimit/setrlimit:
 #include <sys/resource.h>
+#include <sys/mount.h> // for getfsstat(), statfs(), used by ios_volumeStats
 static struct rlimit limitFilesOpen;
+// Number of open file descriptors. Counted when the first command starts (not at startup: the scan
+// goes through every descriptor up to the limit), then kept up to date by the code that opens
+// and closes streams (pipes, redirections, dup2). Commands also open files on their own, so we do a
+// full scan again every DescriptorRescanInterval commands, or when we get close to the limit.
+static _Atomic(int) numFileDescriptorsOpen = 0;
+#define DescriptorRescanInterval 256
+static _Atomic(int) launchesSinceDescriptorScan = DescriptorRescanInterval;
 extern void display_alert(NSString* title, NSString* message);
 
+// Diagnostics on the command path (launch, threads, streams, directory locks...). NSLog is synchronous
+// and slow, so these messages are compiled out unless ios_system is built with IOS_SYSTEM_TRACE=1.
+// Then ios_traceCategories selects what is logged (0 = nothing), and if ios_traceToMemory is set the
+// messages go to a ring buffer (printed by ios_dumpTrace) instead of NSLog. Commands also appear as
+// os_signpost intervals ("ios_system", "commands") in Instruments, and the startup work (environment,
+// command list, command table) as intervals in ("ios_system", "startup").
+#define TraceCommand   0x01 // start and end of commands
+#define TraceThread    0x02 // thread creation and cleanup
+#define TraceStreams   0x04 // closing pipes and redirections
+#define TraceDirectory 0x08 // current directory locks (chdir, fchdir)
+#define TraceParsing   0x10 // command line parsing, alias expansion
+#define TraceSession   0x20 // sh sessions
+unsigned int ios_traceCategories = 0;
+bool ios_traceToMemory = false;
+#if IOS_SYSTEM_TRACE
+#include <os/signpost.h>
+#define TraceRingSize 1024
+#define TraceLineLength 256
+static char traceRing[TraceRingSize][TraceLineLength];
+static _Atomic(unsigned long) traceRingPosition = 0;
+
+static void ios_traceMessage(NSString* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    NSString* message = [[NSString alloc] initWithFormat:format arguments:arguments];
+    va_end(arguments);
+    if (ios_traceToMemory) {
+        unsigned long position = traceRingPosition++;
+        strlcpy(traceRing[position % TraceRingSize], message.UTF8String, TraceLineLength);
+    } else {
+        NSLog(@"%@", message);
+    }
+}
+
+static os_log_t traceLog(void) {
+    static os_log_t log = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        log = os_log_create("ios_system", "commands");
+    });
+    return log;
+}
+#define ios_trace(category, ...) do { if (ios_traceCategories & (category)) ios_traceMessage(__VA_ARGS__); } while (0)
+
+static os_log_t startupLog(void) {
+    static os_log_t log = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        log = os_log_create("ios_system", "startup");
+    });
+    return log;
+}
+#define startupBegin(name) os_signpost_id_t startupSignpost = os_signpost_id_generate(startupLog()); \
+    os_signpost_interval_begin(startupLog(), startupSignpost, name)
+#define startupEnd(name) os_signpost_interval_end(startupLog(), startupSignpost, name)
+#else
+#define ios_trace(category, ...) do { } while (0)
+#define startupBegin(name) do { } while (0)
+#define startupEnd(name) do { } while (0)
+#endif
+
+void ios_dumpTrace(FILE* output) {
+#if IOS_SYSTEM_TRACE
+    unsigned long end = traceRingPosition;
+    unsigned long start = (end > TraceRingSize) ? end - TraceRingSize : 0;
+    for (unsigned long i = start; i < end; i++) fprintf(output, "%s\n", traceRing[i % TraceRingSize]);
+#endif
+}
+
 
 extern __thread int    __db_getopt_reset;
+extern __thread int    thread_opterr, thread_optind, thread_optreset;
 __thread FILE* thread_stdin;
 __thread FILE* thread_stdout;
 __thread FILE* thread_stderr;
 __thread void* thread_context;
 
+// Background jobs started by sh ("command &"). They run in parallel, at most maxJobs at a time per session.
+#define MaxBackgroundJobs 64
+typedef struct _backgroundJob {
+    pid_t pid;
+    int number;        // job number, as displayed by "jobs"
+    char command[128]; // for "jobs", truncated
+} backgroundJob;
+// Default maximum number of background jobs running at the same time in a session. 0: number of cores.
+int maxBackgroundJobs = 0;
+
 // Parameters for each session. We can have multiple sessions running in parallel.
 typedef struct _sessionParameters {
     bool isMainThread;   // are we on the first command?
-    char currentDir[MAXPATHLEN];
-    char previousDirectory[MAXPATHLEN];
-    char localMiniRoot[MAXPATHLEN];
+    // Paths are interned (see internPath), so they can be copied by pointer:
+    const char* currentDir;
+    const char* previousDirectory;
+    const char* localMiniRoot;
     pthread_t current_command_root_thread; // thread ID of first command
     pthread_t lastThreadId; // thread ID of last command
     pthread_t mainThreadId; // thread ID of parent command, if any (e.g. vim, which starts "sh -c cd dir && flake8 file")
@@ -70,8 +161,67 @@ typedef struct _sessionParameters {
     char columns[4];
     char lines[4];
     bool activePager;
+    const char* coordinatedDirectory; // last directory coordinated with NSFileCoordinator, reset by chdir
+    backgroundJob* jobs; // MaxBackgroundJobs entries, allocated with the first background job
+    int numJobs;
+    int maxJobs;
+    int lastJobNumber;
+    // Threads waiting for the commands of this session to terminate sleep on stateChanged:
+    pthread_mutex_t stateMutex;
+    pthread_cond_t stateChanged;
+    // Coalesced terminal output (ios_setOutputCoalescing), protected by outputMutex:
+    pthread_mutex_t outputMutex;
+    FILE* coalescedStream;       // NULL if output is not coalesced
+    int previousBuffering;       // buffering mode of coalescedStream before, restored at the end
+    uint64_t coalescingInterval; // nanoseconds
+    _Atomic(bool) flushPending;
 } sessionParameters;
 
+// Interned paths: each distinct path used by a session (current directory, previous directory, local miniRoot)
+// is stored once, in an open-addressing hash table, and never released. Sessions copy them by pointer
+// instead of keeping three MAXPATHLEN arrays each. The number of distinct directories visited is small.
+static const char** internedPaths = NULL;
+static size_t internedPathsSize = 0; // power of 2
+static size_t numInternedPaths = 0;
+static size_t internedPathsBytes = 0;
+static pthread_mutex_t intern_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t pathHash(const char* path) {
+    size_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)path; *c; c++) hash = (hash ^ *c) * 16777619u;
+    return hash;
+}
+
+static const char* internPath(const char* path) {
+    if (path == NULL) return NULL;
+    if (path[0] == 0) return "";
+    pthread_mutex_lock(&intern_mtx);
+    if ((numInternedPaths + 1) * 2 > internedPathsSize) {
+        size_t newSize = (internedPathsSize == 0) ? 64 : 2 * internedPathsSize;
+        const char** newPaths = calloc(newSize, sizeof(char*));
+        for (size_t i = 0; i < internedPathsSize; i++) {
+            if (internedPaths[i] == NULL) continue;
+            size_t j = pathHash(internedPaths[i]) & (newSize - 1);
+            while (newPaths[j] != NULL) j = (j + 1) & (newSize - 1);
+            newPaths[j] = internedPaths[i];
+        }
+        free(internedPaths);
+        internedPaths = newPaths;
+        internedPathsSize = newSize;
+    }
+    size_t i = pathHash(path) & (internedPathsSize - 1);
+    while ((internedPaths[i] != NULL) && (strcmp(internedPaths[i], path) != 0))
+        i = (i + 1) & (internedPathsSize - 1);
+    if (internedPaths[i] == NULL) {
+        internedPaths[i] = strdup(path);
+        numInternedPaths++;
+        internedPathsBytes += strlen(path) + 1;
+    }
+    const char* result = internedPaths[i];
+    pthread_mutex_unlock(&intern_mtx);
+    return result;
+}
+
 static void initSessionParameters(sessionParameters* sp) {
     NSFileManager *fileManager = [[NSFileManager alloc] init];
     sp->isMainThread = TRUE;
@@ -79,9 +229,9 @@ static void initSessionParameters(sessionParameters* sp) {
     sp->lastThreadId = 0;
     sp->mainThreadId = 0;
     NSString* currentDirectory = [fileManager currentDirectoryPath];
-    strcpy(sp->currentDir, [currentDirectory UTF8String]);
-    strcpy(sp->previousDirectory, [currentDirectory UTF8String]);
-    sp->localMiniRoot[0] = 0;
+    sp->currentDir = internPath([currentDirectory UTF8String]);
+    sp->previousDirectory = internPath([currentDirectory UTF8String]);
+    sp->localMiniRoot = "";
     sp->global_errno = 0;
     sp->stdin = stdin;
     sp->stdout = stdout;
@@ -92,6 +242,25 @@ static void initSessionParameters(sessionParameters* sp) {
     strcpy(sp->columns, "80");
     strcpy(sp->lines, "80");
     sp->activePager = FALSE;
+    sp->coordinatedDirectory = "";
+    sp->numJobs = 0;
+    sp->lastJobNumber = 0;
+    // sp->jobs is kept when the session is reused from the pool.
+    sp->maxJobs = maxBackgroundJobs;
+    if (sp->maxJobs <= 0) sp->maxJobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (sp->maxJobs > MaxBackgroundJobs) sp->maxJobs = MaxBackgroundJobs;
+    if (sp->maxJobs <= 0) sp->maxJobs = 1;
+    pthread_mutex_lock(&sp->outputMutex);
+    sp->coalescedStream = NULL;
+    pthread_mutex_unlock(&sp->outputMutex);
+}
+
+// Wake up all threads waiting for a change of current_command_root_thread or lastThreadId:
+static void sessionStateChanged(sessionParameters* sp) {
+    if (sp == NULL) return;
+    pthread_mutex_lock(&sp->stateMutex);
+    pthread_cond_broadcast(&sp->stateChanged);
+    pthread_mutex_unlock(&sp->stateMutex);
 }
 
 void ios_setBookmarkDictionaryName(NSString* name) {
@@ -139,24 +308,292 @@ void ios_printBookmarkedVersion(char* p) {
     fprintf(thread_stdout, "%s\n", p);
 }
 
-static NSMutableDictionary* sessionList;
-static NSMutableDictionary* aliasDictionary;
+// Sessions, by sessionId: open-addressing hash table on the sessionId pointer, with backward-shift deletion.
+// Closed sessions that have no command running go back to a small pool and are reused by the next session
+// (sh creates a session for every command line with several commands).
+typedef struct _sessionSlot {
+    const void* sessionId;
+    sessionParameters* session; // NULL: empty slot
+} sessionSlot;
+static sessionSlot* sessionTable = NULL;
+static size_t sessionTableSize = 0; // power of 2
+static size_t numSessions = 0;
+static bool sessionTableStarted = false;
+#define SessionPoolSize 8
+static sessionParameters* sessionPool[SessionPoolSize];
+static int numPooledSessions = 0;
+static pthread_mutex_t session_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t sessionHash(const void* sessionId) {
+    uint64_t x = (uint64_t)(uintptr_t)sessionId;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+// Must be called with session_mtx locked. Returns the slot for sessionId, or the empty slot where it would go.
+static size_t sessionSlotIndex(const void* sessionId) {
+    size_t i = sessionHash(sessionId) & (sessionTableSize - 1);
+    while ((sessionTable[i].session != NULL) && (sessionTable[i].sessionId != sessionId))
+        i = (i + 1) & (sessionTableSize - 1);
+    return i;
+}
+
+static sessionParameters* sessionLookup(const void* sessionId) {
+    sessionParameters* session = NULL;
+    pthread_mutex_lock(&session_mtx);
+    if (sessionTableSize > 0) session = sessionTable[sessionSlotIndex(sessionId)].session;
+    pthread_mutex_unlock(&session_mtx);
+    return session;
+}
+
+static void sessionInsert(const void* sessionId, sessionParameters* session) {
+    pthread_mutex_lock(&session_mtx);
+    if ((numSessions + 1) * 2 > sessionTableSize) {
+        size_t oldSize = sessionTableSize;
+        sessionSlot* oldTable = sessionTable;
+        sessionTableSize = (oldSize == 0) ? 16 : 2 * oldSize;
+        sessionTable = calloc(sessionTableSize, sizeof(sessionSlot));
+        for (size_t i = 0; i < oldSize; i++) {
+            if (oldTable[i].session != NULL) sessionTable[sessionSlotIndex(oldTable[i].sessionId)] = oldTable[i];
+        }
+        free(oldTable);
+    }
+    size_t i = sessionSlotIndex(sessionId);
+    if (sessionTable[i].session == NULL) numSessions++;
+    sessionTable[i].sessionId = sessionId;
+    sessionTable[i].session = session;
+    pthread_mutex_unlock(&session_mtx);
+}
+
+static sessionParameters* sessionRemove(const void* sessionId) {
+    sessionParameters* session = NULL;
+    pthread_mutex_lock(&session_mtx);
+    if (sessionTableSize > 0) {
+        size_t mask = sessionTableSize - 1;
+        size_t i = sessionSlotIndex(sessionId);
+        session = sessionTable[i].session;
+        if (session != NULL) {
+            sessionTable[i].session = NULL;
+            numSessions--;
+            // Move back the entries that were displaced past the slot we just emptied:
+            for (size_t j = (i + 1) & mask; sessionTable[j].session != NULL; j = (j + 1) & mask) {
+                size_t home = sessionHash(sessionTable[j].sessionId) & mask;
+                bool stays = (i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j));
+                if (stays) continue;
+                sessionTable[i] = sessionTable[j];
+                sessionTable[j].session = NULL;
+                i = j;
+            }
+        }
+    }
+    pthread_mutex_unlock(&session_mtx);
+    return session;
+}
+
+static sessionParameters* allocateSession(void) {
+    sessionParameters* session = NULL;
+    pthread_mutex_lock(&session_mtx);
+    if (numPooledSessions > 0) session = sessionPool[--numPooledSessions];
+    pthread_mutex_unlock(&session_mtx);
+    if (session == NULL) {
+        session = calloc(1, sizeof(sessionParameters));
+        pthread_mutex_init(&session->stateMutex, NULL);
+        pthread_cond_init(&session->stateChanged, NULL);
+        pthread_mutex_init(&session->outputMutex, NULL);
+    }
+    initSessionParameters(session);
+    return session;
+}
+
+// Sessions with commands still running can't be reused, they are kept in memory (as before).
+static void releaseSession(sessionParameters* session) {
+    if ((session->current_command_root_thread != 0) || (session->lastThreadId != 0) ||
+        (session->mainThreadId != 0) || (session->numJobs != 0)) return;
+    pthread_mutex_lock(&session_mtx);
+    if (numPooledSessions < SessionPoolSize) sessionPool[numPooledSessions++] = session;
+    pthread_mutex_unlock(&session_mtx);
+}
+
+// Memory used by the sessions (open and pooled) and the paths they share:
+size_t ios_sessionMemoryUsage(void) {
+    size_t total = 0;
+    pthread_mutex_lock(&session_mtx);
+    total += sessionTableSize * sizeof(sessionSlot);
+    for (size_t i = 0; i < sessionTableSize; i++) {
+        sessionParameters* session = sessionTable[i].session;
+        if (session == NULL) continue;
+        total += sizeof(sessionParameters);
+        if (session->jobs != NULL) total += MaxBackgroundJobs * sizeof(backgroundJob);
+    }
+    for (int i = 0; i < numPooledSessions; i++) {
+        total += sizeof(sessionParameters);
+        if (sessionPool[i]->jobs != NULL) total += MaxBackgroundJobs * sizeof(backgroundJob);
+    }
+    pthread_mutex_unlock(&session_mtx);
+    pthread_mutex_lock(&intern_mtx);
+    total += internedPathsSize * sizeof(char*) + internedPathsBytes;
+    pthread_mutex_unlock(&intern_mtx);
+    return total;
+}
+
 
 // pointer to sessionParameters. thread-local variable so the entire system is thread-safe.
 // The sessionParameters pointer is shared by all threads in the same session.
 static __thread sessionParameters* currentSession;
-// Python3 multiple interpreters:
+
+// File coordination: before starting a command that operates on files, we tell the system that we are going
+// to write in the current directory (NSFileCoordinator). That is a synchronous round-trip with the file
+// coordination daemon, so by default we only do it once per directory and per session, until the next cd.
+// Set cacheFileCoordination to false to coordinate before every command.
+bool cacheFileCoordination = true;
+static _Atomic(unsigned long) numSkippedCoordinations = 0;
+
+unsigned long ios_skippedFileCoordinations(void) {
+    return numSkippedCoordinations;
+}
+
+// Called by chdir/fchdir (not when restoring the directory at the end of a command):
+static void resetFileCoordination(void) {
+    if (currentSession != NULL) currentSession->coordinatedDirectory = "";
+}
+
+// Interpreters that can run several scripts at the same time (python for Jupyter notebooks, perl for cpan...)
+// come in several copies: the command itself (slot 0), then prefix + A, B, C... (e.g. pythonA, pythonB),
+// each in its own framework. A command declares how many copies there are with a 5th component
+// in its entry of the commands plist (e.g. "6" for python3). The prefix is the command name without
+// its version number ("python3.9" -> "python").
+// Slots are taken and released with atomic operations. When they are all busy, ios_system() waits for
+// one to be released, up to interpreterSlotWaitTime seconds.
+#define MaxInterpreterGroups 16
+#define MaxInterpreterSlots 27 // the command itself, then A-Z
+typedef struct _interpreterGroup {
+    char prefix[16];
+    _Atomic(int) numSlots;
+    int* limit;            // set by the app (numPythonInterpreters...), or NULL
+    _Atomic(int) nextSlot; // we use the slots in turn, starting here
+    _Atomic(bool) busy[MaxInterpreterSlots];
+} interpreterGroup;
 // limit to 6 = 1 kernel, 4 notebooks, one extra.
-static const int MaxPythonInterpreters = 6; // const so we can allocate an array
-int numPythonInterpreters = MaxPythonInterpreters; // Apps can overwrite this
-static bool PythonIsRunning[MaxPythonInterpreters];
-static int currentPythonInterpreter = 0;
-// Same with perl:
-static const int MaxPerlInterpreters = 3; // const so we can allocate an array
+int numPythonInterpreters = 6; // Apps can overwrite this
 // cpan starts perl Makefile.PL, which starts perl -e print Version, so at least 3.
-int numPerlInterpreters = MaxPerlInterpreters; // Apps can overwrite this
-static bool PerlIsRunning[MaxPerlInterpreters];
-static int currentPerlInterpreter = 0;
+int numPerlInterpreters = 3; // Apps can overwrite this
+int interpreterSlotWaitTime = 30; // seconds. Apps can overwrite this
+static interpreterGroup interpreterGroups[MaxInterpreterGroups] = {
+    { "python", 6, &numPythonInterpreters },
+    { "perl", 3, &numPerlInterpreters },
+};
+static _Atomic(int) numInterpreterGroups = 2;
+static pthread_mutex_t interpreterSlot_mtx = PTHREAD_MUTEX_INITIALIZER; // for registration and waiting only
+static pthread_cond_t interpreterSlotReleased = PTHREAD_COND_INITIALIZER;
+static _Atomic(int) interpreterSlotWaiters = 0;
+
+static int interpreterSlotCount(interpreterGroup* group) {
+    int count = group->numSlots;
+    if ((group->limit != NULL) && (*group->limit < count)) count = *group->limit;
+    return MAX(0, MIN(count, MaxInterpreterSlots));
+}
+
+// Length of the prefix in name: name without trailing digits and dots.
+static size_t interpreterPrefixLength(const char* name) {
+    size_t length = strlen(name);
+    while ((length > 0) && (isdigit(name[length - 1]) || (name[length - 1] == '.'))) length--;
+    return length;
+}
+
+// Group for a command name: the prefix, followed by nothing, a version number, or a copy letter.
+static interpreterGroup* interpreterGroupFor(const char* name) {
+    int count = numInterpreterGroups;
+    for (int i = 0; i < count; i++) {
+        interpreterGroup* group = &interpreterGroups[i];
+        size_t length = strlen(group->prefix);
+        if (strncmp(name, group->prefix, length) != 0) continue;
+        const char* rest = name + length;
+        if ((rest[0] >= 'A') && (rest[0] <= 'Z') && (rest[1] == 0)) return group;
+        if (interpreterPrefixLength(name) == length) return group;
+    }
+    return NULL;
+}
+
+// Called when building the command table, for commands with a number of copies in the plist:
+static void registerInterpreterGroup(const char* name, int numSlots) {
+    size_t length = interpreterPrefixLength(name);
+    if ((length == 0) || (length >= sizeof(interpreterGroups[0].prefix)) || (numSlots <= 0)) return;
+    pthread_mutex_lock(&interpreterSlot_mtx);
+    int count = numInterpreterGroups;
+    for (int i = 0; i < count; i++) {
+        interpreterGroup* group = &interpreterGroups[i];
+        if ((strlen(group->prefix) == length) && (strncmp(group->prefix, name, length) == 0)) {
+            group->numSlots = MIN(numSlots, MaxInterpreterSlots);
+            pthread_mutex_unlock(&interpreterSlot_mtx);
+            return;
+        }
+    }
+    if (count < MaxInterpreterGroups) {
+        interpreterGroup* group = &interpreterGroups[count];
+        memcpy(group->prefix, name, length);
+        group->prefix[length] = 0;
+        group->numSlots = MIN(numSlots, MaxInterpreterSlots);
+        numInterpreterGroups = count + 1; // after the group is complete, for the lock-free readers
+    }
+    pthread_mutex_unlock(&interpreterSlot_mtx);
+}
+
+static int tryAcquireInterpreterSlot(interpreterGroup* group) {
+    int count = interpreterSlotCount(group);
+    if (count == 0) return -1;
+    int start = group->nextSlot % count;
+    for (int i = 0; i < count; i++) {
+        int slot = (start + i) % count;
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&group->busy[slot], &expected, true)) {
+            group->nextSlot = slot + 1;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+extern pid_t ios_suspendForkLock(void);
+extern void ios_resumeForkLock(pid_t pid);
+// Take a free copy of the interpreter. If wait is set, wait for one to be released. Returns -1 if none.
+static int acquireInterpreterSlot(interpreterGroup* group, bool wait) {
+    int slot = tryAcquireInterpreterSlot(group);
+    if ((slot >= 0) || !wait || (interpreterSlotCount(group) == 0)) return slot;
+    // The interpreter we are waiting for must be able to chdir, start commands and terminate:
+    pid_t forkedPid = ios_suspendForkLock();
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += interpreterSlotWaitTime;
+    pthread_mutex_lock(&interpreterSlot_mtx);
+    interpreterSlotWaiters++;
+    while ((slot = tryAcquireInterpreterSlot(group)) < 0) {
+        if (ios_isInterrupted()) break;
+        // Wake up every second to check for interruptions:
+        struct timespec now, next;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if ((now.tv_sec > deadline.tv_sec) || ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec))) break;
+        next = now;
+        next.tv_sec += 1;
+        if ((next.tv_sec > deadline.tv_sec) || ((next.tv_sec == deadline.tv_sec) && (next.tv_nsec > deadline.tv_nsec))) next = deadline;
+        pthread_cond_timedwait(&interpreterSlotReleased, &interpreterSlot_mtx, &next);
+    }
+    interpreterSlotWaiters--;
+    pthread_mutex_unlock(&interpreterSlot_mtx);
+    ios_resumeForkLock(forkedPid);
+    return slot;
+}
+
+static void releaseInterpreterSlot(interpreterGroup* group, int slot) {
+    if ((group == NULL) || (slot < 0) || (slot >= MaxInterpreterSlots)) return;
+    group->busy[slot] = false;
+    if (interpreterSlotWaiters > 0) {
+        pthread_mutex_lock(&interpreterSlot_mtx);
+        pthread_cond_broadcast(&interpreterSlotReleased);
+        pthread_mutex_unlock(&interpreterSlot_mtx);
+    }
+}
 // pointers for sh sessions:
 char* sh_session = "sh_session";
 
@@ -205,11 +642,7 @@ void ios_signal(int signal) {
 }
 
 NSString *ios_getLogicalPWD(const void* sessionId) {
-    id sessionKey = @((NSUInteger)sessionId);
-    if (sessionList == nil) {
-        return nil;
-    }
-    sessionParameters *session = (sessionParameters*)[[sessionList objectForKey: sessionKey] pointerValue];
+    sessionParameters *session = sessionLookup(sessionId);
     if (session == nil) {
         return nil;
     }
@@ -222,11 +655,7 @@ void ios_setWindowSize(int width, int height, const void* sessionId) {
     // So we set it without calling ios_switchSession:
     sessionParameters* resizedSession;
 
-    id sessionKey = @((NSUInteger)sessionId);
-    if (sessionList == nil) {
-        return;
-    }
-    resizedSession = (sessionParameters*)[[sessionList objectForKey: sessionKey] pointerValue];
+    resizedSession = sessionLookup(sessionId);
     if (resizedSession == nil) {
         return;
     }
@@ -258,7 +687,7 @@ char * ios_getenv(const char *name) {
         return currentSession->lines;
     }
     if (strcmp(name, "PWD") == 0) {
-        return currentSession->currentDir;
+        return (char*)currentSession->currentDir;
     }
     return libc_getenv(name);
 }
@@ -275,34 +704,617 @@ extern const char* ios_progname(void) {
 }
 
 
+// Resident cache of command handles: dlopen() and dlsym() are only called the first time a command is
+// called, the library stays loaded for the next calls. When the cache is full, the least recently used
+// entry that is not running is released. Set commandCacheSize to 0 to dlopen/dlclose for every command.
+#define MaxCommandCacheSize 128
+int commandCacheSize = 64; // Apps can overwrite this (up to MaxCommandCacheSize)
+typedef struct _commandCacheEntry {
+    char commandName[NAME_MAX];  // empty if the entry has been invalidated
+    void* dlHandle;              // NULL if the entry is free
+    int (*function)(int ac, char** av);
+    unsigned long lastUsed;
+    int numRunning;              // commands currently running from this entry. They keep it loaded.
+    bool pinned;                 // loaded by ios_preloadCommands, not released when the cache is full
+} commandCacheEntry;
+static commandCacheEntry commandCache[MaxCommandCacheSize];
+static unsigned long commandCacheClock = 0;
+static pthread_mutex_t commandCache_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool isGlobalHandle(void* handle) {
+    // handles that were not obtained through dlopen(), and must not be dlclose()d:
+    return (handle == RTLD_SELF) || (handle == RTLD_MAIN_ONLY) || (handle == RTLD_DEFAULT) || (handle == RTLD_NEXT);
+}
+
+static void commandCacheFreeEntry(commandCacheEntry* entry) {
+    // called with commandCache_mtx locked
+    if ((entry->dlHandle != NULL) && !isGlobalHandle(entry->dlHandle)) dlclose(entry->dlHandle);
+    entry->dlHandle = NULL;
+    entry->function = NULL;
+    entry->commandName[0] = 0;
+    entry->numRunning = 0;
+    entry->pinned = false;
+}
+
+// Returns the cache entry for this command (and marks it as running), or NULL if not in cache.
+static commandCacheEntry* commandCacheLookup(const char* commandName) {
+    if (commandCacheSize <= 0) return NULL;
+    pthread_mutex_lock(&commandCache_mtx);
+    for (int i = 0; i < MaxCommandCacheSize; i++) {
+        commandCacheEntry* entry = &commandCache[i];
+        if ((entry->dlHandle != NULL) && (strcmp(entry->commandName, commandName) == 0)) {
+            entry->numRunning += 1;
+            entry->lastUsed = ++commandCacheClock;
+            pthread_mutex_unlock(&commandCache_mtx);
+            return entry;
+        }
+    }
+    pthread_mutex_unlock(&commandCache_mtx);
+    return NULL;
+}
+
+// Stores a resolved command in the cache. The entry takes ownership of handle, and is marked as running.
+// Returns NULL if there is no space left (all entries are running), in which case the caller keeps ownership.
+static commandCacheEntry* commandCacheInsert(const char* commandName, void* handle, int (*function)(int ac, char** av)) {
+    if (commandCacheSize <= 0) return NULL;
+    if (strlen(commandName) >= NAME_MAX) return NULL;
+    int cacheSize = MIN(commandCacheSize, MaxCommandCacheSize);
+    pthread_mutex_lock(&commandCache_mtx);
+    commandCacheEntry* slot = NULL;
+    for (int i = 0; i < cacheSize; i++) {
+        commandCacheEntry* entry = &commandCache[i];
+        if (entry->dlHandle == NULL) { slot = entry; break; }
+        if ((entry->numRunning > 0) || entry->pinned) continue;
+        if ((slot == NULL) || (entry->lastUsed < slot->lastUsed)) slot = entry;
+    }
+    if (slot == NULL) {
+        pthread_mutex_unlock(&commandCache_mtx);
+        return NULL;
+    }
+    if (slot->dlHandle != NULL) {
+        ios_trace(TraceCommand, @"Command cache full, releasing %s", slot->commandName);
+        commandCacheFreeEntry(slot);
+    }
+    strcpy(slot->commandName, commandName);
+    slot->dlHandle = handle;
+    slot->function = function;
+    slot->numRunning = 1;
+    slot->lastUsed = ++commandCacheClock;
+    pthread_mutex_unlock(&commandCache_mtx);
+    return slot;
+}
+
+// Called when a command terminates: the cache keeps the handle, or we close it if it was not cached.
+static void commandCacheRelease(commandCacheEntry* entry, void* handle) {
+    if (entry == NULL) {
+        if ((handle != NULL) && !isGlobalHandle(handle)) dlclose(handle);
+        return;
+    }
+    pthread_mutex_lock(&commandCache_mtx);
+    entry->numRunning -= 1;
+    if ((entry->numRunning <= 0) && (entry->commandName[0] == 0)) {
+        // entry was invalidated while the command was running
+        commandCacheFreeEntry(entry);
+    }
+    pthread_mutex_unlock(&commandCache_mtx);
+}
+
+// Removes a command (or all commands, if commandName is NULL) from the cache.
+// Running commands keep their handle until they terminate.
+static void commandCacheInvalidate(const char* commandName) {
+    pthread_mutex_lock(&commandCache_mtx);
+    for (int i = 0; i < MaxCommandCacheSize; i++) {
+        commandCacheEntry* entry = &commandCache[i];
+        if (entry->dlHandle == NULL) continue;
+        if ((commandName != NULL) && (strcmp(entry->commandName, commandName) != 0)) continue;
+        if (entry->numRunning > 0) entry->commandName[0] = 0;
+        else commandCacheFreeEntry(entry);
+    }
+    pthread_mutex_unlock(&commandCache_mtx);
+}
+
+// Releases all the libraries kept in the command cache (e.g. when the app receives a memory warning).
+void ios_purgeCommandCache(void) {
+    commandCacheInvalidate(NULL);
+}
+
+// Pipeline stages: the commands of a pipeline ("sort | uniq") run in separate threads under the same pid.
+// For each of them we record bytes transferred and time spent waiting on the pipes, for ios_pipelineReport.
+// Waits and bytes read are only measured on in-process pipes (useInProcessPipes): kernel pipes block
+// inside read() and write().
+#define MaxPipelineStages 16
+#define PipelineHistory 32 // pipelines kept for ios_pipelineReport, including the ones that have terminated
+typedef struct _stageRecord {
+    ios_pipelineStage stats;
+    struct timeval start;
+    unsigned long long bytesAtStart; // pool threads keep their output counter from one command to the next
+    double userAtStart;              // and their CPU times
+    double systemAtStart;
+} stageRecord;
+
+typedef struct _pipelineRecord {
+    pid_t pid;
+    int numStages; // in the order they were started, which is the reverse of the pipeline
+    stageRecord stages[MaxPipelineStages];
+} pipelineRecord;
+static pipelineRecord pipelineRecords[PipelineHistory];
+static int nextPipelineRecord = 0;
+static pthread_mutex_t pipeline_mtx = PTHREAD_MUTEX_INITIALIZER;
+static __thread stageRecord* threadStage = NULL; // stage of the command running in this thread
+extern unsigned long long ios_threadBytesOut(void);
+extern __thread void* threadOutputCoalescer; // session whose coalesced stdout the command writes to (libc_replacement.c)
+extern void ios_threadTimes(double* user, double* system);
+
+static double elapsedSince(const struct timeval* start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) * 1e-6;
+}
+
+static bool pipelineRunning(const pipelineRecord* record) {
+    for (int i = 0; i < record->numStages; i++)
+        if (record->stages[i].stats.running) return true;
+    return false;
+}
+
+// Called before starting a command that reads from or writes to a pipe:
+static stageRecord* addPipelineStage(pid_t pid, const char* command) {
+    pthread_mutex_lock(&pipeline_mtx);
+    pipelineRecord* record = NULL;
+    for (int i = 0; i < PipelineHistory; i++) {
+        if ((pipelineRecords[i].pid == pid) && pipelineRunning(&pipelineRecords[i])) { record = &pipelineRecords[i]; break; }
+    }
+    if (record == NULL) {
+        // New pipeline, in place of the oldest one that has terminated:
+        for (int i = 0; i < PipelineHistory; i++) {
+            pipelineRecord* candidate = &pipelineRecords[(nextPipelineRecord + i) % PipelineHistory];
+            if (!pipelineRunning(candidate)) {
+                record = candidate;
+                record->pid = pid;
+                record->numStages = 0;
+                nextPipelineRecord = (nextPipelineRecord + i + 1) % PipelineHistory;
+                break;
+            }
+        }
+    }
+    stageRecord* stage = NULL;
+    if ((record != NULL) && (record->numStages < MaxPipelineStages)) {
+        stage = &record->stages[record->numStages++];
+        memset(stage, 0, sizeof(stageRecord));
+        strlcpy(stage->stats.command, command, sizeof(stage->stats.command));
+        stage->stats.running = true;
+        gettimeofday(&stage->start, NULL);
+    }
+    pthread_mutex_unlock(&pipeline_mtx);
+    return stage;
+}
+
+// In the thread of the stage, when the command starts and when it ends:
+static void startPipelineStage(stageRecord* stage) {
+    threadStage = stage;
+    if (stage == NULL) return;
+    stage->bytesAtStart = ios_threadBytesOut();
+    ios_threadTimes(&stage->userAtStart, &stage->systemAtStart);
+}
+
+static void endPipelineStage(stageRecord* stage) {
+    threadStage = NULL;
+    if (stage == NULL) return;
+    double user, system;
+    ios_threadTimes(&user, &system);
+    pthread_mutex_lock(&pipeline_mtx);
+    stage->stats.bytesOut = ios_threadBytesOut() - stage->bytesAtStart;
+    stage->stats.userTime = user - stage->userAtStart;
+    stage->stats.systemTime = system - stage->systemAtStart;
+    stage->stats.wallTime = elapsedSince(&stage->start);
+    stage->stats.running = false;
+    pthread_mutex_unlock(&pipeline_mtx);
+}
+
+int ios_pipelineReport(pid_t pid, ios_pipelineStage* stages, int maxStages) {
+    pthread_mutex_lock(&pipeline_mtx);
+    // The most recent pipeline for this pid:
+    pipelineRecord* record = NULL;
+    for (int i = 1; i <= PipelineHistory; i++) {
+        pipelineRecord* candidate = &pipelineRecords[(nextPipelineRecord + PipelineHistory - i) % PipelineHistory];
+        if ((candidate->numStages > 0) && (candidate->pid == pid)) { record = candidate; break; }
+    }
+    int numStages = 0;
+    if (record != NULL) {
+        // First command of the pipeline first:
+        for (int i = record->numStages - 1; (i >= 0) && (numStages < maxStages); i--) {
+            stageRecord* stage = &record->stages[i];
+            stages[numStages] = stage->stats;
+            if (stage->stats.running) stages[numStages].wallTime = elapsedSince(&stage->start);
+            numStages++;
+        }
+    }
+    pthread_mutex_unlock(&pipeline_mtx);
+    return numStages;
+}
+
+// Free space of the mounted volumes, for UI code (ios_volumeStats). statfs() on a File Provider or network
+// volume can take seconds, so callers get the values measured last, and the volumes measured more than
+// VolumeStatsMaxAge ago are measured again in the background, each on its own so a slow one doesn't hold the others.
+#define VolumeStatsMaxAge 5.0 // seconds
+typedef struct _volumeRecord {
+    ios_volume stats;
+    struct timeval measured; // zero until a statfs() has returned
+    bool refreshing;
+} volumeRecord;
+static volumeRecord* volumeRecords = NULL;
+static int numVolumeRecords = 0;
+static pthread_mutex_t volume_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static void volumeFromStatfs(ios_volume* volume, const struct statfs* sfs) {
+    strlcpy(volume->mountPoint, sfs->f_mntonname, sizeof(volume->mountPoint));
+    strlcpy(volume->fsType, sfs->f_fstypename, sizeof(volume->fsType));
+    volume->totalBytes = (unsigned long long)sfs->f_blocks * sfs->f_bsize;
+    volume->freeBytes = (unsigned long long)sfs->f_bfree * sfs->f_bsize;
+    volume->availableBytes = (unsigned long long)sfs->f_bavail * sfs->f_bsize;
+    volume->totalFiles = sfs->f_files;
+    volume->freeFiles = sfs->f_ffree;
+}
+
+static volumeRecord* volumeLookup(const char* mountPoint) {
+    for (int i = 0; i < numVolumeRecords; i++)
+        if (strcmp(volumeRecords[i].stats.mountPoint, mountPoint) == 0) return &volumeRecords[i];
+    return NULL;
+}
+
+// The list of volumes, from the values the system keeps (MNT_NOWAIT does not ask the volumes).
+// Called with volume_mtx held; keeps what was measured for the volumes still mounted.
+static void updateVolumeList(void) {
+    int count = getfsstat(NULL, 0, MNT_NOWAIT);
+    if (count <= 0) return;
+    struct statfs* mounts = malloc((count + 4) * sizeof(struct statfs)); // room for volumes mounted meanwhile
+    if (mounts == NULL) return;
+    count = getfsstat(mounts, (int)((count + 4) * sizeof(struct statfs)), MNT_NOWAIT);
+    volumeRecord* records = (count > 0) ? calloc(count, sizeof(volumeRecord)) : NULL;
+    if (records == NULL) {
+        free(mounts);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        volumeRecord* known = volumeLookup(mounts[i].f_mntonname);
+        if (known != NULL) records[i] = *known;
+        else {
+            volumeFromStatfs(&records[i].stats, &mounts[i]);
+            records[i].stats.age = -1;
+        }
+    }
+    free(volumeRecords);
+    volumeRecords = records;
+    numVolumeRecords = count;
+    free(mounts);
+}
+
+static void refreshVolume(volumeRecord* record) {
+    char* mountPoint = strdup(record->stats.mountPoint);
+    if (mountPoint == NULL) return;
+    record->refreshing = true;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        struct statfs sfs;
+        int result = statfs(mountPoint, &sfs);
+        pthread_mutex_lock(&volume_mtx);
+        // The list may have been rebuilt while we waited:
+        volumeRecord* current = volumeLookup(mountPoint);
+        if (current != NULL) {
+            if (result == 0) {
+                volumeFromStatfs(&current->stats, &sfs);
+                gettimeofday(&current->measured, NULL);
+            }
+            current->refreshing = false;
+        }
+        pthread_mutex_unlock(&volume_mtx);
+        free(mountPoint);
+    });
+}
+
+int ios_volumeStats(const char* path, ios_volume* volumes, int maxVolumes) {
+    char absolutePath[MAXPATHLEN];
+    if ((path != NULL) && (path[0] != '/')) {
+        // Only the name is used, the path itself is not looked at:
+        if (getcwd(absolutePath, sizeof(absolutePath)) == NULL) return 0;
+        strlcat(absolutePath, "/", sizeof(absolutePath));
+        strlcat(absolutePath, path, sizeof(absolutePath));
+        path = absolutePath;
+    }
+    pthread_mutex_lock(&volume_mtx);
+    updateVolumeList();
+    volumeRecord* found = NULL;
+    size_t foundLength = 0;
+    for (int i = 0; i < numVolumeRecords; i++) {
+        volumeRecord* record = &volumeRecords[i];
+        if (record->measured.tv_sec != 0) record->stats.age = elapsedSince(&record->measured);
+        if (!record->refreshing && ((record->stats.age < 0) || (record->stats.age > VolumeStatsMaxAge)))
+            refreshVolume(record);
+        if (path == NULL) continue;
+        // The volume with the longest mount point containing path:
+        const char* mountPoint = record->stats.mountPoint;
+        size_t length = strlen(mountPoint);
+        if ((length >= foundLength) && (strncmp(path, mountPoint, length) == 0) &&
+            ((path[length] == '/') || (path[length] == 0) || (strcmp(mountPoint, "/") == 0))) {
+            found = record;
+            foundLength = length;
+        }
+    }
+    int numVolumes = 0;
+    if (path == NULL) {
+        for (; (numVolumes < numVolumeRecords) && (numVolumes < maxVolumes); numVolumes++)
+            volumes[numVolumes] = volumeRecords[numVolumes].stats;
+    } else if ((found != NULL) && (maxVolumes > 0)) {
+        volumes[numVolumes++] = found->stats;
+    }
+    pthread_mutex_unlock(&volume_mtx);
+    return numVolumes;
+}
+
 typedef struct _functionParameters {
     int argc;
     char** argv;
-    char** argv_ref;
+    void* argvBlock; // argv and its strings, in a single allocation (see packArguments)
     int (*function)(int ac, char** av);
     FILE *stdin, *stdout, *stderr;
     void* context;
     void* dlHandle;
+    commandCacheEntry* cacheEntry; // NULL if dlHandle is not in the command cache
+    interpreterGroup* interpreter; // python, perl... with several copies (NULL for other commands)
+    int interpreterSlot;           // the copy running this command
     bool isPipeOut;
     bool isPipeErr;
+    bool isChannelIn; // stdin is the reading end of an in-process pipe, created for this command
+    bool isPipeIn;    // stdin comes from a pipe or popen
+    stageRecord* stage; // if the command is part of a pipeline
     sessionParameters* session;
+#if IOS_SYSTEM_TRACE
+    os_signpost_id_t signpost;
+#endif
 } functionParameters;
 
+static int scanOpenDescriptors(void) {
+    int numOpen = 0;
+    for (int fd = 0; fd < limitFilesOpen.rlim_cur; fd++) {
+        errno = 0;
+        int flags = fcntl(fd, F_GETFD, 0);
+        if (flags == -1 && errno) {
+            continue;
+        }
+        ++numOpen;
+    }
+    return numOpen;
+}
+
+static inline void trackDescriptors(int n) {
+    numFileDescriptorsOpen += n;
+}
+
+static int closeTrackedStream(FILE* stream) {
+    int fd = fileno(stream); // -1 for in-process pipes
+    int res = fclose(stream);
+    if ((res == 0) && (fd >= 0)) trackDescriptors(-1);
+    return res;
+}
+
+// Buffering of the pipes and redirected files created by ios_system. A large buffer with full buffering
+// gives the best throughput for pipelines; line buffering is better for interactive sessions, where
+// commands print their progress. pipeBufferingMode is _IOFBF, _IOLBF, _IONBF or -1 (system default).
+// The environment variable IOS_SYSTEM_BUFFERING (full, line, none or default) overrides it for a session.
+int pipeBufferingMode = _IOFBF;
+size_t pipeBufferSize = 256 * 1024;
+
+// Progress of the large files copied by cp, for host apps that want to show it (cp also prints it on SIGINFO).
+void (*ios_copyProgress)(const char* source, const char* destination, off_t copied, off_t total) = NULL;
+
+static int currentBufferingMode(void) {
+    const char* mode = ios_getenv("IOS_SYSTEM_BUFFERING");
+    if (mode == NULL) return pipeBufferingMode;
+    if (strcmp(mode, "full") == 0) return _IOFBF;
+    if (strcmp(mode, "line") == 0) return _IOLBF;
+    if (strcmp(mode, "none") == 0) return _IONBF;
+    if (strcmp(mode, "default") == 0) return -1;
+    return pipeBufferingMode;
+}
+
+// Must be called before the first read or write on stream.
+static void setStreamBuffering(FILE* stream, bool forWriting) {
+    if (stream == NULL) return;
+    int mode = currentBufferingMode();
+    if (mode < 0) return;
+    // Line buffering makes no difference for reading, but a large buffer does:
+    if (!forWriting) mode = _IOFBF;
+    if (mode == _IONBF) setvbuf(stream, NULL, _IONBF, 0);
+    else setvbuf(stream, NULL, mode, pipeBufferSize);
+}
+
+// In-process pipes: all the commands of a pipeline are threads in the same process, so there is no need
+// to send the data through the kernel. A channel is a ring buffer with one writer and one reader, with a
+// FILE* for each end (funopen). They have no file descriptor (fileno() returns -1), so they are only used
+// when useInProcessPipes is set, by apps whose commands only access pipes through stdio.
+bool useInProcessPipes = false;
+#define ChannelBufferSize (1024 * 1024)
+
+typedef struct _pipeChannel {
+    char* buffer;
+    _Atomic(size_t) readPosition;  // total number of bytes read
+    _Atomic(size_t) writePosition; // total number of bytes written
+    _Atomic(bool) readerClosed;
+    _Atomic(bool) writerClosed;
+    _Atomic(int) numWaiting;       // threads waiting on changed. If 0, no need to take the mutex.
+    _Atomic(int) refCount;         // one for each end
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+} pipeChannel;
+
+static void channelNotify(pipeChannel* channel) {
+    if (channel->numWaiting == 0) return;
+    pthread_mutex_lock(&channel->mutex);
+    pthread_cond_broadcast(&channel->changed);
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+static void channelUnlock(void* mutex) {
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+// Wait until the channel is no longer empty (reader) or full (writer), or the other end is closed.
+static void channelWait(pipeChannel* channel, bool reader) {
+    struct timeval start;
+    if (threadStage != NULL) gettimeofday(&start, NULL);
+    channel->numWaiting++;
+    pthread_mutex_lock(&channel->mutex);
+    pthread_cleanup_push(channelUnlock, &channel->mutex); // commands can be cancelled while waiting
+    if (reader) {
+        if ((channel->writePosition == channel->readPosition) && !channel->writerClosed)
+            pthread_cond_wait(&channel->changed, &channel->mutex);
+    } else {
+        if ((channel->writePosition - channel->readPosition == ChannelBufferSize) && !channel->readerClosed)
+            pthread_cond_wait(&channel->changed, &channel->mutex);
+    }
+    pthread_cleanup_pop(1);
+    channel->numWaiting--;
+    if (threadStage != NULL) {
+        // reader: the previous stage is too slow. writer: the next stage is too slow.
+        if (reader) threadStage->stats.blockedOnRead += elapsedSince(&start);
+        else threadStage->stats.blockedOnWrite += elapsedSince(&start);
+    }
+}
+
+static int channelRead(void* cookie, char* data, int length) {
+    pipeChannel* channel = (pipeChannel*) cookie;
+    size_t available;
+    while ((available = channel->writePosition - channel->readPosition) == 0) {
+        if (channel->writerClosed) {
+            // The writer may have written something just before closing:
+            if (channel->writePosition != channel->readPosition) continue;
+            return 0; // EOF
+        }
+        channelWait(channel, true);
+    }
+    if (available > length) available = length;
+    size_t start = channel->readPosition % ChannelBufferSize;
+    size_t first = MIN(available, ChannelBufferSize - start);
+    memcpy(data, channel->buffer + start, first);
+    memcpy(data + first, channel->buffer, available - first);
+    channel->readPosition += available;
+    if (threadStage != NULL) threadStage->stats.bytesIn += available;
+    channelNotify(channel);
+    return (int) available;
+}
+
+static int channelWrite(void* cookie, const char* data, int length) {
+    pipeChannel* channel = (pipeChannel*) cookie;
+    size_t space;
+    while ((space = ChannelBufferSize - (channel->writePosition - channel->readPosition)) == 0) {
+        if (channel->readerClosed) break;
+        channelWait(channel, false);
+    }
+    if (channel->readerClosed) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (space > length) space = length;
+    size_t start = channel->writePosition % ChannelBufferSize;
+    size_t first = MIN(space, ChannelBufferSize - start);
+    memcpy(channel->buffer + start, data, first);
+    memcpy(channel->buffer, data + first, space - first);
+    channel->writePosition += space;
+    channelNotify(channel);
+    return (int) space;
+}
+
+static void channelRelease(pipeChannel* channel) {
+    if (--channel->refCount > 0) return;
+    pthread_mutex_destroy(&channel->mutex);
+    pthread_cond_destroy(&channel->changed);
+    free(channel->buffer);
+    free(channel);
+}
+
+static int channelCloseReader(void* cookie) {
+    pipeChannel* channel = (pipeChannel*) cookie;
+    channel->readerClosed = true;
+    channelNotify(channel);
+    channelRelease(channel);
+    return 0;
+}
+
+static int channelCloseWriter(void* cookie) {
+    pipeChannel* channel = (pipeChannel*) cookie;
+    channel->writerClosed = true;
+    channelNotify(channel);
+    channelRelease(channel);
+    return 0;
+}
+
+static bool openChannel(FILE** reader, FILE** writer) {
+    pipeChannel* channel = calloc(1, sizeof(pipeChannel));
+    if (channel == NULL) return false;
+    channel->buffer = malloc(ChannelBufferSize);
+    if (channel->buffer == NULL) {
+        free(channel);
+        return false;
+    }
+    pthread_mutex_init(&channel->mutex, NULL);
+    pthread_cond_init(&channel->changed, NULL);
+    channel->refCount = 2;
+    *reader = funopen(channel, channelRead, NULL, NULL, channelCloseReader);
+    *writer = funopen(channel, NULL, channelWrite, NULL, channelCloseWriter);
+    setStreamBuffering(*reader, false);
+    setStreamBuffering(*writer, true);
+    return true;
+}
+
+static bool isChannelReader(FILE* stream) {
+    return (stream != NULL) && (stream->_read == channelRead);
+}
+
+int ios_openDescriptorCount(void) {
+    return numFileDescriptorsOpen;
+}
+
+// Before starting a command, do we have enough file descriptors available?
+static void ensureDescriptorsAvailable(void) {
+    // We assume 128 file descriptors will be enough for a single command.
+    if ((numFileDescriptorsOpen + 128 > limitFilesOpen.rlim_cur) || (++launchesSinceDescriptorScan >= DescriptorRescanInterval)) {
+        // The count could be off, because of files opened or closed by the commands themselves:
+        numFileDescriptorsOpen = scanOpenDescriptors();
+        launchesSinceDescriptorScan = 0;
+    }
+    if (numFileDescriptorsOpen + 128 > limitFilesOpen.rlim_cur) {
+        limitFilesOpen.rlim_cur += 1024;
+        int res = setrlimit(RLIMIT_NOFILE, &limitFilesOpen);
+        if (res == 0) NSLog(@"[Info] Increased file descriptor limit to = %llu\n", limitFilesOpen.rlim_cur);
+        else NSLog(@"[Warning] Failed to increased file descriptor limit to = %llu\n", limitFilesOpen.rlim_cur);
+    }
+}
+
 extern pthread_mutex_t pid_mtx;
 extern _Atomic(int) cleanup_counter;
+extern void ios_startCleanup(void);
+extern void ios_endCleanup(void);
+extern void ios_waitForCleanup(void);
+extern int ios_condTimedWait(pthread_cond_t* cond, pthread_mutex_t* mtx, long timeout_nsec);
+extern void ios_addTimeSpentWaiting(const struct timeval* start);
 static void cleanup_function(void* parameters) {
     // This function is called when pthread_exit() or ios_kill() is called
     functionParameters *p = (functionParameters *) parameters;
     char* commandName = p->argv[0];
-    NSLog(@"cleanup_function: %s thread_id %x pid: %d stdin %d stdout %d stderr %d isPipeOut %d", commandName, pthread_self(), ios_currentPid(), fileno(p->stdin), fileno(p->stdout), fileno(p->stderr), p->isPipeOut);
-    NSLog(@"currentSession->commandName: %s", currentSession->commandName);
+    ios_trace(TraceThread, @"cleanup_function: %s thread_id %x pid: %d stdin %d stdout %d stderr %d isPipeOut %d", commandName, pthread_self(), ios_currentPid(), fileno(p->stdin), fileno(p->stdout), fileno(p->stderr), p->isPipeOut);
+    ios_trace(TraceThread, @"currentSession->commandName: %s", currentSession->commandName);
+#if IOS_SYSTEM_TRACE
+    os_signpost_interval_end(traceLog(), p->signpost, "command", "%{public}s", commandName);
+#endif
     if ((strcmp(commandName, "less") == 0) || (strcmp(commandName, "more") == 0)) {
         if ((strlen(currentSession->commandName) > 0) && (strcmp(currentSession->commandName, "less") != 0) && (strcmp(currentSession->commandName, "more") != 0)) {
             // Command was "root_command | sthg | less". We need to kill root command.
             // If less itself started another command, then currentSession->commandName is "".
             // Unless less / more was started as a pager, in which case don't kill root command (e.g. for man).
+            ios_interruptThread(currentSession->current_command_root_thread);
             pthread_kill(currentSession->current_command_root_thread, SIGINT);
-            while (fgetc(thread_stdin) != EOF) { } // flush input, otherwise previous command gets blocked.
+            // flush input, otherwise previous command gets blocked. In large blocks, not one character at a time:
+            char discard[16384];
+            while (fread(discard, 1, sizeof(discard), thread_stdin) > 0) { }
         }
         currentSession->activePager = FALSE;
     }
@@ -311,57 +1323,38 @@ static void cleanup_function(void* parameters) {
     if ((!joinMainThread) && p->isPipeOut && (strcmp(commandName, "ssh") != 0)) {
         if (currentSession->current_command_root_thread != 0) {
             if (currentSession->current_command_root_thread != pthread_self()) {
-                NSLog(@"Thread %x is waiting for root_thread of currentSession: %x \n", pthread_self(), currentSession->current_command_root_thread);
-                while ((currentSession->current_command_root_thread != 0) && (currentSession->current_command_root_thread != pthread_self())) { }
-                NSLog(@"Thread %x is done waiting for root_thread of currentSession: %x \n", pthread_self(), currentSession->current_command_root_thread);
+                ios_trace(TraceThread, @"Thread %x is waiting for root_thread of currentSession: %x \n", pthread_self(), currentSession->current_command_root_thread);
+                struct timeval start;
+                gettimeofday(&start, NULL);
+                pthread_mutex_lock(&currentSession->stateMutex);
+                while ((currentSession->current_command_root_thread != 0) && (currentSession->current_command_root_thread != pthread_self())) {
+                    // current_command_root_thread is also reset in places that don't signal, hence the timeout:
+                    ios_condTimedWait(&currentSession->stateChanged, &currentSession->stateMutex, 10 * 1000 * 1000);
+                }
+                pthread_mutex_unlock(&currentSession->stateMutex);
+                ios_addTimeSpentWaiting(&start);
+                ios_trace(TraceThread, @"Thread %x is done waiting for root_thread of currentSession: %x \n", pthread_self(), currentSession->current_command_root_thread);
             } else {
-                NSLog(@"Terminating root_thread of currentSession %x \n", pthread_self());
+                ios_trace(TraceThread, @"Terminating root_thread of currentSession %x \n", pthread_self());
                 currentSession->current_command_root_thread = 0;
+                sessionStateChanged(currentSession);
             }
         }
     }
     fflush(thread_stdin);
     fflush(thread_stdout);
-    fflush(thread_stderr);
+    if (thread_stderr != thread_stdout) fflush(thread_stderr);
+    threadOutputCoalescer = NULL;
+    endPipelineStage(p->stage);
     // release parameters:
-    NSLog(@"Terminating command: %s thread_id %x stdin %d stdout %d stderr %d isPipeOut %d", commandName, pthread_self(), fileno(p->stdin), fileno(p->stdout), fileno(p->stderr), p->isPipeOut);
-    // Specific to run multiple python3 interpreters:
-    if (strncmp(commandName, "python", 6) == 0) {
-        // It could be one of the multiple python3 interpreters
-        if (strlen(commandName) == 6) { // "python"
-            PythonIsRunning[0] = false;
-        } else if (strlen(commandName) == strlen("python") + 1) { // python3, pythonA...
-            char commandNumber = commandName[6];
-            if (commandNumber == '3') PythonIsRunning[0] = false;
-            else {
-                commandNumber -= 'A' - 1;
-                if ((commandNumber > 0) && (commandNumber < MaxPythonInterpreters))
-                    PythonIsRunning[commandNumber] = false;
-            }
-        }
-    }
-    // Same with multiple perl interpreters:
-    else if (strncmp(commandName, "perl", 4) == 0) {
-        NSLog(@"Ending a Perl interpreter: %s", commandName);
-        // It could be one of the multiple perl interpreters
-        if (strlen(commandName) == 4) { // "perl"
-            PerlIsRunning[0] = false;
-            NSLog(@"Reset PerlIsRunning for %d, with command: %s", 0, commandName);
-        } else if (strlen(commandName) == strlen("perl") + 1) { // perlA...
-            char commandNumber = commandName[4];
-            commandNumber -= 'A' - 1;
-            if ((commandNumber > 0) && (commandNumber < MaxPerlInterpreters))
-                PerlIsRunning[commandNumber] = false;
-            NSLog(@"Reset PerlIsRunning for %d, with command: %s", commandNumber, commandName);
-        }
-    }
+    ios_trace(TraceThread, @"Terminating command: %s thread_id %x stdin %d stdout %d stderr %d isPipeOut %d", commandName, pthread_self(), fileno(p->stdin), fileno(p->stdout), fileno(p->stderr), p->isPipeOut);
+    // Specific to interpreters with multiple copies (python, perl...):
+    releaseInterpreterSlot(p->interpreter, p->interpreterSlot);
     if (strcmp(currentSession->commandName, commandName) == 0) {
         currentSession->commandName[0] = 0;
     }
     bool isSh = strcmp(p->argv[0], "sh") == 0;
-    for (int i = 0; i < p->argc; i++) free(p->argv_ref[i]);
-    free(p->argv_ref);
-    free(p->argv);
+    free(p->argvBlock); // all the arguments, even if the command changed argv
     bool isLastThread = (currentSession->lastThreadId == pthread_self());
     // Required for Jupyter. Must check for Blink/LibTerm/iVim:
     // Is that the issue in iVim?
@@ -374,12 +1367,12 @@ static void cleanup_function(void* parameters) {
         }
     }
     // Some programs stop waiting as soon as stdout/stderr close (which makes sense)
-    cleanup_counter++;
-    while (pthread_mutex_trylock(&pid_mtx) != 0) { } // Someone else has the lock, so we wait.
+    ios_startCleanup();
+    pthread_mutex_lock(&pid_mtx); // If someone else has the lock, we wait (without spinning).
     pthread_mutex_unlock(&pid_mtx);
     if (mustCloseStderr) {
-        NSLog(@"Closing stderr (mustCloseStderr): %d \n", fileno(p->stderr));
-        int res = fclose(p->stderr);
+        ios_trace(TraceStreams, @"Closing stderr (mustCloseStderr): %d \n", fileno(p->stderr));
+        int res = closeTrackedStream(p->stderr);
     }
     bool mustCloseStdout = fileno(p->stdout) != fileno(stdout);
     if (!isSh) {
@@ -389,18 +1382,20 @@ static void cleanup_function(void* parameters) {
         }
     }
     if (mustCloseStdout) {
-        NSLog(@"Closing stdout (mustCloseStdout): %d \n", fileno(p->stdout));
-        int res = fclose(p->stdout);
+        ios_trace(TraceStreams, @"Closing stdout (mustCloseStdout): %d \n", fileno(p->stdout));
+        int res = closeTrackedStream(p->stdout);
+    }
+    if (p->isChannelIn && isChannelReader(p->stdin)) {
+        // Nobody else reads from this in-process pipe. Closing it tells the writer to stop.
+        fclose(p->stdin);
     }
-    if ((p->dlHandle != RTLD_SELF) && (p->dlHandle != RTLD_MAIN_ONLY)
-        && (p->dlHandle != RTLD_DEFAULT) && (p->dlHandle != RTLD_NEXT))
-        dlclose(p->dlHandle);
+    commandCacheRelease(p->cacheEntry, p->dlHandle);
     free(parameters); // This was malloc'ed in ios_system
     if (isLastThread) {
-        NSLog(@"Terminating lastthread of currentSession %x lastThreadId %x pid: %d\n", pthread_self(), currentSession->lastThreadId, ios_currentPid());
+        ios_trace(TraceThread, @"Terminating lastthread of currentSession %x lastThreadId %x pid: %d\n", pthread_self(), currentSession->lastThreadId, ios_currentPid());
         currentSession->lastThreadId = 0;
     } else {
-        NSLog(@"Current thread %x lastthread %x pid: %d\n", pthread_self(), currentSession->lastThreadId, ios_currentPid());
+        ios_trace(TraceThread, @"Current thread %x lastthread %x pid: %d\n", pthread_self(), currentSession->lastThreadId, ios_currentPid());
     }
     ios_releaseThread(pthread_self());
     if (currentSession->current_command_root_thread == pthread_self()) {
@@ -409,7 +1404,8 @@ static void cleanup_function(void* parameters) {
     if (currentSession->mainThreadId == pthread_self()) {
         currentSession->mainThreadId = 0;
     }
-    cleanup_counter--;
+    sessionStateChanged(currentSession);
+    ios_endCleanup();
 }
 
 // Avoir calling crash_handler several times:
@@ -429,20 +1425,26 @@ void crash_handler(int sig) {
 
 static void* run_function(void* parameters) {
     functionParameters *p = (functionParameters *) parameters;
-    NSLog(@"Storing thread_id: %x pid: %d isPipeOut: %x isPipeErr: %x stdin %d stdout %d stderr %d command= %s\n", pthread_self(), ios_currentPid(), p->isPipeOut, p->isPipeErr, fileno(p->stdin), fileno(p->stdout), fileno(p->stderr), p->argv[0]);
+    crash_handler_called = false; // the thread may have been used by a previous command
+    ios_trace(TraceThread, @"Storing thread_id: %x pid: %d isPipeOut: %x isPipeErr: %x stdin %d stdout %d stderr %d command= %s\n", pthread_self(), ios_currentPid(), p->isPipeOut, p->isPipeErr, fileno(p->stdin), fileno(p->stdout), fileno(p->stderr), p->argv[0]);
     ios_storeThreadId(pthread_self());
+#if IOS_SYSTEM_TRACE
+    p->signpost = os_signpost_id_generate(traceLog());
+    os_signpost_interval_begin(traceLog(), p->signpost, "command", "%{public}s", p->argv[0]);
+#endif
     // NSLog(@"Starting command: %s thread_id %x", p->argv[0], pthread_self());
-    // re-initialize for getopt:
-    // TODO: move to __thread variable for optind too
-    optind = 1;
-    opterr = 1;
-    optreset = 1;
+    // re-initialize for getopt (its state is per thread, but threads can be reused):
+    thread_optind = 1;
+    thread_opterr = 1;
+    thread_optreset = 1;
     __db_getopt_reset = 1;
     thread_stdin  = p->stdin;
     thread_stdout = p->stdout;
     thread_stderr = p->stderr;
     thread_context = p->context;
     currentSession = p->session;
+    threadOutputCoalescer = ((currentSession != NULL) && (currentSession->coalescedStream != NULL) && (p->stdout == currentSession->coalescedStream)) ? currentSession : NULL;
+    startPipelineStage(p->stage);
     if ((strcmp(p->argv[0], "less") == 0) || (strcmp(p->argv[0], "more") == 0)) {
         if (currentSession != nil) currentSession->activePager = TRUE;
     }
@@ -450,9 +1452,6 @@ static void* run_function(void* parameters) {
     signal(SIGSEGV, crash_handler);
     signal(SIGBUS, crash_handler);
 
-    // Because some commands change argv, keep a local copy for release.
-    p->argv_ref = (char **)malloc(sizeof(char*) * (p->argc + 1));
-    for (int i = 0; i < p->argc; i++) p->argv_ref[i] = p->argv[i];
     pthread_cleanup_push(cleanup_function, parameters);
     @try
     {
@@ -475,14 +1474,174 @@ static void* run_function(void* parameters) {
     }
 }
 
+// Pool of threads for running commands: creating a thread (and its stack) is expensive for short commands,
+// so we keep a few idle threads around. A command that terminates with pthread_exit() (through exit(),
+// err() or ios_kill) also terminates its thread, which is replaced when needed.
+// Interpreters (python, perl, lua...) always run in their own thread, with interpreterStackSize.
+// Pool threads are detached, so they must be waited for with joinCommandThread(), not pthread_join().
+#define MaxThreadPoolSize 32
+int threadPoolSize = 4; // Apps can overwrite this (up to MaxThreadPoolSize). 0 disables the pool.
+size_t commandStackSize = 0; // stack size for command threads. 0 = system default.
+size_t interpreterStackSize = 0; // stack size for interpreters. 0 = system default.
+typedef struct _poolWorker {
+    pthread_t thread;          // 0 if the slot is empty
+    functionParameters* job;   // command to run, NULL if the thread is idle
+    bool busy;                 // a command was given to this thread and has not terminated yet
+} poolWorker;
+static poolWorker threadPool[MaxThreadPoolSize];
+static pthread_mutex_t threadPool_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t threadPool_changed = PTHREAD_COND_INITIALIZER;
+// Where to direct input/output of the next thread (defined below). Reset between two commands:
+static __thread FILE* child_stdin;
+static __thread FILE* child_stdout;
+static __thread FILE* child_stderr;
+
+static bool isInterpreter(const char* commandName) {
+    const char* interpreters[] = {"python", "ipython", "perl", "lua", "wasm", "lli", "jsc", "tex", "pdftex", "luatex", "lualatex", "pdflatex", NULL};
+    for (int i = 0; interpreters[i] != NULL; i++) {
+        if (strncmp(commandName, interpreters[i], strlen(interpreters[i])) == 0) return true;
+    }
+    return false;
+}
+
+static void threadPoolWorkerExit(void* arg) {
+    // The command called pthread_exit() or was cancelled: this thread is lost for the pool.
+    poolWorker* worker = (poolWorker*) arg;
+    pthread_mutex_lock(&threadPool_mtx);
+    worker->thread = 0;
+    worker->job = NULL;
+    worker->busy = false;
+    pthread_cond_broadcast(&threadPool_changed);
+    pthread_mutex_unlock(&threadPool_mtx);
+}
+
+static void* threadPoolWorker(void* arg) {
+    poolWorker* worker = (poolWorker*) arg;
+    pthread_cleanup_push(threadPoolWorkerExit, worker);
+    while (true) {
+        // Idle threads can't be cancelled (pthread_cond_wait is a cancellation point):
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        pthread_mutex_lock(&threadPool_mtx);
+        while (worker->job == NULL) pthread_cond_wait(&threadPool_changed, &threadPool_mtx);
+        functionParameters* job = worker->job;
+        pthread_mutex_unlock(&threadPool_mtx);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        run_function(job);
+        // Reset thread-local state before the next command:
+        thread_stdin = NULL;
+        thread_stdout = NULL;
+        thread_stderr = NULL;
+        thread_context = NULL;
+        child_stdin = child_stdout = child_stderr = NULL;
+        pthread_mutex_lock(&threadPool_mtx);
+        worker->job = NULL;
+        worker->busy = false;
+        pthread_cond_broadcast(&threadPool_changed);
+        pthread_mutex_unlock(&threadPool_mtx);
+    }
+    pthread_cleanup_pop(0);
+    return NULL;
+}
+
+static int createThread(pthread_t* tid, size_t stackSize, bool detached, void *(*start)(void *), void* arg) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (stackSize > 0) pthread_attr_setstacksize(&attr, stackSize);
+    if (detached) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int result = pthread_create(tid, &attr, start, arg);
+    pthread_attr_destroy(&attr);
+    return result;
+}
+
+// Called with threadPool_mtx locked:
+static int createPoolWorker(poolWorker* worker) {
+    worker->job = NULL;
+    worker->busy = false;
+    return createThread(&worker->thread, commandStackSize, true, threadPoolWorker, worker);
+}
+
+// Create the threads of the pool in advance:
+static void prewarmThreadPool(void) {
+    int poolSize = MIN(threadPoolSize, MaxThreadPoolSize);
+    pthread_mutex_lock(&threadPool_mtx);
+    for (int i = 0; i < poolSize; i++) {
+        if (threadPool[i].thread == 0) {
+            if (createPoolWorker(&threadPool[i]) != 0) threadPool[i].thread = 0;
+        }
+    }
+    pthread_mutex_unlock(&threadPool_mtx);
+}
+
+// Start the command in params, in a thread from the pool if possible, and store the thread in tid.
+static int startCommandThread(pthread_t* tid, functionParameters* params) {
+    bool interpreter = isInterpreter(params->argv[0]);
+    int poolSize = MIN(threadPoolSize, MaxThreadPoolSize);
+    if (!interpreter && (poolSize > 0)) {
+        pthread_mutex_lock(&threadPool_mtx);
+        poolWorker* worker = NULL;
+        for (int i = 0; i < poolSize; i++) {
+            if ((threadPool[i].thread != 0) && !threadPool[i].busy) { worker = &threadPool[i]; break; }
+        }
+        if (worker == NULL) {
+            // No idle thread. Create a new one if there is an empty slot:
+            for (int i = 0; i < poolSize; i++) {
+                if (threadPool[i].thread == 0) {
+                    if (createPoolWorker(&threadPool[i]) == 0) worker = &threadPool[i];
+                    else threadPool[i].thread = 0;
+                    break;
+                }
+            }
+        }
+        if (worker != NULL) {
+            worker->busy = true;
+            worker->job = params;
+            *tid = worker->thread;
+            pthread_cond_broadcast(&threadPool_changed);
+            pthread_mutex_unlock(&threadPool_mtx);
+            return 0;
+        }
+        pthread_mutex_unlock(&threadPool_mtx);
+    }
+    return createThread(tid, interpreter ? interpreterStackSize : commandStackSize, false, run_function, params);
+}
+
+// Wait until the command running in thread tid terminates:
+static void joinCommandThread(pthread_t tid) {
+    pthread_mutex_lock(&threadPool_mtx);
+    for (int i = 0; i < MaxThreadPoolSize; i++) {
+        if (threadPool[i].thread == tid) {
+            while ((threadPool[i].thread == tid) && threadPool[i].busy) {
+                pthread_cond_wait(&threadPool_changed, &threadPool_mtx);
+            }
+            pthread_mutex_unlock(&threadPool_mtx);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&threadPool_mtx);
+    // Not a pool thread (or a pool thread that has already exited, in which case pthread_join returns ESRCH):
+    pthread_join(tid, NULL);
+}
+
+// A thread must be either joined or detached. Pool threads are already detached.
+static void detachCommandThread(pthread_t tid) {
+    pthread_mutex_lock(&threadPool_mtx);
+    for (int i = 0; i < MaxThreadPoolSize; i++) {
+        if (threadPool[i].thread == tid) {
+            pthread_mutex_unlock(&threadPool_mtx);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&threadPool_mtx);
+    pthread_detach(tid);
+}
+
 static NSString* miniRoot = nil; // limit operations to below a certain directory (~, usually).
 static NSArray<NSString*> *allowedPaths = nil;
 static NSDictionary *commandList = nil;
-// do recompute directoriesInPath only if $PATH has changed
 static NSString* fullCommandPath = @"";
-static NSArray *directoriesInPath;
 
 void initializeEnvironment() {
+    startupBegin("initializeEnvironment");
     // setup a few useful environment variables
     // Initialize paths for application files, including history.txt and keys
     NSString *docsPath;
@@ -516,8 +1675,6 @@ void initializeEnvironment() {
     setenv("CURL_HOME", docsPath.UTF8String, 0); // CURL config in ~/Documents/ or [Cloud Drive]/
     setenv("SSL_CERT_FILE", [docsPath stringByAppendingPathComponent:@"cacert.pem"].UTF8String, 0); // SLL cacert.pem in ~/Documents/cacert.pem or [Cloud Drive]/cacert.pem
     // iOS already defines "HOME" as the home dir of the application
-    for (int i = 0; i < MaxPythonInterpreters; i++) PythonIsRunning[i] = false;
-    for (int i = 0; i < MaxPerlInterpreters; i++) PerlIsRunning[i] = false;
     NSString *libPath = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject];
     // environment variables for Python:
     setenv("PYTHONHOME", libPath.UTF8String, 0);  // Python files are in ~/Library/lib/python[23].x/
@@ -553,10 +1710,15 @@ void initializeEnvironment() {
         binPath = [mainBundlePath stringByAppendingPathComponent:@"bin"];
         fullCommandPath = [[binPath stringByAppendingString:@":"] stringByAppendingString:fullCommandPath];
     }
-    directoriesInPath = [fullCommandPath componentsSeparatedByString:@":"];
     setenv("PATH", fullCommandPath.UTF8String, 1); // 1 = override existing value
     // Store the maximum number of file descriptors allowed:
+    // (open descriptors are counted by the first command, in ensureDescriptorsAvailable)
     getrlimit(RLIMIT_NOFILE, &limitFilesOpen);
+    // Creating the threads of the pool takes time, and the app is probably still launching:
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        prewarmThreadPool();
+    });
+    startupEnd("initializeEnvironment");
 }
 
 NSString * pathJoin(NSString * segmentA, NSString * segmentB);
@@ -688,7 +1850,7 @@ static char* parseArgument(char* argument, char* command) {
 }
 
 
-static void initializeCommandList()
+static void loadCommandList()
 {
     // Loads command names and where to find them (digital library, function name) from plist dictionaries:
     //
@@ -698,6 +1860,7 @@ static void initializeCommandList()
     // 2nd component: name of function to be called
     // 3rd component: chain sent to getopt (for arguments in autocomplete)
     // 4th component: takes a file/directory as argument
+    // 5th component (optional): number of copies, for interpreters that can run several scripts at once
     //
     // Example:
     //    <key>rlogin</key>
@@ -736,6 +1899,168 @@ static void initializeCommandList()
     }
 }
 
+static void initializeCommandList()
+{
+    startupBegin("initializeCommandList");
+    loadCommandList();
+    startupEnd("initializeCommandList");
+}
+
+// C version of commandList, built once from the dictionaries and rebuilt when commandList changes,
+// so launching a command does not go through NSDictionary and NSString comparisons.
+// Lookup uses a perfect hash (hash and displace): each name is hashed to a bucket, and each bucket
+// has a seed chosen so that all the names in it land in distinct slots.
+typedef enum { libraryDynamic, librarySelf, libraryMain } commandLibraryKind;
+typedef enum { operatesOnNothing, operatesOnFile, operatesOnDirectory } commandOperandKind;
+
+typedef struct _commandDescription {
+    char* name;
+    char* library;      // passed to dlopen() (libraryDynamic only)
+    char* function;     // entry point, passed to dlsym()
+    char* getopt;       // string sent to getopt (for arguments in autocomplete)
+    commandLibraryKind libraryKind;
+    commandOperandKind operatesOn;
+} commandDescription;
+
+typedef struct _commandTableType {
+    int numCommands;
+    commandDescription* commands;
+    int numBuckets;
+    unsigned int* seeds; // one per bucket
+    int numSlots;
+    int* slots;          // position in commands, -1 if empty
+} commandTableType;
+
+static commandTableType* commandTable = NULL;
+
+static unsigned int commandHash(const char* name, unsigned int seed) {
+    // FNV-1a, with the seed mixed in the initial value, and a final avalanche:
+    unsigned int hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static char* stringFromCommandStructure(NSArray* commandStructure, int position) {
+    if (commandStructure.count <= position) return strdup("");
+    NSString* value = commandStructure[position];
+    if (![value isKindOfClass:[NSString class]]) return strdup("");
+    return strdup(value.UTF8String);
+}
+
+static void freeCommandTable(commandTableType* table) {
+    if (table == NULL) return;
+    for (int i = 0; i < table->numCommands; i++) {
+        free(table->commands[i].name);
+        free(table->commands[i].library);
+        free(table->commands[i].function);
+        free(table->commands[i].getopt);
+    }
+    free(table->commands);
+    free(table->seeds);
+    free(table->slots);
+    free(table);
+}
+
+// Pick the seed of each bucket, largest buckets first. Returns false if we could not place them all.
+static bool placeCommandBuckets(commandTableType* table, const unsigned int* bucketOf) {
+    int* bucketSize = calloc(table->numBuckets, sizeof(int));
+    for (int i = 0; i < table->numCommands; i++) bucketSize[bucketOf[i]]++;
+    int maxBucketSize = 0;
+    for (int b = 0; b < table->numBuckets; b++) if (bucketSize[b] > maxBucketSize) maxBucketSize = bucketSize[b];
+    int* members = malloc((maxBucketSize + 1) * sizeof(int));
+    int* candidateSlots = malloc((maxBucketSize + 1) * sizeof(int));
+    for (int i = 0; i < table->numSlots; i++) table->slots[i] = -1;
+    bool success = true;
+    for (int size = maxBucketSize; (size > 0) && success; size--) {
+        for (int b = 0; (b < table->numBuckets) && success; b++) {
+            if (bucketSize[b] != size) continue;
+            int numMembers = 0;
+            for (int i = 0; i < table->numCommands; i++) if (bucketOf[i] == b) members[numMembers++] = i;
+            bool placed = false;
+            for (unsigned int seed = 1; (seed < 100 * table->numSlots) && !placed; seed++) {
+                placed = true;
+                for (int m = 0; (m < numMembers) && placed; m++) {
+                    candidateSlots[m] = commandHash(table->commands[members[m]].name, seed) % table->numSlots;
+                    if (table->slots[candidateSlots[m]] >= 0) placed = false;
+                    for (int k = 0; (k < m) && placed; k++) if (candidateSlots[k] == candidateSlots[m]) placed = false;
+                }
+                if (placed) {
+                    table->seeds[b] = seed;
+                    for (int m = 0; m < numMembers; m++) table->slots[candidateSlots[m]] = members[m];
+                }
+            }
+            success = placed;
+        }
+    }
+    free(bucketSize);
+    free(members);
+    free(candidateSlots);
+    return success;
+}
+
+static void buildCommandTable() {
+    startupBegin("buildCommandTable");
+    commandTableType* table = calloc(1, sizeof(commandTableType));
+    NSArray<NSString*>* names = commandList.allKeys;
+    table->commands = calloc(names.count + 1, sizeof(commandDescription));
+    for (NSString* name in names) {
+        NSArray* commandStructure = commandList[name];
+        if (![commandStructure isKindOfClass:[NSArray class]]) continue;
+        commandDescription* command = &table->commands[table->numCommands];
+        command->name = strdup(name.UTF8String);
+        command->library = stringFromCommandStructure(commandStructure, 0);
+        command->function = stringFromCommandStructure(commandStructure, 1);
+        command->getopt = stringFromCommandStructure(commandStructure, 2);
+        if (strcmp(command->library, "SELF") == 0) command->libraryKind = librarySelf;
+        else if (strcmp(command->library, "MAIN") == 0) command->libraryKind = libraryMain;
+        else command->libraryKind = libraryDynamic;
+        char* operatesOn = stringFromCommandStructure(commandStructure, 3);
+        if (strcmp(operatesOn, "file") == 0) command->operatesOn = operatesOnFile;
+        else if (strcmp(operatesOn, "directory") == 0) command->operatesOn = operatesOnDirectory;
+        else command->operatesOn = operatesOnNothing;
+        free(operatesOn);
+        // 5th component: number of copies of an interpreter (see interpreterGroup)
+        if (commandStructure.count > 4) {
+            NSString* copies = commandStructure[4];
+            if ([copies isKindOfClass:[NSString class]]) registerInterpreterGroup(command->name, copies.intValue);
+        }
+        table->numCommands += 1;
+    }
+    unsigned int* bucketOf = malloc((table->numCommands + 1) * sizeof(unsigned int));
+    table->numBuckets = table->numCommands / 4 + 1;
+    table->seeds = calloc(table->numBuckets, sizeof(unsigned int));
+    for (int i = 0; i < table->numCommands; i++) bucketOf[i] = commandHash(table->commands[i].name, 0) % table->numBuckets;
+    table->numSlots = table->numCommands + table->numCommands / 4 + 1;
+    table->slots = malloc(table->numSlots * sizeof(int));
+    while (!placeCommandBuckets(table, bucketOf)) {
+        // Very unlikely. Make more room and try again.
+        table->numSlots *= 2;
+        table->slots = realloc(table->slots, table->numSlots * sizeof(int));
+    }
+    free(bucketOf);
+    commandTableType* oldTable = commandTable;
+    commandTable = table;
+    freeCommandTable(oldTable);
+    startupEnd("buildCommandTable");
+}
+
+static const commandDescription* commandLookup(const char* name) {
+    if (commandList == nil) initializeCommandList();
+    if (commandTable == NULL) buildCommandTable();
+    commandTableType* table = commandTable;
+    if ((name == NULL) || (table->numCommands == 0)) return NULL;
+    unsigned int bucket = commandHash(name, 0) % table->numBuckets;
+    int position = table->slots[commandHash(name, table->seeds[bucket]) % table->numSlots];
+    if ((position >= 0) && (strcmp(table->commands[position].name, name) == 0)) return &table->commands[position];
+    return NULL;
+}
+
 int ios_setMiniRoot(NSString* mRoot) {
     BOOL isDir;
     NSFileManager *fileManager = [[NSFileManager alloc] init];
@@ -758,11 +2083,12 @@ int ios_setMiniRoot(NSString* mRoot) {
     // also don't set the miniRoot if we can't go in there
     // get the real name for miniRoot:
     miniRoot = [fileManager currentDirectoryPath];
+    buildAllowedPrefixes();
     // Back to where we we before:
     [fileManager changeCurrentDirectoryPath:currentDir];
     if (currentSession != nil) {
-        strcpy(currentSession->currentDir, [miniRoot UTF8String]);
-        strcpy(currentSession->previousDirectory, [miniRoot UTF8String]);
+        currentSession->currentDir = internPath([miniRoot UTF8String]);
+        currentSession->previousDirectory = internPath([miniRoot UTF8String]);
     }
     return 1; // mission accomplished
 }
@@ -771,262 +2097,182 @@ int ios_setMiniRoot(NSString* mRoot) {
 int ios_setMiniRootURL(NSURL* mRoot) {
     NSFileManager *fileManager = [[NSFileManager alloc] init];
     if (currentSession == NULL) {
-        currentSession = malloc(sizeof(sessionParameters));
-        initSessionParameters(currentSession);
+        currentSession = allocateSession();
     }
-    strcpy(currentSession->localMiniRoot, [mRoot.path UTF8String]);
-    strcpy(currentSession->previousDirectory, currentSession->currentDir);
-    strcpy(currentSession->currentDir, [[mRoot path] UTF8String]);
+    currentSession->localMiniRoot = internPath([mRoot.path UTF8String]);
+    currentSession->previousDirectory = currentSession->currentDir;
+    currentSession->currentDir = internPath([[mRoot path] UTF8String]);
     [fileManager changeCurrentDirectoryPath:[mRoot path]];
     return 1; // mission accomplished
 }
 
+// Directories where "cd" is allowed: below miniRoot, below the session localMiniRoot, or below one of
+// allowedPaths. The checks are done on C strings, with a table built when miniRoot or allowedPaths change.
+// Tables are immutable once published (and never freed), so chdir can read them without a lock.
+typedef struct _allowedPrefixTable {
+    const char* miniRoot; // NULL: no restriction
+    size_t miniRootLength;
+    int count;
+    struct { const char* path; size_t length; } prefixes[];
+} allowedPrefixTable;
+static _Atomic(allowedPrefixTable*) allowedPrefixes = NULL;
+
+static void buildAllowedPrefixes(void) {
+    int count = (int)[allowedPaths count];
+    allowedPrefixTable* table = calloc(1, sizeof(allowedPrefixTable) + count * sizeof(table->prefixes[0]));
+    if (table == NULL) return;
+    if (miniRoot != nil) {
+        table->miniRoot = internPath(miniRoot.UTF8String);
+        table->miniRootLength = strlen(table->miniRoot);
+    }
+    for (NSString *dir in allowedPaths) {
+        if (table->count >= count) break;
+        table->prefixes[table->count].path = internPath(dir.UTF8String);
+        table->prefixes[table->count].length = strlen(table->prefixes[table->count].path);
+        table->count++;
+    }
+    allowedPrefixes = table;
+}
+
 int ios_setAllowedPaths(NSArray<NSString *> *paths) {
   allowedPaths = paths;
+  buildAllowedPrefixes();
   return 1;
 }
 
-BOOL __allowed_cd_to_path(NSString *path) {
-  if (miniRoot == nil || [path hasPrefix:miniRoot]) {
-    return YES;
-  }
-  
-    if (strlen(currentSession->localMiniRoot) != 0) {
-        NSString *localMiniRootPath = [NSString stringWithCString:currentSession->localMiniRoot encoding:NSUTF8StringEncoding];
-        if (localMiniRootPath && [path hasPrefix:localMiniRootPath]) {
-            return YES;
-        }
+static bool allowedDirectory(const char* path) {
+    allowedPrefixTable* table = allowedPrefixes;
+    if ((table == NULL) || (table->miniRoot == NULL) || (strncmp(path, table->miniRoot, table->miniRootLength) == 0)) {
+        return true;
     }
-  
-  for (NSString *dir in allowedPaths) {
-    if ([path hasPrefix:dir]) {
-      return YES;
+    if ((currentSession != NULL) && (currentSession->localMiniRoot[0] != 0) &&
+        (strncmp(path, currentSession->localMiniRoot, strlen(currentSession->localMiniRoot)) == 0)) {
+        return true;
     }
-  }
-  
-  return NO;
+    for (int i = 0; i < table->count; i++) {
+        if (strncmp(path, table->prefixes[i].path, table->prefixes[i].length) == 0) return true;
+    }
+    return false;
 }
 
-void __cd_to_dir(NSString *newDir, NSFileManager *fileManager) {
-  BOOL isDir;
-  // Check for permission and existence:
-  if (![fileManager fileExistsAtPath:newDir isDirectory:&isDir]) {
-    fprintf(thread_stderr, "cd: %s: no such file or directory\n", [newDir UTF8String]);
-    return;
-  }
-  if (!isDir) {
-    fprintf(thread_stderr, "cd: %s: not a directory\n", [newDir UTF8String]);
-    return;
-  }
-  if (![fileManager isReadableFileAtPath:newDir] ||
-      ![fileManager changeCurrentDirectoryPath:newDir]) {
-    fprintf(thread_stderr, "cd: %s: permission denied\n", [newDir UTF8String]);
-    return;
-  }
-
-  // We managed to change the directory.
-  // Was that allowed?
-  // Allowed "cd" = below miniRoot *or* below localMiniRoot
-  NSString* resultDir = [fileManager currentDirectoryPath];
-
-  if (__allowed_cd_to_path(resultDir)) {
-    strcpy(currentSession->previousDirectory, currentSession->currentDir);
-    strcpy(currentSession->currentDir, [newDir UTF8String]);
-    return;
-  }
-  
-  fprintf(thread_stderr, "cd: %s: permission denied\n", [newDir UTF8String]);
-  // If the user tried to go above the miniRoot, set it to miniRoot
-  if ([miniRoot hasPrefix:resultDir]) {
-    [fileManager changeCurrentDirectoryPath:miniRoot];
-    strcpy(currentSession->currentDir, [miniRoot UTF8String]);
-    strcpy(currentSession->previousDirectory, currentSession->currentDir);
-  } else {
-    // go back to where we were before:
-    [fileManager changeCurrentDirectoryPath:[NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding]];
-  }
+BOOL __allowed_cd_to_path(NSString *path) {
+    return allowedDirectory(path.UTF8String);
 }
 
-// For some Unix commands that call fchdir (including vim):
 #undef fchdir
-int ios_fchdir(const int fd) {
-    NSLog(@"Locking for thread %x in ios_fchdir\n", pthread_self());
-    while (cleanup_counter > 0) { } // Don't chdir while a command is ending.
-    // We cannot have someone change the current directory while a command is starting or terminating.
-    // hence the mutex_lock here.
-    pthread_mutex_lock(&pid_mtx);
+// chdir() is redefined in this file, so we change the process directory with open + fchdir.
+// open() also gives us the errors chdir would return (ENOENT, ENOTDIR, EACCES).
+static int systemChdir(const char* path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
     int result = fchdir(fd);
-    if (result < 0) {
-        NSLog(@"Unlocking for thread %x in ios_fchdir\n", pthread_self());
-        pthread_mutex_unlock(&pid_mtx);
-        return result;
-    }
-    // We managed to change the directory. Update currentSession as well:
-    // Was that allowed?
-    // Allowed "cd" = below miniRoot *or* below localMiniRoot
-    NSFileManager *fileManager = [[NSFileManager alloc] init];
-    NSString* resultDir = [fileManager currentDirectoryPath];
-    NSLog(@"Inside fchdir, path: %s for session: %s\n", resultDir.UTF8String, (char*)currentSession->context);
+    int savedErrno = errno;
+    close(fd);
+    errno = savedErrno;
+    return result;
+}
 
-    if (__allowed_cd_to_path(resultDir)) {
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-        strcpy(currentSession->currentDir, [resultDir UTF8String]);
+// Is the process already in the current directory of this session? (chdir at the end of each command,
+// "cd ." ...). Then there is nothing to change, and no need to take the lock.
+static bool alreadyInDirectory(const char* path) {
+    if ((currentSession == NULL) || (path == NULL) || (currentSession->currentDir == NULL)) return false;
+    if (strcmp(path, currentSession->currentDir) != 0) return false;
+    char processDir[MAXPATHLEN];
+    if (getcwd(processDir, sizeof(processDir)) == NULL) return false;
+    return strcmp(processDir, path) == 0;
+}
+
+// The process directory has changed. Check that it is allowed and update currentSession, or go back.
+// If newDir is not NULL, it is the name stored in the session (instead of the real name).
+static int updateSessionDirectory(const char* newDir, bool setPrevious) {
+    char resultDir[MAXPATHLEN];
+    if (getcwd(resultDir, sizeof(resultDir)) == NULL) return -1;
+    ios_trace(TraceDirectory, @"New directory: %s for session: %s\n", resultDir, currentSession ? (char*)currentSession->context : "");
+    if (currentSession == NULL) {
+        errno = 0;
+        return 0;
+    }
+    if (allowedDirectory(resultDir)) {
+        if (setPrevious) currentSession->previousDirectory = currentSession->currentDir;
+        currentSession->currentDir = internPath((newDir != NULL) ? newDir : resultDir);
         errno = 0;
-        NSLog(@"Unlocking for thread %x in ios_fchdir\n", pthread_self());
-        pthread_mutex_unlock(&pid_mtx);
         return 0;
     }
-    
-    errno = EACCES; // Permission denied
     // If the user tried to go above the miniRoot, set it to miniRoot
-    if ([miniRoot hasPrefix:resultDir]) {
-        [fileManager changeCurrentDirectoryPath:miniRoot];
-        strcpy(currentSession->currentDir, [miniRoot UTF8String]);
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
+    allowedPrefixTable* table = allowedPrefixes;
+    if ((table != NULL) && (table->miniRoot != NULL) && (strncmp(table->miniRoot, resultDir, strlen(resultDir)) == 0)) {
+        systemChdir(table->miniRoot);
+        currentSession->currentDir = table->miniRoot;
+        currentSession->previousDirectory = currentSession->currentDir;
     } else {
         // go back to where we were before:
-        [fileManager changeCurrentDirectoryPath:[NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding]];
+        systemChdir(currentSession->currentDir);
     }
-    NSLog(@"Unlocking for thread %x in ios_fchdir\n", pthread_self());
-    pthread_mutex_unlock(&pid_mtx);
+    errno = EACCES; // Permission denied
     return -1;
 }
 
+void __cd_to_dir(NSString *newDir, NSFileManager *fileManager) {
+    if (systemChdir(newDir.UTF8String) < 0) {
+        switch (errno) {
+            case ENOENT: fprintf(thread_stderr, "cd: %s: no such file or directory\n", [newDir UTF8String]); break;
+            case ENOTDIR: fprintf(thread_stderr, "cd: %s: not a directory\n", [newDir UTF8String]); break;
+            default: fprintf(thread_stderr, "cd: %s: permission denied\n", [newDir UTF8String]); break;
+        }
+        return;
+    }
+    if (updateSessionDirectory(newDir.UTF8String, true) < 0) {
+        fprintf(thread_stderr, "cd: %s: permission denied\n", [newDir UTF8String]);
+    }
+}
+
+// For some Unix commands that call fchdir (including vim):
+int ios_fchdir(const int fd) {
+    ios_trace(TraceDirectory, @"Locking for thread %x in ios_fchdir\n", pthread_self());
+    resetFileCoordination();
+    ios_waitForCleanup(); // Don't chdir while a command is ending.
+    // We cannot have someone change the current directory while a command is starting or terminating.
+    // hence the mutex_lock here.
+    pthread_mutex_lock(&pid_mtx);
+    int result = fchdir(fd);
+    if (result >= 0) result = updateSessionDirectory(NULL, true);
+    ios_trace(TraceDirectory, @"Unlocking for thread %x in ios_fchdir\n", pthread_self());
+    pthread_mutex_unlock(&pid_mtx);
+    return result;
+}
+
 int ios_fchdir_nolock(const int fd) {
     // Same function as fchdir, except it does not lock. To be called when resetting directory after fork().
-    while (cleanup_counter > 0) { } // Don't chdir while a command is ending.
+    ios_waitForCleanup(); // Don't chdir while a command is ending.
     int result = fchdir(fd);
     if (result < 0) {
         return result;
     }
-    // We managed to change the directory. Update currentSession as well:
-    // Was that allowed?
-    // Allowed "cd" = below miniRoot *or* below localMiniRoot
-    NSFileManager *fileManager = [[NSFileManager alloc] init];
-    NSString* resultDir = [fileManager currentDirectoryPath];
-
-    if (__allowed_cd_to_path(resultDir)) {
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-        strcpy(currentSession->currentDir, [resultDir UTF8String]);
-        errno = 0;
-        return 0;
-    }
-    
-    errno = EACCES; // Permission denied
-    // If the user tried to go above the miniRoot, set it to miniRoot
-    if ([miniRoot hasPrefix:resultDir]) {
-        [fileManager changeCurrentDirectoryPath:miniRoot];
-        strcpy(currentSession->currentDir, [miniRoot UTF8String]);
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-    } else {
-        // go back to where we were before:
-        [fileManager changeCurrentDirectoryPath:[NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding]];
-    }
-    return -1;
+    return updateSessionDirectory(NULL, true);
 }
 
 int chdir_nolock(const char* path) {
     // Same function as chdir, except it does not lock. To be called from ios_releaseThread*()
-    NSFileManager *fileManager = [[NSFileManager alloc] init];
-    NSString* newDir = @(path);
-    BOOL isDir;
-    // Check for permission and existence:
-    if (![fileManager fileExistsAtPath:newDir isDirectory:&isDir]) {
-        errno = ENOENT; // No such file or directory
-        return -1;
-    }
-    if (!isDir) {
-        errno = ENOTDIR; // Not a directory
-        return -1;
-    }
-    if (![fileManager isReadableFileAtPath:newDir] ||
-        ![fileManager changeCurrentDirectoryPath:newDir]) {
-        errno = EACCES; // Permission denied
-        return -1;
-    }
-    
-    // We managed to change the directory.
-    // Was that allowed?
-    // Allowed "cd" = below miniRoot *or* below localMiniRoot
-    NSString* resultDir = [fileManager currentDirectoryPath];
-
-    if (__allowed_cd_to_path(resultDir)) {
-        strcpy(currentSession->currentDir, [resultDir UTF8String]);
-        errno = 0;
-        return 0;
-    }
-    
-    errno = EACCES; // Permission denied
-    // If the user tried to go above the miniRoot, set it to miniRoot
-    if ([miniRoot hasPrefix:resultDir]) {
-        [fileManager changeCurrentDirectoryPath:miniRoot];
-        strcpy(currentSession->currentDir, [miniRoot UTF8String]);
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-    } else {
-        // go back to where we were before:
-        [fileManager changeCurrentDirectoryPath:[NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding]];
-    }
-    return -1;
+    if (alreadyInDirectory(path)) return 0;
+    if (systemChdir(path) < 0) return -1;
+    return updateSessionDirectory(NULL, false);
 }
 
 // For some Unix commands that call chdir:
 // Is also called at the end of the execution of each command
 int chdir(const char* path) {
-    while (cleanup_counter > 0) { } // Don't chdir while a command is ending.
-    NSLog(@"Locking for thread %x in chdir, cd %s, stdin= %d\n", pthread_self(), path, fileno(thread_stdin));
+    if (alreadyInDirectory(path)) return 0; // same directory as the session, nothing changes
+    ios_waitForCleanup(); // Don't chdir while a command is ending.
+    resetFileCoordination();
+    ios_trace(TraceDirectory, @"Locking for thread %x in chdir, cd %s, stdin= %d\n", pthread_self(), path, fileno(thread_stdin));
     // We cannot have someone change the current directory while a command is starting or terminating.
     // hence the mutex_lock here.
     pthread_mutex_lock(&pid_mtx);
-    NSFileManager *fileManager = [[NSFileManager alloc] init];
-    NSString* newDir = @(path);
-    BOOL isDir;
-    // Check for permission and existence:
-    if (![fileManager fileExistsAtPath:newDir isDirectory:&isDir]) {
-        errno = ENOENT; // No such file or directory
-        NSLog(@"Unlocking for thread %x in chdir\n", pthread_self());
-        pthread_mutex_unlock(&pid_mtx);
-        return -1;
-    }
-    if (!isDir) {
-        errno = ENOTDIR; // Not a directory
-        NSLog(@"Unlocking for thread %x in chdir\n", pthread_self());
-        pthread_mutex_unlock(&pid_mtx);
-        return -1;
-    }
-    if (![fileManager isReadableFileAtPath:newDir] ||
-        ![fileManager changeCurrentDirectoryPath:newDir]) {
-        errno = EACCES; // Permission denied
-        NSLog(@"Unlocking for thread %x in chdir\n", pthread_self());
-        pthread_mutex_unlock(&pid_mtx);
-        return -1;
-    }
-    
-    // We managed to change the directory.
-    // Was that allowed?
-    // Allowed "cd" = below miniRoot *or* below localMiniRoot
-    NSString* resultDir = [fileManager currentDirectoryPath];
-
-    if (__allowed_cd_to_path(resultDir)) {
-        strcpy(currentSession->currentDir, [resultDir UTF8String]);
-        NSLog(@"Unlocking for thread %x in chdir\n", pthread_self());
-        pthread_mutex_unlock(&pid_mtx);
-        errno = 0;
-        return 0;
-    }
-    
-    errno = EACCES; // Permission denied
-    // If the user tried to go above the miniRoot, set it to miniRoot
-    if ([miniRoot hasPrefix:resultDir]) {
-        [fileManager changeCurrentDirectoryPath:miniRoot];
-        strcpy(currentSession->currentDir, [miniRoot UTF8String]);
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-    } else {
-        // go back to where we were before:
-        [fileManager changeCurrentDirectoryPath:[NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding]];
-    }
-    NSLog(@"Unlocking for thread %x in chdir\n", pthread_self());
+    int result = systemChdir(path);
+    if (result >= 0) result = updateSessionDirectory(NULL, false);
+    ios_trace(TraceDirectory, @"Unlocking for thread %x in chdir\n", pthread_self());
     pthread_mutex_unlock(&pid_mtx);
-    return -1;
+    return result;
 }
 
 int command_not_found(int argc, char** argv) {
@@ -1061,8 +2307,8 @@ int cd_main(int argc, char** argv) {
             [fileManager changeCurrentDirectoryPath:[NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) lastObject]];
         }
 
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-        strcpy(currentSession->currentDir, fileManager.currentDirectoryPath.UTF8String);
+        currentSession->previousDirectory = currentSession->currentDir;
+        currentSession->currentDir = internPath(fileManager.currentDirectoryPath.UTF8String);
     }
 
     newPreviousDirectory(); // If a command is running, this changes the directory it goes back to.
@@ -1086,71 +2332,154 @@ NSString* operatesOn(NSString* commandName) {
 
 int ios_executable(const char* inputCmd) {
     // returns 1 if this is one of the commands we define in ios_system, 0 otherwise
-    if (commandList == nil) initializeCommandList();
     // Take basename in case someone put a path before:
-    NSArray* valuesFromDict = [commandList objectForKey: [NSString stringWithCString:basename(inputCmd) encoding:NSUTF8StringEncoding]];
     // we could dlopen() here, but that would defeat the purpose
-    if (valuesFromDict == nil) return 0;
+    if (commandLookup(basename(inputCmd)) == NULL) return 0;
     else return 1;
 }
 
+// Loads the frameworks for these commands in the background, so the first call does not wait for dlopen()
+// (and the initializers of the framework). They stay in the command cache, and are not released when
+// the cache is full (ios_purgeCommandCache still releases them). Call after initializeEnvironment().
+void ios_preloadCommands(const char** names, int n) {
+    if ((names == NULL) || (n <= 0) || (commandCacheSize <= 0)) return;
+    // Resolve the names now, on the caller's thread (the command list is not thread-safe):
+    // (copies, since the command table is rebuilt by replaceCommand)
+    commandDescription* commands = calloc(n, sizeof(commandDescription));
+    if (commands == NULL) return;
+    int numCommands = 0;
+    for (int i = 0; i < n; i++) {
+        const commandDescription* command = commandLookup(names[i]);
+        if (command == NULL) continue;
+        commands[numCommands] = *command;
+        commands[numCommands].name = strdup(command->name);
+        commands[numCommands].library = strdup(command->library);
+        commands[numCommands].function = strdup(command->function);
+        commands[numCommands].getopt = NULL;
+        numCommands++;
+    }
+    if (numCommands == 0) {
+        free(commands);
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        for (int i = 0; i < numCommands; i++) {
+            const commandDescription* command = &commands[i];
+            commandCacheEntry* entry = commandCacheLookup(command->name);
+            if (entry == NULL) {
+                void* handle;
+                if (command->libraryKind == librarySelf) handle = RTLD_SELF;
+                else if (command->libraryKind == libraryMain) handle = RTLD_MAIN_ONLY;
+                else handle = dlopen(command->library, RTLD_LAZY | RTLD_GLOBAL);
+                if (handle == NULL) {
+                    NSLog(@"Failed preloading %s from %s, cause = %s\n", command->name, command->library, dlerror());
+                    continue;
+                }
+                int (*function)(int ac, char** av) = dlsym(handle, command->function);
+                if (function == NULL) {
+                    NSLog(@"Failed preloading %s from %s, cause = %s\n", command->name, command->library, dlerror());
+                    commandCacheRelease(NULL, handle);
+                    continue;
+                }
+                entry = commandCacheInsert(command->name, handle, function);
+                if (entry == NULL) {
+                    // Cache is full of running commands:
+                    commandCacheRelease(NULL, handle);
+                    continue;
+                }
+            }
+            pthread_mutex_lock(&commandCache_mtx);
+            entry->pinned = true;
+            pthread_mutex_unlock(&commandCache_mtx);
+            commandCacheRelease(entry, NULL);
+            ios_trace(TraceCommand, @"Preloaded %s", command->name);
+        }
+        for (int i = 0; i < numCommands; i++) {
+            free(commands[i].name);
+            free(commands[i].library);
+            free(commands[i].function);
+        }
+        free(commands);
+    });
+}
+
 // Where to direct input/output of the next thread:
 static __thread FILE* child_stdin = NULL;
 static __thread FILE* child_stdout = NULL;
 static __thread FILE* child_stderr = NULL;
 
-FILE* ios_popen(const char* inputCmd, const char* type) {
-    // Save existing streams:
-    int fd[2] = {0};
+// Pipe between the current command and inputCmd. inProcess: use a channel instead of a kernel pipe.
+static FILE* openPipe(const char* inputCmd, const char* type, bool inProcess) {
     const char* command = inputCmd;
     // skip past all spaces
     while ((command[0] == ' ') && strlen(command) > 0) command++;
+    if (inProcess && ((type[0] == 'w') || (type[0] == 'r'))) {
+        FILE* reader = NULL;
+        FILE* writer = NULL;
+        if (openChannel(&reader, &writer)) {
+            if (type[0] == 'w') child_stdin = reader;
+            else child_stdout = writer;
+            int returnValue = ios_system(command);
+            if (returnValue == 0)
+                return (type[0] == 'w') ? writer : reader;
+            return NULL;
+        }
+        // Fall back to a kernel pipe.
+    }
+    // Save existing streams:
+    int fd[2] = {0};
     if (pipe(fd) < 0) { return NULL; } // Nothing we can do if pipe fails
+    trackDescriptors(2);
     // NOTES: fd[0] is set up for reading, fd[1] is set up for writing
     // fpout = fdopen(fd[1], "w");
     // fpin = fdopen(fd[0], "r");
     if (type[0] == 'w') {
         // open pipe for reading
         child_stdin = fdopen(fd[0], "r");
+        setStreamBuffering(child_stdin, false);
         // launch command: if the command fails, return NULL.
         int returnValue = ios_system(command);
-        if (returnValue == 0)
-            return fdopen(fd[1], "w");
+        if (returnValue == 0) {
+            FILE* stream = fdopen(fd[1], "w");
+            setStreamBuffering(stream, true);
+            return stream;
+        }
     } else if (type[0] == 'r') {
         // open pipe for writing
         // set up streams for thread
         child_stdout = fdopen(fd[1], "w");
+        setStreamBuffering(child_stdout, true);
         // launch command: if the command fails, return NULL.
         int returnValue = ios_system(command);
-        if (returnValue == 0)
-            return fdopen(fd[0], "r");
+        if (returnValue == 0) {
+            FILE* stream = fdopen(fd[0], "r");
+            setStreamBuffering(stream, false);
+            return stream;
+        }
     }
     // pipe creation failed, command starting failed:
     return NULL;
 }
 
+FILE* ios_popen(const char* inputCmd, const char* type) {
+    // The caller may need the file descriptor: always a kernel pipe.
+    return openPipe(inputCmd, type, false);
+}
+
 // small function, behaves like strstr but skips quotes (Yury Korolev)
 char *strstrquoted(char* str1, char* str2) {
     
     if (str1 == NULL || str2 == NULL) {
         return NULL;
     }
-    size_t len1 = strlen(str1);
+    // Single pass over str1 (no strlen): it is called on long command lines, often several times.
     size_t len2 = strlen(str2);
     
-    if (len1 < len2) {
-        return NULL;
-    }
-    
-    if (strcmp(str1, str2) == 0) {
-        return str1;
-    }
-    
     char quotechar = 0;
     int esclen = 0;
     int matchlen = 0;
     
-    for (int i = 0; i < len1; i++) {
+    for (int i = 0; str1[i] != 0; i++) {
         char ch = str1[i];
         if (quotechar) {
             if (ch == '\\') {
@@ -1207,7 +2536,7 @@ static char* concatenateArgv(char* const argv[]) {
     while(argv[argc] != NULL) { cmdLength += strlen(argv[argc]) + 1; argc++;}
     if (argc == 0) return NULL; // safeguard check
     char* cmd = malloc((cmdLength  + 3 * argc + 1) * sizeof(char)); // space for quotes
-    NSLog(@"Command allocated: %d ", cmdLength  + 3 * argc + 1);
+    ios_trace(TraceParsing, @"Command allocated: %d ", cmdLength  + 3 * argc + 1);
     strcpy(cmd, argv[0]);
     argc = 1;
     char recordSeparator = 0x1e;
@@ -1237,21 +2566,30 @@ static char* concatenateArgv(char* const argv[]) {
                 argc++;
                 continue;
             }
-            NSLog(@"Argument contains spaces, double quotes, single quotes and recordSeparator");
+            ios_trace(TraceParsing, @"Argument contains spaces, double quotes, single quotes and recordSeparator");
         }
         strcat(cmd, " ");
         strcat(cmd, argv[argc]);
         argc++;
     }
-    NSLog(@"Command length: %d ", strlen(cmd));
+    ios_trace(TraceParsing, @"Command length: %d ", strlen(cmd));
     return cmd;
 }
 
+// The pasteboard type for UTF-8 text, as set by UIPasteboard.string (kUTTypeUTF8PlainText):
+#define PasteboardUTF8Type @"public.utf8-plain-text"
+#define PasteboardReadSize (64 << 10)
+
 int pbpaste(int argc, char** argv) {
     // We can paste strings and URLs.
+    // Strings are written as the UTF-8 bytes on the pasteboard, without going through a C string:
     if ([UIPasteboard generalPasteboard].hasStrings) {
-        fprintf(thread_stdout, "%s", [[UIPasteboard generalPasteboard].string UTF8String]);
-        if (![[UIPasteboard generalPasteboard].string hasSuffix:@"\n"]) fprintf(thread_stdout, "\n");
+        NSData* data = [[UIPasteboard generalPasteboard] dataForPasteboardType:PasteboardUTF8Type];
+        if (data == nil) data = [[UIPasteboard generalPasteboard].string dataUsingEncoding:NSUTF8StringEncoding];
+        const char* bytes = data.bytes;
+        size_t length = data.length;
+        if ((length > 0) && (fwrite(bytes, 1, length, thread_stdout) != length)) return 1;
+        if ((length == 0) || (bytes[length - 1] != '\n')) fputc('\n', thread_stdout);
         return 0;
     }
     if ([UIPasteboard generalPasteboard].hasURLs) {
@@ -1261,31 +2599,58 @@ int pbpaste(int argc, char** argv) {
     return 1;
 }
 
+// Is this valid UTF-8? (what NSString would accept, without building one)
+static bool isUTF8(const unsigned char* s, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        unsigned char c = s[i];
+        if (c < 0x80) { i++; continue; }
+        int extra;
+        unsigned int min, code;
+        if ((c & 0xe0) == 0xc0) { extra = 1; code = c & 0x1f; min = 0x80; }
+        else if ((c & 0xf0) == 0xe0) { extra = 2; code = c & 0x0f; min = 0x800; }
+        else if ((c & 0xf8) == 0xf0) { extra = 3; code = c & 0x07; min = 0x10000; }
+        else return false;
+        if (i + extra >= length) return false;
+        for (int k = 1; k <= extra; k++) {
+            if ((s[i + k] & 0xc0) != 0x80) return false;
+            code = (code << 6) | (s[i + k] & 0x3f);
+        }
+        if ((code < min) || (code > 0x10ffff) || ((code >= 0xd800) && (code <= 0xdfff))) return false;
+        i += extra + 1;
+    }
+    return true;
+}
 
 int pbcopy(int argc, char** argv) {
     if (argc == 1) {
-        // no arguments, listen to stdin
-        const int bufsize = 1024;
-        char buffer[bufsize];
-        NSMutableData* data = [[NSMutableData alloc] init];
-        
-        ssize_t count = 0;
-        while ((count = read(fileno(thread_stdin), buffer, bufsize-1))) {
-            [data appendBytes:buffer length:count];
+        // no arguments, listen to stdin. Read in large blocks, straight into the data given to
+        // the pasteboard, sized from the file when stdin is one:
+        int fd = fileno(thread_stdin);
+        struct stat st;
+        NSUInteger capacity = PasteboardReadSize;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) capacity = (NSUInteger)st.st_size + 1;
+        NSMutableData* data = [[NSMutableData alloc] initWithLength:capacity];
+        NSUInteger used = 0;
+        for (;;) {
+            if (used == data.length) data.length = 2 * used;
+            ssize_t count = read(fd, (char*)data.mutableBytes + used, data.length - used);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                return 1;
+            }
+            if (count == 0) break;
+            used += count;
         }
-        
-        NSString* result = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
-        
-        if (!result) {
+        data.length = used;
+        if (!isUTF8(data.bytes, used)) {
             return 1;
         }
-        
-        [UIPasteboard generalPasteboard].string = result;
+        [[UIPasteboard generalPasteboard] setData:data forPasteboardType:PasteboardUTF8Type];
     } else {
         // threre are arguments, concatenate and paste:
         char* cmd = concatenateArgv(argv + 1);
-        [UIPasteboard generalPasteboard].string = @(cmd);
-        free(cmd);
+        [[UIPasteboard generalPasteboard] setData:[NSData dataWithBytesNoCopy:cmd length:strlen(cmd) freeWhenDone:YES] forPasteboardType:PasteboardUTF8Type];
     }
     return 0;
 }
@@ -1300,28 +2665,209 @@ int type_main(int argc, char** argv) {
     return 0;
 }
 
+// Aliases: C hash table (chained), keyed by the alias name. Each alias is stored as the text that goes
+// before the arguments, the text that goes after the marker (!^: after the first argument, !*: after all of
+// them) and the marker position, so that expansion is one lookup and one copy into the command line.
+// Chained aliases (alias ll="l -a", with l itself an alias) are resolved on first use, up to MaxAliasDepth
+// levels, and the result is kept until an alias is added or removed.
+typedef enum { aliasAppendArguments, aliasAfterFirst, aliasAfterLast } aliasPosition;
+typedef struct _aliasEntry {
+    char* name;
+    char* before;
+    char* after;
+    aliasPosition position;
+    char* resolvedBefore; // before, with chained aliases expanded. NULL: same as before.
+    unsigned long resolvedGeneration;
+    struct _aliasEntry* next;
+} aliasEntry;
+#define AliasBuckets 128
+#define MaxAliasDepth 16
+static aliasEntry* aliasTable[AliasBuckets];
+static int numAliases = 0;
+static unsigned long aliasGeneration = 1; // changes every time an alias is set or removed
+static pthread_mutex_t alias_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int aliasHash(const char* name, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    return hash % AliasBuckets;
+}
+
+// Must be called with alias_mtx locked:
+static aliasEntry* findAlias(const char* name, size_t length) {
+    for (aliasEntry* entry = aliasTable[aliasHash(name, length)]; entry != NULL; entry = entry->next) {
+        if ((strncmp(entry->name, name, length) == 0) && (entry->name[length] == 0)) return entry;
+    }
+    return NULL;
+}
+
+static void freeAlias(aliasEntry* entry) {
+    free(entry->name);
+    free(entry->before);
+    free(entry->after);
+    free(entry->resolvedBefore);
+    free(entry);
+}
+
+static void setAlias(const char* name, const char* before, const char* after, aliasPosition position) {
+    aliasEntry* entry = calloc(1, sizeof(aliasEntry));
+    if (entry == NULL) return;
+    entry->name = strdup(name);
+    entry->before = strdup(before);
+    entry->after = strdup(after);
+    entry->position = position;
+    pthread_mutex_lock(&alias_mtx);
+    aliasEntry** link = &aliasTable[aliasHash(name, strlen(name))];
+    while ((*link != NULL) && (strcmp((*link)->name, name) != 0)) link = &(*link)->next;
+    if (*link != NULL) {
+        aliasEntry* previous = *link;
+        entry->next = previous->next;
+        freeAlias(previous);
+    } else {
+        numAliases++;
+    }
+    *link = entry;
+    aliasGeneration++;
+    pthread_mutex_unlock(&alias_mtx);
+}
+
+static void removeAlias(const char* name) {
+    pthread_mutex_lock(&alias_mtx);
+    aliasEntry** link = &aliasTable[aliasHash(name, strlen(name))];
+    while ((*link != NULL) && (strcmp((*link)->name, name) != 0)) link = &(*link)->next;
+    if (*link != NULL) {
+        aliasEntry* entry = *link;
+        *link = entry->next;
+        freeAlias(entry);
+        numAliases--;
+        aliasGeneration++;
+    }
+    pthread_mutex_unlock(&alias_mtx);
+}
+
+static void removeAllAliases(void) {
+    pthread_mutex_lock(&alias_mtx);
+    for (int i = 0; i < AliasBuckets; i++) {
+        while (aliasTable[i] != NULL) {
+            aliasEntry* entry = aliasTable[i];
+            aliasTable[i] = entry->next;
+            freeAlias(entry);
+        }
+    }
+    numAliases = 0;
+    aliasGeneration++;
+    pthread_mutex_unlock(&alias_mtx);
+}
+
+// The part before the arguments, with the first word expanded if it is itself an alias. Only aliases without
+// a marker can be chained (as in sh, a word is not expanded again inside its own alias).
+// chain: the aliases being expanded. Must be called with alias_mtx locked.
+static const char* resolvedAliasBefore(aliasEntry* entry, aliasEntry** chain, int depth) {
+    if (entry->resolvedGeneration == aliasGeneration) {
+        return (entry->resolvedBefore != NULL) ? entry->resolvedBefore : entry->before;
+    }
+    chain[depth] = entry;
+    char* resolved = NULL;
+    if ((depth + 1 < MaxAliasDepth) && (entry->before[0] != '\\')) {
+        size_t wordLength = strcspn(entry->before, " ");
+        aliasEntry* inner = findAlias(entry->before, wordLength);
+        for (int i = 0; (inner != NULL) && (i <= depth); i++) {
+            if (chain[i] == inner) inner = NULL;
+        }
+        if ((inner != NULL) && (inner->position == aliasAppendArguments)) {
+            const char* innerBefore = resolvedAliasBefore(inner, chain, depth + 1);
+            resolved = malloc(strlen(innerBefore) + strlen(entry->before + wordLength) + 1);
+            if (resolved != NULL) sprintf(resolved, "%s%s", innerBefore, entry->before + wordLength);
+        }
+    }
+    free(entry->resolvedBefore);
+    entry->resolvedBefore = resolved;
+    entry->resolvedGeneration = aliasGeneration;
+    return (resolved != NULL) ? resolved : entry->before;
+}
+
+// The command line with the alias for "name" expanded, or NULL if name is not an alias.
+// arguments: everything after the command name (NULL if there are none).
+static char* expandAlias(const char* name, char* arguments) {
+    char* newCommand = NULL;
+    pthread_mutex_lock(&alias_mtx);
+    aliasEntry* entry = findAlias(name, strlen(name));
+    if (entry != NULL) {
+        aliasEntry* chain[MaxAliasDepth];
+        const char* before = resolvedAliasBefore(entry, chain, 0);
+        ios_trace(TraceParsing, @"alias %s: %s %s %d", name, before, entry->after, entry->position);
+        size_t length = strlen(before) + strlen(entry->after) + ((arguments != NULL) ? strlen(arguments) : 0) + 3;
+        newCommand = malloc(length);
+        if (newCommand != NULL) {
+            if (entry->position == aliasAppendArguments) {
+                // all the alias, then all the arguments:
+                if (arguments == NULL) strcpy(newCommand, before);
+                else sprintf(newCommand, "%s %s", before, arguments);
+            } else if ((arguments == NULL) || (arguments[0] == 0)) {
+                sprintf(newCommand, "%s %s", before, entry->after);
+            } else if (entry->position == aliasAfterLast) {
+                sprintf(newCommand, "%s %s %s", before, arguments, entry->after);
+            } else {
+                // afterFirst: the alias, the first argument, the end of the alias, the other arguments:
+                char* secondSpace = strstrquoted(arguments, " ");
+                if (secondSpace == NULL) {
+                    sprintf(newCommand, "%s %s %s", before, arguments, entry->after);
+                } else {
+                    *secondSpace = 0;
+                    sprintf(newCommand, "%s %s %s %s", before, arguments, entry->after, secondSpace + 1);
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&alias_mtx);
+    return newCommand;
+}
+
+// Pipeline fusion (ios_fusion.c): the stages of a pipeline are fused only if each of them would run the
+// command of text.framework: not an alias (the stages after the first aren't expanded yet), not a file in $PATH.
+extern bool ios_canFusePipeline(const char* command, bool (*fusibleCommand)(const char* name));
+static bool fusibleCommand(const char* name) {
+    pthread_mutex_lock(&alias_mtx);
+    bool alias = (numAliases > 0) && (findAlias(name, strlen(name)) != NULL);
+    pthread_mutex_unlock(&alias_mtx);
+    if (alias) return false;
+    const commandDescription* command = commandLookup(name);
+    if ((command == NULL) || (command->libraryKind != libraryDynamic) || (strcmp(command->library, "text.framework/text") != 0)) return false;
+    char function[64];
+    snprintf(function, sizeof(function), "%s_main", name);
+    if (strcmp(command->function, function) != 0) return false;
+    char* location = ios_which(name);
+    bool builtin = (location != NULL) && (strcmp(location, name) == 0);
+    free(location);
+    return builtin;
+}
+
+static void printAlias(aliasEntry* entry) {
+    fprintf(thread_stdout, "%s", entry->before);
+    if (entry->position == aliasAfterFirst) {
+        fprintf(thread_stdout, " !^ %s", entry->after);
+    } else if (entry->position == aliasAfterLast) {
+        fprintf(thread_stdout, " !* %s", entry->after);
+    }
+    fprintf(thread_stdout, "\n");
+}
+
 int alias_main(int argc, char** argv) {
     // Syntax: alias command="new command" or alias command "new command" (both must work)
     // alias -h or alias --help: print help
     // alias (no arguments): print list of aliases
     // alias (single argument): print corresponding alias
     NSString* usage = @"usage: alias command new command\n\talias command=new command\n\t!^ = first argument\n\t!* = all arguments";
-    if (aliasDictionary == nil) {
-        aliasDictionary = [NSMutableDictionary new];
-    }
     if (argc <= 1) {
         // no arguments: print list of aliases
-        for (NSString* command in aliasDictionary) {
-            NSArray<NSString*>* aliasArray = aliasDictionary[command];
-            fprintf(thread_stdout, "%s\t", command.UTF8String);
-            fprintf(thread_stdout, "%s", aliasArray[0].UTF8String);
-            if ([aliasArray[2] isEqualToString: @"afterFirst"]) {
-                fprintf(thread_stdout, " !^ %s", aliasArray[1].UTF8String);
-            } else if ([aliasArray[2] isEqualToString: @"afterLast"]) {
-                fprintf(thread_stdout, " !* %s", aliasArray[1].UTF8String);
+        pthread_mutex_lock(&alias_mtx);
+        for (int i = 0; i < AliasBuckets; i++) {
+            for (aliasEntry* entry = aliasTable[i]; entry != NULL; entry = entry->next) {
+                fprintf(thread_stdout, "%s\t", entry->name);
+                printAlias(entry);
             }
-            fprintf(thread_stdout, "\n");
         }
+        pthread_mutex_unlock(&alias_mtx);
         return 0;
     }
     if (argv[1][0] == '-') {
@@ -1335,16 +2881,10 @@ int alias_main(int argc, char** argv) {
     NSString* command = nil;
     if ((equalSign == NULL) && (argc == 2)) {
         // single command, show alias:
-        command =  [NSString stringWithCString:argv[1] encoding:NSUTF8StringEncoding];
-        NSArray<NSString*>* aliasArray = aliasDictionary[command];
-        if (aliasArray == nil) { return 0; }
-        fprintf(thread_stdout, "%s", aliasArray[0]);
-        if ([aliasArray[2] isEqualToString: @"afterFirst"]) {
-            fprintf(thread_stdout, " !^ %s", aliasArray[1]);
-        } else if ([aliasArray[2] isEqualToString: @"afterLast"]) {
-            fprintf(thread_stdout, " !* %s", aliasArray[1]);
-        }
-        fprintf(thread_stdout, "\n");
+        pthread_mutex_lock(&alias_mtx);
+        aliasEntry* entry = findAlias(argv[1], strlen(argv[1]));
+        if (entry != NULL) printAlias(entry);
+        pthread_mutex_unlock(&alias_mtx);
         return 0;
     }
     NSMutableArray<NSString *> *commandArray = [[NSMutableArray alloc] init];
@@ -1403,12 +2943,12 @@ int alias_main(int argc, char** argv) {
     }
     NSString* before = @"";
     NSString* after = @"";
-    NSString* position = @"";
+    aliasPosition position = aliasAppendArguments;
     if (([commandArray containsObject:@"!^"]) && ([commandArray containsObject:@"!*"])) {
         fprintf(thread_stderr, "alias: can't pecify both !^ and !*, sorry.\n", argv[1]);
         return 1;
     } else if ([commandArray containsObject:@"!^"]) {
-        position = @"afterFirst";
+        position = aliasAfterFirst;
         bool foundMarker = false;
         for (NSString* component in commandArray) {
             if ([component isEqualToString: @"!^"]) { foundMarker = true; continue; }
@@ -1421,7 +2961,7 @@ int alias_main(int argc, char** argv) {
             }
         }
     } else if ([commandArray containsObject:@"!*"]) {
-        position = @"afterLast";
+        position = aliasAfterLast;
         bool foundMarker = false;
         for (NSString* component in commandArray) {
             if ([component isEqualToString:@"!*"]) {
@@ -1444,8 +2984,7 @@ int alias_main(int argc, char** argv) {
     }
     before = [before stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
     after = [after stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
-    NSArray<NSString *> *result = @[before, after, position];
-    aliasDictionary[command] = result;
+    setAlias(command.UTF8String, before.UTF8String, after.UTF8String, position);
     return 0;
 }
 
@@ -1454,89 +2993,201 @@ NSString* aliasedCommand(NSString* command) {
         // \command = cancel aliasing
         return [command substringFromIndex:1];
     }
-    if (aliasDictionary == nil) {
-        return command;
-    }
-    NSArray<NSString*>* aliasArray = aliasDictionary[command];
-    if (aliasArray == nil) {
-        return command;
-    }
-    NSString* result = aliasArray[0];
-    if ([aliasArray[2] isEqualToString: @"afterFirst"]) {
-        result = [[result stringByAppendingString:@" !^ "] stringByAppendingString: aliasArray[1]];
-    } else if ([aliasArray[2] isEqualToString: @"afterLast"]) {
-        result = [[result stringByAppendingString:@" !* "] stringByAppendingString: aliasArray[1]];
+    NSString* result = command;
+    pthread_mutex_lock(&alias_mtx);
+    aliasEntry* entry = findAlias(command.UTF8String, strlen(command.UTF8String));
+    if (entry != nil) {
+        result = @(entry->before);
+        if (entry->position == aliasAfterFirst) {
+            result = [[result stringByAppendingString:@" !^ "] stringByAppendingString: @(entry->after)];
+        } else if (entry->position == aliasAfterLast) {
+            result = [[result stringByAppendingString:@" !* "] stringByAppendingString: @(entry->after)];
+        }
     }
+    pthread_mutex_unlock(&alias_mtx);
     return result;
 }
 
 int unalias_main(int argc, char** argv) {
     NSString* usage = @"usage: unalias [command|-a]";
-    if (aliasDictionary == nil) {
-        aliasDictionary = [NSMutableDictionary new];
-    }
     if ((argc == 1) || ((argv[1][0] == '-') && (strncmp(argv[1], "-a", 2) != 0))) {
         fprintf(thread_stderr, "%s\n", usage.UTF8String);
         return 0;
     }
     if (strncmp(argv[1], "-a", 2) == 0) {
-        [aliasDictionary removeAllObjects];
+        removeAllAliases();
         return 0;
     }
     for (int i = 1; i < argc; i++) {
-        NSString* command =  [NSString stringWithCString:argv[i] encoding:NSUTF8StringEncoding];
-        [aliasDictionary removeObjectForKey: command];
+        removeAlias(argv[i]);
     }
     return 0;
 }
 
-// Auxiliary function for sh_main. Given a string of characters (command1 && command2),
-// split it into the sub commands and execute each of them in sequence:
+typedef enum { separatorAnd, separatorOr, separatorSequence, separatorBackground } commandSeparator;
+
+// First "&&", "||", ";" or "&" outside of quotes (same quoting rules as strstrquoted), in a single pass.
+// "&" that belongs to a redirection ("2>&1", ">&", "&>", "|&", "&|") is not a separator.
+static char* nextSeparator(char* command, commandSeparator* kind) {
+    char quotechar = 0;
+    int esclen = 0;
+    for (char* c = command; c[0] != 0; c++) {
+        char ch = c[0];
+        if (quotechar) {
+            if (ch == '\\') {
+                esclen++;
+                continue;
+            }
+            if ((ch == quotechar) && (esclen % 2 == 0)) quotechar = 0;
+            esclen = 0;
+            continue;
+        }
+        bool escaped = (esclen % 2 == 1);
+        if (ch == '\\') {
+            esclen++;
+            continue;
+        }
+        esclen = 0;
+        if (escaped) continue; // e.g. "find . -exec ls {} \;"
+        if (ch == '"' || ch == '\'') {
+            quotechar = ch;
+            continue;
+        }
+        if (((ch == '&') || (ch == '|')) && (c[1] == ch)) {
+            *kind = (ch == '&') ? separatorAnd : separatorOr;
+            return c;
+        }
+        if (ch == ';') {
+            *kind = separatorSequence;
+            return c;
+        }
+        if ((ch == '&') && (c[1] != '>') && (c[1] != '|')) {
+            char previous = (c > command) ? c[-1] : 0;
+            if ((previous != '>') && (previous != '|')) {
+                *kind = separatorBackground;
+                return c;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Remove the jobs that have terminated:
+static void reapBackgroundJobs(sessionParameters* session) {
+    int j = 0;
+    for (int i = 0; i < session->numJobs; i++) {
+        if (ios_getThreadId(session->jobs[i].pid) != 0) {
+            session->jobs[j++] = session->jobs[i];
+        }
+    }
+    session->numJobs = j;
+}
+
+static void waitForBackgroundJobs(sessionParameters* session) {
+    for (int i = 0; i < session->numJobs; i++) ios_waitpid(session->jobs[i].pid);
+    session->numJobs = 0;
+}
+
+static void startBackgroundJob(char* command) {
+    if (currentSession->jobs == NULL) {
+        currentSession->jobs = calloc(MaxBackgroundJobs, sizeof(backgroundJob));
+        if (currentSession->jobs == NULL) {
+            ios_system(command);
+            return;
+        }
+    }
+    reapBackgroundJobs(currentSession);
+    // Too many jobs running in parallel: wait for the oldest one.
+    while (currentSession->numJobs >= currentSession->maxJobs) {
+        ios_waitpid(currentSession->jobs[0].pid);
+        reapBackgroundJobs(currentSession);
+    }
+    pid_t pid = ios_fork();
+    if (pid < 0) {
+        // No more processes available: run it in the foreground.
+        ios_system(command);
+        return;
+    }
+    backgroundJob* job = &currentSession->jobs[currentSession->numJobs];
+    job->pid = pid;
+    job->number = ++currentSession->lastJobNumber;
+    strlcpy(job->command, command, sizeof(job->command));
+    currentSession->numJobs += 1;
+    ios_system(command); // does not wait: sh sessions are not on the main thread
+    ios_trace(TraceSession, @"Started background job [%d] pid: %d %s", job->number, pid, command);
+}
+
+// Built-in commands that act on the jobs of the sh session. Returns true if command was one of them.
+static bool jobControlCommand(char* command, int* returnValue) {
+    char* end = command + strlen(command);
+    while ((end > command) && (end[-1] == ' ')) end--;
+    size_t length = end - command;
+    if ((length == 4) && (strncmp(command, "jobs", 4) == 0)) {
+        reapBackgroundJobs(currentSession);
+        for (int i = 0; i < currentSession->numJobs; i++)
+            fprintf(thread_stdout, "[%d]  %d Running\t%s\n", currentSession->jobs[i].number, currentSession->jobs[i].pid, currentSession->jobs[i].command);
+        *returnValue = 0;
+        return true;
+    }
+    if ((length >= 4) && (strncmp(command, "wait", 4) == 0) && ((length == 4) || (command[4] == ' '))) {
+        char* argument = command + 4;
+        while (argument[0] == ' ') argument++;
+        if (argument >= end) {
+            waitForBackgroundJobs(currentSession);
+        } else {
+            // "wait pid" or "wait %job"
+            bool isJobNumber = (argument[0] == '%');
+            int value = atoi(argument + (isJobNumber ? 1 : 0));
+            for (int i = 0; i < currentSession->numJobs; i++) {
+                if ((isJobNumber && (currentSession->jobs[i].number == value)) || (!isJobNumber && (currentSession->jobs[i].pid == value)))
+                    ios_waitpid(currentSession->jobs[i].pid);
+            }
+            reapBackgroundJobs(currentSession);
+        }
+        *returnValue = 0;
+        return true;
+    }
+    return false;
+}
+
+// Does this command contain "&&", "||", ";" or "&"?
+static bool hasCommandSeparator(char* command) {
+    commandSeparator kind;
+    return nextSeparator(command, &kind) != NULL;
+}
+
+// Auxiliary function for sh_split_main. Given a string of characters (command1 && command2 ; command3 & command4),
+// split it into the sub commands and execute each of them in sequence, or in the background if followed by "&":
 static int splitCommandAndExecute(char* command) {
     // Remember to use fork / waitpid to wait for the commands to finish
     if (command == NULL) return 0;
-    char* maxPointer = command + strlen(command);
     int returnValue = 0;
+    bool skipNext = false; // after a failed "&&" or a successful "||"
     while (command[0] != 0) {
-        // NSLog(@"stdout %x \n", fileno(thread_stdout));
-        // NSLog(@"stderr %x \n", fileno(thread_stderr));
-        char* nextAnd = strstrquoted(command, "&&");
-        char* nextOr = strstrquoted(command, "||");
-        if ((nextAnd == NULL) && (nextOr == NULL)) {
-            // Only one command left
-            pid_t pid = ios_fork();
-            returnValue = ios_system(command);
-            NSLog(@"Started command, stored last_thread= %x pid: %d", currentSession->lastThreadId, pid);
-            ios_waitpid(pid);
-            break;
-        }
-        int nextCommandPosition = 0;
-        bool andNextCommand = false;
-        if (nextAnd != NULL) {
-            nextCommandPosition = nextAnd - command;
-            andNextCommand = true;
+        while (command[0] == ' ') command++; // skip spaces
+        if (command[0] == 0) break; // happens if the command ends with a separator
+        commandSeparator separator = separatorSequence;
+        char* next = nextSeparator(command, &separator);
+        if (next != NULL) {
+            next[0] = 0; // terminate string
+            next += ((separator == separatorAnd) || (separator == separatorOr)) ? 2 : 1;
         }
-        if (nextOr != NULL) {
-            if (nextOr - command < nextCommandPosition) {
-                nextCommandPosition = nextOr - command;
-                andNextCommand = false;
+        if (!skipNext) {
+            if (separator == separatorBackground) {
+                startBackgroundJob(command);
+                returnValue = 0;
+            } else if (!jobControlCommand(command, &returnValue)) {
+                pid_t pid = ios_fork();
+                returnValue = ios_system(command);
+                ios_trace(TraceSession, @"Started command, stored last_thread= %x pid: %d", currentSession->lastThreadId, pid);
+                ios_waitpid(pid);
             }
         }
-        command[nextCommandPosition] = NULL; // terminate string
-        pid_t pid = ios_fork();
-        returnValue = ios_system(command);
-        // NSLog(@"Started command (2), stored last_thread= %x", currentSession->lastThreadId);
-        ios_waitpid(pid);
-        if (andNextCommand && (returnValue != 0)) {
-            // && + the command returned error, we return:
-            break;
-        } else if (!andNextCommand && (returnValue == 0)) {
-            // || + the command worked, we return:
-            break;
-        }
-        command += (nextCommandPosition + 2); // char after "&&" or "||"
-        while ((command[0] == ' ') && (command < maxPointer)) command++; // skip spaces
-        if (command > maxPointer) return 0; // happens if the command ends with && or ||
+        if (separator == separatorAnd) skipNext = (returnValue != 0);
+        else if (separator == separatorOr) skipNext = (returnValue == 0);
+        else skipNext = false;
+        if (next == NULL) break;
+        command = next;
     }
     return returnValue;
 }
@@ -1546,16 +3197,20 @@ sessionParameters* parentSession = NULL;
 // TODO: we *do* have multiple sh sessions running. We will need some way to make this safe.
 //
 NSString* parentDir;
-int sh_main(int argc, char** argv) {
+// sh itself is shell_cmds/sh (sh_main, in the shell framework). It only runs one at a time; an sh started
+// while it runs falls back to this:
+int sh_split_main(int argc, char** argv) {
     // NOT an actual shell.
     // for commands that call other commands as "sh -c command" or "sh -c command1 && command2"
-    // NSLog(@"sh_main, stdout %d \n", fileno(thread_stdout));
-    // NSLog(@"sh_main, stderr %d \n", fileno(thread_stderr));
+    // NSLog(@"sh_split_main, stdout %d \n", fileno(thread_stdout));
+    // NSLog(@"sh_split_main, stderr %d \n", fileno(thread_stderr));
     if ((argc < 2) || (strncmp(argv[1], "-h", 2) == 0)) {
         fprintf(thread_stderr, "Not an actual shell. sh is provided for compatibility with commands that call other commands.\n");
         fprintf(thread_stderr, "Usage: sh [-flags] [VAR=value] command: executes command (all flags are ignored, environment variable VAR is set to value).\n");
         fprintf(thread_stderr, "       sh [-flags] command1 && command2 [&& command3 && ...]: executes the commands, in order, until one returns error.\n");
         fprintf(thread_stderr, "       sh [-flags] command1 || command2 [|| command3 || ...]: executes the commands, in order, until one returns OK.\n");
+        fprintf(thread_stderr, "       sh [-flags] command1 ; command2 & command3: executes command1, then command2 in the background and command3 in parallel.\n");
+        fprintf(thread_stderr, "       \"jobs\" lists the background jobs, \"wait [pid|%%job]\" waits for them.\n");
         argv[0][0] = 'h'; // prevent termination in cleanup_function
         return 0;
     }
@@ -1584,12 +3239,12 @@ int sh_main(int argc, char** argv) {
     if ((fileno(currentSession->stdout) == fileno(thread_stdout)) ||
         (fileno(currentSession->stderr) == fileno(thread_stderr)) ||
         (fileno(currentSession->stdout) == fileno(thread_stderr))) {
-        NSLog(@"prevent termination in cleanup_function");
+        ios_trace(TraceSession, @"prevent termination in cleanup_function");
         argv[0][0] = 'h'; // prevent termination in cleanup_function
     }
-    // If there is a single command (no && or ||), no need to create a new session.
+    // If there is a single command (no &&, ||, ; or &), no need to create a new session.
     int i = 0;
-    while ((command[i] != NULL) && (strstrquoted(command[i], "&&") == NULL) && (strstrquoted(command[i], "||") == NULL)) i++;
+    while ((command[i] != NULL) && !hasCommandSeparator(command[i])) i++;
     if (command[i] == NULL) {
         // Just one command:
         char* newCommand = concatenateArgv(command);
@@ -1603,21 +3258,20 @@ int sh_main(int argc, char** argv) {
     }
     // If we reach this point, we have multiple commands to execute.
     // Store current sesssion, create a new session specific for this, execute commands
-    id sessionKey = @((NSUInteger)sh_session);
-    if (sessionList != nil) {
-        sessionParameters* runningShellSession = (sessionParameters*)[[sessionList objectForKey: sessionKey] pointerValue];
+    {
+        sessionParameters* runningShellSession = sessionLookup(sh_session);
         if (runningShellSession != NULL) {
             if ((runningShellSession->lastThreadId != 0) && (runningShellSession->lastThreadId != pthread_self())) {
-                NSLog(@"There is another sh session running: last_thread= %x", runningShellSession->lastThreadId);
+                ios_trace(TraceSession, @"There is another sh session running: last_thread= %x", runningShellSession->lastThreadId);
                 argv[0][0] = 'h'; // prevent termination in cleanup_function
                 return 1;
             } else {
-                NSLog(@"There is another sh session running: last_thread= %x us= %x. Continuing.", runningShellSession->lastThreadId, pthread_self());
+                ios_trace(TraceSession, @"There is another sh session running: last_thread= %x us= %x. Continuing.", runningShellSession->lastThreadId, pthread_self());
             }
         }
     }
     NSFileManager *fileManager = [[NSFileManager alloc] init];
-    NSLog(@"parentSession = %x currentSession = %x currentDir = %s\n", parentSession, currentSession, [fileManager currentDirectoryPath].UTF8String);
+    ios_trace(TraceSession, @"parentSession = %x currentSession = %x currentDir = %s\n", parentSession, currentSession, [fileManager currentDirectoryPath].UTF8String);
     if (currentSession->context == sh_session) {
         NSLog(@"We cannot have a sh command starting a sh command");
         return 1; // We cannot have a sh command starting a sh command.
@@ -1664,6 +3318,8 @@ int sh_main(int argc, char** argv) {
         }
         command += (i+1);
     }
+    // Background jobs use the streams of this session: wait for them before closing it.
+    waitForBackgroundJobs(currentSession);
     // NSLog(@"Closing shell session; last_thread= %x root= %x", currentSession->lastThreadId, currentSession->current_command_root_thread);
     if (![parentDir isEqualToString:[fileManager currentDirectoryPath]]) {
         // NSLog(@"Reset current Dir to= %s instead of %s", parentDir.UTF8String, [fileManager currentDirectoryPath].UTF8String);
@@ -1680,10 +3336,13 @@ int ios_execv(const char *path, char* const argv[]) {
     // TODO: store new environment if current process has already stored some. 
     // path and argv[0] are the same (not in theory, but in practice, since Python wrote the command)
     // start "child" with the child streams:
-    char* cmd = concatenateArgv(argv);
-    int returnValue = ios_system(cmd);
-    free(cmd);
-    return returnValue;
+    if ((argv != NULL) && (argv[0] != NULL) && (argv[1] == NULL) && (strchr(argv[0], ' ') != NULL)) {
+        // Some programs call execv() with a single string: "ssh hg@bitbucket.org 'hg -R ... --stdio'"
+        // So we rely on ios_system to break them into chunks.
+        return ios_system(argv[0]);
+    }
+    // Otherwise, the arguments are already split, no need to concatenate and parse them again:
+    return ios_spawnv(path, argv, NULL, NULL, NULL, NULL);
 }
 
 int ios_execve(const char *path, char* const argv[], char* envp[]) {
@@ -1752,10 +3411,12 @@ int ios_dup2(int fd1, int fd2)
     else if (fd1 != fd2) {
         if (fcntl(fd1, F_GETFL) < 0)
             return -1;
-        if (fcntl(fd2, F_GETFL) >= 0)
-            close(fd2);
+        if (fcntl(fd2, F_GETFL) >= 0) {
+            if (close(fd2) == 0) trackDescriptors(-1);
+        }
         if (fcntl(fd1, F_DUPFD, fd2) < 0)
             return -1;
+        trackDescriptors(1);
     }
     return fd2;
 }
@@ -1775,6 +3436,8 @@ int ios_kill()
             // kill(getpid(), SIGINT); // infinite loop?
         } else {
             // Send pthread_cancel with the given signal to the current main thread, if there is one.
+            // The interruption flag stops it even if it does not reach a cancellation point (buffered output).
+            ios_interruptThread(currentSession->current_command_root_thread);
             return pthread_cancel(currentSession->current_command_root_thread);
         }
     }
@@ -1785,6 +3448,7 @@ int ios_kill()
 extern pthread_t ios_getThreadId(pid_t pid);
 int ios_killpid(pid_t pid, int sig) {
     if (ios_getThreadId(pid) > 0) {
+        if ((sig == SIGKILL) || (sig == SIGTERM)) ios_interrupt(pid);
         return pthread_kill(ios_getThreadId(pid), sig);
     }
     return 0;
@@ -1805,17 +3469,15 @@ void ios_switchSession(const void* sessionId) {
     }
 
     NSFileManager *fileManager = [[NSFileManager alloc] init];
-    id sessionKey = @((NSUInteger)sessionId);
-    if (sessionList == nil) {
-        sessionList = [NSMutableDictionary new];
-        if (currentSession != NULL) [sessionList setObject: [NSValue valueWithPointer:currentSession] forKey: sessionKey];
+    if (!sessionTableStarted) {
+        sessionTableStarted = true;
+        if (currentSession != NULL) sessionInsert(sessionId, currentSession);
     }
-    currentSession = (sessionParameters*)[[sessionList objectForKey: sessionKey] pointerValue];
+    currentSession = sessionLookup(sessionId);
     
     if (currentSession == NULL) {
-        sessionParameters* newSession =  malloc(sizeof(sessionParameters));
-        initSessionParameters(newSession);
-        [sessionList setObject: [NSValue valueWithPointer:newSession] forKey: sessionKey];
+        sessionParameters* newSession = allocateSession();
+        sessionInsert(sessionId, newSession);
         currentSession = newSession;
     } else {
         NSString* currentSessionDir = [NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding];
@@ -1835,16 +3497,19 @@ void ios_setDirectoryURL(NSURL* workingDirectoryURL) {
     if (currentSession != NULL) {
         NSString* currentSessionDir = [NSString stringWithCString:currentSession->currentDir encoding:NSUTF8StringEncoding];
         if ([currentSessionDir isEqualToString:[fileManager currentDirectoryPath]]) return;
-        strcpy(currentSession->previousDirectory, currentSession->currentDir);
-        strcpy(currentSession->currentDir, [[workingDirectoryURL path] UTF8String]);
+        currentSession->previousDirectory = currentSession->currentDir;
+        currentSession->currentDir = internPath([[workingDirectoryURL path] UTF8String]);
     }
 }
 
 void ios_closeSession(const void* sessionId) {
     // delete information associated with current session:
-    if (sessionList == nil) return;
-    id sessionKey = @((NSUInteger)sessionId);
-    [sessionList removeObjectForKey: sessionKey];
+    sessionParameters* session = sessionRemove(sessionId);
+    if (session != NULL) {
+        // The host is going to close the streams:
+        coalesceOutput(session, NULL, 0);
+        releaseSession(session);
+    }
     currentSession = NULL;
 }
 
@@ -1867,8 +3532,60 @@ int ios_isatty(int fd) {
     return 0;
 }
 
+// Coalesced terminal output: interactive commands write to the terminal in small pieces (a line for ls, a
+// character for tr, progress bars for curl), and the host renders each of them. With coalescing, the stdout
+// of the session gets a large buffer, sent when it is full, at the end of each command, before anything is
+// written on stderr, or at most one frame after the first byte written since it was last sent.
+#define CoalescingBufferSize (64 * 1024)
+
+static void flushCoalescedOutput(void* s) {
+    sessionParameters* session = (sessionParameters*) s;
+    session->flushPending = false; // anything written from now on will be flushed now, or schedule another flush
+    pthread_mutex_lock(&session->outputMutex);
+    if (session->coalescedStream != NULL) fflush(session->coalescedStream);
+    pthread_mutex_unlock(&session->outputMutex);
+}
+
+// Called by the output functions (libc_replacement.c) for each write on a coalesced stdout:
+void ios_scheduleOutputFlush(void* s) {
+    sessionParameters* session = (sessionParameters*) s;
+    if (session->flushPending) return;
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&session->flushPending, &expected, true)) return;
+    // Sessions are never freed (they go back to the pool), so the pointer stays valid:
+    dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, session->coalescingInterval), dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), session, flushCoalescedOutput);
+}
+
+// Coalesce output on stream (NULL: stop coalescing). The stream gets back its buffering mode when it is no
+// longer coalesced. Like setvbuf(), this is for streams that no command is writing to.
+static void coalesceOutput(sessionParameters* session, FILE* stream, int framesPerSecond) {
+    pthread_mutex_lock(&session->outputMutex);
+    FILE* previous = session->coalescedStream;
+    if ((previous != NULL) && (previous != stream)) {
+        fflush(previous);
+        setvbuf(previous, NULL, session->previousBuffering, 0);
+    }
+    if ((stream != NULL) && (stream != previous)) {
+        // BSD stdio keeps the buffering mode in the flags of the stream:
+        session->previousBuffering = (stream->_flags & __SNBF) ? _IONBF : ((stream->_flags & __SLBF) ? _IOLBF : _IOFBF);
+        fflush(stream);
+        setvbuf(stream, NULL, _IOFBF, CoalescingBufferSize);
+    }
+    if (framesPerSecond > 0) session->coalescingInterval = NSEC_PER_SEC / framesPerSecond;
+    session->coalescedStream = stream;
+    pthread_mutex_unlock(&session->outputMutex);
+}
+
+// Coalesce the terminal output of the current session, sent at most framesPerSecond times per second (0: every
+// write is sent as it comes, the default). It follows the session's stdout when ios_setStreams changes it.
+void ios_setOutputCoalescing(int framesPerSecond) {
+    if (currentSession == NULL) return;
+    coalesceOutput(currentSession, (framesPerSecond > 0) ? currentSession->stdout : NULL, framesPerSecond);
+}
+
 void ios_setStreams(FILE* _stdin, FILE* _stdout, FILE* _stderr) {
     if (currentSession == NULL) return;
+    if (currentSession->coalescedStream != NULL) coalesceOutput(currentSession, _stdout, 0);
     currentSession->stdin = _stdin;
     currentSession->stdout = _stdout;
     currentSession->stderr = _stderr;
@@ -1881,6 +3598,8 @@ void ios_settty(FILE* _tty) {
 
 int ios_gettty() {
     if (currentSession == NULL) return -1;
+    // the command is about to read from the terminal: the prompt must be there.
+    if (threadOutputCoalescer != NULL) fflush(thread_stdout);
     if (currentSession->tty == NULL) return -1;
     return fileno(currentSession->tty);
 }
@@ -1888,6 +3607,7 @@ int ios_gettty() {
 // Allows commands that are not usually tty-based to get the tty (for password input in ssh/scp/sftp):
 int ios_opentty() {
     if (currentSession == nil) { return -1; }
+    if (threadOutputCoalescer != NULL) fflush(thread_stdout);
     currentSession->activePager = true;
     if (currentSession->tty == NULL) return -1;
     return fileno(currentSession->tty);
@@ -1988,6 +3708,8 @@ void replaceCommand(NSString* commandName, NSString* functionName, bool allOccur
         }
     }
     commandList = [mutableDict copy]; // back to non-mutable version
+    buildCommandTable();
+    commandCacheInvalidate(NULL); // cached functions may have been replaced
 }
 
 // For customization:
@@ -1998,6 +3720,7 @@ void replaceCommand(NSString* commandName, NSString* functionName, bool allOccur
 // 2nd component: name of function to be called
 // 3rd component: chain sent to getopt (for arguments in autocomplete)
 // 4th component: takes a file/directory as argument
+// 5th component (optional): number of copies, for interpreters that can run several scripts at once
 //
 // Example:
 //    <key>rlogin</key>
@@ -2025,6 +3748,8 @@ NSError* addCommandList(NSString* fileLocation) {
     NSMutableDictionary *mutableDict = [commandList mutableCopy];
     [mutableDict addEntriesFromDictionary:newCommandList];
     commandList = [mutableDict copy];
+    buildCommandTable();
+    commandCacheInvalidate(NULL); // new definitions override cached commands
     return NULL;
 }
 
@@ -2075,12 +3800,12 @@ static char* getLastCharacterOfArgument(const char* argument) {
     // Should become: "perl", "-e", "install([ from_to => {@ARGV}, verbose => '0', uninstall_shadows => '0', dir_mode => '755' ]);"
     // If there is no space after the end quote, keep concatenating the argument.
     char recordSeparator = 0x1e;
-    if (strlen(argument) == 0) return NULL; // be safe
+    if (argument[0] == 0) return NULL; // be safe
     if (argument[0] == '"') {
         char* endquote = nextUnescapedCharacter(argument + 1, '"');
         if (endquote != NULL) {
             // Is there a space after the endquote?
-            if (strlen(endquote) <= 1) { return endquote + 1; } // last character
+            if (endquote[1] == 0) { return endquote + 1; } // last character
             if (endquote[1] == ' ') { return endquote + 1; } // space after endquote, we're good
             if (strncmp(endquote, "\"\\\"\"", 3) == 0 ) {
                 // Perl (for example) wrote here: "\"" and if the substitution works we get " inside the argument
@@ -2099,7 +3824,7 @@ static char* getLastCharacterOfArgument(const char* argument) {
         char* endquote = nextUnescapedCharacter(argument + 1, '\'');
         if (endquote != NULL) {
             // Is there a space after the endquote?
-            if (strlen(endquote) <= 1) { return endquote + 1; } // last character
+            if (endquote[1] == 0) { return endquote + 1; } // last character
             if (endquote[1] == ' ') { return endquote + 1; } // space after endquote, we're good
             if (strncmp(endquote, "'\\''", 3) == 0 ) {
                 // Perl (for example) wrote here: '\'' and if the substitution works we get ' inside the argument
@@ -2152,40 +3877,684 @@ static char* unquoteArgument(char* argument) {
         // strcpy(nextOccurence, nextOccurence + 1);
         nextOccurence = strchr(nextOccurence + 1, '\\');
     }
-    return argument;
+    return argument;
+}
+
+
+static int isRealCommand(const char* fileName) {
+    // File exists, is executable, not a directory.
+    // We check whether: a) its size is > 0 and b) it is not a Mach-O binary
+    int returnValue = false;
+    struct stat sb;
+    if (stat(fileName, &sb) == 0) {
+        // We can have an empty file with the same name in the path, to fool which():
+        if (sb.st_size == 0) {
+            return false;
+        }
+        // Not an empty file, so let's check its magic number:
+        int fd = open(fileName, O_RDONLY);
+        if (fd > 0) {
+            char res[4];
+            ssize_t retval = read(fd, &res, 4);
+            if (retval == 4) {
+                // MH_MAGIC_64 = 0xfeedfacf
+                if ((res[0] != '\xcf') || (res[1] != '\xfa') || (res[2] != '\xed') || (res[3] != '\xfe')) {
+                    // it's not a Mach-O binary:
+                    returnValue = true;
+                }
+            }
+            close (fd);
+        }
+    }
+    return returnValue;
+}
+
+// The first line of a file (for #!), which also holds the WebAssembly signature. Only the beginning
+// is read: .wasm modules can be megabytes, and they were read entirely for every command.
+#define FileHeaderSize 1024
+static NSData* fileHeader(const char* fileName) {
+    char buffer[FileHeaderSize];
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return nil;
+    ssize_t length = read(fd, buffer, FileHeaderSize);
+    close(fd);
+    if (length <= 0) return [NSData data];
+    char* endOfLine = memchr(buffer, '\n', length);
+    if (endOfLine != NULL) length = endOfLine - buffer;
+    return [NSData dataWithBytes:buffer length:length];
+}
+
+// Wildcard expansion: glob() reads the directories it goes through. Scripts expand the same patterns
+// (*.c, *.o...) in the same directories over and over, so we keep the last directory listings, and read
+// them again only if the directory has been modified since (mtime). glob() accesses them through
+// GLOB_ALTDIRFUNC. The cache is shared by all sessions.
+#define GlobCacheSize 32
+
+typedef struct _directoryListing {
+    _Atomic(int) refCount;  // one for the cache, one for each reader
+    char* path;
+    struct timespec mtime;
+    int numEntries;
+    char** names;
+    unsigned char* types;   // d_type of each entry
+} directoryListing;
+
+typedef struct _directoryReader {
+    directoryListing* listing;
+    int position;
+    struct dirent entry;    // returned by globReadDirectory
+} directoryReader;
+
+static directoryListing* globCache[GlobCacheSize];
+static unsigned long globCacheLastUsed[GlobCacheSize];
+static unsigned long globCacheClock = 0;
+static pthread_mutex_t globCache_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static void releaseDirectoryListing(directoryListing* listing) {
+    if (listing == NULL) return;
+    if (--listing->refCount > 0) return;
+    for (int i = 0; i < listing->numEntries; i++) free(listing->names[i]);
+    free(listing->names);
+    free(listing->types);
+    free(listing->path);
+    free(listing);
+}
+
+static directoryListing* readDirectoryListing(const char* path, const struct stat* sb) {
+    DIR* directory = opendir(path);
+    if (directory == NULL) return NULL;
+    directoryListing* listing = calloc(1, sizeof(directoryListing));
+    listing->refCount = 1;
+    listing->path = strdup(path);
+    listing->mtime = sb->st_mtimespec;
+    int capacity = 64;
+    listing->names = malloc(capacity * sizeof(char*));
+    listing->types = malloc(capacity);
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (listing->numEntries >= capacity) {
+            capacity *= 2;
+            listing->names = realloc(listing->names, capacity * sizeof(char*));
+            listing->types = realloc(listing->types, capacity);
+        }
+        listing->names[listing->numEntries] = strdup(entry->d_name);
+        listing->types[listing->numEntries] = entry->d_type;
+        listing->numEntries += 1;
+    }
+    closedir(directory);
+    return listing;
+}
+
+static void* globOpenDirectory(const char* path) {
+    char absolutePath[MAXPATHLEN];
+    if (path[0] == '/') {
+        strlcpy(absolutePath, path, MAXPATHLEN);
+    } else {
+        // relative paths depend on the current directory of the session:
+        if (getcwd(absolutePath, MAXPATHLEN) == NULL) return NULL;
+        strlcat(absolutePath, "/", MAXPATHLEN);
+        strlcat(absolutePath, path, MAXPATHLEN);
+    }
+    struct stat sb;
+    if (stat(absolutePath, &sb) != 0) return NULL;
+    if (!S_ISDIR(sb.st_mode)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+    directoryListing* listing = NULL;
+    pthread_mutex_lock(&globCache_mtx);
+    int slot = 0;
+    for (int i = 0; i < GlobCacheSize; i++) {
+        if ((globCache[i] != NULL) && (strcmp(globCache[i]->path, absolutePath) == 0)) {
+            slot = i;
+            if ((globCache[i]->mtime.tv_sec == sb.st_mtimespec.tv_sec) && (globCache[i]->mtime.tv_nsec == sb.st_mtimespec.tv_nsec)) {
+                listing = globCache[i];
+                listing->refCount++;
+            }
+            break;
+        }
+        // otherwise, replace the least recently used:
+        if (globCacheLastUsed[i] < globCacheLastUsed[slot]) slot = i;
+    }
+    globCacheLastUsed[slot] = ++globCacheClock;
+    pthread_mutex_unlock(&globCache_mtx);
+    if (listing == NULL) {
+        // Not in the cache, or the directory has changed:
+        listing = readDirectoryListing(absolutePath, &sb);
+        if (listing == NULL) return NULL;
+        listing->refCount++; // one for the cache, one for us
+        pthread_mutex_lock(&globCache_mtx);
+        directoryListing* previous = globCache[slot];
+        globCache[slot] = listing;
+        pthread_mutex_unlock(&globCache_mtx);
+        releaseDirectoryListing(previous);
+    }
+    directoryReader* reader = calloc(1, sizeof(directoryReader));
+    reader->listing = listing;
+    return reader;
+}
+
+static struct dirent* globReadDirectory(void* handle) {
+    directoryReader* reader = (directoryReader*) handle;
+    if (reader->position >= reader->listing->numEntries) return NULL;
+    const char* name = reader->listing->names[reader->position];
+    strlcpy(reader->entry.d_name, name, sizeof(reader->entry.d_name));
+    reader->entry.d_namlen = strlen(reader->entry.d_name);
+    reader->entry.d_type = reader->listing->types[reader->position];
+    reader->position += 1;
+    return &reader->entry;
+}
+
+static void globCloseDirectory(void* handle) {
+    directoryReader* reader = (directoryReader*) handle;
+    releaseDirectoryListing(reader->listing);
+    free(reader);
+}
+
+// Same as glob(pattern, 0, NULL, gt), with the directory listings cache:
+static int cachedGlob(const char* pattern, glob_t* gt) {
+    memset(gt, 0, sizeof(glob_t));
+    gt->gl_opendir = globOpenDirectory;
+    gt->gl_readdir = globReadDirectory;
+    gt->gl_closedir = globCloseDirectory;
+    gt->gl_lstat = lstat;
+    gt->gl_stat = stat;
+    return glob(pattern, GLOB_ALTDIRFUNC, NULL, gt);
+}
+
+// $PATH lookups, in the style of the shell's "hash": for each command name, the files found in the
+// directories of $PATH (name, name.bc, name.ll or name.wasm). Valid for one value of $PATH (and of the
+// current directory, if $PATH has relative directories), as long as none of the directories has been
+// modified (mtime). Only the directories are checked for each command, instead of 4 files in each of them.
+// "hash -r" (ios_hashReset) empties it, for files changed behind a symbolic link.
+static NSString* pathCacheKey = nil;
+static NSArray<NSString*>* pathCacheDirectories = nil;
+static struct timespec* pathCacheMtimes = NULL; // one per directory, tv_sec = -1 if it isn't a directory
+static NSMutableDictionary<NSString*, NSArray<NSString*>*>* pathCache = nil;
+static unsigned long pathCacheGeneration = 0;
+static pthread_mutex_t pathCache_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+void ios_hashReset(void) {
+    pthread_mutex_lock(&pathCache_mtx);
+    pathCacheKey = nil;
+    [pathCache removeAllObjects];
+    pathCacheGeneration++;
+    pthread_mutex_unlock(&pathCache_mtx);
+}
+
+// The files for commandName in the directories of pathValue, in the order of $PATH.
+static NSArray<NSString*>* locationsInPath(NSString* commandName, NSString* pathValue) {
+    NSArray<NSString*>* directories = nil;
+    NSString* key = pathValue;
+    pthread_mutex_lock(&pathCache_mtx);
+    if ([pathValue isEqualToString:pathCacheKey]) directories = pathCacheDirectories;
+    pthread_mutex_unlock(&pathCache_mtx);
+    if (directories == nil) directories = [pathValue componentsSeparatedByString:@":"];
+    NSUInteger numDirectories = directories.count;
+    struct timespec* mtimes = calloc(numDirectories + 1, sizeof(struct timespec));
+    if (mtimes == NULL) return @[];
+    // Files inside the Application Bundle can't change, nor can the directories.
+    NSString* bundlePath = [[NSBundle mainBundle] resourcePath];
+    for (NSUInteger i = 0; i < numDirectories; i++) {
+        NSString* path = directories[i];
+        struct stat sb;
+        if (![path hasPrefix:@"/"]) {
+            // relative directory, the result depends on where we are:
+            char cwd[MAXPATHLEN];
+            if ([key isEqualToString:pathValue] && (getcwd(cwd, MAXPATHLEN) != NULL))
+                key = [pathValue stringByAppendingFormat:@"\n%s", cwd];
+        } else if ((bundlePath != nil) && [path hasPrefix:bundlePath]) {
+            continue;
+        }
+        if ((stat(path.UTF8String, &sb) == 0) && S_ISDIR(sb.st_mode)) mtimes[i] = sb.st_mtimespec;
+        else mtimes[i].tv_sec = -1;
+    }
+    NSArray<NSString*>* locations = nil;
+    pthread_mutex_lock(&pathCache_mtx);
+    if (![key isEqualToString:pathCacheKey] || (memcmp(mtimes, pathCacheMtimes, numDirectories * sizeof(struct timespec)) != 0)) {
+        // different $PATH, or one of the directories has changed:
+        if (pathCache == nil) pathCache = [[NSMutableDictionary alloc] init];
+        [pathCache removeAllObjects];
+        free(pathCacheMtimes);
+        pathCacheMtimes = mtimes;
+        mtimes = NULL;
+        pathCacheKey = key;
+        pathCacheDirectories = directories;
+        pathCacheGeneration++;
+    } else {
+        locations = pathCache[commandName];
+    }
+    unsigned long generation = pathCacheGeneration;
+    pthread_mutex_unlock(&pathCache_mtx);
+    free(mtimes);
+    if (locations != nil) return locations;
+
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    NSMutableArray<NSString*>* found = [[NSMutableArray alloc] init];
+    for (NSString* path in directories) {
+        // If we don't have access to the path component, there's no point in continuing:
+        BOOL isDir = false;
+        if (![fileManager fileExistsAtPath:path isDirectory:&isDir]) continue;
+        if (!isDir) continue; // same in the (unlikely) event the path component is not a directory
+        // search for 4 possibilities: name, name.bc, name.ll and name.wasm
+        NSString* locationName = [path stringByAppendingPathComponent:commandName];
+        bool fileFound = [fileManager fileExistsAtPath:locationName isDirectory:&isDir];
+        if (fileFound && isDir) continue; // file exists, but is a directory
+        for (NSString* suffix in @[@".bc", @".ll", @".wasm"]) {
+            if (fileFound) break;
+            locationName = [[path stringByAppendingPathComponent:commandName] stringByAppendingString:suffix];
+            fileFound = [fileManager fileExistsAtPath:locationName isDirectory:&isDir];
+            if (fileFound && isDir) break;
+        }
+        if (!fileFound || isDir) continue;
+        // isExecutableFileAtPath replies "NO" even if file has x-bit set.
+        // if (![fileManager  isExecutableFileAtPath:cmdname]) continue;
+        struct stat sb;
+        // Files inside the Application Bundle will always have "x" removed. Don't check.
+        if (!([path containsString:bundlePath]) // Not inside the App Bundle
+            && !((stat(locationName.UTF8String, &sb) == 0))) // file exists, is not a directory
+            continue;
+        [found addObject:locationName];
+    }
+    pthread_mutex_lock(&pathCache_mtx);
+    // unless the cache has been emptied in the meantime:
+    if (generation == pathCacheGeneration) pathCache[commandName] = found;
+    pthread_mutex_unlock(&pathCache_mtx);
+    return found;
 }
 
+// Where the command would be found: a file in $PATH (that ios_system runs, not an empty file or a
+// Mach-O binary standing for one of our commands), or its name for a command of ios_system.
+// NULL if it is neither. The result is allocated with malloc().
+char* ios_which(const char* cmd) {
+    if ((cmd == NULL) || (cmd[0] == 0)) return NULL;
+    if (strchr(cmd, '/') != NULL) {
+        if (isRealCommand(cmd)) return strdup(cmd);
+    } else {
+        const char* path = getenv("PATH");
+        NSString* commandName = [NSString stringWithCString:cmd encoding:NSUTF8StringEncoding];
+        if ((path != NULL) && (commandName != nil)) {
+            NSString* pathValue = [NSString stringWithCString:path encoding:NSUTF8StringEncoding];
+            for (NSString* locationName in locationsInPath(commandName, pathValue)) {
+                if ([locationName hasSuffix:@".bc"] || [locationName hasSuffix:@".ll"] || [locationName hasSuffix:@".wasm"]
+                    || isRealCommand(locationName.UTF8String))
+                    return strdup(locationName.UTF8String);
+            }
+        }
+    }
+    if (ios_executable(cmd)) return strdup(cmd);
+    return NULL;
+}
 
-static int isRealCommand(const char* fileName) {
-    // File exists, is executable, not a directory.
-    // We check whether: a) its size is > 0 and b) it is not a Mach-O binary
-    int returnValue = false;
-    struct stat sb;
-    if (stat(fileName, &sb) == 0) {
-        // We can have an empty file with the same name in the path, to fool which():
-        if (sb.st_size == 0) {
-            return false;
+// Resolves argv[0] (file in $PATH, script with #!, WebAssembly, builtin command), then starts the command.
+// argv has been split and expanded already. It will be released in cleanup_function (or here if the command is not found).
+// Once the command line has been parsed and expanded, the arguments are packed in a single block (the pointers,
+// then the strings), released in one call by cleanup_function. Commands can change argv or its pointers
+// (getopt permutes them) without leaking or freeing the wrong pointer. Releases the original argv.
+static char** packArguments(int argc, char** argv) {
+    size_t size = (argc + 1) * sizeof(char*);
+    for (int i = 0; i < argc; i++) size += strlen(argv[i]) + 1;
+    char** packed = malloc(size);
+    if (packed == NULL) return argv; // out of memory: the strings will leak, argv is still released
+    char* strings = (char*)(packed + argc + 1);
+    for (int i = 0; i < argc; i++) {
+        size_t length = strlen(argv[i]) + 1;
+        memcpy(strings, argv[i], length);
+        packed[i] = strings;
+        strings += length;
+        free(argv[i]);
+    }
+    packed[argc] = NULL;
+    free(argv);
+    return packed;
+}
+
+static void dispatchArgv(int argc, char** argv, functionParameters* params, NSFileManager* fileManager, const char* commandLine) {
+    // Now call the actual command:
+    // - is argv[0] a command that refers to a file? (either absolute path, or in $PATH)
+    //   if so, does it exist, does it have +x bit set, does it have #! python or #! lua on the first line?
+    //   if yes to all, call the relevant interpreter. Works for hg, for example.
+    if (argv[0][0] == '\\') {
+        // Just remove the \ at the beginning
+        // There can be several versions of a command (e.g. ls as precompiled and ls written in Python)
+        // The executable file has precedence, unless the user has specified they want the original
+        // version, by prefixing it with \. So "\ls" == always "our" ls. "ls" == maybe ~/Library/bin/ls
+        // (if it exists).
+        // It also cancels aliases.
+        size_t len_with_terminator = strlen(argv[0] + 1) + 1;
+        memmove(argv[0], argv[0] + 1, len_with_terminator);
+    } else  {
+        NSString* commandName = [NSString stringWithCString:argv[0]  encoding:NSUTF8StringEncoding];
+        strcpy(currentSession->commandName, argv[0]);
+        BOOL isDir = false;
+        bool cmdIsAFile = false;
+        bool cmdIsReal = false;
+        bool cmdIsAPath = false;
+        if ([commandName hasPrefix:@"~/"]) {
+            NSString* replacement_string = [NSString stringWithCString:(getenv("HOME")) encoding:NSUTF8StringEncoding];
+            NSString* test_string = @"~";
+            commandName = [commandName stringByReplacingOccurrencesOfString:test_string withString:replacement_string options:NULL range:NSMakeRange(0, 1)];
         }
-        // Not an empty file, so let's check its magic number:
-        int fd = open(fileName, O_RDONLY);
-        if (fd > 0) {
-            char res[4];
-            ssize_t retval = read(fd, &res, 4);
-            if (retval == 4) {
-                // MH_MAGIC_64 = 0xfeedfacf
-                if ((res[0] != '\xcf') || (res[1] != '\xfa') || (res[2] != '\xed') || (res[3] != '\xfe')) {
-                    // it's not a Mach-O binary:
-                    returnValue = true;
+        if ([fileManager fileExistsAtPath:commandName isDirectory:&isDir]  && (!isDir)) {
+            // File exists, is a file.
+            struct stat sb;
+            if (stat(commandName.UTF8String, &sb) == 0) {
+                // File exists, is executable, not a directory.
+                cmdIsAFile = true;
+                // We can have an empty file with the same name in the path, to fool which():
+                // We can also have a Mach-O binary with the same name in the path (in simulator, mostly)
+                cmdIsReal = isRealCommand(commandName.UTF8String);
+            }
+        }
+        // if commandName contains "/", then it's a path, and we don't search for it in PATH.
+        cmdIsAPath = ([commandName rangeOfString:@"/"].location != NSNotFound);
+        if (!cmdIsAPath || cmdIsAFile) {
+            // We go through the path, because that command may be a file in the path
+            // (the files found in $PATH for a command name are kept in pathCache)
+            NSArray<NSString*>* locations = @[commandName];
+            if (!cmdIsAFile) {
+                NSString* checkingPath = [NSString stringWithCString:getenv("PATH") encoding:NSUTF8StringEncoding];
+                locations = locationsInPath(commandName, checkingPath);
+            }
+            for (NSString* locationName in locations) {
+                if (([locationName hasSuffix:@".bc"]) || ([locationName hasSuffix:@".ll"])) {
+                    // CLANG bitcode. insert lli in front of argument list:
+                    argc += 1;
+                    argv = (char **)realloc(argv, sizeof(char*) * argc);
+                    // Move everything one step up
+                    for (int i = argc; i >= 1; i--) { argv[i] = argv[i-1]; }
+                    argv[1] = realloc(argv[1], locationName.length + 1);
+                    strcpy(argv[1], locationName.UTF8String);
+                    argv[0] = strdup("lli"); // this argument is new
+                    break;
+                } else if ([locationName hasSuffix:@".wasm"]) {
+                    // insert wasm in front of argument list:
+                    argc += 1;
+                    argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
+                    // Move everything one step up
+                    for (int i = argc-1; i >= 1; i--) { argv[i] = argv[i-1]; }
+                    argv[1] = realloc(argv[1], locationName.length + 1);
+                    strcpy(argv[1], locationName.UTF8String);
+                    argv[0] = strdup("wasm"); // this argument is new
+                    break;
+                } else {
+                    if (isRealCommand(locationName.UTF8String)) {
+                        cmdIsReal = true;
+                        NSData *data = fileHeader(locationName.UTF8String);
+                        NSString *fileContent = [[NSString alloc]initWithData:data encoding:NSUTF8StringEncoding];
+                        if ((fileContent == nil) && (data.length > 0)) {
+                            // Conversion to string failed with UTF8. Try with Ascii as a backup:
+                            fileContent =  [[NSString alloc]initWithData:data encoding:NSASCIIStringEncoding];
+                        }
+                        NSString* firstLine;
+                        if (fileContent != nil) {
+                            NSRange firstLineRange = [fileContent rangeOfString:@"\n"];
+                            if (firstLineRange.length > 0) {
+                                firstLineRange.length = firstLineRange.location;
+                            } else {
+                                firstLineRange.length = fileContent.length;
+                            }
+                            firstLineRange.location = 0;
+                            firstLine = [fileContent substringWithRange:firstLineRange];
+                        }
+                        if ([firstLine hasPrefix:@"#!"]) {
+                            // 1) get script language name
+                            // The last word of the line is the command. This covers all of the cases encountered:
+                            // "#! /usr/bin/python", "#! /usr/local/bin/python" and "#! /usr/bin/myStrangePath/python" are all OK.
+                            // We also accept "#! /usr/bin/env python" because it is used.
+                            // And we want to accept "#! bc -l" too, so we can have multiple arguments.
+                            // Take alphanumericCharacterSet and invert it.
+                            firstLine = [firstLine substringFromIndex:2]; // remove "#!" at the beginning
+                            firstLine = [firstLine stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]]; // remove any extra space
+                            NSArray<NSString*> *components = [firstLine componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+                            unsigned long numComponents = components.count;
+                            int start = 0;
+                            if ([components.firstObject hasSuffix:@"env"]) {
+                                // /usr/bin/env <command>
+                                start = 1;
+                                numComponents -= 1;
+                            }
+                            if (numComponents > 0) {
+                                // 2) insert all arguments at beginning of argument list:
+                                argc += numComponents;
+                                argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
+                                // Move everything numComponents step up
+                                for (int i = argc; i >= numComponents; i--) { argv[i] = argv[i-numComponents]; }
+                                // Change the location of the file (from "command" to "/actual/full/path/command"):
+                                // This pointer existed before
+                                argv[numComponents] = realloc(argv[numComponents], locationName.length + 1);
+                                strcpy(argv[numComponents], locationName.UTF8String);
+                                // Copy all arguments without change (except the first):
+                                for (int i = 1; i < numComponents; i++) {
+                                    argv[i] = strdup(components[i + start].UTF8String); // creates new pointer
+                                }
+                                // Extract stript name by removing the path:
+                                NSString* scriptNameString = components[start];
+                                NSCharacterSet* separators = [NSCharacterSet characterSetWithCharactersInString:@"/"];
+                                NSArray<NSString*> *scriptComponents = [scriptNameString componentsSeparatedByCharactersInSet:separators];
+                                scriptNameString = scriptComponents.lastObject;
+                                argv[0] = strdup(scriptNameString.UTF8String); // creates new pointer
+                                // TODO: need to loop back if scriptName is itself a file.
+                                break;
+                            }
+                        } else {
+                            // Detect WebAssembly file signature: '\0asm' (begins with 0, so not a string)
+                            if ((data.length >= 4) && (memcmp(data.bytes, "\0asm", 4) == 0)) {
+                                // WebAssembly file, identified by signature:
+                                // Same code as above, but single command:
+                                argc += 1;
+                                argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
+                                // Move everything numComponents step up
+                                for (int i = argc; i >= 1; i--) { argv[i] = argv[i-1]; }
+                                // Change the location of the file (from "command" to "/actual/full/path/command"):
+                                // This pointer existed before
+                                argv[1] = realloc(argv[1], locationName.length + 1);
+                                strcpy(argv[1], locationName.UTF8String);
+                                // Copy all arguments without change (except the first):
+                                argv[0] = strdup("wasm"); // creates new pointer
+                            }
+                        }
+                    } else {
+                        cmdIsReal = false;
+                    }
                 }
+                if (cmdIsAFile) break; // else keep going through the files found in the path.
             }
-            close (fd);
+        }
+        if (!cmdIsReal || (cmdIsAPath && !cmdIsAFile)) {
+            // argv[0] is a file that doesn't exist, or has size 0. Probably one of our commands.
+            // Replace with its name:
+            char* newName = basename(argv[0]);
+            argv[0] = realloc(argv[0], strlen(newName) + 1);
+            strcpy(argv[0], newName);
         }
     }
-    return returnValue;
+    // NSLog(@"After command parsing, stdout %d stderr %d \n", fileno(params->stdout),  fileno(params->stderr));
+    // fprintf(thread_stderr, "Command after parsing: ");
+    // for (int i = 0; i < argc; i++)
+    //    fprintf(thread_stderr, "[%s] ", argv[i]);
+    // We've reached this point: either the command is a file, from a script we support,
+    // and we have inserted the name of the script at the beginning, or it is a builtin command
+    int (*function)(int ac, char** av) = NULL;
+    char commandName[NAME_MAX];
+    strlcpy(commandName, argv[0], NAME_MAX);
+    // Ability to start multiple python3 scripts (required for Jupyter notebooks) or perl scripts (for cpan):
+    // each one runs in its own copy of the interpreter.
+    interpreterGroup* interpreter = interpreterGroupFor(commandName);
+    int interpreterSlot = -1;
+    if (interpreter != NULL) {
+        // (we don't block the main thread of the app)
+        interpreterSlot = acquireInterpreterSlot(interpreter, ![NSThread isMainThread]);
+        size_t prefixLength = strlen(interpreter->prefix);
+        if (interpreterSlot < 0) {
+            NSString* name = [NSString stringWithUTF8String:interpreter->prefix];
+            display_alert([NSString stringWithFormat:@"Too many %@ scripts", name], [NSString stringWithFormat:@"There are too many %@ interpreters running at the same time. Try closing some of them.", name]);
+            NSLog(@"Too many %s scripts running simultaneously.\n", interpreter->prefix);
+            strcpy(commandName, "notAValidCommand");
+            interpreter = NULL;
+        } else if (interpreterSlot == 0) {
+            // python3.9 creates issues, so we truncate to 'python3'
+            char* version = strchr(argv[0] + prefixLength, '.');
+            if (version != NULL) *version = 0;
+            strlcpy(commandName, argv[0], NAME_MAX);
+        } else {
+            // Copies are named prefix + A, B, C...
+            argv[0] = realloc(argv[0], prefixLength + 2);
+            memcpy(argv[0], interpreter->prefix, prefixLength);
+            argv[0][prefixLength] = 'A' + (interpreterSlot - 1);
+            argv[0][prefixLength + 1] = 0;
+            strlcpy(commandName, argv[0], NAME_MAX);
+        }
+    }
+    //
+    const commandDescription* commandStructure = commandLookup(commandName);
+    void* handle = NULL;
+    commandCacheEntry* cacheEntry = NULL;
+    if (commandStructure != NULL) {
+        cacheEntry = commandCacheLookup(commandName);
+    }
+    if (cacheEntry != NULL) {
+        // Command was already loaded, no need to go through dyld:
+        handle = cacheEntry->dlHandle;
+        function = cacheEntry->function;
+    } else if (commandStructure != NULL) {
+        const char* libraryName = commandStructure->library;
+        if (commandStructure->libraryKind == librarySelf) handle = RTLD_SELF;  // commands defined in ios_system.framework
+        else if (commandStructure->libraryKind == libraryMain) handle = RTLD_MAIN_ONLY; // commands defined in main program
+        else handle = dlopen(libraryName, RTLD_LAZY | RTLD_GLOBAL); // commands defined in dynamic library
+        if (handle == NULL) {
+            NSLog(@"Failed loading %s from %s, cause = %s\n", commandName, libraryName, dlerror());
+            // if (sideLoading)
+            fprintf(thread_stderr, "Failed loading %s from %s, cause = %s\n", commandName, libraryName, dlerror());
+        } else {
+            const char* functionName = commandStructure->function;
+            function = dlsym(handle, functionName);
+            if (function == NULL) {
+                NSLog(@"Failed loading %s from %s, cause = %s\n", commandName, libraryName, dlerror());
+                // if (sideLoading)
+                fprintf(thread_stderr, "Failed loading %s from %s, cause = %s\n", functionName, libraryName, dlerror());
+            } else {
+                cacheEntry = commandCacheInsert(commandName, handle, function);
+            }
+        }
+    }
+    if (function == NULL) {
+        function = &command_not_found;
+        // function = dlsym(RTLD_SELF, "command_not_found");
+    }
+    if (function) {
+        // We run the function in a thread because there are several
+        // points where we can exit from a shell function.
+        // Commands call pthread_exit instead of exit
+        // thread is attached, could also be un-attached
+        params->argc = argc;
+        params->argv = packArguments(argc, argv);
+        params->argvBlock = params->argv;
+        params->function = function;
+        params->dlHandle = handle;
+        params->cacheEntry = cacheEntry;
+        params->interpreter = interpreter;
+        params->interpreterSlot = interpreterSlot;
+        params->isPipeOut = (params->stdout != thread_stdout);
+        // NSLog(@"params->stdout: %d thread_stdout: %d \n", fileno(params->stdout), fileno(thread_stdout));
+        params->isPipeErr = (params->stderr != thread_stderr) && (params->stderr != params->stdout);
+        if (params->isPipeOut || params->isPipeIn) params->stage = addPipelineStage(ios_currentPid(), params->argv[0]);
+        // params->session = currentSession;
+        // Before starting, do we have enough file descriptors available?
+        ensureDescriptorsAvailable();
+        if (currentSession->isMainThread) {
+            bool commandOperatesOnFiles = (((commandStructure != NULL) && (commandStructure->operatesOn != operatesOnNothing)) ||
+                                           params->isPipeOut || params->isPipeErr);
+            NSString* currentPath = [fileManager currentDirectoryPath];
+            commandOperatesOnFiles &= (currentPath != nil);
+            if (commandOperatesOnFiles && cacheFileCoordination) {
+                // Already coordinated for this directory in this session?
+                if (strcmp(currentSession->coordinatedDirectory, currentPath.UTF8String) == 0) {
+                    commandOperatesOnFiles = false;
+                    numSkippedCoordinations++;
+                } else {
+                    currentSession->coordinatedDirectory = internPath(currentPath.UTF8String);
+                }
+            }
+            if (commandOperatesOnFiles) {
+                // Send a signal to the system that we're going to change the current directory:
+                // TODO: only do this if the command actually accesses files: either outputFile exists,
+                // or errorFile exists, or the command uses files.
+                NSURL* currentURL = [NSURL fileURLWithPath:currentPath];
+                NSFileCoordinator *fileCoordinator =  [[NSFileCoordinator alloc] initWithFilePresenter:nil];
+                [fileCoordinator coordinateWritingItemAtURL:currentURL options:0 error:NULL byAccessor:^(NSURL *currentURL) {
+                    currentSession->isMainThread = false;
+                    pthread_t _tid = NULL;
+                    startCommandThread(&_tid, params);
+                    // ios_storeThreadId(_tid);
+                    currentSession->current_command_root_thread = _tid;
+                    if (currentSession->mainThreadId == NULL) currentSession->mainThreadId = _tid;
+                    // Wait for this process to finish:
+						if (joinMainThread) {
+							joinCommandThread(_tid);
+							// If there are auxiliary process, also wait for them:
+							if (currentSession->lastThreadId > 0) joinCommandThread(currentSession->lastThreadId);
+							currentSession->lastThreadId = 0;
+							currentSession->current_command_root_thread = 0;
+							sessionStateChanged(currentSession);
+						} else {
+							detachCommandThread(_tid); // a thread must be either joined or detached
+						}
+                    currentSession->isMainThread = true;
+                }];
+            } else {
+                currentSession->isMainThread = false;
+                pthread_t _tid = NULL;
+                startCommandThread(&_tid, params);
+                // ios_storeThreadId(_tid);
+                currentSession->current_command_root_thread = _tid;
+                if (currentSession->mainThreadId == NULL) currentSession->mainThreadId = _tid;
+                // Wait for this process to finish:
+					if (joinMainThread) {
+						joinCommandThread(_tid);
+						// If there are auxiliary process, also wait for them:
+						if (currentSession->lastThreadId > 0) joinCommandThread(currentSession->lastThreadId);
+						currentSession->lastThreadId = 0;
+						currentSession->current_command_root_thread = 0;
+						sessionStateChanged(currentSession);
+					} else {
+						detachCommandThread(_tid); // a thread must be either joined or detached
+					}
+                currentSession->isMainThread = true;
+            }
+        } else {
+            ios_trace(TraceCommand, @"Starting command %s, global_errno= %d\n", commandLine, currentSession->global_errno);
+            // Don't send signal if not in main thread. Also, don't join threads.
+            pthread_t _tid_local = NULL;
+            // The last command on the command line (with multiple pipes) will be created first
+            startCommandThread(&_tid_local, params);
+            // fprintf(stderr, "Started thread = %x\n", _tid_local);
+            if (currentSession->lastThreadId == 0) currentSession->lastThreadId = _tid_local; // will be joined later
+            else detachCommandThread(_tid_local); // a thread must be either joined or detached.
+        }
+    } else {
+        fprintf(params->stderr, "%s: command not found\n", argv[0]);
+        NSLog(@"%s: command not found\n", argv[0]);
+        free(argv);
+        // If command output was redirected to a pipe, we still need to close it.
+        // (to warn the other command that it can stop waiting)
+        // We still need this step because there can be multiple pipes.
+        if (params->stdout != currentSession->stdout) {
+            closeTrackedStream(params->stdout);
+        }
+        if ((params->stderr != currentSession->stderr) && (params->stderr != params->stdout)) {
+            closeTrackedStream(params->stderr);
+        }
+        commandCacheRelease(cacheEntry, handle);
+        free(params); // This was malloc'ed in ios_system
+        ios_storeThreadId(0);
+        currentSession->global_errno = 127;
+        // TODO: this should also raise an exception, for python scripts
+    } // if (function)
 }
 
 int ios_system(const char* inputCmd) {
-    NSLog(@"command= %s pid= %d\n", inputCmd, ios_currentPid());
+    ios_trace(TraceCommand, @"command= %s pid= %d\n", inputCmd, ios_currentPid());
     char* command;
     // The names of the files for stdin, stdout, stderr
     char* inputFileName = 0;
@@ -2202,8 +4571,7 @@ int ios_system(const char* inputCmd) {
     // NSLog(@"ios_system, stdout %d \n", thread_stdout == NULL ? 0 : fileno(thread_stdout));
     // NSLog(@"ios_system, stderr %d \n", thread_stderr == NULL ? 0 : fileno(thread_stderr));
     if (currentSession == NULL) {
-        currentSession = malloc(sizeof(sessionParameters));
-        initSessionParameters(currentSession);
+        currentSession = allocateSession();
     }
     currentSession->global_errno = 0;
     // Don't start if the command is NULL:
@@ -2260,75 +4628,37 @@ int ios_system(const char* inputCmd) {
     }
     free(commandForParsingFree);
     // alias expansion *before* input, output and error redirection.
-    if ((command[0] != '\\') && (aliasDictionary != nil)) {
+    if ((command[0] != '\\') && (numAliases > 0)) {
         // \command = cancel aliasing, get the original command
         char* commandForParsing = strdup(command);
         char* firstSpace = strstrquoted(commandForParsing, " ");
         if (firstSpace != NULL) { *firstSpace = 0; }
-        NSString* commandAsString = [NSString stringWithCString:commandForParsing encoding:NSUTF8StringEncoding];
-        NSArray<NSString*>* aliasedCommand = aliasDictionary[commandAsString];
-        if (aliasedCommand != nil) {
-            NSLog(@"%s %s %s", aliasedCommand[0].UTF8String, aliasedCommand[1].UTF8String, aliasedCommand[2].UTF8String);
-            char* newCommand = NULL;
-            if (aliasedCommand[2].length == 0) {
-                // all the alias, then all the arguments:
-                if (firstSpace == NULL) {
-                    newCommand = strdup(aliasedCommand[0].UTF8String);
-                } else {
-                    int newCommandLength = aliasedCommand[0].length + 2 + strlen(firstSpace+1);
-                    // + 2: 1 for space, 1 for NULL termination
-                    newCommand = malloc(newCommandLength * sizeof(char));
-                    sprintf(newCommand, "%s %s", aliasedCommand[0].UTF8String, firstSpace+1);
-                }
-            } else if ([aliasedCommand[2] isEqualToString: @"afterLast"]) {
-                int newCommandLength = aliasedCommand[0].length + 2 + aliasedCommand[1].length;
-                // + 2: 1 for space, 1 for NULL termination
-                if (firstSpace == NULL) { // no arguments
-                    newCommand = malloc(newCommandLength * sizeof(char));
-                    sprintf(newCommand, "%s %s", aliasedCommand[0].UTF8String, aliasedCommand[1].UTF8String);
-                } else {
-                    newCommandLength += strlen(firstSpace+1) + 1; // 1 more space
-                    newCommand = malloc(newCommandLength * sizeof(char));
-                    sprintf(newCommand, "%s %s %s", aliasedCommand[0].UTF8String, firstSpace+1, aliasedCommand[1].UTF8String);
-                }
-            } else if ([aliasedCommand[2] isEqualToString: @"afterFirst"]) {
-                int newCommandLength = aliasedCommand[0].length + 2 + aliasedCommand[1].length;
-                // + 2: 1 for space, 1 for NULL termination
-                if (firstSpace == NULL) { // no arguments
-                    newCommand = malloc(newCommandLength * sizeof(char));
-                    sprintf(newCommand, "%s %s", aliasedCommand[0].UTF8String, aliasedCommand[1].UTF8String);
-                } else {
-                    char* arguments = firstSpace + 1;
-                    char* secondSpace = strstrquoted(arguments, " ");
-                    if (secondSpace == NULL) {
-                        // only 1 argument, nothing after that:
-                        newCommandLength += strlen(arguments) + 1; // 1 more space
-                        newCommand = malloc(newCommandLength * sizeof(char));
-                        sprintf(newCommand, "%s %s %s", aliasedCommand[0].UTF8String, arguments, aliasedCommand[1].UTF8String);
-                    } else {
-                        *secondSpace = 0;
-                        char* otherArguments = secondSpace + 1;
-                        newCommandLength += strlen(arguments) + strlen(otherArguments) + 2; // 2 more spaces
-                        newCommand = malloc(newCommandLength * sizeof(char));
-                        sprintf(newCommand, "%s %s %s %s", aliasedCommand[0].UTF8String, arguments, aliasedCommand[1].UTF8String, otherArguments);
-                    }
-                }
-            }
-            if (newCommand != NULL) {
-                free(originalCommand);
-                // After alias expansion, the new command replaces the old one:
-                originalCommand = newCommand;
-                cmd = newCommand;
-                command = newCommand;
-                // Maybe we aliased to an interactive command (vim, ssh, less, more, man, scp, sftp)
-                // We need to tell the command line editor:
-                if (isInteractive(newCommand)) {
-                    ios_startInteractive();
-                }
+        char* newCommand = expandAlias(commandForParsing, (firstSpace != NULL) ? firstSpace + 1 : NULL);
+        if (newCommand != NULL) {
+            free(originalCommand);
+            // After alias expansion, the new command replaces the old one:
+            originalCommand = newCommand;
+            cmd = newCommand;
+            command = newCommand;
+            // Maybe we aliased to an interactive command (vim, ssh, less, more, man, scp, sftp)
+            // We need to tell the command line editor:
+            if (isInteractive(newCommand)) {
+                ios_startInteractive();
             }
         }
         free(commandForParsing);
     }
+    // "grep x file | wc -l", "sort | uniq -c | sort -rn": one command for the whole pipeline, its text passed as a single argument.
+    if (pipelineFusion && ios_canFusePipeline(command, fusibleCommand)) {
+        char* fusedCommand = NULL;
+        if (asprintf(&fusedCommand, "ios_fuse %c%s%c", 0x1e, command, 0x1e) > 0) {
+            ios_trace(TraceParsing, @"fused pipeline: %s", command);
+            free(originalCommand);
+            originalCommand = fusedCommand;
+            cmd = fusedCommand;
+            command = fusedCommand;
+        }
+    }
     // NSLog(@"command after alias expansion= %s\n", command);
     // Search for input, output and error redirection
     // They can be in any order, although the usual are:
@@ -2342,13 +4672,17 @@ int ios_system(const char* inputCmd) {
     params->stdin = child_stdin;
     params->stdout = child_stdout;
     params->stderr = child_stderr;
+    params->isChannelIn = isChannelReader(child_stdin);
+    params->isPipeIn = (child_stdin != NULL);
     params->session = currentSession;
 
     params->context = thread_context;
   
     child_stdin = child_stdout = child_stderr = NULL;
-    params->argc = 0; params->argv = 0; params->argv_ref = 0;
+    params->argc = 0; params->argv = 0; params->argvBlock = 0;
     params->function = NULL; params->isPipeOut = false; params->isPipeErr = false;
+    params->dlHandle = NULL; params->cacheEntry = NULL;
+    params->interpreter = NULL; params->interpreterSlot = -1; params->stage = NULL;
     // Only scan for input / output if there is no argument marker
     char recordSeparator = 0x1e;
     char* recordSeparatorPosition = strchr(inputFileMarker, recordSeparator);
@@ -2373,7 +4707,7 @@ int ios_system(const char* inputCmd) {
             if (params->stdout != 0) thread_stdout = params->stdout;
             if (params->stderr != 0) thread_stderr = params->stderr;
             // if popen fails, don't start the command
-            params->stdout = ios_popen(pipeMarker+2, "w");
+            params->stdout = openPipe(pipeMarker+2, "w", useInProcessPipes);
             params->stderr = params->stdout;
             currentSession->isMainThread = pushMainThread;
             pipeMarker[0] = 0x0;
@@ -2393,7 +4727,7 @@ int ios_system(const char* inputCmd) {
                 if (params->stdout != 0) thread_stdout = params->stdout;
                 if (params->stderr != 0) thread_stderr = params->stderr; // ?????
                 // if popen fails, don't start the command
-                params->stdout = ios_popen(pipeMarker+1, "w");
+                params->stdout = openPipe(pipeMarker+1, "w", useInProcessPipes);
                 currentSession->isMainThread = pushMainThread;
                 pipeMarker[0] = 0x0;
                 if (params->stdout == NULL) { // pipe open failed, return before we start a command
@@ -2497,8 +4831,14 @@ int ios_system(const char* inputCmd) {
         //
         FILE* newStream;
         if (inputFileName) {
+            // The file itself, not a pipe fed from it: commands can fstat() and mmap() fileno(thread_stdin),
+            // and take the paths they have for regular files (sort, grep, wc, tail, md5).
             newStream = fopen(inputFileName, "r");
-            if (newStream) params->stdin = newStream;
+            if (newStream) {
+                trackDescriptors(1);
+                setStreamBuffering(newStream, false);
+                params->stdin = newStream;
+            }
         }
         if (params->stdin == NULL) params->stdin = thread_stdin;
         if (outputFileName) {
@@ -2508,8 +4848,10 @@ int ios_system(const char* inputCmd) {
                 newStream = fopen(outputFileName, "w");
             }
             if (newStream) {
+                trackDescriptors(1);
+                setStreamBuffering(newStream, true);
                 if (params->stdout != NULL) {
-                    if (fileno(params->stdout) != fileno(currentSession->stdout)) fclose(params->stdout);
+                    if (fileno(params->stdout) != fileno(currentSession->stdout)) closeTrackedStream(params->stdout);
                 }
                 params->stdout = newStream;
             }
@@ -2517,7 +4859,7 @@ int ios_system(const char* inputCmd) {
         if (params->stdout == NULL) params->stdout = thread_stdout;
         if (sharedErrorOutput && (params->stderr != params->stdout)) {
             if (params->stderr != NULL) {
-                if (fileno(params->stderr) != fileno(currentSession->stderr)) fclose(params->stderr);
+                if (fileno(params->stderr) != fileno(currentSession->stderr)) closeTrackedStream(params->stderr);
             }
             params->stderr = params->stdout;
         }
@@ -2525,8 +4867,10 @@ int ios_system(const char* inputCmd) {
             newStream = NULL;
             newStream = fopen(errorFileName, "w");
             if (newStream) {
+                trackDescriptors(1);
+                setStreamBuffering(newStream, true);
                 if (params->stderr != NULL) {
-                    if (fileno(params->stderr) != fileno(currentSession->stderr)) fclose(params->stderr);
+                    if (fileno(params->stderr) != fileno(currentSession->stderr)) closeTrackedStream(params->stderr);
                 }
                 params->stderr = newStream;
             }
@@ -2547,7 +4891,7 @@ int ios_system(const char* inputCmd) {
         dontExpand[argc] = false;
         argc += 1;
         char* end = getLastCharacterOfArgument(str);
-        bool mustBreak = (end == NULL) || (strlen(end) == 0);
+        bool mustBreak = (end == NULL) || (end[0] == 0);
         if (!mustBreak) end[0] = 0x0;
         if ((str[0] == '\'') || (str[0] == '"') || (str[0] == recordSeparator)) {
             dontExpand[argc-1] = true; // don't expand arguments in quotes
@@ -2571,464 +4915,53 @@ int ios_system(const char* inputCmd) {
         // We have the arguments. Parse them for environment variables, ~, etc.
         for (int i = 1; i < argc; i++) if (!dontExpand[i]) {  argv[i] = parseArgument(argv[i], argv[0]); }
         // wildcard expansion (*, ?, []...) Has to be after $ and ~ expansion, results in larger arguments
+        // First expand all the arguments, then build the new argv in a single allocation:
+        glob_t* expansions = NULL;
+        int expandedArgc = argc;
         for (int i = 1; i < argc; i++) if (!dontExpand[i]) {
             if (strstrquoted (argv[i],"*") || strstrquoted (argv[i],"?") || strstrquoted (argv[i],"[")) {
-                glob_t gt;
-                if (glob(argv[i], 0, NULL, &gt) == 0) {
-                    argc += gt.gl_matchc - 1;
-                    argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
-                    dontExpand = (bool *)realloc(dontExpand, sizeof(bool) * (argc + 1));
-                    // Move everything after i by gt.gl_matchc - 1 steps up:
-                    for (int j = argc; j - gt.gl_matchc + 1 > i; j--) {
-                        argv[j] = argv[j - gt.gl_matchc + 1];
-                        dontExpand[j] = dontExpand[j - gt.gl_matchc + 1];
-                    }   
-                    for (int j = 0; j < gt.gl_matchc; j++) {
-                        argv[i + j] = strdup(gt.gl_pathv[j]);
-                    }
-                    i += gt.gl_matchc - 1;
-                    globfree(&gt);
+                if (expansions == NULL) expansions = calloc(argc, sizeof(glob_t));
+                if (cachedGlob(argv[i], &expansions[i]) == 0) {
+                    expandedArgc += expansions[i].gl_matchc - 1;
                 } else {
                     // If there is no match, leave parameter as is, continue with command.
                     // Not exactly Unix behaviour, but more convenient on Phones.
                     // fprintf(params->stderr, "%s: %s: No match\n", argv[0], argv[i]);
                     // fflush(params->stderr);
-                    globfree(&gt);
-                }
-            }
-        }
-        free(dontExpand);
-        // Now call the actual command:
-        // - is argv[0] a command that refers to a file? (either absolute path, or in $PATH)
-        //   if so, does it exist, does it have +x bit set, does it have #! python or #! lua on the first line?
-        //   if yes to all, call the relevant interpreter. Works for hg, for example.
-        if (argv[0][0] == '\\') {
-            // Just remove the \ at the beginning
-            // There can be several versions of a command (e.g. ls as precompiled and ls written in Python)
-            // The executable file has precedence, unless the user has specified they want the original
-            // version, by prefixing it with \. So "\ls" == always "our" ls. "ls" == maybe ~/Library/bin/ls
-            // (if it exists).
-            // It also cancels aliases.
-            size_t len_with_terminator = strlen(argv[0] + 1) + 1;
-            memmove(argv[0], argv[0] + 1, len_with_terminator);
-        } else  {
-            NSString* commandName = [NSString stringWithCString:argv[0]  encoding:NSUTF8StringEncoding];
-            strcpy(currentSession->commandName, argv[0]);
-            BOOL isDir = false;
-            bool cmdIsAFile = false;
-            bool cmdIsReal = false;
-            bool cmdIsAPath = false;
-            if ([commandName hasPrefix:@"~/"]) {
-                NSString* replacement_string = [NSString stringWithCString:(getenv("HOME")) encoding:NSUTF8StringEncoding];
-                NSString* test_string = @"~";
-                commandName = [commandName stringByReplacingOccurrencesOfString:test_string withString:replacement_string options:NULL range:NSMakeRange(0, 1)];
-            }
-            if ([fileManager fileExistsAtPath:commandName isDirectory:&isDir]  && (!isDir)) {
-                // File exists, is a file.
-                struct stat sb;
-                if (stat(commandName.UTF8String, &sb) == 0) {
-                    // File exists, is executable, not a directory.
-                    cmdIsAFile = true;
-                    // We can have an empty file with the same name in the path, to fool which():
-                    // We can also have a Mach-O binary with the same name in the path (in simulator, mostly)
-                    cmdIsReal = isRealCommand(commandName.UTF8String);
-                }
-            }
-            // if commandName contains "/", then it's a path, and we don't search for it in PATH.
-            cmdIsAPath = ([commandName rangeOfString:@"/"].location != NSNotFound);
-            if (!cmdIsAPath || cmdIsAFile) {
-                // We go through the path, because that command may be a file in the path
-                NSString* checkingPath = [NSString stringWithCString:getenv("PATH") encoding:NSUTF8StringEncoding];
-                if (! [fullCommandPath isEqualToString:checkingPath]) {
-                    fullCommandPath = checkingPath;
-                    directoriesInPath = [fullCommandPath componentsSeparatedByString:@":"];
-                }
-                for (NSString* path in directoriesInPath) {
-                    // If we don't have access to the path component, there's no point in continuing:
-                    if (![fileManager fileExistsAtPath:path isDirectory:&isDir]) continue;
-                    if (!isDir) continue; // same in the (unlikely) event the path component is not a directory
-                    NSString* locationName;
-                    if (!cmdIsAFile) {
-                        // search for 3 possibilities: name, name.bc and name.ll
-                        locationName = [path stringByAppendingPathComponent:commandName];
-                        bool fileFound = [fileManager fileExistsAtPath:locationName isDirectory:&isDir];
-                        if (fileFound && isDir) continue; // file exists, but is a directory
-                        if (!fileFound) {
-                            locationName = [[path stringByAppendingPathComponent:commandName] stringByAppendingString:@".bc"];
-                            fileFound = [fileManager fileExistsAtPath:locationName isDirectory:&isDir];
-                            if (fileFound && isDir) continue; // file exists, but is a directory
-                        }
-                        if (!fileFound) {
-                            locationName = [[path stringByAppendingPathComponent:commandName] stringByAppendingString:@".ll"];
-                            fileFound = [fileManager fileExistsAtPath:locationName isDirectory:&isDir];
-                            if (fileFound && isDir) continue; // file exists, but is a directory
-                        }
-                        if (!fileFound) {
-                            locationName = [[path stringByAppendingPathComponent:commandName] stringByAppendingString:@".wasm"];
-                            fileFound = [fileManager fileExistsAtPath:locationName isDirectory:&isDir];
-                            if (fileFound && isDir) continue; // file exists, but is a directory
-                        }
-                        if (!fileFound) continue;
-                        // isExecutableFileAtPath replies "NO" even if file has x-bit set.
-                        // if (![fileManager  isExecutableFileAtPath:cmdname]) continue;
-                        struct stat sb;
-                        // Files inside the Application Bundle will always have "x" removed. Don't check.
-                        if (!([path containsString: [[NSBundle mainBundle] resourcePath]]) // Not inside the App Bundle
-                            && !((stat(locationName.UTF8String, &sb) == 0))) // file exists, is not a directory
-                            continue;
-                    } else
-                        // if (cmdIsAFile) we are now ready to execute this file:
-                        locationName = commandName;
-                    if (([locationName hasSuffix:@".bc"]) || ([locationName hasSuffix:@".ll"])) {
-                        // CLANG bitcode. insert lli in front of argument list:
-                        argc += 1;
-                        argv = (char **)realloc(argv, sizeof(char*) * argc);
-                        // Move everything one step up
-                        for (int i = argc; i >= 1; i--) { argv[i] = argv[i-1]; }
-                        argv[1] = realloc(argv[1], locationName.length + 1);
-                        strcpy(argv[1], locationName.UTF8String);
-                        argv[0] = strdup("lli"); // this argument is new
-                        break;
-                    } else if ([locationName hasSuffix:@".wasm"]) {
-                        // insert wasm in front of argument list:
-                        argc += 1;
-                        argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
-                        // Move everything one step up
-                        for (int i = argc-1; i >= 1; i--) { argv[i] = argv[i-1]; }
-                        argv[1] = realloc(argv[1], locationName.length + 1);
-                        strcpy(argv[1], locationName.UTF8String);
-                        argv[0] = strdup("wasm"); // this argument is new
-                        break;
-                    } else {
-                        if (isRealCommand(locationName.UTF8String)) {
-                            cmdIsReal = true;
-                            NSData *data = [NSData dataWithContentsOfFile:locationName]; // You have the data. Conversion to String probably failed.
-                            NSString *fileContent = [[NSString alloc]initWithData:data encoding:NSUTF8StringEncoding];
-                            if ((fileContent == nil) && (data.length > 0)) {
-                                // Conversion to string failed with UTF8. Try with Ascii as a backup:
-                                fileContent =  [[NSString alloc]initWithData:data encoding:NSASCIIStringEncoding];
-                            }
-                            NSString* firstLine;
-                            if (fileContent != nil) {
-                                NSRange firstLineRange = [fileContent rangeOfString:@"\n"];
-                                if (firstLineRange.length > 0) {
-                                    firstLineRange.length = firstLineRange.location;
-                                } else {
-                                    firstLineRange.length = fileContent.length;
-                                }
-                                firstLineRange.location = 0;
-                                firstLine = [fileContent substringWithRange:firstLineRange];
-                            }
-                            if ([firstLine hasPrefix:@"#!"]) {
-                                // 1) get script language name
-                                // The last word of the line is the command. This covers all of the cases encountered:
-                                // "#! /usr/bin/python", "#! /usr/local/bin/python" and "#! /usr/bin/myStrangePath/python" are all OK.
-                                // We also accept "#! /usr/bin/env python" because it is used.
-                                // And we want to accept "#! bc -l" too, so we can have multiple arguments.
-                                // Take alphanumericCharacterSet and invert it.
-                                firstLine = [firstLine substringFromIndex:2]; // remove "#!" at the beginning
-                                firstLine = [firstLine stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]]; // remove any extra space
-                                NSArray<NSString*> *components = [firstLine componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
-                                unsigned long numComponents = components.count;
-                                int start = 0;
-                                if ([components.firstObject hasSuffix:@"env"]) {
-                                    // /usr/bin/env <command>
-                                    start = 1;
-                                    numComponents -= 1;
-                                }
-                                if (numComponents > 0) {
-                                    // 2) insert all arguments at beginning of argument list:
-                                    argc += numComponents;
-                                    argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
-                                    // Move everything numComponents step up
-                                    for (int i = argc; i >= numComponents; i--) { argv[i] = argv[i-numComponents]; }
-                                    // Change the location of the file (from "command" to "/actual/full/path/command"):
-                                    // This pointer existed before
-                                    argv[numComponents] = realloc(argv[numComponents], locationName.length + 1);
-                                    strcpy(argv[numComponents], locationName.UTF8String);
-                                    // Copy all arguments without change (except the first):
-                                    for (int i = 1; i < numComponents; i++) {
-                                        argv[i] = strdup(components[i + start].UTF8String); // creates new pointer
-                                    }
-                                    // Extract stript name by removing the path:
-                                    NSString* scriptNameString = components[start];
-                                    NSCharacterSet* separators = [NSCharacterSet characterSetWithCharactersInString:@"/"];
-                                    NSArray<NSString*> *scriptComponents = [scriptNameString componentsSeparatedByCharactersInSet:separators];
-                                    scriptNameString = scriptComponents.lastObject;
-                                    argv[0] = strdup(scriptNameString.UTF8String); // creates new pointer
-                                    // TODO: need to loop back if scriptName is itself a file.
-                                    break;
-                                }
-                            } else {
-                                // Detect WebAssembly file signature: '\0asm' (begins with 0, so not a string)
-                                if ((data.length >0) && (((char*)data.bytes)[0] == 0)) {
-                                    // fileContent = [[NSString alloc]initWithData:data encoding:NSASCIIStringEncoding];
-                                    NSRange signatureRange = NSMakeRange(1, 3);
-                                    firstLine = [fileContent substringWithRange:signatureRange];
-                                }
-                                if ([firstLine isEqualToString:@"asm"]) {
-                                    // WebAssembly file, identified by signature:
-                                    // Same code as above, but single command:
-                                    argc += 1;
-                                    argv = (char **)realloc(argv, sizeof(char*) * (argc + 1));
-                                    // Move everything numComponents step up
-                                    for (int i = argc; i >= 1; i--) { argv[i] = argv[i-1]; }
-                                    // Change the location of the file (from "command" to "/actual/full/path/command"):
-                                    // This pointer existed before
-                                    argv[1] = realloc(argv[1], locationName.length + 1);
-                                    strcpy(argv[1], locationName.UTF8String);
-                                    // Copy all arguments without change (except the first):
-                                    argv[0] = strdup("wasm"); // creates new pointer
-                                }
-                            }
-                        } else {
-                            cmdIsReal = false;
-                        }
-                    }
-                    if (cmdIsAFile) break; // else keep going through the path elements.
+                    globfree(&expansions[i]);
+                    memset(&expansions[i], 0, sizeof(glob_t));
                 }
             }
-            if (!cmdIsReal || (cmdIsAPath && !cmdIsAFile)) {
-                // argv[0] is a file that doesn't exist, or has size 0. Probably one of our commands.
-                // Replace with its name:
-                char* newName = basename(argv[0]);
-                argv[0] = realloc(argv[0], strlen(newName) + 1);
-                strcpy(argv[0], newName);
-            }
         }
-        // NSLog(@"After command parsing, stdout %d stderr %d \n", fileno(params->stdout),  fileno(params->stderr));
-        // fprintf(thread_stderr, "Command after parsing: ");
-        // for (int i = 0; i < argc; i++)
-        //    fprintf(thread_stderr, "[%s] ", argv[i]);
-        // We've reached this point: either the command is a file, from a script we support,
-        // and we have inserted the name of the script at the beginning, or it is a builtin command
-        int (*function)(int ac, char** av) = NULL;
-        if (commandList == nil) initializeCommandList();
-        NSString* commandName = [NSString stringWithCString:argv[0] encoding:NSUTF8StringEncoding];
-        // hasPrefix covers python, python3, python3.9.
-        if ([commandName hasPrefix: @"python"]) {
-            // Ability to start multiple python3 scripts (required for Jupyter notebooks):
-            // start by increasing the number of the interpreter, until we're out.
-            int numInterpreter = 0;
-            if ((currentPythonInterpreter < numPythonInterpreters) && (!PythonIsRunning[currentPythonInterpreter])) {
-                numInterpreter = currentPythonInterpreter;
-                currentPythonInterpreter++;
-            } else {
-                while  (numInterpreter < numPythonInterpreters) {
-                    if (PythonIsRunning[numInterpreter] == false) break;
-                    numInterpreter++;
-                }
-                if (numInterpreter >= numPythonInterpreters) {
-                    display_alert(@"Too many Python scripts", @"There are too many Python interpreters running at the same time. Try closing some of them.");
-                    NSLog(@"%@", @"Too many python scripts running simultaneously. Try closing some notebooks.\n");
-                    commandName = @"notAValidCommand";
-                } else {
-                    currentPythonInterpreter = numInterpreter;
-                }
-            }
-            if ((numInterpreter == 0) && (strlen(argv[0]) > 7)) {
-                // python3.9 creates issues, so we truncate to 'python3'
-                argv[0][7] = 0;
-            }
-            if ((numInterpreter >= 0) && (numInterpreter < numPythonInterpreters)) {
-                PythonIsRunning[numInterpreter] = true;
-                if (numInterpreter > 0) {
-                    if ([commandName isEqualToString: @"python"]) {
-                        // Add space for an extra letter at the end of "python" (+1 for "A", +1 for '\0')
-                        argv[0] = realloc(argv[0], strlen(argv[0]) + 2);
-                    }
-                    char suffix[2];
-                    suffix[0] = 'A' + (numInterpreter - 1);
-                    suffix[1] = 0;
-                    argv[0][6] = suffix[0];
-                    argv[0][7] = 0;
-                    commandName = [@"python" stringByAppendingString: [NSString stringWithCString: suffix encoding:NSUTF8StringEncoding]];
-                }
-            }
-        } else if ([commandName hasPrefix: @"perl"]) {
-            // Ability to start multiple perl scripts (required for cpan):
-            // start by increasing the number of the interpreter, until we're out.
-            int numInterpreter = 0;
-            if (currentPerlInterpreter < numPerlInterpreters) {
-                numInterpreter = currentPerlInterpreter;
-                currentPerlInterpreter++;
-            } else {
-                while  (numInterpreter < numPerlInterpreters) {
-                    if (PerlIsRunning[numInterpreter] == false) break;
-                    numInterpreter++;
-                }
-                if (numInterpreter >= numPerlInterpreters) {
-                    display_alert(@"Too many Perl scripts", @"There are too many Perl interpreters running at the same time. Try closing some of them.");
-                    NSLog(@"%@", @"Too many perl scripts running simultaneously.\n");
-                    commandName = @"notAValidCommand";
-                }
-            }
-            if ((numInterpreter >= 0) && (numInterpreter < numPerlInterpreters)) {
-                PerlIsRunning[numInterpreter] = true;
-                if (numInterpreter > 0) {
-                    if ([commandName isEqualToString: @"perl"]) {
-                        // Add space for an extra letter at the end of "perl" (+1 for "A", +1 for '\0')
-                        argv[0] = realloc(argv[0], strlen(argv[0]) + 2);
+        if (expansions != NULL) {
+            char** expandedArgv = (char **)malloc(sizeof(char*) * (expandedArgc + 1));
+            int position = 0;
+            for (int i = 0; i < argc; i++) {
+                if ((i > 0) && (expansions[i].gl_matchc > 0)) {
+                    for (int j = 0; j < expansions[i].gl_matchc; j++) {
+                        expandedArgv[position++] = strdup(expansions[i].gl_pathv[j]);
                     }
-                    char suffix[2];
-                    suffix[0] = 'A' + (numInterpreter - 1);
-                    suffix[1] = 0;
-                    argv[0][4] = suffix[0];
-                    argv[0][5] = 0;
-                    commandName = [@"perl" stringByAppendingString: [NSString stringWithCString: suffix encoding:NSUTF8StringEncoding]];
-                }
-            }
-        }
-        //
-        NSArray* commandStructure = [commandList objectForKey: commandName];
-        void* handle = NULL;
-        if (commandStructure != nil) {
-            NSString* libraryName = commandStructure[0];
-            if ([libraryName isEqualToString: @"SELF"]) handle = RTLD_SELF;  // commands defined in ios_system.framework
-            else if ([libraryName isEqualToString: @"MAIN"]) handle = RTLD_MAIN_ONLY; // commands defined in main program
-            else handle = dlopen(libraryName.UTF8String, RTLD_LAZY | RTLD_GLOBAL); // commands defined in dynamic library
-            if (handle == NULL) {
-                NSLog(@"Failed loading %s from %s, cause = %s\n", commandName.UTF8String, libraryName.UTF8String, dlerror());
-                // if (sideLoading)
-                fprintf(thread_stderr, "Failed loading %s from %s, cause = %s\n", commandName.UTF8String, libraryName.UTF8String, dlerror());
-                NSString* fileLocation = [[NSBundle mainBundle] pathForResource:libraryName ofType:nil];
-            } else {
-                NSString* functionName = commandStructure[1];
-                function = dlsym(handle, functionName.UTF8String);
-                if (function == NULL) {
-                    NSLog(@"Failed loading %s from %s, cause = %s\n", commandName.UTF8String, libraryName.UTF8String, dlerror());
-                    // if (sideLoading)
-                    fprintf(thread_stderr, "Failed loading %s from %s, cause = %s\n", functionName.UTF8String, libraryName.UTF8String, dlerror());
-                }
-            }
-        }
-        if (function == NULL) {
-            function = &command_not_found;
-            // function = dlsym(RTLD_SELF, "command_not_found");
-        }
-        if (function) {
-            // We run the function in a thread because there are several
-            // points where we can exit from a shell function.
-            // Commands call pthread_exit instead of exit
-            // thread is attached, could also be un-attached
-            params->argc = argc;
-            params->argv = argv;
-            params->function = function;
-            params->dlHandle = handle;
-            params->isPipeOut = (params->stdout != thread_stdout);
-            // NSLog(@"params->stdout: %d thread_stdout: %d \n", fileno(params->stdout), fileno(thread_stdout));
-            params->isPipeErr = (params->stderr != thread_stderr) && (params->stderr != params->stdout);
-            // params->session = currentSession;
-            // Before starting, do we have enough file descriptors available?
-            int numFileDescriptorsOpen = 0;
-            for (int fd = 0; fd < limitFilesOpen.rlim_cur; fd++) {
-                errno = 0;
-                int flags = fcntl(fd, F_GETFD, 0);
-                if (flags == -1 && errno) {
-                    continue;
-                }
-                ++numFileDescriptorsOpen ;
-            }
-            // fprintf(stderr, "Num file descriptor = %d\n", numFileDescriptorsOpen);
-            // We assume 128 file descriptors will be enough for a single command.
-            if (numFileDescriptorsOpen + 128 > limitFilesOpen.rlim_cur) {
-                limitFilesOpen.rlim_cur += 1024;
-                int res = setrlimit(RLIMIT_NOFILE, &limitFilesOpen);
-                if (res == 0) NSLog(@"[Info] Increased file descriptor limit to = %llu\n", limitFilesOpen.rlim_cur);
-                else NSLog(@"[Warning] Failed to increased file descriptor limit to = %llu\n", limitFilesOpen.rlim_cur);
-            }
-            if (currentSession->isMainThread) {
-                bool commandOperatesOnFiles = ([commandStructure[3] isEqualToString:@"file"] ||
-                                               [commandStructure[3] isEqualToString:@"directory"] ||
-                                               params->isPipeOut || params->isPipeErr);
-                NSString* currentPath = [fileManager currentDirectoryPath];
-                commandOperatesOnFiles &= (currentPath != nil);
-                if (commandOperatesOnFiles) {
-                    // Send a signal to the system that we're going to change the current directory:
-                    // TODO: only do this if the command actually accesses files: either outputFile exists,
-                    // or errorFile exists, or the command uses files.
-                    NSURL* currentURL = [NSURL fileURLWithPath:currentPath];
-                    NSFileCoordinator *fileCoordinator =  [[NSFileCoordinator alloc] initWithFilePresenter:nil];
-                    [fileCoordinator coordinateWritingItemAtURL:currentURL options:0 error:NULL byAccessor:^(NSURL *currentURL) {
-                        currentSession->isMainThread = false;
-                        volatile pthread_t _tid = NULL;
-                        pthread_create(&_tid, NULL, run_function, params);
-                        while (_tid == NULL) { }
-                        // ios_storeThreadId(_tid);
-                        currentSession->current_command_root_thread = _tid;
-                        if (currentSession->mainThreadId == NULL) currentSession->mainThreadId = _tid;
-                        // Wait for this process to finish:
-						if (joinMainThread) {
-							pthread_join(_tid, NULL);
-							// If there are auxiliary process, also wait for them:
-							if (currentSession->lastThreadId > 0) pthread_join(currentSession->lastThreadId, NULL);
-							currentSession->lastThreadId = 0;
-							currentSession->current_command_root_thread = 0;
-						} else {
-							pthread_detach(_tid); // a thread must be either joined or detached
-						}
-                        currentSession->isMainThread = true;
-                    }];
+                    free(argv[i]);
+                    globfree(&expansions[i]);
                 } else {
-                    currentSession->isMainThread = false;
-                    volatile pthread_t _tid = NULL;
-                    pthread_create(&_tid, NULL, run_function, params);
-                    while (_tid == NULL) { }
-                    // ios_storeThreadId(_tid);
-                    currentSession->current_command_root_thread = _tid;
-                    if (currentSession->mainThreadId == NULL) currentSession->mainThreadId = _tid;
-                    // Wait for this process to finish:
-					if (joinMainThread) {
-						pthread_join(_tid, NULL);
-						// If there are auxiliary process, also wait for them:
-						if (currentSession->lastThreadId > 0) pthread_join(currentSession->lastThreadId, NULL);
-						currentSession->lastThreadId = 0;
-						currentSession->current_command_root_thread = 0;
-					} else {
-						pthread_detach(_tid); // a thread must be either joined or detached
-					}
-                    currentSession->isMainThread = true;
+                    expandedArgv[position++] = argv[i];
                 }
-            } else {
-                NSLog(@"Starting command %s, global_errno= %d\n", command, currentSession->global_errno);
-                // Don't send signal if not in main thread. Also, don't join threads.
-                volatile pthread_t _tid_local = NULL;
-                pthread_create(&_tid_local, NULL, run_function, params);
-                // The last command on the command line (with multiple pipes) will be created first
-                while (_tid_local == NULL) { }; // Wait until thread has actually started
-                // fprintf(stderr, "Started thread = %x\n", _tid_local);
-                if (currentSession->lastThreadId == 0) currentSession->lastThreadId = _tid_local; // will be joined later
-                else pthread_detach(_tid_local); // a thread must be either joined or detached.
             }
-        } else {
-            fprintf(params->stderr, "%s: command not found\n", argv[0]);
-            NSLog(@"%s: command not found\n", argv[0]);
+            expandedArgv[position] = NULL;
+            free(expansions);
             free(argv);
-            // If command output was redirected to a pipe, we still need to close it.
-            // (to warn the other command that it can stop waiting)
-            // We still need this step because there can be multiple pipes.
-            if (params->stdout != currentSession->stdout) {
-                fclose(params->stdout);
-            }
-            if ((params->stderr != currentSession->stderr) && (params->stderr != params->stdout)) {
-                fclose(params->stderr);
-            }
-            if ((handle != NULL) && (handle != RTLD_SELF)
-                && (handle != RTLD_MAIN_ONLY)
-                && (handle != RTLD_DEFAULT) && (handle != RTLD_NEXT))
-                dlclose(handle);
-            free(params); // This was malloc'ed in ios_system
-            ios_storeThreadId(0);
-            currentSession->global_errno = 127;
-            // TODO: this should also raise an exception, for python scripts
-        } // if (function)
+            argv = expandedArgv;
+            argc = expandedArgc;
+        }
+        free(dontExpand);
+        dispatchArgv(argc, argv, params, fileManager, command);
     } else { // argc != 0
         ios_storeThreadId(0);
         free(argv); // argv is otherwise freed in cleanup_function
         free(dontExpand);
         free(params);
     }
-    NSLog(@"returning from ios_system, global_errno= %d\n", currentSession->global_errno);
+    ios_trace(TraceCommand, @"returning from ios_system, global_errno= %d\n", currentSession->global_errno);
     free(originalCommand); // releases cmd, which was a strdup of inputCommand
     fflush(thread_stdin);
     fflush(thread_stdout);
@@ -3036,6 +4969,280 @@ int ios_system(const char* inputCmd) {
     return currentSession->global_errno;
 }
 
+// Same as ios_system, but the arguments have already been split (execv, posix_spawn, subprocess...):
+// no alias expansion, no redirection, no $, ~ or wildcard expansion. argv[0] is resolved as in ios_system.
+// envp (if not NULL) becomes the environment of the command. NULL streams: use the current ones.
+int ios_spawnv(const char* path, char* const argv[], char* const envp[], FILE* in, FILE* out, FILE* err) {
+    if (currentSession == NULL) {
+        currentSession = allocateSession();
+    }
+    currentSession->global_errno = 0;
+    if ((argv == NULL) || (argv[0] == NULL)) {
+        ios_storeThreadId(0);
+        return 0;
+    }
+    ios_trace(TraceCommand, @"spawn= %s pid= %d\n", argv[0], ios_currentPid());
+    if (thread_stdin == 0) thread_stdin = currentSession->stdin;
+    if (thread_stdout == 0) thread_stdout = currentSession->stdout;
+    if (thread_stderr == 0) thread_stderr = currentSession->stderr;
+    if (thread_context == 0) thread_context = currentSession->context;
+    if (envp != NULL) storeEnvironment((char**) envp);
+
+    functionParameters *params = (functionParameters*) malloc(sizeof(functionParameters));
+    // Explicit streams first, then child_streams (defined in dup2 or popen), then the current streams:
+    params->stdin = (in != NULL) ? in : child_stdin;
+    params->isChannelIn = (in == NULL) && isChannelReader(child_stdin);
+    params->isPipeIn = (in == NULL) && (child_stdin != NULL);
+    params->stdout = (out != NULL) ? out : child_stdout;
+    params->stderr = (err != NULL) ? err : child_stderr;
+    if (params->stdin == NULL) params->stdin = thread_stdin;
+    if (params->stdout == NULL) params->stdout = thread_stdout;
+    if (params->stderr == NULL) params->stderr = thread_stderr;
+    params->session = currentSession;
+    params->context = thread_context;
+    child_stdin = child_stdout = child_stderr = NULL;
+    params->argc = 0; params->argv = 0; params->argvBlock = 0;
+    params->function = NULL; params->isPipeOut = false; params->isPipeErr = false;
+    params->dlHandle = NULL; params->cacheEntry = NULL;
+    params->interpreter = NULL; params->interpreterSlot = -1; params->stage = NULL;
+
+    int argc = 0;
+    while (argv[argc] != NULL) argc++;
+    // dispatchArgv can realloc the arguments, and cleanup_function releases them:
+    char** argv_copy = (char **)malloc(sizeof(char*) * (argc + 1));
+    for (int i = 0; i < argc; i++) argv_copy[i] = strdup(argv[i]);
+    argv_copy[argc] = NULL;
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    dispatchArgv(argc, argv_copy, params, fileManager, argv[0]);
+    ios_trace(TraceCommand, @"returning from ios_spawnv, global_errno= %d\n", currentSession->global_errno);
+    fflush(thread_stdin);
+    fflush(thread_stdout);
+    fflush(thread_stderr);
+    return currentSession->global_errno;
+}
+
+// NULL-terminated arrays of strings, kept by commands that outlive the caller's copy:
+static char** copyStringArray(char* const array[]) {
+    int n = 0;
+    while (array[n] != NULL) n++;
+    char** copy = (char**) malloc(sizeof(char*) * (n + 1));
+    for (int i = 0; i < n; i++) copy[i] = strdup(array[i]);
+    copy[n] = NULL;
+    return copy;
+}
+
+static void freeStringArray(char** array) {
+    if (array == NULL) return;
+    for (int i = 0; array[i] != NULL; i++) free(array[i]);
+    free(array);
+}
+
+// Asynchronous execution: the command runs on a thread of its own, in a new session that starts as a copy of
+// the current one (directory, window size, context). That thread waits for the command, so the host doesn't
+// have to poll. run(true) starts the command; run(false) only releases what it holds, if no pid was available.
+// done is called on that thread, once the session is released, with the exit status and the resources used.
+// Streams that are NULL are those of the current session. They are not closed at the end.
+static pid_t runAsync(FILE* in, FILE* out, FILE* err, void (^run)(bool start), void (^done)(pid_t pid, int status, ios_processStats stats)) {
+    sessionParameters* parent = currentSession;
+    FILE* commandStdin = (in != NULL) ? in : ((parent != NULL) ? parent->stdin : stdin);
+    FILE* commandStdout = (out != NULL) ? out : ((parent != NULL) ? parent->stdout : stdout);
+    FILE* commandStderr = (err != NULL) ? err : ((parent != NULL) ? parent->stderr : stderr);
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    __block pid_t pid = -1;
+    [NSThread detachNewThreadWithBlock:^{
+        currentSession = allocateSession();
+        if (parent != NULL) {
+            currentSession->currentDir = parent->currentDir;
+            currentSession->previousDirectory = parent->previousDirectory;
+            currentSession->localMiniRoot = parent->localMiniRoot;
+            currentSession->context = parent->context;
+            strcpy(currentSession->columns, parent->columns);
+            strcpy(currentSession->lines, parent->lines);
+        }
+        currentSession->stdin = commandStdin;
+        currentSession->stdout = commandStdout;
+        currentSession->stderr = commandStderr;
+        thread_stdin = commandStdin;
+        thread_stdout = commandStdout;
+        thread_stderr = commandStderr;
+        thread_context = currentSession->context;
+        pid_t commandPid = ios_fork();
+        pid = commandPid;
+        dispatch_semaphore_signal(started);
+        int status;
+        ios_processStats stats;
+        memset(&stats, 0, sizeof(stats));
+        if (commandPid < 0) {
+            ios_storeThreadId(0); // releases pid_mtx
+            run(false);
+            status = EAGAIN;
+        } else {
+            run(true);
+            ios_waitpid(commandPid);
+            status = currentSession->global_errno;
+            stats = ios_getProcessStats(commandPid);
+        }
+        releaseSession(currentSession);
+        currentSession = NULL;
+        if (done != nil) done(commandPid, status, stats);
+    }];
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    return pid;
+}
+
+// Run cmd without waiting. The pid is returned as soon as it is allocated (-1 if there are no more processes),
+// and completion is called on queue (main queue if NULL).
+pid_t ios_system_async(const char* cmd, FILE* in, FILE* out, FILE* err, dispatch_queue_t queue, void (^completion)(pid_t pid, int status, ios_processStats stats)) {
+    if (cmd == NULL) return -1;
+    char* command = strdup(cmd);
+    if (queue == NULL) queue = dispatch_get_main_queue();
+    return runAsync(in, out, err, ^(bool start) {
+        if (start) ios_system(command);
+        free(command);
+    }, ^(pid_t pid, int status, ios_processStats stats) {
+        if (completion != nil) {
+            dispatch_async(queue, ^{
+                completion(pid, status, stats);
+            });
+        }
+    });
+}
+
+// Same, with a C callback:
+pid_t ios_system_async_f(const char* cmd, FILE* in, FILE* out, FILE* err, dispatch_queue_t queue, void* info, void (*completion)(void* info, pid_t pid, int status, ios_processStats stats)) {
+    return ios_system_async(cmd, in, out, err, queue, ^(pid_t pid, int status, ios_processStats stats) {
+        if (completion != NULL) completion(info, pid, status, stats);
+    });
+}
+
+// Runs cmd as ios_system, in a copy of the current session, with stdin read from the caller's memory
+// (fmemopen, no copy), and returns its output in memory: no pipe, and no thread to write or read it.
+// input NULL: stdin is the current one. *out and *err are allocated with malloc() and null-terminated;
+// the lengths are in *outLen and *errLen (if not NULL). out or err NULL: that stream is not captured, it
+// goes to the current one. input must stay valid until the function returns; like in-process pipes, these
+// streams have no file descriptor, so they are only seen by commands that go through stdio.
+// Returns the exit status of the command. Background jobs (&) must not outlive it: the streams are closed.
+int ios_system_with_input(const char* cmd, const void* input, size_t inputLen, char** out, size_t* outLen, char** err, size_t* errLen) {
+    if (cmd == NULL) return 0;
+    char* outBuffer = NULL;
+    char* errBuffer = NULL;
+    size_t outSize = 0;
+    size_t errSize = 0;
+    FILE* inStream = NULL;
+    if (input != NULL) {
+        // fmemopen() refuses an empty buffer:
+        inStream = (inputLen > 0) ? fmemopen((void*)input, inputLen, "r") : fopen("/dev/null", "r");
+    }
+    FILE* outStream = (out != NULL) ? open_memstream(&outBuffer, &outSize) : NULL;
+    FILE* errStream = (err != NULL) ? open_memstream(&errBuffer, &errSize) : NULL;
+    if (((input != NULL) && (inStream == NULL)) || ((out != NULL) && (outStream == NULL)) || ((err != NULL) && (errStream == NULL))) {
+        if (inStream != NULL) fclose(inStream);
+        if (outStream != NULL) fclose(outStream);
+        if (errStream != NULL) fclose(errStream);
+        free(outBuffer);
+        free(errBuffer);
+        return ENOMEM;
+    }
+    char* command = strdup(cmd);
+    __block int result = 0;
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    runAsync(inStream, outStream, errStream, ^(bool start) {
+        if (start) ios_system(command);
+        free(command);
+    }, ^(pid_t pid, int status, ios_processStats stats) {
+        result = status;
+        dispatch_semaphore_signal(done);
+    });
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    if (inStream != NULL) fclose(inStream);
+    // The buffers and their sizes are final once the streams are closed:
+    if (outStream != NULL) {
+        fclose(outStream);
+        *out = outBuffer;
+        if (outLen != NULL) *outLen = outSize;
+    }
+    if (errStream != NULL) {
+        fclose(errStream);
+        *err = errBuffer;
+        if (errLen != NULL) *errLen = errSize;
+    }
+    return result;
+}
+
+// Same, with the current stdin:
+int ios_system_capture(const char* cmd, char** out, size_t* outLen, char** err, size_t* errLen) {
+    return ios_system_with_input(cmd, NULL, 0, out, outLen, err, errLen);
+}
+
+// ios_spawnv without waiting, for commands that run several children at once (xargs -P). argv and envp are
+// copied. completion is called on the thread that ran the command, as soon as it has ended.
+pid_t ios_spawnv_async(const char* path, char* const argv[], char* const envp[], FILE* in, FILE* out, FILE* err, void* info, void (*completion)(void* info, pid_t pid, int status)) {
+    if ((argv == NULL) || (argv[0] == NULL)) return -1;
+    char** argvCopy = copyStringArray(argv);
+    char** envpCopy = (envp != NULL) ? copyStringArray(envp) : NULL;
+    char* pathCopy = strdup((path != NULL) ? path : argv[0]);
+    return runAsync(in, out, err, ^(bool start) {
+        if (start) ios_spawnv(pathCopy, argvCopy, envpCopy, NULL, NULL, NULL);
+        freeStringArray(argvCopy);
+        freeStringArray(envpCopy);
+        free(pathCopy);
+    }, ^(pid_t pid, int status, ios_processStats stats) {
+        if (completion != NULL) completion(info, pid, status);
+    });
+}
+
+// Runs n commands and stores their exit status in statuses (can be NULL; -1 for commands that did not run).
+// By default the commands run one after the other, in the current session, and the function returns when the
+// last one has finished, whatever the value of joinMainThread. With IOS_BATCH_STOP_ON_ERROR, it stops at the
+// first command that fails. With IOS_BATCH_PARALLEL, the commands are independent and run at the same time
+// (at most maxBackgroundJobs, or the number of cores), each in a copy of the current session.
+// Returns the number of commands that failed.
+int ios_system_batch(const char** cmds, int n, int flags, int* statuses) {
+    if ((cmds == NULL) || (n <= 0)) return 0;
+    int* results = (statuses != NULL) ? statuses : calloc(n, sizeof(int));
+    if (results == NULL) return n;
+    for (int i = 0; i < n; i++) results[i] = -1;
+    if (flags & IOS_BATCH_PARALLEL) {
+        int maxParallel = maxBackgroundJobs;
+        if (maxParallel <= 0) maxParallel = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (maxParallel <= 0) maxParallel = 1;
+        dispatch_semaphore_t slots = dispatch_semaphore_create(maxParallel);
+        dispatch_group_t group = dispatch_group_create();
+        dispatch_queue_t queue = dispatch_queue_create("ios_system_batch", DISPATCH_QUEUE_SERIAL);
+        for (int i = 0; i < n; i++) {
+            if (cmds[i] == NULL) continue;
+            dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+            dispatch_group_enter(group);
+            ios_system_async(cmds[i], NULL, NULL, NULL, queue, ^(pid_t pid, int status, ios_processStats stats) {
+                results[i] = status;
+                dispatch_semaphore_signal(slots);
+                dispatch_group_leave(group);
+            });
+        }
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    } else {
+        for (int i = 0; i < n; i++) {
+            if (cmds[i] == NULL) continue;
+            pid_t pid = ios_fork();
+            if (pid < 0) {
+                ios_storeThreadId(0); // releases pid_mtx
+                results[i] = EAGAIN;
+            } else {
+                ios_system(cmds[i]);
+                ios_waitpid(pid);
+                results[i] = ios_getCommandStatus();
+            }
+            if ((flags & IOS_BATCH_STOP_ON_ERROR) && (results[i] != 0)) break;
+        }
+    }
+    int failures = 0;
+    for (int i = 0; i < n; i++) {
+        if (results[i] != 0) failures++;
+    }
+    if (results != statuses) free(results);
+    return failures;
+}
+
 NSArray<NSString *> * pathNormalizeArray(NSArray<NSString *> * parts, BOOL allowAboveRoot) {
   NSMutableArray<NSString *> * res = [[NSMutableArray alloc] init];
   for (NSString * p in parts) {
@@ -3102,47 +5309,20 @@ NSString * pathJoin(NSString * segmentA, NSString * segmentB) {
 //
 char* ios_getPythonLibraryName() {
     // Ability to start multiple python3 scripts, expanded for commands that start python3 as a dynamic library.
-    // (mostly vim, right now)
-    // start by increasing the number of the interpreter, until we're out.
-    int numInterpreter = 0;
-    if ((currentPythonInterpreter < numPythonInterpreters) && (!PythonIsRunning[currentPythonInterpreter])) {
-        numInterpreter = currentPythonInterpreter;
-        currentPythonInterpreter++;
-    } else {
-        while  (numInterpreter < numPythonInterpreters) {
-            if (PythonIsRunning[numInterpreter] == false) break;
-            numInterpreter++;
-        }
-        if (numInterpreter >= numPythonInterpreters) {
-            // NSLog(@"ios_getPythonLibraryName: returning NULL\n");
-            return NULL;
-        } else {
-            currentPythonInterpreter = numInterpreter;
-        }
-    }
-    char* libraryName = NULL;
-    if ((numInterpreter >= 0) && (numInterpreter < numPythonInterpreters)) {
-        PythonIsRunning[numInterpreter] = true;
-        if (numInterpreter > 0) {
-            libraryName = strdup("pythonA");
-            libraryName[6] = 'A' + (numInterpreter - 1);
-        } else {
-            libraryName = strdup("python3_ios");
-        }
-        // NSLog(@"ios_getPythonLibraryName: returning %s\n", libraryName);
-        return libraryName;
-    }
-    // NSLog(@"ios_getPythonLibraryName: returning NULL\n");
-    return NULL;
+    // (mostly vim, right now). Same slots as the python command, but we don't wait for one to be free.
+    interpreterGroup* python = interpreterGroupFor("python");
+    if (python == NULL) return NULL;
+    int slot = acquireInterpreterSlot(python, false);
+    if (slot < 0) return NULL;
+    if (slot == 0) return strdup("python3_ios");
+    char* libraryName = strdup("pythonA");
+    libraryName[6] = 'A' + (slot - 1);
+    return libraryName;
 }
 
 void ios_releasePythonLibraryName(char* name) {
     char libNumber = name[6];
-    if (libNumber == '3') PythonIsRunning[0] = false;
-    else {
-        libNumber -= 'A' - 1;
-        if ((libNumber > 0) && (libNumber < MaxPythonInterpreters))
-            PythonIsRunning[libNumber] = false;
-    }
+    if (libNumber == '3') releaseInterpreterSlot(interpreterGroupFor("python"), 0);
+    else releaseInterpreterSlot(interpreterGroupFor("python"), libNumber - ('A' - 1));
     free(name);
 }
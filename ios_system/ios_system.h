@@ -23,15 +23,50 @@ extern __thread void* thread_context;
 extern bool sideLoading;
 // set to false to have the main thread run in detached mode (non blocking)
 extern bool joinMainThread;
+// set to true to connect the commands of a pipeline with in-process buffers instead of kernel pipes (no file descriptor)
+extern bool useInProcessPipes;
+// set to false to run "grep x file | wc -l", "sort | uniq -c | sort -rn"... as separate commands, not fused in a single one (ios_fuse)
+extern bool pipelineFusion;
+extern void ios_pipelineFusionStats(unsigned long* fused, unsigned long* notFused); // pipelines fused, and of the same commands left as they were
+// buffering of pipes and redirected files (_IOFBF, _IOLBF, _IONBF, -1 for system default) and buffer size
+extern int pipeBufferingMode;
+extern size_t pipeBufferSize;
+// set to false to coordinate file access (NSFileCoordinator) before every command, not once per directory and session
+extern bool cacheFileCoordination;
+extern unsigned long ios_skippedFileCoordinations(void); // number of commands started without a new file coordination
+extern size_t ios_sessionMemoryUsage(void); // bytes used by open and pooled sessions, and the paths they share
+// memory for the scratch files of commands (tmpfile(), temporary files of sort), shared by all; beyond it they go to $TMPDIR (0: always on disk)
+extern size_t scratchMemoryBudget;
+extern size_t ios_scratchMemoryUsage(void); // bytes of scratch files currently in memory
+// commands compiled with IOS_COMMAND_MEMORY allocate in a zone of their own, released when they end (default: false):
+extern bool reclaimCommandMemory;
+// sort, less, awk, tar and the scratch files use at most 1/memoryBudgetShare of the memory the app can still allocate:
+extern int memoryBudgetShare;
+extern size_t ios_memoryBudget(void);
+extern int ios_memoryPressure(void); // 0: normal, 1: warning, 2: critical
+// md5 and cksum keep the digests of files in an extended attribute, reused while the file is unchanged (default: false):
+extern bool cacheFileDigests;
+// maximum number of background jobs ("command &" in sh) running at the same time in a session (0: number of cores)
+extern int maxBackgroundJobs;
+// called by cp (on the thread of the command, or a copier thread with -j) after each chunk of a large file is copied (NULL: no reports)
+extern void (*ios_copyProgress)(const char* source, const char* destination, off_t copied, off_t total);
 
 extern int ios_executable(const char* inputCmd); // does this command exist? (executable file or builtin command)
+extern char* ios_which(const char* cmd); // where this command is: file in $PATH, or name of a builtin command. malloc()ed, NULL if not found.
+extern void ios_hashReset(void); // forget the locations of commands in $PATH ("hash -r"), if files changed behind a symbolic link
 extern int ios_system(const char* inputCmd); // execute this command (executable file or builtin command)
 extern FILE *ios_popen(const char *command, const char *type); // Execute this command and pipe the result
+extern int ios_spawnv(const char* path, char* const argv[], char* const envp[], FILE* in, FILE* out, FILE* err); // execute argv, already split (no parsing or expansion)
 extern int ios_kill(void); // kill the current running command
 extern int ios_killpid(pid_t pid, int sig); // kill the current running command
 extern int chdir(const char* path);
 
 extern int ios_isatty(int fd); // test whether a file descriptor refers to a terminal
+extern int ios_openDescriptorCount(void); // number of file descriptors currently open (estimate)
+extern unsigned long long ios_timeSpentWaiting(void); // total time (in microseconds) threads spent waiting for other commands
+extern unsigned int ios_traceCategories; // which diagnostics to log, if compiled with IOS_SYSTEM_TRACE=1 (0 = none)
+extern bool ios_traceToMemory; // keep diagnostics in a ring buffer instead of sending them to NSLog
+extern void ios_dumpTrace(FILE* output); // print the diagnostics stored in the ring buffer
 extern pthread_t ios_getLastThreadId(void);
 extern pthread_t ios_getThreadId(pid_t pid);
 extern void ios_storeThreadId(pthread_t thread);
@@ -49,6 +84,71 @@ extern void storeEnvironment(char* envp[]);
 extern pid_t ios_fork(void);
 extern void ios_waitpid(pid_t pid);
 extern void ios_signal(int signal);
+// Resources used by a process (ios_getProcessStats). Kept after it terminates, until the pid is reused.
+#ifndef IOS_DURATION_BUCKETS
+#define IOS_DURATION_BUCKETS 32 // ios_getDurationHistogram: bucket i counts commands that took 2^i to 2^(i+1) microseconds
+typedef struct _ios_processStats {
+    double wallTime;                // seconds, from ios_fork to the end of the command
+    double cpuTime;                 // seconds (user + system) of the main thread of the command
+    double userTime;                // the same, split between user
+    double systemTime;              // and system time
+    unsigned long long bytesOut;    // written to stdout
+    unsigned long long bytesErr;    // written to stderr
+    // memory allocated by the parts of the command compiled with IOS_COMMAND_MEMORY:
+    unsigned long long memoryInUse;     // bytes, now (or when it ended)
+    unsigned long long peakMemory;      // bytes, at most at the same time
+    unsigned long long reclaimedMemory; // bytes it had not released, freed when it ended (reclaimCommandMemory)
+    bool running;
+} ios_processStats;
+typedef struct _ios_pipelineStage {
+    char command[32];
+    unsigned long long bytesIn;     // read from the previous stage (in-process pipes only)
+    unsigned long long bytesOut;    // written to stdout
+    double blockedOnRead;           // seconds waiting for the previous stage (in-process pipes only)
+    double blockedOnWrite;          // seconds waiting for the next stage to read (in-process pipes only)
+    double wallTime;                // seconds
+    double userTime;                // CPU seconds of the stage's thread, once it has terminated
+    double systemTime;
+    bool running;
+} ios_pipelineStage;
+#endif
+extern ios_processStats ios_getProcessStats(pid_t pid);
+extern int ios_getDurationHistogram(unsigned long* buckets, int numBuckets);
+// stages of the last pipeline started by pid, first command first; returns the number of stages:
+extern int ios_pipelineReport(pid_t pid, ios_pipelineStage* stages, int maxStages);
+// sample the stacks of the commands running as pids (frequency 0: 397 Hz, duration 0: until they end) and write them
+// to output in the folded format of flamegraph.pl; returns the number of samples. Also the "ios_profile" command.
+extern int ios_profile(const pid_t* pids, int numPids, int frequency, double duration, FILE* output);
+typedef struct _ios_volume {
+    char mountPoint[1024];
+    char fsType[16];
+    unsigned long long totalBytes;
+    unsigned long long freeBytes;
+    unsigned long long availableBytes; // free space usable without privileges
+    unsigned long long totalFiles;
+    unsigned long long freeFiles;
+    double age;                        // seconds since measured; negative if the values are the ones the system had cached
+} ios_volume;
+// Free space of the volume holding path (one entry), or of all mounted volumes if path is NULL; returns the number of
+// entries. Never waits for a volume: it returns the last values known, and volumes older than a few seconds are
+// measured again in the background.
+extern int ios_volumeStats(const char* path, ios_volume* volumes, int maxVolumes);
+extern void ios_interrupt(pid_t pid); // ask a command to stop (at its next output, or when it checks ios_isInterrupted)
+extern void ios_interruptThread(pthread_t thread);
+extern bool ios_isInterrupted(void); // for long loops in commands: has the current command been interrupted?
+// run cmd without waiting, in a copy of the current session; completion is called on queue when it ends:
+extern pid_t ios_system_async(const char* cmd, FILE* in, FILE* out, FILE* err, dispatch_queue_t queue, void (^completion)(pid_t pid, int status, ios_processStats stats));
+extern pid_t ios_system_async_f(const char* cmd, FILE* in, FILE* out, FILE* err, dispatch_queue_t queue, void* info, void (*completion)(void* info, pid_t pid, int status, ios_processStats stats));
+// run cmd and wait, with stdout and stderr in memory (malloc()ed, null-terminated); NULL out or err: not captured:
+extern int ios_system_capture(const char* cmd, char** out, size_t* outLen, char** err, size_t* errLen);
+// same, with stdin read from input (not copied; NULL: the current stdin):
+extern int ios_system_with_input(const char* cmd, const void* input, size_t inputLen, char** out, size_t* outLen, char** err, size_t* errLen);
+// same as ios_spawnv, without waiting; completion is called on the thread of the command when it ends:
+extern pid_t ios_spawnv_async(const char* path, char* const argv[], char* const envp[], FILE* in, FILE* out, FILE* err, void* info, void (*completion)(void* info, pid_t pid, int status));
+// run n commands, in sequence (or in parallel with IOS_BATCH_PARALLEL); returns the number of commands that failed:
+#define IOS_BATCH_PARALLEL      1 // the commands are independent, run them at the same time
+#define IOS_BATCH_STOP_ON_ERROR 2 // in sequence, stop at the first command that fails
+extern int ios_system_batch(const char** cmds, int n, int flags, int* statuses);
 extern NSString *ios_getLogicalPWD(const void* sessionId);
 void ios_setWindowSize(int width, int height, const void* sessionId);
 
@@ -65,6 +165,7 @@ extern void ios_setBookmarkDictionaryName(NSString*);  // name of the dictionary
 extern void ios_switchSession(const void* sessionid);
 extern void ios_closeSession(const void* sessionid);
 extern void ios_setStreams(FILE* _stdin, FILE* _stdout, FILE* _stderr);
+extern void ios_setOutputCoalescing(int framesPerSecond); // send the terminal output of the current session at most framesPerSecond times per second (0: off)
 extern void ios_settty(FILE* _tty);
 extern int ios_gettty(void);
 extern int ios_activePager(void);
@@ -76,5 +177,13 @@ extern void makeGlobal(void);
 extern void makeLocal(void);
 extern void replaceCommand(NSString* commandName, NSString* functionName, bool allOccurences);
 extern NSError* addCommandList(NSString* fileLocation);
-extern int numPythonInterpreters;
+extern int numPythonInterpreters; // maximum number of python scripts running at the same time
+extern int numPerlInterpreters; // same for perl
+extern int interpreterSlotWaitTime; // seconds to wait for a free interpreter when they are all busy (0 = fail immediately)
+extern int threadPoolSize; // number of threads kept ready to run commands (0 = one new thread per command)
+extern size_t commandStackSize; // stack size for command threads (0 = system default)
+extern size_t interpreterStackSize; // stack size for python, perl, lua... (0 = system default)
+extern int commandCacheSize; // number of commands kept loaded between calls (0 = dlclose after each command)
+extern void ios_purgeCommandCache(void); // release all the libraries kept loaded by the command cache
+extern void ios_preloadCommands(const char** names, int n); // load the frameworks for these commands in the background
 extern int cd_main(int argc, char** argv);
@@ -171,6 +171,23 @@
  */
 #define	HAVE_DUP	1
 
+/*
+ * HAVE_MMAP is 1 if your system can map a file into memory with mmap().
+ */
+#define	HAVE_MMAP	1
+
+/*
+ * HAVE_PTHREAD is 1 if your system has POSIX threads.
+ */
+#define	HAVE_PTHREAD	1
+
+/*
+ * HAVE_ZLIB and HAVE_BZLIB are 1 if gzip and bzip2 files can be
+ * decompressed as they are read, with zlib and libbz2.
+ */
+#define	HAVE_ZLIB	1
+#define	HAVE_BZLIB	1
+
 /* Define to 1 if you have the memcpy() function. */
 #define HAVE_MEMCPY 1
 
@@ -25,6 +25,24 @@
 extern dev_t curr_dev;
 extern ino_t curr_ino;
 #endif
+#if HAVE_MMAP
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#if HAVE_PTHREAD
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_BZLIB
+#include <bzlib.h>
+#endif
+#if HAVE_ZLIB || HAVE_BZLIB
+#include <sys/stat.h>
+#endif
 
 typedef POSITION BLOCKNUM;
 
@@ -41,15 +59,109 @@ struct bufnode {
 	struct bufnode *hnext, *hprev;
 };
 
+/*
+ * A block is LBUFSIZE bytes unless --block-size says otherwise.
+ * Its data is either in the buffer's own memory, allocated when
+ * first read into, or in a mapping of the file (--mmap).
+ */
 #define	LBUFSIZE	8192
 struct buf {
 	struct bufnode node;
 	BLOCKNUM block;
 	unsigned int datasize;
-	unsigned char data[LBUFSIZE];
+	unsigned char *data;
+	unsigned char *mem;
+#if HAVE_MMAP
+	void *map;
+	size_t maplen;
+#endif
 };
 #define bufnode_buf(bn)  ((struct buf *) bn)
 
+#if HAVE_PTHREAD
+/*
+ * Input we cannot seek on is read ahead by a thread of its own,
+ * up to RA_BLOCKS blocks, so that the next screenful is usually
+ * there before it is asked for.
+ */
+#define	RA_BLOCKS	64
+struct rablock {
+	struct rablock *next;
+	unsigned int len;
+	unsigned int off;
+	unsigned char data[1];
+};
+struct readahead {
+	struct readahead *next;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int file;
+	unsigned int size;
+	struct rablock *head, *tail;
+	int nblocks;
+	int err;
+	int done;
+	int stop;
+};
+#endif
+
+#if HAVE_ZLIB || HAVE_BZLIB
+/*
+ * A gzip or bzip2 file is decompressed as it is read (CH_ZIP),
+ * rather than through a LESSOPEN pipe, so it can still be seeked on:
+ * forward by decompressing, back by starting again from an access
+ * point, or from the beginning.  Access points are recorded every
+ * ZSPAN bytes of gzip data as it goes by (each keeps a ZWINDOW
+ * dictionary), or read from the sidecar of "gzip --index".
+ * Positions are in the decompressed data.
+ */
+#define	ZIN_GZIP	1
+#define	ZIN_BZIP2	2
+#define	ZBUFSIZE	65536
+#define	ZSPAN		(1024 * 1024)
+#define	ZWINDOW		32768
+
+/* The sidecar of "gzip --index"; see gzindex.c in gzip. */
+#define	GZX_SUFFIX	".gzx"
+#define	GZX_MAGIC	"GZX\1"
+#define	GZX_HEADER	32
+#define	GZX_ENTRY	32
+
+struct zpoint {
+	POSITION out;		/* decompressed offset */
+	off_t in;		/* first full byte of the block */
+	int bits;		/* bits of the block in byte in - 1 */
+	unsigned int winlen;
+	off_t winoff;		/* window in the sidecar, or */
+	unsigned char *window;	/* recorded here */
+};
+
+struct zinput {
+	int type;
+	int file;
+	int xfile;		/* the sidecar, or -1 */
+	POSITION out;		/* decompressed so far */
+	off_t in;		/* read from the file so far */
+	int member;		/* at the start of a gzip member */
+	int raw;		/* raw deflate data, from an access point */
+	int trailer;		/* bytes left of its gzip trailer */
+	int eof;
+	int started;
+#if HAVE_ZLIB
+	z_stream zs;
+	struct zpoint *points;
+	int npoints;
+	int maxpoints;
+	int record;
+#endif
+#if HAVE_BZLIB
+	bz_stream bs;
+#endif
+	unsigned char inbuf[ZBUFSIZE];
+	unsigned char skipbuf[ZBUFSIZE];
+};
+#endif
+
 /*
  * The file state is maintained in a filestate structure.
  * A pointer to the filestate is kept in the ifile structure.
@@ -65,6 +177,12 @@ struct filestate {
 	BLOCKNUM block;
 	unsigned int offset;
 	POSITION fsize;
+#if HAVE_PTHREAD
+	struct readahead *ra;
+#endif
+#if HAVE_ZLIB || HAVE_BZLIB
+	struct zinput *z;
+#endif
 };
 
 #define	ch_bufhead	thisfile->buflist.next
@@ -123,12 +241,18 @@ struct filestate {
 static struct filestate *thisfile;
 static int ch_ungotchar = -1;
 static int maxbufs = -1;
+static int bufspace_k = -1;
+static unsigned int lbufsize = LBUFSIZE;
+#if HAVE_PTHREAD
+static struct readahead *ra_list;
+#endif
 
 extern int autobuf;
 extern int sigs;
 extern int secure;
 extern int screen_trashed;
 extern int follow_mode;
+extern int use_mmap;
 extern constant char helpdata[];
 extern constant int size_helpdata;
 extern IFILE curr_ifile;
@@ -138,6 +262,20 @@ extern char *namelogfile;
 #endif
 
 static int ch_addbuf();
+static int ch_bufmem();
+static void ch_unmap();
+#if HAVE_MMAP
+static int ch_mapblock();
+#endif
+#if HAVE_PTHREAD
+static int ra_read();
+#endif
+#if HAVE_ZLIB || HAVE_BZLIB
+static struct zinput *z_open();
+static void z_close();
+static int z_read();
+static int z_seek();
+#endif
 
 
 /*
@@ -204,9 +342,16 @@ ch_get()
 			 * Allocate a new buffer if:
 			 * 1. We can't seek on this file and -b is not in effect; or
 			 * 2. We haven't allocated the max buffers for this file yet.
+			 * On iOS, not beyond the memory budget: after that, the
+			 * oldest buffers are reused, as with -b (a pipe can no
+			 * longer be scrolled back to its beginning).
 			 */
-			if ((autobuf && !(ch_flags & CH_CANSEEK)) ||
+			if (((autobuf && !(ch_flags & CH_CANSEEK)) ||
 				(maxbufs < 0 || ch_nbufs < maxbufs))
+#ifdef __APPLE__
+				&& (size_t) ch_nbufs * lbufsize < ios_memoryBudget()
+#endif
+				)
 				if (ch_addbuf())
 					/*
 					 * Allocation failed: turn off autobuf.
@@ -216,19 +361,41 @@ ch_get()
 		bn = ch_buftail;
 		bp = bufnode_buf(bn);
 		BUF_HASH_RM(bn); /* Remove from old hash chain. */
+		ch_unmap(bp);
 		bp->block = ch_block;
 		bp->datasize = 0;
 		BUF_HASH_INS(bn, h); /* Insert into new hash chain. */
 	}
 
     read_more:
-	pos = (ch_block * LBUFSIZE) + bp->datasize;
+	pos = (ch_block * lbufsize) + bp->datasize;
 	if ((len = ch_length()) != NULL_POSITION && pos >= len)
 		/*
 		 * At end of file.
 		 */
 		return (EOI);
 
+#if HAVE_MMAP
+	if ((ch_flags & CH_MMAP) && !ignore_eoi && ch_ungotchar == -1)
+	{
+		/*
+		 * Map the block rather than read it.
+		 * The file offset is left alone, so ch_fpos still
+		 * says where a read would come from.
+		 * If the mapping fails, ch_mapblock turns CH_MMAP off
+		 * and we go on to read the file instead.
+		 */
+		if ((n = ch_mapblock(bp)) >= 0)
+			goto got_data;
+	}
+#endif
+	if (ch_bufmem(bp))
+	{
+		error("cannot allocate buffer", NULL_PARG);
+		clear_eol();
+		return (EOI);
+	}
+
 	if (pos != ch_fpos)
 	{
 		/*
@@ -238,6 +405,20 @@ ch_get()
 		 */
 		if (!(ch_flags & CH_CANSEEK))
 			return ('?');
+#if HAVE_ZLIB || HAVE_BZLIB
+		if (ch_flags & CH_ZIP)
+		{
+			n = z_seek(thisfile->z, pos);
+			if (n == READ_INTR)
+				return (EOI);
+			if (n < 0)
+			{
+				error("cannot decompress", NULL_PARG);
+				clear_eol();
+				return (EOI);
+			}
+		} else
+#endif
 		if (lseek(ch_file, (off_t)pos, SEEK_SET) == BAD_LSEEK)
 		{
  			error("seek error", NULL_PARG);
@@ -262,9 +443,23 @@ ch_get()
 		bp->data[bp->datasize] = helpdata[ch_fpos];
 		n = 1;
 	} else
+#if HAVE_PTHREAD
+	if (thisfile->ra != NULL)
+	{
+		n = ra_read(thisfile->ra, &bp->data[bp->datasize],
+			lbufsize - bp->datasize);
+	} else
+#endif
+#if HAVE_ZLIB || HAVE_BZLIB
+	if (ch_flags & CH_ZIP)
+	{
+		n = z_read(thisfile->z, &bp->data[bp->datasize],
+			lbufsize - bp->datasize);
+	} else
+#endif
 	{
 		n = iread(ch_file, &bp->data[bp->datasize], 
-			(unsigned int)(LBUFSIZE - bp->datasize));
+			lbufsize - bp->datasize);
 	}
 
 	if (n == READ_INTR)
@@ -290,6 +485,9 @@ ch_get()
 #endif
 
 	ch_fpos += n;
+#if HAVE_MMAP
+    got_data:
+#endif
 	bp->datasize += n;
 
 	/*
@@ -425,7 +623,7 @@ sync_logfile()
 	BLOCKNUM block;
 	BLOCKNUM nblocks;
 
-	nblocks = (ch_fpos + LBUFSIZE - 1) / LBUFSIZE;
+	nblocks = (ch_fpos + lbufsize - 1) / lbufsize;
 	for (block = 0;  block < nblocks;  block++)
 	{
 		int wrote = FALSE;
@@ -489,7 +687,7 @@ ch_seek(pos)
 	if (pos < ch_zero() || (len != NULL_POSITION && pos > len))
 		return (1);
 
-	new_block = pos / LBUFSIZE;
+	new_block = pos / lbufsize;
 	if (!(ch_flags & CH_CANSEEK) && pos != ch_fpos && !buffered(new_block))
 	{
 		if (ch_fpos > pos)
@@ -507,7 +705,7 @@ ch_seek(pos)
 	 * Set read pointer.
 	 */
 	ch_block = new_block;
-	ch_offset = pos % LBUFSIZE;
+	ch_offset = pos % lbufsize;
 	return (0);
 }
 
@@ -522,7 +720,10 @@ ch_end_seek()
 	if (thisfile == NULL)
 		return (0);
 
-	if (ch_flags & CH_CANSEEK)
+	/*
+	 * The length of compressed data is only known once it is read.
+	 */
+	if ((ch_flags & (CH_CANSEEK|CH_ZIP)) == CH_CANSEEK)
 		ch_fsize = filesize(ch_file);
 
 	len = ch_length();
@@ -556,7 +757,7 @@ ch_end_buffer_seek()
 	FOR_BUFS(bn)
 	{
 		bp = bufnode_buf(bn);
-		buf_pos = (bp->block * LBUFSIZE) + bp->datasize;
+		buf_pos = (bp->block * lbufsize) + bp->datasize;
 		if (buf_pos > end_pos)
 			end_pos = buf_pos;
 	}
@@ -623,7 +824,7 @@ ch_tell()
 {
 	if (thisfile == NULL)
 		return (NULL_POSITION);
-	return (ch_block * LBUFSIZE) + ch_offset;
+	return (ch_block * lbufsize) + ch_offset;
 }
 
 /*
@@ -639,7 +840,7 @@ ch_forw_get()
 	c = ch_get();
 	if (c == EOI)
 		return (EOI);
-	if (ch_offset < LBUFSIZE-1)
+	if (ch_offset < lbufsize-1)
 		ch_offset++;
 	else
 	{
@@ -666,7 +867,7 @@ ch_back_get()
 		if (!(ch_flags & CH_CANSEEK) && !buffered(ch_block-1))
 			return (EOI);
 		ch_block--;
-		ch_offset = LBUFSIZE-1;
+		ch_offset = lbufsize-1;
 	}
 	return (ch_get());
 }
@@ -679,16 +880,30 @@ ch_back_get()
 ch_setbufspace(bufspace)
 	int bufspace;
 {
+	bufspace_k = bufspace;
 	if (bufspace < 0)
 		maxbufs = -1;
 	else
 	{
-		maxbufs = ((bufspace * 1024) + LBUFSIZE-1) / LBUFSIZE;
+		maxbufs = ((bufspace * 1024) + lbufsize-1) / lbufsize;
 		if (maxbufs < 1)
 			maxbufs = 1;
 	}
 }
 
+/*
+ * Set the size of a block, in units of 1024 bytes.
+ * Only done before any file is opened: the buffers
+ * already allocated are all of the old size.
+ */
+	public void
+ch_setblocksize(k)
+	int k;
+{
+	lbufsize = (unsigned int) k * 1024;
+	ch_setbufspace(bufspace_k);
+}
+
 /*
  * Flush (discard) any saved file state, including buffer contents.
  */
@@ -715,20 +930,33 @@ ch_flush()
 	 */
 	FOR_BUFS(bn)
 	{
+		ch_unmap(bufnode_buf(bn));
 		bufnode_buf(bn)->block = -1;
 	}
 
 	/*
 	 * Figure out the size of the file, if we can.
+	 * Compressed data is decompressed again from the start.
 	 */
 	ch_fsize = filesize(ch_file);
+#if HAVE_ZLIB || HAVE_BZLIB
+	if (ch_flags & CH_ZIP)
+	{
+		z_close(thisfile->z);
+		thisfile->z = z_open(ch_file, get_filename(curr_ifile));
+		if (thisfile->z != NULL)
+			ch_fsize = NULL_POSITION;
+		else
+			ch_flags &= ~CH_ZIP;
+	}
+#endif
 
 	/*
 	 * Seek to a known position: the beginning of the file.
 	 */
 	ch_fpos = 0;
-	ch_block = 0; /* ch_fpos / LBUFSIZE; */
-	ch_offset = 0; /* ch_fpos % LBUFSIZE; */
+	ch_block = 0; /* ch_fpos / lbufsize; */
+	ch_offset = 0; /* ch_fpos % lbufsize; */
 
 #if 1
 	/*
@@ -740,7 +968,7 @@ ch_flush()
 	if (ch_fsize == 0)
 	{
 		ch_fsize = NULL_POSITION;
-		ch_flags &= ~CH_CANSEEK;
+		ch_flags &= ~(CH_CANSEEK|CH_MMAP);
 	}
 #endif
 
@@ -781,6 +1009,858 @@ ch_addbuf()
 	return (0);
 }
 
+/*
+ * Make sure a buffer's data is in its own memory, so it can be read into.
+ * Return 0 if successful, non-zero if there is no memory for it.
+ */
+	static int
+ch_bufmem(bp)
+	struct buf *bp;
+{
+	if (bp->mem == NULL)
+	{
+		bp->mem = (unsigned char *) malloc(lbufsize);
+		if (bp->mem == NULL)
+			return (1);
+	}
+	if (bp->data != bp->mem)
+	{
+		/*
+		 * The block was mapped: keep what we have of it.
+		 */
+		if (bp->datasize > 0)
+			memcpy(bp->mem, bp->data, bp->datasize);
+		ch_unmap(bp);
+		bp->data = bp->mem;
+	}
+	return (0);
+}
+
+/*
+ * Drop the mapping of a buffer's block, and the data that was in it.
+ */
+	static void
+ch_unmap(bp)
+	struct buf *bp;
+{
+#if HAVE_MMAP
+	if (bp->map == NULL)
+		return;
+	if (bp->data != bp->mem)
+	{
+		bp->data = bp->mem;
+		bp->datasize = 0;
+	}
+	munmap(bp->map, bp->maplen);
+	bp->map = NULL;
+	bp->maplen = 0;
+#endif
+}
+
+#if HAVE_MMAP
+/*
+ * Map the block a buffer is for, from where its data ends
+ * to the end of the block or of the file.
+ * Return the number of bytes added to the buffer, 0 at end of file,
+ * or -1 if the file cannot be mapped; then CH_MMAP is turned off.
+ */
+	static int
+ch_mapblock(bp)
+	struct buf *bp;
+{
+	struct stat st;
+	off_t start, end, pstart;
+	void *map;
+	long pagesize;
+	int n;
+
+	start = (off_t) bp->block * lbufsize;
+	if (fstat(ch_file, &st) < 0)
+		goto nomap;
+	end = start + lbufsize;
+	if (end > st.st_size)
+		end = st.st_size;
+	if (end <= start + bp->datasize)
+		return (0);
+	/*
+	 * The offset given to mmap must be page aligned;
+	 * a block need not be.
+	 */
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize <= 0)
+		goto nomap;
+	pstart = start - (start % pagesize);
+	map = mmap(NULL, (size_t)(end - pstart), PROT_READ, MAP_SHARED,
+		ch_file, pstart);
+	if (map == MAP_FAILED)
+		goto nomap;
+	n = (int) (end - start) - bp->datasize;
+	if (bp->map != NULL)
+		munmap(bp->map, bp->maplen);
+	bp->map = map;
+	bp->maplen = (size_t)(end - pstart);
+	bp->data = (unsigned char *) map + (start - pstart);
+	return (n);
+
+    nomap:
+	ch_flags &= ~CH_MMAP;
+	return (-1);
+}
+#endif
+
+#if HAVE_PTHREAD
+/*
+ * Free a read-ahead once both its thread and its reader are done with it.
+ */
+	static void
+ra_free(ra)
+	struct readahead *ra;
+{
+	struct rablock *rb;
+
+	while ((rb = ra->head) != NULL)
+	{
+		ra->head = rb->next;
+		free(rb);
+	}
+	pthread_mutex_destroy(&ra->lock);
+	pthread_cond_destroy(&ra->cond);
+	free(ra);
+}
+
+/*
+ * The read-ahead thread: read blocks from the file until end of file,
+ * an error, or until it is told to stop.
+ */
+	static void *
+ra_thread(arg)
+	void *arg;
+{
+	struct readahead *ra = (struct readahead *) arg;
+	struct rablock *rb;
+	int n;
+	int err;
+	int dofree;
+
+	pthread_mutex_lock(&ra->lock);
+	while (!ra->stop)
+	{
+		if (ra->nblocks >= RA_BLOCKS)
+		{
+			pthread_cond_wait(&ra->cond, &ra->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&ra->lock);
+		err = 0;
+		rb = (struct rablock *) malloc(sizeof(struct rablock) + ra->size);
+		if (rb == NULL)
+		{
+			n = -1;
+			err = ENOMEM;
+		} else
+		{
+			while ((n = read(ra->file, rb->data, ra->size)) < 0 &&
+				(errno == EINTR || errno == EAGAIN))
+			{
+				/*
+				 * A non-blocking descriptor has nothing yet:
+				 * wait a little rather than spin.
+				 */
+				if (errno == EAGAIN)
+					usleep(10000);
+			}
+			if (n < 0)
+				err = errno;
+		}
+		pthread_mutex_lock(&ra->lock);
+		if (n <= 0)
+		{
+			free(rb);
+			ra->err = err;
+			break;
+		}
+		rb->next = NULL;
+		rb->len = n;
+		rb->off = 0;
+		if (ra->tail == NULL)
+			ra->head = rb;
+		else
+			ra->tail->next = rb;
+		ra->tail = rb;
+		ra->nblocks++;
+		pthread_cond_broadcast(&ra->cond);
+	}
+	ra->done = TRUE;
+	pthread_cond_broadcast(&ra->cond);
+	dofree = ra->stop;
+	pthread_mutex_unlock(&ra->lock);
+	if (dofree)
+		ra_free(ra);
+	return (NULL);
+}
+
+/*
+ * Start reading a file ahead.
+ * Return NULL if that cannot be done; then the file is read as it is needed.
+ */
+	static struct readahead *
+ra_start(f)
+	int f;
+{
+	struct readahead *ra;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int r;
+
+	ra = (struct readahead *) calloc(1, sizeof(struct readahead));
+	if (ra == NULL)
+		return (NULL);
+	ra->file = f;
+	ra->size = lbufsize;
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+	/*
+	 * Detached: the thread may be stuck in a read
+	 * long after we are done with the file.
+	 */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	r = pthread_create(&thread, &attr, ra_thread, (void *) ra);
+	pthread_attr_destroy(&attr);
+	if (r != 0)
+	{
+		ra_free(ra);
+		return (NULL);
+	}
+	ra->next = ra_list;
+	ra_list = ra;
+	return (ra);
+}
+
+/*
+ * Tell a read-ahead thread to stop.
+ * Whichever of us is last to let go of it frees it.
+ */
+	static void
+ra_stop(ra)
+	struct readahead *ra;
+{
+	int dofree;
+
+	pthread_mutex_lock(&ra->lock);
+	ra->stop = TRUE;
+	pthread_cond_broadcast(&ra->cond);
+	dofree = ra->done;
+	pthread_mutex_unlock(&ra->lock);
+	if (dofree)
+		ra_free(ra);
+}
+
+/*
+ * Take up to len bytes the read-ahead thread has read.
+ * Like iread, return the number of bytes, 0 at end of file,
+ * -1 on error or READ_INTR if interrupted while waiting.
+ */
+	static int
+ra_read(ra, buf, len)
+	struct readahead *ra;
+	unsigned char *buf;
+	unsigned int len;
+{
+	struct rablock *rb;
+	struct timeval now;
+	struct timespec until;
+	int n;
+
+	pthread_mutex_lock(&ra->lock);
+	if (ra->head == NULL && !ra->done)
+	{
+		/*
+		 * Show what we have before waiting, as iread does.
+		 */
+		pthread_mutex_unlock(&ra->lock);
+		flush();
+		pthread_mutex_lock(&ra->lock);
+	}
+	while (ra->head == NULL && !ra->done)
+	{
+		/*
+		 * Wake up now and then to see whether we were interrupted.
+		 */
+		if (ABORT_SIGS())
+		{
+			pthread_mutex_unlock(&ra->lock);
+			return (READ_INTR);
+		}
+		gettimeofday(&now, NULL);
+		until.tv_sec = now.tv_sec;
+		until.tv_nsec = now.tv_usec * 1000 + 100000000;
+		if (until.tv_nsec >= 1000000000)
+		{
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&ra->cond, &ra->lock, &until);
+	}
+	if ((rb = ra->head) == NULL)
+	{
+		n = (ra->err != 0) ? -1 : 0;
+		errno = ra->err;
+		pthread_mutex_unlock(&ra->lock);
+		return (n);
+	}
+	n = rb->len - rb->off;
+	if ((unsigned int) n > len)
+		n = len;
+	memcpy(buf, rb->data + rb->off, n);
+	rb->off += n;
+	if (rb->off == rb->len)
+	{
+		ra->head = rb->next;
+		if (ra->head == NULL)
+			ra->tail = NULL;
+		ra->nblocks--;
+		free(rb);
+		pthread_cond_broadcast(&ra->cond);
+	}
+	pthread_mutex_unlock(&ra->lock);
+	return (n);
+}
+#endif
+
+#if HAVE_ZLIB || HAVE_BZLIB
+/*
+ * How much memory the windows of the recorded access points may take.
+ */
+	static size_t
+z_budget()
+{
+#ifdef __APPLE__
+	return (ios_memoryBudget() / 8);
+#else
+	return (32 * 1024 * 1024);
+#endif
+}
+
+/*
+ * End the current decompression, if any.
+ */
+	static void
+z_end(z)
+	struct zinput *z;
+{
+	if (!z->started)
+		return;
+#if HAVE_ZLIB
+	if (z->type == ZIN_GZIP)
+		inflateEnd(&z->zs);
+#endif
+#if HAVE_BZLIB
+	if (z->type == ZIN_BZIP2)
+		BZ2_bzDecompressEnd(&z->bs);
+#endif
+	z->started = FALSE;
+}
+
+#if HAVE_ZLIB
+/*
+ * A little-endian number of n bytes, from the sidecar.
+ */
+	static unsigned long long
+z_get(p, n)
+	unsigned char *p;
+	int n;
+{
+	unsigned long long v = 0;
+
+	while (n-- > 0)
+		v = v << 8 | p[n];
+	return (v);
+}
+
+/*
+ * Read the access points of the sidecar written by "gzip --index",
+ * if there is one and it is for this version of the file.
+ * The windows stay in the sidecar until they are needed.
+ */
+	static void
+z_readindex(z, filename)
+	struct zinput *z;
+	char *filename;
+{
+	unsigned char header[GZX_HEADER];
+	unsigned char *table, *e;
+	struct stat st, xst;
+	char *xname;
+	long npoints;
+	off_t toff;
+	int i;
+
+	xname = (char *) ecalloc(strlen(filename) + sizeof(GZX_SUFFIX), 1);
+	strcpy(xname, filename);
+	strcat(xname, GZX_SUFFIX);
+	z->xfile = open(xname, OPEN_READ);
+	free(xname);
+	if (z->xfile < 0)
+		return;
+	table = NULL;
+	if (fstat(z->file, &st) != 0 || fstat(z->xfile, &xst) != 0 ||
+	    pread(z->xfile, header, GZX_HEADER, 0) != GZX_HEADER ||
+	    memcmp(header, GZX_MAGIC, 4) != 0 ||
+	    (off_t) z_get(header + 8, 8) != st.st_size ||
+	    (time_t) z_get(header + 16, 8) != st.st_mtime)
+		goto bad;
+	npoints = (long) z_get(header + 4, 4);
+	toff = (off_t) z_get(header + 24, 8);
+	if (npoints == 0 || toff + npoints * GZX_ENTRY != xst.st_size)
+		goto bad;
+	table = (unsigned char *) malloc(npoints * GZX_ENTRY);
+	z->points = (struct zpoint *) calloc(npoints, sizeof(struct zpoint));
+	if (table == NULL || z->points == NULL ||
+	    pread(z->xfile, table, npoints * GZX_ENTRY, toff) !=
+	    npoints * GZX_ENTRY)
+		goto bad;
+	for (i = 0;  i < npoints;  i++)
+	{
+		e = table + i * GZX_ENTRY;
+		z->points[i].out = (POSITION) z_get(e, 8);
+		z->points[i].in = (off_t) z_get(e + 8, 8);
+		z->points[i].winoff = (off_t) z_get(e + 16, 8);
+		z->points[i].winlen = (unsigned int) z_get(e + 24, 4);
+		z->points[i].bits = (int) z_get(e + 28, 4);
+		if (z->points[i].winlen > ZWINDOW || z->points[i].bits > 7 ||
+		    z->points[i].in < (z->points[i].bits ? 1 : 0) ||
+		    (i > 0 && z->points[i].out <= z->points[i-1].out))
+			goto bad;
+	}
+	free(table);
+	z->npoints = npoints;
+	/* The sidecar covers the whole file. */
+	z->record = FALSE;
+	return;
+bad:
+	free(table);
+	free(z->points);
+	z->points = NULL;
+	close(z->xfile);
+	z->xfile = -1;
+}
+
+/*
+ * At the end of a deflate block: remember it as an access point if it
+ * is far enough from the last one.
+ */
+	static void
+z_record(z)
+	struct zinput *z;
+{
+	struct zpoint *p;
+	POSITION last;
+	uInt winlen;
+
+	if ((z->zs.data_type & 128) == 0 || (z->zs.data_type & 64) != 0)
+		return;
+	last = (z->npoints > 0) ? z->points[z->npoints-1].out : 0;
+	if (z->out - last < ZSPAN)
+		return;
+	if ((size_t) (z->npoints + 1) * ZWINDOW > z_budget())
+	{
+		z->record = FALSE;
+		return;
+	}
+	if (z->npoints == z->maxpoints)
+	{
+		p = (struct zpoint *) realloc(z->points,
+			(z->maxpoints + 64) * sizeof(struct zpoint));
+		if (p == NULL)
+		{
+			z->record = FALSE;
+			return;
+		}
+		z->points = p;
+		z->maxpoints += 64;
+	}
+	p = &z->points[z->npoints];
+	if ((p->window = (unsigned char *) malloc(ZWINDOW)) == NULL)
+	{
+		z->record = FALSE;
+		return;
+	}
+	winlen = ZWINDOW;
+	if (inflateGetDictionary(&z->zs, p->window, &winlen) != Z_OK)
+	{
+		free(p->window);
+		z->record = FALSE;
+		return;
+	}
+	p->out = z->out;
+	p->in = z->in - z->zs.avail_in;
+	p->bits = z->zs.data_type & 7;
+	p->winlen = winlen;
+	p->winoff = -1;
+	z->npoints++;
+}
+
+/*
+ * The last access point at or before pos, or NULL.
+ */
+	static struct zpoint *
+z_find(z, pos)
+	struct zinput *z;
+	POSITION pos;
+{
+	int lo, hi, mid;
+
+	if (z->npoints == 0 || z->points[0].out > pos)
+		return (NULL);
+	lo = 0;
+	hi = z->npoints;
+	while (hi - lo > 1)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (z->points[mid].out <= pos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return (&z->points[lo]);
+}
+#endif
+
+/*
+ * Start decompressing again, from the beginning of the file
+ * or from access point p.
+ */
+	static int
+z_start(z, p)
+	struct zinput *z;
+	struct zpoint *p;
+{
+	off_t start;
+#if HAVE_ZLIB
+	unsigned char c;
+	unsigned char *window;
+	int r;
+#endif
+
+	z_end(z);
+	start = (p == NULL) ? 0 : p->in - (p->bits ? 1 : 0);
+	if (lseek(z->file, start, SEEK_SET) == BAD_LSEEK)
+		return (-1);
+	z->in = start;
+	z->out = (p == NULL) ? 0 : p->out;
+	z->member = (p == NULL);
+	z->raw = (p != NULL);
+	z->trailer = 0;
+	z->eof = FALSE;
+#if HAVE_BZLIB
+	if (z->type == ZIN_BZIP2)
+	{
+		memset(&z->bs, 0, sizeof(z->bs));
+		if (BZ2_bzDecompressInit(&z->bs, 0, 0) != BZ_OK)
+			return (-1);
+		z->started = TRUE;
+		return (0);
+	}
+#endif
+#if HAVE_ZLIB
+	memset(&z->zs, 0, sizeof(z->zs));
+	if (inflateInit2(&z->zs, (p == NULL) ? 16 + MAX_WBITS : -MAX_WBITS) != Z_OK)
+		return (-1);
+	z->started = TRUE;
+	if (p == NULL)
+		return (0);
+	if (p->bits != 0)
+	{
+		if (read(z->file, &c, 1) != 1)
+			return (-1);
+		z->in++;
+		inflatePrime(&z->zs, p->bits, c >> (8 - p->bits));
+	}
+	if (p->winlen == 0)
+		return (0);
+	if ((window = p->window) == NULL)
+	{
+		if ((window = (unsigned char *) malloc(p->winlen)) == NULL)
+			return (-1);
+		if (pread(z->xfile, window, p->winlen, p->winoff) != p->winlen)
+		{
+			free(window);
+			return (-1);
+		}
+	}
+	r = inflateSetDictionary(&z->zs, window, p->winlen);
+	if (window != p->window)
+		free(window);
+	return ((r == Z_OK) ? 0 : -1);
+#else
+	return (-1);
+#endif
+}
+
+/*
+ * What kind of compressed file f is: ZIN_GZIP, ZIN_BZIP2 or 0.
+ */
+	public int
+ch_zipped(f)
+	int f;
+{
+	unsigned char magic[3];
+
+	if (pread(f, magic, sizeof(magic), 0) != sizeof(magic))
+		return (0);
+#if HAVE_ZLIB
+	if (magic[0] == 0x1f && magic[1] == 0x8b)
+		return (ZIN_GZIP);
+#endif
+#if HAVE_BZLIB
+	if (magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h')
+		return (ZIN_BZIP2);
+#endif
+	return (0);
+}
+
+	static void
+z_close(z)
+	struct zinput *z;
+{
+#if HAVE_ZLIB
+	int i;
+#endif
+
+	if (z == NULL)
+		return;
+	z_end(z);
+#if HAVE_ZLIB
+	for (i = 0;  i < z->npoints;  i++)
+		free(z->points[i].window);
+	free(z->points);
+	if (z->xfile >= 0)
+		close(z->xfile);
+#endif
+	free(z);
+}
+
+/*
+ * Set up the decompression of file f.
+ */
+	static struct zinput *
+z_open(f, filename)
+	int f;
+	char *filename;
+{
+	struct zinput *z;
+
+	z = (struct zinput *) calloc(1, sizeof(struct zinput));
+	if (z == NULL)
+		return (NULL);
+	z->file = f;
+	z->xfile = -1;
+	if ((z->type = ch_zipped(f)) == 0)
+	{
+		free(z);
+		return (NULL);
+	}
+#if HAVE_ZLIB
+	if (z->type == ZIN_GZIP)
+	{
+		z->record = TRUE;
+		if (filename != NULL)
+			z_readindex(z, filename);
+	}
+#endif
+	if (z_start(z, (struct zpoint *) NULL) != 0)
+	{
+		z_close(z);
+		return (NULL);
+	}
+	return (z);
+}
+
+/*
+ * Data that is not compressed after the first stream is ignored,
+ * as gzip does; anything else wrong is a read error.
+ */
+	static int
+z_garbage(z)
+	struct zinput *z;
+{
+	if (!z->member || z->out == 0)
+		return (-1);
+	z->eof = TRUE;
+	return (0);
+}
+
+/*
+ * Decompress up to len bytes at the current position.
+ * Like iread, return the number of bytes, 0 at the end of the data,
+ * -1 on error or READ_INTR if interrupted.
+ * Anything that follows the compressed data is ignored.
+ */
+	static int
+z_read(z, buf, len)
+	struct zinput *z;
+	unsigned char *buf;
+	unsigned int len;
+{
+	unsigned int avail = 0;
+	int n, r;
+
+	for (;;)
+	{
+		if (z->eof)
+			return (0);
+#if HAVE_ZLIB
+		avail = (z->type == ZIN_GZIP) ? z->zs.avail_in : 0;
+#endif
+#if HAVE_BZLIB
+		if (z->type == ZIN_BZIP2)
+			avail = z->bs.avail_in;
+#endif
+		if (avail == 0)
+		{
+			n = iread(z->file, z->inbuf, ZBUFSIZE);
+			if (n == READ_INTR || n < 0)
+				return (n);
+			if (n == 0)
+			{
+				/* A truncated file shows what it has. */
+				z->eof = TRUE;
+				return (0);
+			}
+			z->in += n;
+#if HAVE_ZLIB
+			z->zs.next_in = z->inbuf;
+			z->zs.avail_in = n;
+#endif
+#if HAVE_BZLIB
+			z->bs.next_in = (char *) z->inbuf;
+			z->bs.avail_in = n;
+#endif
+			avail = n;
+		}
+#if HAVE_BZLIB
+		if (z->type == ZIN_BZIP2)
+		{
+			if (z->member && z->bs.next_in[0] != 'B')
+			{
+				z->eof = TRUE;
+				return (0);
+			}
+			z->bs.next_out = (char *) buf;
+			z->bs.avail_out = len;
+			r = BZ2_bzDecompress(&z->bs);
+			n = len - z->bs.avail_out;
+			z->out += n;
+			if (r == BZ_STREAM_END)
+			{
+				/* Another stream may follow (pbzip2). */
+				char *next_in = z->bs.next_in;
+				avail = z->bs.avail_in;
+				BZ2_bzDecompressEnd(&z->bs);
+				memset(&z->bs, 0, sizeof(z->bs));
+				if (BZ2_bzDecompressInit(&z->bs, 0, 0) != BZ_OK)
+				{
+					z->started = FALSE;
+					return (-1);
+				}
+				z->bs.next_in = next_in;
+				z->bs.avail_in = avail;
+				z->member = TRUE;
+			} else if (r != BZ_OK)
+				return (z_garbage(z));
+			else
+				z->member = FALSE;
+			if (n > 0)
+				return (n);
+			continue;
+		}
+#endif
+#if HAVE_ZLIB
+		if (z->trailer > 0)
+		{
+			/* The CRC and length after raw deflate data. */
+			n = (avail < (unsigned int) z->trailer) ? avail : z->trailer;
+			z->zs.next_in += n;
+			z->zs.avail_in -= n;
+			if ((z->trailer -= n) == 0)
+			{
+				inflateReset2(&z->zs, 16 + MAX_WBITS);
+				z->member = TRUE;
+			}
+			continue;
+		}
+		if (z->member && z->zs.next_in[0] != 0x1f)
+		{
+			z->eof = TRUE;
+			return (0);
+		}
+		z->zs.next_out = buf;
+		z->zs.avail_out = len;
+		r = inflate(&z->zs, Z_BLOCK);
+		n = len - z->zs.avail_out;
+		z->out += n;
+		if (r == Z_STREAM_END)
+		{
+			if (z->raw)
+			{
+				z->raw = FALSE;
+				z->trailer = 8;
+			} else
+			{
+				/* Another member may follow. */
+				inflateReset(&z->zs);
+				z->member = TRUE;
+			}
+		} else if (r != Z_OK && r != Z_BUF_ERROR)
+			return (z_garbage(z));
+		else
+		{
+			z->member = FALSE;
+			if (z->record)
+				z_record(z);
+		}
+		if (n > 0)
+			return (n);
+#endif
+	}
+}
+
+/*
+ * Go to uncompressed position pos: forward by decompressing, back by
+ * starting again from an access point (or the beginning of the file).
+ * Return 0, -1 on error or READ_INTR if interrupted.
+ */
+	static int
+z_seek(z, pos)
+	struct zinput *z;
+	POSITION pos;
+{
+	struct zpoint *p = NULL;
+	unsigned int len;
+	int n;
+
+#if HAVE_ZLIB
+	p = z_find(z, pos);
+#endif
+	if (pos < z->out || (p != NULL && p->out > z->out))
+	{
+		if (z_start(z, p) != 0)
+			return (-1);
+	}
+	while (z->out < pos)
+	{
+		len = (pos - z->out < ZBUFSIZE) ? (unsigned int) (pos - z->out) : ZBUFSIZE;
+		n = z_read(z, z->skipbuf, len);
+		if (n == READ_INTR)
+			return (READ_INTR);
+		if (n <= 0)
+			return (-1);
+	}
+	return (0);
+}
+#endif
+
 /*
  *
  */
@@ -808,6 +1888,8 @@ ch_delbufs()
 	{
 		bn = ch_bufhead;
 		BUF_RM(bn);
+		ch_unmap(bufnode_buf(bn));
+		free(bufnode_buf(bn)->mem);
 		free(bufnode_buf(bn));
 	}
 	ch_nbufs = 0;
@@ -880,6 +1962,28 @@ ch_init(f, flags)
 		 */
 		if ((flags & CH_CANSEEK) && !seekable(f))
 			ch_flags &= ~CH_CANSEEK;
+#if HAVE_MMAP
+		/*
+		 * Map a regular file if asked to.
+		 */
+		if (use_mmap && (ch_flags & CH_CANSEEK) &&
+		    !(ch_flags & (CH_POPENED|CH_HELPFILE|CH_ZIP)))
+		{
+			struct stat st;
+
+			if (fstat(f, &st) == 0 && S_ISREG(st.st_mode))
+				ch_flags |= CH_MMAP;
+		}
+#endif
+#if HAVE_PTHREAD
+		/*
+		 * Standard input we can't seek on is read ahead.
+		 * Not a pipe from LESSOPEN: pclose() closes it under us.
+		 */
+		if ((ch_flags & CH_KEEPOPEN) &&
+		    !(ch_flags & (CH_CANSEEK|CH_POPENED|CH_HELPFILE)))
+			thisfile->ra = ra_start(f);
+#endif
 		set_filestate(curr_ifile, (void *) thisfile);
 	}
 	if (thisfile->file == -1)
@@ -906,6 +2010,10 @@ ch_close()
 		ch_delbufs();
 	} else
 		keepstate = TRUE;
+#if HAVE_ZLIB || HAVE_BZLIB
+	z_close(thisfile->z);
+	thisfile->z = NULL;
+#endif
 	if (!(ch_flags & CH_KEEPOPEN))
 	{
 		/*
@@ -941,6 +2049,39 @@ ch_getflags()
 	return (ch_flags);
 }
 
+/*
+ * Return a descriptor of its own for the current file,
+ * for reading it apart from the buffers, or -1 if the
+ * file cannot be read that way.
+ */
+	public int
+ch_dupfile()
+{
+	if (thisfile == NULL || ch_file < 0 || !(ch_flags & CH_CANSEEK) ||
+	    (ch_flags & (CH_POPENED|CH_HELPFILE|CH_ZIP)))
+		return (-1);
+	return (dup(ch_file));
+}
+
+/*
+ * Stop all reading ahead, before quitting.
+ */
+	public void
+ch_quit()
+{
+#if HAVE_PTHREAD
+	struct readahead *ra;
+
+	while ((ra = ra_list) != NULL)
+	{
+		ra_list = ra->next;
+		ra_stop(ra);
+	}
+	if (thisfile != NULL)
+		thisfile->ra = NULL;
+#endif
+}
+
 #if 0
 	public void
 ch_dump(struct filestate *fs)
@@ -653,6 +653,8 @@ clear_buffers()
 		return;
 	ch_flush();
 	clr_linenum();
+	clr_lnindex();
+	clr_sworker();
 #if HILITE_SEARCH
 	clr_hilite();
 #endif
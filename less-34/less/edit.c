@@ -21,6 +21,7 @@ extern int cbufs;
 extern char *every_first_cmd;
 extern int any_display;
 extern int force_open;
+extern int no_decompress;
 extern int is_tty;
 extern int sigs;
 extern IFILE curr_ifile;
@@ -363,7 +364,9 @@ edit_ifile(ifile)
 	} else 
 	{
 		chflags |= CH_CANSEEK;
-		if (!force_open && !opened(ifile) && bin_file(f))
+		if (!no_decompress && ch_zipped(f))
+			chflags |= CH_ZIP;
+		else if (!force_open && !opened(ifile) && bin_file(f))
 		{
 			/*
 			 * Looks like a binary file.  
@@ -421,6 +424,7 @@ edit_ifile(ifile)
 			}
 		}
 #endif
+		chk_lnindex();
 		if (every_first_cmd != NULL)
 		{
 			ungetcc(CHAR_END_COMMAND);
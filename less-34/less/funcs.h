@@ -45,12 +45,16 @@
 	public int ch_forw_get (void);
 	public int ch_back_get (void);
 	public void ch_setbufspace (int bufspace);
+	public void ch_setblocksize (int k);
 	public void ch_flush (void);
 	public int seekable (int f);
 	public void ch_set_eof (void);
 	public void ch_init (int f, int flags);
 	public void ch_close (void);
 	public int ch_getflags (void);
+	public int ch_dupfile (void);
+	public int ch_zipped (int f);
+	public void ch_quit (void);
 	public void ch_dump (void);
 	public void init_charset (void);
 	public int binary_char (LWCHAR c);
@@ -156,6 +160,8 @@
 	public int held_ifile (IFILE ifile);
 	public void * get_filestate (IFILE ifile);
 	public void set_filestate (IFILE ifile, void *filestate);
+	public void * get_lnindex (IFILE ifile);
+	public void set_lnindex (IFILE ifile, void *lnindex);
 	public void if_dump (void);
 	public POSITION forw_line (POSITION curr_pos);
 	public POSITION back_line (POSITION curr_pos);
@@ -187,6 +193,9 @@
 	public void add_lnum (LINENUM linenum, POSITION pos);
 	public LINENUM find_linenum (POSITION pos);
 	public POSITION find_pos (LINENUM linenum);
+	public void free_lnindex (void *lnindex);
+	public void clr_lnindex (void);
+	public void chk_lnindex (void);
 	public LINENUM currline (int where);
 	public void lsystem (char *cmd, char *donemsg);
 	public int pipe_mark (int c, char *cmd);
@@ -210,6 +219,7 @@
 	public void opt_p (int type, char *s);
 	public void opt__P (int type, char *s);
 	public void opt_b (int type, char *s);
+	public void opt_blocksize (int type, char *s);
 	public void opt_i (int type, char *s);
 	public void opt__V (int type, char *s);
 	public void opt_D (int type, char *s);
@@ -277,6 +287,7 @@
 	public POSITION prev_unfiltered (POSITION pos);
 	public int is_hilited (POSITION pos, POSITION epos, int nohide, int *p_matches);
 	public void chg_hilite (void);
+	public void clr_sworker (void);
 	public void chg_caseless (void);
 	public int search (int search_type, char *pattern, int n);
 	public void prep_hilite (POSITION spos, POSITION epos, int maxlines);
@@ -297,6 +308,7 @@
 	public void open_getchr (void);
 	public void close_getchr (void);
 	public int getchr (void);
+	public int tty_typeahead (void);
  	public void opt_dashp (int type, char *s);
  	// iOS:
  	public void clean_cmds(void); 
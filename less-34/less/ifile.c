@@ -29,6 +29,7 @@ struct ifile {
 	struct ifile *h_prev;
 	char *h_filename;		/* Name of the file */
 	void *h_filestate;		/* File state (used in ch.c) */
+	void *h_lnindex;		/* Line number index (used in linenum.c) */
 	int h_index;			/* Index within command line list */
 	int h_hold;			/* Hold count */
 	char h_opened;			/* Has this ifile been opened? */
@@ -45,7 +46,7 @@ struct ifile {
 /*
  * Anchor for linked list.
  */
-static struct ifile anchor = { &anchor, &anchor, NULL, NULL, 0, 0, '\0',
+static struct ifile anchor = { &anchor, &anchor, NULL, NULL, NULL, 0, 0, '\0',
 				{ NULL_POSITION, 0 } };
 static int ifiles = 0;
 
@@ -119,6 +120,7 @@ new_ifile(filename, prev)
 	p->h_opened = 0;
 	p->h_hold = 0;
 	p->h_filestate = NULL;
+	p->h_lnindex = NULL;
 	link_ifile(p, prev);
 	return (p);
 }
@@ -143,6 +145,7 @@ del_ifile(h)
 		curr_ifile = getoff_ifile(curr_ifile);
 	p = int_ifile(h);
 	unlink_ifile(p);
+	free_lnindex(p->h_lnindex);
 	free(p->h_filename);
 	free(p);
 }
@@ -334,6 +337,21 @@ set_filestate(ifile, filestate)
 	int_ifile(ifile)->h_filestate = filestate;
 }
 
+	public void *
+get_lnindex(ifile)
+	IFILE ifile;
+{
+	return (int_ifile(ifile)->h_lnindex);
+}
+
+	public void
+set_lnindex(ifile, lnindex)
+	IFILE ifile;
+	void *lnindex;
+{
+	int_ifile(ifile)->h_lnindex = lnindex;
+}
+
 #if 0
 	public void
 if_dump()
@@ -509,6 +509,8 @@ struct wchar_range_table
 #define	CH_POPENED	004
 #define	CH_HELPFILE	010
 #define	CH_NODATA  	020	/* Special case for zero length files */
+#define	CH_MMAP		040	/* Blocks are mapped rather than read */
+#define	CH_ZIP		0100	/* Compressed: read through a decompressor */
 
 
 #define	ch_zero()	((POSITION)0)
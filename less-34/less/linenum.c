@@ -30,9 +30,21 @@
  * position in the file.  As a side effect, it calls add_lnum
  * to cache the line number.  Therefore currline is occasionally
  * called to make sure we cache line numbers often enough.
+ *
+ * For a regular file there is also an index, built by a thread of
+ * its own which reads the file apart from the buffers and notes where
+ * every LNI_STEP'th line starts.  When nothing in the cache is near,
+ * we start from the index instead, waiting for the thread to get
+ * there if need be.  The index is kept with the ifile, so it is not
+ * lost when we go to another file and come back.
  */
 
 #include "less.h"
+#if HAVE_PTHREAD
+#include <sys/stat.h>
+#include <errno.h>
+#include <pthread.h>
+#endif
 
 /*
  * Structure to keep track of a line number and the associated file position.
@@ -59,6 +71,27 @@ struct linenum_info
 
 #define	LONGTIME	(2)		/* In seconds */
 
+#if HAVE_PTHREAD
+#define	LNI_STEP	256		/* Lines between entries of the index */
+#define	LNI_READ	65536		/* Bytes the indexer reads at a time */
+#define	LNI_NEAR	65536		/* Bytes we would rather scan than wait */
+
+struct lnindex
+{
+	pthread_mutex_t lock;
+	int file;			/* Descriptor the indexer reads */
+	dev_t dev;			/* The file it is the index of */
+	ino_t ino;
+	POSITION *pos;			/* pos[i] is where line i*LNI_STEP+1 starts */
+	int npos;			/* Entries in pos */
+	int size;			/* Entries pos has room for */
+	POSITION scanned;		/* How far the indexer has got */
+	LINENUM lines;			/* Newlines it has found so far */
+	int done;			/* The indexer has finished */
+	int stop;			/* Nobody wants the index any more */
+};
+#endif
+
 static struct linenum_info anchor;	/* Anchor of the list */
 static struct linenum_info *freelist;	/* Anchor of the unused entries */
 static struct linenum_info pool[NPOOL];	/* The pool itself */
@@ -68,6 +101,11 @@ extern int linenums;
 extern int sigs;
 extern int sc_height;
 extern int screen_trashed;
+extern IFILE curr_ifile;
+#if HAVE_STAT_INO
+extern dev_t curr_dev;
+extern ino_t curr_ino;
+#endif
 
 /*
  * Initialize the line number structures.
@@ -257,6 +295,320 @@ abort_long()
 	error("Line numbers turned off", NULL_PARG);
 }
 
+#if HAVE_PTHREAD
+/*
+ * Free an index once both the indexer and its ifile are done with it.
+ */
+	static void
+lni_free(ix)
+	struct lnindex *ix;
+{
+	pthread_mutex_destroy(&ix->lock);
+	free(ix->pos);
+	free(ix);
+}
+
+/*
+ * The indexer: count the newlines of the whole file,
+ * noting where every LNI_STEP'th line starts.
+ */
+	static void *
+lni_thread(arg)
+	void *arg;
+{
+	struct lnindex *ix = (struct lnindex *) arg;
+	char *buf, *p, *end;
+	POSITION *newpos;
+	POSITION pos;
+	int n;
+	int dofree;
+
+	buf = (char *) malloc(LNI_READ);
+	pthread_mutex_lock(&ix->lock);
+	while (buf != NULL && !ix->stop)
+	{
+		pos = ix->scanned;
+		pthread_mutex_unlock(&ix->lock);
+		while ((n = pread(ix->file, buf, LNI_READ, (off_t)pos)) < 0 &&
+			errno == EINTR)
+			continue;
+		pthread_mutex_lock(&ix->lock);
+		if (n <= 0)
+			break;
+		end = buf + n;
+		for (p = buf;  (p = memchr(p, '\n', end - p)) != NULL;  )
+		{
+			p++;
+			if (++ix->lines % LNI_STEP != 0)
+				continue;
+			if (ix->npos >= ix->size)
+			{
+				newpos = (POSITION *) realloc(ix->pos,
+					2 * ix->size * sizeof(POSITION));
+				if (newpos == NULL)
+					/*
+					 * What we have so far is still good.
+					 */
+					goto out;
+				ix->pos = newpos;
+				ix->size *= 2;
+			}
+			ix->pos[ix->npos++] = pos + (p - buf);
+		}
+		ix->scanned = pos + n;
+	}
+    out:
+	ix->done = TRUE;
+	close(ix->file);
+	ix->file = -1;
+	dofree = ix->stop;
+	pthread_mutex_unlock(&ix->lock);
+	free(buf);
+	if (dofree)
+		lni_free(ix);
+	return (NULL);
+}
+
+/*
+ * Start indexing the current file.
+ * If it is not a regular file we can read on our own,
+ * the index is left with just line 1 in it.
+ */
+	static struct lnindex *
+lni_start()
+{
+	struct lnindex *ix;
+	struct stat st;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int f;
+
+	ix = (struct lnindex *) calloc(1, sizeof(struct lnindex));
+	if (ix == NULL)
+		return (NULL);
+	pthread_mutex_init(&ix->lock, NULL);
+	ix->file = -1;
+	ix->done = TRUE;
+	ix->pos = (POSITION *) malloc(64 * sizeof(POSITION));
+	if (ix->pos == NULL)
+		return (ix);
+	ix->size = 64;
+	ix->pos[ix->npos++] = ch_zero();
+
+	if ((f = ch_dupfile()) < 0)
+		return (ix);
+	if (fstat(f, &st) < 0 || !S_ISREG(st.st_mode))
+	{
+		close(f);
+		return (ix);
+	}
+	ix->dev = st.st_dev;
+	ix->ino = st.st_ino;
+	ix->file = f;
+	ix->done = FALSE;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, lni_thread, (void *) ix) != 0)
+	{
+		close(f);
+		ix->file = -1;
+		ix->done = TRUE;
+	}
+	pthread_attr_destroy(&attr);
+	return (ix);
+}
+
+/*
+ * Return the index of the current file, starting it if need be.
+ */
+	static struct lnindex *
+curr_lnindex()
+{
+	struct lnindex *ix;
+
+	if (curr_ifile == NULL_IFILE)
+		return (NULL);
+	ix = (struct lnindex *) get_lnindex(curr_ifile);
+	if (ix == NULL)
+	{
+		ix = lni_start();
+		set_lnindex(curr_ifile, (void *) ix);
+	}
+	return (ix);
+}
+
+/*
+ * Wait for the indexer to get past a position (or, if pos is
+ * NULL_POSITION, to a line number), or to finish.
+ * Called, and returns, with ix->lock held.
+ * Return -1 if interrupted, else 0.
+ */
+	static int
+lni_wait(ix, pos, linenum)
+	struct lnindex *ix;
+	POSITION pos;
+	LINENUM linenum;
+{
+	while (!ix->done && ((pos != NULL_POSITION) ? (ix->scanned < pos) :
+		(ix->npos <= (linenum - 1) / LNI_STEP)))
+	{
+		pthread_mutex_unlock(&ix->lock);
+		if (ABORT_SIGS())
+		{
+			pthread_mutex_lock(&ix->lock);
+			return (-1);
+		}
+		longish();
+		usleep(10000);
+		pthread_mutex_lock(&ix->lock);
+	}
+	return (0);
+}
+
+/*
+ * Given a line known to start at *posp, at or before pos,
+ * move it to the latest line in the index at or before pos.
+ * Return -1 if interrupted, else 0.
+ */
+	static int
+lni_pos(pos, linep, posp)
+	POSITION pos;
+	LINENUM *linep;
+	POSITION *posp;
+{
+	struct lnindex *ix;
+	int lo, hi, mid;
+	int r;
+
+	if ((ix = curr_lnindex()) == NULL)
+		return (0);
+	pthread_mutex_lock(&ix->lock);
+	r = lni_wait(ix, pos, (LINENUM)0);
+	if (r == 0 && ix->npos > 0)
+	{
+		/*
+		 * Find the last entry at or before pos.
+		 */
+		lo = 0;
+		hi = ix->npos;
+		while (hi - lo > 1)
+		{
+			mid = (lo + hi) / 2;
+			if (ix->pos[mid] <= pos)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		if (ix->pos[lo] > *posp)
+		{
+			*posp = ix->pos[lo];
+			*linep = (LINENUM) lo * LNI_STEP + 1;
+		}
+	}
+	pthread_mutex_unlock(&ix->lock);
+	return (r);
+}
+
+/*
+ * Given a line *linep, at or before linenum, known to start at *posp,
+ * move it to the latest line in the index at or before linenum.
+ * Return -1 if interrupted, else 0.
+ */
+	static int
+lni_line(linenum, linep, posp)
+	LINENUM linenum;
+	LINENUM *linep;
+	POSITION *posp;
+{
+	struct lnindex *ix;
+	LINENUM i;
+	int r;
+
+	if ((ix = curr_lnindex()) == NULL)
+		return (0);
+	pthread_mutex_lock(&ix->lock);
+	r = lni_wait(ix, NULL_POSITION, linenum);
+	if (r == 0 && ix->npos > 0)
+	{
+		i = (linenum - 1) / LNI_STEP;
+		if (i >= ix->npos)
+			i = ix->npos - 1;
+		if (i * LNI_STEP + 1 > *linep)
+		{
+			*linep = i * LNI_STEP + 1;
+			*posp = ix->pos[i];
+		}
+	}
+	pthread_mutex_unlock(&ix->lock);
+	return (r);
+}
+#endif
+
+/*
+ * Let go of the index of an ifile which is being deleted.
+ */
+	public void
+free_lnindex(lnindex)
+	void *lnindex;
+{
+#if HAVE_PTHREAD
+	struct lnindex *ix = (struct lnindex *) lnindex;
+	int dofree;
+
+	if (ix == NULL)
+		return;
+	pthread_mutex_lock(&ix->lock);
+	ix->stop = TRUE;
+	dofree = ix->done;
+	pthread_mutex_unlock(&ix->lock);
+	if (dofree)
+		lni_free(ix);
+#endif
+}
+
+/*
+ * Throw away the index of the current file; it is rebuilt when next needed.
+ */
+	public void
+clr_lnindex()
+{
+	if (curr_ifile == NULL_IFILE)
+		return;
+	free_lnindex(get_lnindex(curr_ifile));
+	set_lnindex(curr_ifile, (void *) NULL);
+}
+
+/*
+ * The current file has just been opened.
+ * Throw away its index if the file is not the one it was built from,
+ * or is shorter than the part of it already indexed.
+ */
+	public void
+chk_lnindex()
+{
+#if HAVE_PTHREAD
+	struct lnindex *ix;
+	POSITION len;
+	int keep;
+
+	if (curr_ifile == NULL_IFILE)
+		return;
+	ix = (struct lnindex *) get_lnindex(curr_ifile);
+	if (ix == NULL)
+		return;
+	len = ch_length();
+	pthread_mutex_lock(&ix->lock);
+	keep = (ix->npos > 1 && len != NULL_POSITION && len >= ix->scanned);
+#if HAVE_STAT_INO
+	if (ix->ino != curr_ino || ix->dev != curr_dev)
+		keep = FALSE;
+#endif
+	pthread_mutex_unlock(&ix->lock);
+	if (!keep)
+		clr_lnindex();
+#endif
+}
+
 /*
  * Find the line number associated with a given position.
  * Return 0 if we can't figure it out.
@@ -266,7 +618,7 @@ find_linenum(pos)
 	POSITION pos;
 {
 	register struct linenum_info *p;
-	register LINENUM linenum;
+	LINENUM linenum;
 	POSITION cpos;
 
 	if (!linenums)
@@ -308,16 +660,31 @@ find_linenum(pos)
 #if HAVE_TIME
 	startime = get_time();
 #endif
-	if (p == &anchor || pos - p->prev->pos < p->pos - pos)
+	loopcount = 0;
+	linenum = p->prev->line;
+	cpos = p->prev->pos;
+#if HAVE_PTHREAD
+	if (pos - cpos > LNI_NEAR && (p == &anchor || p->pos - pos > LNI_NEAR))
+	{
+		/*
+		 * Nothing in the cache is near: see what the index knows.
+		 */
+		if (lni_pos(pos, &linenum, &cpos) < 0)
+		{
+			abort_long();
+			return (0);
+		}
+	}
+#endif
+	if (p == &anchor || pos - cpos < p->pos - pos)
 	{
 		/*
 		 * Go forward.
 		 */
-		p = p->prev;
-		if (ch_seek(p->pos))
+		if (ch_seek(cpos))
 			return (0);
 		loopcount = 0;
-		for (linenum = p->line, cpos = p->pos;  cpos < pos;  linenum++)
+		for (;  cpos < pos;  linenum++)
 		{
 			/*
 			 * Allow a signal to abort this loop.
@@ -399,15 +766,31 @@ find_pos(linenum)
 		/* Found it exactly. */
 		return (p->pos);
 
-	if (p == &anchor || linenum - p->prev->line < p->line - linenum)
+	clinenum = p->prev->line;
+	cpos = p->prev->pos;
+#if HAVE_PTHREAD
+	if (linenum - clinenum > LNI_STEP &&
+	    (p == &anchor || p->line - linenum > LNI_STEP))
+	{
+		/*
+		 * Nothing in the cache is near: see what the index knows.
+		 */
+#if HAVE_TIME
+		startime = get_time();
+#endif
+		loopcount = 0;
+		if (lni_line(linenum, &clinenum, &cpos) < 0)
+			return (NULL_POSITION);
+	}
+#endif
+	if (p == &anchor || linenum - clinenum < p->line - linenum)
 	{
 		/*
 		 * Go forward.
 		 */
-		p = p->prev;
-		if (ch_seek(p->pos))
+		if (ch_seek(cpos))
 			return (NULL_POSITION);
-		for (clinenum = p->line, cpos = p->pos;  clinenum < linenum;  clinenum++)
+		for (;  clinenum < linenum;  clinenum++)
 		{
 			/*
 			 * Allow a signal to abort this loop.
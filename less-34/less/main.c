@@ -122,6 +122,9 @@ extern int quit_on_intr;    /* Quit on interrupt */
 extern int follow_mode;        /* F cmd Follows file desc or file name? */
 extern int oldbot;        /* Old bottom of screen behavior {{REMOVE}} */
 extern int opt_use_backslash;    /* Use backslash escaping in option parsing */
+extern int blocksize;        /* Size of the blocks the input is read in (K) */
+extern int use_mmap;        /* Map regular files rather than read them */
+extern int no_decompress;    /* Show compressed files as they are */
 #if HILITE_SEARCH
 extern int hilite_search;    /* Highlight matched search patterns? */
 #endif
@@ -219,6 +222,9 @@ less_main(argc, argv)
     follow_mode = 0;        /* F cmd Follows file desc or file name? */
     oldbot = 0;        /* Old bottom of screen behavior {{REMOVE}} */
     opt_use_backslash = 0;    /* Use backslash escaping in option parsing */
+    blocksize = 0;        /* Size of the blocks the input is read in (K) */
+    use_mmap = 0;        /* Map regular files rather than read them */
+    no_decompress = 0;    /* Show compressed files as they are */
 #if HILITE_SEARCH
     hilite_search = 0;    /* Highlight matched search patterns? */
 #endif
@@ -608,6 +614,8 @@ quit(status)
 		save_status = status;
 	quitting = 1;
     // iOS:
+    ch_quit();
+    clr_sworker();
     while (curr_ifile != NULL_IFILE)
         del_ifile(curr_ifile);
     clean_cmds();
@@ -29,6 +29,7 @@
 
 extern int nbufs;
 extern int bufspace;
+extern int blocksize;
 extern int pr_type;
 extern int plusoption;
 extern int swindow;
@@ -454,6 +455,33 @@ opt_b(type, s)
 	}
 }
 
+/*
+ * Handler for the --block-size option.
+ */
+	/*ARGSUSED*/
+	public void
+opt_blocksize(type, s)
+	int type;
+	char *s;
+{
+	switch (type)
+	{
+	case INIT:
+		/*
+		 * Keep the size sane: a block is read in one go
+		 * and must fit in a buffer of its own.
+		 */
+		if (blocksize < 1)
+			blocksize = 1;
+		else if (blocksize > 1024)
+			blocksize = 1024;
+		ch_setblocksize(blocksize);
+		break;
+	case QUERY:
+		break;
+	}
+}
+
 /*
  * Handler for the -i option.
  */
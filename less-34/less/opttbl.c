@@ -54,6 +54,9 @@ public int quit_on_intr;	/* Quit on interrupt */
 public int follow_mode;		/* F cmd Follows file desc or file name? */
 public int oldbot;		/* Old bottom of screen behavior {{REMOVE}} */
 public int opt_use_backslash;	/* Use backslash escaping in option parsing */
+public int blocksize;		/* Size of the blocks the input is read in (K) */
+public int use_mmap;		/* Map regular files rather than read them */
+public int no_decompress;	/* Show compressed files as they are */
 #if HILITE_SEARCH
 public int hilite_search;	/* Highlight matched search patterns? */
 #endif
@@ -118,6 +121,9 @@ static struct optname keypad_optname = { "no-keypad",            NULL };
 static struct optname oldbot_optname = { "old-bot",              NULL };
 static struct optname follow_optname = { "follow-name",          NULL };
 static struct optname use_backslash_optname = { "use-backslash", NULL };
+static struct optname blocksize_optname = { "block-size",        NULL };
+static struct optname mmap_optname   = { "mmap",                 NULL };
+static struct optname nodecomp_optname = { "no-decompress",     NULL };
 static struct optname unix2003_n_optname = { "unix2003-n",       NULL };
 static struct optname unix2003_p_optname = { "unix2003-p",       NULL };
 
@@ -459,6 +465,30 @@ static struct loption option[] =
 			NULL
 		}
 	},
+	{ OLETTER_NONE, &blocksize_optname,
+		NUMBER|NO_TOGGLE|INIT_HANDLER, 8, &blocksize, opt_blocksize,
+		{
+			"Block size (K): ",
+			"Block size is %dK",
+			NULL
+		}
+	},
+	{ OLETTER_NONE, &mmap_optname,
+		BOOL|NO_TOGGLE, OPT_OFF, &use_mmap, NULL,
+		{
+			"Read regular files",
+			"Map regular files into memory",
+			NULL
+		}
+	},
+	{ OLETTER_NONE, &nodecomp_optname,
+		BOOL|NO_TOGGLE, OPT_OFF, &no_decompress, NULL,
+		{
+			"Decompress gzip and bzip2 files",
+			"Show compressed files as they are",
+			NULL
+		}
+	},
 	/* The following entries are added to support UNIX 2003 
 	   compatibility. Each is used because the original option
 	   was already defined in "less".
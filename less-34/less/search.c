@@ -16,6 +16,11 @@
 #include "pattern.h"
 #include "position.h"
 #include "charset.h"
+#if HAVE_PTHREAD
+#include <sys/stat.h>
+#include <errno.h>
+#include <pthread.h>
+#endif
 
 #define	MINPOS(a,b)	(((a) < (b)) ? (a) : (b))
 #define	MAXPOS(a,b)	(((a) > (b)) ? (a) : (b))
@@ -40,6 +45,11 @@ extern int hilite_search;
 extern int size_linebuf;
 extern int squished;
 extern int can_goto_line;
+extern IFILE curr_ifile;
+#if HAVE_STAT_INO
+extern dev_t curr_dev;
+extern ino_t curr_ino;
+#endif
 static int hide_hilite;
 static POSITION prep_startpos;
 static POSITION prep_endpos;
@@ -1145,6 +1155,642 @@ search_pos(search_type)
 	return (pos);
 }
 
+#if HAVE_PTHREAD
+/*
+ * The search worker is a thread which reads a regular file on its own,
+ * a large block at a time, and notes where each line matching the
+ * current search pattern starts.  It starts where a search does, goes
+ * on to the end of the file, then from the beginning of the file back
+ * to where it started.  A search asks it first: if it has been over
+ * the part of the file concerned, we can go straight to the match,
+ * and repeated searches (n and N) do not look at the lines again.
+ *
+ * The worker has its own copy of the compiled pattern, and its own
+ * descriptor of the file (reading it with pread), so it does not
+ * touch anything the rest of less uses.
+ */
+#define	SW_READ		(256*1024)	/* Bytes read at a time */
+
+struct swmatches
+{
+	POSITION *pos;			/* Line starts, in increasing order */
+	int n;
+	int size;
+};
+
+struct sworker
+{
+	pthread_mutex_t lock;
+	int file;			/* Descriptor the worker reads */
+	IFILE ifile;			/* The file it is searching */
+#if HAVE_STAT_INO
+	dev_t dev;
+	ino_t ino;
+#endif
+	char *text;			/* What it is looking for */
+	DEFINE_PATTERN(compiled);
+	int search_type;		/* SRCH_NO_MATCH and SRCH_NO_REGEX */
+	int cvt_ops;
+	int caseless;
+	int literal;			/* text has no regex metacharacters */
+	POSITION start;			/* Where it started */
+	POSITION fwd;			/* It has been over [start,fwd) */
+	POSITION wrap;			/* and [0,wrap) */
+	int eof;			/* fwd is the end of the file */
+	struct swmatches fm;		/* Matches in [start,fwd) */
+	struct swmatches wm;		/* Matches in [0,wrap) */
+	char *cline;			/* Lines converted for matching */
+	int cline_size;
+	int done;			/* The worker has finished */
+	int stop;			/* Nobody wants it any more */
+};
+
+static struct sworker *sworker;
+
+/* What sw_find found */
+#define	SW_MATCH	0		/* A match, at *pnpos */
+#define	SW_NONE		1		/* No match till the end of the file */
+#define	SW_UNKNOWN	2		/* No match before *pnpos; no more known */
+#define	SW_INTR		3		/* Interrupted while waiting */
+
+/*
+ * Free a search worker once both it and the searches are done with it.
+ */
+	static void
+sw_free(sw)
+	struct sworker *sw;
+{
+	pthread_mutex_destroy(&sw->lock);
+#if !NO_REGEX
+	uncompile_pattern(&sw->compiled);
+#endif
+	free(sw->text);
+	free(sw->cline);
+	free(sw->fm.pos);
+	free(sw->wm.pos);
+	free(sw);
+}
+
+/*
+ * Could the conversions done before matching change a line
+ * in a way that matters to a literal pattern?
+ */
+	static int
+sw_special(p, len, cvt_ops)
+	register unsigned char *p;
+	int len;
+	int cvt_ops;
+{
+	register unsigned char *end = p + len;
+
+	for (;  p < end;  p++)
+	{
+		if (*p == '\b' && (cvt_ops & CVT_BS))
+			return (TRUE);
+		if ((*p == ESC || *p == CSI) && (cvt_ops & CVT_ANSI))
+			return (TRUE);
+		if (*p >= 0x80 && utf_mode)
+			return (TRUE);
+	}
+	return (FALSE);
+}
+
+/*
+ * Is a literal string in a line?
+ */
+	static int
+sw_literal(pattern, plen, line, len)
+	char *pattern;
+	int plen;
+	char *line;
+	int len;
+{
+	char *p;
+	char *end = line + len - plen;
+
+	for (p = line;  p <= end;  p++)
+	{
+		p = (char *) memchr(p, pattern[0], end - p + 1);
+		if (p == NULL)
+			break;
+		if (memcmp(p, pattern, plen) == 0)
+			return (TRUE);
+	}
+	return (FALSE);
+}
+
+/*
+ * Look for matching lines in some whole lines read from the file,
+ * starting at position base.
+ * Return 0, or -1 if we ran out of memory.
+ */
+	static int
+sw_scan(sw, buf, len, base, m)
+	struct sworker *sw;
+	char *buf;
+	int len;
+	POSITION base;
+	struct swmatches *m;
+{
+	char *p, *nl, *end;
+	char *sp, *ep;
+	POSITION *newpos;
+	int plen;
+	int line_len;
+	int matched;
+
+	plen = (int) strlen(sw->text);
+	end = buf + len;
+	for (p = buf;  p < end;  p = nl + 1)
+	{
+		nl = (char *) memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		line_len = (int) (nl - p);
+		if (sw->literal && !sw_special((unsigned char *) p, line_len, sw->cvt_ops))
+		{
+			matched = sw_literal(sw->text, plen, p, line_len);
+		} else
+		{
+			if (cvt_length(line_len, sw->cvt_ops) > sw->cline_size)
+			{
+				free(sw->cline);
+				sw->cline_size = cvt_length(line_len, sw->cvt_ops);
+				sw->cline = (char *) malloc(sw->cline_size);
+				if (sw->cline == NULL)
+				{
+					sw->cline_size = 0;
+					return (-1);
+				}
+			}
+			cvt_text(sw->cline, p, (int *)NULL, &line_len, sw->cvt_ops);
+			matched = match_pattern(info_compiled(sw), sw->text,
+				sw->cline, line_len, &sp, &ep, 0, sw->search_type);
+		}
+		if (matched)
+		{
+			if (m->n >= m->size)
+			{
+				newpos = (POSITION *) realloc(m->pos,
+					(m->size + 1024) * 2 * sizeof(POSITION));
+				if (newpos == NULL)
+					return (-1);
+				m->pos = newpos;
+				m->size = (m->size + 1024) * 2;
+			}
+			m->pos[m->n++] = base + (p - buf);
+		}
+	}
+	return (0);
+}
+
+/*
+ * The search worker.
+ */
+	static void *
+sw_thread(arg)
+	void *arg;
+{
+	struct sworker *sw = (struct sworker *) arg;
+	struct swmatches found;		/* Matches in the lines just read */
+	struct swmatches *m;
+	POSITION *newpos;
+	char *buf, *nbuf;
+	int size = SW_READ;
+	int have = 0;
+	int final;
+	int len, end, n;
+	int wrapping = FALSE;
+	int stop = FALSE;
+	int dofree;
+	POSITION pos;
+	POSITION limit;
+
+	found.pos = NULL;
+	found.n = found.size = 0;
+	pos = sw->start;
+	buf = (char *) malloc(size);
+	while (buf != NULL && !stop)
+	{
+		if (have == size)
+		{
+			/*
+			 * A very long line: make room for all of it.
+			 */
+			nbuf = (char *) realloc(buf, size * 2);
+			if (nbuf == NULL)
+				break;
+			buf = nbuf;
+			size *= 2;
+		}
+		n = size - have;
+		if (wrapping)
+		{
+			/*
+			 * Read only up to where we started.
+			 */
+			limit = sw->start - (pos + have);
+			if (limit < n)
+				n = (int) limit;
+		}
+		if (n > 0)
+		{
+			while ((n = pread(sw->file, buf + have, n,
+				(off_t)(pos + have))) < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				break;
+		}
+		/*
+		 * Look at the lines seen whole; the last one is whole
+		 * only at the end of the file (or of the wrapped part).
+		 */
+		final = (n == 0);
+		len = have + n;
+		for (end = len;  !final && end > 0 && buf[end-1] != '\n';  end--)
+			continue;
+		if (end == 0 && !final)
+		{
+			have = len;
+			continue;
+		}
+		found.n = 0;
+		if (sw_scan(sw, buf, end, pos, &found) < 0)
+			break;
+
+		m = (wrapping) ? &sw->wm : &sw->fm;
+		pthread_mutex_lock(&sw->lock);
+		if (m->n + found.n > m->size)
+		{
+			newpos = (POSITION *) realloc(m->pos,
+				(m->size + found.n) * 2 * sizeof(POSITION));
+			if (newpos == NULL)
+			{
+				pthread_mutex_unlock(&sw->lock);
+				break;
+			}
+			m->pos = newpos;
+			m->size = (m->size + found.n) * 2;
+		}
+		if (found.n > 0)
+			memcpy(m->pos + m->n, found.pos, found.n * sizeof(POSITION));
+		m->n += found.n;
+		if (wrapping)
+			sw->wrap = pos + end;
+		else
+		{
+			sw->fwd = pos + end;
+			if (final)
+				sw->eof = TRUE;
+		}
+		stop = sw->stop;
+		pthread_mutex_unlock(&sw->lock);
+
+		pos += end;
+		have = len - end;
+		memmove(buf, buf + end, have);
+		if (final)
+		{
+			if (wrapping || sw->start == ch_zero())
+				break;
+			wrapping = TRUE;
+			pos = ch_zero();
+			have = 0;
+		}
+	}
+	free(buf);
+	free(found.pos);
+
+	pthread_mutex_lock(&sw->lock);
+	sw->done = TRUE;
+	close(sw->file);
+	sw->file = -1;
+	dofree = sw->stop;
+	pthread_mutex_unlock(&sw->lock);
+	if (dofree)
+		sw_free(sw);
+	return (NULL);
+}
+
+/*
+ * Let go of the search worker.
+ */
+	static void
+sw_stop()
+{
+	struct sworker *sw = sworker;
+	int dofree;
+
+	if (sw == NULL)
+		return;
+	sworker = NULL;
+	pthread_mutex_lock(&sw->lock);
+	sw->stop = TRUE;
+	dofree = sw->done;
+	pthread_mutex_unlock(&sw->lock);
+	if (dofree)
+		sw_free(sw);
+}
+
+/*
+ * Is a pattern one which matches a line just when it is in it?
+ */
+	static int
+is_literal(pattern, search_type)
+	char *pattern;
+	int search_type;
+{
+	char *p;
+
+	if (*pattern == '\0' || (search_type & SRCH_NO_MATCH))
+		return (FALSE);
+	for (p = pattern;  *p != '\0';  p++)
+	{
+		if (*p < ' ' || *p > '~')
+			return (FALSE);
+		if (!(search_type & SRCH_NO_REGEX) &&
+		    strchr("\\^$.[]|()*+?{}", *p) != NULL)
+			return (FALSE);
+	}
+	return (TRUE);
+}
+
+/*
+ * Can the search worker answer a search of this type, in this file?
+ */
+	static int
+sw_usable(search_type)
+	int search_type;
+{
+	struct sworker *sw = sworker;
+
+	if (sw == NULL || sw->ifile != curr_ifile ||
+	    search_info.text == NULL || strcmp(sw->text, search_info.text) != 0)
+		return (FALSE);
+#if HAVE_STAT_INO
+	if (sw->dev != curr_dev || sw->ino != curr_ino)
+		return (FALSE);
+#endif
+	return (sw->search_type == (search_type & (SRCH_NO_MATCH|SRCH_NO_REGEX)) &&
+		sw->cvt_ops == get_cvt_ops() && sw->caseless == caseless);
+}
+
+/*
+ * Set the search worker going, for a search starting at pos,
+ * unless it is already looking for the same thing.
+ */
+	static void
+sw_start(pos, search_type)
+	POSITION pos;
+	int search_type;
+{
+	struct sworker *sw;
+	struct stat st;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int f;
+
+	if (sw_usable(search_type))
+		return;
+	sw_stop();
+	if (!prev_pattern(&search_info) || (f = ch_dupfile()) < 0)
+		return;
+	if (fstat(f, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    (sw = (struct sworker *) calloc(1, sizeof(struct sworker))) == NULL)
+	{
+		close(f);
+		return;
+	}
+	pthread_mutex_init(&sw->lock, NULL);
+	sw->file = f;
+	sw->ifile = curr_ifile;
+#if HAVE_STAT_INO
+	sw->dev = curr_dev;
+	sw->ino = curr_ino;
+#endif
+	sw->search_type = search_type & (SRCH_NO_MATCH|SRCH_NO_REGEX);
+	sw->cvt_ops = get_cvt_ops();
+	sw->caseless = caseless;
+	sw->literal = !(sw->cvt_ops & CVT_TO_LC) && caseless != OPT_ONPLUS &&
+		is_literal(search_info.text, sw->search_type);
+	sw->text = save(search_info.text);
+	sw->start = sw->fwd = pos;
+	sw->wrap = ch_zero();
+	CLEAR_PATTERN(sw->compiled);
+#if !NO_REGEX
+	if (compile_pattern(sw->text, sw->search_type, &sw->compiled) < 0)
+	{
+		close(f);
+		sw->file = -1;
+		sw_free(sw);
+		return;
+	}
+#endif
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, sw_thread, (void *) sw) != 0)
+	{
+		close(f);
+		sw->file = -1;
+		sw_free(sw);
+	} else
+		sworker = sw;
+	pthread_attr_destroy(&attr);
+}
+
+/*
+ * Find the first of some matches at or after pos (dir > 0),
+ * or the last one before pos (dir < 0).
+ * Return its index, or -1 if there is none.
+ */
+	static int
+sw_bsearch(m, pos, dir)
+	struct swmatches *m;
+	POSITION pos;
+	int dir;
+{
+	int lo = 0;
+	int hi = m->n;
+	int mid;
+
+	/* Find the first one at or after pos. */
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (m->pos[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (dir > 0)
+		return ((lo < m->n) ? lo : -1);
+	return (lo - 1);
+}
+
+/*
+ * Ask the search worker for the next line which matches,
+ * starting at the line at pos if searching forward,
+ * or with the line before pos if searching backward.
+ * Wait for the worker if it is on its way there;
+ * a key pressed meanwhile stops the search.
+ */
+	static int
+sw_find(pos, search_type, pnpos)
+	POSITION pos;
+	int search_type;
+	POSITION *pnpos;
+{
+	struct sworker *sw = sworker;
+	int i;
+	int r;
+	int waited = 0;
+	int ahead = tty_typeahead();
+
+	pthread_mutex_lock(&sw->lock);
+	for (;;)
+	{
+		if (search_type & SRCH_FORW)
+		{
+			if (pos >= sw->start && (pos < sw->fwd || sw->eof))
+			{
+				if ((i = sw_bsearch(&sw->fm, pos, 1)) >= 0)
+				{
+					*pnpos = sw->fm.pos[i];
+					r = SW_MATCH;
+					break;
+				}
+				if (sw->eof)
+				{
+					/*
+					 * Nothing more up to where the file
+					 * ended; look at anything added since
+					 * the old way.
+					 */
+					*pnpos = sw->fwd;
+					r = SW_UNKNOWN;
+					break;
+				}
+			} else if (pos < sw->wrap)
+			{
+				if ((i = sw_bsearch(&sw->wm, pos, 1)) >= 0)
+				{
+					*pnpos = sw->wm.pos[i];
+					r = SW_MATCH;
+					break;
+				}
+				if (sw->wrap >= sw->start)
+				{
+					/* Carry on where the worker started. */
+					pos = sw->start;
+					continue;
+				}
+			} else if (pos < sw->start && !sw->eof)
+			{
+				/*
+				 * The worker won't be here for a while.
+				 */
+				*pnpos = pos;
+				r = SW_UNKNOWN;
+				break;
+			}
+		} else
+		{
+			if (pos > sw->start && (pos <= sw->fwd || sw->eof))
+			{
+				if ((i = sw_bsearch(&sw->fm, pos, -1)) >= 0)
+				{
+					*pnpos = sw->fm.pos[i];
+					r = SW_MATCH;
+					break;
+				}
+				/* Carry on before where the worker started. */
+				pos = sw->start;
+			}
+			if (pos <= sw->wrap || pos == ch_zero())
+			{
+				if ((i = sw_bsearch(&sw->wm, pos, -1)) >= 0)
+				{
+					*pnpos = sw->wm.pos[i];
+					r = SW_MATCH;
+				} else
+					r = SW_NONE;
+				break;
+			}
+			if (pos <= sw->start)
+			{
+				/*
+				 * Don't wait for the worker to go all the way
+				 * round: search the old way from here.
+				 */
+				*pnpos = pos;
+				r = SW_UNKNOWN;
+				break;
+			}
+		}
+		if (sw->done)
+		{
+			/*
+			 * The worker stopped short (out of memory
+			 * or a read error).
+			 */
+			*pnpos = pos;
+			r = SW_UNKNOWN;
+			break;
+		}
+		/*
+		 * The worker is on its way: wait for it.
+		 * Keys typed before we started are commands to come,
+		 * but one typed while we wait stops the search.
+		 */
+		pthread_mutex_unlock(&sw->lock);
+		usleep(10000);
+		if (ABORT_SIGS() || tty_typeahead() > ahead)
+			return (SW_INTR);
+		if (++waited == 100)
+			ierror("Searching", NULL_PARG);
+		pthread_mutex_lock(&sw->lock);
+	}
+	pthread_mutex_unlock(&sw->lock);
+	return (r);
+}
+
+/*
+ * Has the search worker found that the line at pos does not match?
+ */
+	static int
+sw_nomatch(pos)
+	POSITION pos;
+{
+	struct sworker *sw = sworker;
+	struct swmatches *m;
+	int i;
+	int r;
+
+	pthread_mutex_lock(&sw->lock);
+	if (pos >= sw->start && pos < sw->fwd)
+		m = &sw->fm;
+	else if (pos < sw->wrap)
+		m = &sw->wm;
+	else
+		m = NULL;
+	r = (m != NULL && ((i = sw_bsearch(m, pos, 1)) < 0 || m->pos[i] != pos));
+	pthread_mutex_unlock(&sw->lock);
+	return (r);
+}
+#endif
+
+/*
+ * Throw away what the search worker has found,
+ * because the file has changed or we are quitting.
+ */
+	public void
+clr_sworker()
+{
+#if HAVE_PTHREAD
+	sw_stop();
+#endif
+}
+
 /*
  * Search a subset of the file, specified by start/end position.
  */
@@ -1168,9 +1814,16 @@ search_range(pos, endpos, search_type, matches, maxlines, plinepos, pendpos)
 	int cvt_len;
 	int *chpos;
 	POSITION linepos, oldpos;
+#if HAVE_PTHREAD
+	int use_sw;
+	POSITION npos;
+#endif
 
 	linenum = find_linenum(pos);
 	oldpos = pos;
+#if HAVE_PTHREAD
+	use_sw = sw_usable(search_type);
+#endif
 	for (;;)
 	{
 		/*
@@ -1186,6 +1839,38 @@ search_range(pos, endpos, search_type, matches, maxlines, plinepos, pendpos)
 			return (-1);
 		}
 
+#if HAVE_PTHREAD
+		if (use_sw && !(search_type & SRCH_FIND_ALL) &&
+		    endpos == NULL_POSITION && maxlines < 0)
+		{
+			/*
+			 * If the search worker has been here,
+			 * skip to the next line it found to match.
+			 */
+			switch (sw_find(pos, search_type, &npos))
+			{
+			case SW_INTR:
+				return (-1);
+			case SW_NONE:
+				if (pendpos != NULL)
+					*pendpos = oldpos;
+				return (matches);
+			case SW_UNKNOWN:
+				use_sw = FALSE;
+				break;
+			case SW_MATCH:
+				if (!(search_type & SRCH_FORW))
+					npos = forw_raw_line(npos, &line, &line_len);
+				break;
+			}
+			if (npos != pos && npos != NULL_POSITION)
+			{
+				pos = oldpos = npos;
+				linenum = 0;
+			}
+		}
+#endif
+
 		if ((endpos != NULL_POSITION && pos >= endpos) || maxlines == 0)
 		{
 			/*
@@ -1238,7 +1923,7 @@ search_range(pos, endpos, search_type, matches, maxlines, plinepos, pendpos)
 		 * the search.  Remember the line number only if
 		 * we're "far" from the last place we remembered it.
 		 */
-		if (linenums && abs((int)(pos - oldpos)) > 2048)
+		if (linenums && linenum != 0 && abs((int)(pos - oldpos)) > 2048)
 			add_lnum(linenum, pos);
 		oldpos = pos;
 
@@ -1282,7 +1967,12 @@ search_range(pos, endpos, search_type, matches, maxlines, plinepos, pendpos)
 		 * We are successful if we either want a match and got one,
 		 * or if we want a non-match and got one.
 		 */
-		if (prev_pattern(&search_info))
+		if (prev_pattern(&search_info)
+#if HAVE_PTHREAD
+		    /* No need to look at a line the worker knows is no good. */
+		    && !(use_sw && sw_nomatch(linepos))
+#endif
+		    )
 		{
 			line_match = match_pattern(info_compiled(&search_info), search_info.text,
 				cline, line_len, &sp, &ep, 0, search_type);
@@ -1483,6 +2173,12 @@ search(search_type, pattern, n)
 		return (-1);
 	}
 
+#if HAVE_PTHREAD
+	/*
+	 * Have the search worker look through the file ahead of us.
+	 */
+	sw_start((search_type & SRCH_FORW) ? pos : ch_zero(), search_type);
+#endif
 	n = search_range(pos, NULL_POSITION, search_type, n, -1,
 			&pos, (POSITION*)NULL);
 	if (n != 0)
@@ -13,6 +13,9 @@
  */
 
 #include "less.h"
+#if HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
 #if OS2
 #include "cmd.h"
 #include "pckeys.h"
@@ -194,3 +197,18 @@ getchr()
 
 	return (c & 0xFF);
 }
+
+/*
+ * How many characters typed at the keyboard are waiting to be read?
+ */
+	public int
+tty_typeahead()
+{
+#ifdef FIONREAD
+	int n;
+
+	if (ioctl(tty, FIONREAD, &n) == 0)
+		return (n);
+#endif
+	return (0);
+}
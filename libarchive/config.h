@@ -227,6 +227,20 @@
 /* Define to 1 if you have the `lzmadec' library (-llzmadec). */
 /* #undef HAVE_LIBLZMADEC */
 
+/* zstd and lz4 compression: when libzstd / liblz4 built for Apple platforms
+   are in the header search path (and linked into the framework). Without
+   them the filters fall back to running unzstd / unlz4. */
+#if defined(__has_include)
+#if __has_include(<zstd.h>)
+#define HAVE_ZSTD_H 1
+#define HAVE_LIBZSTD 1
+#endif
+#if __has_include(<lz4frame.h>)
+#define HAVE_LZ4FRAME_H 1
+#define HAVE_LIBLZ4 1
+#endif
+#endif
+
 /* Define to 1 if you have the `xml2' library (-lxml2). */
 #define HAVE_LIBXML2 1
 
@@ -300,6 +314,9 @@
 /* Define to 1 if you have the `mknod' function. */
 #define HAVE_MKNOD 1
 
+/* Define to 1 if you have the `mmap' function. */
+#define HAVE_MMAP 1
+
 /* Define to 1 if you have the <ndir.h> header file, and it defines `DIR'. */
 /* #undef HAVE_NDIR_H */
 
@@ -491,6 +508,9 @@
 /* Define to 1 if you have the <sys/mkdev.h> header file. */
 /* #undef HAVE_SYS_MKDEV_H */
 
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#define HAVE_SYS_MMAN_H 1
+
 /* Define to 1 if you have the <sys/ndir.h> header file, and it defines `DIR'.
    */
 /* #undef HAVE_SYS_NDIR_H */
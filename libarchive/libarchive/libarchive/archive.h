@@ -221,6 +221,12 @@ typedef __LA_INT64_T	archive_skip_callback(struct archive *,
 			    void *_client_data, __LA_INT64_T request);
 #endif
 
+/* Seeks to the given offset (whence is SEEK_SET, SEEK_CUR or SEEK_END)
+ * and returns the new absolute position, or a negative value on error.
+ * Same signature as in libarchive 3.0. */
+typedef __LA_INT64_T	archive_seek_callback(struct archive *,
+			    void *_client_data, __LA_INT64_T offset, int whence);
+
 /* Returns size actually written, zero on EOF, -1 on error. */
 typedef __LA_SSIZE_T	archive_write_callback(struct archive *,
 			    void *_client_data,
@@ -245,6 +251,9 @@ typedef int	archive_close_callback(struct archive *, void *_client_data);
 #define	ARCHIVE_COMPRESSION_XZ		6
 #define	ARCHIVE_COMPRESSION_UU		7
 #define	ARCHIVE_COMPRESSION_RPM		8
+/* Same values as ARCHIVE_FILTER_LZ4 and ARCHIVE_FILTER_ZSTD in 3.x. */
+#define	ARCHIVE_COMPRESSION_LZ4		13
+#define	ARCHIVE_COMPRESSION_ZSTD	14
 
 /*
  * Codes returned by archive_format.
@@ -313,6 +322,7 @@ __LA_DECL int		 archive_read_support_compression_all(struct archive *);
 __LA_DECL int		 archive_read_support_compression_bzip2(struct archive *);
 __LA_DECL int		 archive_read_support_compression_compress(struct archive *);
 __LA_DECL int		 archive_read_support_compression_gzip(struct archive *);
+__LA_DECL int		 archive_read_support_compression_lz4(struct archive *);
 __LA_DECL int		 archive_read_support_compression_lzma(struct archive *);
 __LA_DECL int		 archive_read_support_compression_none(struct archive *);
 __LA_DECL int		 archive_read_support_compression_program(struct archive *,
@@ -324,6 +334,7 @@ __LA_DECL int		 archive_read_support_compression_program_signature
 __LA_DECL int		 archive_read_support_compression_rpm(struct archive *);
 __LA_DECL int		 archive_read_support_compression_uu(struct archive *);
 __LA_DECL int		 archive_read_support_compression_xz(struct archive *);
+__LA_DECL int		 archive_read_support_compression_zstd(struct archive *);
 
 __LA_DECL int		 archive_read_support_format_all(struct archive *);
 __LA_DECL int		 archive_read_support_format_ar(struct archive *);
@@ -345,6 +356,14 @@ __LA_DECL int		 archive_read_open(struct archive *, void *_client_data,
 __LA_DECL int		 archive_read_open2(struct archive *, void *_client_data,
 		     archive_open_callback *, archive_read_callback *,
 		     archive_skip_callback *, archive_close_callback *);
+/*
+ * Optional: set before archive_read_open2().  Formats that keep an
+ * index at the end (zip) use it to read the index instead of scanning
+ * the whole archive.  The filename, fd and memory openers set it for
+ * inputs that can seek.
+ */
+__LA_DECL int		 archive_read_set_seek_callback(struct archive *,
+		     archive_seek_callback *);
 
 /*
  * A variety of shortcuts that invoke archive_read_open() with
@@ -525,11 +544,13 @@ __LA_DECL int		 archive_write_set_skip_file(struct archive *, dev_t, ino_t);
 __LA_DECL int		 archive_write_set_compression_bzip2(struct archive *);
 __LA_DECL int		 archive_write_set_compression_compress(struct archive *);
 __LA_DECL int		 archive_write_set_compression_gzip(struct archive *);
+__LA_DECL int		 archive_write_set_compression_lz4(struct archive *);
 __LA_DECL int		 archive_write_set_compression_lzma(struct archive *);
 __LA_DECL int		 archive_write_set_compression_none(struct archive *);
 __LA_DECL int		 archive_write_set_compression_program(struct archive *,
 		     const char *cmd);
 __LA_DECL int		 archive_write_set_compression_xz(struct archive *);
+__LA_DECL int		 archive_write_set_compression_zstd(struct archive *);
 /* A convenience function to set the format based on the code or name. */
 __LA_DECL int		 archive_write_set_format(struct archive *, int format_code);
 __LA_DECL int		 archive_write_set_format_by_name(struct archive *,
@@ -286,6 +286,17 @@ client_close_proxy(struct archive_read_filter *self)
 	return (r);
 }
 
+int
+archive_read_set_seek_callback(struct archive *_a,
+    archive_seek_callback *client_seeker)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+
+	__archive_check_magic(_a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_NEW,
+	    "archive_read_set_seek_callback");
+	a->client.seeker = client_seeker;
+	return (ARCHIVE_OK);
+}
 
 int
 archive_read_open2(struct archive *_a, void *client_data,
@@ -1247,3 +1258,39 @@ __archive_read_filter_skip(struct archive_read_filter *filter, int64_t request)
 	}
 	return (total_bytes_skipped);
 }
+
+/*
+ * Reposition the input.  This only works when the client registered a
+ * seek callback and no decompression filter sits on top of it; callers
+ * must be ready for ARCHIVE_FAILED and fall back to reading forward.
+ * All read-ahead buffers are dropped, so pointers returned by an
+ * earlier __archive_read_ahead() are invalid afterwards.
+ */
+int64_t
+__archive_read_seek(struct archive_read *a, int64_t offset, int whence)
+{
+	struct archive_read_filter *filter = a->filter;
+	int64_t r;
+
+	if (a->client.seeker == NULL || filter->upstream != NULL)
+		return (ARCHIVE_FAILED);
+	if (filter->fatal)
+		return (ARCHIVE_FATAL);
+	/* SEEK_CUR is relative to what the caller has consumed. */
+	if (whence == SEEK_CUR) {
+		offset += a->archive.file_position;
+		whence = SEEK_SET;
+	}
+	r = (a->client.seeker)(&a->archive, filter->data, offset, whence);
+	if (r < 0)
+		return (ARCHIVE_FATAL);
+	filter->next = filter->buffer;
+	filter->avail = 0;
+	filter->client_next = filter->client_buff = NULL;
+	filter->client_avail = filter->client_total = 0;
+	filter->position = r;
+	filter->end_of_file = 0;
+	a->archive.file_position = r;
+	a->archive.raw_position = r;
+	return (r);
+}
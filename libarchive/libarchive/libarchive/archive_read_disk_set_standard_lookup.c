@@ -44,6 +44,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_disk_set_standard_lookup.c
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#include <pthread.h>
 
 #include "archive.h"
 
@@ -55,21 +56,37 @@ archive_read_disk_set_standard_lookup(struct archive *a)
 	return (ARCHIVE_FATAL);
 }
 #else /* ! (_WIN32 && !__CYGWIN__) */
-#define	name_cache_size 127
+#define	name_table_initial_size 256
 
 static const char * const NO_NAME = "(noname)";
 
+/*
+ * The names are kept in two hash tables (uid and gid) shared by all the
+ * archive_read_disk objects of the process: tar runs many times in the
+ * same app, and the first lookup of each id already goes through the
+ * libinfo cache.  The tables grow as needed and nothing is evicted, so
+ * a name returned stays valid; trees with many owners no longer thrash
+ * a fixed direct-mapped cache.
+ */
+struct name_table {
+	struct name_entry {
+		id_t id;
+		const char *name;	/* NULL: free slot */
+	} *entries;
+	size_t	size;			/* power of 2 */
+	size_t	count;
+};
+
+static struct name_table uname_table, gname_table;
+static pthread_mutex_t name_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct name_cache {
 	struct archive *archive;
+	struct name_table *table;
 	char   *buff;
 	size_t  buff_size;
 	int	probes;
 	int	hits;
-	size_t	size;
-	struct {
-		id_t id;
-		const char *name;
-	} cache[name_cache_size];
 };
 
 static const char *	lookup_gname(void *, gid_t);
@@ -107,10 +124,10 @@ archive_read_disk_set_standard_lookup(struct archive *a)
 
 	memset(ucache, 0, sizeof(*ucache));
 	ucache->archive = a;
-	ucache->size = name_cache_size;
+	ucache->table = &uname_table;
 	memset(gcache, 0, sizeof(*gcache));
 	gcache->archive = a;
-	gcache->size = name_cache_size;
+	gcache->table = &gname_table;
 
 	archive_read_disk_set_gname_lookup(a, gcache, lookup_gname, cleanup);
 	archive_read_disk_set_uname_lookup(a, ucache, lookup_uname, cleanup);
@@ -122,19 +139,51 @@ static void
 cleanup(void *data)
 {
 	struct name_cache *cache = (struct name_cache *)data;
-	size_t i;
 
+	/* The names stay in the shared tables. */
 	if (cache != NULL) {
-		for (i = 0; i < cache->size; i++) {
-			if (cache->cache[i].name != NULL &&
-			    cache->cache[i].name != NO_NAME)
-				free((void *)(uintptr_t)cache->cache[i].name);
-		}
 		free(cache->buff);
 		free(cache);
 	}
 }
 
+/* name_table_lock held. */
+static struct name_entry *
+name_table_slot(struct name_table *table, id_t id)
+{
+	size_t slot = ((uint32_t)id * 2654435761u) & (table->size - 1);
+
+	while (table->entries[slot].name != NULL &&
+	    table->entries[slot].id != id)
+		slot = (slot + 1) & (table->size - 1);
+	return (&table->entries[slot]);
+}
+
+/* name_table_lock held.  Keeps the table at most half full. */
+static int
+name_table_grow(struct name_table *table)
+{
+	struct name_table larger;
+	size_t i;
+
+	if (table->entries != NULL && 2 * (table->count + 1) <= table->size)
+		return (0);
+	larger.size = (table->size == 0) ?
+	    name_table_initial_size : 2 * table->size;
+	larger.count = table->count;
+	larger.entries = calloc(larger.size, sizeof(struct name_entry));
+	if (larger.entries == NULL)
+		return (-1);
+	for (i = 0; i < table->size; i++) {
+		if (table->entries[i].name != NULL)
+			*name_table_slot(&larger, table->entries[i].id) =
+			    table->entries[i];
+	}
+	free(table->entries);
+	*table = larger;
+	return (0);
+}
+
 /*
  * Lookup uid/gid from uname/gname, return NULL if no match.
  */
@@ -142,36 +191,48 @@ static const char *
 lookup_name(struct name_cache *cache,
     const char * (*lookup_fn)(struct name_cache *, id_t), id_t id)
 {
+	struct name_table *table = cache->table;
+	struct name_entry *entry;
 	const char *name;
-	int slot;
-
 
 	cache->probes++;
 
-	slot = id % cache->size;
-	if (cache->cache[slot].name != NULL) {
-		if (cache->cache[slot].id == id) {
+	pthread_mutex_lock(&name_table_lock);
+	if (table->entries != NULL) {
+		entry = name_table_slot(table, id);
+		if (entry->name != NULL) {
+			name = entry->name;
+			pthread_mutex_unlock(&name_table_lock);
 			cache->hits++;
-			if (cache->cache[slot].name == NO_NAME)
-				return (NULL);
-			return (cache->cache[slot].name);
+			return ((name == NO_NAME) ? NULL : name);
 		}
-		if (cache->cache[slot].name != NO_NAME)
-			free((void *)(uintptr_t)cache->cache[slot].name);
-		cache->cache[slot].name = NULL;
 	}
+	pthread_mutex_unlock(&name_table_lock);
 
+	/* Not under the lock: the lookup may be slow. */
 	name = (lookup_fn)(cache, id);
-	if (name == NULL) {
-		/* Cache and return the negative response. */
-		cache->cache[slot].name = NO_NAME;
-		cache->cache[slot].id = id;
-		return (NULL);
-	}
+	if (name == NULL)
+		name = NO_NAME; /* Cache the negative response. */
 
-	cache->cache[slot].name = name;
-	cache->cache[slot].id = id;
-	return (cache->cache[slot].name);
+	pthread_mutex_lock(&name_table_lock);
+	if (name_table_grow(table) == 0) {
+		entry = name_table_slot(table, id);
+		if (entry->name == NULL) {
+			entry->id = id;
+			entry->name = name;
+			table->count++;
+		} else {
+			/* Another thread looked it up meanwhile. */
+			if (name != NO_NAME)
+				free((void *)(uintptr_t)name);
+			name = entry->name;
+		}
+		pthread_mutex_unlock(&name_table_lock);
+		return ((name == NO_NAME) ? NULL : name);
+	}
+	pthread_mutex_unlock(&name_table_lock);
+	/* Out of memory: the name can't be kept, and is leaked. */
+	return ((name == NO_NAME) ? NULL : name);
 }
 
 static const char *
@@ -54,6 +54,7 @@ struct read_fd_data {
 	int	 fd;
 	size_t	 block_size;
 	char	 can_skip;
+	off_t	 start;	/* Offset of the archive within the file. */
 	void	*buffer;
 };
 
@@ -64,6 +65,8 @@ static ssize_t	file_skip(struct archive *, void *, size_t request);
 #else
 static off_t	file_skip(struct archive *, void *, off_t request);
 #endif
+static int64_t	file_seek(struct archive *, void *, int64_t offset,
+		    int whence);
 
 int
 archive_read_open_fd(struct archive *a, int fd, size_t block_size)
@@ -99,6 +102,9 @@ archive_read_open_fd(struct archive *a, int fd, size_t block_size)
 	if (S_ISREG(st.st_mode)) {
 		archive_read_extract_set_skip_file(a, st.st_dev, st.st_ino);
 		mine->can_skip = 1;
+		mine->start = lseek(fd, 0, SEEK_CUR);
+		if (mine->start >= 0)
+			archive_read_set_seek_callback(a, file_seek);
 	} else
 		mine->can_skip = 0;
 #if defined(__CYGWIN__) || defined(_WIN32)
@@ -174,6 +180,27 @@ file_skip(struct archive *a, void *client_data, off_t request)
 	return (new_offset - old_offset);
 }
 
+/*
+ * Random access for readers that want it (zip reads its central
+ * directory).  Offsets are relative to where the fd was when the
+ * archive was opened, so an archive embedded in a larger file works.
+ */
+static int64_t
+file_seek(struct archive *a, void *client_data, int64_t offset, int whence)
+{
+	struct read_fd_data *mine = (struct read_fd_data *)client_data;
+	off_t r;
+
+	if (whence == SEEK_SET)
+		offset += mine->start;
+	r = lseek(mine->fd, (off_t)offset, whence);
+	if (r < 0) {
+		archive_set_error(a, errno, "Error seeking");
+		return (ARCHIVE_FATAL);
+	}
+	return (r - mine->start);
+}
+
 static int
 file_close(struct archive *a, void *client_data)
 {
@@ -29,6 +29,9 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_open_filename.c 201093 2009
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
@@ -55,12 +58,33 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_open_filename.c 201093 2009
 #define O_BINARY 0
 #endif
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define USE_MMAP 1
+/*
+ * Regular files are mapped rather than read, a window at a time, and
+ * file_read() hands out pointers straight into the mapping.  With one
+ * large window, read-ahead requests almost never cross a block and
+ * nothing is copied.  The window slides forward through bigger files,
+ * so address space stays bounded; 32-bit devices get a smaller one.
+ */
+#define MMAP_WINDOW	(sizeof(void *) < 8 ? 8 * 1024 * 1024 : 256 * 1024 * 1024)
+#endif
+
 struct read_file_data {
 	int	 fd;
 	size_t	 block_size;
 	void	*buffer;
 	mode_t	 st_mode;  /* Mode bits for opened file. */
 	char	 can_skip; /* This file supports skipping. */
+	off_t	 start;	   /* Offset of the archive within the file. */
+#ifdef USE_MMAP
+	char	 use_mmap; /* Read through map windows, not read(). */
+	off_t	 size;	   /* File size at open. */
+	off_t	 pos;	   /* Next byte file_read() returns. */
+	char	*map;	   /* Current window, or NULL. */
+	off_t	 map_offset; /* File offset of the window. */
+	size_t	 map_size;
+#endif
 	char	 filename[1]; /* Must be last! */
 };
 
@@ -71,6 +95,13 @@ static ssize_t	file_skip(struct archive *, void *, size_t request);
 #else
 static off_t	file_skip(struct archive *, void *, off_t request);
 #endif
+static int64_t	file_seek(struct archive *, void *, int64_t offset,
+		    int whence);
+#ifdef USE_MMAP
+static ssize_t	file_read_mmap(struct archive *, struct read_file_data *,
+		    const void **buff);
+static void	file_unmap(struct read_file_data *);
+#endif
 
 int
 archive_read_open_file(struct archive *a, const char *filename,
@@ -102,6 +133,10 @@ archive_read_open_filename(struct archive *a, const char *filename,
         // iOS: get input from thread_stdin
 		// fd = 0;
         fd = fileno(thread_stdin);
+        // iOS: an in-process pipe of ios_system has no descriptor,
+        // it is read through stdio, straight from the other command.
+        if (fd < 0)
+            return (archive_read_open_FILE(a, thread_stdin));
 #if defined(__CYGWIN__) || defined(_WIN32)
 		setmode(0, O_BINARY);
 #endif
@@ -151,6 +186,17 @@ archive_read_open_filename(struct archive *a, const char *filename,
 		 * enable this optimization for regular files.
 		 */
 		mine->can_skip = 1;
+		/* ... and the same goes for seeking. */
+		mine->start = lseek(fd, 0, SEEK_CUR);
+		if (mine->start >= 0)
+			archive_read_set_seek_callback(a, file_seek);
+#ifdef USE_MMAP
+		if (mine->start >= 0 && st.st_size > mine->start) {
+			mine->use_mmap = 1;
+			mine->size = st.st_size;
+			mine->pos = mine->start;
+		}
+#endif
 	}
 	return (archive_read_open2(a, mine,
 		NULL, file_read, file_skip, file_close));
@@ -162,6 +208,14 @@ file_read(struct archive *a, void *client_data, const void **buff)
 	struct read_file_data *mine = (struct read_file_data *)client_data;
 	ssize_t bytes_read;
 
+#ifdef USE_MMAP
+	if (mine->use_mmap) {
+		bytes_read = file_read_mmap(a, mine, buff);
+		if (bytes_read != ARCHIVE_WARN)
+			return (bytes_read);
+		/* Mapping failed; carry on with read() from pos. */
+	}
+#endif
 	*buff = mine->buffer;
 	bytes_read = read(mine->fd, mine->buffer, mine->block_size);
 	if (bytes_read < 0) {
@@ -188,6 +242,16 @@ file_skip(struct archive *a, void *client_data, off_t request)
 	if (!mine->can_skip) /* We can't skip, so ... */
 		return (0); /* ... skip zero bytes. */
 
+#ifdef USE_MMAP
+	/* Mapped files skip by moving pos; no block rounding needed. */
+	if (mine->use_mmap) {
+		if (request > mine->size - mine->pos)
+			request = mine->size - mine->pos;
+		mine->pos += request;
+		return (request);
+	}
+#endif
+
 	/* Reduce request to the next smallest multiple of block_size */
 	request = (request / mine->block_size) * mine->block_size;
 	if (request == 0)
@@ -233,6 +297,43 @@ file_skip(struct archive *a, void *client_data, off_t request)
 	return (new_offset - old_offset);
 }
 
+/*
+ * Random access for readers that want it (zip reads its central
+ * directory).  Offsets are relative to where the descriptor was at
+ * open, which matters for a redirected stdin.
+ */
+static int64_t
+file_seek(struct archive *a, void *client_data, int64_t offset, int whence)
+{
+	struct read_file_data *mine = (struct read_file_data *)client_data;
+	off_t r;
+
+	if (whence == SEEK_SET)
+		offset += mine->start;
+#ifdef USE_MMAP
+	if (mine->use_mmap) {
+		if (whence == SEEK_CUR)
+			offset += mine->pos;
+		else if (whence == SEEK_END)
+			offset += mine->size;
+		if (offset < mine->start) {
+			archive_set_error(a, EINVAL, "Error seeking in '%s'",
+			    mine->filename);
+			return (ARCHIVE_FATAL);
+		}
+		mine->pos = (off_t)offset;
+		return (mine->pos - mine->start);
+	}
+#endif
+	r = lseek(mine->fd, (off_t)offset, whence);
+	if (r < 0) {
+		archive_set_error(a, errno, "Error seeking in '%s'",
+		    mine->filename);
+		return (ARCHIVE_FATAL);
+	}
+	return (r - mine->start);
+}
+
 static int
 file_close(struct archive *a, void *client_data)
 {
@@ -265,7 +366,73 @@ file_close(struct archive *a, void *client_data)
 		if (mine->filename[0] != '\0')
 			close(mine->fd);
 	}
+#ifdef USE_MMAP
+	file_unmap(mine);
+#endif
 	free(mine->buffer);
 	free(mine);
 	return (ARCHIVE_OK);
 }
+
+#ifdef USE_MMAP
+/*
+ * Return everything from pos to the end of the current window, mapping
+ * a new window first if pos has left the old one.  The previous window
+ * can go as soon as we're called again: the read-ahead layer has copied
+ * whatever it still needed out of it.  Returns ARCHIVE_WARN if mmap()
+ * fails, after which the caller falls back to read() for good.
+ */
+static ssize_t
+file_read_mmap(struct archive *a, struct read_file_data *mine,
+    const void **buff)
+{
+	off_t offset;
+	size_t len;
+	void *p;
+	long pagesize;
+
+	if (mine->pos >= mine->size)
+		return (0);
+	if (mine->map == NULL || mine->pos < mine->map_offset ||
+	    mine->pos >= mine->map_offset + (off_t)mine->map_size) {
+		file_unmap(mine);
+		pagesize = sysconf(_SC_PAGESIZE);
+		if (pagesize <= 0)
+			pagesize = 4096;
+		offset = mine->pos - mine->pos % pagesize;
+		len = MMAP_WINDOW;
+		if ((off_t)len > mine->size - offset)
+			len = (size_t)(mine->size - offset);
+		p = mmap(NULL, len, PROT_READ, MAP_SHARED, mine->fd, offset);
+		if (p == MAP_FAILED) {
+			mine->use_mmap = 0;
+			if (lseek(mine->fd, mine->pos, SEEK_SET) < 0) {
+				archive_set_error(a, errno,
+				    "Error seeking in '%s'", mine->filename);
+				return (ARCHIVE_FATAL);
+			}
+			return (ARCHIVE_WARN);
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise(p, len, MADV_SEQUENTIAL);
+#endif
+		mine->map = p;
+		mine->map_offset = offset;
+		mine->map_size = len;
+	}
+	*buff = mine->map + (mine->pos - mine->map_offset);
+	len = (size_t)(mine->map_offset + mine->map_size - mine->pos);
+	mine->pos += len;
+	return ((ssize_t)len);
+}
+
+static void
+file_unmap(struct read_file_data *mine)
+{
+	if (mine->map != NULL) {
+		munmap(mine->map, mine->map_size);
+		mine->map = NULL;
+		mine->map_size = 0;
+	}
+}
+#endif
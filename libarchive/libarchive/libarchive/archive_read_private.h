@@ -113,6 +113,7 @@ struct archive_read_filter {
 struct archive_read_client {
 	archive_read_callback	*reader;
 	archive_skip_callback	*skipper;
+	archive_seek_callback	*seeker;
 	archive_close_callback	*closer;
 };
 
@@ -138,7 +139,7 @@ struct archive_read {
 	struct archive_read_client client;
 
 	/* Registered filter bidders. */
-	struct archive_read_filter_bidder bidders[8];
+	struct archive_read_filter_bidder bidders[12];
 
 	/* Last filter in chain */
 	struct archive_read_filter *filter;
@@ -195,5 +196,6 @@ ssize_t	__archive_read_filter_consume(struct archive_read_filter *, size_t);
 int64_t	__archive_read_skip(struct archive_read *, int64_t);
 int64_t	__archive_read_skip_lenient(struct archive_read *, int64_t);
 int64_t	__archive_read_filter_skip(struct archive_read_filter *, int64_t);
+int64_t	__archive_read_seek(struct archive_read *, int64_t, int);
 int __archive_read_program(struct archive_read_filter *, const char *);
 #endif
@@ -0,0 +1,258 @@
+/*-
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+
+#if HAVE_LZ4FRAME_H && HAVE_LIBLZ4
+
+struct private_data {
+	LZ4F_dctx	*dctx;
+	unsigned char	*out_block;
+	size_t		 out_block_size;
+	int64_t		 total_out;
+	char		 in_frame; /* True = in the middle of a frame. */
+	char		 eof; /* True = found end of compressed data. */
+};
+
+static ssize_t	lz4_filter_read(struct archive_read_filter *, const void **);
+static int	lz4_filter_close(struct archive_read_filter *);
+#endif
+
+/*
+ * As with xz, we can detect lz4 compressed data even if we can't
+ * decompress it, so the bid framework is always compiled.
+ */
+static int	lz4_bidder_bid(struct archive_read_filter_bidder *,
+		    struct archive_read_filter *);
+static int	lz4_bidder_init(struct archive_read_filter *);
+
+int
+archive_read_support_compression_lz4(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct archive_read_filter_bidder *bidder = __archive_read_get_bidder(a);
+
+	archive_clear_error(_a);
+	if (bidder == NULL)
+		return (ARCHIVE_FATAL);
+
+	bidder->data = NULL;
+	bidder->bid = lz4_bidder_bid;
+	bidder->init = lz4_bidder_init;
+	bidder->options = NULL;
+	bidder->free = NULL;
+#if HAVE_LZ4FRAME_H && HAVE_LIBLZ4
+	return (ARCHIVE_OK);
+#else
+	archive_set_error(_a, ARCHIVE_ERRNO_MISC,
+	    "Using external unlz4 program for lz4 decompression");
+	return (ARCHIVE_WARN);
+#endif
+}
+
+/*
+ * Test whether we can handle this data.
+ */
+static int
+lz4_bidder_bid(struct archive_read_filter_bidder *self,
+    struct archive_read_filter *filter)
+{
+	const unsigned char *buffer;
+	ssize_t avail;
+
+	(void)self; /* UNUSED */
+
+	buffer = __archive_read_filter_ahead(filter, 4, &avail);
+	if (buffer == NULL)
+		return (0);
+
+	/* Frame Magic Number: 04 22 4D 18 (the legacy format isn't
+	 * handled by lz4frame) */
+	if (buffer[0] != 0x04 || buffer[1] != 0x22 ||
+	    buffer[2] != 0x4D || buffer[3] != 0x18)
+		return (0);
+	return (32);
+}
+
+#if HAVE_LZ4FRAME_H && HAVE_LIBLZ4
+
+/*
+ * Setup the callbacks.
+ */
+static int
+lz4_bidder_init(struct archive_read_filter *self)
+{
+	static const size_t out_block_size = 64 * 1024;
+	struct private_data *state;
+	void *out_block;
+
+	self->code = ARCHIVE_COMPRESSION_LZ4;
+	self->name = "lz4";
+
+	state = (struct private_data *)calloc(sizeof(*state), 1);
+	out_block = (unsigned char *)malloc(out_block_size);
+	if (state == NULL || out_block == NULL) {
+		archive_set_error(&self->archive->archive, ENOMEM,
+		    "Can't allocate data for lz4 decompression");
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&state->dctx,
+	    LZ4F_VERSION))) {
+		archive_set_error(&self->archive->archive, ARCHIVE_ERRNO_MISC,
+		    "Internal error initializing lz4 library");
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+
+	self->data = state;
+	state->out_block_size = out_block_size;
+	state->out_block = out_block;
+	self->read = lz4_filter_read;
+	self->skip = NULL; /* not supported */
+	self->close = lz4_filter_close;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Return the next block of decompressed data.
+ */
+static ssize_t
+lz4_filter_read(struct archive_read_filter *self, const void **p)
+{
+	struct private_data *state;
+	const void *next_in;
+	ssize_t avail_in;
+	size_t decompressed, in_size, out_size, ret;
+
+	state = (struct private_data *)self->data;
+	decompressed = 0;
+
+	/* Try to fill the output buffer. */
+	while (decompressed < state->out_block_size && !state->eof) {
+		next_in = __archive_read_filter_ahead(self->upstream, 1,
+		    &avail_in);
+		if (next_in == NULL && avail_in < 0)
+			return (ARCHIVE_FATAL);
+		if (next_in == NULL)
+			avail_in = 0;
+		/* Input may end after any complete frame. */
+		if (avail_in == 0 && !state->in_frame) {
+			state->eof = 1;
+			break;
+		}
+		in_size = avail_in;
+		out_size = state->out_block_size - decompressed;
+
+		/* Decompress as much as we can in one pass. */
+		ret = LZ4F_decompress(state->dctx,
+		    state->out_block + decompressed, &out_size,
+		    next_in, &in_size, NULL);
+		if (LZ4F_isError(ret)) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC,
+			    "lz4 decompression failed: %s",
+			    LZ4F_getErrorName(ret));
+			return (ARCHIVE_FATAL);
+		}
+		/* 0 means a frame just ended. */
+		state->in_frame = (ret != 0);
+		decompressed += out_size;
+		__archive_read_filter_consume(self->upstream, in_size);
+		if (avail_in == 0 && out_size == 0 && state->in_frame) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC,
+			    "Truncated lz4 input");
+			return (ARCHIVE_FATAL);
+		}
+	}
+
+	state->total_out += decompressed;
+	if (decompressed == 0)
+		*p = NULL;
+	else
+		*p = state->out_block;
+	return (decompressed);
+}
+
+/*
+ * Clean up the decompressor.
+ */
+static int
+lz4_filter_close(struct archive_read_filter *self)
+{
+	struct private_data *state;
+
+	state = (struct private_data *)self->data;
+	LZ4F_freeDecompressionContext(state->dctx);
+	free(state->out_block);
+	free(state);
+	return (ARCHIVE_OK);
+}
+
+#else
+
+/*
+ *
+ * If we have no suitable library on this system, we can't actually do
+ * the decompression.  We can, however, still detect compressed
+ * archives and emit a useful message.
+ *
+ */
+static int
+lz4_bidder_init(struct archive_read_filter *self)
+{
+	int r;
+
+	r = __archive_read_program(self, "unlz4");
+	/* Note: We set the format here even if __archive_read_program()
+	 * above fails.  We do, after all, know what the format is
+	 * even if we weren't able to read it. */
+	self->code = ARCHIVE_COMPRESSION_LZ4;
+	self->name = "lz4";
+	return (r);
+}
+
+#endif /* HAVE_LZ4FRAME_H */
@@ -484,14 +484,29 @@ read_more:
 			}
 			break;
 		}
-		if (total + len * 2 > OUT_BUFF_SIZE)
-			break;
+		if (total + len * 2 > OUT_BUFF_SIZE) {
+			if (total == 0) {
+				archive_set_error(&self->archive->archive,
+				    ARCHIVE_ERRNO_MISC,
+				    "Line too long for uudecode");
+				return (ARCHIVE_FATAL);
+			}
+			/*
+			 * Leave the rest for the next call.  The bytes
+			 * before ravail came from in_buff, the upstream
+			 * has already given them up.
+			 */
+			__archive_read_filter_consume(self->upstream,
+			    used - (avail_in - ravail));
+			goto out;
+		}
 		switch (uudecode->state) {
 		default:
 		case ST_FIND_HEAD:
-			if (len - nl > 13 && memcmp(b, "begin ", 6) == 0)
+			/* The same minimum lengths as the bidder. */
+			if (len - nl >= 11 && memcmp(b, "begin ", 6) == 0)
 				l = 6;
-			else if (len - nl > 18 &&
+			else if (len - nl >= 18 &&
 			    memcmp(b, "begin-base64 ", 13) == 0)
 				l = 13;
 			else
@@ -526,6 +541,23 @@ read_more:
 				uudecode->state = ST_UUEND;
 				break;
 			}
+			/* Whole groups of four characters first. */
+			while (l >= 3 && body >= 4 && uuchar[b[0]] &&
+			    uuchar[b[1]] && uuchar[b[2]] && uuchar[b[3]]) {
+				int n;
+
+				n = UUDECODE(b[0]) << 18 |
+				    UUDECODE(b[1]) << 12 |
+				    UUDECODE(b[2]) << 6 | UUDECODE(b[3]);
+				out[0] = n >> 16;
+				out[1] = (n >> 8) & 0xFF;
+				out[2] = n & 0xFF;
+				out += 3;
+				total += 3;
+				b += 4;
+				body -= 4;
+				l -= 3;
+			}
 			while (l > 0) {
 				int n = 0;
 
@@ -576,6 +608,23 @@ read_more:
 				uudecode->state = ST_FIND_HEAD;
 				break;
 			}
+			/* Whole groups of four characters, without padding. */
+			while (l >= 4 && base64[b[0]] && base64[b[1]] &&
+			    base64[b[2]] && base64[b[3]] &&
+			    b[2] != '=' && b[3] != '=') {
+				int n;
+
+				n = base64num[b[0]] << 18 |
+				    base64num[b[1]] << 12 |
+				    base64num[b[2]] << 6 | base64num[b[3]];
+				out[0] = n >> 16;
+				out[1] = (n >> 8) & 0xFF;
+				out[2] = n & 0xFF;
+				out += 3;
+				total += 3;
+				b += 4;
+				l -= 4;
+			}
 			while (l > 0) {
 				int n = 0;
 
@@ -617,7 +666,7 @@ read_more:
 	}
 
 	__archive_read_filter_consume(self->upstream, ravail);
-
+out:
 	*buff = uudecode->out_buff;
 	uudecode->total += total;
 	return (total);
@@ -0,0 +1,264 @@
+/*-
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+
+struct private_data {
+	ZSTD_DStream	*dstream;
+	unsigned char	*out_block;
+	size_t		 out_block_size;
+	int64_t		 total_out;
+	char		 in_frame; /* True = in the middle of a frame. */
+	char		 eof; /* True = found end of compressed data. */
+};
+
+static ssize_t	zstd_filter_read(struct archive_read_filter *, const void **);
+static int	zstd_filter_close(struct archive_read_filter *);
+#endif
+
+/*
+ * As with xz, we can detect zstd compressed data even if we can't
+ * decompress it, so the bid framework is always compiled.
+ */
+static int	zstd_bidder_bid(struct archive_read_filter_bidder *,
+		    struct archive_read_filter *);
+static int	zstd_bidder_init(struct archive_read_filter *);
+
+int
+archive_read_support_compression_zstd(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct archive_read_filter_bidder *bidder = __archive_read_get_bidder(a);
+
+	archive_clear_error(_a);
+	if (bidder == NULL)
+		return (ARCHIVE_FATAL);
+
+	bidder->data = NULL;
+	bidder->bid = zstd_bidder_bid;
+	bidder->init = zstd_bidder_init;
+	bidder->options = NULL;
+	bidder->free = NULL;
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+	return (ARCHIVE_OK);
+#else
+	archive_set_error(_a, ARCHIVE_ERRNO_MISC,
+	    "Using external unzstd program for zstd decompression");
+	return (ARCHIVE_WARN);
+#endif
+}
+
+/*
+ * Test whether we can handle this data.
+ */
+static int
+zstd_bidder_bid(struct archive_read_filter_bidder *self,
+    struct archive_read_filter *filter)
+{
+	const unsigned char *buffer;
+	ssize_t avail;
+
+	(void)self; /* UNUSED */
+
+	buffer = __archive_read_filter_ahead(filter, 4, &avail);
+	if (buffer == NULL)
+		return (0);
+
+	/* Frame Magic Number: 28 B5 2F FD */
+	if (buffer[0] != 0x28 || buffer[1] != 0xB5 ||
+	    buffer[2] != 0x2F || buffer[3] != 0xFD)
+		return (0);
+	return (32);
+}
+
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+
+/*
+ * Setup the callbacks.
+ */
+static int
+zstd_bidder_init(struct archive_read_filter *self)
+{
+	struct private_data *state;
+	size_t out_block_size;
+	void *out_block;
+
+	self->code = ARCHIVE_COMPRESSION_ZSTD;
+	self->name = "zstd";
+
+	/* One output block as large as zstd likes to produce. */
+	out_block_size = ZSTD_DStreamOutSize();
+	state = (struct private_data *)calloc(sizeof(*state), 1);
+	out_block = (unsigned char *)malloc(out_block_size);
+	if (state == NULL || out_block == NULL ||
+	    (state->dstream = ZSTD_createDStream()) == NULL) {
+		archive_set_error(&self->archive->archive, ENOMEM,
+		    "Can't allocate data for zstd decompression");
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	if (ZSTD_isError(ZSTD_initDStream(state->dstream))) {
+		archive_set_error(&self->archive->archive, ARCHIVE_ERRNO_MISC,
+		    "Internal error initializing zstd library");
+		ZSTD_freeDStream(state->dstream);
+		free(out_block);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+
+	self->data = state;
+	state->out_block_size = out_block_size;
+	state->out_block = out_block;
+	self->read = zstd_filter_read;
+	self->skip = NULL; /* not supported */
+	self->close = zstd_filter_close;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Return the next block of decompressed data.
+ */
+static ssize_t
+zstd_filter_read(struct archive_read_filter *self, const void **p)
+{
+	struct private_data *state;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	ssize_t avail_in;
+	size_t before, ret;
+
+	state = (struct private_data *)self->data;
+
+	out.dst = state->out_block;
+	out.size = state->out_block_size;
+	out.pos = 0;
+
+	/* Try to fill the output buffer. */
+	while (out.pos < out.size && !state->eof) {
+		in.src = __archive_read_filter_ahead(self->upstream, 1,
+		    &avail_in);
+		if (in.src == NULL && avail_in < 0)
+			return (ARCHIVE_FATAL);
+		if (in.src == NULL)
+			avail_in = 0;
+		/* Input may end after any complete frame. */
+		if (avail_in == 0 && !state->in_frame) {
+			state->eof = 1;
+			break;
+		}
+		if (in.src == NULL)
+			in.src = out.dst; /* Not read: length is 0. */
+		in.size = avail_in;
+		in.pos = 0;
+
+		/* Decompress as much as we can in one pass. */
+		before = out.pos;
+		ret = ZSTD_decompressStream(state->dstream, &out, &in);
+		if (ZSTD_isError(ret)) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC,
+			    "zstd decompression failed: %s",
+			    ZSTD_getErrorName(ret));
+			return (ARCHIVE_FATAL);
+		}
+		/* 0 means a frame just ended. */
+		state->in_frame = (ret != 0);
+		__archive_read_filter_consume(self->upstream, in.pos);
+		if (avail_in == 0 && out.pos == before && state->in_frame) {
+			archive_set_error(&self->archive->archive,
+			    ARCHIVE_ERRNO_MISC,
+			    "Truncated zstd input");
+			return (ARCHIVE_FATAL);
+		}
+	}
+
+	state->total_out += out.pos;
+	if (out.pos == 0)
+		*p = NULL;
+	else
+		*p = state->out_block;
+	return (out.pos);
+}
+
+/*
+ * Clean up the decompressor.
+ */
+static int
+zstd_filter_close(struct archive_read_filter *self)
+{
+	struct private_data *state;
+
+	state = (struct private_data *)self->data;
+	ZSTD_freeDStream(state->dstream);
+	free(state->out_block);
+	free(state);
+	return (ARCHIVE_OK);
+}
+
+#else
+
+/*
+ *
+ * If we have no suitable library on this system, we can't actually do
+ * the decompression.  We can, however, still detect compressed
+ * archives and emit a useful message.
+ *
+ */
+static int
+zstd_bidder_init(struct archive_read_filter *self)
+{
+	int r;
+
+	r = __archive_read_program(self, "unzstd");
+	/* Note: We set the format here even if __archive_read_program()
+	 * above fails.  We do, after all, know what the format is
+	 * even if we weren't able to read it. */
+	self->code = ARCHIVE_COMPRESSION_ZSTD;
+	self->name = "zstd";
+	return (r);
+}
+
+#endif /* HAVE_ZSTD_H */
@@ -49,7 +49,26 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_zip.c 201102
 #include "archive_crc32.h"
 #endif
 
+/* What the central directory says about one entry. */
+struct zip_entry {
+	int64_t			local_header_offset;
+	int64_t			compressed_size;
+	int64_t			uncompressed_size;
+};
+
 struct zip {
+	/*
+	 * When the input can seek, the central directory at the end
+	 * is read first and the entries are visited from it: skipping
+	 * an entry is free and sizes are known up front even for
+	 * entries written with ZIP_LENGTH_AT_END.
+	 */
+	struct zip_entry	*entries;
+	int64_t			entries_count;
+	int64_t			entries_next;
+	int64_t			base_offset;	/* Bytes in front (SFX stub). */
+	char			central_directory; /* 1 using, -1 not. */
+
 	/* entry_bytes_remaining is the number of bytes we expect. */
 	int64_t			entry_bytes_remaining;
 	int64_t			entry_offset;
@@ -97,6 +116,9 @@ struct zip {
 
 #define ZIP_LENGTH_AT_END	8
 
+#define ZIP_EOCD_SIZE		22	/* End of central directory record. */
+#define ZIP_CD_HEADER_SIZE	46	/* Central directory file header. */
+
 struct zip_file_header {
 	char	signature[4];
 	char	version[2];
@@ -133,8 +155,12 @@ static int	zip_read_data_deflate(struct archive_read *a, const void **buff,
 		    size_t *size, off_t *offset);
 static int	zip_read_data_none(struct archive_read *a, const void **buff,
 		    size_t *size, off_t *offset);
+static int	zip_read_central_directory(struct archive_read *a,
+		    struct zip *zip);
 static int	zip_read_file_header(struct archive_read *a,
 		    struct archive_entry *entry, struct zip *zip);
+static int	zip_read_indexed_header(struct archive_read *a,
+		    struct archive_entry *entry, struct zip *zip);
 static time_t	zip_time(const char *);
 static int	process_extra(struct archive_read *a, const void* extra, struct zip* zip);
 
@@ -304,6 +330,27 @@ archive_read_format_zip_read_header(struct archive_read *a,
 	zip->entry_uncompressed_bytes_read = 0;
 	zip->entry_compressed_bytes_read = 0;
 	zip->entry_crc32 = crc32(0, NULL, 0);
+
+	if (zip->central_directory == 0) {
+		r1 = zip_read_central_directory(a, zip);
+		if (r1 == ARCHIVE_FATAL)
+			return (r1);
+		if (r1 == ARCHIVE_OK)
+			zip->central_directory = 1;
+		else {
+			/* Not seekable, or no usable directory: stream it. */
+			free(zip->entries);
+			zip->entries = NULL;
+			zip->central_directory = -1;
+			archive_clear_error(&a->archive);
+			if (r1 != ARCHIVE_FAILED &&
+			    __archive_read_seek(a, 0, SEEK_SET) != 0)
+				return (ARCHIVE_FATAL);
+		}
+	}
+	if (zip->central_directory > 0)
+		return (zip_read_indexed_header(a, entry, zip));
+
 	if ((h = __archive_read_ahead(a, 4, NULL)) == NULL)
 		return (ARCHIVE_FATAL);
 
@@ -375,6 +422,195 @@ archive_read_format_zip_read_header(struct archive_read *a,
 	return (ARCHIVE_FATAL);
 }
 
+static int
+cmp_local_header_offset(const void *a, const void *b)
+{
+	const struct zip_entry *ea = (const struct zip_entry *)a;
+	const struct zip_entry *eb = (const struct zip_entry *)b;
+
+	if (ea->local_header_offset < eb->local_header_offset)
+		return (-1);
+	return (ea->local_header_offset > eb->local_header_offset);
+}
+
+/*
+ * Find the end-of-central-directory record in the last 64k of the
+ * input and load the directory it points to.  Returns ARCHIVE_FAILED
+ * if the input can't seek (nothing has moved), ARCHIVE_WARN if there
+ * is no usable directory, ARCHIVE_FATAL only for out of memory.
+ */
+static int
+zip_read_central_directory(struct archive_read *a, struct zip *zip)
+{
+	const char *p, *eocd;
+	int64_t size, tail, eocd_offset, count, cd_size, cd_offset, i;
+	size_t len;
+
+	size = __archive_read_seek(a, 0, SEEK_END);
+	if (size == ARCHIVE_FAILED)
+		return (ARCHIVE_FAILED);
+	if (size < ZIP_EOCD_SIZE)
+		return (ARCHIVE_WARN);
+
+	/* The record is followed only by a comment of at most 64k. */
+	tail = size;
+	if (tail > ZIP_EOCD_SIZE + 0xffff)
+		tail = ZIP_EOCD_SIZE + 0xffff;
+	if (__archive_read_seek(a, size - tail, SEEK_SET) < 0)
+		return (ARCHIVE_WARN);
+	if ((p = __archive_read_ahead(a, (size_t)tail, NULL)) == NULL)
+		return (ARCHIVE_WARN);
+	for (eocd = p + tail - ZIP_EOCD_SIZE; eocd >= p; eocd--) {
+		if (memcmp(eocd, "PK\005\006", 4) == 0
+		    && eocd + ZIP_EOCD_SIZE + archive_le16dec(eocd + 20)
+		    == p + tail)
+			break;
+	}
+	if (eocd < p)
+		return (ARCHIVE_WARN);
+	eocd_offset = size - tail + (eocd - p);
+	count = archive_le16dec(eocd + 10);
+	cd_size = archive_le32dec(eocd + 12);
+	cd_offset = archive_le32dec(eocd + 16);
+
+	if (count == 0xffff || cd_size == 0xffffffff
+	    || cd_offset == 0xffffffff) {
+		/* Zip64: a locator just before the record points to
+		 * the 64-bit version of it. */
+		if (eocd - 20 < p || memcmp(eocd - 20, "PK\006\007", 4) != 0)
+			return (ARCHIVE_WARN);
+		if (__archive_read_seek(a, archive_le64dec(eocd - 20 + 8),
+		    SEEK_SET) < 0)
+			return (ARCHIVE_WARN);
+		if ((p = __archive_read_ahead(a, 56, NULL)) == NULL
+		    || memcmp(p, "PK\006\006", 4) != 0)
+			return (ARCHIVE_WARN);
+		count = archive_le64dec(p + 32);
+		cd_size = archive_le64dec(p + 40);
+		cd_offset = archive_le64dec(p + 48);
+		zip->base_offset = 0;
+	} else {
+		/* Offsets in a self-extracting archive don't count
+		 * the executable in front. */
+		zip->base_offset = eocd_offset - cd_size - cd_offset;
+	}
+	if (zip->base_offset < 0 || count > cd_size / ZIP_CD_HEADER_SIZE)
+		return (ARCHIVE_WARN);
+	if (__archive_read_seek(a, zip->base_offset + cd_offset, SEEK_SET) < 0)
+		return (ARCHIVE_WARN);
+
+	zip->entries = calloc(count ? (size_t)count : 1,
+	    sizeof(*zip->entries));
+	if (zip->entries == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate zip central directory");
+		return (ARCHIVE_FATAL);
+	}
+	for (i = 0; i < count; i++) {
+		struct zip_entry *e = &zip->entries[i];
+		const char *extra;
+		unsigned name_length, extra_length, comment_length;
+		unsigned offset, datasize;
+
+		if ((p = __archive_read_ahead(a, ZIP_CD_HEADER_SIZE, NULL))
+		    == NULL || memcmp(p, "PK\001\002", 4) != 0)
+			return (ARCHIVE_WARN);
+		name_length = archive_le16dec(p + 28);
+		extra_length = archive_le16dec(p + 30);
+		comment_length = archive_le16dec(p + 32);
+		len = ZIP_CD_HEADER_SIZE + name_length + extra_length;
+		if ((p = __archive_read_ahead(a, len, NULL)) == NULL)
+			return (ARCHIVE_WARN);
+		e->compressed_size = archive_le32dec(p + 20);
+		e->uncompressed_size = archive_le32dec(p + 24);
+		e->local_header_offset = archive_le32dec(p + 42);
+
+		/* Zip64 extra field: each 64-bit value is present only
+		 * if the 32-bit one above is saturated, in this order. */
+		extra = p + ZIP_CD_HEADER_SIZE + name_length;
+		for (offset = 0; offset + 4 <= extra_length;
+		    offset += 4 + datasize) {
+			const char *q = extra + offset + 4;
+
+			datasize = archive_le16dec(extra + offset + 2);
+			if (offset + 4 + datasize > extra_length)
+				break;
+			if (archive_le16dec(extra + offset) != 0x0001)
+				continue;
+			if (e->uncompressed_size == 0xffffffff
+			    && q + 8 <= extra + offset + 4 + datasize) {
+				e->uncompressed_size = archive_le64dec(q);
+				q += 8;
+			}
+			if (e->compressed_size == 0xffffffff
+			    && q + 8 <= extra + offset + 4 + datasize) {
+				e->compressed_size = archive_le64dec(q);
+				q += 8;
+			}
+			if (e->local_header_offset == 0xffffffff
+			    && q + 8 <= extra + offset + 4 + datasize)
+				e->local_header_offset = archive_le64dec(q);
+		}
+		__archive_read_consume(a, len);
+		if (comment_length > 0 &&
+		    __archive_read_skip(a, comment_length) < 0)
+			return (ARCHIVE_WARN);
+	}
+	zip->entries_count = count;
+	zip->entries_next = 0;
+
+	/* Visit the entries in file order, like a streaming read. */
+	qsort(zip->entries, (size_t)count, sizeof(*zip->entries),
+	    cmp_local_header_offset);
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Seek to the next entry from the central directory and read its
+ * local header.
+ */
+static int
+zip_read_indexed_header(struct archive_read *a, struct archive_entry *entry,
+    struct zip *zip)
+{
+	struct zip_entry *e;
+	const char *p;
+	int r;
+
+	if (zip->entries_next >= zip->entries_count)
+		return (ARCHIVE_EOF);
+	e = &zip->entries[zip->entries_next++];
+	if (__archive_read_seek(a, zip->base_offset + e->local_header_offset,
+	    SEEK_SET) < 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can't seek to ZIP entry");
+		return (ARCHIVE_FATAL);
+	}
+	a->header_position = a->archive.file_position;
+	if ((p = __archive_read_ahead(a, 4, NULL)) == NULL
+	    || memcmp(p, "PK\003\004", 4) != 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Damaged ZIP file: central directory points to a bad entry");
+		return (ARCHIVE_FATAL);
+	}
+	r = zip_read_file_header(a, entry, zip);
+	if (r != ARCHIVE_OK)
+		return (r);
+
+	/*
+	 * Such an entry only records its sizes after the data, but the
+	 * central directory has them.  The trailing descriptor is still
+	 * checked if the data is read to the end.
+	 */
+	if (zip->flags & ZIP_LENGTH_AT_END) {
+		zip->compressed_size = e->compressed_size;
+		zip->uncompressed_size = e->uncompressed_size;
+		zip->entry_bytes_remaining = e->compressed_size;
+		archive_entry_set_size(entry, zip->uncompressed_size);
+	}
+	return (ARCHIVE_OK);
+}
+
 static int
 zip_read_file_header(struct archive_read *a, struct archive_entry *entry,
     struct zip *zip)
@@ -768,6 +1004,12 @@ archive_read_format_zip_read_data_skip(struct archive_read *a)
 	if (zip->end_of_entry)
 		return (ARCHIVE_OK);
 
+	/* The next header is found by seeking, nothing to skip. */
+	if (zip->central_directory > 0) {
+		zip->end_of_entry = 1;
+		return (ARCHIVE_OK);
+	}
+
 	/*
 	 * If the length is at the end, we have no choice but
 	 * to decompress all the data to find the end marker.
@@ -806,6 +1048,7 @@ archive_read_format_zip_cleanup(struct archive_read *a)
 	if (zip->stream_valid)
 		inflateEnd(&zip->stream);
 #endif
+	free(zip->entries);
 	free(zip->uncompressed_buffer);
 	archive_string_free(&(zip->pathname));
 	archive_string_free(&(zip->extra));
@@ -72,10 +72,15 @@ archive_write_open_filename(struct archive *a, const char *filename)
 {
 	struct write_file_data *mine;
 
-	if (filename == NULL || filename[0] == '\0')
+	if (filename == NULL || filename[0] == '\0') {
         // iOS: get the correct fd for stdout:
         // return (archive_write_open_fd(a, 1));
+        // An in-process pipe of ios_system has none, it is written
+        // through stdio.
+        if (fileno(thread_stdout) < 0)
+            return (archive_write_open_FILE(a, thread_stdout));
         return (archive_write_open_fd(a, fileno(thread_stdout)));
+	}
 
 	mine = (struct write_file_data *)malloc(sizeof(*mine) + strlen(filename));
 	if (mine == NULL) {
@@ -37,9 +37,13 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_compression_gzip.c 201
 #include <string.h>
 #endif
 #include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #ifdef HAVE_ZLIB_H
 #include <zlib.h>
 #endif
+#include <pthread.h>
 
 #include "archive.h"
 #include "archive_private.h"
@@ -56,16 +60,53 @@ archive_write_set_compression_gzip(struct archive *a)
 #else
 /* Don't compile this if we don't have zlib. */
 
+/*
+ * With the "threads" option, input is cut into chunks that worker
+ * threads deflate independently, pigz-style.  Each chunk is primed
+ * with the last 32k of the one before it and ends with a sync flush,
+ * so the pieces concatenate into one ordinary deflate stream; the
+ * gzip header, CRC and trailer are still done here.
+ */
+#define	GZIP_MT_CHUNK	(128 * 1024)
+#define	GZIP_MT_DICT	32768
+
+struct gzip_job {
+	struct gzip_job	*next;
+	unsigned char	*in;
+	size_t		 in_len;
+	unsigned char	 dict[GZIP_MT_DICT];
+	size_t		 dict_len;
+	int		 last;
+	unsigned char	*out;
+	size_t		 out_len;
+	int		 status;	/* 0 queued, 1 done, -1 failed */
+};
+
+struct gzip_mt {
+	pthread_mutex_t	 lock;
+	pthread_cond_t	 changed;
+	struct gzip_job	*first, *last;	/* submitted, oldest first */
+	struct gzip_job	*next_job;	/* first one not taken by a worker */
+	struct gzip_job	*filling;	/* collecting input */
+	int		 outstanding;
+	int		 quit;
+	int		 level;
+	int		 nthreads;
+	pthread_t	*threads;
+};
+
 struct private_data {
 	z_stream	 stream;
 	int64_t		 total_in;
 	unsigned char	*compressed;
 	size_t		 compressed_buffer_size;
 	unsigned long	 crc;
+	struct gzip_mt	*mt;	/* non-NULL when compressing in parallel */
 };
 
 struct private_config {
 	int		 compression_level;
+	int		 threads;
 };
 
 
@@ -84,6 +125,11 @@ static int	archive_compressor_gzip_write(struct archive_write *,
 		    const void *, size_t);
 static int	drive_compressor(struct archive_write *, struct private_data *,
 		    int finishing);
+static int	drive_parallel(struct archive_write *, struct private_data *,
+		    int finishing);
+static void	gzip_mt_free(struct gzip_mt *);
+static struct gzip_mt *gzip_mt_new(int level, int nthreads);
+static int	write_block(struct archive_write *, struct private_data *);
 
 
 /*
@@ -104,6 +150,7 @@ archive_write_set_compression_gzip(struct archive *_a)
 	a->compressor.config = config;
 	a->compressor.finish = &archive_compressor_gzip_finish;
 	config->compression_level = Z_DEFAULT_COMPRESSION;
+	config->threads = 1;
 	a->compressor.init = &archive_compressor_gzip_init;
 	a->compressor.options = &archive_compressor_gzip_options;
 	a->archive.compression_code = ARCHIVE_COMPRESSION_GZIP;
@@ -196,6 +243,11 @@ archive_compressor_gzip_init(struct archive_write *a)
 	    8,
 	    Z_DEFAULT_STRATEGY);
 
+	if (ret == Z_OK && config->threads > 1) {
+		/* Without workers, just compress the usual way. */
+		state->mt = gzip_mt_new(config->compression_level,
+		    config->threads);
+	}
 	if (ret == Z_OK) {
 		a->compressor.data = state;
 		return (0);
@@ -245,6 +297,23 @@ archive_compressor_gzip_options(struct archive_write *a, const char *key,
 		config->compression_level = value[0] - '0';
 		return (ARCHIVE_OK);
 	}
+	if (strcmp(key, "threads") == 0) {
+		char *end;
+		long n;
+
+		if (value == NULL)
+			return (ARCHIVE_WARN);
+		n = strtol(value, &end, 10);
+		if (*end != '\0' || n < 0 || n > 256)
+			return (ARCHIVE_WARN);
+#ifdef _SC_NPROCESSORS_ONLN
+		/* threads=0: one per CPU. */
+		if (n == 0)
+			n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		config->threads = n > 1 ? (int)n : 1;
+		return (ARCHIVE_OK);
+	}
 
 	return (ARCHIVE_WARN);
 }
@@ -392,6 +461,7 @@ archive_compressor_gzip_finish(struct archive_write *a)
 
 		/* Cleanup: shut down compressor, release memory, etc. */
 	cleanup:
+		gzip_mt_free(state->mt);
 		switch (deflateEnd(&(state->stream))) {
 		case Z_OK:
 			break;
@@ -419,29 +489,15 @@ archive_compressor_gzip_finish(struct archive_write *a)
 static int
 drive_compressor(struct archive_write *a, struct private_data *state, int finishing)
 {
-	ssize_t bytes_written;
 	int ret;
 
+	if (state->mt != NULL)
+		return (drive_parallel(a, state, finishing));
+
 	for (;;) {
 		if (state->stream.avail_out == 0) {
-			bytes_written = (a->client_writer)(&a->archive,
-			    a->client_data, state->compressed,
-			    state->compressed_buffer_size);
-			if (bytes_written <= 0) {
-				/* TODO: Handle this write failure */
+			if (write_block(a, state) != ARCHIVE_OK)
 				return (ARCHIVE_FATAL);
-			} else if ((size_t)bytes_written < state->compressed_buffer_size) {
-				/* Short write: Move remaining to
-				 * front of block and keep filling */
-				memmove(state->compressed,
-				    state->compressed + bytes_written,
-				    state->compressed_buffer_size - bytes_written);
-			}
-			a->archive.raw_position += bytes_written;
-			state->stream.next_out
-			    = state->compressed +
-			    state->compressed_buffer_size - bytes_written;
-			state->stream.avail_out = bytes_written;
 		}
 
 		/* If there's nothing to do, we're done. */
@@ -474,4 +530,310 @@ drive_compressor(struct archive_write *a, struct private_data *state, int finish
 	}
 }
 
+/*
+ * Write out the full output block.
+ */
+static int
+write_block(struct archive_write *a, struct private_data *state)
+{
+	ssize_t bytes_written;
+
+	bytes_written = (a->client_writer)(&a->archive,
+	    a->client_data, state->compressed,
+	    state->compressed_buffer_size);
+	if (bytes_written <= 0) {
+		/* TODO: Handle this write failure */
+		return (ARCHIVE_FATAL);
+	} else if ((size_t)bytes_written < state->compressed_buffer_size) {
+		/* Short write: Move remaining to
+		 * front of block and keep filling */
+		memmove(state->compressed,
+		    state->compressed + bytes_written,
+		    state->compressed_buffer_size - bytes_written);
+	}
+	a->archive.raw_position += bytes_written;
+	state->stream.next_out
+	    = state->compressed +
+	    state->compressed_buffer_size - bytes_written;
+	state->stream.avail_out = bytes_written;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Deflate one chunk on a worker thread.
+ */
+static int
+gzip_mt_deflate(struct gzip_job *job, int level)
+{
+	z_stream stream;
+	unsigned char *p;
+	size_t size;
+	int ret;
+
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8,
+	    Z_DEFAULT_STRATEGY) != Z_OK)
+		return (-1);
+	if (job->dict_len > 0 &&
+	    deflateSetDictionary(&stream, job->dict, job->dict_len) != Z_OK) {
+		deflateEnd(&stream);
+		return (-1);
+	}
+	/* Room for the sync flush marker, too. */
+	size = deflateBound(&stream, job->in_len) + 16;
+	if ((job->out = malloc(size)) == NULL) {
+		deflateEnd(&stream);
+		return (-1);
+	}
+	stream.next_in = job->in;
+	stream.avail_in = job->in_len;
+	stream.next_out = job->out;
+	stream.avail_out = size;
+	for (;;) {
+		ret = deflate(&stream, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+		if (ret == Z_STREAM_END ||
+		    (ret == Z_OK && !job->last && stream.avail_out > 0))
+			break;
+		if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			deflateEnd(&stream);
+			return (-1);
+		}
+		/* Out of room; grow the buffer and keep going. */
+		if ((p = realloc(job->out, size * 2)) == NULL) {
+			deflateEnd(&stream);
+			return (-1);
+		}
+		job->out = p;
+		stream.next_out = p + size;
+		stream.avail_out = size;
+		size *= 2;
+	}
+	job->out_len = size - stream.avail_out;
+	deflateEnd(&stream);
+	return (0);
+}
+
+static void *
+gzip_mt_worker(void *arg)
+{
+	struct gzip_mt *mt = (struct gzip_mt *)arg;
+	struct gzip_job *job;
+	int r;
+
+	pthread_mutex_lock(&mt->lock);
+	for (;;) {
+		while (mt->next_job == NULL && !mt->quit)
+			pthread_cond_wait(&mt->changed, &mt->lock);
+		if (mt->quit)
+			break;
+		job = mt->next_job;
+		mt->next_job = job->next;
+		pthread_mutex_unlock(&mt->lock);
+		r = gzip_mt_deflate(job, mt->level);
+		pthread_mutex_lock(&mt->lock);
+		job->status = (r == 0) ? 1 : -1;
+		pthread_cond_broadcast(&mt->changed);
+	}
+	pthread_mutex_unlock(&mt->lock);
+	return (NULL);
+}
+
+static struct gzip_job *
+gzip_mt_job_new(void)
+{
+	struct gzip_job *job;
+
+	if ((job = calloc(1, sizeof(*job))) == NULL)
+		return (NULL);
+	if ((job->in = malloc(GZIP_MT_CHUNK)) == NULL) {
+		free(job);
+		return (NULL);
+	}
+	return (job);
+}
+
+static void
+gzip_mt_job_free(struct gzip_job *job)
+{
+	if (job == NULL)
+		return;
+	free(job->in);
+	free(job->out);
+	free(job);
+}
+
+static struct gzip_mt *
+gzip_mt_new(int level, int nthreads)
+{
+	struct gzip_mt *mt;
+
+	if ((mt = calloc(1, sizeof(*mt))) == NULL)
+		return (NULL);
+	mt->level = level;
+	mt->threads = calloc(nthreads, sizeof(pthread_t));
+	mt->filling = gzip_mt_job_new();
+	if (mt->threads == NULL || mt->filling == NULL) {
+		gzip_mt_job_free(mt->filling);
+		free(mt->threads);
+		free(mt);
+		return (NULL);
+	}
+	pthread_mutex_init(&mt->lock, NULL);
+	pthread_cond_init(&mt->changed, NULL);
+	while (mt->nthreads < nthreads &&
+	    pthread_create(&mt->threads[mt->nthreads], NULL,
+		gzip_mt_worker, mt) == 0)
+		mt->nthreads++;
+	if (mt->nthreads == 0) {
+		gzip_mt_free(mt);
+		return (NULL);
+	}
+	return (mt);
+}
+
+static void
+gzip_mt_free(struct gzip_mt *mt)
+{
+	struct gzip_job *job;
+	int i;
+
+	if (mt == NULL)
+		return;
+	pthread_mutex_lock(&mt->lock);
+	mt->quit = 1;
+	pthread_cond_broadcast(&mt->changed);
+	pthread_mutex_unlock(&mt->lock);
+	for (i = 0; i < mt->nthreads; i++)
+		pthread_join(mt->threads[i], NULL);
+	while ((job = mt->first) != NULL) {
+		mt->first = job->next;
+		gzip_mt_job_free(job);
+	}
+	gzip_mt_job_free(mt->filling);
+	pthread_cond_destroy(&mt->changed);
+	pthread_mutex_destroy(&mt->lock);
+	free(mt->threads);
+	free(mt);
+}
+
+/*
+ * Hand the chunk being filled to the workers and start the next one,
+ * primed with the tail of this one.
+ */
+static int
+gzip_mt_submit(struct gzip_mt *mt, int last)
+{
+	struct gzip_job *job = mt->filling, *next = NULL;
+
+	if (!last) {
+		if ((next = gzip_mt_job_new()) == NULL)
+			return (ARCHIVE_FATAL);
+		next->dict_len = job->in_len < GZIP_MT_DICT ?
+		    job->in_len : GZIP_MT_DICT;
+		memcpy(next->dict, job->in + job->in_len - next->dict_len,
+		    next->dict_len);
+	}
+	job->last = last;
+	mt->filling = next;
+
+	pthread_mutex_lock(&mt->lock);
+	if (mt->last != NULL)
+		mt->last->next = job;
+	else
+		mt->first = job;
+	mt->last = job;
+	if (mt->next_job == NULL)
+		mt->next_job = job;
+	mt->outstanding++;
+	pthread_cond_broadcast(&mt->changed);
+	pthread_mutex_unlock(&mt->lock);
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Wait for the oldest chunk and copy its output into the block buffer.
+ */
+static int
+gzip_mt_collect(struct archive_write *a, struct private_data *state)
+{
+	struct gzip_mt *mt = state->mt;
+	struct gzip_job *job;
+	const unsigned char *p;
+	size_t len, n;
+
+	pthread_mutex_lock(&mt->lock);
+	job = mt->first;
+	while (job->status == 0)
+		pthread_cond_wait(&mt->changed, &mt->lock);
+	if ((mt->first = job->next) == NULL)
+		mt->last = NULL;
+	mt->outstanding--;
+	pthread_mutex_unlock(&mt->lock);
+
+	if (job->status < 0) {
+		gzip_mt_job_free(job);
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "GZip compression failed");
+		return (ARCHIVE_FATAL);
+	}
+	p = job->out;
+	len = job->out_len;
+	while (len > 0) {
+		if (state->stream.avail_out == 0 &&
+		    write_block(a, state) != ARCHIVE_OK) {
+			gzip_mt_job_free(job);
+			return (ARCHIVE_FATAL);
+		}
+		n = len < state->stream.avail_out ?
+		    len : state->stream.avail_out;
+		memcpy(state->stream.next_out, p, n);
+		state->stream.next_out += n;
+		state->stream.avail_out -= n;
+		p += n;
+		len -= n;
+	}
+	gzip_mt_job_free(job);
+	return (ARCHIVE_OK);
+}
+
+/*
+ * drive_compressor() for the threaded case: collect input into
+ * chunks, keeping a couple of chunks per worker in flight.
+ */
+static int
+drive_parallel(struct archive_write *a, struct private_data *state,
+    int finishing)
+{
+	struct gzip_mt *mt = state->mt;
+	size_t n;
+
+	while (state->stream.avail_in > 0) {
+		n = GZIP_MT_CHUNK - mt->filling->in_len;
+		if (n > state->stream.avail_in)
+			n = state->stream.avail_in;
+		memcpy(mt->filling->in + mt->filling->in_len,
+		    state->stream.next_in, n);
+		mt->filling->in_len += n;
+		state->stream.next_in += n;
+		state->stream.avail_in -= n;
+		if (mt->filling->in_len < GZIP_MT_CHUNK)
+			break;
+		if (gzip_mt_submit(mt, 0) != ARCHIVE_OK) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate data for compression");
+			return (ARCHIVE_FATAL);
+		}
+		while (mt->outstanding > 2 * mt->nthreads)
+			if (gzip_mt_collect(a, state) != ARCHIVE_OK)
+				return (ARCHIVE_FATAL);
+	}
+	if (finishing) {
+		gzip_mt_submit(mt, 1);
+		while (mt->first != NULL)
+			if (gzip_mt_collect(a, state) != ARCHIVE_OK)
+				return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
 #endif /* HAVE_ZLIB_H */
@@ -0,0 +1,385 @@
+/*-
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_LZ4FRAME_H
+#include <lz4frame.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_write_private.h"
+
+#if !defined(HAVE_LZ4FRAME_H) || !defined(HAVE_LIBLZ4)
+int
+archive_write_set_compression_lz4(struct archive *a)
+{
+	archive_set_error(a, ARCHIVE_ERRNO_MISC,
+	    "lz4 compression not supported on this platform");
+	return (ARCHIVE_FATAL);
+}
+#else
+/* Don't compile this if we don't have liblz4. */
+
+/*
+ * LZ4F_compressUpdate() wants room for the worst case of whatever it
+ * is given, so input goes through in pieces no larger than this, and
+ * the output of each piece is then copied into the block buffer.
+ */
+#define	LZ4_INPUT_CHUNK	(64 * 1024)
+
+struct private_data {
+	LZ4F_cctx	*cctx;
+	LZ4F_preferences_t prefs;
+	int64_t		 total_in;
+	unsigned char	*frame;		/* output of one LZ4F call */
+	size_t		 frame_size;
+	unsigned char	*compressed;
+	size_t		 compressed_buffer_size;
+	size_t		 compressed_used;
+};
+
+struct private_config {
+	int		 compression_level;
+};
+
+static int	archive_compressor_lz4_init(struct archive_write *);
+static int	archive_compressor_lz4_options(struct archive_write *,
+		    const char *, const char *);
+static int	archive_compressor_lz4_finish(struct archive_write *);
+static int	archive_compressor_lz4_write(struct archive_write *,
+		    const void *, size_t);
+static int	drive_compressor(struct archive_write *, struct private_data *,
+		    const void *, size_t);
+static int	emit(struct archive_write *, struct private_data *, size_t);
+
+
+/*
+ * Allocate, initialize and return a archive object.
+ */
+int
+archive_write_set_compression_lz4(struct archive *_a)
+{
+	struct private_config *config;
+	struct archive_write *a = (struct archive_write *)_a;
+	__archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
+	    ARCHIVE_STATE_NEW, "archive_write_set_compression_lz4");
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		archive_set_error(&a->archive, ENOMEM, "Out of memory");
+		return (ARCHIVE_FATAL);
+	}
+	a->compressor.config = config;
+	a->compressor.finish = archive_compressor_lz4_finish;
+	config->compression_level = 1;
+	a->compressor.init = &archive_compressor_lz4_init;
+	a->compressor.options = &archive_compressor_lz4_options;
+	a->archive.compression_code = ARCHIVE_COMPRESSION_LZ4;
+	a->archive.compression_name = "lz4";
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Setup callback.
+ */
+static int
+archive_compressor_lz4_init(struct archive_write *a)
+{
+	int ret;
+	size_t r;
+	struct private_data *state;
+	struct private_config *config;
+
+	if (a->client_opener != NULL) {
+		ret = (a->client_opener)(&a->archive, a->client_data);
+		if (ret != ARCHIVE_OK)
+			return (ret);
+	}
+
+	state = (struct private_data *)calloc(1, sizeof(*state));
+	if (state == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression");
+		return (ARCHIVE_FATAL);
+	}
+	config = a->compressor.config;
+
+	/* Levels 1 and 2 are the fast compressor, 3 and up lz4hc. */
+	state->prefs.compressionLevel = config->compression_level;
+	state->prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+	state->frame_size = LZ4F_compressBound(LZ4_INPUT_CHUNK, &state->prefs);
+	if (state->frame_size < LZ4F_HEADER_SIZE_MAX)
+		state->frame_size = LZ4F_HEADER_SIZE_MAX;
+	state->compressed_buffer_size = a->bytes_per_block;
+	state->frame = (unsigned char *)malloc(state->frame_size);
+	state->compressed = (unsigned char *)malloc(state->compressed_buffer_size);
+	if (state->frame == NULL || state->compressed == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression buffer");
+		free(state->frame);
+		free(state->compressed);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+
+	/* Initialize compression library; start the frame. */
+	if (LZ4F_isError(LZ4F_createCompressionContext(&state->cctx,
+		LZ4F_VERSION)) ||
+	    LZ4F_isError(r = LZ4F_compressBegin(state->cctx, state->frame,
+		state->frame_size, &state->prefs))) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Internal error initializing compression library");
+		LZ4F_freeCompressionContext(state->cctx);
+		free(state->frame);
+		free(state->compressed);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	a->compressor.write = archive_compressor_lz4_write;
+	a->compressor.data = state;
+	return (emit(a, state, r));
+}
+
+/*
+ * Set write options.
+ */
+static int
+archive_compressor_lz4_options(struct archive_write *a, const char *key,
+    const char *value)
+{
+	struct private_config *config;
+
+	config = (struct private_config *)a->compressor.config;
+	if (strcmp(key, "compression-level") == 0) {
+		if (value == NULL || !(value[0] >= '1' && value[0] <= '9') ||
+		    value[1] != '\0')
+			return (ARCHIVE_WARN);
+		config->compression_level = value[0] - '0';
+		return (ARCHIVE_OK);
+	}
+
+	return (ARCHIVE_WARN);
+}
+
+/*
+ * Write data to the compressed stream.
+ */
+static int
+archive_compressor_lz4_write(struct archive_write *a, const void *buff,
+    size_t length)
+{
+	struct private_data *state;
+	int ret;
+
+	state = (struct private_data *)a->compressor.data;
+	if (a->client_writer == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_PROGRAMMER,
+		    "No write callback is registered?  "
+		    "This is probably an internal programming error.");
+		return (ARCHIVE_FATAL);
+	}
+
+	/* Update statistics */
+	state->total_in += length;
+
+	/* Compress input data to output buffer */
+	if ((ret = drive_compressor(a, state, buff, length)) != ARCHIVE_OK)
+		return (ret);
+
+	a->archive.file_position += length;
+	return (ARCHIVE_OK);
+}
+
+
+/*
+ * Finish the compression...
+ */
+static int
+archive_compressor_lz4_finish(struct archive_write *a)
+{
+	ssize_t block_length, target_block_length, bytes_written;
+	int ret;
+	size_t r;
+	struct private_data *state;
+	unsigned tocopy, n;
+
+	ret = ARCHIVE_OK;
+	state = (struct private_data *)a->compressor.data;
+	if (state != NULL) {
+		if (a->client_writer == NULL) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_PROGRAMMER,
+			    "No write callback is registered?  "
+			    "This is probably an internal programming error.");
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+
+		/* By default, always pad the uncompressed data. */
+		if (a->pad_uncompressed) {
+			tocopy = a->bytes_per_block -
+			    (state->total_in % a->bytes_per_block);
+			while (tocopy > 0 && tocopy < (unsigned)a->bytes_per_block) {
+				n = tocopy < a->null_length ?
+				    tocopy : a->null_length;
+				state->total_in += n;
+				tocopy -= n;
+				ret = drive_compressor(a, state, a->nulls, n);
+				if (ret != ARCHIVE_OK)
+					goto cleanup;
+			}
+		}
+
+		/* Finish compression cycle: end mark and checksum. */
+		r = LZ4F_compressEnd(state->cctx, state->frame,
+		    state->frame_size, NULL);
+		if (LZ4F_isError(r)) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "lz4 compression failed: %s",
+			    LZ4F_getErrorName(r));
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+		if ((ret = emit(a, state, r)) != ARCHIVE_OK)
+			goto cleanup;
+
+		/* Optionally, pad the final compressed block. */
+		block_length = state->compressed_used;
+
+		/* Tricky calculation to determine size of last block. */
+		if (a->bytes_in_last_block <= 0)
+			/* Default or Zero: pad to full block */
+			target_block_length = a->bytes_per_block;
+		else
+			/* Round length to next multiple of bytes_in_last_block. */
+			target_block_length = a->bytes_in_last_block *
+			    ( (block_length + a->bytes_in_last_block - 1) /
+				a->bytes_in_last_block);
+		if (target_block_length > a->bytes_per_block)
+			target_block_length = a->bytes_per_block;
+		if (block_length < target_block_length) {
+			memset(state->compressed + block_length, 0,
+			    target_block_length - block_length);
+			block_length = target_block_length;
+		}
+
+		/* Write the last block */
+		bytes_written = (a->client_writer)(&a->archive, a->client_data,
+		    state->compressed, block_length);
+		if (bytes_written <= 0) {
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+		a->archive.raw_position += bytes_written;
+
+		/* Cleanup: shut down compressor, release memory, etc. */
+	cleanup:
+		LZ4F_freeCompressionContext(state->cctx);
+		free(state->frame);
+		free(state->compressed);
+		free(state);
+	}
+	free(a->compressor.config);
+	a->compressor.config = NULL;
+	return (ret);
+}
+
+/*
+ * Copy the first len bytes of the frame buffer into the block buffer,
+ * writing full output blocks as necessary.
+ */
+static int
+emit(struct archive_write *a, struct private_data *state, size_t len)
+{
+	const unsigned char *p = state->frame;
+	ssize_t bytes_written;
+	size_t n;
+
+	while (len > 0) {
+		if (state->compressed_used == state->compressed_buffer_size) {
+			bytes_written = (a->client_writer)(&a->archive,
+			    a->client_data, state->compressed,
+			    state->compressed_buffer_size);
+			if (bytes_written <= 0) {
+				/* TODO: Handle this write failure */
+				return (ARCHIVE_FATAL);
+			} else if ((size_t)bytes_written < state->compressed_buffer_size) {
+				/* Short write: Move remaining to
+				 * front of block and keep filling */
+				memmove(state->compressed,
+				    state->compressed + bytes_written,
+				    state->compressed_buffer_size - bytes_written);
+			}
+			a->archive.raw_position += bytes_written;
+			state->compressed_used
+			    = state->compressed_buffer_size - bytes_written;
+		}
+		n = state->compressed_buffer_size - state->compressed_used;
+		if (n > len)
+			n = len;
+		memcpy(state->compressed + state->compressed_used, p, n);
+		state->compressed_used += n;
+		p += n;
+		len -= n;
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Utility function to push input data through compressor.
+ */
+static int
+drive_compressor(struct archive_write *a, struct private_data *state,
+    const void *buff, size_t length)
+{
+	const char *p = buff;
+	size_t n, r;
+
+	while (length > 0) {
+		n = length < LZ4_INPUT_CHUNK ? length : LZ4_INPUT_CHUNK;
+		r = LZ4F_compressUpdate(state->cctx, state->frame,
+		    state->frame_size, p, n, NULL);
+		if (LZ4F_isError(r)) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "lz4 compression failed: %s",
+			    LZ4F_getErrorName(r));
+			return (ARCHIVE_FATAL);
+		}
+		if (emit(a, state, r) != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+		p += n;
+		length -= n;
+	}
+	return (ARCHIVE_OK);
+}
+
+#endif /* HAVE_LZ4FRAME_H && HAVE_LIBLZ4 */
@@ -38,6 +38,9 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_compression_xz.c 20110
 #include <string.h>
 #endif
 #include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #ifdef HAVE_LZMA_H
 #include <lzma.h>
 #endif
@@ -76,8 +79,15 @@ struct private_data {
 
 struct private_config {
 	int		 compression_level;
+	int		 threads;
 };
 
+/* liblzma 5.2 and later can split an xz stream into blocks and
+ * compress them on several threads. */
+#if defined(LZMA_VERSION) && LZMA_VERSION >= 50020002
+#define	HAVE_LZMA_STREAM_ENCODER_MT	1
+#endif
+
 static int	archive_compressor_xz_init(struct archive_write *);
 static int	archive_compressor_xz_options(struct archive_write *,
 		    const char *, const char *);
@@ -106,6 +116,7 @@ archive_write_set_compression_xz(struct archive *_a)
 	a->compressor.config = config;
 	a->compressor.finish = archive_compressor_xz_finish;
 	config->compression_level = LZMA_PRESET_DEFAULT;
+	config->threads = 1;
 	a->compressor.init = &archive_compressor_xz_init;
 	a->compressor.options = &archive_compressor_xz_options;
 	a->archive.compression_code = ARCHIVE_COMPRESSION_XZ;
@@ -132,12 +143,32 @@ static int
 archive_compressor_xz_init_stream(struct archive_write *a,
     struct private_data *state)
 {
+	struct private_config *config = a->compressor.config;
 	int ret;
 
 	state->stream = (lzma_stream)LZMA_STREAM_INIT;
 	state->stream.next_out = state->compressed;
 	state->stream.avail_out = state->compressed_buffer_size;
-	if (a->archive.compression_code == ARCHIVE_COMPRESSION_XZ)
+	ret = LZMA_OPTIONS_ERROR;
+#ifdef HAVE_LZMA_STREAM_ENCODER_MT
+	if (a->archive.compression_code == ARCHIVE_COMPRESSION_XZ &&
+	    config->threads > 1) {
+		lzma_mt mt;
+
+		memset(&mt, 0, sizeof(mt));
+		mt.threads = config->threads;
+		mt.filters = state->lzmafilters;
+		mt.check = LZMA_CHECK_CRC64;
+		ret = lzma_stream_encoder_mt(&(state->stream), &mt);
+		/* A liblzma built without threads says so here;
+		 * use the single-threaded encoder then. */
+	}
+#else
+	(void)config; /* UNUSED */
+#endif
+	if (ret == LZMA_OK)
+		;
+	else if (a->archive.compression_code == ARCHIVE_COMPRESSION_XZ)
 		ret = lzma_stream_encoder(&(state->stream),
 		    state->lzmafilters, LZMA_CHECK_CRC64);
 	else
@@ -240,6 +271,23 @@ archive_compressor_xz_options(struct archive_write *a, const char *key,
 			config->compression_level = 6;
 		return (ARCHIVE_OK);
 	}
+	if (strcmp(key, "threads") == 0) {
+		char *end;
+		long n;
+
+		if (value == NULL)
+			return (ARCHIVE_WARN);
+		n = strtol(value, &end, 10);
+		if (*end != '\0' || n < 0 || n > 256)
+			return (ARCHIVE_WARN);
+#ifdef _SC_NPROCESSORS_ONLN
+		/* threads=0: one per CPU. */
+		if (n == 0)
+			n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		config->threads = n > 1 ? (int)n : 1;
+		return (ARCHIVE_OK);
+	}
 
 	return (ARCHIVE_WARN);
 }
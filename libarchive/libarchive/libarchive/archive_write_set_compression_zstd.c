@@ -0,0 +1,377 @@
+/*-
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_write_private.h"
+
+#if !defined(HAVE_ZSTD_H) || !defined(HAVE_LIBZSTD)
+int
+archive_write_set_compression_zstd(struct archive *a)
+{
+	archive_set_error(a, ARCHIVE_ERRNO_MISC,
+	    "zstd compression not supported on this platform");
+	return (ARCHIVE_FATAL);
+}
+#else
+/* Don't compile this if we don't have libzstd. */
+
+struct private_data {
+	ZSTD_CCtx	*cctx;
+	ZSTD_outBuffer	 out;
+	int64_t		 total_in;
+	unsigned char	*compressed;
+	size_t		 compressed_buffer_size;
+};
+
+struct private_config {
+	int		 compression_level;
+	int		 threads;
+};
+
+static int	archive_compressor_zstd_init(struct archive_write *);
+static int	archive_compressor_zstd_options(struct archive_write *,
+		    const char *, const char *);
+static int	archive_compressor_zstd_finish(struct archive_write *);
+static int	archive_compressor_zstd_write(struct archive_write *,
+		    const void *, size_t);
+static int	drive_compressor(struct archive_write *, struct private_data *,
+		    ZSTD_inBuffer *, int finishing);
+
+
+/*
+ * Allocate, initialize and return a archive object.
+ */
+int
+archive_write_set_compression_zstd(struct archive *_a)
+{
+	struct private_config *config;
+	struct archive_write *a = (struct archive_write *)_a;
+	__archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
+	    ARCHIVE_STATE_NEW, "archive_write_set_compression_zstd");
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		archive_set_error(&a->archive, ENOMEM, "Out of memory");
+		return (ARCHIVE_FATAL);
+	}
+	a->compressor.config = config;
+	a->compressor.finish = archive_compressor_zstd_finish;
+	config->compression_level = 3; /* zstd's own default */
+	config->threads = 1;
+	a->compressor.init = &archive_compressor_zstd_init;
+	a->compressor.options = &archive_compressor_zstd_options;
+	a->archive.compression_code = ARCHIVE_COMPRESSION_ZSTD;
+	a->archive.compression_name = "zstd";
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Setup callback.
+ */
+static int
+archive_compressor_zstd_init(struct archive_write *a)
+{
+	int ret;
+	struct private_data *state;
+	struct private_config *config;
+
+	if (a->client_opener != NULL) {
+		ret = (a->client_opener)(&a->archive, a->client_data);
+		if (ret != ARCHIVE_OK)
+			return (ret);
+	}
+
+	state = (struct private_data *)calloc(1, sizeof(*state));
+	if (state == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression");
+		return (ARCHIVE_FATAL);
+	}
+	config = a->compressor.config;
+
+	state->compressed_buffer_size = a->bytes_per_block;
+	state->compressed = (unsigned char *)malloc(state->compressed_buffer_size);
+	if (state->compressed == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression buffer");
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	state->out.dst = state->compressed;
+	state->out.size = state->compressed_buffer_size;
+	state->out.pos = 0;
+
+	/* Initialize compression library. */
+	state->cctx = ZSTD_createCCtx();
+	if (state->cctx == NULL ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(state->cctx,
+		ZSTD_c_compressionLevel, config->compression_level))) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Internal error initializing compression library");
+		ZSTD_freeCCtx(state->cctx);
+		free(state->compressed);
+		free(state);
+		return (ARCHIVE_FATAL);
+	}
+	/* A libzstd built without threads refuses this; that's fine. */
+	if (config->threads > 1)
+		ZSTD_CCtx_setParameter(state->cctx, ZSTD_c_nbWorkers,
+		    config->threads);
+
+	a->compressor.write = archive_compressor_zstd_write;
+	a->compressor.data = state;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Set write options.
+ */
+static int
+archive_compressor_zstd_options(struct archive_write *a, const char *key,
+    const char *value)
+{
+	struct private_config *config;
+	char *end;
+	long n;
+
+	config = (struct private_config *)a->compressor.config;
+	if (value == NULL)
+		return (ARCHIVE_WARN);
+	n = strtol(value, &end, 10);
+	if (*end != '\0')
+		return (ARCHIVE_WARN);
+	if (strcmp(key, "compression-level") == 0) {
+		if (n < 1 || n > ZSTD_maxCLevel())
+			return (ARCHIVE_WARN);
+		config->compression_level = (int)n;
+		return (ARCHIVE_OK);
+	}
+	if (strcmp(key, "threads") == 0) {
+		if (n < 0 || n > 256)
+			return (ARCHIVE_WARN);
+#ifdef _SC_NPROCESSORS_ONLN
+		/* threads=0: one per CPU. */
+		if (n == 0)
+			n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		config->threads = n > 1 ? (int)n : 1;
+		return (ARCHIVE_OK);
+	}
+
+	return (ARCHIVE_WARN);
+}
+
+/*
+ * Write data to the compressed stream.
+ */
+static int
+archive_compressor_zstd_write(struct archive_write *a, const void *buff,
+    size_t length)
+{
+	struct private_data *state;
+	ZSTD_inBuffer in;
+	int ret;
+
+	state = (struct private_data *)a->compressor.data;
+	if (a->client_writer == NULL) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_PROGRAMMER,
+		    "No write callback is registered?  "
+		    "This is probably an internal programming error.");
+		return (ARCHIVE_FATAL);
+	}
+
+	/* Update statistics */
+	state->total_in += length;
+
+	/* Compress input data to output buffer */
+	in.src = buff;
+	in.size = length;
+	in.pos = 0;
+	if ((ret = drive_compressor(a, state, &in, 0)) != ARCHIVE_OK)
+		return (ret);
+
+	a->archive.file_position += length;
+	return (ARCHIVE_OK);
+}
+
+
+/*
+ * Finish the compression...
+ */
+static int
+archive_compressor_zstd_finish(struct archive_write *a)
+{
+	ssize_t block_length, target_block_length, bytes_written;
+	int ret;
+	struct private_data *state;
+	ZSTD_inBuffer in;
+	unsigned tocopy;
+
+	ret = ARCHIVE_OK;
+	state = (struct private_data *)a->compressor.data;
+	if (state != NULL) {
+		if (a->client_writer == NULL) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_PROGRAMMER,
+			    "No write callback is registered?  "
+			    "This is probably an internal programming error.");
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+
+		/* By default, always pad the uncompressed data. */
+		if (a->pad_uncompressed) {
+			tocopy = a->bytes_per_block -
+			    (state->total_in % a->bytes_per_block);
+			while (tocopy > 0 && tocopy < (unsigned)a->bytes_per_block) {
+				in.src = a->nulls;
+				in.size = tocopy < a->null_length ?
+				    tocopy : a->null_length;
+				in.pos = 0;
+				state->total_in += in.size;
+				tocopy -= in.size;
+				ret = drive_compressor(a, state, &in, 0);
+				if (ret != ARCHIVE_OK)
+					goto cleanup;
+			}
+		}
+
+		/* Finish compression cycle */
+		in.src = NULL;
+		in.size = 0;
+		in.pos = 0;
+		if (((ret = drive_compressor(a, state, &in, 1))) != ARCHIVE_OK)
+			goto cleanup;
+
+		/* Optionally, pad the final compressed block. */
+		block_length = state->out.pos;
+
+		/* Tricky calculation to determine size of last block. */
+		if (a->bytes_in_last_block <= 0)
+			/* Default or Zero: pad to full block */
+			target_block_length = a->bytes_per_block;
+		else
+			/* Round length to next multiple of bytes_in_last_block. */
+			target_block_length = a->bytes_in_last_block *
+			    ( (block_length + a->bytes_in_last_block - 1) /
+				a->bytes_in_last_block);
+		if (target_block_length > a->bytes_per_block)
+			target_block_length = a->bytes_per_block;
+		if (block_length < target_block_length) {
+			memset(state->compressed + block_length, 0,
+			    target_block_length - block_length);
+			block_length = target_block_length;
+		}
+
+		/* Write the last block */
+		bytes_written = (a->client_writer)(&a->archive, a->client_data,
+		    state->compressed, block_length);
+		if (bytes_written <= 0) {
+			ret = ARCHIVE_FATAL;
+			goto cleanup;
+		}
+		a->archive.raw_position += bytes_written;
+
+		/* Cleanup: shut down compressor, release memory, etc. */
+	cleanup:
+		ZSTD_freeCCtx(state->cctx);
+		free(state->compressed);
+		free(state);
+	}
+	free(a->compressor.config);
+	a->compressor.config = NULL;
+	return (ret);
+}
+
+/*
+ * Utility function to push input data through compressor,
+ * writing full output blocks as necessary.
+ *
+ * Note that this handles both the regular write case (finishing ==
+ * false) and the end-of-archive case (finishing == true).
+ */
+static int
+drive_compressor(struct archive_write *a, struct private_data *state,
+    ZSTD_inBuffer *in, int finishing)
+{
+	ssize_t bytes_written;
+	size_t ret;
+
+	for (;;) {
+		if (state->out.pos == state->out.size) {
+			bytes_written = (a->client_writer)(&a->archive,
+			    a->client_data, state->compressed,
+			    state->compressed_buffer_size);
+			if (bytes_written <= 0) {
+				/* TODO: Handle this write failure */
+				return (ARCHIVE_FATAL);
+			} else if ((size_t)bytes_written < state->compressed_buffer_size) {
+				/* Short write: Move remaining to
+				 * front of block and keep filling */
+				memmove(state->compressed,
+				    state->compressed + bytes_written,
+				    state->compressed_buffer_size - bytes_written);
+			}
+			a->archive.raw_position += bytes_written;
+			state->out.pos
+			    = state->compressed_buffer_size - bytes_written;
+		}
+
+		/* If there's nothing to do, we're done. */
+		if (!finishing && in->pos == in->size)
+			return (ARCHIVE_OK);
+
+		ret = ZSTD_compressStream2(state->cctx, &state->out, in,
+		    finishing ? ZSTD_e_end : ZSTD_e_continue);
+		if (ZSTD_isError(ret)) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "zstd compression failed: %s",
+			    ZSTD_getErrorName(ret));
+			return (ARCHIVE_FATAL);
+		}
+		/* With ZSTD_e_end, 0 means the frame is complete. */
+		if (finishing && ret == 0)
+			return (ARCHIVE_OK);
+		if (!finishing && in->pos == in->size)
+			return (ARCHIVE_OK);
+	}
+}
+
+#endif /* HAVE_ZSTD_H && HAVE_LIBZSTD */
@@ -367,13 +367,10 @@ archive_write_shar_data_sed(struct archive_write *a, const void *buff, size_t n)
 		shar->end_of_line = 0;
 	}
 
-	while (n-- != 0) {
-		if ((*buf++ = *src++) == '\n') {
-			if (n == 0)
-				shar->end_of_line = 1;
-			else
-				*buf++ = 'X';
-		}
+	/* Copy a line, or as much of it as fits, at a time. */
+	while (n != 0) {
+		size_t chunk;
+		const char *nl;
 
 		if (buf >= buf_end) {
 			shar->work.length = buf - shar->work.s;
@@ -384,6 +381,21 @@ archive_write_shar_data_sed(struct archive_write *a, const void *buff, size_t n)
 			archive_string_empty(&shar->work);
 			buf = shar->work.s;
 		}
+		chunk = buf_end - buf;
+		if (chunk > n)
+			chunk = n;
+		if ((nl = memchr(src, '\n', chunk)) != NULL)
+			chunk = nl + 1 - src;
+		memcpy(buf, src, chunk);
+		buf += chunk;
+		src += chunk;
+		n -= chunk;
+		if (nl != NULL) {
+			if (n == 0)
+				shar->end_of_line = 1;
+			else
+				*buf++ = 'X';
+		}
 	}
 
 	shar->work.length = buf - shar->work.s;
@@ -391,7 +403,10 @@ archive_write_shar_data_sed(struct archive_write *a, const void *buff, size_t n)
 	return (written);
 }
 
-#define	UUENC(c)	(((c)!=0) ? ((c) & 077) + ' ': '`')
+static const char uuenc_tab[64] =
+    "`!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_";
+
+#define	UUENC(c)	(uuenc_tab[(c) & 077])
 
 static void
 uuencode_group(const char _in[3], char out[4])
@@ -432,7 +447,7 @@ uuencode_line(struct shar *shar, const char *inbuf, size_t len)
 		else
 			tmp_buf[1] = inbuf[1];
 		tmp_buf[2] = '\0';
-		uuencode_group(inbuf, buf);
+		uuencode_group(tmp_buf, buf);
 		buf += 4;
 	}
 	*buf++ = '\n';
@@ -465,6 +480,7 @@ archive_write_shar_data_uuencode(struct archive_write *a, const void *buff,
 			return length;
 		}
 		uuencode_line(shar, shar->outbuff, 45);
+		shar->outpos = 0;
 		src += n;
 		n = length - n;
 	} else {
@@ -67,6 +67,7 @@ DEFINE_TEST(test_read_format_txz)
 DEFINE_TEST(test_read_format_tz)
 DEFINE_TEST(test_read_format_xar)
 DEFINE_TEST(test_read_format_zip)
+DEFINE_TEST(test_read_format_zip_seek)
 DEFINE_TEST(test_read_large)
 DEFINE_TEST(test_read_pax_truncated)
 DEFINE_TEST(test_read_position)
@@ -78,9 +79,11 @@ DEFINE_TEST(test_ustar_filenames)
 DEFINE_TEST(test_write_compress)
 DEFINE_TEST(test_write_compress_bzip2)
 DEFINE_TEST(test_write_compress_gzip)
+DEFINE_TEST(test_write_compress_lz4)
 DEFINE_TEST(test_write_compress_lzma)
 DEFINE_TEST(test_write_compress_program)
 DEFINE_TEST(test_write_compress_xz)
+DEFINE_TEST(test_write_compress_zstd)
 DEFINE_TEST(test_write_disk)
 DEFINE_TEST(test_write_disk_failures)
 DEFINE_TEST(test_write_disk_hardlink)
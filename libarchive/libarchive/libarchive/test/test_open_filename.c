@@ -30,6 +30,8 @@ DEFINE_TEST(test_open_filename)
 	char buff[64];
 	struct archive_entry *ae;
 	struct archive *a;
+	char *data, *data2;
+	size_t i;
 
 	/* Write an archive through this FILE *. */
 	assert((a = archive_write_new()) != NULL);
@@ -95,6 +97,53 @@ DEFINE_TEST(test_open_filename)
 	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
 	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
 
+	/*
+	 * Read a large entry back in one piece, past a skipped one;
+	 * regular files are mapped, so this crosses no block boundary
+	 * even with a tiny block size.
+	 */
+	data = malloc(1000000);
+	data2 = malloc(1000000);
+	assert(data != NULL && data2 != NULL);
+	for (i = 0; i < 1000000; i++)
+		data[i] = (char)(i * 7 + i / 4096);
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_none(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_filename(a, "test2.tar"));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "skipped");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, 300000);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualIntA(a, 300000, archive_write_data(a, data, 300000));
+	archive_entry_copy_pathname(ae, "big");
+	archive_entry_set_size(ae, 1000000);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualIntA(a, 1000000, archive_write_data(a, data, 1000000));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_compression_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_filename(a, "test2.tar", 512));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("skipped", archive_entry_pathname(ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_data_skip(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("big", archive_entry_pathname(ae));
+	assertEqualIntA(a, 1000000, archive_read_data(a, data2, 1000000));
+	assertEqualMem(data2, data, 1000000);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+	free(data);
+	free(data2);
+
 	/*
 	 * Verify some of the error handling.
 	 */
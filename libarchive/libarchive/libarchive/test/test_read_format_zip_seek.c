@@ -0,0 +1,142 @@
+/*-
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test.h"
+
+/*
+ * A zip read from a seekable source is visited through its central
+ * directory: entries written with the sizes after the data get their
+ * size up front, skipped entries are never read, and a stub in front
+ * of the archive does not confuse the offsets.  A plain stream still
+ * reads the local headers in order.
+ */
+
+static size_t
+make_zip(char *buff, size_t buffsize, size_t prefix)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	size_t used;
+	char data[2000];
+	char path[16];
+	int i;
+
+	/* Something that looks like a self-extractor. */
+	memset(buff, 0, prefix);
+	if (prefix >= 2)
+		memcpy(buff, "MZ", 2);
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+#ifdef HAVE_ZLIB_H
+	/* The reader only recognizes a stub in front of deflated data. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_format_options(a, "zip:compression=deflate"));
+#endif
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_compression_none(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_bytes_per_block(a, 0));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_open_memory(a,
+	    buff + prefix, buffsize - prefix, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	for (i = 0; i < 10; i++) {
+		sprintf(path, "file%d", i);
+		archive_entry_copy_pathname(ae, path);
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, 1000 + i);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		memset(data, 'a' + i, 1000 + i);
+		assertEqualInt(1000 + i, archive_write_data(a, data, 1000 + i));
+	}
+	archive_entry_free(ae);
+	assertEqualInt(ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_finish(a));
+	return (prefix + used);
+}
+
+static void
+read_zip(char *buff, size_t used, int seekable, int indexed)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char data[2000];
+	char path[16];
+	int i;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	if (seekable)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_open_memory(a, buff, used));
+	else
+		assertEqualIntA(a, ARCHIVE_OK,
+		    read_open_memory(a, buff, used, 7));
+	for (i = 0; i < 10; i++) {
+		sprintf(path, "file%d", i);
+		if (!assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae)))
+			break;
+		assertEqualString(path, archive_entry_pathname(ae));
+		if (indexed)
+			assertEqualInt(1000 + i, archive_entry_size(ae));
+		else
+			assertEqualInt(0, archive_entry_size(ae));
+		/* Read every other entry; skip the rest. */
+		if (i % 2)
+			continue;
+		assertEqualIntA(a, 1000 + i,
+		    archive_read_data(a, data, sizeof(data)));
+		assertEqualInt('a' + i, data[0]);
+		assertEqualInt('a' + i, data[999 + i]);
+	}
+	if (i == 10)
+		assertEqualIntA(a, ARCHIVE_EOF,
+		    archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_finish(a));
+}
+
+DEFINE_TEST(test_read_format_zip_seek)
+{
+	size_t buffsize = 100000;
+	char *buff;
+	size_t used;
+
+	assert((buff = malloc(buffsize)) != NULL);
+
+	used = make_zip(buff, buffsize, 0);
+	read_zip(buff, used, 1, 1);
+	read_zip(buff, used, 0, 0);
+
+#ifdef HAVE_ZLIB_H
+	/* Offsets in the directory don't count the stub.  (The bidder
+	 * wants 4k beyond the stub to recognize it.) */
+	used = make_zip(buff, buffsize, 5000);
+	read_zip(buff, used, 1, 1);
+	read_zip(buff, used, 0, 0);
+#endif
+
+	/* Without its end record, fall back to reading in order. */
+	used = make_zip(buff, buffsize, 0);
+	read_zip(buff, used - 22, 1, 0);
+
+	free(buff);
+}
@@ -135,7 +135,8 @@ DEFINE_TEST(test_write_format_zip)
 	assertEqualInt(0, archive_entry_ctime(ae));
 	assertEqualString("file", archive_entry_pathname(ae));
 	//assertEqualInt((S_IFREG | 0755), archive_entry_mode(ae));
-	assertEqualInt(0, archive_entry_size(ae));
+	/* The size comes from the central directory. */
+	assertEqualInt(8, archive_entry_size(ae));
 	assertEqualIntA(a, 8,
 	    archive_read_data(a, filedata, sizeof(filedata)));
 	assertEqualMem(filedata, "12345678", 8);
@@ -154,7 +155,7 @@ DEFINE_TEST(test_write_format_zip)
 	assertEqualInt(0, archive_entry_ctime(ae));
 	assertEqualString("file2", archive_entry_pathname(ae));
 	//assert((S_IFREG | 0755) == archive_entry_mode(ae));
-	assertEqualInt(0, archive_entry_size(ae));
+	assertEqualInt(4, archive_entry_size(ae));
 	assertEqualIntA(a, 4,
 	    archive_read_data(a, filedata, sizeof(filedata)));
 	assertEqualMem(filedata, "1234", 4);
@@ -72,6 +72,7 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/bsdtar.c,v 1.93 2008/11/08 04:43:24 kientzle
 #include "bsdtar.h"
 #include "lafe_err.h"
 #include "ios_error.h"
+#undef optarg	/* ios_error.h maps it to getopt's; we use bsdtar->optarg */
 
 #ifdef __MINGW32__
 int _CRT_glob = 0; /* Disable broken CRT globbing. */
@@ -224,6 +225,9 @@ tar_main(int argc, char **argv)
 	 */
 	while ((opt = bsdtar_getopt(bsdtar)) != -1) {
 		switch (opt) {
+		case 'a': /* GNU tar */
+			bsdtar->option_auto_compress = 1;
+			break;
 		case 'B': /* GNU tar */
 			/* libarchive doesn't need this; just ignore it. */
 			break;
@@ -328,6 +332,13 @@ tar_main(int argc, char **argv)
 			/* GNU tar 1.13  used -l for --one-file-system */
 			bsdtar->option_warn_links = 1;
 			break;
+		case OPTION_LZ4:
+			if (bsdtar->create_compression != '\0')
+				lafe_errc(1, 0,
+				    "Can't specify both -%c and -%c", opt,
+				    bsdtar->create_compression);
+			bsdtar->create_compression = opt;
+			break;
 		case OPTION_LZMA:
 			if (bsdtar->create_compression != '\0')
 				lafe_errc(1, 0,
@@ -458,6 +469,12 @@ tar_main(int argc, char **argv)
 			set_mode(bsdtar, opt);
 			bsdtar->verbose++;
 			break;
+		case OPTION_THREADS: /* ios_system */
+			bsdtar->threads = atoi(bsdtar->optarg);
+			if (bsdtar->threads < 1)
+				lafe_errc(1, 0,
+				    "Argument to --threads must be positive");
+			break;
 		case OPTION_TOTALS: /* GNU tar */
 			bsdtar->option_totals++;
 			break;
@@ -518,6 +535,13 @@ tar_main(int argc, char **argv)
 		case OPTION_USE_COMPRESS_PROGRAM:
 			bsdtar->compress_program = bsdtar->optarg;
 			break;
+		case OPTION_ZSTD:
+			if (bsdtar->create_compression != '\0')
+				lafe_errc(1, 0,
+				    "Can't specify both -%c and -%c", opt,
+				    bsdtar->create_compression);
+			bsdtar->create_compression = opt;
+			break;
 		default:
 			usage();
 		}
@@ -539,6 +563,8 @@ tar_main(int argc, char **argv)
 		    "Must specify one of -c, -r, -t, -u, -x");
 
 	/* Check boolean options only permitted in certain modes. */
+	if (bsdtar->option_auto_compress)
+		only_mode(bsdtar, "-a", "c");
 	if (bsdtar->option_dont_traverse_mounts)
 		only_mode(bsdtar, "--one-file-system", "cru");
 	if (bsdtar->option_fast_read)
@@ -590,6 +616,8 @@ tar_main(int argc, char **argv)
 	}
 	if (bsdtar->strip_components != 0)
 		only_mode(bsdtar, "--strip-components", "xt");
+	if (bsdtar->threads != 0)
+		only_mode(bsdtar, "--threads", "cx");
 
 	switch(bsdtar->mode) {
 	case 'c':
@@ -677,6 +705,8 @@ static const char *long_help_msg =
 	"Create: %p -c [options] [<file> | <dir> | @<archive> | -C <dir> ]\n"
 	"  <file>, <dir>  add these items to archive\n"
 	"  -z, -j, -J, --lzma  Compress archive with gzip/bzip2/xz/lzma\n"
+	"  --zstd, --lz4  Compress archive with zstd/lz4\n"
+	"  -a    Choose compression from the archive suffix\n"
 	"  --format {ustar|pax|cpio|shar}  Select archive format\n"
 	"  --exclude <pattern>  Skip files that match pattern\n"
 	"  -C <dir>  Change to <dir> before processing remaining files\n"
@@ -32,6 +32,9 @@
 
 #define	DEFAULT_BYTES_PER_BLOCK	(20*512)
 
+/* bsdtar parses its own options; it does not use getopt's optarg. */
+#undef	optarg
+
 /*
  * The internal state for the "bsdtar" program.
  *
@@ -54,9 +57,11 @@ struct bsdtar {
 	int		  verbose;   /* -v */
 	int		  extract_flags; /* Flags for extract operation */
 	int		  strip_components; /* Remove this many leading dirs */
+	int		  threads; /* --threads */
 	char		  mode; /* Program mode: 'c', 't', 'r', 'u', 'x' */
 	char		  symlink_mode; /* H or L, per BSD conventions */
 	char		  create_compression; /* j, y, or z */
+	char		  option_auto_compress; /* -a */
 	const char	 *compress_program;
 	char		  option_absolute_paths; /* -P */
 	char		  option_chroot; /* --chroot */
@@ -117,6 +122,7 @@ enum {
 	OPTION_HELP,
 	OPTION_INCLUDE,
 	OPTION_KEEP_NEWER_FILES,
+	OPTION_LZ4,
 	OPTION_LZMA,
 	OPTION_NEWER_CTIME,
 	OPTION_NEWER_CTIME_THAN,
@@ -131,9 +137,11 @@ enum {
 	OPTION_POSIX,
 	OPTION_SAME_OWNER,
 	OPTION_STRIP_COMPONENTS,
+	OPTION_THREADS,
 	OPTION_TOTALS,
 	OPTION_USE_COMPRESS_PROGRAM,
-	OPTION_VERSION
+	OPTION_VERSION,
+	OPTION_ZSTD
 };
 
 
@@ -65,6 +65,7 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/read.c,v 1.40 2008/08/21 06:41:14 kientzle E
 #include <unistd.h>
 #endif
 #include <sys/queue.h>
+#include <pthread.h>
 #include <copyfile.h>
 #include <fcntl.h>
 #include <libgen.h>
@@ -95,6 +96,41 @@ struct copyfile_list_entry_t {
 	LIST_ENTRY(copyfile_list_entry_t) link;
 };
 
+/*
+ * Parallel extraction (--threads): the archive is still read in order on
+ * the command's thread, but small regular files are read into memory and
+ * written out by a pool of threads, each with an archive_write_disk of its
+ * own.  Everything else (directories, links, large files) is extracted in
+ * place as before; the hard links, symlinks and special files wait for the
+ * pool to be idle, since they can refer to files it has not written yet.
+ * Directory times and modes are still fixed up last, by archive_read_close().
+ */
+#define	EXTRACT_MAX_ENTRY	(4 * 1024 * 1024) /* larger ones are streamed */
+#define	EXTRACT_BUDGET		(64 * 1024 * 1024) /* file data queued at most */
+
+struct extract_job {
+	struct extract_job	*next;
+	struct archive_entry	*entry;
+	void			*data;
+	size_t			 size;
+};
+
+struct extract_pool {
+	struct bsdtar		*bsdtar;
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 changed;
+	struct extract_job	*first, *last;
+	size_t			 queued;	/* bytes of data in the queue */
+	int			 busy;		/* jobs being written */
+	int			 done;		/* no more jobs coming */
+	int			 nthreads;
+	pthread_t		*threads;
+	FILE			*out, *err;	/* the command's streams */
+#ifdef HAVE_QUARANTINE
+	qtn_file_t		 qf;
+#endif
+};
+
 static void	list_item_verbose(struct bsdtar *, FILE *,
 		    struct archive_entry *);
 static void	read_archive(struct bsdtar *bsdtar, char mode);
@@ -169,6 +205,198 @@ _qtnapply(struct bsdtar *bsdtar, qtn_file_t qf, char *path)
 }
 #endif /* HAVE_QUARANTINE */
 
+static void
+extract_job_free(struct extract_job *job)
+{
+	archive_entry_free(job->entry);
+	free(job->data);
+	free(job);
+}
+
+static void *
+extract_worker(void *arg)
+{
+	struct extract_pool *pool = arg;
+	struct bsdtar *bsdtar = pool->bsdtar;
+	struct extract_job *job;
+	struct archive *ext;
+	const char *error;
+	int r;
+
+	thread_stdout = pool->out;
+	thread_stderr = pool->err;
+	ext = archive_write_disk_new();
+	if (ext != NULL) {
+		archive_write_disk_set_options(ext, bsdtar->extract_flags);
+		archive_write_disk_set_standard_lookup(ext);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->first == NULL && !pool->done)
+			pthread_cond_wait(&pool->changed, &pool->lock);
+		if ((job = pool->first) == NULL)
+			break;
+		if ((pool->first = job->next) == NULL)
+			pool->last = NULL;
+		pool->busy++;
+		pthread_mutex_unlock(&pool->lock);
+
+		error = "Can't allocate a disk writer";
+		r = ARCHIVE_FATAL;
+		if (ext != NULL) {
+			r = archive_write_header(ext, job->entry);
+			if (r >= ARCHIVE_WARN && job->size > 0 &&
+			    archive_write_data(ext, job->data, job->size) !=
+			    (ssize_t)job->size)
+				r = ARCHIVE_FATAL;
+			if (r >= ARCHIVE_WARN) {
+				int r2 = archive_write_finish_entry(ext);
+				if (r2 < r)
+					r = r2;
+			}
+			error = archive_error_string(ext);
+		}
+#ifdef HAVE_QUARANTINE
+		if (r == ARCHIVE_OK)
+			_qtnapply(bsdtar, pool->qf,
+			    (char *)archive_entry_pathname(job->entry));
+#endif /* HAVE_QUARANTINE */
+
+		pthread_mutex_lock(&pool->lock);
+		if (r != ARCHIVE_OK) {
+			safe_fprintf(thread_stderr, "%s: %s\n",
+			    archive_entry_pathname(job->entry),
+			    error != NULL ? error : "Write failed");
+			bsdtar->return_value = 1;
+		}
+		pool->queued -= job->size;
+		pool->busy--;
+		pthread_cond_broadcast(&pool->changed);
+		pthread_mutex_unlock(&pool->lock);
+		extract_job_free(job);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (ext != NULL)
+		archive_write_finish(ext);
+	return (NULL);
+}
+
+static struct extract_pool *
+extract_pool_start(struct bsdtar *bsdtar)
+{
+	struct extract_pool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return (NULL);
+	pool->threads = calloc(bsdtar->threads, sizeof(pthread_t));
+	if (pool->threads == NULL) {
+		free(pool);
+		return (NULL);
+	}
+	pool->bsdtar = bsdtar;
+	pool->out = thread_stdout;
+	pool->err = thread_stderr;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->changed, NULL);
+	while (pool->nthreads < bsdtar->threads &&
+	    pthread_create(&pool->threads[pool->nthreads], NULL,
+	    extract_worker, pool) == 0)
+		pool->nthreads++;
+	if (pool->nthreads == 0) {
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->changed);
+		free(pool->threads);
+		free(pool);
+		return (NULL);
+	}
+	return (pool);
+}
+
+/* Wait until every file handed to the pool is on disk. */
+static void
+extract_pool_wait(struct extract_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->first != NULL || pool->busy > 0)
+		pthread_cond_wait(&pool->changed, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+extract_pool_finish(struct extract_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->done = 1;
+	pthread_cond_broadcast(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->changed);
+	free(pool->threads);
+	free(pool);
+}
+
+/*
+ * Hand the current entry to the pool, if it is a small regular file.
+ * Returns ARCHIVE_OK when the pool has it, ARCHIVE_RETRY when it is to be
+ * extracted here, or the error reading its data.
+ */
+static int
+extract_pool_add(struct extract_pool *pool, struct archive *a,
+    struct archive_entry *entry)
+{
+	struct extract_job *job;
+	int64_t size = archive_entry_size(entry);
+	size_t got = 0;
+	ssize_t n;
+
+	/* A zip entry streamed with its size after the data has none. */
+	if (archive_entry_filetype(entry) != AE_IFREG ||
+	    archive_entry_hardlink(entry) != NULL ||
+	    !archive_entry_size_is_set(entry) ||
+	    size < 0 || size > EXTRACT_MAX_ENTRY)
+		return (ARCHIVE_RETRY);
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+		return (ARCHIVE_RETRY);
+	job->entry = archive_entry_clone(entry);
+	job->size = (size_t)size;
+	job->data = malloc(job->size > 0 ? job->size : 1);
+	if (job->entry == NULL || job->data == NULL) {
+		extract_job_free(job);
+		return (ARCHIVE_RETRY);
+	}
+	while (got < job->size &&
+	    (n = archive_read_data(a, (char *)job->data + got,
+	    job->size - got)) > 0)
+		got += n;
+	if (got < job->size) {
+		/* A short or failed read: the archive's error says why. */
+		extract_job_free(job);
+		return (ARCHIVE_FATAL);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->queued > 0 && pool->queued + job->size > EXTRACT_BUDGET)
+		pthread_cond_wait(&pool->changed, &pool->lock);
+	if (pool->last != NULL)
+		pool->last->next = job;
+	else
+		pool->first = job;
+	pool->last = job;
+	pool->queued += job->size;
+	pthread_cond_signal(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+	return (ARCHIVE_OK);
+}
+
 /*
  * Handle 'x' and 't' modes.
  */
@@ -186,6 +414,7 @@ read_archive(struct bsdtar *bsdtar, char mode)
 #endif /* HAVE_QUARANTINE */
 	LIST_HEAD(copyfile_list_t, copyfile_list_entry_t) copyfile_list;
 	struct copyfile_list_entry_t *cle;
+	struct extract_pool	 *pool = NULL;
 
 	LIST_INIT(&copyfile_list);
 
@@ -244,6 +473,15 @@ read_archive(struct bsdtar *bsdtar, char mode)
 	}
 #endif /* HAVE_QUARANTINE */
 
+	if (mode == 'x' && bsdtar->threads > 1 &&
+	    !bsdtar->option_stdout && !bsdtar->option_interactive) {
+		pool = extract_pool_start(bsdtar);
+#ifdef HAVE_QUARANTINE
+		if (pool != NULL)
+			pool->qf = qf;
+#endif /* HAVE_QUARANTINE */
+	}
+
 	for (;;) {
 		/* Support --fast-read option */
 		const char *p;
@@ -375,22 +613,36 @@ read_archive(struct bsdtar *bsdtar, char mode)
 			else {
 				/* do this even if disable_copyfile is set, because it can get blown away by its associated real file */
 				char *bname = basename((char *)archive_entry_pathname(entry));
-				if (bname != NULL && strncmp(bname, "._", 2) == 0) {
-					cle = calloc(1, sizeof(struct copyfile_list_entry_t));
-					cle->src = strdup(archive_entry_pathname(entry));
-					asprintf(&cle->tmp, "%s.XXXXXX", cle->src);
-					mktemp(cle->tmp);
-					asprintf(&cle->dst, "%s/%s", dirname(cle->src), basename(cle->src) + 2);
-					LIST_INSERT_HEAD(&copyfile_list, cle, link);
-					archive_entry_set_pathname(entry, cle->tmp);
+				r = ARCHIVE_RETRY;
+				if (pool != NULL && bname != NULL &&
+				    strncmp(bname, "._", 2) != 0) {
+					r = extract_pool_add(pool, a, entry);
+					/* links and special files may refer to
+					   files still in the pool */
+					if (r == ARCHIVE_RETRY &&
+					    (archive_entry_hardlink(entry) != NULL ||
+					    (archive_entry_filetype(entry) != AE_IFREG &&
+					    archive_entry_filetype(entry) != AE_IFDIR)))
+						extract_pool_wait(pool);
 				}
-				r = archive_read_extract(a, entry,
-				    bsdtar->extract_flags);
+				if (r == ARCHIVE_RETRY) {
+					if (bname != NULL && strncmp(bname, "._", 2) == 0) {
+						cle = calloc(1, sizeof(struct copyfile_list_entry_t));
+						cle->src = strdup(archive_entry_pathname(entry));
+						asprintf(&cle->tmp, "%s.XXXXXX", cle->src);
+						mktemp(cle->tmp);
+						asprintf(&cle->dst, "%s/%s", dirname(cle->src), basename(cle->src) + 2);
+						LIST_INSERT_HEAD(&copyfile_list, cle, link);
+						archive_entry_set_pathname(entry, cle->tmp);
+					}
+					r = archive_read_extract(a, entry,
+					    bsdtar->extract_flags);
 #ifdef HAVE_QUARANTINE
-				if (r == ARCHIVE_OK) {
-					_qtnapply(bsdtar, qf, (char *)archive_entry_pathname(entry));
-				}
+					if (r == ARCHIVE_OK) {
+						_qtnapply(bsdtar, qf, (char *)archive_entry_pathname(entry));
+					}
 #endif /* HAVE_QUARANTINE */
+				}
 			}
 			if (r != ARCHIVE_OK) {
 				if (!bsdtar->verbose)
@@ -409,6 +661,10 @@ read_archive(struct bsdtar *bsdtar, char mode)
 		}
 	}
 
+	/* The files of the pool are written before the directories get their
+	   final times and modes. */
+	if (pool != NULL)
+		extract_pool_finish(pool);
 
 	r = archive_read_close(a);
 	if (r != ARCHIVE_OK)
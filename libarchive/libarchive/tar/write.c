@@ -88,6 +88,7 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 #include <libgen.h>
 #include <paths.h>
 #endif
+#include <pthread.h>
 #include "ios_error.h"  // remaps exit() to pthread_exit(NULL)
 
 #include "bsdtar.h"
@@ -98,6 +99,14 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 /* Size of buffer for holding file data prior to writing. */
 #define FILEDATABUFLEN	65536
 
+/* Default block size when the archive is a regular file. */
+#define	DISK_BYTES_PER_BLOCK	(128*512)
+
+/* Read-ahead of file data while the directory tree is walked. */
+#define	PREFETCH_MAX_FILE	(1024 * 1024) /* larger ones are streamed */
+#define	PREFETCH_BUDGET		(16 * 1024 * 1024) /* file data read ahead */
+#define	PREFETCH_DEPTH		32	/* entries queued, each may hold an fd */
+
 /* Fixed size of uname/gname caches. */
 #define	name_cache_size 101
 
@@ -118,6 +127,38 @@ struct archive_dir {
 	struct archive_dir_entry *head, *tail;
 };
 
+/*
+ * Entries found by write_hierarchy() are queued here, with their
+ * source file already open, and written in order.  A reader thread
+ * meanwhile reads the contents of small files into memory, so that
+ * stat(), open() and read() of upcoming files overlap with the
+ * compression and writing of earlier ones.
+ */
+struct prefetch_job {
+	struct prefetch_job	*next;
+	struct archive_entry	*entry;	/* NULL if only a -v line */
+	char			*announce; /* pathname for "a %s" with -v */
+	int			 endline; /* ends the -v line */
+	int			 fd;
+	int			 open_errno;
+	char			*data;	/* contents, if read ahead */
+	ssize_t			 length;
+	size_t			 charged; /* bytes counted in the budget */
+	int			 ready;	/* reader is done with this job */
+};
+
+struct prefetch {
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 changed;
+	struct prefetch_job	*first, *last;
+	struct prefetch_job	*next_read; /* next job for the reader */
+	size_t			 bytes;	/* read-ahead data held */
+	int			 jobs;
+	int			 done;	/* no more jobs coming */
+	int			 running; /* reader thread was started */
+	pthread_t		 thread;
+};
+
 struct name_cache {
 	int	probes;
 	int	hits;
@@ -140,12 +181,26 @@ static int		 copy_file_data(struct bsdtar *, struct archive *a,
 			     struct archive *ina, struct archive_entry *);
 static int		 new_enough(struct bsdtar *, const char *path,
 			     const struct stat *);
+static void		 prefetch_entry(struct bsdtar *, struct archive *,
+			     struct prefetch *, struct archive_entry *,
+			     char *announce, int endline);
+static void		 prefetch_flush(struct bsdtar *, struct archive *,
+			     struct prefetch *);
+static void		*prefetch_reader(void *);
+static void		 prefetch_stop(void *);
+static void		 prefetch_write(struct bsdtar *, struct archive *,
+			     struct prefetch *);
 static void		 report_write(struct bsdtar *, struct archive *,
 			     struct archive_entry *, int64_t progress);
 static void		 test_for_append(struct bsdtar *);
 static void		 write_archive(struct archive *, struct bsdtar *);
+static int		 write_buffer_data(struct bsdtar *, struct archive *,
+			     struct archive_entry *, const char *, ssize_t);
 static void		 write_entry_backend(struct bsdtar *, struct archive *,
 			     struct archive_entry *);
+static void		 write_entry_data(struct bsdtar *, struct archive *,
+			     struct archive_entry *, int fd, int open_errno,
+			     const char *data, ssize_t length);
 static int		 write_file_data(struct bsdtar *, struct archive *,
 			     struct archive_entry *, int fd);
 static void		 write_hierarchy(struct bsdtar *, struct archive *,
@@ -168,6 +223,40 @@ seek_file(int fd, int64_t offset, int whence)
 #define lseek seek_file
 #endif
 
+/*
+ * -a: pick the compression from the archive name's suffix, the same
+ * table GNU tar uses.  Anything unrecognized is written uncompressed.
+ */
+static int
+auto_compression(const char *filename)
+{
+	static const struct {
+		const char *suffix;
+		int compression;
+	} suffixes[] = {
+		{ ".tgz", 'z' }, { ".taz", 'z' }, { ".gz", 'z' },
+		{ ".tbz", 'j' }, { ".tbz2", 'j' }, { ".tz2", 'j' },
+		{ ".bz2", 'j' },
+		{ ".txz", 'J' }, { ".xz", 'J' },
+		{ ".tlz", OPTION_LZMA }, { ".lzma", OPTION_LZMA },
+		{ ".taZ", 'Z' }, { ".Z", 'Z' },
+		{ ".tzst", OPTION_ZSTD }, { ".zst", OPTION_ZSTD },
+		{ ".lz4", OPTION_LZ4 },
+		{ NULL, 0 }
+	};
+	size_t len, slen;
+	int i;
+
+	len = strlen(filename);
+	for (i = 0; suffixes[i].suffix != NULL; i++) {
+		slen = strlen(suffixes[i].suffix);
+		if (len > slen &&
+		    strcmp(filename + len - slen, suffixes[i].suffix) == 0)
+			return (suffixes[i].compression);
+	}
+	return (0);
+}
+
 void
 tar_mode_c(struct bsdtar *bsdtar)
 {
@@ -197,14 +286,32 @@ tar_mode_c(struct bsdtar *bsdtar)
 	 * If user explicitly set the block size, then assume they
 	 * want the last block padded as well.  Otherwise, use the
 	 * default block size and accept archive_write_open_file()'s
-	 * default padding decisions.
+	 * default padding decisions.  The last block of a regular
+	 * file isn't padded, so a larger block there only means
+	 * fewer write() calls; devices, FIFOs and stdout get the
+	 * traditional 20 records.
 	 */
 	if (bsdtar->bytes_per_block != 0) {
 		archive_write_set_bytes_per_block(a, bsdtar->bytes_per_block);
 		archive_write_set_bytes_in_last_block(a,
 		    bsdtar->bytes_per_block);
-	} else
-		archive_write_set_bytes_per_block(a, DEFAULT_BYTES_PER_BLOCK);
+	} else {
+		struct stat st;
+
+		if (bsdtar->filename != NULL &&
+		    (stat(bsdtar->filename, &st) == 0 ?
+			S_ISREG(st.st_mode) : errno == ENOENT))
+			archive_write_set_bytes_per_block(a,
+			    DISK_BYTES_PER_BLOCK);
+		else
+			archive_write_set_bytes_per_block(a,
+			    DEFAULT_BYTES_PER_BLOCK);
+	}
+
+	if (bsdtar->option_auto_compress && bsdtar->create_compression == 0
+	    && bsdtar->compress_program == NULL && bsdtar->filename != NULL)
+		bsdtar->create_compression =
+		    auto_compression(bsdtar->filename);
 
 	if (bsdtar->compress_program) {
 		archive_write_set_compression_program(a, bsdtar->compress_program);
@@ -219,6 +326,9 @@ tar_mode_c(struct bsdtar *bsdtar)
 		case 'J':
 			r = archive_write_set_compression_xz(a);
 			break;
+		case OPTION_LZ4:
+			r = archive_write_set_compression_lz4(a);
+			break;
 		case OPTION_LZMA:
 			r = archive_write_set_compression_lzma(a);
 			break;
@@ -228,6 +338,9 @@ tar_mode_c(struct bsdtar *bsdtar)
 		case 'Z':
 			r = archive_write_set_compression_compress(a);
 			break;
+		case OPTION_ZSTD:
+			r = archive_write_set_compression_zstd(a);
+			break;
 		default:
 			lafe_errc(1, 0,
 			    "Unrecognized compression option -%c",
@@ -240,6 +353,14 @@ tar_mode_c(struct bsdtar *bsdtar)
 		}
 	}
 
+	if (bsdtar->threads > 1) {
+		char threads[32];
+
+		/* Compressors without threads just ignore this. */
+		snprintf(threads, sizeof(threads), "threads=%d",
+		    bsdtar->threads);
+		archive_write_set_compressor_options(a, threads);
+	}
 	if (ARCHIVE_OK != archive_write_set_options(a, bsdtar->option_options))
 		lafe_errc(1, 0, "%s", archive_error_string(a));
 	if (ARCHIVE_OK != archive_write_open_file(a, bsdtar->filename))
@@ -675,6 +796,7 @@ static void
 write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 {
 	struct archive_entry *entry = NULL, *spare_entry = NULL;
+	struct prefetch prefetch;
 	struct tree *tree;
 	char symlink_mode = bsdtar->symlink_mode;
 	dev_t first_dev = 0;
@@ -689,8 +811,19 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 		return;
 	}
 
+	memset(&prefetch, 0, sizeof(prefetch));
+	pthread_mutex_init(&prefetch.lock, NULL);
+	pthread_cond_init(&prefetch.changed, NULL);
+	/* Without the reader, entries are simply written in turn. */
+	if (pthread_create(&prefetch.thread, NULL, prefetch_reader,
+	    &prefetch) == 0)
+		prefetch.running = 1;
+	/* exit() from here on must not leave the reader behind. */
+	pthread_cleanup_push(prefetch_stop, &prefetch);
+
 	while ((tree_ret = tree_next(tree)) != 0) {
 		int r;
+		char *announce;
 		const char *name = tree_current_path(tree);
 		const struct stat *st = NULL; /* info to use for this entry */
 		const struct stat *lst = NULL; /* lstat() information */
@@ -918,8 +1051,9 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 					archive_entry_set_pathname(entry_p, copyfile_fname);
 					archive_entry_copy_sourcepath(entry_p, md_p);
 					archive_read_disk_entry_from_file(bsdtar->diskreader, entry_p, -1, &copyfile_stat);
-					write_entry_backend(bsdtar, a, entry_p);
-					archive_entry_free(entry_p);
+					/* The open fd outlives the unlink(). */
+					prefetch_entry(bsdtar, a, &prefetch,
+					    entry_p, NULL, 0);
 
 					unlink(md_p);
 					free(copyfile_fname);
@@ -931,10 +1065,11 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 #endif
 
 		/* Display entry as we process it.
-		 * This format is required by SUSv2. */
+		 * This format is required by SUSv2.
+		 * The line is printed when the queue gets to it. */
+		announce = NULL;
 		if (bsdtar->verbose)
-			safe_fprintf(thread_stderr, "a %s",
-			    archive_entry_pathname(entry));
+			announce = strdup(archive_entry_pathname(entry));
 
 		/* Non-regular files get archived with zero size. */
 		if (archive_entry_filetype(entry) != AE_IFREG)
@@ -942,20 +1077,217 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 
 		archive_entry_linkify(bsdtar->resolver, &entry, &spare_entry);
 
+		if (entry == NULL)
+			prefetch_entry(bsdtar, a, &prefetch, NULL, announce, 1);
 		while (entry != NULL) {
-			write_entry_backend(bsdtar, a, entry);
-			archive_entry_free(entry);
+			prefetch_entry(bsdtar, a, &prefetch, entry, announce,
+			    spare_entry == NULL);
+			announce = NULL;
 			entry = spare_entry;
 			spare_entry = NULL;
 		}
-
-		if (bsdtar->verbose)
-			fprintf(thread_stderr, "\n");
 	}
 	archive_entry_free(entry);
+	prefetch_flush(bsdtar, a, &prefetch);
+	pthread_cleanup_pop(1);
 	tree_close(tree);
 }
 
+/*
+ * Bytes of file data read ahead, at most.  On iOS, less when memory is
+ * short: the whole app is killed if it goes over its limit.
+ */
+static size_t
+prefetch_budget(void)
+{
+#ifdef __APPLE__
+	if (ios_memoryBudget() / 4 < PREFETCH_BUDGET)
+		return (ios_memoryBudget() / 4);
+#endif
+	return (PREFETCH_BUDGET);
+}
+
+/*
+ * Reader thread: read the contents of queued small files, in order,
+ * while the queue ahead of them is being written.
+ */
+static void *
+prefetch_reader(void *arg)
+{
+	struct prefetch *p = (struct prefetch *)arg;
+	struct prefetch_job *job;
+	int64_t size;
+	size_t want;
+	ssize_t n, bytes_read;
+	char *data;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->next_read == NULL && !p->done)
+			pthread_cond_wait(&p->changed, &p->lock);
+		if ((job = p->next_read) == NULL)
+			break;
+		p->next_read = job->next;
+		size = job->entry != NULL ? archive_entry_size(job->entry) : 0;
+		if (job->fd < 0 || size <= 0 || size > PREFETCH_MAX_FILE) {
+			job->ready = 1;
+			pthread_cond_broadcast(&p->changed);
+			continue;
+		}
+		/* One byte extra, to notice a file that grew. */
+		want = (size_t)size + 1;
+		while (p->bytes > 0 && p->bytes + want > prefetch_budget() &&
+		    !p->done)
+			pthread_cond_wait(&p->changed, &p->lock);
+		p->bytes += want;
+		job->charged = want;
+		pthread_mutex_unlock(&p->lock);
+
+		bytes_read = 0;
+		if ((data = malloc(want)) != NULL) {
+			while ((size_t)bytes_read < want) {
+				n = read(job->fd, data + bytes_read,
+				    want - bytes_read);
+				if (n <= 0)
+					break;
+				bytes_read += n;
+			}
+			close(job->fd);
+			job->fd = -1;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		job->data = data;
+		job->length = bytes_read;
+		job->ready = 1;
+		pthread_cond_broadcast(&p->changed);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return (NULL);
+}
+
+/*
+ * Queue an entry (and its -v line) for writing.  Its source file is
+ * opened now, since tree.c may chdir() elsewhere before the entry is
+ * written.  Takes ownership of entry and announce.
+ */
+static void
+prefetch_entry(struct bsdtar *bsdtar, struct archive *a, struct prefetch *p,
+    struct archive_entry *entry, char *announce, int endline)
+{
+	struct prefetch_job *job;
+
+	if (entry == NULL && announce == NULL)
+		return;
+	if ((job = calloc(1, sizeof(*job))) == NULL)
+		lafe_errc(1, 0, "cannot allocate memory");
+	job->entry = entry;
+	job->announce = announce;
+	job->endline = endline;
+	job->fd = -1;
+	if (entry != NULL && archive_entry_size(entry) > 0) {
+		job->fd = open(archive_entry_sourcepath(entry),
+		    O_RDONLY | O_BINARY);
+		job->open_errno = errno;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	if (p->last != NULL)
+		p->last->next = job;
+	else
+		p->first = job;
+	p->last = job;
+	if (p->next_read == NULL)
+		p->next_read = job;
+	p->jobs++;
+	pthread_cond_broadcast(&p->changed);
+	pthread_mutex_unlock(&p->lock);
+
+	if (!p->running)
+		prefetch_flush(bsdtar, a, p);
+	else while (p->jobs > PREFETCH_DEPTH)
+		prefetch_write(bsdtar, a, p);
+}
+
+/*
+ * Write the oldest queued entry, once the reader is done with it.
+ */
+static void
+prefetch_write(struct bsdtar *bsdtar, struct archive *a, struct prefetch *p)
+{
+	struct prefetch_job *job;
+
+	pthread_mutex_lock(&p->lock);
+	job = p->first;
+	while (p->running && !job->ready)
+		pthread_cond_wait(&p->changed, &p->lock);
+	if ((p->first = job->next) == NULL)
+		p->last = NULL;
+	if (p->next_read == job)
+		p->next_read = job->next;
+	p->jobs--;
+	pthread_mutex_unlock(&p->lock);
+
+	if (job->announce != NULL)
+		safe_fprintf(thread_stderr, "a %s", job->announce);
+	if (job->entry != NULL)
+		write_entry_data(bsdtar, a, job->entry, job->fd,
+		    job->open_errno, job->data, job->length);
+	else if (job->fd >= 0)
+		close(job->fd);
+	if (bsdtar->verbose && job->endline)
+		fprintf(thread_stderr, "\n");
+
+	pthread_mutex_lock(&p->lock);
+	p->bytes -= job->charged;
+	pthread_cond_broadcast(&p->changed);
+	pthread_mutex_unlock(&p->lock);
+	archive_entry_free(job->entry);
+	free(job->announce);
+	free(job->data);
+	free(job);
+}
+
+static void
+prefetch_flush(struct bsdtar *bsdtar, struct archive *a, struct prefetch *p)
+{
+	while (p->first != NULL)
+		prefetch_write(bsdtar, a, p);
+}
+
+/*
+ * Stop the reader and drop whatever is still queued; after
+ * prefetch_flush() that is nothing.
+ */
+static void
+prefetch_stop(void *arg)
+{
+	struct prefetch *p = (struct prefetch *)arg;
+	struct prefetch_job *job;
+
+	pthread_mutex_lock(&p->lock);
+	p->done = 1;
+	p->next_read = NULL;
+	pthread_cond_broadcast(&p->changed);
+	pthread_mutex_unlock(&p->lock);
+	if (p->running)
+		pthread_join(p->thread, NULL);
+	p->running = 0;
+
+	while ((job = p->first) != NULL) {
+		p->first = job->next;
+		if (job->fd >= 0)
+			close(job->fd);
+		archive_entry_free(job->entry);
+		free(job->announce);
+		free(job->data);
+		free(job);
+	}
+	p->last = NULL;
+	pthread_cond_destroy(&p->changed);
+	pthread_mutex_destroy(&p->lock);
+}
+
 /*
  * Backend for write_entry.
  */
@@ -964,19 +1296,31 @@ write_entry_backend(struct bsdtar *bsdtar, struct archive *a,
     struct archive_entry *entry)
 {
 	int fd = -1;
+
+	if (archive_entry_size(entry) > 0)
+		fd = open(archive_entry_sourcepath(entry), O_RDONLY | O_BINARY);
+	write_entry_data(bsdtar, a, entry, fd, errno, NULL, 0);
+}
+
+/*
+ * Write an entry whose source file is open on fd, or whose contents
+ * were already read into data.
+ */
+static void
+write_entry_data(struct bsdtar *bsdtar, struct archive *a,
+    struct archive_entry *entry, int fd, int open_errno,
+    const char *data, ssize_t length)
+{
 	int e;
 
-	if (archive_entry_size(entry) > 0) {
+	if (archive_entry_size(entry) > 0 && fd == -1 && data == NULL) {
 		const char *pathname = archive_entry_sourcepath(entry);
-		fd = open(pathname, O_RDONLY | O_BINARY);
-		if (fd == -1) {
-			if (!bsdtar->verbose)
-				lafe_warnc(errno,
-				    "%s: could not open file", pathname);
-			else
-				fprintf(thread_stderr, ": %s", strerror(errno));
-			return;
-		}
+		if (!bsdtar->verbose)
+			lafe_warnc(open_errno,
+			    "%s: could not open file", pathname);
+		else
+			fprintf(thread_stderr, ": %s", strerror(open_errno));
+		return;
 	}
 
 	e = archive_write_header(a, entry);
@@ -998,7 +1342,12 @@ write_entry_backend(struct bsdtar *bsdtar, struct archive *a,
 	 * to inform us that the archive body won't get stored.  In
 	 * that case, just skip the write.
 	 */
-	if (e >= ARCHIVE_WARN && fd >= 0 && archive_entry_size(entry) > 0) {
+	if (e >= ARCHIVE_WARN && data != NULL &&
+	    archive_entry_size(entry) > 0) {
+		if (write_buffer_data(bsdtar, a, entry, data, length))
+			exit(1);
+	} else if (e >= ARCHIVE_WARN && fd >= 0 &&
+	    archive_entry_size(entry) > 0) {
 		if (write_file_data(bsdtar, a, entry, fd))
 			exit(1);
 	}
@@ -1034,6 +1383,41 @@ report_write(struct bsdtar *bsdtar, struct archive *a,
 }
 
 
+/* Helper function to copy file data read ahead to archive. */
+static int
+write_buffer_data(struct bsdtar *bsdtar, struct archive *a,
+    struct archive_entry *entry, const char *data, ssize_t length)
+{
+	ssize_t	bytes_read;
+	ssize_t	bytes_written;
+	int64_t	progress = 0;
+
+	while (progress < length) {
+		if (need_report())
+			report_write(bsdtar, a, entry, progress);
+
+		bytes_read = length - progress;
+		if (bytes_read > FILEDATABUFLEN)
+			bytes_read = FILEDATABUFLEN;
+		bytes_written = archive_write_data(a, data + progress,
+		    bytes_read);
+		if (bytes_written < 0) {
+			/* Write failed; this is bad */
+			lafe_warnc(0, "%s", archive_error_string(a));
+			return (-1);
+		}
+		if (bytes_written < bytes_read) {
+			/* Write was truncated; warn but continue. */
+			lafe_warnc(0,
+			    "%s: Truncated write; file may have grown while being archived.",
+			    archive_entry_pathname(entry));
+			return (0);
+		}
+		progress += bytes_written;
+	}
+	return 0;
+}
+
 /* Helper function to copy file to archive. */
 static int
 write_file_data(struct bsdtar *bsdtar, struct archive *a,
@@ -11,8 +11,12 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdbool.h>
 #include <sys/wait.h>
 #include <sys/param.h>
+#include <sys/time.h>
+#include <mach/mach.h> // for thread_info(), CPU time of commands
+#include <malloc/malloc.h> // for malloc zones, memory of commands
 
 #include "ios_error.h"
 #undef write
@@ -26,29 +30,76 @@
 #undef setenv
 #undef unsetenv
 
+// Bytes written by the command running on this thread to its stdout and stderr (see ios_getProcessStats):
+static __thread unsigned long long threadBytesOut = 0;
+static __thread unsigned long long threadBytesErr = 0;
+
+// Interruption flag of the process running on this thread (NULL if none). See ios_interrupt.
+static __thread _Atomic(bool)* threadInterrupted = NULL;
+
+// Commands that write to a buffered stream may not reach a cancellation point for a long time, so the shims
+// stop the command themselves if it has been interrupted.
+static inline void checkInterruption(void) {
+    if ((threadInterrupted != NULL) && *threadInterrupted) {
+        threadInterrupted = NULL; // cleanup_function can still write
+        ios_exit(130);
+    }
+}
+
+// Session whose stdout is coalesced (ios_setOutputCoalescing), if the command on this thread writes to it.
+// Set by run_function. Writes schedule the next flush; stderr and write(1) first send what is pending.
+__thread void* threadOutputCoalescer = NULL;
+extern void ios_scheduleOutputFlush(void* session);
+
+static inline void countOutput(FILE* stream, long long bytes) {
+    if (bytes <= 0) return;
+    if (stream == thread_stdout) {
+        threadBytesOut += bytes;
+        if (threadOutputCoalescer != NULL) ios_scheduleOutputFlush(threadOutputCoalescer);
+    } else if (stream == thread_stderr) threadBytesErr += bytes;
+}
+
+// Stream redirection: commands write to stdout/stderr (or to any stream on descriptors 1 and 2), we send
+// that to the thread-local streams. These functions are called for every character by text tools, so the
+// usual cases are pointer comparisons, and the descriptor is read without fileno(), which locks the stream.
+static inline FILE* resolveStream(FILE* stream) {
+    checkInterruption();
+    if ((threadOutputCoalescer != NULL) && (stream != thread_stdout) && (stream != stdout)) {
+        // errors appear after the output that came before them:
+        if ((stream == thread_stderr) || (stream == stderr)) fflush(thread_stdout);
+    }
+    if (thread_stdout == NULL) thread_stdout = stdout;
+    if (thread_stderr == NULL) thread_stderr = stderr;
+    if ((stream == thread_stdout) || (stream == thread_stderr)) return stream;
+    if (stream == stdout) return thread_stdout;
+    if (stream == stderr) return thread_stderr;
+    int fd = fileno_unlocked(stream);
+    if (fd == STDOUT_FILENO) return thread_stdout;
+    if (fd == STDERR_FILENO) return thread_stderr;
+    return stream;
+}
+
 int printf (const char *format, ...) {
     va_list arg;
     int done;
     
+    checkInterruption();
     va_start (arg, format);
     done = vfprintf (thread_stdout, format, arg);
     va_end (arg);
+    countOutput(thread_stdout, done);
     
     return done;
 }
 int fprintf(FILE * restrict stream, const char * restrict format, ...) {
     va_list arg;
     int done;
-    if (thread_stderr == NULL) thread_stderr = stderr;
-    if (thread_stdout == NULL) thread_stdout = stdout;
 
     va_start (arg, format);
-    if (fileno(stream) == STDOUT_FILENO) done = vfprintf (thread_stdout, format, arg);
-    else if (fileno(stream) == STDERR_FILENO) done = vfprintf (thread_stderr, format, arg);
-    // iOS, debug:
-    // else if (fileno(stream) == STDERR_FILENO) done = vfprintf (stderr, format, arg);
-    else done = vfprintf (stream, format, arg);
+    stream = resolveStream(stream);
+    done = vfprintf (stream, format, arg);
     va_end (arg);
+    countOutput(stream, done);
     
     return done;
 }
@@ -69,183 +120,653 @@ int scanf (const char *format, ...) {
 }
 int ios_fflush(FILE *stream) {
     if (stream == NULL) return 0;
-    if (thread_stdout == NULL) thread_stdout = stdout;
-    if (thread_stderr == NULL) thread_stderr = stderr;
-
-    if (fileno(stream) == STDOUT_FILENO) return fflush(thread_stdout);
-    if (fileno(stream) == STDERR_FILENO) return fflush(thread_stderr);
-    return fflush(stream);
+    return fflush(resolveStream(stream));
 }
 ssize_t ios_write(int fildes, const void *buf, size_t nbyte) {
+    checkInterruption();
     if (thread_stdout == NULL) thread_stdout = stdout;
     if (thread_stderr == NULL) thread_stderr = stderr;
-    if (fildes == STDOUT_FILENO) return write(fileno(thread_stdout), buf, nbyte);
-    if (fildes == STDERR_FILENO) return write(fileno(thread_stderr), buf, nbyte);
+    ssize_t result;
+    // Streams without a file descriptor (in-process pipes, ios_system_capture) take the bytes through stdio:
+    if ((fildes == STDOUT_FILENO) || (fildes == STDERR_FILENO)) {
+        FILE* stream = (fildes == STDOUT_FILENO) ? thread_stdout : thread_stderr;
+        if (fileno_unlocked(stream) < 0) {
+            result = fwrite(buf, 1, nbyte, stream);
+            countOutput(stream, result);
+            return ((result == 0) && (nbyte > 0)) ? -1 : result;
+        }
+    }
+    if ((threadOutputCoalescer != NULL) && ((fildes == STDOUT_FILENO) || (fildes == STDERR_FILENO)))
+        fflush(thread_stdout); // the bytes in the stream were written before
+    if (fildes == STDOUT_FILENO) {
+        result = write(fileno_unlocked(thread_stdout), buf, nbyte);
+        if (result > 0) threadBytesOut += result;
+        return result;
+    }
+    if (fildes == STDERR_FILENO) {
+        result = write(fileno_unlocked(thread_stderr), buf, nbyte);
+        if (result > 0) threadBytesErr += result;
+        return result;
+    }
     return write(fildes, buf, nbyte);
 }
 size_t ios_fwrite(const void *restrict ptr, size_t size, size_t nitems, FILE *restrict stream) {
-    if (thread_stdout == NULL) thread_stdout = stdout;
-    if (thread_stderr == NULL) thread_stderr = stderr;
-    if (fileno(stream) == STDOUT_FILENO) return fwrite(ptr, size, nitems, thread_stdout);
-    if (fileno(stream) == STDERR_FILENO) return fwrite(ptr, size, nitems, thread_stderr);
-    return fwrite(ptr, size, nitems, stream);
+    stream = resolveStream(stream);
+    size_t result = fwrite(ptr, size, nitems, stream);
+    countOutput(stream, result * size);
+    return result;
 }
 int ios_puts(const char *s) {
+    checkInterruption();
     if (thread_stdout == NULL) thread_stdout = stdout;
-    // puts adds a newline at the end.
-    int returnValue = fputs(s, thread_stdout);
-    fputc('\n', thread_stdout);
+    FILE* stream = thread_stdout;
+    // puts adds a newline at the end. One lock for both, so the line is not split by other threads.
+    flockfile(stream);
+    int returnValue = fputs(s, stream);
+    if (returnValue != EOF) returnValue = (putc_unlocked('\n', stream) == EOF) ? EOF : returnValue;
+    funlockfile(stream);
+    if (returnValue != EOF) countOutput(stream, strlen(s) + 1);
     return returnValue;
 }
 int ios_fputs(const char* s, FILE *stream) {
-    if (thread_stdout == NULL) thread_stdout = stdout;
-    if (thread_stderr == NULL) thread_stderr = stderr;
-    if (fileno(stream) == STDOUT_FILENO) return fputs(s, thread_stdout);
-    if (fileno(stream) == STDERR_FILENO) return fputs(s, thread_stderr);
-    return fputs(s, stream);
+    stream = resolveStream(stream);
+    int returnValue = fputs(s, stream);
+    if (returnValue != EOF) countOutput(stream, strlen(s));
+    return returnValue;
 }
 int ios_fputc(int c, FILE *stream) {
-    if (thread_stdout == NULL) thread_stdout = stdout;
-    if (thread_stderr == NULL) thread_stderr = stderr;
-    if (fileno(stream) == STDOUT_FILENO) return fputc(c, thread_stdout);
-    if (fileno(stream) == STDERR_FILENO) return fputc(c, thread_stderr);
-    return fputc(c, stream);
+    stream = resolveStream(stream);
+    int returnValue = fputc(c, stream);
+    if (returnValue != EOF) countOutput(stream, 1);
+    return returnValue;
 }
 
 #include <assert.h>
 
 int ios_putw(int w, FILE *stream) {
-    if (thread_stdout == NULL) thread_stdout = stdout;
-    if (thread_stderr == NULL) thread_stderr = stderr;
-    if (fileno(stream) == STDOUT_FILENO) return putw(w, thread_stdout);
-    if (fileno(stream) == STDERR_FILENO) return putw(w, thread_stderr);
-    return putw(w, stream);
+    stream = resolveStream(stream);
+    int returnValue = putw(w, stream);
+    if (returnValue == 0) countOutput(stream, sizeof(int));
+    return returnValue;
 }
 
 // Fake process IDs to go with fake forking:
 // You will still need to edit your code to make sure you go through both branches.
-#define IOS_MAX_THREADS 128
-static pthread_t thread_ids[IOS_MAX_THREADS];
-static int numVariablesSet[IOS_MAX_THREADS];
-static char** environment[IOS_MAX_THREADS];
-static char** copyEnvironment[IOS_MAX_THREADS];
-static char previousDirectory[IOS_MAX_THREADS][MAXPATHLEN];
-static int previousPid[IOS_MAX_THREADS];
-
-static int pid_overflow = 0;
+// The process table is a list of chunks of PROCESS_CHUNK_SIZE entries, allocated when needed.
+// Chunks never move, so entries can be read without locking. Free entries are kept in a FIFO list:
+// we do not recycle process ids too quickly, to avoid collisions.
+#define PROCESS_CHUNK_SIZE 64
+#define PROCESS_MAX_CHUNKS 1024 // 65536 processes
+typedef struct _processEntry {
+    pthread_t thread;          // -1: not started, >0 started, not finished, 0: finished (or free)
+    struct _environmentTable* environment;     // NULL: use the global environment
+    struct _environmentTable* copyEnvironment; // stored by makeGlobal()
+    char* previousDirectory;   // MAXPATHLEN, allocated the first time the entry is used
+    pid_t previousPid;
+    pid_t nextFree;            // next entry in the free list, -1 if none
+    bool isFree;
+    // Accounting, kept after the process terminates (until the pid is reused):
+    struct timeval startTime;  // ios_fork
+    ios_processStats stats;
+    double userAtStart;        // CPU times of the thread when the command started (threads are reused)
+    double systemAtStart;
+    _Atomic(bool) interrupted; // set by ios_interrupt, checked by the stdio shims
+    malloc_zone_t* zone;       // memory of the command, with reclaimCommandMemory
+} processEntry;
+static processEntry firstProcessChunk[PROCESS_CHUNK_SIZE]; // pid 0 (the app itself) must always exist
+static processEntry* processChunks[PROCESS_MAX_CHUNKS] = { firstProcessChunk };
+static _Atomic(int) numProcessChunks = 1;
+static pid_t firstFreePid = -1;
+static pid_t lastFreePid = -1;
+static pthread_mutex_t processTable_mtx = PTHREAD_MUTEX_INITIALIZER; // protects the free list
+static __thread pid_t threadPid = 0; // pid stored by this thread in ios_storeThreadId, for fast release
+
+static inline processEntry* process(pid_t pid) {
+    return &processChunks[pid / PROCESS_CHUNK_SIZE][pid % PROCESS_CHUNK_SIZE];
+}
+
+static inline bool isValidPid(pid_t pid) {
+    return (pid >= 0) && (pid < numProcessChunks * PROCESS_CHUNK_SIZE);
+}
+
+// Called with processTable_mtx locked:
+static void addToFreeList(pid_t pid) {
+    processEntry* entry = process(pid);
+    if (entry->isFree) return;
+    entry->isFree = true;
+    entry->nextFree = -1;
+    if (lastFreePid >= 0) process(lastFreePid)->nextFree = pid;
+    else firstFreePid = pid;
+    lastFreePid = pid;
+}
+
+static void releasePid(pid_t pid) {
+    if (pid <= 0) return; // pid 0 is never released
+    pthread_mutex_lock(&processTable_mtx);
+    addToFreeList(pid);
+    pthread_mutex_unlock(&processTable_mtx);
+}
+
+// Called with processTable_mtx locked. Returns false if the table has reached its maximum size.
+static bool addProcessChunk(void) {
+    static bool initialized = false;
+    if (!initialized) {
+        // Entries of the first chunk (except 0) go to the free list
+        initialized = true;
+        for (pid_t pid = 1; pid < PROCESS_CHUNK_SIZE; pid++) addToFreeList(pid);
+        return true;
+    }
+    if (numProcessChunks >= PROCESS_MAX_CHUNKS) return false;
+    processEntry* chunk = calloc(PROCESS_CHUNK_SIZE, sizeof(processEntry));
+    if (chunk == NULL) return false;
+    processChunks[numProcessChunks] = chunk;
+    pid_t firstPid = numProcessChunks * PROCESS_CHUNK_SIZE;
+    numProcessChunks += 1;
+    for (pid_t pid = firstPid; pid < firstPid + PROCESS_CHUNK_SIZE; pid++) addToFreeList(pid);
+    return true;
+}
+
+// Returns the next free pid (or -1 if there are none left) and removes it from the free list.
+static pid_t allocatePid(void) {
+    pthread_mutex_lock(&processTable_mtx);
+    if ((firstFreePid < 0) && !addProcessChunk()) {
+        pthread_mutex_unlock(&processTable_mtx);
+        return -1;
+    }
+    pid_t pid = firstFreePid;
+    processEntry* entry = process(pid);
+    firstFreePid = entry->nextFree;
+    if (firstFreePid < 0) lastFreePid = -1;
+    entry->isFree = false;
+    entry->nextFree = -1;
+    if (entry->previousDirectory == NULL) entry->previousDirectory = malloc(MAXPATHLEN);
+    pthread_mutex_unlock(&processTable_mtx);
+    return pid;
+}
 static pid_t current_pid = 0;
 // We need to lock current_pid during operations
 pthread_mutex_t pid_mtx = PTHREAD_MUTEX_INITIALIZER;
+// Thread that locked pid_mtx in ios_fork(), until the command starts (ios_storeThreadId):
+static _Atomic(pthread_t) pidLockOwner = 0;
+// Number of commands currently terminating (inside cleanup_function). Don't start or chdir while > 0.
 _Atomic(int) cleanup_counter = 0;
-static pid_t last_allocated_pid = 0;
+static pthread_mutex_t cleanup_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cleanup_cond = PTHREAD_COND_INITIALIZER;
+// Total time spent by threads waiting for other commands (microseconds), for instrumentation:
+static _Atomic(unsigned long long) timeSpentWaiting = 0;
+// Signalled each time a process terminates, so ios_waitpid() can sleep instead of spinning.
+// Separate from pid_mtx, since processes terminate while other threads hold pid_mtx.
+static pthread_mutex_t wait_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+// Some state changes (e.g. lastThreadId in the session) happen without a signal, so we also wake up regularly:
+#define WAIT_TIMEOUT_NSEC (10 * 1000 * 1000) // 10 ms
+
+static void signalProcessTermination(void) {
+    pthread_mutex_lock(&wait_mtx);
+    pthread_cond_broadcast(&wait_cond);
+    pthread_mutex_unlock(&wait_mtx);
+}
+
+// pthread_cond_wait with a timeout (in nanoseconds). mtx must be locked.
+int ios_condTimedWait(pthread_cond_t* cond, pthread_mutex_t* mtx, long timeout_nsec) {
+    struct timeval now;
+    struct timespec timeout;
+    gettimeofday(&now, NULL);
+    long nsec = now.tv_usec * 1000L + timeout_nsec;
+    timeout.tv_sec = now.tv_sec + nsec / 1000000000L;
+    timeout.tv_nsec = nsec % 1000000000L;
+    return pthread_cond_timedwait(cond, mtx, &timeout);
+}
+
+// Wait (with wait_mtx locked) until the next process terminates, or until timeout:
+static void waitForProcessTermination(void) {
+    ios_condTimedWait(&wait_cond, &wait_mtx, WAIT_TIMEOUT_NSEC);
+}
+
+void ios_addTimeSpentWaiting(const struct timeval* start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long long elapsed = (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_usec - start->tv_usec);
+    if (elapsed > 0) timeSpentWaiting += elapsed;
+}
+
+unsigned long long ios_timeSpentWaiting(void) {
+    return timeSpentWaiting;
+}
+
+// Called by cleanup_function, at the beginning and at the end:
+void ios_startCleanup(void) {
+    pthread_mutex_lock(&cleanup_mtx);
+    cleanup_counter++;
+    pthread_mutex_unlock(&cleanup_mtx);
+}
+
+void ios_endCleanup(void) {
+    pthread_mutex_lock(&cleanup_mtx);
+    cleanup_counter--;
+    if (cleanup_counter <= 0) pthread_cond_broadcast(&cleanup_cond);
+    pthread_mutex_unlock(&cleanup_mtx);
+}
+
+// Sleep until no command is terminating:
+void ios_waitForCleanup(void) {
+    if (cleanup_counter <= 0) return;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    pthread_mutex_lock(&cleanup_mtx);
+    while (cleanup_counter > 0) {
+        pthread_cond_wait(&cleanup_cond, &cleanup_mtx);
+    }
+    pthread_mutex_unlock(&cleanup_mtx);
+    ios_addTimeSpentWaiting(&start);
+}
 
 
 void makeGlobal(void) {
-    copyEnvironment[current_pid] = environment[current_pid];
-    environment[current_pid] = NULL; // makes it really global
+    process(current_pid)->copyEnvironment = process(current_pid)->environment;
+    process(current_pid)->environment = NULL; // makes it really global
 }
 void makeLocal(void) {
-    environment[current_pid] = copyEnvironment[current_pid];
-    copyEnvironment[current_pid] = NULL;
+    process(current_pid)->environment = process(current_pid)->copyEnvironment;
+    process(current_pid)->copyEnvironment = NULL;
 }
 
 inline pthread_t ios_getThreadId(pid_t pid) {
     // return ios_getLastThreadId(); // previous behaviour
-    return thread_ids[pid];
+    if (!isValidPid(pid)) return 0;
+    return process(pid)->thread;
 }
 
 void newPreviousDirectory(void) {
     // Called when a command calls "cd". Actually changes the directory for that command.
-    getwd(previousDirectory[current_pid]);
+    if (process(current_pid)->previousDirectory == NULL) return; // pid 0: there is no directory to go back to
+    getwd(process(current_pid)->previousDirectory);
+}
+
+// Resource accounting: for each process, wall time from ios_fork to the end of the command, CPU time of its
+// main thread and bytes written to stdout/stderr, plus a histogram of command durations for all processes.
+static _Atomic(unsigned long) durationHistogram[IOS_DURATION_BUCKETS];
+
+static void threadTimes(pthread_t thread, double* user, double* system) {
+    *user = *system = 0;
+    if ((thread == 0) || (thread == (pthread_t)-1)) return;
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    mach_port_t port = pthread_mach_thread_np(thread);
+    if (thread_info(port, THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS) return;
+    *user = info.user_time.seconds + info.user_time.microseconds * 1e-6;
+    *system = info.system_time.seconds + info.system_time.microseconds * 1e-6;
+}
+
+// User and system time of the process since it started, from the CPU times of its thread:
+static void processTimes(processEntry* entry, pthread_t thread, ios_processStats* stats) {
+    double user, system;
+    threadTimes(thread, &user, &system);
+    stats->userTime = (user > entry->userAtStart) ? user - entry->userAtStart : 0;
+    stats->systemTime = (system > entry->systemAtStart) ? system - entry->systemAtStart : 0;
+    stats->cpuTime = stats->userTime + stats->systemTime;
+}
+
+// CPU times of the calling thread (for the stages of a pipeline, which share a pid):
+void ios_threadTimes(double* user, double* system) {
+    threadTimes(pthread_self(), user, system);
+}
+
+static double elapsedSince(const struct timeval* start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) * 1e-6;
+}
+
+// Called when process pid terminates, before its entry is released:
+static void recordProcessStats(pid_t pid, pthread_t thread) {
+    processEntry* entry = process(pid);
+    if (!entry->stats.running) return;
+    entry->stats.wallTime = elapsedSince(&entry->startTime);
+    processTimes(entry, thread, &entry->stats);
+    if (thread == pthread_self()) {
+        entry->stats.bytesOut = threadBytesOut;
+        entry->stats.bytesErr = threadBytesErr;
+    }
+    entry->stats.running = false;
+    // bucket i: between 2^i and 2^(i+1) microseconds
+    unsigned long long usec = (unsigned long long)(entry->stats.wallTime * 1e6);
+    int bucket = 0;
+    while ((usec > 1) && (bucket < IOS_DURATION_BUCKETS - 1)) {
+        usec >>= 1;
+        bucket++;
+    }
+    durationHistogram[bucket]++;
+}
+
+// Bytes written to stdout by this thread (not reset when a pool thread runs a new command):
+unsigned long long ios_threadBytesOut(void) {
+    return threadBytesOut;
+}
+
+// Memory of the commands compiled with IOS_COMMAND_MEMORY (see ios_error.h). Counted in the stats of the
+// process running on this thread; with reclaimCommandMemory, allocated in a zone released when it ends.
+// Memory allocated by the other threads of the command goes to the default zone, as usual.
+bool reclaimCommandMemory = false;
+static __thread malloc_zone_t* threadZone = NULL;
+
+static inline void countAllocation(void* ptr, long long delta) {
+    if ((ptr == NULL) || (threadPid <= 0)) return;
+    ios_processStats* stats = &process(threadPid)->stats;
+    if (delta < 0) {
+        // memory allocated before the command started, or by another thread, was not counted:
+        stats->memoryInUse = (stats->memoryInUse > -delta) ? stats->memoryInUse + delta : 0;
+    } else {
+        stats->memoryInUse += delta;
+        if (stats->memoryInUse > stats->peakMemory) stats->peakMemory = stats->memoryInUse;
+    }
+}
+
+void* ios_malloc(size_t size) {
+    void* ptr = (threadZone != NULL) ? malloc_zone_malloc(threadZone, size) : malloc(size);
+    if (ptr != NULL) countAllocation(ptr, malloc_size(ptr));
+    return ptr;
 }
 
-// We do not recycle process ids too quickly to avoid collisions.
-void storeEnvironment(char* envp[]);
+void* ios_calloc(size_t count, size_t size) {
+    void* ptr = (threadZone != NULL) ? malloc_zone_calloc(threadZone, count, size) : calloc(count, size);
+    if (ptr != NULL) countAllocation(ptr, malloc_size(ptr));
+    return ptr;
+}
+
+// The block stays in its zone: realloc() and free() find it.
+void* ios_realloc(void* ptr, size_t size) {
+    if (ptr == NULL) return ios_malloc(size);
+    size_t previous = malloc_size(ptr);
+    void* newPtr = realloc(ptr, size);
+    if (newPtr != NULL) countAllocation(newPtr, (long long)malloc_size(newPtr) - (long long)previous);
+    return newPtr;
+}
+
+void ios_free(void* ptr) {
+    if (ptr == NULL) return;
+    countAllocation(ptr, -(long long)malloc_size(ptr));
+    free(ptr);
+}
+
+char* ios_strdup(const char* s) {
+    size_t length = strlen(s) + 1;
+    char* copy = ios_malloc(length);
+    if (copy != NULL) memcpy(copy, s, length);
+    return copy;
+}
+
+// The command is ending on this thread: everything left in its zone is released.
+static void releaseCommandMemory(processEntry* entry) {
+    threadZone = NULL;
+    if (entry->zone == NULL) return;
+    malloc_statistics_t zoneStats;
+    malloc_zone_statistics(entry->zone, &zoneStats);
+    entry->stats.reclaimedMemory = zoneStats.size_in_use;
+    malloc_destroy_zone(entry->zone);
+    entry->zone = NULL;
+}
+
+ios_processStats ios_getProcessStats(pid_t pid) {
+    ios_processStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!isValidPid(pid) || (pid == 0)) return stats;
+    processEntry* entry = process(pid);
+    stats = entry->stats;
+    if (stats.running) {
+        // Still running: values so far
+        stats.wallTime = elapsedSince(&entry->startTime);
+        processTimes(entry, entry->thread, &stats);
+        if (pid == threadPid) {
+            stats.bytesOut = threadBytesOut;
+            stats.bytesErr = threadBytesErr;
+        }
+    }
+    return stats;
+}
+
+int ios_getDurationHistogram(unsigned long* buckets, int numBuckets) {
+    if (numBuckets > IOS_DURATION_BUCKETS) numBuckets = IOS_DURATION_BUCKETS;
+    for (int i = 0; i < numBuckets; i++) buckets[i] = durationHistogram[i];
+    return numBuckets;
+}
+
+// Asks a command to stop: it exits the next time it writes through the stdio shims, or when it calls
+// ios_isInterrupted() in a long loop. Unlike pthread_cancel, this does not need a cancellation point.
+void ios_interrupt(pid_t pid) {
+    if (!isValidPid(pid) || (pid == 0)) return;
+    if (process(pid)->thread != 0) process(pid)->interrupted = true;
+}
+
+// Same, for the command running on this thread:
+void ios_interruptThread(pthread_t thread) {
+    if ((thread == 0) || (thread == (pthread_t)-1)) return;
+    int numProcesses = numProcessChunks * PROCESS_CHUNK_SIZE;
+    for (pid_t p = 1; p < numProcesses; p++) {
+        if (process(p)->thread == thread) {
+            process(p)->interrupted = true;
+            return;
+        }
+    }
+}
+
+bool ios_isInterrupted(void) {
+    return (threadInterrupted != NULL) && *threadInterrupted;
+}
+
+static void inheritEnvironment(pid_t pid, struct _environmentTable* parentEnvironment);
 static inline const pid_t ios_nextAvailablePid() {
-    while (cleanup_counter > 0) { } // Don't start a command while another is ending.
+    ios_waitForCleanup(); // Don't start a command while another is ending.
     // fprintf(stderr, "Locking in ios_nextAvailablePid\n");
     pthread_mutex_lock(&pid_mtx);
-    char** currentEnvironment = environmentVariables(current_pid);
+    pidLockOwner = pthread_self();
+    struct _environmentTable* parentEnvironment = process(current_pid)->environment;
     int previousPidId = current_pid;
-    if (!pid_overflow && (last_allocated_pid < IOS_MAX_THREADS - 1)
-        && (thread_ids[last_allocated_pid+1] == 0)) {
-        current_pid = last_allocated_pid + 1;
-        last_allocated_pid = current_pid;
-        thread_ids[current_pid] = -1; // Not yet started
-        numVariablesSet[current_pid] = 0;
-        environment[current_pid] = NULL;
-        storeEnvironment(currentEnvironment); // duplicate the environment variables
-        getwd(previousDirectory[current_pid]); // store current working directory
-        previousPid[current_pid] = previousPidId;
-        // fprintf(stderr, "Returning from ios_nextAvailablePid, pid= %d\n", current_pid);
-        return current_pid;
-    }
-    // We've already started more than IOS_MAX_THREADS threads.
-    if (!pid_overflow) current_pid = 0; // first time over the limit
-    pid_overflow = 1;
-    while (1) {
-        current_pid = last_allocated_pid + 1;
-        last_allocated_pid = current_pid;
-        if (current_pid >= IOS_MAX_THREADS) {
-            current_pid = 1;
-            last_allocated_pid = 1;
-        }
-        pthread_t thread_pid = ios_getThreadId(current_pid);
-        if (thread_pid == 0) { // We found a not-active pid
-            thread_ids[current_pid] = -1; // Not yet started
-            numVariablesSet[current_pid] = 0;
-            environment[current_pid] = NULL;
-            storeEnvironment(currentEnvironment); // duplicate the environment variables
-            getwd(previousDirectory[current_pid]); // store current working directory
-            previousPid[current_pid] = previousPidId;
-            // fprintf(stderr, "Returning from ios_nextAvailablePid, pid= %d\n", current_pid);
-            return current_pid;
-        }
-        // Dangerous: if the process is already killed, this wil crash
-        /*
-        if (pthread_kill(thread_pid, 0) != 0) {
-            thread_ids[current_pid] = 0;
-            return current_pid; // not running anymore
-        }
-        */
+    pid_t newPid = allocatePid();
+    if (newPid < 0) {
+        // We have reached the maximum number of processes. pid_mtx stays locked until ios_storeThreadId.
+        errno = EAGAIN;
+        return -1;
     }
+    current_pid = newPid;
+    process(current_pid)->thread = -1; // Not yet started
+    // Share the environment variables with the parent process. They are copied if one of them changes.
+    inheritEnvironment(current_pid, parentEnvironment);
+    getwd(process(current_pid)->previousDirectory); // store current working directory
+    process(current_pid)->previousPid = previousPidId;
+    gettimeofday(&process(current_pid)->startTime, NULL);
+    memset(&process(current_pid)->stats, 0, sizeof(ios_processStats));
+    process(current_pid)->stats.running = true;
+    process(current_pid)->interrupted = false;
+    // fprintf(stderr, "Returning from ios_nextAvailablePid, pid= %d\n", current_pid);
+    return current_pid;
+}
+
+// ios_fork() keeps pid_mtx locked until the command has started. If the thread starting the command has
+// to wait for something that another command releases (e.g. a free copy of an interpreter), it lets
+// other commands start and end in the meantime. Returns the pid to give back to ios_resumeForkLock
+// (-1 if this thread does not hold the lock).
+pid_t ios_suspendForkLock(void) {
+    if (pidLockOwner != pthread_self()) return -1;
+    pid_t pid = current_pid;
+    pidLockOwner = 0;
+    pthread_mutex_unlock(&pid_mtx);
+    return pid;
+}
+
+void ios_resumeForkLock(pid_t pid) {
+    if (pid < 0) return;
+    pthread_mutex_lock(&pid_mtx);
+    pidLockOwner = pthread_self();
+    current_pid = pid; // other commands may have been forked in the meantime
 }
 
 inline void ios_storeThreadId(pthread_t thread) {
     // To avoid issues when a command starts a command without forking,
     // we only store thread IDs for the first thread of the "process".
-    // fprintf(stderr, "Unlocking pid %x, storing thread %x current value: %x\n", current_pid, thread,  thread_ids[current_pid]);
-    if (thread_ids[current_pid] == -1) {
-        thread_ids[current_pid] = thread;
+    // fprintf(stderr, "Unlocking pid %x, storing thread %x current value: %x\n", current_pid, thread,  process(current_pid)->thread);
+    pid_t pid = current_pid;
+    bool released = false;
+    if (process(pid)->thread == -1) {
+        process(pid)->thread = thread;
+        if (thread == pthread_self()) {
+            threadPid = pid;
+            threadBytesOut = 0;
+            threadBytesErr = 0;
+            threadInterrupted = &process(pid)->interrupted;
+            threadTimes(thread, &process(pid)->userAtStart, &process(pid)->systemAtStart);
+            if (reclaimCommandMemory && (process(pid)->zone == NULL)) {
+                process(pid)->zone = malloc_create_zone(0, 0);
+                if (process(pid)->zone != NULL) malloc_set_zone_name(process(pid)->zone, "ios_system command");
+            }
+            threadZone = process(pid)->zone;
+        }
+        released = (thread == 0);
+        if (released) process(pid)->stats.running = false;
     }
+    pidLockOwner = 0;
     pthread_mutex_unlock(&pid_mtx);
+    if (released) releasePid(pid);
+    if (thread == 0) {
+        // The command did not start, anyone waiting for it can stop:
+        signalProcessTermination();
+    }
+}
+
+// Environment of each process: an array of "NAME=value" strings (NULL-terminated, so it can be returned
+// by environmentVariables()), with a hash index on the names for fast lookup.
+// Children share the environment of their parent (copy-on-write): it is duplicated only when one
+// of them changes a variable.
+typedef struct _environmentTable {
+    _Atomic(int) refCount;  // number of processes sharing this environment
+    int numVariables;
+    int capacity;           // size of variables, not counting the final NULL
+    char** variables;
+    int* hashIndex;         // position in variables, -1 if empty. Open addressing, linear probing.
+    int hashSize;           // power of 2, at least twice numVariables
+} environmentTable;
+
+static unsigned int hashVariableName(const char* name, size_t length) {
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t variableNameLength(const char* variable) {
+    const char* equalSign = strchr(variable, '=');
+    if (equalSign == NULL) return strlen(variable);
+    return equalSign - variable;
+}
+
+static void rebuildHashIndex(environmentTable* table) {
+    int hashSize = 16;
+    while (hashSize < 2 * (table->numVariables + 1)) hashSize *= 2;
+    if (hashSize != table->hashSize) {
+        free(table->hashIndex);
+        table->hashIndex = malloc(hashSize * sizeof(int));
+        table->hashSize = hashSize;
+    }
+    for (int i = 0; i < hashSize; i++) table->hashIndex[i] = -1;
+    for (int i = 0; i < table->numVariables; i++) {
+        unsigned int slot = hashVariableName(table->variables[i], variableNameLength(table->variables[i])) & (hashSize - 1);
+        while (table->hashIndex[slot] >= 0) slot = (slot + 1) & (hashSize - 1);
+        table->hashIndex[slot] = i;
+    }
+}
+
+// Returns the slot in hashIndex for this name: either the slot containing it, or the empty slot where it would go.
+static unsigned int findHashSlot(const environmentTable* table, const char* name, size_t length) {
+    unsigned int slot = hashVariableName(name, length) & (table->hashSize - 1);
+    while (table->hashIndex[slot] >= 0) {
+        const char* variable = table->variables[table->hashIndex[slot]];
+        if ((strncmp(variable, name, length) == 0) && (variable[length] == '=')) break;
+        slot = (slot + 1) & (table->hashSize - 1);
+    }
+    return slot;
+}
+
+static environmentTable* createEnvironment(char* const envp[]) {
+    environmentTable* table = calloc(1, sizeof(environmentTable));
+    int numVariables = 0;
+    while (envp[numVariables] != NULL) numVariables++;
+    table->refCount = 1;
+    table->capacity = numVariables + 8;
+    table->variables = malloc((table->capacity + 1) * sizeof(char*));
+    for (int i = 0; i < numVariables; i++) {
+        // skip invalid entries and duplicates (the first one wins, as with getenv):
+        if (strchr(envp[i], '=') == NULL) continue;
+        if (table->hashSize > 0) {
+            unsigned int slot = findHashSlot(table, envp[i], variableNameLength(envp[i]));
+            if (table->hashIndex[slot] >= 0) continue;
+            table->hashIndex[slot] = table->numVariables;
+        }
+        table->variables[table->numVariables] = strdup(envp[i]);
+        table->numVariables += 1;
+        if (table->hashSize < 2 * (table->numVariables + 1)) rebuildHashIndex(table);
+    }
+    table->variables[table->numVariables] = NULL;
+    if (table->hashSize == 0) rebuildHashIndex(table);
+    return table;
+}
+
+static environmentTable* retainEnvironment(environmentTable* table) {
+    if (table != NULL) table->refCount += 1;
+    return table;
+}
+
+static void releaseEnvironment(environmentTable* table) {
+    if (table == NULL) return;
+    if (--table->refCount > 0) return;
+    for (int i = 0; i < table->numVariables; i++) free(table->variables[i]);
+    free(table->variables);
+    free(table->hashIndex);
+    free(table);
+}
+
+// Before changing the environment of the current process: if it is shared, take a private copy.
+static environmentTable* writableEnvironment(void) {
+    environmentTable* table = process(current_pid)->environment;
+    if (table->refCount > 1) {
+        environmentTable* copy = createEnvironment(table->variables);
+        releaseEnvironment(table);
+        process(current_pid)->environment = copy;
+        table = copy;
+    }
+    return table;
+}
+
+// Sets variable (a "NAME=value" string, now owned by the table). Replaces the existing value, if any.
+static void setEnvironmentVariable(environmentTable* table, char* variable, size_t nameLength) {
+    unsigned int slot = findHashSlot(table, variable, nameLength);
+    if (table->hashIndex[slot] >= 0) {
+        free(table->variables[table->hashIndex[slot]]);
+        table->variables[table->hashIndex[slot]] = variable;
+        return;
+    }
+    if (table->numVariables >= table->capacity) {
+        table->capacity = 2 * table->capacity + 8;
+        table->variables = realloc(table->variables, (table->capacity + 1) * sizeof(char*));
+    }
+    table->hashIndex[slot] = table->numVariables;
+    table->variables[table->numVariables] = variable;
+    table->numVariables += 1;
+    table->variables[table->numVariables] = NULL;
+    if (table->hashSize < 2 * (table->numVariables + 1)) rebuildHashIndex(table);
 }
 
 char* libc_getenv(const char* variableName) {
-    if (environment[current_pid] != NULL) {
+    environmentTable* table = process(current_pid)->environment;
+    if (table != NULL) {
         if (variableName == NULL) { return NULL; }
-        char** envp = environment[current_pid];
-        int varNameLen = strlen(variableName);
+        size_t varNameLen = strlen(variableName);
         if (varNameLen == 0) { return NULL; }
-        for (int i = 0; i < numVariablesSet[current_pid]; i++) {
-            if (envp[i] == NULL) { continue; }
-            if (strlen(envp[i]) < varNameLen) { continue; }
-            if (strncmp(variableName, envp[i], varNameLen) == 0) {
-                if (strlen(envp[i]) > varNameLen) {
-                    if (envp[i][varNameLen] == '=') {
-                        return envp[i] + varNameLen + 1;
-                    }
-                }
-            }
-            /*
-            char* position = strchr(envp[i],'=');
-            if (strncmp(variableName, envp[i], position - envp[i]) == 0) {
-                char* value = position + 1;
-                return value;
-            }
-             */
-        }
-        return NULL;
+        int position = table->hashIndex[findHashSlot(table, variableName, varNameLen)];
+        if (position < 0) { return NULL; }
+        return table->variables[position] + varNameLen + 1;
     } else {
         return getenv(variableName);
     }
@@ -253,7 +774,7 @@ char* libc_getenv(const char* variableName) {
 
 extern void set_session_errno(int n);
 int ios_setenv(const char* variableName, const char* value, int overwrite) {
-    if (environment[current_pid] != NULL) {
+    if (process(current_pid)->environment != NULL) {
         if (variableName == NULL) {
             set_session_errno(EINVAL);
             return -1;
@@ -267,29 +788,11 @@ int ios_setenv(const char* variableName, const char* value, int overwrite) {
             set_session_errno(EINVAL);
             return -1;
         }
-        char** envp = environment[current_pid];
-        int varNameLen = strlen(variableName);
-        for (int i = 0; i < numVariablesSet[current_pid]; i++) {
-            if (envp[i] == NULL) { continue; }
-            if (strncmp(variableName, envp[i], varNameLen) == 0) {
-                if (strlen(envp[i]) > varNameLen) {
-                    if (envp[i][varNameLen] == '=') {
-                        // This variable is defined in the current environment:
-                        if (overwrite == 0) { return 0; }
-                        envp[i] = realloc(envp[i], strlen(variableName) + strlen(value) + 2);
-                        sprintf(envp[i], "%s=%s", variableName, value);
-                        return 0;
-                    }
-                }
-            }
-        }
-        // Not found so far, add it to the list:
-        int pos = numVariablesSet[current_pid];
-        environment[current_pid] = realloc(envp, (numVariablesSet[current_pid] + 2) * sizeof(char*));
-        environment[current_pid][pos] = malloc(strlen(variableName) + strlen(value) + 2);
-        environment[current_pid][pos + 1] = NULL;
-        sprintf(environment[current_pid][pos], "%s=%s", variableName, value);
-        numVariablesSet[current_pid] += 1;
+        size_t varNameLen = strlen(variableName);
+        if ((overwrite == 0) && (libc_getenv(variableName) != NULL)) { return 0; }
+        char* variable = malloc(varNameLen + strlen(value) + 2);
+        sprintf(variable, "%s=%s", variableName, value);
+        setEnvironmentVariable(writableEnvironment(), variable, varNameLen);
         return 0;
     } else {
         return setenv(variableName, value, overwrite);
@@ -297,37 +800,15 @@ int ios_setenv(const char* variableName, const char* value, int overwrite) {
 }
 
 int ios_putenv(char* string) {
-    if (environment[current_pid] != NULL) {
-        unsigned length;
-        char     *temp;
-
+    if (process(current_pid)->environment != NULL) {
         /*  Find the length of the "NAME="  */
-        temp = strchr(string,'=');
+        char* temp = strchr(string,'=');
         if ( temp == 0 ) {
             set_session_errno(EINVAL);
             return( -1 );
         }
-        length = (unsigned) (temp - string + 1);
-
-        /*  Scan through the environment looking for "NAME="  */
-        char** envp = environment[current_pid];
-
-        for (int i = 0; i < numVariablesSet[current_pid]; i++) {
-            if (envp[i] == NULL) { continue; }
-            if ( strncmp( string, envp[i], length ) == 0 ) {
-                // Found it. Copy in place.
-                envp[i] = realloc(envp[i], strlen(string) + 1);
-                memcpy(envp[i], string, strlen(string) + 1);
-                return 0;
-            }
-        }
-        // Not found so far, add it to the list:
-        int pos = numVariablesSet[current_pid];
-        environment[current_pid] = realloc(envp, (numVariablesSet[current_pid] + 2) * sizeof(char*));
-        environment[current_pid][pos] = malloc(strlen(string) + 1);
-        environment[current_pid][pos + 1] = NULL;
-        memcpy(environment[current_pid][pos], string, strlen(string) + 1);
-        numVariablesSet[current_pid] += 1;
+        // We keep our own copy of the string:
+        setEnvironmentVariable(writableEnvironment(), strdup(string), temp - string);
         return 0;
     } else {
         return putenv(string);
@@ -337,7 +818,7 @@ int ios_putenv(char* string) {
 int ios_unsetenv(const char* variableName) {
     // Someone calls unsetenv once the process has been terminated.
     // Best thing to do is erase the environment and return
-    if (environment[current_pid] != NULL) {
+    if (process(current_pid)->environment != NULL) {
         if (variableName == NULL) {
             set_session_errno(EINVAL);
             return -1;
@@ -351,36 +832,18 @@ int ios_unsetenv(const char* variableName) {
             set_session_errno(EINVAL);
             return -1;
         }
-        char** envp = environment[current_pid];
-        int varNameLen = strlen(variableName);
-        for (int i = 0; i < numVariablesSet[current_pid]; i++) {
-            if (envp[i] == NULL) { continue; }
-            if (strncmp(variableName, envp[i], varNameLen) == 0) {
-                if (strlen(envp[i]) > varNameLen) {
-                    if (envp[i][varNameLen] == '=') {
-                        // This variable is defined in the current environment:
-                        free(envp[i]);
-                        envp[i] = NULL;
-                        if (i < numVariablesSet[current_pid] - 1) {
-                            for (int j = i; j < numVariablesSet[current_pid] - 1; j++) {
-                                envp[j] = envp[j+1];
-                            }
-                            envp[numVariablesSet[current_pid] - 1] = NULL;
-                        }
-                        numVariablesSet[current_pid] -= 1;
-                        environment[current_pid] = realloc(envp, (numVariablesSet[current_pid] + 1) * sizeof(char*));
-                        return 0;
-                    }
-                }
-            }
+        if (libc_getenv(variableName) == NULL) {
+            // Not found:
+            return 0;
         }
-        /*
-        for (int i = 0; i < numVariablesSet[current_pid]; i++) {
-            char* position = strstr(envp[i],"=");
-            if (strncmp(variableName, envp[i], position - envp[i]) == 0) {
-            }
-        } */
-        // Not found:
+        environmentTable* table = writableEnvironment();
+        size_t varNameLen = strlen(variableName);
+        int i = table->hashIndex[findHashSlot(table, variableName, varNameLen)];
+        // This variable is defined in the current environment. Remove it, keep the order of the others:
+        free(table->variables[i]);
+        memmove(table->variables + i, table->variables + i + 1, (table->numVariables - i) * sizeof(char*));
+        table->numVariables -= 1;
+        rebuildHashIndex(table);
         return 0;
     } else {
         return unsetenv(variableName);
@@ -393,61 +856,59 @@ int ios_unsetenv(const char* variableName) {
 extern char** environ;
 void resetEnvironment(pid_t pid);
 void storeEnvironment(char* envp[]) {
-    if (environment[current_pid] != NULL) {
-        // We already allocated one environment. Let's clean it:
-        resetEnvironment(current_pid);
-    }
-    int i = 0;
-    while (envp[i] != NULL) {
-        i++;
-    }
-    numVariablesSet[current_pid] = i;
-    environment[current_pid] = malloc((numVariablesSet[current_pid] + 1) * sizeof(char*));
-    for (int i = 0; i < numVariablesSet[current_pid]; i++) {
-        if (envp[i] != NULL)
-            environment[current_pid][i] = strdup(envp[i]);
-        else
-            environment[current_pid][i] = NULL;
-    }
-    // Keep NULL-termination:
-    environment[current_pid][numVariablesSet[current_pid]] = NULL;
+    environmentTable* table = createEnvironment(envp);
+    // If we already had an environment, release it:
+    resetEnvironment(current_pid);
+    process(current_pid)->environment = table;
 }
 
 // when the command is terminated, release the environment variables that were added.
 void resetEnvironment(pid_t pid) {
-    if (environment[pid] != NULL) {
-        // Free the variables allocated:
-        for (int i = 0; i < numVariablesSet[pid]; i++) {
-            if (environment[pid][i] == NULL) { continue; }
-            free(environment[pid][i]);
-            environment[pid][i] = NULL;
-        }
-        free(environment[pid]);
-        environment[pid] = NULL;
-        numVariablesSet[pid] = 0;
+    if (process(pid)->environment != NULL) {
+        releaseEnvironment(process(pid)->environment);
+        process(pid)->environment = NULL;
     }
 }
 
 char** environmentVariables(pid_t pid) {
-    if (environment[pid] != NULL) {
-        return environment[pid];
+    if (isValidPid(pid) && (process(pid)->environment != NULL)) {
+        return process(pid)->environment->variables;
     } else {
         return environ;
     }
 }
 
+static void inheritEnvironment(pid_t pid, environmentTable* parentEnvironment) {
+    // The previous process with this pid terminated long ago, we can release its environment:
+    resetEnvironment(pid);
+    if (parentEnvironment != NULL) process(pid)->environment = retainEnvironment(parentEnvironment);
+    else process(pid)->environment = createEnvironment(environ);
+}
+
 extern int chdir_nolock(const char* path); // defined in ios_system.m
 void ios_releaseThread(pthread_t thread) {
-    // TODO: this is inefficient. Replace with NSMutableArray?
-    for (int p = 0; p < IOS_MAX_THREADS; p++) {
-        if (thread_ids[p] == thread) {
+    // Usually, the thread releases itself and we know its pid. Otherwise, we scan the table.
+    pid_t first = 0;
+    if ((thread == pthread_self()) && isValidPid(threadPid) && (process(threadPid)->thread == thread)) first = threadPid;
+    int numProcesses = numProcessChunks * PROCESS_CHUNK_SIZE;
+    for (int p = first; p < numProcesses; p++) {
+        if (process(p)->thread == thread) {
+            if (thread == pthread_self()) {
+                threadPid = 0;
+                threadInterrupted = NULL;
+                // (a command released by another thread keeps its memory, it may still be running)
+                releaseCommandMemory(process(p));
+            }
             // fprintf(stderr, "Found Id %d\n", p);
             // Don't reset the environment; sometimes, commands try to change the environment while it is being erased.
             // resetEnvironment(p);
-            // fprintf(stderr, "Reset current directory to %s because process %d terminates\n", previousDirectory[p], p);
-            current_pid = previousPid[p];
-            thread_ids[p] = NULL;
-            chdir_nolock(previousDirectory[p]);
+            // fprintf(stderr, "Reset current directory to %s because process %d terminates\n", process(p)->previousDirectory, p);
+            recordProcessStats(p, thread);
+            current_pid = process(p)->previousPid;
+            process(p)->thread = NULL;
+            if (process(p)->previousDirectory != NULL) chdir_nolock(process(p)->previousDirectory);
+            releasePid(p);
+            signalProcessTermination();
             return;
         }
     }
@@ -458,12 +919,16 @@ void ios_releaseThread(pthread_t thread) {
 void ios_releaseThreadId(pid_t pid) {
     // Don't reset the environment; sometimes, commands try to change the environment while it is being erased.
     // resetEnvironment(pid);
-    if (thread_ids[pid] != 0) {
+    if (!isValidPid(pid)) return;
+    if (process(pid)->thread != 0) {
+        recordProcessStats(pid, process(pid)->thread);
         // fprintf(stderr, "Locking for pid %d in ios_releaseThreadId\n", pid);
-        // fprintf(stderr, "Reset current directory to %s because process %d terminates\n", previousDirectory[pid], pid);
-        chdir_nolock(previousDirectory[pid]);
-        current_pid = previousPid[pid];
-        thread_ids[pid] = 0;
+        // fprintf(stderr, "Reset current directory to %s because process %d terminates\n", process(pid)->previousDirectory, pid);
+        if (process(pid)->previousDirectory != NULL) chdir_nolock(process(pid)->previousDirectory);
+        current_pid = process(pid)->previousPid;
+        process(pid)->thread = 0;
+        releasePid(pid);
+        signalProcessTermination();
         // fprintf(stderr, "Unlocking for pid %d in ios_releaseThreadId\n", pid);
     } else {
         // fprintf(stderr, "ios_releaseThreadId: pid %d was already terminated.\n", pid);
@@ -479,29 +944,32 @@ pid_t ios_fork(void) { return ios_nextAvailablePid(); } // increases current_pid
 pid_t vfork(void) { return ios_nextAvailablePid(); }
 
 // simple replacement of waitpid for swift programs
-// We use "optnone" to prevent optimization, otherwise the while loops never end.
-__attribute__ ((optnone)) void ios_waitpid(pid_t pid) {
-
-    pthread_t threadToWaitFor;
+// The thread sleeps until a process terminates (signalled by ios_releaseThread), then checks again.
+void ios_waitpid(pid_t pid) {
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    pthread_mutex_lock(&wait_mtx);
     // Old system: no explicit pid, just store last thread Id.
     if ((pid == -1) || (pid == 0)) {
-        threadToWaitFor = ios_getLastThreadId();
-        while (threadToWaitFor != 0) {
-            threadToWaitFor = ios_getLastThreadId();
+        while (ios_getLastThreadId() != 0) {
+            waitForProcessTermination();
         }
+        pthread_mutex_unlock(&wait_mtx);
+        ios_addTimeSpentWaiting(&start);
         return;
     }
     // New system: thread Id is store with pid:
-    threadToWaitFor = ios_getThreadId(pid);
-    while (threadToWaitFor != 0) {
-        // -1: not started, >0 started, not finished, 0: finished
-        threadToWaitFor = ios_getThreadId(pid);
+    // -1: not started, >0 started, not finished, 0: finished
+    while (ios_getThreadId(pid) != 0) {
+        waitForProcessTermination();
     }
+    pthread_mutex_unlock(&wait_mtx);
+    ios_addTimeSpentWaiting(&start);
     // fprintf(stderr, "Returning from ios_waitpid for %d \n", pid);
     return;
 }
 
-__attribute__ ((optnone)) pid_t waitpid(pid_t pid, int *stat_loc, int options) {
+pid_t waitpid(pid_t pid, int *stat_loc, int options) {
     // pthread_join won't work,  because the thread might have been detached.
     // (and you can't re-join a detached thread).
     // -1 = the call waits for any child process (not good yet)
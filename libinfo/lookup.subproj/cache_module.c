@@ -39,13 +39,37 @@ uint32_t gL1CacheEnabled = 1;
 
 #define CACHE_COUNT CATEGORY_COUNT
 #define CACHE_MAX 20
+#define CACHE_TTL 600 /* seconds an entry is kept, even while its source says it is valid */
+
+/*
+ * Lookups that found nothing.  A source module can not tell when one of
+ * these becomes stale, so they are only kept for CACHE_NEG_TTL seconds.
+ */
+#define CACHE_NEG_MAX 20
+#define CACHE_NEG_TTL 30
 
 typedef struct
 {
-	pthread_mutex_t mutex;
+	int which;
+	uint32_t num;
+	char *name;
+	time_t stamp;
+} cache_neg_t;
+
+/*
+ * Readers share the lock and only take references; entries that have
+ * gone stale are left for the next add to replace.
+ */
+typedef struct
+{
+	pthread_rwlock_t lock;
 	int head;
 	si_item_t *item[CACHE_MAX];
+	time_t stamp[CACHE_MAX];
 	si_list_t *list;
+	time_t list_stamp;
+	int neg_head;
+	cache_neg_t neg[CACHE_NEG_MAX];
 } cache_store_t;
 
 typedef struct
@@ -53,24 +77,31 @@ typedef struct
 	cache_store_t cache_store[CACHE_COUNT];
 } cache_si_private_t;
 
+static time_t
+cache_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+	return ts.tv_sec;
+}
+
 static void *
-cache_validate_item(cache_si_private_t *pp, int cat, int where)
+cache_validate_item(cache_si_private_t *pp, int cat, int where, time_t now)
 {
 	si_item_t *item;
 
 	item = pp->cache_store[cat].item[where];
 	if (item == NULL) return NULL;
+	if ((now - pp->cache_store[cat].stamp[where]) >= CACHE_TTL) return NULL;
 
 	if (si_item_is_valid(item)) return si_item_retain(item);
 
-	si_item_release(item);
-	pp->cache_store[cat].item[where] = NULL;
-
 	return NULL;
 }
 
 static void *
-cache_validate_list(cache_si_private_t *pp, int cat)
+cache_validate_list(cache_si_private_t *pp, int cat, time_t now)
 {
 	uint32_t i, valid;
 	si_item_t *item, *last;
@@ -80,6 +111,7 @@ cache_validate_list(cache_si_private_t *pp, int cat)
 
 	if (list == NULL) return NULL;
 	if (list->count == 0) return NULL;
+	if ((now - pp->cache_store[cat].list_stamp) >= CACHE_TTL) return NULL;
 
 	last = list->entry[0];
 	valid = si_item_is_valid(last);
@@ -95,18 +127,31 @@ cache_validate_list(cache_si_private_t *pp, int cat)
 
 	if (valid) return si_list_retain(list);
 
-	si_list_release(list);
-	pp->cache_store[cat].list = NULL;
-
 	return NULL;
 }
 
+/* negative entries are kept for users and groups */
+static int
+cache_neg_category(int cat)
+{
+	return ((cat == CATEGORY_USER) || (cat == CATEGORY_GROUP));
+}
+
+static int
+cache_neg_match(cache_neg_t *neg, const char *name, uint32_t num, int which)
+{
+	if (neg->which != which) return 0;
+	if (which == SEL_NAME) return ((name != NULL) && (neg->name != NULL) && string_equal(name, neg->name));
+	return (neg->num == num);
+}
+
 static si_item_t *
 cache_fetch_item(si_mod_t *si, int cat, const char *name, uint32_t num, int which)
 {
 	int i;
 	cache_si_private_t *pp;
 	si_item_t *item;
+	time_t now;
 
 	if (si == NULL) return NULL;
 	if (gL1CacheEnabled == 0) return NULL;
@@ -114,11 +159,13 @@ cache_fetch_item(si_mod_t *si, int cat, const char *name, uint32_t num, int whic
 	pp = (cache_si_private_t *)si->private;
 	if (pp == NULL) return NULL;
 
-	pthread_mutex_lock(&pp->cache_store[cat].mutex);
+	now = cache_now();
+
+	pthread_rwlock_rdlock(&(pp->cache_store[cat].lock));
 
 	for (i = 0; i < CACHE_MAX; i++)
 	{
-		item = cache_validate_item(pp, cat, i);
+		item = cache_validate_item(pp, cat, i, now);
 		if (item && si_item_match(item, cat, name, num, which))
 		{
 			break;
@@ -130,7 +177,7 @@ cache_fetch_item(si_mod_t *si, int cat, const char *name, uint32_t num, int whic
 		}
 	}
 
-	pthread_mutex_unlock(&(pp->cache_store[cat].mutex));
+	pthread_rwlock_unlock(&(pp->cache_store[cat].lock));
 
 	return item;
 }
@@ -147,9 +194,9 @@ cache_fetch_list(si_mod_t *si, int cat)
 	pp = (cache_si_private_t *)si->private;
 	if (pp == NULL) return NULL;
 
-	pthread_mutex_lock(&(pp->cache_store[cat].mutex));
-	list = cache_validate_list(pp, cat);
-	pthread_mutex_unlock(&(pp->cache_store[cat].mutex));
+	pthread_rwlock_rdlock(&(pp->cache_store[cat].lock));
+	list = cache_validate_list(pp, cat, cache_now());
+	pthread_rwlock_unlock(&(pp->cache_store[cat].lock));
 
 	return list;
 }
@@ -395,8 +442,14 @@ cache_close(si_mod_t *si)
 			si_item_release(pp->cache_store[i].item[j]);
 			pp->cache_store[i].item[j] = NULL;
 		}
+
+		for (j = 0; j < CACHE_NEG_MAX; j++)
+		{
+			free(pp->cache_store[i].neg[j].name);
+			pp->cache_store[i].neg[j].name = NULL;
+		}
 		
-		pthread_mutex_destroy(&(pp->cache_store[i].mutex));
+		pthread_rwlock_destroy(&(pp->cache_store[i].lock));
 	}
 
 	free(pp);
@@ -477,16 +530,14 @@ si_module_static_cache(void)
 
 	dispatch_once(&once, ^{
 		cache_si_private_t *cache;
-		int i, j;
+		int i;
 		
 		cache = calloc(1, sizeof(cache_si_private_t));
 		si.name = strdup("cache");
 		si.private = cache;
 
 		for (i = 0; i < CACHE_COUNT; i++) {
-			for (j = 0; j < CACHE_MAX; j++) {
-				pthread_mutex_init(&(cache->cache_store[i].mutex), NULL);
-			}
+			pthread_rwlock_init(&(cache->cache_store[i].lock), NULL);
 		}
 	});
 
@@ -497,7 +548,9 @@ void
 si_cache_add_item(si_mod_t *si, si_mod_t *src, si_item_t *item)
 {
 	cache_si_private_t *pp;
-	int head, cat;
+	cache_neg_t *neg;
+	int head, cat, i;
+	time_t now;
 
 	if (si == NULL) return;
 	if (src == NULL) return;
@@ -514,18 +567,29 @@ si_cache_add_item(si_mod_t *si, si_mod_t *src, si_item_t *item)
 	pp = (cache_si_private_t *)si->private;
 	if (pp == NULL) return;
 
-	pthread_mutex_lock(&(pp->cache_store[cat].mutex));
+	now = cache_now();
+
+	pthread_rwlock_wrlock(&(pp->cache_store[cat].lock));
 
 	head = pp->cache_store[item->type].head;
 
 	si_item_release(pp->cache_store[item->type].item[head]);
 	pp->cache_store[item->type].item[head] = si_item_retain(item);
+	pp->cache_store[item->type].stamp[head] = now;
 
 	head++;
 	if (head >= CACHE_MAX) head = 0;
 	pp->cache_store[item->type].head = head;
 
-	pthread_mutex_unlock(&(pp->cache_store[cat].mutex));
+	/* the item answers any lookup that found nothing before */
+	for (i = 0; i < CACHE_NEG_MAX; i++)
+	{
+		neg = &(pp->cache_store[cat].neg[i]);
+		if (neg->stamp == 0) continue;
+		if (si_item_match(item, cat, neg->name, neg->num, neg->which)) neg->stamp = 0;
+	}
+
+	pthread_rwlock_unlock(&(pp->cache_store[cat].lock));
 }
 
 void
@@ -554,10 +618,93 @@ si_cache_add_list(si_mod_t *si, si_mod_t *src, si_list_t *list)
 	pp = (cache_si_private_t *)si->private;
 	if (pp == NULL) return;
 
-	pthread_mutex_lock(&(pp->cache_store[cat].mutex));
+	pthread_rwlock_wrlock(&(pp->cache_store[cat].lock));
 
 	si_list_release(pp->cache_store[item->type].list);
 	pp->cache_store[item->type].list = si_list_retain(list);
+	pp->cache_store[item->type].list_stamp = cache_now();
+
+	pthread_rwlock_unlock(&(pp->cache_store[cat].lock));
+}
+
+/*
+ * Returns 1 if a lookup of the same key in category cat found nothing
+ * less than CACHE_NEG_TTL seconds ago.
+ */
+int
+si_cache_is_negative(si_mod_t *si, int cat, const char *name, uint32_t num, int which)
+{
+	cache_si_private_t *pp;
+	cache_neg_t *neg;
+	time_t now;
+	int i, found;
+
+	if (si == NULL) return 0;
+	if (gL1CacheEnabled == 0) return 0;
+	if ((cat < 0) || (cat >= CACHE_COUNT)) return 0;
+	if (cache_neg_category(cat) == 0) return 0;
+
+	pp = (cache_si_private_t *)si->private;
+	if (pp == NULL) return 0;
+
+	now = cache_now();
+	found = 0;
+
+	pthread_rwlock_rdlock(&(pp->cache_store[cat].lock));
+
+	for (i = 0; (i < CACHE_NEG_MAX) && (found == 0); i++)
+	{
+		neg = &(pp->cache_store[cat].neg[i]);
+		if (neg->stamp == 0) continue;
+		if ((now - neg->stamp) >= CACHE_NEG_TTL) continue;
+		found = cache_neg_match(neg, name, num, which);
+	}
+
+	pthread_rwlock_unlock(&(pp->cache_store[cat].lock));
+
+	return found;
+}
+
+void
+si_cache_add_negative(si_mod_t *si, int cat, const char *name, uint32_t num, int which)
+{
+	cache_si_private_t *pp;
+	cache_neg_t *neg;
+	char *copy;
+	int head;
+
+	if (si == NULL) return;
+	if (gL1CacheEnabled == 0) return;
+	if ((cat < 0) || (cat >= CACHE_COUNT)) return;
+	if (cache_neg_category(cat) == 0) return;
+	if ((which == SEL_NAME) && (name == NULL)) return;
+
+	pp = (cache_si_private_t *)si->private;
+	if (pp == NULL) return;
+
+	copy = NULL;
+	if (which == SEL_NAME)
+	{
+		copy = strdup(name);
+		if (copy == NULL) return;
+	}
+
+	pthread_rwlock_wrlock(&(pp->cache_store[cat].lock));
+
+	head = pp->cache_store[cat].neg_head;
+	neg = &(pp->cache_store[cat].neg[head]);
+
+	free(neg->name);
+	neg->name = copy;
+	neg->num = num;
+	neg->which = which;
+	neg->stamp = cache_now();
+	/* a stamp of 0 marks an unused slot */
+	if (neg->stamp == 0) neg->stamp = 1;
+
+	head++;
+	if (head >= CACHE_NEG_MAX) head = 0;
+	pp->cache_store[cat].neg_head = head;
 
-	pthread_mutex_unlock(&(pp->cache_store[cat].mutex));
+	pthread_rwlock_unlock(&(pp->cache_store[cat].lock));
 }
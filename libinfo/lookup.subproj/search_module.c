@@ -57,6 +57,8 @@ typedef struct
 
 extern void si_cache_add_item(si_mod_t *si, si_mod_t *src, si_item_t *item);
 extern void si_cache_add_list(si_mod_t *si, si_mod_t *src, si_list_t *list);
+extern int si_cache_is_negative(si_mod_t *si, int cat, const char *name, uint32_t num, int which);
+extern void si_cache_add_negative(si_mod_t *si, int cat, const char *name, uint32_t num, int which);
 
 extern char **_fsi_tokenize(char *data, const char *sep, int trailing_empty, int *ntokens);
 extern char *_fsi_get_line(FILE *fp);
@@ -171,7 +173,7 @@ search_item_byname(si_mod_t *si, const char *name, int cat, si_item_t *(*call)(s
 	int i;
 	search_si_private_t *pp;
 	si_item_t *item;
-	si_mod_t *src;
+	si_mod_t *src, *cache;
 
 	if (si == NULL) return NULL;
 	if (call == NULL) return NULL;
@@ -179,6 +181,10 @@ search_item_byname(si_mod_t *si, const char *name, int cat, si_item_t *(*call)(s
 	pp = (search_si_private_t *)si->private;
 	if (pp == NULL) return NULL;
 
+	/* the last lookup of this key found nothing */
+	cache = search_cat_cache(pp, cat);
+	if (si_cache_is_negative(cache, cat, name, 0, SEL_NAME)) return NULL;
+
 	i = 0;
 
 	while (NULL != (src = search_get_module(pp, cat, &i)))
@@ -186,11 +192,12 @@ search_item_byname(si_mod_t *si, const char *name, int cat, si_item_t *(*call)(s
 		item = call(src, name);
 		if (item != NULL)
 		{
-			si_cache_add_item(search_cat_cache(pp, cat), src, item);
+			si_cache_add_item(cache, src, item);
 			return item;
 		}
 	}
 
+	si_cache_add_negative(cache, cat, name, 0, SEL_NAME);
 	return NULL;
 }
 
@@ -200,7 +207,7 @@ search_item_bynumber(si_mod_t *si, uint32_t number, int cat, si_item_t *(*call)(
 	int i;
 	search_si_private_t *pp;
 	si_item_t *item;
-	si_mod_t *src;
+	si_mod_t *src, *cache;
 
 	if (si == NULL) return NULL;
 	if (call == NULL) return NULL;
@@ -208,6 +215,10 @@ search_item_bynumber(si_mod_t *si, uint32_t number, int cat, si_item_t *(*call)(
 	pp = (search_si_private_t *)si->private;
 	if (pp == NULL) return NULL;
 
+	/* the last lookup of this key found nothing */
+	cache = search_cat_cache(pp, cat);
+	if (si_cache_is_negative(cache, cat, NULL, number, SEL_NUMBER)) return NULL;
+
 	i = 0;
 
 	while (NULL != (src = search_get_module(pp, cat, &i)))
@@ -215,11 +226,12 @@ search_item_bynumber(si_mod_t *si, uint32_t number, int cat, si_item_t *(*call)(
 		item = call(src, number);
 		if (item != NULL)
 		{
-			si_cache_add_item(search_cat_cache(pp, cat), src, item);
+			si_cache_add_item(cache, src, item);
 			return item;
 		}
 	}
 
+	si_cache_add_negative(cache, cat, NULL, number, SEL_NUMBER);
 	return NULL;
 }
 
@@ -47,12 +47,31 @@ ExtentManager::MergeExtent(const ExtentInfo &a, const ExtentInfo &b, ExtentInfo
 	c->numBlocks = max(a.blockAddr + a.numBlocks, b.blockAddr + b.numBlocks) - c->blockAddr;
 }
 
+//
+// Returns the first extent that is not entirely before ext, which is where
+// a run of extents overlapping (or touching) ext would start.  The map is
+// disjoint, so only the extent starting at or before ext can reach into it.
+//
+MapExtIt
+ExtentManager::FirstOverlap(const ExtentInfo &ext)
+{
+	MapExtIt curIt, prevIt;
+
+	curIt = extentMap.upper_bound(ext.blockAddr);
+	if (curIt != extentMap.begin()) {
+		prevIt = curIt;
+		prevIt--;
+		if (prevIt->first + prevIt->second >= ext.blockAddr)
+			curIt = prevIt;
+	}
+	return curIt;
+}
+
 void
 ExtentManager::AddBlockRangeExtent(off_t blockAddr, off_t numBlocks)
 {
-	struct ExtentInfo ext, newExt;
-	ListExtIt curIt, newIt;
-	bool merged = false;
+	struct ExtentInfo ext, curExt, newExt;
+	MapExtIt curIt;
 
 	// make the range a valid range
 	if ((blockAddr > totalBlocks) || (blockAddr + numBlocks < 0)) { // totally out of range, do nothing
@@ -69,57 +88,39 @@ ExtentManager::AddBlockRangeExtent(off_t blockAddr, off_t numBlocks)
 	ext.blockAddr = blockAddr;
 	ext.numBlocks = numBlocks;
 
-	for (curIt = extentList.begin(); curIt != extentList.end(); curIt++) {
-		if (BeforeExtent(ext, *curIt))
-			break;
-		if (!BeforeExtent(*curIt, ext)) { // overlapped extents
-			MergeExtent(ext, *curIt, &newExt);
-			*curIt = newExt;
-			merged = true;
+	// merge every extent that overlaps or touches ext into it
+	curIt = FirstOverlap(ext);
+	while (curIt != extentMap.end()) {
+		curExt.blockAddr = curIt->first;
+		curExt.numBlocks = curIt->second;
+		if (BeforeExtent(ext, curExt)) // curIt is after ext now, we are done
 			break;
-		}
-	}
-
-	// insert ext before curIt
-	if (!merged) {
-		curIt = extentList.insert(curIt, ext); // throws bad_alloc when out of memory
-	}
-
-	// merge the extents
-	newIt = curIt;
-	curIt = extentList.begin();
-	while (curIt != extentList.end()) {
-		if (curIt == newIt || BeforeExtent(*curIt, *newIt)) { // curIt is before newIt
-			curIt++;
-			continue;
-		}
-		if (BeforeExtent(*newIt, *curIt)) { // curIt is after newIt now, we are done
-			break;
-		}
-		// merge the two extents
-		MergeExtent(*curIt, *newIt, &newExt);
-		*newIt = newExt;
-		curIt = extentList.erase(curIt);
+		MergeExtent(ext, curExt, &newExt);
+		ext = newExt;
+		extentMap.erase(curIt++);
 	}
+	extentMap[ext.blockAddr] = ext.numBlocks; // throws bad_alloc when out of memory
 	// printf("After %s(%lld, %lld)\n", __func__, blockAddr, numBlocks);	 DebugPrint();
 } // ExtentManager::AddBlockRangeExtent
 
 void
 ExtentManager::RemoveBlockRangeExtent(off_t blockAddr, off_t numBlocks)
 {
-	struct ExtentInfo ext, newExt;
-	ListExtIt curIt;
+	struct ExtentInfo ext, curExt, newExt;
+	MapExtIt curIt;
+
+	// an empty range would only split an extent into two that touch
+	if (numBlocks <= 0)
+		return;
 
 	ext.blockAddr = blockAddr;
 	ext.numBlocks = numBlocks;
 
-	curIt = extentList.begin();
-	while (curIt != extentList.end()) {
-		if (BeforeExtent(*curIt, ext)) {
-			curIt++;
-			continue;
-		}
-		if (BeforeExtent(ext, *curIt)) // we are done
+	curIt = FirstOverlap(ext);
+	while (curIt != extentMap.end()) {
+		curExt.blockAddr = curIt->first;
+		curExt.numBlocks = curIt->second;
+		if (BeforeExtent(ext, curExt)) // we are done
 			break;
 		
 		//
@@ -128,43 +129,43 @@ ExtentManager::RemoveBlockRangeExtent(off_t blockAddr, off_t numBlocks)
 		// or be split into two non-contiguous extents.
 		//
 		
-		if (curIt->blockAddr >= ext.blockAddr &&
-			curIt->blockAddr + curIt->numBlocks <= ext.blockAddr + ext.numBlocks) {
+		if (curExt.blockAddr >= ext.blockAddr &&
+			curExt.blockAddr + curExt.numBlocks <= ext.blockAddr + ext.numBlocks) {
 			//
 			// The input extent totally contains *curIt, so remove *curIt.
 			//
-			curIt = extentList.erase(curIt);
-		} else if (curIt->blockAddr < ext.blockAddr &&
-			curIt->blockAddr + curIt->numBlocks > ext.blockAddr + ext.numBlocks) {
+			extentMap.erase(curIt++);
+		} else if (curExt.blockAddr < ext.blockAddr &&
+			curExt.blockAddr + curExt.numBlocks > ext.blockAddr + ext.numBlocks) {
 			//
 			// The input extent does not include the start of *curIt, nor the end of *curIt,
 			// so split *curIt into two extents.
 			//
 			newExt.blockAddr = ext.blockAddr + ext.numBlocks;
-			newExt.numBlocks = curIt->blockAddr + curIt->numBlocks - newExt.blockAddr;
-			curIt->numBlocks = ext.blockAddr - curIt->blockAddr;
+			newExt.numBlocks = curExt.blockAddr + curExt.numBlocks - newExt.blockAddr;
+			curIt->second = ext.blockAddr - curExt.blockAddr;
+			curIt = extentMap.insert(++curIt, make_pair(newExt.blockAddr, newExt.numBlocks)); // throws bad_alloc when out of memory
 			curIt++;
-			extentList.insert(curIt, newExt); // throws bad_alloc when out of memory
-			curIt++;	
 		} else {
 			//
 			// The input extent contains either the start or the end of *curIt, but not both.
 			// The remove will leave either the end or the start of *curIt (respectively) and
-			// not change the number of extents in the list.
+			// not change the number of extents in the map.
 			//
-			if (curIt->blockAddr >= ext.blockAddr) {
+			if (curExt.blockAddr >= ext.blockAddr) {
 				//
-				// Remove the start of *curIt by updating both its starting block and size.
+				// Remove the start of *curIt by moving it to a new starting block.
 				//
-				assert(curIt->blockAddr + curIt->numBlocks > ext.blockAddr + ext.numBlocks);
+				assert(curExt.blockAddr + curExt.numBlocks > ext.blockAddr + ext.numBlocks);
 				newExt.blockAddr = ext.blockAddr + ext.numBlocks;
-				newExt.numBlocks = curIt->blockAddr + curIt->numBlocks - newExt.blockAddr;
-				*curIt = newExt;
+				newExt.numBlocks = curExt.blockAddr + curExt.numBlocks - newExt.blockAddr;
+				extentMap.erase(curIt++);
+				curIt = extentMap.insert(curIt, make_pair(newExt.blockAddr, newExt.numBlocks)); // throws bad_alloc when out of memory
 			} else {
 				//
 				// Remove the end of *curIt by updating its size.
 				//
-				curIt->numBlocks = ext.blockAddr - curIt->blockAddr;
+				curIt->second = ext.blockAddr - curExt.blockAddr;
 			}
 			curIt++;
 		}
@@ -184,10 +185,10 @@ ExtentManager::AddByteRangeExtent(off_t byteAddr, off_t numBytes)
 void
 ExtentManager::DebugPrint()
 {
-	ListExtIt it;
+	MapExtIt it;
 
-	for (it = extentList.begin(); it != extentList.end(); it++) {
-		printf("[%lld, %lld] ", it->blockAddr, it->numBlocks);
+	for (it = extentMap.begin(); it != extentMap.end(); it++) {
+		printf("[%lld, %lld] ", it->first, it->second);
 	}
 	printf("\n");
 }
@@ -207,11 +208,11 @@ const char *DebugDescription(class ExtentManager *extMan)
 	char *result = strdup("");
 	char *temp;
 	
-	ListExtIt it;
+	MapExtIt it;
 
-	for (it = extMan->extentList.begin(); it != extMan->extentList.end(); it++) {
+	for (it = extMan->extentMap.begin(); it != extMan->extentMap.end(); it++) {
 		temp = result;
-		asprintf(&result, "%s[%lld, %lld] ", temp, it->blockAddr, it->numBlocks);
+		asprintf(&result, "%s[%lld, %lld] ", temp, it->first, it->second);
 		free(temp);
 	}
 	
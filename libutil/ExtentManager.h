@@ -26,7 +26,7 @@
 #ifndef EXTENTMANAGER_H
 #define EXTENTMANAGER_H
 
-#include <list>
+#include <map>
 #include <vector>
 #include <algorithm>
 #include <sys/types.h>
@@ -45,7 +45,11 @@ inline bool BeforeExtent(const ExtentInfo &a, const ExtentInfo &b)
 		return (a.blockAddr + a.numBlocks) < b.blockAddr;
 }
 
-typedef list<ExtentInfo>::iterator ListExtIt;
+// Extents are kept by start block, mapped to their length.  Extents that
+// overlap or touch are merged when added, so the map stays sorted and
+// disjoint and a range is found with one lookup instead of a list walk.
+typedef map<off_t, off_t> ExtentMap;
+typedef ExtentMap::iterator MapExtIt;
 
 class ExtentManager {
 public:
@@ -62,13 +66,14 @@ public:
 
 protected:
 	void MergeExtent(const ExtentInfo &a, const ExtentInfo &b, ExtentInfo *c);
+	MapExtIt FirstOverlap(const ExtentInfo &ext);
 
 public:
 	size_t blockSize;
 	size_t nativeBlockSize;
 	off_t totalBytes;
 	off_t totalBlocks;
-	list<ExtentInfo> extentList;
+	ExtentMap extentMap;
 };
 
 #endif // #ifndef EXTENTMANAGER_H
@@ -0,0 +1,472 @@
+/*
+ * dirwalk -- directory reader and tree fan-out shared by the file commands.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <sys/attr.h>
+#include <sys/vnode.h>
+#endif
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dirwalk.h"
+#include "ios_error.h"
+
+/* A dw_list being filled in */
+struct dw_build {
+	struct dw_list	*dl;
+	int		 want;
+	size_t		 size;		/* Entries allocated */
+	size_t		 namelen;	/* Bytes of dl_names used */
+	size_t		 namesize;
+};
+
+static size_t	dw_add(struct dw_build *, const char *);
+static void	dw_finish(struct dw_build *);
+static int	dw_namecmp(const void *, const void *);
+static int	dw_readdir(int, struct dw_build *);
+static void	dw_stat(int, struct dw_build *, size_t);
+static void	*dw_worker(void *);
+#ifdef __APPLE__
+static int	dw_readbulk(int, struct dw_build *);
+#endif
+
+/*
+ * Read the entries of the directory open as dfd, but for ``.'' and
+ * ``..'', with the attributes named by want.  Entries that could not be
+ * stat'ed have de_errno set.  Returns -1, with errno set, if the
+ * directory could not be read.
+ */
+int
+dirwalk_read(int dfd, int want, struct dw_list *dl)
+{
+	struct dw_build b;
+	int rval;
+
+	memset(dl, 0, sizeof(*dl));
+	memset(&b, 0, sizeof(b));
+	b.dl = dl;
+	b.want = want;
+#ifdef __APPLE__
+	if ((rval = dw_readbulk(dfd, &b)) == 1)
+#endif
+		rval = dw_readdir(dfd, &b);
+	if (rval == -1) {
+		dirwalk_free(dl);
+		return (-1);
+	}
+	dw_finish(&b);
+	if (want & DW_SORT && dl->dl_count > 1)
+		qsort(dl->dl_ents, dl->dl_count, sizeof(*dl->dl_ents),
+		    dw_namecmp);
+	return (0);
+}
+
+void
+dirwalk_free(struct dw_list *dl)
+{
+
+	free(dl->dl_ents);
+	free(dl->dl_sbs);
+	free(dl->dl_names);
+	memset(dl, 0, sizeof(*dl));
+}
+
+/*
+ * Make room for one more entry, called name, and return its index.
+ */
+static size_t
+dw_add(struct dw_build *b, const char *name)
+{
+	struct dw_list *dl;
+	struct dw_entry *e;
+	size_t len;
+
+	dl = b->dl;
+	if (dl->dl_count == b->size) {
+		b->size = b->size ? b->size * 2 : 64;
+		if ((dl->dl_ents = reallocf(dl->dl_ents,
+		    b->size * sizeof(*dl->dl_ents))) == NULL)
+			err(1, "realloc");
+		if (b->want & DW_STAT & ~DW_TYPE &&
+		    (dl->dl_sbs = reallocf(dl->dl_sbs,
+		    b->size * sizeof(*dl->dl_sbs))) == NULL)
+			err(1, "realloc");
+	}
+	len = strlen(name);
+	if (b->namelen + len + 1 > b->namesize) {
+		do
+			b->namesize = b->namesize ? b->namesize * 2 : 4096;
+		while (b->namelen + len + 1 > b->namesize);
+		if ((dl->dl_names = reallocf(dl->dl_names,
+		    b->namesize)) == NULL)
+			err(1, "realloc");
+	}
+	memcpy(dl->dl_names + b->namelen, name, len + 1);
+	b->namelen += len + 1;
+
+	e = &dl->dl_ents[dl->dl_count];
+	memset(e, 0, sizeof(*e));
+	e->de_namelen = len;
+	if (dl->dl_sbs != NULL)
+		memset(&dl->dl_sbs[dl->dl_count], 0, sizeof(*dl->dl_sbs));
+	return (dl->dl_count++);
+}
+
+/*
+ * Point the entries at their names and attributes, now that nothing
+ * moves any more.
+ */
+static void
+dw_finish(struct dw_build *b)
+{
+	struct dw_list *dl;
+	struct dw_entry *e;
+	char *name;
+	size_t i;
+
+	dl = b->dl;
+	name = dl->dl_names;
+	for (i = 0; i < dl->dl_count; i++) {
+		e = &dl->dl_ents[i];
+		e->de_name = name;
+		name += e->de_namelen + 1;
+		if (dl->dl_sbs != NULL && e->de_errno == 0)
+			e->de_sb = &dl->dl_sbs[i];
+	}
+}
+
+static int
+dw_namecmp(const void *a, const void *b)
+{
+
+	return (strcmp(((const struct dw_entry *)a)->de_name,
+	    ((const struct dw_entry *)b)->de_name));
+}
+
+/*
+ * Stat entry i, whose name is the last one added, relative to dfd.
+ */
+static void
+dw_stat(int dfd, struct dw_build *b, size_t i)
+{
+	struct dw_entry *e;
+	struct stat sb, *sp;
+	const char *name;
+
+	e = &b->dl->dl_ents[i];
+	name = b->dl->dl_names + b->namelen - e->de_namelen - 1;
+	sp = b->dl->dl_sbs != NULL ? &b->dl->dl_sbs[i] : &sb;
+	if (fstatat(dfd, name, sp, AT_SYMLINK_NOFOLLOW) == -1)
+		e->de_errno = errno;
+	else
+		e->de_type = sp->st_mode & S_IFMT;
+}
+
+static int
+dw_readdir(int dfd, struct dw_build *b)
+{
+	DIR *dirp;
+	struct dirent *dp;
+	size_t i;
+	int fd;
+
+	/* fdopendir() takes the descriptor over */
+	if ((fd = dup(dfd)) == -1)
+		return (-1);
+	if ((dirp = fdopendir(fd)) == NULL) {
+		(void)close(fd);
+		return (-1);
+	}
+	while ((dp = readdir(dirp)) != NULL) {
+		if (dp->d_name[0] == '.' && (dp->d_name[1] == '\0' ||
+		    (dp->d_name[1] == '.' && dp->d_name[2] == '\0')))
+			continue;
+		i = dw_add(b, dp->d_name);
+		if (b->dl->dl_sbs != NULL || dp->d_type == DT_UNKNOWN)
+			dw_stat(dfd, b, i);
+		else
+			b->dl->dl_ents[i].de_type = DTTOIF(dp->d_type);
+	}
+	(void)closedir(dirp);
+	return (0);
+}
+
+#ifdef __APPLE__
+#define	BULK_BUFSIZE	(128 * 1024)
+
+#define	BULK_GET(v, bit, set) do {					\
+	if ((set) & (bit)) {						\
+		memcpy(&(v), field, sizeof(v));				\
+		field += sizeof(v);					\
+	}								\
+} while (0)
+
+/*
+ * Read the directory with getattrlistbulk(), asking only for what the
+ * caller wants.  Entries whose attributes come back incomplete, and
+ * directories when their link count or size is wanted, are stat'ed.
+ * Returns 1 if the directory cannot be read this way: nothing has been
+ * read from dfd yet.
+ */
+static int
+dw_readbulk(int dfd, struct dw_build *b)
+{
+	struct attrlist al;
+	attribute_set_t rattrs;
+	attrreference_t nref;
+	struct timespec crtime, modtime, chgtime, acctime;
+	struct dw_entry *e;
+	struct stat *sp;
+	char *buf, *cp, *field, *name;
+	u_int32_t len, error, objtype, ownerid, grpid, mask, flags;
+	u_int32_t dlinks, nlink, iosize, devtype;
+	u_int32_t cmnneed, fileneed;
+	u_int64_t fileid;
+	off_t allocsize, datalen;
+	dev_t devid;
+	mode_t type;
+	size_t i;
+	int count, j, nread, needstat, saved;
+
+	memset(&al, 0, sizeof(al));
+	al.bitmapcount = ATTR_BIT_MAP_COUNT;
+	al.commonattr = ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_NAME |
+	    ATTR_CMN_OBJTYPE | ATTR_CMN_ERROR;
+	if (b->want & DW_INODE)
+		al.commonattr |= ATTR_CMN_DEVID | ATTR_CMN_FILEID;
+	if (b->want & DW_TIMES)
+		al.commonattr |= ATTR_CMN_CRTIME | ATTR_CMN_MODTIME |
+		    ATTR_CMN_CHGTIME | ATTR_CMN_ACCTIME;
+	if (b->want & DW_OWNER)
+		al.commonattr |= ATTR_CMN_OWNERID | ATTR_CMN_GRPID |
+		    ATTR_CMN_ACCESSMASK | ATTR_CMN_FLAGS;
+	if (b->want & DW_DIRLINKS)
+		al.dirattr = ATTR_DIR_LINKCOUNT;
+	if (b->want & DW_NLINK)
+		al.fileattr |= ATTR_FILE_LINKCOUNT;
+	if (b->want & DW_SIZE)
+		al.fileattr |= ATTR_FILE_ALLOCSIZE | ATTR_FILE_DATALENGTH;
+	if (b->want & DW_MISC)
+		al.fileattr |= ATTR_FILE_IOBLOCKSIZE | ATTR_FILE_DEVTYPE;
+	/* Needed to fill in a struct stat; the device type may be missing */
+	cmnneed = al.commonattr & ~(ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_ERROR);
+	fileneed = al.fileattr & ~ATTR_FILE_DEVTYPE;
+
+	if ((buf = malloc(BULK_BUFSIZE)) == NULL)
+		return (1);
+	nread = 0;
+	while ((count = getattrlistbulk(dfd, &al, buf, BULK_BUFSIZE, 0)) > 0) {
+		nread += count;
+		for (cp = buf, j = 0; j < count; j++, cp += len) {
+			memcpy(&len, cp, sizeof(len));
+			field = cp + sizeof(len);
+			memcpy(&rattrs, field, sizeof(rattrs));
+			field += sizeof(rattrs);
+			error = 0;
+			BULK_GET(error, ATTR_CMN_ERROR, rattrs.commonattr);
+			if (!(rattrs.commonattr & ATTR_CMN_NAME))
+				continue;
+			memcpy(&nref, field, sizeof(nref));
+			name = field + nref.attr_dataoffset;
+			field += sizeof(nref);
+			objtype = VNON;
+			dlinks = devtype = 0;
+			BULK_GET(devid, ATTR_CMN_DEVID, rattrs.commonattr);
+			BULK_GET(objtype, ATTR_CMN_OBJTYPE, rattrs.commonattr);
+			BULK_GET(crtime, ATTR_CMN_CRTIME, rattrs.commonattr);
+			BULK_GET(modtime, ATTR_CMN_MODTIME, rattrs.commonattr);
+			BULK_GET(chgtime, ATTR_CMN_CHGTIME, rattrs.commonattr);
+			BULK_GET(acctime, ATTR_CMN_ACCTIME, rattrs.commonattr);
+			BULK_GET(ownerid, ATTR_CMN_OWNERID, rattrs.commonattr);
+			BULK_GET(grpid, ATTR_CMN_GRPID, rattrs.commonattr);
+			BULK_GET(mask, ATTR_CMN_ACCESSMASK, rattrs.commonattr);
+			BULK_GET(flags, ATTR_CMN_FLAGS, rattrs.commonattr);
+			BULK_GET(fileid, ATTR_CMN_FILEID, rattrs.commonattr);
+			BULK_GET(dlinks, ATTR_DIR_LINKCOUNT, rattrs.dirattr);
+			BULK_GET(nlink, ATTR_FILE_LINKCOUNT, rattrs.fileattr);
+			BULK_GET(allocsize, ATTR_FILE_ALLOCSIZE, rattrs.fileattr);
+			BULK_GET(iosize, ATTR_FILE_IOBLOCKSIZE, rattrs.fileattr);
+			BULK_GET(devtype, ATTR_FILE_DEVTYPE, rattrs.fileattr);
+			BULK_GET(datalen, ATTR_FILE_DATALENGTH, rattrs.fileattr);
+
+			switch (objtype) {
+			case VDIR:	type = S_IFDIR; break;
+			case VREG:	type = S_IFREG; break;
+			case VLNK:	type = S_IFLNK; break;
+			case VBLK:	type = S_IFBLK; break;
+			case VCHR:	type = S_IFCHR; break;
+			case VFIFO:	type = S_IFIFO; break;
+			case VSOCK:	type = S_IFSOCK; break;
+			default:	type = 0; break;
+			}
+			i = dw_add(b, name);
+			e = &b->dl->dl_ents[i];
+			e->de_type = type;
+			e->de_dirlinks = dlinks;
+
+			/* Directories have no link count or size here */
+			needstat = error != 0 || type == 0 ||
+			    (rattrs.commonattr & cmnneed) != cmnneed ||
+			    (type == S_IFDIR ? (b->want &
+			    (DW_NLINK | DW_SIZE | DW_MISC)) != 0 :
+			    (rattrs.fileattr & fileneed) != fileneed);
+			if (needstat) {
+				dw_stat(dfd, b, i);
+				continue;
+			}
+			if ((sp = b->dl->dl_sbs) == NULL)
+				continue;
+			sp += i;
+			sp->st_mode = type;
+			if (b->want & DW_INODE) {
+				sp->st_dev = devid;
+				sp->st_ino = fileid;
+			}
+			if (b->want & DW_NLINK)
+				sp->st_nlink = nlink;
+			if (b->want & DW_SIZE) {
+				sp->st_size = datalen;
+				sp->st_blocks = howmany(allocsize, S_BLKSIZE);
+			}
+			if (b->want & DW_OWNER) {
+				sp->st_mode |= mask & ALLPERMS;
+				sp->st_uid = ownerid;
+				sp->st_gid = grpid;
+				sp->st_flags = flags;
+			}
+			if (b->want & DW_TIMES) {
+				sp->st_atimespec = acctime;
+				sp->st_mtimespec = modtime;
+				sp->st_ctimespec = chgtime;
+				sp->st_birthtimespec = crtime;
+			}
+			if (b->want & DW_MISC) {
+				sp->st_rdev = devtype;
+				sp->st_blksize = iosize;
+			}
+		}
+	}
+	saved = errno;
+	free(buf);
+	if (count == -1) {
+		if (nread == 0)
+			return (1);
+		errno = saved;
+		return (-1);
+	}
+	return (0);
+}
+#endif /* __APPLE__ */
+
+/*
+ * Set up pool to call func, with pool and an item, for each item pushed.
+ * The threads write where the calling thread does.
+ */
+void
+dw_pool_init(struct dw_pool *pool, void (*func)(struct dw_pool *, void *),
+    void *arg)
+{
+
+	memset(pool, 0, sizeof(*pool));
+	pthread_mutex_init(&pool->dp_mtx, NULL);
+	pthread_cond_init(&pool->dp_work, NULL);
+	pool->dp_func = func;
+	pool->dp_arg = arg;
+	pool->dp_in = thread_stdin;
+	pool->dp_out = thread_stdout;
+	pool->dp_err = thread_stderr;
+}
+
+/*
+ * Queue item for a thread; the last one pushed is the first one taken.
+ * Not to be called with dp_mtx held.
+ */
+void
+dw_pool_push(struct dw_pool *pool, void *item)
+{
+
+	pthread_mutex_lock(&pool->dp_mtx);
+	if (pool->dp_depth == pool->dp_size) {
+		pool->dp_size = pool->dp_size ? pool->dp_size * 2 : 64;
+		if ((pool->dp_stack = reallocf(pool->dp_stack,
+		    pool->dp_size * sizeof(*pool->dp_stack))) == NULL)
+			err(1, "realloc");
+	}
+	pool->dp_stack[pool->dp_depth++] = item;
+	pthread_cond_signal(&pool->dp_work);
+	pthread_mutex_unlock(&pool->dp_mtx);
+}
+
+/*
+ * Work through the items with nthreads threads, until none is left and
+ * no thread is still at work to push more.  If no thread can be started
+ * the calling thread does it all.
+ */
+void
+dw_pool_run(struct dw_pool *pool, unsigned int nthreads)
+{
+	pthread_t *threads;
+	unsigned int n;
+
+	if ((threads = calloc(MAX(nthreads, 1), sizeof(*threads))) == NULL)
+		err(1, "calloc");
+	for (n = 0; n < nthreads; n++)
+		if (pthread_create(&threads[n], NULL, dw_worker, pool) != 0)
+			break;
+	if (n == 0)
+		(void)dw_worker(pool);
+	while (n > 0)
+		pthread_join(threads[--n], NULL);
+	free(threads);
+}
+
+void
+dw_pool_destroy(struct dw_pool *pool)
+{
+
+	pthread_cond_destroy(&pool->dp_work);
+	pthread_mutex_destroy(&pool->dp_mtx);
+	free(pool->dp_stack);
+	pool->dp_stack = NULL;
+}
+
+static void *
+dw_worker(void *arg)
+{
+	struct dw_pool *pool = arg;
+	void *item;
+
+	thread_stdin = pool->dp_in;
+	thread_stdout = pool->dp_out;
+	thread_stderr = pool->dp_err;
+
+	pthread_mutex_lock(&pool->dp_mtx);
+	for (;;) {
+		while (pool->dp_depth == 0 && pool->dp_busy > 0)
+			pthread_cond_wait(&pool->dp_work, &pool->dp_mtx);
+		if (pool->dp_depth == 0)
+			break;
+		item = pool->dp_stack[--pool->dp_depth];
+		pool->dp_busy++;
+		pthread_mutex_unlock(&pool->dp_mtx);
+
+		pool->dp_func(pool, item);
+
+		pthread_mutex_lock(&pool->dp_mtx);
+		/* Wake the others to finish */
+		if (--pool->dp_busy == 0)
+			pthread_cond_broadcast(&pool->dp_work);
+	}
+	pthread_mutex_unlock(&pool->dp_mtx);
+	return (NULL);
+}
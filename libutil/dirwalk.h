@@ -0,0 +1,74 @@
+/*
+ * dirwalk -- directory reader and tree fan-out shared by the file commands.
+ *
+ * dirwalk_read() reads a whole directory, given its descriptor, along
+ * with just the attributes the caller asks for.  Where getattrlistbulk()
+ * is supported the names and the attributes come back together; elsewhere
+ * the directory is read with readdir() and the entries are stat'ed only
+ * when d_type does not answer the question.
+ *
+ * A struct dw_pool hands the directories of a tree out to a number of
+ * threads: each call of the work function may push more of them.
+ */
+
+#ifndef DIRWALK_H
+#define	DIRWALK_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+#include <stdio.h>
+
+/* What dirwalk_read() is asked to fill in, in each entry's de_sb */
+#define	DW_TYPE		0x0001	/* de_type, always there */
+#define	DW_INODE	0x0002	/* st_dev, st_ino */
+#define	DW_NLINK	0x0004	/* st_nlink */
+#define	DW_SIZE		0x0008	/* st_size, st_blocks */
+#define	DW_OWNER	0x0010	/* st_uid, st_gid, st_flags, permission bits */
+#define	DW_TIMES	0x0020	/* st_[amcb]timespec */
+#define	DW_MISC		0x0040	/* st_rdev, st_blksize */
+#define	DW_STAT		0x007f	/* All of struct stat */
+#define	DW_DIRLINKS	0x0100	/* de_dirlinks, for directories */
+#define	DW_SORT		0x0200	/* Entries in strcmp() order of their names */
+
+struct dw_entry {
+	char		*de_name;
+	size_t		 de_namelen;
+	mode_t		 de_type;	/* S_IFMT bits, 0 if unknown */
+	int		 de_errno;	/* Could not be stat'ed, de_sb is unset */
+	u_int32_t	 de_dirlinks;	/* Links to a directory, 0 if unknown */
+	struct stat	*de_sb;		/* NULL if only DW_TYPE was asked for */
+};
+
+struct dw_list {
+	struct dw_entry	*dl_ents;
+	size_t		 dl_count;
+	struct stat	*dl_sbs;
+	char		*dl_names;
+};
+
+struct dw_pool {
+	pthread_mutex_t	 dp_mtx;	/* Also for the work function's use */
+	pthread_cond_t	 dp_work;
+	void		**dp_stack;	/* Items not taken yet */
+	size_t		 dp_depth;
+	size_t		 dp_size;
+	unsigned int	 dp_busy;	/* Threads in the work function */
+	void		(*dp_func)(struct dw_pool *, void *);
+	void		*dp_arg;
+	FILE		*dp_in;		/* The caller's, for the threads */
+	FILE		*dp_out;
+	FILE		*dp_err;
+};
+
+int	 dirwalk_read(int, int, struct dw_list *);
+void	 dirwalk_free(struct dw_list *);
+
+void	 dw_pool_init(struct dw_pool *, void (*)(struct dw_pool *, void *),
+	    void *);
+void	 dw_pool_push(struct dw_pool *, void *);
+void	 dw_pool_run(struct dw_pool *, unsigned int);
+void	 dw_pool_destroy(struct dw_pool *);
+
+#endif /* !DIRWALK_H */
@@ -0,0 +1,263 @@
+/*
+ * filecmp -- equality check of two files, shared by diff and cmp.
+ */
+
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "filecmp.h"
+#include "ios_error.h"
+
+#define	FC_WINDOW	(8 * 1024 * 1024)	/* Bytes mapped at a time */
+#define	FC_BUFSIZE	(128 * 1024)		/* Read buffers for the rest */
+#define	FC_CLONEMIN	(1024 * 1024)		/* Worth asking about clones */
+
+static int	fc_fill(int, char *, size_t, size_t *);
+static off_t	fc_shared(int, int, off_t, off_t);
+static int	fc_window(int, int, off_t, size_t, size_t *);
+
+/*
+ * Returns the offset of the first byte at which a and b differ, or len
+ * if they are the same.
+ */
+size_t
+filecmp_mem(const void *a, const void *b, size_t len)
+{
+	const unsigned char *p = a, *q = b;
+	size_t i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+	uint8x16_t x;
+
+	for (; len - i >= 64; i += 64) {
+		x = veorq_u8(vld1q_u8(p + i), vld1q_u8(q + i));
+		x = vorrq_u8(x, veorq_u8(vld1q_u8(p + i + 16),
+		    vld1q_u8(q + i + 16)));
+		x = vorrq_u8(x, veorq_u8(vld1q_u8(p + i + 32),
+		    vld1q_u8(q + i + 32)));
+		x = vorrq_u8(x, veorq_u8(vld1q_u8(p + i + 48),
+		    vld1q_u8(q + i + 48)));
+		if (vmaxvq_u8(x) != 0)
+			break;
+	}
+#else
+	uint64_t u, v;
+
+	for (; len - i >= 8; i += 8) {
+		memcpy(&u, p + i, sizeof(u));
+		memcpy(&v, q + i, sizeof(v));
+		if (u != v)
+			break;
+	}
+#endif
+	/* Find the byte in the block that differs */
+	for (; i < len; i++)
+		if (p[i] != q[i])
+			break;
+	return (i);
+}
+
+/*
+ * Compare the files open as fd1 and fd2 from their start.  Returns
+ * FC_SAME or FC_DIFFER, or -1 with errno set on a read error.  When they
+ * differ and offp is not NULL, *offp is the offset of the first byte
+ * that differs, or the size of the shorter file if it is a prefix of the
+ * other; with FC_QUICK, regular files of different sizes are not read
+ * and *offp is -1.
+ */
+int
+filecmp_fd(int fd1, int fd2, int flags, off_t *offp)
+{
+	char *buf1, *buf2;
+	struct stat sb1, sb2;
+	off_t off, size, shared;
+	size_t n, n1, n2, d;
+	int eof1, eof2, rval;
+
+	if (offp != NULL)
+		*offp = -1;
+	if (fstat(fd1, &sb1) == -1 || fstat(fd2, &sb2) == -1)
+		return (-1);
+
+	if (S_ISREG(sb1.st_mode) && S_ISREG(sb2.st_mode)) {
+		if (sb1.st_dev == sb2.st_dev && sb1.st_ino == sb2.st_ino)
+			return (FC_SAME);
+		if (sb1.st_size != sb2.st_size && flags & FC_QUICK)
+			return (FC_DIFFER);
+		size = MIN(sb1.st_size, sb2.st_size);
+		/*
+		 * Clones share their blocks until written to.  The mapping
+		 * is only final once any dirty data has been written out.
+		 */
+		shared = 0;
+		if (sb1.st_dev == sb2.st_dev && size >= FC_CLONEMIN &&
+		    fsync(fd1) == 0 && fsync(fd2) == 0)
+			shared = fc_shared(fd1, fd2, 0, size);
+		for (off = 0; off < size; off += n) {
+			if (shared > 0) {
+				n = (size_t)shared;
+				shared = fc_shared(fd1, fd2, off + n,
+				    size - off - n);
+				continue;
+			}
+			n = (size_t)MIN(size - off, FC_WINDOW);
+			if (fc_window(fd1, fd2, off, n, &d) == -1)
+				return (-1);
+			if (d < n) {
+				if (offp != NULL)
+					*offp = off + d;
+				return (FC_DIFFER);
+			}
+			if (sb1.st_dev == sb2.st_dev && size >= FC_CLONEMIN &&
+			    off + n < size)
+				shared = fc_shared(fd1, fd2, off + n,
+				    size - off - n);
+		}
+		if (sb1.st_size != sb2.st_size) {
+			if (offp != NULL)
+				*offp = size;
+			return (FC_DIFFER);
+		}
+		return (FC_SAME);
+	}
+
+	if ((buf1 = malloc(FC_BUFSIZE)) == NULL ||
+	    (buf2 = malloc(FC_BUFSIZE)) == NULL) {
+		free(buf1);
+		return (-1);
+	}
+	rval = FC_SAME;
+	for (off = 0;; off += n1) {
+		if ((eof1 = fc_fill(fd1, buf1, FC_BUFSIZE, &n1)) == -1 ||
+		    (eof2 = fc_fill(fd2, buf2, FC_BUFSIZE, &n2)) == -1) {
+			rval = -1;
+			break;
+		}
+		n = MIN(n1, n2);
+		if ((d = filecmp_mem(buf1, buf2, n)) < n || n1 != n2) {
+			if (offp != NULL)
+				*offp = off + d;
+			rval = FC_DIFFER;
+			break;
+		}
+		if (eof1 || eof2)
+			break;
+	}
+	free(buf1);
+	free(buf2);
+	return (rval);
+}
+
+/*
+ * Compare len bytes of two regular files at off, setting *dp to the
+ * offset in the window of the first difference, or len.
+ */
+static int
+fc_window(int fd1, int fd2, off_t off, size_t len, size_t *dp)
+{
+	char *m1, *m2, *buf1, *buf2;
+	off_t base;
+	size_t skip, n, d, done, want;
+	ssize_t r1, r2;
+
+	/* mmap() wants a page aligned offset */
+	base = off & ~((off_t)getpagesize() - 1);
+	skip = (size_t)(off - base);
+	m1 = mmap(NULL, len + skip, PROT_READ, MAP_PRIVATE, fd1, base);
+	m2 = m1 == MAP_FAILED ? MAP_FAILED :
+	    mmap(NULL, len + skip, PROT_READ, MAP_PRIVATE, fd2, base);
+	if (m2 != MAP_FAILED) {
+		*dp = filecmp_mem(m1 + skip, m2 + skip, len);
+		munmap(m2, len + skip);
+		munmap(m1, len + skip);
+		return (0);
+	}
+	if (m1 != MAP_FAILED)
+		munmap(m1, len + skip);
+
+	if ((buf1 = malloc(FC_BUFSIZE)) == NULL ||
+	    (buf2 = malloc(FC_BUFSIZE)) == NULL) {
+		free(buf1);
+		return (-1);
+	}
+	for (done = 0; done < len; done += n) {
+		want = MIN(len - done, FC_BUFSIZE);
+		r1 = pread(fd1, buf1, want, off + done);
+		r2 = pread(fd2, buf2, want, off + done);
+		if (r1 == -1 || r2 == -1) {
+			free(buf1);
+			free(buf2);
+			return (-1);
+		}
+		/* A short read means a file shrank under us: a difference */
+		n = MIN((size_t)r1, (size_t)r2);
+		if ((d = filecmp_mem(buf1, buf2, n)) < n || n < want) {
+			done += d;
+			break;
+		}
+	}
+	free(buf1);
+	free(buf2);
+	*dp = done;
+	return (0);
+}
+
+/*
+ * Returns how many bytes from off, up to len, the two files have in the
+ * same blocks on disk, or 0 if that cannot be told.
+ */
+static off_t
+fc_shared(int fd1, int fd2, off_t off, off_t len)
+{
+#ifdef F_LOG2PHYS_EXT
+	struct log2phys l1, l2;
+
+	if (len <= 0)
+		return (0);
+	memset(&l1, 0, sizeof(l1));
+	l1.l2p_contigbytes = len;
+	l1.l2p_devoffset = off;
+	l2 = l1;
+	if (fcntl(fd1, F_LOG2PHYS_EXT, &l1) == -1 ||
+	    fcntl(fd2, F_LOG2PHYS_EXT, &l2) == -1 ||
+	    l1.l2p_devoffset != l2.l2p_devoffset)
+		return (0);
+	return (MAX(MIN(MIN(l1.l2p_contigbytes, l2.l2p_contigbytes), len),
+	    0));
+#else
+	return (0);
+#endif
+}
+
+/*
+ * Read up to len bytes, retrying short reads from pipes and terminals.
+ * Returns 1 at end of file, 0 if the buffer was filled, or -1.
+ */
+static int
+fc_fill(int fd, char *buf, size_t len, size_t *np)
+{
+	ssize_t r;
+
+	for (*np = 0; *np < len; *np += r) {
+		if ((r = read(fd, buf + *np, len - *np)) == -1) {
+			if (errno == EINTR) {
+				r = 0;
+				continue;
+			}
+			return (-1);
+		}
+		if (r == 0)
+			return (1);
+	}
+	return (0);
+}
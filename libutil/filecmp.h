@@ -0,0 +1,30 @@
+/*
+ * filecmp -- equality check of two files, shared by diff and cmp.
+ *
+ * filecmp_fd() answers whether two open files have the same contents,
+ * and where they first differ.  Regular files are compared through
+ * mmap() windows, a block at a time, stopping at the first difference;
+ * the same file seen twice, or ranges of two clones that still share
+ * their blocks on disk, are not read at all.  Other files are read into
+ * two buffers.
+ *
+ * filecmp_mem() is the block compare itself: 64 bytes at a time with
+ * NEON, otherwise 8 at a time in a 64-bit word.
+ */
+
+#ifndef FILECMP_H
+#define	FILECMP_H
+
+#include <sys/types.h>
+
+/* Flags for filecmp_fd() */
+#define	FC_QUICK	0x0001	/* Regular files of different sizes differ */
+
+/* Results of filecmp_fd() */
+#define	FC_SAME		0
+#define	FC_DIFFER	1
+
+int	 filecmp_fd(int, int, int, off_t *);
+size_t	 filecmp_mem(const void *, const void *, size_t);
+
+#endif /* !FILECMP_H */
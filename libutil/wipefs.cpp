@@ -34,11 +34,31 @@
 #include <string.h>
 #include <spawn.h>
 #include <os/log.h>
+#include <pthread.h>
 
 #include "ExtentManager.h"
 #include "wipefs.h"
 
 #define	wipefs_roundup(x, y)	((((x)+((y)-1))/(y))*(y))
+#define	WIPEFS_IOVCNT	16		// zero buffers handed to each pwritev()
+#define	WIPEFS_BUFSIZE	(1024 * 1024)	// the zero buffer, reused for every write
+#define	WIPEFS_THREADS	4		// writers at most, including the caller
+
+struct WipeRun {
+	off_t offset;
+	off_t length;
+};
+
+// Runs to zero, shared by the writer threads of wipefs_wipe()
+struct WipeWork {
+	int fd;
+	uint8_t *bufZero;
+	size_t bufSize;
+	vector<WipeRun> runs;
+	size_t next;		// first run not taken yet
+	int err;		// first error, stops the other writers
+	pthread_mutex_t lock;
+};
 
 struct __wipefs_ctx {
 	int fd;
@@ -365,15 +385,75 @@ wipefs_except_blocks(wipefs_ctx handle, off_t block_offset, off_t nblocks)
 	return err;
 }
 
+//
+// Write zeroes over numBytes at byteOffset, up to WIPEFS_IOVCNT buffers at a time.
+//
+static int
+WriteZeroRange(int fd, uint8_t *bufZero, size_t bufSize, off_t byteOffset, off_t numBytes)
+{
+	struct iovec iov[WIPEFS_IOVCNT];
+	size_t numBytesToWrite;
+	ssize_t written;
+	int iovcnt;
+
+	while (numBytes > 0) {
+		numBytesToWrite = 0;
+		for (iovcnt = 0; iovcnt < WIPEFS_IOVCNT && numBytes - (off_t)numBytesToWrite > 0; iovcnt++) {
+			iov[iovcnt].iov_base = bufZero;
+			iov[iovcnt].iov_len = (size_t)min(numBytes - (off_t)numBytesToWrite, (off_t)bufSize);
+			numBytesToWrite += iov[iovcnt].iov_len;
+		}
+		written = pwritev(fd, iov, iovcnt, byteOffset);
+		if (written != (ssize_t)numBytesToWrite) {
+			return (written < 0) ? errno : EIO;
+		}
+		numBytes -= numBytesToWrite;
+		byteOffset += numBytesToWrite;
+	}
+	return 0;
+}
+
+//
+// Writer thread: zero runs until there are none left or one has failed.
+//
+static void *
+WipeWorker(void *arg)
+{
+	struct WipeWork *work = (struct WipeWork *)arg;
+	WipeRun run;
+	int err;
+
+	for (;;) {
+		pthread_mutex_lock(&work->lock);
+		if (work->err != 0 || work->next == work->runs.size()) {
+			pthread_mutex_unlock(&work->lock);
+			break;
+		}
+		run = work->runs[work->next++];
+		pthread_mutex_unlock(&work->lock);
+
+		err = WriteZeroRange(work->fd, work->bufZero, work->bufSize, run.offset, run.length);
+		if (err != 0) {
+			pthread_mutex_lock(&work->lock);
+			if (work->err == 0)
+				work->err = err;
+			pthread_mutex_unlock(&work->lock);
+		}
+	}
+	return NULL;
+}
+
 extern "C" int
 wipefs_wipe(wipefs_ctx handle)
 {
 	int err = 0;
-	uint8_t *bufZero = NULL;
-	ListExtIt curExt;
-	size_t bufSize;
+	MapExtIt curExt;
 	dk_extent_t extent;
 	dk_unmap_t unmap;
+	struct WipeWork work;
+	pthread_t threads[WIPEFS_THREADS - 1];
+	int numThreads, i;
+	long ncpu;
 
 	if (handle->diskname != NULL) {
 		// Remove this disk's entry from the xART.
@@ -393,51 +473,99 @@ wipefs_wipe(wipefs_ctx handle)
 	//
 	ioctl(handle->fd, DKIOCUNMAP, (caddr_t)&unmap);
 
-	bufSize = 128 * 1024; // issue large I/O to get better performance
-	if (handle->extMan.nativeBlockSize > bufSize) {
-	    bufSize = handle->extMan.nativeBlockSize;
+	//
+	// issue large I/O to get better performance, from one zero buffer
+	// aligned for the device and shared by every write.
+	//
+	size_t nativeBlockSize = handle->extMan.nativeBlockSize;
+	work.fd = handle->fd;
+	work.bufSize = wipefs_roundup(max((size_t)WIPEFS_BUFSIZE, nativeBlockSize), nativeBlockSize);
+	work.bufZero = NULL;
+	work.next = 0;
+	work.err = 0;
+	if ((err = posix_memalign((void **)&work.bufZero, max((size_t)getpagesize(), nativeBlockSize), work.bufSize)) != 0) {
+		goto labelExit;
 	}
-	bufZero = new uint8_t[bufSize];
-	bzero(bufZero, bufSize);
+	bzero(work.bufZero, work.bufSize);
 
-	off_t byteOffset, totalBytes;
-	size_t numBytes, numBytesToWrite, blockSize;
+	off_t byteOffset, totalBytes, runOffset, runEnd, chunk, runChunk;
+	size_t numBytes, blockSize;
 
 	blockSize = handle->extMan.blockSize;
 	totalBytes = handle->extMan.totalBytes;
-	// write zero to all extents
-	for (curExt = handle->extMan.extentList.begin(); curExt != handle->extMan.extentList.end(); curExt++) {
-		byteOffset = curExt->blockAddr * blockSize;
-		numBytes = curExt->numBlocks * blockSize;
-		// make both offset and numBytes on native block boundary
-		if (byteOffset % handle->extMan.nativeBlockSize != 0 ||
-			numBytes % handle->extMan.nativeBlockSize != 0) {
-			size_t nativeBlockSize = handle->extMan.nativeBlockSize;
-			off_t newOffset, newEndOffset;
-			newOffset = byteOffset / nativeBlockSize * nativeBlockSize;
-			newEndOffset = wipefs_roundup(byteOffset + numBytes, nativeBlockSize);
-			byteOffset = newOffset;
-			numBytes = newEndOffset - newOffset;
-		}
-		if (byteOffset + (off_t)numBytes > totalBytes) {
-			numBytes = totalBytes - byteOffset;
-		}
-		while (numBytes > 0) {
-			numBytesToWrite = min(numBytes, bufSize);
-			if (pwrite(handle->fd, bufZero, numBytesToWrite, byteOffset) != (ssize_t)numBytesToWrite) {
-				err = errno;
-				goto labelExit;
+	chunk = (off_t)work.bufSize * WIPEFS_IOVCNT;
+	//
+	// write zero to all extents.  Once rounded out to native blocks, extents
+	// can share or touch a native block; those are coalesced into one run so
+	// that each run is written once.  Runs are then cut into pieces of one
+	// pwritev() each, for the writers to share.
+	//
+	try {
+		runOffset = runEnd = 0;
+		for (curExt = handle->extMan.extentMap.begin(); ; curExt++) {
+			if (curExt != handle->extMan.extentMap.end()) {
+				byteOffset = curExt->first * blockSize;
+				numBytes = curExt->second * blockSize;
+				// make both offset and numBytes on native block boundary
+				if (byteOffset % nativeBlockSize != 0 || numBytes % nativeBlockSize != 0) {
+					off_t newOffset, newEndOffset;
+					newOffset = byteOffset / nativeBlockSize * nativeBlockSize;
+					newEndOffset = wipefs_roundup(byteOffset + numBytes, nativeBlockSize);
+					byteOffset = newOffset;
+					numBytes = newEndOffset - newOffset;
+				}
+				if (byteOffset + (off_t)numBytes > totalBytes) {
+					numBytes = totalBytes - byteOffset;
+				}
+				if (numBytes == 0) {
+					continue;
+				}
+				if (byteOffset <= runEnd && runEnd != runOffset) {
+					runEnd = max(runEnd, byteOffset + (off_t)numBytes);
+					continue;
+				}
+			}
+			for (; runOffset < runEnd; runOffset += runChunk) {
+				runChunk = min(runEnd - runOffset, chunk);
+				WipeRun run = { runOffset, runChunk };
+				work.runs.push_back(run); // throws bad_alloc when out of memory
+			}
+			if (curExt == handle->extMan.extentMap.end()) {
+				break;
 			}
-			numBytes -= numBytesToWrite;
-			byteOffset += numBytesToWrite;
+			runOffset = byteOffset;
+			runEnd = byteOffset + numBytes;
 		}
 	}
+	catch (...) { // currently only ENOMEM is possible
+		err = ENOMEM;
+		goto labelExit;
+	}
+
+	pthread_mutex_init(&work.lock, NULL);
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	numThreads = WIPEFS_THREADS;
+	if (ncpu > 0 && ncpu < numThreads)
+		numThreads = (int)ncpu;
+	if (work.runs.size() < (size_t)numThreads)
+		numThreads = max((int)work.runs.size(), 1);
+	for (i = 0; i < numThreads - 1; i++) {
+		if (pthread_create(&threads[i], NULL, WipeWorker, &work) != 0)
+			break;
+	}
+	numThreads = i;
+	WipeWorker(&work);
+	for (i = 0; i < numThreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&work.lock);
+	err = work.err;
 
   labelExit:
 
 	(void)ioctl(handle->fd, DKIOCSYNCHRONIZECACHE);
-	if (bufZero != NULL)
-		delete[] bufZero;
+	if (work.bufZero != NULL)
+		free(work.bufZero);
 
 	return err;
 } // wipefs_wipe
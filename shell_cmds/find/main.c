@@ -1,166 +0,0 @@
-/*-
- * Copyright (c) 1990, 1993, 1994
- *	The Regents of the University of California.  All rights reserved.
- *
- * This code is derived from software contributed to Berkeley by
- * Cimarron D. Taylor of the University of California, Berkeley.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- * 4. Neither the name of the University nor the names of its contributors
- *    may be used to endorse or promote products derived from this software
- *    without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
- * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
- * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
- * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
- * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
- * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
- * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
- * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
- * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
- * SUCH DAMAGE.
- */
-
-#ifndef lint
-static const char copyright[] =
-"@(#) Copyright (c) 1990, 1993, 1994\n\
-	The Regents of the University of California.  All rights reserved.\n";
-#endif /* not lint */
-
-#ifndef lint
-#if 0
-static char sccsid[] = "@(#)main.c	8.4 (Berkeley) 5/4/95";
-#endif
-#endif /* not lint */
-
-#include <sys/cdefs.h>
-__FBSDID("$FreeBSD: src/usr.bin/find/main.c,v 1.23 2011/12/10 18:11:06 ed Exp $");
-
-#include <sys/types.h>
-#include <sys/stat.h>
-
-#include <err.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <fts.h>
-#include <locale.h>
-#include <regex.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-#include <unistd.h>
-
-#include "find.h"
-
-time_t now;			/* time find was run */
-int dotfd;			/* starting directory */
-int ftsoptions;			/* options for the ftsopen(3) call */
-int isdeprecated;		/* using deprecated syntax */
-int isdepth;			/* do directories on post-order visit */
-int isoutput;			/* user specified output operator */
-int issort;         		/* do hierarchies in lexicographical order */
-int isxargs;			/* don't permit xargs delimiting chars */
-int mindepth = -1, maxdepth = -1; /* minimum and maximum depth */
-int regexp_flags = REG_BASIC;	/* use the "basic" regexp by default*/
-
-static void usage(void);
-
-int
-main(int argc, char *argv[])
-{
-	char **p, **start;
-	int Hflag, Lflag, ch;
-
-	(void)setlocale(LC_ALL, "");
-
-	(void)time(&now);	/* initialize the time-of-day */
-
-	p = start = argv;
-	Hflag = Lflag = 0;
-	ftsoptions = FTS_NOSTAT | FTS_PHYSICAL;
-	while ((ch = getopt(argc, argv, "EHLPXdf:sx")) != -1)
-		switch (ch) {
-		case 'E':
-			regexp_flags |= REG_EXTENDED;
-			break;
-		case 'H':
-			Hflag = 1;
-			Lflag = 0;
-			break;
-		case 'L':
-			Lflag = 1;
-			Hflag = 0;
-			break;
-		case 'P':
-			Hflag = Lflag = 0;
-			break;
-		case 'X':
-			isxargs = 1;
-			break;
-		case 'd':
-			isdepth = 1;
-			break;
-		case 'f':
-			*p++ = optarg;
-			break;
-		case 's':
-			issort = 1;
-			break;
-		case 'x':
-			ftsoptions |= FTS_XDEV;
-			break;
-		case '?':
-		default:
-			usage();
-		}
-
-	argc -= optind;
-	argv += optind;
-
-	if (Hflag)
-		ftsoptions |= FTS_COMFOLLOW;
-	if (Lflag) {
-		ftsoptions &= ~FTS_PHYSICAL;
-		ftsoptions |= FTS_LOGICAL;
-	}
-
-	/*
-	 * Find first option to delimit the file list.  The first argument
-	 * that starts with a -, or is a ! or a ( must be interpreted as a
-	 * part of the find expression, according to POSIX .2.
-	 */
-	for (; *argv != NULL; *p++ = *argv++) {
-		if (argv[0][0] == '-')
-			break;
-		if ((argv[0][0] == '!' || argv[0][0] == '(') &&
-		    argv[0][1] == '\0')
-			break;
-	}
-
-	if (p == start)
-		usage();
-	*p = NULL;
-
-	if ((dotfd = open(".", O_RDONLY, 0)) < 0)
-		err(1, ".");
-
-	exit(find_execute(find_formplan(argv), start));
-}
-
-static void
-usage(void)
-{
-	(void)fprintf(stderr, "%s\n%s\n",
-"usage: find [-H | -L | -P] [-EXdsx] [-f path] path ... [expression]",
-"       find [-H | -L | -P] [-EXdsx] -f path [path ...] [expression]");
-	exit(1);
-}
@@ -57,6 +57,7 @@ static off_t address;			/* address/offset in stream */
 static off_t eaddress;			/* end address */
 
 static __inline void print(PR *, u_char *);
+static void canon_line(u_char *);
 
 void
 display(void)
@@ -69,6 +70,10 @@ display(void)
 	off_t saveaddress;
 	u_char savech=0, *savebp;
 
+	if (canonical)
+		while ((bp = get()))
+			canon_line(bp);
+	else
 	while ((bp = get()))
 	    for (fs = fshead, savebp = bp, saveaddress = address; fs;
 		fs = fs->nextfs, bp = savebp, address = saveaddress)
@@ -115,6 +120,51 @@ display(void)
 	}
 }
 
+/*
+ * Lay out one line of the -C format from tables, instead of going
+ * through the format units for every byte.  Must match what they print.
+ */
+static void
+canon_line(u_char *bp)
+{
+	static const char hex[] = "0123456789abcdef";
+	static char pchar[256];
+	char line[96], *p;
+	int i, n, shift;
+
+	if (pchar[0] == '\0')
+		for (i = 0; i < 256; i++)
+			pchar[i] = isprint(i) && isascii(i) ? i : '.';
+	n = eaddress && eaddress - address < 16 ? eaddress - address : 16;
+
+	/* %08.8qx: eight digits or as many as it takes. */
+	p = line;
+	for (shift = 28; shift < 60 && address >> (shift + 4) != 0; shift += 4)
+		;
+	for (; shift >= 0; shift -= 4)
+		*p++ = hex[(address >> shift) & 0xf];
+	for (i = 0; i < 16; i++) {
+		*p++ = ' ';
+		if (i == 0 || i == 8)
+			*p++ = ' ';
+		if (i < n) {
+			*p++ = hex[bp[i] >> 4];
+			*p++ = hex[bp[i] & 0xf];
+		} else {
+			*p++ = ' ';
+			*p++ = ' ';
+		}
+	}
+	*p++ = ' ';
+	*p++ = ' ';
+	*p++ = '|';
+	for (i = 0; i < n; i++)
+		*p++ = pchar[bp[i]];
+	*p++ = '|';
+	*p++ = '\n';
+	(void)fwrite(line, 1, p - line, stdout);
+}
+
 static __inline void
 print(PR *pr, u_char *bp)
 {
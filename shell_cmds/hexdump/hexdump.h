@@ -82,6 +82,7 @@ extern int exitval;			/* final exit value */
 extern int odmode;			/* are we acting as od(1)? */
 extern int length;			/* amount of data to read */
 extern off_t skip;			/* amount of data to skip at start */
+extern int canonical;			/* just -C, see display_canonical() */
 enum _vflag { ALL, DUP, FIRST, WAIT };	/* -v values */
 extern enum _vflag vflag;
 
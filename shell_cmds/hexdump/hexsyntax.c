@@ -50,17 +50,20 @@ __FBSDID("$FreeBSD: src/usr.bin/hexdump/hexsyntax.c,v 1.12 2002/09/04 23:29:01 d
 #include "hexdump.h"
 
 off_t skip;				/* bytes to skip */
+int canonical;				/* the -C format, and no other */
 
 void
 newsyntax(int argc, char ***argvp)
 {
-	int ch;
+	int ch, ncanon, nother;
 	char *p, **argv;
 
 	argv = *argvp;
+	ncanon = nother = 0;
 	if ((p = rindex(argv[0], 'h')) != NULL &&
 	    strcmp(p, "hd") == 0) {
 		/* "Canonical" format, implies -C. */
+		ncanon++;
 		add("\"%08.8_Ax\n\"");
 		add("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ");
 		add("\"  |\" 16/1 \"%_p\" \"|\\n\"");
@@ -68,26 +71,32 @@ newsyntax(int argc, char ***argvp)
 	while ((ch = getopt(argc, argv, "bcCde:f:n:os:vx")) != -1)
 		switch (ch) {
 		case 'b':
+			nother++;
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"");
 			break;
 		case 'c':
+			nother++;
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"");
 			break;
 		case 'C':
+			ncanon++;
 			add("\"%08.8_Ax\n\"");
 			add("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ");
 			add("\"  |\" 16/1 \"%_p\" \"|\\n\"");
 			break;
 		case 'd':
+			nother++;
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"");
 			break;
 		case 'e':
+			nother++;
 			add(optarg);
 			break;
 		case 'f':
+			nother++;
 			addfile(optarg);
 			break;
 		case 'n':
@@ -95,6 +104,7 @@ newsyntax(int argc, char ***argvp)
 				errx(1, "%s: bad length value", optarg);
 			break;
 		case 'o':
+			nother++;
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"");
 			break;
@@ -120,6 +130,7 @@ newsyntax(int argc, char ***argvp)
 			vflag = ALL;
 			break;
 		case 'x':
+			nother++;
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"");
 			break;
@@ -127,6 +138,7 @@ newsyntax(int argc, char ***argvp)
 			usage();
 		}
 
+	canonical = ncanon == 1 && nother == 0;
 	if (!fshead) {
 		add("\"%07.7_Ax\n\"");
 		add("\"%07.7_ax \" 16/1 \"%02x \" \"\\n\"");
@@ -54,6 +54,7 @@ __FBSDID("$FreeBSD: src/usr.bin/jot/jot.c,v 1.40 2009/12/13 03:14:06 delphij Exp
 #include <ctype.h>
 #include <err.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -76,6 +77,9 @@ __FBSDID("$FreeBSD: src/usr.bin/jot/jot.c,v 1.40 2009/12/13 03:14:06 delphij Exp
 
 #define	is_default(s)	(*(s) == 0 || strcmp((s), "-") == 0)
 
+#define	OUTBUFSIZ	(64 * 1024)	/* Output block of putintegers() */
+#define	EXACT_MAX	9007199254740992LL	/* 2^53, doubles are exact to it */
+
 static bool	boring;
 static int	prec;
 static bool	longdata;
@@ -88,6 +92,7 @@ static char	format[BUFSIZ];
 static void	getformat(void);
 static int	getprec(const char *);
 static int	putdata(double, bool);
+static long	putintegers(double *, double, long, bool);
 static void	usage(void);
 
 int
@@ -299,10 +304,15 @@ main(int argc, char **argv)
 			if (putdata(y * x + begin, !(reps - i)))
 				errx(1, "range error in conversion");
 		}
-	} else
-		for (i = 1, x = begin; i <= reps || infinity; i++, x += s)
+	} else {
+		i = 1;
+		x = begin;
+		if (!have_format && !chardata && prec == 0)
+			i = putintegers(&x, s, reps, infinity);
+		for (; i <= reps || infinity; i++, x += s)
 			if (putdata(x, !(reps - i)))
 				errx(1, "range error in conversion");
+	}
 	if (!nofinalnl)
 		putchar('\n');
 	exit(0);
@@ -349,6 +359,69 @@ putdata(double x, bool last)
 	return (0);
 }
 
+/*
+ * Print the data from *xp on as putdata() would with the default "%.0f"
+ * format, for as long as they are integers a double holds exactly.  The
+ * current value is kept in decimal, counted up in place when the step is
+ * 1, and the output is written out in blocks.  Return the number of the
+ * first value not printed, and leave it in *xp.
+ */
+static long
+putintegers(double *xp, double s, long reps, bool infinity)
+{
+	static char out[OUTBUFSIZ];
+	char num[24], *np, *cp, *end;
+	size_t len, n, seplen;
+	long long v, step;
+	unsigned long long u;
+	long i;
+
+	seplen = strlen(sepstring);
+	if (*xp != floor(*xp) || s != floor(s) || fabs(*xp) > EXACT_MAX ||
+	    fabs(s) > EXACT_MAX || (*xp == 0 && signbit(*xp)) ||
+	    seplen > OUTBUFSIZ / 2)
+		return (1);
+	v = *xp;
+	step = s;
+	end = num + sizeof(num);
+	np = end;
+	n = 0;
+	for (i = 1; (i <= reps || infinity) && llabs(v) <= EXACT_MAX;
+	    i++, v += step) {
+		if (step == 1 && np != end && v > 0) {
+			/* The last value was >= 0, add one to it */
+			for (cp = end - 1; cp >= np && *cp == '9'; cp--)
+				*cp = '0';
+			if (cp < np)
+				*--np = '1';
+			else
+				++*cp;
+		} else {
+			np = end;
+			u = v < 0 ? -(unsigned long long)v : v;
+			do
+				*--np = '0' + u % 10;
+			while ((u /= 10) != 0);
+			if (v < 0)
+				*--np = '-';
+		}
+		len = end - np;
+		if (n + len + seplen > sizeof(out)) {
+			fwrite(out, 1, n, stdout);
+			n = 0;
+		}
+		memcpy(out + n, np, len);
+		n += len;
+		if (reps - i) {
+			memcpy(out + n, sepstring, seplen);
+			n += seplen;
+		}
+	}
+	fwrite(out, 1, n, stdout);
+	*xp = v;
+	return (i);
+}
+
 static void
 usage(void)
 {
@@ -56,6 +56,11 @@ __FBSDID("$FreeBSD$");
 #ifdef SHELL
 #define main killcmd
 #include "bltin/bltin.h"
+#if TARGET_OS_IPHONE
+/* The process ids are those of ios_system() */
+#define	kill	ios_killpid
+extern int ios_killpid(pid_t, int);
+#endif
 #endif
 
 static void nosig(const char *);
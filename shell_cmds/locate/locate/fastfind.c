@@ -41,7 +41,7 @@
 #ifndef _LOCATE_STATISTIC_
 #define _LOCATE_STATISTIC_
 
-void 
+static void 
 statistic (fp, path_fcodes)
 	FILE *fp;               /* open database */
 	char *path_fcodes;  	/* for error message */
@@ -103,9 +103,7 @@ statistic (fp, path_fcodes)
 }
 #endif /* _LOCATE_STATISTIC_ */
 
-extern	char	separator;
-
-void
+static void
 #ifdef FF_MMAP
 
 
@@ -114,10 +112,11 @@ fastfind_mmap_icase
 #else
 fastfind_mmap
 #endif /* FF_ICASE */
-(pathpart, paddr, len, database)
+(pathpart, paddr, len, start, database)
 	char *pathpart; 	/* search string */
 	caddr_t paddr;  	/* mmap pointer */
-	int len;        	/* length of database */
+	int len;        	/* length of database, or end of the part */
+	int start;		/* restart point to begin at, or 0 */
 	char *database; 	/* for error message */
 
 
@@ -144,6 +143,9 @@ fastfind
 	int count, found, globflag;
 	u_char *cutoff;
 	u_char bigram1[NBG], bigram2[NBG], path[MAXPATHLEN];
+#ifdef FF_MMAP
+	int restart;
+#endif /* FF_MMAP */
 
 #ifdef FF_ICASE
 	/* use a lookup table for case insensitive search */
@@ -161,6 +163,13 @@ fastfind
 		p[c] = check_bigram_char(*paddr++);
 		s[c] = check_bigram_char(*paddr++);
 	}
+
+	/* a part of the database, from a restart point on */
+	restart = start > 2 * NBG;
+	if (restart) {
+		paddr += start - 2 * NBG;
+		len -= start - 2 * NBG;
+	}
 #else
 	for (c = 0, p = bigram1, s = bigram2; c < NBG; c++) {
 		p[c] = check_bigram_char(getc(fp));
@@ -216,11 +225,24 @@ fastfind
 			count += c - OFFSET;
 		}
 
+#ifdef FF_MMAP
+		/* a restart point has no common prefix with the name before */
+		if (restart) {
+			count = 0;
+			restart = 0;
+		}
+#endif /* FF_MMAP */
+
 #ifdef __APPLE__
 		if (count < 0) {
+#if TARGET_OS_IPHONE
+			errx(1, "Your locate database appears to be corrupt. "
+			    "Run 'updatedb' to regenerate the database.");
+#else
 			errx(1, "Your locate database appears to be corrupt. "
 			    "Run 'sudo /usr/libexec/locate.updatedb' to "
 			    "regenerate the database.");
+#endif
 		}
 #endif /* __APPLE__ */
 
@@ -85,11 +85,19 @@ static const char rcsid[] =
 #include <errno.h>
 #endif /* __APPLE__ */
 #include <fnmatch.h>
+#include <limits.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <TargetConditionals.h>
+#include "ios_error.h"
+
+/* The database is mmap'ed unless -s is given */
+#ifndef MMAP
+#define	MMAP
+#endif
 
 #ifdef MMAP
 #  include <sys/types.h>
@@ -101,6 +109,7 @@ static const char rcsid[] =
 
 #include "locate.h"
 #include "pathnames.h"
+#include "dirwalk.h"
 
 #ifdef DEBUG
 #  include <sys/time.h>
@@ -108,27 +117,30 @@ static const char rcsid[] =
 #  include <sys/resource.h>
 #endif
 
-int f_mmap;             /* use mmap */
-int f_icase;            /* ignore case */
-int f_stdin;            /* read database from stdin */
-int f_statistic;        /* print statistic */
-int f_silent;           /* suppress output, show only count of matches */
-int f_limit;            /* limit number of output lines, 0 == infinite */
-u_int counter;          /* counter for matches [-c] */
-char separator='\n';	/* line separator */
+static int f_mmap;      /* use mmap */
+static int f_icase;     /* ignore case */
+static int f_stdin;     /* read database from stdin */
+static int f_statistic; /* print statistic */
+static int f_silent;    /* suppress output, show only count of matches */
+static int f_limit;     /* limit number of output lines, 0 == infinite */
+static __thread u_int counter; /* counter for matches [-c], per thread */
+static char separator='\n';	/* line separator */
 #ifdef __APPLE__
 u_char myctype[UCHAR_MAX + 1];
 #endif /* __APPLE__ */
 
 
-void    usage(void);
-void    statistic(FILE *, char *);
-void    fastfind(FILE *, char *, char *);
-void    fastfind_icase(FILE *, char *, char *);
-void    fastfind_mmap(char *, caddr_t, int, char *);
-void    fastfind_mmap_icase(char *, caddr_t, int, char *);
-void	search_mmap(char *, char **);
-void	search_fopen(char *, char **);
+static void usage(void);
+static void statistic(FILE *, char *);
+static void fastfind(FILE *, char *, char *);
+static void fastfind_icase(FILE *, char *, char *);
+static void fastfind_mmap(char *, caddr_t, int, int, char *);
+static void fastfind_mmap_icase(char *, caddr_t, int, int, char *);
+static void search_mmap(char *, char **);
+static void search_fopen(char *, char **);
+#ifdef __APPLE__
+static void nodatabase(char *);
+#endif
 unsigned long cputime(void);
 
 extern char     **colon(char **, char*, char*);
@@ -140,13 +152,18 @@ extern int	check_bigram_char(int);
 extern char 	*patprep(char *);
 
 int
-main(argc, argv)
+locate_main(argc, argv)
         int argc;
         char **argv;
 {
         register int ch;
         char **dbv = NULL;
 	char *path_fcodes;      /* locate database */
+
+    optind = 1; opterr = 1; optreset = 1;
+	f_mmap = f_icase = f_stdin = f_statistic = f_silent = f_limit = 0;
+	counter = 0;
+	separator = '\n';
 #ifdef MMAP
         f_mmap = 1;		/* mmap is default */
 #endif
@@ -231,7 +248,7 @@ main(argc, argv)
 }
 
 
-void
+static void
 search_fopen(db, s)
 	char *db; /* database */
 	char **s; /* search strings */
@@ -251,19 +268,8 @@ search_fopen(db, s)
 	} 
 #ifdef __APPLE__
 	else if ((fp = fopen(db, "r")) == NULL) {
-		if (errno == ENOENT && !strcmp(db, _PATH_FCODES)) {
-			fprintf(stderr, "\n"
-			    "WARNING: The locate database (%s) does not exist.\n"
-			    "To create the database, run the following command:\n"
-			    "\n"
-			    "  sudo launchctl load -w /System/Library/LaunchDaemons/com.apple.locate.plist\n"
-				"\n"
-				"Please be aware that the database can take some time to generate; once\n"
-				"the database has been created, this message will no longer appear.\n"
-			    "\n",
-			    db);
-			exit(1);
-		}
+		if (errno == ENOENT && !strcmp(db, _PATH_FCODES))
+			nodatabase(db);
 		err(1,  "`%s'", db);
 	}
 #else /* !__APPLE__ */
@@ -299,8 +305,159 @@ search_fopen(db, s)
 	(void)fclose(fp);
 } 
 
+#ifdef __APPLE__
+static void
+nodatabase(db)
+	char *db;
+{
+#if TARGET_OS_IPHONE
+	fprintf(stderr, "\n"
+	    "WARNING: The locate database (%s) does not exist.\n"
+	    "To create the database, run the following command:\n"
+	    "\n"
+	    "  updatedb\n"
+	    "\n",
+	    db);
+#else
+	fprintf(stderr, "\n"
+	    "WARNING: The locate database (%s) does not exist.\n"
+	    "To create the database, run the following command:\n"
+	    "\n"
+	    "  sudo launchctl load -w /System/Library/LaunchDaemons/com.apple.locate.plist\n"
+		"\n"
+		"Please be aware that the database can take some time to generate; once\n"
+		"the database has been created, this message will no longer appear.\n"
+	    "\n",
+	    db);
+#endif
+	exit(1);
+}
+#endif /* __APPLE__ */
+
 #ifdef MMAP
-void
+/*
+ * The restart points of db, as listed by updatedb, or NULL if it has no
+ * restart file, or one that was not written along with this database.
+ */
+static u_int32_t *
+read_restarts(char *db, struct stat *sb, u_int32_t *np)
+{
+	struct locate_restarts lr;
+	char path[MAXPATHLEN];
+	u_int32_t *offs, i;
+	FILE *fp;
+
+	if (snprintf(path, sizeof(path), "%s%s", db, RESTART_SUFFIX) >=
+	    (int)sizeof(path) || (fp = fopen(path, "r")) == NULL)
+		return (NULL);
+	offs = NULL;
+	if (fread(&lr, sizeof(lr), 1, fp) != 1 ||
+	    memcmp(lr.lr_magic, RESTART_MAGIC, sizeof(lr.lr_magic)) != 0 ||
+	    lr.lr_size != sb->st_size ||
+	    lr.lr_mtime != sb->st_mtimespec.tv_sec ||
+	    lr.lr_mnsec != sb->st_mtimespec.tv_nsec ||
+	    lr.lr_count == 0 || lr.lr_count > sb->st_size / 2)
+		goto bad;
+	if ((offs = malloc(lr.lr_count * sizeof(*offs))) == NULL ||
+	    fread(offs, sizeof(*offs), lr.lr_count, fp) != lr.lr_count)
+		goto bad;
+	for (i = 0; i < lr.lr_count; i++)
+		if (offs[i] <= (i == 0 ? 2 * NBG : offs[i - 1]) ||
+		    offs[i] >= sb->st_size)
+			goto bad;
+	(void)fclose(fp);
+	*np = lr.lr_count;
+	return (offs);
+bad:
+	free(offs);
+	(void)fclose(fp);
+	return (NULL);
+}
+
+/* A run of the database between two restart points */
+struct part {
+	char		*pt_pattern;	/* Its own copy, -i lowers it */
+	caddr_t		 pt_paddr;
+	int		 pt_start;	/* A restart point, or 0 for the first */
+	int		 pt_end;
+	char		*pt_db;
+	char		*pt_buf;	/* What was found */
+	size_t		 pt_len;
+	u_int		 pt_count;
+};
+
+static void
+search_part(struct dw_pool *pool, void *item)
+{
+	struct part *pt = item;
+	FILE *fp, *out;
+
+	if ((fp = open_memstream(&pt->pt_buf, &pt->pt_len)) == NULL)
+		err(1, "open_memstream");
+	out = thread_stdout;
+	thread_stdout = fp;
+	counter = 0;
+	if (f_icase)
+		fastfind_mmap_icase(pt->pt_pattern, pt->pt_paddr,
+		    pt->pt_end, pt->pt_start, pt->pt_db);
+	else
+		fastfind_mmap(pt->pt_pattern, pt->pt_paddr,
+		    pt->pt_end, pt->pt_start, pt->pt_db);
+	pt->pt_count = counter;
+	thread_stdout = out;
+	(void)fclose(fp);
+}
+
+/*
+ * Search for one pattern on nthreads threads, a few parts of the
+ * database each, as some parts have more matches than others; what
+ * was found is then printed part after part, in database order.
+ */
+static void
+search_parts(char *pattern, caddr_t paddr, int len, u_int32_t *offs,
+    u_int32_t n, char *db, unsigned int nthreads)
+{
+	struct dw_pool pool;
+	struct part *parts, *pt;
+	u_int32_t i, first, last, step, nparts;
+
+	/* There are n + 1 runs, before, between and after the n restarts */
+	step = (n + nthreads * 4) / (nthreads * 4);
+	nparts = (n + step) / step;
+	if ((parts = calloc(nparts, sizeof(*parts))) == NULL)
+		err(1, "calloc");
+	for (i = 0; i < nparts; i++) {
+		pt = &parts[i];
+		first = i * step;
+		last = first + step - 1;
+		if ((pt->pt_pattern = strdup(pattern)) == NULL)
+			err(1, "strdup");
+		pt->pt_paddr = paddr;
+		pt->pt_start = first == 0 ? 0 : offs[first - 1];
+		pt->pt_end = last < n ? offs[last] : len;
+		pt->pt_db = db;
+	}
+
+	dw_pool_init(&pool, search_part, NULL);
+	/* The last one pushed is taken first */
+	for (i = nparts; i-- > 0; )
+		dw_pool_push(&pool, &parts[i]);
+	dw_pool_run(&pool, nthreads);
+	dw_pool_destroy(&pool);
+
+	for (i = 0; i < nparts; i++) {
+		pt = &parts[i];
+		if (pt->pt_len != 0 &&
+		    fwrite(pt->pt_buf, 1, pt->pt_len, stdout) != pt->pt_len)
+			err(1, "stdout");
+		counter += pt->pt_count;
+		free(pt->pt_buf);
+		free(pt->pt_pattern);
+	}
+	free(parts);
+}
+
+static void
 search_mmap(db, s)
 	char *db; /* database */
 	char **s; /* search strings */
@@ -309,28 +466,49 @@ search_mmap(db, s)
         int fd;
         caddr_t p;
         off_t len;
+	u_int32_t *offs, n;
+	long ncpu;
 #ifdef DEBUG
         long t0;
 #endif
-	if ((fd = open(db, O_RDONLY)) == -1 ||
-	    fstat(fd, &sb) == -1)
+	if ((fd = open(db, O_RDONLY)) == -1) {
+#ifdef __APPLE__
+		if (errno == ENOENT && !strcmp(db, _PATH_FCODES))
+			nodatabase(db);
+#endif /* __APPLE__ */
+		err(1, "`%s'", db);
+	}
+	if (fstat(fd, &sb) == -1)
 		err(1, "`%s'", db);
 	len = sb.st_size;
+	if (len > INT_MAX)
+		errx(1, "database too large: %s", db);
 
 	if ((p = mmap((caddr_t)0, (size_t)len,
 		      PROT_READ, MAP_SHARED,
 		      fd, (off_t)0)) == MAP_FAILED)
 		err(1, "mmap ``%s''", db);
 
+	/*
+	 * -l stops at the limit'th match, which has to be found by going
+	 * through the file names in order.
+	 */
+	offs = NULL;
+	if (!f_limit && (ncpu = sysconf(_SC_NPROCESSORS_ONLN)) > 1)
+		offs = read_restarts(db, &sb, &n);
+
 	/* foreach search string ... */
 	while (*s != NULL) {
 #ifdef DEBUG
 		t0 = cputime();
 #endif
-		if (f_icase)
-			fastfind_mmap_icase(*s, p, (int)len, db);
+		if (offs != NULL)
+			search_parts(*s, p, (int)len, offs, n, db,
+			    (unsigned int)ncpu);
+		else if (f_icase)
+			fastfind_mmap_icase(*s, p, (int)len, 0, db);
 		else
-			fastfind_mmap(*s, p, (int)len, db);
+			fastfind_mmap(*s, p, (int)len, 0, db);
 #ifdef DEBUG
 		warnx("fastfind %ld ms", cputime () - t0);
 #endif
@@ -340,6 +518,7 @@ search_mmap(db, s)
 	if (munmap(p, (size_t)len) == -1)
 		warn("munmap %s\n", db);
 	
+	free(offs);
 	(void)close(fd);
 }
 #endif /* MMAP */
@@ -355,7 +534,7 @@ cputime ()
 }
 #endif /* DEBUG */
 
-void
+static void
 usage ()
 {
         (void)fprintf(stderr,
@@ -73,4 +73,24 @@ u_char myctype[UCHAR_MAX + 1];
 
 #define INTSIZE (sizeof(int))
 
+/*
+ * updatedb starts every RESTART'th file name over, with a common prefix
+ * of 0, and lists where these names start in the database's restart
+ * file: locate can then decode the parts in between on several threads.
+ * The header is followed by lr_count offsets; the restart file is only
+ * believed while the database's size and mtime are the recorded ones.
+ */
+#define	RESTART		4096
+#define	RESTART_SUFFIX	".restarts"
+#define	RESTART_MAGIC	"LOCRST1"
+
+struct locate_restarts {
+	char		lr_magic[8];
+	int64_t		lr_size;	/* st_size of the database */
+	int64_t		lr_mtime;	/* st_mtimespec of the database */
+	int64_t		lr_mnsec;
+	u_int32_t	lr_count;	/* Offsets that follow */
+	u_int32_t	lr_pad;
+};
+
 #define LOCATE_REG "*?[]\\"  /* fnmatch(3) meta characters */
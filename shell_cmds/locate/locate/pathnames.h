@@ -33,4 +33,13 @@
  *	@(#)pathnames.h	8.1 (Berkeley) 6/6/93
  */
 
+#include <TargetConditionals.h>
+
+#if TARGET_OS_IPHONE
+/* There is no /var/db to write to: the database is in the app container */
+#define	_PATH_FCODES_HOME	"Library/locate.database"
+#define	_PATH_FCODES	locate_fcodes()
+char	*locate_fcodes(void);
+#else
 #define	_PATH_FCODES	"/var/db/locate.database"
+#endif
@@ -0,0 +1,420 @@
+/*
+ * updatedb -- build the locate database in process.
+ *
+ * locate.updatedb pipes find -s through locate.bigram, sort and
+ * locate.code, which takes a shell and a cron job.  Here the trees are
+ * walked with fts(3) in strcmp() order, the names are front compressed
+ * as they come, and once all are in, the 128 bigrams most common in what
+ * is left of them are picked and the database is written out the way
+ * locate.code writes it.  Every RESTART'th name is written whole, and
+ * where these names start goes to the restart file (see locate.h), for
+ * locate to search the parts in between on several threads.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <fts.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <TargetConditionals.h>
+#include "ios_error.h"
+
+#include "locate.h"
+#include "pathnames.h"
+
+/* Each name as a 2 byte common prefix count, then the rest of it and a NUL */
+struct names {
+	u_char		*nm_buf;
+	size_t		 nm_len;
+	size_t		 nm_size;
+	u_int32_t	 nm_count;
+	u_int		*nm_bigram;	/* [UCHAR_MAX + 1][UCHAR_MAX + 1] */
+};
+
+/* A bigram, and how often it came up */
+struct bgcount {
+	u_int		 bc_count;
+	u_char		 bc_bigram[2];
+};
+
+static void	add_name(struct names *, u_char *, size_t, u_char *, size_t);
+static int	bgcmp(const void *, const void *);
+static void	bigrams(struct names *, u_char *);
+static int	namecmp(const FTSENT **, const FTSENT **);
+static FILE	*open_temp(const char *, char *, size_t);
+static void	usage(void);
+static int	walk(char **, char **, int, struct names *);
+static off_t	write_db(FILE *, struct names *, u_char *, u_int32_t *);
+
+int
+updatedb_main(int argc, char *argv[])
+{
+	struct locate_restarts lr;
+	struct names nm;
+	struct stat sb;
+	u_char bg[2 * NBG];
+	char dbtmp[MAXPATHLEN], rstpath[MAXPATHLEN], rsttmp[MAXPATHLEN];
+	char *db, **paths, **prune, *defpaths[2];
+	u_int32_t *offs;
+	FILE *dbfp, *rstfp;
+	off_t size;
+	int ch, nprune, rval;
+
+    optind = 1; opterr = 1; optreset = 1;
+	db = NULL;
+	if ((prune = calloc(argc, sizeof(*prune))) == NULL)
+		err(1, "calloc");
+	nprune = 0;
+	while ((ch = getopt(argc, argv, "d:p:")) != -1)
+		switch (ch) {
+		case 'd':
+			db = optarg;
+			break;
+		case 'p':
+			prune[nprune++] = optarg;
+			break;
+		case '?':
+		default:
+			free(prune);
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+
+	if (db == NULL)
+		db = _PATH_FCODES;
+	if (argc > 0)
+		paths = argv;
+	else {
+#if TARGET_OS_IPHONE
+		/* The app container is as far as the sandbox lets us see */
+		if ((defpaths[0] = getenv("HOME")) == NULL)
+			defpaths[0] = "/";
+#else
+		defpaths[0] = "/";
+#endif
+		defpaths[1] = NULL;
+		paths = defpaths;
+	}
+
+	memset(&nm, 0, sizeof(nm));
+	if ((nm.nm_bigram = calloc((UCHAR_MAX + 1) * (UCHAR_MAX + 1),
+	    sizeof(*nm.nm_bigram))) == NULL)
+		err(1, "calloc");
+	rval = walk(paths, prune, nprune, &nm);
+	free(prune);
+	if (nm.nm_count == 0) {
+		warnx("locate database would be empty, %s not written", db);
+		free(nm.nm_bigram);
+		free(nm.nm_buf);
+		return (1);
+	}
+	bigrams(&nm, bg);
+	free(nm.nm_bigram);
+
+	if ((offs = calloc(nm.nm_count / RESTART + 1, sizeof(*offs))) == NULL)
+		err(1, "calloc");
+	if (snprintf(rstpath, sizeof(rstpath), "%s%s", db, RESTART_SUFFIX) >=
+	    (int)sizeof(rstpath))
+		errc(1, ENAMETOOLONG, "%s", db);
+
+	/*
+	 * Both files are written aside and renamed over the old ones, the
+	 * restart file first: it names the size and mtime of the database
+	 * it goes with, so locate ignores it until the new database is in.
+	 */
+	if ((dbfp = open_temp(db, dbtmp, sizeof(dbtmp))) == NULL)
+		err(1, "%s", db);
+	size = write_db(dbfp, &nm, bg, offs);
+	free(nm.nm_buf);
+	if (fflush(dbfp) != 0 || ferror(dbfp) || fstat(fileno(dbfp), &sb) != 0) {
+		warn("%s", dbtmp);
+		goto bad;
+	}
+	if (size > INT_MAX) {
+		warnx("%s: database too large", db);
+		goto bad;
+	}
+
+	memset(&lr, 0, sizeof(lr));
+	memcpy(lr.lr_magic, RESTART_MAGIC, sizeof(lr.lr_magic));
+	lr.lr_size = sb.st_size;
+	lr.lr_mtime = sb.st_mtimespec.tv_sec;
+	lr.lr_mnsec = sb.st_mtimespec.tv_nsec;
+	lr.lr_count = (nm.nm_count - 1) / RESTART;
+	if ((rstfp = open_temp(rstpath, rsttmp, sizeof(rsttmp))) == NULL) {
+		warn("%s", rstpath);
+		goto bad;
+	}
+	if (fwrite(&lr, sizeof(lr), 1, rstfp) != 1 ||
+	    fwrite(offs, sizeof(*offs), lr.lr_count, rstfp) != lr.lr_count ||
+	    fclose(rstfp) != 0) {
+		warn("%s", rsttmp);
+		(void)unlink(rsttmp);
+		goto bad;
+	}
+	if (rename(rsttmp, rstpath) != 0) {
+		warn("%s", rstpath);
+		(void)unlink(rsttmp);
+		goto bad;
+	}
+	if (fclose(dbfp) != 0) {
+		dbfp = NULL;
+		warn("%s", dbtmp);
+		goto bad;
+	}
+	if (rename(dbtmp, db) != 0) {
+		warn("%s", db);
+		(void)unlink(dbtmp);
+		free(offs);
+		return (1);
+	}
+	free(offs);
+	return (rval);
+
+bad:
+	if (dbfp != NULL)
+		(void)fclose(dbfp);
+	(void)unlink(dbtmp);
+	free(offs);
+	return (1);
+}
+
+/*
+ * Gather the names under paths, but for those matching one of the prune
+ * patterns and what is under them.  As with locate.updatedb, which
+ * throws find's complaints away, what cannot be read is left out quietly.
+ */
+static int
+walk(char **paths, char **prune, int nprune, struct names *nm)
+{
+	FTS *ftsp;
+	FTSENT *p;
+	u_char buf1[MAXPATHLEN], buf2[MAXPATHLEN], *name, *old, *t;
+	size_t len, oldlen, i;
+	int j;
+
+	if ((ftsp = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR | FTS_NOSTAT,
+	    namecmp)) == NULL)
+		err(1, "fts_open");
+	name = buf1;
+	old = buf2;
+	oldlen = 0;
+	while ((p = fts_read(ftsp)) != NULL) {
+		switch (p->fts_info) {
+		case FTS_DP:
+		case FTS_ERR:
+		case FTS_NS:
+			continue;
+		}
+		for (j = 0; j < nprune; j++)
+			if (fnmatch(prune[j], p->fts_path, 0) == 0)
+				break;
+		if (j < nprune) {
+			(void)fts_set(ftsp, p, FTS_SKIP);
+			continue;
+		}
+
+		/* locate reads names back into MAXPATHLEN bytes */
+		len = p->fts_pathlen;
+		if (len == 0 || len >= MAXPATHLEN)
+			continue;
+		for (i = 0; i < len; i++)
+			/* old locate implementations core'd for char 30 */
+			name[i] = p->fts_path[i] == SWITCH ? '?' : p->fts_path[i];
+		add_name(nm, name, len, old, oldlen);
+
+		t = old;
+		old = name;
+		name = t;
+		oldlen = len;
+	}
+	if (errno != 0) {
+		warn("fts_read");
+		(void)fts_close(ftsp);
+		return (1);
+	}
+	(void)fts_close(ftsp);
+	return (0);
+}
+
+static void
+add_name(struct names *nm, u_char *name, size_t len, u_char *old,
+    size_t oldlen)
+{
+	u_char *cp, *end;
+	size_t count;
+
+	/* Skip longest common prefix, but at a restart point */
+	count = 0;
+	if (nm->nm_count % RESTART != 0)
+		while (count < len && count < oldlen &&
+		    name[count] == old[count])
+			count++;
+
+	if (nm->nm_len + 2 + len - count + 1 > nm->nm_size) {
+		nm->nm_size = nm->nm_size == 0 ? 1024 * 1024 : nm->nm_size * 2;
+		if ((nm->nm_buf = reallocf(nm->nm_buf, nm->nm_size)) == NULL)
+			err(1, "realloc");
+	}
+	cp = nm->nm_buf + nm->nm_len;
+	*cp++ = count & 0xff;
+	*cp++ = count >> 8;
+	memcpy(cp, name + count, len - count);
+	end = cp + len - count;
+	*end = '\0';
+	nm->nm_len = end + 1 - nm->nm_buf;
+	nm->nm_count++;
+
+	/* As locate.bigram counts them, in twos from the prefix on */
+	for (; cp + 1 < end; cp += 2)
+		nm->nm_bigram[cp[0] * (UCHAR_MAX + 1) + cp[1]]++;
+}
+
+/* Most common first, the same order for the same names */
+static int
+bgcmp(const void *a, const void *b)
+{
+	const struct bgcount *x = a, *y = b;
+
+	if (x->bc_count != y->bc_count)
+		return (x->bc_count < y->bc_count ? 1 : -1);
+	return (memcmp(x->bc_bigram, y->bc_bigram, sizeof(x->bc_bigram)));
+}
+
+/* The NBG most common bigrams of printable characters, padded with NULs */
+static void
+bigrams(struct names *nm, u_char *bg)
+{
+	struct bgcount *bc;
+	size_t n, i;
+	int c1, c2;
+
+	if ((bc = calloc((ASCII_MAX - ASCII_MIN + 1) *
+	    (ASCII_MAX - ASCII_MIN + 1), sizeof(*bc))) == NULL)
+		err(1, "calloc");
+	n = 0;
+	for (c1 = ASCII_MIN; c1 <= ASCII_MAX; c1++)
+		for (c2 = ASCII_MIN; c2 <= ASCII_MAX; c2++)
+			if (nm->nm_bigram[c1 * (UCHAR_MAX + 1) + c2] != 0) {
+				bc[n].bc_count =
+				    nm->nm_bigram[c1 * (UCHAR_MAX + 1) + c2];
+				bc[n].bc_bigram[0] = c1;
+				bc[n].bc_bigram[1] = c2;
+				n++;
+			}
+	qsort(bc, n, sizeof(*bc), bgcmp);
+
+	memset(bg, 0, 2 * NBG);
+	for (i = 0; i < n && i < NBG; i++) {
+		bg[2 * i] = bc[i].bc_bigram[0];
+		bg[2 * i + 1] = bc[i].bc_bigram[1];
+	}
+	free(bc);
+}
+
+/*
+ * Write the database as locate.code does, and the offsets of the names
+ * at the restart points into offs.  Returns the size of the database.
+ */
+static off_t
+write_db(FILE *fp, struct names *nm, u_char *bg, u_int32_t *offs)
+{
+	short (*big)[UCHAR_MAX + 1];
+	u_char *cp;
+	u_int32_t n;
+	off_t off;
+	int code, count, diffcount, oldcount, i;
+
+	/* Lookup table of the bigrams' codes, 3x faster than searching */
+	if ((big = malloc(sizeof(short) * (UCHAR_MAX + 1) * (UCHAR_MAX + 1)))
+	    == NULL)
+		err(1, "malloc");
+	memset(big, 0xff, sizeof(short) * (UCHAR_MAX + 1) * (UCHAR_MAX + 1));
+	for (i = 0; i < 2 * NBG && bg[i] != '\0'; i += 2)
+		big[bg[i]][bg[i + 1]] = i;
+
+	(void)fwrite(bg, 1, 2 * NBG, fp);
+	off = 2 * NBG;
+	oldcount = 0;
+	for (cp = nm->nm_buf, n = 0; n < nm->nm_count; n++) {
+		count = cp[0] | cp[1] << 8;
+		cp += 2;
+		if (n != 0 && n % RESTART == 0)
+			offs[n / RESTART - 1] = (u_int32_t)off;
+
+		diffcount = count - oldcount + OFFSET;
+		oldcount = count;
+		if (diffcount < 0 || diffcount > 2 * OFFSET) {
+			(void)putc(SWITCH, fp);
+			(void)putw(diffcount, fp);
+			off += 1 + INTSIZE;
+		} else {
+			(void)putc(diffcount, fp);
+			off++;
+		}
+
+		while (*cp != '\0') {
+			/* a bigram code is marked with the parity bit */
+			if ((code = big[cp[0]][cp[1]]) != -1) {
+				(void)putc((code / 2) | PARITY, fp);
+				off++;
+				cp += 2;
+				continue;
+			}
+			for (i = 0; i < 2 && *cp != '\0'; i++) {
+				/* 8 bit characters follow an UMLAUT */
+				if (*cp < ASCII_MIN || *cp > ASCII_MAX) {
+					(void)putc(UMLAUT, fp);
+					off++;
+				}
+				(void)putc(*cp++, fp);
+				off++;
+			}
+		}
+		cp++;
+	}
+	free(big);
+	return (off);
+}
+
+static int
+namecmp(const FTSENT **a, const FTSENT **b)
+{
+	return (strcmp((*a)->fts_name, (*b)->fts_name));
+}
+
+static FILE *
+open_temp(const char *path, char *tmp, size_t size)
+{
+	FILE *fp;
+	int fd;
+
+	if (snprintf(tmp, size, "%s.XXXXXX", path) >= (int)size) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+	if ((fd = mkstemp(tmp)) == -1)
+		return (NULL);
+	if (fchmod(fd, 0644) != 0 || (fp = fdopen(fd, "w")) == NULL) {
+		(void)close(fd);
+		(void)unlink(tmp);
+		return (NULL);
+	}
+	return (fp);
+}
+
+static void
+usage(void)
+{
+	(void)fprintf(stderr,
+	    "usage: updatedb [-d database] [-p pattern] [path ...]\n");
+	exit(1);
+}
@@ -44,8 +44,10 @@
 #include <sys/param.h>
 #include <arpa/inet.h>
 #include <stdio.h>
+#include "ios_error.h"
 
 #include "locate.h"
+#include "pathnames.h"
 
 char 	**colon(char **, char*, char*);
 char 	*patprep(char *);
@@ -55,6 +57,24 @@ int 	getwm(caddr_t);
 int 	getwf(FILE *);
 int	check_bigram_char(int);
 
+#if TARGET_OS_IPHONE
+/*
+ * The default database, $HOME/Library/locate.database; HOME is
+ * looked up each time, so that it can be changed in the shell.
+ */
+char *
+locate_fcodes(void)
+{
+	static char path[MAXPATHLEN];
+	char *home;
+
+	if ((home = getenv("HOME")) == NULL)
+		home = "";
+	(void)snprintf(path, sizeof(path), "%s/%s", home, _PATH_FCODES_HOME);
+	return (path);
+}
+#endif
+
 /* 
  * Validate bigram chars. If the test failed the database is corrupt 
  * or the database is obviously not a locate database.
@@ -148,7 +168,7 @@ print_matches(counter)
  * extract last glob-free subpattern in name for fast pre-match; prepend
  * '\0' for backwards match; return end of new pattern
  */
-static char globfree[100];
+static __thread char globfree[100];
 
 char *
 patprep(name)
@@ -49,6 +49,9 @@ __FBSDID("$FreeBSD: src/usr.bin/seq/seq.c,v 1.2 2010/02/20 01:23:15 delphij Exp
 #define ISEXP(c)	((int)(c) == 'e' || (int)(c) == 'E')
 #define ISODIGIT(c)	((int)(c) >= '0' && (int)(c) <= '7')
 
+#define OUTBUFSIZ	(64 * 1024)	/* output block for integer sequences */
+#define G_INTMAX	999999		/* larger integers print as %e with %g */
+
 /* Globals */
 
 const char *decimal_point = ".";	/* default */
@@ -57,6 +60,7 @@ char default_format[] = { "%g" };	/* default */
 /* Prototypes */
 
 double e_atof(const char *);
+double print_integers(double, double, double, const char *);
 
 int decimal_places(const char *);
 int main(int, char *[]);
@@ -166,6 +170,9 @@ main(int argc, char *argv[])
 	} else
 		fmt = generate_format(first, incr, last, equalize, pad);
 
+	if (fmt == default_format)
+		first = print_integers(first, incr, last, sep);
+
 	if (incr > 0) {
 		for (; first <= last; first += incr) {
 			printf(fmt, first);
@@ -183,6 +190,68 @@ main(int argc, char *argv[])
 	return (0);
 }
 
+/*
+ * print_integers - print the start of an integer sequence as "%g" would
+ *	The value is kept as decimal digits, counted up in place when incr
+ *	is 1, and the output goes out in blocks of OUTBUFSIZ.  %g prints
+ *	integers in full only up to G_INTMAX, so this stops there; the
+ *	value it returns is the first not printed.
+ */
+double
+print_integers(double first, double incr, double last, const char *sep)
+{
+	static char out[OUTBUFSIZ];
+	char num[24], *np, *cp, *end;
+	size_t len, n, seplen;
+	long long v, step, stop;
+	unsigned long long u;
+
+	seplen = strlen(sep);
+	if (first != floor(first) || incr != floor(incr) ||
+	    fabs(first) > G_INTMAX || isnan(last) || seplen > OUTBUFSIZ / 2)
+		return (first);
+	v = first;
+	step = incr;
+	if (step > 0)
+		stop = (last < G_INTMAX) ? floor(last) : G_INTMAX;
+	else
+		stop = (last > -G_INTMAX) ? ceil(last) : -G_INTMAX;
+
+	end = num + sizeof(num);
+	np = end;
+	n = 0;
+	for (; (step > 0) ? v <= stop : v >= stop; v += step) {
+		if (step == 1 && np != end && v > 0) {
+			/* one more than the last number, which was >= 0 */
+			for (cp = end - 1; cp >= np && *cp == '9'; cp--)
+				*cp = '0';
+			if (cp < np)
+				*--np = '1';
+			else
+				++*cp;
+		} else {
+			np = end;
+			u = (v < 0) ? -(unsigned long long)v : v;
+			do {
+				*--np = '0' + u % 10;
+			} while ((u /= 10) != 0);
+			if (v < 0)
+				*--np = '-';
+		}
+		len = end - np;
+		if (n + len + seplen > sizeof(out)) {
+			fwrite(out, 1, n, stdout);
+			n = 0;
+		}
+		memcpy(out + n, np, len);
+		memcpy(out + n + len, sep, seplen);
+		n += len + seplen;
+	}
+	fwrite(out, 1, n, stdout);
+
+	return (v);
+}
+
 /*
  * numeric - verify that string is numeric
  */
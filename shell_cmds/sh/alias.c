@@ -119,7 +119,10 @@ unalias(const char *name)
 	return (1);
 }
 
-static void
+#if !TARGET_OS_IPHONE
+static
+#endif
+void
 rmaliases(void)
 {
 	struct alias *ap, *tmp;
@@ -141,6 +144,14 @@ rmaliases(void)
 	INTON;
 }
 
+#if TARGET_OS_IPHONE
+int
+havealiases(void)
+{
+	return aliases != 0;
+}
+#endif
+
 struct alias *
 lookupalias(const char *name, int check)
 {
@@ -43,3 +43,7 @@ struct alias {
 };
 
 struct alias *lookupalias(const char *, int);
+#if TARGET_OS_IPHONE
+void rmaliases(void);
+int havealiases(void);
+#endif
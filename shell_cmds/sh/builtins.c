@@ -0,0 +1,98 @@
+/*
+ * This file was generated by the mkbuiltins program.
+ */
+
+#include <stdlib.h>
+#include "shell.h"
+#include "builtins.h"
+
+int (*const builtinfunc[])(int, char **) = {
+	bltincmd,
+	aliascmd,
+	bindcmd,
+	breakcmd,
+	cdcmd,
+	commandcmd,
+	dotcmd,
+	echocmd,
+	evalcmd,
+	execcmd,
+	exitcmd,
+	letcmd,
+	exportcmd,
+	falsecmd,
+	freebsd_wordexpcmd,
+	getoptscmd,
+	hashcmd,
+	histcmd,
+	jobidcmd,
+	jobscmd,
+	killcmd,
+	localcmd,
+	printfcmd,
+	pwdcmd,
+	readcmd,
+	returncmd,
+	setcmd,
+	setvarcmd,
+	shiftcmd,
+	testcmd,
+	timescmd,
+	trapcmd,
+	truecmd,
+	typecmd,
+	ulimitcmd,
+	umaskcmd,
+	unaliascmd,
+	unsetcmd,
+	waitcmd,
+	wordexpcmd,
+};
+
+const unsigned char builtincmd[] = {
+	"\007\000builtin"
+	"\005\001alias"
+	"\004\002bind"
+	"\005\203break"
+	"\010\203continue"
+	"\002\004cd"
+	"\005\004chdir"
+	"\007\005command"
+	"\001\206."
+	"\004\007echo"
+	"\004\210eval"
+	"\004\211exec"
+	"\004\212exit"
+	"\003\013let"
+	"\006\214export"
+	"\010\214readonly"
+	"\005\015false"
+	"\017\016freebsd_wordexp"
+	"\007\017getopts"
+	"\004\020hash"
+	"\002\021fc"
+	"\005\022jobid"
+	"\004\023jobs"
+	"\004\024kill"
+	"\005\025local"
+	"\006\026printf"
+	"\003\027pwd"
+	"\004\030read"
+	"\006\231return"
+	"\003\232set"
+	"\006\033setvar"
+	"\005\234shift"
+	"\004\035test"
+	"\001\035["
+	"\005\236times"
+	"\004\237trap"
+	"\001\240:"
+	"\004\040true"
+	"\004\041type"
+	"\006\042ulimit"
+	"\005\043umask"
+	"\007\044unalias"
+	"\005\245unset"
+	"\004\046wait"
+	"\007\047wordexp"
+};
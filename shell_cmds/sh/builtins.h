@@ -0,0 +1,91 @@
+/*
+ * This file was generated by the mkbuiltins program.
+ */
+
+#include <sys/cdefs.h>
+#define BLTINCMD 0
+#define ALIASCMD 1
+#define BINDCMD 2
+#define BREAKCMD 3
+#define CDCMD 4
+#define COMMANDCMD 5
+#define DOTCMD 6
+#define ECHOCMD 7
+#define EVALCMD 8
+#define EXECCMD 9
+#define EXITCMD 10
+#define LETCMD 11
+#define EXPORTCMD 12
+#define FALSECMD 13
+#define FREEBSD_WORDEXPCMD 14
+#define GETOPTSCMD 15
+#define HASHCMD 16
+#define HISTCMD 17
+#define JOBIDCMD 18
+#define JOBSCMD 19
+#define KILLCMD 20
+#define LOCALCMD 21
+#define PRINTFCMD 22
+#define PWDCMD 23
+#define READCMD 24
+#define RETURNCMD 25
+#define SETCMD 26
+#define SETVARCMD 27
+#define SHIFTCMD 28
+#define TESTCMD 29
+#define TIMESCMD 30
+#define TRAPCMD 31
+#define TRUECMD 32
+#define TYPECMD 33
+#define ULIMITCMD 34
+#define UMASKCMD 35
+#define UNALIASCMD 36
+#define UNSETCMD 37
+#define WAITCMD 38
+#define WORDEXPCMD 39
+
+#define BUILTIN_SPECIAL 0x80
+
+extern int (*const builtinfunc[])(int, char **);
+extern const unsigned char builtincmd[];
+
+int bltincmd(int, char **);
+int aliascmd(int, char **);
+int bindcmd(int, char **);
+int breakcmd(int, char **);
+int cdcmd(int, char **);
+int commandcmd(int, char **);
+int dotcmd(int, char **);
+int echocmd(int, char **);
+int evalcmd(int, char **);
+int execcmd(int, char **);
+int exitcmd(int, char **);
+int letcmd(int, char **);
+int exportcmd(int, char **);
+int falsecmd(int, char **);
+int freebsd_wordexpcmd(int, char **);
+int getoptscmd(int, char **);
+int hashcmd(int, char **);
+int histcmd(int, char **);
+int jobidcmd(int, char **);
+int jobscmd(int, char **);
+int killcmd(int, char **);
+int localcmd(int, char **);
+int printfcmd(int, char **);
+int pwdcmd(int, char **);
+int readcmd(int, char **);
+int returncmd(int, char **);
+int setcmd(int, char **);
+int setvarcmd(int, char **);
+int shiftcmd(int, char **);
+int testcmd(int, char **);
+int timescmd(int, char **);
+int trapcmd(int, char **);
+int truecmd(int, char **);
+int typecmd(int, char **);
+int ulimitcmd(int, char **);
+int umaskcmd(int, char **);
+int unaliascmd(int, char **);
+int unsetcmd(int, char **);
+int waitcmd(int, char **);
+int wordexpcmd(int, char **);
@@ -419,3 +419,50 @@ pwd_init(int warn)
 		out2fmt_flush("sh: cannot determine working directory\n");
 	setvar("PWD", curdir, VEXPORT);
 }
+
+#if TARGET_OS_IPHONE
+/*
+ * The working directory of a subshell is the shell's: savecwd() returns
+ * it, for restorecwd() to go back there when the subshell is done.
+ */
+char *
+savecwd(void)
+{
+	char *p;
+
+	if ((p = getpwd()) == NULL)
+		return (NULL);
+	return (savestr(p));
+}
+
+void
+restorecwd(char *dir)
+{
+	if (dir == NULL)
+		return;
+	INTOFF;
+	if (curdir == NULL || strcmp(curdir, dir) != 0) {
+		hashcd();
+		if (chdir(dir) < 0) {
+			ckfree(dir);
+			dir = NULL;
+		}
+		if (curdir != NULL)
+			ckfree(curdir);
+		curdir = dir;
+	} else
+		ckfree(dir);
+	INTON;
+}
+
+/*
+ * Forget the working directory, when the shell is done.
+ */
+void
+freecwd(void)
+{
+	if (curdir != NULL)
+		ckfree(curdir);
+	curdir = NULL;
+}
+#endif
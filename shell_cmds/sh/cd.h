@@ -30,3 +30,8 @@
  */
 
 void	 pwd_init(int);
+#if TARGET_OS_IPHONE
+char	*savecwd(void);
+void	 restorecwd(char *);
+void	 freecwd(void);
+#endif
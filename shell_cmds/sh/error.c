@@ -100,6 +100,20 @@ exraise(int e)
  * Arrange for this here.
  */
 
+#if TARGET_OS_IPHONE
+/*
+ * There are no signals, only checkintr(): the interruption is an exception,
+ * for the shell and for a subshell alike.
+ */
+
+void
+onint(void)
+{
+
+	intpending = 0;
+	exraise(EXINT);
+}
+#else
 void
 onint(void)
 {
@@ -124,6 +138,7 @@ onint(void)
 		_exit(128 + SIGINT);
 	}
 }
+#endif
 
 
 static void
@@ -72,6 +72,10 @@ __FBSDID("$FreeBSD: head/bin/sh/eval.c 293635 2016-01-10 16:31:28Z jilles $");
 #ifndef NO_HISTORY
 #include "myhistedit.h"
 #endif
+#if TARGET_OS_IPHONE
+#include "cd.h"
+#include "main.h"
+#endif
 
 
 int evalskip;			/* set if we are skipping commands */
@@ -98,6 +102,34 @@ static void evalpipe(union node *);
 static int is_valid_fast_cmdsubst(union node *n);
 static void evalcommand(union node *, int, struct backcmd *);
 static void prehash(union node *);
+#if TARGET_OS_IPHONE
+/*
+ * There is no fork().  A subshell runs in the shell itself, which saves
+ * what the subshell may change, and restores it when it is done.  The
+ * commands that are not part of the shell run on threads of their own,
+ * started by spawnjob() or spawncmd().
+ */
+struct subshell {
+	struct jmploc *handler;
+	struct localvar *localvars;
+	struct shparam shellparam;
+	struct trapstate traps;
+	char *cwd;
+	int loopnest;
+	int rootshell;
+};
+
+static int bgjobidx;		/* where EV_BACKGND starts the command */
+static int bgprocidx;
+static int bgmode;
+
+static void entersubshell(struct subshell *, int, int);
+static int leavesubshell(struct subshell *, int);
+static int exceptionstatus(int);
+static int evalinsubshell(union node *, int, int, int, union node *);
+static void evalspawn(union node *, int, int, int, int, int);
+static int isexternal(union node *);
+#endif
 
 
 /*
@@ -204,6 +236,9 @@ evaltree(union node *n, int flags)
 	}
 	do {
 		next = NULL;
+#if TARGET_OS_IPHONE
+		checkintr();
+#endif
 #ifndef NO_HISTORY
 		displayhist = 1;	/* show history substitutions done with fc */
 #endif
@@ -424,6 +459,213 @@ evalcase(union node *n)
  * Kick off a subshell to evaluate a tree.
  */
 
+#if TARGET_OS_IPHONE
+static char dashname[] = "-";
+
+/*
+ * Start a subshell, with its standard input and output redirected to the
+ * descriptors in and out if they are not -1.  They belong to the subshell
+ * from then on.
+ */
+
+static void
+entersubshell(struct subshell *ss, int in, int out)
+{
+	INTOFF;
+	flushall();
+	ss->handler = handler;
+	ss->localvars = localvars;
+	localvars = NULL;
+	forcelocal++;
+	mklocal(dashname);
+	ss->shellparam = shellparam;
+	shellparam.malloc = 0;
+	ss->loopnest = loopnest;
+	loopnest = 0;
+	ss->rootshell = rootshell;
+	rootshell = 0;
+	ss->cwd = savecwd();
+	pushtraps(&ss->traps);
+	redirectio(in, out);
+	INTON;
+}
+
+
+/*
+ * End the subshell, which exits with status, and return the status it
+ * exits with once its trap on EXIT has run.
+ */
+
+static int
+leavesubshell(struct subshell *ss, int status)
+{
+	INTOFF;
+	status = runexittrap(status);
+	handler = ss->handler;
+	popredir();
+	poptraps(&ss->traps);
+	restorecwd(ss->cwd);
+	freeparam(&shellparam);
+	shellparam = ss->shellparam;
+	loopnest = ss->loopnest;
+	rootshell = ss->rootshell;
+	poplocalvars();
+	forcelocal--;
+	localvars = ss->localvars;
+	evalskip = 0;
+	skipcount = 0;
+	INTON;
+	return (status);
+}
+
+
+/*
+ * The exit status of a subshell that ends with the exception e.
+ */
+
+static int
+exceptionstatus(int e)
+{
+	switch (e) {
+	case EXINT:
+		return (128 + SIGINT);
+	case EXERROR:
+		return (2);
+	case EXEXEC:
+		return (exerrno);
+	default:
+		return (exitstatus);
+	}
+}
+
+
+/*
+ * Evaluate n in a subshell, after the redirections redir, and return its
+ * exit status.
+ */
+
+static int
+evalinsubshell(union node *n, int flags, int in, int out, union node *redir)
+{
+	struct subshell ss;
+	struct jmploc jmploc;
+	volatile int e;
+	int status;
+
+	entersubshell(&ss, in, out);
+	e = -1;
+	if (setjmp(jmploc.loc)) {
+		e = exception;
+		status = exceptionstatus(e);
+	} else {
+		handler = &jmploc;
+		redirect(redir, 0);
+		evaltree(n, flags | EV_EXIT);	/* never returns */
+		status = exitstatus;
+	}
+	status = leavesubshell(&ss, status);
+	if (e == EXINT)
+		exraise(EXINT);
+	return (status);
+}
+
+
+/*
+ * Start the command n, which isexternal(), as the process procidx of the
+ * job jobidx, with its standard input and output redirected to in and out
+ * if they are not -1.  They are closed once the command has them.  If it
+ * fails before it starts, its exit status is that of the child process it
+ * would have been.
+ */
+
+static void
+evalspawn(union node *n, int jobidx, int procidx, int mode, int in, int out)
+{
+	struct jmploc jmploc;
+	struct jmploc *savehandler;
+	struct procstat *ps;
+	int status;
+
+	redirectio(in, out);
+	savehandler = handler;
+	if (setjmp(jmploc.loc)) {
+		handler = savehandler;
+		popredir();
+		if (exception != EXERROR && exception != EXEXEC)
+			longjmp(handler->loc, 1);
+		status = exceptionstatus(exception);
+		FORCEINTON;
+	} else {
+		handler = &jmploc;
+		bgjobidx = jobidx;
+		bgprocidx = procidx;
+		bgmode = mode;
+		evaltree(n, EV_BACKGND);
+		status = exitstatus;
+		handler = savehandler;
+		popredir();
+	}
+	ps = &jobfromindex(jobidx)->ps[procidx];
+	if (ps->pid == -1 && ps->status == -1)
+		setjobstatus(jobfromindex(jobidx), procidx, status);
+}
+
+
+/*
+ * Is n a simple command that runs on a thread of its own?  Only its name
+ * is looked at, unexpanded, so as not to expand anything twice.
+ */
+
+static int
+isexternal(union node *n)
+{
+	struct cmdentry entry;
+	union node *argp;
+
+	if (n == NULL || n->type != NCMD)
+		return (0);
+	for (argp = n->ncmd.args ; argp ; argp = argp->narg.next)
+		if (!isassignment(argp->narg.text))
+			break;
+	if (argp == NULL || !goodname(argp->narg.text))
+		return (0);
+	find_command(argp->narg.text, &entry, 0, pathval());
+	return (entry.cmdtype == CMDNORMAL);
+}
+
+
+static void
+evalsubshell(union node *n, int flags)
+{
+	struct job *jp;
+	int backgnd = (n->type == NBACKGND);
+	int status;
+
+	oexitstatus = exitstatus;
+	expredir(n->nredir.redirect);
+	if (!backgnd && flags & EV_EXIT && !have_traps()) {
+		redirect(n->nredir.redirect, 0);
+		evaltree(n->nredir.n, flags | EV_EXIT);	/* never returns */
+	} else if (backgnd && n->nredir.redirect == NULL &&
+	    isexternal(n->nredir.n)) {
+		INTOFF;
+		jp = makejob(n, 1);
+		evalspawn(n->nredir.n, jobindex(jp), 0, FORK_BG, -1, -1);
+		INTON;
+		exitstatus = 0;
+	} else {
+		/*
+		 * Anything else in the background runs to its end first, as
+		 * a subshell in the foreground.
+		 */
+		if (backgnd)
+			flags &=~ EV_TESTED;
+		status = evalinsubshell(n->nredir.n, flags & EV_TESTED, -1, -1,
+		    n->nredir.redirect);
+		exitstatus = backgnd ? 0 : status;
+	}
+}
+#else
 static void
 evalsubshell(union node *n, int flags)
 {
@@ -445,6 +687,7 @@ evalsubshell(union node *n, int flags)
 	} else
 		exitstatus = 0;
 }
+#endif
 
 
 /*
@@ -560,6 +803,106 @@ expredir(union node *n)
 
 
 
+#if TARGET_OS_IPHONE
+/*
+ * Evaluate a pipeline.  The commands that are not part of the shell start
+ * on threads of their own, connected with pipes.  The others run in the
+ * shell, one after the other, as subshells: the output of one that is
+ * followed by another such command goes to a file, which the next command
+ * reads once it is done.  The last such command of the pipeline runs once
+ * all the commands after it have started.
+ */
+
+static void
+evalpipe(union node *n)
+{
+	struct jmploc jmploc;
+	struct jmploc *savehandler;
+	struct job *jp;
+	struct nodelist *lp, *rp;
+	struct procstat *ps;
+	int backgnd = n->npipe.backgnd;
+	int mode = backgnd ? FORK_BG : FORK_FG;
+	int jobidx, pipelen, i, j, status;
+	volatile int in;
+	int prevfd;
+	int pip[2], rpip[2];
+
+	TRACE(("evalpipe(%p) called\n", (void *)n));
+	pipelen = 0;
+	for (lp = n->npipe.cmdlist ; lp ; lp = lp->next)
+		pipelen++;
+	INTOFF;
+	jobidx = jobindex(makejob(n, pipelen));
+	in = -1;
+	savehandler = handler;
+	if (setjmp(jmploc.loc)) {
+		/* Interrupted: what did not start never will */
+		handler = savehandler;
+		jp = jobfromindex(jobidx);
+		for (i = 0, ps = jp->ps; i < pipelen; i++, ps++)
+			if (ps->pid == -1 && ps->status == -1)
+				setjobstatus(jp, i, 128 + SIGINT);
+		if (in >= 0)
+			close(in);
+		longjmp(handler->loc, 1);
+	}
+	handler = &jmploc;
+	for (lp = n->npipe.cmdlist, i = 0 ; lp ; lp = lp->next, i++) {
+		prehash(lp->n);
+		pip[0] = pip[1] = -1;
+		if (isexternal(lp->n)) {
+			if (lp->next && pipe(pip) < 0)
+				error("Pipe call failed: %s", strerror(errno));
+			prevfd = in;
+			in = -1;
+			evalspawn(lp->n, jobidx, i, mode, prevfd, pip[1]);
+			in = pip[0];
+			continue;
+		}
+		for (rp = lp->next ; rp ; rp = rp->next)
+			if (!isexternal(rp->n))
+				break;
+		if (rp != NULL)
+			filepipe(pip);
+		else if (lp->next != NULL) {
+			/* The rest of the pipeline reads as it goes */
+			if (pipe(pip) < 0)
+				error("Pipe call failed: %s", strerror(errno));
+			prevfd = pip[0];
+			for (rp = lp->next, j = i + 1 ; rp ; rp = rp->next, j++) {
+				prehash(rp->n);
+				rpip[0] = rpip[1] = -1;
+				if (rp->next && pipe(rpip) < 0)
+					error("Pipe call failed: %s",
+					    strerror(errno));
+				evalspawn(rp->n, jobidx, j, mode, prevfd,
+				    rpip[1]);
+				prevfd = rpip[0];
+			}
+			pip[0] = -1;
+		}
+		prevfd = in;
+		in = -1;
+		status = evalinsubshell(lp->n, 0, prevfd, pip[1], NULL);
+		in = pip[0];
+		setjobstatus(jobfromindex(jobidx), i, status);
+		if (rp == NULL)
+			break;
+	}
+	handler = savehandler;
+	jp = jobfromindex(jobidx);
+	INTON;
+	if (n->npipe.backgnd == 0 || jp->state == JOBDONE) {
+		INTOFF;
+		exitstatus = waitforjob(jp, (int *)NULL);
+		TRACE(("evalpipe:  job done exit status %d\n", exitstatus));
+		INTON;
+	}
+	if (n->npipe.backgnd)
+		exitstatus = 0;
+}
+#else
 /*
  * Evaluate a pipeline.  All the processes in the pipeline are children
  * of the process creating the pipeline.  (This differs from some versions
@@ -624,6 +967,7 @@ evalpipe(union node *n)
 	} else
 		exitstatus = 0;
 }
+#endif
 
 
 
@@ -645,7 +989,9 @@ void
 evalbackcmd(union node *n, struct backcmd *result)
 {
 	int pip[2];
+#if !TARGET_OS_IPHONE
 	struct job *jp;
+#endif
 	struct stackmark smark;
 	struct jmploc jmploc;
 	struct jmploc *savehandler;
@@ -689,6 +1035,11 @@ evalbackcmd(union node *n, struct backcmd *result)
 		localvars = savelocalvars;
 		shellparam.reset = saveoptreset;
 	} else {
+#if TARGET_OS_IPHONE
+		filepipe(pip);
+		exitstatus = evalinsubshell(n, 0, -1, pip[1], NULL);
+		result->fd = pip[0];
+#else
 		if (pipe(pip) < 0)
 			error("Pipe call failed: %s", strerror(errno));
 		jp = makejob(n, 1);
@@ -704,6 +1055,7 @@ evalbackcmd(union node *n, struct backcmd *result)
 		close(pip[1]);
 		result->fd = pip[0];
 		result->jp = jp;
+#endif
 	}
 	popstackmark(&smark);
 	TRACE(("evalbackcmd done: fd=%d buf=%p nleft=%d jp=%p\n",
@@ -842,10 +1194,19 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 	struct parsefile *savetopfile;
 	volatile int e;
 	char *lastarg;
+#if !TARGET_OS_IPHONE
 	int realstatus;
+#endif
 	int do_clearcmdentry;
 	const char *path = pathval();
 	int i;
+#if TARGET_OS_IPHONE
+	struct subshell ss;
+	struct jmploc subjmp;
+	volatile int subexc;
+	int insubshell;
+	int bgjob, bgproc;
+#endif
 
 	/* First expand the arguments. */
 	TRACE(("evalcommand(%p, %d) called\n", (void *)cmd, flags));
@@ -856,6 +1217,13 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 	do_clearcmdentry = 0;
 	oexitstatus = exitstatus;
 	exitstatus = 0;
+#if TARGET_OS_IPHONE
+	/* The expansions may evaluate other commands with EV_BACKGND */
+	bgjob = bgjobidx;
+	bgproc = bgprocidx;
+	insubshell = 0;
+	subexc = -1;
+#endif
 	/* Add one slot at the beginning for tryexec(). */
 	appendarglist(&arglist, nullstr);
 	for (argp = cmd->ncmd.args ; argp ; argp = argp->narg.next) {
@@ -984,6 +1352,29 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 			cmdentry.special = 0;
 	}
 
+#if TARGET_OS_IPHONE
+	/*
+	 * Nothing is forked.  A command substitution that would need a child
+	 * process runs in a subshell of the shell, which writes to a file.
+	 */
+	if (cmdentry.cmdtype != CMDNORMAL && cmdentry.cmdtype != CMDUNKNOWN)
+		flags &= ~EV_BACKGND;
+	if ((flags & EV_BACKCMD) != 0
+	    && (cmdentry.cmdtype != CMDBUILTIN ||
+		 !safe_builtin(cmdentry.u.index, argc, argv))) {
+		filepipe(pip);
+		backcmd->fd = pip[0];
+		entersubshell(&ss, -1, pip[1]);
+		insubshell = 1;
+		if (setjmp(subjmp.loc)) {
+			subexc = exception;
+			exitstatus = exceptionstatus(subexc);
+			goto out;
+		}
+		handler = &subjmp;
+		flags = (flags & ~EV_BACKCMD) | EV_EXIT;
+	}
+#else
 	/* Fork off a child process if necessary. */
 	if (((cmdentry.cmdtype == CMDNORMAL || cmdentry.cmdtype == CMDUNKNOWN)
 	    && ((flags & EV_EXIT) == 0 || have_traps()))
@@ -1019,6 +1410,7 @@ evalcommand(union node *cmd, int flags, struct backcmd *backcmd)
 		}
 		flags |= EV_EXIT;
 	}
+#endif
 
 	/* This is the child process if a fork occurred. */
 	/* Execute the command. */
@@ -1151,15 +1543,63 @@ cmddone:
 #ifdef DEBUG
 		trputs("normal command:  ");  trargs(argv);
 #endif
+#if TARGET_OS_IPHONE
+		/*
+		 * The command runs on a thread of its own, with the shell's
+		 * descriptors and variables as they would be in the child.
+		 */
+		INTOFF;
+		savelocalvars = localvars;
+		localvars = NULL;
+		savehandler = handler;
+		if (setjmp(jmploc.loc)) {
+			e = exception;
+			handler = savehandler;
+			poplocalvars();
+			localvars = savelocalvars;
+			popredir();
+			if (e != EXERROR && e != EXEXEC)
+				longjmp(handler->loc, 1);
+			/* As the child would have */
+			exitstatus = 2;
+			FORCEINTON;
+			goto out;
+		}
+		handler = &jmploc;
+		redirect(cmd->ncmd.redirect, REDIR_PUSH);
+		for (i = 0; i < varlist.count; i++) {
+			mklocal(varlist.args[i]);
+			setvareq(savestr(varlist.args[i]), VEXPORT|VNOLOCAL);
+		}
+		envp = environment();
+		if (flags & EV_BACKGND)
+			spawnjob(jobfromindex(bgjob), bgproc, cmd, argv, envp,
+			    bgmode);
+		else {
+			exitstatus = spawncmd(argv, envp);
+			if (iflag && loopnest > 0 &&
+			    exitstatus == 128 + SIGINT) {
+				evalskip = SKIPBREAK;
+				skipcount = loopnest;
+			}
+		}
+		handler = savehandler;
+		poplocalvars();
+		localvars = savelocalvars;
+		popredir();
+		INTON;
+#else
 		redirect(cmd->ncmd.redirect, 0);
 		for (i = 0; i < varlist.count; i++)
 			setvareq(varlist.args[i], VEXPORT|VSTACK);
 		envp = environment();
 		shellexec(argv, envp, path, cmdentry.u.index);
 		/*NOTREACHED*/
+#endif
 	}
 	goto out;
 
+#if !TARGET_OS_IPHONE
 parent:	/* parent process gets here (if we forked) */
 	if (mode == FORK_FG) {	/* argument to fork */
 		INTOFF;
@@ -1174,8 +1614,16 @@ parent:	/* parent process gets here (if we forked) */
 		close(pip[1]);
 		backcmd->jp = jp;
 	}
+#endif
 
 out:
+#if TARGET_OS_IPHONE
+	if (insubshell) {
+		exitstatus = leavesubshell(&ss, exitstatus);
+		if (subexc == EXINT)
+			exraise(EXINT);
+	}
+#endif
 	if (lastarg)
 		setvar("_", lastarg, 0);
 	if (do_clearcmdentry)
@@ -52,6 +52,9 @@ void reseteval(void);
 #define EV_EXIT 01		/* exit after evaluating tree */
 #define EV_TESTED 02		/* exit status is checked; ignore -e flag */
 #define EV_BACKCMD 04		/* command executing within back quotes */
+#if TARGET_OS_IPHONE
+#define EV_BACKGND 010		/* start the command where evalspawn() says */
+#endif
 
 void evalstring(const char *, int);
 union node;	/* BLETCH for ansi C */
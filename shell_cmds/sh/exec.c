@@ -74,6 +74,10 @@ __FBSDID("$FreeBSD: head/bin/sh/exec.c 296813 2016-03-13 22:54:14Z jilles $");
 #include "show.h"
 #include "jobs.h"
 #include "alias.h"
+#if TARGET_OS_IPHONE
+#include "trap.h"
+#include "ios_error.h"
+#endif
 
 #ifdef __APPLE__
 #define eaccess(path, mode) faccessat(AT_FDCWD, path, mode, AT_EACCESS)
@@ -97,7 +101,9 @@ static int cmdtable_cd = 0;	/* cmdtable contains cd-dependent entries */
 int exerrno = 0;			/* Last exec error */
 
 
+#if !TARGET_OS_IPHONE
 static void tryexec(char *, char **, char **);
+#endif
 static void printentry(struct tblentry *, int);
 static struct tblentry *cmdlookup(const char *, int);
 static void delete_cmd_entry(void);
@@ -105,6 +111,20 @@ static void addcmdentry(const char *, struct cmdentry *);
 
 
 
+#if TARGET_OS_IPHONE
+/*
+ * Exec a program.  Never returns.  There is no exec on iOS: the command
+ * runs, then the shell exits with its status.  "not found" comes from
+ * ios_system().
+ */
+
+void
+shellexec(char **argv, char **envp, const char *path __unused,
+    int idx __unused)
+{
+	exitshell(spawncmd(argv, envp));
+}
+#else
 /*
  * Exec a program.  Never returns.  If you change this routine, you may
  * have to change the find_command routine as well.
@@ -172,6 +192,7 @@ tryexec(char *cmd, char **argv, char **envp)
 	}
 	errno = e;
 }
+#endif
 
 /*
  * Do a path search.  The variable path (passed by reference) should be
@@ -240,6 +261,9 @@ hashcmd(int argc __unused, char **argv __unused)
 	while ((c = nextopt("rv")) != '\0') {
 		if (c == 'r') {
 			clearcmdentry();
+#if TARGET_OS_IPHONE
+			ios_hashReset();
+#endif
 		} else if (c == 'v') {
 			verbose++;
 		}
@@ -283,7 +307,10 @@ printentry(struct tblentry *cmdp, int verbose)
 	const char *path;
 	char *name;
 
-	if (cmdp->cmdtype == CMDNORMAL) {
+	if (cmdp->cmdtype == CMDNORMAL && cmdp->param.index < 0) {
+		/* A command of ios_system */
+		out1str(cmdp->cmdname);
+	} else if (cmdp->cmdtype == CMDNORMAL) {
 		idx = cmdp->param.index;
 		path = pathval();
 		do {
@@ -362,6 +389,21 @@ find_command(const char *name, struct cmdentry *entry, int act,
 		goto success;
 	}
 
+#if TARGET_OS_IPHONE
+	/* Then for the commands that ios_system knows */
+	if (ios_executable(name)) {
+		INTOFF;
+		cmdp = cmdlookup(name, 1);
+		if (cmdp->cmdtype == CMDFUNCTION)
+			cmdp = &loc_cmd;
+		cmdp->cmdtype = CMDNORMAL;
+		cmdp->param.index = -1;
+		cmdp->special = 0;
+		INTON;
+		goto success;
+	}
+#endif
+
 	/* We have to search path. */
 
 	e = ENOENT;
@@ -516,6 +558,33 @@ clearcmdentry(void)
 }
 
 
+#if TARGET_OS_IPHONE
+/*
+ * Forget all the commands, and the functions, when the shell is done.
+ */
+
+void
+freecmdtable(void)
+{
+	struct tblentry **tblp;
+	struct tblentry *cmdp, *next;
+
+	INTOFF;
+	for (tblp = cmdtable ; tblp < &cmdtable[CMDTABLESIZE] ; tblp++) {
+		for (cmdp = *tblp ; cmdp != NULL ; cmdp = next) {
+			next = cmdp->next;
+			if (cmdp->cmdtype == CMDFUNCTION)
+				unreffunc(cmdp->param.func);
+			ckfree(cmdp);
+		}
+		*tblp = NULL;
+	}
+	cmdtable_cd = 0;
+	INTON;
+}
+#endif
+
+
 /*
  * Locate a command in the command hash table.  If "add" is nonzero,
  * add the command to the table if it is not already present.  The
@@ -709,6 +778,13 @@ typecmd_impl(int argc, char **argv, int cmd, const char *path)
 				const char *path2 = path;
 				char *name;
 				int j = entry.u.index;
+#if TARGET_OS_IPHONE
+				/* A command of the app, not a file in $PATH */
+				if (j < 0) {
+					name = argv[i];
+					cmdp = NULL;
+				} else
+#endif
 				do {
 					name = padvance(&path2, argv[i]);
 					stunalloc(name);
@@ -75,3 +75,6 @@ int unsetfunc(const char *);
 int isfunc(const char *);
 int typecmd_impl(int, char **, int, const char *);
 void clearcmdentry(void);
+#if TARGET_OS_IPHONE
+void freecmdtable(void);
+#endif
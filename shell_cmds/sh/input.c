@@ -59,7 +59,9 @@ __FBSDID("$FreeBSD: head/bin/sh/input.c 295937 2016-02-23 22:44:01Z jilles $");
 #include "error.h"
 #include "alias.h"
 #include "parser.h"
+#ifndef NO_HISTORY
 #include "myhistedit.h"
+#endif
 #include "trap.h"
 
 #define EOF_NLEFT -99		/* value of parsenleft when EOF pushed back */
@@ -87,6 +89,9 @@ struct parsefile {
 	char *buf;		/* input buffer */
 	struct strpush *strpush; /* for pushing strings at this level */
 	struct strpush basestrpush; /* so pushing one is fast */
+#if TARGET_OS_IPHONE
+	int hadnul;		/* nul characters were deleted from the input */
+#endif
 };
 
 
@@ -178,17 +183,27 @@ retry:
 		}
 	} else
 #endif
+#if TARGET_OS_IPHONE
+		nr = read(parsefile->fd == 0 ? shellfd(0) : parsefile->fd,
+		    parsefile->buf, BUFSIZ);
+#else
 		nr = read(parsefile->fd, parsefile->buf, BUFSIZ);
+#endif
 
 	if (nr <= 0) {
                 if (nr < 0) {
                         if (errno == EINTR)
                                 goto retry;
                         if (parsefile->fd == 0 && errno == EWOULDBLOCK) {
-                                int flags = fcntl(0, F_GETFL, 0);
+#if TARGET_OS_IPHONE
+                                int fd0 = shellfd(0);
+#else
+                                int fd0 = 0;
+#endif
+                                int flags = fcntl(fd0, F_GETFL, 0);
                                 if (flags >= 0 && flags & O_NONBLOCK) {
                                         flags &=~ O_NONBLOCK;
-                                        if (fcntl(0, F_SETFL, flags) >= 0) {
+                                        if (fcntl(fd0, F_SETFL, flags) >= 0) {
 						out2fmt_flush("sh: turning off NDELAY mode\n");
                                                 goto retry;
                                         }
@@ -250,6 +265,9 @@ again:
 				*r++ = *q;
 		}
 		parselleft -= end - r;
+#if TARGET_OS_IPHONE
+		parsefile->hadnul = 1;
+#endif
 		if (parselleft == 0)
 			goto again;
 		end = p + parselleft;
@@ -414,9 +432,66 @@ setinputfd(int fd, int push)
 		parsefile->buf = ckmalloc(BUFSIZ + 1);
 	parselleft = parsenleft = 0;
 	plinno = 1;
+#if TARGET_OS_IPHONE
+	parsefile->hadnul = 0;
+#endif
+}
+
+
+#if TARGET_OS_IPHONE
+/*
+ * Return the descriptor of the file the shell reads.
+ */
+
+int
+inputfd(void)
+{
+	return parsefile->fd;
+}
+
+
+/*
+ * Return how far the parser has got in the file set by setinputfile(), or
+ * -1 if the input is not such a file or the offset cannot be told.
+ */
+
+off_t
+inputoffset(void)
+{
+	off_t off;
+	int left;
+
+	if (parsefile->fd < 10 || parsefile->strpush != NULL ||
+	    parsefile->hadnul)
+		return -1;
+	if ((off = lseek(parsefile->fd, 0, SEEK_CUR)) == -1)
+		return -1;
+	left = 0;
+	if (parsenleft > 0)
+		left += parsenleft;
+	if (parselleft > 0)
+		left += parselleft;
+	return off - left;
 }
 
 
+/*
+ * Go on reading the file at an offset returned by inputoffset(), with the
+ * given line number.
+ */
+
+void
+seekinput(off_t off, int linno)
+{
+	if (lseek(parsefile->fd, off, SEEK_SET) == -1)
+		error("cannot seek: %s", strerror(errno));
+	parsenextc = parsefile->buf;
+	parselleft = parsenleft = 0;
+	plinno = linno;
+}
+#endif
+
+
 /*
  * Like setinputfile, but takes input from a string.
  */
@@ -56,6 +56,11 @@ void pushstring(const char *, int, struct alias *);
 void setinputfile(const char *, int);
 void setinputfd(int, int);
 void setinputstring(const char *, int);
+#if TARGET_OS_IPHONE
+int inputfd(void);
+off_t inputoffset(void);
+void seekinput(off_t, int);
+#endif
 void popfile(void);
 struct parsefile *getcurrentfile(void);
 void popfilesupto(struct parsefile *);
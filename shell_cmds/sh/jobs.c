@@ -73,6 +73,12 @@ __FBSDID("$FreeBSD: head/bin/sh/jobs.c 296326 2016-03-02 21:24:46Z jilles $");
 #include "mystring.h"
 #include "var.h"
 #include "builtins.h"
+#if TARGET_OS_IPHONE
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include "ios_error.h"
+#endif
 
 
 static struct job *jobtab;	/* array of jobs */
@@ -85,6 +91,37 @@ static pid_t initialpgrp;	/* pgrp of shell on invocation */
 #endif
 static int ttyfd = -1;
 
+#if TARGET_OS_IPHONE
+/*
+ * There are no child processes to wait3() for: the commands run on
+ * threads started by ios_spawnv_async(), whose completion queues their
+ * exit status here.  The queue outlives the shell if some of them are
+ * still running when it exits.
+ */
+struct spawnqueue;
+
+struct spawned {
+	struct spawned *next;
+	pid_t pid;
+	int status;		/* exit code */
+	int done;
+	FILE *fp[3];		/* opened for the command, closed once done */
+	struct spawnqueue *queue;
+};
+
+struct spawnqueue {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct spawned *list;
+	int refs;		/* the shell, and each command not done */
+};
+
+static struct spawnqueue *spawnq;
+
+static void updatejob(struct job *);
+static pid_t waitspawned(int, int *);
+#endif
+
 /* mode flags for dowait */
 #define DOWAIT_BLOCK	0x1 /* wait until a child exits */
 #define DOWAIT_SIG	0x2 /* if DOWAIT_BLOCK, abort on signal */
@@ -675,12 +712,16 @@ killjob(const char *name, int sig)
 	jp = getjob(name);
 	if (jp->state == JOBDONE)
 		return 0;
+#if JOBS
 	if (jp->jobctl)
 		return kill(-jp->ps[0].pid, sig);
+#endif
 	ret = -1;
 	errno = ESRCH;
 	for (i = 0; i < jp->nprocs; i++)
-		if (jp->ps[i].status == -1 || WIFSTOPPED(jp->ps[i].status)) {
+		if (jp->ps[i].pid == -1)
+			continue;	/* ran in the shell */
+		else if (jp->ps[i].status == -1 || WIFSTOPPED(jp->ps[i].status)) {
 			if (kill(jp->ps[i].pid, sig) == 0)
 				ret = 0;
 		} else
@@ -752,6 +793,18 @@ makejob(union node *node __unused, int nprocs)
 	} else {
 		jp->ps = &jp->ps0;
 	}
+#if TARGET_OS_IPHONE
+	/*
+	 * The commands of a pipeline do not start in order: each one has its
+	 * place from the start, and the job is not done until all are filled.
+	 */
+	for (i = 0; i < nprocs; i++) {
+		jp->ps[i].pid = -1;
+		jp->ps[i].status = -1;
+		jp->ps[i].cmd = nullstr;
+	}
+	jp->nprocs = nprocs;
+#endif
 	INTON;
 	TRACE(("makejob(%p, %d) returns %%%td\n", (void *)node, nprocs,
 	    jp - jobtab + 1));
@@ -818,6 +871,245 @@ getcurjob(struct job *nj)
 
 #endif
 
+#if TARGET_OS_IPHONE
+/*
+ * Start the command argv on a thread of its own, with the shell's
+ * descriptors 0, 1 and 2, as the process idx of the job jp (which may be
+ * NULL).  N is the command, for the jobs builtin.  The mode is FORK_FG,
+ * FORK_BG or FORK_NOJOB, as for forkshell() elsewhere: a background
+ * command has its standard input redirected to /dev/null, unless it is
+ * not the first of a pipeline or it has been redirected.
+ */
+
+static void
+spawndone(void *info, pid_t pid, int status)
+{
+	struct spawned *sp = info;
+	struct spawnqueue *q = sp->queue;
+	struct spawned *next;
+	int i, last;
+
+	for (i = 0; i < 3; i++)
+		if (sp->fp[i] != NULL)
+			fclose(sp->fp[i]);
+	pthread_mutex_lock(&q->mtx);
+	if (pid > 0)
+		sp->pid = pid;
+	sp->status = status;
+	sp->done = 1;
+	last = --q->refs == 0;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->mtx);
+	if (last) {
+		/* The shell has exited */
+		for (sp = q->list; sp != NULL; sp = next) {
+			next = sp->next;
+			free(sp);
+		}
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->mtx);
+		free(q);
+	}
+}
+
+pid_t
+spawnjob(struct job *jp, int idx, union node *n, char **argv, char **envp,
+    int mode)
+{
+	struct spawnqueue *q;
+	struct spawned *sp;
+	FILE *fp[3];
+	pid_t pid;
+	int fresh, i;
+
+	TRACE(("spawnjob(%%%td, %d, %s, %d) called\n", jp - jobtab, idx,
+	    argv[0], mode));
+	INTOFF;
+	if (mode == FORK_BG && idx == 0)
+		checkzombies();
+	if ((q = spawnq) == NULL) {
+		q = ckmalloc(sizeof(*q));
+		pthread_mutex_init(&q->mtx, NULL);
+		pthread_cond_init(&q->cond, NULL);
+		q->list = NULL;
+		q->refs = 1;
+		spawnq = q;
+	}
+	sp = ckmalloc(sizeof(*sp));
+	sp->pid = -1;
+	sp->status = -1;
+	sp->done = 0;
+	sp->queue = q;
+	for (i = 0; i < 3; i++) {
+		if (i == 0 && mode == FORK_BG && idx == 0 &&
+		    ! fd0_redirected_p ()) {
+			fp[i] = fopen(_PATH_DEVNULL, "r");
+			fresh = 1;
+		} else
+			fp[i] = shellstream(i, &fresh);
+		sp->fp[i] = fresh ? fp[i] : NULL;
+	}
+	flushall();
+	pthread_mutex_lock(&q->mtx);
+	sp->next = q->list;
+	q->list = sp;
+	q->refs++;
+	pthread_mutex_unlock(&q->mtx);
+	/* spawndone() is called in any case, and closes the streams */
+	pid = ios_spawnv_async(argv[0], argv, envp, fp[0], fp[1], fp[2],
+	    sp, spawndone);
+	pthread_mutex_lock(&q->mtx);
+	if (pid > 0)
+		sp->pid = pid;
+	else
+		sp->pid = pid = -2;	/* never matches a process */
+	pthread_mutex_unlock(&q->mtx);
+	if (mode == FORK_BG) {
+		if (bgjob != NULL && bgjob->state == JOBDONE &&
+		    !bgjob->remembered && !iflag)
+			freejob(bgjob);
+		backgndpid = pid;		/* set $! */
+		bgjob = jp;
+	}
+	if (jp) {
+		struct procstat *ps = &jp->ps[idx];
+		ps->pid = pid;
+		ps->status = pid > 0 ? -1 : W_EXITCODE(126, 0);
+		if (iflag && rootshell && n)
+			ps->cmd = commandtext(n);
+		jp->foreground = mode == FORK_FG;
+		updatejob(jp);
+	}
+	INTON;
+	TRACE(("spawnjob: command %d\n", (int)pid));
+	return pid;
+}
+
+
+/*
+ * Run the command argv in the foreground, on the shell's descriptors 0, 1
+ * and 2, and return its exit status.  ios_spawnv() closes the streams it
+ * is given for the output when the command ends, but not the input.
+ */
+
+int
+spawncmd(char **argv, char **envp)
+{
+	FILE *in, *out, *err;
+	int fresh;
+	pid_t pid;
+	int status;
+
+	TRACE(("spawncmd(%s) called\n", argv[0]));
+	INTOFF;
+	out = shellstream(1, &fresh);
+	err = shellstream(2, &fresh);
+	in = shellstream(0, &fresh);
+	flushall();
+	pid = ios_fork();
+	ios_spawnv(argv[0], argv, envp, in, out, err);
+	ios_waitpid(pid);
+	status = ios_getCommandStatus();
+	if (fresh && in != NULL)
+		fclose(in);
+	INTON;
+	TRACE(("spawncmd: exit status %d\n", status));
+	return (status & 0xff);
+}
+
+
+/*
+ * The exit status of the process idx of the job jp, which ran in the
+ * shell.
+ */
+
+void
+setjobstatus(struct job *jp, int idx, int status)
+{
+	struct procstat *ps = &jp->ps[idx];
+
+	ps->pid = -1;
+	ps->status = W_EXITCODE(status & 0xff, 0);
+	updatejob(jp);
+}
+
+
+/*
+ * A job is done once all its processes have their status.
+ */
+
+static void
+updatejob(struct job *jp)
+{
+	int i;
+
+	for (i = 0; i < jp->nprocs; i++)
+		if (jp->ps[i].status == -1)
+			return;
+	jp->state = JOBDONE;
+}
+
+
+/*
+ * Jobs move when the table grows: their index is what stays.
+ */
+
+int
+jobindex(struct job *jp)
+{
+	return (jp - jobtab);
+}
+
+struct job *
+jobfromindex(int idx)
+{
+	return (&jobtab[idx]);
+}
+
+
+/*
+ * Forget all the jobs, when the shell exits.  The commands still running
+ * are left alone.
+ */
+
+void
+freejobs(void)
+{
+	struct spawnqueue *q = spawnq;
+	struct spawned *sp, **spp;
+	int i, last;
+
+	INTOFF;
+	for (i = 0; i < njobs; i++)
+		if (jobtab[i].used)
+			freejob(&jobtab[i]);
+	if (jobtab != NULL)
+		ckfree(jobtab);
+	jobtab = NULL;
+	njobs = 0;
+	backgndpid = -1;
+	bgjob = NULL;
+	spawnq = NULL;
+	INTON;
+	if (q == NULL)
+		return;
+	pthread_mutex_lock(&q->mtx);
+	for (spp = &q->list; (sp = *spp) != NULL; ) {
+		if (sp->done) {
+			*spp = sp->next;
+			free(sp);
+		} else
+			spp = &sp->next;
+	}
+	last = --q->refs == 0;
+	pthread_mutex_unlock(&q->mtx);
+	if (last) {
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->mtx);
+		free(q);
+	}
+}
+#else
 /*
  * Fork of a subshell.  If we are doing job control, give the subshell its
  * own process group.  Jp is a job structure that the job is to be added to.
@@ -994,6 +1286,7 @@ vforkexecshell(struct job *jp, char **argv, char **envp, const char *path, int i
 	TRACE(("In parent shell:  child = %d\n", (int)pid));
 	return pid;
 }
+#endif
 
 
 /*
@@ -1066,10 +1359,81 @@ waitforjob(struct job *jp, int *origstatus)
 }
 
 
+#if TARGET_OS_IPHONE
+/*
+ * Take the first command that is done off the queue, and return its pid
+ * with its status in *status.  Without DOWAIT_BLOCK, 0 if none is done.
+ * -1 with ECHILD if no command is running, or with EINTR if the shell
+ * has been interrupted: the commands are then interrupted too.
+ */
+
+static pid_t
+waitspawned(int mode, int *status)
+{
+	struct spawnqueue *q = spawnq;
+	struct spawned *sp, **spp;
+	struct timespec ts;
+	pid_t pid;
+
+	if (q == NULL) {
+		errno = ECHILD;
+		return -1;
+	}
+	pthread_mutex_lock(&q->mtx);
+	for (;;) {
+		for (spp = &q->list; (sp = *spp) != NULL; spp = &sp->next)
+			if (sp->done)
+				break;
+		if (sp != NULL) {
+			*spp = sp->next;
+			pid = sp->pid;
+			/* An interrupted command, as if killed by SIGINT */
+			if ((sp->status & 0xff) == 128 + SIGINT)
+				*status = W_EXITCODE(0, SIGINT);
+			else
+				*status = W_EXITCODE(sp->status & 0xff, 0);
+			free(sp);
+			if (pid < 0)
+				continue;	/* did not start */
+			break;
+		}
+		if (q->refs == 1) {
+			pid = -1;
+			errno = ECHILD;
+			break;
+		}
+		if ((mode & DOWAIT_BLOCK) == 0) {
+			pid = 0;
+			break;
+		}
+		if (intrequested()) {
+			for (sp = q->list; sp != NULL; sp = sp->next)
+				if (sp->pid > 0 && !sp->done)
+					ios_interrupt(sp->pid);
+			pthread_mutex_unlock(&q->mtx);
+			if (mode & DOWAIT_SIG)
+				pendingsig_waitcmd = SIGINT;
+			checkintr();
+			errno = EINTR;
+			return -1;
+		}
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100 * 1000 * 1000;
+		if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000 * 1000 * 1000;
+		}
+		pthread_cond_timedwait(&q->cond, &q->mtx, &ts);
+	}
+	pthread_mutex_unlock(&q->mtx);
+	return pid;
+}
+#else
 static void
 dummy_handler(int sig __unused)
 {
 }
+#endif
 
 /*
  * Wait for a process to terminate.
@@ -1078,8 +1442,12 @@ dummy_handler(int sig __unused)
 static pid_t
 dowait(int mode, struct job *job)
 {
+#if !TARGET_OS_IPHONE
 	struct sigaction sa, osa;
 	sigset_t mask, omask;
+	int wflags;
+	int restore_sigchld;
+#endif
 	pid_t pid;
 	int status;
 	struct procstat *sp;
@@ -1090,10 +1458,14 @@ dowait(int mode, struct job *job)
 	int stopped;
 	int sig;
 	int coredump;
-	int wflags;
-	int restore_sigchld;
 
 	TRACE(("dowait(%d, %p) called\n", mode, job));
+#if TARGET_OS_IPHONE
+	pid = waitspawned(mode, &status);
+	TRACE(("wait returns %d, status=%d\n", (int)pid, status));
+	if (pid == -1 && errno == ECHILD && job != NULL)
+		job->state = JOBDONE;
+#else
 	restore_sigchld = 0;
 	if ((mode & DOWAIT_SIG) != 0) {
 		sigfillset(&mask);
@@ -1138,6 +1510,7 @@ dowait(int mode, struct job *job)
 		sigprocmask(SIG_SETMASK, &omask, NULL);
 		INTON;
 	}
+#endif
 	if (pid <= 0)
 		return pid;
 	INTOFF;
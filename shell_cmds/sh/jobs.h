@@ -87,8 +87,17 @@ extern int job_warning;		/* user was warned about stopped jobs */
 void setjobctl(int);
 void showjobs(int, int);
 struct job *makejob(union node *, int);
+#if TARGET_OS_IPHONE
+pid_t spawnjob(struct job *, int, union node *, char **, char **, int);
+int spawncmd(char **, char **);
+void setjobstatus(struct job *, int, int);
+int jobindex(struct job *);
+struct job *jobfromindex(int);
+void freejobs(void);
+#else
 pid_t forkshell(struct job *, union node *, int);
 pid_t vforkexecshell(struct job *, char **, char **, const char *, int, int []);
+#endif
 int waitforjob(struct job *, int *);
 int stoppedjobs(void);
 int backgndpidset(void);
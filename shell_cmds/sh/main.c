@@ -73,6 +73,10 @@ __FBSDID("$FreeBSD: head/bin/sh/main.c 265772 2014-05-09 13:27:30Z jilles $");
 #include "cd.h"
 #include "redir.h"
 #include "builtins.h"
+#if TARGET_OS_IPHONE
+#include <pthread.h>
+#include "alias.h"
+#endif
 
 int rootpid;
 int rootshell;
@@ -83,6 +87,24 @@ static void reset(void);
 static void cmdloop(int);
 static void read_profile(const char *);
 static char *find_dot_file(char *);
+#if TARGET_OS_IPHONE
+static void freeshell(void);
+static void leaveshell(void *);
+struct script;
+static struct script *findscript(void);
+static void releasescript(struct script *, int);
+static void resetscripts(void);
+static union node *nextcmd(struct script *, volatile int *, int);
+
+/*
+ * The state of the shell is global, and one shell runs at a time.  An sh
+ * started while it runs, by one of its commands or by another session,
+ * splits its command line as ios_system() always did.
+ */
+static pthread_mutex_t shell_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+int sh_split_main(int, char **);
+#endif
 
 /*
  * Main routine.  We initialize things, parse the arguments, execute
@@ -92,6 +114,352 @@ static char *find_dot_file(char *);
  * is used to figure out how far we had gotten.
  */
 
+#if TARGET_OS_IPHONE
+/*
+ * On iOS, sh_main() is run by ios_system() in a thread of the app, and
+ * returns the exit status instead of exiting: exitshell() raises EXEXIT,
+ * caught here.
+ */
+
+int
+sh_main(int argc, char *argv[])
+{
+	struct stackmark smark, smark2;
+	volatile int state;
+	char *shinit;
+	int status;
+
+	if (pthread_mutex_trylock(&shell_mtx) != 0)
+		return sh_split_main(argc, argv);
+	pthread_cleanup_push(leaveshell, argv);
+	initredir();
+	initcharset();
+	setstackmark(&smark);
+	state = 0;
+	if (setjmp(main_handler.loc)) {
+		switch (exception) {
+		case EXEXEC:
+			exitstatus = exerrno;
+			break;
+
+		case EXERROR:
+			exitstatus = 2;
+			break;
+
+		case EXINT:
+			exitstatus = SIGINT + 128;
+			break;
+
+		default:
+			break;
+		}
+
+		if (state == 0 || iflag == 0 || ! rootshell ||
+		    exception == EXEXIT)
+			goto out;
+		reset();
+		if (exception == EXINT)
+			out2fmt_flush("\n");
+		popstackmark(&smark);
+		FORCEINTON;				/* enable interrupts */
+		if (state == 1)
+			goto state1;
+		else if (state == 2)
+			goto state2;
+		else if (state == 3)
+			goto state3;
+		else
+			goto state4;
+	}
+	handler = &main_handler;
+#ifdef DEBUG
+	opentrace();
+	trputs("Shell args:  ");  trargs(argv);
+#endif
+	rootpid = getpid();
+	rootshell = 1;
+	INTOFF;
+	initvar();
+	setstackmark(&smark2);
+	procargs(argc, argv);
+	pwd_init(iflag);
+	INTON;
+	if (iflag)
+		chkmail(1);
+	if (argv[0] && argv[0][0] == '-') {
+		state = 1;
+		read_profile("/etc/profile");
+state1:
+		state = 2;
+		if (privileged == 0)
+			read_profile("${HOME-}/.profile");
+		else
+			read_profile("/etc/suid_profile");
+	}
+state2:
+	state = 3;
+	if (!privileged && iflag) {
+		if ((shinit = lookupvar("ENV")) != NULL && *shinit != '\0') {
+			state = 3;
+			read_profile(shinit);
+		}
+	}
+state3:
+	state = 4;
+	popstackmark(&smark2);
+	if (minusc) {
+		evalstring(minusc, sflag ? 0 : EV_EXIT);
+	}
+state4:
+	if (sflag || minusc == NULL) {
+		cmdloop(1);
+	}
+	exitshell(exitstatus);
+out:
+	status = runexittrap(exitstatus);
+	handler = NULL;
+	popstackmark(&smark);
+	pthread_cleanup_pop(1);
+	return status;
+}
+
+/*
+ * Forget everything the shell did, so that the next one starts afresh.
+ */
+
+static void
+freeshell(void)
+{
+	suppressint = 1;	/* whatever the shell was doing */
+	freejobs();
+	freeredir();
+	closescript();
+	resetinput();
+	rmaliases();
+	freecmdtable();
+	freevars();
+	freetraps();
+	freecwd();
+	resetscripts();
+	freeparam(&shellparam);
+	memset(&shellparam, 0, sizeof(shellparam));
+	arg0 = minusc = NULL;
+	reseteval();
+	funcnest = 0;
+	exitstatus = oexitstatus = 0;
+	intpending = 0;
+	suppressint = 0;
+}
+
+/*
+ * When the shell returns, and also when its thread is ended by ios_exit().
+ */
+
+static void
+leaveshell(void *arg)
+{
+	char **argv = arg;
+
+	freeshell();
+	/* Not "sh" any more, for the clean-up of ios_system() */
+	if (argv[0] != NULL)
+		argv[0][0] = 'h';
+	pthread_mutex_unlock(&shell_mtx);
+}
+
+/*
+ * The commands parsed from a script run by name are kept, so that running
+ * it again does not read and parse it again.  A script is told by its file
+ * and checked against its size and modification time.  Its commands are
+ * kept as far as they were parsed; the shell goes on reading the file from
+ * where they stop, or from where an alias or -v could make the parse come
+ * out differently.  The cache outlives the shell, and is only used by the
+ * one holding shell_mtx.
+ */
+
+#define	NSCRIPTS	8		/* Scripts kept */
+#define	MAXSCRIPT	(256 * 1024)	/* Larger scripts are not kept */
+
+struct scriptcmd {
+	struct funcdef *fn;		/* The command */
+	off_t end;			/* Where it ends in the file */
+	int linno;			/* Line number there */
+};
+
+struct script {
+	struct script *next;		/* Most recently used first */
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct scriptcmd *cmds;
+	int ncmds;
+	int maxcmds;
+	off_t end;			/* How far the file was parsed */
+	int linno;
+	int complete;			/* Parsed up to its end */
+	int busy;			/* Command loops running it */
+	int recording;			/* One of them parses the rest */
+};
+
+static struct script *scripts;
+
+static void
+freescript(struct script *sp)
+{
+	int i;
+
+	for (i = 0; i < sp->ncmds; i++)
+		unreffunc(sp->cmds[i].fn);
+	ckfree(sp->cmds);
+	ckfree(sp);
+}
+
+/*
+ * Return the script for the file cmdloop() is about to read, creating it
+ * if need be, or NULL if the input is not to be cached.
+ */
+
+static struct script *
+findscript(void)
+{
+	struct script *sp, **spp, **lastp;
+	struct stat st;
+	int n;
+
+	if (inputoffset() != 0 || fstat(inputfd(), &st) == -1 ||
+	    !S_ISREG(st.st_mode) || st.st_size > MAXSCRIPT)
+		return NULL;
+	INTOFF;
+	n = 0;
+	lastp = NULL;
+	for (spp = &scripts; (sp = *spp) != NULL; ) {
+		if (sp->dev == st.st_dev && sp->ino == st.st_ino) {
+			if (sp->size == st.st_size &&
+			    sp->mtime.tv_sec == st.st_mtimespec.tv_sec &&
+			    sp->mtime.tv_nsec == st.st_mtimespec.tv_nsec)
+				break;
+			if (sp->busy) {
+				INTON;
+				return NULL;
+			}
+			*spp = sp->next;
+			freescript(sp);
+			continue;
+		}
+		if (sp->busy == 0)
+			lastp = spp;
+		n++;
+		spp = &sp->next;
+	}
+	if (sp != NULL)
+		*spp = sp->next;
+	else {
+		if (n >= NSCRIPTS && lastp != NULL) {
+			sp = *lastp;
+			*lastp = sp->next;
+			freescript(sp);
+		}
+		sp = ckmalloc(sizeof(*sp));
+		memset(sp, 0, sizeof(*sp));
+		sp->dev = st.st_dev;
+		sp->ino = st.st_ino;
+		sp->size = st.st_size;
+		sp->mtime = st.st_mtimespec;
+		sp->linno = 1;
+		sp->maxcmds = 16;
+		sp->cmds = ckmalloc(sp->maxcmds * sizeof(*sp->cmds));
+	}
+	sp->next = scripts;
+	scripts = sp;
+	sp->busy++;
+	INTON;
+	return sp;
+}
+
+static void
+releasescript(struct script *sp, int next)
+{
+	if (next == -2)
+		sp->recording = 0;
+	sp->busy--;
+}
+
+/*
+ * No command loop runs once the shell is left, whichever way it was.
+ */
+
+static void
+resetscripts(void)
+{
+	struct script *sp;
+
+	for (sp = scripts; sp != NULL; sp = sp->next)
+		sp->busy = sp->recording = 0;
+}
+
+/*
+ * Return the next command of a script, as cmdloop() would have parsed it.
+ * *next is the index of the next cached command to run, -2 once the shell
+ * parses the file and adds to the cache, and -1 once it just parses it.
+ */
+
+static union node *
+nextcmd(struct script *sp, volatile int *next, int inter)
+{
+	union node *n;
+	struct scriptcmd *cp;
+	off_t off;
+
+	if (sp == NULL || *next == -1)
+		return parsecmd(inter);
+	if (*next >= 0) {
+		if (!havealiases() && !vflag) {
+			if (*next < sp->ncmds)
+				return getfuncnode(sp->cmds[(*next)++].fn);
+			if (sp->complete)
+				return NEOF;
+		}
+		if (*next < sp->ncmds || sp->complete || sp->recording) {
+			if (*next == 0)
+				seekinput(0, 1);
+			else
+				seekinput(sp->cmds[*next - 1].end,
+				    sp->cmds[*next - 1].linno);
+			*next = -1;
+			return parsecmd(inter);
+		}
+		seekinput(sp->end, sp->linno);
+		sp->recording = 1;
+		*next = -2;
+	}
+	n = parsecmd(inter);
+	if (havealiases() || vflag || (off = inputoffset()) == -1) {
+		sp->recording = 0;
+		*next = -1;
+		return n;
+	}
+	if (n == NEOF)
+		sp->complete = 1;
+	else if (n != NULL) {
+		INTOFF;
+		if (sp->ncmds == sp->maxcmds) {
+			sp->maxcmds *= 2;
+			sp->cmds = ckrealloc(sp->cmds,
+			    sp->maxcmds * sizeof(*sp->cmds));
+		}
+		cp = &sp->cmds[sp->ncmds++];
+		cp->fn = copyfunc(n);
+		cp->end = off;
+		cp->linno = plinno;
+		INTON;
+	}
+	sp->end = off;
+	sp->linno = plinno;
+	return n;
+}
+
+#else
 int
 main(int argc, char *argv[])
 {
@@ -181,6 +549,7 @@ state4:
 	/*NOTREACHED*/
 	return 0;
 }
+#endif
 
 static void
 reset(void)
@@ -201,8 +570,27 @@ cmdloop(int top)
 	struct stackmark smark;
 	int inter;
 	int numeof = 0;
+#if TARGET_OS_IPHONE
+	struct jmploc jmploc;
+	struct jmploc *volatile savehandler;
+	struct script *volatile sp;
+	volatile int next;
+#endif
 
 	TRACE(("cmdloop(%d) called\n", top));
+#if TARGET_OS_IPHONE
+	sp = iflag && top ? NULL : findscript();
+	next = 0;
+	if (sp != NULL) {
+		savehandler = handler;
+		if (setjmp(jmploc.loc)) {
+			handler = savehandler;
+			releasescript(sp, next);
+			longjmp(handler->loc, 1);
+		}
+		handler = &jmploc;
+	}
+#endif
 	setstackmark(&smark);
 	for (;;) {
 		if (pendingsig)
@@ -214,7 +602,11 @@ cmdloop(int top)
 			chkmail(0);
 			flushout(&output);
 		}
+#if TARGET_OS_IPHONE
+		n = nextcmd(sp, &next, inter);
+#else
 		n = parsecmd(inter);
+#endif
 		/* showtree(n); DEBUG */
 		if (n == NEOF) {
 			if (!top || numeof >= 50)
@@ -239,6 +631,12 @@ cmdloop(int top)
 		}
 	}
 	popstackmark(&smark);
+#if TARGET_OS_IPHONE
+	if (sp != NULL) {
+		handler = savehandler;
+		releasescript(sp, next);
+	}
+#endif
 }
 
 
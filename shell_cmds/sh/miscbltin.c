@@ -61,6 +61,10 @@ __FBSDID("$FreeBSD: head/bin/sh/miscbltin.c 301452 2016-06-05 16:09:31Z jilles $
 #include "mystring.h"
 #include "syntax.h"
 #include "trap.h"
+#if TARGET_OS_IPHONE
+#include "redir.h"
+#define	isatty(fd)	shellisatty(fd)
+#endif
 
 #undef eflag
 
@@ -106,6 +110,11 @@ readcmd(int argc __unused, char **argv __unused)
 	fd_set ifds;
 	ssize_t nread;
 	int sig;
+#if TARGET_OS_IPHONE
+	int fd0 = shellfd(0);
+#else
+	int fd0 = STDIN_FILENO;
+#endif
 
 	rflag = 0;
 	prompt = NULL;
@@ -155,8 +164,9 @@ readcmd(int argc __unused, char **argv __unused)
 		 * Wait for something to become available.
 		 */
 		FD_ZERO(&ifds);
-		FD_SET(0, &ifds);
-		status = select(1, &ifds, NULL, NULL, &tv);
+		if (fd0 >= 0)
+			FD_SET(fd0, &ifds);
+		status = select(fd0 + 1, &ifds, NULL, NULL, &tv);
 		/*
 		 * If there's nothing ready, return an error.
 		 */
@@ -172,7 +182,7 @@ readcmd(int argc __unused, char **argv __unused)
 	STARTSTACKSTR(p);
 	lastnonifs = lastnonifsws = -1;
 	for (;;) {
-		nread = read(STDIN_FILENO, &c, 1);
+		nread = read(fd0, &c, 1);
 		if (nread == -1) {
 			if (errno == EINTR) {
 				sig = pendingsig;
@@ -57,6 +57,10 @@ __FBSDID("$FreeBSD: head/bin/sh/options.c 296577 2016-03-09 21:00:57Z jilles $")
 #include "error.h"
 #include "mystring.h"
 #include "builtins.h"
+#if TARGET_OS_IPHONE
+#include "redir.h"
+#define	isatty(fd)	shellisatty(fd)
+#endif
 #ifndef NO_HISTORY
 #include "myhistedit.h"
 #endif
@@ -63,6 +63,11 @@ __FBSDID("$FreeBSD: head/bin/sh/output.c 275766 2014-12-14 16:26:19Z jilles $");
 #include "memalloc.h"
 #include "error.h"
 #include "var.h"
+#if TARGET_OS_IPHONE
+#include <signal.h>
+#include "redir.h"
+#include "trap.h"
+#endif
 
 
 #define OUTBUFSIZ BUFSIZ
@@ -245,8 +250,20 @@ flushout(struct output *dest)
 
 	if (dest->buf == NULL || dest->nextc == dest->buf || dest->fd < 0)
 		return;
+#if TARGET_OS_IPHONE
+	if (xwrite(shellfd(dest->fd), dest->buf, dest->nextc - dest->buf) < 0) {
+		dest->flags |= OUTPUT_ERR;
+		if (errno == EPIPE) {
+			/* There is no SIGPIPE to end the shell or subshell */
+			dest->nextc = dest->buf;
+			dest->nleft = dest->bufsize;
+			exitshell(128 + SIGPIPE);
+		}
+	}
+#else
 	if (xwrite(dest->fd, dest->buf, dest->nextc - dest->buf) < 0)
 		dest->flags |= OUTPUT_ERR;
+#endif
 	dest->nextc = dest->buf;
 	dest->nleft = dest->bufsize;
 }
@@ -60,6 +60,13 @@ __FBSDID("$FreeBSD: head/bin/sh/redir.c 295085 2016-01-30 21:21:25Z jilles $");
 #include "memalloc.h"
 #include "error.h"
 #include "options.h"
+#if TARGET_OS_IPHONE
+#include <limits.h>
+#include <paths.h>
+#include <stdio.h>
+#include "var.h"
+#include "ios_error.h"
+#endif
 
 
 #define EMPTY -2		/* marks an unused slot in redirtab */
@@ -86,6 +93,21 @@ static int fd0_redirected = 0;
 /* Number of redirtabs that have not been allocated. */
 static unsigned int empty_redirs = 0;
 
+#if TARGET_OS_IPHONE
+/*
+ * The descriptors 0 to 9 of the shell are not those of the process, which
+ * it shares with the app and the other commands.  shfd[] holds what each
+ * of them stands for: -1 if it is closed, 0, 1 or 2 for thread_stdin,
+ * thread_stdout and thread_stderr, which the shell borrows and never
+ * closes, or a descriptor of the process that belongs to the shell.
+ */
+static int shfd[10];
+
+static int dupshellfd(int);
+static void closeshellfd(int);
+static void setshellfd(int, int);
+#endif
+
 static void openredirect(union node *, char[10 ]);
 static int openhere(union node *);
 
@@ -140,6 +162,10 @@ redirect(union node *redir, int flags)
 			continue; /* redirect from/to same file descriptor */
 
 		if ((flags & REDIR_PUSH) && sv->renamed[fd] == EMPTY) {
+#if TARGET_OS_IPHONE
+			/* setshellfd() leaves it open for popredir() */
+			sv->renamed[fd] = shfd[fd];
+#else
 			INTOFF;
 			if ((i = fcntl(fd, F_DUPFD_CLOEXEC, 10)) == -1) {
 				switch (errno) {
@@ -154,6 +180,7 @@ redirect(union node *redir, int flags)
 			}
 			sv->renamed[fd] = i;
 			INTON;
+#endif
 		}
 		openredirect(n, memory);
 		INTON;
@@ -174,7 +201,9 @@ openredirect(union node *redir, char memory[10])
 	int fd = redir->nfile.fd;
 	const char *fname;
 	int f;
+#if !TARGET_OS_IPHONE
 	int e;
+#endif
 
 	memory[fd] = 0;
 	switch (redir->nfile.type) {
@@ -224,12 +253,23 @@ openredirect(union node *redir, char memory[10])
 			if (memory[redir->ndup.dupfd])
 				memory[fd] = 1;
 			else {
+#if TARGET_OS_IPHONE
+				if ((f = dupshellfd(redir->ndup.dupfd)) < 0)
+					error("%d: %s", redir->ndup.dupfd,
+							strerror(errno));
+				setshellfd(fd, f);
+#else
 				if (dup2(redir->ndup.dupfd, fd) < 0)
 					error("%d: %s", redir->ndup.dupfd,
 							strerror(errno));
+#endif
 			}
 		} else {
+#if TARGET_OS_IPHONE
+			setshellfd(fd, CLOSED);
+#else
 			close(fd);
+#endif
 		}
 		return;
 	case NHERE:
@@ -239,6 +279,9 @@ openredirect(union node *redir, char memory[10])
 	default:
 		abort();
 	}
+#if TARGET_OS_IPHONE
+	setshellfd(fd, f);
+#else
 	if (f != fd) {
 		if (dup2(f, fd) == -1) {
 			e = errno;
@@ -247,9 +290,47 @@ openredirect(union node *redir, char memory[10])
 		}
 		close(f);
 	}
+#endif
 }
 
 
+#if TARGET_OS_IPHONE
+/*
+ * Handle here documents.  There is no process to feed a pipe with them,
+ * so they go to a temporary file.
+ */
+
+static int
+openhere(union node *redir)
+{
+	const char *p;
+	size_t len;
+	ssize_t written;
+	int pip[2];
+
+	if (redir->type == NXHERE)
+		p = redir->nhere.expdoc;
+	else
+		p = redir->nhere.doc->narg.text;
+	len = strlen(p);
+	filepipe(pip);
+	while (len > 0) {
+		written = write(pip[1], p, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			close(pip[0]);
+			close(pip[1]);
+			error("cannot write here document: %s",
+			    strerror(errno));
+		}
+		p += written;
+		len -= written;
+	}
+	close(pip[1]);
+	return pip[0];
+}
+#else
 /*
  * Handle here documents.  Normally we fork off a process to write the
  * data to a pipe.  If the document is short, we can stuff the data in
@@ -299,6 +380,7 @@ out:
 	close(pip[1]);
 	return pip[0];
 }
+#endif
 
 
 
@@ -320,12 +402,16 @@ popredir(void)
 	}
 	for (i = 0 ; i < 10 ; i++) {
 		if (rp->renamed[i] != EMPTY) {
+#if TARGET_OS_IPHONE
+			setshellfd(i, rp->renamed[i]);
+#else
 			if (rp->renamed[i] >= 0) {
 				dup2(rp->renamed[i], i);
 				close(rp->renamed[i]);
 			} else {
 				close(i);
 			}
+#endif
 		}
 	}
 	fd0_redirected = rp->fd0_redirected;
@@ -354,10 +440,241 @@ clearredir(void)
 
 	for (rp = redirlist ; rp ; rp = rp->next) {
 		for (i = 0 ; i < 10 ; i++) {
+#if TARGET_OS_IPHONE
+			closeshellfd(rp->renamed[i]);
+#else
 			if (rp->renamed[i] >= 0) {
 				close(rp->renamed[i]);
 			}
+#endif
 			rp->renamed[i] = EMPTY;
 		}
 	}
 }
+
+
+#if TARGET_OS_IPHONE
+/*
+ * Start with the streams of the thread, before anything else is done.
+ */
+
+void
+initredir(void)
+{
+	int i;
+
+	for (i = 0 ; i < 10 ; i++)
+		shfd[i] = i < 3 ? i : CLOSED;
+	redirlist = NULL;
+	fd0_redirected = 0;
+	empty_redirs = 0;
+}
+
+
+/*
+ * Undo all the redirections, and close what the shell still has open.
+ */
+
+void
+freeredir(void)
+{
+	int i;
+
+	while (redirlist != NULL || empty_redirs > 0)
+		popredir();
+	for (i = 0 ; i < 10 ; i++)
+		setshellfd(i, i < 3 ? i : CLOSED);
+}
+
+
+/*
+ * Redirect the standard input and output to descriptors of the process
+ * (-1 to leave them as they are), for a subshell or a part of a pipeline.
+ * They belong to the shell from now on.  All the descriptors are saved,
+ * and given back by popredir(), so that what the commands do with them
+ * in the meantime does not last.
+ */
+
+void
+redirectio(int in, int out)
+{
+	struct redirtab *sv;
+	int i;
+
+	INTOFF;
+	sv = ckmalloc(sizeof (struct redirtab));
+	for (i = 0 ; i < 10 ; i++) {
+		sv->renamed[i] = shfd[i];
+		shfd[i] = shfd[i] >= 0 ? dupshellfd(i) : CLOSED;
+	}
+	sv->fd0_redirected = fd0_redirected;
+	sv->empty_redirs = empty_redirs;
+	sv->next = redirlist;
+	redirlist = sv;
+	empty_redirs = 0;
+	if (in >= 0) {
+		setshellfd(0, in);
+		fd0_redirected = 1;
+	}
+	if (out >= 0)
+		setshellfd(1, out);
+	INTON;
+}
+
+
+/*
+ * The descriptor of the process to read or write the shell's descriptor
+ * fd, -1 if it is closed.
+ */
+
+int
+shellfd(int fd)
+{
+	FILE *fp;
+
+	if (fd < 0 || fd >= 10)
+		return (fd);
+	switch (shfd[fd]) {
+	case 0:
+		fp = thread_stdin;
+		break;
+	case 1:
+		fp = thread_stdout;
+		break;
+	case 2:
+		fp = thread_stderr;
+		break;
+	default:
+		return (shfd[fd]);
+	}
+	return (fp != NULL ? fileno(fp) : -1);
+}
+
+
+/*
+ * isatty() for the descriptors of the shell: the streams of the thread
+ * are a terminal if they are those of the session.
+ */
+
+int
+shellisatty(int fd)
+{
+	if (fd < 0 || fd >= 10 || shfd[fd] < 0)
+		return (0);
+	if (shfd[fd] < 3)
+		return (ios_isatty(shfd[fd]));
+	return (isatty(shfd[fd]));
+}
+
+
+/*
+ * A stream for a command started by the shell, on the shell's descriptor
+ * fd.  *fresh is set if it has been opened for the command and must be
+ * closed after it: the streams of the thread are passed as they are, a
+ * closed descriptor becomes /dev/null.
+ */
+
+FILE *
+shellstream(int fd, int *fresh)
+{
+	const char *mode = fd == 0 ? "r" : "w";
+	FILE *fp;
+	int f;
+
+	switch (shfd[fd]) {
+	case 0:
+		*fresh = 0;
+		return (thread_stdin);
+	case 1:
+		*fresh = 0;
+		return (thread_stdout);
+	case 2:
+		*fresh = 0;
+		return (thread_stderr);
+	}
+	*fresh = 1;
+	fp = NULL;
+	if (shfd[fd] >= 0 && (f = dup(shfd[fd])) >= 0) {
+		if ((fp = fdopen(f, mode)) == NULL)
+			close(f);
+	}
+	if (fp == NULL)
+		fp = fopen(_PATH_DEVNULL, mode);
+	if (fp != NULL && fd != 0)
+		setvbuf(fp, NULL, fd == 2 ? _IONBF : _IOLBF, 0);
+	return (fp);
+}
+
+
+/*
+ * Like pipe(), but through a new file that is already removed, for what
+ * would go through a pipe between two processes of the shell: here
+ * documents, the output of subshells.  What is written to pip[1] can be
+ * read from pip[0] once the writer is done, from the start.
+ */
+
+void
+filepipe(int pip[2])
+{
+	char name[PATH_MAX];
+	const char *tmpdir;
+	int e;
+
+	tmpdir = lookupvar("TMPDIR");
+	if (tmpdir == NULL || *tmpdir == '\0')
+		tmpdir = _PATH_TMP;
+	snprintf(name, sizeof(name), "%s/sh.XXXXXXXXXX", tmpdir);
+	INTOFF;
+	if ((pip[1] = mkstemp(name)) < 0)
+		error("cannot create temporary file: %s", strerror(errno));
+	if ((pip[0] = open(name, O_RDONLY | O_CLOEXEC)) < 0) {
+		e = errno;
+		unlink(name);
+		close(pip[1]);
+		error("cannot open temporary file: %s", strerror(e));
+	}
+	unlink(name);
+	INTON;
+}
+
+
+/*
+ * A copy of the shell's descriptor fd, to put in another one.  The
+ * streams of the thread are shared.
+ */
+
+static int
+dupshellfd(int fd)
+{
+	if (fd < 0 || fd >= 10 || shfd[fd] < 0) {
+		errno = EBADF;
+		return (-1);
+	}
+	if (shfd[fd] < 3)
+		return (shfd[fd]);
+	return (fcntl(shfd[fd], F_DUPFD_CLOEXEC, 10));
+}
+
+
+static void
+closeshellfd(int f)
+{
+	if (f >= 3)
+		close(f);
+}
+
+
+/*
+ * Put f in the shell's descriptor fd.  What was there is closed, unless
+ * the last redirection has saved it.
+ */
+
+static void
+setshellfd(int fd, int f)
+{
+	if (shfd[fd] != f &&
+	    (redirlist == NULL || redirlist->renamed[fd] != shfd[fd]))
+		closeshellfd(shfd[fd]);
+	shfd[fd] = f;
+}
+#endif
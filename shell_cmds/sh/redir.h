@@ -42,4 +42,14 @@ void redirect(union node *, int);
 void popredir(void);
 int fd0_redirected_p(void);
 void clearredir(void);
+#if TARGET_OS_IPHONE
+#include <stdio.h>
+void initredir(void);
+void freeredir(void);
+void redirectio(int, int);
+int shellfd(int);
+int shellisatty(int);
+FILE *shellstream(int, int *);
+void filepipe(int [2]);
+#endif
 
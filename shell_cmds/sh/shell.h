@@ -49,7 +49,28 @@
  */
 
 
+#include <TargetConditionals.h>
+
+#if TARGET_OS_IPHONE
+/*
+ * On iOS the shell runs as a thread of the app, with the other commands:
+ * no fork, no process groups, no terminal of its own and no libedit.
+ * Commands are started with ios_spawnv(), subshells and pipelines are
+ * evaluated in the same thread.  The globals the shell shares a library
+ * with the other commands are renamed.
+ */
+#define	JOBS 0
+#define	NO_HISTORY
+#define	exitstatus	sh_exitstatus
+#define	commandname	sh_commandname
+#define	output		sh_output
+#define	error		sh_error
+#define	handler		sh_handler
+#define	exception	sh_exception
+#define	yylval		sh_yylval
+#else
 #define	JOBS 1
+#endif
 /* #define DEBUG 1 */
 
 /*
@@ -56,7 +56,12 @@ __FBSDID("$FreeBSD: head/bin/sh/trap.c 297360 2016-03-28 18:58:40Z jilles $");
 #include "trap.h"
 #include "mystring.h"
 #include "builtins.h"
+#ifndef NO_HISTORY
 #include "myhistedit.h"
+#endif
+#if TARGET_OS_IPHONE
+#include "ios_error.h"
+#endif
 
 #ifdef __APPLE__
 #define sys_nsig (NSIG)
@@ -75,7 +80,9 @@ __FBSDID("$FreeBSD: head/bin/sh/trap.c 297360 2016-03-28 18:58:40Z jilles $");
 #define S_RESET 5		/* temporary - to reset a hard ignored sig */
 
 
+#if !TARGET_OS_IPHONE
 static char sigmode[NSIG];	/* current value of signal */
+#endif
 volatile sig_atomic_t pendingsig;	/* indicates some signal received */
 volatile sig_atomic_t pendingsig_waitcmd;	/* indicates wait builtin should be interrupted */
 static int in_dotrap;			/* do we execute in a trap handler? */
@@ -87,8 +94,12 @@ static int last_trapsig;
 
 static int exiting;		/* exitshell() has been called */
 static int exiting_exitstatus;	/* value passed to exitshell() */
+#if TARGET_OS_IPHONE
+static int intseen;		/* the interruption has been acted upon */
+#else
 
 static int getsigaction(int, sig_t *);
+#endif
 
 
 /*
@@ -257,6 +268,14 @@ have_traps(void)
 void
 setsignal(int signo)
 {
+#if TARGET_OS_IPHONE
+	/*
+	 * The signal handlers belong to the app: the traps are only kept,
+	 * for the trap builtin and for checkintr().
+	 */
+	(void)signo;
+}
+#else
 	int action;
 	sig_t sigact = SIG_DFL;
 	struct sigaction sa;
@@ -334,8 +353,10 @@ setsignal(int signo)
 	sigemptyset(&sa.sa_mask);
 	sigaction(signo, &sa, NULL);
 }
+#endif
 
 
+#if !TARGET_OS_IPHONE
 /*
  * Return the current setting for sig w/o changing it.
  */
@@ -349,6 +370,7 @@ getsigaction(int signo, sig_t *sigact)
 	*sigact = (sig_t) sa.sa_handler;
 	return 1;
 }
+#endif
 
 
 /*
@@ -358,12 +380,16 @@ void
 ignoresig(int signo)
 {
 
+#if TARGET_OS_IPHONE
+	(void)signo;
+#else
 	if (sigmode[signo] == 0)
 		setsignal(signo);
 	if (sigmode[signo] != S_IGN && sigmode[signo] != S_HARD_IGN) {
 		signal(signo, SIG_IGN);
 		sigmode[signo] = S_IGN;
 	}
+#endif
 }
 
 
@@ -509,6 +535,152 @@ exitshell(int status)
 	exitshell_savedstatus();
 }
 
+#if TARGET_OS_IPHONE
+/*
+ * The shell is a thread of the app, and only the top of the shell, or of
+ * the subshell, can tell what is left to do: the exit is an exception.
+ * They catch it and call runexittrap().
+ */
+void
+exitshell_savedstatus(void)
+{
+
+	if (!exiting) {
+		if (in_dotrap && last_trapsig)
+			exiting_exitstatus = last_trapsig + 128;
+		else
+			exiting_exitstatus = oexitstatus;
+		exiting = 1;
+	}
+	exitstatus = oexitstatus = exiting_exitstatus;
+	exraise(EXEXIT);
+}
+
+
+/*
+ * Run the trap on EXIT and flush the output, for a shell or subshell
+ * exiting with status.  Return the status it exits with in the end, which
+ * the trap may change.
+ */
+int
+runexittrap(int status)
+{
+	struct jmploc loc1, loc2;
+	struct jmploc *savehandler;
+	char *p;
+
+	exiting = 1;
+	exiting_exitstatus = status;
+	exitstatus = oexitstatus = status;
+	savehandler = handler;
+	p = trap[0];
+	trap[0] = NULL;
+	if (!setjmp(loc1.loc)) {
+		handler = &loc1;
+		if (p != NULL && *p != '\0') {
+			/*
+			 * Reset evalskip, or the trap on EXIT could be
+			 * interrupted if the last command was a "return".
+			 */
+			evalskip = 0;
+			evalstring(p, 0);
+		}
+	}
+	if (!setjmp(loc2.loc)) {
+		handler = &loc2;
+		flushall();
+	}
+	handler = savehandler;
+	if (p != NULL)
+		ckfree(p);
+	return (exiting_exitstatus);
+}
+
+
+/*
+ * A subshell starts with the traps reset, and with its own exit state.
+ */
+void
+pushtraps(struct trapstate *ts)
+{
+	int i;
+
+	INTOFF;
+	for (i = 0; i < NSIG; i++) {
+		ts->trap[i] = trap[i];
+		/* Ignored signals stay ignored */
+		trap[i] = trap[i] != NULL && *trap[i] == '\0' ?
+		    savestr(trap[i]) : NULL;
+	}
+	ts->exiting = exiting;
+	ts->exiting_exitstatus = exiting_exitstatus;
+	exiting = 0;
+	INTON;
+}
+
+void
+poptraps(struct trapstate *ts)
+{
+	int i;
+
+	INTOFF;
+	for (i = 0; i < NSIG; i++) {
+		if (trap[i] != NULL)
+			ckfree(trap[i]);
+		trap[i] = ts->trap[i];
+	}
+	exiting = ts->exiting;
+	exiting_exitstatus = ts->exiting_exitstatus;
+	INTON;
+}
+
+
+/*
+ * Forget the traps, when the shell starts and when it is done.
+ */
+void
+freetraps(void)
+{
+	int i;
+
+	for (i = 0; i < NSIG; i++) {
+		if (trap[i] != NULL)
+			ckfree(trap[i]);
+		trap[i] = NULL;
+		gotsig[i] = 0;
+	}
+	pendingsig = 0;
+	pendingsig_waitcmd = 0;
+	in_dotrap = 0;
+	ignore_sigchld = 0;
+	last_trapsig = 0;
+	exiting = 0;
+	exiting_exitstatus = 0;
+	intseen = 0;
+}
+
+
+/*
+ * There is no SIGINT either: ios_system() marks the command as
+ * interrupted, for good.  The shell acts on it as onsig() would, once.
+ */
+int
+intrequested(void)
+{
+
+	return (!intseen && ios_isInterrupted());
+}
+
+void
+checkintr(void)
+{
+
+	if (!intrequested())
+		return;
+	intseen = 1;
+	onsig(SIGINT);
+}
+#else
 void
 exitshell_savedstatus(void)
 {
@@ -555,3 +727,4 @@ exitshell_savedstatus(void)
 	}
 	_exit(exiting_exitstatus);
 }
+#endif
@@ -46,3 +46,17 @@ void dotrap(void);
 void setinteractive(int);
 void exitshell(int) __dead2;
 void exitshell_savedstatus(void) __dead2;
+#if TARGET_OS_IPHONE
+struct trapstate {		/* saved over a subshell, see pushtraps() */
+	char *trap[NSIG];
+	int exiting;
+	int exiting_exitstatus;
+};
+
+int runexittrap(int);
+void pushtraps(struct trapstate *);
+void poptraps(struct trapstate *);
+void freetraps(void);
+int intrequested(void);
+void checkintr(void);
+#endif
@@ -67,6 +67,21 @@ __FBSDID("$FreeBSD: head/bin/sh/var.c 306843 2016-10-08 13:40:12Z jilles $");
 #ifndef NO_HISTORY
 #include "myhistedit.h"
 #endif
+#if TARGET_OS_IPHONE
+#include "ios_error.h"
+
+/*
+ * The locale and the environment of the process are the app's, shared by
+ * all its threads: the shell leaves them alone, and gives the commands
+ * the environment they run with.
+ */
+static char *
+sh_setlocale(int category __unused, const char *locale __unused)
+{
+	return (NULL);
+}
+#define	setlocale(category, locale)	sh_setlocale(category, locale)
+#endif
 
 
 #define VTABSIZE 39
@@ -144,7 +159,9 @@ static struct var *find_var(const char *, struct var ***, int *);
 static int localevar(const char *);
 static void setvareq_const(const char *s, int flags);
 
+#if !TARGET_OS_IPHONE
 extern char **environ;
+#endif
 
 /*
  * This routine initializes the builtin variables and imports the environment.
@@ -180,11 +197,20 @@ initvar(void)
 	}
 	fmtstr(ppid, sizeof(ppid), "%d", (int)getppid());
 	setvarsafe("PPID", ppid, 0);
+#if TARGET_OS_IPHONE
+	/* The environment of the session, which may change under us */
+	for (envp = environmentVariables(ios_currentPid()) ; *envp ; envp++) {
+		if (strchr(*envp, '=')) {
+			setvareq(savestr(*envp), VEXPORT);
+		}
+	}
+#else
 	for (envp = environ ; *envp ; envp++) {
 		if (strchr(*envp, '=')) {
 			setvareq(*envp, VEXPORT|VTEXTFIXED);
 		}
 	}
+#endif
 	setvareq_const("OPTIND=1", 0);
 	setvareq_const("IFS= \t\n", 0);
 }
@@ -291,6 +317,10 @@ localevar(const char *s)
 static void
 change_env(const char *s, int set)
 {
+#if TARGET_OS_IPHONE
+	(void)s;
+	(void)set;
+#else
 	char *eqp;
 	char *ss;
 
@@ -304,6 +334,7 @@ change_env(const char *s, int set)
 		(void) unsetenv(ss);
 	ckfree(ss);
 	INTON;
+#endif
 
 	return;
 }
@@ -965,3 +996,33 @@ find_var(const char *name, struct var ***vppp, int *lenp)
 	}
 	return NULL;
 }
+
+
+#if TARGET_OS_IPHONE
+/*
+ * Forget all the variables, when the shell is done: the next one starts
+ * from initvar() with an empty table.
+ */
+void
+freevars(void)
+{
+	struct var **vpp;
+	struct var *vp, *next;
+
+	INTOFF;
+	while (localvars != NULL)
+		poplocalvars();
+	forcelocal = 0;
+	for (vpp = vartab ; vpp < vartab + VTABSIZE ; vpp++) {
+		for (vp = *vpp ; vp ; vp = next) {
+			next = vp->next;
+			if ((vp->flags & (VTEXTFIXED|VSTACK)) == 0)
+				ckfree(vp->text);
+			if ((vp->flags & VSTRFIXED) == 0)
+				ckfree(vp);
+		}
+		*vpp = NULL;
+	}
+	INTON;
+}
+#endif
@@ -128,3 +128,6 @@ void mklocal(char *);
 void poplocalvars(void);
 int unsetvar(const char *);
 int setvarsafe(const char *, const char *, int);
+#if TARGET_OS_IPHONE
+void freevars(void);
+#endif
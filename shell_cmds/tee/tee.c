@@ -51,23 +51,56 @@ __RCSID("$NetBSD: tee.c,v 1.6 1997/10/20 00:37:11 lukem Exp $");
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <locale.h>
 #include <err.h>
+#include <pthread.h>
 #include "ios_error.h"
 
+/*
+ * With -q or -l, each destination has a writer thread, fed through a queue
+ * of at most qsize bytes, so that a slow one does not hold the others up
+ * until its queue is full.  What happens then is up to the lag policy.
+ */
+typedef struct _chunk {
+	int refs;			/* Destinations still to write it */
+	size_t len;
+	char *data;
+	struct _chunk *next[];		/* In the queue of each destination */
+} CHUNK;
+
+#define	LAG_BLOCK	0		/* Wait for room in the queue */
+#define	LAG_DROP	1		/* Leave the destination out */
+#define	LAG_SPILL	2		/* Queue to a temporary file */
+
 typedef struct _list {
 	struct _list *next;
     FILE* stream;
 	// int fd;
 	char *name;
+	/* Asynchronous mode */
+	int idx;			/* Of its link in the chunks */
+	pthread_t thread;
+	pthread_mutex_t mtx;
+	pthread_cond_t data;		/* Something to write, or the end */
+	pthread_cond_t room;		/* Something written */
+	CHUNK *qhead, **qtail;
+	size_t qbytes;
+	int spillfd;
+	off_t spillrd, spillwr;		/* Still to write from the spill file */
+	off_t dropped;
+	int error;			/* errno of the first failed write */
+	int spillerror;			/* Of the spill file rather */
+	int done;
 } LIST;
 static LIST *head;
 
 static void	add __P((FILE*, char *));
+static int	tee_async __P((int, int, size_t));
 int	tee_main __P((int, char **));
 
 int
@@ -81,8 +114,11 @@ tee_main(argc, argv)
     FILE* fd;
 	char *bp;
 	int append, ch, exitval;
-	char *buf;
+	char *buf, *ep;
+	int async, lag;
+	size_t qsize;
 #define	BSIZE (8 * 1024)
+#define	QSIZE_DEF (1024 * 1024)
     // iOS: initialize flags:
     append = 0; exitval = 0;
     rval = 0; wval = 0; fd = 0; n = 0; ch = 0;
@@ -91,7 +127,10 @@ tee_main(argc, argv)
 	setlocale(LC_ALL, "");
 
 	append = 0;
-	while ((ch = getopt(argc, argv, "ai")) != -1)
+	async = 0;
+	lag = LAG_BLOCK;
+	qsize = QSIZE_DEF;
+	while ((ch = getopt(argc, argv, "ail:q:")) != -1)
 		switch((char)ch) {
 		case 'a':
 			append = 1;
@@ -99,9 +138,35 @@ tee_main(argc, argv)
 		case 'i':
 			(void)signal(SIGINT, SIG_IGN);
 			break;
+		case 'l':
+			if (strcmp(optarg, "block") == 0)
+				lag = LAG_BLOCK;
+			else if (strcmp(optarg, "drop") == 0)
+				lag = LAG_DROP;
+			else if (strcmp(optarg, "spill") == 0)
+				lag = LAG_SPILL;
+			else
+				errx(1, "%s: unknown lag policy", optarg);
+			async = 1;
+			break;
+		case 'q':
+			errno = 0;
+			qsize = strtoul(optarg, &ep, 10);
+			if (*ep == 'k' || *ep == 'K') {
+				qsize *= 1024;
+				ep++;
+			} else if (*ep == 'm' || *ep == 'M') {
+				qsize *= 1024 * 1024;
+				ep++;
+			}
+			if (errno != 0 || ep == optarg || *ep != '\0' ||
+			    qsize < BSIZE)
+				errx(1, "%s: bad queue size", optarg);
+			async = 1;
+			break;
 		case '?':
 		default:
-			(void)fprintf(thread_stderr, "usage: tee [-ai] [file ...]\n");
+			(void)fprintf(thread_stderr, "usage: tee [-ai] [-l block | drop | spill] [-q size] [file ...]\n");
 			exit(1);
 		}
 	argv += optind;
@@ -114,12 +179,17 @@ tee_main(argc, argv)
 	add(thread_stdout, "stdout");
 
 	for (exitval = 0; *argv; ++argv)
-        if ((fd = fopen(*argv, append ? "a" : "w")) < 0) {
+        if ((fd = fopen(*argv, append ? "a" : "w")) == NULL) {
             warn("%s", *argv);
 			exitval = 1;
 		} else
 			add(fd, *argv);
 
+	if (async) {
+		if (tee_async(fileno(thread_stdin), lag, qsize) != 0)
+			exitval = 1;
+		rval = 0;
+	} else
 	while ((rval = read(fileno(thread_stdin), buf, BSIZE)) > 0)
 		for (p = head; p; p = p->next) {
 			n = rval;
@@ -173,3 +243,236 @@ add(stream, name)
 	p->next = head;
 	head = p;
 }
+
+static pthread_mutex_t chunk_mtx = PTHREAD_MUTEX_INITIALIZER;
+static FILE *tee_stdout, *tee_stderr;	/* For the writer threads */
+
+static void
+release(CHUNK *c)
+{
+	int refs;
+
+	pthread_mutex_lock(&chunk_mtx);
+	refs = --c->refs;
+	pthread_mutex_unlock(&chunk_mtx);
+	if (refs == 0)
+		free(c);
+}
+
+/*
+ * Write out a destination's queue, then what was spilled for it.  Once a
+ * write failed, the rest is thrown away.
+ */
+static void *
+writer(void *arg)
+{
+	LIST *p = arg;
+	CHUNK *c;
+	char *buf;
+	size_t len;
+	ssize_t n;
+	off_t off;
+	int error, spillerror;
+
+	thread_stdout = tee_stdout;
+	thread_stderr = tee_stderr;
+	buf = NULL;
+	error = 0;
+	pthread_mutex_lock(&p->mtx);
+	for (;;) {
+		if (error && !p->error)
+			p->error = error;
+		if ((c = p->qhead) != NULL) {
+			if ((p->qhead = c->next[p->idx]) == NULL)
+				p->qtail = &p->qhead;
+			pthread_mutex_unlock(&p->mtx);
+			len = c->len;
+			if (!error && fwrite(c->data, 1, len, p->stream) != len)
+				error = errno ? errno : EIO;
+			release(c);
+			pthread_mutex_lock(&p->mtx);
+			p->qbytes -= len;
+			pthread_cond_signal(&p->room);
+		} else if (p->spillrd < p->spillwr) {
+			off = p->spillrd;
+			len = p->spillwr - off;
+			pthread_mutex_unlock(&p->mtx);
+			spillerror = 0;
+			if (buf == NULL && (buf = malloc(BSIZE)) == NULL)
+				n = -1;
+			else
+				n = pread(p->spillfd, buf,
+				    len < BSIZE ? len : BSIZE, off);
+			if (n <= 0) {
+				if (!error) {
+					error = n < 0 ? errno : EIO;
+					spillerror = 1;
+				}
+				n = len;
+			} else if (!error &&
+			    fwrite(buf, 1, n, p->stream) != (size_t)n)
+				error = errno ? errno : EIO;
+			pthread_mutex_lock(&p->mtx);
+			if (spillerror && !p->error)
+				p->spillerror = 1;
+			p->spillrd += n;
+			if (p->spillrd == p->spillwr)
+				p->spillrd = p->spillwr = 0;
+		} else if (p->done)
+			break;
+		else
+			pthread_cond_wait(&p->data, &p->mtx);
+	}
+	pthread_mutex_unlock(&p->mtx);
+	if (!p->error && fflush(p->stream) != 0)
+		p->error = errno ? errno : EIO;
+	free(buf);
+	return (NULL);
+}
+
+/*
+ * Hand a chunk to a destination's writer, or deal with it by the lag
+ * policy if the destination's queue is full.
+ */
+static void
+enqueue(LIST *p, CHUNK *c, int lag, size_t qsize)
+{
+	pthread_mutex_lock(&p->mtx);
+	if (p->error) {
+		pthread_mutex_unlock(&p->mtx);
+		release(c);
+		return;
+	}
+	/* Once spilling, keep to it until the writer has caught up. */
+	if (p->spillrd < p->spillwr)
+		goto spill;
+	while (p->qhead != NULL && p->qbytes + c->len > qsize) {
+		if (lag == LAG_DROP) {
+			p->dropped += c->len;
+			pthread_mutex_unlock(&p->mtx);
+			release(c);
+			return;
+		}
+		if (lag == LAG_SPILL)
+			goto spill;
+		pthread_cond_wait(&p->room, &p->mtx);
+	}
+	c->next[p->idx] = NULL;
+	*p->qtail = c;
+	p->qtail = &c->next[p->idx];
+	p->qbytes += c->len;
+	pthread_cond_signal(&p->data);
+	pthread_mutex_unlock(&p->mtx);
+	return;
+spill:
+	if (pwrite(p->spillfd, c->data, c->len, p->spillwr) !=
+	    (ssize_t)c->len) {
+		p->error = errno ? errno : EIO;
+		p->spillerror = 1;
+	} else
+		p->spillwr += c->len;
+	pthread_cond_signal(&p->data);
+	pthread_mutex_unlock(&p->mtx);
+	release(c);
+}
+
+static int
+spillfile(void)
+{
+	char path[PATH_MAX];
+	const char *tmpdir;
+	int fd;
+
+	if ((tmpdir = getenv("TMPDIR")) == NULL || *tmpdir == '\0')
+		tmpdir = "/tmp";
+	(void)snprintf(path, sizeof(path), "%s/tee.XXXXXX", tmpdir);
+	if ((fd = mkstemp(path)) == -1)
+		err(1, "%s", path);
+	(void)unlink(path);
+	return (fd);
+}
+
+/*
+ * Copy fd to the destinations, each written by its own thread.  Return
+ * non-zero if any of it could not be read, or written.
+ */
+static int
+tee_async(int fd, int lag, size_t qsize)
+{
+	LIST *p;
+	CHUNK *c;
+	char *buf;
+	ssize_t rval;
+	int ndest, error, intr;
+
+	if ((buf = malloc(BSIZE)) == NULL)
+		err(1, "malloc");
+	tee_stdout = thread_stdout;
+	tee_stderr = thread_stderr;
+	ndest = 0;
+	for (p = head; p; p = p->next) {
+		p->idx = ndest++;
+		pthread_mutex_init(&p->mtx, NULL);
+		pthread_cond_init(&p->data, NULL);
+		pthread_cond_init(&p->room, NULL);
+		p->qhead = NULL;
+		p->qtail = &p->qhead;
+		p->qbytes = 0;
+		p->spillfd = lag == LAG_SPILL ? spillfile() : -1;
+		p->spillrd = p->spillwr = 0;
+		p->dropped = 0;
+		p->error = p->spillerror = p->done = 0;
+		if ((errno = pthread_create(&p->thread, NULL, writer, p)) != 0)
+			err(1, "pthread_create");
+	}
+
+	error = 0;
+	while ((rval = read(fd, buf, BSIZE)) > 0 && !ios_isInterrupted()) {
+		if ((c = malloc(sizeof(*c) + ndest * sizeof(c->next[0]) +
+		    rval)) == NULL)
+			err(1, "malloc");
+		c->refs = ndest;
+		c->len = rval;
+		c->data = (char *)&c->next[ndest];
+		memcpy(c->data, buf, rval);
+		for (p = head; p; p = p->next)
+			enqueue(p, c, lag, qsize);
+	}
+	if (rval < 0) {
+		warn("read");
+		error = 1;
+	}
+	free(buf);
+
+	/* If interrupted, what has not been written yet is thrown away. */
+	intr = ios_isInterrupted();
+	for (p = head; p; p = p->next) {
+		pthread_mutex_lock(&p->mtx);
+		if (intr && !p->error)
+			p->error = EINTR;
+		p->done = 1;
+		pthread_cond_signal(&p->data);
+		pthread_mutex_unlock(&p->mtx);
+	}
+	for (p = head; p; p = p->next) {
+		pthread_join(p->thread, NULL);
+		if (intr)
+			error = 1;
+		else if (p->error || p->dropped) {
+			if (p->spillerror)
+				warnc(p->error, "%s: spill file", p->name);
+			else if (p->error)
+				warnc(p->error, "%s", p->name);
+			if (p->dropped)
+				warnx("%s: %lld bytes dropped", p->name,
+				    (long long)p->dropped);
+			error = 1;
+		}
+		if (p->spillfd != -1)
+			close(p->spillfd);
+		pthread_cond_destroy(&p->room);
+		pthread_cond_destroy(&p->data);
+		pthread_mutex_destroy(&p->mtx);
+	}
+	return (error);
+}
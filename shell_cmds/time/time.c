@@ -55,14 +55,36 @@ __RCSID("$NetBSD: time.c,v 1.9 1997/10/20 03:28:21 lukem Exp $");
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#if TARGET_OS_IPHONE
+#include <string.h>
+#include "ios_error.h"
+
+#define	MAXSTAGES	16
+#endif
 
 int lflag;
 int portableflag;
 
+#if TARGET_OS_IPHONE
+static void
+settime(tv, secs)
+	struct timeval *tv;
+	double secs;
+{
+	tv->tv_sec = (time_t)secs;
+	tv->tv_usec = (suseconds_t)((secs - tv->tv_sec) * 1000000);
+}
+
+int	time_main __P((int, char **));
+
+int
+time_main(argc, argv)
+#else
 int	main __P((int, char **));
 
 int
 main(argc, argv)
+#endif
 	int argc;
 	char **argv;
 {
@@ -70,11 +92,21 @@ main(argc, argv)
 	int ch, status;
 	struct timeval before, after;
 	struct rusage ru;
+#if TARGET_OS_IPHONE
+	ios_processStats ps;
+	ios_pipelineStage stages[MAXSTAGES];
+	int i, nstages;
+	double user, sys;
+#endif
 
 #ifdef __GNUC__		/* XXX: borken gcc */
 	(void)&argv;
 #endif
 	lflag = 0;
+#if TARGET_OS_IPHONE
+	portableflag = 0;
+	optind = 1;
+#endif
 	while ((ch = getopt(argc, argv, "lp")) != -1)
 		switch((char)ch) {
 		case 'p':
@@ -94,6 +126,45 @@ main(argc, argv)
 	argv += optind;
 
 	gettimeofday(&before, (struct timezone *)NULL);
+#if TARGET_OS_IPHONE
+	/*
+	 * The utility is a thread of this process, under a pid of its own:
+	 * there is no child to wait3() for, and getrusage() would count the
+	 * whole app.  The times are those the process table keeps for the
+	 * utility's thread or, for a pipeline, the sum of its stages.
+	 * A single argument is a command line, and may be a pipeline.
+	 */
+	pid = ios_fork();
+	if (argc == 1)
+		status = ios_system(*argv);
+	else {
+		ios_spawnv(*argv, argv, NULL, NULL, NULL, NULL);
+		status = -1;
+	}
+	ios_waitpid(pid);
+	if (status == -1)
+		status = ios_getCommandStatus();
+	gettimeofday(&after, (struct timezone *)NULL);
+	timersub(&after, &before, &after);
+
+	ps = ios_getProcessStats(pid);
+	user = ps.userTime;
+	sys = ps.systemTime;
+	nstages = 0;
+	if (argc == 1 && strchr(*argv, '|') != NULL &&
+	    (nstages = ios_pipelineReport(pid, stages, MAXSTAGES)) > 0) {
+		if (nstages > MAXSTAGES)
+			nstages = MAXSTAGES;
+		user = sys = 0;
+		for (i = 0; i < nstages; i++) {
+			user += stages[i].userTime;
+			sys += stages[i].systemTime;
+		}
+	}
+	memset(&ru, 0, sizeof(ru));
+	settime(&ru.ru_utime, user);
+	settime(&ru.ru_stime, sys);
+#else
 	switch(pid = vfork()) {
 	case -1:			/* error */
 		perror("time");
@@ -114,6 +185,7 @@ main(argc, argv)
 	if (!WIFEXITED(status))
 		fprintf(stderr, "Command terminated abnormally.\n");
 	timersub(&after, &before, &after);
+#endif
 
 	if (portableflag) {
 		fprintf (stderr, "real %9ld.%02ld\n", 
@@ -132,6 +204,32 @@ main(argc, argv)
 			(long)ru.ru_stime.tv_sec, (long)ru.ru_stime.tv_usec/10000);
 	}
 
+#if TARGET_OS_IPHONE
+	/*
+	 * Nothing else of struct rusage is kept per thread: what was written
+	 * is, and how each stage of a pipeline fared.
+	 */
+	if (lflag) {
+		fprintf(stderr, "%10llu  %s\n",
+			ps.bytesOut, "bytes written to standard output");
+		fprintf(stderr, "%10llu  %s\n",
+			ps.bytesErr, "bytes written to standard error");
+		for (i = 0; i < nstages; i++) {
+			settime(&ru.ru_utime, stages[i].userTime);
+			settime(&ru.ru_stime, stages[i].systemTime);
+			fprintf(stderr, "%9ld.%02ld user %9ld.%02ld sys "
+			    "%10llu in %10llu out  %.*s\n",
+			    (long)ru.ru_utime.tv_sec,
+			    (long)ru.ru_utime.tv_usec/10000,
+			    (long)ru.ru_stime.tv_sec,
+			    (long)ru.ru_stime.tv_usec/10000,
+			    stages[i].bytesIn, stages[i].bytesOut,
+			    (int)sizeof(stages[i].command), stages[i].command);
+		}
+	}
+
+	return (status);
+#else
 	if (lflag) {
 		int hz = 100;			/* XXX */
 		long ticks;
@@ -170,4 +268,5 @@ main(argc, argv)
 	}
 
 	exit (WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+#endif
 }
@@ -59,6 +59,7 @@ __FBSDID("$FreeBSD: src/usr.bin/xargs/xargs.c,v 1.57 2005/02/27 02:01:31 gad Exp
 #include <langinfo.h>
 #include <locale.h>
 #include <paths.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -101,6 +102,28 @@ static size_t pad9314053;
 
 static __thread volatile int childerr;
 
+#if TARGET_OS_IPHONE
+/*
+ * With -P, the utilities run on threads of their own, with
+ * ios_spawnv_async(), and their exit statuses are queued here for
+ * waitchildren().  The structure is freed by its last user, since a
+ * child can still be running when xargs exits on an error.
+ */
+struct xjobs {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 done;
+	int		*status;	/* Not reaped yet, at most maxprocs */
+	int		 nstatus;
+	int		 refs;		/* xargs and the children running */
+	FILE		*in;		/* /dev/null, or /dev/tty with -o */
+};
+static __thread struct xjobs *jobs;
+
+static void	childdone(void *, pid_t, int);
+static void	jobs_release(struct xjobs *);
+static void	spawn(char **);
+#endif
+
 extern char **environ;
 
 int
@@ -148,6 +171,9 @@ xargs_main(int argc, char *argv[])
     curprocs = 0;
     maxprocs = 0;
     childerr = 0;
+#if TARGET_OS_IPHONE
+    jobs = NULL;
+#endif
     // end init
     
 	(void)setlocale(LC_ALL, "");
@@ -622,6 +648,12 @@ run(char **argv)
 	}
 exec:
 	childerr = 0;
+#if TARGET_OS_IPHONE
+	if (maxprocs > 1) {
+		spawn(argv);
+		return;
+	}
+#endif
 	switch(pid = vfork()) {
 	case -1:
 		err(1, "vfork");
@@ -666,8 +698,76 @@ exec:
 #endif
 }
 
-// wait for all children of current process (Unix default).
-// Won't work with the current version of ios_system.
+#if TARGET_OS_IPHONE
+/*
+ * Start argv without waiting for it, then wait for a free slot as
+ * waitchildren() does after a fork.
+ */
+static void
+spawn(char **argv)
+{
+	struct xjobs *j;
+
+	if ((j = jobs) == NULL) {
+		if ((j = calloc(1, sizeof(*j))) == NULL ||
+		    (j->status = calloc(maxprocs, sizeof(*j->status))) == NULL)
+			err(1, "calloc");
+		pthread_mutex_init(&j->mtx, NULL);
+		pthread_cond_init(&j->done, NULL);
+		j->refs = 1;
+		if (oflag) {
+			if ((j->in = fopen(_PATH_TTY, "r")) == NULL)
+				err(1, "can't open /dev/tty");
+		} else if ((j->in = fopen(_PATH_DEVNULL, "r")) == NULL)
+			err(1, "%s", _PATH_DEVNULL);
+		jobs = j;
+	}
+	pthread_mutex_lock(&j->mtx);
+	j->refs++;
+	pthread_mutex_unlock(&j->mtx);
+	/* The child's own status comes through childdone() either way */
+	if (ios_spawnv_async(argv[0], argv, NULL, j->in, NULL, NULL, j,
+	    childdone) == -1)
+		err(1, "vfork");
+	curprocs++;
+	waitchildren(*argv, 0);
+}
+
+static void
+childdone(void *arg, pid_t pid __unused, int status)
+{
+	struct xjobs *j = arg;
+
+	pthread_mutex_lock(&j->mtx);
+	j->status[j->nstatus++] = status;
+	pthread_cond_signal(&j->done);
+	pthread_mutex_unlock(&j->mtx);
+	jobs_release(j);
+}
+
+static void
+jobs_release(struct xjobs *j)
+{
+	int last;
+
+	pthread_mutex_lock(&j->mtx);
+	last = --j->refs == 0;
+	pthread_mutex_unlock(&j->mtx);
+	if (!last)
+		return;
+	if (j->in != NULL)
+		(void)fclose(j->in);
+	pthread_cond_destroy(&j->done);
+	pthread_mutex_destroy(&j->mtx);
+	free(j->status);
+	free(j);
+}
+#endif
+
+/*
+ * Reap the children that have finished, and wait for more while all
+ * maxprocs are running, or until none is left if waitall is set.
+ */
 static void
 waitchildren(const char *name, int waitall)
 {
@@ -675,7 +775,37 @@ waitchildren(const char *name, int waitall)
 	int status;
 
 #if TARGET_OS_IPHONE
-    return;
+	struct xjobs *j;
+
+	/* Without -P, run() has already waited. */
+	if ((j = jobs) == NULL)
+		return;
+	pthread_mutex_lock(&j->mtx);
+	for (;;) {
+		while (j->nstatus == 0 && curprocs > 0 &&
+		    (waitall || curprocs >= maxprocs))
+			pthread_cond_wait(&j->done, &j->mtx);
+		if (j->nstatus == 0)
+			break;
+		status = j->status[--j->nstatus];
+		curprocs--;
+		pthread_mutex_unlock(&j->mtx);
+		/* The utility could not be found: ios_system said so. */
+		if (status == 127)
+			exit(127);
+		/* The status is an exit code, not a wait(2) status. */
+		if (status == 255)
+			exit(1);
+		if (status != 0)
+			rval = 1;
+		pthread_mutex_lock(&j->mtx);
+	}
+	pthread_mutex_unlock(&j->mtx);
+	if (waitall) {
+		jobs = NULL;
+		jobs_release(j);
+	}
+	return;
 #endif
 	while ((pid = waitpid(-1, &status, !waitall && curprocs < maxprocs ?
 	    WNOHANG : 0)) > 0) {
@@ -51,6 +51,186 @@ func printUsage() {
 // add searching for modules in ~/Library
 // npm to install new modules (not parcel, though)
 
+// Setting up a context is most of the time of a short script: each jsc takes a warmed context from
+// a pool. A context is used for one script only, so nothing is left from the previous one; once it
+// is done, a fresh context is prepared in its virtual machine, in the background. Each context has
+// a virtual machine of its own: a script locks its machine while it runs, and the jsc commands of
+// a pipeline run at the same time. The machine keeps the code it compiled from a source it has seen.
+private let contextPoolLock = NSLock()
+private var contextPool: [JSContext] = []
+private let contextPoolSize = 2
+private let contextPoolQueue = DispatchQueue(label: "jsc.contextPool", qos: .utility)
+
+// Sources of the scripts and modules, kept while their file is unchanged:
+private struct CachedScript {
+    let modified: Date
+    let size: UInt64
+    let source: String
+}
+private let scriptCacheLock = NSLock()
+private var scriptCache: [String: CachedScript] = [:]
+private let scriptCacheSize = 32
+
+func readScript(atPath path: String) throws -> String {
+    let attributes = try FileManager.default.attributesOfItem(atPath: path)
+    let modified = attributes[.modificationDate] as? Date ?? Date.distantPast
+    let size = (attributes[.size] as? NSNumber)?.uint64Value ?? 0
+    scriptCacheLock.lock()
+    let cached = scriptCache[path]
+    scriptCacheLock.unlock()
+    if let cached = cached, cached.modified == modified, cached.size == size {
+        return cached.source
+    }
+    let source = try String(contentsOf: URL(fileURLWithPath: path), encoding: String.Encoding.utf8)
+    scriptCacheLock.lock()
+    if (scriptCache[path] == nil) && (scriptCache.count >= scriptCacheSize) {
+        scriptCache.removeAll()
+    }
+    scriptCache[path] = CachedScript(modified: modified, size: size, source: source)
+    scriptCacheLock.unlock()
+    return source
+}
+
+// A context with print, println, console.log and require.
+// The blocks use JSContext.current(): a block that kept its context would keep it alive in the pool.
+func makeContext(virtualMachine: JSVirtualMachine) -> JSContext {
+    let context = JSContext(virtualMachine: virtualMachine)!
+    
+    context.exceptionHandler = { context, exception in
+        let line = exception!.objectForKeyedSubscript("line").toString()
+        let column = exception!.objectForKeyedSubscript("column").toString()
+        let stacktrace = exception!.objectForKeyedSubscript("stack").toString()
+        let unknown = "<unknown>"
+        fputs("jsc: Error ", thread_stderr)
+        if let currentFilename = context?.evaluateScript("if (typeof __filename !== 'undefined') { __filename }") {
+            if (!currentFilename.isUndefined) {
+                let file = currentFilename.toString()
+                fputs("in file " + (file ?? unknown) + " ", thread_stderr)
+            }
+        }
+        fputs("at line " + (line ?? unknown), thread_stderr)
+        fputs(", column: " + (column ?? unknown) + ": ", thread_stderr)
+        fputs(exception!.toString() + "\n", thread_stderr)
+        if (stacktrace != nil) {
+            fputs("jsc: Full stack: " + stacktrace! + "\n", thread_stderr)
+        }
+    }
+    let print: @convention(block) (String) -> Void = { string in
+        fputs(string, thread_stdout)
+    }
+    context.setObject(print, forKeyedSubscript: "print" as NSString)
+    let println: @convention(block) (String) -> Void = { string in
+        fputs(string + "\n", thread_stdout)
+    }
+    context.setObject(println, forKeyedSubscript: "println" as NSString)
+    // console.log
+    context.evaluateScript("var console = { log: function(message) { _consoleLog(message) } }")
+    let consoleLog: @convention(block) (String) -> Void = { message in
+        fputs("console.log: " + message + "\n", thread_stderr)
+    }
+    context.setObject(consoleLog, forKeyedSubscript: "_consoleLog" as NSString)
+    // exports, __filename, and __dirname
+    // require
+    let require: @convention(block) (String) -> (JSValue?) = { path in
+        guard let context = JSContext.current() else {
+            return nil
+        }
+        // Store module, filename, exports, dirname before if they exist. Restore them at the end.
+        let currentDirectory = context.evaluateScript("if (typeof __dirname !== 'undefined') { __dirname }")
+        let currentFilename = context.evaluateScript("if (typeof __filename !== 'undefined') { __filename }")
+        let currentExports = context.evaluateScript("if (typeof exports !== 'undefined') { exports }")
+        let currentModule = context.evaluateScript("if (typeof module !== 'undefined') { module }")
+        var expandedPath = NSString(string: path).expandingTildeInPath
+        if (expandedPath.hasPrefix(".")) {
+            if (currentDirectory != nil) {
+                if (!currentDirectory!.isUndefined) {
+                    NSLog("currentDirectory = \(currentDirectory!)")
+                    var shortPath = expandedPath
+                    shortPath.removeFirst(".".count)
+                    expandedPath = currentDirectory!.toString() + shortPath
+                }
+            }
+        }
+        let expandedPathFile = expandedPath + ".js"
+        if (!FileManager.default.fileExists(atPath: expandedPath) && !FileManager.default.fileExists(atPath: expandedPathFile)) {
+            // Not found locally, trying globally
+            let bundleUrl = URL(fileURLWithPath: Bundle.main.resourcePath!)
+            let newUrl = bundleUrl.appendingPathComponent("node_modules").appendingPathComponent(path)
+            if (FileManager.default.fileExists(atPath: newUrl.path)) {
+                expandedPath = newUrl.path
+                if (newUrl.isDirectory) {
+                    let browserUrl = newUrl.appendingPathComponent("browser.js")
+                    if (FileManager.default.fileExists(atPath: browserUrl.path)) {
+                        expandedPath = browserUrl.path
+                    } else {
+                        let indexUrl = newUrl.appendingPathComponent("index.js")
+                        if (FileManager.default.fileExists(atPath: indexUrl.path)) {
+                            expandedPath = indexUrl.path
+                        }
+                    }
+                }
+            }
+        }
+        if (!FileManager.default.fileExists(atPath: expandedPath) && FileManager.default.fileExists(atPath: expandedPathFile)) {
+            expandedPath = expandedPathFile
+        }
+        // Return void or throw an error here.
+        guard FileManager.default.fileExists(atPath: expandedPath)
+            else {
+                fputs("Require: filename \(expandedPath) not found.\n", thread_stderr)
+                return nil
+        }
+        guard let fileContent = try? readScript(atPath: expandedPath)
+            else {
+                fputs("Empty content for: \(expandedPath)\n", thread_stderr)
+                return nil
+        }
+        // module and exports. One for each module we load with require:
+        let dirName = URL(fileURLWithPath: expandedPath).deletingLastPathComponent().path
+        context.evaluateScript("var module = { id: '.', exports: {}, parent: null, filename: '" + expandedPath + "',  dirname: '" + dirName + "', loaded: false, children: [], paths: []};")
+        context.evaluateScript("var exports = module.exports; var __filename = module.filename; var __dirname = module.dirname; ")
+        let returnValue = context.evaluateScript(fileContent)
+        // Restore previous value for module, exports, etc:
+        if (currentModule != nil) {
+            if (!currentModule!.isUndefined) {
+                context.setObject(currentModule, forKeyedSubscript: "module" as NSString)
+                context.evaluateScript("exports = module.exports; __filename = module.filename; __dirname = module.dirname; ")
+            }
+        }
+        // send return
+        return returnValue
+    }
+    context.setObject(require, forKeyedSubscript: "require" as NSString)
+    return context
+}
+
+func takeContext() -> JSContext {
+    contextPoolLock.lock()
+    let context = contextPool.popLast()
+    contextPoolLock.unlock()
+    return context ?? makeContext(virtualMachine: JSVirtualMachine())
+}
+
+// The context of a script that has ended is dropped; a fresh one takes its place in the pool.
+// Not when memory is short: the machine and what it compiled go away with the context.
+func replaceContext(_ context: JSContext) {
+    let virtualMachine = context.virtualMachine!
+    contextPoolQueue.async {
+        if (ios_memoryPressure() != 0) {
+            contextPoolLock.lock()
+            contextPool.removeAll()
+            contextPoolLock.unlock()
+            return
+        }
+        let fresh = makeContext(virtualMachine: virtualMachine)
+        contextPoolLock.lock()
+        if (contextPool.count < contextPoolSize) {
+            contextPool.append(fresh)
+        }
+        contextPoolLock.unlock()
+    }
+}
+
 // execute JavaScript:
 @_cdecl("jsc")
 public func jsc(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
@@ -65,111 +245,11 @@ public func jsc(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int
     let command = args[1]
     let fileName = FileManager().currentDirectoryPath + "/" + command
     do {
-        let javascript = try String(contentsOf: URL(fileURLWithPath: fileName), encoding: String.Encoding.utf8)
-        let context = JSContext()!
-        
-        context.exceptionHandler = { context, exception in
-            let line = exception!.objectForKeyedSubscript("line").toString()
-            let column = exception!.objectForKeyedSubscript("column").toString()
-            let stacktrace = exception!.objectForKeyedSubscript("stack").toString()
-            let unknown = "<unknown>"
-            fputs("jsc: Error ", thread_stderr)
-            if let currentFilename = context?.evaluateScript("if (typeof __filename !== 'undefined') { __filename }") {
-                if (!currentFilename.isUndefined) {
-                    let file = currentFilename.toString()
-                    fputs("in file " + (file ?? unknown) + " ", thread_stderr)
-                }
-            }
-            fputs("at line " + (line ?? unknown), thread_stderr)
-            fputs(", column: " + (column ?? unknown) + ": ", thread_stderr)
-            fputs(exception!.toString() + "\n", thread_stderr)
-            if (stacktrace != nil) {
-                fputs("jsc: Full stack: " + stacktrace! + "\n", thread_stderr)
-            }
-        }
-        let print: @convention(block) (String) -> Void = { string in
-            fputs(string, thread_stdout)
-        }
-        context.setObject(print, forKeyedSubscript: "print" as NSString)
-        let println: @convention(block) (String) -> Void = { string in
-            fputs(string + "\n", thread_stdout)
-        }
-        context.setObject(println, forKeyedSubscript: "println" as NSString)
-        // console.log
-        context.evaluateScript("var console = { log: function(message) { _consoleLog(message) } }")
-        let consoleLog: @convention(block) (String) -> Void = { message in
-            fputs("console.log: " + message + "\n", thread_stderr)
-        }
-        context.setObject(consoleLog, forKeyedSubscript: "_consoleLog" as NSString)
-        // exports, __filename, and __dirname
-        // require
-        let require: @convention(block) (String) -> (JSValue?) = { path in
-            // Store module, filename, exports, dirname before if they exist. Restore them at the end.
-            let currentDirectory = context.evaluateScript("if (typeof __dirname !== 'undefined') { __dirname }")
-            let currentFilename = context.evaluateScript("if (typeof __filename !== 'undefined') { __filename }")
-            let currentExports = context.evaluateScript("if (typeof exports !== 'undefined') { exports }")
-            let currentModule = context.evaluateScript("if (typeof module !== 'undefined') { module }")
-            var expandedPath = NSString(string: path).expandingTildeInPath
-            if (expandedPath.hasPrefix(".")) {
-                if (currentDirectory != nil) {
-                    if (!currentDirectory!.isUndefined) {
-                        NSLog("currentDirectory = \(currentDirectory!)")
-                        var shortPath = expandedPath
-                        shortPath.removeFirst(".".count)
-                        expandedPath = currentDirectory!.toString() + shortPath
-                    }
-                }
-            }
-            let expandedPathFile = expandedPath + ".js"
-            if (!FileManager.default.fileExists(atPath: expandedPath) && !FileManager.default.fileExists(atPath: expandedPathFile)) {
-                // Not found locally, trying globally
-                let bundleUrl = URL(fileURLWithPath: Bundle.main.resourcePath!)
-                let newUrl = bundleUrl.appendingPathComponent("node_modules").appendingPathComponent(path)
-                if (FileManager.default.fileExists(atPath: newUrl.path)) {
-                    expandedPath = newUrl.path
-                    if (newUrl.isDirectory) {
-                        let browserUrl = newUrl.appendingPathComponent("browser.js")
-                        if (FileManager.default.fileExists(atPath: browserUrl.path)) {
-                            expandedPath = browserUrl.path
-                        } else {
-                            let indexUrl = newUrl.appendingPathComponent("index.js")
-                            if (FileManager.default.fileExists(atPath: indexUrl.path)) {
-                                expandedPath = indexUrl.path
-                            }
-                        }
-                    }
-                }
-            }
-            if (!FileManager.default.fileExists(atPath: expandedPath) && FileManager.default.fileExists(atPath: expandedPathFile)) {
-                expandedPath = expandedPathFile
-            }
-            // Return void or throw an error here.
-            guard FileManager.default.fileExists(atPath: expandedPath)
-                else {
-                    fputs("Require: filename \(expandedPath) not found.\n", thread_stderr)
-                    return nil
-            }
-            guard let fileContent = try? String(contentsOfFile: expandedPath)
-                else {
-                    fputs("Empty content for: \(expandedPath)\n", thread_stderr)
-                    return nil
-            }
-            // module and exports. One for each module we load with require:
-            let dirName = URL(fileURLWithPath: expandedPath).deletingLastPathComponent().path
-            context.evaluateScript("var module = { id: '.', exports: {}, parent: null, filename: '" + expandedPath + "',  dirname: '" + dirName + "', loaded: false, children: [], paths: []};")
-            context.evaluateScript("var exports = module.exports; var __filename = module.filename; var __dirname = module.dirname; ")
-            let returnValue = context.evaluateScript(fileContent)
-            // Restore previous value for module, exports, etc:
-            if (currentModule != nil) {
-                if (!currentModule!.isUndefined) {
-                    context.setObject(currentModule, forKeyedSubscript: "module" as NSString)
-                    context.evaluateScript("exports = module.exports; __filename = module.filename; __dirname = module.dirname; ")
-                }
-            }
-            // send return
-            return returnValue
+        let javascript = try readScript(atPath: fileName)
+        let context = takeContext()
+        defer {
+            replaceContext(context)
         }
-        context.setObject(require, forKeyedSubscript: "require" as NSString)
         // actual script execution:
         if let result = context.evaluateScript(javascript) {
             if (!result.isUndefined) {
@@ -49,6 +49,9 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_KQUEUE
+#include <sys/event.h>
+#endif
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -83,6 +86,7 @@
 #include "authfd.h"
 #include "pathnames.h"
 #include "match.h"
+#include "monitor_fdpass.h"
 
 /* -- agent forwarding */
 #define	NUM_SOCKS	10
@@ -98,9 +102,8 @@
 /* Maximum number of fake X11 displays to try. */
 #define MAX_DISPLAYS  1000
 
-/* Per-channel callback for pre/post select() actions */
-typedef void chan_fn(struct ssh *, Channel *c,
-    fd_set *readset, fd_set *writeset);
+/* Per-channel callback for pre/post IO actions */
+typedef void chan_fn(struct ssh *, Channel *c);
 
 /*
  * Data structure for storing which hosts are permitted for forward requests.
@@ -176,6 +179,25 @@ struct ssh_channels {
 	chan_fn **channel_pre;
 	chan_fn **channel_post;
 
+#ifdef HAVE_KQUEUE
+	/*
+	 * kqueue(2) that replaces select() for the client.  Filters stay
+	 * registered across wakeups: each round only adds the ones newly
+	 * asked for and deletes the ones nobody wants any more.  kq_fds
+	 * holds the CHAN_KQ_* state of each fd; kq_live lists the fds
+	 * that have a filter registered or wanted.
+	 */
+	int kq;
+	pid_t kq_pid;
+	int kq_failed;
+	u_char *kq_fds;
+	u_int kq_nfds;
+	int *kq_live;
+	u_int kq_nlive, kq_live_alloc;
+	struct kevent *kq_ev;
+	u_int kq_ev_alloc;
+#endif
+
 	/* -- tcp forwarding */
 	struct permission_set local_perms;
 	struct permission_set remote_perms;
@@ -220,6 +242,10 @@ static int rdynamic_connect_finish(struct ssh *, Channel *);
 /* Setup helper */
 static void channel_handler_init(struct ssh_channels *sc);
 
+#ifdef HAVE_KQUEUE
+static void channel_kqueue_forget(struct ssh_channels *, int);
+#endif
+
 /* -- channel core */
 
 void
@@ -232,6 +258,9 @@ channel_init_channels(struct ssh *ssh)
 	sc->channels_alloc = 10;
 	sc->channels = xcalloc(sc->channels_alloc, sizeof(*sc->channels));
 	sc->IPv4or6 = AF_UNSPEC;
+#ifdef HAVE_KQUEUE
+	sc->kq = -1;
+#endif
 	channel_handler_init(sc);
 
 	ssh->chanctxt = sc;
@@ -428,6 +457,9 @@ channel_close_fd(struct ssh *ssh, int *fdp)
 	int ret = 0, fd = *fdp;
 
 	if (fd != -1) {
+#ifdef HAVE_KQUEUE
+		channel_kqueue_forget(sc, fd);
+#endif
 		ret = close(fd);
 		*fdp = -1;
 		if (fd == sc->channel_max_fd)
@@ -667,6 +699,22 @@ channel_free_all(struct ssh *ssh)
 	free(sc->x11_fake_data);
 	sc->x11_fake_data = NULL;
 	sc->x11_fake_data_len = 0;
+
+#ifdef HAVE_KQUEUE
+	if (sc->kq != -1 && sc->kq_pid == getpid())
+		close(sc->kq);
+	sc->kq = -1;
+	sc->kq_failed = 0;
+	free(sc->kq_fds);
+	sc->kq_fds = NULL;
+	sc->kq_nfds = 0;
+	free(sc->kq_live);
+	sc->kq_live = NULL;
+	sc->kq_nlive = sc->kq_live_alloc = 0;
+	free(sc->kq_ev);
+	sc->kq_ev = NULL;
+	sc->kq_ev_alloc = 0;
+#endif
 }
 
 /*
@@ -1068,33 +1116,30 @@ channel_set_fds(struct ssh *ssh, int id, int rfd, int wfd, int efd,
 }
 
 static void
-channel_pre_listener(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_pre_listener(struct ssh *ssh, Channel *c)
 {
-	FD_SET(c->sock, readset);
+	c->io_want |= SSH_CHAN_IO_SOCK_R;
 }
 
 static void
-channel_pre_connecting(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_pre_connecting(struct ssh *ssh, Channel *c)
 {
 	debug3("channel %d: waiting for connection", c->self);
-	FD_SET(c->sock, writeset);
+	c->io_want |= SSH_CHAN_IO_SOCK_W;
 }
 
 static void
-channel_pre_open(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_pre_open(struct ssh *ssh, Channel *c)
 {
 	if (c->istate == CHAN_INPUT_OPEN &&
 	    c->remote_window > 0 &&
 	    sshbuf_len(c->input) < c->remote_window &&
 	    sshbuf_check_reserve(c->input, CHAN_RBUF) == 0)
-		FD_SET(c->rfd, readset);
+		c->io_want |= SSH_CHAN_IO_RFD;
 	if (c->ostate == CHAN_OUTPUT_OPEN ||
 	    c->ostate == CHAN_OUTPUT_WAIT_DRAIN) {
 		if (sshbuf_len(c->output) > 0) {
-			FD_SET(c->wfd, writeset);
+			c->io_want |= SSH_CHAN_IO_WFD;
 		} else if (c->ostate == CHAN_OUTPUT_WAIT_DRAIN) {
 			if (CHANNEL_EFD_OUTPUT_ACTIVE(c))
 				debug2("channel %d: "
@@ -1109,12 +1154,12 @@ channel_pre_open(struct ssh *ssh, Channel *c,
 	    c->ostate == CHAN_OUTPUT_CLOSED)) {
 		if (c->extended_usage == CHAN_EXTENDED_WRITE &&
 		    sshbuf_len(c->extended) > 0)
-			FD_SET(c->efd, writeset);
+			c->io_want |= SSH_CHAN_IO_EFD_W;
 		else if (c->efd != -1 && !(c->flags & CHAN_EOF_SENT) &&
 		    (c->extended_usage == CHAN_EXTENDED_READ ||
 		    c->extended_usage == CHAN_EXTENDED_IGNORE) &&
 		    sshbuf_len(c->extended) < c->remote_window)
-			FD_SET(c->efd, readset);
+			c->io_want |= SSH_CHAN_IO_EFD_R;
 	}
 	/* XXX: What about efd? races? */
 }
@@ -1196,8 +1241,7 @@ x11_open_helper(struct ssh *ssh, struct sshbuf *b)
 }
 
 static void
-channel_pre_x11_open(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_pre_x11_open(struct ssh *ssh, Channel *c)
 {
 	int ret = x11_open_helper(ssh, c->output);
 
@@ -1205,7 +1249,7 @@ channel_pre_x11_open(struct ssh *ssh, Channel *c,
 
 	if (ret == 1) {
 		c->type = SSH_CHANNEL_OPEN;
-		channel_pre_open(ssh, c, readset, writeset);
+		channel_pre_open(ssh, c);
 	} else if (ret == -1) {
 		logit("X11 connection rejected because of wrong authentication.");
 		debug2("X11 rejected %d i%d/o%d",
@@ -1220,12 +1264,11 @@ channel_pre_x11_open(struct ssh *ssh, Channel *c,
 }
 
 static void
-channel_pre_mux_client(struct ssh *ssh,
-    Channel *c, fd_set *readset, fd_set *writeset)
+channel_pre_mux_client(struct ssh *ssh, Channel *c)
 {
 	if (c->istate == CHAN_INPUT_OPEN && !c->mux_pause &&
 	    sshbuf_check_reserve(c->input, CHAN_RBUF) == 0)
-		FD_SET(c->rfd, readset);
+		c->io_want |= SSH_CHAN_IO_RFD;
 	if (c->istate == CHAN_INPUT_WAIT_DRAIN) {
 		/* clear buffer immediately (discard any partial packet) */
 		sshbuf_reset(c->input);
@@ -1236,7 +1279,7 @@ channel_pre_mux_client(struct ssh *ssh,
 	if (c->ostate == CHAN_OUTPUT_OPEN ||
 	    c->ostate == CHAN_OUTPUT_WAIT_DRAIN) {
 		if (sshbuf_len(c->output) > 0)
-			FD_SET(c->wfd, writeset);
+			c->io_want |= SSH_CHAN_IO_WFD;
 		else if (c->ostate == CHAN_OUTPUT_WAIT_DRAIN)
 			chan_obuf_empty(ssh, c);
 	}
@@ -1514,8 +1557,7 @@ channel_connect_stdio_fwd(struct ssh *ssh,
 
 /* dynamic port forwarding */
 static void
-channel_pre_dynamic(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_pre_dynamic(struct ssh *ssh, Channel *c)
 {
 	const u_char *p;
 	u_int have;
@@ -1527,7 +1569,7 @@ channel_pre_dynamic(struct ssh *ssh, Channel *c,
 	/* check if the fixed size part of the packet is in buffer. */
 	if (have < 3) {
 		/* need more */
-		FD_SET(c->sock, readset);
+		c->io_want |= SSH_CHAN_IO_SOCK_R;
 		return;
 	}
 	/* try to guess the protocol */
@@ -1549,9 +1591,9 @@ channel_pre_dynamic(struct ssh *ssh, Channel *c,
 	} else if (ret == 0) {
 		debug2("channel %d: pre_dynamic: need more", c->self);
 		/* need more */
-		FD_SET(c->sock, readset);
+		c->io_want |= SSH_CHAN_IO_SOCK_R;
 		if (sshbuf_len(c->output))
-			FD_SET(c->sock, writeset);
+			c->io_want |= SSH_CHAN_IO_SOCK_W;
 	} else {
 		/* switch to the next state */
 		c->type = SSH_CHANNEL_OPENING;
@@ -1631,8 +1673,7 @@ channel_before_prepare_select_rdynamic(struct ssh *ssh, Channel *c)
 
 /* This is our fake X11 server socket. */
 static void
-channel_post_x11_listener(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_x11_listener(struct ssh *ssh, Channel *c)
 {
 	Channel *nc;
 	struct sockaddr_storage addr;
@@ -1640,7 +1681,7 @@ channel_post_x11_listener(struct ssh *ssh, Channel *c,
 	socklen_t addrlen;
 	char buf[16384], *remote_ipaddr;
 
-	if (!FD_ISSET(c->sock, readset))
+	if (!(c->io_ready & SSH_CHAN_IO_SOCK_R))
 		return;
 
 	debug("X11 connection requested.");
@@ -1749,8 +1790,7 @@ channel_set_x11_refuse_time(struct ssh *ssh, u_int refuse_time)
  * This socket is listening for connections to a forwarded TCP/IP port.
  */
 static void
-channel_post_port_listener(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_port_listener(struct ssh *ssh, Channel *c)
 {
 	Channel *nc;
 	struct sockaddr_storage addr;
@@ -1758,7 +1798,7 @@ channel_post_port_listener(struct ssh *ssh, Channel *c,
 	socklen_t addrlen;
 	char *rtype;
 
-	if (!FD_ISSET(c->sock, readset))
+	if (!(c->io_ready & SSH_CHAN_IO_SOCK_R))
 		return;
 
 	debug("Connection to port %d forwarding to %.100s port %d requested.",
@@ -1809,15 +1849,14 @@ channel_post_port_listener(struct ssh *ssh, Channel *c,
  * clients.
  */
 static void
-channel_post_auth_listener(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_auth_listener(struct ssh *ssh, Channel *c)
 {
 	Channel *nc;
 	int r, newsock;
 	struct sockaddr_storage addr;
 	socklen_t addrlen;
 
-	if (!FD_ISSET(c->sock, readset))
+	if (!(c->io_ready & SSH_CHAN_IO_SOCK_R))
 		return;
 
 	addrlen = sizeof(addr);
@@ -1838,13 +1877,12 @@ channel_post_auth_listener(struct ssh *ssh, Channel *c,
 }
 
 static void
-channel_post_connecting(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_connecting(struct ssh *ssh, Channel *c)
 {
 	int err = 0, sock, isopen, r;
 	socklen_t sz = sizeof(err);
 
-	if (!FD_ISSET(c->sock, writeset))
+	if (!(c->io_ready & SSH_CHAN_IO_SOCK_W))
 		return;
 	if (!c->have_remote_id)
 		fatal_f("channel %d: no remote id", c->self);
@@ -1876,6 +1914,9 @@ channel_post_connecting(struct ssh *ssh, Channel *c,
 		    c->self, strerror(err));
 		/* Try next address, if any */
 		if ((sock = connect_next(&c->connect_ctx)) > 0) {
+#ifdef HAVE_KQUEUE
+			channel_kqueue_forget(ssh->chanctxt, c->sock);
+#endif
 			close(c->sock);
 			c->sock = c->rfd = c->wfd = sock;
 			channel_find_maxfd(ssh->chanctxt);
@@ -1903,8 +1944,7 @@ channel_post_connecting(struct ssh *ssh, Channel *c,
 }
 
 static int
-channel_handle_rfd(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_handle_rfd(struct ssh *ssh, Channel *c)
 {
 	char buf[CHAN_RBUF];
 	ssize_t len;
@@ -1912,7 +1952,7 @@ channel_handle_rfd(struct ssh *ssh, Channel *c,
 
 	force = c->isatty && c->detach_close && c->istate != CHAN_INPUT_CLOSED;
 
-	if (c->rfd == -1 || (!force && !FD_ISSET(c->rfd, readset)))
+	if (c->rfd == -1 || (!force && !(c->io_ready & SSH_CHAN_IO_RFD)))
 		return 1;
 
 	errno = 0;
@@ -1951,15 +1991,14 @@ channel_handle_rfd(struct ssh *ssh, Channel *c,
 }
 
 static int
-channel_handle_wfd(struct ssh *ssh, Channel *c,
-   fd_set *readset, fd_set *writeset)
+channel_handle_wfd(struct ssh *ssh, Channel *c)
 {
 	struct termios tio;
 	u_char *data = NULL, *buf; /* XXX const; need filter API change */
 	size_t dlen, olen = 0;
 	int r, len;
 
-	if (c->wfd == -1 || !FD_ISSET(c->wfd, writeset) ||
+	if (c->wfd == -1 || !(c->io_ready & SSH_CHAN_IO_WFD) ||
 	    sshbuf_len(c->output) == 0)
 		return 1;
 
@@ -2041,13 +2080,12 @@ channel_handle_wfd(struct ssh *ssh, Channel *c,
 }
 
 static int
-channel_handle_efd_write(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_handle_efd_write(struct ssh *ssh, Channel *c)
 {
 	int r;
 	ssize_t len;
 
-	if (!FD_ISSET(c->efd, writeset) || sshbuf_len(c->extended) == 0)
+	if (!(c->io_ready & SSH_CHAN_IO_EFD_W) || sshbuf_len(c->extended) == 0)
 		return 1;
 
 	len = write(c->efd, sshbuf_ptr(c->extended),
@@ -2068,8 +2106,7 @@ channel_handle_efd_write(struct ssh *ssh, Channel *c,
 }
 
 static int
-channel_handle_efd_read(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_handle_efd_read(struct ssh *ssh, Channel *c)
 {
 	char buf[CHAN_RBUF];
 	ssize_t len;
@@ -2077,7 +2114,7 @@ channel_handle_efd_read(struct ssh *ssh, Channel *c,
 
 	force = c->isatty && c->detach_close && c->istate != CHAN_INPUT_CLOSED;
 
-	if (c->efd == -1 || (!force && !FD_ISSET(c->efd, readset)))
+	if (c->efd == -1 || (!force && !(c->io_ready & SSH_CHAN_IO_EFD_R)))
 		return 1;
 
 	len = read(c->efd, buf, sizeof(buf));
@@ -2096,8 +2133,7 @@ channel_handle_efd_read(struct ssh *ssh, Channel *c,
 }
 
 static int
-channel_handle_efd(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_handle_efd(struct ssh *ssh, Channel *c)
 {
 	if (c->efd == -1)
 		return 1;
@@ -2105,14 +2141,52 @@ channel_handle_efd(struct ssh *ssh, Channel *c,
 	/** XXX handle drain efd, too */
 
 	if (c->extended_usage == CHAN_EXTENDED_WRITE)
-		return channel_handle_efd_write(ssh, c, readset, writeset);
+		return channel_handle_efd_write(ssh, c);
 	else if (c->extended_usage == CHAN_EXTENDED_READ ||
 	    c->extended_usage == CHAN_EXTENDED_IGNORE)
-		return channel_handle_efd_read(ssh, c, readset, writeset);
+		return channel_handle_efd_read(ssh, c);
 
 	return 1;
 }
 
+/*
+ * Grow the receive window of a bulk channel when the sender is limited by
+ * it: if the data we took in over the last few round trips says more than
+ * half the window is in flight per RTT, double it (HPN-style). Returns the
+ * extra window to advertise.
+ */
+static u_int
+channel_grow_window(struct ssh *ssh, Channel *c)
+{
+	double now, elapsed, rtt, bdp;
+	u_int grow;
+
+	if (c->local_window_max >= c->local_window_limit)
+		return 0;
+	now = monotime_double();
+	c->local_window_acked += c->local_consumed;
+	if (c->local_window_sampled == 0) {
+		c->local_window_sampled = now;
+		c->local_window_acked = 0;
+		return 0;
+	}
+	if ((elapsed = now - c->local_window_sampled) < 0.1)
+		return 0;
+	if ((rtt = ssh_packet_get_rtt(ssh)) <= 0 || elapsed < 2 * rtt)
+		return 0;
+	bdp = c->local_window_acked / elapsed * rtt;
+	c->local_window_sampled = now;
+	c->local_window_acked = 0;
+	if (bdp * 2 < c->local_window_max)
+		return 0;
+	grow = MINIMUM(c->local_window_max,
+	    c->local_window_limit - c->local_window_max);
+	c->local_window_max += grow;
+	debug2("channel %d: rtt %.3fs, %.0f bytes/rtt, window grown to %u",
+	    c->self, rtt, bdp, c->local_window_max);
+	return grow;
+}
+
 static int
 channel_check_window(struct ssh *ssh, Channel *c)
 {
@@ -2126,6 +2200,7 @@ channel_check_window(struct ssh *ssh, Channel *c)
 	    c->local_consumed > 0) {
 		if (!c->have_remote_id)
 			fatal_f("channel %d: no remote id", c->self);
+		c->local_consumed += channel_grow_window(ssh, c);
 		if ((r = sshpkt_start(ssh,
 		    SSH2_MSG_CHANNEL_WINDOW_ADJUST)) != 0 ||
 		    (r = sshpkt_put_u32(ssh, c->remote_id)) != 0 ||
@@ -2142,12 +2217,11 @@ channel_check_window(struct ssh *ssh, Channel *c)
 }
 
 static void
-channel_post_open(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_open(struct ssh *ssh, Channel *c)
 {
-	channel_handle_rfd(ssh, c, readset, writeset);
-	channel_handle_wfd(ssh, c, readset, writeset);
-	channel_handle_efd(ssh, c, readset, writeset);
+	channel_handle_rfd(ssh, c);
+	channel_handle_wfd(ssh, c);
+	channel_handle_efd(ssh, c);
 	channel_check_window(ssh, c);
 }
 
@@ -2176,12 +2250,11 @@ read_mux(struct ssh *ssh, Channel *c, u_int need)
 }
 
 static void
-channel_post_mux_client_read(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_mux_client_read(struct ssh *ssh, Channel *c)
 {
 	u_int need;
 
-	if (c->rfd == -1 || !FD_ISSET(c->rfd, readset))
+	if (c->rfd == -1 || !(c->io_ready & SSH_CHAN_IO_RFD))
 		return;
 	if (c->istate != CHAN_INPUT_OPEN && c->istate != CHAN_INPUT_WAIT_DRAIN)
 		return;
@@ -2213,13 +2286,12 @@ channel_post_mux_client_read(struct ssh *ssh, Channel *c,
 }
 
 static void
-channel_post_mux_client_write(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_mux_client_write(struct ssh *ssh, Channel *c)
 {
 	ssize_t len;
 	int r;
 
-	if (c->wfd == -1 || !FD_ISSET(c->wfd, writeset) ||
+	if (c->wfd == -1 || !(c->io_ready & SSH_CHAN_IO_WFD) ||
 	    sshbuf_len(c->output) == 0)
 		return;
 
@@ -2235,29 +2307,39 @@ channel_post_mux_client_write(struct ssh *ssh, Channel *c,
 }
 
 static void
-channel_post_mux_client(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_mux_client(struct ssh *ssh, Channel *c)
 {
-	channel_post_mux_client_read(ssh, c, readset, writeset);
-	channel_post_mux_client_write(ssh, c, readset, writeset);
+	channel_post_mux_client_read(ssh, c);
+	channel_post_mux_client_write(ssh, c);
 }
 
 static void
-channel_post_mux_listener(struct ssh *ssh, Channel *c,
-    fd_set *readset, fd_set *writeset)
+channel_post_mux_listener(struct ssh *ssh, Channel *c)
 {
 	Channel *nc;
+#if !TARGET_OS_IPHONE
 	struct sockaddr_storage addr;
 	socklen_t addrlen;
-	int newsock;
 	uid_t euid;
 	gid_t egid;
+#endif
+	int newsock;
 
-	if (!FD_ISSET(c->sock, readset))
+	if (!(c->io_ready & SSH_CHAN_IO_SOCK_R))
 		return;
 
 	debug("multiplexing control connection");
 
+#if TARGET_OS_IPHONE
+	/*
+	 * The listener is one end of a socketpair held by the in-process
+	 * control socket registry (mux.c); clients pass their end over it.
+	 */
+	if ((newsock = mm_receive_fd(c->sock)) == -1) {
+		c->notbefore = monotime() + 1;
+		return;
+	}
+#else
 	/*
 	 * Accept connection on control socket
 	 */
@@ -2282,6 +2364,7 @@ channel_post_mux_listener(struct ssh *ssh, Channel *c,
 		close(newsock);
 		return;
 	}
+#endif
 	nc = channel_new(ssh, "multiplex client", SSH_CHANNEL_MUX_CLIENT,
 	    newsock, newsock, -1, c->local_window_max,
 	    c->local_maxpacket, 0, "mux-control", 1);
@@ -2359,8 +2442,7 @@ channel_garbage_collect(struct ssh *ssh, Channel *c)
 enum channel_table { CHAN_PRE, CHAN_POST };
 
 static void
-channel_handler(struct ssh *ssh, int table,
-    fd_set *readset, fd_set *writeset, time_t *unpause_secs)
+channel_handler(struct ssh *ssh, int table, time_t *unpause_secs)
 {
 	struct ssh_channels *sc = ssh->chanctxt;
 	chan_fn **ftab = table == CHAN_PRE ? sc->channel_pre : sc->channel_post;
@@ -2375,6 +2457,8 @@ channel_handler(struct ssh *ssh, int table,
 		c = sc->channels[i];
 		if (c == NULL)
 			continue;
+		if (table == CHAN_PRE)
+			c->io_want = c->io_ready = 0;
 		if (c->delayed) {
 			if (table == CHAN_PRE)
 				c->delayed = 0;
@@ -2386,7 +2470,7 @@ channel_handler(struct ssh *ssh, int table,
 			 * Run handlers that are not paused.
 			 */
 			if (c->notbefore <= now)
-				(*ftab[c->type])(ssh, c, readset, writeset);
+				(*ftab[c->type])(ssh, c);
 			else if (unpause_secs != NULL) {
 				/*
 				 * Collect the time that the earliest
@@ -2428,6 +2512,23 @@ channel_before_prepare_select(struct ssh *ssh)
 	}
 }
 
+/* Returns the fd that a SSH_CHAN_IO_* bit refers to */
+static int
+channel_io_fd(Channel *c, u_int io)
+{
+	switch (io) {
+	case SSH_CHAN_IO_RFD:
+		return c->rfd;
+	case SSH_CHAN_IO_WFD:
+		return c->wfd;
+	case SSH_CHAN_IO_EFD_R:
+	case SSH_CHAN_IO_EFD_W:
+		return c->efd;
+	default:
+		return c->sock;
+	}
+}
+
 /*
  * Allocate/update select bitmasks and add any bits relevant to channels in
  * select bitmasks.
@@ -2436,7 +2537,10 @@ void
 channel_prepare_select(struct ssh *ssh, fd_set **readsetp, fd_set **writesetp,
     int *maxfdp, u_int *nallocp, time_t *minwait_secs)
 {
-	u_int n, sz, nfdset;
+	struct ssh_channels *sc = ssh->chanctxt;
+	Channel *c;
+	u_int i, io, n, sz, nfdset;
+	int fd;
 
 	channel_before_prepare_select(ssh); /* might update channel_max_fd */
 
@@ -2458,9 +2562,23 @@ channel_prepare_select(struct ssh *ssh, fd_set **readsetp, fd_set **writesetp,
 	memset(*readsetp, 0, sz);
 	memset(*writesetp, 0, sz);
 
-	if (!ssh_packet_is_rekeying(ssh))
-		channel_handler(ssh, CHAN_PRE, *readsetp, *writesetp,
-		    minwait_secs);
+	if (ssh_packet_is_rekeying(ssh))
+		return;
+	channel_handler(ssh, CHAN_PRE, minwait_secs);
+	for (i = 0; i < sc->channels_alloc; i++) {
+		if ((c = sc->channels[i]) == NULL || c->io_want == 0)
+			continue;
+		for (io = 1; io <= c->io_want; io <<= 1) {
+			if ((c->io_want & io) == 0)
+				continue;
+			if ((fd = channel_io_fd(c, io)) < 0 || fd > (int)n) {
+				c->io_want &= ~io;
+				continue;
+			}
+			FD_SET(fd, (io & SSH_CHAN_IO_WRITE) ?
+			    *writesetp : *readsetp);
+		}
+	}
 }
 
 /*
@@ -2470,8 +2588,241 @@ channel_prepare_select(struct ssh *ssh, fd_set **readsetp, fd_set **writesetp,
 void
 channel_after_select(struct ssh *ssh, fd_set *readset, fd_set *writeset)
 {
-	channel_handler(ssh, CHAN_POST, readset, writeset, NULL);
+	struct ssh_channels *sc = ssh->chanctxt;
+	Channel *c;
+	u_int i, io;
+	int fd;
+
+	for (i = 0; i < sc->channels_alloc; i++) {
+		if ((c = sc->channels[i]) == NULL || c->io_want == 0)
+			continue;
+		for (io = 1; io <= c->io_want; io <<= 1) {
+			if ((c->io_want & io) == 0 ||
+			    (fd = channel_io_fd(c, io)) < 0)
+				continue;
+			if (FD_ISSET(fd, (io & SSH_CHAN_IO_WRITE) ?
+			    writeset : readset))
+				c->io_ready |= io;
+		}
+	}
+	channel_handler(ssh, CHAN_POST, NULL);
+}
+
+#ifdef HAVE_KQUEUE
+/* kq_fds state */
+#define CHAN_KQ_REG_R		0x01	/* EVFILT_READ registered */
+#define CHAN_KQ_REG_W		0x02	/* EVFILT_WRITE registered */
+#define CHAN_KQ_WANT_R		0x04	/* asked for this round */
+#define CHAN_KQ_WANT_W		0x08
+#define CHAN_KQ_READY_R		0x10	/* reported this round */
+#define CHAN_KQ_READY_W		0x20
+#define CHAN_KQ_LIVE		0x40	/* on kq_live */
+
+/*
+ * Called before the fd is closed, which drops its filters from the kqueue,
+ * so that they are registered again if the fd number is reused.
+ */
+static void
+channel_kqueue_forget(struct ssh_channels *sc, int fd)
+{
+	if (fd >= 0 && (u_int)fd < sc->kq_nfds)
+		sc->kq_fds[fd] &= ~(CHAN_KQ_REG_R|CHAN_KQ_REG_W);
+}
+
+/* Opens the kqueue, again in a child as fork(2) does not pass it on */
+static int
+channel_kqueue_open(struct ssh_channels *sc)
+{
+	u_int i;
+
+	if (sc->kq != -1 && sc->kq_pid == getpid())
+		return 0;
+	for (i = 0; i < sc->kq_nlive; i++)
+		channel_kqueue_forget(sc, sc->kq_live[i]);
+	if ((sc->kq = kqueue()) == -1) {
+		error_f("kqueue: %s", strerror(errno));
+		sc->kq_failed = 1;
+		return -1;
+	}
+	sc->kq_pid = getpid();
+	return 0;
+}
+
+/*
+ * Runs the pre handlers and asks for the fds they want to be watched.
+ * The caller adds its own with channel_kqueue_want().
+ */
+void
+channel_prepare_kqueue(struct ssh *ssh, time_t *minwait_secs)
+{
+	struct ssh_channels *sc = ssh->chanctxt;
+	Channel *c;
+	u_int i, io;
+
+	/* Forget the events of the last wait */
+	for (i = 0; i < sc->kq_nlive; i++)
+		sc->kq_fds[sc->kq_live[i]] &= ~(CHAN_KQ_READY_R|CHAN_KQ_READY_W);
+
+	channel_before_prepare_select(ssh);
+	if (ssh_packet_is_rekeying(ssh))
+		return;
+	channel_handler(ssh, CHAN_PRE, minwait_secs);
+	for (i = 0; i < sc->channels_alloc; i++) {
+		if ((c = sc->channels[i]) == NULL || c->io_want == 0)
+			continue;
+		for (io = 1; io <= c->io_want; io <<= 1) {
+			if ((c->io_want & io) != 0)
+				channel_kqueue_want(ssh, channel_io_fd(c, io),
+				    (io & SSH_CHAN_IO_WRITE) != 0);
+		}
+	}
+}
+
+/* Watch fd for reading, or writing if "write" is set, until the next wait */
+void
+channel_kqueue_want(struct ssh *ssh, int fd, int write)
+{
+	struct ssh_channels *sc = ssh->chanctxt;
+	u_int n;
+
+	if (fd < 0)
+		return;
+	if ((u_int)fd >= sc->kq_nfds) {
+		n = MAXIMUM((u_int)fd + 1, sc->kq_nfds * 2);
+		sc->kq_fds = xrecallocarray(sc->kq_fds, sc->kq_nfds, n, 1);
+		sc->kq_nfds = n;
+	}
+	if ((sc->kq_fds[fd] & CHAN_KQ_LIVE) == 0) {
+		if (sc->kq_nlive >= sc->kq_live_alloc) {
+			n = sc->kq_live_alloc == 0 ? 16 : sc->kq_live_alloc * 2;
+			sc->kq_live = xrecallocarray(sc->kq_live,
+			    sc->kq_live_alloc, n, sizeof(*sc->kq_live));
+			sc->kq_live_alloc = n;
+		}
+		sc->kq_live[sc->kq_nlive++] = fd;
+		sc->kq_fds[fd] |= CHAN_KQ_LIVE;
+	}
+	sc->kq_fds[fd] |= write ? CHAN_KQ_WANT_W : CHAN_KQ_WANT_R;
+}
+
+/*
+ * Brings the registered filters in line with what was asked for since the
+ * last wait, then waits for events like select() would.  Only the
+ * difference is passed to the kernel, so a wakeup costs in proportion to
+ * the fds that changed state rather than to the number or value of the
+ * fds watched.  Returns the number of events or -1 with errno set.
+ */
+int
+channel_kqueue_wait(struct ssh *ssh, const struct timespec *timeout)
+{
+	struct ssh_channels *sc = ssh->chanctxt;
+	struct kevent *ev;
+	u_int i, j, n, nch = 0;
+	u_char st, want, reg;
+	int fd, nev;
+
+	if (channel_kqueue_open(sc) != 0)
+		return -1;
+
+	/* At most two changes and, with their errors, two events per fd */
+	n = MAXIMUM(sc->kq_nlive * 4, 4);
+	if (n > sc->kq_ev_alloc) {
+		sc->kq_ev = xrecallocarray(sc->kq_ev, sc->kq_ev_alloc, n,
+		    sizeof(*sc->kq_ev));
+		sc->kq_ev_alloc = n;
+	}
+	ev = sc->kq_ev;
+	for (i = j = 0; i < sc->kq_nlive; i++) {
+		fd = sc->kq_live[i];
+		st = sc->kq_fds[fd];
+		want = (st & (CHAN_KQ_WANT_R|CHAN_KQ_WANT_W)) >> 2;
+		if ((st ^ want) & CHAN_KQ_REG_R)
+			EV_SET(&ev[nch++], fd, EVFILT_READ,
+			    (want & CHAN_KQ_REG_R) ? EV_ADD : EV_DELETE,
+			    0, 0, NULL);
+		if ((st ^ want) & CHAN_KQ_REG_W)
+			EV_SET(&ev[nch++], fd, EVFILT_WRITE,
+			    (want & CHAN_KQ_REG_W) ? EV_ADD : EV_DELETE,
+			    0, 0, NULL);
+		if (want == 0) {
+			sc->kq_fds[fd] = 0;
+			continue;
+		}
+		sc->kq_fds[fd] = want | CHAN_KQ_LIVE;
+		sc->kq_live[j++] = fd;
+	}
+	sc->kq_nlive = j;
+
+	if ((nev = kevent(sc->kq, ev, nch, ev, n, timeout)) == -1)
+		return -1;
+	for (i = 0; i < (u_int)nev; i++) {
+		fd = (int)ev[i].ident;
+		if (fd < 0 || (u_int)fd >= sc->kq_nfds)
+			continue;
+		reg = ev[i].filter == EVFILT_READ ?
+		    CHAN_KQ_REG_R : CHAN_KQ_REG_W;
+		if ((ev[i].flags & EV_ERROR) == 0) {
+			sc->kq_fds[fd] |= reg << 4;
+			continue;
+		}
+		/* Failing to delete a filter that a close() dropped is fine */
+		if ((sc->kq_fds[fd] & reg) == 0)
+			continue;
+		sc->kq_fds[fd] &= ~reg;
+		if (ev[i].data == EBADF) {
+			/* Let the handler find out from its read or write */
+			sc->kq_fds[fd] |= reg << 4;
+			continue;
+		}
+		error_f("fd %d: %s", fd, strerror((int)ev[i].data));
+		sc->kq_failed = 1;
+	}
+	return nev;
+}
+
+/* Returns non-zero if the last wait found fd readable, or writable */
+int
+channel_kqueue_ready(struct ssh *ssh, int fd, int write)
+{
+	struct ssh_channels *sc = ssh->chanctxt;
+
+	if (fd < 0 || (u_int)fd >= sc->kq_nfds)
+		return 0;
+	return (sc->kq_fds[fd] &
+	    (write ? CHAN_KQ_READY_W : CHAN_KQ_READY_R)) != 0;
+}
+
+/*
+ * Returns non-zero once the kqueue could not be opened or refused an fd;
+ * the caller should go back to select().
+ */
+int
+channel_kqueue_failed(struct ssh *ssh)
+{
+	return ssh->chanctxt->kq_failed;
+}
+
+/* Like channel_after_select(), for the events of the last wait */
+void
+channel_after_kqueue(struct ssh *ssh)
+{
+	struct ssh_channels *sc = ssh->chanctxt;
+	Channel *c;
+	u_int i, io;
+
+	for (i = 0; i < sc->channels_alloc; i++) {
+		if ((c = sc->channels[i]) == NULL || c->io_want == 0)
+			continue;
+		for (io = 1; io <= c->io_want; io <<= 1) {
+			if ((c->io_want & io) != 0 &&
+			    channel_kqueue_ready(ssh, channel_io_fd(c, io),
+			    (io & SSH_CHAN_IO_WRITE) != 0))
+				c->io_ready |= io;
+		}
+	}
+	channel_handler(ssh, CHAN_POST, NULL);
 }
+#endif /* HAVE_KQUEUE */
 
 /*
  * Enqueue data for channels with open or draining c->input.
@@ -139,6 +139,8 @@ struct Channel {
 				 * to a matching pre-select handler.
 				 * this way post-select handlers are not
 				 * accidentally called if a FD gets reused */
+	u_int	io_want;	/* bitmask of SSH_CHAN_IO_* */
+	u_int	io_ready;	/* bitmask of SSH_CHAN_IO_* */
 	struct sshbuf *input;	/* data read from socket, to be sent over
 				 * encrypted connection */
 	struct sshbuf *output;	/* data received over encrypted connection for
@@ -158,6 +160,9 @@ struct Channel {
 	u_int	local_window_max;
 	u_int	local_consumed;
 	u_int	local_maxpacket;
+	u_int	local_window_limit;	/* grow local_window_max up to this */
+	double	local_window_sampled;	/* start of the throughput sample */
+	u_int64_t local_window_acked;	/* bytes adjusted since then */
 	int     extended_usage;
 	int	single_connection;
 
@@ -190,6 +195,16 @@ struct Channel {
 	int     		mux_downstream_id;
 };
 
+/* IO the pre handlers ask for and the post handlers are told about */
+#define SSH_CHAN_IO_RFD			0x01
+#define SSH_CHAN_IO_WFD			0x02
+#define SSH_CHAN_IO_EFD_R		0x04
+#define SSH_CHAN_IO_EFD_W		0x08
+#define SSH_CHAN_IO_SOCK_R		0x10
+#define SSH_CHAN_IO_SOCK_W		0x20
+#define SSH_CHAN_IO_WRITE \
+	(SSH_CHAN_IO_WFD|SSH_CHAN_IO_EFD_W|SSH_CHAN_IO_SOCK_W)
+
 #define CHAN_EXTENDED_IGNORE		0
 #define CHAN_EXTENDED_READ		1
 #define CHAN_EXTENDED_WRITE		2
@@ -197,6 +212,9 @@ struct Channel {
 /* default window/packet sizes for tcp/x11-fwd-channel */
 #define CHAN_SES_PACKET_DEFAULT	(32*1024)
 #define CHAN_SES_WINDOW_DEFAULT	(64*CHAN_SES_PACKET_DEFAULT)
+/* session windows grow with the link, up to ChannelWindowMax */
+#define CHAN_SES_WINDOW_MAX_DEFAULT	(16*1024*1024)
+#define CHAN_SES_WINDOW_LIMIT		(1024*1024*1024)
 #define CHAN_TCP_PACKET_DEFAULT	(32*1024)
 #define CHAN_TCP_WINDOW_DEFAULT	(64*CHAN_TCP_PACKET_DEFAULT)
 #define CHAN_X11_PACKET_DEFAULT	(16*1024)
@@ -291,6 +309,14 @@ int	 channel_input_status_confirm(int, u_int32_t, struct ssh *);
 void	 channel_prepare_select(struct ssh *, fd_set **, fd_set **, int *,
 	     u_int*, time_t*);
 void     channel_after_select(struct ssh *, fd_set *, fd_set *);
+#ifdef HAVE_KQUEUE
+void	 channel_prepare_kqueue(struct ssh *, time_t *);
+void	 channel_kqueue_want(struct ssh *, int, int);
+int	 channel_kqueue_wait(struct ssh *, const struct timespec *);
+int	 channel_kqueue_ready(struct ssh *, int, int);
+int	 channel_kqueue_failed(struct ssh *);
+void	 channel_after_kqueue(struct ssh *);
+#endif
 void     channel_output_poll(struct ssh *);
 
 int      channel_not_very_much_buffered_data(struct ssh *);
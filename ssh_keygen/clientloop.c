@@ -113,7 +113,7 @@
 #include "hostfile.h"
 
 /* import options */
-extern Options options;
+extern __thread Options options;
 
 /* Flag indicating that stdin should be redirected from /dev/null. */
 extern __thread int stdin_null_flag;
@@ -127,7 +127,7 @@ extern int fork_after_authentication_flag;
 #endif
 
 /* Control socket */
-extern int muxserver_sock; /* XXX use mux_client_cleanup() instead */
+extern __thread int muxserver_sock; /* XXX use mux_client_cleanup() instead */
 
 /*
  * Name of the host we are connecting to.  This is the name given on the
@@ -165,6 +165,9 @@ static __thread int need_rekeying;	/* Set to non-zero if rekeying is requested.
 static __thread int session_closed;	/* In SSH2: login session closed. */
 static __thread u_int x11_refuse_time;	/* If >0, refuse x11 opens after this time. */
 static __thread time_t server_alive_time;	/* Time to do server_alive_check */
+#ifdef HAVE_KQUEUE
+static __thread int use_kqueue;		/* Wait with kqueue(2), not select() */
+#endif
 
 static void client_init_dispatch(struct ssh *ssh);
 __thread int	session_ident = -1;
@@ -496,36 +499,71 @@ server_alive_check(struct ssh *ssh)
 
 /*
  * Waits until the client can do something (some data becomes available on
- * one of the file descriptors).
+ * one of the file descriptors).  Sets *conn_in_readyp and *conn_out_readyp
+ * if the server connection can be read or written.
+ *
+ * Where kqueue(2) is available it is used instead of select(): the channel
+ * code keeps the filters registered between calls, so a wakeup does not
+ * rebuild and rescan fd_sets sized by the highest fd in use.
  */
 static void
 client_wait_until_can_do_something(struct ssh *ssh,
     fd_set **readsetp, fd_set **writesetp,
-    int *maxfdp, u_int *nallocp, int rekeying)
+    int *maxfdp, u_int *nallocp, int *conn_in_readyp, int *conn_out_readyp,
+    int rekeying)
 {
 	struct timeval tv, *tvp;
+#ifdef HAVE_KQUEUE
+	struct timespec ts;
+#endif
 	int timeout_secs;
 	time_t minwait_secs = 0, now = monotime();
+	const char *what = "select";
 	int r, ret;
 
-	/* Add any selections by the channel mechanism. */
-	channel_prepare_select(ssh, readsetp, writesetp, maxfdp,
-	    nallocp, &minwait_secs);
+	*conn_in_readyp = *conn_out_readyp = 0;
 
-	/* channel_prepare_select could have closed the last channel */
-	if (session_closed && !channel_still_open(ssh) &&
-	    !ssh_packet_have_data_to_write(ssh)) {
-		/* clear mask since we did not call select() */
-		memset(*readsetp, 0, *nallocp);
-		memset(*writesetp, 0, *nallocp);
-		return;
+#ifdef HAVE_KQUEUE
+	if (use_kqueue && channel_kqueue_failed(ssh)) {
+		debug("kqueue failed, using select");
+		use_kqueue = 0;
 	}
+	if (use_kqueue) {
+		/* Add any selections by the channel mechanism. */
+		channel_prepare_kqueue(ssh, &minwait_secs);
 
-	FD_SET(connection_in, *readsetp);
+		/* channel_prepare_kqueue could have closed the last channel */
+		if (session_closed && !channel_still_open(ssh) &&
+		    !ssh_packet_have_data_to_write(ssh))
+			return;
 
-	/* Select server connection if have data to write to the server. */
-	if (ssh_packet_have_data_to_write(ssh))
-		FD_SET(connection_out, *writesetp);
+		channel_kqueue_want(ssh, connection_in, 0);
+
+		/* Watch server connection if have data to write to it. */
+		if (ssh_packet_have_data_to_write(ssh))
+			channel_kqueue_want(ssh, connection_out, 1);
+	} else
+#endif
+	{
+		/* Add any selections by the channel mechanism. */
+		channel_prepare_select(ssh, readsetp, writesetp, maxfdp,
+		    nallocp, &minwait_secs);
+
+		/* channel_prepare_select could have closed the last channel */
+		if (session_closed && !channel_still_open(ssh) &&
+		    !ssh_packet_have_data_to_write(ssh)) {
+			/* clear mask since we did not call select() */
+			memset(*readsetp, 0, *nallocp);
+			memset(*writesetp, 0, *nallocp);
+			return;
+		}
+
+		FD_SET(connection_in, *readsetp);
+
+		/* Select server connection if have data to write to it. */
+		if (ssh_packet_have_data_to_write(ssh))
+			FD_SET(connection_out, *writesetp);
+	}
 
 	/*
 	 * Wait for something to happen.  This will suspend the process until
@@ -548,32 +586,56 @@ client_wait_until_can_do_something(struct ssh *ssh,
 	}
 	if (minwait_secs != 0)
 		timeout_secs = MINIMUM(timeout_secs, (int)minwait_secs);
-	if (timeout_secs == INT_MAX)
-		tvp = NULL;
-	else {
-		tv.tv_sec = timeout_secs;
-		tv.tv_usec = 0;
-		tvp = &tv;
-	}
 
-	ret = select((*maxfdp)+1, *readsetp, *writesetp, NULL, tvp);
+#ifdef HAVE_KQUEUE
+	if (use_kqueue) {
+		what = "kevent";
+		ts.tv_sec = timeout_secs;
+		ts.tv_nsec = 0;
+		ret = channel_kqueue_wait(ssh,
+		    timeout_secs == INT_MAX ? NULL : &ts);
+		if (ret > 0) {
+			*conn_in_readyp =
+			    channel_kqueue_ready(ssh, connection_in, 0);
+			*conn_out_readyp =
+			    channel_kqueue_ready(ssh, connection_out, 1);
+		}
+	} else
+#endif
+	{
+		if (timeout_secs == INT_MAX)
+			tvp = NULL;
+		else {
+			tv.tv_sec = timeout_secs;
+			tv.tv_usec = 0;
+			tvp = &tv;
+		}
+
+		ret = select((*maxfdp)+1, *readsetp, *writesetp, NULL, tvp);
+		if (ret == -1) {
+			/*
+			 * We have to clear the select masks, because we
+			 * return.  We have to return, because the mainloop
+			 * checks for the flags set by the signal handlers.
+			 */
+			memset(*readsetp, 0, *nallocp);
+			memset(*writesetp, 0, *nallocp);
+		} else {
+			*conn_in_readyp = FD_ISSET(connection_in, *readsetp);
+			*conn_out_readyp =
+			    FD_ISSET(connection_out, *writesetp);
+		}
+	}
 	if (ret == -1) {
-		/*
-		 * We have to clear the select masks, because we return.
-		 * We have to return, because the mainloop checks for the flags
-		 * set by the signal handlers.
-		 */
-		memset(*readsetp, 0, *nallocp);
-		memset(*writesetp, 0, *nallocp);
 		if (errno == EINTR)
 			return;
 		/* Note: we might still have data in the buffers. */
 		if ((r = sshbuf_putf(stderr_buffer,
-		    "select: %s\r\n", strerror(errno))) != 0)
+		    "%s: %s\r\n", what, strerror(errno))) != 0)
 			fatal_fr(r, "sshbuf_putf");
 		quit_pending = 1;
-	} else if (options.server_alive_interval > 0 && !FD_ISSET(connection_in,
-	     *readsetp) && monotime() >= server_alive_time)
+	} else if (options.server_alive_interval > 0 && !*conn_in_readyp &&
+	    monotime() >= server_alive_time)
 		/*
 		 * ServerAlive check is needed. We can't rely on the select
 		 * timing out since traffic on the client side such as port
@@ -609,7 +671,7 @@ client_suspend_self(struct sshbuf *bin, struct sshbuf *bout, struct sshbuf *berr
 }
 
 static void
-client_process_net_input(struct ssh *ssh, fd_set *readset)
+client_process_net_input(struct ssh *ssh, int conn_in_ready)
 {
 	char buf[SSH_IOBUFSZ];
 	int r, len;
@@ -618,7 +680,7 @@ client_process_net_input(struct ssh *ssh, fd_set *readset)
 	 * Read input from the server, and add any such data to the buffer of
 	 * the packet subsystem.
 	 */
-	if (FD_ISSET(connection_in, readset)) {
+	if (conn_in_ready) {
 		schedule_server_alive_check();
 		/* Read as much as possible. */
 		len = read(connection_in, buf, sizeof(buf));
@@ -1222,6 +1284,7 @@ client_loop(struct ssh *ssh, int have_pty, int escape_char_arg,
 	fd_set *readset = NULL, *writeset = NULL;
 	double start_time, total_time;
 	int r, max_fd = 0, max_fd2 = 0, len;
+	int conn_in_ready, conn_out_ready;
 	u_int64_t ibytes, obytes;
 	u_int nalloc = 0;
 
@@ -1272,6 +1335,9 @@ client_loop(struct ssh *ssh, int have_pty, int escape_char_arg,
 	max_fd = MAXIMUM(connection_in, connection_out);
 
 	quit_pending = 0;
+#ifdef HAVE_KQUEUE
+	use_kqueue = 1;
+#endif
 
 	/* Initialize buffer. */
 	if ((stderr_buffer = sshbuf_new()) == NULL)
@@ -1351,17 +1417,24 @@ client_loop(struct ssh *ssh, int have_pty, int escape_char_arg,
 		 */
 		max_fd2 = max_fd;
 		client_wait_until_can_do_something(ssh, &readset, &writeset,
-		    &max_fd2, &nalloc, ssh_packet_is_rekeying(ssh));
+		    &max_fd2, &nalloc, &conn_in_ready, &conn_out_ready,
+		    ssh_packet_is_rekeying(ssh));
 
 		if (quit_pending)
 			break;
 
 		/* Do channel operations unless rekeying in progress. */
-		if (!ssh_packet_is_rekeying(ssh))
-			channel_after_select(ssh, readset, writeset);
+		if (!ssh_packet_is_rekeying(ssh)) {
+#ifdef HAVE_KQUEUE
+			if (use_kqueue)
+				channel_after_kqueue(ssh);
+			else
+#endif
+				channel_after_select(ssh, readset, writeset);
+		}
 
 		/* Buffer input from the connection.  */
-		client_process_net_input(ssh, readset);
+		client_process_net_input(ssh, conn_in_ready);
 
 		if (quit_pending)
 			break;
@@ -1370,7 +1443,7 @@ client_loop(struct ssh *ssh, int have_pty, int escape_char_arg,
 		 * Send as much buffered packet data as possible to the
 		 * sender.
 		 */
-		if (FD_ISSET(connection_out, writeset)) {
+		if (conn_out_ready) {
 			if ((r = ssh_packet_write_poll(ssh)) != 0) {
 				sshpkt_fatal(ssh, r,
 				    "%s: ssh_packet_write_poll", __func__);
@@ -79,6 +79,9 @@ void client_expect_confirm(struct ssh *, int, const char *,
 
 void	muxserver_listen(struct ssh *);
 int	muxclient(const char *);
+#if TARGET_OS_IPHONE
+void	mux_broker_unlisten(const char *);
+#endif
 void	mux_exit_message(struct ssh *, Channel *, int);
 void	mux_tty_alloc_failed(struct ssh *ssh, Channel *);
 
@@ -495,7 +495,7 @@
 /* #undef HAVE_ETC_DEFAULT_LOGIN */
 
 /* Define to 1 if you have the `EVP_chacha20' function. */
-#undef HAVE_EVP_CHACHA20
+#define HAVE_EVP_CHACHA20 1
 
 /* Define to 1 if you have the `EVP_CIPHER_CTX_ctrl' function. */
 #define HAVE_EVP_CIPHER_CTX_CTRL 1
@@ -825,6 +825,9 @@
 /* Define if you have isblank(3C). */
 #define HAVE_ISBLANK 1
 
+/* Define to 1 if you have the `kqueue' function. */
+#define HAVE_KQUEUE 1
+
 /* Define to 1 if you have the `krb5_cc_new_unique' function. */
 #define HAVE_KRB5_CC_NEW_UNIQUE 1
 
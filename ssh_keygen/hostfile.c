@@ -44,6 +44,7 @@
 #include <netinet/in.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <resolv.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -57,6 +58,7 @@
 #include "hostfile.h"
 #include "log.h"
 #include "misc.h"
+#include "misc.h"
 #include "pathnames.h"
 #include "ssherr.h"
 #include "digest.h"
@@ -283,19 +285,392 @@ load_hostkeys_file(struct hostkeys *hostkeys, const char *host,
 		debug3_f("loaded %lu keys from %s", ctx.num_loaded, host);
 }
 
+/*
+ * In-memory index of a known_hosts file, kept across lookups (and across
+ * the ssh, scp and sftp commands run in this process) until the file's
+ * size, inode or mtime changes. A lookup only replays the lines that can
+ * match through hostkeys_foreach_line(), so results are the same as a
+ * full scan:
+ *  - literal host names are kept in a sorted array of lowercased names;
+ *  - hashed entries are grouped by salt, so each distinct salt costs one
+ *    HMAC per lookup;
+ *  - lines with wildcards, negations or undecodable hashes are always
+ *    replayed.
+ * The last few lookups are remembered, so connecting again to the same
+ * host needs no HMAC at all.
+ */
+#define HOSTFILE_INDEX_MAX	8	/* files kept */
+#define HOSTFILE_INDEX_MEMO	16	/* lookups remembered per file */
+
+struct hostfile_index_name {
+	char *name;
+	u_int line;
+};
+
+struct hostfile_index_hash {
+	char *salt;
+	char *hosts;
+	u_int line;
+};
+
+struct hostfile_index_memo {
+	char *host;
+	u_int *lines;
+	u_int nlines;
+};
+
+struct hostfile_index {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	char **lines;
+	u_long *linenums;
+	u_int nlines;
+	struct hostfile_index_name *names;
+	u_int nnames;
+	struct hostfile_index_hash *hashes;
+	u_int nhashes;
+	u_int *always;
+	u_int nalways;
+	struct hostfile_index_memo memo[HOSTFILE_INDEX_MEMO];
+	u_int memo_next;
+};
+
+static struct hostfile_index *hostfile_indexes[HOSTFILE_INDEX_MAX];
+static pthread_mutex_t hostfile_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int hostkeys_foreach_line(const char *, char *, u_long,
+    struct hostkey_foreach_line *, hostkeys_foreach_fn *, void *,
+    const char *, const char *, u_int, u_int);
+
+static void
+hostfile_index_free(struct hostfile_index *idx)
+{
+	u_int i;
+
+	if (idx == NULL)
+		return;
+	for (i = 0; i < idx->nlines; i++)
+		free(idx->lines[i]);
+	for (i = 0; i < idx->nnames; i++)
+		free(idx->names[i].name);
+	for (i = 0; i < idx->nhashes; i++) {
+		free(idx->hashes[i].salt);
+		free(idx->hashes[i].hosts);
+	}
+	for (i = 0; i < HOSTFILE_INDEX_MEMO; i++) {
+		free(idx->memo[i].host);
+		free(idx->memo[i].lines);
+	}
+	free(idx->lines);
+	free(idx->linenums);
+	free(idx->names);
+	free(idx->hashes);
+	free(idx->always);
+	free(idx->path);
+	free(idx);
+}
+
+static int
+hostfile_index_name_cmp(const void *a, const void *b)
+{
+	const struct hostfile_index_name *na = a, *nb = b;
+	int r;
+
+	if ((r = strcmp(na->name, nb->name)) != 0)
+		return r;
+	return na->line < nb->line ? -1 : (na->line > nb->line);
+}
+
+static int
+hostfile_index_hash_cmp(const void *a, const void *b)
+{
+	const struct hostfile_index_hash *ha = a, *hb = b;
+	int r;
+
+	if ((r = strcmp(ha->salt, hb->salt)) != 0)
+		return r;
+	return ha->line < hb->line ? -1 : (ha->line > hb->line);
+}
+
+static int
+hostfile_index_line_cmp(const void *a, const void *b)
+{
+	u_int la = *(const u_int *)a, lb = *(const u_int *)b;
+
+	return la < lb ? -1 : (la > lb);
+}
+
+static void
+hostfile_index_always(struct hostfile_index *idx, u_int line)
+{
+	idx->always = xrecallocarray(idx->always, idx->nalways,
+	    idx->nalways + 1, sizeof(*idx->always));
+	idx->always[idx->nalways++] = line;
+}
+
+/* Sort one line's host patterns into the index */
+static void
+hostfile_index_add(struct hostfile_index *idx, u_int line)
+{
+	char *copy, *cp, *cp2, *name, *p;
+	u_char salt[256];
+	size_t l;
+
+	copy = cp = xstrdup(idx->lines[line]);
+	for (; *cp == ' ' || *cp == '\t'; cp++)
+		;
+	/* comments, blank lines and bad markers never match a host */
+	if (*cp == '\0' || *cp == '#' || check_markers(&cp) == MRK_ERROR)
+		goto out;
+	for (cp2 = cp; *cp2 && *cp2 != ' ' && *cp2 != '\t'; cp2++)
+		;
+	*cp2 = '\0';
+	l = strlen(cp);
+
+	if (*cp == HASH_DELIM) {
+		if (extract_salt(cp, l, salt, sizeof(salt)) == -1 ||
+		    (p = strchr(cp + sizeof(HASH_MAGIC) - 1,
+		    HASH_DELIM)) == NULL) {
+			hostfile_index_always(idx, line);
+			goto out;
+		}
+		idx->hashes = xrecallocarray(idx->hashes, idx->nhashes,
+		    idx->nhashes + 1, sizeof(*idx->hashes));
+		idx->hashes[idx->nhashes].salt = xstrdup(cp);
+		idx->hashes[idx->nhashes].salt[p - cp] = '\0';
+		idx->hashes[idx->nhashes].hosts = xstrdup(cp);
+		idx->hashes[idx->nhashes].line = line;
+		idx->nhashes++;
+		goto out;
+	}
+	if (strpbrk(cp, "*?!") != NULL) {
+		hostfile_index_always(idx, line);
+		goto out;
+	}
+	for (p = cp; (name = strsep(&p, ",")) != NULL;) {
+		if (*name == '\0')
+			continue;
+		idx->names = xrecallocarray(idx->names, idx->nnames,
+		    idx->nnames + 1, sizeof(*idx->names));
+		idx->names[idx->nnames].name = xstrdup(name);
+		lowercase(idx->names[idx->nnames].name);
+		idx->names[idx->nnames].line = line;
+		idx->nnames++;
+	}
+ out:
+	free(copy);
+}
+
+static struct hostfile_index *
+hostfile_index_build(const char *path, FILE *f, const struct stat *st)
+{
+	struct hostfile_index *idx;
+	char *line = NULL;
+	size_t linesize = 0;
+	u_long linenum = 0;
+	u_int i;
+
+	idx = xcalloc(1, sizeof(*idx));
+	idx->path = xstrdup(path);
+	idx->dev = st->st_dev;
+	idx->ino = st->st_ino;
+	idx->size = st->st_size;
+	idx->mtime = st->st_mtime;
+	while (getline(&line, &linesize, f) != -1) {
+		linenum++;
+		idx->lines = xrecallocarray(idx->lines, idx->nlines,
+		    idx->nlines + 1, sizeof(*idx->lines));
+		idx->linenums = xrecallocarray(idx->linenums, idx->nlines,
+		    idx->nlines + 1, sizeof(*idx->linenums));
+		idx->lines[idx->nlines] = xstrdup(line);
+		idx->linenums[idx->nlines] = linenum;
+		idx->nlines++;
+	}
+	free(line);
+	for (i = 0; i < idx->nlines; i++)
+		hostfile_index_add(idx, i);
+	if (idx->nnames > 0)
+		qsort(idx->names, idx->nnames, sizeof(*idx->names),
+		    hostfile_index_name_cmp);
+	if (idx->nhashes > 0)
+		qsort(idx->hashes, idx->nhashes, sizeof(*idx->hashes),
+		    hostfile_index_hash_cmp);
+	debug3_f("%s: %u lines, %u names, %u hashed, %u patterns", path,
+	    idx->nlines, idx->nnames, idx->nhashes, idx->nalways);
+	return idx;
+}
+
+/* Returns the sorted lines of idx that may match host */
+static u_int *
+hostfile_index_lookup(struct hostfile_index *idx, const char *host,
+    u_int *nlinesp)
+{
+	struct hostfile_index_memo *memo;
+	struct hostfile_index_name key, *n;
+	char *lhost, *hashed = NULL;
+	u_int i, j, nlines = 0, *lines = NULL;
+	size_t lo, hi, mid;
+
+	for (i = 0; i < HOSTFILE_INDEX_MEMO; i++) {
+		memo = &idx->memo[i];
+		if (memo->host != NULL && strcmp(memo->host, host) == 0) {
+			*nlinesp = memo->nlines;
+			return memo->lines;
+		}
+	}
+
+	lines = xcalloc(idx->nalways + 1, sizeof(*lines));
+	memcpy(lines, idx->always, idx->nalways * sizeof(*lines));
+	nlines = idx->nalways;
+
+	/* literal names: find the first match, then walk the run */
+	lhost = xstrdup(host);
+	lowercase(lhost);
+	key.name = lhost;
+	key.line = 0;
+	for (lo = 0, hi = idx->nnames; lo < hi;) {
+		mid = (lo + hi) / 2;
+		if (hostfile_index_name_cmp(&idx->names[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < idx->nnames; lo++) {
+		n = &idx->names[lo];
+		if (strcmp(n->name, lhost) != 0)
+			break;
+		lines = xrecallocarray(lines, nlines, nlines + 1,
+		    sizeof(*lines));
+		lines[nlines++] = n->line;
+	}
+	free(lhost);
+
+	/* hashed entries: one HMAC per distinct salt */
+	for (i = 0; i < idx->nhashes; i++) {
+		if (i == 0 ||
+		    strcmp(idx->hashes[i].salt, idx->hashes[i - 1].salt) != 0) {
+			free(hashed);
+			hashed = NULL;
+			if ((hashed = host_hash(host, idx->hashes[i].hosts,
+			    strlen(idx->hashes[i].hosts))) != NULL)
+				hashed = xstrdup(hashed);
+		}
+		if (hashed == NULL || strcmp(hashed, idx->hashes[i].hosts) != 0)
+			continue;
+		lines = xrecallocarray(lines, nlines, nlines + 1,
+		    sizeof(*lines));
+		lines[nlines++] = idx->hashes[i].line;
+	}
+	free(hashed);
+
+	/* replay in file order, each line once */
+	qsort(lines, nlines, sizeof(*lines), hostfile_index_line_cmp);
+	for (i = j = 0; i < nlines; i++) {
+		if (j == 0 || lines[j - 1] != lines[i])
+			lines[j++] = lines[i];
+	}
+	nlines = j;
+
+	memo = &idx->memo[idx->memo_next];
+	idx->memo_next = (idx->memo_next + 1) % HOSTFILE_INDEX_MEMO;
+	free(memo->host);
+	free(memo->lines);
+	memo->host = xstrdup(host);
+	memo->lines = lines;
+	memo->nlines = nlines;
+	*nlinesp = nlines;
+	return lines;
+}
+
+/*
+ * Returns the index for path, building it if needed.
+ * Called with hostfile_index_lock held.
+ */
+static struct hostfile_index *
+hostfile_index_get(const char *path, FILE *f)
+{
+	struct hostfile_index *idx;
+	struct stat st;
+	u_int i, slot = HOSTFILE_INDEX_MAX;
+
+	if (fstat(fileno(f), &st) == -1 || !S_ISREG(st.st_mode))
+		return NULL;
+	for (i = 0; i < HOSTFILE_INDEX_MAX; i++) {
+		if ((idx = hostfile_indexes[i]) == NULL) {
+			if (slot == HOSTFILE_INDEX_MAX)
+				slot = i;
+			continue;
+		}
+		if (strcmp(idx->path, path) != 0)
+			continue;
+		if (idx->dev == st.st_dev && idx->ino == st.st_ino &&
+		    idx->size == st.st_size && idx->mtime == st.st_mtime)
+			return idx;
+		debug3_f("%s changed, rebuilding index", path);
+		hostfile_index_free(idx);
+		hostfile_indexes[i] = NULL;
+		slot = i;
+		break;
+	}
+	if (slot == HOSTFILE_INDEX_MAX) {
+		/* table full: evict the first entry */
+		slot = 0;
+		hostfile_index_free(hostfile_indexes[slot]);
+	}
+	hostfile_indexes[slot] = hostfile_index_build(path, f, &st);
+	return hostfile_indexes[slot];
+}
+
 void
 load_hostkeys(struct hostkeys *hostkeys, const char *host, const char *path,
     u_int note)
 {
+	struct hostfile_index *idx;
+	struct hostkey_foreach_line lineinfo;
+	struct load_callback_ctx ctx;
 	FILE *f;
+	char *line;
+	u_int i, nlines, *lines;
+	int r;
 
 	if ((f = fopen(path, "r")) == NULL) {
 		debug_f("fopen %s: %s", path, strerror(errno));
 		return;
 	}
 
-	load_hostkeys_file(hostkeys, host, path, f, note);
+	pthread_mutex_lock(&hostfile_index_lock);
+	if ((idx = hostfile_index_get(path, f)) == NULL) {
+		pthread_mutex_unlock(&hostfile_index_lock);
+		load_hostkeys_file(hostkeys, host, path, f, note);
+		fclose(f);
+		return;
+	}
 	fclose(f);
+
+	ctx.host = host;
+	ctx.num_loaded = 0;
+	ctx.hostkeys = hostkeys;
+	memset(&lineinfo, 0, sizeof(lineinfo));
+	lines = hostfile_index_lookup(idx, host, &nlines);
+	for (i = 0; i < nlines; i++) {
+		line = xstrdup(idx->lines[lines[i]]);
+		r = hostkeys_foreach_line(path, line,
+		    idx->linenums[lines[i]], &lineinfo, record_hostkey, &ctx,
+		    host, NULL, HKF_WANT_MATCH|HKF_WANT_PARSE_KEY, note);
+		free(line);
+		if (r != 0) {
+			debug_fr(r, "hostkeys_foreach failed for %s", path);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hostfile_index_lock);
+	sshkey_free(lineinfo.key);
+	free(lineinfo.line);
+	if (ctx.num_loaded != 0)
+		debug3_f("loaded %lu keys from %s", ctx.num_loaded, host);
 }
 
 void
@@ -745,168 +1120,177 @@ match_maybe_hashed(const char *host, const char *names, int *was_hashed)
 	return match_hostname(host, names) == 1;
 }
 
-int
-hostkeys_foreach_file(const char *path, FILE *f, hostkeys_foreach_fn *callback,
+static int
+hostkeys_foreach_line(const char *path, char *line, u_long linenum,
+    struct hostkey_foreach_line *lineinfo, hostkeys_foreach_fn *callback,
     void *ctx, const char *host, const char *ip, u_int options, u_int note)
 {
-	char *line = NULL, ktype[128];
-	u_long linenum = 0;
+	char ktype[128];
 	char *cp, *cp2;
 	u_int kbits;
 	int hashed;
-	int s, r = 0;
-	struct hostkey_foreach_line lineinfo;
-	size_t linesize = 0, l;
+	int s;
+	size_t l;
+
+	line[strcspn(line, "\n")] = '\0';
+
+	free(lineinfo->line);
+	sshkey_free(lineinfo->key);
+	memset(lineinfo, 0, sizeof(*lineinfo));
+	lineinfo->path = path;
+	lineinfo->linenum = linenum;
+	lineinfo->line = xstrdup(line);
+	lineinfo->marker = MRK_NONE;
+	lineinfo->status = HKF_STATUS_OK;
+	lineinfo->keytype = KEY_UNSPEC;
+	lineinfo->note = note;
+
+	/* Skip any leading whitespace, comments and empty lines. */
+	for (cp = line; *cp == ' ' || *cp == '\t'; cp++)
+		;
+	if (!*cp || *cp == '#' || *cp == '\n') {
+		if ((options & HKF_WANT_MATCH) == 0) {
+			lineinfo->status = HKF_STATUS_COMMENT;
+			return callback(lineinfo, ctx);
+		}
+		return 0;
+	}
 
-	memset(&lineinfo, 0, sizeof(lineinfo));
-	if (host == NULL && (options & HKF_WANT_MATCH) != 0)
-		return SSH_ERR_INVALID_ARGUMENT;
+	if ((lineinfo->marker = check_markers(&cp)) == MRK_ERROR) {
+		verbose_f("invalid marker at %s:%lu", path, linenum);
+		if ((options & HKF_WANT_MATCH) == 0)
+			goto bad;
+		return 0;
+	}
 
-	while (getline(&line, &linesize, f) != -1) {
-		linenum++;
-		line[strcspn(line, "\n")] = '\0';
-
-		free(lineinfo.line);
-		sshkey_free(lineinfo.key);
-		memset(&lineinfo, 0, sizeof(lineinfo));
-		lineinfo.path = path;
-		lineinfo.linenum = linenum;
-		lineinfo.line = xstrdup(line);
-		lineinfo.marker = MRK_NONE;
-		lineinfo.status = HKF_STATUS_OK;
-		lineinfo.keytype = KEY_UNSPEC;
-		lineinfo.note = note;
-
-		/* Skip any leading whitespace, comments and empty lines. */
-		for (cp = line; *cp == ' ' || *cp == '\t'; cp++)
-			;
-		if (!*cp || *cp == '#' || *cp == '\n') {
-			if ((options & HKF_WANT_MATCH) == 0) {
-				lineinfo.status = HKF_STATUS_COMMENT;
-				if ((r = callback(&lineinfo, ctx)) != 0)
-					break;
-			}
-			continue;
+	/* Find the end of the host name portion. */
+	for (cp2 = cp; *cp2 && *cp2 != ' ' && *cp2 != '\t'; cp2++)
+		;
+	lineinfo->hosts = cp;
+	*cp2++ = '\0';
+
+	/* Check if the host name matches. */
+	if (host != NULL) {
+		if ((s = match_maybe_hashed(host, lineinfo->hosts,
+		    &hashed)) == -1) {
+			debug2_f("%s:%ld: bad host hash \"%.32s\"",
+			    path, linenum, lineinfo->hosts);
+			goto bad;
 		}
-
-		if ((lineinfo.marker = check_markers(&cp)) == MRK_ERROR) {
-			verbose_f("invalid marker at %s:%lu", path, linenum);
-			if ((options & HKF_WANT_MATCH) == 0)
-				goto bad;
-			continue;
+		if (s == 1) {
+			lineinfo->status = HKF_STATUS_MATCHED;
+			lineinfo->match |= HKF_MATCH_HOST |
+			    (hashed ? HKF_MATCH_HOST_HASHED : 0);
 		}
-
-		/* Find the end of the host name portion. */
-		for (cp2 = cp; *cp2 && *cp2 != ' ' && *cp2 != '\t'; cp2++)
-			;
-		lineinfo.hosts = cp;
-		*cp2++ = '\0';
-
-		/* Check if the host name matches. */
-		if (host != NULL) {
-			if ((s = match_maybe_hashed(host, lineinfo.hosts,
+		/* Try matching IP address if supplied */
+		if (ip != NULL) {
+			if ((s = match_maybe_hashed(ip, lineinfo->hosts,
 			    &hashed)) == -1) {
-				debug2_f("%s:%ld: bad host hash \"%.32s\"",
-				    path, linenum, lineinfo.hosts);
+				debug2_f("%s:%ld: bad ip hash "
+				    "\"%.32s\"", path, linenum,
+				    lineinfo->hosts);
 				goto bad;
 			}
 			if (s == 1) {
-				lineinfo.status = HKF_STATUS_MATCHED;
-				lineinfo.match |= HKF_MATCH_HOST |
-				    (hashed ? HKF_MATCH_HOST_HASHED : 0);
+				lineinfo->status = HKF_STATUS_MATCHED;
+				lineinfo->match |= HKF_MATCH_IP |
+				    (hashed ? HKF_MATCH_IP_HASHED : 0);
 			}
-			/* Try matching IP address if supplied */
-			if (ip != NULL) {
-				if ((s = match_maybe_hashed(ip, lineinfo.hosts,
-				    &hashed)) == -1) {
-					debug2_f("%s:%ld: bad ip hash "
-					    "\"%.32s\"", path, linenum,
-					    lineinfo.hosts);
-					goto bad;
-				}
-				if (s == 1) {
-					lineinfo.status = HKF_STATUS_MATCHED;
-					lineinfo.match |= HKF_MATCH_IP |
-					    (hashed ? HKF_MATCH_IP_HASHED : 0);
-				}
-			}
-			/*
-			 * Skip this line if host matching requested and
-			 * neither host nor address matched.
-			 */
-			if ((options & HKF_WANT_MATCH) != 0 &&
-			    lineinfo.status != HKF_STATUS_MATCHED)
-				continue;
 		}
+		/*
+		 * Skip this line if host matching requested and
+		 * neither host nor address matched.
+		 */
+		if ((options & HKF_WANT_MATCH) != 0 &&
+		    lineinfo->status != HKF_STATUS_MATCHED)
+			return 0;
+	}
+
+	/* Got a match.  Skip host name and any following whitespace */
+	for (; *cp2 == ' ' || *cp2 == '\t'; cp2++)
+		;
+	if (*cp2 == '\0' || *cp2 == '#') {
+		debug2("%s:%ld: truncated before key type",
+		    path, linenum);
+		goto bad;
+	}
+	lineinfo->rawkey = cp = cp2;
+
+	if ((options & HKF_WANT_PARSE_KEY) != 0) {
+		/*
+		 * Extract the key from the line.  This will skip
+		 * any leading whitespace.  Ignore badly formatted
+		 * lines.
+		 */
+		if ((lineinfo->key = sshkey_new(KEY_UNSPEC)) == NULL) {
+			error_f("sshkey_new failed");
+			return SSH_ERR_ALLOC_FAIL;
+		}
+		if (!hostfile_read_key(&cp, &kbits, lineinfo->key)) {
+			goto bad;
+		}
+		lineinfo->keytype = lineinfo->key->type;
+		lineinfo->comment = cp;
+	} else {
+		/* Extract and parse key type */
+		l = strcspn(lineinfo->rawkey, " \t");
+		if (l <= 1 || l >= sizeof(ktype) ||
+		    lineinfo->rawkey[l] == '\0')
+			goto bad;
+		memcpy(ktype, lineinfo->rawkey, l);
+		ktype[l] = '\0';
+		lineinfo->keytype = sshkey_type_from_name(ktype);
+
+		/*
+		 * Assume legacy RSA1 if the first component is a short
+		 * decimal number.
+		 */
+		if (lineinfo->keytype == KEY_UNSPEC && l < 8 &&
+		    strspn(ktype, "0123456789") == l)
+			goto bad;
 
-		/* Got a match.  Skip host name and any following whitespace */
+		/*
+		 * Check that something other than whitespace follows
+		 * the key type. This won't catch all corruption, but
+		 * it does catch trivial truncation.
+		 */
+		cp2 += l; /* Skip past key type */
 		for (; *cp2 == ' ' || *cp2 == '\t'; cp2++)
 			;
 		if (*cp2 == '\0' || *cp2 == '#') {
-			debug2("%s:%ld: truncated before key type",
+			debug2("%s:%ld: truncated after key type",
 			    path, linenum);
-			goto bad;
+			lineinfo->keytype = KEY_UNSPEC;
 		}
-		lineinfo.rawkey = cp = cp2;
-
-		if ((options & HKF_WANT_PARSE_KEY) != 0) {
-			/*
-			 * Extract the key from the line.  This will skip
-			 * any leading whitespace.  Ignore badly formatted
-			 * lines.
-			 */
-			if ((lineinfo.key = sshkey_new(KEY_UNSPEC)) == NULL) {
-				error_f("sshkey_new failed");
-				r = SSH_ERR_ALLOC_FAIL;
-				break;
-			}
-			if (!hostfile_read_key(&cp, &kbits, lineinfo.key)) {
-				goto bad;
-			}
-			lineinfo.keytype = lineinfo.key->type;
-			lineinfo.comment = cp;
-		} else {
-			/* Extract and parse key type */
-			l = strcspn(lineinfo.rawkey, " \t");
-			if (l <= 1 || l >= sizeof(ktype) ||
-			    lineinfo.rawkey[l] == '\0')
-				goto bad;
-			memcpy(ktype, lineinfo.rawkey, l);
-			ktype[l] = '\0';
-			lineinfo.keytype = sshkey_type_from_name(ktype);
-
-			/*
-			 * Assume legacy RSA1 if the first component is a short
-			 * decimal number.
-			 */
-			if (lineinfo.keytype == KEY_UNSPEC && l < 8 &&
-			    strspn(ktype, "0123456789") == l)
-				goto bad;
-
-			/*
-			 * Check that something other than whitespace follows
-			 * the key type. This won't catch all corruption, but
-			 * it does catch trivial truncation.
-			 */
-			cp2 += l; /* Skip past key type */
-			for (; *cp2 == ' ' || *cp2 == '\t'; cp2++)
-				;
-			if (*cp2 == '\0' || *cp2 == '#') {
-				debug2("%s:%ld: truncated after key type",
-				    path, linenum);
-				lineinfo.keytype = KEY_UNSPEC;
-			}
-			if (lineinfo.keytype == KEY_UNSPEC) {
+		if (lineinfo->keytype == KEY_UNSPEC) {
  bad:
-				sshkey_free(lineinfo.key);
-				lineinfo.key = NULL;
-				lineinfo.status = HKF_STATUS_INVALID;
-				if ((r = callback(&lineinfo, ctx)) != 0)
-					break;
-				continue;
-			}
+			sshkey_free(lineinfo->key);
+			lineinfo->key = NULL;
+			lineinfo->status = HKF_STATUS_INVALID;
+			return callback(lineinfo, ctx);
 		}
-		if ((r = callback(&lineinfo, ctx)) != 0)
+	}
+	return callback(lineinfo, ctx);
+}
+
+int
+hostkeys_foreach_file(const char *path, FILE *f, hostkeys_foreach_fn *callback,
+    void *ctx, const char *host, const char *ip, u_int options, u_int note)
+{
+	char *line = NULL;
+	u_long linenum = 0;
+	int r = 0;
+	struct hostkey_foreach_line lineinfo;
+	size_t linesize = 0;
+
+	memset(&lineinfo, 0, sizeof(lineinfo));
+	if (host == NULL && (options & HKF_WANT_MATCH) != 0)
+		return SSH_ERR_INVALID_ARGUMENT;
+
+	while (getline(&line, &linesize, f) != -1) {
+		linenum++;
+		if ((r = hostkeys_foreach_line(path, line, linenum, &lineinfo,
+		    callback, ctx, host, ip, options, note)) != 0)
 			break;
 	}
 	sshkey_free(lineinfo.key);
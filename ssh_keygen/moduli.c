@@ -47,6 +47,7 @@
 #include <openssl/dh.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -119,6 +120,10 @@
 #define BIT_CLEAR(a,n)	((a)[(n)>>SHIFT_WORD] &= ~(1L << ((n) & 31)))
 #define BIT_SET(a,n)	((a)[(n)>>SHIFT_WORD] |= (1L << ((n) & 31)))
 #define BIT_TEST(a,n)	((a)[(n)>>SHIFT_WORD] & (1L << ((n) & 31)))
+/* for the large sieve, which sieving threads mark concurrently */
+#define BIT_SET_SHARED(a,n) \
+	__atomic_fetch_or(&(a)[(n)>>SHIFT_WORD], (u_int32_t)(1L << ((n) & 31)), \
+	    __ATOMIC_RELAXED)
 
 /*
  * Prime testing defines
@@ -135,16 +140,60 @@
 static u_int32_t *TinySieve, tinybits;
 
 /* sieve 2**30 in 2**16 parts */
-static u_int32_t *SmallSieve, smallbits, smallbase;
+static u_int32_t smallwords, smallbits;
 
 /* sieve relative to the initial value */
 static u_int32_t *LargeSieve, largewords, largetries, largenumbers;
 static u_int32_t largebits, largememory;	/* megabytes */
 static BIGNUM *largebase;
 
-int gen_candidates(FILE *, u_int32_t, u_int32_t, BIGNUM *);
+/* next block of the small sieve to hand to a sieving thread */
+static u_int32_t small_next;
+static pthread_mutex_t small_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int gen_candidates(FILE *, u_int32_t, u_int32_t, BIGNUM *, u_int);
 int prime_test(FILE *, FILE *, u_int32_t, u_int32_t, char *, unsigned long,
-    unsigned long);
+    unsigned long, u_int);
+
+/*
+ * Worker threads start with their own (empty) thread-local stdio and
+ * log settings; copy the caller's so that logging keeps working.
+ */
+struct moduli_env {
+	FILE *in, *out, *err;
+	LogLevel level;
+};
+
+static void
+moduli_env_save(struct moduli_env *env)
+{
+	env->in = thread_stdin;
+	env->out = thread_stdout;
+	env->err = thread_stderr;
+	env->level = log_level_get();
+}
+
+static void
+moduli_env_restore(const struct moduli_env *env)
+{
+	thread_stdin = env->in;
+	thread_stdout = env->out;
+	thread_stderr = env->err;
+	log_init("ssh-keygen", env->level, SYSLOG_FACILITY_USER, 1);
+}
+
+/* Number of threads to use when the caller did not ask for a number */
+static u_int
+moduli_threads(u_int threads)
+{
+	long n;
+
+	if (threads != 0)
+		return threads;
+	if ((n = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		return 1;
+	return n > 64 ? 64 : (u_int)n;
+}
 
 /*
  * print moduli out in consistent form,
@@ -184,12 +233,12 @@ qfileout(FILE * ofile, u_int32_t otype, u_int32_t otests, u_int32_t otries,
  ** Sieve p's and q's with small factors
  */
 static void
-sieve_large(u_int32_t s)
+sieve_large(u_int32_t s, u_int32_t *tries, int shared)
 {
 	u_int32_t r, u;
 
 	debug3("sieve_large %u", s);
-	largetries++;
+	(*tries)++;
 	/* r = largebase mod s */
 	r = BN_mod_word(largebase, s);
 	if (r == 0)
@@ -207,8 +256,12 @@ sieve_large(u_int32_t s)
 			u += s; /* Make largebase+u odd, and u even */
 
 		/* Mark all multiples of 2*s */
-		for (u /= 2; u < largebits; u += s)
-			BIT_SET(LargeSieve, u);
+		for (u /= 2; u < largebits; u += s) {
+			if (shared)
+				BIT_SET_SHARED(LargeSieve, u);
+			else
+				BIT_SET(LargeSieve, u);
+		}
 	}
 
 	/* r = p mod s */
@@ -231,9 +284,94 @@ sieve_large(u_int32_t s)
 		}
 
 		/* Mark all multiples of 4*s */
-		for (u /= 4; u < largebits; u += s)
-			BIT_SET(LargeSieve, u);
+		for (u /= 4; u < largebits; u += s) {
+			if (shared)
+				BIT_SET_SHARED(LargeSieve, u);
+			else
+				BIT_SET(LargeSieve, u);
+		}
+	}
+}
+
+/*
+ * Sieve one 2**16 block of small numbers starting at smallbase with the
+ * tiny primes, then sieve the large sieve with the primes that remain.
+ */
+static void
+sieve_small(u_int32_t *SmallSieve, u_int32_t smallbase, u_int32_t *tries,
+    int shared)
+{
+	u_int32_t i, r, s, t;
+
+	for (i = 0; i < tinybits; i++) {
+		if (BIT_TEST(TinySieve, i))
+			continue; /* 2*i+3 is composite */
+
+		/* The next tiny prime */
+		t = 2 * i + 3;
+		r = smallbase % t;
+
+		if (r == 0) {
+			s = 0; /* t divides into smallbase exactly */
+		} else {
+			/* smallbase+s is first entry divisible by t */
+			s = t - r;
+		}
+
+		/*
+		 * The sieve omits even numbers, so ensure that
+		 * smallbase+s is odd. Then, step through the sieve
+		 * in increments of 2*t
+		 */
+		if (s & 1)
+			s += t; /* Make smallbase+s odd, and s even */
+
+		/* Mark all multiples of 2*t */
+		for (s /= 2; s < smallbits; s += t)
+			BIT_SET(SmallSieve, s);
+	}
+
+	/*
+	 * SmallSieve
+	 */
+	for (i = 0; i < smallbits; i++) {
+		if (BIT_TEST(SmallSieve, i))
+			continue; /* 2*i+smallbase is composite */
+
+		/* The next small prime */
+		sieve_large((2 * i) + smallbase, tries, shared);
+	}
+
+	memset(SmallSieve, 0, smallwords << SHIFT_BYTE);
+}
+
+struct sieve_thread {
+	pthread_t thread;
+	struct moduli_env env;
+	u_int32_t tries;
+};
+
+/* Take blocks of the small sieve until none are left */
+static void *
+sieve_thread_main(void *arg)
+{
+	struct sieve_thread *st = arg;
+	u_int32_t *SmallSieve, smallbase;
+
+	moduli_env_restore(&st->env);
+	SmallSieve = xcalloc(smallwords, sizeof(u_int32_t));
+	for (;;) {
+		pthread_mutex_lock(&small_lock);
+		smallbase = small_next;
+		if (smallbase < (SMALL_MAXIMUM - TINY_NUMBER))
+			small_next += TINY_NUMBER;
+		pthread_mutex_unlock(&small_lock);
+		if (smallbase >= (SMALL_MAXIMUM - TINY_NUMBER))
+			break;
+		sieve_small(SmallSieve, smallbase, &st->tries, 1);
 	}
+	free(SmallSieve);
+	return NULL;
 }
 
 /*
@@ -242,16 +380,21 @@ sieve_large(u_int32_t s)
  * The list is checked against small known primes (less than 2**30).
  */
 int
-gen_candidates(FILE *out, u_int32_t memory, u_int32_t power, BIGNUM *start)
+gen_candidates(FILE *out, u_int32_t memory, u_int32_t power, BIGNUM *start,
+    u_int threads)
 {
 	BIGNUM *q;
-	u_int32_t j, r, s, t;
-	u_int32_t smallwords = TINY_NUMBER >> 6;
+	u_int32_t j, r, t;
 	u_int32_t tinywords = TINY_NUMBER >> 6;
+	u_int32_t *SmallSieve;
+	struct sieve_thread *st;
 	time_t time_start, time_stop;
 	u_int32_t i;
+	u_int n;
 	int ret = 0;
 
+	smallwords = TINY_NUMBER >> 6;
+
 	largememory = memory;
 
 	if (memory != 0 &&
@@ -360,56 +503,35 @@ gen_candidates(FILE *out, u_int32_t memory, u_int32_t power, BIGNUM *start)
 		for (j = i + t; j < tinybits; j += t)
 			BIT_SET(TinySieve, j);
 
-		sieve_large(t);
+		sieve_large(t, &largetries, 0);
 	}
 
 	/*
 	 * Start the small block search at the next possible prime. To avoid
-	 * fencepost errors, the last pass is skipped.
+	 * fencepost errors, the last pass is skipped. The blocks are
+	 * independent, so they are shared out between threads which mark
+	 * the large sieve with atomic operations.
 	 */
-	for (smallbase = TINY_NUMBER + 3;
-	    smallbase < (SMALL_MAXIMUM - TINY_NUMBER);
-	    smallbase += TINY_NUMBER) {
-		for (i = 0; i < tinybits; i++) {
-			if (BIT_TEST(TinySieve, i))
-				continue; /* 2*i+3 is composite */
-
-			/* The next tiny prime */
-			t = 2 * i + 3;
-			r = smallbase % t;
-
-			if (r == 0) {
-				s = 0; /* t divides into smallbase exactly */
-			} else {
-				/* smallbase+s is first entry divisible by t */
-				s = t - r;
-			}
-
-			/*
-			 * The sieve omits even numbers, so ensure that
-			 * smallbase+s is odd. Then, step through the sieve
-			 * in increments of 2*t
-			 */
-			if (s & 1)
-				s += t; /* Make smallbase+s odd, and s even */
-
-			/* Mark all multiples of 2*t */
-			for (s /= 2; s < smallbits; s += t)
-				BIT_SET(SmallSieve, s);
+	threads = moduli_threads(threads);
+	small_next = TINY_NUMBER + 3;
+	if (threads == 1) {
+		for (; small_next < (SMALL_MAXIMUM - TINY_NUMBER);
+		    small_next += TINY_NUMBER)
+			sieve_small(SmallSieve, small_next, &largetries, 0);
+	} else {
+		debug("sieving with %u threads", threads);
+		st = xcalloc(threads, sizeof(*st));
+		for (n = 0; n < threads; n++) {
+			moduli_env_save(&st[n].env);
+			if (pthread_create(&st[n].thread, NULL,
+			    sieve_thread_main, &st[n]) != 0)
+				fatal("pthread_create: %s", strerror(errno));
 		}
-
-		/*
-		 * SmallSieve
-		 */
-		for (i = 0; i < smallbits; i++) {
-			if (BIT_TEST(SmallSieve, i))
-				continue; /* 2*i+smallbase is composite */
-
-			/* The next small prime */
-			sieve_large((2 * i) + smallbase);
+		for (n = 0; n < threads; n++) {
+			pthread_join(st[n].thread, NULL);
+			largetries += st[n].tries;
 		}
-
-		memset(SmallSieve, 0, smallwords << SHIFT_BYTE);
+		free(st);
 	}
 
 	time(&time_stop);
@@ -567,6 +689,292 @@ print_progress(unsigned long start_lineno, unsigned long current_lineno,
 	free(eta_str);
 }
 
+/* Result of screening one line of the candidate file */
+struct screen_result {
+	int status;		/* SCREEN_* */
+	u_int32_t tests, tries, size, generator;
+};
+#define SCREEN_SKIPPED	0	/* comment, bad line or unwanted generator */
+#define SCREEN_FAILED	1	/* tested, not a safe prime */
+#define SCREEN_PRIME	2	/* safe prime, left in p */
+
+/*
+ * perform a Miller-Rabin primality test on one candidate line
+ * (checking both q and p)
+ */
+static void
+screen_line(const char *lp, u_int32_t count_in, u_int32_t trials,
+    u_int32_t generator_wanted, BIGNUM *p, BIGNUM *q,
+    struct screen_result *res)
+{
+	BIGNUM *a;
+	char *cp;
+	u_int32_t generator_known, in_tests, in_tries, in_type, in_size;
+	int is_prime;
+
+	res->status = SCREEN_SKIPPED;
+	if (strlen(lp) < 14 || *lp == '!' || *lp == '#') {
+		debug2("%10u: comment or short line", count_in);
+		return;
+	}
+
+	/* XXX - fragile parser */
+	/* time */
+	cp = (char *)&lp[14];	/* (skip) */
+
+	/* type */
+	in_type = strtoul(cp, &cp, 10);
+
+	/* tests */
+	in_tests = strtoul(cp, &cp, 10);
+
+	if (in_tests & MODULI_TESTS_COMPOSITE) {
+		debug2("%10u: known composite", count_in);
+		return;
+	}
+
+	/* tries */
+	in_tries = strtoul(cp, &cp, 10);
+
+	/* size (most significant bit) */
+	in_size = strtoul(cp, &cp, 10);
+
+	/* generator (hex) */
+	generator_known = strtoul(cp, &cp, 16);
+
+	/* Skip white space */
+	cp += strspn(cp, " ");
+
+	/* modulus (hex) */
+	switch (in_type) {
+	case MODULI_TYPE_SOPHIE_GERMAIN:
+		debug2("%10u: (%u) Sophie-Germain", count_in, in_type);
+		a = q;
+		if (BN_hex2bn(&a, cp) == 0)
+			fatal("BN_hex2bn failed");
+		/* p = 2*q + 1 */
+		if (BN_lshift(p, q, 1) == 0)
+			fatal("BN_lshift failed");
+		if (BN_add_word(p, 1) == 0)
+			fatal("BN_add_word failed");
+		in_size += 1;
+		generator_known = 0;
+		break;
+	case MODULI_TYPE_UNSTRUCTURED:
+	case MODULI_TYPE_SAFE:
+	case MODULI_TYPE_SCHNORR:
+	case MODULI_TYPE_STRONG:
+	case MODULI_TYPE_UNKNOWN:
+		debug2("%10u: (%u)", count_in, in_type);
+		a = p;
+		if (BN_hex2bn(&a, cp) == 0)
+			fatal("BN_hex2bn failed");
+		/* q = (p-1) / 2 */
+		if (BN_rshift(q, p, 1) == 0)
+			fatal("BN_rshift failed");
+		break;
+	default:
+		debug2("Unknown prime type");
+		break;
+	}
+
+	/*
+	 * due to earlier inconsistencies in interpretation, check
+	 * the proposed bit size.
+	 */
+	if ((u_int32_t)BN_num_bits(p) != (in_size + 1)) {
+		debug2("%10u: bit size %u mismatch", count_in, in_size);
+		return;
+	}
+	if (in_size < QSIZE_MINIMUM) {
+		debug2("%10u: bit size %u too short", count_in, in_size);
+		return;
+	}
+
+	if (in_tests & MODULI_TESTS_MILLER_RABIN)
+		in_tries += trials;
+	else
+		in_tries = trials;
+
+	/*
+	 * guess unknown generator
+	 */
+	if (generator_known == 0) {
+		if (BN_mod_word(p, 24) == 11)
+			generator_known = 2;
+		else {
+			u_int32_t r = BN_mod_word(p, 10);
+
+			if (r == 3 || r == 7)
+				generator_known = 5;
+		}
+	}
+	/*
+	 * skip tests when desired generator doesn't match
+	 */
+	if (generator_wanted > 0 &&
+	    generator_wanted != generator_known) {
+		debug2("%10u: generator %d != %d",
+		    count_in, generator_known, generator_wanted);
+		return;
+	}
+
+	/*
+	 * Primes with no known generator are useless for DH, so
+	 * skip those.
+	 */
+	if (generator_known == 0) {
+		debug2("%10u: no known generator", count_in);
+		return;
+	}
+
+	res->status = SCREEN_FAILED;
+
+	/*
+	 * The (1/4)^N performance bound on Miller-Rabin is
+	 * extremely pessimistic, so don't spend a lot of time
+	 * really verifying that q is prime until after we know
+	 * that p is also prime. A single pass will weed out the
+	 * vast majority of composite q's.
+	 */
+	is_prime = BN_is_prime_ex(q, 1, NULL, NULL);
+	if (is_prime < 0)
+		fatal("BN_is_prime_ex failed");
+	if (is_prime == 0) {
+		debug("%10u: q failed first possible prime test",
+		    count_in);
+		return;
+	}
+
+	/*
+	 * q is possibly prime, so go ahead and really make sure
+	 * that p is prime. If it is, then we can go back and do
+	 * the same for q. If p is composite, chances are that
+	 * will show up on the first Rabin-Miller iteration so it
+	 * doesn't hurt to specify a high iteration count.
+	 */
+	is_prime = BN_is_prime_ex(p, trials, NULL, NULL);
+	if (is_prime < 0)
+		fatal("BN_is_prime_ex failed");
+	if (is_prime == 0) {
+		debug("%10u: p is not prime", count_in);
+		return;
+	}
+	debug("%10u: p is almost certainly prime", count_in);
+
+	/* recheck q more rigorously */
+	is_prime = BN_is_prime_ex(q, trials - 1, NULL, NULL);
+	if (is_prime < 0)
+		fatal("BN_is_prime_ex failed");
+	if (is_prime == 0) {
+		debug("%10u: q is not prime", count_in);
+		return;
+	}
+	debug("%10u: q is almost certainly prime", count_in);
+
+	res->status = SCREEN_PRIME;
+	res->tests = in_tests | MODULI_TESTS_MILLER_RABIN;
+	res->tries = in_tries;
+	res->size = in_size;
+	res->generator = generator_known;
+}
+
+/*
+ * Lines are screened by a pool of threads. The reader queues them in a
+ * ring; results are written, and the checkpoint advanced, strictly in
+ * input order, so a checkpoint never covers a line still being tested.
+ */
+struct screen_job {
+	char *line;
+	u_int32_t lineno;
+	int done;
+	struct screen_result res;
+	BIGNUM *p;
+};
+
+struct screen_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct screen_job *jobs;
+	u_int njobs;
+	u_int64_t queued, taken, written;
+	int eof;
+	u_int32_t trials, generator_wanted;
+	struct moduli_env env;
+};
+
+static void *
+screen_thread_main(void *arg)
+{
+	struct screen_pool *pool = arg;
+	struct screen_job *job;
+	BIGNUM *p, *q;
+
+	moduli_env_restore(&pool->env);
+	if ((p = BN_new()) == NULL || (q = BN_new()) == NULL)
+		fatal("BN_new failed");
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->taken == pool->queued && !pool->eof)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->taken == pool->queued)
+			break;
+		job = &pool->jobs[pool->taken++ % pool->njobs];
+		pthread_mutex_unlock(&pool->lock);
+
+		screen_line(job->line, job->lineno, pool->trials,
+		    pool->generator_wanted, p, q, &job->res);
+		if (job->res.status == SCREEN_PRIME &&
+		    (job->p = BN_dup(p)) == NULL)
+			fatal("BN_dup failed");
+
+		pthread_mutex_lock(&pool->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	BN_free(p);
+	BN_free(q);
+	return NULL;
+}
+
+/*
+ * Write out the results at the head of the ring that are complete.
+ * Called with the pool locked. Returns -1 if writing failed.
+ */
+static int
+screen_write(struct screen_pool *pool, FILE *out, char *checkpoint_file,
+    u_int32_t *count_out, u_int32_t *count_possible)
+{
+	struct screen_job *job;
+	int ret = 0;
+
+	while (pool->written < pool->queued) {
+		job = &pool->jobs[pool->written % pool->njobs];
+		if (!job->done)
+			break;
+		if (job->res.status != SCREEN_SKIPPED)
+			(*count_possible)++;
+		if (job->res.status == SCREEN_PRIME && ret == 0) {
+			if (qfileout(out, MODULI_TYPE_SAFE, job->res.tests,
+			    job->res.tries, job->res.size,
+			    job->res.generator, job->p))
+				ret = -1;
+			else
+				(*count_out)++;
+		}
+		if (checkpoint_file != NULL && ret == 0)
+			write_checkpoint(checkpoint_file, job->lineno);
+		BN_free(job->p);
+		job->p = NULL;
+		free(job->line);
+		job->line = NULL;
+		job->done = 0;
+		pool->written++;
+	}
+	return ret;
+}
+
 /*
  * perform a Miller-Rabin primality test
  * on the list of candidates
@@ -575,15 +983,18 @@ print_progress(unsigned long start_lineno, unsigned long current_lineno,
  */
 int
 prime_test(FILE *in, FILE *out, u_int32_t trials, u_int32_t generator_wanted,
-    char *checkpoint_file, unsigned long start_lineno, unsigned long num_lines)
+    char *checkpoint_file, unsigned long start_lineno, unsigned long num_lines,
+    u_int threads)
 {
-	BIGNUM *q, *p, *a;
-	char *cp, *lp;
+	struct screen_pool pool;
+	struct screen_job *job;
+	pthread_t *tids;
+	char *lp;
 	u_int32_t count_in = 0, count_out = 0, count_possible = 0;
-	u_int32_t generator_known, in_tests, in_tries, in_type, in_size;
 	unsigned long last_processed = 0, end_lineno;
 	time_t time_start, time_stop;
-	int res, is_prime;
+	u_int n;
+	int res;
 
 	if (trials < TRIAL_MINIMUM) {
 		error("Minimum primality trials is %d", TRIAL_MINIMUM);
@@ -597,13 +1008,10 @@ prime_test(FILE *in, FILE *out, u_int32_t trials, u_int32_t generator_wanted,
 
 	time(&time_start);
 
-	if ((p = BN_new()) == NULL)
-		fatal("BN_new failed");
-	if ((q = BN_new()) == NULL)
-		fatal("BN_new failed");
-
-	debug2("%.24s Final %u Miller-Rabin trials (%x generator)",
-	    ctime(&time_start), trials, generator_wanted);
+	threads = moduli_threads(threads);
+	debug2("%.24s Final %u Miller-Rabin trials (%x generator), "
+	    "%u threads", ctime(&time_start), trials, generator_wanted,
+	    threads);
 
 	if (checkpoint_file != NULL)
 		last_processed = read_checkpoint(checkpoint_file);
@@ -614,193 +1022,80 @@ prime_test(FILE *in, FILE *out, u_int32_t trials, u_int32_t generator_wanted,
 		debug("process from line %lu to line %lu", last_processed,
 		    end_lineno);
 
+	memset(&pool, 0, sizeof(pool));
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+	pool.njobs = threads * 4;
+	pool.jobs = xcalloc(pool.njobs, sizeof(*pool.jobs));
+	pool.trials = trials;
+	pool.generator_wanted = generator_wanted;
+	moduli_env_save(&pool.env);
+	tids = xcalloc(threads, sizeof(*tids));
+	for (n = 0; n < threads; n++) {
+		if (pthread_create(&tids[n], NULL, screen_thread_main,
+		    &pool) != 0)
+			fatal("pthread_create: %s", strerror(errno));
+	}
+
 	res = 0;
 	lp = xmalloc(QLINESIZE + 1);
-	while (fgets(lp, QLINESIZE + 1, in) != NULL && count_in < end_lineno) {
+	pthread_mutex_lock(&pool.lock);
+	while (res == 0 && count_in < end_lineno) {
+		pthread_mutex_unlock(&pool.lock);
+		if (fgets(lp, QLINESIZE + 1, in) == NULL) {
+			pthread_mutex_lock(&pool.lock);
+			break;
+		}
 		count_in++;
+		pthread_mutex_lock(&pool.lock);
 		if (count_in <= last_processed) {
 			debug3("skipping line %u, before checkpoint or "
 			    "specified start line", count_in);
 			continue;
 		}
-		if (checkpoint_file != NULL)
-			write_checkpoint(checkpoint_file, count_in);
 		print_progress(start_lineno, count_in, end_lineno);
-		if (strlen(lp) < 14 || *lp == '!' || *lp == '#') {
-			debug2("%10u: comment or short line", count_in);
-			continue;
-		}
-
-		/* XXX - fragile parser */
-		/* time */
-		cp = &lp[14];	/* (skip) */
-
-		/* type */
-		in_type = strtoul(cp, &cp, 10);
-
-		/* tests */
-		in_tests = strtoul(cp, &cp, 10);
-
-		if (in_tests & MODULI_TESTS_COMPOSITE) {
-			debug2("%10u: known composite", count_in);
-			continue;
-		}
-
-		/* tries */
-		in_tries = strtoul(cp, &cp, 10);
-
-		/* size (most significant bit) */
-		in_size = strtoul(cp, &cp, 10);
-
-		/* generator (hex) */
-		generator_known = strtoul(cp, &cp, 16);
-
-		/* Skip white space */
-		cp += strspn(cp, " ");
-
-		/* modulus (hex) */
-		switch (in_type) {
-		case MODULI_TYPE_SOPHIE_GERMAIN:
-			debug2("%10u: (%u) Sophie-Germain", count_in, in_type);
-			a = q;
-			if (BN_hex2bn(&a, cp) == 0)
-				fatal("BN_hex2bn failed");
-			/* p = 2*q + 1 */
-			if (BN_lshift(p, q, 1) == 0)
-				fatal("BN_lshift failed");
-			if (BN_add_word(p, 1) == 0)
-				fatal("BN_add_word failed");
-			in_size += 1;
-			generator_known = 0;
-			break;
-		case MODULI_TYPE_UNSTRUCTURED:
-		case MODULI_TYPE_SAFE:
-		case MODULI_TYPE_SCHNORR:
-		case MODULI_TYPE_STRONG:
-		case MODULI_TYPE_UNKNOWN:
-			debug2("%10u: (%u)", count_in, in_type);
-			a = p;
-			if (BN_hex2bn(&a, cp) == 0)
-				fatal("BN_hex2bn failed");
-			/* q = (p-1) / 2 */
-			if (BN_rshift(q, p, 1) == 0)
-				fatal("BN_rshift failed");
-			break;
-		default:
-			debug2("Unknown prime type");
+		/* wait for room in the ring */
+		while ((res = screen_write(&pool, out, checkpoint_file,
+		    &count_out, &count_possible)) == 0 &&
+		    pool.queued - pool.written == pool.njobs)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		if (res != 0)
 			break;
-		}
-
-		/*
-		 * due to earlier inconsistencies in interpretation, check
-		 * the proposed bit size.
-		 */
-		if ((u_int32_t)BN_num_bits(p) != (in_size + 1)) {
-			debug2("%10u: bit size %u mismatch", count_in, in_size);
-			continue;
-		}
-		if (in_size < QSIZE_MINIMUM) {
-			debug2("%10u: bit size %u too short", count_in, in_size);
-			continue;
-		}
-
-		if (in_tests & MODULI_TESTS_MILLER_RABIN)
-			in_tries += trials;
-		else
-			in_tries = trials;
-
-		/*
-		 * guess unknown generator
-		 */
-		if (generator_known == 0) {
-			if (BN_mod_word(p, 24) == 11)
-				generator_known = 2;
-			else {
-				u_int32_t r = BN_mod_word(p, 10);
-
-				if (r == 3 || r == 7)
-					generator_known = 5;
-			}
-		}
-		/*
-		 * skip tests when desired generator doesn't match
-		 */
-		if (generator_wanted > 0 &&
-		    generator_wanted != generator_known) {
-			debug2("%10u: generator %d != %d",
-			    count_in, generator_known, generator_wanted);
-			continue;
-		}
-
-		/*
-		 * Primes with no known generator are useless for DH, so
-		 * skip those.
-		 */
-		if (generator_known == 0) {
-			debug2("%10u: no known generator", count_in);
-			continue;
-		}
-
-		count_possible++;
-
-		/*
-		 * The (1/4)^N performance bound on Miller-Rabin is
-		 * extremely pessimistic, so don't spend a lot of time
-		 * really verifying that q is prime until after we know
-		 * that p is also prime. A single pass will weed out the
-		 * vast majority of composite q's.
-		 */
-		is_prime = BN_is_prime_ex(q, 1, NULL, NULL);
-		if (is_prime < 0)
-			fatal("BN_is_prime_ex failed");
-		if (is_prime == 0) {
-			debug("%10u: q failed first possible prime test",
-			    count_in);
-			continue;
-		}
-
-		/*
-		 * q is possibly prime, so go ahead and really make sure
-		 * that p is prime. If it is, then we can go back and do
-		 * the same for q. If p is composite, chances are that
-		 * will show up on the first Rabin-Miller iteration so it
-		 * doesn't hurt to specify a high iteration count.
-		 */
-		is_prime = BN_is_prime_ex(p, trials, NULL, NULL);
-		if (is_prime < 0)
-			fatal("BN_is_prime_ex failed");
-		if (is_prime == 0) {
-			debug("%10u: p is not prime", count_in);
-			continue;
-		}
-		debug("%10u: p is almost certainly prime", count_in);
-
-		/* recheck q more rigorously */
-		is_prime = BN_is_prime_ex(q, trials - 1, NULL, NULL);
-		if (is_prime < 0)
-			fatal("BN_is_prime_ex failed");
-		if (is_prime == 0) {
-			debug("%10u: q is not prime", count_in);
-			continue;
-		}
-		debug("%10u: q is almost certainly prime", count_in);
-
-		if (qfileout(out, MODULI_TYPE_SAFE,
-		    in_tests | MODULI_TESTS_MILLER_RABIN,
-		    in_tries, in_size, generator_known, p)) {
-			res = -1;
+		job = &pool.jobs[pool.queued++ % pool.njobs];
+		job->line = xstrdup(lp);
+		job->lineno = count_in;
+		pthread_cond_broadcast(&pool.cond);
+	}
+	/* drain */
+	pool.eof = 1;
+	pthread_cond_broadcast(&pool.cond);
+	while (res == 0 && pool.written < pool.queued) {
+		if ((res = screen_write(&pool, out, checkpoint_file,
+		    &count_out, &count_possible)) != 0 ||
+		    pool.written == pool.queued)
 			break;
-		}
-
-		count_out++;
+		pthread_cond_wait(&pool.cond, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+	for (n = 0; n < threads; n++)
+		pthread_join(tids[n], NULL);
+	/* after a write error, discard what is left */
+	pthread_mutex_lock(&pool.lock);
+	for (; pool.written < pool.queued; pool.written++) {
+		job = &pool.jobs[pool.written % pool.njobs];
+		BN_free(job->p);
+		free(job->line);
 	}
+	pthread_mutex_unlock(&pool.lock);
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
+	free(pool.jobs);
+	free(tids);
 
 	time(&time_stop);
 	free(lp);
-	BN_free(p);
-	BN_free(q);
 
-	if (checkpoint_file != NULL)
+	if (checkpoint_file != NULL && res == 0)
 		unlink(checkpoint_file);
 
 	logit("%.24s Found %u safe primes of %u candidates in %ld seconds",
@@ -26,6 +26,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stddef.h>
@@ -70,7 +71,7 @@
 
 /* from ssh.c */
 extern __thread int tty_flag;
-extern Options options;
+extern __thread Options options;
 extern __thread int stdin_null_flag;
 extern __thread char *host;
 extern __thread int subsystem_flag;
@@ -103,21 +104,21 @@ struct mux_channel_confirm_ctx {
 };
 
 /* fd to control socket */
-int muxserver_sock = -1;
+__thread int muxserver_sock = -1;
 
 /* client request id */
-u_int muxclient_request_id = 0;
+__thread u_int muxclient_request_id = 0;
 
 /* Multiplexing control command */
-u_int muxclient_command = 0;
+__thread u_int muxclient_command = 0;
 
 /* Set when signalled. */
-static volatile sig_atomic_t muxclient_terminate = 0;
+static __thread volatile sig_atomic_t muxclient_terminate = 0;
 
 /* PID of multiplex server */
-static u_int muxserver_pid = 0;
+static __thread u_int muxserver_pid = 0;
 
-static Channel *mux_listener_channel = NULL;
+static __thread Channel *mux_listener_channel = NULL;
 
 struct mux_master_state {
 	int hello_rcvd;
@@ -465,11 +466,14 @@ mux_master_process_new_session(struct ssh *ssh, u_int rid,
 	if (cctx->want_tty) {
 		window >>= 1;
 		packetmax >>= 1;
-	}
+	} else if (cctx->want_subsys)
+		window <<= 3;
 
 	nc = channel_new(ssh, "session", SSH_CHANNEL_OPENING,
 	    new_fd[0], new_fd[1], new_fd[2], window, packetmax,
 	    CHAN_EXTENDED_WRITE, "client-session", /*nonblock*/0);
+	if (!cctx->want_tty)
+		nc->local_window_limit = options.channel_window_max;
 
 	nc->ctl_chan = c->self;		/* link session -> control channel */
 	c->remote_id = nc->self;	/* link control -> session channel */
@@ -1267,15 +1271,164 @@ mux_tty_alloc_failed(struct ssh *ssh, Channel *c)
 	sshbuf_free(m);
 }
 
+#if TARGET_OS_IPHONE
+/*
+ * On iOS every ssh, scp and sftp runs as a thread of the same process and
+ * the sandbox leaves no good place for named sockets. Control sockets are
+ * kept in an in-process registry instead: a master registers one end of a
+ * socketpair under its ControlPath and a client connects by passing one
+ * end of a fresh socketpair through it. The master receives that fd in
+ * channel_post_mux_listener() where it would otherwise accept().
+ */
+struct mux_broker {
+	TAILQ_ENTRY(mux_broker) next;
+	char *path;
+	int fd;			/* registry end of the master's socketpair */
+	pthread_t owner;
+};
+static TAILQ_HEAD(, mux_broker) mux_brokers =
+    TAILQ_HEAD_INITIALIZER(mux_brokers);
+static pthread_mutex_t mux_broker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mux_broker_once = PTHREAD_ONCE_INIT;
+static pthread_key_t mux_broker_key;
+
+static struct mux_broker *
+mux_broker_find(const char *path)
+{
+	struct mux_broker *b;
+
+	TAILQ_FOREACH(b, &mux_brokers, next) {
+		if (strcmp(b->path, path) == 0)
+			return b;
+	}
+	return NULL;
+}
+
+static void
+mux_broker_free(struct mux_broker *b)
+{
+	TAILQ_REMOVE(&mux_brokers, b, next);
+	close(b->fd);
+	free(b->path);
+	free(b);
+}
+
+/* A master thread that exits without unlistening still drops its entry. */
+static void
+mux_broker_thread_exit(void *arg)
+{
+	mux_broker_unlisten(arg);
+	free(arg);
+}
+
+static void
+mux_broker_init(void)
+{
+	pthread_key_create(&mux_broker_key, mux_broker_thread_exit);
+}
+
+static int
+mux_broker_socketpair(int sv[2])
+{
+	int on = 1;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+		return -1;
+	(void)setsockopt(sv[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	(void)setsockopt(sv[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	return 0;
+}
+
+/* Register path for this thread; returns the master's end or -1/errno. */
+static int
+mux_broker_listen(const char *path)
+{
+	struct mux_broker *b;
+	int sv[2];
+
+	pthread_once(&mux_broker_once, mux_broker_init);
+	pthread_mutex_lock(&mux_broker_lock);
+	if (mux_broker_find(path) != NULL) {
+		pthread_mutex_unlock(&mux_broker_lock);
+		errno = EADDRINUSE;
+		return -1;
+	}
+	if (mux_broker_socketpair(sv) == -1) {
+		pthread_mutex_unlock(&mux_broker_lock);
+		return -1;
+	}
+	b = xcalloc(1, sizeof(*b));
+	b->path = xstrdup(path);
+	b->fd = sv[1];
+	b->owner = pthread_self();
+	TAILQ_INSERT_TAIL(&mux_brokers, b, next);
+	pthread_mutex_unlock(&mux_broker_lock);
+	free(pthread_getspecific(mux_broker_key));
+	pthread_setspecific(mux_broker_key, xstrdup(path));
+	return sv[0];
+}
+
+/* Connect to the master registered under path; returns a socket or -1. */
+static int
+mux_broker_connect(const char *path)
+{
+	struct mux_broker *b;
+	int sv[2], oerrno;
+
+	pthread_once(&mux_broker_once, mux_broker_init);
+	pthread_mutex_lock(&mux_broker_lock);
+	if ((b = mux_broker_find(path)) == NULL) {
+		pthread_mutex_unlock(&mux_broker_lock);
+		errno = ENOENT;
+		return -1;
+	}
+	if (mux_broker_socketpair(sv) == -1) {
+		oerrno = errno;
+		pthread_mutex_unlock(&mux_broker_lock);
+		errno = oerrno;
+		return -1;
+	}
+	if (mm_send_fd(b->fd, sv[1]) == -1) {
+		/* The master went away without unlistening */
+		mux_broker_free(b);
+		pthread_mutex_unlock(&mux_broker_lock);
+		close(sv[0]);
+		close(sv[1]);
+		errno = ECONNREFUSED;
+		return -1;
+	}
+	pthread_mutex_unlock(&mux_broker_lock);
+	close(sv[1]);
+	return sv[0];
+}
+
+/* Drop the registration for path made by this thread, if any. */
+void
+mux_broker_unlisten(const char *path)
+{
+	struct mux_broker *b;
+
+	if (path == NULL)
+		return;
+	pthread_mutex_lock(&mux_broker_lock);
+	if ((b = mux_broker_find(path)) != NULL &&
+	    pthread_equal(b->owner, pthread_self()))
+		mux_broker_free(b);
+	pthread_mutex_unlock(&mux_broker_lock);
+}
+#endif /* TARGET_OS_IPHONE */
+
 /* Prepare a mux master to listen on a Unix domain socket. */
 void
 muxserver_listen(struct ssh *ssh)
 {
+#if !TARGET_OS_IPHONE
 	mode_t old_umask;
 	char *orig_control_path = options.control_path;
 	char rbuf[16+1];
 	u_int i, r;
 	int oerrno;
+#endif
 
 	if (options.control_path == NULL ||
 	    options.control_master == SSHCTL_MASTER_NO)
@@ -1283,6 +1436,19 @@ muxserver_listen(struct ssh *ssh)
 
 	debug("setting up multiplex master socket");
 
+#if TARGET_OS_IPHONE
+	if ((muxserver_sock = mux_broker_listen(options.control_path)) == -1) {
+		if (errno != EADDRINUSE)
+			fatal_f("ControlSocket %s: %s", options.control_path,
+			    strerror(errno));
+		error("ControlSocket %s already exists, disabling multiplexing",
+		    options.control_path);
+		free(options.control_path);
+		options.control_path = NULL;
+		options.control_master = SSHCTL_MASTER_NO;
+		return;
+	}
+#else
 	/*
 	 * Use a temporary path before listen so we can pseudo-atomically
 	 * establish the listening socket in its final location to avoid
@@ -1339,6 +1505,7 @@ muxserver_listen(struct ssh *ssh)
 	unlink(options.control_path);
 	free(options.control_path);
 	options.control_path = orig_control_path;
+#endif
 
 	set_nonblock(muxserver_sock);
 
@@ -2250,7 +2417,9 @@ mux_client_request_stop_listening(int fd)
 int
 muxclient(const char *path)
 {
+#if !TARGET_OS_IPHONE
 	struct sockaddr_un addr;
+#endif
 	int sock;
 	u_int pid;
 
@@ -2272,6 +2441,24 @@ muxclient(const char *path)
 		return -1;
 	}
 
+#if TARGET_OS_IPHONE
+	if ((sock = mux_broker_connect(path)) == -1) {
+		switch (muxclient_command) {
+		case SSHMUX_COMMAND_OPEN:
+		case SSHMUX_COMMAND_STDIO_FWD:
+			break;
+		default:
+			fatal("Control socket connect(%.100s): %s", path,
+			    strerror(errno));
+		}
+		if (errno == ENOENT)
+			debug("Control socket \"%.100s\" does not exist", path);
+		else
+			debug("Control socket connect(%.100s): %s", path,
+			    strerror(errno));
+		return -1;
+	}
+#else
 	memset(&addr, '\0', sizeof(addr));
 	addr.sun_family = AF_UNIX;
 
@@ -2305,6 +2492,7 @@ muxclient(const char *path)
 		close(sock);
 		return -1;
 	}
+#endif
 	set_nonblock(sock);
 
 	if (mux_client_hello_exchange(sock) != 0) {
@@ -48,6 +48,7 @@
 
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #include <errno.h>
@@ -104,6 +105,7 @@
 #endif
 
 #define PACKET_MAX_SIZE (256 * 1024)
+#define PACKET_SPARE_BUFS 8
 
 struct packet_state {
 	u_int32_t seqnr;
@@ -224,8 +226,35 @@ struct session_state {
 	void *hook_in_ctx;
 
 	TAILQ_HEAD(, packet) outgoing;
+
+	/* Emptied packet buffers, reused while packets queue up for rekey */
+	struct sshbuf *spare_bufs[PACKET_SPARE_BUFS];
+	u_int nspare_bufs;
 };
 
+/* Take a packet buffer from the connection's pool, or allocate one */
+static struct sshbuf *
+ssh_packet_buf_get(struct session_state *state)
+{
+	if (state->nspare_bufs > 0)
+		return state->spare_bufs[--state->nspare_bufs];
+	return sshbuf_new();
+}
+
+/* Return a packet buffer to the pool; it keeps its allocation */
+static void
+ssh_packet_buf_put(struct session_state *state, struct sshbuf *b)
+{
+	if (b == NULL)
+		return;
+	if (state->nspare_bufs >= PACKET_SPARE_BUFS) {
+		sshbuf_free(b);
+		return;
+	}
+	sshbuf_recycle(b);
+	state->spare_bufs[state->nspare_bufs++] = b;
+}
+
 struct ssh *
 ssh_alloc_session_state(void)
 {
@@ -472,6 +501,32 @@ ssh_packet_get_bytes(struct ssh *ssh, u_int64_t *ibytes, u_int64_t *obytes)
 		*obytes = ssh->state->p_send.bytes;
 }
 
+/* Smoothed round trip time of the TCP connection in seconds, 0 if unknown. */
+double
+ssh_packet_get_rtt(struct ssh *ssh)
+{
+	int fd = ssh->state->connection_in;
+#if defined(TCP_CONNECTION_INFO)
+	struct tcp_connection_info ti;
+	socklen_t len = sizeof(ti);
+
+	if (fd == -1 || getsockopt(fd, IPPROTO_TCP, TCP_CONNECTION_INFO,
+	    &ti, &len) == -1)
+		return 0;
+	return ti.tcpi_srtt / 1000.0;		/* milliseconds */
+#elif defined(TCP_INFO)
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+
+	if (fd == -1 || getsockopt(fd, IPPROTO_TCP, TCP_INFO,
+	    &ti, &len) == -1)
+		return 0;
+	return ti.tcpi_rtt / 1000000.0;		/* microseconds */
+#else
+	return 0;
+#endif
+}
+
 int
 ssh_packet_connection_af(struct ssh *ssh)
 {
@@ -599,6 +654,8 @@ ssh_packet_close_internal(struct ssh *ssh, int do_close)
 	sshbuf_free(state->output);
 	sshbuf_free(state->outgoing_packet);
 	sshbuf_free(state->incoming_packet);
+	while (state->nspare_bufs > 0)
+		sshbuf_free(state->spare_bufs[--state->nspare_bufs]);
 	for (mode = 0; mode < MODE_MAX; mode++) {
 		kex_free_newkeys(state->newkeys[mode]);	/* current keys */
 		state->newkeys[mode] = NULL;
@@ -1094,11 +1151,11 @@ ssh_packet_send2_wrapped(struct ssh *ssh)
 		/* skip header, compress only payload */
 		if ((r = sshbuf_consume(state->outgoing_packet, 5)) != 0)
 			goto out;
-		sshbuf_reset(state->compression_buffer);
+		sshbuf_recycle(state->compression_buffer);
 		if ((r = compress_buffer(ssh, state->outgoing_packet,
 		    state->compression_buffer)) != 0)
 			goto out;
-		sshbuf_reset(state->outgoing_packet);
+		sshbuf_recycle(state->outgoing_packet);
 		if ((r = sshbuf_put(state->outgoing_packet,
 		    "\0\0\0\0\0", 5)) != 0 ||
 		    (r = sshbuf_putb(state->outgoing_packet,
@@ -1170,13 +1227,20 @@ ssh_packet_send2_wrapped(struct ssh *ssh)
 			goto out;
 		DBG(debug("done calc MAC out #%d", state->p_send.seqnr));
 	}
-	/* encrypt packet and append to output buffer. */
-	if ((r = sshbuf_reserve(state->output,
-	    sshbuf_len(state->outgoing_packet) + authlen, &cp)) != 0)
+	/*
+	 * Encrypt the packet in place, leaving room for the AEAD tag, then
+	 * hand it to the output buffer. When the output buffer is empty it
+	 * takes over the packet's storage instead of copying it.
+	 */
+	if (authlen != 0 &&
+	    (r = sshbuf_reserve(state->outgoing_packet, authlen, NULL)) != 0)
+		goto out;
+	if ((cp = sshbuf_mutable_ptr(state->outgoing_packet)) == NULL) {
+		r = SSH_ERR_INTERNAL_ERROR;
 		goto out;
+	}
 	if ((r = cipher_crypt(state->send_context, state->p_send.seqnr, cp,
-	    sshbuf_ptr(state->outgoing_packet),
-	    len - aadlen, aadlen, authlen)) != 0)
+	    cp, len - aadlen, aadlen, authlen)) != 0)
 		goto out;
 	/* append unencrypted MAC */
 	if (mac && mac->enabled) {
@@ -1188,9 +1252,12 @@ ssh_packet_send2_wrapped(struct ssh *ssh)
 			DBG(debug("done calc MAC(EtM) out #%d",
 			    state->p_send.seqnr));
 		}
-		if ((r = sshbuf_put(state->output, macbuf, mac->mac_len)) != 0)
+		if ((r = sshbuf_put(state->outgoing_packet,
+		    macbuf, mac->mac_len)) != 0)
 			goto out;
 	}
+	if ((r = sshbuf_move(state->output, state->outgoing_packet)) != 0)
+		goto out;
 #ifdef PACKET_DEBUG
 	fprintf(stderr, "encrypted: ");
 	sshbuf_dump(state->output, stderr);
@@ -1203,7 +1270,7 @@ ssh_packet_send2_wrapped(struct ssh *ssh)
 			return SSH_ERR_NEED_REKEY;
 	state->p_send.blocks += len / block_size;
 	state->p_send.bytes += len;
-	sshbuf_reset(state->outgoing_packet);
+	sshbuf_recycle(state->outgoing_packet);
 
 	if (type == SSH2_MSG_NEWKEYS)
 		r = ssh_set_newkeys(ssh, MODE_OUT);
@@ -1255,7 +1322,7 @@ ssh_packet_send2(struct ssh *ssh)
 		p->type = type;
 		p->payload = state->outgoing_packet;
 		TAILQ_INSERT_TAIL(&state->outgoing, p, next);
-		state->outgoing_packet = sshbuf_new();
+		state->outgoing_packet = ssh_packet_buf_get(state);
 		if (state->outgoing_packet == NULL)
 			return SSH_ERR_ALLOC_FAIL;
 		if (need_rekey) {
@@ -1293,7 +1360,7 @@ ssh_packet_send2(struct ssh *ssh)
 				return kex_start_rekex(ssh);
 			}
 			debug("dequeue packet: %u", type);
-			sshbuf_free(state->outgoing_packet);
+			ssh_packet_buf_put(state, state->outgoing_packet);
 			state->outgoing_packet = p->payload;
 			TAILQ_REMOVE(&state->outgoing, p, next);
 			memset(p, 0, sizeof(*p));
@@ -1458,7 +1525,7 @@ ssh_packet_read_poll2_mux(struct ssh *ssh, u_char *typep, u_int32_t *seqnr_p)
 	need = state->packlen + 4;
 	if (sshbuf_len(state->input) < need)
 		return 0; /* packet is incomplete */
-	sshbuf_reset(state->incoming_packet);
+	sshbuf_recycle(state->incoming_packet);
 	if ((r = sshbuf_put(state->incoming_packet, cp + 4,
 	    state->packlen)) != 0 ||
 	    (r = sshbuf_consume(state->input, need)) != 0 ||
@@ -1520,7 +1587,7 @@ ssh_packet_read_poll2(struct ssh *ssh, u_char *typep, u_int32_t *seqnr_p)
 				return r;
 			return SSH_ERR_CONN_CORRUPT;
 		}
-		sshbuf_reset(state->incoming_packet);
+		sshbuf_recycle(state->incoming_packet);
 	} else if (state->packlen == 0) {
 		/*
 		 * check if input size is less than the cipher block size,
@@ -1528,7 +1595,7 @@ ssh_packet_read_poll2(struct ssh *ssh, u_char *typep, u_int32_t *seqnr_p)
 		 */
 		if (sshbuf_len(state->input) < block_size)
 			return 0;
-		sshbuf_reset(state->incoming_packet);
+		sshbuf_recycle(state->incoming_packet);
 		if ((r = sshbuf_reserve(state->incoming_packet, block_size,
 		    &cp)) != 0)
 			goto out;
@@ -1654,11 +1721,11 @@ ssh_packet_read_poll2(struct ssh *ssh, u_char *typep, u_int32_t *seqnr_p)
 	DBG(debug("input: len before de-compress %zd",
 	    sshbuf_len(state->incoming_packet)));
 	if (comp && comp->enabled) {
-		sshbuf_reset(state->compression_buffer);
+		sshbuf_recycle(state->compression_buffer);
 		if ((r = uncompress_buffer(ssh, state->incoming_packet,
 		    state->compression_buffer)) != 0)
 			goto out;
-		sshbuf_reset(state->incoming_packet);
+		sshbuf_recycle(state->incoming_packet);
 		if ((r = sshbuf_putb(state->incoming_packet,
 		    state->compression_buffer)) != 0)
 			goto out;
@@ -2605,7 +2672,7 @@ sshpkt_start(struct ssh *ssh, u_char type)
 	DBG(debug("packet_start[%d]", type));
 	memset(buf, 0, sizeof(buf));
 	buf[sizeof(buf) - 1] = type;
-	sshbuf_reset(ssh->state->outgoing_packet);
+	sshbuf_recycle(ssh->state->outgoing_packet);
 	return sshbuf_put(ssh->state->outgoing_packet, buf, sizeof(buf));
 }
 
@@ -2630,12 +2697,12 @@ ssh_packet_send_mux(struct ssh *ssh)
 	if (type >= SSH2_MSG_CONNECTION_MIN &&
 	    type <= SSH2_MSG_CONNECTION_MAX) {
 		POKE_U32(cp, len - 4);
-		if ((r = sshbuf_putb(state->output,
+		if ((r = sshbuf_move(state->output,
 		    state->outgoing_packet)) != 0)
 			return r;
 		/* sshbuf_dump(state->output, stderr); */
 	}
-	sshbuf_reset(state->outgoing_packet);
+	sshbuf_recycle(state->outgoing_packet);
 	return 0;
 }
 
@@ -96,6 +96,7 @@ struct ssh *ssh_packet_set_connection(struct ssh *, int, int);
 void     ssh_packet_set_timeout(struct ssh *, int, int);
 int	 ssh_packet_stop_discard(struct ssh *);
 int	 ssh_packet_connection_af(struct ssh *);
+double	 ssh_packet_get_rtt(struct ssh *);
 void     ssh_packet_set_nonblocking(struct ssh *);
 int      ssh_packet_get_connection_in(struct ssh *);
 int      ssh_packet_get_connection_out(struct ssh *);
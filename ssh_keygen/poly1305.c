@@ -14,6 +14,133 @@
 
 #include "poly1305.h"
 
+#if defined(__SIZEOF_INT128__)
+/*
+ * poly1305-donna-64.h from the same source: three 44-bit limbs and
+ * 64x64->128 bit multiplies, about three times the speed of the 32-bit
+ * code on arm64 and x86_64.
+ */
+typedef unsigned __int128 uint128_t;
+
+#define U8TO64_LE(p) \
+	(((uint64_t)((p)[0])      ) | \
+	 ((uint64_t)((p)[1]) <<  8) | \
+	 ((uint64_t)((p)[2]) << 16) | \
+	 ((uint64_t)((p)[3]) << 24) | \
+	 ((uint64_t)((p)[4]) << 32) | \
+	 ((uint64_t)((p)[5]) << 40) | \
+	 ((uint64_t)((p)[6]) << 48) | \
+	 ((uint64_t)((p)[7]) << 56))
+
+#define U64TO8_LE(p, v) \
+	do { \
+		(p)[0] = (uint8_t)((v)      ); \
+		(p)[1] = (uint8_t)((v) >>  8); \
+		(p)[2] = (uint8_t)((v) >> 16); \
+		(p)[3] = (uint8_t)((v) >> 24); \
+		(p)[4] = (uint8_t)((v) >> 32); \
+		(p)[5] = (uint8_t)((v) >> 40); \
+		(p)[6] = (uint8_t)((v) >> 48); \
+		(p)[7] = (uint8_t)((v) >> 56); \
+	} while (0)
+
+void
+poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen, const unsigned char key[POLY1305_KEYLEN]) {
+	uint64_t r0,r1,r2,s1,s2;
+	uint64_t h0,h1,h2;
+	uint64_t t0,t1,g0,g1,g2,c;
+	uint64_t hibit = (uint64_t)1 << 40;
+	uint128_t d0,d1,d2;
+	unsigned char mp[16];
+	size_t j;
+
+	/* clamp key: r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = U8TO64_LE(key+0);
+	t1 = U8TO64_LE(key+8);
+	r0 = ( t0                    ) & 0xffc0fffffffULL;
+	r1 = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+	r2 = ((t1 >> 24)             ) & 0x00ffffffc0fULL;
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	h0 = 0;
+	h1 = 0;
+	h2 = 0;
+
+	while (inlen > 0) {
+		if (inlen >= 16) {
+			t0 = U8TO64_LE(m+0);
+			t1 = U8TO64_LE(m+8);
+			m += 16;
+			inlen -= 16;
+		} else {
+			/* final bytes, padded with 1 instead of the high bit */
+			for (j = 0; j < inlen; j++) mp[j] = m[j];
+			mp[j++] = 1;
+			for (; j < 16; j++) mp[j] = 0;
+			t0 = U8TO64_LE(mp+0);
+			t1 = U8TO64_LE(mp+8);
+			hibit = 0;
+			inlen = 0;
+		}
+
+		h0 += (( t0                    ) & 0xfffffffffffULL);
+		h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffffULL);
+		h2 += (((t1 >> 24)             ) & 0x3ffffffffffULL) | hibit;
+
+		d0 = (uint128_t)h0 * r0 + (uint128_t)h1 * s2 + (uint128_t)h2 * s1;
+		d1 = (uint128_t)h0 * r1 + (uint128_t)h1 * r0 + (uint128_t)h2 * s2;
+		d2 = (uint128_t)h0 * r2 + (uint128_t)h1 * r1 + (uint128_t)h2 * r0;
+
+		           c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & 0xfffffffffffULL;
+		d1 += c;   c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & 0xfffffffffffULL;
+		d2 += c;   c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & 0x3ffffffffffULL;
+		h0 += c * 5; c = (h0 >> 44);         h0 = h0 & 0xfffffffffffULL;
+		h1 += c;
+	}
+
+	/* fully carry h */
+	             c = (h1 >> 44); h1 &= 0xfffffffffffULL;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffffULL;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffffULL;
+	h1 += c;     c = (h1 >> 44); h1 &= 0xfffffffffffULL;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffffULL;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffffULL;
+	h1 += c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = (g0 >> 44); g0 &= 0xfffffffffffULL;
+	g1 = h1 + c; c = (g1 >> 44); g1 &= 0xfffffffffffULL;
+	g2 = h2 + c - ((uint64_t)1 << 42);
+
+	/* select h if h < p, or h + -p if h >= p */
+	c = (g2 >> 63) - 1;
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = (h0 & c) | g0;
+	h1 = (h1 & c) | g1;
+	h2 = (h2 & c) | g2;
+
+	/* h = (h + pad) */
+	t0 = U8TO64_LE(key+16);
+	t1 = U8TO64_LE(key+24);
+	h0 += (( t0                    ) & 0xfffffffffffULL)    ; c = (h0 >> 44); h0 &= 0xfffffffffffULL;
+	h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffffULL) + c; c = (h1 >> 44); h1 &= 0xfffffffffffULL;
+	h2 += (((t1 >> 24)             ) & 0x3ffffffffffULL) + c;                 h2 &= 0x3ffffffffffULL;
+
+	/* mac = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 44));
+	h1 = ((h1 >> 20) | (h2 << 24));
+
+	U64TO8_LE(&out[0], h0);
+	U64TO8_LE(&out[8], h1);
+}
+
+#else /* !__SIZEOF_INT128__ */
+
 #define mul32x32_64(a,b) ((uint64_t)(a) * (b))
 
 #define U8TO32_LE(p) \
@@ -158,3 +285,5 @@ poly1305_donna_finish:
 	U32TO8_LE(&out[ 8], f2); f3 += (f2 >> 32);
 	U32TO8_LE(&out[12], f3);
 }
+
+#endif /* __SIZEOF_INT128__ */
@@ -51,6 +51,7 @@
 # include <vis.h>
 #endif
 
+#include "openbsd-compat/sys-queue.h"
 #include "xmalloc.h"
 #include "ssh.h"
 #include "ssherr.h"
@@ -60,6 +61,7 @@
 #include "log.h"
 #include "sshkey.h"
 #include "misc.h"
+#include "channels.h"
 #include "readconf.h"
 #include "match.h"
 #include "kex.h"
@@ -173,7 +175,7 @@ typedef enum {
 	oStreamLocalBindMask, oStreamLocalBindUnlink, oRevokedHostKeys,
 	oFingerprintHash, oUpdateHostkeys, oHostbasedAcceptedAlgorithms,
 	oPubkeyAcceptedAlgorithms, oCASignatureAlgorithms, oProxyJump,
-	oSecurityKeyProvider, oKnownHostsCommand,
+	oSecurityKeyProvider, oKnownHostsCommand, oChannelWindowMax,
 	oIgnore, oIgnoredUnknownOption, oDeprecated, oUnsupported
 } OpCodes;
 
@@ -316,6 +318,7 @@ static struct {
 	{ "proxyjump", oProxyJump },
 	{ "securitykeyprovider", oSecurityKeyProvider },
 	{ "knownhostscommand", oKnownHostsCommand },
+	{ "channelwindowmax", oChannelWindowMax },
 
 	{ NULL, oBadOption }
 };
@@ -1160,6 +1163,31 @@ parse_time:
 		}
 		break;
 
+	case oChannelWindowMax:
+		arg = strdelim(&s);
+		if (!arg || *arg == '\0') {
+			error("%.200s line %d: Missing argument.", filename,
+			    linenum);
+			return -1;
+		}
+		if (strcmp(arg, "none") == 0) {
+			val64 = 0;
+		} else {
+			if (scan_scaled(arg, &val64) == -1) {
+				error("%.200s line %d: Bad number '%s': %s",
+				    filename, linenum, arg, strerror(errno));
+				return -1;
+			}
+			if (val64 < 0 || val64 > CHAN_SES_WINDOW_LIMIT) {
+				error("%.200s line %d: ChannelWindowMax out "
+				    "of range", filename, linenum);
+				return -1;
+			}
+		}
+		if (*activep && options->channel_window_max == -1)
+			options->channel_window_max = val64;
+		break;
+
 	case oIdentityFile:
 		arg = strdelim(&s);
 		if (!arg || *arg == '\0') {
@@ -2246,6 +2274,7 @@ initialize_options(Options * options)
 	options->identities_only = - 1;
 	options->rekey_limit = - 1;
 	options->rekey_interval = -1;
+	options->channel_window_max = -1;
 	options->verify_host_key_dns = -1;
 	options->server_alive_interval = -1;
 	options->server_alive_count_max = -1;
@@ -2429,6 +2458,8 @@ fill_default_options(Options * options)
 		options->rekey_limit = 0;
 	if (options->rekey_interval == -1)
 		options->rekey_interval = 0;
+	if (options->channel_window_max == -1)
+		options->channel_window_max = CHAN_SES_WINDOW_MAX_DEFAULT;
 	if (options->verify_host_key_dns == -1)
 		options->verify_host_key_dns = 0;
 	if (options->server_alive_interval == -1)
@@ -3257,6 +3288,10 @@ dump_client_config(Options *o, const char *host)
 	fprintf(thread_stdout, "rekeylimit %llu %d\n",
 	    (unsigned long long)o->rekey_limit, o->rekey_interval);
 
+	/* oChannelWindowMax */
+	fprintf(thread_stdout, "channelwindowmax %llu\n",
+	    (unsigned long long)o->channel_window_max);
+
 	/* oStreamLocalBindMask */
 	fprintf(thread_stdout, "streamlocalbindmask 0%o\n",
 	    o->fwd_opts.streamlocal_bind_mask);
@@ -121,6 +121,7 @@ typedef struct {
 	int	enable_ssh_keysign;
 	int64_t rekey_limit;
 	int	rekey_interval;
+	int64_t channel_window_max;	/* session window growth cap, 0 = fixed */
 	int	no_host_authentication_for_localhost;
 	int	identities_only;
 	int	server_alive_interval;
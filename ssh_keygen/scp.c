@@ -97,6 +97,7 @@
 #ifdef HAVE_FNMATCH_H
 #include <fnmatch.h>
 #endif
+#include <libgen.h>
 #include <limits.h>
 #include <locale.h>
 #include <pwd.h>
@@ -122,6 +123,9 @@
 #include "misc.h"
 #include "progressmeter.h"
 #include "utf8.h"
+#include "sftp.h"
+#include "sftp-common.h"
+#include "sftp-client.h"
 
 #if TARGET_OS_IPHONE
 #define __progname ssh_progname
@@ -129,9 +133,15 @@
 
 extern __thread char *__progname;
 
-#define COPY_BUFLEN	16384
+#define COPY_BUFLEN	(128*1024)
 
-int do_cmd(char *host, char *remuser, int port, char *cmd, int *fdin, int *fdout);
+/* SFTP mode: the same as sftp's defaults */
+#define SFTP_COPY_BUFLEN	32768
+#define SFTP_NUM_REQUESTS	64
+#define SFTP_MAX_REQUESTS	512
+
+int do_cmd(char *host, char *remuser, int port, int subsystem, char *cmd,
+    int *fdin, int *fdout);
 int do_cmd2(char *host, char *remuser, int port, char *cmd, int fdin, int fdout);
 
 /* Struct for addargs */
@@ -149,8 +159,17 @@ __thread char *curfile;
 __thread int verbose_mode = 0;
 
 #if TARGET_OS_IPHONE
+// sftp.c's, read by sftp-client.c in SFTP mode
+extern __thread int showprogress;
+static void
+sftp_showprogress(int on)
+{
+	showprogress = on;
+}
 // Avoid name collision with sftp
 #define showprogress scp_showprogress
+#else
+#define sftp_showprogress(on)
 #endif
 /* This is set to zero if the progressmeter is not desired. */
 __thread int showprogress = 1;
@@ -170,6 +189,15 @@ __thread char *ssh_program = _PATH_SSH_PROGRAM;
 /* This is used to store the pid of ssh_program */
 __thread pid_t do_cmd_pid = -1;
 
+/* Transfer files with the SFTP protocol instead of scp/rcp's (-s) */
+__thread int sftp_mode = 0;
+
+/* Number of files transferred at once in SFTP mode (-j) */
+__thread int sftp_transfers = 1;
+
+int remote_glob(struct sftp_conn *, const char *, int,
+    int (*)(const char *, int), glob_t *); /* proto for sftp-glob.c */
+
 static void
 killchild(int signo)
 {
@@ -249,9 +277,12 @@ do_local_cmd(arglist *a)
  */
 
 int
-do_cmd(char *host, char *remuser, int port, char *cmd, int *fdin, int *fdout)
+do_cmd(char *host, char *remuser, int port, int subsystem, char *cmd,
+    int *fdin, int *fdout)
 {
 	int pin[2], pout[2], reserved[2];
+	arglist a;
+	u_int i;
 
 	if (verbose_mode)
 		fmprintf(stderr,
@@ -298,21 +329,28 @@ do_cmd(char *host, char *remuser, int port, char *cmd, int *fdin, int *fdout)
 		close(pout[1]);
 #endif
 
-		replacearg(&args, 0, "%s", ssh_program);
+		/* A copy: on iOS there is no child, and args is used again */
+		memset(&a, '\0', sizeof(a));
+		for (i = 0; i < args.num; i++)
+			addargs(&a, "%s", args.list[i]);
+		replacearg(&a, 0, "%s", ssh_program);
 		if (port != -1) {
-			addargs(&args, "-p");
-			addargs(&args, "%d", port);
+			addargs(&a, "-p");
+			addargs(&a, "%d", port);
 		}
 		if (remuser != NULL) {
-			addargs(&args, "-l");
-			addargs(&args, "%s", remuser);
+			addargs(&a, "-l");
+			addargs(&a, "%s", remuser);
 		}
-		addargs(&args, "--");
-		addargs(&args, "%s", host);
-		addargs(&args, "%s", cmd);
+		if (subsystem)
+			addargs(&a, "-s");
+		addargs(&a, "--");
+		addargs(&a, "%s", host);
+		addargs(&a, "%s", cmd);
 
-		execvp(ssh_program, args.list);
+		execvp(ssh_program, a.list);
 #if TARGET_OS_IPHONE
+		freeargs(&a);
         *fdout = pin[1];
         *fdin = pout[0];
 #else
@@ -456,7 +494,7 @@ scp_main(int argc, char **argv)
 
 	fflag = Tflag = tflag = 0;
 	while ((ch = getopt(argc, argv,
-	    "12346ABCTdfpqrtvF:J:P:S:c:i:l:o:")) != -1) {
+	    "12346ABCTdfpqrstvF:J:P:S:c:i:j:l:o:")) != -1) {
 		switch (ch) {
 		/* User-visible flags. */
 		case '1':
@@ -508,6 +546,15 @@ scp_main(int argc, char **argv)
 		case 'r':
 			iamrecursive = 1;
 			break;
+		case 's':
+			sftp_mode = 1;
+			break;
+		case 'j':
+			sftp_transfers = strtonum(optarg, 1, 16, &errstr);
+			if (errstr != NULL)
+				fatal("Invalid number of transfers: %s", errstr);
+			sftp_mode = 1;
+			break;
 		case 'S':
 			ssh_program = xstrdup(optarg);
 			break;
@@ -916,12 +963,149 @@ brace_expand(const char *pattern, char ***patternsp, size_t *npatternsp)
 	return ret;
 }
 
+/* SFTP mode: connect to the sftp subsystem of host through ssh. */
+static void
+sftp_disconnect(void)
+{
+	int status;
+
+	if (remin != -1)
+		(void) close(remin);
+	if (remout != -1 && remout != remin)
+		(void) close(remout);
+	remin = remout = -1;
+	if (do_cmd_pid == -1)
+		return;
+	if (waitpid(do_cmd_pid, &status, 0) == -1 ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		++errs;
+	do_cmd_pid = -1;
+}
+
+static struct sftp_conn *
+sftp_connect(char *host, char *remuser, int port)
+{
+	struct sftp_conn *conn;
+
+	if (do_cmd(host, remuser, port, 1, "sftp", &remin, &remout) < 0)
+		return NULL;
+	if ((conn = do_init(remin, remout, SFTP_COPY_BUFLEN,
+	    SFTP_NUM_REQUESTS, limit_kbps)) == NULL) {
+		error("Couldn't initialise connection to server");
+		sftp_disconnect();
+		return NULL;
+	}
+	sftp_set_adaptive_requests(conn, SFTP_MAX_REQUESTS);
+	sftp_set_parallel_transfers(conn, sftp_transfers);
+	sftp_showprogress(showprogress);
+	return conn;
+}
+
+/*
+ * Files are queued for the connection's parallel transfers; directories
+ * are walked by upload_dir()/download_dir(), which run their own.
+ */
+static void
+sftp_upload(struct sftp_conn *conn, char *src, char *targ, int targ_is_dir)
+{
+	struct stat st;
+	char *dst, *tmp, *filename;
+
+	if (stat(src, &st) == -1) {
+		error("%s: %s", src, strerror(errno));
+		++errs;
+		return;
+	}
+	if (!S_ISREG(st.st_mode) && !(S_ISDIR(st.st_mode) && iamrecursive)) {
+		error("%s: not a regular file", src);
+		++errs;
+		return;
+	}
+	tmp = xstrdup(src);
+	if ((filename = basename(tmp)) == NULL)
+		fatal("basename %s: %s", src, strerror(errno));
+	dst = targ_is_dir ? path_append(targ, filename) : xstrdup(targ);
+	free(tmp);
+
+	if (S_ISDIR(st.st_mode)) {
+		if (sftp_transfer_finish(conn) == -1)
+			++errs;
+		if (upload_dir(conn, src, dst, pflag, verbose_mode, 0, 0) == -1)
+			++errs;
+		sftp_transfer_start(conn, 1, pflag, 0, 0);
+	} else if (sftp_transfer_queue(conn, src, dst, NULL) == -1)
+		++errs;
+	free(dst);
+}
+
+static void
+sftp_download(struct sftp_conn *conn, char *src, char *targ)
+{
+	glob_t g;
+	Attrib a, *ap;
+	char *dst, *tmp, *filename;
+	int i, r, targ_is_dir;
+
+	if (*src == '\0')
+		src = ".";
+	memset(&g, 0, sizeof(g));
+	if ((r = remote_glob(conn, src, GLOB_MARK|GLOB_KEEPSTAT, NULL,
+	    &g)) != 0) {
+		error("%s: %s", src, r == GLOB_NOSPACE ?
+		    "Too many matches" : "No such file or directory");
+		++errs;
+		return;
+	}
+	targ_is_dir = local_is_dir(targ);
+	if ((g.gl_matchc > 1 || targetshouldbedirectory) && !targ_is_dir) {
+		error("%s: Not a directory", targ);
+		++errs;
+		goto out;
+	}
+	for (i = 0; g.gl_pathv[i] != NULL; i++) {
+		tmp = xstrdup(g.gl_pathv[i]);
+		if ((filename = basename(tmp)) == NULL)
+			fatal("basename %s: %s", tmp, strerror(errno));
+		dst = targ_is_dir ? path_append(targ, filename) : xstrdup(targ);
+		free(tmp);
+
+		if (globpath_is_dir(g.gl_pathv[i])) {
+			if (!iamrecursive) {
+				error("%s: not a regular file", g.gl_pathv[i]);
+				++errs;
+			} else {
+				if (sftp_transfer_finish(conn) == -1)
+					++errs;
+				if (download_dir(conn, g.gl_pathv[i], dst, NULL,
+				    pflag, verbose_mode, 0, 0) == -1)
+					++errs;
+				sftp_transfer_start(conn, 0, pflag, 0, 0);
+			}
+		} else {
+			/* Saves a stat per file; links are resolved later */
+			ap = NULL;
+			if (g.gl_statv[i] != NULL &&
+			    S_ISREG(g.gl_statv[i]->st_mode)) {
+				stat_to_attrib(g.gl_statv[i], &a);
+				ap = &a;
+			}
+			if (sftp_transfer_queue(conn, g.gl_pathv[i], dst,
+			    ap) == -1)
+				++errs;
+		}
+		free(dst);
+	}
+ out:
+	globfree(&g);
+}
+
 void
 toremote(int argc, char **argv)
 {
 	char *suser = NULL, *host = NULL, *src = NULL;
 	char *bp, *tuser, *thost, *targ;
-	int sport = -1, tport = -1;
+	int sport = -1, tport = -1, targ_is_dir = 0;
+	struct sftp_conn *conn = NULL;
 	arglist alist;
 	int i, r;
 	u_int j;
@@ -970,7 +1154,8 @@ toremote(int argc, char **argv)
 		if (host && throughlocal) {	/* extended remote to remote */
 			xasprintf(&bp, "%s -f %s%s", cmd,
 			    *src == '-' ? "-- " : "", src);
-			if (do_cmd(host, suser, sport, bp, &remin, &remout) < 0)
+			if (do_cmd(host, suser, sport, 0, bp, &remin,
+			    &remout) < 0)
 				exit(1);
 			free(bp);
 			xasprintf(&bp, "%s -t %s%s", cmd,
@@ -1017,11 +1202,29 @@ toremote(int argc, char **argv)
 			    thost, targ);
 			if (do_local_cmd(&alist) != 0)
 				errs = 1;
+		} else if (sftp_mode) {	/* local to remote, over SFTP */
+			if (conn == NULL) {
+				if ((conn = sftp_connect(thost, tuser,
+				    tport)) == NULL)
+					exit(1);
+				if (*targ == '\0') {
+					free(targ);
+					targ = xstrdup(".");
+				}
+				targ_is_dir = remote_is_dir(conn, targ);
+				if (targetshouldbedirectory && !targ_is_dir) {
+					error("%s: Not a directory", targ);
+					++errs;
+					goto out;
+				}
+				sftp_transfer_start(conn, 1, pflag, 0, 0);
+			}
+			sftp_upload(conn, argv[i], targ, targ_is_dir);
 		} else {	/* local to remote */
 			if (remin == -1) {
 				xasprintf(&bp, "%s -t %s%s", cmd,
 				    *targ == '-' ? "-- " : "", targ);
-				if (do_cmd(thost, tuser, tport, bp, &remin,
+				if (do_cmd(thost, tuser, tport, 0, bp, &remin,
 				    &remout) < 0)
 					exit(1);
 				if (response() < 0)
@@ -1031,6 +1234,8 @@ toremote(int argc, char **argv)
 			source(1, argv + i);
 		}
 	}
+	if (conn != NULL && sftp_transfer_finish(conn) == -1)
+		++errs;
 out:
 	free(tuser);
 	free(thost);
@@ -1044,8 +1249,10 @@ void
 tolocal(int argc, char **argv)
 {
 	char *bp, *host = NULL, *src = NULL, *suser = NULL;
+	char *chost = NULL, *cuser = NULL;
+	struct sftp_conn *conn = NULL;
 	arglist alist;
-	int i, r, sport = -1;
+	int i, r, sport = -1, cport = -1;
 
 	memset(&alist, '\0', sizeof(alist));
 	alist.list = NULL;
@@ -1080,10 +1287,36 @@ tolocal(int argc, char **argv)
 				++errs;
 			continue;
 		}
+		if (sftp_mode) {	/* Remote to local, over SFTP */
+			/* One connection for consecutive sources on a host */
+			if (conn != NULL && (strcmp(host, chost) != 0 ||
+			    sport != cport || (suser == NULL) != (cuser == NULL) ||
+			    (suser != NULL && strcmp(suser, cuser) != 0))) {
+				if (sftp_transfer_finish(conn) == -1)
+					++errs;
+				sftp_disconnect();
+				conn = NULL;
+			}
+			if (conn == NULL) {
+				if ((conn = sftp_connect(host, suser,
+				    sport)) == NULL) {
+					++errs;
+					continue;
+				}
+				free(chost);
+				free(cuser);
+				chost = xstrdup(host);
+				cuser = suser == NULL ? NULL : xstrdup(suser);
+				cport = sport;
+				sftp_transfer_start(conn, 0, pflag, 0, 0);
+			}
+			sftp_download(conn, src, argv[argc - 1]);
+			continue;
+		}
 		/* Remote to local. */
 		xasprintf(&bp, "%s -f %s%s",
 		    cmd, *src == '-' ? "-- " : "", src);
-		if (do_cmd(host, suser, sport, bp, &remin, &remout) < 0) {
+		if (do_cmd(host, suser, sport, 0, bp, &remin, &remout) < 0) {
 			free(bp);
 			++errs;
 			continue;
@@ -1095,6 +1328,10 @@ tolocal(int argc, char **argv)
 		remin = remout = -1;
 #endif
 	}
+	if (conn != NULL && sftp_transfer_finish(conn) == -1)
+		++errs;
+	free(chost);
+	free(cuser);
 	free(suser);
 	free(host);
 	free(src);
@@ -1629,9 +1866,9 @@ void
 usage(void)
 {
 	(void) fprintf(stderr,
-	    "usage: scp [-346ABCpqrTv] [-c cipher] [-F ssh_config] [-i identity_file]\n"
-	    "            [-J destination] [-l limit] [-o ssh_option] [-P port]\n"
-	    "            [-S program] source ... target\n");
+	    "usage: scp [-346ABCpqrsTv] [-c cipher] [-F ssh_config] [-i identity_file]\n"
+	    "            [-J destination] [-j num_transfers] [-l limit]\n"
+	    "            [-o ssh_option] [-P port] [-S program] source ... target\n");
 	exit(1);
 }
 
@@ -38,6 +38,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -60,6 +61,10 @@
 
 extern __thread volatile sig_atomic_t interrupted;
 extern __thread int showprogress;
+#if TARGET_OS_IPHONE
+#define __progname ssh_progname
+#endif
+extern __thread char *__progname;
 
 /* Minimum amount of data to read at a time */
 #define MIN_READ_SIZE	512
@@ -74,6 +79,25 @@ extern __thread int showprogress;
 # define SFTP_DIRECTORY_CHARS      "/"
 #endif /* HAVE_CYGWIN */
 
+/*
+ * Directory listings kept for glob(3) and completion, which would otherwise
+ * read the same directory again for every pattern and every Tab.  They
+ * are dropped after SFTP_DIRCACHE_TTL seconds, and all at once whenever
+ * we change something on the server ourselves.
+ */
+#define SFTP_DIRCACHE_TTL	5
+#define SFTP_DIRCACHE_MAX	16	/* Directories kept */
+
+struct sftp_dircache {
+	char *path;
+	SFTP_DIRENT **dir;
+	time_t when;
+	TAILQ_ENTRY(sftp_dircache) tq;
+};
+
+/* READDIRs kept in flight by do_lsreaddir() */
+#define SFTP_READDIR_AHEAD	16
+
 struct sftp_conn {
 	int fd_in;
 	int fd_out;
@@ -90,8 +114,87 @@ struct sftp_conn {
 	u_int exts;
 	u_int64_t limit_kbps;
 	struct bwlimit bwlimit_in, bwlimit_out;
+	u_int max_requests;	/* Adaptive window ceiling, 0 if fixed */
+	double rtt;		/* Lowest request round trip, seconds */
+	double bw;		/* Best delivery rate, bytes/second */
+	double bw_start;	/* Start of the current rate sample */
+	u_int64_t bw_bytes;	/* Bytes delivered since bw_start */
+	u_int ntransfers;	/* Files transferred at once by *_dir() */
+	struct sftp_pool *pool;	/* Set while a transfer pool runs */
+	int xfer_upload;	/* sftp_transfer_start() flags, used */
+	int xfer_preserve;	/* when there is no pool */
+	int xfer_resume;
+	int xfer_fsync;
+	TAILQ_HEAD(sftp_dircaches, sftp_dircache) dircache; /* By last use */
+	u_int ndircache;
+};
+
+/*
+ * Parallel transfers.  download_dir() and upload_dir() walk the tree on
+ * the calling thread and queue regular files for worker threads, which
+ * run do_download() and do_upload() over the same connection.  The top
+ * byte of a request id names the thread that sent it (0 for the walker),
+ * so each thread can number its requests on its own.  Any thread waiting
+ * for a reply may read the next one off the connection; it files it in
+ * the inbox of the thread the id names.
+ */
+#define SFTP_ID_SHIFT		24
+#define SFTP_ID_MASK		((1U << SFTP_ID_SHIFT) - 1)
+#define SFTP_MAX_TRANSFERS	16
+
+struct sftp_reply {
+	struct sshbuf *msg;
+	TAILQ_ENTRY(sftp_reply) tq;
+};
+TAILQ_HEAD(sftp_replies, sftp_reply);
+
+struct sftp_job {
+	char *src;
+	char *dst;
+	Attrib a;
+	TAILQ_ENTRY(sftp_job) tq;
 };
 
+/* Directory attributes to set once the files inside are written */
+struct sftp_fixup {
+	char *path;
+	Attrib a;
+	mode_t mode, tmpmode;
+	TAILQ_ENTRY(sftp_fixup) tq;
+};
+
+struct sftp_worker {
+	struct sftp_conn *conn;
+	u_int index;
+	pthread_t thread;
+	volatile sig_atomic_t *interrupted;
+};
+
+struct sftp_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;	/* Replies, jobs and finished transfers */
+	pthread_mutex_t send_lock;
+	int reading;		/* Some thread is reading a reply */
+	struct sftp_replies *inbox;	/* Indexed by id >> SFTP_ID_SHIFT */
+	u_int *msg_id;
+	TAILQ_HEAD(, sftp_job) jobs;
+	u_int njobs;
+	u_int busy;		/* Transfers in progress */
+	int done;
+	int failed;
+	TAILQ_HEAD(, sftp_fixup) fixups;
+	int upload;
+	int preserve_flag, resume_flag, fsync_flag;
+	FILE *out, *err;
+	LogLevel log_level;
+	char *progname;
+	u_int nworkers;
+	struct sftp_worker *workers;
+};
+
+/* Which pool thread we are: 0 walks the tree, workers count from 1 */
+static __thread u_int pool_index;
+
 static u_char *
 get_handle(struct sftp_conn *conn, u_int expected_id, size_t *len,
     const char *errfmt, ...) __attribute__((format(printf, 4, 5)));
@@ -108,6 +211,78 @@ sftpio(void *_bwlimit, size_t amount)
 	return 0;
 }
 
+static u_int
+next_id(struct sftp_conn *conn)
+{
+	struct sftp_pool *pool = conn->pool;
+
+	if (pool == NULL)
+		return conn->msg_id++;
+	/* Only this thread uses its counter */
+	return (pool_index << SFTP_ID_SHIFT) |
+	    (pool->msg_id[pool_index]++ & SFTP_ID_MASK);
+}
+
+/*
+ * Adaptive request window: keep the lowest round trip seen and the best
+ * delivery rate over samples about one round trip long, then allow twice
+ * their product in flight, shared among the running transfers.  While
+ * the window is below the link's capacity the rate follows it up, so
+ * the window roughly doubles every round trip; once the link is full
+ * the rate stops growing and the window settles.
+ */
+static void
+request_sample(struct sftp_conn *conn, double sent, size_t len)
+{
+	double now, t;
+
+	if (conn->max_requests == 0)
+		return;
+	if (conn->pool != NULL)
+		pthread_mutex_lock(&conn->pool->lock);
+	now = monotime_double();
+	t = now - sent;
+	/* Let the minimum creep up so a changed route is noticed */
+	if (conn->rtt == 0 || t < conn->rtt)
+		conn->rtt = t;
+	else
+		conn->rtt += (t - conn->rtt) / 256;
+	if (conn->bw_start == 0)
+		conn->bw_start = sent;
+	conn->bw_bytes += len;
+	if (now - conn->bw_start >= MAXIMUM(conn->rtt, 0.01)) {
+		t = conn->bw_bytes / (now - conn->bw_start);
+		if (t > conn->bw)
+			conn->bw = t;
+		else
+			conn->bw = (conn->bw * 7 + t) / 8;
+		conn->bw_start = now;
+		conn->bw_bytes = 0;
+	}
+	if (conn->pool != NULL)
+		pthread_mutex_unlock(&conn->pool->lock);
+}
+
+static u_int
+request_window(struct sftp_conn *conn, u_int buflen)
+{
+	double n;
+	u_int shared = 1;
+
+	if (conn->max_requests == 0)
+		return conn->num_requests;
+	if (conn->pool != NULL) {
+		pthread_mutex_lock(&conn->pool->lock);
+		shared = MAXIMUM(conn->pool->busy, 1);
+	}
+	n = 2 * conn->bw * conn->rtt / buflen + 1;
+	if (conn->pool != NULL)
+		pthread_mutex_unlock(&conn->pool->lock);
+	n = MINIMUM(n, conn->max_requests);
+	n = MAXIMUM(n, conn->num_requests);
+	return MAXIMUM((u_int)n / shared, 1);
+}
+
 static void
 send_msg(struct sftp_conn *conn, struct sshbuf *m)
 {
@@ -124,10 +299,14 @@ send_msg(struct sftp_conn *conn, struct sshbuf *m)
 	iov[1].iov_base = (u_char *)sshbuf_ptr(m);
 	iov[1].iov_len = sshbuf_len(m);
 
+	if (conn->pool != NULL)
+		pthread_mutex_lock(&conn->pool->send_lock);
 	if (atomiciov6(writev, conn->fd_out, iov, 2, sftpio,
 	    conn->limit_kbps > 0 ? &conn->bwlimit_out : NULL) !=
 	    sshbuf_len(m) + sizeof(mlen))
 		fatal("Couldn't send packet: %s", strerror(errno));
+	if (conn->pool != NULL)
+		pthread_mutex_unlock(&conn->pool->send_lock);
 
 	sshbuf_reset(m);
 }
@@ -173,7 +352,50 @@ get_msg_extended(struct sftp_conn *conn, struct sshbuf *m, int initial)
 static void
 get_msg(struct sftp_conn *conn, struct sshbuf *m)
 {
-	get_msg_extended(conn, m, 0);
+	struct sftp_pool *pool = conn->pool;
+	struct sftp_reply *reply;
+	struct sshbuf *in;
+	u_int id, owner;
+	int r;
+
+	if (pool == NULL) {
+		get_msg_extended(conn, m, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while ((reply = TAILQ_FIRST(&pool->inbox[pool_index])) == NULL) {
+		if (pool->reading) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		pool->reading = 1;
+		pthread_mutex_unlock(&pool->lock);
+
+		if ((in = sshbuf_new()) == NULL)
+			fatal_f("sshbuf_new failed");
+		get_msg_extended(conn, in, 0);
+		if (sshbuf_len(in) < 5)
+			fatal("Short reply (%zu bytes)", sshbuf_len(in));
+		id = PEEK_U32(sshbuf_ptr(in) + 1);
+		owner = id >> SFTP_ID_SHIFT;
+		if (owner > pool->nworkers)
+			fatal("Unexpected reply %u", id);
+		reply = xcalloc(1, sizeof(*reply));
+		reply->msg = in;
+
+		pthread_mutex_lock(&pool->lock);
+		pool->reading = 0;
+		TAILQ_INSERT_TAIL(&pool->inbox[owner], reply, tq);
+		pthread_cond_broadcast(&pool->cond);
+	}
+	TAILQ_REMOVE(&pool->inbox[pool_index], reply, tq);
+	pthread_mutex_unlock(&pool->lock);
+
+	if ((r = sshbuf_putb(m, reply->msg)) != 0)
+		fatal_fr(r, "sshbuf_putb");
+	sshbuf_free(reply->msg);
+	free(reply);
 }
 
 static void
@@ -409,6 +631,7 @@ do_init(int fd_in, int fd_out, u_int transfer_buflen, u_int num_requests,
 	ret->num_requests = num_requests;
 	ret->exts = 0;
 	ret->limit_kbps = 0;
+	TAILQ_INIT(&ret->dircache);
 
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
@@ -499,6 +722,18 @@ do_init(int fd_in, int fd_out, u_int transfer_buflen, u_int num_requests,
 	return ret;
 }
 
+void
+sftp_set_adaptive_requests(struct sftp_conn *conn, u_int max_requests)
+{
+	conn->max_requests = MAXIMUM(max_requests, conn->num_requests);
+}
+
+void
+sftp_set_parallel_transfers(struct sftp_conn *conn, u_int n)
+{
+	conn->ntransfers = MINIMUM(n, SFTP_MAX_TRANSFERS);
+}
+
 u_int
 sftp_proto_version(struct sftp_conn *conn)
 {
@@ -515,7 +750,7 @@ do_close(struct sftp_conn *conn, const u_char *handle, u_int handle_len)
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_CLOSE)) != 0 ||
 	    (r = sshbuf_put_u32(msg, id)) != 0 ||
 	    (r = sshbuf_put_string(msg, handle, handle_len)) != 0)
@@ -539,15 +774,16 @@ do_lsreaddir(struct sftp_conn *conn, const char *path, int print_flag,
 {
 	struct sshbuf *msg;
 	u_int count, id, i, expected_id, ents = 0;
+	u_int ids[SFTP_READDIR_AHEAD], first = 0, inflight = 0, ahead;
 	size_t handle_len;
 	u_char type, *handle;
 	int status = SSH2_FX_FAILURE;
-	int r;
+	int r, done = 0, failed = 0;
 
 	if (dir)
 		*dir = NULL;
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
@@ -570,17 +806,27 @@ do_lsreaddir(struct sftp_conn *conn, const char *path, int print_flag,
 		(*dir)[0] = NULL;
 	}
 
-	for (; !interrupted;) {
-		id = expected_id = conn->msg_id++;
-
-		debug3("Sending SSH2_FXP_READDIR I:%u", id);
-
-		sshbuf_reset(msg);
-		if ((r = sshbuf_put_u8(msg, SSH2_FXP_READDIR)) != 0 ||
-		    (r = sshbuf_put_u32(msg, id)) != 0 ||
-		    (r = sshbuf_put_string(msg, handle, handle_len)) != 0)
-			fatal_fr(r, "compose READDIR");
-		send_msg(conn, msg);
+	/*
+	 * Keep several READDIRs in flight: the server answers them in
+	 * order, each with the next batch of names and with EOF once there
+	 * are none left.  Two cover a small directory in one round trip;
+	 * allow one more for every batch that comes back.
+	 */
+	ahead = 2;
+	for (;;) {
+		while (!done && !interrupted && inflight < ahead) {
+			id = next_id(conn);
+			debug3("Sending SSH2_FXP_READDIR I:%u", id);
+			if ((r = sshbuf_put_u8(msg, SSH2_FXP_READDIR)) != 0 ||
+			    (r = sshbuf_put_u32(msg, id)) != 0 ||
+			    (r = sshbuf_put_string(msg, handle,
+			    handle_len)) != 0)
+				fatal_fr(r, "compose READDIR");
+			send_msg(conn, msg);
+			ids[(first + inflight++) % SFTP_READDIR_AHEAD] = id;
+		}
+		if (inflight == 0)
+			break;
 
 		sshbuf_reset(msg);
 
@@ -592,19 +838,29 @@ do_lsreaddir(struct sftp_conn *conn, const char *path, int print_flag,
 
 		debug3("Received reply T:%u I:%u", type, id);
 
+		expected_id = ids[first];
+		first = (first + 1) % SFTP_READDIR_AHEAD;
+		inflight--;
 		if (id != expected_id)
 			fatal("ID mismatch (%u != %u)", id, expected_id);
 
+		/* Past EOF or an error, only collect what is in flight */
+		if (done || interrupted)
+			continue;
+
 		if (type == SSH2_FXP_STATUS) {
 			u_int rstatus;
 
 			if ((r = sshbuf_get_u32(msg, &rstatus)) != 0)
 				fatal_fr(r, "parse status");
 			debug3("Received SSH2_FXP_STATUS %d", rstatus);
-			if (rstatus == SSH2_FX_EOF)
-				break;
-			error("Couldn't read directory: %s", fx2txt(rstatus));
-			goto out;
+			done = 1;
+			if (rstatus != SSH2_FX_EOF) {
+				error("Couldn't read directory: %s",
+				    fx2txt(rstatus));
+				failed = 1;
+			}
+			continue;
 		} else if (type != SSH2_FXP_NAME)
 			fatal("Expected SSH2_FXP_NAME(%u) packet, got %u",
 			    SSH2_FXP_NAME, type);
@@ -613,8 +869,10 @@ do_lsreaddir(struct sftp_conn *conn, const char *path, int print_flag,
 			fatal_fr(r, "parse count");
 		if (count > SSHBUF_SIZE_MAX)
 			fatal_f("nonsensical number of entries");
-		if (count == 0)
-			break;
+		if (count == 0) {
+			done = 1;
+			continue;
+		}
 		debug3("Received %d SSH2_FXP_NAME responses", count);
 		for (i = 0; i < count; i++) {
 			char *filename, *longname;
@@ -629,7 +887,8 @@ do_lsreaddir(struct sftp_conn *conn, const char *path, int print_flag,
 				error_fr(r, "couldn't decode attrib");
 				free(filename);
 				free(longname);
-				goto out;
+				done = failed = 1;
+				break;
 			}
 
 			if (print_flag)
@@ -654,10 +913,12 @@ do_lsreaddir(struct sftp_conn *conn, const char *path, int print_flag,
 			free(filename);
 			free(longname);
 		}
+		if (ahead < SFTP_READDIR_AHEAD)
+			ahead++;
 	}
-	status = 0;
+	if (!failed)
+		status = 0;
 
- out:
 	sshbuf_free(msg);
 	do_close(conn, handle, handle_len);
 	free(handle);
@@ -696,14 +957,142 @@ void free_sftp_dirents(SFTP_DIRENT **s)
 	free(s);
 }
 
+static SFTP_DIRENT **
+dup_sftp_dirents(SFTP_DIRENT **s)
+{
+	SFTP_DIRENT **d;
+	u_int i, n;
+
+	for (n = 0; s[n] != NULL; n++)
+		;
+	d = xcalloc(n + 1, sizeof(*d));
+	for (i = 0; i < n; i++) {
+		d[i] = xcalloc(1, sizeof(**d));
+		d[i]->filename = xstrdup(s[i]->filename);
+		d[i]->longname = xstrdup(s[i]->longname);
+		memcpy(&d[i]->a, &s[i]->a, sizeof(d[i]->a));
+	}
+	return d;
+}
+
+static void
+dircache_free(struct sftp_conn *conn, struct sftp_dircache *dc)
+{
+	TAILQ_REMOVE(&conn->dircache, dc, tq);
+	conn->ndircache--;
+	free(dc->path);
+	free_sftp_dirents(dc->dir);
+	free(dc);
+}
+
+/* Returns the cached listing of path, if it is recent enough */
+static struct sftp_dircache *
+dircache_find(struct sftp_conn *conn, const char *path)
+{
+	struct sftp_dircache *dc, *tmp;
+	time_t now = monotime();
+
+	TAILQ_FOREACH_SAFE(dc, &conn->dircache, tq, tmp) {
+		if (now - dc->when >= SFTP_DIRCACHE_TTL) {
+			dircache_free(conn, dc);
+			continue;
+		}
+		if (strcmp(dc->path, path) == 0) {
+			TAILQ_REMOVE(&conn->dircache, dc, tq);
+			TAILQ_INSERT_HEAD(&conn->dircache, dc, tq);
+			return dc;
+		}
+	}
+	return NULL;
+}
+
+/* Forgets every listing; called before we change anything remotely */
+static void
+dircache_flush(struct sftp_conn *conn)
+{
+	struct sftp_dircache *dc;
+
+	if (conn->pool != NULL)
+		pthread_mutex_lock(&conn->pool->lock);
+	while ((dc = TAILQ_FIRST(&conn->dircache)) != NULL)
+		dircache_free(conn, dc);
+	if (conn->pool != NULL)
+		pthread_mutex_unlock(&conn->pool->lock);
+}
+
+int
+do_readdir_cached(struct sftp_conn *conn, const char *path,
+    SFTP_DIRENT ***dir)
+{
+	struct sftp_dircache *dc;
+
+	if (conn->pool != NULL)
+		return do_readdir(conn, path, dir);
+	if ((dc = dircache_find(conn, path)) != NULL) {
+		debug3_f("\"%s\" from cache", path);
+		*dir = dup_sftp_dirents(dc->dir);
+		return 0;
+	}
+	if (do_readdir(conn, path, dir) != 0)
+		return -1;
+	if (interrupted)
+		return 0;
+
+	if (conn->ndircache >= SFTP_DIRCACHE_MAX)
+		dircache_free(conn, TAILQ_LAST(&conn->dircache, sftp_dircaches));
+	dc = xcalloc(1, sizeof(*dc));
+	dc->path = xstrdup(path);
+	dc->dir = dup_sftp_dirents(*dir);
+	dc->when = monotime();
+	TAILQ_INSERT_HEAD(&conn->dircache, dc, tq);
+	conn->ndircache++;
+	return 0;
+}
+
+int
+sftp_cached_lstat(struct sftp_conn *conn, const char *path, Attrib *a)
+{
+	struct sftp_dircache *dc;
+	const char *name;
+	char *parent;
+	u_int i;
+
+	if (conn->pool != NULL || (name = strrchr(path, '/')) == NULL ||
+	    *++name == '\0')
+		return -1;
+	parent = xstrdup(path);
+	parent[name - path] = '\0';
+	dc = dircache_find(conn, parent);
+	if (dc == NULL && name - path > 1) {
+		/* glob(3) reads "dir/" but looks up "dir/name" */
+		parent[name - path - 1] = '\0';
+		dc = dircache_find(conn, parent);
+	}
+	free(parent);
+	if (dc == NULL)
+		return -1;
+	for (i = 0; dc->dir[i] != NULL; i++) {
+		if (strcmp(dc->dir[i]->filename, name) != 0)
+			continue;
+		/* Not every server sends the mode in a listing */
+		if ((dc->dir[i]->a.flags & SSH2_FILEXFER_ATTR_PERMISSIONS) == 0)
+			return -1;
+		memcpy(a, &dc->dir[i]->a, sizeof(*a));
+		return 0;
+	}
+	return -1;
+}
+
 int
 do_rm(struct sftp_conn *conn, const char *path)
 {
 	u_int status, id;
 
+	dircache_flush(conn);
+
 	debug2("Sending SSH2_FXP_REMOVE \"%s\"", path);
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 	send_string_request(conn, id, SSH2_FXP_REMOVE, path, strlen(path));
 	status = get_status(conn, id);
 	if (status != SSH2_FX_OK)
@@ -716,7 +1105,9 @@ do_mkdir(struct sftp_conn *conn, const char *path, Attrib *a, int print_flag)
 {
 	u_int status, id;
 
-	id = conn->msg_id++;
+	dircache_flush(conn);
+
+	id = next_id(conn);
 	send_string_attrs_request(conn, id, SSH2_FXP_MKDIR, path,
 	    strlen(path), a);
 
@@ -732,7 +1123,9 @@ do_rmdir(struct sftp_conn *conn, const char *path)
 {
 	u_int status, id;
 
-	id = conn->msg_id++;
+	dircache_flush(conn);
+
+	id = next_id(conn);
 	send_string_request(conn, id, SSH2_FXP_RMDIR, path,
 	    strlen(path));
 
@@ -748,7 +1141,7 @@ do_stat(struct sftp_conn *conn, const char *path, int quiet)
 {
 	u_int id;
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 
 	send_string_request(conn, id,
 	    conn->version == 0 ? SSH2_FXP_STAT_VERSION_0 : SSH2_FXP_STAT,
@@ -770,7 +1163,7 @@ do_lstat(struct sftp_conn *conn, const char *path, int quiet)
 		return(do_stat(conn, path, quiet));
 	}
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 	send_string_request(conn, id, SSH2_FXP_LSTAT, path,
 	    strlen(path));
 
@@ -784,7 +1177,7 @@ do_fstat(struct sftp_conn *conn, const u_char *handle, u_int handle_len,
 {
 	u_int id;
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 	send_string_request(conn, id, SSH2_FXP_FSTAT, handle,
 	    handle_len);
 
@@ -797,7 +1190,9 @@ do_setstat(struct sftp_conn *conn, const char *path, Attrib *a)
 {
 	u_int status, id;
 
-	id = conn->msg_id++;
+	dircache_flush(conn);
+
+	id = next_id(conn);
 	send_string_attrs_request(conn, id, SSH2_FXP_SETSTAT, path,
 	    strlen(path), a);
 
@@ -815,7 +1210,9 @@ do_fsetstat(struct sftp_conn *conn, const u_char *handle, u_int handle_len,
 {
 	u_int status, id;
 
-	id = conn->msg_id++;
+	dircache_flush(conn);
+
+	id = next_id(conn);
 	send_string_attrs_request(conn, id, SSH2_FXP_FSETSTAT, handle,
 	    handle_len, a);
 
@@ -836,7 +1233,7 @@ do_realpath(struct sftp_conn *conn, const char *path)
 	u_char type;
 	int r;
 
-	expected_id = id = conn->msg_id++;
+	expected_id = id = next_id(conn);
 	send_string_request(conn, id, SSH2_FXP_REALPATH, path,
 	    strlen(path));
 
@@ -891,11 +1288,13 @@ do_rename(struct sftp_conn *conn, const char *oldpath, const char *newpath,
 	u_int status, id;
 	int r, use_ext = (conn->exts & SFTP_EXT_POSIX_RENAME) && !force_legacy;
 
+	dircache_flush(conn);
+
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
 
 	/* Send rename request */
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if (use_ext) {
 		if ((r = sshbuf_put_u8(msg, SSH2_FXP_EXTENDED)) != 0 ||
 		    (r = sshbuf_put_u32(msg, id)) != 0 ||
@@ -931,6 +1330,8 @@ do_hardlink(struct sftp_conn *conn, const char *oldpath, const char *newpath)
 	u_int status, id;
 	int r;
 
+	dircache_flush(conn);
+
 	if ((conn->exts & SFTP_EXT_HARDLINK) == 0) {
 		error("Server does not support hardlink@openssh.com extension");
 		return -1;
@@ -940,7 +1341,7 @@ do_hardlink(struct sftp_conn *conn, const char *oldpath, const char *newpath)
 		fatal_f("sshbuf_new failed");
 
 	/* Send link request */
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_EXTENDED)) != 0 ||
 	    (r = sshbuf_put_u32(msg, id)) != 0 ||
 	    (r = sshbuf_put_cstring(msg, "hardlink@openssh.com")) != 0 ||
@@ -967,6 +1368,8 @@ do_symlink(struct sftp_conn *conn, const char *oldpath, const char *newpath)
 	u_int status, id;
 	int r;
 
+	dircache_flush(conn);
+
 	if (conn->version < 3) {
 		error("This server does not support the symlink operation");
 		return(SSH2_FX_OP_UNSUPPORTED);
@@ -976,7 +1379,7 @@ do_symlink(struct sftp_conn *conn, const char *oldpath, const char *newpath)
 		fatal_f("sshbuf_new failed");
 
 	/* Send symlink request */
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_SYMLINK)) != 0 ||
 	    (r = sshbuf_put_u32(msg, id)) != 0 ||
 	    (r = sshbuf_put_cstring(msg, oldpath)) != 0 ||
@@ -1009,7 +1412,7 @@ do_fsync(struct sftp_conn *conn, u_char *handle, u_int handle_len)
 	/* Send fsync request */
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_EXTENDED)) != 0 ||
 	    (r = sshbuf_put_u32(msg, id)) != 0 ||
 	    (r = sshbuf_put_cstring(msg, "fsync@openssh.com")) != 0 ||
@@ -1037,7 +1440,7 @@ do_readlink(struct sftp_conn *conn, const char *path)
 	u_char type;
 	int r;
 
-	expected_id = id = conn->msg_id++;
+	expected_id = id = next_id(conn);
 	send_string_request(conn, id, SSH2_FXP_READLINK, path, strlen(path));
 
 	if ((msg = sshbuf_new()) == NULL)
@@ -1096,7 +1499,7 @@ do_statvfs(struct sftp_conn *conn, const char *path, struct sftp_statvfs *st,
 		return -1;
 	}
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
@@ -1124,7 +1527,7 @@ do_fstatvfs(struct sftp_conn *conn, const u_char *handle, u_int handle_len,
 		return -1;
 	}
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
@@ -1147,12 +1550,14 @@ do_lsetstat(struct sftp_conn *conn, const char *path, Attrib *a)
 	u_int status, id;
 	int r;
 
+	dircache_flush(conn);
+
 	if ((conn->exts & SFTP_EXT_LSETSTAT) == 0) {
 		error("Server does not support lsetstat@openssh.com extension");
 		return -1;
 	}
 
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((msg = sshbuf_new()) == NULL)
 		fatal_f("sshbuf_new failed");
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_EXTENDED)) != 0 ||
@@ -1210,6 +1615,7 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 		u_int id;
 		size_t len;
 		u_int64_t offset;
+		double sent;
 		TAILQ_ENTRY(request) tq;
 	};
 	TAILQ_HEAD(reqhead, request) requests;
@@ -1245,7 +1651,7 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 	attrib_clear(&junk); /* Send empty attributes */
 
 	/* Send open request */
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_OPEN)) != 0 ||
 	    (r = sshbuf_put_u32(msg, id)) != 0 ||
 	    (r = sshbuf_put_cstring(msg, remote_path)) != 0 ||
@@ -1323,9 +1729,10 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 			    (unsigned long long)offset + buflen - 1,
 			    num_req, max_req);
 			req = xcalloc(1, sizeof(*req));
-			req->id = conn->msg_id++;
+			req->id = next_id(conn);
 			req->len = buflen;
 			req->offset = offset;
+			req->sent = monotime_double();
 			offset += buflen;
 			num_req++;
 			TAILQ_INSERT_TAIL(&requests, req, tq);
@@ -1369,6 +1776,7 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 				fatal("Received more data than asked for "
 				    "%zu > %zu", len, req->len);
 			lmodified = 1;
+			request_sample(conn, req->sent, len);
 			if ((lseek(local_fd, req->offset, SEEK_SET) == -1 ||
 			    atomicio(vwrite, local_fd, data, len) != len) &&
 			    !write_error) {
@@ -1394,9 +1802,10 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 				    (unsigned long long)req->offset + len,
 				    (unsigned long long)req->offset +
 				    req->len - 1, num_req);
-				req->id = conn->msg_id++;
+				req->id = next_id(conn);
 				req->len -= len;
 				req->offset += len;
+				req->sent = monotime_double();
 				send_read_request(conn, req->id,
 				    req->offset, req->len, handle, handle_len);
 				/* Reduce the request size */
@@ -1411,8 +1820,9 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 					    (unsigned long long)offset,
 					    num_req);
 					max_req = 1;
-				} else if (max_req < conn->num_requests) {
-					++max_req;
+				} else {
+					max_req = MINIMUM(max_req + 1,
+					    request_window(conn, buflen));
 				}
 			}
 			break;
@@ -1488,6 +1898,263 @@ do_download(struct sftp_conn *conn, const char *remote_path,
 	return status == SSH2_FX_OK ? 0 : -1;
 }
 
+static void
+download_dir_fixup(const char *dst, Attrib *dirattrib, mode_t mode,
+    mode_t tmpmode, int preserve_flag)
+{
+	if (preserve_flag) {
+		if (dirattrib->flags & SSH2_FILEXFER_ATTR_ACMODTIME) {
+			struct timeval tv[2];
+			tv[0].tv_sec = dirattrib->atime;
+			tv[1].tv_sec = dirattrib->mtime;
+			tv[0].tv_usec = tv[1].tv_usec = 0;
+			if (utimes(dst, tv) == -1)
+				error("Can't set times on \"%s\": %s",
+				    dst, strerror(errno));
+		} else
+			debug("Server did not send times for directory "
+			    "\"%s\"", dst);
+	}
+
+	if (mode != tmpmode && chmod(dst, mode) == -1)
+		error("Can't set final mode on \"%s\": %s", dst,
+		    strerror(errno));
+}
+
+static void *
+pool_worker(void *arg)
+{
+	struct sftp_worker *w = (struct sftp_worker *)arg;
+	struct sftp_conn *conn = w->conn;
+	struct sftp_pool *pool = conn->pool;
+	struct sftp_job *job;
+	int r;
+
+	thread_stdout = pool->out;
+	thread_stderr = pool->err;
+	log_init(pool->progname, pool->log_level, SYSLOG_FACILITY_USER, 1);
+	/* The progress meter draws one file at a time */
+	showprogress = 0;
+	pool_index = w->index;
+
+	pthread_mutex_lock(&pool->lock);
+	w->interrupted = &interrupted;
+	for (;;) {
+		while ((job = TAILQ_FIRST(&pool->jobs)) == NULL && !pool->done)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (job == NULL)
+			break;
+		TAILQ_REMOVE(&pool->jobs, job, tq);
+		pool->njobs--;
+		pool->busy++;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (interrupted)
+			r = -1;
+		else if (pool->upload) {
+			r = do_upload(conn, job->src, job->dst,
+			    pool->preserve_flag, pool->resume_flag,
+			    pool->fsync_flag);
+			if (r == -1)
+				error("Uploading of file %s to %s failed!",
+				    job->src, job->dst);
+		} else {
+			r = do_download(conn, job->src, job->dst, &job->a,
+			    pool->preserve_flag, pool->resume_flag,
+			    pool->fsync_flag);
+			if (r == -1)
+				error("Download of file %s to %s failed",
+				    job->src, job->dst);
+		}
+		free(job->src);
+		free(job->dst);
+		free(job);
+
+		pthread_mutex_lock(&pool->lock);
+		if (r == -1)
+			pool->failed = 1;
+		pool->busy--;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	w->interrupted = NULL;
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/*
+ * Wait on the pool from the walking thread.  An interrupt there is
+ * passed on to the workers, which drain their outstanding requests, and
+ * drops the files not started yet.  Called with the lock held.
+ */
+static void
+pool_wait(struct sftp_pool *pool)
+{
+	struct sftp_job *job;
+	struct timespec ts;
+	u_int i;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec++;
+	pthread_cond_timedwait(&pool->cond, &pool->lock, &ts);
+	if (!interrupted)
+		return;
+	for (i = 0; i < pool->nworkers; i++)
+		if (pool->workers[i].interrupted != NULL)
+			*pool->workers[i].interrupted = 1;
+	while ((job = TAILQ_FIRST(&pool->jobs)) != NULL) {
+		TAILQ_REMOVE(&pool->jobs, job, tq);
+		free(job->src);
+		free(job->dst);
+		free(job);
+	}
+	pool->njobs = 0;
+}
+
+static void
+pool_start(struct sftp_conn *conn, int upload, int preserve_flag,
+    int resume_flag, int fsync_flag)
+{
+	struct sftp_pool *pool;
+	u_int i;
+	int r;
+
+	if (conn->ntransfers <= 1)
+		return;
+
+	pool = xcalloc(1, sizeof(*pool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pthread_mutex_init(&pool->send_lock, NULL);
+	pool->nworkers = conn->ntransfers;
+	pool->inbox = xcalloc(pool->nworkers + 1, sizeof(*pool->inbox));
+	pool->msg_id = xcalloc(pool->nworkers + 1, sizeof(*pool->msg_id));
+	for (i = 0; i <= pool->nworkers; i++) {
+		TAILQ_INIT(&pool->inbox[i]);
+		pool->msg_id[i] = 1;
+	}
+	TAILQ_INIT(&pool->jobs);
+	TAILQ_INIT(&pool->fixups);
+	pool->upload = upload;
+	pool->preserve_flag = preserve_flag;
+	pool->resume_flag = resume_flag;
+	pool->fsync_flag = fsync_flag;
+	pool->out = thread_stdout;
+	pool->err = thread_stderr;
+	pool->log_level = log_level_get();
+	pool->progname = __progname;
+
+	/* Nothing is outstanding, so request ids can start over */
+	conn->pool = pool;
+	pool_index = 0;
+	pool->workers = xcalloc(pool->nworkers, sizeof(*pool->workers));
+	for (i = 0; i < pool->nworkers; i++) {
+		pool->workers[i].conn = conn;
+		pool->workers[i].index = i + 1;
+		if ((r = pthread_create(&pool->workers[i].thread, NULL,
+		    pool_worker, &pool->workers[i])) != 0)
+			fatal_f("pthread_create: %s", strerror(r));
+	}
+}
+
+static void
+pool_queue(struct sftp_conn *conn, const char *src, const char *dst,
+    Attrib *a)
+{
+	struct sftp_pool *pool = conn->pool;
+	struct sftp_job *job;
+
+	job = xcalloc(1, sizeof(*job));
+	job->src = xstrdup(src);
+	job->dst = xstrdup(dst);
+	if (a != NULL)
+		job->a = *a;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->njobs >= 2 * pool->nworkers && !interrupted)
+		pool_wait(pool);
+	if (interrupted) {
+		pthread_mutex_unlock(&pool->lock);
+		free(job->src);
+		free(job->dst);
+		free(job);
+		return;
+	}
+	TAILQ_INSERT_TAIL(&pool->jobs, job, tq);
+	pool->njobs++;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+pool_fixup(struct sftp_conn *conn, const char *path, Attrib *a,
+    mode_t mode, mode_t tmpmode)
+{
+	struct sftp_fixup *fixup;
+
+	fixup = xcalloc(1, sizeof(*fixup));
+	fixup->path = xstrdup(path);
+	fixup->a = *a;
+	fixup->mode = mode;
+	fixup->tmpmode = tmpmode;
+	/* Only the walking thread touches the list */
+	TAILQ_INSERT_TAIL(&conn->pool->fixups, fixup, tq);
+}
+
+/*
+ * Wait for the queued files, stop the workers and apply the directory
+ * attributes, innermost first as they were recorded.
+ */
+static int
+pool_finish(struct sftp_conn *conn)
+{
+	struct sftp_pool *pool = conn->pool;
+	struct sftp_fixup *fixup;
+	struct sftp_reply *reply;
+	int ret;
+	u_int i;
+
+	if (pool == NULL)
+		return 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->njobs > 0 || pool->busy > 0)
+		pool_wait(pool);
+	pool->done = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	conn->pool = NULL;
+	ret = pool->failed ? -1 : 0;
+
+	while ((fixup = TAILQ_FIRST(&pool->fixups)) != NULL) {
+		TAILQ_REMOVE(&pool->fixups, fixup, tq);
+		if (pool->upload)
+			do_setstat(conn, fixup->path, &fixup->a);
+		else
+			download_dir_fixup(fixup->path, &fixup->a,
+			    fixup->mode, fixup->tmpmode, pool->preserve_flag);
+		free(fixup->path);
+		free(fixup);
+	}
+	for (i = 0; i <= pool->nworkers; i++) {
+		while ((reply = TAILQ_FIRST(&pool->inbox[i])) != NULL) {
+			TAILQ_REMOVE(&pool->inbox[i], reply, tq);
+			sshbuf_free(reply->msg);
+			free(reply);
+		}
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->send_lock);
+	free(pool->workers);
+	free(pool->inbox);
+	free(pool->msg_id);
+	free(pool);
+	return ret;
+}
+
 static int
 download_dir_internal(struct sftp_conn *conn, const char *src, const char *dst,
     int depth, Attrib *dirattrib, int preserve_flag, int print_flag,
@@ -1550,7 +2217,10 @@ download_dir_internal(struct sftp_conn *conn, const char *src, const char *dst,
 			    print_flag, resume_flag, fsync_flag) == -1)
 				ret = -1;
 		} else if (S_ISREG(dir_entries[i]->a.perm) ) {
-			if (do_download(conn, new_src, new_dst,
+			if (conn->pool != NULL)
+				pool_queue(conn, new_src, new_dst,
+				    &(dir_entries[i]->a));
+			else if (do_download(conn, new_src, new_dst,
 			    &(dir_entries[i]->a), preserve_flag,
 			    resume_flag, fsync_flag) == -1) {
 				error("Download of file %s to %s failed",
@@ -1564,23 +2234,11 @@ download_dir_internal(struct sftp_conn *conn, const char *src, const char *dst,
 	free(new_dst);
 	free(new_src);
 
-	if (preserve_flag) {
-		if (dirattrib->flags & SSH2_FILEXFER_ATTR_ACMODTIME) {
-			struct timeval tv[2];
-			tv[0].tv_sec = dirattrib->atime;
-			tv[1].tv_sec = dirattrib->mtime;
-			tv[0].tv_usec = tv[1].tv_usec = 0;
-			if (utimes(dst, tv) == -1)
-				error("Can't set times on \"%s\": %s",
-				    dst, strerror(errno));
-		} else
-			debug("Server did not send times for directory "
-			    "\"%s\"", dst);
-	}
-
-	if (mode != tmpmode && chmod(dst, mode) == -1)
-		error("Can't set final mode on \"%s\": %s", dst,
-		    strerror(errno));
+	if (conn->pool != NULL)
+		pool_fixup(conn, dst, dirattrib, mode, tmpmode);
+	else
+		download_dir_fixup(dst, dirattrib, mode, tmpmode,
+		    preserve_flag);
 
 	free_sftp_dirents(dir_entries);
 
@@ -1600,8 +2258,11 @@ download_dir(struct sftp_conn *conn, const char *src, const char *dst,
 		return -1;
 	}
 
+	pool_start(conn, 0, preserve_flag, resume_flag, fsync_flag);
 	ret = download_dir_internal(conn, src_canon, dst, 0,
 	    dirattrib, preserve_flag, print_flag, resume_flag, fsync_flag);
+	if (pool_finish(conn) == -1)
+		ret = -1;
 	free(src_canon);
 	return ret;
 }
@@ -1625,6 +2286,7 @@ do_upload(struct sftp_conn *conn, const char *local_path,
 		u_int id;
 		u_int len;
 		off_t offset;
+		double sent;
 		TAILQ_ENTRY(outstanding_ack) tq;
 	};
 	TAILQ_HEAD(ackhead, outstanding_ack) acks;
@@ -1632,6 +2294,7 @@ do_upload(struct sftp_conn *conn, const char *local_path,
 	size_t handle_len;
 
 	TAILQ_INIT(&acks);
+	dircache_flush(conn);
 
 	if ((local_fd = open(local_path, O_RDONLY, 0)) == -1) {
 		error("Couldn't open local file \"%s\" for reading: %s",
@@ -1681,7 +2344,7 @@ do_upload(struct sftp_conn *conn, const char *local_path,
 		fatal_f("sshbuf_new failed");
 
 	/* Send open request */
-	id = conn->msg_id++;
+	id = next_id(conn);
 	if ((r = sshbuf_put_u8(msg, SSH2_FXP_OPEN)) != 0 ||
 	    (r = sshbuf_put_u32(msg, id)) != 0 ||
 	    (r = sshbuf_put_cstring(msg, remote_path)) != 0 ||
@@ -1736,6 +2399,7 @@ do_upload(struct sftp_conn *conn, const char *local_path,
 			ack->id = ++id;
 			ack->offset = offset;
 			ack->len = len;
+			ack->sent = monotime_double();
 			TAILQ_INSERT_TAIL(&acks, ack, tq);
 
 			sshbuf_reset(msg);
@@ -1756,7 +2420,7 @@ do_upload(struct sftp_conn *conn, const char *local_path,
 			fatal("Unexpected ACK %u", id);
 
 		if (id == startid || len == 0 ||
-		    id - ackid >= conn->num_requests) {
+		    id - ackid >= request_window(conn, conn->transfer_buflen)) {
 			u_int rid;
 
 			sshbuf_reset(msg);
@@ -1785,6 +2449,7 @@ do_upload(struct sftp_conn *conn, const char *local_path,
 			    ack->id, ack->len, (long long)ack->offset);
 			++ackid;
 			progress_counter += ack->len;
+			request_sample(conn, ack->sent, ack->len);
 			free(ack);
 		}
 		offset += len;
@@ -1907,7 +2572,9 @@ upload_dir_internal(struct sftp_conn *conn, const char *src, const char *dst,
 			    fsync_flag) == -1)
 				ret = -1;
 		} else if (S_ISREG(sb.st_mode)) {
-			if (do_upload(conn, new_src, new_dst,
+			if (conn->pool != NULL)
+				pool_queue(conn, new_src, new_dst, NULL);
+			else if (do_upload(conn, new_src, new_dst,
 			    preserve_flag, resume, fsync_flag) == -1) {
 				error("Uploading of file %s to %s failed!",
 				    new_src, new_dst);
@@ -1919,7 +2586,10 @@ upload_dir_internal(struct sftp_conn *conn, const char *src, const char *dst,
 	free(new_dst);
 	free(new_src);
 
-	do_setstat(conn, dst, &a);
+	if (conn->pool != NULL)
+		pool_fixup(conn, dst, &a, 0, 0);
+	else
+		do_setstat(conn, dst, &a);
 
 	(void) closedir(dirp);
 	return ret;
@@ -1937,13 +2607,48 @@ upload_dir(struct sftp_conn *conn, const char *src, const char *dst,
 		return -1;
 	}
 
+	pool_start(conn, 1, preserve_flag, resume, fsync_flag);
 	ret = upload_dir_internal(conn, src, dst_canon, 0, preserve_flag,
 	    print_flag, resume, fsync_flag);
+	if (pool_finish(conn) == -1)
+		ret = -1;
 
 	free(dst_canon);
 	return ret;
 }
 
+void
+sftp_transfer_start(struct sftp_conn *conn, int upload, int preserve_flag,
+    int resume_flag, int fsync_flag)
+{
+	conn->xfer_upload = upload;
+	conn->xfer_preserve = preserve_flag;
+	conn->xfer_resume = resume_flag;
+	conn->xfer_fsync = fsync_flag;
+	pool_start(conn, upload, preserve_flag, resume_flag, fsync_flag);
+}
+
+int
+sftp_transfer_queue(struct sftp_conn *conn, const char *src, const char *dst,
+    Attrib *a)
+{
+	if (conn->pool != NULL) {
+		pool_queue(conn, src, dst, a);
+		return 0;
+	}
+	if (conn->xfer_upload)
+		return do_upload(conn, src, dst, conn->xfer_preserve,
+		    conn->xfer_resume, conn->xfer_fsync);
+	return do_download(conn, src, dst, a, conn->xfer_preserve,
+	    conn->xfer_resume, conn->xfer_fsync);
+}
+
+int
+sftp_transfer_finish(struct sftp_conn *conn)
+{
+	return pool_finish(conn);
+}
+
 char *
 path_append(const char *p1, const char *p2)
 {
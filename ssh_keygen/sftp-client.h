@@ -59,6 +59,19 @@ struct sftp_statvfs {
  */
 struct sftp_conn *do_init(int, int, u_int, u_int, u_int64_t);
 
+/*
+ * Let the number of outstanding requests per transfer grow past the
+ * do_init() value, up to 'max', following the measured bandwidth-delay
+ * product of the link.
+ */
+void sftp_set_adaptive_requests(struct sftp_conn *, u_int);
+
+/*
+ * Run up to 'n' file transfers at once over the connection in
+ * download_dir() and upload_dir().
+ */
+void sftp_set_parallel_transfers(struct sftp_conn *, u_int);
+
 u_int sftp_proto_version(struct sftp_conn *);
 
 /* Close file referred to by 'handle' */
@@ -67,6 +80,18 @@ int do_close(struct sftp_conn *, const u_char *, u_int);
 /* Read contents of 'path' to NULL-terminated array 'dir' */
 int do_readdir(struct sftp_conn *, const char *, SFTP_DIRENT ***);
 
+/*
+ * As do_readdir(), but may return a listing up to a few seconds old that
+ * was read before; none survive a change we make on the server.
+ */
+int do_readdir_cached(struct sftp_conn *, const char *, SFTP_DIRENT ***);
+
+/*
+ * Get the attributes of 'path' from the cached listing of its directory,
+ * without asking the server.  Returns -1 if it is not there.
+ */
+int sftp_cached_lstat(struct sftp_conn *, const char *, Attrib *);
+
 /* Frees a NULL-terminated array of SFTP_DIRENTs (eg. from do_readdir) */
 void free_sftp_dirents(SFTP_DIRENT **);
 
@@ -139,6 +164,17 @@ int do_upload(struct sftp_conn *, const char *, const char *, int, int, int);
 int upload_dir(struct sftp_conn *, const char *, const char *, int, int, int,
     int);
 
+/*
+ * Transfer single files the way download_dir() and upload_dir() do, up
+ * to sftp_set_parallel_transfers() at a time. sftp_transfer_queue()
+ * returns -1 if a file it transferred itself failed; files handed to the
+ * parallel transfers are accounted for by sftp_transfer_finish().
+ */
+void sftp_transfer_start(struct sftp_conn *, int, int, int, int);
+int sftp_transfer_queue(struct sftp_conn *, const char *, const char *,
+    Attrib *);
+int sftp_transfer_finish(struct sftp_conn *);
+
 /* Concatenate paths, taking care of slashes. Caller must free result. */
 char *path_append(const char *, const char *);
 
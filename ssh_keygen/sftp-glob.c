@@ -51,7 +51,7 @@ fudge_opendir(const char *path)
 
 	r = xcalloc(1, sizeof(*r));
 
-	if (do_readdir(cur.conn, (char *)path, &r->dir)) {
+	if (do_readdir_cached(cur.conn, (char *)path, &r->dir)) {
 		free(r);
 		return(NULL);
 	}
@@ -110,8 +110,12 @@ fudge_closedir(struct SFTP_OPENDIR *od)
 static int
 fudge_lstat(const char *path, struct stat *st)
 {
-	Attrib *a;
+	Attrib *a, ca;
 
+	if (sftp_cached_lstat(cur.conn, path, &ca) == 0) {
+		attrib_to_stat(&ca, st);
+		return(0);
+	}
 	if (!(a = do_lstat(cur.conn, (char *)path, 1)))
 		return(-1);
 
@@ -123,8 +127,14 @@ fudge_lstat(const char *path, struct stat *st)
 static int
 fudge_stat(const char *path, struct stat *st)
 {
-	Attrib *a;
+	Attrib *a, ca;
 
+	/* Only a symlink needs the server to follow it */
+	if (sftp_cached_lstat(cur.conn, path, &ca) == 0 &&
+	    !S_ISLNK(ca.perm)) {
+		attrib_to_stat(&ca, st);
+		return(0);
+	}
 	if (!(a = do_stat(cur.conn, (char *)path, 1)))
 		return(-1);
 
@@ -72,6 +72,7 @@ typedef void EditLine;
 
 #define DEFAULT_COPY_BUFLEN	32768	/* Size of buffer for up/download */
 #define DEFAULT_NUM_REQUESTS	64	/* # concurrent outstanding requests */
+#define DEFAULT_MAX_REQUESTS	512	/* Ceiling of the adaptive window */
 
 /* File to read commands from */
 static __thread FILE* infile;
@@ -2369,9 +2370,9 @@ usage(void)
 	fprintf(stderr,
 	    "usage: %s [-46AaCfNpqrv] [-B buffer_size] [-b batchfile] [-c cipher]\n"
 	    "          [-D sftp_server_path] [-F ssh_config] [-i identity_file]\n"
-	    "          [-J destination] [-l limit] [-o ssh_option] [-P port]\n"
-	    "          [-R num_requests] [-S program] [-s subsystem | sftp_server]\n"
-	    "          destination\n",
+	    "          [-j num_transfers] [-J destination] [-l limit]\n"
+	    "          [-o ssh_option] [-P port] [-R num_requests] [-S program]\n"
+	    "          [-s subsystem | sftp_server] destination\n",
 	    __progname);
 	exit(1);
 }
@@ -2392,6 +2393,7 @@ sftp_main(int argc, char **argv)
 	struct sftp_conn *conn;
 	size_t copy_buffer_len = DEFAULT_COPY_BUFLEN;
 	size_t num_requests = DEFAULT_NUM_REQUESTS;
+	int fixed_requests = 0, num_transfers = 1;
 	long long limit_kbps = 0;
 
 	/* Ensure that fds 0, 1 and 2 are open or directed to /dev/null */
@@ -2416,7 +2418,7 @@ sftp_main(int argc, char **argv)
 #endif
 
 	while ((ch = getopt(argc, argv,
-	    "1246AafhNpqrvCc:D:i:l:o:s:S:b:B:F:J:P:R:")) != -1) {
+	    "1246AafhNpqrvCc:D:i:j:l:o:s:S:b:B:F:J:P:R:")) != -1) {
 		switch (ch) {
 		/* Passed through to ssh(1) */
 		case 'A':
@@ -2490,6 +2492,12 @@ sftp_main(int argc, char **argv)
 		case 'D':
 			sftp_direct = optarg;
 			break;
+		case 'j':
+			num_transfers = strtonum(optarg, 1, 16, &errstr);
+			if (errstr != NULL)
+				fatal("Invalid number of transfers \"%s\": %s",
+				    optarg, errstr);
+			break;
 		case 'l':
 			limit_kbps = strtonum(optarg, 1, 100 * 1024 * 1024,
 			    &errstr);
@@ -2505,6 +2513,7 @@ sftp_main(int argc, char **argv)
 			if (num_requests == 0 || *cp != '\0')
 				fatal("Invalid number of requests \"%s\"",
 				    optarg);
+			fixed_requests = 1;
 			break;
 		case 's':
 			sftp_server = optarg;
@@ -2593,6 +2602,9 @@ sftp_main(int argc, char **argv)
     
 	if (conn == NULL)
 		fatal("Couldn't initialise connection to server");
+	if (!fixed_requests)
+		sftp_set_adaptive_requests(conn, DEFAULT_MAX_REQUESTS);
+	sftp_set_parallel_transfers(conn, num_transfers);
     fflush(thread_stderr);
     
 	if (!quiet) {
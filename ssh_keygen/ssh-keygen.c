@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <pthread.h>
 #ifdef HAVE_PATHS_H
 # include <paths.h>
 #endif
@@ -179,9 +180,9 @@ static char hostname[NI_MAXHOST];
 
 #ifdef WITH_OPENSSL
 /* moduli.c */
-int gen_candidates(FILE *, u_int32_t, u_int32_t, BIGNUM *);
+int gen_candidates(FILE *, u_int32_t, u_int32_t, BIGNUM *, u_int);
 int prime_test(FILE *, FILE *, u_int32_t, u_int32_t, char *, unsigned long,
-    unsigned long);
+    unsigned long, u_int);
 #endif
 
 #if TARGET_OS_IPHONE
@@ -2841,6 +2842,7 @@ do_moduli_gen(const char *out_file, char **opts, size_t nopts)
 	u_int32_t memory = 0;
 	BIGNUM *start = NULL;
 	int moduli_bits = 0;
+	u_int threads = 0;
 	FILE *out;
 	size_t i;
 	const char *errstr;
@@ -2865,6 +2867,12 @@ do_moduli_gen(const char *out_file, char **opts, size_t nopts)
 				fatal("Invalid number: %s (%s)",
 					opts[i]+12, errstr);
 			}
+		} else if (strncmp(opts[i], "threads=", 8) == 0) {
+			threads = (u_int)strtonum(opts[i]+8, 1, 64, &errstr);
+			if (errstr) {
+				fatal("Invalid number of threads: %s (%s)",
+				    opts[i]+8, errstr);
+			}
 		} else {
 			fatal("Option \"%s\" is unsupported for moduli "
 			    "generation", opts[i]);
@@ -2879,7 +2887,7 @@ do_moduli_gen(const char *out_file, char **opts, size_t nopts)
 
 	if (moduli_bits == 0)
 		moduli_bits = DEFAULT_BITS;
-	if (gen_candidates(out, memory, moduli_bits, start) != 0)
+	if (gen_candidates(out, memory, moduli_bits, start, threads) != 0)
 		fatal("modulus candidate generation failed");
 #else /* WITH_OPENSSL */
 	fatal("Moduli generation is not supported");
@@ -2895,6 +2903,7 @@ do_moduli_screen(const char *out_file, char **opts, size_t nopts)
 	u_int32_t generator_wanted = 0;
 	unsigned long start_lineno = 0, lines_to_process = 0;
 	int prime_tests = 0;
+	u_int threads = 0;
 	FILE *out, *in = stdin;
 	size_t i;
 	const char *errstr;
@@ -2921,6 +2930,12 @@ do_moduli_screen(const char *out_file, char **opts, size_t nopts)
 				fatal("Invalid number: %s (%s)",
 					opts[i]+12, errstr);
 			}
+		} else if (strncmp(opts[i], "threads=", 8) == 0) {
+			threads = (u_int)strtonum(opts[i]+8, 1, 64, &errstr);
+			if (errstr) {
+				fatal("Invalid number of threads: %s (%s)",
+				    opts[i]+8, errstr);
+			}
 		} else {
 			fatal("Option \"%s\" is unsupported for moduli "
 			    "screening", opts[i]);
@@ -2942,7 +2957,7 @@ do_moduli_screen(const char *out_file, char **opts, size_t nopts)
 	setvbuf(out, NULL, _IOLBF, 0);
 	if (prime_test(in, out, prime_tests == 0 ? 100 : prime_tests,
 	    generator_wanted, checkpoint,
-	    start_lineno, lines_to_process) != 0)
+	    start_lineno, lines_to_process, threads) != 0)
 		fatal("modulus screening failed");
 #else /* WITH_OPENSSL */
 	fatal("Moduli screening is not supported");
@@ -2982,6 +2997,157 @@ passphrase_again:
 	return passphrase1;
 }
 
+/*
+ * Batch key generation (-O batch=N): N keys of one type, saved as
+ * <file>-1 ... <file>-N with the same passphrase and comment, generated
+ * by a pool of threads. The globals of this file are thread-local on
+ * iOS, so everything a worker needs is passed in struct gen_batch.
+ */
+struct gen_batch_key {
+	char path[PATH_MAX];
+	struct sshkey *public;
+	int r;
+	const char *what;
+};
+
+struct gen_batch {
+	pthread_mutex_t lock;
+	struct gen_batch_key *keys;
+	u_int nkeys, next;
+	int type;
+	u_int32_t bits;
+	const char *passphrase, *comment, *cipher;
+	int format, rounds;
+	FILE *in, *out, *err;
+	LogLevel level;
+};
+
+static void *
+gen_batch_thread(void *arg)
+{
+	struct gen_batch *gb = arg;
+	struct gen_batch_key *k;
+	struct sshkey *private;
+	char pubpath[PATH_MAX];
+
+	thread_stdin = gb->in;
+	thread_stdout = gb->out;
+	thread_stderr = gb->err;
+	log_init("ssh-keygen", gb->level, SYSLOG_FACILITY_USER, 1);
+	for (;;) {
+		pthread_mutex_lock(&gb->lock);
+		k = gb->next < gb->nkeys ? &gb->keys[gb->next++] : NULL;
+		pthread_mutex_unlock(&gb->lock);
+		if (k == NULL)
+			break;
+		private = NULL;
+		if ((k->r = sshkey_generate(gb->type, gb->bits,
+		    &private)) != 0) {
+			k->what = "sshkey_generate";
+			continue;
+		}
+		if ((k->r = sshkey_from_private(private,
+		    &k->public)) != 0) {
+			k->what = "sshkey_from_private";
+		} else if ((k->r = sshkey_save_private(private, k->path,
+		    gb->passphrase, gb->comment, gb->format, gb->cipher,
+		    gb->rounds)) != 0) {
+			k->what = "saving private key";
+		} else {
+			snprintf(pubpath, sizeof(pubpath), "%s.pub", k->path);
+			if ((k->r = sshkey_save_public(k->public, pubpath,
+			    gb->comment)) != 0)
+				k->what = "saving public key";
+		}
+		sshkey_free(private);
+	}
+	return NULL;
+}
+
+static void
+do_gen_batch(struct passwd *pw, int type, u_int32_t bits, u_int count,
+    u_int threads, const char *identity_comment)
+{
+	struct gen_batch gb;
+	pthread_t *tids;
+	char *passphrase, comment[1024], *fp;
+	u_int i;
+	long n;
+	int r, failed = 0;
+
+	if (!have_identity)
+		ask_filename(pw, "Enter file prefix in which to save the keys");
+	hostfile_create_user_ssh_dir(identity_file, !quiet);
+
+	memset(&gb, 0, sizeof(gb));
+	gb.keys = xcalloc(count, sizeof(*gb.keys));
+	gb.nkeys = count;
+	for (i = 0; i < count; i++) {
+		r = snprintf(gb.keys[i].path, sizeof(gb.keys[i].path),
+		    "%s-%u", identity_file, i + 1);
+		if (r < 0 || (size_t)r >= sizeof(gb.keys[i].path))
+			fatal("Key path \"%s\" too long", identity_file);
+		if (!confirm_overwrite(gb.keys[i].path))
+			exit(1);
+	}
+
+	passphrase = private_key_passphrase();
+	if (identity_comment) {
+		strlcpy(comment, identity_comment, sizeof(comment));
+	} else {
+		/* Create default comment field for the passphrase. */
+		snprintf(comment, sizeof comment, "%s@%s", pw->pw_name, hostname);
+	}
+
+	if (threads == 0) {
+		if ((n = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+			n = 1;
+		threads = n > 64 ? 64 : (u_int)n;
+	}
+	if (threads > count)
+		threads = count;
+	pthread_mutex_init(&gb.lock, NULL);
+	gb.type = type;
+	gb.bits = bits;
+	gb.passphrase = passphrase;
+	gb.comment = comment;
+	gb.format = private_key_format;
+	gb.cipher = openssh_format_cipher;
+	gb.rounds = rounds;
+	gb.in = thread_stdin;
+	gb.out = thread_stdout;
+	gb.err = thread_stderr;
+	gb.level = log_level_get();
+	tids = xcalloc(threads, sizeof(*tids));
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&tids[i], NULL, gen_batch_thread, &gb) != 0)
+			fatal("pthread_create: %s", strerror(errno));
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	pthread_mutex_destroy(&gb.lock);
+	free(tids);
+	freezero(passphrase, strlen(passphrase));
+
+	for (i = 0; i < count; i++) {
+		if (gb.keys[i].r != 0) {
+			error_r(gb.keys[i].r, "%s: %s failed",
+			    gb.keys[i].path, gb.keys[i].what);
+			failed = 1;
+		} else if (!quiet) {
+			if ((fp = sshkey_fingerprint(gb.keys[i].public,
+			    fingerprint_hash, SSH_FP_DEFAULT)) == NULL)
+				fatal("sshkey_fingerprint failed");
+			fprintf(thread_stdout, "%s %s %s\n",
+			    gb.keys[i].path, fp, comment);
+			free(fp);
+		}
+		sshkey_free(gb.keys[i].public);
+	}
+	free(gb.keys);
+	exit(failed);
+}
+
 static const char *
 skip_ssh_url_preamble(const char *s)
 {
@@ -3608,6 +3774,35 @@ sshkeygen_main(int argc, char **argv)
 	type = sshkey_type_from_name(key_type_name);
 	type_bits_valid(type, key_type_name, &bits);
 
+	if (type != KEY_ECDSA_SK && type != KEY_ED25519_SK) {
+		u_int batch = 0, threads = 0;
+		const char *errstr;
+
+		for (i = 0; i < nopts; i++) {
+			if (strncasecmp(opts[i], "batch=", 6) == 0) {
+				batch = (u_int)strtonum(opts[i] + 6, 1,
+				    100000, &errstr);
+				if (errstr != NULL)
+					fatal("Invalid batch size: %s (%s)",
+					    opts[i] + 6, errstr);
+			} else if (strncasecmp(opts[i], "threads=", 8) == 0) {
+				threads = (u_int)strtonum(opts[i] + 8, 1,
+				    64, &errstr);
+				if (errstr != NULL)
+					fatal("Invalid number of threads: "
+					    "%s (%s)", opts[i] + 8, errstr);
+			}
+		}
+		if (batch != 0) {
+			if (!quiet)
+				fprintf(thread_stdout, "Generating %u public/"
+				    "private %s key pairs.\n", batch,
+				    key_type_name);
+			do_gen_batch(pw, type, bits, batch, threads,
+			    identity_comment);
+		}
+	}
+
 	if (!quiet)
 		fprintf(thread_stdout, "Generating public/private %s key pair.\n",
 		    key_type_name);
@@ -58,6 +58,7 @@
 #ifdef HAVE_PATHS_H
 #include <paths.h>
 #endif
+#include <pthread.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -144,6 +145,36 @@ __thread int need_controlpersist_detach = 0;
 /* Copies of flags for ControlPersist foreground mux-client */
 __thread int ostdin_null_flag, ono_shell_flag, otty_flag, orequest_tty;
 
+#if TARGET_OS_IPHONE
+/*
+ * There is no fork() for ControlPersist: the master runs ssh_main() again
+ * on a thread of its own, with the arguments we were started with, and
+ * reports back once it is listening for mux clients.
+ */
+#define CP_STARTING	0
+#define CP_READY	1	/* master is listening */
+#define CP_FAILED	2	/* master exited before listening */
+#define CP_NOMUX	3	/* master connected but could not listen */
+
+struct control_persist_ctx {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int refs;
+	int state;
+	int ac;
+	char **av;
+	FILE *in, *out, *err;
+	FILE *devnull;
+};
+
+/* Set in the master thread only */
+static __thread struct control_persist_ctx *control_persist_master = NULL;
+
+/* Arguments of this ssh_main(), for the master thread */
+static __thread int orig_ac;
+static __thread char **orig_av;
+#endif
+
 /*
  * Flag indicating that ssh should fork after authentication.  This is useful
  * so that the passphrase can be entered manually, and then ssh goes to the
@@ -157,9 +188,10 @@ int fork_after_authentication_flag = 0;
  * General data structure for command line options and options configurable
  * in configuration files.  See readconf.h.
  */
-// Making this variable __thread breaks ssh connection (banner exchange: Connection to unknown port)
-// Warning: it appears 4 times, make sure all 4 are __thread first.
-Options options;
+// iOS: a control master runs on a thread of its own next to its clients.
+// The extern declarations in clientloop.c, mux.c, sshconnect.c and
+// sshconnect2.c must be __thread too, or the connection breaks.
+__thread Options options;
 
 /* optional user configfile */
 __thread char *config = NULL;
@@ -181,7 +213,7 @@ __thread char *forward_agent_sock_path = NULL;
 __thread struct sockaddr_storage hostaddr;
 
 /* Private host keys. */
-Sensitive sensitive_data;
+__thread Sensitive sensitive_data;
 
 /* command to be executed */
 __thread struct sshbuf *command;
@@ -193,8 +225,8 @@ __thread int subsystem_flag = 0;
 static __thread int forward_confirms_pending = -1;
 
 /* mux.c */
-extern int muxserver_sock;
-extern u_int muxclient_command;
+extern __thread int muxserver_sock;
+extern __thread u_int muxclient_command;
 
 /* Prints a help message to the user.  This function never returns. */
 
@@ -214,6 +246,11 @@ usage(void)
 }
 
 static int ssh_session2(struct ssh *, const struct ssh_conn_info *);
+#if TARGET_OS_IPHONE
+static void control_persist_start(void);
+static void control_persist_signal(int);
+static void control_persist_ready(void);
+#endif
 static void load_public_identity_files(const struct ssh_conn_info *);
 static void main_sigchld_handler(int);
 
@@ -668,6 +705,9 @@ ssh_main(int ac, char **av)
 	compat_init_setproctitle(ac, av);
 	av = saved_av;
 #endif
+#else
+	orig_ac = ac;
+	orig_av = av;
 #endif
 
 	seed_rng();
@@ -799,6 +839,8 @@ ssh_main(int ac, char **av)
 				cp = cipher_alg_list('\n', 0);
 			else if (strcmp(optarg, "cipher-auth") == 0)
 				cp = cipher_alg_list('\n', 1);
+			else if (strcmp(optarg, "cipher-speed") == 0)
+				cp = cipher_speed_list('\n');
 			else if (strcmp(optarg, "mac") == 0 ||
 			    strcasecmp(optarg, "MACs") == 0)
 				cp = mac_alg_list('\n');
@@ -831,7 +873,7 @@ ssh_main(int ac, char **av)
 						cp[n] = '\n';
 			} else if (strcmp(optarg, "help") == 0) {
 				cp = xstrdup(
-				    "cipher\ncipher-auth\ncompression\nkex\n"
+				    "cipher\ncipher-auth\ncipher-speed\ncompression\nkex\n"
 				    "key\nkey-cert\nkey-plain\nkey-sig\nmac\n"
 				    "protocol-version\nsig");
 			}
@@ -1246,6 +1288,28 @@ ssh_main(int ac, char **av)
 			set_addrinfo_port(addrs, options.port);
 	}
 
+#if TARGET_OS_IPHONE
+	/*
+	 * ssh, scp and sftp all run in this process: unless the
+	 * configuration says otherwise, commands and subsystems share one
+	 * connection per destination, kept open for ten minutes by a
+	 * master thread. Interactive logins still connect on their own.
+	 */
+	if (options.control_master == -1 && options.control_path == NULL &&
+	    options.control_persist == -1 && muxclient_command == 0 &&
+	    options.stdio_forward_host == NULL &&
+	    options.num_local_forwards == 0 &&
+	    options.num_remote_forwards == 0 &&
+	    options.tun_open == -1 &&
+	    (sshbuf_len(command) != 0 || options.remote_command != NULL ||
+	    subsystem_flag)) {
+		options.control_master = SSHCTL_MASTER_AUTO;
+		options.control_path = xstrdup("%C");
+		options.control_persist = 1;
+		options.control_persist_timeout = 600;
+	}
+#endif
+
 	/* Fill configuration defaults. */
 	if (fill_default_options(&options) != 0)
 		cleanup_exit(255);
@@ -1547,6 +1611,14 @@ ssh_main(int ac, char **av)
 			ssh_packet_set_mux(ssh);
 			goto skip_connect;
 		}
+#if TARGET_OS_IPHONE
+		if (options.control_persist &&
+		    options.control_master != SSHCTL_MASTER_NO &&
+		    control_persist_master == NULL &&
+		    (muxclient_command == SSHMUX_COMMAND_OPEN ||
+		    muxclient_command == SSHMUX_COMMAND_STDIO_FWD))
+			control_persist_start();
+#endif
 	}
 
 	/*
@@ -1712,14 +1784,156 @@ ssh_main(int ac, char **av)
 	ssh_packet_close(ssh);
 
 	if (options.control_path != NULL && muxserver_sock != -1)
+#if TARGET_OS_IPHONE
+		mux_broker_unlisten(options.control_path);
+#else
 		unlink(options.control_path);
+#endif
 
 	/* Kill ProxyCommand if it is running. */
 	ssh_kill_proxy_command();
 	return exit_status;
 }
 
-#if !TARGET_OS_IPHONE
+#if TARGET_OS_IPHONE
+static void
+control_persist_release(struct control_persist_ctx *cp)
+{
+	int i, refs;
+
+	pthread_mutex_lock(&cp->lock);
+	refs = --cp->refs;
+	pthread_mutex_unlock(&cp->lock);
+	if (refs > 0)
+		return;
+	for (i = 0; i < cp->ac; i++)
+		free(cp->av[i]);
+	free(cp->av);
+	pthread_cond_destroy(&cp->cond);
+	pthread_mutex_destroy(&cp->lock);
+	free(cp);
+}
+
+/* Tell the thread that started this master how far it got, once. */
+static void
+control_persist_signal(int state)
+{
+	struct control_persist_ctx *cp = control_persist_master;
+
+	if (cp == NULL)
+		return;
+	pthread_mutex_lock(&cp->lock);
+	if (cp->state == CP_STARTING) {
+		cp->state = state;
+		pthread_cond_broadcast(&cp->cond);
+	}
+	pthread_mutex_unlock(&cp->lock);
+}
+
+/* Runs on every exit from the master thread, including exit() */
+static void
+control_persist_thread_exit(void *arg)
+{
+	struct control_persist_ctx *cp = arg;
+
+	control_persist_signal(CP_FAILED);
+	control_persist_master = NULL;
+	if (cp->devnull != NULL)
+		fclose(cp->devnull);
+	control_persist_release(cp);
+}
+
+static void *
+control_persist_thread(void *arg)
+{
+	struct control_persist_ctx *cp = arg;
+	extern int optind, optreset;
+
+	/* Prompts before authentication go to the starting command */
+	thread_stdin = cp->in;
+	thread_stdout = cp->out;
+	thread_stderr = cp->err;
+	control_persist_master = cp;
+	optind = optreset = 1;
+	pthread_cleanup_push(control_persist_thread_exit, cp);
+	ssh_main(cp->ac, cp->av);
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+/*
+ * Start a master thread for options.control_path and wait until it is
+ * listening, then become its mux client. Returns only if the master could
+ * not set up the control socket, with multiplexing disabled.
+ */
+static void
+control_persist_start(void)
+{
+	struct control_persist_ctx *cp;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int i, r, state;
+
+	debug_f("starting master thread for %s", options.control_path);
+	cp = xcalloc(1, sizeof(*cp));
+	pthread_mutex_init(&cp->lock, NULL);
+	pthread_cond_init(&cp->cond, NULL);
+	cp->refs = 2;
+	cp->state = CP_STARTING;
+	cp->ac = orig_ac;
+	cp->av = xcalloc(orig_ac + 1, sizeof(*cp->av));
+	for (i = 0; i < orig_ac; i++)
+		cp->av[i] = xstrdup(orig_av[i]);
+	cp->in = thread_stdin;
+	cp->out = thread_stdout;
+	cp->err = thread_stderr;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	r = pthread_create(&thread, &attr, control_persist_thread, cp);
+	pthread_attr_destroy(&attr);
+	if (r != 0) {
+		error_f("pthread_create: %s", strerror(r));
+		cp->refs = 1;
+		state = CP_NOMUX;
+	} else {
+		pthread_mutex_lock(&cp->lock);
+		while (cp->state == CP_STARTING)
+			pthread_cond_wait(&cp->cond, &cp->lock);
+		state = cp->state;
+		pthread_mutex_unlock(&cp->lock);
+	}
+	control_persist_release(cp);
+
+	options.control_master = SSHCTL_MASTER_NO;
+	switch (state) {
+	case CP_READY:
+		muxclient(options.control_path);
+		/* muxclient() doesn't return on success. */
+		fatal("Failed to connect to new control master");
+	case CP_FAILED:
+		/* The master has already said why */
+		cleanup_exit(255);
+	default:
+		debug_f("no control master, connecting directly");
+		break;
+	}
+}
+
+/* Master thread: authenticated and listening, let go of the caller. */
+static void
+control_persist_ready(void)
+{
+	struct control_persist_ctx *cp = control_persist_master;
+
+	debug_f("master thread listening on %s", options.control_path);
+	/* The caller's streams may be closed as soon as it is signalled */
+	if ((cp->devnull = fopen(_PATH_DEVNULL, "r+")) == NULL)
+		fatal_f("open %s: %s", _PATH_DEVNULL, strerror(errno));
+	thread_stdin = thread_stdout = thread_stderr = cp->devnull;
+	control_persist_signal(CP_READY);
+}
+#else
 static void
 control_persist_detach(void)
 {
@@ -2115,11 +2329,17 @@ ssh_session2_open(struct ssh *ssh)
 	if (tty_flag) {
 		window >>= 1;
 		packetmax >>= 1;
+	} else if (subsystem_flag) {
+		/* Room for sftp's adaptive read window on long, fast links */
+		window <<= 3;
 	}
 	c = channel_new(ssh,
 	    "session", SSH_CHANNEL_OPENING, in, out, err,
 	    window, packetmax, CHAN_EXTENDED_WRITE,
 	    "client-session", /*nonblock*/0);
+	/* Bulk sessions (scp, sftp, pipes) may grow their window */
+	if (!tty_flag)
+		c->local_window_limit = options.channel_window_max;
 
 	debug3_f("channel_new: %d", c->self);
 
@@ -2189,6 +2409,16 @@ ssh_session2(struct ssh *ssh, const struct ssh_conn_info *cinfo)
 	 */
 	if (options.control_persist && muxserver_sock == -1)
 		ssh_init_stdio_forwarding(ssh);
+#if TARGET_OS_IPHONE
+	if (control_persist_master != NULL) {
+		if (muxserver_sock == -1) {
+			/* Another master got the ControlPath first */
+			control_persist_signal(CP_NOMUX);
+			cleanup_exit(255);
+		}
+		control_persist_ready();
+	}
+#endif
 
 	if (!no_shell_flag)
 		id = ssh_session2_open(ssh);
@@ -189,6 +189,49 @@ sshbuf_reset(struct sshbuf *buf)
 	explicit_bzero(buf->d, SSHBUF_SIZE_INIT);
 }
 
+void
+sshbuf_recycle(struct sshbuf *buf)
+{
+	if (buf->readonly || buf->refcount > 1 ||
+	    buf->alloc > SSHBUF_RECYCLE_MAX) {
+		sshbuf_reset(buf);
+		return;
+	}
+	(void) sshbuf_check_sanity(buf);
+	explicit_bzero(buf->d, buf->size);
+	buf->off = buf->size = 0;
+}
+
+int
+sshbuf_move(struct sshbuf *buf, struct sshbuf *src)
+{
+	u_char *d;
+	size_t alloc;
+	int r;
+
+	if ((r = sshbuf_check_sanity(buf)) != 0 ||
+	    (r = sshbuf_check_sanity(src)) != 0)
+		return r;
+	if (sshbuf_len(buf) != 0 || buf->readonly || src->readonly ||
+	    buf->refcount > 1 || src->refcount > 1 ||
+	    src->alloc > buf->max_size || buf->alloc > src->max_size) {
+		if ((r = sshbuf_putb(buf, src)) != 0)
+			return r;
+		sshbuf_recycle(src);
+		return 0;
+	}
+	d = buf->d;
+	alloc = buf->alloc;
+	buf->cd = buf->d = src->d;
+	buf->alloc = src->alloc;
+	buf->off = src->off;
+	buf->size = src->size;
+	src->cd = src->d = d;
+	src->alloc = alloc;
+	src->off = src->size = 0;
+	return 0;
+}
+
 size_t
 sshbuf_max_size(const struct sshbuf *buf)
 {
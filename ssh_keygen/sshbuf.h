@@ -89,6 +89,13 @@ void	sshbuf_free(struct sshbuf *buf);
  */
 void	sshbuf_reset(struct sshbuf *buf);
 
+/*
+ * Like sshbuf_reset(), but keep the allocation (up to SSHBUF_RECYCLE_MAX)
+ * so a buffer that is refilled for every packet does not go back through
+ * realloc each time. Only the bytes that were in use are cleared.
+ */
+void	sshbuf_recycle(struct sshbuf *buf);
+
 /*
  * Return the maximum size of buf
  */
@@ -161,6 +168,12 @@ int	sshbuf_get(struct sshbuf *buf, void *v, size_t len);
 int	sshbuf_put(struct sshbuf *buf, const void *v, size_t len);
 int	sshbuf_putb(struct sshbuf *buf, const struct sshbuf *v);
 
+/*
+ * Append the contents of src to buf and empty src. If buf is empty the
+ * two buffers exchange their storage instead of copying.
+ */
+int	sshbuf_move(struct sshbuf *buf, struct sshbuf *src);
+
 /* Append using a printf(3) format */
 int	sshbuf_putf(struct sshbuf *buf, const char *fmt, ...)
 	    __attribute__((format(printf, 2, 3)));
@@ -381,6 +394,7 @@ u_int	sshbuf_refcount(const struct sshbuf *buf);
 # define SSHBUF_SIZE_INIT	256		/* Initial allocation */
 # define SSHBUF_SIZE_INC	256		/* Preferred increment length */
 # define SSHBUF_PACK_MIN	8192		/* Minimim packable offset */
+# define SSHBUF_RECYCLE_MAX	0x80000		/* Largest allocation kept by sshbuf_recycle */
 
 /* # define SSHBUF_ABORT abort */
 /* # define SSHBUF_DEBUG */
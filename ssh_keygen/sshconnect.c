@@ -78,7 +78,7 @@ static __thread pid_t proxy_command_pid = 0;
 
 /* import */
 extern __thread int debug_flag;
-extern Options options;
+extern __thread Options options;
 #if !TARGET_OS_IPHONE
 extern char *__progname;
 #else
@@ -83,7 +83,7 @@
 /* import */
 extern char *client_version_string;
 extern char *server_version_string;
-extern Options options;
+extern __thread Options options;
 
 /*
  * SSH2 key exchange
@@ -47,6 +47,7 @@ static char sccsid[] = "@(#)cat.c	8.2 (Berkeley) 4/27/95";
 __FBSDID("$FreeBSD: src/bin/cat/cat.c,v 1.32 2005/01/10 08:39:20 imp Exp $");
 
 #include <sys/param.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #ifndef NO_UDOM_SUPPORT
 #include <sys/socket.h>
@@ -72,6 +73,7 @@ const __thread char *filename;
 static void usage(void);
 static void scanfiles(char *argv[], int cooked);
 static void cook_cat(FILE *);
+static int map_cat(int);
 static void raw_cat(int);
 
 #ifndef NO_UDOM_SUPPORT
@@ -142,9 +144,10 @@ scanfiles(char *argv[], int cooked)
 	FILE *fp;
 
 	while ((path = argv[i]) != NULL || i == 0) {
-		int fd;
+		int fd, isstdin;
 
-		if (path == NULL || strcmp(path, "-") == 0) {
+		isstdin = path == NULL || strcmp(path, "-") == 0;
+		if (isstdin) {
 			filename = "stdin";
 			fd = fileno(thread_stdin);
 		} else {
@@ -155,11 +158,11 @@ scanfiles(char *argv[], int cooked)
 				fd = udom_open(path, O_RDONLY);
 #endif
 		}
-		if (fd < 0) {
+		if (fd < 0 && !isstdin) {
             warn("%s", path);
 			rval = 1;
 		} else if (cooked) {
-			if (fd == fileno(thread_stdin))
+			if (isstdin)
 				cook_cat(thread_stdin);
 			else {
 				fp = fdopen(fd, "r");
@@ -168,7 +171,7 @@ scanfiles(char *argv[], int cooked)
 			}
 		} else {
 			raw_cat(fd);
-			if (fd != fileno(thread_stdin))
+			if (!isstdin)
 				close(fd);
 		}
 		if (path == NULL)
@@ -239,40 +242,80 @@ cook_cat(FILE *fp)
     }
 }
 
+/*
+ * Regular files are written straight from a mapping of the file, a window
+ * at a time, which saves the copy through a read buffer; when standard
+ * output is an in-process pipe that leaves the single copy into the pipe.
+ * Anything else goes through a page-aligned buffer.  rfd is -1 when
+ * standard input has no descriptor (an in-process pipe).
+ */
+#define	CAT_BUFSIZ	(1024 * 1024)
+#define	CAT_MAPSIZ	(8 * 1024 * 1024)
+
+static int
+map_cat(int rfd)
+{
+	struct stat sb;
+	off_t off, moff;
+	size_t len, skip;
+	char *map;
+
+	if (fstat(rfd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0)
+		return (0);
+	if ((off = lseek(rfd, 0, SEEK_CUR)) < 0)
+		return (0);
+	while (off < sb.st_size) {
+		moff = off & ~((off_t)getpagesize() - 1);
+		len = MIN(sb.st_size - moff, CAT_MAPSIZ);
+		map = mmap(NULL, len, PROT_READ, MAP_SHARED, rfd, moff);
+		if (map == MAP_FAILED) {
+			/* Let read() carry on from here. */
+			(void)lseek(rfd, off, SEEK_SET);
+			return (0);
+		}
+		(void)madvise(map, len, MADV_SEQUENTIAL);
+		skip = off - moff;
+		if (fwrite(map + skip, 1, len - skip, thread_stdout) !=
+		    len - skip) {
+			(void)munmap(map, len);
+			err(1, "stdout");
+		}
+		(void)munmap(map, len);
+		off = moff + len;
+	}
+	(void)lseek(rfd, off, SEEK_SET);
+	return (1);
+}
+
 static void
 raw_cat(int rfd)
 {
-	int off, wfd;
-	ssize_t nr, nw;
-	static __thread size_t bsize;
-	static __thread char *buf = NULL;
-	// struct stat sbuf;
+	ssize_t nr;
+	char *buf;
 
-	wfd = fileno(thread_stdout);
-	if (buf == NULL) {
-        // if (fstat(wfd, &sbuf))
-			// err(1, "%s", filename);
-        bsize = 1024; // MAX(sbuf.st_blksize, 1024);
-        if ((buf = malloc(bsize)) == NULL) {
-            err(1, "buffer");
-        }
+	if (rfd >= 0 && map_cat(rfd))
+		return;
+	if ((buf = valloc(CAT_BUFSIZ)) == NULL)
+		err(1, "buffer");
+	for (;;) {
+		if (rfd >= 0)
+			nr = read(rfd, buf, CAT_BUFSIZ);
+		else if ((nr = fread(buf, 1, CAT_BUFSIZ, thread_stdin)) == 0 &&
+		    ferror(thread_stdin))
+			nr = -1;
+		if (nr <= 0)
+			break;
+		/* The descriptor of stdout may not be writable: use stdio. */
+		if (fwrite(buf, 1, nr, thread_stdout) != (size_t)nr) {
+			free(buf);
+			err(1, "stdout");
+		}
 	}
-	while ((nr = read(rfd, buf, bsize)) > 0)
-        for (off = 0; nr; nr -= nw, off += nw) {
-            // We can't write to the fd of stdout, so we write to stdout
-            nw = 0; // number of bytes written
-            for (int i = 0; i < nr; i++) {
-                fputc(*(buf+off+nw), thread_stdout);
-                nw += 1;
-            }
-			// if ((nw = write(wfd, buf + off, (size_t)nr)) < 0) err(1, "stdout");
-        }
 	if (nr < 0) {
         warn("%s", filename);
 		rval = 1;
 	}
-    free(buf);
-    buf = NULL;
+	free(buf);
 }
 
 #ifndef NO_UDOM_SUPPORT
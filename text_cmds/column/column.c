@@ -45,6 +45,7 @@ __FBSDID("$FreeBSD: src/usr.bin/column/column.c,v 1.19 2011/11/06 08:14:34 ed Ex
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/param.h>
+#include <sys/stat.h>
 
 #include <err.h>
 #include <limits.h>
@@ -57,14 +58,39 @@ __FBSDID("$FreeBSD: src/usr.bin/column/column.c,v 1.19 2011/11/06 08:14:34 ed Ex
 #include <wctype.h>
 
 #define	TAB	8
+#define	DEFCOLS	25
+#define	DEFNUM		1000
+#define	MAXLINELEN	(LINE_MAX + 1)
 
-static void	c_columnate(void);
+/*
+ * Input read once for the column widths and again for the output; the
+ * default layout reads each output column with its own cursor.
+ */
+struct cursor {
+	int	 file;			/* index in files */
+	off_t	 off;			/* offset of its next record */
+	FILE	*fp;
+};
+
+static void	c_put(const wchar_t *);
+static wchar_t	*cursor_get(struct cursor *, wchar_t *);
+static void	emit(wchar_t *);
+static wchar_t	*getrec(FILE *, wchar_t *);
 static void	input(FILE *);
-static void	maketbl(void);
-static void	print(void);
+static void	layout(void);
+static void	mark(wchar_t *);
+static void	measure(wchar_t *);
 static void	r_columnate(void);
+static void	r_stream(void);
+static void	readinput(void);
+static void	sample(wchar_t *);
+static void	store(wchar_t *);
+static void	tbl_measure(const wchar_t *);
+static void	tbl_put(const wchar_t *);
+static int	tbl_split(const wchar_t *);
 static void	usage(void);
 static int	width(const wchar_t *);
+static int	widthn(const wchar_t *, size_t);
 
 static int	termwidth = 80;		/* default terminal width */
 
@@ -73,14 +99,36 @@ static int	eval;			/* exit value */
 static int	maxlength;		/* longest record */
 static wchar_t	**list;			/* array of pointers to records */
 static const wchar_t *separator = L"\t "; /* field separator for table option */
+static int	tflag, xflag;
+
+static void	(*record)(wchar_t *);	/* what input() does with a record */
+static char	**files;		/* input files, NULL if unreadable */
+static int	nfiles;			/* 0 for the standard input */
+static int	curfile;		/* file being read */
+static off_t	stdinoff;		/* where the standard input started */
+static int	rereading;		/* second pass over the input */
+static int	wantoff;		/* getrec() must set recoff */
+static off_t	recoff;			/* offset of the record read last */
+static int	samplesz;		/* -p: records the widths come from */
+
+static int	chcnt, col, endcol;	/* c_put() output position */
+
+static const wchar_t **fld;		/* -t: fields of the current record */
+static int	*fldlen, *fldwidth;
+static int	*lens;			/* -t: widest field of each column */
+static int	maxcols;
+
+static struct cursor *cursors;		/* r_stream() */
+static int	numrows;
+static int	nmarked;
 
 int
 main(int argc, char **argv)
 {
 	struct winsize win;
-	FILE *fp;
-	int ch, tflag, xflag;
-	char *p;
+	struct stat sb;
+	int ch, i, seekable;
+	char *p, *ep;
 	const char *src;
 	wchar_t *newsep;
 	size_t seplen;
@@ -93,12 +141,16 @@ main(int argc, char **argv)
 	} else
 		termwidth = win.ws_col;
 
-	tflag = xflag = 0;
-	while ((ch = getopt(argc, argv, "c:s:tx")) != -1)
+	while ((ch = getopt(argc, argv, "c:p:s:tx")) != -1)
 		switch(ch) {
 		case 'c':
 			termwidth = atoi(optarg);
 			break;
+		case 'p':
+			samplesz = strtol(optarg, &ep, 10);
+			if (samplesz <= 0 || *ep != '\0')
+				errx(1, "%s: illegal sample size", optarg);
+			break;
 		case 's':
 			src = optarg;
 			seplen = mbsrtowcs(NULL, &src, 0, NULL);
@@ -123,59 +175,114 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (!*argv)
-		input(stdin);
-	else for (; *argv; ++argv)
-		if ((fp = fopen(*argv, "r"))) {
-			input(fp);
-			(void)fclose(fp);
-		} else {
-			warn("%s", *argv);
-			eval = 1;
-		}
+	/*
+	 * Regular files can be read twice: once to find the widths, once
+	 * to write them out, so that the records need not all be kept.
+	 */
+	files = argv;
+	nfiles = argc;
+	if (nfiles == 0)
+		seekable = fstat(fileno(stdin), &sb) == 0 &&
+		    S_ISREG(sb.st_mode) &&
+		    (stdinoff = ftello(stdin)) != -1;
+	else
+		for (seekable = 1, i = 0; i < nfiles; i++)
+			if (stat(files[i], &sb) == 0 && !S_ISREG(sb.st_mode))
+				seekable = 0;
+
+	if (seekable)
+		record = measure;
+	else if (samplesz > 0 && (tflag || xflag))
+		record = sample;
+	else
+		record = store;
+	readinput();
 
 	if (!entries)
 		exit(eval);
+	if (record == emit) {		/* -p: already streaming */
+		if (chcnt)
+			putwchar('\n');
+		exit(eval);
+	}
+	if (record == sample)		/* -p: fewer records than sampled */
+		record = store;
+	if (record == store)
+		layout();
+
+	if (record == measure) {
+		layout();
+		rereading = 1;
+		if (tflag || xflag || maxlength >= termwidth) {
+			record = emit;
+			readinput();
+		} else if (nfiles > 0)
+			r_stream();
+		else {
+			record = store;
+			entries = 0;
+			readinput();
+			r_columnate();
+		}
+	} else if (tflag || xflag || maxlength >= termwidth) {
+		if (tflag)
+			for (i = 0; i < entries; i++)
+				tbl_measure(list[i]);
+		for (i = 0; i < entries; i++)
+			emit(list[i]);
+	} else
+		r_columnate();
+	if (chcnt)
+		putwchar('\n');
+	exit(eval);
+}
+
+/*
+ * Settle the column width once the records have been measured.
+ */
+static void
+layout(void)
+{
 
 	maxlength = roundup(maxlength + 1, TAB);
+}
+
+/*
+ * Write out one record in input order: as a table row (-t), on a line of
+ * its own if the records are too wide to columnate, or filling rows (-x).
+ */
+static void
+emit(wchar_t *rec)
+{
+
 	if (tflag)
-		maketbl();
+		tbl_put(rec);
 	else if (maxlength >= termwidth)
-		print();
-	else if (xflag)
-		c_columnate();
+		(void)wprintf(L"%ls\n", rec);
 	else
-		r_columnate();
-	exit(eval);
+		c_put(rec);
 }
 
 static void
-c_columnate(void)
+c_put(const wchar_t *rec)
 {
-	int chcnt, col, cnt, endcol, numcols;
-	wchar_t **lp;
+	int cnt;
 
-	numcols = termwidth / maxlength;
-	endcol = maxlength;
-	for (chcnt = col = 0, lp = list;; ++lp) {
-		wprintf(L"%ls", *lp);
-		chcnt += width(*lp);
-		if (!--entries)
-			break;
-		if (++col == numcols) {
-			chcnt = col = 0;
-			endcol = maxlength;
-			putwchar('\n');
-		} else {
-			while ((cnt = roundup(chcnt + 1, TAB)) <= endcol) {
-				(void)putwchar('\t');
-				chcnt = cnt;
-			}
-			endcol += maxlength;
+	if (col == 0)
+		endcol = maxlength;
+	else {
+		while ((cnt = roundup(chcnt + 1, TAB)) <= endcol) {
+			(void)putwchar('\t');
+			chcnt = cnt;
 		}
+		endcol += maxlength;
 	}
-	if (chcnt)
+	wprintf(L"%ls", rec);
+	chcnt += width(rec);
+	if (++col == termwidth / maxlength) {
 		putwchar('\n');
+		chcnt = col = 0;
+	}
 }
 
 static void
@@ -205,120 +312,291 @@ r_columnate(void)
 	}
 }
 
+/*
+ * r_columnate() for input files that can be read again: one more pass
+ * notes where each output column starts, then a cursor per column reads
+ * its records as the rows are written.
+ */
 static void
-print(void)
+r_stream(void)
 {
-	int cnt;
-	wchar_t **lp;
+	wchar_t buf[MAXLINELEN];
+	int base, chcnt, cnt, col, endcol, numcols, row;
 
-	for (cnt = entries, lp = list; cnt--; ++lp)
-		(void)wprintf(L"%ls\n", *lp);
-}
+	numcols = termwidth / maxlength;
+	numrows = entries / numcols;
+	if (entries % numcols)
+		++numrows;
+	if ((cursors = calloc(numcols, sizeof(*cursors))) == NULL)
+		err(1, NULL);
+	record = mark;
+	wantoff = 1;
+	readinput();
+	wantoff = 0;
 
-typedef struct _tbl {
-	wchar_t **list;
-	int cols, *len;
-} TBL;
-#define	DEFCOLS	25
+	for (row = 0; row < numrows; ++row) {
+		endcol = maxlength;
+		for (base = row, chcnt = col = 0; col < numcols; ++col) {
+			if (cursor_get(&cursors[col], buf) == NULL)
+				errx(1, "input changed while being read");
+			wprintf(L"%ls", buf);
+			chcnt += width(buf);
+			if ((base += numrows) >= entries)
+				break;
+			while ((cnt = roundup(chcnt + 1, TAB)) <= endcol) {
+				(void)putwchar('\t');
+				chcnt = cnt;
+			}
+			endcol += maxlength;
+		}
+		putwchar('\n');
+	}
+	for (col = 0; col < numcols; col++)
+		if (cursors[col].fp != NULL)
+			(void)fclose(cursors[col].fp);
+	free(cursors);
+}
 
+/* Note the first record of each output column. */
 static void
-maketbl(void)
+mark(wchar_t *rec __unused)
 {
-	TBL *t;
-	int coloff, cnt;
-	wchar_t *p, **lp;
-	int *lens, maxcols;
-	TBL *tbl;
-	wchar_t **cols;
-	wchar_t *last;
-
-	if ((t = tbl = calloc(entries, sizeof(TBL))) == NULL)
-		err(1, (char *)NULL);
-	if ((cols = calloc((maxcols = DEFCOLS), sizeof(*cols))) == NULL)
-		err(1, (char *)NULL);
-	if ((lens = calloc(maxcols, sizeof(int))) == NULL)
-		err(1, (char *)NULL);
-	for (cnt = 0, lp = list; cnt < entries; ++cnt, ++lp, ++t) {
-		for (coloff = 0, p = *lp;
-		    (cols[coloff] = wcstok(p, separator, &last));
-		    p = NULL)
-			if (++coloff == maxcols) {
-				if (!(cols = realloc(cols, ((u_int)maxcols +
-				    DEFCOLS) * sizeof(char *))) ||
-				    !(lens = realloc(lens,
-				    ((u_int)maxcols + DEFCOLS) * sizeof(int))))
-					err(1, NULL);
-				memset((char *)lens + maxcols * sizeof(int),
-				    0, DEFCOLS * sizeof(int));
-				maxcols += DEFCOLS;
-			}
-		if ((t->list = calloc(coloff, sizeof(*t->list))) == NULL)
-			err(1, (char *)NULL);
-		if ((t->len = calloc(coloff, sizeof(int))) == NULL)
-			err(1, (char *)NULL);
-		for (t->cols = coloff; --coloff >= 0;) {
-			t->list[coloff] = cols[coloff];
-			t->len[coloff] = width(cols[coloff]);
-			if (t->len[coloff] > lens[coloff])
-				lens[coloff] = t->len[coloff];
+	struct cursor *c;
+
+	if (nmarked % numrows == 0) {
+		c = &cursors[nmarked / numrows];
+		c->file = curfile;
+		c->off = recoff;
+	}
+	nmarked++;
+}
+
+static wchar_t *
+cursor_get(struct cursor *c, wchar_t *buf)
+{
+
+	for (;;) {
+		if (c->fp == NULL) {
+			while (c->file < nfiles && files[c->file] == NULL)
+				c->file++;
+			if (c->file == nfiles)
+				return (NULL);
+			if ((c->fp = fopen(files[c->file], "r")) == NULL ||
+			    fseeko(c->fp, c->off, SEEK_SET) != 0)
+				err(1, "%s", files[c->file]);
 		}
+		if (getrec(c->fp, buf) != NULL)
+			return (buf);
+		(void)fclose(c->fp);
+		c->fp = NULL;
+		c->file++;
+		c->off = 0;
 	}
-	for (cnt = 0, t = tbl; cnt < entries; ++cnt, ++t) {
-		for (coloff = 0; coloff < t->cols  - 1; ++coloff)
-			(void)wprintf(L"%ls%*ls", t->list[coloff],
-			    lens[coloff] - t->len[coloff] + 2, L" ");
-		(void)wprintf(L"%ls\n", t->list[coloff]);
+}
+
+/*
+ * Split a record into the fields of a table row, without changing it.
+ */
+static int
+tbl_split(const wchar_t *p)
+{
+	int n;
+
+	for (n = 0;; n++) {
+		p += wcsspn(p, separator);
+		if (*p == L'\0')
+			break;
+		if (n == maxcols) {
+			maxcols += DEFCOLS;
+			if (!(fld = realloc(fld, maxcols * sizeof(*fld))) ||
+			    !(fldlen = realloc(fldlen, maxcols * sizeof(int))) ||
+			    !(fldwidth = realloc(fldwidth,
+			    maxcols * sizeof(int))) ||
+			    !(lens = realloc(lens, maxcols * sizeof(int))))
+				err(1, NULL);
+			memset(lens + n, 0, DEFCOLS * sizeof(int));
+		}
+		fld[n] = p;
+		fldlen[n] = wcscspn(p, separator);
+		fldwidth[n] = widthn(p, fldlen[n]);
+		p += fldlen[n];
 	}
+	return (n);
 }
 
-#define	DEFNUM		1000
-#define	MAXLINELEN	(LINE_MAX + 1)
+static void
+tbl_measure(const wchar_t *rec)
+{
+	int i, n;
+
+	for (i = 0, n = tbl_split(rec); i < n; i++)
+		if (fldwidth[i] > lens[i])
+			lens[i] = fldwidth[i];
+}
+
+static void
+tbl_put(const wchar_t *rec)
+{
+	int i, n;
+
+	n = tbl_split(rec);
+	for (i = 0; i < n - 1; i++)
+		(void)wprintf(L"%.*ls%*ls", fldlen[i], fld[i],
+		    MAX(lens[i] - fldwidth[i], 0) + 2, L" ");
+	if (n > 0)
+		(void)wprintf(L"%.*ls", fldlen[n - 1], fld[n - 1]);
+	putwchar('\n');
+}
+
+/*
+ * Read every input file, or the standard input, handing each record to
+ * record().  The second time around the input is read from its start
+ * again and files that could not be opened are skipped.
+ */
+static void
+readinput(void)
+{
+	FILE *fp;
+	int i;
+
+	if (nfiles == 0) {
+		if (rereading && fseeko(stdin, stdinoff, SEEK_SET) != 0)
+			err(1, "stdin");
+		input(stdin);
+		return;
+	}
+	for (i = 0; i < nfiles; i++) {
+		if (files[i] == NULL)
+			continue;
+		if ((fp = fopen(files[i], "r")) == NULL) {
+			warn("%s", files[i]);
+			eval = 1;
+			files[i] = NULL;
+			continue;
+		}
+		curfile = i;
+		input(fp);
+		(void)fclose(fp);
+	}
+}
 
 static void
 input(FILE *fp)
 {
-	static int maxentry;
-	int len;
-	wchar_t *p, buf[MAXLINELEN];
+	wchar_t buf[MAXLINELEN];
 
-	if (!list)
-		if ((list = calloc((maxentry = DEFNUM), sizeof(*list))) ==
-		    NULL)
-			err(1, (char *)NULL);
-	while (fgetws(buf, MAXLINELEN, fp)) {
+	while (getrec(fp, buf) != NULL)
+		record(buf);
+}
+
+/*
+ * Read the next non-empty line into buf and strip its newline.
+ */
+static wchar_t *
+getrec(FILE *fp, wchar_t *buf)
+{
+	wchar_t *p;
+
+	for (;;) {
+		if (wantoff)
+			recoff = ftello(fp);
+		if (fgetws(buf, MAXLINELEN, fp) == NULL)
+			return (NULL);
 		for (p = buf; *p && iswspace(*p); ++p);
 		if (!*p)
 			continue;
 		if (!(p = wcschr(p, L'\n'))) {
-			warnx("line too long");
-			eval = 1;
+			if (!rereading) {
+				warnx("line too long");
+				eval = 1;
+			}
 			continue;
 		}
 		*p = L'\0';
-		len = width(buf);
-		if (maxlength < len)
-			maxlength = len;
-		if (entries == maxentry) {
-			maxentry += DEFNUM;
-			if (!(list = realloc(list,
-			    (u_int)maxentry * sizeof(*list))))
-				err(1, NULL);
-		}
-		list[entries] = malloc((wcslen(buf) + 1) * sizeof(wchar_t));
-		if (list[entries] == NULL)
+		return (buf);
+	}
+}
+
+/* Measure a record that will be read again. */
+static void
+measure(wchar_t *rec)
+{
+	int len;
+
+	len = width(rec);
+	if (maxlength < len)
+		maxlength = len;
+	if (tflag)
+		tbl_measure(rec);
+	entries++;
+}
+
+static void
+store(wchar_t *rec)
+{
+	static int maxentry;
+	int len;
+
+	if (!list)
+		if ((list = calloc((maxentry = DEFNUM), sizeof(*list))) ==
+		    NULL)
+			err(1, (char *)NULL);
+	len = width(rec);
+	if (maxlength < len)
+		maxlength = len;
+	if (entries == maxentry) {
+		maxentry += DEFNUM;
+		if (!(list = realloc(list,
+		    (u_int)maxentry * sizeof(*list))))
 			err(1, NULL);
-		wcscpy(list[entries], buf);
-		entries++;
 	}
+	list[entries] = malloc((wcslen(rec) + 1) * sizeof(wchar_t));
+	if (list[entries] == NULL)
+		err(1, NULL);
+	wcscpy(list[entries], rec);
+	entries++;
+}
+
+/*
+ * -p: keep the first samplesz records, size the output from them, then
+ * write everything else out as it is read.  Later records that are wider
+ * than the sample push their row out of line.
+ */
+static void
+sample(wchar_t *rec)
+{
+	int i;
+
+	store(rec);
+	if (entries < samplesz)
+		return;
+	layout();
+	if (tflag)
+		for (i = 0; i < entries; i++)
+			tbl_measure(list[i]);
+	for (i = 0; i < entries; i++) {
+		emit(list[i]);
+		free(list[i]);
+	}
+	free(list);
+	list = NULL;
+	record = emit;
 }
 
 /* Like wcswidth(), but ignores non-printing characters. */
 static int
 width(const wchar_t *wcs)
+{
+
+	return (widthn(wcs, wcslen(wcs)));
+}
+
+static int
+widthn(const wchar_t *wcs, size_t n)
 {
 	int w, cw;
 
-	for (w = 0; *wcs != L'\0'; wcs++)
+	for (w = 0; n > 0; wcs++, n--)
 		if ((cw = wcwidth(*wcs)) > 0)
 			w += cw;
 	return (w);
@@ -329,6 +607,6 @@ usage(void)
 {
 
 	(void)fprintf(stderr,
-	    "usage: column [-tx] [-c columns] [-s sep] [file ...]\n");
+	    "usage: column [-tx] [-c columns] [-p num] [-s sep] [file ...]\n");
 	exit(1);
 }
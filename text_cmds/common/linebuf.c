@@ -0,0 +1,121 @@
+/*
+ * linebuf -- line reader shared by the text commands.
+ */
+
+#include <sys/stat.h>
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linebuf.h"
+#include "ios_error.h"
+
+static void	linebuf_grow(struct linebuf *, size_t);
+
+/*
+ * Regular files are read a block at a time.  Pipes and terminals are read
+ * a line at a time with fgetln(), so that each line is available as soon
+ * as it has been written.
+ */
+void
+linebuf_init(struct linebuf *lb, FILE *fp)
+{
+	struct stat sb;
+
+	lb->lb_fp = fp;
+	lb->lb_regular = fp != NULL && fileno(fp) >= 0 &&
+	    fstat(fileno(fp), &sb) == 0 && S_ISREG(sb.st_mode);
+	lb->lb_buf = NULL;
+	lb->lb_size = lb->lb_off = lb->lb_len = 0;
+	lb->lb_saved = -1;
+	lb->lb_eof = 0;
+}
+
+/*
+ * Return the next line and store its length, newline included, in *lenp.
+ * Return NULL at end of file or on error; the caller tells them apart
+ * with ferror().
+ */
+char *
+linebuf_get(struct linebuf *lb, size_t *lenp)
+{
+	char *line, *nl, *p;
+	size_t n, scan;
+
+	/* Put back the byte the previous line was terminated over. */
+	if (lb->lb_saved != -1) {
+		lb->lb_buf[lb->lb_off] = lb->lb_saved;
+		lb->lb_saved = -1;
+	}
+	scan = lb->lb_off;
+	for (;;) {
+		nl = scan < lb->lb_len ?
+		    memchr(lb->lb_buf + scan, '\n', lb->lb_len - scan) : NULL;
+		if (nl != NULL) {
+			line = lb->lb_buf + lb->lb_off;
+			*lenp = nl + 1 - line;
+			lb->lb_off += *lenp;
+			if (lb->lb_off < lb->lb_len)
+				lb->lb_saved = (unsigned char)nl[1];
+			nl[1] = '\0';
+			return (line);
+		}
+		if (lb->lb_eof) {
+			if (lb->lb_off == lb->lb_len)
+				return (NULL);
+			/* Last line, without a newline. */
+			line = lb->lb_buf + lb->lb_off;
+			*lenp = lb->lb_len - lb->lb_off;
+			lb->lb_off = lb->lb_len;
+			line[*lenp] = '\0';
+			return (line);
+		}
+
+		/* Move the partial line to the front and read some more. */
+		scan = lb->lb_len - lb->lb_off;
+		if (lb->lb_off > 0) {
+			memmove(lb->lb_buf, lb->lb_buf + lb->lb_off, scan);
+			lb->lb_off = 0;
+			lb->lb_len = scan;
+		}
+		if (lb->lb_regular) {
+			linebuf_grow(lb, LINEBUF_SIZE / 2);
+			n = fread(lb->lb_buf + lb->lb_len, 1,
+			    lb->lb_size - lb->lb_len - 1, lb->lb_fp);
+		} else if ((p = fgetln(lb->lb_fp, &n)) != NULL) {
+			linebuf_grow(lb, n);
+			memcpy(lb->lb_buf + lb->lb_len, p, n);
+		} else
+			n = 0;
+		if (n == 0)
+			lb->lb_eof = 1;
+		lb->lb_len += n;
+	}
+}
+
+/*
+ * Make room for at least len more bytes and the NUL.
+ */
+static void
+linebuf_grow(struct linebuf *lb, size_t len)
+{
+	size_t n;
+
+	if (lb->lb_size - lb->lb_len > len)
+		return;
+	for (n = lb->lb_size ? lb->lb_size : LINEBUF_SIZE;
+	    n - lb->lb_len <= len; n *= 2)
+		;
+	if ((lb->lb_buf = realloc(lb->lb_buf, n)) == NULL)
+		err(1, "realloc");
+	lb->lb_size = n;
+}
+
+void
+linebuf_free(struct linebuf *lb)
+{
+
+	free(lb->lb_buf);
+	linebuf_init(lb, NULL);
+}
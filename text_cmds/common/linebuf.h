@@ -0,0 +1,32 @@
+/*
+ * linebuf -- line reader shared by the text commands.
+ *
+ * Reads regular files in large blocks, so that stdio takes its lock once
+ * per block instead of once per character, and returns each line in place
+ * in the read buffer.  Lines are returned with their newline, if any, and
+ * NUL-terminated.  A line stays valid until the next call.
+ */
+
+#ifndef LINEBUF_H
+#define	LINEBUF_H
+
+#include <stdio.h>
+
+#define	LINEBUF_SIZE	(64 * 1024)
+
+struct linebuf {
+	FILE	*lb_fp;
+	char	*lb_buf;	/* Read buffer */
+	size_t	 lb_size;	/* Its size, one byte is kept for a NUL */
+	size_t	 lb_off;	/* Start of the data not returned yet */
+	size_t	 lb_len;	/* End of the data read */
+	int	 lb_saved;	/* Byte overwritten by the NUL, or -1 */
+	int	 lb_regular;	/* Read in blocks rather than lines */
+	int	 lb_eof;
+};
+
+void	 linebuf_init(struct linebuf *, FILE *);
+char	*linebuf_get(struct linebuf *, size_t *);
+void	 linebuf_free(struct linebuf *);
+
+#endif /* !LINEBUF_H */
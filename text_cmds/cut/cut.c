@@ -46,14 +46,17 @@ __FBSDID("$FreeBSD: src/usr.bin/cut/cut.c,v 1.30 2004/11/05 10:45:23 tjr Exp $")
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <langinfo.h>
 #include <limits.h>
 #include <locale.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <wchar.h>
 #include <sysexits.h>
+#include "../common/linebuf.h"
 
 int	bflag;
 int	cflag;
@@ -63,6 +66,8 @@ int	dflag;
 int	fflag;
 int	nflag;
 int	sflag;
+int	fastsep;	/* f_cut() may look for dchar with memchr() */
+int	utf8;
 
 size_t	autostart, autostop, maxval;
 char *	positions;
@@ -71,6 +76,8 @@ int	b_cut(FILE *, const char *);
 int	b_n_cut(FILE *, const char *);
 int	c_cut(FILE *, const char *);
 int	f_cut(FILE *, const char *);
+static	int ascii(const char *, size_t);
+static	void f_cut_line(const char *, size_t, size_t);
 void	get_list(char *);
 void	needpos(size_t);
 static 	void usage(void);
@@ -131,6 +138,15 @@ main(int argc, char *argv[])
 	else if (!bflag && nflag)
 		usage();
 
+	/*
+	 * A single-byte delimiter can be searched for as a byte when every
+	 * character is one byte, or, in UTF-8, when it is ASCII: then it
+	 * cannot occur inside a multibyte character.
+	 */
+	utf8 = MB_CUR_MAX > 1 && strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+	fastsep = dcharmb[1] == '\0' && dchar != '\n' &&
+	    (MB_CUR_MAX == 1 || (utf8 && (unsigned char)dcharmb[0] < 0x80));
+
 	if (fflag)
 		fcn = f_cut;
 	else if (cflag)
@@ -279,10 +295,12 @@ b_n_cut(FILE *fp, const char *fname)
 	char *lbuf;
 	int canwrite, clen, warned;
 	mbstate_t mbs;
+	struct linebuf lb;
 
 	memset(&mbs, 0, sizeof(mbs));
 	warned = 0;
-	while ((lbuf = fgetln(fp, &lbuflen)) != NULL) {
+	linebuf_init(&lb, fp);
+	while ((lbuf = linebuf_get(&lb, &lbuflen)) != NULL) {
 		for (col = 0; lbuflen > 0; col += clen) {
 			if ((clen = mbrlen(lbuf, lbuflen, &mbs)) < 0) {
 				if (!warned) {
@@ -331,6 +349,7 @@ b_n_cut(FILE *fp, const char *fname)
 		if (lbuflen > 0)
 			putchar('\n');
 	}
+	linebuf_free(&lb);
 	return (warned);
 }
 
@@ -379,9 +398,11 @@ f_cut(FILE *fp, const char *fname)
 	int output;
 	char *lbuf, *mlbuf;
 	size_t clen, lbuflen, reallen;
+	struct linebuf lb;
 
 	mlbuf = NULL;
-	for (sep = dchar; (lbuf = fgetln(fp, &lbuflen)) != NULL;) {
+	linebuf_init(&lb, fp);
+	for (sep = dchar; (lbuf = linebuf_get(&lb, &lbuflen)) != NULL;) {
 		reallen = lbuflen;
 		/* Assert EOL has a newline. */
 		if (*(lbuf + lbuflen - 1) != '\n') {
@@ -394,6 +415,14 @@ f_cut(FILE *fp, const char *fname)
 			lbuf = mlbuf;
 			reallen++;
 		}
+		/*
+		 * Lines of multibyte text are decoded below, so that bad
+		 * sequences are reported; pure ASCII needs no decoding.
+		 */
+		if (fastsep && (!utf8 || ascii(lbuf, reallen))) {
+			f_cut_line(lbuf, reallen, lbuflen);
+			continue;
+		}
 		output = 0;
 		for (isdelim = 0, p = lbuf;; p += clen) {
 			clen = mbrtowc(&ch, p, lbuf + reallen - p, NULL);
@@ -453,10 +482,70 @@ f_cut(FILE *fp, const char *fname)
 		}
 		(void)putchar('\n');
 	}
+	linebuf_free(&lb);
 	free(mlbuf);
 	return (0);
 }
 
+/*
+ * Return whether the len bytes at p are all ASCII, a word at a time.
+ */
+static int
+ascii(const char *p, size_t len)
+{
+	uint64_t w, acc;
+
+	for (acc = 0; len >= sizeof(w); p += sizeof(w), len -= sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		acc |= w;
+	}
+	for (; len > 0; len--)
+		acc |= (unsigned char)*p++;
+	return ((acc & 0x8080808080808080ULL) == 0);
+}
+
+/*
+ * Cut the fields out of one line for a single-byte delimiter.  reallen
+ * includes a newline, len is the length of the line as read.  Fields are
+ * found with memchr() and written whole, and nothing past the last
+ * selected field is looked at unless it is to be printed (-f N-).
+ */
+static void
+f_cut_line(const char *lbuf, size_t reallen, size_t len)
+{
+	const char *end, *p, *q;
+	size_t field;
+	int output;
+
+	end = lbuf + reallen - 1;
+	if ((q = memchr(lbuf, dcharmb[0], end - lbuf)) == NULL) {
+		if (!sflag)
+			(void)fwrite(lbuf, len, 1, stdout);
+		return;
+	}
+
+	output = 0;
+	for (field = 1, p = lbuf; field <= maxval; field++) {
+		if (field > 1)
+			q = memchr(p, dcharmb[0], end - p);
+		if (positions[field]) {
+			if (output++)
+				(void)putchar(dcharmb[0]);
+			(void)fwrite(p, (q != NULL ? q : end) - p, 1, stdout);
+		}
+		if (q == NULL)
+			break;
+		p = q + 1;
+	}
+	/* Stopped at the last selected field, not at the end of line. */
+	if (field > maxval && autostop) {
+		if (output)
+			(void)putchar(dcharmb[0]);
+		(void)fwrite(p, end - p, 1, stdout);
+	}
+	(void)putchar('\n');
+}
+
 static void
 usage(void)
 {
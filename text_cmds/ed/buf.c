@@ -1,5 +1,6 @@
 /* buf.c: This file contains the scratch-file buffer routines for the
-   ed line editor. */
+   ed line editor.  Line text is kept in memory until it outgrows
+   SBUFMEMSZ bytes, and only then moved to a scratch file. */
 /*-
  * Copyright (c) 1993 Andrew Moore, Talke Studio.
  * All rights reserved.
@@ -44,6 +45,14 @@ off_t sfseek;				/* scratch file position */
 int seek_write;				/* seek before writing */
 line_t buffer_head;			/* incore buffer */
 
+/* Until sfp is opened, lp->seek is an offset into mbuf instead. */
+static __thread char *mbuf;		/* in-memory scratch buffer */
+static __thread int mbufsz;		/* its size */
+static __thread int mbuflen;		/* bytes of it in use */
+
+static int open_sfile(void);
+static int spill_sbuf(void);
+
 /* get_sbuf_line: get a line of text from the scratch file; return pointer
    to the text */
 char *
@@ -56,6 +65,13 @@ get_sbuf_line(line_t *lp)
 
 	if (lp == &buffer_head)
 		return NULL;
+	if (sfp == NULL) {
+		len = lp->len;
+		REALLOC(sfbuf, sfbufsz, len + 1, NULL);
+		memcpy(sfbuf, mbuf + lp->seek, len);
+		sfbuf[len] = '\0';
+		return sfbuf;
+	}
 	seek_write = 1;				/* force seek on write */
 	/* out of position */
 	if (sfseek != lp->seek) {
@@ -101,6 +117,19 @@ put_sbuf_line(const char *cs)
 		return NULL;
 	}
 	len = s - cs;
+	if (sfp == NULL) {
+		if (len <= SBUFMEMSZ - mbuflen) {
+			REALLOC(mbuf, mbufsz, mbuflen + len, NULL);
+			memcpy(mbuf + mbuflen, cs, len);
+			lp->len = len;
+			lp->seek = mbuflen;
+			add_line_node(lp);
+			mbuflen += len;
+			return ++s;
+		}
+		if (spill_sbuf() < 0)
+			return NULL;
+	}
 	/* out of position */
 	if (seek_write) {
 		if (fseeko(sfp, (off_t)0, SEEK_END) < 0) {
@@ -191,29 +220,52 @@ extern __thread int newline_added;
 
 char sfn[PATH_MAX] = "";				/* scratch file name */
 
-/* open_sbuf: open scratch file */
+/* open_sbuf: start an empty scratch buffer; the scratch file itself is
+   only opened once the text no longer fits in memory */
 int
 open_sbuf(void)
 {
-	int fd;
-	int u;
-
 	isbinary = newline_added = 0;
-	u = umask(077);
-    // getenv($HOME) + "/tmp/" or NSString * NSTemporaryDirectory(void);
-    // the latter, I guess.
-    sprintf(sfn, "%s/ed.XXXXXX", NSTemporaryDirectory().UTF8String);
-	// strcpy(sfn, "/tmp/ed.XXXXXX");
-	if ((fd = mkstemp(sfn)) == -1 ||
-	    (sfp = fdopen(fd, "w+")) == NULL) {
-		if (fd != -1)
-			close(fd);
+	mbuflen = 0;
+	return 0;
+}
+
+
+/* spill_sbuf: move the in-memory scratch buffer to the scratch file.  The
+   text keeps its offsets, so the line nodes need not change. */
+static int
+spill_sbuf(void)
+{
+	if (open_sfile() < 0)
+		return ERR;
+	if (mbuflen > 0 &&
+	    fwrite(mbuf, sizeof(char), mbuflen, sfp) != (size_t)mbuflen) {
+		fprintf(thread_stderr, "%s\n", strerror(errno));
+		errmsg = "cannot write temp file";
+		fclose(sfp);
+		sfp = NULL;
+		return ERR;
+	}
+	sfseek = mbuflen;
+	seek_write = 0;
+	free(mbuf);
+	mbuf = NULL;
+	mbufsz = mbuflen = 0;
+	return 0;
+}
+
+
+/* open_sfile: open scratch file (in memory as long as the scratch budget
+   of ios_system allows, then on disk) */
+static int
+open_sfile(void)
+{
+	strcpy(sfn, "scratch file");
+	if ((sfp = tmpfile()) == NULL) {
 		perror(sfn);
 		errmsg = "cannot open temp file";
-		umask(u);
 		return ERR;
 	}
-	umask(u);
 	return 0;
 }
 
@@ -229,8 +281,10 @@ close_sbuf(void)
 			return ERR;
 		}
 		sfp = NULL;
-		unlink(sfn);
 	}
+	free(mbuf);
+	mbuf = NULL;
+	mbufsz = mbuflen = 0;
 	sfseek = seek_write = 0;
 	return 0;
 }
@@ -240,10 +294,8 @@ close_sbuf(void)
 void
 quit(int n)
 {
-	if (sfp) {
+	if (sfp)
 		fclose(sfp);
-		unlink(sfn);
-	}
 	exit(n);
 }
 
@@ -43,6 +43,9 @@
 #define FATAL		(-4)
 
 #define MINBUFSZ 512		/* minimum buffer size - must be > 0 */
+#ifndef SBUFMEMSZ
+#define SBUFMEMSZ (32 * 1024 * 1024) /* scratch text kept in memory, in bytes */
+#endif
 #define SE_MAX 30		/* max subexpressions in a regular expression */
 #ifdef INT_MAX
 # define LINECHARS INT_MAX	/* max chars per line */
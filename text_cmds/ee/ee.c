@@ -126,10 +126,33 @@ struct text {
 	int line_number;		/* line number			*/
 	int line_length;	/* actual number of characters in the line */
 	int max_length;	/* maximum number of characters the line handles */
+	int flags;		/* TEXT_IN_CHUNK, NODE_IN_CHUNK		*/
 	struct text *next_line;		/* next line of text		*/
 	struct text *prev_line;		/* previous line of text	*/
 	};
 
+/*
+ |	Lines read from a file are carved out of large chunks instead of
+ |	two malloc() per line: their text from text chunks, their structures
+ |	from node chunks.  A line is copied out of its chunk the first time
+ |	it is resized; the chunks are released when the buffer is emptied.
+ */
+#define TEXT_IN_CHUNK	1	/* line points into a text chunk	*/
+#define NODE_IN_CHUNK	2	/* structure is part of a node chunk	*/
+
+#define TEXT_CHUNK_SIZE	65536
+#define NODE_CHUNK_SIZE	1024	/* structures per node chunk		*/
+
+struct chunk {
+	struct chunk *next;
+	size_t size;		/* bytes available in data		*/
+	size_t used;
+	double data[1];		/* (aligned for struct text)		*/
+	};
+
+struct chunk *text_chunks;	/* current chunk first			*/
+struct chunk *node_chunks;
+
 struct text *first_line;	/* first line of current buffer		*/
 struct text *dlt_line;		/* structure for info on deleted line	*/
 struct text *curr_line;		/* current line cursor is on		*/
@@ -200,7 +223,8 @@ char *tmp_file;	/* temporary file name			*/
 unsigned char *d_char;		/* deleted character			*/
 unsigned char *d_word;		/* deleted word				*/
 unsigned char *d_line;		/* deleted line				*/
-char in_string[513];	/* buffer for reading a file		*/
+#define READ_SIZE 65536
+char in_string[READ_SIZE + 1];	/* buffer for reading a file	*/
 unsigned char *print_command = (unsigned char *)"lpr";	/* string to use for the print command 	*/
 unsigned char *start_at_line = NULL;	/* move to this line at start of session*/
 int in;				/* input character			*/
@@ -265,6 +289,10 @@ int len_char P_((int character, int column));
 void draw_line P_((int vertical, int horiz, unsigned char *ptr, int t_pos, int length));
 void insert_line P_((int disp));
 struct text *txtalloc P_((void));
+void *chunk_alloc P_((struct chunk **list, size_t size, size_t chunk_size));
+struct text *txtalloc_chunk P_((void));
+void txtfree P_((struct text *tline));
+void free_chunks P_((void));
 struct files *name_alloc P_((void));
 unsigned char *next_word P_((unsigned char *string));
 void prev_word P_((void));
@@ -677,8 +705,19 @@ int rpos;
 	unsigned char *rpoint;
 	int resiz_var;
  
-	rline->max_length += factor;
-	rpoint = rline->line = realloc(rline->line, rline->max_length );
+	if (rline->flags & TEXT_IN_CHUNK)	/* copy it out of its chunk */
+	{
+		rpoint = malloc(rline->max_length + factor);
+		memcpy(rpoint, rline->line, min(rline->max_length, rline->max_length + factor));
+		rline->flags &= ~TEXT_IN_CHUNK;
+		rline->line = rpoint;
+		rline->max_length += factor;
+	}
+	else
+	{
+		rline->max_length += factor;
+		rpoint = rline->line = realloc(rline->line, rline->max_length );
+	}
 	for (resiz_var = 1 ; (resiz_var < rpos) ; resiz_var++)
 		rpoint++;
 	return(rpoint);
@@ -848,8 +887,7 @@ int disp;
 			temp2++;
 		}
 		*tp = '\0';
-		free(temp_buff->line);
-		free(temp_buff);
+		txtfree(temp_buff);
 		temp_buff = curr_line;
 		temp_vert = scr_vert;
 		scr_pos = scr_horz;
@@ -1137,7 +1175,74 @@ int disp;
 
 struct text *txtalloc()		/* allocate space for line structure	*/
 {
-	return((struct text *) malloc(sizeof( struct text)));
+	return((struct text *) calloc(1, sizeof( struct text)));
+}
+
+void *
+chunk_alloc(list, size, chunk_size)	/* carve size bytes out of a chunk */
+struct chunk **list;
+size_t size;
+size_t chunk_size;
+{
+	struct chunk *chunk = *list;
+	void *ptr;
+
+	size = (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+	if ((chunk == NULL) || (chunk->size - chunk->used < size))
+	{
+		if (size > chunk_size)	/* very long line: a chunk of its own */
+			chunk_size = size;
+		chunk = malloc(sizeof(struct chunk) + chunk_size);
+		if (chunk == NULL)
+			return(NULL);
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		chunk->next = *list;
+		*list = chunk;
+	}
+	ptr = (char *) chunk->data + chunk->used;
+	chunk->used += size;
+	return(ptr);
+}
+
+struct text *txtalloc_chunk()	/* line structure for a line being read */
+{
+	struct text *tline;
+
+	tline = chunk_alloc(&node_chunks, sizeof(struct text),
+				NODE_CHUNK_SIZE * sizeof(struct text));
+	if (tline == NULL)
+		return(txtalloc());
+	memset(tline, 0, sizeof(struct text));
+	tline->flags = NODE_IN_CHUNK;
+	return(tline);
+}
+
+void 
+txtfree(tline)			/* release a line and its text		*/
+struct text *tline;
+{
+	if ((tline->line != NULL) && !(tline->flags & TEXT_IN_CHUNK))
+		free(tline->line);
+	if (!(tline->flags & NODE_IN_CHUNK))
+		free(tline);
+}
+
+void 
+free_chunks()			/* no line uses the chunks anymore	*/
+{
+	struct chunk *chunk;
+
+	while ((chunk = text_chunks) != NULL)
+	{
+		text_chunks = chunk->next;
+		free(chunk);
+	}
+	while ((chunk = node_chunks) != NULL)
+	{
+		node_chunks = chunk->next;
+		free(chunk);
+	}
 }
 
 struct files *name_alloc()	/* allocate space for file name list node */
@@ -2268,7 +2373,7 @@ char *file_name;
 	else
 		append = TRUE;
 	can_read = FALSE;		/* test if file has any characters  */
-	while (((length = read(get_fd, in_string, 512)) != 0) && (length != -1))
+	while (((length = read(get_fd, in_string, READ_SIZE)) != 0) && (length != -1))
 	{
 		can_read = TRUE;  /* if set file has at least 1 character   */
 		get_line(length, in_string, &append);
@@ -2279,9 +2384,7 @@ char *file_name;
 		temp_line->next_line = curr_line->next_line;
 		if (temp_line->next_line != NULL)
 			temp_line->next_line->prev_line = temp_line;
-		if (curr_line->line != NULL)
-			free(curr_line->line);
-		free(curr_line);
+		txtfree(curr_line);
 		curr_line = temp_line;
 	}
 	if (input_file)	/* if this is the file to be edited display number of lines	*/
@@ -2310,39 +2413,22 @@ int *append;	/* TRUE if must append more text to end of current line	*/
 {
 	unsigned char *str1;
 	unsigned char *str2;
-	int num;		/* offset from start of string		*/
+	unsigned char *end;	/* end of string read			*/
 	int char_count;		/* length of new line (or added portion	*/
-	int temp_counter;	/* temporary counter value		*/
 	struct text *tline;	/* temporary pointer to new line	*/
-	int first_time;		/* if TRUE, the first time through the loop */
 
-	str2 = in_string;
-	num = 0;
-	first_time = TRUE;
-	while (num < length)
+	str1 = in_string;
+	end = in_string + length;
+	for (;;)
 	{
-		if (!first_time)
-		{
-			if (num < length)
-			{
-				str2++;
-				num++;
-			}
-		}
-		else
-			first_time = FALSE;
-		str1 = str2;
-		char_count = 1;
 		/* find end of line	*/
-		while ((*str2 != '\n') && (num < length))
-		{
-			str2++;
-			num++;
-			char_count++;
-		}
+		str2 = memchr(str1, '\n', end - str1);
+		if (str2 == NULL)
+			str2 = end;
+		char_count = 1 + (str2 - str1);
 		if (!(*append))	/* if not append to current line, insert new one */
 		{
-			tline = txtalloc();	/* allocate data structure for next line */
+			tline = txtalloc_chunk();	/* allocate data structure for next line */
 			tline->line_number = curr_line->line_number + 1;
 			tline->next_line = curr_line->next_line;
 			tline->prev_line = curr_line;
@@ -2350,7 +2436,12 @@ int *append;	/* TRUE if must append more text to end of current line	*/
 			if (tline->next_line != NULL)
 				tline->next_line->prev_line = tline;
 			curr_line = tline;
-			curr_line->line = point = (unsigned char *) malloc(char_count);
+			point = chunk_alloc(&text_chunks, char_count, TEXT_CHUNK_SIZE);
+			if (point != NULL)
+				curr_line->flags |= TEXT_IN_CHUNK;
+			else
+				point = (unsigned char *) malloc(char_count);
+			curr_line->line = point;
 			curr_line->line_length = char_count;
 			curr_line->max_length = char_count;
 		}
@@ -2359,16 +2450,16 @@ int *append;	/* TRUE if must append more text to end of current line	*/
 			point = resiz_line(char_count, curr_line, curr_line->line_length); 
 			curr_line->line_length += (char_count - 1);
 		}
-		for (temp_counter = 1; temp_counter < char_count; temp_counter++)
+		memcpy(point, str1, char_count - 1);
+		point += char_count - 1;
+		*point = '\0';
+		if (str2 == end)	/* line continues in the next read */
 		{
-			*point = *str1;
-			point++;
-			str1++;
+			*append = TRUE;
+			break;
 		}
-		*point = '\0';
 		*append = FALSE;
-		if ((num == length) && (*str2 != '\n'))
-			*append = TRUE;
+		str1 = str2 + 1;
 	}
 }
 
@@ -2485,12 +2576,14 @@ delete_text()
 		curr_line = curr_line->next_line;
 	while (curr_line != first_line)
 	{
-		free(curr_line->line);
 		curr_line = curr_line->prev_line;
 		absolute_lin--;
-		free(curr_line->next_line);
+		txtfree(curr_line->next_line);
 	}
 	curr_line->next_line = NULL;
+	if (curr_line->flags & TEXT_IN_CHUNK)
+		resiz_line(0, curr_line, 1);
+	free_chunks();
 	*curr_line->line = '\0';
 	curr_line->line_length = 1;
 	curr_line->line_number = 1;
@@ -41,10 +41,13 @@ __FBSDID("$FreeBSD: src/usr.bin/grep/file.c,v 1.7 2011/10/11 22:27:23 gabor Exp
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #ifndef WITHOUT_LZMA
 #include <lzma.h>
 #endif
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -62,44 +65,115 @@ __FBSDID("$FreeBSD: src/usr.bin/grep/file.c,v 1.7 2011/10/11 22:27:23 gabor Exp
 #define	MAXBUFSIZ	(32 * 1024)
 #define	LNBUFBUMP	80
 
-static gzFile gzbufdesc;
-#ifndef WITHOUT_LZMA
-static lzma_stream lstrm = LZMA_STREAM_INIT;
-#endif
+/*
+ * Plain reads use at least GREPBUFSIZ bytes, or the preferred I/O size
+ * of the file system when it is larger, up to GREPBUFMAX.
+ */
+#define	GREPBUFSIZ	(256 * 1024)
+#define	GREPBUFMAX	(4 * 1024 * 1024)
+
+#define	DZ_NBUF		4	/* Decompressed buffers in flight */
+
+/*
+ * A compressed file is decompressed by a second thread into a ring of
+ * DZ_NBUF buffers, while this thread matches the lines of the buffer it
+ * holds.  The decoders work on a dup of the file descriptor, which they
+ * close themselves.
+ */
+struct dzring {
+	pthread_t	 thr;
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;		/* buffer filled, or buffer freed */
+	unsigned char	*buf[DZ_NBUF];
+	size_t		 len[DZ_NBUF];
+	size_t		 bufsiz;
+	unsigned long	 head;		/* buffers filled */
+	unsigned long	 tail;		/* buffers handed out */
+	bool		 threaded;
+	bool		 eof;
+	bool		 error;
+	bool		 stop;
+	int		 behave;	/* filebehave of the file */
+	int		 fd;
+	gzFile		 gz;
 #ifndef WITHOUT_BZIP2
-static BZFILE* bzbufdesc;
+	FILE		*bzfp;
+	BZFILE		*bz;
+	int		 bzstreams;	/* streams opened, -1 after the last */
+	char		 bzunused[BZ_MAX_UNUSED];
+#endif
+#ifndef WITHOUT_LZMA
+	lzma_stream	 lz;
+	uint8_t		*lzin;
+	bool		 lzend;
 #endif
+};
 
-static unsigned char *buffer;
-static unsigned char *bufpos;
-static size_t bufrem;
-static size_t fsiz;
+static __thread struct dzring *dzring;
 
-static unsigned char *lnbuf;
-static size_t lnbuflen;
+static __thread unsigned char *buffer;
+static __thread unsigned char *bufpos;
+static __thread size_t bufrem;
+static __thread size_t bufsiz;		/* of the malloc'ed buffer */
+static __thread unsigned char *mapaddr;	/* the file, with --mmap */
+static __thread size_t fsiz;
+static __thread bool bufmapped;
 
-static inline int
-grep_refill(struct file *f)
+static __thread unsigned char *lnbuf;
+static __thread size_t lnbuflen;
+
+/*
+ * Decompress up to size bytes into out.  Returns the number of bytes,
+ * 0 at the end of the data, or -1.  Runs on the decompressing thread,
+ * so it must not touch the thread-local state of grep.
+ */
+static ssize_t
+dz_decode(struct dzring *dz, unsigned char *out, size_t size)
 {
 	ssize_t nr;
 
-	if (filebehave == FILE_MMAP)
-		return (0);
-
-	bufpos = buffer;
-	bufrem = 0;
-
-	if (filebehave == FILE_GZIP) {
-		nr = gzread(gzbufdesc, buffer, MAXBUFSIZ);
+	switch (dz->behave) {
+	case FILE_GZIP:
+		return (gzread(dz->gz, out, (unsigned)MIN(size, INT_MAX)));
 #ifndef WITHOUT_BZIP2
-	} else if (filebehave == FILE_BZIP && bzbufdesc != NULL) {
-		int bzerr;
-
-		nr = BZ2_bzRead(&bzerr, bzbufdesc, buffer, MAXBUFSIZ);
+	case FILE_BZIP: {
+		void *unused;
+		int bzerr, nunused, c;
+
+		if (dz->bz == NULL)
+			/* Not bzip2 after all, or the last stream ended */
+			return (dz->bzstreams < 0 ? 0 :
+			    read(dz->fd, out, size));
+		nr = BZ2_bzRead(&bzerr, dz->bz, out,
+		    (int)MIN(size, INT_MAX));
 		switch (bzerr) {
 		case BZ_OK:
+			break;
 		case BZ_STREAM_END:
-			/* No problem, nr will be okay */
+			/*
+			 * Files made by pbzip2 and the like hold several
+			 * streams, one after the other: go on with the next.
+			 */
+			BZ2_bzReadGetUnused(&bzerr, dz->bz, &unused, &nunused);
+			if (bzerr != BZ_OK)
+				return (-1);
+			memcpy(dz->bzunused, unused, nunused);
+			BZ2_bzReadClose(&bzerr, dz->bz);
+			dz->bz = NULL;
+			if (nunused == 0) {
+				if ((c = getc(dz->bzfp)) == EOF) {
+					dz->bzstreams = -1;
+					break;
+				}
+				dz->bzunused[nunused++] = c;
+			}
+			dz->bz = BZ2_bzReadOpen(&bzerr, dz->bzfp, 0, 0,
+			    dz->bzunused, nunused);
+			if (dz->bz == NULL)
+				return (-1);
+			dz->bzstreams++;
+			if (nr == 0)
+				return (dz_decode(dz, out, size));
 			break;
 		case BZ_DATA_ERROR_MAGIC:
 			/*
@@ -108,53 +182,289 @@ grep_refill(struct file *f)
 			 * compressed format, BZ2_bzRead() instead aborts.
 			 *
 			 * So, just restart at the beginning of the file again,
-			 * and use plain reads from now on.
+			 * and use plain reads from now on.  Trailing garbage
+			 * after a stream ends the data, as with bzip2 -d.
 			 */
-			BZ2_bzReadClose(&bzerr, bzbufdesc);
-			bzbufdesc = NULL;
-			if (lseek(f->fd, 0, SEEK_SET) == -1)
+			BZ2_bzReadClose(&bzerr, dz->bz);
+			dz->bz = NULL;
+			if (dz->bzstreams > 1) {
+				dz->bzstreams = -1;
+				return (0);
+			}
+			if (lseek(dz->fd, 0, SEEK_SET) == -1)
 				return (-1);
-			nr = read(f->fd, buffer, MAXBUFSIZ);
-			break;
+			return (read(dz->fd, out, size));
 		default:
 			/* Make sure we exit with an error */
-			nr = -1;
+			return (-1);
 		}
+		return (nr);
+	}
 #endif
 #ifndef WITHOUT_LZMA
-	} else if ((filebehave == FILE_XZ) || (filebehave == FILE_LZMA)) {
-		lzma_action action = LZMA_RUN;
-		uint8_t in_buf[MAXBUFSIZ];
+	case FILE_XZ:
+	case FILE_LZMA: {
 		lzma_ret ret;
 
-		ret = (filebehave == FILE_XZ) ?
-		    lzma_stream_decoder(&lstrm, UINT64_MAX,
-		    LZMA_CONCATENATED) :
-		    lzma_alone_decoder(&lstrm, UINT64_MAX);
-
-		if (ret != LZMA_OK)
-			return (-1);
+		if (dz->lzend)
+			return (0);
+		dz->lz.next_out = out;
+		dz->lz.avail_out = size;
+		while (dz->lz.avail_out > 0) {
+			if (dz->lz.avail_in == 0) {
+				if ((nr = read(dz->fd, dz->lzin, MAXBUFSIZ)) < 0)
+					return (-1);
+				dz->lz.next_in = dz->lzin;
+				dz->lz.avail_in = nr;
+			}
+			ret = lzma_code(&dz->lz,
+			    dz->lz.avail_in == 0 ? LZMA_FINISH : LZMA_RUN);
+			if (ret == LZMA_STREAM_END) {
+				dz->lzend = true;
+				break;
+			}
+			if (ret != LZMA_OK)
+				return (-1);
+		}
+		return (size - dz->lz.avail_out);
+	}
+#endif
+	default:
+		return (read(dz->fd, out, size));
+	}
+}
 
-		lstrm.next_out = buffer;
-		lstrm.avail_out = MAXBUFSIZ;
-		lstrm.next_in = in_buf;
-		nr = read(f->fd, in_buf, MAXBUFSIZ);
+/*
+ * Fill a buffer as far as the data goes, so that the matcher gets large
+ * pieces.  Returns 0 and the length, 0 at the end, or -1.
+ */
+static int
+dz_fill(struct dzring *dz, unsigned char *out, size_t *lenp)
+{
+	ssize_t nr;
 
+	for (*lenp = 0; *lenp < dz->bufsiz; *lenp += nr) {
+		nr = dz_decode(dz, out + *lenp, dz->bufsiz - *lenp);
 		if (nr < 0)
 			return (-1);
-		else if (nr == 0)
-			action = LZMA_FINISH;
+		if (nr == 0)
+			break;
+	}
+	return (0);
+}
 
-		lstrm.avail_in = nr;
-		ret = lzma_code(&lstrm, action);
+static void *
+dz_thread(void *arg)
+{
+	struct dzring *dz = arg;
+	unsigned char *out;
+	size_t len;
+	int rv;
+
+	pthread_mutex_lock(&dz->mtx);
+	for (;;) {
+		/* One buffer stays with the matcher */
+		while (!dz->stop && dz->head - dz->tail >= DZ_NBUF - 1)
+			pthread_cond_wait(&dz->cv, &dz->mtx);
+		if (dz->stop)
+			break;
+		out = dz->buf[dz->head % DZ_NBUF];
+		pthread_mutex_unlock(&dz->mtx);
+
+		rv = dz_fill(dz, out, &len);
+
+		pthread_mutex_lock(&dz->mtx);
+		if (rv == -1)
+			dz->error = true;
+		else if (len == 0)
+			dz->eof = true;
+		else
+			dz->len[dz->head++ % DZ_NBUF] = len;
+		pthread_cond_broadcast(&dz->cv);
+		if (dz->error || dz->eof)
+			break;
+	}
+	pthread_mutex_unlock(&dz->mtx);
+	return (NULL);
+}
 
-		if (ret != LZMA_OK && ret != LZMA_STREAM_END)
-			return (-1);
-		bufrem = MAXBUFSIZ - lstrm.avail_out;
+/*
+ * Hand the next decompressed buffer to the matcher, giving the one it
+ * held back to the decompressing thread.
+ */
+static int
+dz_next(struct dzring *dz)
+{
+	size_t len;
+
+	bufrem = 0;
+	if (!dz->threaded) {
+		if (dz->eof || dz_fill(dz, dz->buf[0], &len) == -1)
+			return (dz->eof ? 0 : -1);
+		dz->eof = (len == 0);
+		bufpos = dz->buf[0];
+		bufrem = len;
 		return (0);
+	}
+
+	pthread_mutex_lock(&dz->mtx);
+	while (dz->head == dz->tail && !dz->eof && !dz->error)
+		pthread_cond_wait(&dz->cv, &dz->mtx);
+	if (dz->head == dz->tail) {
+		pthread_mutex_unlock(&dz->mtx);
+		return (dz->error ? -1 : 0);
+	}
+	bufpos = dz->buf[dz->tail % DZ_NBUF];
+	bufrem = dz->len[dz->tail % DZ_NBUF];
+	dz->tail++;
+	pthread_cond_broadcast(&dz->cv);
+	pthread_mutex_unlock(&dz->mtx);
+	return (0);
+}
+
+static void
+dz_free(struct dzring *dz)
+{
+	int i;
+#ifndef WITHOUT_BZIP2
+	int bzerr;
 #endif
-	} else
-		nr = read(f->fd, buffer, MAXBUFSIZ);
+
+	switch (dz->behave) {
+	case FILE_GZIP:
+		if (dz->gz != NULL)
+			gzclose(dz->gz);
+		else
+			close(dz->fd);
+		break;
+#ifndef WITHOUT_BZIP2
+	case FILE_BZIP:
+		if (dz->bz != NULL)
+			BZ2_bzReadClose(&bzerr, dz->bz);
+		if (dz->bzfp != NULL)
+			fclose(dz->bzfp);
+		else
+			close(dz->fd);
+		break;
+#endif
+	default:
+#ifndef WITHOUT_LZMA
+		lzma_end(&dz->lz);
+		free(dz->lzin);
+#endif
+		close(dz->fd);
+		break;
+	}
+	for (i = 0; i < DZ_NBUF; i++)
+		free(dz->buf[i]);
+	free(dz);
+}
+
+/*
+ * Set up the decoder for filebehave on a dup of fd, and start the
+ * decompressing thread.  Without a thread, the buffers are filled on
+ * demand.
+ */
+static struct dzring *
+dz_open(int fd, size_t bufsiz)
+{
+	struct dzring *dz;
+	int i;
+#ifndef WITHOUT_BZIP2
+	int bzerr;
+#endif
+
+	dz = grep_malloc(sizeof(*dz));
+	memset(dz, 0, sizeof(*dz));
+	dz->behave = filebehave;
+	dz->bufsiz = bufsiz;
+	if ((dz->fd = dup(fd)) == -1) {
+		free(dz);
+		return (NULL);
+	}
+	for (i = 0; i < DZ_NBUF; i++)
+		dz->buf[i] = grep_malloc(bufsiz);
+
+	switch (dz->behave) {
+	case FILE_GZIP:
+		if ((dz->gz = gzdopen(dz->fd, "r")) == NULL)
+			goto error;
+		gzbuffer(dz->gz, MAXBUFSIZ * 4);
+		break;
+#ifndef WITHOUT_BZIP2
+	case FILE_BZIP:
+		if ((dz->bzfp = fdopen(dz->fd, "r")) == NULL ||
+		    (dz->bz = BZ2_bzReadOpen(&bzerr, dz->bzfp, 0, 0, NULL,
+		    0)) == NULL)
+			goto error;
+		dz->bzstreams = 1;
+		break;
+#endif
+#ifndef WITHOUT_LZMA
+	case FILE_XZ:
+	case FILE_LZMA:
+		dz->lz = (lzma_stream)LZMA_STREAM_INIT;
+		dz->lzin = grep_malloc(MAXBUFSIZ);
+		if (((dz->behave == FILE_XZ) ?
+		    lzma_stream_decoder(&dz->lz, UINT64_MAX,
+		    LZMA_CONCATENATED) :
+		    lzma_alone_decoder(&dz->lz, UINT64_MAX)) != LZMA_OK)
+			goto error;
+		break;
+#endif
+	default:
+		break;
+	}
+
+	pthread_mutex_init(&dz->mtx, NULL);
+	pthread_cond_init(&dz->cv, NULL);
+	dz->threaded = pthread_create(&dz->thr, NULL, dz_thread, dz) == 0;
+	if (!dz->threaded) {
+		pthread_cond_destroy(&dz->cv);
+		pthread_mutex_destroy(&dz->mtx);
+	}
+	return (dz);
+
+error:
+	dz_free(dz);
+	return (NULL);
+}
+
+/*
+ * Stop the decompressing thread, which may be waiting for a free buffer
+ * if the matcher stopped early (-l, -q, -m).
+ */
+static void
+dz_close(struct dzring *dz)
+{
+
+	if (dz->threaded) {
+		pthread_mutex_lock(&dz->mtx);
+		dz->stop = true;
+		pthread_cond_broadcast(&dz->cv);
+		pthread_mutex_unlock(&dz->mtx);
+		pthread_join(dz->thr, NULL);
+		pthread_cond_destroy(&dz->cv);
+		pthread_mutex_destroy(&dz->mtx);
+	}
+	dz_free(dz);
+}
+
+static inline int
+grep_refill(struct file *f)
+{
+	ssize_t nr;
+
+	if (bufmapped)
+		return (0);
+
+	if (dzring != NULL)
+		return (dz_next(dzring));
+
+	bufpos = buffer;
+	bufrem = 0;
+
+	nr = read(f->fd, buffer, bufsiz);
 
 	if (nr < 0)
 		return (-1);
@@ -256,58 +566,81 @@ error:
 struct file *
 grep_open(const char *path)
 {
+	struct stat st;
 	struct file *f;
+	off_t start = 0;
 
 	f = grep_malloc(sizeof *f);
 	memset(f, 0, sizeof *f);
-	if (path == NULL) {
-		/* Processing stdin implies --line-buffered. */
-		lbflag = true;
+	if (path == NULL)
 		f->fd = fileno(thread_stdin);
-	} else if ((f->fd = open(path, O_RDONLY)) == -1)
+	else if ((f->fd = open(path, O_RDONLY)) == -1)
 		goto error1;
 
-	if (filebehave == FILE_MMAP) {
-		struct stat st;
+	if (fstat(f->fd, &st) == -1)
+		st.st_mode = 0;
 
-		if ((fstat(f->fd, &st) == -1) || (st.st_size > OFF_MAX) ||
-		    (!S_ISREG(st.st_mode)))
-			filebehave = FILE_STDIO;
-		else {
+	if (path == NULL) {
+		/*
+		 * Processing stdin implies --line-buffered, unless it is a
+		 * regular file (grep < file); that one is read from where
+		 * the descriptor is.
+		 */
+		if (!S_ISREG(st.st_mode))
+			lbflag = true;
+		else if ((start = lseek(f->fd, 0, SEEK_CUR)) < 0)
+			start = 0;
+	}
+
+	/*
+	 * Only regular files are mapped, and only for this file: a pipe or
+	 * an empty file in a recursive search keeps the other files mapped.
+	 */
+	if (filebehave == FILE_MMAP && S_ISREG(st.st_mode) &&
+	    st.st_size > start && st.st_size <= OFF_MAX &&
+	    (uintmax_t)st.st_size <= SIZE_MAX) {
+		void *addr;
 #ifdef __APPLE__
-			int flags = MAP_PRIVATE | MAP_NOCACHE;
+		int flags = MAP_PRIVATE | MAP_NOCACHE;
 #else
-			int flags = MAP_PRIVATE | MAP_NOCORE | MAP_NOSYNC;
+		int flags = MAP_PRIVATE | MAP_NOCORE | MAP_NOSYNC;
 #endif
 #ifdef MAP_PREFAULT_READ
-			flags |= MAP_PREFAULT_READ;
+		flags |= MAP_PREFAULT_READ;
 #endif
-			fsiz = st.st_size;
-			buffer = mmap(NULL, fsiz, PROT_READ, flags,
-			     f->fd, (off_t)0);
-            fprintf(thread_stderr, "Read buffer: %s\n", buffer);
-			if (buffer == MAP_FAILED)
-				filebehave = FILE_STDIO;
-			else {
-				bufrem = st.st_size;
-				bufpos = buffer;
-				madvise(buffer, st.st_size, MADV_SEQUENTIAL);
-			}
+
+		addr = mmap(NULL, (size_t)st.st_size, PROT_READ, flags,
+		    f->fd, (off_t)0);
+		if (addr != MAP_FAILED) {
+			madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+			mapaddr = addr;
+			fsiz = (size_t)st.st_size;
+			bufpos = mapaddr + start;
+			bufrem = fsiz - (size_t)start;
+			bufmapped = true;
 		}
 	}
 
-	if ((buffer == NULL) || (buffer == MAP_FAILED))
-		buffer = grep_malloc(MAXBUFSIZ);
-
-	if (filebehave == FILE_GZIP &&
-	    (gzbufdesc = gzdopen(f->fd, "r")) == NULL)
-		goto error2;
-
-#ifndef WITHOUT_BZIP2
-	if (filebehave == FILE_BZIP &&
-	    (bzbufdesc = BZ2_bzdopen(f->fd, "r")) == NULL)
-		goto error2;
-#endif
+	if (!bufmapped) {
+		size_t want = GREPBUFSIZ;
+
+		if (S_ISREG(st.st_mode) && st.st_blksize > GREPBUFSIZ)
+			want = MIN((size_t)st.st_blksize, GREPBUFMAX);
+		if (filebehave == FILE_GZIP || filebehave == FILE_BZIP ||
+		    filebehave == FILE_XZ || filebehave == FILE_LZMA) {
+			if ((dzring = dz_open(f->fd, want)) == NULL)
+				goto error2;
+			bufpos = dzring->buf[0];
+		} else {
+			if (buffer == NULL || want > bufsiz) {
+				free(buffer);
+				buffer = grep_malloc(want);
+				bufsiz = want;
+			}
+			bufpos = buffer;
+		}
+		bufrem = 0;
+	}
 
 	/* Fill read buffer, also catches errors early */
 	if (bufrem == 0 && grep_refill(f) != 0)
@@ -320,6 +653,15 @@ grep_open(const char *path)
 	return (f);
 
 error2:
+	if (dzring != NULL) {
+		dz_close(dzring);
+		dzring = NULL;
+	}
+	if (bufmapped) {
+		munmap(mapaddr, fsiz);
+		mapaddr = NULL;
+		bufmapped = false;
+	}
 	close(f->fd);
 error1:
 	free(f);
@@ -333,12 +675,17 @@ void
 grep_close(struct file *f)
 {
 
+	if (dzring != NULL) {
+		dz_close(dzring);
+		dzring = NULL;
+	}
 	close(f->fd);
 
 	/* Reset read buffer and line buffer */
-	if (filebehave == FILE_MMAP) {
-		munmap(buffer, fsiz);
-		buffer = NULL;
+	if (bufmapped) {
+		munmap(mapaddr, fsiz);
+		mapaddr = NULL;
+		bufmapped = false;
 	}
 	bufpos = buffer;
 	bufrem = 0;
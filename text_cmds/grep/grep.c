@@ -70,9 +70,9 @@ const char	*errstr[] = {
 /* 2*/	"cannot read bzip2 compressed file",
 /* 3*/	"grep: unknown %s option\n",
 #ifdef __APPLE__
-/* 4*/	"usage: %s [-abcDEFGHhIiJLlmnOoqRSsUVvwxZ] [-A num] [-B num] [-C[num]]\n",
+/* 4*/	"usage: %s [-abcDEFGHhIiJLlmnOoqRSsUVvwxZ] [-A num] [-B num] [-C[num]] [-j num]\n",
 #else
-/* 4*/	"usage: %s [-abcDEFGHhIiJLlmnOoPqRSsUVvwxZ] [-A num] [-B num] [-C[num]]\n",
+/* 4*/	"usage: %s [-abcDEFGHhIiJLlmnOoPqRSsUVvwxZ] [-A num] [-B num] [-C[num]] [-j num]\n",
 #endif
 /* 5*/	"\t[-e pattern] [-f file] [--binary-files=value] [--color=when]\n",
 /* 6*/	"\t[--context[=num]] [--directories=action] [--label] [--line-buffered]\n",
@@ -92,6 +92,7 @@ __thread bool		 matchall;
 unsigned __thread int	 patterns, pattern_sz;
 __thread struct pat	*pattern;
 __thread regex_t		*r_pattern;
+__thread struct litpat	*l_pattern;
 #ifndef WITHOUT_FASTMATCH
 __thread fastmatch_t	*fg_pattern;
 #endif
@@ -116,6 +117,7 @@ bool	 __thread iflag;		/* -i: ignore case */
 bool	 __thread lflag;		/* -l: only show names of files with matches */
 bool	 __thread mflag;		/* -m x: stop reading the files after x matches */
 long long __thread mcount;	/* count for -m */
+unsigned int __thread njobs;	/* -j x: search x files at once with -r */
 bool	 __thread nflag;		/* -n: show line numbers in front of matching lines */
 bool	 __thread oflag;		/* -o: print only matching part */
 bool	 __thread qflag;		/* -q: quiet mode (don't output anything) */
@@ -175,7 +177,7 @@ usage(void)
 	exit(2);
 }
 
-static const char	*optstr = "0123456789A:B:C:D:EFGHIJMLOPSRUVZabcd:e:f:hilm:nopqrsuvwxXy";
+static const char	*optstr = "0123456789A:B:C:D:EFGHIJMLOPSRUVZabcd:e:f:hij:lm:nopqrsuvwxXy";
 
 static const struct option long_options[] =
 {
@@ -208,6 +210,7 @@ static const struct option long_options[] =
 	{"with-filename",	no_argument,		NULL, 'H'},
 	{"ignore-case",		no_argument,		NULL, 'i'},
 	{"bz2decompress",	no_argument,		NULL, 'J'},
+	{"jobs",		required_argument,	NULL, 'j'},
 	{"files-with-matches",	no_argument,		NULL, 'l'},
 	{"files-without-match", no_argument,            NULL, 'L'},
 	{"max-count",		required_argument,	NULL, 'm'},
@@ -385,6 +388,7 @@ grep_main(int argc, char *argv[])
     Aflag = Bflag = 0;
     Hflag = Lflag = bflag = cflag = hflag = iflag = lflag = mflag = false;
     mcount = 0;
+    njobs = 1;
     nflag = oflag = qflag = sflag = vflag = wflag = xflag = lbflag = nullflag = false;
     label = NULL;
     grepbehave = GREP_BASIC;
@@ -585,6 +589,15 @@ grep_main(int argc, char *argv[])
 			Lflag = false;
 			lflag = true;
 			break;
+		case 'j':
+			errno = 0;
+			l = strtoull(optarg, &ep, 10);
+			if (errno != 0 || ep[0] != '\0' || l == 0 || l > UINT_MAX) {
+				errno = EINVAL;
+				err(2, NULL);
+			}
+			njobs = (unsigned int)l;
+			break;
 		case 'm':
 			mflag = true;
 			errno = 0;
@@ -637,10 +650,7 @@ grep_main(int argc, char *argv[])
 			break;
 		case 'u':
 		case MMAP_OPT:
-#ifndef __APPLE__
-			/* mmap mode is buggy (10789286) */
 			filebehave = FILE_MMAP;
-#endif
 			break;
 		case 'V':
 			fprintf(thread_stdout, getstr(9), progname, VERSION);
@@ -797,6 +807,7 @@ grep_main(int argc, char *argv[])
 		}
 #endif
 	}
+	literal_init();
 
 	if (lbflag)
 		setlinebuf(thread_stdout);
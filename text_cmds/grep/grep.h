@@ -112,6 +112,13 @@ struct epat {
 	int		 mode;
 };
 
+/* Literal that every match of a pattern contains */
+struct litpat {
+	const char	*lit;		/* NULL if none was found */
+	size_t		 len;
+	bool		 whole;		/* the pattern is just the literal */
+};
+
 /* Flags passed to regcomp() and regexec() */
 extern __thread int	 cflags, eflags;
 
@@ -122,6 +129,7 @@ extern __thread bool	 Eflag, Fflag, Gflag, Hflag, Lflag,
 extern __thread bool	 dexclude, dinclude, fexclude, finclude, lbflag, nullflag;
 extern __thread unsigned long long Aflag, Bflag;
 extern __thread long long mcount;
+extern __thread unsigned int njobs;
 extern __thread char	*label;
 extern __thread const char *color;
 extern __thread int	 binbehave, devbehave, dirbehave, filebehave, grepbehave, linkbehave;
@@ -132,6 +140,7 @@ extern __thread unsigned int dpatterns, fpatterns, patterns;
 extern __thread struct pat *pattern;
 extern __thread struct epat *dpattern, *fpattern;
 extern __thread regex_t	*er_pattern, *r_pattern;
+extern __thread struct litpat *l_pattern;
 #ifndef WITHOUT_FASTMATCH
 extern __thread fastmatch_t *fg_pattern;
 #endif
@@ -149,6 +158,7 @@ void	*grep_calloc(size_t nmemb, size_t size);
 void	*grep_realloc(void *ptr, size_t size);
 char	*grep_strdup(const char *str);
 void	 printline(struct str *line, int sep, regmatch_t *matches, int m);
+void	 literal_init(void);
 
 /* queue.c */
 void	 enqueue(struct str *x);
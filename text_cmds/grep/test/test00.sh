@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Literal fast path: a run of ordinary characters seen before an
+# alternation must not be required of the lines the pattern matches.
+#
+
+GREP=${GREP:-grep}
+STATUS=0
+
+check() {
+	input=$1
+	expected=$2
+	shift 2
+	r=`printf "$input" | $GREP "$@" 2>&1`
+	if [ "$r" != "$expected" ] ; then
+		echo "ERROR grep $*: got '$r', expected '$expected'" 1>&2
+		STATUS=1
+	fi
+}
+
+check 'foo\nbaz\nbar\n'	'foo
+baz'	-E 'fo+|baz'
+check 'foo\nbaz\nbar\n'	'baz'	-E 'ba+z|qux'
+check 'ab\nxyz\nq\n'	'ab
+xyz'	'ab*\|xyz'
+check 'xaz\nfoo\nbar\n'	'xaz
+foo'	-E 'x.z|(foo)'
+check 'abc\nxyz\n'	'xyz'	-E 'abcd|x'
+check 'abc\nxyz\n'	'abc'	-v -E 'abcd|x'
+check 'abc\nxyz\n'	'2'	-c -e 'abcd\|x' -e 'c'
+
+# The literal is still used, and whole for patterns without metacharacters
+check 'foo\nbaz\nbar\n'	'baz'	'baz'
+check 'foo\nbaz\nbar\n'	'bar'	-E 'ba+r'
+check 'foo\nbaz\nbar\n'	'ba
+ba'	-o 'ba'
+
+exit $STATUS
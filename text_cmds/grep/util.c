@@ -44,9 +44,12 @@ __FBSDID("$FreeBSD: src/usr.bin/grep/util.c,v 1.19 2011/12/07 12:25:28 gabor Exp
 #include <fnmatch.h>
 #include <fts.h>
 #include <libgen.h>
+#include <limits.h>
 #ifdef __APPLE__
 #include <locale.h>
+#include <xlocale.h>
 #endif /* __APPLE__ */
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -61,9 +64,93 @@ __FBSDID("$FreeBSD: src/usr.bin/grep/util.c,v 1.19 2011/12/07 12:25:28 gabor Exp
 #include "grep.h"
 #include "ios_error.h"
 
-static int	 linesqueued;
+static __thread int	 linesqueued;
 static int	 procline(struct str *l, int);
 
+/*
+ * Parallel recursive search (-j): fts_read() runs on the calling thread
+ * and feeds a bounded window of files to the worker threads.  Each
+ * worker runs procfile() with its output going to memory buffers, which
+ * are written out in traversal order, so the result does not depend on
+ * scheduling.
+ */
+#define	GREP_WINDOW	8	/* files in flight per worker */
+
+struct grep_job {
+	char		*path;
+	char		*out, *errs;	/* buffered stdout and stderr */
+	size_t		 outlen, errlen;
+	int		 c;
+	bool		 file_err;
+	bool		 done;
+};
+
+/*
+ * The options are thread-local, so the workers start with a copy of
+ * the calling thread's.
+ */
+struct grep_state {
+	int		 cflags, eflags;
+	bool		 Hflag, Lflag, bflag, cflag, hflag, iflag, lflag,
+			 nflag, oflag, qflag, sflag, vflag, wflag, xflag,
+			 dexclude, dinclude, fexclude, finclude, lbflag,
+			 nullflag, first, matchall, prev;
+	unsigned long long Aflag, Bflag;
+	char		*label;
+	const char	*color;
+	int		 binbehave, devbehave, dirbehave, filebehave,
+			 grepbehave, linkbehave, tail;
+	unsigned int	 dpatterns, fpatterns, patterns;
+	struct pat	*pattern;
+	struct epat	*dpattern, *fpattern;
+	regex_t		*r_pattern;
+	struct litpat	*l_pattern;
+	struct ac	*ac_pattern;
+#ifndef WITHOUT_FASTMATCH
+	fastmatch_t	*fg_pattern;
+#endif
+#ifndef WITHOUT_NLS
+	nl_catd		 catalog;
+#endif
+};
+
+struct grep_pool {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* job queued, or end of traversal */
+	pthread_cond_t	 done;		/* job completed */
+	struct grep_job	*jobs;
+	size_t		 size;
+	size_t		 head;		/* next job to print */
+	size_t		 next;		/* next job to start */
+	size_t		 tail;		/* next free slot */
+	bool		 finished;
+	int		 c;
+	unsigned int	 nthreads;
+	pthread_t	*threads;
+	struct grep_state state;
+};
+
+/*
+ * Aho-Corasick automaton over all the patterns, when every one of them
+ * is a literal.  The root has a full transition table; the other nodes
+ * keep their children in a sibling list.
+ */
+struct acnode {
+	int		 child;		/* first child, or 0 */
+	int		 sibling;	/* next child of the parent, or 0 */
+	int		 fail;
+	unsigned char	 byte;
+	bool		 match;		/* a pattern ends here */
+};
+
+struct ac {
+	struct acnode	*nodes;
+	int		 nnodes, size;
+	int		 root[UCHAR_MAX + 1];
+};
+
+static __thread struct ac *ac_pattern;
+
 bool
 file_matching(const char *fname)
 {
@@ -108,15 +195,201 @@ dir_matching(const char *dname)
 	return (ret);
 }
 
+static void
+grep_state_copy(struct grep_state *st, bool save)
+{
+#define	XFER(v)	do { if (save) st->v = v; else v = st->v; } while (0)
+	XFER(cflags); XFER(eflags);
+	XFER(Hflag); XFER(Lflag); XFER(bflag); XFER(cflag); XFER(hflag);
+	XFER(iflag); XFER(lflag); XFER(nflag); XFER(oflag); XFER(qflag);
+	XFER(sflag); XFER(vflag); XFER(wflag); XFER(xflag);
+	XFER(dexclude); XFER(dinclude); XFER(fexclude); XFER(finclude);
+	XFER(lbflag); XFER(nullflag); XFER(first); XFER(matchall); XFER(prev);
+	XFER(Aflag); XFER(Bflag); XFER(label); XFER(color);
+	XFER(binbehave); XFER(devbehave); XFER(dirbehave); XFER(filebehave);
+	XFER(grepbehave); XFER(linkbehave); XFER(tail);
+	XFER(dpatterns); XFER(fpatterns); XFER(patterns);
+	XFER(pattern); XFER(dpattern); XFER(fpattern); XFER(r_pattern);
+	XFER(l_pattern); XFER(ac_pattern);
+#ifndef WITHOUT_FASTMATCH
+	XFER(fg_pattern);
+#endif
+#ifndef WITHOUT_NLS
+	XFER(catalog);
+#endif
+#undef XFER
+}
+
+static void *
+grep_worker(void *arg)
+{
+	struct grep_pool *pool = arg;
+	struct grep_job *job;
+	FILE *out, *errs;
+
+	grep_state_copy(&pool->state, false);
+
+	for (;;) {
+		pthread_mutex_lock(&pool->mtx);
+		while (pool->next == pool->tail && !pool->finished)
+			pthread_cond_wait(&pool->work, &pool->mtx);
+		if (pool->next == pool->tail) {
+			pthread_mutex_unlock(&pool->mtx);
+			break;
+		}
+		job = &pool->jobs[pool->next++ % pool->size];
+		pthread_mutex_unlock(&pool->mtx);
+
+		if ((out = open_memstream(&job->out, &job->outlen)) == NULL ||
+		    (errs = open_memstream(&job->errs, &job->errlen)) == NULL)
+			err(2, "open_memstream");
+		thread_stdout = out;
+		thread_stderr = errs;
+		file_err = false;
+
+		job->c = procfile(job->path);
+		job->file_err = file_err;
+		fclose(out);
+		fclose(errs);
+
+		pthread_mutex_lock(&pool->mtx);
+		job->done = true;
+		pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->mtx);
+	}
+	return (NULL);
+}
+
+/*
+ * Returns NULL if the search should stay on this thread: -A, -B and -C
+ * print separators depending on the previous file, -m counts across
+ * files, and matchall may exit from procfile().
+ */
+static struct grep_pool *
+grep_pool_create(void)
+{
+	struct grep_pool *pool;
+	unsigned int i;
+
+	if (njobs <= 1 || mflag || matchall || Aflag > 0 || Bflag > 0)
+		return (NULL);
+
+	pool = grep_calloc(1, sizeof(*pool));
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->size = (size_t)njobs * GREP_WINDOW;
+	pool->jobs = grep_calloc(pool->size, sizeof(struct grep_job));
+	pool->threads = grep_calloc(njobs, sizeof(pthread_t));
+	grep_state_copy(&pool->state, true);
+
+	for (i = 0; i < njobs; i++) {
+		if (pthread_create(&pool->threads[i], NULL, grep_worker,
+		    pool) != 0)
+			break;
+		pool->nthreads++;
+	}
+	if (pool->nthreads == 0) {
+		pthread_cond_destroy(&pool->done);
+		pthread_cond_destroy(&pool->work);
+		pthread_mutex_destroy(&pool->mtx);
+		free(pool->threads);
+		free(pool->jobs);
+		free(pool);
+		return (NULL);
+	}
+	return (pool);
+}
+
+/*
+ * Writes out the completed jobs at the head of the window, waiting
+ * until no more than "keep" jobs are left in flight.
+ */
+static void
+grep_pool_print(struct grep_pool *pool, size_t keep)
+{
+	struct grep_job *job;
+
+	pthread_mutex_lock(&pool->mtx);
+	while (pool->head != pool->tail) {
+		job = &pool->jobs[pool->head % pool->size];
+		if (!job->done) {
+			if (pool->tail - pool->head <= keep)
+				break;
+			pthread_cond_wait(&pool->done, &pool->mtx);
+			continue;
+		}
+		pool->head++;
+		pthread_mutex_unlock(&pool->mtx);
+
+		fwrite(job->errs, 1, job->errlen, thread_stderr);
+		fwrite(job->out, 1, job->outlen, thread_stdout);
+		pool->c += job->c;
+		if (job->file_err)
+			file_err = true;
+		free(job->path);
+		free(job->out);
+		free(job->errs);
+
+		pthread_mutex_lock(&pool->mtx);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+static void
+grep_pool_add(struct grep_pool *pool, const char *path)
+{
+	struct grep_job *job;
+
+	/* Keep one slot free; the workers never touch it */
+	grep_pool_print(pool, pool->size - 1);
+
+	job = &pool->jobs[pool->tail % pool->size];
+	memset(job, 0, sizeof(*job));
+	job->path = grep_strdup(path);
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->tail++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+static int
+grep_pool_finish(struct grep_pool *pool)
+{
+	unsigned int i;
+	int c;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->finished = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->mtx);
+
+	grep_pool_print(pool, 0);
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	c = pool->c;
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->mtx);
+	free(pool->threads);
+	free(pool->jobs);
+	free(pool);
+	return (c);
+}
+
 /*
  * Processes a directory when a recursive search is performed with
- * the -R option.  Each appropriate file is passed to procfile().
+ * the -R option.  Each appropriate file is passed to procfile(),
+ * or to the worker threads with -j.
  */
 int
 grep_tree(char **argv)
 {
 	FTS *fts;
 	FTSENT *p;
+	struct grep_pool *pool;
 	int c, fts_flags;
 	bool ok;
 
@@ -139,6 +412,7 @@ grep_tree(char **argv)
     if (!(fts = fts_open(argv, fts_flags, NULL))) {
 		err(2, "fts_open");
     }
+	pool = grep_pool_create();
 	while ((p = fts_read(fts)) != NULL) {
 		switch (p->fts_info) {
 		case FTS_DNR:
@@ -167,12 +441,18 @@ grep_tree(char **argv)
 			if (fexclude || finclude)
 				ok &= file_matching(p->fts_path);
 
-			if (ok)
-				c += procfile(p->fts_path);
+			if (ok) {
+				if (pool != NULL)
+					grep_pool_add(pool, p->fts_path);
+				else
+					c += procfile(p->fts_path);
+			}
 			break;
 		}
 	}
 
+	if (pool != NULL)
+		c += grep_pool_finish(pool);
 	fts_close(fts);
 	return (c);
 }
@@ -305,6 +585,313 @@ mbtowc_reverse(wchar_t *pwc, const char *s, size_t n)
 
 #define iswword(x)	(iswalnum((x)) || (x) == L'_')
 
+/*
+ * Finds the longest run of ordinary characters outside of any group
+ * that every match of the pattern has to contain.  There is none as
+ * soon as the pattern has an alternation.  A run followed by a
+ * quantifier loses its last character.
+ */
+static void
+literal_extract(const struct pat *p, struct litpat *lp)
+{
+	const char *s, *end, *run;
+	size_t runlen;
+	bool ere, plain, quant;
+	int depth, rundepth;
+
+	memset(lp, 0, sizeof(*lp));
+	if (p->pat == NULL || p->len == 0 || (cflags & REG_ICASE))
+		return;
+	/* REG_LITERAL, for -F */
+	if (cflags & 0020) {
+		lp->lit = p->pat;
+		lp->len = p->len;
+		lp->whole = true;
+		return;
+	}
+
+	ere = (cflags & REG_EXTENDED) != 0;
+	plain = true;
+	depth = rundepth = 0;
+	run = NULL;
+	runlen = 0;
+	for (s = p->pat, end = p->pat + p->len; s <= end; ) {
+		if (s < end && *s != '\\' && *s != '[' && *s != '.' &&
+		    *s != '*' && *s != '^' && *s != '$' && !(ere &&
+		    strchr("+?{}()|", *s) != NULL)) {
+			if (runlen++ == 0) {
+				run = s;
+				rundepth = depth;
+			}
+			s++;
+			continue;
+		}
+
+		/* End of a run of ordinary characters */
+		quant = false;
+		if (s < end) {
+			plain = false;
+			if (*s == '\\') {
+				if (++s == end || *s == '|')
+					goto none;
+				if (!ere && *s == '(')
+					depth++;
+				else if (!ere && *s == ')')
+					depth--;
+				else if (!ere && (*s == '?' || *s == '+'))
+					quant = true;
+				else if (!ere && *s == '{') {
+					quant = true;
+					while (s < end - 1 &&
+					    !(s[0] == '\\' && s[1] == '}'))
+						s++;
+					if (s == end - 1)
+						goto none;
+					s++;
+				}
+				s++;
+			} else if (*s == '[') {
+				if (++s < end && *s == '^')
+					s++;
+				if (s < end && *s == ']')
+					s++;
+				while (s < end && *s != ']') {
+					if (*s == '[' && s + 1 < end &&
+					    strchr(":.=", s[1]) != NULL) {
+						s = memchr(s + 2, ']', end - s - 2);
+						if (s == NULL)
+							goto none;
+					}
+					s++;
+				}
+				if (s == end)
+					goto none;
+				s++;
+			} else if (ere && *s == '|') {
+				goto none;
+			} else if (ere && *s == '(') {
+				depth++;
+				s++;
+			} else if (ere && *s == ')') {
+				depth--;
+				s++;
+			} else if (ere && *s == '{') {
+				quant = true;
+				if ((s = memchr(s, '}', end - s)) == NULL)
+					goto none;
+				s++;
+			} else {
+				quant = (*s == '*' || *s == '+' || *s == '?');
+				s++;
+			}
+		} else
+			s++;
+
+		if (quant && runlen > 0)
+			runlen--;
+		if (rundepth == 0 && runlen > lp->len) {
+			lp->lit = run;
+			lp->len = runlen;
+		}
+		runlen = 0;
+	}
+	lp->whole = plain;
+	return;
+
+none:
+	/* A run seen before this point is not required by the whole pattern */
+	memset(lp, 0, sizeof(*lp));
+}
+
+static int
+ac_child(const struct ac *ac, int n, unsigned char b)
+{
+	int ch;
+
+	if (n == 0)
+		return (ac->root[b]);
+	for (ch = ac->nodes[n].child; ch != 0; ch = ac->nodes[ch].sibling)
+		if (ac->nodes[ch].byte == b)
+			return (ch);
+	return (0);
+}
+
+static int
+ac_newnode(struct ac *ac, int parent, unsigned char b)
+{
+	struct acnode *np;
+	int n;
+
+	if (ac->nnodes == ac->size) {
+		ac->size *= 2;
+		ac->nodes = grep_realloc(ac->nodes,
+		    ac->size * sizeof(struct acnode));
+	}
+	n = ac->nnodes++;
+	np = &ac->nodes[n];
+	memset(np, 0, sizeof(*np));
+	np->byte = b;
+	if (parent == 0)
+		ac->root[b] = n;
+	else {
+		np->sibling = ac->nodes[parent].child;
+		ac->nodes[parent].child = n;
+	}
+	return (n);
+}
+
+static struct ac *
+ac_build(void)
+{
+	struct ac *ac;
+	const unsigned char *lit;
+	int *queue, qhead, qtail;
+	int ch, f, n, next;
+	unsigned int i;
+	size_t k;
+
+	ac = grep_calloc(1, sizeof(*ac));
+	ac->size = 256;
+	ac->nodes = grep_malloc(ac->size * sizeof(struct acnode));
+	ac->nnodes = 1;
+	memset(&ac->nodes[0], 0, sizeof(struct acnode));
+
+	for (i = 0; i < patterns; i++) {
+		lit = (const unsigned char *)l_pattern[i].lit;
+		for (n = 0, k = 0; k < l_pattern[i].len; k++) {
+			if ((next = ac_child(ac, n, lit[k])) == 0)
+				next = ac_newnode(ac, n, lit[k]);
+			n = next;
+		}
+		ac->nodes[n].match = true;
+	}
+
+	/* Failure links, breadth first */
+	queue = grep_malloc(ac->nnodes * sizeof(int));
+	qhead = qtail = 0;
+	for (k = 0; k <= UCHAR_MAX; k++)
+		if ((n = ac->root[k]) != 0)
+			queue[qtail++] = n;
+	while (qhead < qtail) {
+		n = queue[qhead++];
+		for (ch = ac->nodes[n].child; ch != 0;
+		    ch = ac->nodes[ch].sibling) {
+			f = ac->nodes[n].fail;
+			while (f != 0 && ac_child(ac, f, ac->nodes[ch].byte) == 0)
+				f = ac->nodes[f].fail;
+			ac->nodes[ch].fail = ac_child(ac, f, ac->nodes[ch].byte);
+			if (ac->nodes[ac->nodes[ch].fail].match)
+				ac->nodes[ch].match = true;
+			queue[qtail++] = ch;
+		}
+	}
+	free(queue);
+	return (ac);
+}
+
+/*
+ * Tells whether any of the patterns occurs in the buffer, in one pass.
+ */
+static bool
+ac_exec(const struct ac *ac, const char *dat, size_t len)
+{
+	const unsigned char *p, *end;
+	int n, next;
+
+	n = 0;
+	for (p = (const unsigned char *)dat, end = p + len; p < end; p++) {
+		while ((next = ac_child(ac, n, *p)) == 0 && n != 0)
+			n = ac->nodes[n].fail;
+		n = next;
+		if (ac->nodes[n].match)
+			return (true);
+	}
+	return (false);
+}
+
+/*
+ * Looks for the required literals of the patterns, once they are
+ * compiled.  When all of them are plain literals, as with fgrep -f,
+ * they are also merged into one automaton.
+ */
+void
+literal_init(void)
+{
+	unsigned int i;
+	bool all;
+
+	l_pattern = grep_calloc(patterns, sizeof(*l_pattern));
+	ac_pattern = NULL;
+	if (matchall)
+		return;
+	all = true;
+	for (i = 0; i < patterns; i++) {
+		literal_extract(&pattern[i], &l_pattern[i]);
+		all &= l_pattern[i].whole;
+	}
+	if (all && patterns > 1)
+		ac_pattern = ac_build();
+}
+
+/*
+ * Searches the part of the line given by pmatch for the literal of a
+ * pattern; memchr() does the scanning.  Returns REG_NOMATCH when the
+ * literal is absent, 0 with pmatch set when the pattern is just the
+ * literal, and -1 when regexec() has to decide.
+ */
+static int
+litexec(const struct litpat *lp, const char *dat, regmatch_t *pmatch)
+{
+	const char *p, *last;
+
+	if (lp->lit == NULL)
+		return (-1);
+	if ((size_t)(pmatch->rm_eo - pmatch->rm_so) < lp->len)
+		return (REG_NOMATCH);
+
+	p = dat + pmatch->rm_so;
+	last = dat + pmatch->rm_eo - lp->len;
+	for (; p <= last; p++) {
+		p = memchr(p, lp->lit[0], last - p + 1);
+		if (p == NULL)
+			return (REG_NOMATCH);
+		if (memcmp(p + 1, lp->lit + 1, lp->len - 1) == 0)
+			break;
+	}
+	if (p > last)
+		return (REG_NOMATCH);
+	if (!lp->whole)
+		return (-1);
+	pmatch->rm_so = p - dat;
+	pmatch->rm_eo = pmatch->rm_so + lp->len;
+	return (0);
+}
+
+#ifdef __APPLE__
+static pthread_once_t	 c_locale_once = PTHREAD_ONCE_INIT;
+static locale_t		 c_locale_loc;
+
+static void
+c_locale_init(void)
+{
+
+	c_locale_loc = newlocale(LC_ALL_MASK, "C", NULL);
+}
+
+/*
+ * The C locale, for binary files.  uselocale() only affects the calling
+ * thread, where setlocale() would also switch the other -j workers and
+ * the other commands running in the process.
+ */
+static locale_t
+c_locale(void)
+{
+
+	pthread_once(&c_locale_once, c_locale_init);
+	return (c_locale_loc);
+}
+#endif
+
 /*
  * Processes a line comparing it with the specified patterns.  Each pattern
  * is looped to be compared along with the full string, saving each and every
@@ -325,6 +912,9 @@ procline(struct str *l, int nottext)
 	size_t st = 0;
 	unsigned int i;
 	int c = 0, m = 0, r = 0;
+#ifdef __APPLE__
+	locale_t oldloc = NULL;
+#endif
 
 #ifdef __APPLE__
 	nmatches = MIN_LINE_MATCHES;
@@ -343,12 +933,28 @@ procline(struct str *l, int nottext)
 		pmatch.rm_so = st;
 		pmatch.rm_eo = l->len;
 
+		/*
+		 * With only literals, one pass over the line rejects it, or
+		 * accepts it if the match itself does not matter.
+		 */
+		i = 0;
+		if (ac_pattern != NULL && st == 0) {
+			if (!ac_exec(ac_pattern, l->dat, l->len)) {
+				r = REG_NOMATCH;
+				i = patterns;
+			} else if (!wflag && !xflag &&
+			    ((color == NULL && !oflag) || qflag || lflag)) {
+				c = 1;
+				i = patterns;
+			}
+		}
+
 		/* Loop to compare with all the patterns */
-		for (i = 0; i < patterns; i++) {
+		for (; i < patterns; i++) {
 #ifdef __APPLE__
 			/* 10462853: Treat binary files as binary. */
 			if (nottext) {
-				setlocale(LC_ALL, "C");
+				oldloc = uselocale(c_locale());
 			}
 #endif /* __APPLE__ */
 #ifndef WITHOUT_FASTMATCH
@@ -357,11 +963,12 @@ procline(struct str *l, int nottext)
 				    l->dat, 1, &pmatch, eflags);
 			else
 #endif
+			if ((r = litexec(&l_pattern[i], l->dat, &pmatch)) < 0)
 				r = regexec(&r_pattern[i], l->dat, 1,
 				    &pmatch, eflags);
 #ifdef __APPLE__
 			if (nottext) {
-				setlocale(LC_ALL, "");
+				uselocale(oldloc);
 			}
 #endif /* __APPLE__ */
 			r = (r == 0) ? 0 : REG_NOMATCH;
@@ -386,7 +993,7 @@ procline(struct str *l, int nottext)
 				wbegin = wend = L' ';
 				if (pmatch.rm_so != 0 &&
 #ifdef __APPLE__
-				    mbtowc_reverse(&wbegin, &l->dat[pmatch.rm_so], MAX(MB_CUR_MAX, pmatch.rm_so)) == -1)
+				    mbtowc_reverse(&wbegin, &l->dat[pmatch.rm_so], MIN(MB_CUR_MAX, pmatch.rm_so)) == -1)
 #else
 				    sscanf(&l->dat[pmatch.rm_so - 1],
 				    "%lc", &wbegin) != 1)
@@ -395,7 +1002,7 @@ procline(struct str *l, int nottext)
 				else if ((size_t)pmatch.rm_eo !=
 				    l->len &&
 #ifdef __APPLE__
-				    mbtowc(&wend, &l->dat[pmatch.rm_eo], MAX(MB_CUR_MAX, l->len - (size_t)pmatch.rm_eo)) == -1)
+				    mbtowc(&wend, &l->dat[pmatch.rm_eo], MIN(MB_CUR_MAX, l->len - (size_t)pmatch.rm_eo)) == -1)
 #else
 				    sscanf(&l->dat[pmatch.rm_eo],
 				    "%lc", &wend) != 1)
@@ -62,6 +62,8 @@ __FBSDID("$FreeBSD: src/usr.bin/join/join.c,v 1.20 2004/08/26 06:28:05 maxim Exp
 #include <wchar.h>
 #include <sysexits.h>
 
+#include "../common/linebuf.h"
+
 #ifdef __APPLE__
 #include "get_compat.h"
 #else
@@ -93,6 +95,7 @@ typedef struct {
 	u_long pushback;	/* line on the stack */
 	u_long setcnt;		/* set count */
 	u_long setalloc;	/* set allocated count */
+	struct linebuf lb;	/* line reader for fp */
 } INPUT;
 INPUT input1 = { NULL, 0, 0, 1, NULL, 0, 0, 0, 0 },
       input2 = { NULL, 0, 0, 2, NULL, 0, 0, 0, 0 };
@@ -331,7 +334,9 @@ slurp(INPUT *F)
 			F->pushbool = 0;
 			continue;
 		}
-		if ((bp = fgetln(F->fp, &len)) == NULL) {
+		if (F->lb.lb_fp != F->fp)
+			linebuf_init(&F->lb, F->fp);
+		if ((bp = linebuf_get(&F->lb, &len)) == NULL) {
 			if (ferror(F->fp)) {
 				err(EX_IOERR, NULL);
 			}
@@ -65,6 +65,7 @@ __FBSDID("$FreeBSD: src/usr.bin/look/look.c,v 1.18.10.2.4.1 2010/06/14 02:09:06
 #include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -89,6 +90,11 @@ int      look(wchar_t *, unsigned char *, unsigned char *);
 wchar_t	*prepkey(const char *, wchar_t);
 void     print_from(wchar_t *, unsigned char *, unsigned char *);
 
+static unsigned char *gallop_search(wchar_t *, unsigned char *, unsigned char *);
+static int	 look_keys(wchar_t **, size_t, unsigned char *, unsigned char *);
+static unsigned char *map_file(int, struct stat *);
+static wchar_t	**read_keys(const char *, wchar_t, size_t *);
+static void	 unmap_file(unsigned char *, size_t);
 static void usage(void);
 
 int
@@ -99,13 +105,16 @@ main(int argc, char *argv[])
 	wchar_t termchar;
 	unsigned char *back, *front;
 	unsigned const char *file;
-	wchar_t *key;
+	const char *keyfile;
+	wchar_t *key, **keys;
+	size_t nkeys;
 
 	(void) setlocale(LC_CTYPE, "");
 
 	file = _path_words;
 	termchar = L'\0';
-	while ((ch = getopt(argc, argv, "dft:")) != -1)
+	keyfile = NULL;
+	while ((ch = getopt(argc, argv, "dfk:t:")) != -1)
 		switch(ch) {
 		case 'd':
 			dflag = 1;
@@ -113,6 +122,9 @@ main(int argc, char *argv[])
 		case 'f':
 			fflag = 1;
 			break;
+		case 'k':
+			keyfile = optarg;
+			break;
 		case 't':
 			if (mbrtowc(&termchar, optarg, MB_LEN_MAX, NULL) !=
 			    strlen(optarg))
@@ -125,17 +137,27 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	key = NULL;
+	keys = NULL;
+	nkeys = 0;
+	if (keyfile != NULL) {
+		if (argc == 0)		/* Default to -df, as below. */
+			dflag = fflag = 1;
+		keys = read_keys(keyfile, termchar, &nkeys);
+	} else {
 /* 4384130 */
 #ifdef __APPLE__
-	if (argc <= 0)
+		if (argc <= 0)
 #else
-	if (argc == 0)
+		if (argc == 0)
 #endif
-		usage();
-	if (argc == 1) 			/* But set -df by default. */
-		dflag = fflag = 1;
-	key = prepkey(*argv++, termchar);
-	if (argc >= 2)
+			usage();
+		if (argc == 1) 		/* But set -df by default. */
+			dflag = fflag = 1;
+		key = prepkey(*argv++, termchar);
+		argc--;
+	}
+	if (argc >= 1)
 		file = *argv++;
 
 	match = 1;
@@ -149,12 +171,16 @@ main(int argc, char *argv[])
 			close(fd);
 			continue;
 		}
-		if ((front = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, (off_t)0)) == MAP_FAILED)
+		if ((front = map_file(fd, &sb)) == NULL)
 			err(2, "%s", file);
 		back = front + sb.st_size;
-		match *= (look(key, front, back));
+		if (keys != NULL)
+			match *= look_keys(keys, nkeys, front, back);
+		else
+			match *= (look(key, front, back));
+		unmap_file(front, (size_t)sb.st_size);
 		close(fd);
-	} while (argc-- > 2 && (file = *argv++));
+	} while (argc-- > 1 && (file = *argv++));
 
 	exit(match);
 }
@@ -190,6 +216,91 @@ prepkey(const char *string, wchar_t termchar)
 	return (key);
 }
 
+/*
+ * The keys of -k, one per line, prepared as prepkey() does and sorted in
+ * the order of compare(), without duplicates.  Empty lines are skipped.
+ */
+static int
+compare_keys(const void *a, const void *b)
+{
+
+	return (wcscmp(*(wchar_t * const *)a, *(wchar_t * const *)b));
+}
+
+static wchar_t **
+read_keys(const char *path, wchar_t termchar, size_t *nkeys)
+{
+	FILE *fp;
+	wchar_t **keys, **larger;
+	char *line;
+	size_t cap, n, i, linecap;
+	ssize_t len;
+
+	if (strcmp(path, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(path, "r")) == NULL)
+		err(2, "%s", path);
+	keys = NULL;
+	line = NULL;
+	linecap = 0;
+	cap = n = 0;
+	while ((len = getline(&line, &linecap, fp)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+		if (n == cap) {
+			cap = cap ? cap * 2 : 64;
+			if ((larger = realloc(keys, cap * sizeof(*keys))) == NULL)
+				err(2, NULL);
+			keys = larger;
+		}
+		keys[n++] = prepkey(line, termchar);
+	}
+	if (ferror(fp))
+		err(2, "%s", path);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	if (n == 0)
+		errx(2, "%s: no keys", path);
+
+	qsort(keys, n, sizeof(*keys), compare_keys);
+	for (i = 1, cap = 1; i < n; i++) {
+		if (wcscmp(keys[cap - 1], keys[i]) == 0)
+			free(keys[i]);
+		else
+			keys[cap++] = keys[i];
+	}
+	*nkeys = cap;
+	return (keys);
+}
+
+/*
+ * Look up the sorted keys in one pass over the file.  The first line not
+ * less than a key is never before the one of the previous key, so each
+ * search starts there, and gallops forward before the binary search: a
+ * batch of nearby keys only touches the pages around them.  The lines
+ * matching each key are printed in the order of the keys.
+ */
+static int
+look_keys(wchar_t **keys, size_t nkeys, unsigned char *front,
+    unsigned char *back)
+{
+	size_t i;
+	int match;
+
+	match = 1;
+	for (i = 0; i < nkeys && front < back; i++) {
+		front = gallop_search(keys[i], front, back);
+		if (front < back && compare(keys[i], front, back) == EQUAL) {
+			print_from(keys[i], front, back);
+			match = 0;
+		}
+	}
+	return (match);
+}
+
 int
 look(wchar_t *string, unsigned char *front, unsigned char *back)
 {
@@ -267,6 +378,37 @@ binary_search(wchar_t *string, unsigned char *front, unsigned char *back)
 	return (front);
 }
 
+/*
+ * Return the first line at or after front that is not less than string
+ * (back if there is none), front being the start of a line before it.
+ *
+ * Lines at front + 4k, 8k, 16k... are compared until one is not less than
+ * string; the line is between the last two, where binary_search() and a
+ * linear search find it.
+ */
+#define	GALLOP_STEP	4096
+
+static unsigned char *
+gallop_search(wchar_t *string, unsigned char *front, unsigned char *back)
+{
+	unsigned char *p;
+	size_t step;
+
+	for (step = GALLOP_STEP; (size_t)(back - front) > step; step *= 2) {
+		p = front + step;
+		SKIP_PAST_NEWLINE(p, back);
+		if (p >= back || compare(string, p, back) != GREATER) {
+			back = p;
+			break;
+		}
+		front = p;
+	}
+	front = (unsigned char *)binary_search(string, front, back);
+	while (front < back && compare(string, front, back) == GREATER)
+		SKIP_PAST_NEWLINE(front, back);
+	return (front);
+}
+
 /*
  * Find the first line that starts with string, linearly searching from front
  * to back.
@@ -349,9 +491,71 @@ compare(wchar_t *s1, unsigned char *s2, unsigned char *back)
 	return (*s1 ? GREATER : EQUAL);
 }
 
+/*
+ * The last file looked in stays mapped: a host that runs look many times
+ * in the same process (ios_system) doesn't map the dictionary and fault
+ * its pages in again for every word.  The mapping is replaced when the
+ * file changes, or another one is looked in, once no thread uses it.
+ */
+static struct {
+	dev_t		 dev;
+	ino_t		 ino;
+	off_t		 size;
+	time_t		 mtime;
+	unsigned char	*front;
+	int		 users;
+} mapped;
+static pthread_mutex_t mapped_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char *
+map_file(int fd, struct stat *sb)
+{
+	unsigned char *front;
+
+	pthread_mutex_lock(&mapped_lock);
+	if (mapped.front != NULL && mapped.dev == sb->st_dev &&
+	    mapped.ino == sb->st_ino && mapped.size == sb->st_size &&
+	    mapped.mtime == sb->st_mtime) {
+		mapped.users++;
+		front = mapped.front;
+		pthread_mutex_unlock(&mapped_lock);
+		return (front);
+	}
+	if ((front = mmap(NULL, (size_t)sb->st_size, PROT_READ, MAP_SHARED, fd,
+	    (off_t)0)) == MAP_FAILED) {
+		pthread_mutex_unlock(&mapped_lock);
+		return (NULL);
+	}
+	if (mapped.users == 0) {
+		if (mapped.front != NULL)
+			munmap(mapped.front, (size_t)mapped.size);
+		mapped.dev = sb->st_dev;
+		mapped.ino = sb->st_ino;
+		mapped.size = sb->st_size;
+		mapped.mtime = sb->st_mtime;
+		mapped.front = front;
+		mapped.users = 1;
+	}
+	pthread_mutex_unlock(&mapped_lock);
+	return (front);
+}
+
+static void
+unmap_file(unsigned char *front, size_t size)
+{
+
+	pthread_mutex_lock(&mapped_lock);
+	if (front == mapped.front)
+		mapped.users--;
+	else
+		munmap(front, size);
+	pthread_mutex_unlock(&mapped_lock);
+}
+
 static void
 usage(void)
 {
-	(void)fprintf(stderr, "usage: look [-df] [-t char] string [file ...]\n");
+	(void)fprintf(stderr, "usage: look [-df] [-t char] string [file ...]\n"
+	    "       look [-df] [-t char] -k keyfile [file ...]\n");
 	exit(2);
 }
@@ -19,6 +19,10 @@ int ios_CCDigestInit(ios_CCDigestAlgorithm alg, ios_CCDigestRef ctx) {
       return CC_SHA1_Init(&ctx->ctx);
     case kCCDigestSHA256:
       return CC_SHA256_Init(&ctx->ctx);
+    case kCCDigestSHA384:
+      return CC_SHA384_Init(&ctx->ctx);
+    case kCCDigestSHA512:
+      return CC_SHA512_Init(&ctx->ctx);
     default:
       return 0;
   }
@@ -32,6 +36,10 @@ int ios_CCDigestFinal(ios_CCDigestRef ctx, unsigned char *md) {
       return CC_SHA1_Final(md, &ctx->ctx);
     case kCCDigestSHA256:
       return CC_SHA256_Final(md, &ctx->ctx);
+    case kCCDigestSHA384:
+      return CC_SHA384_Final(md, &ctx->ctx);
+    case kCCDigestSHA512:
+      return CC_SHA512_Final(md, &ctx->ctx);
     default:
       return -1;
   }
@@ -45,6 +53,10 @@ int ios_CCDigestUpdate(ios_CCDigestRef ctx, const void *data, size_t len) {
       return CC_SHA1_Update(&ctx->ctx, data, len);
     case kCCDigestSHA256:
       return CC_SHA256_Update(&ctx->ctx, data, len);
+    case kCCDigestSHA384:
+      return CC_SHA384_Update(&ctx->ctx, data, len);
+    case kCCDigestSHA512:
+      return CC_SHA512_Update(&ctx->ctx, data, len);
     default:
       return -1;
   }
@@ -58,6 +70,10 @@ size_t ios_CCDigestOutputSize(ios_CCDigestRef ctx) {
       return CC_SHA1_DIGEST_LENGTH;
     case kCCDigestSHA256:
       return CC_SHA256_DIGEST_LENGTH;
+    case kCCDigestSHA384:
+      return CC_SHA384_DIGEST_LENGTH;
+    case kCCDigestSHA512:
+      return CC_SHA512_DIGEST_LENGTH;
     default:
       return 0;
   }
@@ -67,11 +83,15 @@ char *
 Digest_End(ios_CCDigestRef ctx, char *buf)
 {
 	static const char hex[] = "0123456789abcdef";
-	uint8_t digest[32]; // SHA256 is the biggest
+	uint8_t digest[CC_SHA512_DIGEST_LENGTH]; // SHA512 is the biggest
 	size_t i, length;
+	int ret;
 
 //  (void)os_assumes_zero(CCDigestFinal(ctx, digest));
-  assert(ios_CCDigestFinal(ctx, digest) == 1);
+  // not inside assert(), which compiles to nothing with NDEBUG
+  ret = ios_CCDigestFinal(ctx, digest);
+  assert(ret == 1);
+  (void)ret;
 	length = ios_CCDigestOutputSize(ctx);
 	//os_assert(length <= sizeof(digest));
   assert(length <= sizeof(digest));
@@ -88,11 +108,15 @@ char *
 Digest_Data(ios_CCDigestAlg algorithm, const void *data, size_t len, char *buf)
 {
 	ios_CCDigestCtx ctx;
+	int ret;
 
 //  (void)os_assumes_zero(CCDigestInit(algorithm, &ctx));
-  assert(ios_CCDigestInit(algorithm, &ctx) == 1);
+  ret = ios_CCDigestInit(algorithm, &ctx);
+  assert(ret == 1);
 //  (void)os_assumes_zero(CCDigestUpdate(&ctx, data, len));
-  assert(ios_CCDigestUpdate(&ctx, data, len));
+  ret = ios_CCDigestUpdate(&ctx, data, len);
+  assert(ret == 1);
+  (void)ret;
 	return Digest_End(&ctx, buf);
 }
 
@@ -100,6 +124,22 @@ char *
 Digest_File(ios_CCDigestAlg algorithm, const char *filename, char *buf)
 {
 	int fd;
+
+	/* dispatch_io_create_with_path requires an absolute path */
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	return Digest_Fd(algorithm, fd, buf);
+}
+
+/*
+ * Digests fd from its offset to the end of the file, and closes it.
+ */
+char *
+Digest_Fd(ios_CCDigestAlg algorithm, int fd, char *buf)
+{
 	__block ios_CCDigestCtx ctx;
 	dispatch_queue_t queue;
 	dispatch_semaphore_t sema;
@@ -107,17 +147,14 @@ Digest_File(ios_CCDigestAlg algorithm, const char *filename, char *buf)
 	__block int s_error = 0;
 	__block bool eof = false;
 	off_t chunk_offset;
-
-	/* dispatch_io_create_with_path requires an absolute path */
-	fd = open(filename, O_RDONLY);
-	if (fd < 0) {
-		return NULL;
-	}
+	int ret;
 
 	(void)fcntl(fd, F_NOCACHE, 1);
 
 //  (void)os_assumes_zero(CCDigestInit(algorithm, &ctx));
-  assert(ios_CCDigestInit(algorithm, &ctx) == 1);
+  ret = ios_CCDigestInit(algorithm, &ctx);
+  assert(ret == 1);
+  (void)ret;
 
 	queue = dispatch_queue_create("com.apple.mtree.io", NULL);
 //  os_assert(queue);
@@ -140,7 +177,9 @@ Digest_File(ios_CCDigestAlg algorithm, const char *filename, char *buf)
 			if (data != NULL) {
 				(void)dispatch_data_apply(data, ^(__unused dispatch_data_t region, __unused size_t offset, const void *buffer, size_t size) {
 //          (void)os_assumes_zero(CCDigestUpdate(&ctx, buffer, size));
-          assert(ios_CCDigestUpdate(&ctx, buffer, size) == 1);
+          int uret = ios_CCDigestUpdate(&ctx, buffer, size);
+          assert(uret == 1);
+          (void)uret;
 					return (bool)true;
 				});
 			}
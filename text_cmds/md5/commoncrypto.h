@@ -14,8 +14,8 @@ enum {
   kCCDigestSHA1        = 8,
 //  kCCDigestSHA224        = 9,
   kCCDigestSHA256        = 10,
-//  kCCDigestSHA384        = 11,
-//  kCCDigestSHA512        = 12,
+  kCCDigestSHA384        = 11,
+  kCCDigestSHA512        = 12,
 //  kCCDigestSkein128      = 13,
 //  kCCDigestSkein160      = 14,
 //  kCCDigestSkein224      = 16,
@@ -31,6 +31,7 @@ typedef union {
   CC_MD5_CTX md5;
   CC_SHA1_CTX sha1;
   CC_SHA256_CTX sha256;
+  CC_SHA512_CTX sha512; // also SHA384
 //  RIPEMD160_CTX ripemd160;
 } _DIGEST_CTX;
 
@@ -43,9 +44,11 @@ typedef struct ios_CCDigestCtx_t {
 int ios_CCDigestInit(ios_CCDigestAlgorithm alg, ios_CCDigestRef ctx);
 int ios_CCDigestFinal(ios_CCDigestRef ctx, unsigned char *md);
 int ios_CCDigestUpdate(ios_CCDigestRef ctx, const void *data, size_t len);
+size_t ios_CCDigestOutputSize(ios_CCDigestRef ctx);
 
 char *Digest_End(ios_CCDigestRef, char *);
 
 char *Digest_Data(ios_CCDigestAlg, const void *, size_t, char *);
 
 char *Digest_File(ios_CCDigestAlg, const char *, char *);
+char *Digest_Fd(ios_CCDigestAlg, int, char *);
@@ -21,9 +21,12 @@
 __FBSDID("$FreeBSD: src/sbin/md5/md5.c,v 1.34 2005/03/09 19:23:04 cperciva Exp $");
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #ifndef __APPLE__
 #include <md5.h>
 #include <ripemd.h>
@@ -39,6 +42,7 @@ __FBSDID("$FreeBSD: src/sbin/md5/md5.c,v 1.34 2005/03/09 19:23:04 cperciva Exp $
 #include "ios_error.h"
 
 #ifdef __APPLE__
+#include <dispatch/dispatch.h>
 #include "commoncrypto.h"
 #endif /* __APPLE__ */
 
@@ -49,12 +53,18 @@ __FBSDID("$FreeBSD: src/sbin/md5/md5.c,v 1.34 2005/03/09 19:23:04 cperciva Exp $
 #define TEST_BLOCK_COUNT 100000
 #define MDTESTCOUNT 8
 
+/*
+ * Size of the read buffer for the standard input.
+ */
+#define FILTER_BUFSIZ (1024 * 1024)
+
 //int qflag;
 __thread int md5_qflag;
 //int rflag;
 __thread int md5_rflag;
 //int sflag;
 __thread int md5_sflag;
+__thread int md5_Nflag;
 
 typedef void (DIGEST_Init)(void *);
 typedef void (DIGEST_Update)(void *, const unsigned char *, size_t);
@@ -63,6 +73,8 @@ typedef char *(DIGEST_End)(void *, char *);
 extern const char *MD5TestOutput[MDTESTCOUNT];
 extern const char *SHA1_TestOutput[MDTESTCOUNT];
 extern const char *SHA256_TestOutput[MDTESTCOUNT];
+extern const char *SHA384_TestOutput[MDTESTCOUNT];
+extern const char *SHA512_TestOutput[MDTESTCOUNT];
 extern const char *RIPEMD160_TestOutput[MDTESTCOUNT];
 
 typedef struct Algorithm_t {
@@ -87,6 +99,11 @@ static void MDString(Algorithm_t *, const char *);
 static void MDTimeTrial(Algorithm_t *);
 static void MDTestSuite(Algorithm_t *);
 static void MDFilter(Algorithm_t *, int);
+static void MDPrint(Algorithm_t *, const char *, const char *);
+static int MDFiles(Algorithm_t *, char **, long);
+#ifdef __APPLE__
+static char *MDFile(Algorithm_t *, const char *, char *, int);
+#endif /* __APPLE__ */
 static void usage(Algorithm_t *);
 
 
@@ -102,8 +119,8 @@ typedef union {
 #endif /* __APPLE__ */
 
 /* max(MD5_DIGEST_LENGTH, SHA_DIGEST_LENGTH, 
-	SHA256_DIGEST_LENGTH, RIPEMD160_DIGEST_LENGTH)*2+1 */
-#define HEX_DIGEST_LENGTH 65
+	SHA256_DIGEST_LENGTH, SHA512_DIGEST_LENGTH, RIPEMD160_DIGEST_LENGTH)*2+1 */
+#define HEX_DIGEST_LENGTH 129
 
 /* algorithm function table */
 
@@ -112,6 +129,8 @@ struct Algorithm_t Algorithm[] = {
 	{ "md5", "MD5", &MD5TestOutput, kCCDigestMD5, },
 	{ "sha1", "SHA1", &SHA1_TestOutput, kCCDigestSHA1 },
 	{ "sha256", "SHA256", &SHA256_TestOutput, kCCDigestSHA256 },
+	{ "sha384", "SHA384", &SHA384_TestOutput, kCCDigestSHA384 },
+	{ "sha512", "SHA512", &SHA512_TestOutput, kCCDigestSHA512 },
 //  { "rmd160", "RMD160", &RIPEMD160_TestOutput, kCCDigestRMD160 },
 #else
 	{ "md5", "MD5", &MD5TestOutput, (DIGEST_Init*)&MD5Init,
@@ -153,6 +172,7 @@ md5_main(int argc, char *argv[])
 	char   *p;
 	char	buf[HEX_DIGEST_LENGTH];
 	int     failed=0;
+	long	njobs=1;
  	unsigned	digest=0;
  	const char*	progname;
  
@@ -170,8 +190,17 @@ md5_main(int argc, char *argv[])
 	    digest = 0;
 	}
 
-	while ((ch = getopt(argc, argv, "pqrs:tx")) != -1)
+	md5_Nflag = 0;
+	while ((ch = getopt(argc, argv, "j:Npqrs:tx")) != -1)
 		switch (ch) {
+		case 'j':
+			njobs = strtol(optarg, &p, 10);
+			if (*p != '\0' || njobs < 1)
+				errx(1, "invalid number of jobs: %s", optarg);
+			break;
+		case 'N':
+			md5_Nflag = 1;
+			break;
 		case 'p':
 			MDFilter(&Algorithm[digest], 1);
 			break;
@@ -201,26 +230,7 @@ md5_main(int argc, char *argv[])
 	argv += optind;
 
 	if (*argv) {
-		do {
-#ifdef __APPLE__
-			p = Digest_File(Algorithm[digest].algorithm, *argv, buf);
-#else
-			p = Algorithm[digest].File(*argv, buf);
-#endif
-			if (!p) {
-				warn("%s", *argv);
-				failed++;
-			} else {
-				//if (qflag)
-        if (md5_qflag)
-					printf("%s\n", p);
-        //else if (rflag)
-        else if (md5_rflag)
-					printf("%s %s\n", p, *argv);
-				else
-					printf("%s (%s) = %s\n", Algorithm[digest].name, *argv, p);
-			}
-		} while (*++argv);
+		failed = MDFiles(&Algorithm[digest], argv, njobs);
 	//} else if (!sflag && (optind == 1 || qflag || rflag))
   } else if (!md5_sflag && (optind == 1 || md5_qflag || md5_rflag))
 		MDFilter(&Algorithm[digest], 0);
@@ -230,6 +240,125 @@ md5_main(int argc, char *argv[])
  
 	return (0);
 }
+/*
+ * Prints the digest of a file.
+ */
+static void
+MDPrint(Algorithm_t *alg, const char *name, const char *p)
+{
+	//if (qflag)
+  if (md5_qflag)
+		printf("%s\n", p);
+  //else if (rflag)
+  else if (md5_rflag)
+		printf("%s %s\n", p, name);
+	else
+		printf("%s (%s) = %s\n", alg->name, name, p);
+}
+
+/*
+ * Digests the files and prints the results, in the order of the
+ * arguments.  With -j, up to njobs files are read and digested at the
+ * same time.  Returns the number of files that could not be read.
+ */
+static int
+MDFiles(Algorithm_t *alg, char **argv, long njobs)
+{
+	char buf[HEX_DIGEST_LENGTH];
+	char *p;
+	int failed = 0;
+#ifdef __APPLE__
+	/* md5_Nflag is per thread: the workers get it from here */
+	int cache = !md5_Nflag;
+	struct MDJob {
+		char buf[HEX_DIGEST_LENGTH];
+		char *p;
+		int error;
+		dispatch_semaphore_t done;
+	} *jobs;
+	dispatch_queue_t queue;
+	size_t head, next, nfiles;
+
+	if (njobs > 1) {
+		for (nfiles = 0; argv[nfiles] != NULL; nfiles++)
+			;
+		if ((jobs = calloc(nfiles, sizeof(*jobs))) == NULL)
+			err(1, NULL);
+		queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+		for (head = next = 0; head < nfiles; head++) {
+			/* Keep up to njobs files in flight ahead of the printing */
+			for (; next < nfiles && next - head < (size_t)njobs; next++) {
+				struct MDJob *job = &jobs[next];
+				const char *name = argv[next];
+
+				job->done = dispatch_semaphore_create(0);
+				dispatch_async(queue, ^{
+					job->p = MDFile(alg, name, job->buf, cache);
+					job->error = errno;
+					dispatch_semaphore_signal(job->done);
+				});
+			}
+			dispatch_semaphore_wait(jobs[head].done, DISPATCH_TIME_FOREVER);
+			dispatch_release(jobs[head].done);
+			if (jobs[head].p == NULL) {
+				errno = jobs[head].error;
+				warn("%s", argv[head]);
+				failed++;
+			} else
+				MDPrint(alg, argv[head], jobs[head].p);
+		}
+		free(jobs);
+		return (failed);
+	}
+#endif /* __APPLE__ */
+
+	do {
+#ifdef __APPLE__
+		p = MDFile(alg, *argv, buf, cache);
+#else
+		p = alg->File(*argv, buf);
+#endif
+		if (!p) {
+			warn("%s", *argv);
+			failed++;
+		} else
+			MDPrint(alg, *argv, p);
+	} while (*++argv);
+	return (failed);
+}
+
+#ifdef __APPLE__
+/*
+ * Digests a file, or takes its digest from the cache of ios_system when
+ * the file hasn't changed since it was stored there.
+ */
+static char *
+MDFile(Algorithm_t *alg, const char *name, char *buf, int cache)
+{
+	struct stat st;
+	int fd, dfd, error;
+
+	if (!cache)
+		return (Digest_File(alg->algorithm, name, buf));
+	if ((fd = open(name, O_RDONLY)) < 0)
+		return (NULL);
+	if (ios_getCachedDigest(fd, alg->progname, buf, HEX_DIGEST_LENGTH,
+	    &st) == NULL) {
+		/* Digest_Fd() closes the descriptor it is given */
+		if ((dfd = dup(fd)) < 0 ||
+		    Digest_Fd(alg->algorithm, dfd, buf) == NULL) {
+			error = errno;
+			(void)close(fd);
+			errno = error;
+			return (NULL);
+		}
+		ios_setCachedDigest(fd, alg->progname, buf, &st);
+	}
+	(void)close(fd);
+	return (buf);
+}
+#endif /* __APPLE__ */
+
 /*
  * Digests a string and prints the result.
  */
@@ -356,6 +485,28 @@ const char *SHA256_TestOutput[MDTESTCOUNT] = {
 	"e6eae09f10ad4122a0e2a4075761d185a272ebd9f5aa489e998ff2f09cbfdd9f"
 };
 
+const char *SHA384_TestOutput[MDTESTCOUNT] = {
+	"38b060a751ac96384cd9327eb1b1e36a21fdb71114be07434c0cc7bf63f6e1da274edebfe76f65fbd51ad2f14898b95b",
+	"54a59b9f22b0b80880d8427e548b7c23abd873486e1f035dce9cd697e85175033caa88e6d57bc35efae0b5afd3145f31",
+	"cb00753f45a35e8bb5a03d699ac65007272c32ab0eded1631a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7",
+	"473ed35167ec1f5d8e550368a3db39be54639f828868e9454c239fc8b52e3c61dbd0d8b4de1390c256dcbb5d5fd99cd5",
+	"feb67349df3db6f5924815d6c3dc133f091809213731fe5c7b5f4999e463479ff2877f5f2936fa63bb43784b12f3ebb4",
+	"1761336e3f7cbfe51deb137f026f89e01a448e3b1fafa64039c1464ee8732f11a5341a6f41e0c202294736ed64db1a84",
+	"b12932b0627d1c060942f5447764155655bd4da0c9afa6dd9b9ef53129af1b8fb0195996d2de9ca0df9d821ffee67026",
+	"99428d401bf4abcd4ee0695248c9858b7503853acfae21a9cffa7855f46d1395ef38596fcd06d5a8c32d41a839cc5dfb"
+};
+
+const char *SHA512_TestOutput[MDTESTCOUNT] = {
+	"cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e",
+	"1f40fc92da241694750979ee6cf582f2d5d7d28e18335de05abc54d0560e0f5302860c652bf08d560252aa5e74210546f369fbbbce8c12cfc7957b2652fe9a75",
+	"ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f",
+	"107dbf389d9e9f71a3a95f6c055b9251bc5268c2be16d6c13492ea45b0199f3309e16455ab1e96118e8a905d5597b72038ddb372a89826046de66687bb420e7c",
+	"4dbff86cc2ca1bae1e16468a05cb9881c97f1753bce3619034898faa1aabe429955a1bf8ec483d7421fe3c1646613a59ed5441fb0f321389f77f48a879c7b1f1",
+	"1e07be23c26a86ea37ea810c8ec7809352515a970e9253c26f536cfc7a9996c45c8370583e0a78fa4a90041d71a4ceab7423f19c71b9d5a3e01249f0bebd5894",
+	"72ec1ef1124a45b047e8b7c75a932195135bb61de24ec0d1914042246e0aec3a2354e093d76f3048b456764346900cb130d2a4fd5dd16abb5e30bcb850dee843",
+	"e8a835195e039708b13d9131e025f4441dbdc521ce625f245a436dcd762f54bf5cb298d96235e6c6a304e087ec8189b9512cbdf6427737ea82793460c367b9c3"
+};
+
 const char *RIPEMD160_TestOutput[MDTESTCOUNT] = {
 	"9c1185a5c5e9fc54612808977ee8f548b2258d31",
 	"0bdc9d2d256b3ee9daae347be6f4dc835a467ffe",
@@ -395,16 +546,41 @@ static void
 MDFilter(Algorithm_t *alg, int tee)
 {
 	DIGEST_CTX context;
-	unsigned int len;
-	unsigned char buffer[BUFSIZ];
+	size_t len;
+	unsigned char *buffer;
 	char buf[HEX_DIGEST_LENGTH];
+#ifdef __APPLE__
+	struct stat st;
+	off_t start;
+	char *p;
+	int fd;
+
+	/*
+	 * md5 < file: read the file like a named one, from where the
+	 * stream is, instead of through stdio.
+	 */
+	if (!tee && (fd = fileno(thread_stdin)) >= 0 &&
+	    fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    (start = ftello(thread_stdin)) >= 0 &&
+	    lseek(fd, start, SEEK_SET) == start && (fd = dup(fd)) >= 0) {
+		if ((p = Digest_Fd(alg->algorithm, fd, buf)) == NULL)
+			err(EX_IOERR, NULL);
+		(void)fseeko(thread_stdin, 0, SEEK_END);
+		printf("%s\n", p);
+		return;
+	}
+#endif
+
+	/* Page-aligned, so large reads can go straight to the buffer */
+	if ((buffer = valloc(FILTER_BUFSIZ)) == NULL)
+		err(1, NULL);
 
 #ifdef __APPLE__
 	ios_CCDigestInit(alg->algorithm, &context);
 #else
 	alg->Init(&context);
 #endif
-	while ((len = fread(buffer, 1, BUFSIZ, thread_stdin))) {
+	while ((len = fread(buffer, 1, FILTER_BUFSIZ, thread_stdin))) {
 		if (tee && len != fwrite(buffer, 1, len, thread_stdout))
 			err(1, "stdout");
 #ifdef __APPLE__
@@ -416,6 +592,7 @@ MDFilter(Algorithm_t *alg, int tee)
 	if (ferror(thread_stdin)) {
 		errx(EX_IOERR, NULL);
 	}
+	free(buffer);
 #ifdef __APPLE__
 	printf("%s\n", Digest_End(&context, buf));
 #else
@@ -427,6 +604,6 @@ static void
 usage(Algorithm_t *alg)
 {
 
-	fprintf(thread_stderr, "usage: %s [-pqrtx] [-s string] [files ...]\n", alg->progname);
+	fprintf(thread_stderr, "usage: %s [-Npqrtx] [-j jobs] [-s string] [files ...]\n", alg->progname);
 	exit(1);
 }
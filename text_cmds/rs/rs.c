@@ -50,6 +50,8 @@ static const char sccsid[] = "@(#)rs.c	8.1 (Berkeley) 6/6/93";
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD: src/usr.bin/rs/rs.c,v 1.13 2005/04/28 12:37:15 robert Exp $");
 
+#include <sys/stat.h>
+
 #include <err.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -75,6 +77,7 @@ long	flags;
 #define	OCOLBOUNDS	040000
 #define ONEPERCHAR	0100000
 #define NOARGS		0200000
+#define	STREAM		0400000		/* read the input twice, keep none */
 
 short	*colwidths;
 short	*cord;
@@ -94,6 +97,9 @@ int	propgutter;
 char	isep = ' ', osep = ' ';
 char	blank[] = "";
 int	owidth = 80, gutter = 2;
+off_t	startoff;		/* STREAM: where the input starts */
+int	rereading;		/* STREAM: second pass, writing out */
+int	nstreamed;		/* STREAM: entries seen so far */
 
 void	  getargs(int, char *[]);
 void	  getfile(void);
@@ -104,6 +110,8 @@ char	**getptrs(char **);
 void	  prepfile(void);
 void	  prints(char *, int);
 void	  putfile(void);
+char	**putline(char **);
+int	  streamable(void);
 static void usage(void);
 
 #define	INCR(ep) do {			\
@@ -115,6 +123,8 @@ int
 main(int argc, char *argv[])
 {
 	getargs(argc, argv);
+	if (streamable())
+		flags |= STREAM;
 	getfile();
 	if (flags & SHAPEONLY) {
 		printf("%d %d\n", irows, icols);
@@ -134,6 +144,7 @@ getfile(void)
 	int multisep = (flags & ONEISEPONLY ? 0 : 1);
 	int nullpad = flags & NULLPAD;
 	char **padto;
+	int nskip = skip;
 
 	while (skip--) {
 		rs_getline();
@@ -162,6 +173,8 @@ getfile(void)
 			if (maxlen < curlen)
 				maxlen = curlen;
 			irows++;
+			if (flags & STREAM)
+				ep = putline(ep);
 			continue;
 		}
 		for (p = curline, endp = curline + curlen; p < endp; p++) {
@@ -186,9 +199,53 @@ getfile(void)
 				INCR(ep);
 			}
 		}
+		if (flags & STREAM)
+			ep = putline(ep);
 	} while (rs_getline() != EOF);
 	*ep = 0;				/* mark end of pointers */
-	nelem = ep - elem;
+	nelem = flags & STREAM ? nstreamed : ep - elem;
+	skip = nskip;
+}
+
+/*
+ * Input on a regular file can be read once to size the output and once
+ * more to write it, one line at a time, as long as each entry's place
+ * in the output follows from its place in the input.
+ */
+int
+streamable(void)
+{
+	struct stat sb;
+
+	if (flags & (TRANSPOSE | MTRANSPOSE | RECYCLE | SQUEEZE | NULLPAD |
+	    SHAPEONLY | DETAILSHAPE))
+		return (0);
+	if (fstat(fileno(stdin), &sb) != 0 || !S_ISREG(sb.st_mode))
+		return (0);
+	return ((startoff = ftello(stdin)) != -1);
+}
+
+/*
+ * STREAM: count the entries of the line just split up, or on the second
+ * pass print them; return where the next line's entries go.
+ */
+char **
+putline(char **ep)
+{
+	char **lp;
+	int k;
+
+	for (lp = elem; lp < ep; lp++, nstreamed++) {
+		if (!rereading)
+			continue;
+		k = nstreamed;
+		if (k >= orows * ocols)
+			continue;
+		prints(*lp, k % ocols);
+		if (k % ocols == ocols - 1)
+			putchar('\n');
+	}
+	return (elem);
 }
 
 void
@@ -197,6 +254,21 @@ putfile(void)
 	char **ep;
 	int i, j, k;
 
+	if (flags & STREAM) {
+		if (fseeko(stdin, startoff, SEEK_SET) != 0)
+			err(EX_IOERR, "stdin");
+		flags &= ~SKIPPRINT;
+		irows = icols = nstreamed = 0;
+		rereading = 1;
+		getfile();
+		/* Finish the last row, then pad out to orows rows. */
+		k = nelem < orows * ocols ? nelem : orows * ocols;
+		if (k % ocols != 0)
+			putchar('\n');
+		for (i = k / ocols + (k % ocols != 0); i < orows; i++)
+			putchar('\n');
+		return;
+	}
 	ep = elem;
 	if (flags & TRANSPOSE)
 		for (i = 0; i < orows; i++) {
@@ -274,7 +346,7 @@ prepfile(void)
 	else if (ocols == 0)			/* decide on cols */
 		ocols = nelem / orows + (nelem % orows ? 1 : 0);
 	lp = elem + orows * ocols;
-	while (lp > endelem) {
+	while (lp > endelem && !(flags & STREAM)) {
 		getptrs(elem + nelem);
 		lp = elem + orows * ocols;
 	}
@@ -351,7 +423,8 @@ rs_getline(void)	/* get line; maintain curline, curlen; manage storage */
 		if (putlength) {	/* print length, recycle storage */
 			printf(" %d line %d\n", curlen, irows);
 			curline = ibuf;
-		}
+		} else if (flags & STREAM)	/* entries already used */
+			curline = ibuf;
 	}
 	if (!putlength && endblock - curline < BUFSIZ) {   /* need storage */
 		/*ww = endblock-curline; tt += ww;*/
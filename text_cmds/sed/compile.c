@@ -46,6 +46,7 @@ static const char sccsid[] = "@(#)compile.c	8.1 (Berkeley) 6/6/93";
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -87,6 +88,8 @@ static struct s_command
 		 *findlabel(char *);
 static void	  fixuplabel(struct s_command *, struct s_command *);
 static void	  uselabel(void);
+static void	  compile_alloc(void);
+static int	  prog_reset(struct s_command *, struct s_command *);
 
 /*
  * Command specification.  This is used to drive the command parser.
@@ -142,6 +145,15 @@ compile(void)
 	*compile_stream(&prog) = NULL;
 	fixuplabel(prog, NULL);
 	uselabel();
+	compile_alloc();
+}
+
+/*
+ * Allocate the per-run arrays sized by the compiled program.
+ */
+static void
+compile_alloc(void)
+{
 	if (appendnum == 0)
 		appends = NULL;
 	else if ((appends = malloc(sizeof(struct s_appends) * appendnum)) ==
@@ -151,6 +163,152 @@ compile(void)
         err(1, "malloc");
 }
 
+/*
+ * Cache of compiled programs, shared by every sed running in the process.
+ * Scripts run repeatedly from a shell loop are parsed and their regular
+ * expressions compiled only once.  An entry is handed to one run at a
+ * time; a run finding its entry busy compiles a private copy.  Programs
+ * writing files ('w' and s///w) open them at compile time and are never
+ * cached.  Like an uncached run, an evicted program is not freed.
+ */
+#define	PROGCACHESZ	8
+
+static struct progcache {
+	char *key;			/* Flags, locale and script text */
+	size_t keylen;
+	struct s_command *prog;
+	int appendnum;			/* Values left by compile() */
+	size_t maxnsub;
+	int busy;			/* In use by a running sed */
+	u_long lru;
+} progcache[PROGCACHESZ];
+static u_long progcache_clock;
+static pthread_mutex_t progcache_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct progcache *progcached;
+
+/*
+ * Compile the program, or take it from the cache when key is not NULL.
+ * The cache takes ownership of key.
+ */
+void
+compile_cached(char *key, size_t keylen)
+{
+	struct progcache *pc, *victim;
+	int i;
+
+	progcached = NULL;
+	if (key == NULL) {
+		compile();
+		return;
+	}
+	victim = NULL;
+	pthread_mutex_lock(&progcache_lock);
+	for (i = 0; i < PROGCACHESZ; i++) {
+		pc = &progcache[i];
+		if (pc->key != NULL && pc->keylen == keylen &&
+		    memcmp(pc->key, key, keylen) == 0) {
+			if (pc->busy)
+				break;
+			pc->busy = 1;
+			pc->lru = ++progcache_clock;
+			pthread_mutex_unlock(&progcache_lock);
+			free(key);
+			progcached = pc;
+			prog = pc->prog;
+			appendnum = pc->appendnum;
+			maxnsub = pc->maxnsub;
+			(void)prog_reset(prog, NULL);
+			compile_alloc();
+			return;
+		}
+	}
+	pthread_mutex_unlock(&progcache_lock);
+
+	compile();
+	if (prog_reset(prog, NULL)) {
+		free(key);
+		return;
+	}
+
+	pthread_mutex_lock(&progcache_lock);
+	for (i = 0; i < PROGCACHESZ; i++) {
+		pc = &progcache[i];
+		if (pc->key != NULL && pc->keylen == keylen &&
+		    memcmp(pc->key, key, keylen) == 0) {
+			victim = NULL;	/* Another run got there first */
+			break;
+		}
+		if (pc->busy)
+			continue;
+		if (victim == NULL || pc->key == NULL ||
+		    (victim->key != NULL && pc->lru < victim->lru))
+			victim = pc;
+	}
+	if (victim != NULL) {
+		free(victim->key);
+		victim->key = key;
+		victim->keylen = keylen;
+		victim->prog = prog;
+		victim->appendnum = appendnum;
+		victim->maxnsub = maxnsub;
+		victim->busy = 1;
+		victim->lru = ++progcache_clock;
+		progcached = victim;
+	}
+	pthread_mutex_unlock(&progcache_lock);
+	if (victim == NULL)
+		free(key);
+}
+
+/*
+ * Done with the program: hand it back to the cache, or close its files.
+ */
+void
+compile_release(void *arg)
+{
+	(void)arg;
+	free(appends);
+	appends = NULL;
+	free(match);
+	match = NULL;
+	if (progcached == NULL) {
+		cfclose(prog, NULL);
+		return;
+	}
+	pthread_mutex_lock(&progcache_lock);
+	progcached->busy = 0;
+	pthread_mutex_unlock(&progcache_lock);
+	progcached = NULL;
+}
+
+/*
+ * Clear the range state left by a previous run.  Return true if the
+ * program writes to files and so cannot be cached.
+ */
+static int
+prog_reset(struct s_command *cp, struct s_command *end)
+{
+	int wfiles;
+
+	wfiles = 0;
+	for (; cp != end; cp = cp->next) {
+		cp->inrange = 0;
+		switch (cp->code) {
+		case 's':
+			if (cp->u.s->wfile != NULL)
+				wfiles = 1;
+			break;
+		case 'w':
+			wfiles = 1;
+			break;
+		case '{':
+			wfiles |= prog_reset(cp->u.c, cp->next);
+			break;
+		}
+	}
+	return (wfiles);
+}
+
 #define EATSPACE() do {							\
 	if (p)								\
 		while (*p && isspace((unsigned char)*p))                \
@@ -47,6 +47,8 @@ extern __thread int rflags;	/* regex flags to use */
 
 void	 cfclose(struct s_command *, struct s_command *);
 void	 compile(void);
+void	 compile_cached(char *, size_t);
+void	 compile_release(void *);
 void	 cspace(SPACE *, const char *, size_t, enum e_spflag);
 char	*cu_fgets(char *, int, int *);
 int	 mf_fgets(SPACE *, enum e_spflag);
@@ -118,13 +118,15 @@ __thread u_long linenum;
 static void add_compunit(enum e_cut, char *);
 static void add_file(char *);
 static int inplace_edit(char **);
+static char *script_key(size_t *);
 static void usage(void);
 
 int
 sed_main(int argc, char *argv[])
 {
 	int c, fflag;
-	char *temp_arg;
+	char *temp_arg, *key;
+	size_t keylen;
 
     // init all flags:
     aflag = eflag = sed_nflag = rflags = 0;
@@ -189,7 +191,9 @@ sed_main(int argc, char *argv[])
 		argv++;
 	}
 
-	compile();
+	keylen = 0;
+	key = script_key(&keylen);
+	compile_cached(key, keylen);
 
 	/* Continue with first and start second usage */
 	if (*argv)
@@ -197,8 +201,9 @@ sed_main(int argc, char *argv[])
 			add_file(*argv);
 	else
 		add_file(NULL);
+	pthread_cleanup_push(compile_release, NULL);
 	process();
-	cfclose(prog, NULL);
+	pthread_cleanup_pop(1);
 	// if (fclose(stdout))
 	//	err(1, "stdout");
     if ((infile != NULL) && (infile != thread_stdin)) fclose(infile);
@@ -215,6 +220,42 @@ usage(void)
     exit(1);
 }
 
+/*
+ * Key for the compiled program cache: the regex flags and locale, which
+ * change how the script compiles, followed by every compilation unit.
+ * Scripts read with -f are not cached since the file may change.
+ */
+static char *
+script_key(size_t *lenp)
+{
+	struct s_compunit *cu;
+	char head[128], *key, *p;
+	size_t len;
+	int n;
+
+	n = snprintf(head, sizeof(head), "%d %s %s", rflags,
+	    setlocale(LC_CTYPE, NULL), setlocale(LC_COLLATE, NULL));
+	if (n < 0 || n >= sizeof(head))
+		return (NULL);
+	len = n + 1;
+	for (cu = script; cu != NULL; cu = cu->next) {
+		if (cu->type != CU_STRING)
+			return (NULL);
+		len += strlen(cu->s) + 1;
+	}
+	if ((key = malloc(len)) == NULL)
+		return (NULL);
+	memcpy(key, head, n + 1);
+	p = key + n + 1;
+	for (cu = script; cu != NULL; cu = cu->next) {
+		n = strlen(cu->s) + 1;
+		memcpy(p, cu->s, n);
+		p += n;
+	}
+	*lenp = len;
+	return (key);
+}
+
 /*
  * Like fgets, but go through the chain of compilation units chaining them
  * together.  Empty strings and files are ignored.
@@ -73,6 +73,7 @@ static void		 flush_appends(void);
 static void		 lputs(char *, size_t);
 static __inline int	 regexec_e(regex_t *, const char *, int, int, size_t);
 static void		 regsub(SPACE *, char *, char *);
+static void		 space_need(SPACE *, size_t);
 static int		 substitute(struct s_command *);
 
 __thread struct s_appends *appends;	/* Array of pointers to strings to append. */
@@ -346,6 +347,12 @@ substitute(struct s_command *cp)
 
 	switch (n) {
 	case 0:					/* Global */
+		/*
+		 * Build the result in one pass over the pattern space.  The
+		 * substitute space is kept between lines and sized for the
+		 * whole line up front, so it rarely has to grow per match.
+		 */
+		space_need(&SS, psl);
 		do {
 			if (lastempty || match[0].rm_so != match[0].rm_eo) {
 				/* Locate start of replaced string. */
@@ -643,13 +650,9 @@ regsub(SPACE *sp, char *string, char *src)
 #define	NEEDSP(reqlen)							\
 	/* XXX What is the +1 for? */					\
 	if (sp->len + (reqlen) + 1 >= sp->blen) {			\
-		sp->blen += (reqlen) + 1024;				\
-		if ((sp->space = sp->back = realloc(sp->back, sp->blen)) \
-		    == NULL)						\
-            fprintf(thread_stderr, "sed: realloc: %s\n", strerror(errno)); \
+		space_need(sp, (reqlen) + 1);				\
 		dst = sp->space + sp->len;				\
 	}
-    // err(1, "realloc");
 
 	dst = sp->space + sp->len;
 	while ((c = *src++) != '\0') {
@@ -677,6 +680,26 @@ regsub(SPACE *sp, char *string, char *src)
 	*dst = '\0';
 }
 
+/*
+ * space_need --
+ *	Make room for len more bytes and a NUL.  The buffer at least doubles
+ *	each time, so a line built a piece at a time costs few reallocs.
+ */
+static void
+space_need(SPACE *sp, size_t len)
+{
+	size_t tlen;
+
+	tlen = sp->len + len + 1;
+	if (tlen <= sp->blen)
+		return;
+	if (tlen < sp->blen * 2)
+		tlen = sp->blen * 2;
+	sp->blen = tlen + 1024;
+	if ((sp->space = sp->back = realloc(sp->back, sp->blen)) == NULL)
+		err(1, "realloc");
+}
+
 /*
  * aspace --
  *	Append the source space to the destination space, allocating new
@@ -689,13 +712,8 @@ cspace(SPACE *sp, const char *p, size_t len, enum e_spflag spflag)
 
 	/* Make sure SPACE has enough memory and ramp up quickly. */
 	tlen = sp->len + len + 1;
-	if (tlen > sp->blen) {
-		sp->blen = tlen + 1024;
-		if ((sp->space = sp->back = realloc(sp->back, sp->blen)) ==
-            NULL) {
-            err(1, "realloc");
-        }
-    }
+	if (tlen > sp->blen)
+		space_need(sp, len);
 
 	if (spflag == REPLACE)
 		sp->len = 0;
@@ -189,11 +189,16 @@ bwsalloc(size_t sz)
 {
 	struct bwstring *ret;
 
+	size_t memsize;
+
 	if (MB_CUR_MAX == 1)
-		ret = sort_malloc(sizeof(struct bwstring) + 1 + sz);
+		memsize = sizeof(struct bwstring) + 1 + sz;
+	else
+		memsize = sizeof(struct bwstring) + SIZEOF_WCHAR_STRING(sz + 1);
+	if (line_arena)
+		ret = sort_arena_alloc(line_arena, memsize);
 	else
-		ret = sort_malloc(sizeof(struct bwstring) +
-		    SIZEOF_WCHAR_STRING(sz + 1));
+		ret = sort_malloc(memsize);
 	ret->len = sz;
 
 	if (MB_CUR_MAX == 1)
@@ -315,7 +320,7 @@ void
 bwsfree(const struct bwstring *s)
 {
 
-	if (s)
+	if (s && (line_arena == NULL))
 		sort_free(s);
 }
 
@@ -35,9 +35,6 @@ __FBSDID("$FreeBSD: head/usr.bin/sort/coll.c 298089 2016-04-15 22:31:22Z pfg $")
 #include <langinfo.h>
 #include <limits.h>
 #include <math.h>
-#ifndef __APPLE__
-#include <md5.h>
-#endif
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
@@ -63,6 +60,9 @@ static int numcoll(struct key_value*, struct key_value *, size_t offset);
 static int hnumcoll(struct key_value*, struct key_value *, size_t offset);
 static int randomcoll(struct key_value*, struct key_value *, size_t offset);
 static int versioncoll(struct key_value*, struct key_value *, size_t offset);
+static uint64_t num_key_prefix(struct bwstring *k, bool use_suffix);
+static uint64_t gnum_key_prefix(struct bwstring *k);
+static uint64_t month_key_prefix(struct bwstring *k);
 
 /*
  * Allocate keys array
@@ -143,7 +143,10 @@ sort_list_item_alloc(void)
 	size_t sz;
 
 	sz = sizeof(struct sort_list_item) + keys_array_size();
-	si = sort_malloc(sz);
+	if (line_arena)
+		si = sort_arena_alloc(line_arena, sz);
+	else
+		si = sort_malloc(sz);
 	memset(si, 0, sz);
 
 	return (si);
@@ -170,6 +173,63 @@ sort_list_item_size(struct sort_list_item *si)
 	return (ret);
 }
 
+/*
+ * With a byte sort on a plain string key, comparing the first 8 bytes of
+ * the first key as a big-endian integer gives the same order as memcmp(),
+ * so most comparisons are decided without going to the strings.
+ *
+ * For -n, -h, -g and -M the prefix is the value of the first key, encoded
+ * so that keys in order have prefixes in order (KP_NUMBER).  Equal
+ * prefixes do not mean equal keys, only that the comparison function has
+ * to decide; the radix sort sorts on the 8 bytes and leaves ties to it.
+ */
+enum key_prefix_kind key_prefix_kind;
+
+void
+init_key_prefix(void)
+{
+	cmpcoll_t func;
+
+	key_prefix_kind = KP_NONE;
+	if (keys_num == 0)
+		return;
+
+	func = keys[0].sm.func;
+	if (func == wstrcoll) {
+		if ((MB_CUR_MAX == 1) && byte_sort)
+			key_prefix_kind = KP_BYTES;
+	} else if (func == numcoll || func == hnumcoll || func == gnumcoll ||
+	    func == monthcoll)
+		key_prefix_kind = KP_NUMBER;
+}
+
+static inline uint64_t
+key_prefix(const struct bwstring *k)
+{
+	uint64_t prefix = 0;
+	size_t len;
+
+	if (k == NULL)
+		return (0);
+
+	if (key_prefix_kind == KP_NUMBER) {
+		cmpcoll_t func = keys[0].sm.func;
+
+		if (func == numcoll)
+			return (num_key_prefix((struct bwstring *)k, false));
+		if (func == hnumcoll)
+			return (num_key_prefix((struct bwstring *)k, true));
+		if (func == gnumcoll)
+			return (gnum_key_prefix((struct bwstring *)k));
+		return (month_key_prefix((struct bwstring *)k));
+	}
+
+	len = (k->len < 8) ? k->len : 8;
+	for (size_t i = 0; i < len; ++i)
+		prefix |= (uint64_t) k->data.cstr[i] << (56 - 8 * i);
+	return (prefix);
+}
+
 /*
  * Calculate key for a sort list item
  */
@@ -178,6 +238,8 @@ sort_list_item_make_key(struct sort_list_item *si)
 {
 
 	preproc(si->str, &(si->ka));
+	if (key_prefix_kind != KP_NONE)
+		si->prefix = key_prefix(si->ka.key[0].k);
 }
 
 /*
@@ -566,6 +628,13 @@ list_coll_offset(struct sort_list_item **ss1, struct sort_list_item **ss2,
 {
 	int ret;
 
+	if ((key_prefix_kind != KP_NONE) && (offset == 0) && !debug_sort &&
+	    ((*ss1)->prefix != (*ss2)->prefix)) {
+		/* the first key decides */
+		ret = ((*ss1)->prefix < (*ss2)->prefix) ? -1 : +1;
+		return (keys[0].sm.rflag ? -ret : ret);
+	}
+
 	ret = key_coll(&((*ss1)->ka), &((*ss2)->ka), offset);
 
 	if (debug_sort) {
@@ -967,16 +1036,65 @@ hnumcoll(struct key_value *kv1, struct key_value *kv2, size_t offset)
 	return (numcoll_impl(kv1, kv2, offset, true));
 }
 
+#define	SIP_ROTL(x, b)	(((x) << (b)) | ((x) >> (64 - (b))))
+#define	SIP_ROUND(v0, v1, v2, v3) do {					\
+	v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32);	\
+	v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;			\
+	v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;			\
+	v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32);	\
+} while (0)
+
+/*
+ * SipHash-2-4 of len bytes at data under a 128-bit key.
+ */
+uint64_t
+siphash24(const uint64_t key[2], const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t v0, v1, v2, v3, m;
+	size_t i, left;
+
+	v0 = key[0] ^ 0x736f6d6570736575ULL;
+	v1 = key[1] ^ 0x646f72616e646f6dULL;
+	v2 = key[0] ^ 0x6c7967656e657261ULL;
+	v3 = key[1] ^ 0x7465646279746573ULL;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		m = 0;
+		for (size_t j = 0; j < 8; j++)
+			m |= (uint64_t)p[i + j] << (8 * j);
+		v3 ^= m;
+		SIP_ROUND(v0, v1, v2, v3);
+		SIP_ROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+	m = (uint64_t)len << 56;
+	for (left = 0; i + left < len; left++)
+		m |= (uint64_t)p[i + left] << (8 * left);
+	v3 ^= m;
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	v0 ^= m;
+
+	v2 ^= 0xff;
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	return (v0 ^ v1 ^ v2 ^ v3);
+}
+
 /*
- * Implements random sort (-R).
+ * Implements random sort (-R).  Each key is hashed once, into its hint;
+ * keys that hash the same are ordered as strings, so equal keys stay
+ * together.
  */
 static int
 randomcoll(struct key_value *kv1, struct key_value *kv2,
     size_t offset __unused)
 {
 	struct bwstring *s1, *s2;
-	MD5_CTX ctx1, ctx2;
-	char *b1, *b2;
+	uint64_t h1, h2;
 
 	s1 = kv1->k;
 	s2 = kv2->k;
@@ -989,35 +1107,23 @@ randomcoll(struct key_value *kv1, struct key_value *kv2,
 	if (s1 == s2)
 		return (0);
 
-	memcpy(&ctx1,&md5_ctx,sizeof(MD5_CTX));
-	memcpy(&ctx2,&md5_ctx,sizeof(MD5_CTX));
-
-	MD5Update(&ctx1, bwsrawdata(s1), bwsrawlen(s1));
-	MD5Update(&ctx2, bwsrawdata(s2), bwsrawlen(s2));
-	b1 = MD5End(&ctx1, NULL);
-	b2 = MD5End(&ctx2, NULL);
-	if (b1 == NULL) {
-		if (b2 == NULL)
-			return (0);
-		else {
-			sort_free(b2);
-			return (-1);
-		}
-	} else if (b2 == NULL) {
-		sort_free(b1);
-		return (+1);
-	} else {
-		int cmp_res;
-
-		cmp_res = strcmp(b1,b2);
-		sort_free(b1);
-		sort_free(b2);
+	if (kv1->hint->status == HS_UNINITIALIZED) {
+		kv1->hint->v.Rh.h = siphash24(random_sort_key, bwsrawdata(s1),
+		    bwsrawlen(s1));
+		kv1->hint->status = HS_INITIALIZED;
+	}
+	if (kv2->hint->status == HS_UNINITIALIZED) {
+		kv2->hint->v.Rh.h = siphash24(random_sort_key, bwsrawdata(s2),
+		    bwsrawlen(s2));
+		kv2->hint->status = HS_INITIALIZED;
+	}
 
-		if (!cmp_res)
-			cmp_res = bwscoll(s1, s2, 0);
+	h1 = kv1->hint->v.Rh.h;
+	h2 = kv2->hint->v.Rh.h;
+	if (h1 != h2)
+		return ((h1 < h2) ? -1 : +1);
 
-		return (cmp_res);
-	}
+	return (bwscoll(s1, s2, 0));
 }
 
 /*
@@ -1303,3 +1409,85 @@ monthcoll(struct key_value *kv1, struct key_value *kv2, size_t offset __unused)
 		return (-1);
 	return (+1);
 }
+
+/*
+ * Prefix of a -n (or, with use_suffix, -h) key, in the order of
+ * numcoll_impl(): negative numbers, then zero or no number, then positive
+ * numbers.  A positive number is its suffix for -h, the number of digits
+ * before the decimal point, and as many of the digits as fit, 4 bits
+ * each; a negative number is that inverted.
+ */
+static uint64_t
+num_key_prefix(struct bwstring *k, bool use_suffix)
+{
+	wchar_t sfrac[MAX_NUM_SIZE + 1], smain[MAX_NUM_SIZE + 1];
+	size_t frac_len, main_len, i;
+	uint64_t m, d;
+	int sign, bits;
+	unsigned char si;
+
+	sign = 0;
+	main_len = frac_len = 0;
+	read_number(k, &sign, smain, &main_len, sfrac, &frac_len, &si);
+	if ((main_len + frac_len) == 0)
+		return ((uint64_t)1 << 62);
+
+	/* 62 bits below the 2-bit class */
+	m = 0;
+	bits = 62;
+	if (use_suffix) {
+		bits -= 4;
+		m |= (uint64_t)si << bits;
+	}
+	bits -= 8;
+	m |= (uint64_t)main_len << bits;
+	for (i = 0; bits >= 4 && i < main_len + frac_len; i++) {
+		d = (i < main_len) ? smain[i] : sfrac[i - main_len];
+		/* other digits sort after '9' in wcscmp() */
+		d = (d >= L'0' && d <= L'9') ? d - L'0' : 15;
+		bits -= 4;
+		m |= d << bits;
+	}
+
+	if (sign < 0)
+		return (~m & (((uint64_t)1 << 62) - 1));
+	return (((uint64_t)2 << 62) | m);
+}
+
+/*
+ * Prefix of a -g key: no number, then NaN, then the value as a double,
+ * with the sign bit flipped (and the rest too for negative numbers) so
+ * that its bits compare as the value does.  The smallest negative
+ * number, -Inf, encodes above 1.
+ */
+static uint64_t
+gnum_key_prefix(struct bwstring *k)
+{
+	uint64_t u;
+	double d;
+	bool empty;
+
+	errno = 0;
+	d = bwstod(k, &empty);
+	if (empty)
+		return (0);
+	if (is_nan(d))
+		return (1);
+	/* -0 compares equal to 0 */
+	if (d == 0)
+		d = 0;
+	memcpy(&u, &d, sizeof(u));
+	if (u & ((uint64_t)1 << 63))
+		return (~u);
+	return (u | ((uint64_t)1 << 63));
+}
+
+/*
+ * Prefix of a -M key: the month, with no month first.
+ */
+static uint64_t
+month_key_prefix(struct bwstring *k)
+{
+
+	return ((uint64_t)(bws_month_score(k) + 1) << 56);
+}
@@ -30,6 +30,8 @@
 #if !defined(__COLL_H__)
 #define	__COLL_H__
 
+#include <stdint.h>
+
 #include "bwstring.h"
 #include "sort.h"
 
@@ -62,6 +64,14 @@ struct M_hint
 	int			 m;
 };
 
+/*
+ * Sort hint data for -R
+ */
+struct R_hint
+{
+	uint64_t		 h;
+};
+
 /*
  * Status of a sort hint object
  */
@@ -81,6 +91,7 @@ struct key_hint
 		struct n_hint		nh;
 		struct g_hint		gh;
 		struct M_hint		Mh;
+		struct R_hint		Rh;
 	}			v;
 };
 
@@ -121,6 +132,7 @@ struct key_specs
 struct sort_list_item
 {
 	struct bwstring		*str;
+	uint64_t		 prefix; /* first bytes or value of the first key, see init_key_prefix() */
 	struct keys_array	 ka;
 };
 
@@ -155,6 +167,7 @@ void sort_list_item_clean(struct sort_list_item *si);
 size_t sort_list_item_size(struct sort_list_item *si);
 
 int preproc(struct bwstring *s, struct keys_array *ka);
+uint64_t siphash24(const uint64_t key[2], const void *data, size_t len);
 int top_level_str_coll(const struct bwstring *, const struct bwstring *);
 int key_coll(struct keys_array *ks1, struct keys_array *ks2, size_t offset);
 int str_list_coll(struct bwstring *str1, struct sort_list_item **ss2);
@@ -164,4 +177,13 @@ int list_coll_offset(struct sort_list_item **ss1, struct sort_list_item **ss2, s
 
 listcoll_t get_list_call_func(size_t offset);
 
+enum key_prefix_kind
+{
+	KP_NONE, KP_BYTES, KP_NUMBER
+};
+
+extern enum key_prefix_kind key_prefix_kind;
+
+void init_key_prefix(void);
+
 #endif /* __COLL_H__ */
@@ -29,6 +29,8 @@
 __FBSDID("$FreeBSD: head/usr.bin/sort/file.c 298089 2016-04-15 22:31:22Z pfg $");
 
 #include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/queue.h>
@@ -37,6 +39,7 @@ __FBSDID("$FreeBSD: head/usr.bin/sort/file.c 298089 2016-04-15 22:31:22Z pfg $")
 #include <fcntl.h>
 #if defined(SORT_THREADS)
 #include <pthread.h>
+#include <sched.h>
 #endif
 #include <semaphore.h>
 #include <stdio.h>
@@ -45,6 +48,7 @@ __FBSDID("$FreeBSD: head/usr.bin/sort/file.c 298089 2016-04-15 22:31:22Z pfg $")
 #include <unistd.h>
 #include <wchar.h>
 #include <wctype.h>
+#include <zlib.h>
 
 #include "coll.h"
 #include "file.h"
@@ -58,13 +62,20 @@ bool use_mmap;
 
 const char *tmpdir = "/var/tmp";
 const char *compress_program;
+bool compress_temp;
 
-size_t max_open_files = 16;
+size_t max_open_files = 0;	/* 0: fit the descriptor limit */
 
 /*
  * How much space we read from file at once
  */
-#define READ_CHUNK (4096)
+#define READ_CHUNK (32 * 1024)
+
+/*
+ * Widest merge, and most descriptors held by merges at once
+ */
+#define MERGE_FANIN_MAX (64)
+#define MERGE_FD_MAX (1024)
 
 /*
  * File reader structure
@@ -159,7 +170,7 @@ clear_tmp_files(void)
 	sem_wait(&tmp_files_sem);
 	LIST_FOREACH(item,&tmp_files,files) {
 		if ((item) && (item->fn))
-			unlink(item->fn);
+			ios_scratch_unlink(item->fn);
 	}
 	sem_post(&tmp_files_sem);
 }
@@ -270,7 +281,7 @@ file_list_clean(struct file_list *fl)
 			for (i = 0; i < fl->count; i++) {
 				if (fl->fns[i]) {
 					if (fl->tmp)
-						unlink(fl->fns[i]);
+						ios_scratch_unlink(fl->fns[i]);
 					sort_free(fl->fns[i]);
 					fl->fns[i] = 0;
 				}
@@ -296,6 +307,7 @@ sort_list_init(struct sort_list *l)
 		l->size = 0;
 		l->memsize = sizeof(struct sort_list);
 		l->list = NULL;
+		l->arena = NULL;
 	}
 }
 
@@ -333,6 +345,13 @@ sort_list_clean(struct sort_list *l)
 {
 
 	if (l) {
+		if (l->arena) {
+			/* the items and their strings are all in the arena */
+			sort_free(l->list);
+			l->list = NULL;
+			sort_arena_free(l->arena);
+			l->arena = NULL;
+		}
 		if (l->list) {
 			size_t i;
 
@@ -531,6 +550,58 @@ end:
 	return (0);
 }
 
+/*
+ * Built-in compression of temporary files: a gzip stream wrapped
+ * in a stdio FILE, so that readers and writers need no changes.
+ */
+#define	GZ_TMP_BUFSIZE	(128 * 1024)
+
+static int
+gz_tmp_read(void *cookie, char *buf, int len)
+{
+
+	return (gzread((gzFile) cookie, buf, (unsigned) len));
+}
+
+static int
+gz_tmp_write(void *cookie, const char *buf, int len)
+{
+
+	return (gzwrite((gzFile) cookie, buf, (unsigned) len));
+}
+
+static int
+gz_tmp_close(void *cookie)
+{
+
+	return ((gzclose((gzFile) cookie) == Z_OK) ? 0 : -1);
+}
+
+static FILE *
+gz_tmp_open(const char *fn, const char *mode)
+{
+	FILE *file;
+	gzFile gz;
+
+	/* Level 1: temporary runs favour speed over ratio */
+	gz = gzopen(fn, (mode[0] == 'r') ? "rb" : "wb1");
+	if (gz == NULL)
+		err(2, "%s", fn);
+	gzbuffer(gz, GZ_TMP_BUFSIZE);
+
+	if (mode[0] == 'r')
+		file = funopen(gz, gz_tmp_read, NULL, NULL, gz_tmp_close);
+	else if (mode[0] == 'w')
+		file = funopen(gz, NULL, gz_tmp_write, NULL, gz_tmp_close);
+	else
+		err(2, "%s", getstr(7));
+
+	if (file == NULL)
+		err(2, NULL);
+
+	return (file);
+}
+
 /*
  * Opens a file.  If the given filename is "-", stdout will be
  * opened.
@@ -573,6 +644,12 @@ openfile(const char *fn, const char *mode)
 
 			sort_free(cmd);
 
+		} else if (is_tmp && compress_temp) {
+			file = gz_tmp_open(fn, mode);
+		} else if (is_tmp) {
+			/* In memory while they fit in the scratch budget */
+			if ((file = ios_scratch_fopen(fn, mode)) == NULL)
+				err(2, NULL);
 		} else
 			if ((file = fopen(fn, mode)) == NULL)
 				err(2, NULL);
@@ -600,11 +677,30 @@ closefile(FILE *f, const char *fn)
 		if (file_is_tmp(fn) && compress_program != NULL) {
 			if(pclose(f)<0)
 				err(2,NULL);
+		} else if (file_is_tmp(fn) && compress_temp) {
+			if (fclose(f) != 0)
+				err(2, "%s", fn);
 		} else
 			fclose(f);
 	}
 }
 
+/*
+ * Whether the standard input is a regular file (sort < file), which can
+ * then be read like a named one.  *offp is where the stream is in it.
+ */
+static bool
+stdin_is_regular(struct stat *st, off_t *offp)
+{
+	int fd;
+
+	fd = fileno(thread_stdin);
+	if (fd < 0 || fstat(fd, st) < 0 || !S_ISREG(st->st_mode))
+		return (false);
+	*offp = ftello(thread_stdin);
+	return (*offp >= 0 && *offp <= st->st_size);
+}
+
 /*
  * Reads a file into the internal buffer.
  */
@@ -612,6 +708,9 @@ struct file_reader *
 file_reader_init(const char *fsrc)
 {
 	struct file_reader *ret;
+	struct stat stat_buf;
+	off_t off = 0;
+	bool is_stdin;
 
 	if (fsrc == NULL)
 		fsrc = "-";
@@ -624,11 +723,12 @@ file_reader_init(const char *fsrc)
 		ret->elsymb = 0;
 
 	ret->fname = sort_strdup(fsrc);
+	is_stdin = (strcmp(fsrc, "-") == 0);
 
-	if (strcmp(fsrc, "-") && (compress_program == NULL) && use_mmap) {
+	if ((compress_program == NULL) && use_mmap &&
+	    !(compress_temp && file_is_tmp(fsrc))) {
 
 		do {
-			struct stat stat_buf;
 			void *addr;
 			size_t sz = 0;
 			int fd, flags;
@@ -640,13 +740,23 @@ file_reader_init(const char *fsrc)
 #endif
 			addr = MAP_FAILED;
 
-			fd = open(fsrc, O_RDONLY);
-			if (fd < 0)
-				err(2, NULL);
+			if (is_stdin) {
+				if (!stdin_is_regular(&stat_buf, &off))
+					break;
+				fd = fileno(thread_stdin);
+			} else {
+				fd = open(fsrc, O_RDONLY);
+				if (fd < 0) {
+					/* a temporary file kept in memory */
+					if (errno == ENOENT && file_is_tmp(fsrc))
+						break;
+					err(2, NULL);
+				}
 
-			if (fstat(fd, &stat_buf) < 0) {
-				close(fd);
-				break;
+				if (fstat(fd, &stat_buf) < 0) {
+					close(fd);
+					break;
+				}
 			}
 
 			sz = stat_buf.st_size;
@@ -657,14 +767,19 @@ file_reader_init(const char *fsrc)
 
 			addr = mmap(NULL, sz, PROT_READ, flags, fd, 0);
 			if (addr == MAP_FAILED) {
-				close(fd);
+				if (!is_stdin)
+					close(fd);
 				break;
 			}
 
-			ret->fd = fd;
+			/* The stream's descriptor stays with the stream */
+			if (is_stdin)
+				fseeko(thread_stdin, 0, SEEK_END);
+			else
+				ret->fd = fd;
 			ret->mmapaddr = addr;
 			ret->mmapsize = sz;
-			ret->mmapptr = ret->mmapaddr;
+			ret->mmapptr = ret->mmapaddr + off;
 
 		} while (0);
 	}
@@ -674,7 +789,11 @@ file_reader_init(const char *fsrc)
 		if (ret->file == NULL)
 			err(2, NULL);
 
-		if (strcmp(fsrc, "-")) {
+		/*
+		 * Files are read in chunks; a terminal or a pipe on the
+		 * standard input line by line.
+		 */
+		if (!is_stdin || stdin_is_regular(&stat_buf, &off)) {
 			ret->cbsz = READ_CHUNK;
 			ret->buffer = sort_malloc(ret->cbsz);
 			ret->bsz = 0;
@@ -719,7 +838,7 @@ file_reader_readline(struct file_reader *fr)
 			}
 		}
 
-	} else if (fr->file != thread_stdin) {
+	} else if (fr->buffer != NULL) {
 		unsigned char *strend;
 		size_t bsz1, remsz, search_start;
 
@@ -840,23 +959,42 @@ int
 sort_procfile(const char *fsrc, struct sort_list *list, struct file_list *fl)
 {
 	struct file_reader *fr;
+	unsigned long long limit;
+	int pressure;
 
 	fr = file_reader_init(fsrc);
 	if (fr == NULL)
 		err(2, NULL);
 
+	limit = available_free_memory;
+	pressure = 0;
+
 	/* file browse cycle */
 	for (;;) {
 		struct bwstring *bws;
 
+		/* no malloc() for each line: they are all released together */
+		if (list->arena == NULL)
+			list->arena = sort_arena_create();
+		line_arena = list->arena;
 		bws = file_reader_readline(fr);
+		if (bws != NULL)
+			sort_list_add(list, bws);
+		line_arena = NULL;
 
 		if (bws == NULL)
 			break;
 
-		sort_list_add(list, bws);
-
-		if (list->memsize >= available_free_memory) {
+#ifdef __APPLE__
+		/* Memory is getting short: go to temporary files sooner. */
+		if (ios_memoryPressure() != pressure) {
+			pressure = ios_memoryPressure();
+			limit = available_free_memory;
+			if (pressure != 0 && ios_memoryBudget() < limit)
+				limit = ios_memoryBudget();
+		}
+#endif
+		if (list->memsize >= limit) {
 			char *fn;
 
 			fn = new_tmp_file_name();
@@ -947,92 +1085,53 @@ file_header_close(struct file_header **fh)
 	}
 }
 
-/*
- * Swap two array elements
- */
-static void
-file_header_swap(struct file_header **fh, size_t i1, size_t i2)
-{
-	struct file_header *tmp;
-
-	tmp = fh[i1];
-	fh[i1] = fh[i2];
-	fh[i2] = tmp;
-}
-
-/* heap algorithm ==>> */
+/* tournament tree ==>> */
 
 /*
- * See heap sort algorithm
- * "Raises" last element to its right place
+ * Play the matches below node t of the loser tree lt over fnum files,
+ * whose leaves are the nodes fnum..2*fnum-1: each internal node keeps
+ * the loser of its match.  Returns the winner.
  */
-static void
-file_header_heap_swim(struct file_header **fh, size_t indx)
+static size_t
+file_header_tree_build(struct file_header **fh, size_t *lt, size_t fnum,
+    size_t t)
 {
+	size_t w1, w2;
 
-	if (indx > 0) {
-		size_t parent_index;
+	if (t >= fnum)
+		return (t - fnum);
 
-		parent_index = (indx - 1) >> 1;
-
-		if (file_header_cmp(fh[indx], fh[parent_index]) < 0) {
-			/* swap child and parent and continue */
-			file_header_swap(fh, indx, parent_index);
-			file_header_heap_swim(fh, parent_index);
-		}
+	w1 = file_header_tree_build(fh, lt, fnum, t + t);
+	w2 = file_header_tree_build(fh, lt, fnum, t + t + 1);
+	if (file_header_cmp(fh[w1], fh[w2]) > 0) {
+		lt[t] = w1;
+		return (w2);
 	}
+	lt[t] = w2;
+	return (w1);
 }
 
 /*
- * Sink the top element to its correct position
+ * The winner w has a new line: replay its matches up to the root, one
+ * comparison per level, and leave the new winner in lt[0].
  */
 static void
-file_header_heap_sink(struct file_header **fh, size_t indx, size_t size)
+file_header_tree_replay(struct file_header **fh, size_t *lt, size_t fnum,
+    size_t w)
 {
-	size_t left_child_index;
-	size_t right_child_index;
-
-	left_child_index = indx + indx + 1;
-	right_child_index = left_child_index + 1;
-
-	if (left_child_index < size) {
-		size_t min_child_index;
+	size_t t, tmp;
 
-		min_child_index = left_child_index;
-
-		if ((right_child_index < size) &&
-		    (file_header_cmp(fh[left_child_index],
-		    fh[right_child_index]) > 0))
-			min_child_index = right_child_index;
-		if (file_header_cmp(fh[indx], fh[min_child_index]) > 0) {
-			file_header_swap(fh, indx, min_child_index);
-			file_header_heap_sink(fh, min_child_index, size);
+	for (t = (w + fnum) >> 1; t > 0; t >>= 1) {
+		if (file_header_cmp(fh[w], fh[lt[t]]) > 0) {
+			tmp = lt[t];
+			lt[t] = w;
+			w = tmp;
 		}
 	}
+	lt[0] = w;
 }
 
-/* <<== heap algorithm */
-
-/*
- * Adds element to the "left" end
- */
-static void
-file_header_list_rearrange_from_header(struct file_header **fh, size_t size)
-{
-
-	file_header_heap_sink(fh, 0, size);
-}
-
-/*
- * Adds element to the "right" end
- */
-static void
-file_header_list_push(struct file_header *f, struct file_header **fh, size_t size)
-{
-
-	fh[size++] = f;
-	file_header_heap_swim(fh, size - 1);
-}
+/* <<== tournament tree */
 
 struct last_printed
 {
@@ -1093,25 +1192,29 @@ static void
 file_headers_merge(size_t fnum, struct file_header **fh, FILE *f_out)
 {
 	struct last_printed lp;
-	size_t i;
+	size_t *lt;
+
+	if (fnum == 0)
+		return;
 
 	memset(&lp, 0, sizeof(lp));
 
 	/*
 	 * construct the initial sort structure
 	 */
-	for (i = 0; i < fnum; i++)
-		file_header_list_push(fh[i], fh, i);
+	lt = sort_malloc(fnum * sizeof(size_t));
+	lt[0] = file_header_tree_build(fh, lt, fnum, 1);
 
-	while (fh[0]->fr) { /* unfinished files are always in front */
+	while (fh[lt[0]]->fr) { /* finished files always lose */
 		/* output the smallest line: */
-		file_header_print(fh[0], f_out, &lp);
+		file_header_print(fh[lt[0]], f_out, &lp);
 		/* read a new line, if possible: */
-		file_header_read_next(fh[0]);
-		/* re-arrange the list: */
-		file_header_list_rearrange_from_header(fh, fnum);
+		file_header_read_next(fh[lt[0]]);
+		/* re-play the winner's matches: */
+		file_header_tree_replay(fh, lt, fnum, lt[0]);
 	}
 
+	sort_free(lt);
 	if (lp.str)
 		bwsfree(lp.str);
 }
@@ -1151,38 +1254,162 @@ merge_files_array(size_t argc, char **argv, const char *fn_out)
 }
 
 /*
- * Shrinks the file list until its size smaller than max number of opened files
+ * Descriptors one merge pass may hold open: a share of the limit, as the
+ * other commands running in this process need some too.
+ */
+static size_t
+merge_fd_budget(void)
+{
+	struct rlimit rl;
+	size_t budget = MERGE_FD_MAX;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+	    rl.rlim_cur / 2 < budget)
+		budget = (size_t) rl.rlim_cur / 2;
+	if (budget < 16)
+		budget = 16;
+	return (budget);
+}
+
+/*
+ * One merge of a pass: argc files into fn_out
+ */
+struct merge_group
+{
+	char		**argv;
+	char		 *fn_out;
+	size_t		  argc;
+};
+
+#if defined(SORT_THREADS)
+struct merge_worker
+{
+	struct merge_group	*groups;
+	size_t			 ngroups;
+	size_t			 first;
+	size_t			 step;
+};
+
+/*
+ * Merge every step-th group of a pass, from first
+ */
+static void *
+merge_group_thread(void *arg)
+{
+	struct merge_worker *mw = arg;
+	size_t i;
+
+	for (i = mw->first; i < mw->ngroups; i += mw->step)
+		merge_files_array(mw->groups[i].argc, mw->groups[i].argv,
+		    mw->groups[i].fn_out);
+
+	return (arg);
+}
+#endif
+
+/*
+ * Run the merges of a pass, up to nworkers at a time
+ */
+static void
+merge_groups(struct merge_group *groups, size_t ngroups, size_t nworkers)
+{
+#if defined(SORT_THREADS)
+	if (nworkers > 1) {
+		struct merge_worker *mw;
+		pthread_t *pth;
+		size_t i;
+
+		mw = sort_malloc(nworkers * sizeof(struct merge_worker));
+		pth = sort_malloc(nworkers * sizeof(pthread_t));
+
+		for (i = 0; i < nworkers; ++i) {
+			mw[i].groups = groups;
+			mw[i].ngroups = ngroups;
+			mw[i].first = i;
+			mw[i].step = nworkers;
+			/* the caller takes the first share itself */
+			if (i == 0)
+				continue;
+			for (;;) {
+				int res = pthread_create(&pth[i], NULL,
+				    merge_group_thread, &mw[i]);
+
+				if (res == 0)
+					break;
+				if (res == EAGAIN) {
+					sched_yield();
+					continue;
+				}
+				errc(2, res, NULL);
+			}
+		}
+
+		merge_group_thread(&mw[0]);
+		for (i = 1; i < nworkers; ++i)
+			pthread_join(pth[i], NULL);
+
+		sort_free(pth);
+		sort_free(mw);
+	} else
+#endif
+	{
+		size_t i;
+
+		for (i = 0; i < ngroups; ++i)
+			merge_files_array(groups[i].argc, groups[i].argv,
+			    groups[i].fn_out);
+	}
+}
+
+/*
+ * Shrinks the file list until its size is at most fanin, merging
+ * groups of files of even size into temporary files.  The groups of a
+ * pass are independent, so they are merged in parallel as far as the
+ * descriptor budget allows.
  */
 static int
-shrink_file_list(struct file_list *fl)
+shrink_file_list(struct file_list *fl, size_t fanin, size_t budget)
 {
 
-	if ((fl == NULL) || (size_t) (fl->count) < max_open_files)
+	if ((fl == NULL) || (size_t) (fl->count) <= fanin)
 		return (0);
 	else {
 		struct file_list new_fl;
-		size_t indx = 0;
-
-		file_list_init(&new_fl, true);
-		while (indx < fl->count) {
-			char *fnew;
-			size_t num;
+		struct merge_group *groups;
+		size_t gsize, i, indx, ngroups, nworkers;
+
+		ngroups = (fl->count + fanin - 1) / fanin;
+		gsize = (fl->count + ngroups - 1) / ngroups;
+
+		groups = sort_malloc(ngroups * sizeof(struct merge_group));
+		for (i = 0, indx = 0; i < ngroups; ++i) {
+			groups[i].argv = fl->fns + indx;
+			groups[i].argc = MIN(gsize, fl->count - indx);
+			groups[i].fn_out = new_tmp_file_name();
+			indx += groups[i].argc;
+		}
 
-			num = fl->count - indx;
-			fnew = new_tmp_file_name();
+		nworkers = 1;
+#if defined(SORT_THREADS)
+		nworkers = MIN(nthreads, ngroups);
+		if (nworkers > budget / (gsize + 1))
+			nworkers = budget / (gsize + 1);
+		if (nworkers < 1)
+			nworkers = 1;
+#endif
+		merge_groups(groups, ngroups, nworkers);
 
-			if ((size_t) num >= max_open_files)
-				num = max_open_files - 1;
-			merge_files_array(num, fl->fns + indx, fnew);
+		file_list_init(&new_fl, true);
+		for (i = 0; i < ngroups; ++i) {
 			if (fl->tmp) {
-				size_t i;
+				size_t j;
 
-				for (i = 0; i < num; i++)
-					unlink(fl->fns[indx + i]);
+				for (j = 0; j < groups[i].argc; j++)
+					ios_scratch_unlink(groups[i].argv[j]);
 			}
-			file_list_add(&new_fl, fnew, false);
-			indx += num;
+			file_list_add(&new_fl, groups[i].fn_out, false);
 		}
+		sort_free(groups);
 		fl->tmp = false; /* already taken care of */
 		file_list_clean(fl);
 
@@ -1196,14 +1423,25 @@ shrink_file_list(struct file_list *fl)
 }
 
 /*
- * Merge list of files
+ * Merge list of files.  Without --batch-size, as many files are merged
+ * at once as the descriptor budget allows, up to MERGE_FANIN_MAX: the
+ * tournament tree makes a wide merge cheap, and every pass saved is a
+ * full read and write of the data.
  */
 void
 merge_files(struct file_list *fl, const char *fn_out)
 {
 
 	if (fl && fn_out) {
-		while (shrink_file_list(fl));
+		size_t budget, fanin;
+
+		budget = merge_fd_budget();
+		if (max_open_files > 1)
+			fanin = max_open_files - 1;
+		else
+			fanin = MIN(budget - 1, MERGE_FANIN_MAX);
+
+		while (shrink_file_list(fl, fanin, budget));
 
 		merge_files_array(fl->count, fl->fns, fn_out);
 	}
@@ -1247,6 +1485,11 @@ sort_list_to_file(struct sort_list *list, const char *outfile)
 		if ((sort_opts_vals.sort_method == SORT_DEFAULT) && byte_sort)
 			sort_opts_vals.sort_method = SORT_RADIXSORT;
 
+	} else if (key_prefix_kind == KP_NUMBER) {
+		/* radix sort on the encoded value, see key_prefix() */
+		if (sort_opts_vals.sort_method == SORT_DEFAULT)
+			sort_opts_vals.sort_method = SORT_RADIXSORT;
+
 	} else if (sort_opts_vals.sort_method == SORT_RADIXSORT)
 		err(2, "%s", getstr(9));
 
@@ -1299,7 +1542,7 @@ sort_list_to_file(struct sort_list *list, const char *outfile)
 
 #if defined(SORT_THREADS)
 /* semaphore to count threads */
-static sem_t mtsem;
+static sort_sem_t mtsem;
 
 /* current system sort function */
 static int (*g_sort_func)(void *, size_t, size_t,
@@ -1316,7 +1559,7 @@ mt_sort_thread(void* arg)
 	g_sort_func(list->list, list->count, sizeof(struct sort_list_item *),
 	    (int(*)(const void *, const void *)) list_coll);
 
-	sem_post(&mtsem);
+	sort_sem_post(&mtsem);
 
 	return (arg);
 }
@@ -1558,7 +1801,7 @@ mt_sort(struct sort_list *list,
 		}
 
 		/* init threads counting semaphore */
-		sem_init(&mtsem, 0, 0);
+		sort_sem_init(&mtsem);
 
 		/* start threads */
 		for (i = 0; i < nthreads; ++i) {
@@ -1566,19 +1809,19 @@ mt_sort(struct sort_list *list,
 			pthread_attr_t attr;
 
 			pthread_attr_init(&attr);
-			pthread_attr_setdetachstate(&attr, PTHREAD_DETACHED);
+			pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
 			for (;;) {
 				int res = pthread_create(&pth, &attr,
 				    mt_sort_thread, parts[i]);
 
-				if (res >= 0)
+				if (res == 0)
 					break;
-				if (errno == EAGAIN) {
-					pthread_yield();
+				if (res == EAGAIN) {
+					sched_yield();
 					continue;
 				}
-				err(2, NULL);
+				errc(2, res, NULL);
 			}
 
 			pthread_attr_destroy(&attr);
@@ -1586,10 +1829,10 @@ mt_sort(struct sort_list *list,
 
 		/* wait for threads completion */
 		for (i = 0; i < nthreads; ++i) {
-			sem_wait(&mtsem);
+			sort_sem_wait(&mtsem);
 		}
 		/* destroy the semaphore - we do not need it anymore */
-		sem_destroy(&mtsem);
+		sort_sem_destroy(&mtsem);
 
 		/* merge sorted sub-lists to the file */
 		merge_list_parts(parts, nthreads, fn);
@@ -52,6 +52,7 @@ struct sort_list
 	size_t			 count;
 	size_t			 size;
 	size_t			 sub_list_pos;
+	struct sort_arena	*arena; /* items and lines read by sort_procfile() */
 };
 
 /*
@@ -85,7 +86,8 @@ extern bool use_mmap;
 extern const char *tmpdir;
 
 /*
- * Max number of simultaneously open files (including the output file).
+ * Max number of simultaneously open files (including the output file),
+ * or 0 to fit the merges to the descriptor limit.
  */
 extern size_t max_open_files;
 
@@ -94,6 +96,11 @@ extern size_t max_open_files;
  */
 extern const char* compress_program;
 
+/*
+ * Compress temporary files with the built-in zlib stream
+ */
+extern bool compress_temp;
+
 /* funcs */
 
 struct file_reader *file_reader_init(const char *fsrc);
@@ -80,3 +80,70 @@ sort_strdup(const char *str)
 		err(2, NULL);
 	return (dup);
 }
+
+#define	SORT_ARENA_CHUNK (1024 * 1024)
+#define	SORT_ARENA_ALIGN (sizeof(long double))
+
+struct sort_arena_chunk
+{
+	struct sort_arena_chunk	*next;
+	size_t			 size;
+	size_t			 used;
+	long double		 data[0];
+};
+
+struct sort_arena
+{
+	struct sort_arena_chunk	*chunks; /* current chunk first */
+};
+
+struct sort_arena *line_arena = NULL;
+
+struct sort_arena *
+sort_arena_create(void)
+{
+	struct sort_arena *arena;
+
+	arena = sort_malloc(sizeof(struct sort_arena));
+	arena->chunks = NULL;
+	return (arena);
+}
+
+void *
+sort_arena_alloc(struct sort_arena *arena, size_t size)
+{
+	struct sort_arena_chunk *chunk;
+	void *ptr;
+
+	size = (size + SORT_ARENA_ALIGN - 1) & ~(SORT_ARENA_ALIGN - 1);
+	chunk = arena->chunks;
+	if ((chunk == NULL) || (chunk->size - chunk->used < size)) {
+		size_t chunk_size = SORT_ARENA_CHUNK;
+
+		/* very long lines get a chunk of their own */
+		if (size > chunk_size)
+			chunk_size = size;
+		chunk = sort_malloc(sizeof(struct sort_arena_chunk) + chunk_size);
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+	ptr = (char *) chunk->data + chunk->used;
+	chunk->used += size;
+	return (ptr);
+}
+
+void
+sort_arena_free(struct sort_arena *arena)
+{
+	struct sort_arena_chunk *chunk, *next;
+
+	if (arena == NULL)
+		return;
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		sort_free(chunk);
+	}
+	sort_free(arena);
+}
@@ -42,4 +42,16 @@ void sort_free(const void *ptr);
 void *sort_realloc(void *, size_t);
 char *sort_strdup(const char *);
 
+/*
+ * Chunked arena for the lines of an in-memory run: everything is freed at once.
+ * While line_arena is set, bwstrings and sort list items are allocated there,
+ * and bwsfree() leaves them alone.
+ */
+struct sort_arena;
+extern struct sort_arena *line_arena;
+
+struct sort_arena *sort_arena_create(void);
+void *sort_arena_alloc(struct sort_arena *, size_t);
+void sort_arena_free(struct sort_arena *);
+
 #endif /* __SORT_MEM_H__ */
@@ -34,6 +34,7 @@ __FBSDID("$FreeBSD: head/usr.bin/sort/radixsort.c 281133 2015-04-06 03:02:20Z pf
 #include <math.h>
 #if defined(SORT_THREADS)
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #endif
 #include <stdlib.h>
@@ -92,7 +93,7 @@ static size_t sort_left;
 static pthread_mutex_t sort_left_mutex;
 
 /* semaphore to count threads */
-static sem_t mtsem;
+static sort_sem_t mtsem;
 
 /*
  * Decrement items counter
@@ -246,6 +247,13 @@ get_wc_index(struct sort_list_item *sli, size_t level)
 {
 	const struct bwstring *bws;
 
+	/* a numeric key is sorted on its 8-byte value, see key_prefix() */
+	if (key_prefix_kind == KP_NUMBER) {
+		if (level < sizeof(sli->prefix))
+			return ((sli->prefix >> (56 - 8 * level)) & 0xff);
+		return (-1);
+	}
+
 	bws = sli->ka.key[0].k;
 
 	if ((BWSLEN(bws) > level))
@@ -386,7 +394,7 @@ run_sort_level_next(struct sort_level *sl)
 	sl->tosort_sz = 0;
 
 	if (sl->leaves_num > 1) {
-		if (keys_num > 1) {
+		if (keys_num > 1 || key_prefix_kind == KP_NUMBER) {
 			if (sort_opts_vals.sflag) {
 				mergesort(sl->leaves, sl->leaves_num,
 				    sizeof(struct sort_list_item *),
@@ -496,7 +504,7 @@ run_sort_cycle_mt(void)
 		slc = pop_ls_mt();
 		if (slc == NULL) {
 			if (have_sort_left()) {
-				pthread_yield();
+				sched_yield();
 				continue;
 			}
 			break;
@@ -514,7 +522,7 @@ sort_thread(void* arg)
 
 	run_sort_cycle_mt();
 
-	sem_post(&mtsem);
+	sort_sem_post(&mtsem);
 
 	return (arg);
 }
@@ -538,7 +546,7 @@ run_top_sort_level(struct sort_level *sl)
 		place_item(sl, i);
 
 	if (sl->leaves_num > 1) {
-		if (keys_num > 1) {
+		if (keys_num > 1 || key_prefix_kind == KP_NUMBER) {
 			if (sort_opts_vals.sflag) {
 				mergesort(sl->leaves, sl->leaves_num,
 				    sizeof(struct sort_list_item *),
@@ -610,25 +618,25 @@ run_top_sort_level(struct sort_level *sl)
 
 			pthread_attr_init(&attr);
 			pthread_attr_setdetachstate(&attr,
-			    PTHREAD_DETACHED);
+			    PTHREAD_CREATE_DETACHED);
 
 			for (;;) {
 				int res = pthread_create(&pth, &attr,
 				    sort_thread, NULL);
-				if (res >= 0)
+				if (res == 0)
 					break;
-				if (errno == EAGAIN) {
-					pthread_yield();
+				if (res == EAGAIN) {
+					sched_yield();
 					continue;
 				}
-				err(2, NULL);
+				errc(2, res, NULL);
 			}
 
 			pthread_attr_destroy(&attr);
 		}
 
 		for(i = 0; i < nthreads; ++i)
-			sem_wait(&mtsem);
+			sort_sem_wait(&mtsem);
 	}
 #endif /* defined(SORT_THREADS) */
 }
@@ -647,14 +655,16 @@ run_sort(struct sort_list_item **base, size_t nmemb)
 		pthread_mutexattr_t mattr;
 
 		pthread_mutexattr_init(&mattr);
+#ifdef PTHREAD_MUTEX_ADAPTIVE_NP
 		pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_ADAPTIVE_NP);
+#endif
 
 		pthread_mutex_init(&g_ls_mutex, &mattr);
 		pthread_mutex_init(&sort_left_mutex, &mattr);
 
 		pthread_mutexattr_destroy(&mattr);
 
-		sem_init(&mtsem, 0, 0);
+		sort_sem_init(&mtsem);
 
 	}
 #endif
@@ -676,7 +686,7 @@ run_sort(struct sort_list_item **base, size_t nmemb)
 
 #if defined(SORT_THREADS)
 	if (nthreads > 1) {
-		sem_destroy(&mtsem);
+		sort_sem_destroy(&mtsem);
 		pthread_mutex_destroy(&g_ls_mutex);
 		pthread_mutex_destroy(&sort_left_mutex);
 	}
@@ -70,7 +70,7 @@ static const char *random_source = DEFAULT_RANDOM_SORT_SEED_FILE;
 static const void *random_seed;
 static size_t random_seed_size;
 
-MD5_CTX md5_ctx;
+uint64_t random_sort_key[2];
 
 /*
  * Default messages to use when NLS is disabled or no catalogue
@@ -98,7 +98,7 @@ const char *nlsstr[] = { "",
 #endif
       "[--human-numeric-sort] "
       "[--version-sort] [--random-sort [--random-source file]] "
-      "[--compress-program program] [file ...]\n" };
+      "[--compress-program program] [--compress-temp] [file ...]\n" };
 
 struct sort_opts sort_opts_vals;
 
@@ -139,6 +139,7 @@ enum
 #endif
 	RANDOMSOURCE_OPT,
 	COMPRESSPROGRAM_OPT,
+	COMPRESSTEMP_OPT,
 	QSORT_OPT,
 	MERGESORT_OPT,
 	HEAPSORT_OPT,
@@ -155,6 +156,7 @@ static struct option long_options[] = {
 				{ "check", optional_argument, NULL, 'c' },
 				{ "check=silent|quiet", optional_argument, NULL, 'C' },
 				{ "compress-program", required_argument, NULL, COMPRESSPROGRAM_OPT },
+				{ "compress-temp", no_argument, NULL, COMPRESSTEMP_OPT },
 				{ "debug", no_argument, NULL, DEBUG_OPT },
 				{ "dictionary-order", no_argument, NULL, 'd' },
 				{ "field-separator", required_argument, NULL, 't' },
@@ -301,7 +303,12 @@ set_hw_params(void)
 #endif
 
 	free_memory = (unsigned long long) pages * (unsigned long long) psize;
+#ifdef __APPLE__
+	/* Going over its memory limit gets the whole app killed. */
+	available_free_memory = ios_memoryBudget();
+#else
 	available_free_memory = free_memory / 2;
+#endif
 
 	if (available_free_memory < 1024)
 		available_free_memory = 1024;
@@ -593,6 +600,7 @@ set_sort_modifier(struct sort_mods *sm, int c)
 		case 'R':
 			sm->Rflag = true;
 			need_random = true;
+			need_hint = true;
 			break;
 		case 'M':
 			initialise_months();
@@ -959,10 +967,13 @@ set_random_seed(void)
 			random_seed_size = strlen(b);
 		}
 
-		MD5Init(&md5_ctx);
-		if(random_seed_size>0) {
-			MD5Update(&md5_ctx, random_seed, random_seed_size);
-		}
+		/* The key for -R hashes: the seed hashed twice, from a zero key */
+		random_sort_key[0] = 0;
+		random_sort_key[1] = 0;
+		random_sort_key[0] = siphash24(random_sort_key, random_seed,
+		    random_seed_size);
+		random_sort_key[1] = siphash24(random_sort_key, random_seed,
+		    random_seed_size);
 	}
 }
 
@@ -1137,6 +1148,9 @@ sort_main(int argc, char **argv)
 			case COMPRESSPROGRAM_OPT:
 				compress_program = strdup(optarg);
 				break;
+			case COMPRESSTEMP_OPT:
+				compress_temp = true;
+				break;
 			case FF_OPT:
 				read_fns_from_file0(optarg);
 				break;
@@ -1217,6 +1231,7 @@ sort_main(int argc, char **argv)
 
 		ks->sm.func = get_sort_func(&(ks->sm));
 	}
+	init_key_prefix();
 
 	if (debug_sort) {
 		printf("Memory to be used for sorting: %llu\n",available_free_memory);
@@ -1262,10 +1277,11 @@ sort_main(int argc, char **argv)
 		}
 	}
 
-#if defined(SORT_THREADS)
-	if ((argc < 1) || (strcmp(outfile, "-") == 0) || (*outfile == 0))
-		nthreads = 1;
-#endif
+	/*
+	 * NH: with ios_system, sort can use its threads when reading stdin or
+	 * writing to stdout too: they are only used for sorting in memory and
+	 * merging, all the input and output happens in the main thread.
+	 */
 
 	if (!sort_opts_vals.cflag && !sort_opts_vals.mflag) {
 		struct file_list fl;
@@ -32,6 +32,7 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sysexits.h>
 #include <wchar.h>
@@ -64,6 +65,27 @@ extern const char *nlsstr[];
 #define	MT_SORT_THRESHOLD (10000)
 extern unsigned int ncpu;
 extern size_t nthreads;
+
+/*
+ * Semaphore counting the sort threads that have finished.
+ * Unnamed POSIX semaphores are not implemented on Darwin (sem_init()
+ * fails with ENOSYS and sem_wait() does not wait), so we use GCD there.
+ */
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+typedef dispatch_semaphore_t sort_sem_t;
+#define	sort_sem_init(s)	(*(s) = dispatch_semaphore_create(0))
+#define	sort_sem_post(s)	dispatch_semaphore_signal(*(s))
+#define	sort_sem_wait(s)	dispatch_semaphore_wait(*(s), DISPATCH_TIME_FOREVER)
+#define	sort_sem_destroy(s)	dispatch_release(*(s))
+#else
+#include <semaphore.h>
+typedef sem_t sort_sem_t;
+#define	sort_sem_init(s)	sem_init((s), 0, 0)
+#define	sort_sem_post(s)	sem_post(s)
+#define	sort_sem_wait(s)	sem_wait(s)
+#define	sort_sem_destroy(s)	sem_destroy(s)
+#endif
 #endif
 
 /*
@@ -72,9 +94,9 @@ extern size_t nthreads;
 extern bool debug_sort;
 
 /*
- * MD5 context for random hash function
+ * SipHash key for random hash function
  */
-extern MD5_CTX md5_ctx;
+extern uint64_t random_sort_key[2];
 
 /*
  * sort.c
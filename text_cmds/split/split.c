@@ -45,6 +45,7 @@ static const char sccsid[] = "@(#)split.c	8.2 (Berkeley) 4/16/94";
 #endif
 
 #include <sys/param.h>
+#include <sys/stat.h>
 
 #include <ctype.h>
 #include <err.h>
@@ -53,6 +54,7 @@ static const char sccsid[] = "@(#)split.c	8.2 (Berkeley) 4/16/94";
 #include <inttypes.h>
 #include <limits.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -62,6 +64,8 @@ static const char sccsid[] = "@(#)split.c	8.2 (Berkeley) 4/16/94";
 #include <sysexits.h>
 
 #define DEFLINE	1000			/* Default num lines per file. */
+#define	SPLIT_MAXTHREADS 8		/* Writers for a regular input file. */
+#define	SPLIT_BUFSIZ	(1024 * 1024)	/* Copy buffer of each writer. */
 
 off_t	 bytecnt;			/* Byte count to split on. */
 long	 numlines;			/* Line count to split on. */
@@ -73,9 +77,27 @@ regex_t	 rgx;
 int	 pflag;
 long	 sufflen = 2;			/* File name suffix length. */
 
+static long fnum;			/* Next output file number. */
+static char *fpnt;			/* Where the suffix goes in fname. */
+
+/* State shared by the writers of split1r(). */
+static struct {
+	pthread_mutex_t	 mtx;
+	off_t		 start;		/* Input offset of the first piece. */
+	off_t		 size;		/* Number of bytes to split. */
+	long		 npieces;
+	long		 next;		/* Next piece to hand out. */
+	int		 error;		/* errno of the first failure. */
+	char		 errname[MAXPATHLEN];
+} sr = { PTHREAD_MUTEX_INITIALIZER };
+
 void newfile(void);
 void split1(void);
 void split2(void);
+static long maxfiles(void);
+static void mkname(char *, long);
+static int split1r(void);
+static void *split1r_worker(void *);
 static void usage(void);
 
 int
@@ -195,6 +217,8 @@ split1(void)
 	char *C;
 	ssize_t dist, len;
 
+	if (split1r())
+		exit(0);
 	for (bcnt = 0;;)
 		switch ((len = read(ifd, bfr, MAXBSIZE))) {
 		case 0:
@@ -232,6 +256,124 @@ split1(void)
 		}
 }
 
+/*
+ * split1r --
+ *	Split a regular input file by bytes.  The pieces are known up
+ *	front, so they are copied by several threads at once with
+ *	pread()/pwrite(), each into its own preallocated output file.
+ *	Return 0, having written nothing, if the input does not qualify.
+ */
+static int
+split1r(void)
+{
+	pthread_t tid[SPLIT_MAXTHREADS];
+	struct stat sb;
+	long i, ncpu, nthreads;
+	int error;
+
+	if (fstat(ifd, &sb) != 0 || !S_ISREG(sb.st_mode) ||
+	    (sr.start = lseek(ifd, 0, SEEK_CUR)) == -1 ||
+	    sb.st_size <= sr.start + bytecnt)
+		return (0);
+	sr.size = sb.st_size - sr.start;
+	sr.npieces = sr.size / bytecnt + (sr.size % bytecnt != 0);
+	/* Leave running out of names to the sequential code. */
+	if (sr.npieces > maxfiles())
+		return (0);
+
+	if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		ncpu = 1;
+	nthreads = MIN(MIN(ncpu, SPLIT_MAXTHREADS), sr.npieces);
+	for (i = 0; i < nthreads; i++)
+		if ((error = pthread_create(&tid[i], NULL, split1r_worker,
+		    NULL)) != 0) {
+			if (i == 0)
+				errc(EX_OSERR, error, "pthread_create");
+			break;
+		}
+	nthreads = i;
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tid[i], NULL);
+
+	if (sr.error != 0)
+		errc(EX_IOERR, sr.error, "%s", sr.errname);
+	(void)lseek(ifd, sb.st_size, SEEK_SET);
+	return (1);
+}
+
+static void *
+split1r_worker(void *arg __unused)
+{
+	char name[MAXPATHLEN];
+	char *buf;
+	off_t len, off, done;
+	ssize_t n;
+	long piece;
+	int fd;
+#ifdef F_PREALLOCATE
+	fstore_t fst;
+#endif
+
+	if ((buf = malloc(SPLIT_BUFSIZ)) == NULL) {
+		pthread_mutex_lock(&sr.mtx);
+		if (sr.error == 0) {
+			sr.error = errno;
+			(void)strlcpy(sr.errname, "malloc",
+			    sizeof(sr.errname));
+		}
+		pthread_mutex_unlock(&sr.mtx);
+		return (NULL);
+	}
+	for (;;) {
+		pthread_mutex_lock(&sr.mtx);
+		piece = sr.error == 0 && sr.next < sr.npieces ? sr.next++ : -1;
+		pthread_mutex_unlock(&sr.mtx);
+		if (piece == -1)
+			break;
+
+		off = (off_t)piece * bytecnt;
+		len = MIN(bytecnt, sr.size - off);
+		off += sr.start;
+		mkname(name, piece);
+		if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC,
+		    DEFFILEMODE)) == -1)
+			goto fail;
+#ifdef F_PREALLOCATE
+		/* Contiguous if possible; this is only a hint. */
+		fst.fst_flags = F_ALLOCATECONTIG;
+		fst.fst_posmode = F_PEOFPOSMODE;
+		fst.fst_offset = 0;
+		fst.fst_length = len;
+		if (fcntl(fd, F_PREALLOCATE, &fst) == -1) {
+			fst.fst_flags = F_ALLOCATEALL;
+			(void)fcntl(fd, F_PREALLOCATE, &fst);
+		}
+#endif
+		for (done = 0; done < len; done += n) {
+			n = pread(ifd, buf, MIN(len - done, SPLIT_BUFSIZ),
+			    off + done);
+			if (n == 0)
+				errno = EIO;	/* File shrank under us. */
+			if (n <= 0 || pwrite(fd, buf, n, done) != n) {
+				(void)close(fd);
+				goto fail;
+			}
+		}
+		if (close(fd) == 0)
+			continue;
+fail:
+		pthread_mutex_lock(&sr.mtx);
+		if (sr.error == 0) {
+			sr.error = errno;
+			(void)strlcpy(sr.errname, name, sizeof(sr.errname));
+		}
+		pthread_mutex_unlock(&sr.mtx);
+		break;
+	}
+	free(buf);
+	return (NULL);
+}
+
 /*
  * split2 --
  *	Split the input by lines.
@@ -291,44 +433,60 @@ writeit:
 void
 newfile(void)
 {
-	long i, maxfiles, tfnum;
-	static long fnum;
-	static int defname;
-	static char *fpnt;
 
-	if (ofd == -1) {
-		if (fname[0] == '\0') {
-			fname[0] = 'x';
-			fpnt = fname + 1;
-			defname = 1;
-		} else {
-			fpnt = fname + strlen(fname);
-			defname = 0;
-		}
+	if (ofd == -1)
 		ofd = fileno(stdout);
-	}
+
+	if (fnum == maxfiles())
+		errx(EX_DATAERR, "too many files");
+
+	mkname(fname, fnum);
+	++fnum;
+	if (!freopen(fname, "w", stdout))
+		err(EX_IOERR, "%s", fname);
+	file_open = 1;
+}
+
+/*
+ * maxfiles --
+ *	Return the number of names sufflen letters allow.
+ */
+static long
+maxfiles(void)
+{
+	long i, maxfiles;
 
 	/* maxfiles = 26^sufflen, but don't use libm. */
 	for (maxfiles = 1, i = 0; i < sufflen; i++)
 		if ((maxfiles *= 26) <= 0)
 			errx(EX_USAGE, "suffix is too long (max %ld)", i);
+	return (maxfiles);
+}
 
-	if (fnum == maxfiles)
-		errx(EX_DATAERR, "too many files");
+/*
+ * mkname --
+ *	Store the name of output file number n in buf, a copy of fname.
+ */
+static void
+mkname(char *buf, long n)
+{
+	long i;
+
+	if (fpnt == NULL) {
+		if (fname[0] == '\0')
+			fname[0] = 'x';
+		fpnt = fname + strlen(fname);
+	}
+	if (buf != fname)
+		memcpy(buf, fname, fpnt - fname);
 
 	/* Generate suffix of sufflen letters */
-	tfnum = fnum;
 	i = sufflen - 1;
 	do {
-		fpnt[i] = tfnum % 26 + 'a';
-		tfnum /= 26;
+		buf[fpnt - fname + i] = n % 26 + 'a';
+		n /= 26;
 	} while (i-- > 0);
-	fpnt[sufflen] = '\0';
-
-	++fnum;
-	if (!freopen(fname, "w", stdout))
-		err(EX_IOERR, "%s", fname);
-	file_open = 1;
+	buf[fpnt - fname + sufflen] = '\0';
 }
 
 static void
@@ -41,6 +41,7 @@
 	} while(0)
 
 #define TAILMAPLEN (4<<20)
+#define TAILBUFLEN (1<<20)
 
 struct mapinfo {
 	off_t	mapoff;
@@ -54,6 +55,8 @@ struct file_info {
 	FILE *fp;
 	char *file_name;
 	struct stat st;
+	int ready;		/* follow: may have new data */
+	int moved;		/* follow: -F saw it deleted or renamed */
 };
 
 typedef struct file_info file_info_t;
@@ -71,6 +74,8 @@ void ierr(void);
 void oerr(void);
 int mapprint(struct mapinfo *, off_t, off_t);
 int maparound(struct mapinfo *, off_t);
+char *rnewline(const char *, size_t);
 
 extern int Fflag, fflag, tail_qflag, rflag, rval, no_files;
+extern pid_t follow_pid;
 extern const char *tail_fname;
@@ -76,6 +76,7 @@ int action = USE_SLEEP;
 int kq;
 
 static const file_info_t *last;
+static __thread char *showbuf;		/* Read buffer for show() */
 
 /*
  * forward -- display the file, from an offset, forward.
@@ -203,117 +204,59 @@ rlines(fp, off, sbp)
 	to distress, and even on local file systems other processes
 	truncating the file can also lead to upset. */
 
-	/* Seek to sbp->st_blksize before the end of the file, find
-	all the newlines.   If there are enough, print the last off
-	lines.  Otherwise go back another sbp->st_blksize bytes,
-	and count newlines.  Avoid re-reading blocks when possible. */
-
-	// +1 because we capture line ends and we want off line _starts_,
-	// +1 because the first line might be partial when try_at != 0
-	off_t search_for = off +2;
-	off_t try_at = sbp->st_size;
-	off_t last_try = sbp->st_size;
-	off_t found_this_pass = 0;
-	off_t found_total = 0;
-	off_t *found_at = calloc(search_for, sizeof(off_t));
-
-	flockfile(fp);
-
-	if (found_at == NULL) {
+	/* Read the file backwards from the end, TAILBUFLEN bytes at a
+	time, until enough newlines have been seen, so that only the
+	tail of a large file is touched.  Then print from the start of
+	the first wanted line to the end. */
+	off_t pos, target;
+	size_t len, scan;
+	ssize_t nr;
+	char *buf, *p;
+	int fd;
+
+	fd = fileno(fp);
+	if ((buf = malloc(TAILBUFLEN)) == NULL) {
 		ierr();
-		goto done;
-	}
-
-	if (off == 0 || sbp->st_size == 0) {
-		goto done;
-	}
-
-	/* The last character is special.  Check to make sure that it is a \n,
-	 * and if not, subtract one from the number of \n we need to search for.
-	 */
-	if (0 != fseeko(fp, sbp->st_size - 1, SEEK_SET)) {
-		ierr();
-		goto done;
-	}
-	if ('\n' != getc_unlocked(fp)) {
-		search_for--;
+		return;
 	}
 
-	while(try_at != 0) {
-		found_this_pass = 0;
-
-		if (try_at < sbp->st_blksize) {
-			found_at[found_this_pass++] = 0;
-			try_at = 0;
-		} else {
-			last_try = try_at;
-			try_at -= sbp->st_blksize;
-		}
-
-		if (0 != fseeko(fp, try_at, SEEK_SET)) {
+	/* The last character is special, ignore whether newline or not. */
+	target = 0;
+	for (pos = sbp->st_size; pos > 0;) {
+		len = MIN(pos, TAILBUFLEN);
+		pos -= len;
+		if (pread(fd, buf, len, pos) != (ssize_t)len) {
 			ierr();
 			goto done;
 		}
-
-		char ch;
-		while(EOF != (ch = getc_unlocked(fp))) {
-			if (ch == '\n') {
-				found_at[found_this_pass++ % search_for] = ftello(fp);
-				found_total++;
-			}
-			if (ftello(fp) == last_try && found_total < search_for) {
-				// We just reached the last block we scanned,
-				// and we know there arn't enough lines found
-				// so far to be happy, so we don't have to
-				// read it again.
-				break;
+		scan = len;
+		if (pos + len == sbp->st_size)
+			scan--;
+		while ((p = rnewline(buf, scan)) != NULL) {
+			if (--off == 0) {
+				target = pos + (p - buf) + 1;
+				goto found;
 			}
+			scan = p - buf;
 		}
-
-		if (found_this_pass >= search_for || try_at == 0) {
-			off_t min = found_at[0];
-			int min_i = 0;
-			int i;
-			int lim = (found_this_pass < search_for) ? found_this_pass : search_for;
-			for(i = 1; i < lim; i++) {
-				if (found_at[i] < min) {
-					min = found_at[i];
-					min_i = i;
-				}
-			}
-
-			off_t target = min;
-
-			if (found_this_pass >= search_for) {
-				// min_i might be a partial line (unless
-				// try_at is 0).   If we  found search_for
-				// lines, min_i+1 is the first known full line
-				// _and_ because we look for an extra line we
-				// don't need to show it.
-				target = found_at[(min_i + 1) % search_for];
-			}
-
-			if (0 != fseeko(fp, target, SEEK_SET)) {
+	}
+found:
+	for (pos = target; pos < sbp->st_size; pos += nr) {
+		len = MIN(sbp->st_size - pos, TAILBUFLEN);
+		if ((nr = pread(fd, buf, len, pos)) <= 0) {
+			if (nr < 0)
 				ierr();
-				goto done;
-			}
-
-			flockfile(thread_stdout);
-			while(EOF != (ch = getc_unlocked(fp))) {
-				if (EOF == putc_unlocked(ch, thread_stdout)) {
-					funlockfile(thread_stdout);
-					oerr();
-					goto done;
-				}
-			}
-			funlockfile(thread_stdout);
-			goto done;
+			break;
 		}
+		if (fwrite(buf, 1, nr, thread_stdout) != (size_t)nr)
+			oerr();
 	}
 
+	/* Set the file pointer to reflect the length displayed. */
+	if (fseeko(fp, pos, SEEK_SET) == -1)
+		ierr();
 done:
-	funlockfile(fp);
-	free(found_at);
+	free(buf);
 	return;
 #else
 	struct mapinfo map;
@@ -362,28 +305,31 @@ done:
 #endif
 }
 
+/*
+ * show -- copy whatever has been appended to the file to standard output.
+ * The caller flushes standard output, once for all the files that changed.
+ */
 static void
 show(file_info_t *file)
 {
-    int ch;
+	size_t nr;
 
-    while ((ch = getc(file->fp)) != EOF) {
-	if (last != file && no_files > 1) {
-		if (!tail_qflag)
-			(void)printf("\n==> %s <==\n", file->file_name);
-		last = file;
+	while ((nr = fread(showbuf, 1, TAILBUFLEN, file->fp)) > 0) {
+		if (last != file && no_files > 1) {
+			if (!tail_qflag)
+				(void)printf("\n==> %s <==\n", file->file_name);
+			last = file;
+		}
+		if (fwrite(showbuf, 1, nr, thread_stdout) != nr)
+			oerr();
 	}
-	if (putchar(ch) == EOF)
-		oerr();
-    }
-    (void)fflush(stdout);
-    if (ferror(file->fp)) {
-	    file->fp = NULL;
-	    tail_fname = file->file_name;
-	    ierr();
-	    tail_fname = NULL;
-    } else
-	    clearerr(file->fp);
+	if (ferror(file->fp)) {
+		file->fp = NULL;
+		tail_fname = file->file_name;
+		ierr();
+		tail_fname = NULL;
+	} else
+		clearerr(file->fp);
 }
 
 static void
@@ -411,11 +357,11 @@ set_events(file_info_t *files)
 		if (Fflag && fileno(file->fp) != STDIN_FILENO) {
 			EV_SET(&ev[n], fileno(file->fp), EVFILT_VNODE,
 			    EV_ADD | EV_ENABLE | EV_CLEAR,
-			    NOTE_DELETE | NOTE_RENAME, 0, 0);
+			    NOTE_DELETE | NOTE_RENAME, 0, file);
 			n++;
 		}
 		EV_SET(&ev[n], fileno(file->fp), EVFILT_READ,
-		    EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, 0);
+		    EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, file);
 		n++;
 	}
 
@@ -431,7 +377,7 @@ set_events(file_info_t *files)
 void
 follow(file_info_t *files, enum STYLE style, off_t off)
 {
-	int active, i, n = -1;
+	int active, i, moved, n = -1, nev;
 	struct stat sb2;
 	file_info_t *file;
 	struct timespec ts;
@@ -442,6 +388,8 @@ follow(file_info_t *files, enum STYLE style, off_t off)
 	active = 0;
 	n = 0;
 	for (i = 0; i < no_files; i++, file++) {
+		file->ready = 1;
+		file->moved = 0;
 		if (file->fp) {
 			active = 1;
 			n++;
@@ -462,21 +410,33 @@ follow(file_info_t *files, enum STYLE style, off_t off)
 	kq = kqueue();
 	if (kq < 0)
 		err(1, "kqueue");
-	ev = malloc(n * sizeof(struct kevent));
+	nev = n;
+	ev = malloc(nev * sizeof(struct kevent));
 	if (! ev)
 	    err(1, "Couldn't allocate memory for kevents.");
+	if ((showbuf = malloc(TAILBUFLEN)) == NULL)
+		err(1, "malloc");
 	set_events(files);
 
+	/*
+	 * Only the files kqueue reported are read, and what they had is
+	 * written out with a single flush.  kevent() only needs a timeout
+	 * while -F is waiting for a moved file to be recreated, and to check
+	 * whether the -p process is still running.
+	 */
 	for (;;) {
+		moved = 0;
 		for (i = 0, file = files; i < no_files; i++, file++) {
 			if (! file->fp)
 				continue;
-			if (Fflag && file->fp && fileno(file->fp) != STDIN_FILENO) {
+			if (file->moved) {
 				if (stat(file->file_name, &sb2) == 0 &&
 				    (sb2.st_ino != file->st.st_ino ||
 				     sb2.st_dev != file->st.st_dev ||
 				     sb2.st_nlink == 0)) {
 					show(file);
+					file->moved = 0;
+					file->ready = 1;
 					file->fp = freopen(file->file_name, "r", file->fp);
 					if (file->fp == NULL) {
 						ierr();
@@ -485,37 +445,61 @@ follow(file_info_t *files, enum STYLE style, off_t off)
 						memcpy(&file->st, &sb2, sizeof(struct stat));
 						set_events(files);
 					}
-				}
+				} else
+					moved = 1;
+			}
+			if (file->ready) {
+				show(file);
+				file->ready = 0;
 			}
-			show(file);
+		}
+		(void)fflush(thread_stdout);
+
+		if (follow_pid != 0 && ios_getThreadId(follow_pid) == 0) {
+			/* Pick up anything written just before it exited. */
+			for (i = 0, file = files; i < no_files; i++, file++)
+				if (file->fp)
+					show(file);
+			(void)fflush(thread_stdout);
+			break;
 		}
 
 		switch (action) {
 		case USE_KQUEUE:
 			ts.tv_sec = 1;
 			ts.tv_nsec = 0;
-			/*
-			 * In the -F case we set a timeout to ensure that
-			 * we re-stat the file at least once every second.
-			 */
-			n = kevent(kq, NULL, 0, ev, 1, Fflag ? &ts : NULL);
+			n = kevent(kq, NULL, 0, ev, nev,
+			    (moved || follow_pid != 0) ? &ts : NULL);
 			if (n < 0)
 				err(1, "kevent");
-			if (n == 0) {
-				/* timeout */
-				break;
-			} else if (ev->filter == EVFILT_READ && ev->data < 0) {
-				 /* file shrank, reposition to end */
-				if (lseek(ev->ident, (off_t)0, SEEK_END) == -1) {
-					ierr();
-					continue;
+			for (i = 0; i < n; i++) {
+				file = ev[i].udata;
+				if (ev[i].filter == EVFILT_VNODE)
+					file->moved = 1;
+				else if (ev[i].filter == EVFILT_READ &&
+				    ev[i].data < 0 && file->fp != NULL) {
+					/* file shrank, reposition to end */
+					if (fseeko(file->fp, (off_t)0, SEEK_END) == -1)
+						ierr();
 				}
+				file->ready = 1;
 			}
 			break;
 
 		case USE_SLEEP:
 			(void) usleep(250000);
+			for (i = 0, file = files; i < no_files; i++, file++) {
+				file->ready = 1;
+				if (Fflag && file->fp &&
+				    fileno(file->fp) != STDIN_FILENO)
+					file->moved = 1;
+			}
 			break;
 		}
 	}
+	free(showbuf);
+	showbuf = NULL;
+	free(ev);
+	ev = NULL;
+	close(kq);
 }
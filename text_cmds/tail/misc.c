@@ -48,6 +48,8 @@ static const char sccsid[] = "@(#)misc.c	8.1 (Berkeley) 6/6/93";
 
 #include <err.h>
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -118,3 +120,32 @@ maparound(struct mapinfo *mip, off_t offset)
 
 	return (0);
 }
+
+/*
+ * Return a pointer to the last newline in the `len' bytes at `p', or NULL.
+ * Scans a word at a time once aligned, since the lines being skipped over
+ * from the end of the file can be many megabytes.
+ */
+char *
+rnewline(const char *p, size_t len)
+{
+	const char *e;
+	uintptr_t w;
+
+#define	ONES	((uintptr_t)-1 / 0xff)
+#define	HIGHS	(ONES << 7)
+	for (e = p + len; e > p && ((uintptr_t)e & (sizeof(w) - 1)); )
+		if (*--e == '\n')
+			return ((char *)e);
+	for (; e - p >= (ptrdiff_t)sizeof(w); e -= sizeof(w)) {
+		w = *(const uintptr_t *)(e - sizeof(w)) ^ (ONES * '\n');
+		if ((w - ONES) & ~w & HIGHS)
+			break;
+	}
+	while (e > p)
+		if (*--e == '\n')
+			return ((char *)e);
+	return (NULL);
+#undef	ONES
+#undef	HIGHS
+}
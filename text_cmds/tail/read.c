@@ -69,17 +69,18 @@ static const char sccsid[] = "@(#)read.c	8.1 (Berkeley) 6/6/93";
 int
 bytes(FILE *fp, off_t off)
 {
-	int ch, len, tlen;
+	int len, tlen;
 	char *ep, *p, *t;
 	int wrap;
 	char *sp;
+	size_t nr;
 
 	if ((sp = p = malloc(off)) == NULL)
 		err(1, "malloc");
 
-	for (wrap = 0, ep = p + off; (ch = getc(fp)) != EOF;) {
-		*p = ch;
-		if (++p == ep) {
+	/* Read straight into the wrap-around buffer. */
+	for (wrap = 0, ep = p + off; (nr = fread(p, 1, ep - p, fp)) > 0;) {
+		if ((p += nr) == ep) {
 			wrap = 1;
 			p = sp;
 		}
@@ -143,35 +144,40 @@ lines(FILE *fp, off_t off)
 		int blen;
 		u_int len;
 		char *l;
-	} *llines;
-	int ch, rc;
-	char *p, *sp;
-	int blen, cnt, recno, wrap;
+	} *llines, *lp;
+	int rc;
+	char *buf, *bp, *be, *nl;
+	int cnt, len, recno, wrap;
+	size_t nr;
 
 	if ((llines = malloc(off * sizeof(*llines))) == NULL)
 		err(1, "malloc");
 	bzero(llines, off * sizeof(*llines));
-	sp = NULL;
-	blen = cnt = recno = wrap = 0;
+	if ((buf = malloc(TAILBUFLEN)) == NULL)
+		err(1, "malloc");
+	cnt = recno = wrap = 0;
 	rc = 0;
 
-	while ((ch = getc(fp)) != EOF) {
-		if (++cnt > blen) {
-			if ((sp = realloc(sp, blen += 1024)) == NULL)
-				err(1, "realloc");
-			p = sp + cnt - 1;
-		}
-		*p++ = ch;
-		if (ch == '\n') {
-			if ((int)llines[recno].blen < cnt) {
-				llines[recno].blen = cnt + 256;
-				if ((llines[recno].l = realloc(llines[recno].l,
-				    llines[recno].blen)) == NULL)
+	/*
+	 * Read in blocks and copy each line straight into its slot; cnt is
+	 * the length of the line being built in llines[recno].
+	 */
+	while ((nr = fread(buf, 1, TAILBUFLEN, fp)) > 0) {
+		for (bp = buf, be = buf + nr; bp < be; bp += len) {
+			nl = memchr(bp, '\n', be - bp);
+			len = (nl != NULL ? nl + 1 : be) - bp;
+			lp = &llines[recno];
+			if (lp->blen < cnt + len) {
+				lp->blen = cnt + len + 256;
+				if ((lp->l = realloc(lp->l, lp->blen)) == NULL)
 					err(1, "realloc");
 			}
-			bcopy(sp, llines[recno].l, llines[recno].len = cnt);
+			memcpy(lp->l + cnt, bp, len);
+			cnt += len;
+			if (nl == NULL)
+				continue;
+			lp->len = cnt;
 			cnt = 0;
-			p = sp;
 			if (++recno == off) {
 				wrap = 1;
 				recno = 0;
@@ -184,8 +190,6 @@ lines(FILE *fp, off_t off)
 		goto done;
 	}
 	if (cnt) {
-		llines[recno].l = sp;
-		sp = NULL;
 		llines[recno].len = cnt;
 		if (++recno == off) {
 			wrap = 1;
@@ -209,7 +213,7 @@ lines(FILE *fp, off_t off)
 done:
 	for (cnt = 0; cnt < off; cnt++)
 		free(llines[cnt].l);
-	free(sp);
+	free(buf);
 	free(llines);
 	return (rc);
 }
@@ -114,6 +114,7 @@ r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 {
 	struct mapinfo map;
 	off_t curoff, size, lineend;
+	char *p;
 	int i;
 
 	if (!(size = sbp->st_size))
@@ -137,11 +138,16 @@ r_reg(FILE *fp, enum STYLE style, off_t off, struct stat *sbp)
 				return;
 			}
 		}
-		for (i = curoff - map.mapoff; i >= 0; i--) {
-			if (style == RBYTES && --off == 0)
-				break;
-			if (map.start[i] == '\n')
-				break;
+		if (style == RBYTES) {
+			for (i = curoff - map.mapoff; i >= 0; i--) {
+				if (--off == 0)
+					break;
+				if (map.start[i] == '\n')
+					break;
+			}
+		} else {
+			p = rnewline(map.start, curoff - map.mapoff + 1);
+			i = p != NULL ? p - map.start : -1;
 		}
 		/* `i' is either the map offset of a '\n', or -1. */
 		curoff = map.mapoff + i;
@@ -194,7 +200,7 @@ static void
 r_buf(FILE *fp)
 {
 	BF *mark, *tl, *tr;
-	int ch, len, llen;
+	int len, llen;
 	char *p;
 	off_t enomem;
 
@@ -222,9 +228,7 @@ r_buf(FILE *fp)
 		}
 
 		/* Fill the block with input data. */
-		for (p = tl->l, len = 0;
-		    len < BSZ && (ch = getc(fp)) != EOF; ++len)
-			*p++ = ch;
+		len = fread(tl->l, 1, BSZ, fp);
 
 		if (ferror(fp)) {
 			ierr();
@@ -242,7 +246,7 @@ r_buf(FILE *fp)
 		}
 
 		tl->len = len;
-		if (ch == EOF)
+		if (len < BSZ)
 			break;
 	}
 
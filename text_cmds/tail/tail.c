@@ -53,6 +53,7 @@ static const char sccsid[] = "@(#)tail.c	8.1 (Berkeley) 6/6/93";
 
 #include <err.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -62,6 +63,7 @@ static const char sccsid[] = "@(#)tail.c	8.1 (Berkeley) 6/6/93";
 #include "ios_error.h"
 
 int Fflag, fflag, tail_qflag, rflag, rval, no_files;
+pid_t follow_pid;			/* -p: stop following when it exits */
 const char *tail_fname;
 
 file_info_t *files;
@@ -79,11 +81,13 @@ tail_main(int argc, char *argv[])
 	int i, ch, first;
 	file_info_t *file;
 	char *p;
+	long l;
 
     Fflag = 0;
     fflag = 0;
     tail_qflag = 0;
     rflag = 0;
+    follow_pid = 0;
     rval = 0;
     no_files = 0;
     
@@ -122,7 +126,7 @@ tail_main(int argc, char *argv[])
 
 	obsolete(argv);
 	style = NOTSET;
-	while ((ch = getopt(argc, argv, "Fb:c:fn:qr")) != -1)
+	while ((ch = getopt(argc, argv, "Fb:c:fn:p:qr")) != -1)
 		switch(ch) {
 		case 'F':	/* -F is superset of (and implies) -f */
 			Fflag = fflag = 1;
@@ -139,6 +143,12 @@ tail_main(int argc, char *argv[])
 		case 'n':
 			ARG(1, FLINES, RLINES);
 			break;
+		case 'p':
+			l = strtol(optarg, &p, 10);
+			if (*p || l <= 0 || l > INT_MAX)
+				errx(1, "illegal process id -- %s", optarg);
+			follow_pid = l;
+			break;
 		case 'q':
 			tail_qflag = 1;
 			break;
@@ -186,8 +196,9 @@ tail_main(int argc, char *argv[])
 		 * Determine if input is a pipe.  4.4BSD will set the SOCKET
 		 * bit in the st_mode field for pipes.  Fix this then.
 		 */
-		if (lseek(fileno(thread_stdin), (off_t)0, SEEK_CUR) == -1 &&
-		    errno == ESPIPE) {
+		if (fileno(thread_stdin) < 0 ||
+		    (lseek(fileno(thread_stdin), (off_t)0, SEEK_CUR) == -1 &&
+		    errno == ESPIPE)) {
 			errno = 0;
 			fflag = 0;		/* POSIX.2 requires this. */
 		}
@@ -246,7 +257,14 @@ tail_main(int argc, char *argv[])
 	} else {
 		tail_fname = "stdin";
 
-		if (fstat(fileno(thread_stdin), &sb)) {
+		/*
+		 * tail < file takes the regular file paths (seek, read
+		 * from the end); an in-process pipe has no descriptor.
+		 */
+		if (fileno(thread_stdin) < 0) {
+			memset(&sb, 0, sizeof(sb));
+			sb.st_mode = S_IFIFO;
+		} else if (fstat(fileno(thread_stdin), &sb)) {
 			ierr();
 			exit(1);
 		}
@@ -351,7 +369,7 @@ static void
 usage(void)
 {
 	(void)fprintf(thread_stderr,
-	    "usage: tail [-F | -f | -r] [-q] [-b # | -c # | -n #]"
+	    "usage: tail [-F | -f | -r] [-q] [-p pid] [-b # | -c # | -n #]"
 	    " [file ...]\n");
 	exit(1);
 }
@@ -189,6 +189,23 @@ cset_invert(struct cset *cs)
 	cs->cs_havecache = false;
 }
 
+/*
+ * cset_max --
+ *	Return the largest character added to the set, or -1 if none were.
+ *	Classes and inversion are not taken into account.
+ */
+wchar_t
+cset_max(struct cset *cs)
+{
+	struct csnode *t;
+
+	if ((t = cs->cs_root) == NULL)
+		return (-1);
+	while (t->csn_right != NULL)
+		t = t->csn_right;
+	return (t->csn_max);
+}
+
 /*
  * cset_addclass --
  *	Add a wctype()-style character class to the set, optionally
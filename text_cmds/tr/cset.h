@@ -59,6 +59,7 @@ bool			cset_addclass(struct cset *, wctype_t, bool);
 struct cset *		cset_alloc(void);
 bool 			cset_add(struct cset *, wchar_t);
 void			cset_invert(struct cset *);
+wchar_t			cset_max(struct cset *);
 bool			cset_in_hard(struct cset *, wchar_t);
 void			cset_cache(struct cset *);
 
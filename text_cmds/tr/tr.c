@@ -50,6 +50,7 @@ static const char sccsid[] = "@(#)tr.c	8.2 (Berkeley) 5/4/95";
 #include <ctype.h>
 #include <err.h>
 #include <limits.h>
+#include <langinfo.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -68,6 +69,22 @@ static const char sccsid[] = "@(#)tr.c	8.2 (Berkeley) 5/4/95";
 STR s1 = { STRING1, NORMAL, 0, OOBCH, 0, { 0, OOBCH }, NULL, NULL };
 STR s2 = { STRING2, NORMAL, 0, OOBCH, 0, { 0, OOBCH }, NULL, NULL };
 
+/*
+ * Byte translation table, used instead of the wide character loop when
+ * every character the sets can touch is a single byte.  xlate holds the
+ * output byte for each input byte, or -1 to delete it; squeeze marks the
+ * output bytes that belong to the squeeze set.
+ */
+struct bytetab {
+	int		xlate[NCHARS_SB];
+	bool		squeeze[NCHARS_SB];
+};
+
+#define	TR_BUFSIZ	(64 * 1024)
+
+static bool bytetab_setup(struct bytetab *, struct cmap *, struct cset *,
+		struct cset *, int);
+static void bytetab_run(struct bytetab *, int);
 static struct cset *setup(char *, STR *, int, int);
 static void usage(void);
 
@@ -133,6 +150,7 @@ tr_main(int argc, char **argv)
 	int n, *p;
 	int Cflag, cflag, dflag, sflag, isstring2;
 	wint_t ch, cnt, lastch;
+	struct bytetab bt;
     
     // iOS: reinitialize parameters:
     initSTR(&s1); initSTR(&s2); s2.which = STRING2;
@@ -193,12 +211,15 @@ tr_main(int argc, char **argv)
 		delete = setup(argv[0], &s1, cflag, Cflag);
 		squeeze = setup(argv[1], &s2, 0, 0);
 
-		for (lastch = OOBCH; (ch = getwchar()) != WEOF;)
-			if (!cset_in(delete, ch) &&
-			    (lastch != ch || !cset_in(squeeze, ch))) {
-				lastch = ch;
-                (void)putwc(ch, thread_stdout); // (void)putwchar(ch);
-			}
+		if (bytetab_setup(&bt, NULL, delete, squeeze, 0))
+			bytetab_run(&bt, 1);
+		else
+			for (lastch = OOBCH; (ch = getwchar()) != WEOF;)
+				if (!cset_in(delete, ch) &&
+				    (lastch != ch || !cset_in(squeeze, ch))) {
+					lastch = ch;
+                    (void)putwc(ch, thread_stdout); // (void)putwchar(ch);
+				}
         if (ferror(thread_stdin)) {
             cset_free(delete);
             cset_free(squeeze);
@@ -219,9 +240,12 @@ tr_main(int argc, char **argv)
 
 		delete = setup(argv[0], &s1, cflag, Cflag);
 
-		while ((ch = getwchar()) != WEOF)
-			if (!cset_in(delete, ch))
-				(void)putwc(ch, thread_stdout); // (void)putwchar(ch);
+		if (bytetab_setup(&bt, NULL, delete, NULL, 0))
+			bytetab_run(&bt, 0);
+		else
+			while ((ch = getwchar()) != WEOF)
+				if (!cset_in(delete, ch))
+					(void)putwc(ch, thread_stdout); // (void)putwchar(ch);
         if (ferror(thread_stdin)) {
             cset_free(delete);
             err(1, NULL);
@@ -237,11 +261,14 @@ tr_main(int argc, char **argv)
 	if (sflag && !isstring2) {
 		squeeze = setup(argv[0], &s1, cflag, Cflag);
 
-		for (lastch = OOBCH; (ch = getwchar()) != WEOF;)
-			if (lastch != ch || !cset_in(squeeze, ch)) {
-				lastch = ch;
-				(void)putwc(ch, thread_stdout); // (void)putwchar(ch);
-			}
+		if (bytetab_setup(&bt, NULL, NULL, squeeze, 0))
+			bytetab_run(&bt, 1);
+		else
+			for (lastch = OOBCH; (ch = getwchar()) != WEOF;)
+				if (lastch != ch || !cset_in(squeeze, ch)) {
+					lastch = ch;
+					(void)putwc(ch, thread_stdout); // (void)putwchar(ch);
+				}
         if (ferror(thread_stdin)) {
             cset_free(squeeze);
 			err(1, NULL);
@@ -393,7 +420,9 @@ endloop:
 	cset_cache(squeeze);
 	cmap_cache(map);
 
-	if (sflag)
+	if (bytetab_setup(&bt, map, NULL, sflag ? squeeze : NULL, Cflag))
+		bytetab_run(&bt, sflag);
+	else if (sflag)
 		for (lastch = OOBCH; (ch = getwchar()) != WEOF;) {
 			if (!Cflag || iswrune(ch))
 				ch = cmap_lookup(map, ch);
@@ -417,6 +446,100 @@ endloop:
 	// exit (0);
 }
 
+/*
+ * A set is byte-sized if it can only hold ASCII characters, which are the
+ * only single-byte characters of UTF-8.
+ */
+static bool
+cset_ascii(struct cset *cs)
+{
+
+	return (cs == NULL || (!cs->cs_invert && cs->cs_classes == NULL &&
+	    cset_max(cs) < 0x80));
+}
+
+/*
+ * Fill in the byte table for the given map and sets, any of which may be
+ * NULL.  Return false if some byte cannot be handled on its own.  In a
+ * UTF-8 locale the sets must leave non-ASCII characters alone, so that
+ * the bytes encoding them can be copied through unchanged.
+ */
+static bool
+bytetab_setup(struct bytetab *bt, struct cmap *map, struct cset *delete,
+    struct cset *squeeze, int Cflag)
+{
+	wint_t wc, to;
+	int c, utf8;
+
+	utf8 = 0;
+	if (MB_CUR_MAX > 1) {
+		if (strcmp(nl_langinfo(CODESET), "UTF-8") != 0)
+			return (false);
+		if (!cset_ascii(delete) || !cset_ascii(squeeze))
+			return (false);
+		if (map != NULL && (map->cm_def != CM_DEF_SELF ||
+		    (map->cm_root != NULL && cmap_max(map) >= 0x80)))
+			return (false);
+		utf8 = 1;
+	}
+	for (c = 0; c < NCHARS_SB; c++) {
+		bt->squeeze[c] = false;
+		if (utf8 && c >= 0x80) {
+			bt->xlate[c] = c;
+			continue;
+		}
+		if ((wc = btowc(c)) == WEOF)
+			return (false);
+		if (squeeze != NULL)
+			bt->squeeze[c] = cset_in(squeeze, wc);
+		if (delete != NULL && cset_in(delete, wc)) {
+			bt->xlate[c] = -1;
+			continue;
+		}
+		to = wc;
+		if (map != NULL && (!Cflag || iswrune(wc)))
+			to = cmap_lookup(map, wc);
+		if (to == OOBCH || (bt->xlate[c] = wctob(to)) == EOF)
+			return (false);
+	}
+	return (true);
+}
+
+/*
+ * Copy standard input to standard output through the byte table, a block
+ * at a time.
+ */
+static void
+bytetab_run(struct bytetab *bt, int sflag)
+{
+	unsigned char *ibuf, *obuf, *op;
+	size_t i, n;
+	int c, lastc;
+
+	if ((ibuf = malloc(TR_BUFSIZ)) == NULL ||
+	    (obuf = malloc(TR_BUFSIZ)) == NULL)
+		err(1, NULL);
+	lastc = OOBCH;
+	while ((n = fread(ibuf, 1, TR_BUFSIZ, thread_stdin)) > 0) {
+		op = obuf;
+		for (i = 0; i < n; i++) {
+			if ((c = bt->xlate[ibuf[i]]) < 0)
+				continue;
+			if (sflag) {
+				if (c == lastc && bt->squeeze[c])
+					continue;
+				lastc = c;
+			}
+			*op++ = c;
+		}
+		if (op > obuf && fwrite(obuf, 1, op - obuf, thread_stdout) !=
+		    (size_t)(op - obuf))
+			err(1, "stdout");
+	}
+	free(ibuf);
+	free(obuf);
+}
+
 static struct cset *
 setup(char *arg, STR *str, int cflag, int Cflag)
 {
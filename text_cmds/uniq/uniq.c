@@ -51,6 +51,7 @@ static const char rcsid[] =
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <getopt.h>
 #include <limits.h>
 #include <locale.h>
 #include <nl_types.h>
@@ -63,12 +64,33 @@ static const char rcsid[] =
 #include <wchar.h>
 #include <wctype.h>
 #include "ios_error.h"
+#include "../common/linebuf.h"
 
-static int cflag, dflag, uflag, iflag;
+static int cflag, dflag, uflag, iflag, Hflag;
 static long numchars, numfields;
 static int repeats;
 
+static const struct option long_opts[] =
+{
+	{"unsorted",	no_argument,		NULL, 'H'},
+	{NULL,		no_argument,		NULL, 0}
+};
+
+/*
+ * -H: a distinct line, in the order of first appearance.
+ */
+struct uline {
+	char	*ul_key;		/* Comparison key */
+	size_t	 ul_keylen;
+	int	 ul_wide;		/* Key is a wchar_t string */
+	size_t	 ul_hash;
+	char	*ul_line;		/* First occurrence, unless streaming */
+	int	 ul_count;
+};
+
 static FILE	*file(const char *, const char *);
+static void	 hashed(struct linebuf *, FILE *, const char *);
+static void	 keep(char **, size_t *, const char *, size_t);
 static wchar_t	*convert(const char *);
 static int	 inlcmp(const char *, const char *);
 static void	 show(FILE *, const char *);
@@ -93,9 +115,10 @@ uniq_main (int argc, char *argv[])
 	wchar_t *tprev, *tthis;
 	FILE *ifp, *ofp;
 	int ch, comp;
-	size_t prevbuflen, thisbuflen, b1;
+	size_t prevbuflen, prevlen, len;
 	char *prevline, *thisline, *p;
 	const char *ifn;
+	struct linebuf lb;
 #ifndef __APPLE__
 	cap_rights_t rights;
 #endif
@@ -104,6 +127,7 @@ uniq_main (int argc, char *argv[])
     dflag = 0;
     uflag = 0;
     iflag = 0;
+    Hflag = 0;
     numchars = 0;
     numfields = 0;
     repeats = 0;
@@ -111,7 +135,8 @@ uniq_main (int argc, char *argv[])
 	(void) setlocale(LC_ALL, "");
 
 	obsolete(argv);
-	while ((ch = getopt(argc, argv, "cdif:s:u")) != -1)
+	while ((ch = getopt_long(argc, argv, "cdHif:s:u", long_opts,
+	    NULL)) != -1)
 		switch (ch) {
 		case 'c':
 			cflag = 1;
@@ -119,6 +144,9 @@ uniq_main (int argc, char *argv[])
 		case 'd':
 			dflag = 1;
 			break;
+		case 'H':
+			Hflag = 1;
+			break;
 		case 'i':
 			iflag = 1;
 			break;
@@ -192,21 +220,34 @@ uniq_main (int argc, char *argv[])
 	strerror_init();
 #endif
 
-	prevbuflen = thisbuflen = 0;
-	prevline = thisline = NULL;
+	linebuf_init(&lb, ifp);
+	if (Hflag) {
+		hashed(&lb, ofp, ifn);
+		exit(0);
+	}
 
-	if (getline(&prevline, &prevbuflen, ifp) < 0) {
+	prevbuflen = 0;
+	prevline = NULL;
+
+	if ((thisline = linebuf_get(&lb, &len)) == NULL) {
 		if (ferror(ifp))
 			err(1, "%s", ifn);
 		exit(0);
 	}
+	keep(&prevline, &prevbuflen, thisline, prevlen = len);
 	tprev = convert(prevline);
 
 	if (!cflag && uflag && dflag)
 		show(ofp, prevline);
 
 	tthis = NULL;
-	while (getline(&thisline, &thisbuflen, ifp) >= 0) {
+	while ((thisline = linebuf_get(&lb, &len)) != NULL) {
+		/* Identical bytes compare equal whatever the locale. */
+		if (len == prevlen && !numfields && !numchars && !iflag &&
+		    memcmp(thisline, prevline, len) == 0) {
+			++repeats;
+			continue;
+		}
 		if (tthis != NULL)
 			free(tthis);
 		tthis = convert(thisline);
@@ -222,17 +263,12 @@ uniq_main (int argc, char *argv[])
 			/* If different, print; set previous to new value. */
 			if (cflag || !dflag || !uflag)
 				show(ofp, prevline);
-			p = prevline;
-			b1 = prevbuflen;
-			prevline = thisline;
-			prevbuflen = thisbuflen;
+			keep(&prevline, &prevbuflen, thisline, prevlen = len);
 			if (tprev != NULL)
 				free(tprev);
 			tprev = tthis;
 			if (!cflag && uflag && dflag)
 				show(ofp, prevline);
-			thisline = p;
-			thisbuflen = b1;
 			tthis = NULL;
 			repeats = 0;
 		} else
@@ -245,6 +281,125 @@ uniq_main (int argc, char *argv[])
 	exit(0);
 }
 
+/*
+ * Copy a line, and its NUL, into a buffer of its own.
+ */
+static void
+keep(char **bufp, size_t *sizep, const char *line, size_t len)
+{
+
+	if (*sizep <= len) {
+		*sizep = len + 1 > 128 ? len + 1 : 128;
+		if ((*bufp = realloc(*bufp, *sizep)) == NULL)
+			err(1, "realloc");
+	}
+	memcpy(*bufp, line, len + 1);
+}
+
+/*
+ * hashed --
+ *	Remember every distinct line, so that the input need not be sorted.
+ *	Lines are compared after -f, -s and -i as in the sorted case, but
+ *	exactly rather than with wcscoll().  Without -c, -d or -u each line
+ *	is printed when first seen; otherwise the lines are printed at the
+ *	end, in the order they first appeared.
+ */
+static void
+hashed(struct linebuf *lb, FILE *ofp, const char *ifn)
+{
+	struct uline *ul, *ulines;
+	size_t *table, hash, i, key, keylen, len, mask, nlines, nalloc;
+	char *line, *k;
+	wchar_t *w;
+	int stream;
+
+	stream = !cflag && dflag && uflag;
+	nlines = nalloc = 0;
+	ulines = NULL;
+	mask = 1024 - 1;
+	if ((table = calloc(mask + 1, sizeof(*table))) == NULL)
+		err(1, "calloc");
+
+	while ((line = linebuf_get(lb, &len)) != NULL) {
+		if ((w = convert(line)) != NULL) {
+			k = (char *)w;
+			keylen = wcslen(w) * sizeof(*w);
+		} else {
+			/* Not valid in this locale: compare the bytes. */
+			if (len > 0 && line[len - 1] == '\n')
+				len--;
+			if ((k = malloc(len + 1)) == NULL)
+				err(1, "malloc");
+			memcpy(k, line, len);
+			k[len] = '\0';
+			keylen = len;
+		}
+		for (hash = 2166136261u, i = 0; i < keylen; i++)
+			hash = (hash ^ (unsigned char)k[i]) * 16777619;
+
+		for (i = hash & mask; (key = table[i]) != 0;
+		    i = (i + 1) & mask) {
+			ul = &ulines[key - 1];
+			if (ul->ul_hash == hash && ul->ul_keylen == keylen &&
+			    ul->ul_wide == (w != NULL) &&
+			    memcmp(ul->ul_key, k, keylen) == 0)
+				break;
+		}
+		if (key != 0) {
+			ulines[key - 1].ul_count++;
+			free(k);
+			continue;
+		}
+
+		if (nlines == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 1024;
+			if ((ulines = realloc(ulines,
+			    nalloc * sizeof(*ulines))) == NULL)
+				err(1, "realloc");
+		}
+		ul = &ulines[nlines];
+		ul->ul_key = k;
+		ul->ul_keylen = keylen;
+		ul->ul_wide = w != NULL;
+		ul->ul_hash = hash;
+		ul->ul_count = 1;
+		ul->ul_line = NULL;
+		if (stream)
+			show(ofp, line);
+		else if ((ul->ul_line = strdup(line)) == NULL)
+			err(1, "strdup");
+		table[i] = ++nlines;
+
+		/* Keep the table at most half full. */
+		if (nlines * 2 > mask) {
+			free(table);
+			mask = mask * 2 + 1;
+			if ((table = calloc(mask + 1, sizeof(*table))) == NULL)
+				err(1, "calloc");
+			for (key = 0; key < nlines; key++) {
+				for (i = ulines[key].ul_hash & mask;
+				    table[i] != 0; i = (i + 1) & mask)
+					;
+				table[i] = key + 1;
+			}
+		}
+	}
+	if (ferror(lb->lb_fp))
+		err(1, "%s", ifn);
+
+	for (key = 0; key < nlines; key++) {
+		ul = &ulines[key];
+		if (!stream) {
+			repeats = ul->ul_count - 1;
+			show(ofp, ul->ul_line);
+			free(ul->ul_line);
+		}
+		free(ul->ul_key);
+	}
+	free(ulines);
+	free(table);
+}
+
 static wchar_t *
 convert(const char *str)
 {
@@ -371,6 +526,6 @@ static void
 usage(void)
 {
 	(void)fprintf(thread_stderr,
-"usage: uniq [-c | -d | -u] [-i] [-f fields] [-s chars] [input [output]]\n");
+"usage: uniq [-c | -d | -u] [-H] [-i] [-f fields] [-s chars] [input [output]]\n");
 	exit(1);
 }
@@ -49,6 +49,7 @@ static const char sccsid[] = "@(#)vis.c	8.1 (Berkeley) 6/6/93";
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <vis.h>
 #include <sysexits.h>
@@ -58,8 +59,21 @@ static const char sccsid[] = "@(#)vis.c	8.1 (Berkeley) 6/6/93";
 int eflags, fold, foldwidth=80, none, markeol, debug;
 
 void process(FILE *);
+static void process_tbl(FILE *);
+static void mktbl(void);
 static void usage(void);
 
+/*
+ * Without folding each input byte has a fixed encoding, so it is looked
+ * up rather than worked out by vis(3) every time.  A byte whose encoding
+ * depends on the byte after it (\0 before a digit, with -c) is marked
+ * and still goes through vis().
+ */
+#define	VIS_BUFSIZ	(64 * 1024)
+static char	enc[256][5];
+static u_char	enclen[256];
+static char	encdep[256];
+
 int
 main(int argc, char *argv[])
 {
@@ -126,6 +140,79 @@ main(int argc, char *argv[])
 	exit(0);
 }
 
+static void
+mktbl(void)
+{
+	static const int nexts[] = { '\0', '0', '7', '8', 'a', ' ', '\n',
+	    '\\', 0x80, 0xff, EOF };
+	char alt[5];
+	int c, i;
+
+	for (c = 0; c < 256; c++) {
+		if (none) {
+			enc[c][0] = c;
+			enc[c][1] = c == '\\' ? '\\' : '\0';
+			enc[c][2] = '\0';
+		} else if (markeol && c == '\n') {
+			i = 0;
+			if ((eflags & VIS_NOSLASH) == 0)
+				enc[c][i++] = '\\';
+			enc[c][i++] = '$';
+			enc[c][i++] = '\n';
+			enc[c][i] = '\0';
+		} else {
+			(void) vis(enc[c], (char)c, eflags, (char)nexts[0]);
+			for (i = 1; i < (int)(sizeof(nexts) / sizeof(nexts[0]));
+			    i++) {
+				(void) vis(alt, (char)c, eflags, (char)nexts[i]);
+				if (strcmp(alt, enc[c]) != 0)
+					encdep[c] = 1;
+			}
+		}
+		/* A NUL byte shown as itself still takes one byte. */
+		enclen[c] = enc[c][0] == '\0' ? 1 : strlen(enc[c]);
+	}
+}
+
+/*
+ * process() for unfolded output: encode a block at a time.
+ */
+static void
+process_tbl(FILE *fp)
+{
+	static u_char *ibuf;
+	static char *obuf;
+	char *op;
+	size_t i, n;
+	int c, next;
+
+	if (ibuf == NULL) {
+		if ((ibuf = malloc(VIS_BUFSIZ)) == NULL ||
+		    (obuf = malloc(VIS_BUFSIZ * 4 + 1)) == NULL)
+			err(1, NULL);
+		mktbl();
+	}
+	while ((n = fread(ibuf, 1, VIS_BUFSIZ, fp)) > 0) {
+		for (op = obuf, i = 0; i < n; i++) {
+			c = ibuf[i];
+			if (!encdep[c]) {
+				memcpy(op, enc[c], enclen[c]);
+				op += enclen[c];
+				continue;
+			}
+			if (i + 1 < n)
+				next = ibuf[i + 1];
+			else if ((next = getc(fp)) != EOF)
+				(void) ungetc(next, fp);
+			op = vis(op, (char)c, eflags, (char)next);
+		}
+		if (fwrite(obuf, 1, op - obuf, stdout) != (size_t)(op - obuf))
+			err(EX_IOERR, "stdout");
+	}
+	if (ferror(fp))
+		errx(EX_IOERR, NULL);
+}
+
 
 static void
 usage(void)
@@ -147,6 +234,10 @@ process(FILE *fp)
 	int c, rachar;
 	char buff[5];
 
+	if (!fold) {
+		process_tbl(fp);
+		return;
+	}
 	c = getc(fp);
 	while (c != EOF) {
 		rachar = getc(fp);
@@ -62,6 +62,9 @@ __FBSDID("$FreeBSD: src/usr.bin/wc/wc.c,v 1.21 2004/12/27 22:27:56 josef Exp $")
 #include <unistd.h>
 #include <wchar.h>
 #include <wctype.h>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "ios_error.h"
 
 /* We allocte this much memory statically, and use it as a fallback for
@@ -73,6 +76,7 @@ static uintmax_t tlinect, twordct, tcharct;
 static int doline, doword, dochar, domulti;
 
 static int	cnt(const char *);
+static uintmax_t count_newlines(const u_char *, size_t);
 static void	usage(void);
 
 int
@@ -151,8 +155,10 @@ cnt(const char *file)
 	int fd, len, warned;
 	int stat_ret;
 	size_t clen;
-	short gotsp;
+	short gotsp, mbpartial;
+	u_char asciisp[0x80];
 	u_char *p;
+	off_t start = 0;
 	static u_char small_buf[SMALL_BUF_SIZE];
 	static u_char *buf = small_buf;
 	static off_t buf_size = SMALL_BUF_SIZE;
@@ -163,6 +169,14 @@ cnt(const char *file)
 	if (file == NULL) {
 		file = "stdin";
 		fd = fileno(thread_stdin);
+		/*
+		 * The descriptor is read directly: start where the stream
+		 * is, some of it may have been read already.
+		 */
+		if ((start = ftello(thread_stdin)) > 0)
+			(void)lseek(fd, start, SEEK_SET);
+		else
+			start = 0;
 	} else {
 		if ((fd = open(file, O_RDONLY, 0)) < 0) {
             warn("%s: open", file);
@@ -200,13 +214,11 @@ cnt(const char *file)
 				return (1);
 			}
 			charct += len;
-			for (p = buf; len--; ++p)
-                if (*p == '\n')
-					++linect;
+			linect += count_newlines(buf, len);
 		}
 		tlinect += linect;
 		(void)fprintf(thread_stdout, " %7ju", linect);
-		if (dochar) {
+		if (dochar || domulti) {
 			tcharct += charct;
 			(void)fprintf(thread_stdout, " %7ju", charct);
 		}
@@ -223,7 +235,8 @@ cnt(const char *file)
 			(void)close(fd);
 			return (1);
 		}
-		if (S_ISREG(sb.st_mode)) {
+		if (S_ISREG(sb.st_mode) && sb.st_size >= start) {
+			sb.st_size -= start;
 			(void)fprintf(thread_stdout, " %7lld", (long long)sb.st_size);
 			tcharct += sb.st_size;
 			(void)close(fd);
@@ -234,7 +247,10 @@ cnt(const char *file)
 	/* Do it the hard way... */
 word:	gotsp = 1;
 	warned = 0;
+	mbpartial = 0;
 	memset(&mbs, 0, sizeof(mbs));
+	for (clen = 0; clen < sizeof(asciisp); clen++)
+		asciisp[clen] = iswspace((wint_t)clen) != 0;
 	while ((len = read(fd, buf, buf_size)) != 0) {
 		if (len == -1) {
             warn("%s: read", file);
@@ -243,6 +259,23 @@ word:	gotsp = 1;
 		}
 		p = buf;
 		while (len > 0) {
+			/*
+			 * ASCII outside of a multibyte sequence needs neither
+			 * mbrtowc() nor iswspace().
+			 */
+			if (*p < 0x80 && !mbpartial) {
+				charct++;
+				len--;
+				if (*p == '\n')
+					++linect;
+				if (asciisp[*p++])
+					gotsp = 1;
+				else if (gotsp) {
+					gotsp = 0;
+					++wordct;
+				}
+				continue;
+			}
 			if (!domulti || MB_CUR_MAX == 1) {
 				clen = 1;
 				wch = (unsigned char)*p;
@@ -256,10 +289,13 @@ word:	gotsp = 1;
 				memset(&mbs, 0, sizeof(mbs));
 				clen = 1;
 				wch = (unsigned char)*p;
-			} else if (clen == (size_t)-2)
+			} else if (clen == (size_t)-2) {
+				/* The sequence goes on in the next buffer */
+				mbpartial = 1;
 				break;
-			else if (clen == 0)
+			} else if (clen == 0)
 				clen = 1;
+			mbpartial = 0;
 			charct++;
 			len -= clen;
 			p += clen;
@@ -292,6 +328,47 @@ word:	gotsp = 1;
 	return (0);
 }
 
+/*
+ * Counts the newlines in a buffer: 16 bytes at a time with NEON,
+ * otherwise 8 at a time in a 64-bit word.
+ */
+static uintmax_t
+count_newlines(const u_char *p, size_t len)
+{
+	uintmax_t n = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+	const uint8x16_t nl = vdupq_n_u8('\n');
+	uint8x16_t acc;
+	size_t i, blocks;
+
+	while (len >= 16) {
+		/* Each lane counts up to 255 newlines before spilling */
+		blocks = MIN(len / 16, 255);
+		acc = vdupq_n_u8(0);
+		for (i = 0; i < blocks; i++, p += 16)
+			acc = vsubq_u8(acc, vceqq_u8(vld1q_u8(p), nl));
+		n += vaddlvq_u8(acc);
+		len -= blocks * 16;
+	}
+#else
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t high = 0x8080808080808080ULL;
+	uint64_t w;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&w, p, sizeof(w));
+		/* The high bit is set in each byte that is not a newline */
+		w ^= ones * '\n';
+		w = ((w & ~high) + ~high) | w;
+		n += __builtin_popcountll(~w & high);
+	}
+#endif
+	for (; len > 0; len--)
+		if (*p++ == '\n')
+			n++;
+	return (n);
+}
+
 static void
 usage()
 {